@@ -37,21 +37,57 @@
  *     1       1.1.13   ATTRD_OP_UPDATE (with F_ATTR_REGEX), ATTRD_OP_QUERY
  *     1       1.1.15   ATTRD_OP_UPDATE_BOTH, ATTRD_OP_UPDATE_DELAY
  *     2       1.1.17   ATTRD_OP_CLEAR_FAILURE
+ *     3       2.0.1    ATTRD_OP_SYNC_SUMMARY, ATTRD_OP_SYNC_PULL
+ *     4       2.0.1    ATTRD_OP_UPDATE_BATCH
+ *     5       2.0.1    F_ATTRD_IS_METRIC, F_ATTRD_THRESHOLDS
+ *     6       2.0.1    ATTRD_OP_QUERY with F_ATTRD_REGEX or multiple names
  */
-#define ATTRD_PROTOCOL_VERSION "2"
+#define ATTRD_PROTOCOL_VERSION "6"
+
+// The first protocol versions that support particular requests
+#define ATTRD_SYNC_SUMMARY_VERSION 3
+#define ATTRD_UPDATE_BATCH_VERSION 4
 
 int last_cib_op_done = 0;
 char *peer_writer = NULL;
 GHashTable *attributes = NULL;
 
+/*
+ * CIB write batching
+ *
+ * When many attributes change at once (fail counts and last-failure times
+ * during a failure storm, for example), writing each in its own CIB update
+ * means a CIB transaction, and a status section diff sent to every node, per
+ * attribute. Instead, the changes of all attributes written within
+ * WRITE_BATCH_MS of the first are collected into one update. Each attribute
+ * still gets its own result (via attrd_cib_callback()), so one that fails is
+ * retried as before. Only attributes written as the same user can share an
+ * update, since the user is checked against the ACLs for the whole update.
+ */
+
+#define WRITE_BATCH_MS 50
+
+static xmlNode *write_batch = NULL;         // status section being collected
+static GList *write_batch_attrs = NULL;     // IDs of attributes in write_batch
+static char *write_batch_user = NULL;
+static enum cib_call_options write_batch_flags = cib_none;
+static int write_batch_changes = 0;
+static mainloop_timer_t *write_batch_timer = NULL;
+
+static void write_batch_flush(void);
+static void attrd_attribute_written(int call_id, int rc, const char *name);
+
 void write_attribute(attribute_t *a);
 void write_or_elect_attribute(attribute_t *a);
 void attrd_current_only_attribute_update(crm_node_t *peer, xmlNode *xml);
 void attrd_peer_update(crm_node_t *peer, xmlNode *xml, const char *host, bool filter);
 void attrd_peer_sync(crm_node_t *peer, xmlNode *xml);
+void attrd_peer_sync_summary(crm_node_t *peer, xmlNode *xml, bool is_writer);
+void attrd_peer_sync_pull(crm_node_t *peer, xmlNode *xml);
 void attrd_peer_remove(const char *host, gboolean uncache, const char *source);
+static void prepare_client_update(xmlNode *xml);
 
-static gboolean
+gboolean
 send_attrd_message(crm_node_t * node, xmlNode * data)
 {
     crm_xml_add(data, F_TYPE, T_ATTRD);
@@ -61,6 +97,51 @@ send_attrd_message(crm_node_t * node, xmlNode * data)
     return send_cluster_message(node, crm_msg_attrd, data, TRUE);
 }
 
+// Whether a node's protocol attribute value is at least a given version
+static bool
+node_protocol_at_least(attribute_t *protocol, const char *node, int version)
+{
+    attribute_value_t *v = NULL;
+
+    if ((protocol == NULL) || (node == NULL)) {
+        return FALSE;
+    }
+    v = g_hash_table_lookup(protocol->values, node);
+    return (v != NULL) && (crm_parse_int(v->current, "0") >= version);
+}
+
+/*!
+ * \internal
+ * \brief Check whether peers support a given protocol version
+ *
+ * \param[in] peer     Peer to check (or NULL for all active peers)
+ * \param[in] version  Protocol version required
+ *
+ * \return TRUE if the peer (or every active cluster peer) is known to
+ *         support \p version, otherwise FALSE
+ */
+static bool
+peers_support_protocol(crm_node_t *peer, int version)
+{
+    attribute_t *protocol = g_hash_table_lookup(attributes, CRM_ATTR_PROTOCOL);
+    GHashTableIter iter;
+    crm_node_t *node = NULL;
+
+    if (peer != NULL) {
+        return node_protocol_at_least(protocol, peer->uname, version);
+    }
+
+    g_hash_table_iter_init(&iter, crm_peer_cache);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &node)) {
+        if (safe_str_eq(node->state, CRM_NODE_MEMBER)
+            && safe_str_neq(node->uname, attrd_cluster->uname)
+            && !node_protocol_at_least(protocol, node->uname, version)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
 static gboolean
 attribute_timer_cb(gpointer data)
 {
@@ -90,6 +171,7 @@ free_attribute(gpointer data)
         free(a->set);
         free(a->uuid);
         free(a->user);
+        free(a->thresholds);
 
         mainloop_timer_del(a->timer);
         g_hash_table_destroy(a->values);
@@ -99,21 +181,21 @@ free_attribute(gpointer data)
 }
 
 static xmlNode *
-build_attribute_xml(
-    xmlNode *parent, const char *name, const char *set, const char *uuid, unsigned int timeout_ms, const char *user,
-    gboolean is_private, const char *peer, uint32_t peerid, const char *value)
+build_attribute_xml(xmlNode *parent, attribute_t *a, const char *peer,
+                    uint32_t peerid, const char *value)
 {
     xmlNode *xml = create_xml_node(parent, __FUNCTION__);
 
-    crm_xml_add(xml, F_ATTRD_ATTRIBUTE, name);
-    crm_xml_add(xml, F_ATTRD_SET, set);
-    crm_xml_add(xml, F_ATTRD_KEY, uuid);
-    crm_xml_add(xml, F_ATTRD_USER, user);
+    crm_xml_add(xml, F_ATTRD_ATTRIBUTE, a->id);
+    crm_xml_add(xml, F_ATTRD_SET, a->set);
+    crm_xml_add(xml, F_ATTRD_KEY, a->uuid);
+    crm_xml_add(xml, F_ATTRD_USER, a->user);
     crm_xml_add(xml, F_ATTRD_HOST, peer);
     crm_xml_add_int(xml, F_ATTRD_HOST_ID, peerid);
     crm_xml_add(xml, F_ATTRD_VALUE, value);
-    crm_xml_add_int(xml, F_ATTRD_DAMPEN, timeout_ms/1000);
-    crm_xml_add_int(xml, F_ATTRD_IS_PRIVATE, is_private);
+    crm_xml_add_int(xml, F_ATTRD_DAMPEN, a->timeout_ms/1000);
+    crm_xml_add_int(xml, F_ATTRD_IS_PRIVATE, a->is_private);
+    attrd_metric_add_xml(xml, a);
 
     return xml;
 }
@@ -136,6 +218,221 @@ clear_attribute_value_seen(void)
     }
 }
 
+/*
+ * Attribute name indexes
+ *
+ * Updates by regular expression (most often, clearing a resource's failures)
+ * would otherwise check every attribute name. Since attributes are never
+ * removed from the attributes table (only their values are), two indexes of
+ * attribute IDs are simply added to as attributes are created: a sorted
+ * sequence, so a regular expression with a literal prefix need check only
+ * names with that prefix, and a table of each resource's fail count and last
+ * failure attributes, so clearing a resource's failures checks only those.
+ */
+
+static GSequence *attribute_names = NULL;   // attribute IDs in sorted order
+static GHashTable *failure_attributes = NULL; // resource -> list of IDs
+
+static gint
+compare_names(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    return strcmp((const char *) a, (const char *) b);
+}
+
+// Get the resource name from a failure-related attribute name (if it is one)
+static char *
+failure_attribute_rsc(const char *name)
+{
+    const char *rsc = NULL;
+    size_t len = 0;
+
+    if (crm_starts_with(name, CRM_FAIL_COUNT_PREFIX "-")) {
+        rsc = name + strlen(CRM_FAIL_COUNT_PREFIX "-");
+    } else if (crm_starts_with(name, CRM_LAST_FAILURE_PREFIX "-")) {
+        rsc = name + strlen(CRM_LAST_FAILURE_PREFIX "-");
+    } else {
+        return NULL;
+    }
+    len = strcspn(rsc, "#");
+    return (len > 0)? strndup(rsc, len) : NULL;
+}
+
+static void
+index_attribute(const char *id)
+{
+    char *rsc = failure_attribute_rsc(id);
+
+    if (attribute_names == NULL) {
+        attribute_names = g_sequence_new(NULL);
+        failure_attributes = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                   free, (GDestroyNotify) g_list_free);
+    }
+    g_sequence_insert_sorted(attribute_names, (gpointer) id, compare_names,
+                             NULL);
+
+    if (rsc != NULL) {
+        GList *ids = g_hash_table_lookup(failure_attributes, rsc);
+
+        if (ids == NULL) {
+            g_hash_table_insert(failure_attributes, rsc,
+                                g_list_prepend(NULL, (gpointer) id));
+        } else {
+            // The list head doesn't change, so the table entry stays valid
+            ids = g_list_insert(ids, (gpointer) id, 1);
+            free(rsc);
+        }
+    }
+}
+
+void
+attrd_free_attribute_index(void)
+{
+    if (attribute_names != NULL) {
+        g_sequence_free(attribute_names);
+        attribute_names = NULL;
+        g_hash_table_destroy(failure_attributes);
+        failure_attributes = NULL;
+    }
+}
+
+/*!
+ * \internal
+ * \brief Get the literal prefix that all matches of a regular expression have
+ *
+ * \param[in] pattern  Extended regular expression
+ *
+ * \return Newly allocated prefix (or NULL if no prefix is certain)
+ */
+static char *
+regex_literal_prefix(const char *pattern)
+{
+    const char *c = NULL;
+    int depth = 0;
+    size_t len = 0;
+
+    if ((pattern == NULL) || (pattern[0] != '^')) {
+        return NULL;
+    }
+
+    // Alternation at the top level could match anything
+    for (c = pattern; *c != '\0'; c++) {
+        if (*c == '\\') {
+            if (*++c == '\0') {
+                break;
+            }
+        } else if (*c == '[') {
+            c += strcspn(c + 1, "]") + 1;
+            if (*c == '\0') {
+                break;
+            }
+        } else if (*c == '(') {
+            depth++;
+        } else if (*c == ')') {
+            depth--;
+        } else if ((*c == '|') && (depth == 0)) {
+            return NULL;
+        }
+    }
+
+    len = strcspn(pattern + 1, ".[]()*+?{}|^$\\");
+    // A quantifier applies to the character before it
+    if ((len > 0) && (strchr("*?{", pattern[1 + len]) != NULL)
+        && (pattern[1 + len] != '\0')) {
+        len--;
+    }
+    return (len > 0)? strndup(pattern + 1, len) : NULL;
+}
+
+/*!
+ * \internal
+ * \brief Get the names of all attributes matching a regular expression
+ *
+ * \param[in] pattern  Extended regular expression to match
+ *
+ * \return List of matching attribute IDs (caller must free the list, but not
+ *         the IDs), or NULL if none match or \p pattern is invalid
+ */
+static GList *
+attributes_matching(const char *pattern)
+{
+    const regex_t *regex = attrd_regex(pattern);
+    char *prefix = NULL;
+    size_t prefix_len = 0;
+    GSequenceIter *iter = NULL;
+    GList *matches = NULL;
+
+    if (regex == NULL) {
+        crm_err("Bad regex '%s'", pattern);
+        return NULL;
+    } else if (attribute_names == NULL) {
+        return NULL;
+    }
+
+    prefix = regex_literal_prefix(pattern);
+    if (prefix == NULL) {
+        iter = g_sequence_get_begin_iter(attribute_names);
+    } else {
+        prefix_len = strlen(prefix);
+        iter = g_sequence_search(attribute_names, prefix, compare_names, NULL);
+    }
+
+    for (; !g_sequence_iter_is_end(iter); iter = g_sequence_iter_next(iter)) {
+        const char *id = g_sequence_get(iter);
+
+        if ((prefix != NULL) && (strncmp(id, prefix, prefix_len) != 0)) {
+            break;
+        }
+        if (regexec(regex, id, 0, NULL, 0) == 0) {
+            matches = g_list_prepend(matches, (gpointer) id);
+        }
+    }
+    free(prefix);
+    return matches;
+}
+
+/*!
+ * \internal
+ * \brief Get the names of failure-related attributes to clear
+ *
+ * \param[in] rsc    Resource to clear (or NULL for all)
+ * \param[in] op     Operation to clear if rsc is specified (or NULL for all)
+ * \param[in] interval_ms  Interval of operation to clear if op is specified
+ *
+ * \return List of matching attribute IDs (caller must free the list, but not
+ *         the IDs)
+ */
+static GList *
+failure_attributes_matching(const char *rsc, const char *op, guint interval_ms)
+{
+    char *pattern = attrd_failure_pattern(rsc, op, interval_ms);
+    const regex_t *regex = attrd_regex(pattern);
+    GList *matches = NULL;
+    GHashTableIter iter;
+    GList *ids = NULL;
+
+    if ((regex == NULL) || (failure_attributes == NULL)) {
+        free(pattern);
+        return NULL;
+    }
+    crm_trace("Clearing attributes matching %s", pattern);
+
+    if (rsc != NULL) {
+        ids = g_hash_table_lookup(failure_attributes, rsc);
+        for (GList *id = ids; id != NULL; id = id->next) {
+            if (regexec(regex, id->data, 0, NULL, 0) == 0) {
+                matches = g_list_prepend(matches, id->data);
+            }
+        }
+    } else {
+        g_hash_table_iter_init(&iter, failure_attributes);
+        while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &ids)) {
+            matches = g_list_concat(g_list_copy(ids), matches);
+        }
+    }
+    free(pattern);
+    return matches;
+}
+
 static attribute_t *
 create_attribute(xmlNode *xml)
 {
@@ -149,6 +446,7 @@ create_attribute(xmlNode *xml)
     a->values = g_hash_table_new_full(crm_strcase_hash, crm_strcase_equal, NULL, free_attribute_value);
 
     crm_element_value_int(xml, F_ATTRD_IS_PRIVATE, &a->is_private);
+    attrd_metric_update(a, xml, TRUE);
 
 #if ENABLE_ACL
     crm_trace("Performing all %s operations as user '%s'", a->id, a->user);
@@ -164,12 +462,16 @@ create_attribute(xmlNode *xml)
 
     if(dampen > 0) {
         a->timeout_ms = dampen;
-        a->timer = mainloop_timer_add(a->id, a->timeout_ms, FALSE, attribute_timer_cb, a);
+        if (!a->is_metric) {
+            a->timer = mainloop_timer_add(a->id, a->timeout_ms, FALSE,
+                                          attribute_timer_cb, a);
+        }
     } else if (dampen < 0) {
 	crm_warn("Ignoring invalid delay %s for attribute %s", value, a->id);
     }
 
     g_hash_table_replace(attributes, a->id, a);
+    index_attribute(a->id);
     return a;
 }
 
@@ -231,45 +533,121 @@ attrd_client_peer_remove(const char *client_name, xmlNode *xml)
 void
 attrd_client_update(xmlNode *xml)
 {
-    attribute_t *a = NULL;
-    char *host = crm_element_value_copy(xml, F_ATTRD_HOST);
     const char *attr = crm_element_value(xml, F_ATTRD_ATTRIBUTE);
     const char *value = crm_element_value(xml, F_ATTRD_VALUE);
     const char *regex = crm_element_value(xml, F_ATTRD_REGEX);
 
     /* If a regex was specified, broadcast a message for each match */
     if ((attr == NULL) && regex) {
-        GHashTableIter aIter;
-        regex_t *r_patt = calloc(1, sizeof(regex_t));
+        GList *matches = NULL;
 
         crm_debug("Setting %s to %s", regex, value);
-        if (regcomp(r_patt, regex, REG_EXTENDED|REG_NOSUB)) {
-            crm_err("Bad regex '%s' for update", regex);
-
+        if (crm_is_true(crm_element_value(xml, F_ATTRD_CLEAR_FAILURE))) {
+            // Only the failure attributes of the named resource can match
+            const char *rsc = crm_element_value(xml, F_ATTRD_RESOURCE);
+            const char *op = crm_element_value(xml, F_ATTRD_OPERATION);
+            const char *interval_spec = crm_element_value(xml, F_ATTRD_INTERVAL);
+
+            matches = failure_attributes_matching(rsc, op,
+                                                  crm_parse_interval_spec(interval_spec));
+            xml_remove_prop(xml, F_ATTRD_CLEAR_FAILURE);
         } else {
-            g_hash_table_iter_init(&aIter, attributes);
-            while (g_hash_table_iter_next(&aIter, (gpointer *) & attr, NULL)) {
-                int status = regexec(r_patt, attr, 0, NULL, 0);
-
-                if (status == 0) {
-                    crm_trace("Matched %s with %s", attr, regex);
-                    crm_xml_add(xml, F_ATTRD_ATTRIBUTE, attr);
-                    send_attrd_message(NULL, xml);
-                }
-            }
+            matches = attributes_matching(regex);
         }
 
-        free(host);
-        regfree(r_patt);
-        free(r_patt);
+        for (GList *iter = matches; iter != NULL; iter = iter->next) {
+            crm_trace("Matched %s with %s", (const char *) iter->data, regex);
+            crm_xml_add(xml, F_ATTRD_ATTRIBUTE, iter->data);
+            send_attrd_message(NULL, xml);
+        }
+        g_list_free(matches);
         return;
 
     } else if (attr == NULL) {
         crm_err("Update request did not specify attribute or regular expression");
-        free(host);
         return;
     }
 
+    prepare_client_update(xml);
+    if (attrd_metric_hold(xml)) {
+        return;
+    }
+    send_attrd_message(NULL, xml); /* ends up at attrd_peer_message() */
+}
+
+/*!
+ * \internal
+ * \brief Respond to a client request to update many attributes at once
+ *
+ * \param[in] xml  Root of request XML, with an update request as each child
+ *
+ * \note If all peers support it, the updates (apart from any that use a
+ *       regular expression) are broadcast in a single message.
+ */
+void
+attrd_client_update_batch(xmlNode *xml)
+{
+    xmlNode *batch = NULL;
+    int n_updates = 0;
+#if ENABLE_ACL
+    const char *user = crm_element_value(xml, F_ATTRD_USER);
+#endif
+
+    if (peers_support_protocol(NULL, ATTRD_UPDATE_BATCH_VERSION)) {
+        batch = create_xml_node(NULL, __FUNCTION__);
+        crm_xml_add(batch, F_ATTRD_TASK, ATTRD_OP_UPDATE_BATCH);
+    }
+
+    for (xmlNode *child = __xml_first_child_element(xml); child != NULL;
+         child = __xml_next_element(child)) {
+        const char *task = crm_element_value(child, F_ATTRD_TASK);
+
+        if (safe_str_neq(task, ATTRD_OP_UPDATE)
+            && safe_str_neq(task, ATTRD_OP_UPDATE_BOTH)
+            && safe_str_neq(task, ATTRD_OP_UPDATE_DELAY)) {
+            crm_warn("Ignoring %s request in client update batch",
+                     crm_str(task));
+            continue;
+        }
+
+#if ENABLE_ACL
+        // Updates are checked as the client, whatever the children say
+        xml_remove_prop(child, F_ATTRD_USER);
+        crm_xml_add(child, F_ATTRD_USER, user);
+#endif
+
+        if ((batch == NULL)
+            || (crm_element_value(child, F_ATTRD_ATTRIBUTE) == NULL)) {
+            attrd_client_update(child);
+
+        } else {
+            prepare_client_update(child);
+            add_node_copy(batch, child);
+            n_updates++;
+        }
+    }
+
+    if (n_updates > 0) {
+        crm_debug("Broadcasting batch of %d attribute updates", n_updates);
+        send_attrd_message(NULL, batch); /* ends up at attrd_peer_message() */
+    }
+    free_xml(batch);
+}
+
+/*!
+ * \internal
+ * \brief Prepare a client update of a named attribute to be broadcast
+ *
+ * \param[in,out] xml  Update request XML (with F_ATTRD_ATTRIBUTE)
+ */
+static void
+prepare_client_update(xmlNode *xml)
+{
+    attribute_t *a = NULL;
+    char *host = crm_element_value_copy(xml, F_ATTRD_HOST);
+    const char *attr = crm_element_value(xml, F_ATTRD_ATTRIBUTE);
+    const char *value = crm_element_value(xml, F_ATTRD_VALUE);
+
     if (host == NULL) {
         crm_trace("Inferring host");
         host = strdup(attrd_cluster->uname);
@@ -307,8 +685,6 @@ attrd_client_update(xmlNode *xml)
               ((election_state(writer) == election_won)? " (writer)" : ""));
 
     free(host);
-
-    send_attrd_message(NULL, xml); /* ends up at attrd_peer_message() */
 }
 
 /*!
@@ -336,31 +712,19 @@ attrd_client_clear_failure(xmlNode *xml)
     const char *rsc = crm_element_value(xml, F_ATTRD_RESOURCE);
     const char *op = crm_element_value(xml, F_ATTRD_OPERATION);
     const char *interval_spec = crm_element_value(xml, F_ATTRD_INTERVAL);
+    char *pattern = NULL;
 
     /* Map this to an update */
     crm_xml_add(xml, F_ATTRD_TASK, ATTRD_OP_UPDATE);
 
     /* Add regular expression matching desired attributes */
+    pattern = attrd_failure_pattern(rsc, op,
+                                    crm_parse_interval_spec(interval_spec));
+    crm_xml_add(xml, F_ATTRD_REGEX, pattern);
+    free(pattern);
 
-    if (rsc) {
-        char *pattern;
-
-        if (op == NULL) {
-            pattern = crm_strdup_printf(ATTRD_RE_CLEAR_ONE, rsc);
-
-        } else {
-            guint interval_ms = crm_parse_interval_spec(interval_spec);
-
-            pattern = crm_strdup_printf(ATTRD_RE_CLEAR_OP,
-                                        rsc, op, interval_ms);
-        }
-
-        crm_xml_add(xml, F_ATTRD_REGEX, pattern);
-        free(pattern);
-
-    } else {
-        crm_xml_add(xml, F_ATTRD_REGEX, ATTRD_RE_CLEAR_ALL);
-    }
+    // Let attrd_client_update() use the failure index to find matches
+    crm_xml_add(xml, F_ATTRD_CLEAR_FAILURE, XML_BOOLEAN_TRUE);
 
     /* Make sure attribute and value are not set, so we delete via regex */
     if (crm_element_value(xml, F_ATTRD_ATTRIBUTE)) {
@@ -397,20 +761,73 @@ attrd_client_refresh(void)
     write_attributes(TRUE);
 }
 
+/*!
+ * \internal
+ * \brief Add an attribute's value(s) to a client query reply
+ *
+ * \param[in,out] reply  Query reply to add to
+ * \param[in]     a      Attribute to add
+ * \param[in]     host   Name of requested host (or NULL for all hosts)
+ *
+ * \return TRUE on success, FALSE if XML could not be created
+ */
+static bool
+add_query_values(xmlNode *reply, attribute_t *a, const char *host)
+{
+    attribute_value_t *v = NULL;
+    xmlNode *host_value = NULL;
+
+    /* If a specific node was requested, add its value */
+    if (host) {
+        v = g_hash_table_lookup(a->values, host);
+        host_value = create_xml_node(reply, XML_CIB_TAG_NODE);
+        if (host_value == NULL) {
+            return FALSE;
+        }
+        crm_xml_add(host_value, F_ATTRD_ATTRIBUTE, a->id);
+        crm_xml_add(host_value, F_ATTRD_HOST, host);
+        crm_xml_add(host_value, F_ATTRD_VALUE, (v? v->current : NULL));
+
+    /* Otherwise, add all nodes' values */
+    } else {
+        GHashTableIter iter;
+
+        g_hash_table_iter_init(&iter, a->values);
+        while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &v)) {
+            host_value = create_xml_node(reply, XML_CIB_TAG_NODE);
+            if (host_value == NULL) {
+                return FALSE;
+            }
+            crm_xml_add(host_value, F_ATTRD_ATTRIBUTE, a->id);
+            crm_xml_add(host_value, F_ATTRD_HOST, v->nodename);
+            crm_xml_add(host_value, F_ATTRD_VALUE, v->current);
+        }
+    }
+    return TRUE;
+}
+
 /*!
  * \internal
  * \brief Build the XML reply to a client query
  *
- * param[in] attr Name of requested attribute
- * param[in] host Name of requested host (or NULL for all hosts)
+ * A query names one attribute with F_ATTRD_ATTRIBUTE, and may name more with
+ * F_ATTRD_ATTRIBUTE in XML_ATTR_OP children, or instead give F_ATTRD_REGEX to
+ * query all attributes matching it. Each value in the reply is a
+ * XML_CIB_TAG_NODE child with the attribute name, host and value.
+ *
+ * \param[in] query  Root of query XML
+ * \param[in] host   Name of requested host (or NULL for all hosts)
  *
  * \return New XML reply
  * \note Caller is responsible for freeing the resulting XML
  */
-static xmlNode *build_query_reply(const char *attr, const char *host)
+static xmlNode *
+build_query_reply(xmlNode *query, const char *host)
 {
+    const char *attr = crm_element_value(query, F_ATTRD_ATTRIBUTE);
+    const char *regex = crm_element_value(query, F_ATTRD_REGEX);
     xmlNode *reply = create_xml_node(NULL, __FUNCTION__);
-    attribute_t *a;
+    GList *names = NULL;
 
     if (reply == NULL) {
         return NULL;
@@ -418,47 +835,46 @@ static xmlNode *build_query_reply(const char *attr, const char *host)
     crm_xml_add(reply, F_TYPE, T_ATTRD);
     crm_xml_add(reply, F_ATTRD_VERSION, ATTRD_PROTOCOL_VERSION);
 
-    /* If desired attribute exists, add its value(s) to the reply */
-    a = g_hash_table_lookup(attributes, attr);
-    if (a) {
-        attribute_value_t *v;
-        xmlNode *host_value;
+    /* Allow caller to use "localhost" to refer to local node */
+    if (safe_str_eq(host, "localhost")) {
+        host = attrd_cluster->uname;
+        crm_trace("Mapped localhost to %s", host);
+    }
 
-        crm_xml_add(reply, F_ATTRD_ATTRIBUTE, attr);
+    if (regex) {
+        names = attributes_matching(regex);
 
-        /* Allow caller to use "localhost" to refer to local node */
-        if (safe_str_eq(host, "localhost")) {
-            host = attrd_cluster->uname;
-            crm_trace("Mapped localhost to %s", host);
-        }
+    } else {
+        for (xmlNode *child = __xml_first_child_element(query); child != NULL;
+             child = __xml_next_element(child)) {
 
-        /* If a specific node was requested, add its value */
-        if (host) {
-            v = g_hash_table_lookup(a->values, host);
-            host_value = create_xml_node(reply, XML_CIB_TAG_NODE);
-            if (host_value == NULL) {
-                free_xml(reply);
-                return NULL;
-            }
-            crm_xml_add(host_value, F_ATTRD_HOST, host);
-            crm_xml_add(host_value, F_ATTRD_VALUE, (v? v->current : NULL));
+            const char *name = crm_element_value(child, F_ATTRD_ATTRIBUTE);
 
-        /* Otherwise, add all nodes' values */
-        } else {
-            GHashTableIter iter;
-
-            g_hash_table_iter_init(&iter, a->values);
-            while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &v)) {
-                host_value = create_xml_node(reply, XML_CIB_TAG_NODE);
-                if (host_value == NULL) {
-                    free_xml(reply);
-                    return NULL;
-                }
-                crm_xml_add(host_value, F_ATTRD_HOST, v->nodename);
-                crm_xml_add(host_value, F_ATTRD_VALUE, v->current);
+            if (name && crm_str_eq((const char *) child->name, XML_ATTR_OP,
+                                   TRUE)) {
+                names = g_list_prepend(names, (gpointer) name);
             }
         }
+        names = g_list_prepend(names, (gpointer) attr);
+
+        /* For compatibility with older clients, a query of a single existing
+         * attribute identifies it in the reply
+         */
+        if ((names->next == NULL) && g_hash_table_lookup(attributes, attr)) {
+            crm_xml_add(reply, F_ATTRD_ATTRIBUTE, attr);
+        }
     }
+
+    for (GList *iter = names; iter != NULL; iter = iter->next) {
+        attribute_t *a = g_hash_table_lookup(attributes, iter->data);
+
+        if (a && !add_query_values(reply, a, host)) {
+            free_xml(reply);
+            reply = NULL;
+            break;
+        }
+    }
+    g_list_free(names);
     return reply;
 }
 
@@ -474,7 +890,6 @@ static xmlNode *build_query_reply(const char *attr, const char *host)
 void
 attrd_client_query(crm_client_t *client, uint32_t id, uint32_t flags, xmlNode *query)
 {
-    const char *attr;
     const char *origin = crm_element_value(query, F_ORIG);
     ssize_t rc;
     xmlNode *reply;
@@ -485,15 +900,14 @@ attrd_client_query(crm_client_t *client, uint32_t id, uint32_t flags, xmlNode *q
     crm_debug("Query arrived from %s", origin);
 
     /* Request must specify attribute name to query */
-    attr = crm_element_value(query, F_ATTRD_ATTRIBUTE);
-    if (attr == NULL) {
+    if (crm_element_value(query, F_ATTRD_ATTRIBUTE) == NULL) {
         crm_warn("Ignoring malformed query from %s (no attribute name given)",
                  origin);
         return;
     }
 
     /* Build the XML reply */
-    reply = build_query_reply(attr, crm_element_value(query, F_ATTRD_HOST));
+    reply = build_query_reply(query, crm_element_value(query, F_ATTRD_HOST));
     if (reply == NULL) {
         crm_err("Could not respond to query from %s: could not create XML reply",
                  origin);
@@ -525,15 +939,7 @@ attrd_peer_clear_failure(crm_node_t *peer, xmlNode *xml)
     const char *op = crm_element_value(xml, F_ATTRD_OPERATION);
     const char *interval_spec = crm_element_value(xml, F_ATTRD_INTERVAL);
     guint interval_ms = crm_parse_interval_spec(interval_spec);
-    char *attr = NULL;
-    GHashTableIter iter;
-    regex_t regex;
-
-    if (attrd_failure_regex(&regex, rsc, op, interval_ms) != pcmk_ok) {
-        crm_info("Ignoring invalid request to clear failures for %s",
-                 (rsc? rsc : "all resources"));
-        return;
-    }
+    GList *matches = failure_attributes_matching(rsc, op, interval_ms);
 
     crm_xml_add(xml, F_ATTRD_TASK, ATTRD_OP_UPDATE);
 
@@ -542,16 +948,13 @@ attrd_peer_clear_failure(crm_node_t *peer, xmlNode *xml)
         crm_xml_replace(xml, F_ATTRD_VALUE, NULL);
     }
 
-    g_hash_table_iter_init(&iter, attributes);
-    while (g_hash_table_iter_next(&iter, (gpointer *) &attr, NULL)) {
-        if (regexec(&regex, attr, 0, NULL, 0) == 0) {
-            crm_trace("Matched %s when clearing %s",
-                      attr, (rsc? rsc : "all resources"));
-            crm_xml_add(xml, F_ATTRD_ATTRIBUTE, attr);
-            attrd_peer_update(peer, xml, host, FALSE);
-        }
+    for (GList *iter = matches; iter != NULL; iter = iter->next) {
+        crm_trace("Matched %s when clearing %s",
+                  (const char *) iter->data, (rsc? rsc : "all resources"));
+        crm_xml_add(xml, F_ATTRD_ATTRIBUTE, iter->data);
+        attrd_peer_update(peer, xml, host, FALSE);
     }
-    regfree(&regex);
+    g_list_free(matches);
 }
 
 /*!
@@ -625,9 +1028,24 @@ attrd_peer_message(crm_node_t *peer, xmlNode *xml)
     if (safe_str_eq(op, ATTRD_OP_UPDATE) || safe_str_eq(op, ATTRD_OP_UPDATE_BOTH) || safe_str_eq(op, ATTRD_OP_UPDATE_DELAY)) {
         attrd_peer_update(peer, xml, host, FALSE);
 
+    } else if (safe_str_eq(op, ATTRD_OP_UPDATE_BATCH)) {
+        for (xmlNode *child = __xml_first_child_element(xml); child != NULL;
+             child = __xml_next_element(child)) {
+            attrd_peer_update(peer, child,
+                              crm_element_value(child, F_ATTRD_HOST), FALSE);
+        }
+
     } else if (safe_str_eq(op, ATTRD_OP_SYNC)) {
         attrd_peer_sync(peer, xml);
 
+    } else if (safe_str_eq(op, ATTRD_OP_SYNC_SUMMARY)
+               && safe_str_neq(peer->uname, attrd_cluster->uname)) {
+        crm_info("Processing %s from %s", op, peer->uname);
+        attrd_peer_sync_summary(peer, xml, (peer_state == election_won));
+
+    } else if (safe_str_eq(op, ATTRD_OP_SYNC_PULL)) {
+        attrd_peer_sync_pull(peer, xml);
+
     } else if (safe_str_eq(op, ATTRD_OP_PEER_REMOVE)) {
         attrd_peer_remove(host, TRUE, peer->uname);
 
@@ -643,8 +1061,12 @@ attrd_peer_message(crm_node_t *peer, xmlNode *xml)
 
         crm_info("Processing %s from %s", op, peer->uname);
 
-        /* Clear the seen flag for attribute processing held only in the own node. */
-        if (peer_state == election_won) {
+        /* Clear the seen flag for attribute processing held only in the own
+         * node (unless this answers a pull, in which case the summary already
+         * took care of it)
+         */
+        if ((peer_state == election_won)
+            && !crm_is_true(crm_element_value(xml, F_ATTRD_SYNC_PARTIAL))) {
             clear_attribute_value_seen();
         }
 
@@ -660,6 +1082,250 @@ attrd_peer_message(crm_node_t *peer, xmlNode *xml)
     }
 }
 
+/*
+ * Digest-based peer sync
+ *
+ * Sending every attribute value to peers (after each election, for example)
+ * can mean megabytes of CPG traffic, and processing each value, when the
+ * peers already have nearly all of them. So when all peers support it, the
+ * writer instead sends a summary: attributes are divided into SYNC_BUCKETS
+ * buckets by a hash of their name, and the summary has a digest of the names,
+ * dampening and values of all attributes in each bucket. Each peer compares
+ * it with the digests of its own attributes, and pulls (gets a sync response
+ * for) only the buckets that differ. Values in buckets that match count as
+ * seen, so values the writer does not have are still found and sent by
+ * attrd_current_only_attribute_update().
+ */
+
+#define SYNC_BUCKETS 256
+
+static guint
+sync_bucket(const char *name)
+{
+    // FNV-1a, so that all nodes agree regardless of GLib version
+    guint32 hash = 2166136261U;
+
+    for (const unsigned char *c = (const unsigned char *) name; *c != '\0';
+         c++) {
+        hash = (hash ^ *c) * 16777619U;
+    }
+    return hash % SYNC_BUCKETS;
+}
+
+static gint
+sort_values_by_node(gconstpointer a, gconstpointer b)
+{
+    return strcmp(((const attribute_value_t *) a)->nodename,
+                  ((const attribute_value_t *) b)->nodename);
+}
+
+/*!
+ * \internal
+ * \brief Calculate the sync digest of each bucket of attributes
+ *
+ * \return Newly allocated array of SYNC_BUCKETS digests (NULL for an empty
+ *         bucket), to be freed with free_bucket_digests()
+ */
+static char **
+sync_bucket_digests(void)
+{
+    GString **inputs = calloc(SYNC_BUCKETS, sizeof(GString *));
+    char **digests = calloc(SYNC_BUCKETS + 1, sizeof(char *));
+    GList *names = NULL;
+
+    CRM_ASSERT((inputs != NULL) && (digests != NULL));
+
+    // Both sides must see attributes and values in the same order
+    names = g_list_sort(g_hash_table_get_keys(attributes),
+                        (GCompareFunc) strcmp);
+    for (GList *iter = names; iter != NULL; iter = iter->next) {
+        attribute_t *a = g_hash_table_lookup(attributes, iter->data);
+        guint bucket = sync_bucket(a->id);
+        GList *values = g_list_sort(g_hash_table_get_values(a->values),
+                                    sort_values_by_node);
+
+        if (inputs[bucket] == NULL) {
+            inputs[bucket] = g_string_sized_new(1024);
+        }
+        g_string_append_printf(inputs[bucket], "%s %d", a->id,
+                               a->timeout_ms / 1000);
+        for (GList *v_iter = values; v_iter != NULL; v_iter = v_iter->next) {
+            attribute_value_t *v = v_iter->data;
+
+            g_string_append_printf(inputs[bucket], " %s%s%s", v->nodename,
+                                   (v->current? "=" : ""),
+                                   (v->current? v->current : ""));
+        }
+        g_string_append_c(inputs[bucket], '\n');
+        g_list_free(values);
+    }
+    g_list_free(names);
+
+    for (int lpc = 0; lpc < SYNC_BUCKETS; lpc++) {
+        if (inputs[lpc] != NULL) {
+            digests[lpc] = crm_md5sum(inputs[lpc]->str);
+            g_string_free(inputs[lpc], TRUE);
+        }
+    }
+    free(inputs);
+    return digests;
+}
+
+static void
+free_bucket_digests(char **digests)
+{
+    for (int lpc = 0; lpc < SYNC_BUCKETS; lpc++) {
+        free(digests[lpc]);
+    }
+    free(digests);
+}
+
+static void
+send_sync_summary(crm_node_t *peer)
+{
+    char **digests = sync_bucket_digests();
+    xmlNode *sync = create_xml_node(NULL, __FUNCTION__);
+
+    crm_xml_add(sync, F_ATTRD_TASK, ATTRD_OP_SYNC_SUMMARY);
+    for (int lpc = 0; lpc < SYNC_BUCKETS; lpc++) {
+        if (digests[lpc] != NULL) {
+            xmlNode *bucket = create_xml_node(sync, XML_ATTRD_SYNC_BUCKET);
+
+            crm_xml_add_int(bucket, XML_ATTR_ID, lpc);
+            crm_xml_add(bucket, F_ATTRD_DIGEST, digests[lpc]);
+        }
+    }
+    free_bucket_digests(digests);
+
+    crm_debug("Syncing value summary to %s", peer?peer->uname:"everyone");
+    send_attrd_message(peer, sync);
+    free_xml(sync);
+}
+
+/*!
+ * \internal
+ * \brief Pull the attributes that differ from a peer's sync summary
+ *
+ * \param[in] peer       Peer that sent summary
+ * \param[in] xml        Summary
+ * \param[in] is_writer  Whether \p peer is the writer
+ */
+void
+attrd_peer_sync_summary(crm_node_t *peer, xmlNode *xml, bool is_writer)
+{
+    char **digests = sync_bucket_digests();
+    bool differs[SYNC_BUCKETS];
+    xmlNode *pull = NULL;
+    int n_differ = 0;
+
+    // A bucket that only we have differs too
+    for (int lpc = 0; lpc < SYNC_BUCKETS; lpc++) {
+        differs[lpc] = (digests[lpc] != NULL);
+    }
+    for (xmlNode *bucket = __xml_first_child_element(xml); bucket != NULL;
+         bucket = __xml_next_element(bucket)) {
+        int id = -1;
+
+        crm_element_value_int(bucket, XML_ATTR_ID, &id);
+        if ((id >= 0) && (id < SYNC_BUCKETS)) {
+            differs[id] = safe_str_neq(crm_element_value(bucket,
+                                                         F_ATTRD_DIGEST),
+                                       digests[id]);
+        }
+    }
+    free_bucket_digests(digests);
+
+    if (is_writer) {
+        GHashTableIter aIter;
+        GHashTableIter vIter;
+        attribute_t *a = NULL;
+        attribute_value_t *v = NULL;
+
+        clear_attribute_value_seen();
+        g_hash_table_iter_init(&aIter, attributes);
+        while (g_hash_table_iter_next(&aIter, NULL, (gpointer *) &a)) {
+            if (!differs[sync_bucket(a->id)]) {
+                g_hash_table_iter_init(&vIter, a->values);
+                while (g_hash_table_iter_next(&vIter, NULL, (gpointer *) &v)) {
+                    v->seen = TRUE;
+                }
+            }
+        }
+    }
+
+    pull = create_xml_node(NULL, __FUNCTION__);
+    crm_xml_add(pull, F_ATTRD_TASK, ATTRD_OP_SYNC_PULL);
+    for (int lpc = 0; lpc < SYNC_BUCKETS; lpc++) {
+        if (differs[lpc]) {
+            xmlNode *bucket = create_xml_node(pull, XML_ATTRD_SYNC_BUCKET);
+
+            crm_xml_add_int(bucket, XML_ATTR_ID, lpc);
+            n_differ++;
+        }
+    }
+
+    if (n_differ > 0) {
+        crm_debug("Pulling %d of %d attribute buckets from %s",
+                  n_differ, SYNC_BUCKETS, peer->uname);
+        send_attrd_message(peer, pull);
+
+    } else {
+        crm_debug("All attributes match those of %s", peer->uname);
+        if (is_writer) {
+            attrd_current_only_attribute_update(peer, xml);
+        }
+    }
+    free_xml(pull);
+}
+
+/*!
+ * \internal
+ * \brief Send a peer the attributes in the buckets it pulled
+ *
+ * \param[in] peer  Peer that sent pull request
+ * \param[in] xml   Pull request
+ */
+void
+attrd_peer_sync_pull(crm_node_t *peer, xmlNode *xml)
+{
+    bool wanted[SYNC_BUCKETS] = { FALSE, };
+    GHashTableIter aIter;
+    GHashTableIter vIter;
+    attribute_t *a = NULL;
+    attribute_value_t *v = NULL;
+    xmlNode *sync = NULL;
+
+    for (xmlNode *bucket = __xml_first_child_element(xml); bucket != NULL;
+         bucket = __xml_next_element(bucket)) {
+        int id = -1;
+
+        crm_element_value_int(bucket, XML_ATTR_ID, &id);
+        if ((id >= 0) && (id < SYNC_BUCKETS)) {
+            wanted[id] = TRUE;
+        }
+    }
+
+    sync = create_xml_node(NULL, __FUNCTION__);
+    crm_xml_add(sync, F_ATTRD_TASK, ATTRD_OP_SYNC_RESPONSE);
+    crm_xml_add(sync, F_ATTRD_SYNC_PARTIAL, XML_BOOLEAN_TRUE);
+
+    g_hash_table_iter_init(&aIter, attributes);
+    while (g_hash_table_iter_next(&aIter, NULL, (gpointer *) & a)) {
+        if (!wanted[sync_bucket(a->id)]) {
+            continue;
+        }
+        g_hash_table_iter_init(&vIter, a->values);
+        while (g_hash_table_iter_next(&vIter, NULL, (gpointer *) & v)) {
+            crm_trace("Syncing %s[%s] = %s to %s", a->id, v->nodename, v->current, peer->uname);
+            build_attribute_xml(sync, a, v->nodename, v->nodeid, v->current);
+        }
+    }
+
+    crm_debug("Syncing pulled values to %s", peer->uname);
+    send_attrd_message(peer, sync);
+    free_xml(sync);
+}
+
 void
 attrd_peer_sync(crm_node_t *peer, xmlNode *xml)
 {
@@ -668,8 +1334,14 @@ attrd_peer_sync(crm_node_t *peer, xmlNode *xml)
 
     attribute_t *a = NULL;
     attribute_value_t *v = NULL;
-    xmlNode *sync = create_xml_node(NULL, __FUNCTION__);
+    xmlNode *sync = NULL;
 
+    if (peers_support_protocol(peer, ATTRD_SYNC_SUMMARY_VERSION)) {
+        send_sync_summary(peer);
+        return;
+    }
+
+    sync = create_xml_node(NULL, __FUNCTION__);
     crm_xml_add(sync, F_ATTRD_TASK, ATTRD_OP_SYNC_RESPONSE);
 
     g_hash_table_iter_init(&aIter, attributes);
@@ -677,8 +1349,7 @@ attrd_peer_sync(crm_node_t *peer, xmlNode *xml)
         g_hash_table_iter_init(&vIter, a->values);
         while (g_hash_table_iter_next(&vIter, NULL, (gpointer *) & v)) {
             crm_debug("Syncing %s[%s] = %s to %s", a->id, v->nodename, v->current, peer?peer->uname:"everyone");
-            build_attribute_xml(sync, a->id, a->set, a->uuid, a->timeout_ms, a->user, a->is_private,
-                                v->nodename, v->nodeid, v->current);
+            build_attribute_xml(sync, a, v->nodename, v->nodeid, v->current);
         }
     }
 
@@ -781,8 +1452,8 @@ attrd_current_only_attribute_update(crm_node_t *peer, xmlNode *xml)
                 crm_trace("Syncing %s[%s] = %s to everyone.(from local only attributes)", a->id, v->nodename, v->current);
 
                 build = TRUE;
-                build_attribute_xml(sync, a->id, a->set, a->uuid, a->timeout_ms, a->user, a->is_private,
-                            v->nodename, v->nodeid, v->current);
+                build_attribute_xml(sync, a, v->nodename, v->nodeid,
+                                    v->current);
             } else {
                 crm_trace("Local attribute(%s[%s] = %s) was ignore.(another host) : [%s]", a->id, v->nodename, v->current, attrd_cluster->uname);
                 continue;
@@ -825,6 +1496,8 @@ attrd_peer_update(crm_node_t *peer, xmlNode *xml, const char *host, bool filter)
             crm_warn("Could not update %s: attribute not found", attr);
             return;
         }
+    } else {
+        attrd_metric_update(a, xml, FALSE);
     }
 
     // Update attribute dampening
@@ -849,7 +1522,7 @@ attrd_peer_update(crm_node_t *peer, xmlNode *xml, const char *host, bool filter)
             mainloop_timer_stop(a->timer);
             mainloop_timer_del(a->timer);
             a->timeout_ms = dampen;
-            if (dampen > 0) {
+            if ((dampen > 0) && !a->is_metric) {
                 a->timer = mainloop_timer_add(attr, a->timeout_ms, FALSE,
                                               attribute_timer_cb, a);
                 crm_info("Update attribute %s delay to %dms (%s)",
@@ -897,8 +1570,7 @@ attrd_peer_update(crm_node_t *peer, xmlNode *xml, const char *host, bool filter)
 
         crm_xml_add(sync, F_ATTRD_TASK, ATTRD_OP_SYNC_RESPONSE);
         v = g_hash_table_lookup(a->values, host);
-        build_attribute_xml(sync, attr, a->set, a->uuid, a->timeout_ms, a->user,
-                            a->is_private, v->nodename, v->nodeid, v->current);
+        build_attribute_xml(sync, a, v->nodename, v->nodeid, v->current);
 
         crm_xml_add_int(sync, F_ATTRD_WRITER, election_state(writer));
 
@@ -912,6 +1584,7 @@ attrd_peer_update(crm_node_t *peer, xmlNode *xml, const char *host, bool filter)
         free(v->current);
         v->current = (value? strdup(value) : NULL);
         a->changed = TRUE;
+        attrd_notify_change(a, v);
 
         // Write out new value or start dampening timer
         if (a->timer) {
@@ -961,17 +1634,150 @@ write_or_elect_attribute(attribute_t *a)
     }
 }
 
+#define XPATH_TRANSIENT_ATTRS \
+    "/" XML_TAG_CIB "/" XML_CIB_TAG_STATUS "/" XML_CIB_TAG_STATE \
+    "/" XML_TAG_TRANSIENT_NODEATTRS
+
+/*!
+ * \internal
+ * \brief Collect the transient attribute values in CIB query output
+ *
+ * \param[in]     xml        Query output (or part of it)
+ * \param[in]     node_uuid  UUID of node that \p xml belongs to (if known)
+ * \param[in,out] values     Table of values, keyed by "<node UUID> <name>"
+ */
+static void
+collect_cib_values(xmlNode *xml, const char *node_uuid, GHashTable *values)
+{
+    if (crm_str_eq((const char *) xml->name, XML_TAG_TRANSIENT_NODEATTRS,
+                   TRUE)) {
+        node_uuid = ID(xml);
+
+    } else if ((node_uuid != NULL)
+               && crm_str_eq((const char *) xml->name, XML_CIB_TAG_NVPAIR,
+                             TRUE)) {
+        const char *name = crm_element_value(xml, XML_NVPAIR_ATTR_NAME);
+        const char *value = crm_element_value(xml, XML_NVPAIR_ATTR_VALUE);
+
+        if ((name != NULL) && (value != NULL)) {
+            g_hash_table_replace(values,
+                                 crm_strdup_printf("%s %s", node_uuid, name),
+                                 strdup(value));
+        }
+        return;
+    }
+
+    for (xmlNode *child = __xml_first_child(xml); child != NULL;
+         child = __xml_next(child)) {
+        collect_cib_values(child, node_uuid, values);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Check whether any value of an attribute differs from the CIB's
+ *
+ * \param[in] a       Attribute to check
+ * \param[in] values  Values in CIB, as collected by collect_cib_values()
+ *
+ * \return TRUE if any value differs (or cannot be compared), FALSE otherwise
+ */
+static bool
+attribute_differs_from_cib(attribute_t *a, GHashTable *values)
+{
+    GHashTableIter iter;
+    attribute_value_t *v = NULL;
+
+    g_hash_table_iter_init(&iter, a->values);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) & v)) {
+        crm_node_t *peer = crm_get_peer_full(v->nodeid, v->nodename,
+                                             CRM_GET_PEER_ANY);
+        char *key = NULL;
+        const char *in_cib = NULL;
+
+        if ((peer == NULL) || (peer->uuid == NULL)) {
+            return TRUE;
+        }
+        key = crm_strdup_printf("%s %s", peer->uuid, a->id);
+        in_cib = g_hash_table_lookup(values, key);
+        free(key);
+        if (safe_str_neq(in_cib, v->current)) {
+            crm_trace("%s[%s] is %s in CIB but %s here", a->id, v->nodename,
+                      (in_cib? in_cib : "unset"),
+                      (v->current? v->current : "unset"));
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void
+election_query_callback(xmlNode *msg, int call_id, int rc, xmlNode *output,
+                        void *user_data)
+{
+    GHashTable *values = NULL;
+    GHashTableIter iter;
+    attribute_t *a = NULL;
+    int differ = 0;
+
+    if (election_state(writer) != election_won) {
+        crm_debug("No longer the writer, so not comparing attributes to CIB");
+        return;
+    }
+
+    // -ENXIO means the CIB has no transient attributes at all
+    if ((rc != pcmk_ok) && (rc != -ENXIO)) {
+        crm_warn("Writing all attributes because CIB query failed: %s "
+                 CRM_XS " rc=%d", pcmk_strerror(rc), rc);
+        write_attributes(TRUE);
+        return;
+    }
+
+    values = crm_str_table_new();
+    if ((rc == pcmk_ok) && (output != NULL)) {
+        collect_cib_values(output, NULL, values);
+    }
+
+    g_hash_table_iter_init(&iter, attributes);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) & a)) {
+        if (!a->is_private && !a->changed
+            && attribute_differs_from_cib(a, values)) {
+            a->changed = TRUE;
+            differ++;
+        }
+    }
+    g_hash_table_destroy(values);
+
+    crm_info("%d of %u attribute%s differ from the CIB after election",
+             differ, g_hash_table_size(attributes),
+             ((g_hash_table_size(attributes) == 1)? "" : "s"));
+    write_attributes(FALSE);
+}
+
 gboolean
 attrd_election_cb(gpointer user_data)
 {
+    int call_id = 0;
+
     free(peer_writer);
     peer_writer = strdup(attrd_cluster->uname);
 
     /* Update the peers after an election */
     attrd_peer_sync(NULL, NULL);
 
-    /* Update the CIB after an election */
-    write_attributes(TRUE);
+    /* Update the CIB after an election, writing only what the previous writer
+     * did not (comparing against the CIB rather than rewriting every value)
+     */
+    if (the_cib == NULL) {
+        write_attributes(TRUE);
+        return FALSE;
+    }
+    call_id = the_cib->cmds->query(the_cib, XPATH_TRANSIENT_ATTRS, NULL,
+                                   cib_xpath|cib_multiple|cib_scope_local);
+    the_cib->cmds->register_callback_full(the_cib, call_id, 120, FALSE, NULL,
+                                          "election_query_callback",
+                                          election_query_callback, NULL);
+    crm_trace("Comparing attributes to CIB (call %d)", call_id);
     return FALSE;
 }
 
@@ -1002,13 +1808,28 @@ attrd_peer_change_cb(enum crm_status_type kind, crm_node_t *peer, const void *da
 
 static void
 attrd_cib_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void *user_data)
+{
+    GList *names = user_data;
+
+    for (GList *iter = names; iter != NULL; iter = iter->next) {
+        attrd_attribute_written(call_id, rc, iter->data);
+    }
+}
+
+static void
+free_attribute_names(void *user_data)
+{
+    g_list_free_full((GList *) user_data, free);
+}
+
+static void
+attrd_attribute_written(int call_id, int rc, const char *name)
 {
     int level = LOG_ERR;
     GHashTableIter iter;
     const char *peer = NULL;
     attribute_value_t *v = NULL;
 
-    char *name = user_data;
     attribute_t *a = g_hash_table_lookup(attributes, name);
 
     if(a == NULL) {
@@ -1044,6 +1865,7 @@ attrd_cib_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void *u
         v->requested = NULL;
         if (rc != pcmk_ok) {
             a->changed = TRUE; /* Attempt write out again */
+            v->metric_written = FALSE;
         }
     }
   done:
@@ -1052,6 +1874,106 @@ attrd_cib_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void *u
     }
 }
 
+/*!
+ * \internal
+ * \brief Send the CIB update collected for all batched attribute writes
+ */
+static void
+write_batch_flush(void)
+{
+    int call_id = 0;
+    GList *names = write_batch_attrs;
+
+    if (write_batch == NULL) {
+        return;
+    }
+    write_batch_attrs = NULL;
+    mainloop_timer_stop(write_batch_timer);
+
+    if (names == NULL) {
+        crm_trace("No attribute changes to write");
+
+    } else if (the_cib == NULL) {
+        // Write the attributes again once the CIB is back
+        crm_info("Write out of %d attribute%s delayed: cib not connected",
+                 g_list_length(names), ((names && names->next)? "s" : ""));
+        for (GList *iter = names; iter != NULL; iter = iter->next) {
+            attribute_t *a = g_hash_table_lookup(attributes, iter->data);
+
+            if (a != NULL) {
+                a->changed = TRUE;
+            }
+        }
+        free_attribute_names(names);
+
+    } else {
+        crm_log_xml_trace(write_batch, __FUNCTION__);
+        call_id = cib_internal_op(the_cib, CIB_OP_MODIFY, NULL,
+                                  XML_CIB_TAG_STATUS, write_batch, NULL,
+                                  write_batch_flags, write_batch_user);
+
+        crm_info("Sent update %d with %d change%s for %d attribute%s",
+                 call_id, write_batch_changes,
+                 ((write_batch_changes == 1)? "" : "s"),
+                 g_list_length(names), ((names && names->next)? "s" : ""));
+
+        for (GList *iter = names; iter != NULL; iter = iter->next) {
+            attribute_t *a = g_hash_table_lookup(attributes, iter->data);
+
+            if (a != NULL) {
+                a->update = call_id;
+            }
+        }
+        the_cib->cmds->register_callback_full(the_cib, call_id, 120, FALSE,
+                                              names, "attrd_cib_callback",
+                                              attrd_cib_callback,
+                                              free_attribute_names);
+    }
+
+    free_xml(write_batch);
+    write_batch = NULL;
+    free(write_batch_user);
+    write_batch_user = NULL;
+    write_batch_flags = cib_none;
+    write_batch_changes = 0;
+}
+
+static gboolean
+write_batch_timer_cb(gpointer data)
+{
+    write_batch_flush();
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Get the status section XML to add an attribute's changes to
+ *
+ * \param[in] a  Attribute about to be written
+ *
+ * \return Status section of the pending batched CIB update
+ */
+static xmlNode *
+write_batch_for(attribute_t *a)
+{
+    if ((write_batch != NULL) && safe_str_neq(a->user, write_batch_user)) {
+        write_batch_flush();
+    }
+
+    if (write_batch == NULL) {
+        write_batch = create_xml_node(NULL, XML_CIB_TAG_STATUS);
+        write_batch_user = a->user? strdup(a->user) : NULL;
+        write_batch_flags = cib_quorum_override;
+        if (write_batch_timer == NULL) {
+            write_batch_timer = mainloop_timer_add("attrd-write-batch",
+                                                   WRITE_BATCH_MS, FALSE,
+                                                   write_batch_timer_cb, NULL);
+        }
+        mainloop_timer_start(write_batch_timer);
+    }
+    return write_batch;
+}
+
 void
 write_attributes(bool all)
 {
@@ -1077,33 +1999,61 @@ write_attributes(bool all)
 static void
 build_update_element(xmlNode *parent, attribute_t *a, const char *nodeid, const char *value)
 {
-    const char *set = NULL;
+    char *set = NULL;
+    char *nvpair_id = NULL;
     xmlNode *xml_obj = NULL;
+    xmlNode *child = NULL;
 
-    xml_obj = create_xml_node(parent, XML_CIB_TAG_STATE);
-    crm_xml_add(xml_obj, XML_ATTR_ID, nodeid);
+    /* The update may already have elements for this node (and set, and even
+     * attribute, if it changed again before the update was sent), so reuse
+     * them rather than adding duplicates
+     */
+    xml_obj = find_entity(parent, XML_CIB_TAG_STATE, nodeid);
+    if (xml_obj == NULL) {
+        xml_obj = create_xml_node(parent, XML_CIB_TAG_STATE);
+        crm_xml_add(xml_obj, XML_ATTR_ID, nodeid);
+    }
 
-    xml_obj = create_xml_node(xml_obj, XML_TAG_TRANSIENT_NODEATTRS);
-    crm_xml_add(xml_obj, XML_ATTR_ID, nodeid);
+    child = find_entity(xml_obj, XML_TAG_TRANSIENT_NODEATTRS, nodeid);
+    if (child == NULL) {
+        child = create_xml_node(xml_obj, XML_TAG_TRANSIENT_NODEATTRS);
+        crm_xml_add(child, XML_ATTR_ID, nodeid);
+    }
+    xml_obj = child;
 
-    xml_obj = create_xml_node(xml_obj, XML_TAG_ATTR_SETS);
     if (a->set) {
-        crm_xml_set_id(xml_obj, "%s", a->set);
+        set = strdup(a->set);
     } else {
-        crm_xml_set_id(xml_obj, "%s-%s", XML_CIB_TAG_STATUS, nodeid);
+        set = crm_strdup_printf("%s-%s", XML_CIB_TAG_STATUS, nodeid);
+    }
+    crm_xml_sanitize_id(set);
+    child = find_entity(xml_obj, XML_TAG_ATTR_SETS, set);
+    if (child == NULL) {
+        child = create_xml_node(xml_obj, XML_TAG_ATTR_SETS);
+        crm_xml_add(child, XML_ATTR_ID, set);
     }
-    set = ID(xml_obj);
+    xml_obj = child;
 
-    xml_obj = create_xml_node(xml_obj, XML_CIB_TAG_NVPAIR);
     if (a->uuid) {
-        crm_xml_set_id(xml_obj, "%s", a->uuid);
+        nvpair_id = strdup(a->uuid);
     } else {
-        crm_xml_set_id(xml_obj, "%s-%s", set, a->id);
+        nvpair_id = crm_strdup_printf("%s-%s", set, a->id);
+    }
+    crm_xml_sanitize_id(nvpair_id);
+    child = find_entity(xml_obj, XML_CIB_TAG_NVPAIR, nvpair_id);
+    if (child == NULL) {
+        child = create_xml_node(xml_obj, XML_CIB_TAG_NVPAIR);
+        crm_xml_add(child, XML_ATTR_ID, nvpair_id);
     }
+    xml_obj = child;
+    free(nvpair_id);
+    free(set);
+
     crm_xml_add(xml_obj, XML_NVPAIR_ATTR_NAME, a->id);
 
     if(value) {
         crm_xml_add(xml_obj, XML_NVPAIR_ATTR_VALUE, value);
+        xml_remove_prop(xml_obj, "__delete__");
 
     } else {
         crm_xml_add(xml_obj, XML_NVPAIR_ATTR_VALUE, "");
@@ -1149,18 +2099,33 @@ void
 write_attribute(attribute_t *a)
 {
     int private_updates = 0, cib_updates = 0;
+    bool in_cib = FALSE;
     xmlNode *xml_top = NULL;
     attribute_value_t *v = NULL;
     GHashTableIter iter;
-    enum cib_call_options flags = cib_quorum_override;
+    enum cib_call_options flags = cib_none;
     GHashTable *alert_attribute_value = NULL;
 
     if (a == NULL) {
         return;
     }
 
+    in_cib = !a->is_private;
+
+    /* A metric attribute is written only when a value changes band */
+    if (in_cib && a->is_metric) {
+        in_cib = FALSE;
+        g_hash_table_iter_init(&iter, a->values);
+        while (g_hash_table_iter_next(&iter, NULL, (gpointer *) & v)) {
+            if (attrd_metric_needs_write(a, v)) {
+                in_cib = TRUE;
+                break;
+            }
+        }
+    }
+
     /* If this attribute will be written to the CIB ... */
-    if (!a->is_private) {
+    if (in_cib) {
 
         /* Defer the write if now's not a good time */
         if (the_cib == NULL) {
@@ -1179,8 +2144,8 @@ write_attribute(attribute_t *a)
             return;
         }
 
-        /* Initialize the status update XML */
-        xml_top = create_xml_node(NULL, XML_CIB_TAG_STATUS);
+        /* Add to the batched status update XML */
+        xml_top = write_batch_for(a);
     }
 
     /* Attribute will be written shortly, so clear changed flag */
@@ -1212,8 +2177,11 @@ write_attribute(attribute_t *a)
             v->nodeid = peer->id;
         }
 
-        /* If this is a private attribute, no update needs to be sent */
-        if (a->is_private) {
+        /* If this is a private attribute (or a metric value that has not
+         * changed band), no update needs to be sent
+         */
+        if (a->is_private
+            || (a->is_metric && !attrd_metric_needs_write(a, v))) {
             private_updates++;
             continue;
         }
@@ -1231,6 +2199,9 @@ write_attribute(attribute_t *a)
                   v->current, peer->uuid, peer->id, v->nodeid, peer->uname);
         build_update_element(xml_top, a, peer->uuid, v->current);
         cib_updates++;
+        if (a->is_metric) {
+            attrd_metric_written(a, v);
+        }
 
         /* Preservation of the attribute to transmit alert */
         set_alert_attribute_value(alert_attribute_value, v);
@@ -1253,23 +2224,20 @@ write_attribute(attribute_t *a)
                  a->id, (a->uuid? a->uuid : "<n/a>"), a->set);
     }
     if (cib_updates) {
-        crm_log_xml_trace(xml_top, __FUNCTION__);
-
-        a->update = cib_internal_op(the_cib, CIB_OP_MODIFY, NULL, XML_CIB_TAG_STATUS, xml_top, NULL,
-                                    flags, a->user);
-
-        crm_info("Sent update %d with %d changes for %s, id=%s, set=%s",
-                 a->update, cib_updates, a->id, (a->uuid? a->uuid : "<n/a>"), a->set);
+        crm_info("Batched %d change%s for %s, id=%s, set=%s",
+                 cib_updates, ((cib_updates == 1)? "" : "s"),
+                 a->id, (a->uuid? a->uuid : "<n/a>"), a->set);
+        write_batch_flags |= flags;
+        write_batch_changes += cib_updates;
+        if (g_list_find_custom(write_batch_attrs, a->id,
+                               (GCompareFunc) strcmp) == NULL) {
+            write_batch_attrs = g_list_append(write_batch_attrs,
+                                              strdup(a->id));
+        }
 
-        the_cib->cmds->register_callback_full(the_cib, a->update, 120, FALSE,
-                                              strdup(a->id),
-                                              "attrd_cib_callback",
-                                              attrd_cib_callback, free);
         /* Transmit alert of the attribute */
         send_alert_attributes_value(a, alert_attribute_value);
-
     }
 
     g_hash_table_destroy(alert_attribute_value);
-    free_xml(xml_top);
 }
@@ -0,0 +1,295 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include <crm/crm.h>
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+
+#include "pacemaker-attrd.h"
+
+/*
+ * Metric attributes
+ *
+ * Health agents and the like may update an attribute every second or so. As
+ * a normal attribute, each change would be a CIB update, with a disk write,
+ * a diff sent to every node and possibly a scheduler run.
+ *
+ * A metric attribute is kept out of the CIB like a private attribute, except
+ * that a node's value is written when it moves into a different band, as
+ * delimited by the attribute's thresholds (an ascending, comma-separated list
+ * of numbers). The scheduler thus sees a snapshot of the value that changes
+ * only when the change could matter to it. Without thresholds, a metric
+ * attribute is never written.
+ *
+ * In addition, a metric attribute's dampening is used as the minimum interval
+ * between broadcasts to peers of the updates clients make here. Updates
+ * within the same band during the interval are coalesced, with only the
+ * latest broadcast at the end of the interval, while a change of band is
+ * broadcast at once. (Since metric values are not written because of a
+ * change, dampening has no other use for them.)
+ */
+
+// Most recent broadcast of one node's value for a metric attribute
+struct metric_hold_s {
+    char *sent_value;           // last value broadcast
+    xmlNode *held;              // latest update not yet broadcast, if any
+    mainloop_timer_t *timer;    // running while broadcasts are limited
+};
+
+static GHashTable *metric_holds = NULL; // "<attr> <host>" -> metric_hold_s
+
+static void
+free_metric_hold(gpointer data)
+{
+    struct metric_hold_s *hold = data;
+
+    mainloop_timer_del(hold->timer);
+    free_xml(hold->held);
+    free(hold->sent_value);
+    free(hold);
+}
+
+/*!
+ * \internal
+ * \brief Get the band that a metric value falls in
+ *
+ * \param[in] thresholds  Ascending, comma-separated list of numbers (or NULL)
+ * \param[in] value       Metric value (or NULL if unset)
+ *
+ * \return Number of thresholds that \p value is at or above, or -1 if
+ *         \p value is unset or not a number
+ */
+int
+attrd_metric_band(const char *thresholds, const char *value)
+{
+    char *end = NULL;
+    double number = 0.0;
+    int band = 0;
+
+    if ((value == NULL) || (*value == '\0')) {
+        return -1;
+    }
+    number = strtod(value, &end);
+    if (*end != '\0') {
+        return -1;
+    }
+
+    for (const char *t = thresholds; (t != NULL) && (*t != '\0'); t = end) {
+        double threshold = strtod(t, &end);
+
+        if (end == t) {
+            break; // invalid list, so ignore the rest
+        }
+        if (number < threshold) {
+            break;
+        }
+        band++;
+        end += strspn(end, ", ");
+    }
+    return band;
+}
+
+/*!
+ * \internal
+ * \brief Update whether an attribute is a metric, from an update request
+ *
+ * \param[in,out] a    Attribute being updated
+ * \param[in]     xml  Update request
+ *
+ * \note An attribute is made a metric by its creating update, which is also
+ *       when it can be made private. Later updates may change the thresholds.
+ */
+void
+attrd_metric_update(attribute_t *a, xmlNode *xml, bool creating)
+{
+    const char *thresholds = crm_element_value(xml, F_ATTRD_THRESHOLDS);
+    GHashTableIter iter;
+    attribute_value_t *v = NULL;
+
+    if (creating) {
+        crm_element_value_int(xml, F_ATTRD_IS_METRIC, &a->is_metric);
+    }
+    if (!a->is_metric || (thresholds == NULL)
+        || safe_str_eq(thresholds, a->thresholds)) {
+        return;
+    }
+
+    crm_info("Using thresholds %s for metric attribute %s", thresholds, a->id);
+    free(a->thresholds);
+    a->thresholds = strdup(thresholds);
+
+    // Bands may now be different, so check every value at the next write
+    g_hash_table_iter_init(&iter, a->values);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &v)) {
+        v->metric_written = FALSE;
+    }
+    a->changed = TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Add an attribute's metric settings to a peer message
+ *
+ * \param[in,out] xml  Message XML for one attribute value
+ * \param[in]     a    Attribute the message is for
+ */
+void
+attrd_metric_add_xml(xmlNode *xml, attribute_t *a)
+{
+    if (a->is_metric) {
+        crm_xml_add_int(xml, F_ATTRD_IS_METRIC, a->is_metric);
+        crm_xml_add(xml, F_ATTRD_THRESHOLDS, a->thresholds);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Check whether a metric attribute value must be written to the CIB
+ *
+ * \param[in] a  Metric attribute
+ * \param[in] v  Attribute value to check
+ *
+ * \return TRUE if the value is in a different band from the one last
+ *         written (or has never been written), otherwise FALSE
+ */
+bool
+attrd_metric_needs_write(attribute_t *a, attribute_value_t *v)
+{
+    if (a->thresholds == NULL) {
+        return FALSE;
+    }
+    return !v->metric_written
+           || (attrd_metric_band(a->thresholds, v->current) != v->metric_band);
+}
+
+/*!
+ * \internal
+ * \brief Remember that a metric attribute value has been written to the CIB
+ *
+ * \param[in]     a  Metric attribute
+ * \param[in,out] v  Attribute value written
+ */
+void
+attrd_metric_written(attribute_t *a, attribute_value_t *v)
+{
+    v->metric_band = attrd_metric_band(a->thresholds, v->current);
+    v->metric_written = TRUE;
+}
+
+static gboolean
+metric_hold_timer_cb(gpointer data)
+{
+    struct metric_hold_s *hold = data;
+
+    if (hold->held != NULL) {
+        free(hold->sent_value);
+        hold->sent_value = crm_element_value_copy(hold->held, F_ATTRD_VALUE);
+        send_attrd_message(NULL, hold->held);
+        free_xml(hold->held);
+        hold->held = NULL;
+
+        // Keep limiting broadcasts for another interval
+        mainloop_timer_start(hold->timer);
+    }
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Rate-limit a client update of a metric attribute
+ *
+ * \param[in] xml  Client update request, with host and value already resolved
+ *
+ * \return TRUE if the update has been held for later broadcast (in which case
+ *         the caller should not broadcast it), otherwise FALSE
+ */
+bool
+attrd_metric_hold(xmlNode *xml)
+{
+    const char *attr = crm_element_value(xml, F_ATTRD_ATTRIBUTE);
+    const char *host = crm_element_value(xml, F_ATTRD_HOST);
+    const char *value = crm_element_value(xml, F_ATTRD_VALUE);
+    const char *thresholds = crm_element_value(xml, F_ATTRD_THRESHOLDS);
+    const char *dampen = crm_element_value(xml, F_ATTRD_DAMPEN);
+    attribute_t *a = g_hash_table_lookup(attributes, attr);
+    struct metric_hold_s *hold = NULL;
+    char *key = NULL;
+    int is_metric = 0;
+    int interval_ms = 0;
+
+    if (a != NULL) {
+        is_metric = a->is_metric;
+        interval_ms = a->timeout_ms;
+        if (thresholds == NULL) {
+            thresholds = a->thresholds;
+        }
+    } else {
+        crm_element_value_int(xml, F_ATTRD_IS_METRIC, &is_metric);
+    }
+    if (dampen != NULL) {
+        interval_ms = crm_get_msec(dampen);
+    }
+    if (!is_metric || (interval_ms <= 0) || (host == NULL)
+        || safe_str_eq(crm_element_value(xml, F_ATTRD_TASK),
+                       ATTRD_OP_UPDATE_DELAY)) {
+        return FALSE;
+    }
+
+    if (metric_holds == NULL) {
+        metric_holds = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                             free_metric_hold);
+    }
+    key = crm_strdup_printf("%s %s", attr, host);
+    hold = g_hash_table_lookup(metric_holds, key);
+    if (hold == NULL) {
+        hold = calloc(1, sizeof(struct metric_hold_s));
+        CRM_ASSERT(hold != NULL);
+        hold->timer = mainloop_timer_add(key, interval_ms, FALSE,
+                                         metric_hold_timer_cb, hold);
+        g_hash_table_insert(metric_holds, key, hold);
+    } else {
+        free(key);
+        mainloop_timer_set_period(hold->timer, interval_ms);
+    }
+
+    if (mainloop_timer_running(hold->timer)
+        && (attrd_metric_band(thresholds, value)
+            == attrd_metric_band(thresholds, hold->sent_value))) {
+
+        crm_trace("Holding update of metric %s[%s]=%s", attr, host, value);
+        free_xml(hold->held);
+        hold->held = copy_xml(xml);
+        return TRUE;
+    }
+
+    // Broadcast now, superseding any held update
+    free_xml(hold->held);
+    hold->held = NULL;
+    free(hold->sent_value);
+    hold->sent_value = value? strdup(value) : NULL;
+    mainloop_timer_start(hold->timer);
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Free all metric rate-limiting state
+ */
+void
+attrd_metric_cleanup(void)
+{
+    if (metric_holds != NULL) {
+        g_hash_table_destroy(metric_holds);
+        metric_holds = NULL;
+    }
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <errno.h>
+#include <regex.h>
+#include <glib.h>
+
+#include <crm/crm.h>
+#include <crm/msg_xml.h>
+#include <crm/common/ipcs.h>
+
+#include "pacemaker-attrd.h"
+
+/*
+ * Attribute change notifications
+ *
+ * IPC clients may subscribe (with ATTRD_OP_NOTIFY) to be sent an
+ * ATTRD_OP_CHANGED event whenever the value of an attribute changes on any
+ * node, optionally only for attributes whose names match a regular
+ * expression. Events are sent as soon as the change is known here, which is
+ * before (and independent of) the change being written to the CIB, so
+ * subscribers do not have to watch CIB diffs or wait for the write.
+ */
+
+struct subscription_s {
+    regex_t *pattern;   // only notify of attributes matching this, if set
+};
+
+static GHashTable *subscriptions = NULL;   // client ID -> subscription_s
+
+static void
+free_subscription(gpointer data)
+{
+    struct subscription_s *sub = data;
+
+    if (sub->pattern != NULL) {
+        regfree(sub->pattern);
+        free(sub->pattern);
+    }
+    free(sub);
+}
+
+/*!
+ * \internal
+ * \brief Subscribe or unsubscribe a client to attribute change notifications
+ *
+ * \param[in] client  Client that sent the request
+ * \param[in] xml     Request XML
+ *
+ * \return pcmk_ok on success, -errno otherwise
+ */
+int
+attrd_client_notify(crm_client_t *client, xmlNode *xml)
+{
+    const char *regex = crm_element_value(xml, F_ATTRD_REGEX);
+    struct subscription_s *sub = NULL;
+    int enabled = 1;
+
+    crm_element_value_int(xml, F_ATTRD_NOTIFY_ENABLED, &enabled);
+    if (!enabled) {
+        if (subscriptions != NULL) {
+            g_hash_table_remove(subscriptions, client->id);
+        }
+        crm_debug("Client %s unsubscribed from attribute changes",
+                  client->name);
+        return pcmk_ok;
+    }
+
+    sub = calloc(1, sizeof(struct subscription_s));
+    CRM_ASSERT(sub != NULL);
+    if (regex != NULL) {
+        sub->pattern = calloc(1, sizeof(regex_t));
+        CRM_ASSERT(sub->pattern != NULL);
+        if (regcomp(sub->pattern, regex, REG_EXTENDED|REG_NOSUB) != 0) {
+            crm_err("Ignoring attribute change subscription from %s: "
+                    "invalid pattern '%s'", client->name, regex);
+            free(sub->pattern);
+            free(sub);
+            return -EINVAL;
+        }
+    }
+
+    if (subscriptions == NULL) {
+        subscriptions = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                              free_subscription);
+    }
+    g_hash_table_replace(subscriptions, strdup(client->id), sub);
+    crm_debug("Client %s subscribed to changes of %s", client->name,
+              (regex? regex : "all attributes"));
+    return pcmk_ok;
+}
+
+/*!
+ * \internal
+ * \brief Forget any subscription of a client that has disconnected
+ *
+ * \param[in] client  Client being destroyed
+ */
+void
+attrd_notify_forget_client(crm_client_t *client)
+{
+    if ((subscriptions != NULL) && (client->id != NULL)) {
+        g_hash_table_remove(subscriptions, client->id);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Notify subscribers that an attribute value has changed
+ *
+ * \param[in] a  Attribute that changed
+ * \param[in] v  New value (and the node it is for)
+ */
+void
+attrd_notify_change(attribute_t *a, attribute_value_t *v)
+{
+    GHashTableIter iter;
+    const char *client_id = NULL;
+    struct subscription_s *sub = NULL;
+    xmlNode *event = NULL;
+    char *dampen = NULL;
+
+    if ((subscriptions == NULL) || (g_hash_table_size(subscriptions) == 0)) {
+        return;
+    }
+
+    g_hash_table_iter_init(&iter, subscriptions);
+    while (g_hash_table_iter_next(&iter, (gpointer *) &client_id,
+                                  (gpointer *) &sub)) {
+        crm_client_t *client = crm_client_get_by_id(client_id);
+
+        if (client == NULL) {
+            g_hash_table_iter_remove(&iter);
+            continue;
+        }
+        if ((sub->pattern != NULL)
+            && (regexec(sub->pattern, a->id, 0, NULL, 0) != 0)) {
+            continue;
+        }
+
+        if (event == NULL) {
+            event = create_xml_node(NULL, __FUNCTION__);
+            crm_xml_add(event, F_TYPE, T_ATTRD);
+            crm_xml_add(event, F_ATTRD_TASK, ATTRD_OP_CHANGED);
+            crm_xml_add(event, F_ATTRD_ATTRIBUTE, a->id);
+            crm_xml_add(event, F_ATTRD_SET, a->set);
+            crm_xml_add(event, F_ATTRD_HOST, v->nodename);
+            crm_xml_add_int(event, F_ATTRD_HOST_ID, v->nodeid);
+            crm_xml_add_int(event, F_ATTRD_IS_REMOTE, v->is_remote);
+            crm_xml_add_int(event, F_ATTRD_IS_PRIVATE, a->is_private);
+            dampen = crm_strdup_printf("%dms", a->timeout_ms);
+            crm_xml_add(event, F_ATTRD_DAMPEN, dampen);
+            free(dampen);
+            crm_xml_add(event, F_ATTRD_VALUE, v->current);
+        }
+        crm_ipcs_send(client, 0, event, crm_ipc_server_event);
+    }
+    free_xml(event);
+}
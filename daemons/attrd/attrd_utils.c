@@ -128,6 +128,7 @@ attrd_ipc_closed(qb_ipcs_connection_t *c)
         crm_trace("Ignoring request to clean up unknown connection %p", c);
     } else {
         crm_trace("Cleaning up closed client connection %p", c);
+        attrd_notify_forget_client(client);
         crm_client_destroy(client);
     }
     return FALSE;
@@ -232,38 +233,73 @@ attrd_expand_value(const char *value, const char *old_value)
 
 /*!
  * \internal
- * \brief Create regular expression matching failure-related attributes
+ * \brief Create regular expression pattern matching failure-related attributes
  *
- * \param[out] regex  Where to store created regular expression
  * \param[in]  rsc    Name of resource to clear (or NULL for all)
  * \param[in]  op     Operation to clear if rsc is specified (or NULL for all)
  * \param[in]  interval_ms  Interval of operation to clear if op is specified
  *
- * \return pcmk_ok on success, -EINVAL if arguments are invalid
+ * \return Newly allocated pattern
+ */
+char *
+attrd_failure_pattern(const char *rsc, const char *op, guint interval_ms)
+{
+    if (rsc == NULL) {
+        return strdup(ATTRD_RE_CLEAR_ALL);
+    } else if (op == NULL) {
+        return crm_strdup_printf(ATTRD_RE_CLEAR_ONE, rsc);
+    }
+    return crm_strdup_printf(ATTRD_RE_CLEAR_OP, rsc, op, interval_ms);
+}
+
+/* Compiled regular expressions, by pattern. Cleanups during recovery use the
+ * same few patterns over and over, and compiling is much of their cost.
+ */
+#define REGEX_CACHE_MAX 64
+
+static GHashTable *regex_cache = NULL;
+
+static void
+free_regex(gpointer data)
+{
+    regfree((regex_t *) data);
+    free(data);
+}
+
+/*!
+ * \internal
+ * \brief Get a compiled (extended, no subexpressions) regular expression
+ *
+ * \param[in] pattern  Regular expression pattern
  *
- * \note The caller is responsible for freeing the result with regfree().
+ * \return Compiled regular expression, or NULL if \p pattern is invalid
+ * \note The result is owned by a cache and valid until the next call.
  */
-int
-attrd_failure_regex(regex_t *regex, const char *rsc, const char *op,
-                    guint interval_ms)
+const regex_t *
+attrd_regex(const char *pattern)
 {
-    char *pattern = NULL;
-    int rc;
+    regex_t *regex = NULL;
 
-    /* Create a pattern that matches desired attributes */
+    if (regex_cache == NULL) {
+        regex_cache = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                            free_regex);
+    }
 
-    if (rsc == NULL) {
-        pattern = strdup(ATTRD_RE_CLEAR_ALL);
-    } else if (op == NULL) {
-        pattern = crm_strdup_printf(ATTRD_RE_CLEAR_ONE, rsc);
-    } else {
-        pattern = crm_strdup_printf(ATTRD_RE_CLEAR_OP, rsc, op, interval_ms);
+    regex = g_hash_table_lookup(regex_cache, pattern);
+    if (regex != NULL) {
+        return regex;
     }
 
-    /* Compile pattern into regular expression */
-    crm_trace("Clearing attributes matching %s", pattern);
-    rc = regcomp(regex, pattern, REG_EXTENDED|REG_NOSUB);
-    free(pattern);
+    regex = calloc(1, sizeof(regex_t));
+    CRM_ASSERT(regex != NULL);
+    if (regcomp(regex, pattern, REG_EXTENDED|REG_NOSUB) != 0) {
+        free(regex);
+        return NULL;
+    }
 
-    return (rc == 0)? pcmk_ok : -EINVAL;
+    if (g_hash_table_size(regex_cache) >= REGEX_CACHE_MAX) {
+        g_hash_table_remove_all(regex_cache);
+    }
+    g_hash_table_insert(regex_cache, strdup(pattern), regex);
+    return regex;
 }
@@ -201,6 +201,14 @@ attrd_cib_connect(int max_retry)
         goto cleanup;
     }
 
+    // Only changes to the alerts section are of interest (see attrd_alerts.c)
+    rc = the_cib->cmds->set_notify_filter(the_cib, "/" XML_TAG_CIB "/"
+                                          XML_CIB_TAG_CONFIGURATION "/"
+                                          XML_CIB_TAG_ALERTS, 1);
+    if (rc != pcmk_ok) {
+        crm_debug("Could not filter CIB notifications: %s", pcmk_strerror(rc));
+    }
+
     // We have no attribute values in memory, wipe the CIB to match
     attrd_erase_attrs();
 
@@ -273,6 +281,10 @@ attrd_ipc_dispatch(qb_ipcs_connection_t * c, void *data, size_t size)
     } else if (safe_str_eq(op, ATTRD_OP_UPDATE_DELAY)) {
         attrd_send_ack(client, id, flags);
         attrd_client_update(xml);
+
+    } else if (safe_str_eq(op, ATTRD_OP_UPDATE_BATCH)) {
+        attrd_send_ack(client, id, flags);
+        attrd_client_update_batch(xml);
   
     } else if (safe_str_eq(op, ATTRD_OP_REFRESH)) {
         attrd_send_ack(client, id, flags);
@@ -282,6 +294,10 @@ attrd_ipc_dispatch(qb_ipcs_connection_t * c, void *data, size_t size)
         /* queries will get reply, so no ack is necessary */
         attrd_client_query(client, id, flags, xml);
 
+    } else if (safe_str_eq(op, ATTRD_OP_NOTIFY)) {
+        attrd_send_ack(client, id, flags);
+        attrd_client_notify(client, xml);
+
     } else {
         crm_info("Ignoring request from client %s with unknown operation %s",
                  client->name, op);
@@ -379,6 +395,7 @@ main(int argc, char **argv)
     writer = election_init(T_ATTRD, attrd_cluster->uname, 120000, attrd_election_cb);
     attrd_init_ipc(&ipcs, attrd_ipc_dispatch);
     crm_info("Accepting attribute updates");
+    pcmk__notify_ready(crm_proc_attrd);
 
     attrd_run_mainloop();
 
@@ -390,6 +407,8 @@ main(int argc, char **argv)
         crm_client_disconnect_all(ipcs);
         qb_ipcs_destroy(ipcs);
         g_hash_table_destroy(attributes);
+        attrd_free_attribute_index();
+        attrd_metric_cleanup();
     }
 
     attrd_lrmd_disconnect();
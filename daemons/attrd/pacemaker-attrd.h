@@ -48,8 +48,9 @@ int attrd_expand_value(const char *value, const char *old_value);
  */
 #define ATTRD_RE_CLEAR_OP ATTRD_RE_CLEAR_ALL "%s(#%s_%u)?$"
 
-int attrd_failure_regex(regex_t *regex, const char *rsc, const char *op,
-                        guint interval_ms);
+char *attrd_failure_pattern(const char *rsc, const char *op,
+                            guint interval_ms);
+const regex_t *attrd_regex(const char *pattern);
 
 extern cib_t *the_cib;
 
@@ -76,6 +77,8 @@ typedef struct attribute_s {
     bool changed; /* whether attribute value has changed since last write */
     bool unknown_peer_uuids; /* whether we know we're missing a peer uuid */
     gboolean is_private; /* whether to keep this attribute out of the CIB */
+    gboolean is_metric; /* whether to write only changes of band to the CIB */
+    char *thresholds; /* band boundaries of a metric attribute */
 
     mainloop_timer_t *timer;
 
@@ -90,6 +93,8 @@ typedef struct attribute_value_s {
         char *current;
         char *requested;
         gboolean seen;
+        int metric_band; /* band of value last written (metric attributes) */
+        bool metric_written; /* whether metric_band is valid */
 } attribute_value_t;
 
 crm_cluster_t *attrd_cluster;
@@ -99,17 +104,32 @@ election_t *writer;
 #define attrd_send_ack(client, id, flags) \
     crm_ipcs_send_ack((client), (id), (flags), "ack", __FUNCTION__, __LINE__)
 
+gboolean send_attrd_message(crm_node_t *node, xmlNode *data);
 void write_attributes(bool all);
 void attrd_broadcast_protocol(void);
 void attrd_peer_message(crm_node_t *client, xmlNode *msg);
 void attrd_client_peer_remove(const char *client_name, xmlNode *xml);
 void attrd_client_clear_failure(xmlNode *xml);
 void attrd_client_update(xmlNode *xml);
+void attrd_client_update_batch(xmlNode *xml);
 void attrd_client_refresh(void);
 void attrd_client_query(crm_client_t *client, uint32_t id, uint32_t flags, xmlNode *query);
 
 void free_attribute(gpointer data);
 
+int attrd_client_notify(crm_client_t *client, xmlNode *xml);
+void attrd_notify_forget_client(crm_client_t *client);
+void attrd_notify_change(attribute_t *a, attribute_value_t *v);
+void attrd_free_attribute_index(void);
+
+int attrd_metric_band(const char *thresholds, const char *value);
+void attrd_metric_update(attribute_t *a, xmlNode *xml, bool creating);
+void attrd_metric_add_xml(xmlNode *xml, attribute_t *a);
+bool attrd_metric_needs_write(attribute_t *a, attribute_value_t *v);
+void attrd_metric_written(attribute_t *a, attribute_value_t *v);
+bool attrd_metric_hold(xmlNode *xml);
+void attrd_metric_cleanup(void);
+
 gboolean attrd_election_cb(gpointer user_data);
 void attrd_peer_change_cb(enum crm_status_type type, crm_node_t *peer, const void *data);
 
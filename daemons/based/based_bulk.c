@@ -0,0 +1,144 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include <glib.h>
+
+#include <crm/crm.h>
+#include <crm/cib/internal.h>
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+#include <crm/common/ipcs.h>
+
+#include <pacemaker-based.h>
+
+/*
+ * Staged transactions
+ *
+ * A transaction large enough to be a problem to send in one request (such as
+ * cibadmin --bulk-load of thousands of objects) can be sent in parts. Each
+ * cib_stage_transact request adds its <cib_transaction> requests to those
+ * already staged for the client, without touching the CIB, so nothing is
+ * validated, versioned, diffed or broadcast, and the controller sees no
+ * change. A cib_commit_transact request whose input is an empty
+ * <cib_transaction> marked as staged then commits everything staged as one
+ * transaction, exactly as if it had been sent in one piece (it is forwarded or
+ * broadcast to peers as usual, but over the cluster layer, which has no size
+ * limit like IPC's).
+ *
+ * Staged requests are kept only by the node the client is connected to, and
+ * are discarded if the client disconnects before committing them.
+ */
+
+// Client ID -> <cib_transaction> of requests staged by that client
+static GHashTable *staged_transactions = NULL;
+
+/*!
+ * \internal
+ * \brief Stage the requests in a cib_stage_transact request
+ *
+ * \param[in] request  Request from client
+ * \param[in] client   Client that sent request
+ *
+ * \return Standard Pacemaker return code
+ */
+int
+cib_bulk_stage(xmlNode *request, crm_client_t *client)
+{
+    xmlNode *input = get_message_xml(request, F_CIB_CALLDATA);
+    xmlNode *staged = NULL;
+    int count = 0;
+
+    if (safe_str_neq(crm_element_name(input), T_CIB_TRANSACTION)) {
+        crm_err("Cannot stage transaction requests from %s: no requests given",
+                client->name);
+        return -EINVAL;
+    }
+
+    if (staged_transactions == NULL) {
+        staged_transactions = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                    free,
+                                                    (GDestroyNotify) free_xml);
+    }
+
+    staged = g_hash_table_lookup(staged_transactions, client->id);
+    if (staged == NULL) {
+        staged = create_xml_node(NULL, T_CIB_TRANSACTION);
+        g_hash_table_insert(staged_transactions, strdup(client->id), staged);
+    }
+
+    for (xmlNode *child = __xml_first_child_element(input); child != NULL;
+         child = __xml_next_element(child)) {
+
+        if (!cib_op_in_transaction(crm_element_value(child, F_CIB_OPERATION))) {
+            crm_err("Operation %s is not allowed in a transaction",
+                    crm_str(crm_element_value(child, F_CIB_OPERATION)));
+            return -EOPNOTSUPP;
+        }
+        add_node_copy(staged, child);
+        count++;
+    }
+
+    crm_trace("Staged %d transaction request%s for %s",
+              count, ((count == 1)? "" : "s"), client->name);
+    return pcmk_ok;
+}
+
+/*!
+ * \internal
+ * \brief Replace a commit request's input with any requests staged for it
+ *
+ * \param[in,out] request  cib_commit_transact request from client
+ * \param[in]     client   Client that sent request
+ *
+ * \note If the request does not ask to commit staged requests, it is left
+ *       alone. If it does but nothing is staged, it is also left alone, and
+ *       cib_process_commit_transaction() rejects it.
+ */
+void
+cib_bulk_unstage(xmlNode *request, crm_client_t *client)
+{
+    xmlNode *input = get_message_xml(request, F_CIB_CALLDATA);
+    xmlNode *wrapper = NULL;
+    gpointer key = NULL;
+    gpointer staged = NULL;
+
+    if ((input == NULL) || !crm_is_true(crm_element_value(input, F_CIB_STAGED))
+        || (staged_transactions == NULL)
+        || !g_hash_table_lookup_extended(staged_transactions, client->id,
+                                         &key, &staged)) {
+        return;
+    }
+
+    g_hash_table_steal(staged_transactions, client->id);
+    free(key);
+
+    wrapper = first_named_child(request, F_CIB_CALLDATA);
+    free_xml(input);
+    add_node_nocopy(wrapper, NULL, staged);
+    crm_debug("Committing staged transaction from %s", client->name);
+}
+
+/*!
+ * \internal
+ * \brief Discard any requests staged by a client
+ *
+ * \param[in] client  Client that disconnected
+ */
+void
+cib_bulk_forget_client(crm_client_t *client)
+{
+    if ((staged_transactions != NULL) && (client->id != NULL)
+        && g_hash_table_remove(staged_transactions, client->id)) {
+        crm_info("Discarded uncommitted staged transaction from %s",
+                 crm_str(client->name));
+    }
+}
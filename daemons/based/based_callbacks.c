@@ -45,11 +45,29 @@ qb_ipcs_service_t *ipcs_shm = NULL;
 void send_cib_replace(const xmlNode * sync_request, const char *host);
 static void cib_process_request(xmlNode* request, gboolean force_synchronous,
                                 gboolean privileged, crm_client_t *cib_client);
+static void do_local_notify(xmlNode * notify_src, const char *client_id,
+                            gboolean sync_reply, gboolean from_peer);
 
 
 int cib_process_command(xmlNode * request, xmlNode ** reply,
                         xmlNode ** cib_diff, gboolean privileged);
 
+/* Reply to a query for the whole CIB, whose data has not been attached yet
+ * because local IPC clients are sent the shared serialization of the CIB
+ * instead (see cib_query_full_reply_text())
+ */
+static xmlNode *full_cib_reply = NULL;
+
+// Attach the CIB to a reply whose data has been left out, if needed
+static void
+attach_full_cib(xmlNode *reply)
+{
+    if ((reply != NULL) && (reply == full_cib_reply)) {
+        add_message_xml(reply, F_CIB_CALLDATA, the_cib);
+        full_cib_reply = NULL;
+    }
+}
+
 gboolean cib_common_callback(qb_ipcs_connection_t * c, void *data, size_t size,
                              gboolean privileged);
 
@@ -108,6 +126,8 @@ cib_ipc_closed(qb_ipcs_connection_t * c)
         return 0;
     }
     crm_trace("Connection %p", c);
+    cib_notify_forget_client(client);
+    cib_bulk_forget_client(client);
     crm_client_destroy(client);
     return 0;
 }
@@ -161,9 +181,22 @@ cib_common_callback_worker(uint32_t id, uint32_t flags, xmlNode * op_request,
         int on_off = 0;
         long long bit = 0;
         const char *type = crm_element_value(op_request, F_CIB_NOTIFY_TYPE);
+        const char *filter = crm_element_value(op_request, F_CIB_NOTIFY_FILTER);
 
         crm_element_value_int(op_request, F_CIB_NOTIFY_ACTIVATE, &on_off);
 
+        if (filter != NULL) {
+            /* Restrict which diff notifications the client gets (older
+             * servers ignore this and send it all of them)
+             */
+            cib_notify_set_filter(cib_client, filter, on_off);
+            if (flags & crm_ipc_client_response) {
+                crm_ipcs_send_ack(cib_client, id, flags, "ack", __FUNCTION__,
+                                  __LINE__);
+            }
+            return;
+        }
+
         crm_debug("Setting %s callbacks for %s (%s): %s",
                   type, cib_client->name, cib_client->id, on_off ? "on" : "off");
 
@@ -194,6 +227,35 @@ cib_common_callback_worker(uint32_t id, uint32_t flags, xmlNode * op_request,
             crm_ipcs_send_ack(cib_client, id, flags, "ack", __FUNCTION__, __LINE__);
         }
         return;
+
+    } else if (crm_str_eq(op, CIB_OP_STAGE_TRANSACT, TRUE)) {
+        /* Hold the requests until they are committed (see based_bulk.c). This
+         * modifies nothing, so it is answered here rather than processed.
+         */
+        int call_options = 0;
+        int rc = privileged? cib_bulk_stage(op_request, cib_client) : -EACCES;
+        xmlNode *reply = create_xml_node(NULL, "cib-reply");
+
+        crm_element_value_int(op_request, F_CIB_CALLOPTS, &call_options);
+        crm_xml_add(reply, F_TYPE, T_CIB);
+        crm_xml_add(reply, F_CIB_OPERATION, op);
+        crm_xml_add(reply, F_CIB_CALLID,
+                    crm_element_value(op_request, F_CIB_CALLID));
+        crm_xml_add(reply, F_CIB_CLIENTID, cib_client->id);
+        crm_xml_add_int(reply, F_CIB_CALLOPTS, call_options);
+        crm_xml_add_int(reply, F_CIB_RC, rc);
+        do_local_notify(reply, cib_client->id,
+                        is_set(call_options, cib_sync_call), FALSE);
+        free_xml(reply);
+        return;
+
+    } else if (!privileged && cib_query_offload(id, flags, op_request,
+                                                cib_client)) {
+        // Answered from a snapshot of the CIB (see based_query.c)
+        return;
+
+    } else if (crm_str_eq(op, CIB_OP_COMMIT_TRANSACT, TRUE) && privileged) {
+        cib_bulk_unstage(op_request, cib_client);
     }
 
     cib_process_request(op_request, FALSE, privileged, cib_client);
@@ -291,6 +353,7 @@ cib_digester_cb(gpointer data)
         crm_xml_add(ping, F_CIB_PING_ID, buffer);
 
         crm_xml_add(ping, XML_ATTR_CRM_VERSION, CRM_FEATURE_SET);
+        cib_compact_announce(ping);
         send_cluster_message(NULL, crm_msg_cib, ping, TRUE);
 
         free_xml(ping);
@@ -311,6 +374,7 @@ process_ping_reply(xmlNode *reply)
     if (seq_s) {
         seq = crm_int_helper(seq_s, NULL);
     }
+    cib_compact_note_peer(host, pong);
 
     if(digest == NULL) {
         crm_trace("Ignoring ping reply %s from %s with no digest", seq_s, host);
@@ -350,8 +414,12 @@ process_ping_reply(xmlNode *reply)
                 crm_trace("End of differences");
             }
 
-            free_xml(remote_cib);
-            sync_our_cib(reply, FALSE);
+            if (cib_history_sync(host, remote_cib, digest)) {
+                free_xml(remote_cib);
+            } else {
+                free_xml(remote_cib);
+                sync_our_cib(reply, FALSE);
+            }
         }
     }
 }
@@ -398,8 +466,18 @@ do_local_notify(xmlNode * notify_src, const char *client_id,
 
     switch (client_obj->kind) {
         case CRM_CLIENT_IPC:
-            rc = crm_ipcs_send(client_obj, rid, notify_src, (sync_reply?
-                               crm_ipc_flags_none : crm_ipc_server_event));
+            if (!sync_reply) {
+                cib_notify_send_held(client_obj); // Keep events in order
+            }
+            if (notify_src == full_cib_reply) {
+                rc = pcmk__ipcs_send_text(client_obj, rid,
+                                          cib_query_full_reply_text(notify_src),
+                                          (sync_reply? crm_ipc_flags_none
+                                                     : crm_ipc_server_event));
+            } else {
+                rc = crm_ipcs_send(client_obj, rid, notify_src, (sync_reply?
+                                   crm_ipc_flags_none : crm_ipc_server_event));
+            }
             if (rc < 0) {
                 crm_warn("%s reply to %s failed: %s " CRM_XS " rc=%lld",
                          (sync_reply? "Synchronous" : "Asynchronous"),
@@ -410,6 +488,7 @@ do_local_notify(xmlNode * notify_src, const char *client_id,
         case CRM_CLIENT_TLS:
 #endif
         case CRM_CLIENT_TCP:
+            attach_full_cib(notify_src);
             crm_remote_send(client_obj->remote, notify_src);
             break;
         default:
@@ -806,6 +885,10 @@ forward_request(xmlNode * request, crm_client_t * cib_client, int call_options)
         crm_trace("Forwarding %s op to %s", op, host);
         send_cluster_message(crm_get_peer(0, host), crm_msg_cib, request, FALSE);
 
+    } else if (!cib_legacy_mode()) {
+        crm_trace("Forwarding %s op to all instances", op);
+        cib_compact_broadcast(request);
+
     } else {
         crm_trace("Forwarding %s op to master instance", op);
         send_cluster_message(NULL, crm_msg_cib, request, FALSE);
@@ -861,7 +944,7 @@ send_peer_reply(xmlNode * msg, xmlNode * result_diff, const char *originator, gb
             CRM_ASSERT(digest != NULL);
         }
 
-        add_message_xml(msg, F_CIB_UPDATE_DIFF, result_diff);
+        cib_compact_add_patchset(msg, F_CIB_UPDATE_DIFF, result_diff);
         crm_log_xml_explicit(msg, "copy");
         return send_cluster_message(NULL, crm_msg_cib, msg, TRUE);
 
@@ -1079,6 +1162,7 @@ cib_process_request(xmlNode *request, gboolean force_synchronous,
             crm_trace("Queuing local %ssync notification for %s",
                       (call_options & cib_sync_call) ? "" : "a-", client_id);
 
+            attach_full_cib(op_reply);
             queue_local_notify(op_reply, client_id, (call_options & cib_sync_call), from_peer);
             op_reply = NULL;    /* the reply is queued, so don't free here */
         }
@@ -1100,6 +1184,7 @@ cib_process_request(xmlNode *request, gboolean force_synchronous,
             crm_trace("Directing reply to %s", originator);
         }
 
+        attach_full_cib(op_reply);
         send_peer_reply(op_reply, result_diff, originator, FALSE);
     }
 
@@ -1113,12 +1198,56 @@ cib_process_request(xmlNode *request, gboolean force_synchronous,
         }
     }
 
-    free_xml(op_reply);
+    full_cib_reply = NULL;
+    pcmk__xml_free_later(op_reply);
     free_xml(result_diff);
 
     return;
 }
 
+/*!
+ * \internal
+ * \brief Check whether a request can be applied to the CIB in place
+ *
+ * Copying large CIBs accounts for a huge percentage of our CIB usage, so
+ * where possible, requests are applied directly to the current CIB, which is
+ * restored from a snapshot if the request fails (see cib_perform_op()). That
+ * requires that the request keep the same CIB element and that its changes be
+ * described by a v2 patchset.
+ *
+ * \param[in] op             Request operation
+ * \param[in] call_options   Request call options
+ * \param[in] section        Section of the CIB the request applies to
+ * \param[in] global_update  Whether the request is a legacy global update
+ *
+ * \return TRUE if the request can modify the CIB in place, otherwise FALSE
+ */
+static gboolean
+cib_modifies_in_place(const char *op, int call_options, const char *section,
+                      gboolean global_update)
+{
+    const char *feature_set = crm_element_value(the_cib,
+                                                XML_ATTR_CRM_VERSION);
+
+    if (is_set(call_options, cib_dryrun)) {
+        return FALSE;
+
+    } else if (safe_str_eq(section, XML_CIB_TAG_STATUS)) {
+        return TRUE;
+
+    } else if (global_update || (compare_version("3.0.8", feature_set) >= 0)) {
+        // v1 patchsets are calculated by comparing against a full copy
+        return FALSE;
+    }
+
+    return crm_str_eq(op, CIB_OP_MODIFY, TRUE)
+           || crm_str_eq(op, CIB_OP_CREATE, TRUE)
+           || crm_str_eq(op, CIB_OP_DELETE, TRUE)
+           || crm_str_eq(op, CIB_OP_DELETE_ALT, TRUE)
+           || crm_str_eq(op, CIB_OP_BUMP, TRUE)
+           || crm_str_eq(op, CIB_OP_COMMIT_TRANSACT, TRUE);
+}
+
 int
 cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gboolean privileged)
 {
@@ -1141,6 +1270,7 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
     gboolean global_update = FALSE;
     gboolean config_changed = FALSE;
     gboolean manage_counters = TRUE;
+    gint64 started = 0;
 
     static mainloop_timer_t *digest_timer = NULL;
 
@@ -1157,6 +1287,9 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
     /* Start processing the request... */
     op = crm_element_value(request, F_CIB_OPERATION);
     crm_element_value_int(request, F_CIB_CALLOPTS, &call_options);
+    pcmk__trace_event(pcmk__trace_cib_op_begin, crm_atoi(call_id, "0"),
+                      call_options, op);
+    started = g_get_monotonic_time();
     rc = cib_get_operation_id(op, &call_type);
 
     if (rc == pcmk_ok && privileged == FALSE) {
@@ -1201,8 +1334,7 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
             manage_counters = FALSE;
         }
 
-        if (is_not_set(call_options, cib_dryrun) && safe_str_eq(section, XML_CIB_TAG_STATUS)) {
-            /* Copying large CIBs accounts for a huge percentage of our CIB usage */
+        if (cib_modifies_in_place(op, call_options, section, global_update)) {
             call_options |= cib_zero_copy;
         } else {
             clear_bit(call_options, cib_zero_copy);
@@ -1241,11 +1373,12 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
                   crm_element_value(result_cib, XML_ATTR_NUMUPDATES),
                   (is_set(call_options, cib_zero_copy)? " zero-copy" : ""),
                   (config_changed? " changed" : ""));
-        if(is_not_set(call_options, cib_zero_copy)) {
-            rc = activateCibXml(result_cib, config_changed, op);
-            crm_trace("Activated %s (%d)",
-                      crm_element_value(current_cib, XML_ATTR_NUMUPDATES), rc);
-        }
+        /* Replacements are always written in full (see above) */
+        rc = activateCibXml(result_cib, config_changed, op,
+                            (crm_str_eq(CIB_OP_REPLACE, op, TRUE)?
+                             NULL : *cib_diff));
+        crm_trace("Activated %s (%d)",
+                  crm_element_value(current_cib, XML_ATTR_NUMUPDATES), rc);
 
         if (rc == pcmk_ok && cib_internal_config_changed(*cib_diff)) {
             cib_read_config(config_hash, result_cib);
@@ -1273,8 +1406,7 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
         mainloop_timer_start(digest_timer);
 
     } else if (rc == -pcmk_err_schema_validation) {
-        CRM_ASSERT(is_not_set(call_options, cib_zero_copy));
-
+        // result_cib is a copy even for zero-copy requests
         if (output != NULL) {
             crm_log_xml_info(output, "cib:output");
             free_xml(output);
@@ -1315,7 +1447,11 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
         crm_xml_add_int(*reply, F_CIB_CALLOPTS, call_options);
         crm_xml_add_int(*reply, F_CIB_RC, rc);
 
-        if (output != NULL) {
+        if ((output == the_cib) && !cib_op_modifies(call_type)) {
+            crm_trace("Leaving CIB out of reply until it is sent");
+            full_cib_reply = *reply;
+
+        } else if (output != NULL) {
             crm_trace("Attaching reply output");
             add_message_xml(*reply, F_CIB_CALLDATA, output);
         }
@@ -1326,7 +1462,7 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
     crm_trace("cleanup");
 
     if (cib_op_modifies(call_type) == FALSE && output != current_cib) {
-        free_xml(output);
+        pcmk__xml_free_later(output);
         output = NULL;
     }
 
@@ -1334,6 +1470,12 @@ cib_process_command(xmlNode * request, xmlNode ** reply, xmlNode ** cib_diff, gb
         cib_op_cleanup(call_type, call_options, &input, &output);
     }
 
+    pcmk__trace_event(pcmk__trace_cib_op_end, crm_atoi(call_id, "0"), rc, op);
+    pcmk__metric_observe_us(pcmk__metric(pcmk__metric_histogram,
+                                         "cib_operation_seconds",
+                                         "Time taken to process CIB requests, "
+                                         "by operation", "op", op),
+                            g_get_monotonic_time() - started);
     crm_trace("done");
     return rc;
 }
@@ -1356,6 +1498,11 @@ cib_peer_callback(xmlNode * msg, void *private_data)
     } else if (crm_peer_cache == NULL) {
         reason = "membership not established";
         goto bail;
+
+    } else if (!cib_compact_expand(msg, F_CIB_UPDATE_DIFF)
+               || !cib_compact_expand(msg, F_CIB_CALLDATA)) {
+        reason = "invalid compact data";
+        goto bail;
     }
 
     if (crm_element_value(msg, F_CIB_CLIENTNAME) == NULL) {
@@ -1506,6 +1653,7 @@ terminate_cib(const char *caller, int fast)
         remote_tls_fd = 0;
     }
 
+    cib_flush_writes();
     uninitializeCib();
 
     if (fast > 0) {
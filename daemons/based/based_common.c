@@ -164,6 +164,7 @@ static cib_operation_t cib_server_ops[] = {
     {CIB_OP_ISMASTER,  FALSE, TRUE,  FALSE, cib_prepare_none, cib_cleanup_none,   cib_process_readwrite},
     {"cib_shutdown_req",FALSE, TRUE, FALSE, cib_prepare_sync, cib_cleanup_none,   cib_process_shutdown_req},
     {CRM_OP_PING,      FALSE, FALSE, FALSE, cib_prepare_none, cib_cleanup_output, cib_process_ping},
+    {CIB_OP_COMMIT_TRANSACT,TRUE, TRUE, TRUE, cib_prepare_data, cib_cleanup_data, cib_process_commit_transaction},
 };
 
 int
@@ -0,0 +1,632 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include <crm/crm.h>
+#include <crm/cib/internal.h>
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+#include <crm/cluster.h>
+#include <crm/services.h>
+
+#include <pacemaker-based.h>
+
+/*
+ * Compact encoding of CIB updates between peers
+ *
+ * Every CIB change is sent to all peers, either as the request itself (which
+ * each peer then applies) or, in legacy mode, as a patchset. Status changes in
+ * particular mostly consist of the same few element and attribute names
+ * (lrm_rsc_op, transition-magic, call-id, ...) and small numbers. When every
+ * active peer has said it understands it, the XML data of broadcast requests
+ * and v2 patchsets is sent in a compact binary form (base64-encoded so it can
+ * be carried in a message attribute) instead of as XML.
+ *
+ * Each element is encoded as its name, the number of attributes, each
+ * attribute's name and value, the number of children, and then each child.
+ * Counts and numbers are unsigned LEB128 varints. A string is encoded as a
+ * varint token, which is 0 for a new string (followed by its length and
+ * bytes, after which it can be referred to by number), or refers to a name in
+ * the static dictionary below or to a string that appeared earlier in the same
+ * message. An attribute value is encoded as (token << 2), or as
+ * ((number << 2) | 1) or ((number << 2) | 2) for a non-negative or negative
+ * decimal number written the canonical way.
+ *
+ * Support is announced with the cib_compact version in ping requests and
+ * replies (see cib_compact_note_peer()), rather than with the feature set,
+ * which affects whether nodes can join the cluster at all. Data that contains
+ * anything other than elements is always sent as XML.
+ */
+
+#define CIB_COMPACT_VERSION 1
+#define CIB_COMPACT_MAGIC   'P'
+#define CIB_COMPACT_DEPTH_MAX 256
+
+/* Static dictionary for CIB_COMPACT_VERSION 1 (names may be added to the end
+ * in later versions, but never removed or reordered)
+ */
+static const char *compact_names[] = {
+    // Patchset structure
+    "diff", "version", "change", "change-list", "change-attr",
+    "change-result", "format", "operation", "path", "position", "target",
+    "name", "value", "create", "modify", "delete", "move", "set", "unset",
+
+    // CIB structure
+    XML_TAG_CIB, XML_CIB_TAG_STATUS, XML_CIB_TAG_CONFIGURATION,
+    XML_CIB_TAG_CRMCONFIG, XML_CIB_TAG_NODES, XML_CIB_TAG_RESOURCES,
+    XML_CIB_TAG_CONSTRAINTS, XML_CIB_TAG_NODE, XML_CIB_TAG_STATE,
+    XML_CIB_TAG_PROPSET, XML_TAG_ATTR_SETS, XML_TAG_META_SETS,
+    XML_TAG_TRANSIENT_NODEATTRS, XML_CIB_TAG_NVPAIR, XML_CIB_TAG_RESOURCE,
+    XML_CIB_TAG_GROUP, XML_CIB_TAG_INCARNATION, XML_ATTR_OP, "operations",
+
+    // Status
+    XML_CIB_TAG_LRM, XML_LRM_TAG_RESOURCES, XML_LRM_TAG_RESOURCE,
+    XML_LRM_TAG_RSC_OP,
+
+    // Attribute names
+    XML_ATTR_ID, XML_ATTR_GENERATION_ADMIN, XML_ATTR_GENERATION,
+    XML_ATTR_NUMUPDATES, XML_ATTR_CRM_VERSION, XML_ATTR_VALIDATION,
+    XML_CIB_ATTR_WRITTEN, XML_ATTR_UPDATE_ORIG, XML_ATTR_UPDATE_CLIENT,
+    XML_ATTR_UPDATE_USER, XML_ATTR_HAVE_QUORUM, XML_ATTR_DC_UUID,
+    XML_ATTR_UNAME, XML_NODE_IN_CLUSTER, XML_NODE_IS_PEER,
+    XML_ATTR_ORIGIN, XML_NODE_JOIN_STATE, XML_NODE_EXPECTED,
+    XML_LRM_ATTR_TASK, XML_LRM_ATTR_TASK_KEY, XML_ATTR_TRANSITION_KEY,
+    XML_ATTR_TRANSITION_MAGIC, XML_LRM_ATTR_EXIT_REASON,
+    XML_LRM_ATTR_TARGET, XML_LRM_ATTR_CALLID, XML_LRM_ATTR_RC,
+    XML_LRM_ATTR_OPSTATUS, XML_LRM_ATTR_INTERVAL_MS, XML_RSC_OP_LAST_RUN,
+    XML_RSC_OP_LAST_CHANGE, XML_RSC_OP_T_EXEC, XML_RSC_OP_T_QUEUE,
+    XML_LRM_ATTR_OP_DIGEST, XML_LRM_ATTR_OP_RESTART,
+    XML_LRM_ATTR_RESTART_DIGEST, XML_LRM_ATTR_OP_SECURE,
+    XML_LRM_ATTR_SECURE_DIGEST, XML_AGENT_ATTR_CLASS,
+    XML_AGENT_ATTR_PROVIDER, XML_ATTR_TYPE,
+
+    // Common values
+    XML_BOOLEAN_TRUE, XML_BOOLEAN_FALSE, CRM_NODE_MEMBER, ONLINESTATUS,
+    OFFLINESTATUS, CRMD_JOINSTATE_MEMBER, CRMD_JOINSTATE_DOWN,
+    CRMD_ACTION_START, CRMD_ACTION_STOP, CRMD_ACTION_STATUS,
+    CRMD_ACTION_PROMOTE, CRMD_ACTION_DEMOTE, CRMD_ACTION_NOTIFY,
+    CRMD_ACTION_MIGRATE, CRMD_ACTION_MIGRATED,
+    PCMK_RESOURCE_CLASS_OCF, PCMK_RESOURCE_CLASS_STONITH, "heartbeat",
+    "pacemaker", "do_update_resource", "do_state_transition",
+    "do_lrm_query_internal", "peer_update_callback", "crmd",
+    "pacemaker-controld", "pacemaker-attrd", "pacemaker-based",
+};
+
+#define COMPACT_STATIC_NAMES ((unsigned) DIMOF(compact_names))
+
+// Value encodings (low two bits of an attribute value's varint)
+enum compact_value_e {
+    compact_value_string = 0,
+    compact_value_uint   = 1,
+    compact_value_neg    = 2,
+};
+
+// Peers that have announced support for the compact encoding
+static GHashTable *compact_peers = NULL;
+
+// Static dictionary name -> (index + 1)
+static GHashTable *compact_index = NULL;
+
+/*!
+ * \internal
+ * \brief Advertise our support for the compact encoding in a message
+ *
+ * \param[in,out] msg  Ping request or reply to add support to
+ */
+void
+cib_compact_announce(xmlNode *msg)
+{
+    crm_xml_add_int(msg, F_CIB_COMPACT, CIB_COMPACT_VERSION);
+}
+
+/*!
+ * \internal
+ * \brief Record whether a peer supports the compact encoding
+ *
+ * \param[in] peer  Name of node that sent \p msg
+ * \param[in] msg   Ping request or reply from \p peer
+ */
+void
+cib_compact_note_peer(const char *peer, xmlNode *msg)
+{
+    int version = 0;
+
+    if ((peer == NULL) || safe_str_eq(peer, cib_our_uname)) {
+        return;
+    }
+    if (compact_peers == NULL) {
+        compact_peers = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                              NULL);
+    }
+
+    crm_element_value_int(msg, F_CIB_COMPACT, &version);
+    if (version >= CIB_COMPACT_VERSION) {
+        if (g_hash_table_lookup(compact_peers, peer) == NULL) {
+            crm_debug("Peer %s supports compact CIB updates", peer);
+            g_hash_table_insert(compact_peers, strdup(peer), GINT_TO_POINTER(1));
+        }
+    } else {
+        g_hash_table_remove(compact_peers, peer);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Forget what a peer supports (because it left the cluster)
+ *
+ * \param[in] peer  Name of node that left
+ */
+void
+cib_compact_forget_peer(const char *peer)
+{
+    if ((compact_peers != NULL) && (peer != NULL)) {
+        g_hash_table_remove(compact_peers, peer);
+    }
+}
+
+// Whether every active peer is known to support the compact encoding
+static gboolean
+compact_usable(void)
+{
+    GHashTableIter iter;
+    crm_node_t *node = NULL;
+
+    if ((compact_peers == NULL) || (crm_peer_cache == NULL)) {
+        return FALSE;
+    }
+    g_hash_table_iter_init(&iter, crm_peer_cache);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &node)) {
+        if ((node->uname == NULL) || !crm_is_peer_active(node)) {
+            continue;
+        }
+        if (safe_str_neq(node->uname, cib_our_uname)
+            && (g_hash_table_lookup(compact_peers, node->uname) == NULL)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Encoding
+ */
+
+struct compact_encoder_s {
+    GByteArray *out;
+    GHashTable *strings;    // String -> token of strings seen so far
+    unsigned next_token;
+};
+
+static void
+put_varint(GByteArray *out, uint64_t value)
+{
+    do {
+        guint8 byte = value & 0x7f;
+
+        value >>= 7;
+        if (value) {
+            byte |= 0x80;
+        }
+        g_byte_array_append(out, &byte, 1);
+    } while (value);
+}
+
+static void
+put_string(struct compact_encoder_s *encoder, const char *s)
+{
+    gpointer token = g_hash_table_lookup(compact_index, s);
+
+    if (token == NULL) {
+        token = g_hash_table_lookup(encoder->strings, s);
+    }
+    if (token != NULL) {
+        put_varint(encoder->out, GPOINTER_TO_UINT(token));
+
+    } else {
+        size_t len = strlen(s);
+
+        put_varint(encoder->out, 0);
+        put_varint(encoder->out, len);
+        g_byte_array_append(encoder->out, (const guint8 *) s, len);
+        g_hash_table_insert(encoder->strings, (gpointer) s,
+                            GUINT_TO_POINTER(encoder->next_token++));
+    }
+}
+
+// Whether s is a decimal number that would be written back exactly the same
+static gboolean
+canonical_number(const char *s, uint64_t *number, gboolean *negative)
+{
+    size_t len = 0;
+    uint64_t value = 0;
+
+    *negative = (s[0] == '-');
+    if (*negative) {
+        s++;
+    }
+    len = strlen(s);
+    if ((len == 0) || (len > 18) || ((s[0] == '0') && ((len > 1) || *negative))) {
+        return FALSE;
+    }
+    for (; *s != '\0'; s++) {
+        if ((*s < '0') || (*s > '9')) {
+            return FALSE;
+        }
+        value = (value * 10) + (*s - '0');
+    }
+    *number = value;
+    return TRUE;
+}
+
+static void
+put_value(struct compact_encoder_s *encoder, const char *value)
+{
+    uint64_t number = 0;
+    gboolean negative = FALSE;
+
+    if (canonical_number(value, &number, &negative)) {
+        put_varint(encoder->out, (number << 2)
+                   | (negative? compact_value_neg : compact_value_uint));
+
+    } else {
+        gpointer token = g_hash_table_lookup(compact_index, value);
+
+        if (token == NULL) {
+            token = g_hash_table_lookup(encoder->strings, value);
+        }
+        if (token != NULL) {
+            put_varint(encoder->out,
+                       ((uint64_t) GPOINTER_TO_UINT(token)) << 2);
+        } else {
+            size_t len = strlen(value);
+
+            put_varint(encoder->out, compact_value_string);
+            put_varint(encoder->out, len);
+            g_byte_array_append(encoder->out, (const guint8 *) value, len);
+            g_hash_table_insert(encoder->strings, (gpointer) value,
+                                GUINT_TO_POINTER(encoder->next_token++));
+        }
+    }
+}
+
+static gboolean
+put_element(struct compact_encoder_s *encoder, xmlNode *xml, int depth)
+{
+    unsigned count = 0;
+
+    if ((xml->type != XML_ELEMENT_NODE) || (depth > CIB_COMPACT_DEPTH_MAX)) {
+        return FALSE;
+    }
+
+    put_string(encoder, (const char *) xml->name);
+
+    for (xmlAttr *a = xml->properties; a != NULL; a = a->next) {
+        count++;
+    }
+    put_varint(encoder->out, count);
+    for (xmlAttr *a = xml->properties; a != NULL; a = a->next) {
+        const char *value = crm_element_value(xml, (const char *) a->name);
+
+        put_string(encoder, (const char *) a->name);
+        put_value(encoder, value? value : "");
+    }
+
+    count = 0;
+    for (xmlNode *child = xml->children; child != NULL; child = child->next) {
+        count++;
+    }
+    put_varint(encoder->out, count);
+    for (xmlNode *child = xml->children; child != NULL; child = child->next) {
+        if (!put_element(encoder, child, depth + 1)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static void
+init_compact_index(void)
+{
+    if (compact_index == NULL) {
+        compact_index = g_hash_table_new(crm_str_hash, g_str_equal);
+        for (unsigned lpc = 0; lpc < COMPACT_STATIC_NAMES; lpc++) {
+            // Keep the first index of any name listed twice
+            if (g_hash_table_lookup(compact_index, compact_names[lpc]) == NULL) {
+                g_hash_table_insert(compact_index, (gpointer) compact_names[lpc],
+                                    GUINT_TO_POINTER(lpc + 1));
+            }
+        }
+    }
+}
+
+// Encode XML compactly (or return NULL if it cannot or should not be)
+static char *
+compact_encode(xmlNode *xml)
+{
+    struct compact_encoder_s encoder;
+    guint8 header[2] = { CIB_COMPACT_MAGIC, CIB_COMPACT_VERSION };
+    char *encoded = NULL;
+
+    if ((xml == NULL) || !compact_usable()) {
+        return NULL;
+    }
+
+    init_compact_index();
+    encoder.out = g_byte_array_new();
+    encoder.strings = g_hash_table_new(crm_str_hash, g_str_equal);
+    encoder.next_token = COMPACT_STATIC_NAMES + 1;
+
+    g_byte_array_append(encoder.out, header, sizeof(header));
+    if (put_element(&encoder, xml, 0)) {
+        encoded = g_base64_encode(encoder.out->data, encoder.out->len);
+        crm_trace("Encoded %s in %u bytes", crm_element_name(xml),
+                  (unsigned) encoder.out->len);
+    } else {
+        crm_trace("Sending %s as XML: cannot be encoded compactly",
+                  crm_element_name(xml));
+    }
+    g_hash_table_destroy(encoder.strings);
+    g_byte_array_free(encoder.out, TRUE);
+    return encoded;
+}
+
+// Add compactly encoded XML to a message as a field's "_compact" attribute
+static void
+add_compact(xmlNode *msg, const char *field, char *encoded)
+{
+    char *name = crm_strdup_printf("%s_compact", field);
+
+    crm_xml_add(msg, name, encoded);
+    free(name);
+    g_free(encoded);
+}
+
+/*!
+ * \internal
+ * \brief Add a patchset to a peer message, compactly if possible
+ *
+ * \param[in,out] msg    Message to add patchset to
+ * \param[in]     field  Name of message field for patchset
+ * \param[in]     diff   Patchset to add
+ */
+void
+cib_compact_add_patchset(xmlNode *msg, const char *field, xmlNode *diff)
+{
+    int format = 1;
+    char *encoded = NULL;
+
+    crm_element_value_int(diff, "format", &format);
+    if (format == 2) {
+        encoded = compact_encode(diff);
+    }
+    if (encoded != NULL) {
+        add_compact(msg, field, encoded);
+    } else {
+        add_message_xml(msg, field, diff);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Broadcast a request to all peers, with its data compactly if possible
+ *
+ * \param[in,out] request  Request to broadcast (unchanged on return)
+ *
+ * \return TRUE if the request was sent, otherwise FALSE
+ */
+gboolean
+cib_compact_broadcast(xmlNode *request)
+{
+    xmlNode *wrapper = first_named_child(request, F_CIB_CALLDATA);
+    char *encoded = NULL;
+    gboolean sent = FALSE;
+
+    if ((wrapper != NULL) && (__xml_first_child(wrapper) != NULL)
+        && (__xml_next(__xml_first_child(wrapper)) == NULL)) {
+        encoded = compact_encode(__xml_first_child(wrapper));
+    }
+    if (encoded == NULL) {
+        return send_cluster_message(NULL, crm_msg_cib, request, FALSE);
+    }
+
+    // Send the request without its XML data, then put the data back
+    xmlUnlinkNode(wrapper);
+    add_compact(request, F_CIB_CALLDATA, encoded);
+    sent = send_cluster_message(NULL, crm_msg_cib, request, FALSE);
+    xml_remove_prop(request, F_CIB_CALLDATA "_compact");
+    xmlAddChild(request, wrapper);
+    return sent;
+}
+
+/*
+ * Decoding
+ */
+
+struct compact_decoder_s {
+    const guint8 *data;
+    gsize len;
+    gsize pos;
+    GPtrArray *strings;     // Strings introduced in this message
+};
+
+static gboolean
+get_varint(struct compact_decoder_s *decoder, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        guint8 byte;
+
+        if (decoder->pos >= decoder->len) {
+            return FALSE;
+        }
+        byte = decoder->data[decoder->pos++];
+        *value |= ((uint64_t) (byte & 0x7f)) << shift;
+        if ((byte & 0x80) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Look up or read a string given its token (the result must not be freed)
+static const char *
+get_token_string(struct compact_decoder_s *decoder, uint64_t token)
+{
+    if (token == 0) {
+        uint64_t len = 0;
+        char *s = NULL;
+
+        if (!get_varint(decoder, &len) || (len > (decoder->len - decoder->pos))) {
+            return NULL;
+        }
+        s = strndup((const char *) decoder->data + decoder->pos, len);
+        CRM_ASSERT(s != NULL);
+        decoder->pos += len;
+        g_ptr_array_add(decoder->strings, s);
+        return s;
+
+    } else if (token <= COMPACT_STATIC_NAMES) {
+        return compact_names[token - 1];
+
+    } else if ((token - COMPACT_STATIC_NAMES - 1) < decoder->strings->len) {
+        return g_ptr_array_index(decoder->strings,
+                                 token - COMPACT_STATIC_NAMES - 1);
+    }
+    return NULL;
+}
+
+static xmlNode *
+get_element(struct compact_decoder_s *decoder, xmlNode *parent, int depth)
+{
+    uint64_t token = 0;
+    uint64_t count = 0;
+    const char *name = NULL;
+    xmlNode *xml = NULL;
+
+    if ((depth > CIB_COMPACT_DEPTH_MAX) || !get_varint(decoder, &token)
+        || ((name = get_token_string(decoder, token)) == NULL)) {
+        return NULL;
+    }
+    xml = create_xml_node(parent, name);
+
+    if (!get_varint(decoder, &count)) {
+        goto fail;
+    }
+    for (; count > 0; count--) {
+        const char *attr = NULL;
+        uint64_t value = 0;
+
+        if (!get_varint(decoder, &token)
+            || ((attr = get_token_string(decoder, token)) == NULL)
+            || !get_varint(decoder, &value)) {
+            goto fail;
+        }
+        switch (value & 0x3) {
+            case compact_value_string:
+                name = get_token_string(decoder, value >> 2);
+                if (name == NULL) {
+                    goto fail;
+                }
+                crm_xml_add(xml, attr, name);
+                break;
+
+            case compact_value_uint:
+            case compact_value_neg:
+                {
+                    char *number = crm_strdup_printf("%s%llu",
+                        (((value & 0x3) == compact_value_neg)? "-" : ""),
+                        (unsigned long long) (value >> 2));
+
+                    crm_xml_add(xml, attr, number);
+                    free(number);
+                }
+                break;
+
+            default:
+                goto fail;
+        }
+    }
+
+    if (!get_varint(decoder, &count)) {
+        goto fail;
+    }
+    for (; count > 0; count--) {
+        if (get_element(decoder, xml, depth + 1) == NULL) {
+            goto fail;
+        }
+    }
+    return xml;
+
+  fail:
+    if (parent == NULL) {
+        free_xml(xml);
+    }
+    return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Replace compactly-encoded data in a peer message with XML
+ *
+ * \param[in,out] msg    Message received from peer
+ * \param[in]     field  Name of message field for data
+ *
+ * \return TRUE if \p msg now has any data as XML, FALSE on decoding error
+ */
+gboolean
+cib_compact_expand(xmlNode *msg, const char *field)
+{
+    struct compact_decoder_s decoder;
+    char *name = crm_strdup_printf("%s_compact", field);
+    const char *encoded = crm_element_value(msg, name);
+    guchar *data = NULL;
+    xmlNode *diff = NULL;
+
+    if (encoded == NULL) {
+        free(name);
+        return TRUE;
+    }
+
+    init_compact_index();
+    data = g_base64_decode(encoded, &decoder.len);
+    decoder.data = data;
+    decoder.pos = 2;
+    decoder.strings = g_ptr_array_new_with_free_func(free);
+
+    if ((data != NULL) && (decoder.len > 2)
+        && (data[0] == CIB_COMPACT_MAGIC) && (data[1] == CIB_COMPACT_VERSION)) {
+        diff = get_element(&decoder, NULL, 0);
+    }
+    if ((diff != NULL) && (decoder.pos != decoder.len)) {
+        free_xml(diff);
+        diff = NULL;
+    }
+
+    g_ptr_array_free(decoder.strings, TRUE);
+    g_free(data);
+
+    if (diff == NULL) {
+        crm_err("Could not decode compact %s from %s", field,
+                crm_str(crm_element_value(msg, F_ORIG)));
+        free(name);
+        return FALSE;
+    }
+
+    xml_remove_prop(msg, name);
+    free(name);
+    add_message_xml(msg, field, diff);
+    free_xml(diff);
+    return TRUE;
+}
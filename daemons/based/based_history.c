@@ -0,0 +1,199 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include <crm/crm.h>
+#include <crm/cib/internal.h>
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+#include <crm/cluster.h>
+
+#include <pacemaker-based.h>
+
+/*
+ * Recent CIB history
+ *
+ * The last PCMK_cib_sync_history versions of the CIB are remembered by their
+ * version and digest, along with the v2 patchset that led to each. When a peer
+ * that is out of date (because it asked for a resync, or because its digest did
+ * not match in reply to a ping) has a version and digest that we remember, it
+ * is sent only the patchsets it is missing rather than the whole CIB.
+ *
+ * Any change that is not described by a v2 patchset (a replacement, for
+ * example) starts the history over, so the history always describes a single
+ * chain of changes ending with the current CIB. If the peer cannot apply the
+ * patchsets, it asks again for a full resync.
+ */
+
+#define CIB_HISTORY_DEFAULT "100"
+
+struct cib_history_s {
+    int version[3];     // admin_epoch, epoch, num_updates
+    char *digest;       // of the CIB at this version
+    xmlNode *patchset;  // from the previous version (NULL for the first)
+};
+
+static struct cib_history_s *history = NULL;
+static int history_max = -1;
+static int history_start = 0;   // index of oldest entry
+static int history_len = 0;
+
+static int
+history_size(void)
+{
+    if (history_max < 0) {
+        const char *value = daemon_option("cib_sync_history");
+
+        history_max = crm_parse_int(value, CIB_HISTORY_DEFAULT);
+        if (history_max < 0) {
+            history_max = 0;
+        }
+        if (history_max > 0) {
+            history = calloc(history_max, sizeof(struct cib_history_s));
+            CRM_ASSERT(history != NULL);
+        }
+    }
+    return history_max;
+}
+
+static struct cib_history_s *
+history_entry(int n)
+{
+    return &(history[(history_start + n) % history_max]);
+}
+
+static void
+clear_entry(struct cib_history_s *entry)
+{
+    free(entry->digest);
+    free_xml(entry->patchset);
+    entry->digest = NULL;
+    entry->patchset = NULL;
+}
+
+static void
+get_version(xmlNode *xml, int version[3])
+{
+    crm_element_value_int(xml, XML_ATTR_GENERATION_ADMIN, &(version[0]));
+    crm_element_value_int(xml, XML_ATTR_GENERATION, &(version[1]));
+    crm_element_value_int(xml, XML_ATTR_NUMUPDATES, &(version[2]));
+}
+
+/*!
+ * \internal
+ * \brief Remember the current CIB and the change that led to it
+ *
+ * \param[in] patchset  Change that led to the current CIB (or NULL if unknown)
+ *
+ * \note This must be called whenever the_cib changes or is replaced.
+ */
+void
+cib_history_record(xmlNode *patchset)
+{
+    struct cib_history_s *entry = NULL;
+    int format = 1;
+
+    if ((history_size() == 0) || (the_cib == NULL)) {
+        return;
+    }
+
+    if (patchset != NULL) {
+        crm_element_value_int(patchset, "format", &format);
+    }
+    if ((patchset == NULL) || (format != 2)) {
+        // The chain is broken, so start over
+        for (int lpc = 0; lpc < history_len; lpc++) {
+            clear_entry(history_entry(lpc));
+        }
+        history_start = 0;
+        history_len = 0;
+    }
+
+    if (history_len == history_max) {
+        clear_entry(history_entry(0));
+        history_start = (history_start + 1) % history_max;
+        history_len--;
+    }
+
+    entry = history_entry(history_len++);
+    get_version(the_cib, entry->version);
+    entry->digest = calculate_xml_versioned_digest(the_cib, FALSE, TRUE,
+                                                   CRM_FEATURE_SET);
+    entry->patchset = (history_len > 1)? copy_xml(patchset) : NULL;
+}
+
+/*!
+ * \internal
+ * \brief Bring a peer up to date by sending only the changes it is missing
+ *
+ * \param[in] host         Peer to update
+ * \param[in] peer_cib     XML with the peer's CIB version attributes
+ * \param[in] peer_digest  Digest of the peer's CIB
+ *
+ * \return TRUE if the changes were sent, or FALSE if the peer's CIB is not in
+ *         the history (and it must be sent the whole CIB instead)
+ */
+gboolean
+cib_history_sync(const char *host, xmlNode *peer_cib, const char *peer_digest)
+{
+    int version[3] = { -1, -1, -1 };
+    int start = -1;
+    crm_node_t *peer = NULL;
+
+    if ((history_size() == 0) || (host == NULL) || (peer_cib == NULL)
+        || (peer_digest == NULL)) {
+        return FALSE;
+    }
+
+    get_version(peer_cib, version);
+    for (int lpc = history_len - 1; lpc >= 0; lpc--) {
+        struct cib_history_s *entry = history_entry(lpc);
+
+        if ((memcmp(entry->version, version, sizeof(version)) == 0)
+            && safe_str_eq(entry->digest, peer_digest)) {
+            start = lpc + 1;
+            break;
+        }
+    }
+
+    // An up-to-date peer with a different digest needs a full sync
+    if ((start < 1) || (start >= history_len)) {
+        return FALSE;
+    }
+
+    peer = crm_get_peer(0, host);
+    crm_notice("Sending %d change%s to bring %s up to date from %d.%d.%d",
+               history_len - start, ((history_len - start) == 1)? "" : "s",
+               host, version[0], version[1], version[2]);
+
+    for (int lpc = start; lpc < history_len; lpc++) {
+        xmlNode *msg = create_xml_node(NULL, "cib_command");
+
+        crm_xml_add(msg, F_TYPE, T_CIB);
+        crm_xml_add(msg, F_CIB_OPERATION, CIB_OP_APPLY_DIFF);
+        crm_xml_add(msg, F_CIB_HOST, host);
+        crm_xml_add(msg, F_CIB_USER, CRM_DAEMON_USER);
+        crm_xml_add_int(msg, F_CIB_CALLOPTS, cib_discard_reply);
+        crm_xml_add_int(msg, F_CIB_SYNC_DELTA, history_len - lpc - 1);
+        cib_compact_add_patchset(msg, F_CIB_UPDATE_DIFF,
+                                 history_entry(lpc)->patchset);
+
+        if (send_cluster_message(peer, crm_msg_cib, msg, FALSE) == FALSE) {
+            free_xml(msg);
+            return FALSE;
+        }
+        free_xml(msg);
+    }
+    return TRUE;
+}
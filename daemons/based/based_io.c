@@ -14,6 +14,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <dirent.h>
+#include <signal.h>
 
 #include <sys/param.h>
 #include <sys/types.h>
@@ -35,9 +36,23 @@ extern const char *cib_root;
 
 crm_trigger_t *cib_writer = NULL;
 
+/* CIB writes are coalesced: a write is started at most once per delay, and
+ * only one writer runs at a time (the trigger is not dispatched again until
+ * the previous writer exits), with each writer saving the CIB as of when it
+ * starts. Changes made while a write is delayed or in progress are therefore
+ * folded into the next write, which always saves the latest version.
+ */
+#define CIB_WRITE_DELAY_DEFAULT 100 // ms
+
+static guint cib_write_timer = 0;
+static int cib_write_delay = -1;
+static pid_t cib_writer_pid = 0; // Forked writer still running, if any
+
 extern int cib_status;
 
 int write_cib_contents(gpointer p);
+static void cib_diskwrite_complete(mainloop_child_t *p, pid_t pid, int core,
+                                   int signo, int exitcode);
 
 static void
 cib_rename(const char *old)
@@ -145,37 +160,42 @@ static int cib_archive_filter(const struct dirent * a)
     return rc;
 }
 
-static int cib_archive_sort(const struct dirent ** a, const struct dirent **b)
-{
-    /* Order by creation date - most recently created file first */
-    int rc = 0;
-    struct stat buf;
+/* Next sequence number of the backup series, as of when the backups are
+ * sorted (with frequent writes, many backups share the same timestamp, but
+ * each has its own place in the series)
+ */
+static int cib_archive_next = 0;
 
-    time_t a_age = 0;
-    time_t b_age = 0;
+// Greater than any sequence number in the series
+#define CIB_ARCHIVE_WRAP 1000000
 
-    char *a_path = crm_strdup_printf("%s/%s", cib_root, a[0]->d_name);
-    char *b_path = crm_strdup_printf("%s/%s", cib_root, b[0]->d_name);
+// Position of a backup in the series, with the oldest first
+static int
+cib_archive_rank(const char *name)
+{
+    int seq = -1;
 
-    if(stat(a_path, &buf) == 0) {
-        a_age = buf.st_ctime;
-    }
-    if(stat(b_path, &buf) == 0) {
-        b_age = buf.st_ctime;
+    if (sscanf(name, "cib-%d.", &seq) != 1) {
+        return -1; // not part of the series, so try it last
     }
+    return (seq < cib_archive_next)? (seq + CIB_ARCHIVE_WRAP) : seq;
+}
 
-    free(a_path);
-    free(b_path);
+static int cib_archive_sort(const struct dirent ** a, const struct dirent **b)
+{
+    /* Order by place in the series - most recently created file last */
+    int a_rank = cib_archive_rank(a[0]->d_name);
+    int b_rank = cib_archive_rank(b[0]->d_name);
+    int rc = 0;
 
-    if(a_age > b_age) {
+    if (a_rank > b_rank) {
         rc = 1;
-    } else if(a_age < b_age) {
+    } else if (a_rank < b_rank) {
         rc = -1;
     }
 
-    crm_trace("%s (%lu) vs. %s (%lu) : %d",
-	a[0]->d_name, (unsigned long)a_age,
-	b[0]->d_name, (unsigned long)b_age, rc);
+    crm_trace("%s (%d) vs. %s (%d) : %d",
+              a[0]->d_name, a_rank, b[0]->d_name, b_rank, rc);
     return rc;
 }
 
@@ -210,6 +230,7 @@ readCibXmlFile(const char *dir, const char *file, gboolean discard_status)
 
     if (root == NULL) {
         crm_warn("Primary configuration corrupt or unusable, trying backups in %s", cib_root);
+        cib_archive_next = get_last_sequence(cib_root, "cib");
         lpc = scandir(cib_root, &namelist, cib_archive_filter, cib_archive_sort);
         if (lpc < 0) {
             crm_perror(LOG_NOTICE, "scandir(%s) failed", cib_root);
@@ -243,6 +264,11 @@ readCibXmlFile(const char *dir, const char *file, gboolean discard_status)
         crm_warn("Continuing with an empty configuration.");
     }
 
+    /* Bring the configuration up to date with any changes saved since the
+     * last checkpoint
+     */
+    cib_journal_replay(root, dir);
+
     if (cib_writes_enabled && use_valgrind &&
         (crm_is_true(use_valgrind) || strstr(use_valgrind, "pacemaker-based"))) {
 
@@ -326,6 +352,8 @@ uninitializeCib(void)
     }
 
     the_cib = NULL;
+    cib_query_invalidate();
+    cib_shared_withdraw();
 
     crm_debug("Deallocating the CIB.");
 
@@ -336,22 +364,135 @@ uninitializeCib(void)
     return TRUE;
 }
 
+static gboolean
+cib_write_timer_cb(gpointer data)
+{
+    cib_write_timer = 0;
+    mainloop_set_trigger(cib_writer);
+    return FALSE;
+}
+
+static void
+schedule_cib_write(const char *op)
+{
+    if (cib_write_delay < 0) {
+        const char *value = daemon_option("cib_write_delay");
+
+        cib_write_delay = value? crm_parse_int(value, "0")
+                               : CIB_WRITE_DELAY_DEFAULT;
+        if (cib_write_delay < 0) {
+            cib_write_delay = 0;
+        }
+        crm_debug("Coalescing CIB writes within %dms", cib_write_delay);
+    }
+
+    if (cib_write_delay == 0) {
+        crm_debug("Triggering CIB write for %s op", op);
+        mainloop_set_trigger(cib_writer);
+
+    } else if (cib_write_timer == 0) {
+        crm_debug("Scheduling CIB write for %s op in %dms",
+                  op, cib_write_delay);
+        cib_write_timer = g_timeout_add(cib_write_delay, cib_write_timer_cb,
+                                        NULL);
+    } else {
+        crm_trace("CIB write for %s op coalesced with pending write", op);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Wait for a forked writer to exit, and handle its result
+ *
+ * \note The main loop will not reap the writer once this has, since
+ *       cib_diskwrite_complete() ignores writers it no longer expects.
+ */
+static void
+cib_wait_for_writer(void)
+{
+    pid_t pid = cib_writer_pid;
+    int status = 0;
+    int core = 0;
+
+    crm_info("Waiting for disk write process %d to finish", pid);
+    if (waitpid(pid, &status, 0) != pid) {
+        // Treat it as failed, so that nothing else writes the CIB
+        crm_perror(LOG_ERR, "Could not wait for disk write process %d", pid);
+        cib_diskwrite_complete(NULL, pid, 0, SIGCHLD, 1);
+        return;
+    }
+#ifdef WCOREDUMP
+    core = WCOREDUMP(status)? 1 : 0;
+#endif
+    cib_diskwrite_complete(NULL, pid, core,
+                           (WIFSIGNALED(status)? WTERMSIG(status) : 0),
+                           (WIFEXITED(status)? WEXITSTATUS(status) : 0));
+}
+
+/*!
+ * \internal
+ * \brief Write out the CIB immediately if a write is still pending
+ *
+ * If a forked writer is still running, this waits for it first, so that the
+ * two do not race on cib.xml and its digest.
+ *
+ * \note This is intended for use at shutdown, when the main loop will not
+ *       run again to dispatch a delayed write.
+ */
+void
+cib_flush_writes(void)
+{
+    if (cib_write_timer == 0) {
+        return;
+    }
+    g_source_remove(cib_write_timer);
+    cib_write_timer = 0;
+
+    if (cib_writer_pid != 0) {
+        cib_wait_for_writer();
+    }
+
+    if (cib_writes_enabled && (cib_status == pcmk_ok) && (the_cib != NULL)) {
+        crm_info("Writing pending CIB changes before exiting");
+        write_cib_contents(the_cib);
+    }
+}
+
 /*
  * This method will free the old CIB pointer on success and the new one
- * on failure.
+ * on failure. If diff is given and the change can be journaled, cib.xml is
+ * written only at the next checkpoint.
  */
 int
-activateCibXml(xmlNode * new_cib, gboolean to_disk, const char *op)
+activateCibXml(xmlNode * new_cib, gboolean to_disk, const char *op,
+               xmlNode *diff)
 {
     if (new_cib) {
         xmlNode *saved_cib = the_cib;
 
-        CRM_ASSERT(new_cib != saved_cib);
-        the_cib = new_cib;
-        free_xml(saved_cib);
-        if (cib_writes_enabled && cib_status == pcmk_ok && to_disk) {
-            crm_debug("Triggering CIB write for %s op", op);
-            mainloop_set_trigger(cib_writer);
+        // new_cib is the_cib if the request modified it in place
+        if (new_cib != saved_cib) {
+            the_cib = new_cib;
+            pcmk__xml_free_later(saved_cib);
+        }
+
+        // Let digests of the CIB reuse the text of unchanged sections
+        pcmk__xml_cache_digests(the_cib);
+
+        // Queries must not be answered from the old CIB any more
+        cib_query_invalidate();
+        cib_shared_publish(the_cib);
+        cib_history_record(diff);
+
+        if (cib_writes_enabled && cib_status == pcmk_ok) {
+            if (!to_disk) {
+                // Keep the journaled versions contiguous
+                cib_journal_append(diff, FALSE);
+
+            } else if (!cib_journal_append(diff, TRUE)
+                       || cib_journal_checkpoint_due()) {
+                schedule_cib_write(op);
+            }
         }
         return pcmk_ok;
     }
@@ -365,9 +506,23 @@ activateCibXml(xmlNode * new_cib, gboolean to_disk, const char *op)
     return -ENODATA;
 }
 
+static gint64 diskwrite_started = 0;
+
 static void
 cib_diskwrite_complete(mainloop_child_t * p, pid_t pid, int core, int signo, int exitcode)
 {
+    if (pid != cib_writer_pid) {
+        crm_trace("Ignoring disk write process %d (already handled)", pid);
+        return;
+    }
+    cib_writer_pid = 0;
+
+    pcmk__metric_observe_us(pcmk__metric(pcmk__metric_histogram,
+                                         "cib_write_seconds",
+                                         "Time taken to write the CIB to disk",
+                                         NULL, NULL),
+                            g_get_monotonic_time() - diskwrite_started);
+
     if (signo) {
         crm_notice("Disk write process terminated with signal %d (pid=%d, core=%d)", signo, pid,
                    core);
@@ -382,6 +537,7 @@ cib_diskwrite_complete(mainloop_child_t * p, pid_t pid, int core, int signo, int
         cib_writes_enabled = FALSE;
     }
 
+    cib_journal_checkpoint_done(exitcode == 0);
     mainloop_trigger_complete(cib_writer);
 }
 
@@ -391,6 +547,11 @@ write_cib_contents(gpointer p)
     int exit_rc = pcmk_ok;
     xmlNode *cib_local = NULL;
 
+    /* Later changes go to a new journal, so the one this write makes
+     * obsolete can be discarded once it completes
+     */
+    cib_journal_checkpoint_start();
+
     /* Make a copy of the CIB to write (possibly in a forked child) */
     if (p) {
         /* Synchronous write out */
@@ -408,6 +569,7 @@ write_cib_contents(gpointer p)
          */
         qb_log_ctl(QB_LOG_BLACKBOX, QB_LOG_CONF_ENABLED, QB_FALSE);
 
+        diskwrite_started = g_get_monotonic_time();
         pid = fork();
         if (pid < 0) {
             crm_perror(LOG_ERR, "Disabling disk writes after fork failure");
@@ -417,6 +579,7 @@ write_cib_contents(gpointer p)
 
         if (pid) {
             /* Parent */
+            cib_writer_pid = pid;
             mainloop_child_add(pid, 0, "disk-writer", NULL, cib_diskwrite_complete);
             if (bb_state == QB_LOG_STATE_ENABLED) {
                 /* Re-enable now that it it safe */
@@ -439,7 +602,10 @@ write_cib_contents(gpointer p)
 
     /* A nonzero exit code will cause further writes to be disabled */
     free_xml(cib_local);
-    if (p == NULL) {
+    if (p) {
+        cib_journal_checkpoint_done(exit_rc == pcmk_ok);
+
+    } else {
         crm_exit_t exit_code = CRM_EX_OK;
 
         switch (exit_rc) {
@@ -0,0 +1,544 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <crm/crm.h>
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+#include <crm/common/internal.h>
+
+#include <pacemaker-based.h>
+
+/*
+ * CIB journal
+ *
+ * If PCMK_cib_journal is enabled, each configuration change is saved by
+ * appending its (v2) patchset to cib.journal, rather than by rewriting
+ * cib.xml. A full checkpoint of cib.xml is written only once
+ * PCMK_cib_checkpoint_changes changes have been journaled, or
+ * PCMK_cib_checkpoint_interval seconds after the first change since the last
+ * checkpoint, whichever comes first.
+ *
+ * Each record is a header line giving its sequence number, the length of the
+ * patchset text, and the MD5 sum of the text, followed by the text itself and
+ * a newline. Status changes are not journaled, because the status section is
+ * not kept across restarts, but every change of the CIB version (including
+ * the num_updates bump of a status change) gets a record, so that consecutive
+ * records always continue each other's version. Records of changes without a
+ * configuration part are not synced on their own; a lost one can only be
+ * followed by lost records anyway.
+ *
+ * When a checkpoint starts, the journal is renamed to cib.journal.old and a
+ * new journal is started for later changes; the old journal is removed once
+ * the checkpoint has been written successfully. At startup, both journals are
+ * replayed on top of cib.xml, skipping any change the CIB already contains
+ * (as determined by the admin_epoch and epoch the change was made to). Once a
+ * change has been applied, replay stops at the first record whose sequence
+ * number or source version (admin_epoch, epoch and num_updates) does not
+ * continue the one before it, in either journal.
+ */
+
+#define JOURNAL_FILE        "cib.journal"
+#define JOURNAL_OLD_FILE    "cib.journal.old"
+
+#define CHECKPOINT_CHANGES_DEFAULT  100
+#define CHECKPOINT_INTERVAL_DEFAULT 60  // seconds
+
+static int journal_fd = -1;
+static int journal_enabled = -1;
+static int checkpoint_changes = CHECKPOINT_CHANGES_DEFAULT;
+static int checkpoint_interval = CHECKPOINT_INTERVAL_DEFAULT;
+static int changes_since_checkpoint = 0;
+static guint checkpoint_timer = 0;
+static unsigned long long next_sequence = 1;
+
+static char *
+journal_path(const char *dir, const char *file)
+{
+    return crm_strdup_printf("%s/%s", (dir? dir : cib_root), file);
+}
+
+static int
+journal_option(const char *name, int default_value)
+{
+    const char *value = daemon_option(name);
+    int result = value? crm_parse_int(value, NULL) : default_value;
+
+    return (result > 0)? result : default_value;
+}
+
+/*!
+ * \internal
+ * \brief Check whether configuration changes should be journaled
+ *
+ * \return TRUE if PCMK_cib_journal is enabled, otherwise FALSE
+ */
+gboolean
+cib_journal_enabled(void)
+{
+    if (journal_enabled < 0) {
+        const char *value = daemon_option("cib_journal");
+
+        journal_enabled = (value != NULL) && crm_is_true(value);
+        checkpoint_changes = journal_option("cib_checkpoint_changes",
+                                            CHECKPOINT_CHANGES_DEFAULT);
+        checkpoint_interval = journal_option("cib_checkpoint_interval",
+                                             CHECKPOINT_INTERVAL_DEFAULT);
+        if (journal_enabled) {
+            crm_info("Journaling CIB changes, with checkpoints every %d "
+                     "changes or %ds", checkpoint_changes, checkpoint_interval);
+        }
+    }
+    return journal_enabled;
+}
+
+static void
+disable_journal(void)
+{
+    crm_err("Disabling CIB journal and writing changes in full");
+    journal_enabled = FALSE;
+    if (journal_fd >= 0) {
+        close(journal_fd);
+        journal_fd = -1;
+    }
+}
+
+static gboolean
+checkpoint_timer_cb(gpointer data)
+{
+    checkpoint_timer = 0;
+    crm_debug("Triggering CIB checkpoint after %ds", checkpoint_interval);
+    mainloop_set_trigger(cib_writer);
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Copy a patchset without anything that should not be journaled
+ *
+ * \param[in] patchset  Patchset to copy
+ *
+ * \return Newly allocated copy of \p patchset without status changes or
+ *         digest, or NULL if \p patchset cannot be journaled
+ */
+static xmlNode *
+journal_patchset(xmlNode *patchset)
+{
+    int format = 1;
+    xmlNode *copy = NULL;
+    xmlNode *change = NULL;
+
+    crm_element_value_int(patchset, "format", &format);
+    if (format != 2) {
+        return NULL;
+    }
+
+    copy = copy_xml(patchset);
+    xml_remove_prop(copy, XML_ATTR_DIGEST);
+
+    change = __xml_first_child_element(copy);
+    while (change != NULL) {
+        xmlNode *next = __xml_next_element(change);
+        const char *path = crm_element_value(change, XML_DIFF_PATH);
+        const char *op = crm_element_value(change, XML_DIFF_OP);
+
+        if (path && (strncmp(path, "/" XML_TAG_CIB "/" XML_CIB_TAG_STATUS,
+                             strlen("/" XML_TAG_CIB "/" XML_CIB_TAG_STATUS))
+                     == 0)) {
+            free_xml(change);
+
+        } else if (safe_str_eq(op, "create")
+                   && safe_str_eq(path, "/" XML_TAG_CIB)
+                   && safe_str_eq(crm_element_name(
+                                      __xml_first_child_element(change)),
+                                  XML_CIB_TAG_STATUS)) {
+            free_xml(change);
+        }
+        change = next;
+    }
+    return copy;
+}
+
+static gboolean
+write_all(int fd, const char *buffer, size_t length)
+{
+    while (length > 0) {
+        ssize_t rc = write(fd, buffer, length);
+
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FALSE;
+        }
+        buffer += rc;
+        length -= rc;
+    }
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Append a CIB change to the journal
+ *
+ * \param[in] patchset        Patchset describing the change
+ * \param[in] config_changed  Whether the change affects the configuration
+ *
+ * \return TRUE if the change was journaled (and cib.xml need not be written
+ *         until the next checkpoint), otherwise FALSE
+ * \note Changes that do not affect the configuration are journaled only to
+ *       keep the recorded versions contiguous.
+ */
+gboolean
+cib_journal_append(xmlNode *patchset, gboolean config_changed)
+{
+    int add[3] = { 0, 0, 0 };
+    int del[3] = { 0, 0, 0 };
+    xmlNode *record_xml = NULL;
+    char *text = NULL;
+    char *digest = NULL;
+    char *header = NULL;
+    gboolean rc = FALSE;
+
+    if ((patchset == NULL) || !cib_journal_enabled()) {
+        return FALSE;
+    }
+
+    xml_patch_versions(patchset, add, del);
+    if (!config_changed
+        && (add[0] == del[0]) && (add[1] == del[1]) && (add[2] == del[2])) {
+        return FALSE; // Nothing to record
+    }
+
+    record_xml = journal_patchset(patchset);
+    if (record_xml == NULL) {
+        if (config_changed) {
+            crm_debug("Writing CIB in full because change is not a v2 patchset");
+        }
+        return FALSE;
+    }
+
+    if (journal_fd < 0) {
+        char *path = journal_path(NULL, JOURNAL_FILE);
+
+        journal_fd = open(path, O_WRONLY | O_CREAT | O_APPEND,
+                          S_IRUSR | S_IWUSR);
+        if (journal_fd < 0) {
+            crm_perror(LOG_ERR, "Could not open CIB journal %s", path);
+        }
+        free(path);
+        if (journal_fd < 0) {
+            free_xml(record_xml);
+            disable_journal();
+            return FALSE;
+        }
+    }
+
+    text = dump_xml_unformatted(record_xml);
+    free_xml(record_xml);
+    digest = crm_md5sum(text);
+    header = crm_strdup_printf("%llu %lu %s\n", next_sequence,
+                               (unsigned long) strlen(text), digest);
+
+    if (write_all(journal_fd, header, strlen(header))
+        && write_all(journal_fd, text, strlen(text))
+        && write_all(journal_fd, "\n", 1)
+        && (!config_changed || (fsync(journal_fd) == 0))) {
+
+        crm_trace("Journaled CIB change %llu (%lu bytes)",
+                  next_sequence, (unsigned long) strlen(text));
+        next_sequence++;
+        if (config_changed) {
+            changes_since_checkpoint++;
+            rc = TRUE;
+        }
+
+    } else {
+        crm_perror(LOG_ERR, "Could not append to CIB journal");
+        disable_journal();
+    }
+
+    free(header);
+    free(digest);
+    free(text);
+
+    if (rc && (checkpoint_timer == 0)) {
+        checkpoint_timer = g_timeout_add_seconds(checkpoint_interval,
+                                                 checkpoint_timer_cb, NULL);
+    }
+    return rc;
+}
+
+/*!
+ * \internal
+ * \brief Check whether enough changes have been journaled for a checkpoint
+ *
+ * \return TRUE if cib.xml should be written now, otherwise FALSE
+ */
+gboolean
+cib_journal_checkpoint_due(void)
+{
+    return changes_since_checkpoint >= checkpoint_changes;
+}
+
+/*!
+ * \internal
+ * \brief Start a new journal for changes made after a checkpoint
+ *
+ * \note This must be called before the CIB is copied for a checkpoint.
+ */
+void
+cib_journal_checkpoint_start(void)
+{
+    char *path = journal_path(NULL, JOURNAL_FILE);
+    char *old_path = journal_path(NULL, JOURNAL_OLD_FILE);
+
+    if (checkpoint_timer != 0) {
+        g_source_remove(checkpoint_timer);
+        checkpoint_timer = 0;
+    }
+    changes_since_checkpoint = 0;
+
+    if (journal_fd >= 0) {
+        close(journal_fd);
+        journal_fd = -1;
+    }
+
+    /* If an earlier checkpoint did not complete, its old journal is still
+     * needed, so keep appending to the current one.
+     */
+    if ((access(path, F_OK) == 0) && (access(old_path, F_OK) != 0)) {
+        if (rename(path, old_path) < 0) {
+            crm_perror(LOG_WARNING, "Could not rename %s to %s",
+                       path, old_path);
+        }
+    }
+    free(path);
+    free(old_path);
+}
+
+/*!
+ * \internal
+ * \brief Discard journaled changes that are included in a checkpoint
+ *
+ * \param[in] success  Whether the checkpoint was written successfully
+ */
+void
+cib_journal_checkpoint_done(gboolean success)
+{
+    char *old_path = NULL;
+
+    if (!success) {
+        return;
+    }
+    old_path = journal_path(NULL, JOURNAL_OLD_FILE);
+    if ((unlink(old_path) < 0) && (errno != ENOENT)) {
+        crm_perror(LOG_WARNING, "Could not remove %s", old_path);
+    }
+    free(old_path);
+}
+
+static void
+cib_versions(xmlNode *cib, int versions[2])
+{
+    versions[0] = 0;
+    versions[1] = 0;
+    crm_element_value_int(cib, XML_ATTR_GENERATION_ADMIN, &versions[0]);
+    crm_element_value_int(cib, XML_ATTR_GENERATION, &versions[1]);
+}
+
+static int
+compare_versions(const int a[2], const int b[2])
+{
+    if (a[0] != b[0]) {
+        return (a[0] < b[0])? -1 : 1;
+    } else if (a[1] != b[1]) {
+        return (a[1] < b[1])? -1 : 1;
+    }
+    return 0;
+}
+
+/* Where replay has got to, across both journals. Until the first record is
+ * applied, the CIB's num_updates is not known (cib.xml is written with 0), so
+ * only the first applied record is matched to the CIB by admin_epoch and
+ * epoch alone; every record after it must continue it exactly.
+ */
+struct replay_state_s {
+    int applied;                    // number of records applied
+    unsigned long long sequence;    // last record applied (or 0 if none)
+    int version[3];                 // CIB version after last applied record
+};
+
+/*!
+ * \internal
+ * \brief Apply one journal record to a CIB
+ *
+ * \return TRUE if replay should continue with the next record, otherwise FALSE
+ */
+static gboolean
+replay_record(xmlNode *cib, const char *text, const char *filename,
+              unsigned long long sequence, struct replay_state_s *state)
+{
+    int add[3] = { 0, 0, 0 };
+    int del[3] = { 0, 0, 0 };
+    int current[2];
+    int rc = pcmk_ok;
+    xmlNode *patchset = NULL;
+
+    if ((state->sequence != 0) && (sequence != state->sequence + 1)) {
+        crm_warn("Ignoring rest of %s: record %llu does not follow record %llu",
+                 filename, sequence, state->sequence);
+        return FALSE;
+    }
+
+    patchset = string2xml(text);
+    if (patchset == NULL) {
+        crm_warn("Ignoring rest of %s: record %llu is not valid XML",
+                 filename, sequence);
+        return FALSE;
+    }
+
+    xml_patch_versions(patchset, add, del);
+    cib_versions(cib, current);
+
+    if (state->sequence != 0) {
+        if ((del[0] != state->version[0]) || (del[1] != state->version[1])
+            || (del[2] != state->version[2])) {
+            crm_warn("Ignoring rest of %s: change %llu was made to %d.%d.%d, "
+                     "but CIB is at %d.%d.%d", filename, sequence,
+                     del[0], del[1], del[2], state->version[0],
+                     state->version[1], state->version[2]);
+            free_xml(patchset);
+            return FALSE;
+        }
+
+    } else if (compare_versions(add, current) <= 0) {
+        crm_trace("Skipping journaled change %llu: already in CIB", sequence);
+        free_xml(patchset);
+        return TRUE;
+
+    } else if (compare_versions(del, current) != 0) {
+        crm_warn("Ignoring rest of %s: change %llu was made to %d.%d, "
+                 "but CIB is at %d.%d", filename, sequence,
+                 del[0], del[1], current[0], current[1]);
+        free_xml(patchset);
+        return FALSE;
+    }
+
+    rc = xml_apply_patchset(cib, patchset, FALSE);
+    free_xml(patchset);
+    if (rc != pcmk_ok) {
+        crm_warn("Ignoring rest of %s: could not apply change %llu: %s",
+                 filename, sequence, pcmk_strerror(rc));
+        return FALSE;
+    }
+    crm_xml_add_int(cib, XML_ATTR_GENERATION_ADMIN, add[0]);
+    crm_xml_add_int(cib, XML_ATTR_GENERATION, add[1]);
+    crm_xml_add_int(cib, XML_ATTR_NUMUPDATES, add[2]);
+
+    state->applied++;
+    state->sequence = sequence;
+    memcpy(state->version, add, sizeof(state->version));
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Replay one journal file
+ */
+static void
+replay_journal(xmlNode *cib, const char *dir, const char *file,
+               struct replay_state_s *state)
+{
+    char *filename = journal_path(dir, file);
+    char *contents = crm_read_contents(filename);
+    char *pos = contents;
+    char *end = contents? (contents + strlen(contents)) : NULL;
+    int applied = state->applied;
+
+    while ((pos != NULL) && (*pos != '\0')) {
+        unsigned long long sequence = 0;
+        unsigned long length = 0;
+        char digest[33] = { '\0', };
+        char *text = strchr(pos, '\n');
+        char *calculated = NULL;
+        gboolean more = FALSE;
+
+        if ((text == NULL)
+            || (sscanf(pos, "%llu %lu %32s", &sequence, &length, digest) != 3)
+            || ((size_t) (end - text) < length + 2)
+            || (text[length + 1] != '\n')) {
+            crm_warn("Ignoring rest of %s: record header or text is incomplete",
+                     filename);
+            break;
+        }
+        text++;
+        text[length] = '\0';
+
+        calculated = crm_md5sum(text);
+        if (safe_str_neq(calculated, digest)) {
+            crm_warn("Ignoring rest of %s: record %llu has a bad checksum",
+                     filename, sequence);
+        } else {
+            more = replay_record(cib, text, filename, sequence, state);
+        }
+        free(calculated);
+        if (!more) {
+            break;
+        }
+
+        if (sequence >= next_sequence) {
+            next_sequence = sequence + 1;
+        }
+        pos = text + length + 1;
+    }
+
+    applied = state->applied - applied;
+    if (applied > 0) {
+        crm_notice("Applied %d journaled change%s from %s",
+                   applied, ((applied == 1)? "" : "s"), filename);
+    }
+    free(contents);
+    free(filename);
+}
+
+/*!
+ * \internal
+ * \brief Apply any journaled changes not yet in a CIB read from disk
+ *
+ * \param[in,out] cib  CIB read from cib.xml (or a backup)
+ * \param[in]     dir  Directory containing CIB and journal
+ *
+ * \return Number of changes applied
+ */
+int
+cib_journal_replay(xmlNode *cib, const char *dir)
+{
+    struct replay_state_s state = { 0, };
+
+    if (cib == NULL) {
+        return 0;
+    }
+
+    /* The current journal continues where the old one stopped, so replay
+     * checks contiguity across both
+     */
+    replay_journal(cib, dir, JOURNAL_OLD_FILE, &state);
+    replay_journal(cib, dir, JOURNAL_FILE, &state);
+    return state.applied;
+}
@@ -132,6 +132,11 @@ cib_process_readwrite(const char *op, int options, const char *section, xmlNode
  */
 static int sync_in_progress = 0;
 
+/* Set when changes sent to bring us up to date could not be applied, so the
+ * next sync request asks for the whole CIB
+ */
+static gboolean sync_delta_failed = FALSE;
+
 void
 send_sync_request(const char *host)
 {
@@ -144,6 +149,21 @@ send_sync_request(const char *host)
     crm_xml_add(sync_me, F_CIB_OPERATION, CIB_OP_SYNC_ONE);
     crm_xml_add(sync_me, F_CIB_DELEGATED, cib_our_uname);
 
+    // Let the peer send only the changes we are missing, if it can
+    if ((the_cib != NULL) && !sync_delta_failed) {
+        char *digest = calculate_xml_versioned_digest(the_cib, FALSE, TRUE,
+                                                      CRM_FEATURE_SET);
+
+        crm_xml_add(sync_me, XML_ATTR_GENERATION_ADMIN,
+                    crm_element_value(the_cib, XML_ATTR_GENERATION_ADMIN));
+        crm_xml_add(sync_me, XML_ATTR_GENERATION,
+                    crm_element_value(the_cib, XML_ATTR_GENERATION));
+        crm_xml_add(sync_me, XML_ATTR_NUMUPDATES,
+                    crm_element_value(the_cib, XML_ATTR_NUMUPDATES));
+        crm_xml_add(sync_me, XML_ATTR_DIGEST, digest);
+        free(digest);
+    }
+
     send_cluster_message(host ? crm_get_peer(0, host) : NULL, crm_msg_cib, sync_me, FALSE);
     free_xml(sync_me);
 }
@@ -164,6 +184,8 @@ cib_process_ping(const char *op, int options, const char *section, xmlNode * req
     crm_xml_add(*answer, XML_ATTR_CRM_VERSION, CRM_FEATURE_SET);
     crm_xml_add(*answer, XML_ATTR_DIGEST, digest);
     crm_xml_add(*answer, F_CIB_PING_ID, seq);
+    cib_compact_announce(*answer);
+    cib_compact_note_peer(host, req);
 
     if (cs == NULL) {
         cs = qb_log_callsite_get(__func__, __FILE__, __FUNCTION__, LOG_TRACE, __LINE__, crm_trace_nonlog);
@@ -274,6 +296,32 @@ cib_server_process_diff(const char *op, int options, const char *section, xmlNod
                         xmlNode ** answer)
 {
     int rc = pcmk_ok;
+    int remaining = -1;
+
+    // A sync request may be answered with just the changes we are missing
+    crm_element_value_int(req, F_CIB_SYNC_DELTA, &remaining);
+    if ((remaining >= 0) && !sync_delta_failed) {
+        rc = cib_process_diff(op, options, section, req, input, existing_cib,
+                              result_cib, answer);
+        if (rc == -pcmk_err_old_data) {
+            // Another peer already sent us this change
+            crm_trace("Ignoring duplicate change sent for resync");
+
+        } else if (rc != pcmk_ok) {
+            crm_warn("Requesting full CIB refresh because change sent for resync"
+                     " could not be applied: %s " CRM_XS " rc=%d",
+                     pcmk_strerror(rc), rc);
+            free_xml(*result_cib);
+            *result_cib = NULL;
+            sync_delta_failed = TRUE;
+            send_sync_request(NULL);
+
+        } else if (remaining == 0) {
+            crm_info("Resync completed by applying missing changes");
+            sync_in_progress = 0;
+        }
+        return rc;
+    }
 
     if (sync_in_progress > MAX_DIFF_RETRY) {
         /* Don't ignore diffs forever; the last request may have been lost.
@@ -339,6 +387,7 @@ cib_process_replace_svr(const char *op, int options, const char *section, xmlNod
         cib_process_replace(op, options, section, req, input, existing_cib, result_cib, answer);
     if (rc == pcmk_ok && safe_str_eq(tag, XML_TAG_CIB)) {
         sync_in_progress = 0;
+        sync_delta_failed = FALSE;
     }
     return rc;
 }
@@ -456,8 +505,15 @@ sync_our_cib(xmlNode * request, gboolean all)
     const char *host = crm_element_value(request, F_ORIG);
     const char *op = crm_element_value(request, F_CIB_OPERATION);
 
-    xmlNode *replace_request = cib_msg_copy(request, FALSE);
+    xmlNode *replace_request = NULL;
+
+    if (!all && safe_str_eq(op, CIB_OP_SYNC_ONE)
+        && cib_history_sync(host, request,
+                            crm_element_value(request, XML_ATTR_DIGEST))) {
+        return pcmk_ok;
+    }
 
+    replace_request = cib_msg_copy(request, FALSE);
     CRM_CHECK(the_cib != NULL,;);
     CRM_CHECK(replace_request != NULL,;);
 
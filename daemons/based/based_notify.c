@@ -23,26 +23,508 @@
 #include <crm/msg_xml.h>
 
 #include <crm/common/xml.h>
+#include <crm/common/internal.h>
 #include <pacemaker-based.h>
 
 int pending_updates = 0;
 
 struct cib_notification_s {
     xmlNode *msg;
-    struct iovec *iov;
-    int32_t iov_size;
+    xmlNode *diff;  // patchset, if msg is a diff notification
+    struct iovec *iov;      // prepared for IPC clients, once one needs it
+    struct iovec *iov_lz4;  // same, for IPC clients that accept LZ4
+    gboolean failed;        // whether preparing for IPC clients failed
 };
 
+/* Client ID -> list of paths that the client wants diff notifications for
+ * (only clients that registered a filter have an entry)
+ */
+static GHashTable *notify_filters = NULL;
+
+/* Diff notifications for an IPC client that is not keeping up (one with at
+ * least NOTIFY_BACKLOG events already queued) are not queued as well. They are
+ * instead merged into a single held-back notification, whose patchset has the
+ * changes of them all, and which is sent once the client catches up (checked
+ * every NOTIFY_RETRY_MS) or before any other event for it.
+ *
+ * If the merged patchset grows past NOTIFY_MERGE_MAX changes, its changes are
+ * dropped and its source version is set to its target version, and the whole
+ * current CIB is sent with it (as F_CIB_UPDATE_CIB), which is then cheaper
+ * than the changes. Applying such a patchset fails with -pcmk_err_diff_resync,
+ * so a client that cannot apply it can take the CIB from the notification
+ * instead of querying it again. Patchsets in the version 1 format cannot be
+ * merged, so they are always queued.
+ */
+#define NOTIFY_BACKLOG      10
+#define NOTIFY_MERGE_MAX    1000
+#define NOTIFY_RETRY_MS     500
+
+struct held_diff_s {
+    xmlNode *msg;       // notification, with merged patchset
+    int changes;        // number of changes merged into the patchset
+    gboolean resync;    // whether changes were dropped
+};
+
+// Client ID -> held-back diff notification (only for clients that have one)
+static GHashTable *held_diffs = NULL;
+static guint held_diffs_timer = 0;
+
+static void
+free_filter_list(gpointer data)
+{
+    g_list_free_full((GList *) data, free);
+}
+
+/*!
+ * \internal
+ * \brief Add or remove a path from a client's diff notification filter
+ *
+ * \param[in] client   Client to update
+ * \param[in] path     Absolute XPath (such as /cib/status/node_state) of the
+ *                     elements the client is interested in, or section name
+ * \param[in] enabled  Whether to add (TRUE) or remove (FALSE) \p path
+ *
+ * \note A client with no filter receives notifications of all changes.
+ */
+void
+cib_notify_set_filter(crm_client_t *client, const char *path, gboolean enabled)
+{
+    char *key = NULL;
+    GList *paths = NULL;
+    GList *existing = NULL;
+
+    if (path[0] != '/') {
+        const char *section = path;
+
+        path = get_object_path(section);
+        if (path == NULL) {
+            crm_warn("Ignoring diff notification filter for %s (%s): "
+                     "unknown section %s", client->name, client->id, section);
+            return;
+        }
+    }
+    if ((path[0] == '/') && (path[1] == '/')) {
+        path++; // Patchset paths are absolute, not "anywhere"
+    }
+
+    if (notify_filters == NULL) {
+        notify_filters = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                               free_filter_list);
+    }
+
+    // Take the list out of the table, since its head may change
+    if (g_hash_table_lookup_extended(notify_filters, client->id,
+                                     (gpointer *) &key, (gpointer *) &paths)) {
+        g_hash_table_steal(notify_filters, client->id);
+    } else {
+        key = strdup(client->id);
+    }
+
+    existing = g_list_find_custom(paths, path, (GCompareFunc) strcmp);
+    if (enabled && (existing == NULL)) {
+        paths = g_list_prepend(paths, strdup(path));
+        crm_debug("Sending diff notifications of %s to %s (%s)",
+                  path, client->name, client->id);
+
+    } else if (!enabled && (existing != NULL)) {
+        free(existing->data);
+        paths = g_list_delete_link(paths, existing);
+        crm_debug("No longer sending diff notifications of %s to %s (%s)",
+                  path, client->name, client->id);
+    }
+
+    if (paths == NULL) {
+        free(key);
+    } else {
+        g_hash_table_insert(notify_filters, key, paths);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Forget a disconnecting client's diff notification filter
+ *
+ * \param[in] client  Client that is disconnecting
+ */
+void
+cib_notify_forget_client(crm_client_t *client)
+{
+    if ((notify_filters != NULL) && (client->id != NULL)) {
+        g_hash_table_remove(notify_filters, client->id);
+    }
+    if ((held_diffs != NULL) && (client->id != NULL)) {
+        g_hash_table_remove(held_diffs, client->id);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Check whether one path is the same as, or within, another
+ *
+ * \return TRUE if \p ancestor is a prefix of \p path that ends at a step
+ *         boundary, otherwise FALSE
+ */
+static gboolean
+path_within(const char *path, const char *ancestor)
+{
+    size_t len = strlen(ancestor);
+
+    if (strncmp(path, ancestor, len) != 0) {
+        return FALSE;
+    }
+    return (path[len] == '\0') || (path[len] == '/') || (path[len] == '[');
+}
+
+/*!
+ * \internal
+ * \brief Check whether a patchset change affects a filtered path
+ *
+ * \param[in] change  Change from a version 2 patchset
+ * \param[in] path    Path of \p change
+ * \param[in] filter  Filtered path
+ *
+ * \return TRUE if \p change is within \p filter's subtree, or deletes or
+ *         creates an element containing it, otherwise FALSE
+ * \note Attribute changes and moves of an ancestor of \p filter leave its
+ *       subtree alone, so they are not relevant.
+ */
+static gboolean
+change_affects(xmlNode *change, const char *path, const char *filter)
+{
+    const char *op = crm_element_value(change, XML_DIFF_OP);
+
+    if (path_within(path, filter)) {
+        return TRUE;
+    }
+    if (!path_within(filter, path)) {
+        return FALSE; // Unrelated part of the CIB
+    }
+
+    // The change is to an ancestor of the filtered path
+    if (safe_str_eq(op, "delete")) {
+        return TRUE;
+    }
+    if (safe_str_eq(op, "create")) {
+        xmlNode *created = __xml_first_child_element(change);
+        const char *id = ID(created);
+        char *created_path = NULL;
+        gboolean rc = FALSE;
+
+        if (created == NULL) {
+            return FALSE;
+        }
+        if (id == NULL) {
+            created_path = crm_strdup_printf("%s/%s", path,
+                                             crm_element_name(created));
+        } else {
+            created_path = crm_strdup_printf("%s/%s[@id='%s']", path,
+                                             crm_element_name(created), id);
+        }
+        rc = path_within(filter, created_path)
+             || path_within(created_path, filter);
+        free(created_path);
+        return rc;
+    }
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Check whether a patchset touches anything a filter is interested in
+ *
+ * \param[in] paths  Client's filter
+ * \param[in] diff   Patchset to check
+ *
+ * \return FALSE if the patchset is known to have no relevant changes,
+ *         otherwise TRUE
+ * \note Patchsets in the version 1 format are always considered relevant,
+ *       since they do not list the changed paths.
+ */
+static gboolean
+diff_matches_filter(GList *paths, xmlNode *diff)
+{
+    int format = 1;
+
+    crm_element_value_int(diff, "format", &format);
+    if (format != 2) {
+        return TRUE;
+    }
+
+    for (xmlNode *change = __xml_first_child(diff); change != NULL;
+         change = __xml_next(change)) {
+
+        const char *path = crm_element_value(change, XML_DIFF_PATH);
+
+        if ((path == NULL) || safe_str_neq(crm_element_name(change),
+                                           XML_DIFF_CHANGE)) {
+            continue;
+        }
+        for (GList *iter = paths; iter != NULL; iter = iter->next) {
+            if (change_affects(change, path, (const char *) iter->data)) {
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
 void attach_cib_generation(xmlNode * msg, const char *field, xmlNode * a_cib);
 
 void do_cib_notify(int options, const char *op, xmlNode * update,
                    int result, xmlNode * result_data, const char *msg_type);
 
+static void
+free_held_diff(gpointer data)
+{
+    struct held_diff_s *held = data;
+
+    free_xml(held->msg);
+    free(held);
+}
+
+static gboolean
+client_backed_up(crm_client_t *client)
+{
+    return (client->event_queue != NULL)
+           && (g_queue_get_length(client->event_queue) >= NOTIFY_BACKLOG);
+}
+
+static gboolean
+has_held_diff(crm_client_t *client)
+{
+    return (held_diffs != NULL)
+           && (g_hash_table_lookup(held_diffs, client->id) != NULL);
+}
+
+static int
+count_changes(xmlNode *diff)
+{
+    int count = 0;
+
+    for (xmlNode *change = __xml_first_child(diff); change != NULL;
+         change = __xml_next(change)) {
+        if (safe_str_eq(crm_element_name(change), XML_DIFF_CHANGE)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Replace a patchset version (source or target) with one from another patchset
+static void
+copy_diff_version(xmlNode *diff, const char *to, xmlNode *from_diff,
+                  const char *from)
+{
+    xmlNode *version = first_named_child(diff, XML_DIFF_VERSION);
+    xmlNode *from_version = first_named_child(from_diff, XML_DIFF_VERSION);
+    xmlNode *old = first_named_child(version, to);
+    xmlNode *new = NULL;
+
+    if ((version == NULL) || (from_version == NULL)) {
+        return;
+    }
+    free_xml(old);
+    new = create_xml_node(version, to);
+    copy_in_properties(new, first_named_child(from_version, from));
+}
+
+static void
+send_held(crm_client_t *client, struct held_diff_s *held)
+{
+    crm_trace("Sending held-back diff notification with %d change%s to "
+              "%s (%s)", held->changes, ((held->changes == 1)? "" : "s"),
+              client->name, client->id);
+    if (held->resync) {
+        // The client will need the whole CIB, so save it a round trip
+        free_xml(first_named_child(held->msg, F_CIB_UPDATE_CIB));
+        add_message_xml(held->msg, F_CIB_UPDATE_CIB, the_cib);
+    }
+    if (crm_ipcs_send(client, 0, held->msg, crm_ipc_server_event) < 0) {
+        crm_warn("Notification of client %s/%s failed",
+                 client->name, client->id);
+    }
+}
+
+// Send held-back notifications to clients that have caught up
+static gboolean
+send_held_diffs(gpointer user_data)
+{
+    GHashTableIter iter;
+    const char *id = NULL;
+    struct held_diff_s *held = NULL;
+
+    g_hash_table_iter_init(&iter, held_diffs);
+    while (g_hash_table_iter_next(&iter, (gpointer *) &id,
+                                  (gpointer *) &held)) {
+        crm_client_t *client = crm_client_get_by_id(id);
+
+        if (client == NULL) {
+            g_hash_table_iter_remove(&iter);
+
+        } else if (!client_backed_up(client)) {
+            send_held(client, held);
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+    if (g_hash_table_size(held_diffs) == 0) {
+        held_diffs_timer = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Add a diff notification to a client's held-back notification
+ *
+ * \param[in] client  Client to notify
+ * \param[in] msg     Diff notification (with a version 2 patchset)
+ * \param[in] diff    Patchset from \p msg
+ */
+static void
+hold_diff(crm_client_t *client, xmlNode *msg, xmlNode *diff)
+{
+    struct held_diff_s *held = NULL;
+    xmlNode *new_msg = NULL;
+    xmlNode *merged = NULL;
+
+    if (held_diffs == NULL) {
+        held_diffs = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                           free_held_diff);
+    }
+
+    held = g_hash_table_lookup(held_diffs, client->id);
+    if (held == NULL) {
+        crm_debug("Holding back diff notifications for %s (%s) "
+                  "until it catches up", client->name, client->id);
+        held = calloc(1, sizeof(struct held_diff_s));
+        CRM_ASSERT(held != NULL);
+        held->msg = copy_xml(msg);
+        held->changes = count_changes(diff);
+
+        // The request is of no use once merged with others
+        free_xml(first_named_child(held->msg, F_CIB_UPDATE));
+        g_hash_table_insert(held_diffs, strdup(client->id), held);
+        if (held_diffs_timer == 0) {
+            held_diffs_timer = g_timeout_add(NOTIFY_RETRY_MS,
+                                             send_held_diffs, NULL);
+        }
+        return;
+    }
+
+    // The rest of the notification comes from the newest one
+    new_msg = create_xml_node(NULL, crm_element_name(msg));
+    copy_in_properties(new_msg, msg);
+    attach_cib_generation(new_msg, "cib_generation", the_cib);
+    merged = first_named_child(held->msg, F_CIB_UPDATE_RESULT);
+    xmlUnlinkNode(merged);
+    xmlAddChild(new_msg, merged);
+    free_xml(held->msg);
+    held->msg = new_msg;
+    merged = get_message_xml(new_msg, F_CIB_UPDATE_RESULT);
+
+    copy_diff_version(merged, XML_DIFF_VTARGET, diff, XML_DIFF_VTARGET);
+    if (held->resync) {
+        copy_diff_version(merged, XML_DIFF_VSOURCE, diff, XML_DIFF_VTARGET);
+        return;
+    }
+
+    // The digest (if any) is of the CIB after the last change
+    if (crm_element_value(diff, XML_ATTR_DIGEST) == NULL) {
+        xml_remove_prop(merged, XML_ATTR_DIGEST);
+    } else {
+        crm_xml_add(merged, XML_ATTR_DIGEST,
+                    crm_element_value(diff, XML_ATTR_DIGEST));
+    }
+
+    for (xmlNode *change = __xml_first_child(diff); change != NULL;
+         change = __xml_next(change)) {
+        if (safe_str_eq(crm_element_name(change), XML_DIFF_CHANGE)) {
+            add_node_copy(merged, change);
+            held->changes++;
+        }
+    }
+
+    if (held->changes > NOTIFY_MERGE_MAX) {
+        xmlNode *change = __xml_first_child(merged);
+
+        crm_notice("%s (%s) is too far behind, so it will be told to "
+                   "re-read the CIB", client->name, client->id);
+        while (change != NULL) {
+            xmlNode *next = __xml_next(change);
+
+            if (safe_str_eq(crm_element_name(change), XML_DIFF_CHANGE)) {
+                free_xml(change);
+            }
+            change = next;
+        }
+        copy_diff_version(merged, XML_DIFF_VSOURCE, diff, XML_DIFF_VTARGET);
+        xml_remove_prop(merged, XML_ATTR_DIGEST);
+        held->resync = TRUE;
+    }
+}
+
+/*!
+ * \internal
+ * \brief Send a client's held-back diff notification, if it has one
+ *
+ * \param[in] client  Client to notify
+ *
+ * \note This must be called before any other event is sent to the client, so
+ *       that events stay in order.
+ */
+void
+cib_notify_send_held(crm_client_t *client)
+{
+    struct held_diff_s *held = NULL;
+
+    if ((held_diffs == NULL) || (client->id == NULL)) {
+        return;
+    }
+    held = g_hash_table_lookup(held_diffs, client->id);
+    if (held != NULL) {
+        send_held(client, held);
+        g_hash_table_remove(held_diffs, client->id);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Get a notification prepared for sending to IPC clients
+ *
+ * \param[in,out] update  Notification to send
+ * \param[in]     lz4     Whether the client accepts LZ4 compression
+ *
+ * \return Prepared notification, or NULL if it could not be prepared
+ * \note Each variant is prepared only once, when the first client needs it.
+ *       The same message is sent to many clients, so it is never sent in
+ *       shared memory (which the first recipient would unlink).
+ */
+static struct iovec *
+notification_iov(struct cib_notification_s *update, bool lz4)
+{
+    struct iovec **iov = lz4? &(update->iov_lz4) : &(update->iov);
+
+    if ((*iov == NULL) && !update->failed) {
+        ssize_t rc = pcmk__ipc_prepare_text(0, dump_xml_unformatted(update->msg),
+                                            iov, 0,
+                                            lz4? crm_ipc_accept_lz4 : 0);
+
+        if (rc < 0) {
+            crm_notice("Could not notify clients: %s " CRM_XS " rc=%lld",
+                       pcmk_strerror(rc), (long long) rc);
+            update->failed = TRUE;
+        }
+    }
+    return *iov;
+}
+
 static gboolean
 cib_notify_send_one(gpointer key, gpointer value, gpointer user_data)
 {
     const char *type = NULL;
     gboolean do_send = FALSE;
+    struct iovec *iov = NULL;
 
     crm_client_t *client = value;
     struct cib_notification_s *update = user_data;
@@ -59,7 +541,16 @@ cib_notify_send_one(gpointer key, gpointer value, gpointer user_data)
 
     CRM_LOG_ASSERT(type != NULL);
     if (is_set(client->options, cib_notify_diff) && safe_str_eq(type, T_CIB_DIFF_NOTIFY)) {
-        do_send = TRUE;
+        GList *paths = NULL;
+
+        if ((notify_filters != NULL) && (update->diff != NULL)) {
+            paths = g_hash_table_lookup(notify_filters, client->id);
+        }
+        do_send = (paths == NULL) || diff_matches_filter(paths, update->diff);
+        if (!do_send) {
+            crm_trace("Skipping diff notification for %s (%s): "
+                      "no changes match its filter", client->name, client->id);
+        }
 
     } else if (is_set(client->options, cib_notify_replace)
                && safe_str_eq(type, T_CIB_REPLACE_NOTIFY)) {
@@ -76,10 +567,28 @@ cib_notify_send_one(gpointer key, gpointer value, gpointer user_data)
         do_send = TRUE;
     }
 
+    if (do_send && (client->kind == CRM_CLIENT_IPC)) {
+        int format = 1;
+
+        if (update->diff != NULL) {
+            crm_element_value_int(update->diff, "format", &format);
+        }
+        if ((format == 2)
+            && (has_held_diff(client) || client_backed_up(client))) {
+            hold_diff(client, update->msg, update->diff);
+            return FALSE;
+        }
+        cib_notify_send_held(client);
+    }
+
     if (do_send) {
         switch (client->kind) {
             case CRM_CLIENT_IPC:
-                if (crm_ipcs_sendv(client, update->iov, crm_ipc_server_event) < 0) {
+                iov = notification_iov(update,
+                                       is_set(client->flags,
+                                              crm_client_flag_ipc_lz4));
+                if ((iov == NULL)
+                    || (crm_ipcs_sendv(client, iov, crm_ipc_server_event) < 0)) {
                     crm_warn("Notification of client %s/%s failed", client->name, client->id);
                 }
                 break;
@@ -100,23 +609,16 @@ cib_notify_send_one(gpointer key, gpointer value, gpointer user_data)
 static void
 cib_notify_send(xmlNode * xml)
 {
-    struct iovec *iov;
-    struct cib_notification_s update;
-
-    ssize_t rc = crm_ipc_prepare(0, xml, &iov, 0);
+    struct cib_notification_s update = { NULL, };
 
     crm_trace("Notifying clients");
-    if (rc > 0) {
-        update.msg = xml;
-        update.iov = iov;
-        update.iov_size = rc;
-        g_hash_table_foreach_remove(client_connections, cib_notify_send_one, &update);
-
-    } else {
-        crm_notice("Could not notify clients: %s " CRM_XS " rc=%lld",
-                   pcmk_strerror(rc), (long long) rc);
+    update.msg = xml;
+    if (safe_str_eq(crm_element_value(xml, F_SUBTYPE), T_CIB_DIFF_NOTIFY)) {
+        update.diff = get_message_xml(xml, F_CIB_UPDATE_RESULT);
     }
-    pcmk_free_ipc_event(iov);
+    g_hash_table_foreach_remove(client_connections, cib_notify_send_one, &update);
+    pcmk_free_ipc_event(update.iov);
+    pcmk_free_ipc_event(update.iov_lz4);
     crm_trace("Notify complete");
 }
 
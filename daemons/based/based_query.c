@@ -0,0 +1,426 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include <crm/crm.h>
+#include <crm/cib/internal.h>
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+#include <crm/common/ipcs.h>
+#include <crm/common/internal.h>
+
+#include <pacemaker-based.h>
+
+/*
+ * Read-only query service
+ *
+ * Queries from the read-only IPC channel for the whole CIB or one of its
+ * sections (the kind that crm_mon and most other tools make) do not need the
+ * request processing that writes go through. They are instead answered from a
+ * snapshot: a private copy of the CIB that is made when the first such query
+ * arrives after a change, is never modified, and is freed once the CIB has
+ * changed and no query is using it any more.
+ *
+ * Serializing the reply is the expensive part of a query, so it is done by
+ * PCMK_cib_query_threads worker threads (by default, one per processor), and
+ * only the preparing and sending of the finished reply is done in the main
+ * loop. The serialized text of the whole CIB is kept with the snapshot, so a
+ * burst of queries between two changes serializes the CIB only once. Workers
+ * never log (logging is not thread-safe), so anything that might is left to
+ * the main loop.
+ *
+ * Workers may finish in any order, so each client's queries are kept in a
+ * queue in the order they arrived, and a reply is sent only once the replies
+ * to all the client's earlier queries have been.
+ *
+ * Queries that need anything else (XPath, ACL filtering, another host, and so
+ * on) are processed as before.
+ */
+
+struct cib_snapshot_s {
+    int refs;           // only used in the main thread
+    xmlNode *xml;       // never modified while referenced
+    char *text;         // serialized xml, once a worker has needed it
+};
+
+struct cib_query_s {
+    struct cib_snapshot_s *snapshot;
+    xmlNode *section;   // section of snapshot queried (NULL for whole CIB)
+    char *reply_start;  // serialized reply, without the end of its start tag
+    char *client_id;
+    char *call_id;
+    gboolean sync_reply;
+    uint32_t accepts;   // crm_ipc_accept_* flags usable for client
+    uint32_t request_id;
+    char *text;         // serialized reply (set by worker)
+    gboolean done;      // whether worker has finished with query
+};
+
+// Snapshot of the_cib, if one has been made since the last change
+static struct cib_snapshot_s *current_snapshot = NULL;
+
+// Client ID -> GQueue of its unanswered queries, oldest first
+static GHashTable *pending_queries = NULL;
+
+static int query_threads = -1;
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+static GMutex snapshot_text_lock;
+#endif
+
+static void
+snapshot_unref(struct cib_snapshot_s *snapshot)
+{
+    if ((snapshot != NULL) && (--snapshot->refs == 0)) {
+        free_xml(snapshot->xml);
+        free(snapshot->text);
+        free(snapshot);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Stop answering new queries from the current snapshot
+ *
+ * \note This must be called whenever the_cib changes or is replaced.
+ */
+void
+cib_query_invalidate(void)
+{
+    snapshot_unref(current_snapshot);
+    current_snapshot = NULL;
+    cib__acl_views_invalidate();
+}
+
+static struct cib_snapshot_s *
+snapshot_ref(void)
+{
+    if (current_snapshot == NULL) {
+        current_snapshot = calloc(1, sizeof(struct cib_snapshot_s));
+        CRM_ASSERT(current_snapshot != NULL);
+        current_snapshot->refs = 1; // Held until the next change
+        current_snapshot->xml = copy_xml(the_cib);
+        crm_trace("Took read-only snapshot of CIB %s.%s.%s",
+                  crm_element_value(the_cib, XML_ATTR_GENERATION_ADMIN),
+                  crm_element_value(the_cib, XML_ATTR_GENERATION),
+                  crm_element_value(the_cib, XML_ATTR_NUMUPDATES));
+    }
+    current_snapshot->refs++;
+    return current_snapshot;
+}
+
+static void
+free_query(struct cib_query_s *query)
+{
+    snapshot_unref(query->snapshot);
+    free(query->reply_start);
+    free(query->client_id);
+    free(query->call_id);
+    free(query->text);
+    free(query);
+}
+
+// Get (and cache) the serialized text of a snapshot (in any thread)
+static const char *
+snapshot_text(struct cib_snapshot_s *snapshot)
+{
+    const char *text = NULL;
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    g_mutex_lock(&snapshot_text_lock);
+#endif
+    if (snapshot->text == NULL) {
+        snapshot->text = dump_xml_unformatted(snapshot->xml);
+    }
+    text = snapshot->text;
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    g_mutex_unlock(&snapshot_text_lock);
+#endif
+    return text;
+}
+
+/*!
+ * \internal
+ * \brief Serialize a reply without data, leaving its start tag open
+ *
+ * \param[in] reply  Reply without data (an empty cib-reply element)
+ *
+ * \return Newly allocated text of \p reply without the "/>" that closes it
+ */
+static char *
+reply_start_text(xmlNode *reply)
+{
+    char *reply_text = dump_xml_unformatted(reply);
+    size_t reply_len = strlen(reply_text);
+
+    CRM_ASSERT((reply_len > 2) && (strcmp(reply_text + reply_len - 2, "/>") == 0));
+    reply_text[reply_len - 2] = '\0';
+    return reply_text;
+}
+
+// Complete a serialized reply with its data (in any thread)
+static char *
+reply_text(const char *reply_start, const char *data)
+{
+    // This is exactly what add_message_xml() and dumping the reply would give
+    return crm_strdup_printf("%s><" F_CIB_CALLDATA ">%s</" F_CIB_CALLDATA
+                             "></cib-reply>", reply_start, data);
+}
+
+// Serialize a query reply (in any thread, so without logging)
+static void
+prepare_reply(gpointer user_data)
+{
+    struct cib_query_s *query = user_data;
+    const char *data = NULL;
+    char *section_text = NULL;
+
+    if (query->section == NULL) {
+        data = snapshot_text(query->snapshot);
+    } else {
+        section_text = dump_xml_unformatted(query->section);
+        data = section_text;
+    }
+
+    query->text = reply_text(query->reply_start, data);
+    free(section_text);
+}
+
+// Prepare and send a serialized query reply (in the main thread)
+static void
+send_reply(struct cib_query_s *query)
+{
+    crm_client_t *client = crm_client_get_by_id(query->client_id);
+    struct iovec *iov = NULL;
+    ssize_t rc = 0;
+
+    if (client == NULL) {
+        crm_debug("Could not send response %s: client %s not found",
+                  query->call_id, query->client_id);
+        return;
+    }
+
+    rc = pcmk__ipc_prepare_text(query->request_id, query->text, &iov, 0,
+                                query->accepts);
+    query->text = NULL; // Now owned by (and freed by) the IPC layer
+    if (rc >= 0) {
+        if (query->sync_reply) {
+            client->request_id = 0;
+        }
+        crm_trace("Sending %s read-only query response %s to %s",
+                  (query->sync_reply? "synchronous" : "asynchronous"),
+                  query->call_id, client->name);
+        rc = crm_ipcs_sendv(client, iov,
+                            crm_ipc_server_free
+                            | (query->sync_reply? crm_ipc_flags_none
+                                                : crm_ipc_server_event));
+    }
+    if (rc < 0) {
+        crm_warn("%s reply to %s failed: %s " CRM_XS " rc=%lld",
+                 (query->sync_reply? "Synchronous" : "Asynchronous"),
+                 client->name, pcmk_strerror(rc), (long long) rc);
+    }
+}
+
+// Send a client's finished replies that no earlier reply is waiting for
+static void
+reply_finished(gpointer user_data)
+{
+    struct cib_query_s *query = user_data;
+    const char *client_id = NULL;
+    GQueue *queue = NULL;
+
+    query->done = TRUE;
+    CRM_CHECK(g_hash_table_lookup_extended(pending_queries, query->client_id,
+                                           (gpointer *) &client_id,
+                                           (gpointer *) &queue),
+              free_query(query); return);
+
+    while (!g_queue_is_empty(queue)
+           && ((struct cib_query_s *) g_queue_peek_head(queue))->done) {
+        query = g_queue_pop_head(queue);
+        send_reply(query);
+        free_query(query);
+    }
+    if (g_queue_is_empty(queue)) {
+        g_hash_table_remove(pending_queries, client_id);
+    }
+}
+
+static int
+query_thread_count(void)
+{
+    if (query_threads < 0) {
+        const char *value = daemon_option("cib_query_threads");
+
+        if (value == NULL) {
+            query_threads = crm_procfs_num_cores();
+        } else {
+            query_threads = crm_parse_int(value, "0");
+        }
+        if (query_threads < 0) {
+            query_threads = 0;
+        }
+        crm_debug("Using %d threads for read-only CIB queries", query_threads);
+    }
+    return query_threads;
+}
+
+/*!
+ * \internal
+ * \brief Check whether a query can be answered from a snapshot
+ *
+ * \param[in] request  Query request
+ * \param[in] client   Client that sent request
+ * \param[out] section Where to store section queried (NULL for whole CIB)
+ *
+ * \return TRUE if \p request can be answered from a snapshot, otherwise FALSE
+ */
+static gboolean
+query_is_simple(xmlNode *request, crm_client_t *client, const char **section)
+{
+    int call_options = 0;
+    const char *host = crm_element_value(request, F_CIB_HOST);
+
+    *section = crm_element_value(request, F_CIB_SECTION);
+    crm_element_value_int(request, F_CIB_CALLOPTS, &call_options);
+
+    if ((the_cib == NULL) || (cib_status != pcmk_ok) || cib_legacy_mode()
+        || (client->kind != CRM_CLIENT_IPC)
+        || safe_str_neq(crm_element_value(request, F_CIB_OPERATION),
+                        CIB_OP_QUERY)) {
+        return FALSE;
+    }
+    if ((host != NULL) && (host[0] != '\0')
+        && safe_str_neq(host, cib_our_uname)) {
+        return FALSE;
+    }
+    if (call_options & (cib_xpath|cib_no_children|cib_discard_reply)) {
+        return FALSE;
+    }
+
+#if ENABLE_ACL
+    if (pcmk_acl_required(crm_element_value(request, F_CIB_USER))
+        && crm_is_true(cib_pref(config_hash, "enable-acl"))) {
+        return FALSE;
+    }
+#endif
+
+    if (safe_str_eq(*section, XML_CIB_TAG_SECTION_ALL)
+        || safe_str_eq(*section, XML_TAG_CIB)) {
+        *section = NULL;
+    }
+    // An error reply for an unknown or missing section is left to the usual path
+    return (*section == NULL) || (get_object_root(*section, the_cib) != NULL);
+}
+
+/*!
+ * \internal
+ * \brief Answer a query from a CIB snapshot, if possible
+ *
+ * \param[in] id       IPC request ID
+ * \param[in] flags    IPC flags of request
+ * \param[in] request  Client request
+ * \param[in] client   Client that sent request
+ *
+ * \return TRUE if the reply will be sent from a snapshot, FALSE if the request
+ *         must be processed as usual
+ */
+gboolean
+cib_query_offload(uint32_t id, uint32_t flags, xmlNode *request,
+                  crm_client_t *client)
+{
+    struct cib_query_s *query = NULL;
+    const char *section = NULL;
+    int call_options = 0;
+    xmlNode *reply = NULL;
+    GQueue *queue = NULL;
+
+    if ((query_thread_count() == 0)
+        || !query_is_simple(request, client, &section)) {
+        return FALSE;
+    }
+
+    crm_element_value_int(request, F_CIB_CALLOPTS, &call_options);
+
+    query = calloc(1, sizeof(struct cib_query_s));
+    CRM_ASSERT(query != NULL);
+    query->snapshot = snapshot_ref();
+    if (section != NULL) {
+        // Found here rather than by the worker, because lookups may log
+        query->section = get_object_root(section, query->snapshot->xml);
+    }
+    query->client_id = strdup(client->id);
+    query->call_id = crm_element_value_copy(request, F_CIB_CALLID);
+    query->sync_reply = is_set(call_options, cib_sync_call);
+    query->request_id = query->sync_reply? id : 0;
+    query->accepts = pcmk__ipc_client_accepts(client);
+
+    // The reply is the same as cib_process_command() would create
+    reply = create_xml_node(NULL, "cib-reply");
+    crm_xml_add(reply, F_TYPE, T_CIB);
+    crm_xml_add(reply, F_CIB_OPERATION, CIB_OP_QUERY);
+    crm_xml_add(reply, F_CIB_CALLID, query->call_id);
+    crm_xml_add(reply, F_CIB_CLIENTID, client->id);
+    crm_xml_add_int(reply, F_CIB_CALLOPTS, call_options);
+    crm_xml_add_int(reply, F_CIB_RC, pcmk_ok);
+    query->reply_start = reply_start_text(reply);
+    free_xml(reply);
+
+    crm_trace("Answering query %s from %s from snapshot",
+              query->call_id, client->name);
+
+    if (pending_queries == NULL) {
+        pending_queries = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                free,
+                                                (GDestroyNotify) g_queue_free);
+    }
+    queue = g_hash_table_lookup(pending_queries, client->id);
+    if (queue == NULL) {
+        queue = g_queue_new();
+        g_hash_table_insert(pending_queries, strdup(client->id), queue);
+    }
+    g_queue_push_tail(queue, query);
+
+    // The query threads are the CIB manager's worker threads
+    pcmk__workers_init(query_threads);
+    pcmk__workers_push(prepare_reply, reply_finished, query);
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Serialize a reply to a query for the whole CIB
+ *
+ * Replies to queries that are not offloaded to the query threads (such as
+ * those from the controller before each scheduler run) reuse the text of the
+ * current snapshot too, so the CIB is serialized once per change however many
+ * clients query it.
+ *
+ * \param[in] reply  Reply without data (an empty cib-reply element)
+ *
+ * \return Newly allocated text identical to that of \p reply with the_cib
+ *         attached as its data
+ */
+char *
+cib_query_full_reply_text(xmlNode *reply)
+{
+    struct cib_snapshot_s *snapshot = snapshot_ref();
+    char *reply_start = reply_start_text(reply);
+    char *text = reply_text(reply_start, snapshot_text(snapshot));
+
+    free(reply_start);
+    snapshot_unref(snapshot);
+    return text;
+}
@@ -108,10 +108,16 @@ init_remote_listener(int port, gboolean encrypted)
         crm_gnutls_global_init();
         /* gnutls_global_set_log_level (10); */
         gnutls_global_set_log_function(debug_log);
+        gnutls_anon_allocate_server_credentials(&anon_cred_s);
+#  ifdef HAVE_GNUTLS_ANON_SET_SERVER_KNOWN_DH_PARAMS
+        // Use a standard (RFC 7919) group rather than generating one
+        gnutls_anon_set_server_known_dh_params(anon_cred_s,
+                                               GNUTLS_SEC_PARAM_MEDIUM);
+#  else
         gnutls_dh_params_init(&dh_params);
         gnutls_dh_params_generate2(dh_params, DH_BITS);
-        gnutls_anon_allocate_server_credentials(&anon_cred_s);
         gnutls_anon_set_server_dh_params(anon_cred_s, dh_params);
+#  endif
 #endif
     } else {
         crm_warn("Starting a plain_text listener on port %d.", port);
@@ -385,6 +391,8 @@ cib_remote_connection_destroy(gpointer user_data)
         close(csock);
     }
 
+    cib_notify_forget_client(client);
+    cib_bulk_forget_client(client);
     crm_client_destroy(client);
 
     crm_trace("Freed the cib client");
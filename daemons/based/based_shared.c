@@ -0,0 +1,88 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <crm/crm.h>
+#include <crm/cib/internal.h>
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+
+#include <pacemaker-based.h>
+
+/*
+ * Shared CIB snapshot
+ *
+ * If PCMK_cib_shared_snapshot is enabled, every CIB that is activated is
+ * published to CIB_SNAPSHOT_FILE (see lib/cib/cib_snapshot.c), where local
+ * clients that are not subject to ACLs read it instead of querying it over
+ * IPC. This costs a serialization of the whole CIB per change here, in
+ * exchange for not sending the CIB to every reader.
+ */
+
+static int shared_enabled = -1;
+
+/*!
+ * \internal
+ * \brief Remove the shared CIB snapshot, so that clients query the CIB manager
+ */
+void
+cib_shared_withdraw(void)
+{
+    if ((unlink(CIB_SNAPSHOT_FILE) < 0) && (errno != ENOENT)) {
+        crm_perror(LOG_WARNING, "Could not remove %s", CIB_SNAPSHOT_FILE);
+    }
+}
+
+static gboolean
+cib_shared_enabled(void)
+{
+    if (shared_enabled < 0) {
+        const char *value = daemon_option("cib_shared_snapshot");
+
+        shared_enabled = (value != NULL) && crm_is_true(value);
+        if (shared_enabled) {
+            crm_info("Publishing the CIB to %s for local readers",
+                     CIB_SNAPSHOT_FILE);
+        } else {
+            // Don't leave a snapshot from an earlier run for clients to find
+            cib_shared_withdraw();
+        }
+    }
+    return shared_enabled;
+}
+
+/*!
+ * \internal
+ * \brief Publish a newly activated CIB, if shared snapshots are enabled
+ *
+ * \param[in] cib  CIB that was just activated
+ */
+void
+cib_shared_publish(xmlNode *cib)
+{
+    int rc = pcmk_ok;
+
+    if ((cib == NULL) || !cib_shared_enabled()) {
+        return;
+    }
+
+    rc = cib__publish_snapshot(cib, CIB_SNAPSHOT_FILE);
+    if (rc != pcmk_ok) {
+        /* Clients would keep reading an outdated CIB, so make them query us
+         * instead from now on
+         */
+        crm_err("Disabling shared CIB snapshot after failing to publish it: "
+                "%s", pcmk_strerror(rc));
+        shared_enabled = FALSE;
+        cib_shared_withdraw();
+    }
+}
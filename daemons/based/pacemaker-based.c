@@ -170,6 +170,7 @@ main(int argc, char **argv)
     }
 
     crm_log_init(NULL, LOG_INFO, TRUE, FALSE, argc, argv, FALSE);
+    pcmk__mainloop_use_scalable();
 
     if (cib_root == NULL) {
         cib_root = CRM_CONFIG_DIR;
@@ -185,6 +186,9 @@ main(int argc, char **argv)
         return CRM_EX_FATAL;
     }
 
+    // Keep ACL-filtered views of the CIB between changes
+    cib__acl_views_enable();
+
     /* read local config file */
     cib_init();
 
@@ -257,6 +261,9 @@ cib_peer_update_callback(enum crm_status_type type, crm_node_t * node, const voi
 {
     switch (type) {
         case crm_status_processes:
+            if (is_not_set(node->processes, crm_proc_cpg)) {
+                cib_compact_forget_peer(node->uname);
+            }
             if (cib_legacy_mode()
                 && is_not_set(node->processes, crm_get_cluster_proc())) {
 
@@ -272,6 +279,9 @@ cib_peer_update_callback(enum crm_status_type type, crm_node_t * node, const voi
 
         case crm_status_uname:
         case crm_status_nstate:
+            if (!crm_is_peer_active(node)) {
+                cib_compact_forget_peer(node->uname);
+            }
             if (cib_shutdown_flag && (crm_active_peers() < 2)
                 && crm_hash_table_size(client_connections) == 0) {
 
@@ -323,6 +333,8 @@ cib_init(void)
 
     if (stand_alone) {
         cib_is_master = TRUE;
+    } else {
+        pcmk__notify_ready(crm_proc_based);
     }
 
     /* Create the mainloop and run it... */
@@ -345,7 +357,7 @@ startCib(const char *filename)
     gboolean active = FALSE;
     xmlNode *cib = readCibXmlFile(cib_root, filename, !preserve_status);
 
-    if (activateCibXml(cib, TRUE, "start") == 0) {
+    if (activateCibXml(cib, TRUE, "start", NULL) == 0) {
         int port = 0;
         const char *port_s = NULL;
 
@@ -89,7 +89,16 @@ gboolean verifyCibXml(xmlNode *cib);
 xmlNode *readCibXml(char *buffer);
 xmlNode *readCibXmlFile(const char *dir, const char *file,
                         gboolean discard_status);
-int activateCibXml(xmlNode *doc, gboolean to_disk, const char *op);
+int activateCibXml(xmlNode *doc, gboolean to_disk, const char *op,
+                   xmlNode *diff);
+void cib_flush_writes(void);
+
+gboolean cib_journal_enabled(void);
+gboolean cib_journal_append(xmlNode *patchset, gboolean config_changed);
+gboolean cib_journal_checkpoint_due(void);
+void cib_journal_checkpoint_start(void);
+void cib_journal_checkpoint_done(gboolean success);
+int cib_journal_replay(xmlNode *cib, const char *dir);
 
 xmlNode *createCibRequest(gboolean isLocal, const char *operation,
                           const char *section, const char *verbose,
@@ -145,6 +154,28 @@ void cib_diff_notify(int options, const char *client, const char *call_id,
                      xmlNode *old_cib);
 void cib_replace_notify(const char *origin, xmlNode *update, int result,
                         xmlNode *diff);
+void cib_notify_set_filter(crm_client_t *client, const char *path,
+                           gboolean enabled);
+void cib_notify_forget_client(crm_client_t *client);
+void cib_notify_send_held(crm_client_t *client);
+gboolean cib_query_offload(uint32_t id, uint32_t flags, xmlNode *request,
+                           crm_client_t *client);
+void cib_query_invalidate(void);
+char *cib_query_full_reply_text(xmlNode *reply);
+int cib_bulk_stage(xmlNode *request, crm_client_t *client);
+void cib_bulk_unstage(xmlNode *request, crm_client_t *client);
+void cib_bulk_forget_client(crm_client_t *client);
+void cib_history_record(xmlNode *patchset);
+void cib_shared_publish(xmlNode *cib);
+void cib_shared_withdraw(void);
+gboolean cib_history_sync(const char *host, xmlNode *peer_cib,
+                          const char *peer_digest);
+void cib_compact_announce(xmlNode *msg);
+void cib_compact_note_peer(const char *peer, xmlNode *msg);
+void cib_compact_forget_peer(const char *peer);
+void cib_compact_add_patchset(xmlNode *msg, const char *field, xmlNode *diff);
+gboolean cib_compact_broadcast(xmlNode *request);
+gboolean cib_compact_expand(xmlNode *msg, const char *field);
 
 static inline const char *
 cib_config_lookup(const char *opt)
@@ -14,9 +14,13 @@
 #include <controld_fsa.h>
 #include <controld_utils.h>
 #include <controld_messages.h>
+#include <controld_transition.h>
 
 crm_ipc_t *attrd_ipc = NULL;
 
+// Connection for attribute change notifications (if PCMK_attrd_early_abort)
+static mainloop_io_t *attrd_notify_conn = NULL;
+
 static void
 log_attrd_error(const char *host, const char *name, const char *value,
                 gboolean is_remote, char command, int rc)
@@ -140,3 +144,90 @@ update_attrd_clear_failures(const char *host, const char *rsc, const char *op,
              interval_desc, op_desc, rsc, node_type, host);
     update_attrd_helper(host, rsc, op, interval_spec, NULL, is_remote_node, 0);
 }
+
+/*!
+ * \internal
+ * \brief Abort any transition in progress for an undampened attribute change
+ *
+ * pacemaker-attrd notifies us of each change as soon as it learns of it, so a
+ * transition that may depend on the attribute (for example, through node
+ * health or a location rule) stops initiating new actions without waiting for
+ * the change to be written to the CIB. The CIB change still triggers the
+ * scheduler run that takes the new value into account.
+ */
+static int
+attrd_notify_dispatch(const char *buffer, ssize_t length, gpointer userdata)
+{
+    xmlNode *msg = string2xml(buffer);
+    const char *dampen = NULL;
+    int is_private = 0;
+
+    if (msg == NULL) {
+        return 0;
+    }
+    if (!AM_I_DC || (transition_graph == NULL) || transition_graph->complete
+        || safe_str_neq(crm_element_value(msg, F_ATTRD_TASK), ATTRD_OP_CHANGED)) {
+        goto done;
+    }
+
+    crm_element_value_int(msg, F_ATTRD_IS_PRIVATE, &is_private);
+    dampen = crm_element_value(msg, F_ATTRD_DAMPEN);
+    if (is_private || (crm_get_msec(dampen) > 0)) {
+        goto done;
+    }
+
+    crm_info("Node attribute %s changed to %s on %s before being written",
+             crm_element_value(msg, F_ATTRD_ATTRIBUTE),
+             crm_str(crm_element_value(msg, F_ATTRD_VALUE)),
+             crm_element_value(msg, F_ATTRD_HOST));
+    abort_transition(INFINITY, tg_restart, "Transient attribute change", NULL);
+
+done:
+    free_xml(msg);
+    return 0;
+}
+
+static void
+attrd_notify_destroy(gpointer userdata)
+{
+    crm_info("Lost pacemaker-attrd connection for attribute change notifications");
+    attrd_notify_conn = NULL;
+}
+
+/*!
+ * \internal
+ * \brief Subscribe to attribute changes if PCMK_attrd_early_abort is enabled
+ *
+ * \note This is called when taking over as DC, and does nothing if already
+ *       subscribed, so a lost connection is remade at the next DC election.
+ */
+void
+controld_attrd_subscribe(void)
+{
+    static struct ipc_client_callbacks notify_callbacks = {
+        .dispatch = attrd_notify_dispatch,
+        .destroy = attrd_notify_destroy
+    };
+    int rc = pcmk_ok;
+
+    if ((attrd_notify_conn != NULL)
+        || !crm_is_true(daemon_option("attrd_early_abort"))) {
+        return;
+    }
+
+    attrd_notify_conn = mainloop_add_ipc_client(T_ATTRD, G_PRIORITY_HIGH, 0,
+                                                NULL, &notify_callbacks);
+    if (attrd_notify_conn == NULL) {
+        crm_warn("Could not connect to pacemaker-attrd for attribute change "
+                 "notifications");
+        return;
+    }
+
+    rc = attrd_subscribe(mainloop_get_ipc_client(attrd_notify_conn), NULL,
+                         TRUE);
+    if (rc != pcmk_ok) {
+        crm_warn("Could not subscribe to attribute change notifications: "
+                 "%s " CRM_XS " rc=%d", pcmk_strerror(rc), rc);
+        mainloop_del_ipc_client(attrd_notify_conn);
+    }
+}
@@ -9,6 +9,7 @@
 
 #include <unistd.h>  /* sleep */
 
+#include <crm/cluster/internal.h>  /* crm_proc_based */
 #include <crm/common/alerts_internal.h>
 #include <crm/common/xml.h>
 #include <crm/crm.h>
@@ -57,6 +58,7 @@ do_cib_control(long long action,
 
     if (action & A_CIB_STOP) {
 
+        controld_flush_resource_updates();
         if (fsa_cib_conn->state != cib_disconnected && last_resource_update != 0) {
             crm_info("Waiting for resource update %d to complete", last_resource_update);
             crmd_fsa_stall(FALSE);
@@ -85,7 +87,7 @@ do_cib_control(long long action,
 
         rc = fsa_cib_conn->cmds->signon(fsa_cib_conn, CRM_SYSTEM_CRMD, cib_command_nonblocking);
 
-        if (rc != pcmk_ok) {
+        if ((rc != pcmk_ok) && controld_daemon_ready(crm_proc_based)) {
             /* a short wait that usually avoids stalling the FSA */
             sleep(1);
             rc = fsa_cib_conn->cmds->signon(fsa_cib_conn, CRM_SYSTEM_CRMD, cib_command_nonblocking);
@@ -176,7 +176,7 @@ peer_update_callback(enum crm_status_type type, crm_node_t * node, const void *d
     }
 
     if (AM_I_DC) {
-        xmlNode *update = NULL;
+        const char *abort_reason = NULL;
         int flags = node_update_peer;
         gboolean alive = is_remote? appeared : crm_is_peer_active(node);
         crm_action_t *down = match_down_event(node->uuid);
@@ -225,7 +225,7 @@ peer_update_callback(enum crm_status_type type, crm_node_t * node, const void *d
                 crm_update_peer_join(__FUNCTION__, node, crm_join_none);
                 check_join_state(fsa_state, __FUNCTION__);
             }
-            abort_transition(INFINITY, tg_restart, "Node failure", NULL);
+            abort_reason = "Node failure";
             fail_incompletable_actions(transition_graph, node->uuid);
 
         } else {
@@ -241,16 +241,14 @@ peer_update_callback(enum crm_status_type type, crm_node_t * node, const void *d
 
             /* Trigger resource placement on newly integrated nodes */
             if (appeared) {
-                abort_transition(INFINITY, tg_restart,
-                                 "pacemaker_remote node integrated", NULL);
+                abort_reason = "pacemaker_remote node integrated";
             }
         }
 
-        /* Update the CIB node state */
-        update = create_node_state_update(node, flags, NULL, __FUNCTION__);
-        fsa_cib_anon_update(XML_CIB_TAG_STATUS, update,
-                            cib_scope_local | cib_quorum_override | cib_can_create);
-        free_xml(update);
+        /* Update the CIB node state (and abort, if needed) together with any
+         * other nodes affected by the same membership event
+         */
+        controld_queue_node_state(node, flags, abort_reason, __FUNCTION__);
     }
 
     trigger_fsa(fsa_source);
@@ -281,8 +279,8 @@ crmd_cib_connection_destroy(gpointer user_data)
 gboolean
 crm_fsa_trigger(gpointer user_data)
 {
-    crm_trace("Invoked (queue len: %d)", g_list_length(fsa_message_queue));
+    crm_trace("Invoked (queue len: %u)", g_queue_get_length(&fsa_message_queue));
     s_crmd_fsa(C_FSA_INTERNAL);
-    crm_trace("Exited  (queue len: %d)", g_list_length(fsa_message_queue));
+    crm_trace("Exited  (queue len: %u)", g_queue_get_length(&fsa_message_queue));
     return TRUE;
 }
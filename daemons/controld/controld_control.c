@@ -45,6 +45,12 @@ crm_trigger_t *fsa_source = NULL;
 crm_trigger_t *config_read = NULL;
 bool no_quorum_suicide_escalation = FALSE;
 
+/* Connection to pacemakerd, used to learn when local daemons become ready, so
+ * connection attempts waiting on wait_timer can be retried right away
+ */
+static mainloop_io_t *mcp_conn = NULL;
+static uint32_t mcp_ready = 0;  // crm_proc_* flags of ready local daemons
+
 static gboolean
 election_timeout_popped(gpointer data)
 {
@@ -213,6 +219,12 @@ crmd_exit(crm_exit_t exit_code)
 
     pe_subsystem_free();
 
+    if (mcp_conn) {
+        crm_trace("Closing connection to pacemakerd");
+        mainloop_del_ipc_client(mcp_conn);
+        mcp_conn = NULL;
+    }
+
     if(stonith_api) {
         crm_trace("Disconnecting fencing API");
         clear_bit(fsa_input_register, R_ST_REQUIRED);
@@ -239,7 +251,7 @@ crmd_exit(crm_exit_t exit_code)
 
 /* Clean up as much memory as possible for valgrind */
 
-    for (gIter = fsa_message_queue; gIter != NULL; gIter = gIter->next) {
+    for (gIter = fsa_message_queue.head; gIter != NULL; gIter = gIter->next) {
         fsa_data_t *fsa_data = gIter->data;
 
         crm_info("Dropping %s: [ state=%s cause=%s origin=%s ]",
@@ -250,7 +262,7 @@ crmd_exit(crm_exit_t exit_code)
     }
 
     clear_bit(fsa_input_register, R_MEMBERSHIP);
-    g_list_free(fsa_message_queue); fsa_message_queue = NULL;
+    g_queue_clear(&fsa_message_queue);
 
     metadata_cache_fini();
 
@@ -383,6 +395,74 @@ do_exit(long long action,
 
 static void sigpipe_ignore(int nsig) { return; }
 
+static int
+mcp_dispatch(const char *buffer, ssize_t length, gpointer userdata)
+{
+    xmlNode *msg = string2xml(buffer);
+    int ready = 0;
+
+    if ((msg != NULL)
+        && (crm_element_value_int(msg, "ready", &ready) == 0)) {
+        uint32_t newly_ready = (uint32_t) ready & ~mcp_ready;
+
+        mcp_ready = (uint32_t) ready;
+        if ((newly_ready != 0) && is_timer_started(wait_timer)) {
+            crm_debug("Local daemons became ready (%.8x), retrying now",
+                      newly_ready);
+            crm_timer_stop(wait_timer);
+            mainloop_set_trigger(fsa_source);
+        }
+    }
+    free_xml(msg);
+    return 0;
+}
+
+static void
+mcp_destroy(gpointer userdata)
+{
+    crm_debug("Lost connection to pacemakerd");
+    mcp_conn = NULL;
+    mcp_ready = 0;
+}
+
+static void
+mcp_connect(void)
+{
+    static struct ipc_client_callbacks mcp_callbacks = {
+        .dispatch = mcp_dispatch,
+        .destroy = mcp_destroy
+    };
+    xmlNode *poke = NULL;
+
+    mcp_conn = mainloop_add_ipc_client(CRM_SYSTEM_MCP, G_PRIORITY_DEFAULT, 0,
+                                       NULL, &mcp_callbacks);
+    if (mcp_conn == NULL) {
+        crm_info("Not tracking readiness of local daemons: "
+                 "pacemakerd is not available");
+        return;
+    }
+
+    // Sending anything gets us the process list, with updates from then on
+    poke = create_xml_node(NULL, "poke");
+    crm_ipc_send(mainloop_get_ipc_client(mcp_conn), poke, 0, 0, NULL);
+    free_xml(poke);
+}
+
+/*!
+ * \internal
+ * \brief Check whether a local daemon may be ready for connections
+ *
+ * \param[in] proc  crm_proc_* flag of daemon to check
+ *
+ * \return FALSE if pacemakerd has said the daemon is not ready yet,
+ *         otherwise TRUE
+ */
+bool
+controld_daemon_ready(uint32_t proc)
+{
+    return (mcp_conn == NULL) || is_set(mcp_ready, proc);
+}
+
 /*	 A_STARTUP	*/
 void
 do_startup(long long action,
@@ -398,6 +478,11 @@ do_startup(long long action,
     fsa_source = mainloop_add_trigger(G_PRIORITY_HIGH, crm_fsa_trigger, NULL);
     config_read = mainloop_add_trigger(G_PRIORITY_HIGH, crm_read_options, NULL);
     transition_trigger = mainloop_add_trigger(G_PRIORITY_LOW, te_graph_trigger, NULL);
+    pcmk__trigger_set_name(fsa_source, "fsa");
+    pcmk__trigger_set_name(config_read, "config-read");
+    pcmk__trigger_set_name(transition_trigger, "transition");
+
+    mcp_connect();
 
     crm_debug("Creating CIB manager and executor objects");
     fsa_cib_conn = cib_new();
@@ -640,6 +725,8 @@ do_started(long long action,
     if (ipcs == NULL) {
         crm_err("Failed to create IPC server: shutting down and inhibiting respawn");
         register_fsa_error(C_FSA_INTERNAL, I_ERROR, NULL);
+    } else {
+        pcmk__notify_ready(crm_proc_controld);
     }
 
     if (stonith_reconnect == NULL) {
@@ -696,6 +783,13 @@ static pe_cluster_option crmd_opts[] = {
         },
 	{ "node-action-limit", NULL, "integer", NULL, "0", &check_number,
           "The maximum number of jobs that can be scheduled per node. Defaults to 2x cores"},
+	{
+        "election-ranking", NULL, "boolean", NULL, "false", &check_boolean,
+        "Choose the DC by node ID rather than by uptime",
+        "Rank DC candidates with the same version by their cluster node ID (lowest wins). Nodes that\n"
+        "are outranked by an active peer wait up to dc-deadtime for it to win before voting, so a new\n"
+        "DC is normally chosen in a single round. Takes effect between nodes that all enable it."
+    },
 	{ XML_CONFIG_ATTR_ELECTION_FAIL, NULL, "time", NULL, "2min", &check_timer,
           "*** Advanced Use Only ***.", "If need to adjust this value, it probably indicates the presence of a bug."
         },
@@ -717,9 +811,29 @@ static pe_cluster_option crmd_opts[] = {
 	{
         "transition-delay", "crmd-transition-delay",
         "time", NULL, "0s", &check_timer,
-        "*** Advanced Use Only *** Enabling this option will slow down cluster recovery under all conditions",
+        "*** Advanced Use Only *** Enabling this option will slow down cluster recovery after attribute and configuration changes",
         "Delay cluster recovery for the configured interval to allow for additional/related events to occur.\n"
         "Useful if your configuration is sensitive to the order in which ping updates arrive."
+    },
+	{
+        "transition-delay-max", NULL, "time", NULL, "0s", &check_timer,
+        "*** Advanced Use Only *** Longest time attribute and configuration changes may delay a new transition",
+        "When transition-delay is set, each attribute or configuration change restarts it, so a steady\n"
+        "stream of such changes could postpone recovery indefinitely. If set, a new transition is computed\n"
+        "no later than this after the first change of a burst. Changes such as node failures and action\n"
+        "results are never delayed. 0 means no limit."
+    },
+	{
+        "transition-speculation", NULL, "boolean", NULL, "false", &check_boolean,
+        "*** Advanced Use Only *** Calculate the next transition while the aborted one finishes",
+        "When a transition is aborted, ask the scheduler for the next one immediately instead of after\n"
+        "in-flight actions complete. The result is used if the CIB has not changed by then."
+    },
+	{
+        "scheduler-offload", NULL, "string", NULL, "false", NULL,
+        "*** Advanced Use Only *** Run the DC's scheduler calculations on another node",
+        "Name of the node whose scheduler should calculate transitions for the DC, or \"true\" for the\n"
+        "least loaded node. The DC uses its own scheduler if no result arrives within 30 seconds."
     },
 	{ "stonith-watchdog-timeout", NULL, "time", NULL, NULL, &check_sbd_timeout,
 	  "How long to wait before we can assume nodes are safely down", NULL
@@ -799,6 +913,10 @@ config_query_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void
     value = crmd_pref(config_hash, XML_CONFIG_ATTR_DC_DEADTIME);
     election_trigger->period_ms = crm_get_msec(value);
 
+    value = crmd_pref(config_hash, "election-ranking");
+    pcmk__election_set_ranked(fsa_election, crm_is_true(value),
+                              QB_MAX(election_trigger->period_ms, 0));
+
     value = crmd_pref(config_hash, "node-action-limit"); /* Also checks migration-limit */
     throttle_update_job_max(value);
 
@@ -830,6 +948,15 @@ config_query_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void
     value = crmd_pref(config_hash, "transition-delay");
     transition_timer->period_ms = crm_get_msec(value);
 
+    value = crmd_pref(config_hash, "transition-delay-max");
+    update_transition_delay_max(value);
+
+    value = crmd_pref(config_hash, "transition-speculation");
+    controld_set_speculation(value);
+
+    value = crmd_pref(config_hash, "scheduler-offload");
+    controld_set_offload(value);
+
     value = crmd_pref(config_hash, "join-integration-timeout");
     integration_timer->period_ms = crm_get_msec(value);
 
@@ -866,6 +993,9 @@ crm_read_options(gpointer user_data)
 
     fsa_register_cib_callback(call_id, FALSE, NULL, config_query_callback);
     crm_trace("Querying the CIB... call %d", call_id);
+
+    // Only done once, the first time the configuration is read
+    controld_prefetch_metadata();
     return TRUE;
 }
 
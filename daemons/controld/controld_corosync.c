@@ -42,16 +42,7 @@ crmd_cs_dispatch(cpg_handle_t handle, const struct cpg_name *groupName,
     }
     if (kind == crm_class_cluster) {
         crm_node_t *peer = NULL;
-        xmlNode *xml = string2xml(data);
-
-        if (xml == NULL) {
-            crm_err("Could not parse message content (%d): %.100s", kind, data);
-            free(data);
-            return;
-        }
-
-        crm_xml_add(xml, F_ORIG, from);
-        /* crm_xml_add_int(xml, F_SEQ, wrapper->id); Fake? */
+        xmlNode *xml = NULL;
 
         peer = crm_get_peer(0, from);
         if (is_not_set(peer->processes, crm_proc_cpg)) {
@@ -63,6 +54,33 @@ crmd_cs_dispatch(cpg_handle_t handle, const struct cpg_name *groupName,
             crm_update_peer_proc(__FUNCTION__, peer, crm_proc_cpg,
                                  ONLINESTATUS);
         }
+
+        /* Messages for the DC are broadcast to every node, so check whether
+         * this one is for us before parsing it
+         */
+        if (!AM_I_DC) {
+            char *sys_to = NULL;
+
+            if ((pcmk__xml_peek_attr(data, F_CRM_SYS_TO, &sys_to) == pcmk_ok)
+                && safe_str_eq(sys_to, CRM_SYSTEM_DC)) {
+                crm_trace("Ignoring message for DC from %s", from);
+                free(sys_to);
+                free(data);
+                return;
+            }
+            free(sys_to);
+        }
+
+        xml = string2xml(data);
+        if (xml == NULL) {
+            crm_err("Could not parse message content (%d): %.100s", kind, data);
+            free(data);
+            return;
+        }
+
+        crm_xml_add(xml, F_ORIG, from);
+        /* crm_xml_add_int(xml, F_SEQ, wrapper->id); Fake? */
+
         crmd_ha_msg_filter(xml);
         free_xml(xml);
     } else {
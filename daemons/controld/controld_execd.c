@@ -10,6 +10,7 @@
 #include <sys/param.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
 #include <crm/crm.h>
 #include <crm/services.h>
@@ -22,6 +23,7 @@
 #include <controld_messages.h>
 #include <controld_callbacks.h>
 #include <controld_lrm.h>
+#include <controld_throttle.h>
 #include <regex.h>
 #include <crm/pengine/rules.h>
 
@@ -38,6 +40,9 @@ struct delete_event_s {
 
 static gboolean is_rsc_active(lrm_state_t * lrm_state, const char *rsc_id);
 static gboolean build_active_RAs(lrm_state_t * lrm_state, xmlNode * rsc_list);
+static void save_cold_start_history(lrm_state_t *lrm_state);
+static void load_cold_start_history(void);
+static void free_cold_start_history(void);
 static gboolean stop_recurring_actions(gpointer key, gpointer value, gpointer user_data);
 static int delete_rsc_status(lrm_state_t * lrm_state, const char *rsc_id, int call_options,
                              const char *user_name);
@@ -90,6 +95,134 @@ copy_meta_keys(gpointer key, gpointer value, gpointer user_data)
     }
 }
 
+/*
+ * Resource history memory
+ *
+ * The history cache has an entry for every resource on every node that the
+ * controller manages (including each remote and guest node), and each entry
+ * keeps copies of several operation results. Most of the strings in them
+ * (resource IDs, operation names, node names, and parameter names and values)
+ * are the same across many entries, so they are shared: each distinct string
+ * is kept once, with a reference count. Parameter tables with the same
+ * contents are also kept once, found by a digest of their contents (see
+ * pcmk__str_table_share()).
+ *
+ * Tables and strings in the history cache must therefore be treated as
+ * read-only, and events in it freed with history_free_event().
+ */
+
+static lrmd_event_data_t *
+history_copy_event(lrmd_event_data_t *event)
+{
+    lrmd_event_data_t *copy = calloc(1, sizeof(lrmd_event_data_t));
+
+    CRM_ASSERT(copy != NULL);
+
+    // Get all the scalar values, then replace the pointers
+    memcpy(copy, event, sizeof(lrmd_event_data_t));
+    copy->rsc_id = pcmk__str_intern(event->rsc_id);
+    copy->op_type = pcmk__str_intern(event->op_type);
+    copy->remote_nodename = pcmk__str_intern(event->remote_nodename);
+    copy->user_data = event->user_data? strdup(event->user_data) : NULL;
+    copy->output = event->output? strdup(event->output) : NULL;
+    copy->exit_reason = event->exit_reason? strdup(event->exit_reason) : NULL;
+    copy->params = pcmk__str_table_share(event->params);
+    return copy;
+}
+
+static void
+history_free_event(lrmd_event_data_t *event)
+{
+    if (event == NULL) {
+        return;
+    }
+    pcmk__str_release(event->rsc_id);
+    pcmk__str_release(event->op_type);
+    pcmk__str_release(event->remote_nodename);
+    free((char *) event->user_data);
+    free((char *) event->output);
+    free((char *) event->exit_reason);
+    pcmk__str_table_release(event->params);
+    free(event);
+}
+
+/*
+ * History compaction
+ *
+ * The scheduler needs only each resource's last operation, last failure and
+ * active recurring operations, which is what the controller writes. But when a
+ * recurring operation ends without being cancelled through the controller
+ * (because a stop or similar ended it in the executor, for example), its entry
+ * would stay in the CIB, to be read, sorted and ignored by every scheduler run
+ * until the node next rejoins. So unless PCMK_history_compact is "false", such
+ * entries are removed as soon as the result that made them stale is written.
+ */
+
+static int history_compact = -1;
+static unsigned long long history_compactions = 0;
+static unsigned long long history_compacted_ops = 0;
+
+static bool
+history_compact_enabled(void)
+{
+    if (history_compact < 0) {
+        const char *value = daemon_option("history_compact");
+
+        history_compact = (value == NULL) || crm_is_true(value);
+    }
+    return history_compact;
+}
+
+/*!
+ * \internal
+ * \brief Add resource history memory statistics to XML
+ *
+ * \param[in,out] parent  XML to add a "history-stats" child to
+ */
+void
+history_stats_add_xml(xmlNode *parent)
+{
+    xmlNode *xml = create_xml_node(parent, "history-stats");
+    unsigned long long strings = 0;
+    unsigned long long string_bytes = 0;
+    unsigned long long string_refs = 0;
+    unsigned long long tables = 0;
+    unsigned long long table_refs = 0;
+    unsigned long long entries = 0;
+    GList *states = lrm_state_get_list();
+
+    for (GList *state_iter = states; state_iter != NULL;
+         state_iter = state_iter->next) {
+        lrm_state_t *lrm_state = state_iter->data;
+
+        if (lrm_state->resource_history != NULL) {
+            entries += g_hash_table_size(lrm_state->resource_history);
+        }
+    }
+
+    pcmk__str_sharing_stats(&strings, &string_bytes, &string_refs, &tables,
+                            &table_refs);
+
+#define add_stat(name, value) do {                                      \
+        char *s = crm_strdup_printf("%llu", (unsigned long long) (value)); \
+        crm_xml_add(xml, name, s);                                      \
+        free(s);                                                        \
+    } while (0)
+
+    add_stat("nodes", g_list_length(states));
+    add_stat("resources", entries);
+    add_stat("strings", strings);
+    add_stat("string_bytes", string_bytes);
+    add_stat("string_refs", string_refs);
+    add_stat("param_tables", tables);
+    add_stat("param_table_refs", table_refs);
+    add_stat("compactions", history_compactions);
+    add_stat("compacted_ops", history_compacted_ops);
+#undef add_stat
+
+    g_list_free(states);
+}
+
 /*!
  * \internal
  * \brief Remove a recurring operation from a resource's history
@@ -112,7 +245,7 @@ history_remove_recurring_op(rsc_history_t *history, const lrmd_event_data_t *op)
             && safe_str_eq(op->op_type, existing->op_type)) {
 
             history->recurring_op_list = g_list_delete_link(history->recurring_op_list, iter);
-            lrmd_free_event(existing);
+            history_free_event(existing);
             return TRUE;
         }
     }
@@ -131,7 +264,7 @@ history_free_recurring_ops(rsc_history_t *history)
     GList *iter;
 
     for (iter = history->recurring_op_list; iter != NULL; iter = iter->next) {
-        lrmd_free_event(iter->data);
+        history_free_event(iter->data);
     }
     g_list_free(history->recurring_op_list);
     history->recurring_op_list = NULL;
@@ -148,19 +281,18 @@ history_free(gpointer data)
 {
     rsc_history_t *history = (rsc_history_t*)data;
 
-    if (history->stop_params) {
-        g_hash_table_destroy(history->stop_params);
-    }
+    pcmk__str_table_release(history->stop_params);
 
     /* Don't need to free history->rsc.id because it's set to history->id */
-    free(history->rsc.type);
-    free(history->rsc.standard);
-    free(history->rsc.provider);
+    pcmk__str_release(history->rsc.type);
+    pcmk__str_release(history->rsc.standard);
+    pcmk__str_release(history->rsc.provider);
 
-    lrmd_free_event(history->failed);
-    lrmd_free_event(history->last);
-    free(history->id);
+    history_free_event(history->failed);
+    history_free_event(history->last);
+    pcmk__str_release(history->id);
     history_free_recurring_ops(history);
+    g_list_free_full(history->stale_ops, free);
     free(history);
 }
 
@@ -185,17 +317,13 @@ update_history_cache(lrm_state_t * lrm_state, lrmd_rsc_info_t * rsc, lrmd_event_
     entry = g_hash_table_lookup(lrm_state->resource_history, op->rsc_id);
     if (entry == NULL && rsc) {
         entry = calloc(1, sizeof(rsc_history_t));
-        entry->id = strdup(op->rsc_id);
+        entry->id = (char *) pcmk__str_intern(op->rsc_id);
         g_hash_table_insert(lrm_state->resource_history, entry->id, entry);
 
         entry->rsc.id = entry->id;
-        entry->rsc.type = strdup(rsc->type);
-        entry->rsc.standard = strdup(rsc->standard);
-        if (rsc->provider) {
-            entry->rsc.provider = strdup(rsc->provider);
-        } else {
-            entry->rsc.provider = NULL;
-        }
+        entry->rsc.type = (char *) pcmk__str_intern(rsc->type);
+        entry->rsc.standard = (char *) pcmk__str_intern(rsc->standard);
+        entry->rsc.provider = (char *) pcmk__str_intern(rsc->provider);
 
     } else if (entry == NULL) {
         crm_info("Resource %s no longer exists, not updating cache", op->rsc_id);
@@ -221,27 +349,27 @@ update_history_cache(lrm_state_t * lrm_state, lrmd_rsc_info_t * rsc, lrmd_event_
          * to be forgotten when a stop happens.
          */
         if (entry->failed) {
-            lrmd_free_event(entry->failed);
+            history_free_event(entry->failed);
         }
-        entry->failed = lrmd_copy_event(op);
+        entry->failed = history_copy_event(op);
 
     } else if (op->interval_ms == 0) {
         if (entry->last) {
-            lrmd_free_event(entry->last);
+            history_free_event(entry->last);
         }
-        entry->last = lrmd_copy_event(op);
+        entry->last = history_copy_event(op);
 
         if (op->params &&
             (safe_str_eq(CRMD_ACTION_START, op->op_type) ||
              safe_str_eq("reload", op->op_type) ||
              safe_str_eq(CRMD_ACTION_STATUS, op->op_type))) {
 
-            if (entry->stop_params) {
-                g_hash_table_destroy(entry->stop_params);
-            }
-            entry->stop_params = crm_str_table_new();
+            GHashTable *stop_params = crm_str_table_new();
 
-            g_hash_table_foreach(op->params, copy_instance_keys, entry->stop_params);
+            g_hash_table_foreach(op->params, copy_instance_keys, stop_params);
+            pcmk__str_table_release(entry->stop_params);
+            entry->stop_params = pcmk__str_table_share(stop_params);
+            g_hash_table_destroy(stop_params);
         }
     }
 
@@ -251,12 +379,23 @@ update_history_cache(lrm_state_t * lrm_state, lrmd_rsc_info_t * rsc, lrmd_event_
 
         crm_trace("Adding recurring op: " CRM_OP_FMT,
                   op->rsc_id, op->op_type, op->interval_ms);
-        entry->recurring_op_list = g_list_prepend(entry->recurring_op_list, lrmd_copy_event(op));
+        entry->recurring_op_list = g_list_prepend(entry->recurring_op_list, history_copy_event(op));
 
     } else if (entry->recurring_op_list && safe_str_eq(op->op_type, RSC_STATUS) == FALSE) {
         crm_trace("Dropping %d recurring ops because of: " CRM_OP_FMT,
                   g_list_length(entry->recurring_op_list), op->rsc_id,
                   op->op_type, op->interval_ms);
+        if (history_compact_enabled()) {
+            for (GList *iter = entry->recurring_op_list; iter != NULL;
+                 iter = iter->next) {
+                lrmd_event_data_t *stale = iter->data;
+
+                entry->stale_ops = g_list_prepend(entry->stale_ops,
+                                                  generate_op_key(stale->rsc_id,
+                                                                  stale->op_type,
+                                                                  stale->interval_ms));
+            }
+        }
         history_free_recurring_ops(entry);
     }
 }
@@ -345,6 +484,11 @@ do_lrm_control(long long action,
             }
         }
 
+        if (is_set(fsa_input_register, R_SHUTDOWN)) {
+            save_cold_start_history(lrm_state);
+        }
+        free_cold_start_history();
+
         clear_bit(fsa_input_register, R_LRM_CONNECTED);
         crm_info("Disconnecting from the executor");
         lrm_state_disconnect(lrm_state);
@@ -381,6 +525,7 @@ do_lrm_control(long long action,
 
         set_bit(fsa_input_register, R_LRM_CONNECTED);
         crm_info("Connection to the executor established");
+        load_cold_start_history();
     }
 
     if (action & ~(A_LRM_CONNECT | A_LRM_DISCONNECT)) {
@@ -402,6 +547,9 @@ lrm_state_verify_stopped(lrm_state_t * lrm_state, enum crmd_fsa_state cur_state,
 
     crm_debug("Checking for active resources before exit");
 
+    // Queued probes are pending too, once sent
+    lrm_state_flush_execs(lrm_state);
+
     if (cur_state == S_TERMINATE) {
         log_level = LOG_ERR;
         when = "shutdown";
@@ -773,6 +921,16 @@ is_rsc_active(lrm_state_t * lrm_state, const char *rsc_id)
     return TRUE;
 }
 
+static gint
+sort_event_by_callid(gconstpointer a, gconstpointer b)
+{
+    const lrmd_event_data_t *event_a = a;
+    const lrmd_event_data_t *event_b = b;
+
+    return (event_a->call_id > event_b->call_id)
+           - (event_a->call_id < event_b->call_id);
+}
+
 static gboolean
 build_active_RAs(lrm_state_t * lrm_state, xmlNode * rsc_list)
 {
@@ -783,6 +941,7 @@ build_active_RAs(lrm_state_t * lrm_state, xmlNode * rsc_list)
     while (g_hash_table_iter_next(&iter, NULL, (void **)&entry)) {
 
         GList *gIter = NULL;
+        GList *events = NULL;
         xmlNode *xml_rsc = create_xml_node(rsc_list, XML_LRM_TAG_RESOURCE);
 
         crm_xml_add(xml_rsc, XML_ATTR_ID, entry->id);
@@ -797,16 +956,201 @@ build_active_RAs(lrm_state_t * lrm_state, xmlNode * rsc_list)
                 crm_xml_add(xml_rsc, XML_RSC_ATTR_CONTAINER, container);
             }
         }
-        build_operation_update(xml_rsc, &(entry->rsc), entry->failed, lrm_state->node_name, __FUNCTION__);
-        build_operation_update(xml_rsc, &(entry->rsc), entry->last, lrm_state->node_name, __FUNCTION__);
-        for (gIter = entry->recurring_op_list; gIter != NULL; gIter = gIter->next) {
+
+        /* Write the entries in call ID order, so the scheduler does not need
+         * to sort them (the sort is stable, so a failure whose result is also
+         * the last one is still written first)
+         */
+        events = g_list_copy(entry->recurring_op_list);
+        if (entry->last) {
+            events = g_list_prepend(events, entry->last);
+        }
+        if (entry->failed) {
+            events = g_list_prepend(events, entry->failed);
+        }
+        events = g_list_sort(events, sort_event_by_callid);
+        for (gIter = events; gIter != NULL; gIter = gIter->next) {
             build_operation_update(xml_rsc, &(entry->rsc), gIter->data, lrm_state->node_name, __FUNCTION__);
         }
+        g_list_free(events);
+    }
+
+    return FALSE;
+}
+
+/*
+ * Cold start history
+ *
+ * On a full cluster start, the status section is empty, so the scheduler
+ * would probe every resource on every node before starting anything. If
+ * PCMK_cold_start_history is enabled, the controller saves the last result of
+ * each inactive resource at clean shutdown, and advertises those results when
+ * it next joins the cluster, so resources can be placed right away.
+ *
+ * Advertised results have call ID 0, which no executor result can have, and
+ * which any new result for the resource overwrites. Once the node has been
+ * quiet for a while, any that remain are erased, so that the scheduler
+ * verifies them with probes that no longer hold anything up.
+ */
+
+#define COLD_START_FILE         CRM_PACEMAKER_DIR "/last-resource-state.xml"
+#define COLD_START_VERIFY_MS    30000
+
+static xmlNode *cold_start_history = NULL;  // saved XML_LRM_TAG_RESOURCES
+static guint cold_start_timer = 0;
+
+static void
+save_cold_start_history(lrm_state_t *lrm_state)
+{
+    GHashTableIter iter;
+    rsc_history_t *entry = NULL;
+    xmlNode *rsc_list = NULL;
+    int count = 0;
+
+    if (!daemon_option_enabled(crm_system_name, "cold_start_history")
+        || (lrm_state->resource_history == NULL)) {
+        return;
+    }
+
+    rsc_list = create_xml_node(NULL, XML_LRM_TAG_RESOURCES);
+    g_hash_table_iter_init(&iter, lrm_state->resource_history);
+    while (g_hash_table_iter_next(&iter, NULL, (void **)&entry)) {
+        xmlNode *xml_rsc = NULL;
+
+        // Only a clean stop or "not running" result is worth reusing
+        if ((entry->last == NULL) || (entry->failed != NULL)
+            || ((entry->last->rc != PCMK_OCF_NOT_RUNNING)
+                && ((entry->last->rc != PCMK_OCF_OK)
+                    || safe_str_neq(entry->last->op_type, CRMD_ACTION_STOP)))) {
+            continue;
+        }
+
+        xml_rsc = create_xml_node(rsc_list, XML_LRM_TAG_RESOURCE);
+        crm_xml_add(xml_rsc, XML_ATTR_ID, entry->id);
+        crm_xml_add(xml_rsc, XML_ATTR_TYPE, entry->rsc.type);
+        crm_xml_add(xml_rsc, XML_AGENT_ATTR_CLASS, entry->rsc.standard);
+        crm_xml_add(xml_rsc, XML_AGENT_ATTR_PROVIDER, entry->rsc.provider);
+        build_operation_update(xml_rsc, &(entry->rsc), entry->last,
+                               lrm_state->node_name, __FUNCTION__);
+        count++;
+    }
+
+    if (count > 0) {
+        if (write_xml_file(rsc_list, COLD_START_FILE, FALSE) < 0) {
+            crm_warn("Could not save resource states to " COLD_START_FILE);
+        } else {
+            crm_info("Saved %d resource state%s for next start",
+                     count, s_if_plural(count));
+        }
+    }
+    free_xml(rsc_list);
+}
+
+static void
+load_cold_start_history(void)
+{
+    int count = 0;
+
+    if (access(COLD_START_FILE, F_OK) < 0) {
+        return;
+    }
+
+    // The saved states are only good for the start right after saving them
+    if (daemon_option_enabled(crm_system_name, "cold_start_history")) {
+        cold_start_history = filename2xml(COLD_START_FILE);
+    }
+    unlink(COLD_START_FILE);
+    if (cold_start_history == NULL) {
+        return;
+    }
+
+    for (xmlNode *xml_rsc = first_named_child(cold_start_history,
+                                              XML_LRM_TAG_RESOURCE);
+         xml_rsc != NULL; xml_rsc = crm_next_same_xml(xml_rsc)) {
+
+        for (xmlNode *xml_op = first_named_child(xml_rsc, XML_LRM_TAG_RSC_OP);
+             xml_op != NULL; xml_op = crm_next_same_xml(xml_op)) {
+            crm_xml_add_int(xml_op, XML_LRM_ATTR_CALLID, 0);
+        }
+        count++;
+    }
+    crm_notice("Advertising %d saved resource state%s until verified",
+               count, s_if_plural(count));
+}
+
+static void
+free_cold_start_history(void)
+{
+    if (cold_start_timer != 0) {
+        g_source_remove(cold_start_timer);
+        cold_start_timer = 0;
+    }
+    free_xml(cold_start_history);
+    cold_start_history = NULL;
+}
+
+static gboolean
+verify_cold_start_history(gpointer user_data)
+{
+    lrm_state_t *lrm_state = lrm_state_find(fsa_our_uname);
+    struct recurring_op_s *pending = NULL;
+    GHashTableIter iter;
+    char *xpath = NULL;
+    int call_id = 0;
+
+    // Wait until anything the node is doing has finished
+    if ((lrm_state != NULL) && (lrm_state->pending_ops != NULL)) {
+        g_hash_table_iter_init(&iter, lrm_state->pending_ops);
+        while (g_hash_table_iter_next(&iter, NULL, (void **)&pending)) {
+            if (pending->interval_ms == 0) {
+                return TRUE;
+            }
+        }
+    }
+
+    cold_start_timer = 0;
+    free_cold_start_history();
+    if (fsa_cib_conn == NULL) {
+        return FALSE;
     }
 
+    xpath = crm_strdup_printf("//" XML_CIB_TAG_STATE "[@" XML_ATTR_UNAME "='%s']"
+                              "//" XML_LRM_TAG_RSC_OP
+                              "[@" XML_LRM_ATTR_CALLID "='0']", fsa_our_uname);
+    crm_notice("Verifying saved resource states with probes");
+    call_id = fsa_cib_conn->cmds->remove(fsa_cib_conn, xpath, NULL,
+                                         cib_quorum_override|cib_xpath
+                                         |cib_multiple);
+    crm_trace("Erasing saved resource states (call %d)", call_id);
+    free(xpath);
     return FALSE;
 }
 
+static void
+add_cold_start_history(lrm_state_t *lrm_state, xmlNode *rsc_list)
+{
+    if ((cold_start_history == NULL) || !lrm_state_is_local(lrm_state)) {
+        return;
+    }
+
+    for (xmlNode *xml_rsc = first_named_child(cold_start_history,
+                                              XML_LRM_TAG_RESOURCE);
+         xml_rsc != NULL; xml_rsc = crm_next_same_xml(xml_rsc)) {
+
+        if (g_hash_table_lookup(lrm_state->resource_history,
+                                ID(xml_rsc)) == NULL) {
+            add_node_copy(rsc_list, xml_rsc);
+        }
+    }
+
+    // Verify only after the states have been quiet for a while
+    if (cold_start_timer != 0) {
+        g_source_remove(cold_start_timer);
+    }
+    cold_start_timer = g_timeout_add(COLD_START_VERIFY_MS,
+                                     verify_cold_start_history, NULL);
+}
+
 static xmlNode *
 do_lrm_query_internal(lrm_state_t *lrm_state, int update_flags)
 {
@@ -830,6 +1174,7 @@ do_lrm_query_internal(lrm_state_t *lrm_state, int update_flags)
 
     /* Build a list of active (not always running) resources */
     build_active_RAs(lrm_state, rsc_list);
+    add_cold_start_history(lrm_state, rsc_list);
 
     crm_log_xml_trace(xml_state, "Current executor state");
 
@@ -849,6 +1194,27 @@ do_lrm_query(gboolean is_replace, const char *node_name)
                                  node_update_cluster|node_update_peer);
 }
 
+/*!
+ * \internal
+ * \brief Trigger a new transition after an unexpected history deletion
+ *
+ * \param[in] from_sys  Subsystem that requested the deletion
+ * \param[in] what      What was deleted (for logging)
+ */
+static void
+trigger_deletion_refresh(const char *from_sys, const char *what)
+{
+    char *now_s = crm_itoa(time(NULL));
+
+    crm_debug("Triggering a refresh after %s deleted %s from the executor",
+              from_sys, what);
+
+    update_attr_delegate(fsa_cib_conn, cib_none, XML_CIB_TAG_CRMCONFIG, NULL, NULL, NULL, NULL,
+                         "last-lrm-refresh", now_s, FALSE, NULL, NULL);
+
+    free(now_s);
+}
+
 static void
 notify_deleted(lrm_state_t * lrm_state, ha_msg_input_t * input, const char *rsc_id, int rc)
 {
@@ -875,16 +1241,7 @@ notify_deleted(lrm_state_t * lrm_state, ha_msg_input_t * input, const char *rsc_
 
     if (safe_str_neq(from_sys, CRM_SYSTEM_TENGINE)) {
         /* this isn't expected - trigger a new transition */
-        time_t now = time(NULL);
-        char *now_s = crm_itoa(now);
-
-        crm_debug("Triggering a refresh after %s deleted %s from the executor",
-                  from_sys, rsc_id);
-
-        update_attr_delegate(fsa_cib_conn, cib_none, XML_CIB_TAG_CRMCONFIG, NULL, NULL, NULL, NULL,
-                             "last-lrm-refresh", now_s, FALSE, NULL, NULL);
-
-        free(now_s);
+        trigger_deletion_refresh(from_sys, rsc_id);
     }
 }
 
@@ -933,6 +1290,7 @@ delete_rsc_status(lrm_state_t * lrm_state, const char *rsc_id, int call_options,
 
     rsc_xpath = crm_strdup_printf(rsc_template, lrm_state->node_name, rsc_id);
 
+    controld_flush_resource_updates();
     rc = cib_internal_op(fsa_cib_conn, CIB_OP_DELETE, NULL, rsc_xpath,
                          NULL, NULL, call_options | cib_xpath, user_name);
 
@@ -1001,6 +1359,7 @@ erase_lrm_history_by_op(lrm_state_t *lrm_state, lrmd_event_data_t *op)
     crm_debug("Erasing resource operation history for " CRM_OP_FMT " (call=%d)",
               op->rsc_id, op->op_type, op->interval_ms, op->call_id);
 
+    controld_flush_resource_updates();
     fsa_cib_conn->cmds->remove(fsa_cib_conn, XML_CIB_TAG_STATUS, xml_top,
                                cib_quorum_override);
 
@@ -1062,9 +1421,87 @@ erase_lrm_history_by_id(lrm_state_t *lrm_state, const char *rsc_id,
 
     crm_debug("Erasing resource operation history for %s on %s (call=%d)",
               key, rsc_id, call_id);
+    controld_flush_resource_updates();
+    fsa_cib_conn->cmds->remove(fsa_cib_conn, op_xpath, NULL,
+                               cib_quorum_override | cib_xpath);
+    free(op_xpath);
+}
+
+// Check whether a recurring operation is still active in the executor
+static bool
+recurring_op_is_active(lrm_state_t *lrm_state, const char *rsc_id,
+                       const char *key)
+{
+    GHashTableIter iter;
+    struct recurring_op_s *pending = NULL;
+
+    g_hash_table_iter_init(&iter, lrm_state->pending_ops);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &pending)) {
+        if ((pending->interval_ms > 0) && !pending->cancelled
+            && safe_str_eq(pending->rsc_id, rsc_id)
+            && safe_str_eq(pending->op_key, key)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Remove a resource's stale recurring operation entries from the CIB
+ *
+ * \param[in] lrm_state  Executor state of the resource's node
+ * \param[in] rsc_id     Resource whose history was just updated
+ */
+static void
+compact_history(lrm_state_t *lrm_state, const char *rsc_id)
+{
+    rsc_history_t *entry = g_hash_table_lookup(lrm_state->resource_history,
+                                               rsc_id);
+    char *predicate = NULL;
+    char *op_xpath = NULL;
+    int removed = 0;
+
+    if ((entry == NULL) || (entry->stale_ops == NULL)) {
+        return;
+    }
+
+    for (GList *iter = entry->stale_ops; iter != NULL; iter = iter->next) {
+        const char *key = iter->data;
+        char *with_key = NULL;
+
+        // The op may have been started again before its old entry went stale
+        if (recurring_op_is_active(lrm_state, rsc_id, key)) {
+            continue;
+        }
+        with_key = crm_strdup_printf("%s%s@" XML_ATTR_ID "='%s'",
+                                     (predicate? predicate : ""),
+                                     (predicate? " or " : ""), key);
+        free(predicate);
+        predicate = with_key;
+        removed++;
+    }
+    g_list_free_full(entry->stale_ops, free);
+    entry->stale_ops = NULL;
+
+    if (predicate == NULL) {
+        return;
+    }
+
+    op_xpath = crm_strdup_printf(XPATH_HISTORY "[%s]", lrm_state->node_name,
+                                 rsc_id, predicate);
+    crm_info("Compacting history of %s on %s by removing %d stale recurring "
+             "operation entr%s", rsc_id, lrm_state->node_name, removed,
+             ((removed == 1)? "y" : "ies"));
+    history_compactions++;
+    history_compacted_ops += removed;
+
+    // Any batched result that made these stale must be written first
+    controld_flush_resource_updates();
     fsa_cib_conn->cmds->remove(fsa_cib_conn, op_xpath, NULL,
                                cib_quorum_override | cib_xpath);
     free(op_xpath);
+    free(predicate);
 }
 
 static inline gboolean
@@ -1121,7 +1558,7 @@ lrm_clear_last_failure(const char *rsc_id, const char *node_name,
                                                    rsc_id);
 
         if (last_failed_matches_op(entry, operation, interval_ms)) {
-            lrmd_free_event(entry->failed);
+            history_free_event(entry->failed);
             entry->failed = NULL;
         }
     }
@@ -1561,6 +1998,7 @@ handle_refresh_op(lrm_state_t *lrm_state, const char *user_name,
     int rc = pcmk_ok;
     xmlNode *fragment = do_lrm_query_internal(lrm_state, node_update_all);
 
+    controld_flush_resource_updates();
     fsa_cib_update(XML_CIB_TAG_STATUS, fragment, cib_quorum_override, rc, user_name);
     crm_info("Forced a local resource history refresh: call=%d", rc);
 
@@ -1618,6 +2056,137 @@ handle_reprobe_op(lrm_state_t *lrm_state, const char *from_sys,
     }
 }
 
+/*!
+ * \internal
+ * \brief Clean up the history of several resources on a node at once
+ *
+ * Unlike a CRM_OP_LRM_DELETE request per resource, this erases the history
+ * of all the listed resources in a single CIB request, triggers a single
+ * refresh, and sends a single reply.
+ *
+ * \param[in] input      Request, with a resource element per resource to clean
+ * \param[in] lrm_state  Executor state of node to clean up
+ * \param[in] from_sys   Subsystem that sent the request
+ * \param[in] from_host  Node that sent the request
+ * \param[in] user_name  ACL user to apply CIB changes as
+ */
+static void
+handle_cleanup_op(ha_msg_input_t *input, lrm_state_t *lrm_state,
+                  const char *from_sys, const char *from_host,
+                  const char *user_name)
+{
+    GList *rsc_ids = NULL;
+    char *xpath = NULL;
+    int n_rscs = 0;
+    int rc = pcmk_ok;
+    xmlNode *reply = NULL;
+
+    // Resolve the executor's IDs (the request may use clone names)
+    for (xmlNode *xml_rsc = first_named_child(input->xml, XML_CIB_TAG_RESOURCE);
+         xml_rsc != NULL; xml_rsc = crm_next_same_xml(xml_rsc)) {
+
+        lrmd_rsc_info_t *rsc = NULL;
+        char *one = NULL;
+
+        if (ID(xml_rsc) == NULL) {
+            continue;
+        }
+        if (get_lrm_resource(lrm_state, xml_rsc, FALSE, &rsc) == pcmk_ok) {
+            rsc_ids = g_list_prepend(rsc_ids, strdup(rsc->id));
+            lrmd_free_rsc_info(rsc);
+        } else {
+            // Deleting something that does not exist is a success
+            rsc_ids = g_list_prepend(rsc_ids, strdup(ID(xml_rsc)));
+        }
+
+        one = crm_strdup_printf(rsc_template, lrm_state->node_name,
+                                (const char *) rsc_ids->data);
+        if (xpath == NULL) {
+            xpath = one;
+        } else {
+            char *both = crm_strdup_printf("%s|%s", xpath, one);
+
+            free(xpath);
+            free(one);
+            xpath = both;
+        }
+        n_rscs++;
+    }
+
+    if (xpath == NULL) {
+        crm_debug("Ignoring cleanup request from %s with no resources",
+                  from_sys);
+        goto done;
+    }
+
+#if ENABLE_ACL
+    rc = cib_internal_op(fsa_cib_conn, CIB_OP_DELETE, NULL, xpath, NULL, NULL,
+                         cib_xpath|cib_multiple|cib_dryrun|cib_sync_call,
+                         user_name);
+    if (rc != pcmk_ok) {
+        crm_err("Could not clean up %d resource%s for %s (user %s) on %s: %s "
+                CRM_XS " rc=%d",
+                n_rscs, s_if_plural(n_rscs), from_sys,
+                (user_name? user_name : "unknown"), lrm_state->node_name,
+                pcmk_strerror(rc), rc);
+        goto done;
+    }
+#endif
+
+    crm_info("Cleaning up %d resource%s on %s for %s (%s)",
+             n_rscs, s_if_plural(n_rscs), lrm_state->node_name, from_sys,
+             (user_name? user_name : "internal"));
+
+    for (GList *iter = rsc_ids; iter != NULL; iter = iter->next) {
+        const char *rsc_id = iter->data;
+
+        /* Keep remote connections registered, since unregistering one would
+         * end the remote node's membership
+         */
+        if (!is_remote_lrmd_ra(NULL, NULL, rsc_id)
+            && lrm_state_is_connected(lrm_state)) {
+            int unreg_rc = lrm_state_unregister_rsc(lrm_state, rsc_id, 0);
+
+            if ((unreg_rc != pcmk_ok) && (unreg_rc != -EINPROGRESS)) {
+                crm_warn("Could not remove %s from the executor on %s: %s "
+                         CRM_XS " rc=%d", rsc_id, lrm_state->node_name,
+                         pcmk_strerror(unreg_rc), unreg_rc);
+            }
+        }
+        g_hash_table_remove(lrm_state->resource_history, rsc_id);
+        g_hash_table_foreach_remove(lrm_state->pending_ops,
+                                    lrm_remove_deleted_op, (gpointer) rsc_id);
+    }
+
+    controld_flush_resource_updates();
+    rc = cib_internal_op(fsa_cib_conn, CIB_OP_DELETE, NULL, xpath, NULL, NULL,
+                         cib_quorum_override|cib_xpath|cib_multiple,
+                         user_name);
+    if (rc > 0) {
+        rc = pcmk_ok;
+    }
+
+    if (safe_str_neq(from_sys, CRM_SYSTEM_TENGINE)) {
+        char *what = crm_strdup_printf("%d resource%s", n_rscs,
+                                       s_if_plural(n_rscs));
+
+        trigger_deletion_refresh(from_sys, what);
+        free(what);
+    }
+
+done:
+    reply = create_request(CRM_OP_INVOKE_LRM, NULL, from_host, from_sys,
+                           CRM_SYSTEM_LRMD, fsa_our_uuid);
+    crm_xml_add_int(reply, XML_LRM_ATTR_RC, rc);
+    crm_debug("ACK'ing cleanup from %s (%s)", from_sys, from_host);
+    if (relay_message(reply, TRUE) == FALSE) {
+        crm_log_xml_err(reply, "Unable to route reply");
+    }
+    free_xml(reply);
+    g_list_free_full(rsc_ids, free);
+    free(xpath);
+}
+
 static bool do_lrm_cancel(ha_msg_input_t *input, lrm_state_t *lrm_state,
               lrmd_rsc_info_t *rsc, const char *from_host, const char *from_sys)
 {
@@ -1789,6 +2358,10 @@ do_lrm_invoke(long long action,
                           from_sys);
         return;
 
+    } else if (safe_str_eq(crm_op, CRM_OP_LRM_CLEANUP)) {
+        handle_cleanup_op(input, lrm_state, from_sys, from_host, user_name);
+        return;
+
     } else if (input->xml != NULL) {
         operation = crm_element_value(input->xml, XML_LRM_ATTR_TASK);
     }
@@ -2038,15 +2611,95 @@ construct_op(lrm_state_t * lrm_state, xmlNode * rsc_op, const char *rsc_id, cons
     return op;
 }
 
-void
-send_direct_ack(const char *to_host, const char *to_sys,
-                lrmd_rsc_info_t * rsc, lrmd_event_data_t * op, const char *rsc_id)
+/* While a batch of executor requests is processed, acknowledgements to the
+ * batch's sender are collected and sent together once the batch is done.
+ */
+static xmlNode *ack_batch = NULL;
+static char *ack_batch_host = NULL;
+static char *ack_batch_sys = NULL;
+
+static void
+flush_ack_batch(void)
 {
-    xmlNode *reply = NULL;
-    xmlNode *update, *iter;
-    crm_node_t *peer = NULL;
+    if (ack_batch == NULL) {
+        return;
+    }
 
-    CRM_CHECK(op != NULL, return);
+    if (__xml_first_child(ack_batch) != NULL) {
+        xmlNode *reply = create_request(CRM_OP_INVOKE_LRM, ack_batch,
+                                        ack_batch_host, ack_batch_sys,
+                                        CRM_SYSTEM_LRMD, NULL);
+
+        crm_debug("ACK'ing %lu resource ops at once: %s",
+                  xmlChildElementCount(ack_batch),
+                  crm_element_value(reply, XML_ATTR_REFERENCE));
+        if (relay_message(reply, TRUE) == FALSE) {
+            crm_log_xml_err(reply, "Unable to route reply");
+        }
+        free_xml(reply);
+    }
+
+    free_xml(ack_batch);
+    free(ack_batch_host);
+    free(ack_batch_sys);
+    ack_batch = NULL;
+    ack_batch_host = NULL;
+    ack_batch_sys = NULL;
+}
+
+/*!
+ * \internal
+ * \brief Handle a CRM_OP_INVOKE_LRM_BATCH request
+ *
+ * Each executor request in the batch is handled exactly as if it had arrived
+ * in its own CRM_OP_INVOKE_LRM message, except that any direct
+ * acknowledgements are sent back in a single reply.
+ *
+ * \param[in] msg_data  FSA data with the batch message
+ */
+void
+do_lrm_invoke_batch(fsa_data_t *msg_data)
+{
+    ha_msg_input_t *input = fsa_typed_data(fsa_dt_ha_msg);
+    ha_msg_input_t op_input = { .msg = input->msg, .xml = NULL };
+    fsa_data_t op_data = *msg_data;
+    const char *from_sys = crm_element_value(input->msg, F_CRM_SYS_FROM);
+    xmlNode *rsc_op = NULL;
+
+    CRM_CHECK(input->xml != NULL, return);
+
+    flush_ack_batch();
+    ack_batch = create_xml_node(NULL, CRM_OP_INVOKE_LRM_BATCH);
+    ack_batch_sys = strdup(from_sys? from_sys : CRM_SYSTEM_TENGINE);
+    if (safe_str_neq(from_sys, CRM_SYSTEM_TENGINE)) {
+        // Same as do_lrm_invoke()
+        ack_batch_host = crm_element_value_copy(input->msg, F_CRM_HOST_FROM);
+    }
+
+    crm_debug("Processing %lu executor requests from %s",
+              xmlChildElementCount(input->xml), crm_str(from_sys));
+
+    crm_xml_add(input->msg, F_CRM_TASK, CRM_OP_INVOKE_LRM);
+    op_data.data = &op_input;
+    for (rsc_op = __xml_first_child(input->xml); rsc_op != NULL;
+         rsc_op = __xml_next(rsc_op)) {
+        op_input.xml = rsc_op;
+        do_lrm_invoke(A_LRM_INVOKE, msg_data->fsa_cause, fsa_state,
+                      msg_data->fsa_input, &op_data);
+    }
+
+    flush_ack_batch();
+}
+
+void
+send_direct_ack(const char *to_host, const char *to_sys,
+                lrmd_rsc_info_t * rsc, lrmd_event_data_t * op, const char *rsc_id)
+{
+    xmlNode *reply = NULL;
+    xmlNode *update, *iter;
+    crm_node_t *peer = NULL;
+
+    CRM_CHECK(op != NULL, return);
     if (op->rsc_id == NULL) {
         CRM_ASSERT(rsc_id != NULL);
         op->rsc_id = strdup(rsc_id);
@@ -2067,6 +2720,16 @@ send_direct_ack(const char *to_host, const char *to_sys,
     crm_xml_add(iter, XML_ATTR_ID, op->rsc_id);
 
     build_operation_update(iter, rsc, op, fsa_our_uname, __FUNCTION__);
+
+    if ((ack_batch != NULL) && safe_str_eq(to_host, ack_batch_host)
+        && safe_str_eq(to_sys, ack_batch_sys)) {
+        crm_debug("Batching ACK for resource op " CRM_OP_FMT,
+                  op->rsc_id, op->op_type, op->interval_ms, op->user_data);
+        add_node_copy(ack_batch, update);
+        free_xml(update);
+        return;
+    }
+
     reply = create_request(CRM_OP_INVOKE_LRM, update, to_host, to_sys, CRM_SYSTEM_LRMD, NULL);
 
     crm_log_xml_trace(update, "ACK Update");
@@ -2177,6 +2840,223 @@ record_pending_op(const char *node_name, lrmd_rsc_info_t *rsc, lrmd_event_data_t
     do_update_resource(node_name, rsc, op);
 }
 
+static lrmd_key_value_t *
+exec_params(lrmd_event_data_t *op)
+{
+    lrmd_key_value_t *params = NULL;
+
+    if (op->params) {
+        char *key = NULL;
+        char *value = NULL;
+        GHashTableIter iter;
+
+        g_hash_table_iter_init(&iter, op->params);
+        while (g_hash_table_iter_next(&iter, (gpointer *) & key, (gpointer *) & value)) {
+            params = lrmd_key_value_add(params, key, value);
+        }
+    }
+    return params;
+}
+
+/*!
+ * \internal
+ * \brief Record the result of asking the executor to perform an operation
+ *
+ * \param[in]     lrm_state  Executor state operation was sent to
+ * \param[in]     rsc        Resource operation is on
+ * \param[in,out] op         Operation (its params are taken if it was sent)
+ * \param[in]     op_id      Operation key
+ * \param[in]     call_id    Executor call ID (or negative error code)
+ */
+static void
+exec_done(lrm_state_t *lrm_state, lrmd_rsc_info_t *rsc, lrmd_event_data_t *op,
+          const char *op_id, int call_id)
+{
+    const char *operation = op->op_type;
+    fsa_data_t *msg_data = NULL;
+
+    if (call_id <= 0 && lrm_state_is_local(lrm_state)) {
+        crm_err("Operation %s on %s failed: %d", operation, rsc->id, call_id);
+        register_fsa_error(C_FSA_INTERNAL, I_FAIL, NULL);
+
+    } else if (call_id <= 0) {
+        crm_err("Operation %s on resource %s failed to execute on remote node %s: %d",
+                operation, rsc->id, lrm_state->node_name, call_id);
+        fake_op_status(lrm_state, op, PCMK_LRM_OP_DONE, PCMK_OCF_UNKNOWN_ERROR);
+        process_lrm_event(lrm_state, op, NULL);
+
+    } else {
+        /* record all operations so we can wait
+         * for them to complete during shutdown
+         */
+        char *call_id_s = make_stop_id(rsc->id, call_id);
+        struct recurring_op_s *pending = NULL;
+
+        pending = calloc(1, sizeof(struct recurring_op_s));
+        crm_trace("Recording pending op: %d - %s %s", call_id, op_id, call_id_s);
+
+        pending->call_id = call_id;
+        pending->interval_ms = op->interval_ms;
+        pending->op_type = strdup(operation);
+        pending->op_key = strdup(op_id);
+        pending->rsc_id = strdup(rsc->id);
+        pending->start_time = time(NULL);
+        pending->user_data = strdup(op->user_data);
+        g_hash_table_replace(lrm_state->pending_ops, call_id_s, pending);
+
+        if ((op->interval_ms > 0)
+            && (op->start_delay > START_DELAY_THRESHOLD)) {
+
+            char *uuid = NULL;
+            int dummy = 0, target_rc = 0;
+
+            crm_info("Faking confirmation of %s: execution postponed for over 5 minutes", op_id);
+
+            decode_transition_key(op->user_data, &uuid, &dummy, &dummy, &target_rc);
+            free(uuid);
+
+            op->rc = target_rc;
+            op->op_status = PCMK_LRM_OP_DONE;
+            send_direct_ack(NULL, NULL, rsc, op, rsc->id);
+        }
+
+        pending->params = op->params;
+        op->params = NULL;
+    }
+}
+
+/*
+ * Probe batching
+ *
+ * When a node's resources are probed (after it joins, or after a refresh), the
+ * controller gets one request per resource, often many in one dispatch of
+ * cluster messages. Rather than an executor request and reply for each, probes
+ * are queued and sent together with the executor API's exec_batch(), from a
+ * high-priority trigger that runs once the current batch of messages has been
+ * handled. Any other request to the same executor first sends the queue, so
+ * the executor still sees requests in the order they were made.
+ */
+
+struct queued_exec_s {
+    lrmd_rsc_info_t *rsc;
+    lrmd_event_data_t *op;
+    char *op_id;
+};
+
+static crm_trigger_t *exec_batch_trigger = NULL;
+
+static void
+free_queued_exec(gpointer data)
+{
+    struct queued_exec_s *queued = data;
+
+    lrmd_free_rsc_info(queued->rsc);
+    lrmd_free_event(queued->op);
+    free(queued->op_id);
+    free(queued);
+}
+
+static gboolean
+exec_can_batch(lrmd_rsc_info_t *rsc, lrmd_event_data_t *op)
+{
+    return (op->interval_ms == 0)
+           && safe_str_eq(op->op_type, CRMD_ACTION_STATUS)
+           && !is_remote_lrmd_ra(NULL, NULL, rsc->id);
+}
+
+static gboolean
+flush_all_execs(gpointer user_data)
+{
+    GList *states = lrm_state_get_list();
+
+    for (GList *iter = states; iter != NULL; iter = iter->next) {
+        lrm_state_flush_execs((lrm_state_t *) iter->data);
+    }
+    g_list_free(states);
+    return TRUE;
+}
+
+// Takes ownership of op and op_id
+static void
+queue_exec(lrm_state_t *lrm_state, lrmd_rsc_info_t *rsc, lrmd_event_data_t *op,
+           char *op_id)
+{
+    struct queued_exec_s *queued = calloc(1, sizeof(struct queued_exec_s));
+
+    CRM_ASSERT(queued != NULL);
+    queued->rsc = lrmd_copy_rsc_info(rsc);
+    queued->op = op;
+    queued->op_id = op_id;
+    lrm_state->queued_execs = g_list_append(lrm_state->queued_execs, queued);
+
+    if (exec_batch_trigger == NULL) {
+        exec_batch_trigger = mainloop_add_trigger(G_PRIORITY_HIGH,
+                                                  flush_all_execs, NULL);
+        pcmk__trigger_set_name(exec_batch_trigger, "exec-batch");
+    }
+    mainloop_set_trigger(exec_batch_trigger);
+}
+
+void
+lrm_state_flush_execs(lrm_state_t *lrm_state)
+{
+    GList *queue = lrm_state->queued_execs;
+    lrmd_exec_op_t *ops = NULL;
+    int n_ops = 0;
+    int lpc = 0;
+
+    if (queue == NULL) {
+        return;
+    }
+
+    // Anything done while handling results must not see this queue again
+    lrm_state->queued_execs = NULL;
+
+    n_ops = g_list_length(queue);
+    ops = calloc(n_ops, sizeof(lrmd_exec_op_t));
+    CRM_ASSERT(ops != NULL);
+
+    for (GList *iter = queue; iter != NULL; iter = iter->next, lpc++) {
+        struct queued_exec_s *queued = iter->data;
+
+        ops[lpc].rsc_id = queued->rsc->id;
+        ops[lpc].action = queued->op->op_type;
+        ops[lpc].userdata = queued->op->user_data;
+        ops[lpc].interval_ms = queued->op->interval_ms;
+        ops[lpc].timeout = queued->op->timeout;
+        ops[lpc].start_delay = queued->op->start_delay;
+        ops[lpc].params = exec_params(queued->op);
+    }
+
+    crm_debug("Sending %d probe%s to executor on %s",
+              n_ops, s_if_plural(n_ops), lrm_state->node_name);
+    lrm_state_exec_batch(lrm_state, ops, n_ops);
+
+    lpc = 0;
+    for (GList *iter = queue; iter != NULL; iter = iter->next, lpc++) {
+        struct queued_exec_s *queued = iter->data;
+
+        exec_done(lrm_state, queued->rsc, queued->op, queued->op_id,
+                  ops[lpc].call_id);
+    }
+
+    free(ops);
+    g_list_free_full(queue, free_queued_exec);
+}
+
+void
+lrm_state_discard_execs(lrm_state_t *lrm_state)
+{
+    if (lrm_state->queued_execs != NULL) {
+        crm_debug("Discarding %u queued probe%s for %s",
+                  g_list_length(lrm_state->queued_execs),
+                  s_if_plural(g_list_length(lrm_state->queued_execs)),
+                  lrm_state->node_name);
+        g_list_free_full(lrm_state->queued_execs, free_queued_exec);
+        lrm_state->queued_execs = NULL;
+    }
+}
+
 static void
 do_lrm_rsc_op(lrm_state_t * lrm_state, lrmd_rsc_info_t * rsc, const char *operation, xmlNode * msg,
               xmlNode * request)
@@ -2184,8 +3064,6 @@ do_lrm_rsc_op(lrm_state_t * lrm_state, lrmd_rsc_info_t * rsc, const char *operat
     int call_id = 0;
     char *op_id = NULL;
     lrmd_event_data_t *op = NULL;
-    lrmd_key_value_t *params = NULL;
-    fsa_data_t *msg_data = NULL;
     const char *transition = NULL;
     gboolean stop_recurring = FALSE;
     bool send_nack = FALSE;
@@ -2274,80 +3152,68 @@ do_lrm_rsc_op(lrm_state_t * lrm_state, lrmd_rsc_info_t * rsc, const char *operat
         cancel_op_key(lrm_state, rsc, op_id, FALSE);
     }
 
-    if (op->params) {
-        char *key = NULL;
-        char *value = NULL;
-        GHashTableIter iter;
-
-        g_hash_table_iter_init(&iter, op->params);
-        while (g_hash_table_iter_next(&iter, (gpointer *) & key, (gpointer *) & value)) {
-            params = lrmd_key_value_add(params, key, value);
-        }
+    if (exec_can_batch(rsc, op)) {
+        queue_exec(lrm_state, rsc, op, op_id);
+        return;
     }
 
     call_id = lrm_state_exec(lrm_state, rsc->id, op->op_type, op->user_data,
                              op->interval_ms, op->timeout, op->start_delay,
-                             params);
-
-    if (call_id <= 0 && lrm_state_is_local(lrm_state)) {
-        crm_err("Operation %s on %s failed: %d", operation, rsc->id, call_id);
-        register_fsa_error(C_FSA_INTERNAL, I_FAIL, NULL);
-
-    } else if (call_id <= 0) {
-        crm_err("Operation %s on resource %s failed to execute on remote node %s: %d",
-                operation, rsc->id, lrm_state->node_name, call_id);
-        fake_op_status(lrm_state, op, PCMK_LRM_OP_DONE, PCMK_OCF_UNKNOWN_ERROR);
-        process_lrm_event(lrm_state, op, NULL);
-
-    } else {
-        /* record all operations so we can wait
-         * for them to complete during shutdown
-         */
-        char *call_id_s = make_stop_id(rsc->id, call_id);
-        struct recurring_op_s *pending = NULL;
-
-        pending = calloc(1, sizeof(struct recurring_op_s));
-        crm_trace("Recording pending op: %d - %s %s", call_id, op_id, call_id_s);
-
-        pending->call_id = call_id;
-        pending->interval_ms = op->interval_ms;
-        pending->op_type = strdup(operation);
-        pending->op_key = strdup(op_id);
-        pending->rsc_id = strdup(rsc->id);
-        pending->start_time = time(NULL);
-        pending->user_data = strdup(op->user_data);
-        g_hash_table_replace(lrm_state->pending_ops, call_id_s, pending);
+                             exec_params(op));
+    exec_done(lrm_state, rsc, op, op_id, call_id);
 
-        if ((op->interval_ms > 0)
-            && (op->start_delay > START_DELAY_THRESHOLD)) {
+    free(op_id);
+    lrmd_free_event(op);
+    return;
+}
 
-            char *uuid = NULL;
-            int dummy = 0, target_rc = 0;
+int last_resource_update = 0;
 
-            crm_info("Faking confirmation of %s: execution postponed for over 5 minutes", op_id);
+/* When trace events are being recorded, the span IDs of failed operations
+ * (comma-separated) whose results are batched, and of those in each CIB update
+ * until it completes (by call ID)
+ */
+static char *rsc_update_spans = NULL;
+static GHashTable *history_spans = NULL;
 
-            decode_transition_key(op->user_data, &uuid, &dummy, &dummy, &target_rc);
-            free(uuid);
+static void
+add_span(char **spans, const char *span)
+{
+    char *old = *spans;
 
-            op->rc = target_rc;
-            op->op_status = PCMK_LRM_OP_DONE;
-            send_direct_ack(NULL, NULL, rsc, op, rsc->id);
-        }
+    *spans = old? crm_strdup_printf("%s,%s", old, span) : strdup(span);
+    free(old);
+}
 
-        pending->params = op->params;
-        op->params = NULL;
+static void
+history_spans_sent(int call_id, char *spans)
+{
+    if (spans == NULL) {
+        return;
     }
-
-    free(op_id);
-    lrmd_free_event(op);
-    return;
+    pcmk__trace_hops(pcmk__hop_history_sent, call_id, spans);
+    if (call_id <= 0) {
+        free(spans);
+        return;
+    }
+    if (history_spans == NULL) {
+        history_spans = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                              NULL, free);
+    }
+    g_hash_table_replace(history_spans, GINT_TO_POINTER(call_id), spans);
 }
 
-int last_resource_update = 0;
-
 static void
 cib_rsc_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void *user_data)
 {
+    if (history_spans != NULL) {
+        const char *spans = g_hash_table_lookup(history_spans,
+                                                GINT_TO_POINTER(call_id));
+
+        pcmk__trace_hops(pcmk__hop_history_committed, rc, spans);
+        g_hash_table_remove(history_spans, GINT_TO_POINTER(call_id));
+    }
+
     switch (rc) {
         case pcmk_ok:
         case -pcmk_err_diff_failed:
@@ -2358,12 +3224,179 @@ cib_rsc_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void *use
             crm_warn("Resource update %d failed: (rc=%d) %s", call_id, rc, pcmk_strerror(rc));
     }
 
+    if ((rc == pcmk_ok) && (user_data != NULL)) {
+        gint64 sent = *(gint64 *) user_data;
+
+        throttle_record_cib_latency((guint) ((g_get_monotonic_time() - sent)
+                                             / 1000));
+    }
+
     if (call_id == last_resource_update) {
         last_resource_update = 0;
         trigger_fsa(fsa_source);
     }
 }
 
+/*
+ * Resource history updates
+ *
+ * Operation results recorded within PCMK_resource_update_delay milliseconds of
+ * the first (by default, 2) are written to the CIB in a single update. The
+ * batch is sent when the delay expires, and before anything else that could
+ * change or remove resource history, so the CIB still sees the results (and
+ * the transition engine still gets confirmations) in the order they happened.
+ */
+#define RSC_UPDATE_DELAY_DEFAULT "2"
+
+static int rsc_update_delay = -1;
+static xmlNode *rsc_update_batch = NULL;        // <status>
+static GHashTable *rsc_update_nodes = NULL;     // uuid -> <lrm_resources>
+static GHashTable *rsc_update_resources = NULL; // "uuid rsc" -> <lrm_resource>
+static guint rsc_update_timer = 0;
+static int rsc_update_count = 0;
+
+static int
+resource_update_delay(void)
+{
+    if (rsc_update_delay < 0) {
+        rsc_update_delay = crm_parse_int(daemon_option("resource_update_delay"),
+                                         RSC_UPDATE_DELAY_DEFAULT);
+        if (rsc_update_delay < 0) {
+            rsc_update_delay = 0;
+        }
+    }
+    return rsc_update_delay;
+}
+
+// Time that a resource history update was sent (for its CIB callback)
+static gint64 *
+resource_update_sent(void)
+{
+    gint64 *sent = malloc(sizeof(gint64));
+
+    CRM_ASSERT(sent != NULL);
+    *sent = g_get_monotonic_time();
+    return sent;
+}
+
+/*!
+ * \internal
+ * \brief Write any batched operation results to the CIB
+ *
+ * \note This must be called before any other change to the status section that
+ *       must be ordered after resource history updates.
+ */
+void
+controld_flush_resource_updates(void)
+{
+    int rc = pcmk_ok;
+
+    if (rsc_update_batch == NULL) {
+        return;
+    }
+    if (rsc_update_timer != 0) {
+        g_source_remove(rsc_update_timer);
+        rsc_update_timer = 0;
+    }
+
+    crm_log_xml_trace(rsc_update_batch, __FUNCTION__);
+    fsa_cib_update(XML_CIB_TAG_STATUS, rsc_update_batch, crmd_cib_smart_opt(),
+                   rc, NULL);
+    if (rc > 0) {
+        last_resource_update = rc;
+    }
+    crm_debug("Sent %d resource operation result%s in update %d",
+              rsc_update_count, ((rsc_update_count == 1)? "" : "s"), rc);
+    fsa_register_cib_callback(rc, FALSE, resource_update_sent(),
+                              cib_rsc_callback);
+    history_spans_sent(rc, rsc_update_spans);
+    rsc_update_spans = NULL;
+
+    free_xml(rsc_update_batch);
+    g_hash_table_destroy(rsc_update_nodes);
+    g_hash_table_destroy(rsc_update_resources);
+    rsc_update_batch = NULL;
+    rsc_update_nodes = NULL;
+    rsc_update_resources = NULL;
+    rsc_update_count = 0;
+}
+
+static gboolean
+resource_update_timer_cb(gpointer user_data)
+{
+    rsc_update_timer = 0;
+    controld_flush_resource_updates();
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Add one operation result to the batch of resource history updates
+ *
+ * \param[in] update  Status section update with a single operation result
+ */
+static void
+queue_resource_update(xmlNode *update)
+{
+    xmlNode *state = first_named_child(update, XML_CIB_TAG_STATE);
+    xmlNode *lrm_rsc = first_named_child(state, XML_CIB_TAG_LRM);
+    xmlNode *rsc_op = NULL;
+    xmlNode *batched = NULL;
+    const char *uuid = ID(state);
+    char *key = NULL;
+
+    lrm_rsc = first_named_child(lrm_rsc, XML_LRM_TAG_RESOURCES);
+    lrm_rsc = first_named_child(lrm_rsc, XML_LRM_TAG_RESOURCE);
+    rsc_op = first_named_child(lrm_rsc, XML_LRM_TAG_RSC_OP);
+    CRM_CHECK((uuid != NULL) && (rsc_op != NULL), return);
+
+    key = crm_strdup_printf("%s %s", uuid, ID(lrm_rsc));
+    if (rsc_update_batch != NULL) {
+        batched = g_hash_table_lookup(rsc_update_resources, key);
+    }
+    if ((batched != NULL)
+        && (find_entity(batched, XML_LRM_TAG_RSC_OP, ID(rsc_op)) != NULL)) {
+        // An earlier result for the same history entry must be written first
+        controld_flush_resource_updates();
+        batched = NULL;
+    }
+
+    if (rsc_update_batch == NULL) {
+        rsc_update_batch = create_xml_node(NULL, XML_CIB_TAG_STATUS);
+        rsc_update_nodes = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                 free, NULL);
+        rsc_update_resources = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                     free, NULL);
+        rsc_update_timer = g_timeout_add(resource_update_delay(),
+                                         resource_update_timer_cb, NULL);
+    }
+
+    if (batched != NULL) {
+        add_node_copy(batched, rsc_op);
+
+    } else {
+        xmlNode *lrm_rscs = g_hash_table_lookup(rsc_update_nodes, uuid);
+
+        if (lrm_rscs == NULL) {
+            // Copy the whole node_state, which has only this result so far
+            state = add_node_copy(rsc_update_batch, state);
+            lrm_rscs = first_named_child(first_named_child(state,
+                                                           XML_CIB_TAG_LRM),
+                                         XML_LRM_TAG_RESOURCES);
+            g_hash_table_insert(rsc_update_nodes, strdup(uuid), lrm_rscs);
+            batched = first_named_child(lrm_rscs, XML_LRM_TAG_RESOURCE);
+
+        } else {
+            batched = add_node_copy(lrm_rscs, lrm_rsc);
+        }
+        g_hash_table_insert(rsc_update_resources, key, batched);
+        key = NULL;
+    }
+
+    rsc_update_count++;
+    free(key);
+}
+
 static int
 do_update_resource(const char *node_name, lrmd_rsc_info_t * rsc, lrmd_event_data_t * op)
 {
@@ -2379,9 +3412,16 @@ do_update_resource(const char *node_name, lrmd_rsc_info_t * rsc, lrmd_event_data
     xmlNode *update, *iter = NULL;
     int call_opt = crmd_cib_smart_opt();
     const char *uuid = NULL;
+    char span[PCMK__TRACE_TAG_LEN] = { '\0', };
 
     CRM_CHECK(op != NULL, return 0);
 
+    if (pcmk__trace_active && did_rsc_op_fail(op, rsc_op_expected_rc(op))) {
+        pcmk__trace_span_id(span, op->rsc_id, op->call_id);
+        pcmk__trace_event(pcmk__trace_recovery_hop, pcmk__hop_result_received,
+                          op->rc, span);
+    }
+
     iter = create_xml_node(iter, XML_CIB_TAG_STATUS);
     update = iter;
     iter = create_xml_node(iter, XML_CIB_TAG_STATE);
@@ -2437,6 +3477,16 @@ do_update_resource(const char *node_name, lrmd_rsc_info_t * rsc, lrmd_event_data
 
     crm_log_xml_trace(update, __FUNCTION__);
 
+    if (resource_update_delay() > 0) {
+        queue_resource_update(update);
+        if (span[0] != '\0') {
+            add_span(&rsc_update_spans, span);
+        }
+        crm_trace("Batched resource state update for %s=%u on %s",
+                  op->op_type, op->interval_ms, op->rsc_id);
+        goto cleanup;
+    }
+
     /* make it an asynchronous call and be done with it
      *
      * Best case:
@@ -2463,7 +3513,11 @@ do_update_resource(const char *node_name, lrmd_rsc_info_t * rsc, lrmd_event_data
     /* the return code is a call number, not an error code */
     crm_trace("Sent resource state update message: %d for %s=%u on %s",
               rc, op->op_type, op->interval_ms, op->rsc_id);
-    fsa_register_cib_callback(rc, FALSE, NULL, cib_rsc_callback);
+    fsa_register_cib_callback(rc, FALSE, resource_update_sent(),
+                              cib_rsc_callback);
+    if (span[0] != '\0') {
+        history_spans_sent(rc, strdup(span));
+    }
 
   cleanup:
     free_xml(update);
@@ -2517,6 +3571,11 @@ process_lrm_event(lrm_state_t * lrm_state, lrmd_event_data_t * op, struct recurr
     op_id = make_stop_id(op->rsc_id, op->call_id);
     op_key = generate_op_key(op->rsc_id, op->op_type, op->interval_ms);
     rsc = lrm_state_get_rsc_info(lrm_state, op->rsc_id, 0);
+
+    if (lrm_state_is_local(lrm_state)
+        && (op->op_status != PCMK_LRM_OP_CANCELLED)) {
+        throttle_record_queue_time(op->queue_time);
+    }
     if(pending == NULL) {
         remove = TRUE;
         pending = g_hash_table_lookup(lrm_state->pending_ops, op_id);
@@ -2666,6 +3725,7 @@ process_lrm_event(lrm_state_t * lrm_state, lrmd_event_data_t * op, struct recurr
      */
     mainloop_set_trigger(fsa_source);
     update_history_cache(lrm_state, rsc, op);
+    compact_history(lrm_state, op->rsc_id);
 
     lrmd_free_rsc_info(rsc);
     free(op_key);
@@ -171,6 +171,7 @@ internal_lrm_state_destroy(gpointer data)
     crm_trace("Destroying proxy table %s with %d members", lrm_state->node_name, g_hash_table_size(proxy_table));
     g_hash_table_foreach_remove(proxy_table, remote_proxy_remove_by_node, (char *) lrm_state->node_name);
     remote_ra_cleanup(lrm_state);
+    lrm_state_discard_execs(lrm_state);
     lrmd_api_delete(lrm_state->conn);
 
     if (lrm_state->rsc_info_cache) {
@@ -335,6 +336,7 @@ lrm_state_disconnect_only(lrm_state_t * lrm_state)
     if (!lrm_state->conn) {
         return;
     }
+    lrm_state_flush_execs(lrm_state);
     crm_trace("Disconnecting %s", lrm_state->node_name);
 
     remote_proxy_disconnect_by_node(lrm_state->node_name);
@@ -485,6 +487,8 @@ crmd_remote_proxy_cb(lrmd_t *lrmd, void *userdata, xmlNode *msg)
     remote_proxy_t *proxy = g_hash_table_lookup(proxy_table, session);
 
     const char *op = crm_element_value(msg, F_LRMD_IPC_OP);
+
+    remote_ra_count_traffic(lrm_state);
     if (safe_str_eq(op, LRMD_IPC_OP_NEW)) {
         const char *channel = crm_element_value(msg, F_LRMD_IPC_IPC_SERVER);
 
@@ -641,6 +645,7 @@ lrm_state_cancel(lrm_state_t *lrm_state, const char *rsc_id, const char *action,
     if (!lrm_state->conn) {
         return -ENOTCONN;
     }
+    lrm_state_flush_execs(lrm_state);
 
     /* Figure out a way to make this async?
      * NOTICE: Currently it's synced and directly acknowledged in do_lrm_invoke(). */
@@ -690,6 +695,7 @@ lrm_state_exec(lrm_state_t *lrm_state, const char *rsc_id, const char *action,
         lrmd_key_value_freeall(params);
         return -ENOTCONN;
     }
+    lrm_state_flush_execs(lrm_state);
 
     if (is_remote_lrmd_ra(NULL, NULL, rsc_id)) {
         return remote_ra_exec(lrm_state, rsc_id, action, userdata, interval_ms,
@@ -706,6 +712,34 @@ lrm_state_exec(lrm_state_t *lrm_state, const char *rsc_id, const char *action,
                                                     lrmd_opt_notify_changes_only, params);
 }
 
+/*!
+ * \internal
+ * \brief Execute several resource operations with one executor request
+ *
+ * \param[in]     lrm_state  Executor state for node to execute operations on
+ * \param[in,out] ops        Operations to execute (call_id of each will be set)
+ * \param[in]     n_ops      Number of entries in \p ops
+ *
+ * \return Number of operations successfully queued in executor
+ * \note The operations must not be on remote connection resources.
+ */
+int
+lrm_state_exec_batch(lrm_state_t *lrm_state, lrmd_exec_op_t *ops, int n_ops)
+{
+    if (!lrm_state->conn) {
+        for (int lpc = 0; lpc < n_ops; lpc++) {
+            lrmd_key_value_freeall(ops[lpc].params);
+            ops[lpc].params = NULL;
+            ops[lpc].call_id = -ENOTCONN;
+        }
+        return -ENOTCONN;
+    }
+
+    return ((lrmd_t *) lrm_state->conn)->cmds->exec_batch(lrm_state->conn,
+                                                          ops, n_ops,
+                                                          lrmd_opt_notify_changes_only);
+}
+
 int
 lrm_state_register_rsc(lrm_state_t * lrm_state,
                        const char *rsc_id,
@@ -736,6 +770,7 @@ lrm_state_unregister_rsc(lrm_state_t * lrm_state,
     if (!lrm_state->conn) {
         return -ENOTCONN;
     }
+    lrm_state_flush_execs(lrm_state);
 
     if (is_remote_lrmd_ra(NULL, NULL, rsc_id)) {
         lrm_state_destroy(rsc_id);
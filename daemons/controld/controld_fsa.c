@@ -121,6 +121,122 @@ do_fsa_action(fsa_data_t * fsa_data, long long an_action,
     function(an_action, fsa_data->fsa_cause, fsa_state, fsa_data->fsa_input, fsa_data);
 }
 
+/*
+ * FSA input statistics
+ *
+ * For each type of input, we count how many were processed, how long they
+ * waited in the queue (with a histogram of waits by order of magnitude), and
+ * how long the FSA took to process them. A DC that is slow to process inputs
+ * is busy in the FSA itself, while one whose inputs wait long in the queue is
+ * mostly busy with something else (such as other main loop sources).
+ */
+
+#define FSA_STATS_BUCKETS 6     // < 1ms, < 10ms, < 100ms, < 1s, < 10s, more
+
+struct fsa_input_stats_s {
+    unsigned long long count;
+    unsigned long long wait_us;
+    unsigned long long max_wait_us;
+    unsigned long long process_us;
+    unsigned long long max_process_us;
+    unsigned long long wait_histogram[FSA_STATS_BUCKETS];
+};
+
+static struct fsa_input_stats_s fsa_input_stats[MAXINPUT + 1];
+static unsigned int fsa_max_queue_len = 0;
+
+/*!
+ * \internal
+ * \brief Note the FSA queue length after an input is queued
+ *
+ * \param[in] queue_len  New length of FSA queue
+ */
+void
+fsa_stats_queued(unsigned int queue_len)
+{
+    if (queue_len > fsa_max_queue_len) {
+        fsa_max_queue_len = queue_len;
+    }
+}
+
+static void
+fsa_stats_record(fsa_data_t *fsa_data, gint64 start)
+{
+    struct fsa_input_stats_s *stats = NULL;
+    gint64 now = g_get_monotonic_time();
+    unsigned long long wait_us = 0;
+    unsigned long long process_us = (unsigned long long) (now - start);
+    int bucket = 0;
+
+    if ((fsa_data->fsa_input < 0) || (fsa_data->fsa_input > MAXINPUT)) {
+        return;
+    }
+    stats = &(fsa_input_stats[fsa_data->fsa_input]);
+
+    if ((fsa_data->queued > 0) && (start > fsa_data->queued)) {
+        wait_us = (unsigned long long) (start - fsa_data->queued);
+    }
+    for (unsigned long long limit = 1000;
+         (wait_us >= limit) && (bucket < (FSA_STATS_BUCKETS - 1));
+         limit *= 10) {
+        bucket++;
+    }
+
+    stats->count++;
+    stats->wait_us += wait_us;
+    stats->max_wait_us = QB_MAX(stats->max_wait_us, wait_us);
+    stats->process_us += process_us;
+    stats->max_process_us = QB_MAX(stats->max_process_us, process_us);
+    stats->wait_histogram[bucket]++;
+}
+
+/*!
+ * \internal
+ * \brief Add FSA input statistics to XML
+ *
+ * \param[in,out] parent  XML to add an "fsa-stats" child to
+ */
+void
+fsa_stats_add_xml(xmlNode *parent)
+{
+    xmlNode *xml = create_xml_node(parent, "fsa-stats");
+    char *s = NULL;
+
+    crm_xml_add_int(xml, "queue_len", g_queue_get_length(&fsa_message_queue));
+    crm_xml_add_int(xml, "max_queue_len", fsa_max_queue_len);
+
+    for (int lpc = 0; lpc <= MAXINPUT; lpc++) {
+        struct fsa_input_stats_s *stats = &(fsa_input_stats[lpc]);
+        xmlNode *input = NULL;
+
+        if (stats->count == 0) {
+            continue;
+        }
+        input = create_xml_node(xml, "input");
+        crm_xml_add(input, XML_ATTR_ID,
+                    fsa_input2string((enum crmd_fsa_input) lpc));
+
+#define add_stat(name, value) do {                                      \
+            s = crm_strdup_printf("%llu", (value));                     \
+            crm_xml_add(input, (name), s);                              \
+            free(s);                                                    \
+        } while (0)
+
+        add_stat("count", stats->count);
+        add_stat("wait_us", stats->wait_us);
+        add_stat("max_wait_us", stats->max_wait_us);
+        add_stat("process_us", stats->process_us);
+        add_stat("max_process_us", stats->max_process_us);
+        add_stat("wait_lt_1ms", stats->wait_histogram[0]);
+        add_stat("wait_lt_10ms", stats->wait_histogram[1]);
+        add_stat("wait_lt_100ms", stats->wait_histogram[2]);
+        add_stat("wait_lt_1s", stats->wait_histogram[3]);
+        add_stat("wait_lt_10s", stats->wait_histogram[4]);
+        add_stat("wait_ge_10s", stats->wait_histogram[5]);
+#undef add_stat
+    }
+}
+
 static long long startup_actions =
     A_STARTUP | A_CIB_START | A_LRM_CONNECT | A_HA_CONNECT | A_READCONFIG |
     A_STARTED | A_CL_JOIN_QUERY;
@@ -187,16 +303,21 @@ s_crmd_fsa(enum crmd_fsa_cause cause)
         fsa_data->fsa_cause = C_FSA_INTERNAL;
         fsa_data->origin = __FUNCTION__;
         fsa_data->data_type = fsa_dt_none;
-        fsa_message_queue = g_list_append(fsa_message_queue, fsa_data);
+        fsa_data->queued = g_get_monotonic_time();
+        g_queue_push_tail(&fsa_message_queue, fsa_data);
         fsa_data = NULL;
     }
     while (is_message() && do_fsa_stall == FALSE) {
-        crm_trace("Checking messages (%d remaining)", g_list_length(fsa_message_queue));
+        gint64 start = 0;
+
+        crm_trace("Checking messages (%u remaining)",
+                  g_queue_get_length(&fsa_message_queue));
 
         fsa_data = get_message();
         if(fsa_data == NULL) {
             continue;
         }
+        start = g_get_monotonic_time();
 
         log_fsa_input(fsa_data);
 
@@ -254,13 +375,15 @@ s_crmd_fsa(enum crmd_fsa_cause cause)
 
         /* start doing things... */
         s_crmd_fsa_actions(fsa_data);
+        fsa_stats_record(fsa_data, start);
         delete_fsa_input(fsa_data);
         fsa_data = NULL;
     }
 
-    if (g_list_length(fsa_message_queue) > 0 || fsa_actions != A_NOTHING || do_fsa_stall) {
-        crm_debug("Exiting the FSA: queue=%d, fsa_actions=0x%llx, stalled=%s",
-                  g_list_length(fsa_message_queue), fsa_actions, do_fsa_stall ? "true" : "false");
+    if (is_message() || fsa_actions != A_NOTHING || do_fsa_stall) {
+        crm_debug("Exiting the FSA: queue=%u, fsa_actions=0x%llx, stalled=%s",
+                  g_queue_get_length(&fsa_message_queue), fsa_actions,
+                  do_fsa_stall ? "true" : "false");
     } else {
         crm_trace("Exiting the FSA");
     }
@@ -491,6 +614,9 @@ do_state_transition(long long actions,
 
     do_dot_log(DOT_PREFIX "\t%s -> %s [ label=%s cause=%s origin=%s ]",
                state_from, state_to, input, fsa_cause2string(cause), msg_data->origin);
+    pcmk__metric_add(pcmk__metric(pcmk__metric_counter, "fsa_transitions",
+                                  "Controller state transitions, by new state",
+                                  "state", state_to), 1);
 
     if (cur_state == S_IDLE || next_state == S_IDLE) {
         level = LOG_NOTICE;
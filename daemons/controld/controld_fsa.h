@@ -481,6 +481,7 @@ struct fsa_data_s {
     const char *origin;
     void *data;
     enum fsa_data_type data_type;
+    gint64 queued;      // monotonic time (in microseconds) input was queued
 };
 
 /* Global FSA stuff */
@@ -496,7 +497,7 @@ extern char *fsa_our_uuid;
 extern char *fsa_pe_ref;        // Last invocation of the scheduler
 extern char *fsa_our_dc;
 extern char *fsa_our_dc_version;
-extern GListPtr fsa_message_queue;
+extern GQueue fsa_message_queue;
 
 extern char *fsa_cluster_name;
 
@@ -527,6 +528,8 @@ const char *fsa_cause2string(enum crmd_fsa_cause cause);
 const char *fsa_action2string(long long action);
 
 enum crmd_fsa_state s_crmd_fsa(enum crmd_fsa_cause cause);
+void fsa_stats_queued(unsigned int queue_len);
+void fsa_stats_add_xml(xmlNode *parent);
 
 #  define AM_I_DC is_set(fsa_input_register, R_THE_DC)
 #  define AM_I_OPERATIONAL (is_set(fsa_input_register, R_STARTING) == FALSE)
@@ -689,6 +692,7 @@ void do_update_node_status(long long action, enum crmd_fsa_cause cause,
 void do_lrm_invoke(long long action, enum crmd_fsa_cause cause,
                    enum crmd_fsa_state cur_state,
                    enum crmd_fsa_input cur_input, fsa_data_t *msg_data);
+void do_lrm_invoke_batch(fsa_data_t *msg_data);
 
 /* A_LRM_EVENT */
 void do_lrm_event(long long action, enum crmd_fsa_cause cause,
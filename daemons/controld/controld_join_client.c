@@ -179,6 +179,8 @@ join_query_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void *
 
         crm_xml_add(reply, F_CRM_JOIN_ID, join_id);
         crm_xml_add(reply, XML_ATTR_CRM_VERSION, CRM_FEATURE_SET);
+        crm_xml_add(reply, F_CRM_LRM_BATCH, XML_BOOLEAN_TRUE);
+        crm_xml_add(reply, F_CRM_JOIN_BATCH, XML_BOOLEAN_TRUE);
         send_cluster_message(crm_get_peer(0, fsa_our_dc), crm_msg_crmd, reply, TRUE);
         free_xml(reply);
     }
@@ -213,6 +215,105 @@ set_join_state(const char * start_state)
 
 /*	A_CL_JOIN_RESULT	*/
 /* aka. this is notification that we have (or have not) been accepted */
+/*!
+ * \internal
+ * \brief Find the part of a join acknowledgement that applies to the local node
+ *
+ * \param[in] msg  Join acknowledgement from DC
+ *
+ * \return \p msg if it was sent to us alone, our entry if it was broadcast and
+ *         lists us, otherwise NULL
+ */
+static xmlNode *
+join_ack_for_us(xmlNode *msg)
+{
+    xmlNode *acked = first_named_child(msg, F_CRM_JOIN_ACKED);
+
+    if (acked == NULL) {
+        return msg;
+    }
+    for (xmlNode *node = __xml_first_child(acked); node != NULL;
+         node = __xml_next(node)) {
+        if (safe_str_eq(crm_element_value(node, XML_ATTR_UNAME),
+                        fsa_our_uname)) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Leave only the resources whose history differs from the CIB's
+ *
+ * \param[in,out] node_state  Local executor state (from do_lrm_query())
+ * \param[in]     digests     History digests of the CIB copy, from the DC
+ *
+ * Resources whose history matches the CIB are dropped, and each resource that
+ * is in the CIB but no longer in the local history is listed with
+ * F_CRM_HISTORY_REMOVED, so the DC can update only what changed.
+ */
+static void
+trim_join_history(xmlNode *node_state, xmlNode *digests)
+{
+    GHashTable *cib_digests = g_hash_table_new(crm_str_hash, g_str_equal);
+    xmlNode *rsc_list = first_named_child(first_named_child(node_state,
+                                                            XML_CIB_TAG_LRM),
+                                          XML_LRM_TAG_RESOURCES);
+    xmlNode *next = NULL;
+    GHashTableIter iter;
+    const char *id = NULL;
+    int unchanged = 0;
+    int removed = 0;
+
+    CRM_CHECK(rsc_list != NULL, g_hash_table_destroy(cib_digests); return);
+
+    for (xmlNode *entry = __xml_first_child_element(digests); entry != NULL;
+         entry = __xml_next_element(entry)) {
+        if (ID(entry) != NULL) {
+            g_hash_table_insert(cib_digests, (gpointer) ID(entry),
+                                (gpointer) crm_element_value(entry,
+                                                             XML_ATTR_DIGEST));
+        }
+    }
+
+    for (xmlNode *xml_rsc = __xml_first_child_element(rsc_list);
+         xml_rsc != NULL; xml_rsc = next) {
+        const char *cib_digest = NULL;
+
+        next = __xml_next_element(xml_rsc);
+        if (!g_hash_table_lookup_extended(cib_digests, ID(xml_rsc), NULL,
+                                          (gpointer *) &cib_digest)) {
+            continue;
+        }
+        g_hash_table_remove(cib_digests, ID(xml_rsc));
+        if (cib_digest != NULL) {
+            char *digest = controld_history_digest(xml_rsc);
+
+            if (safe_str_eq(digest, cib_digest)) {
+                free_xml(xml_rsc);
+                unchanged++;
+            }
+            free(digest);
+        }
+    }
+
+    // Whatever is left is in the CIB but no longer in our history
+    g_hash_table_iter_init(&iter, cib_digests);
+    while (g_hash_table_iter_next(&iter, (gpointer *) &id, NULL)) {
+        xmlNode *entry = create_xml_node(rsc_list, XML_LRM_TAG_RESOURCE);
+
+        crm_xml_add(entry, XML_ATTR_ID, id);
+        crm_xml_add(entry, F_CRM_HISTORY_REMOVED, XML_BOOLEAN_TRUE);
+        removed++;
+    }
+    g_hash_table_destroy(cib_digests);
+
+    crm_debug("Omitting history of %d unchanged resource%s from join "
+              "confirmation (%d removed)",
+              unchanged, ((unchanged == 1)? "" : "s"), removed);
+}
+
 void
 do_cl_join_finalize_respond(long long action,
                             enum crmd_fsa_cause cause,
@@ -220,6 +321,8 @@ do_cl_join_finalize_respond(long long action,
                             enum crmd_fsa_input current_input, fsa_data_t * msg_data)
 {
     xmlNode *tmp1 = NULL;
+    xmlNode *our_ack = NULL;
+    xmlNode *digests = NULL;
     gboolean was_nack = TRUE;
     static gboolean first_join = TRUE;
     ha_msg_input_t *input = fsa_typed_data(fsa_dt_ha_msg);
@@ -242,6 +345,12 @@ do_cl_join_finalize_respond(long long action,
 
     crm_element_value_int(input->msg, F_CRM_JOIN_ID, &join_id);
 
+    our_ack = join_ack_for_us(input->msg);
+    if (!was_nack && (our_ack == NULL)) {
+        crm_trace("Ignoring join-%d acknowledgement for other nodes", join_id);
+        return;
+    }
+
     if (was_nack) {
         crm_err("Shutting down because cluster join with leader %s failed "
                 CRM_XS" join-%d NACK'd", welcome_from, join_id);
@@ -265,10 +374,20 @@ do_cl_join_finalize_respond(long long action,
     /* send our status section to the DC */
     tmp1 = do_lrm_query(TRUE, fsa_our_uname);
     if (tmp1 != NULL) {
-        xmlNode *reply = create_request(CRM_OP_JOIN_CONFIRM, tmp1, fsa_our_dc,
-                                        CRM_SYSTEM_DC, CRM_SYSTEM_CRMD, NULL);
+        xmlNode *reply = NULL;
+
+        digests = first_named_child(our_ack, F_CRM_HISTORY_DIGESTS);
+        if (digests != NULL) {
+            trim_join_history(tmp1, digests);
+        }
+
+        reply = create_request(CRM_OP_JOIN_CONFIRM, tmp1, fsa_our_dc,
+                               CRM_SYSTEM_DC, CRM_SYSTEM_CRMD, NULL);
 
         crm_xml_add_int(reply, F_CRM_JOIN_ID, join_id);
+        if (digests != NULL) {
+            crm_xml_add(reply, F_CRM_HISTORY_DELTA, XML_BOOLEAN_TRUE);
+        }
 
         crm_debug("Confirming join-%d: sending local operation history to %s",
                   join_id, fsa_our_dc);
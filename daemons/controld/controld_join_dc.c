@@ -22,13 +22,34 @@ char *max_generation_from = NULL;
 xmlNode *max_generation_xml = NULL;
 
 void initialize_join(gboolean before);
-void finalize_join_for(gpointer key, gpointer value, gpointer user_data);
+static void finalize_join(void);
 void finalize_sync_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void *user_data);
 gboolean check_join_state(enum crmd_fsa_state cur_state, const char *source);
 
 static int current_join_id = 0;
 unsigned long long saved_ccm_membership_id = 0;
 
+/* Peers whose controllers accept a broadcast join acknowledgement */
+static GHashTable *join_batch_peers = NULL;
+
+/* Executor history from join confirmations that has not yet been written to
+ * the CIB. It is written for all confirmed nodes at once, when no more
+ * confirmations are expected or JOIN_HISTORY_DELAY_MS after the first.
+ */
+#define JOIN_HISTORY_DELAY_MS 1000
+
+static xmlNode *join_history = NULL;        // status section fragment
+static guint join_history_count = 0;        // number of nodes in join_history
+static GList *join_history_nodes = NULL;    // names of nodes to replace fully
+static GString *join_history_erase = NULL;  // XPath of resources to replace
+static guint join_history_timer = 0;
+
+#define XPATH_JOIN_RESOURCE \
+    "//node_state[@uname='%s']/" XML_CIB_TAG_LRM "/" XML_LRM_TAG_RESOURCES \
+    "/" XML_LRM_TAG_RESOURCE "[@id='%s']"
+
+static void flush_join_history(void);
+
 void
 crm_update_peer_join(const char *source, crm_node_t * node, enum crm_join_phase phase)
 {
@@ -77,11 +98,18 @@ initialize_join(gboolean before)
     crm_debug("join-%d: Initializing join data (flag=%s)",
               current_join_id, before ? "true" : "false");
 
+    // Anything confirmed in the previous join still needs to be recorded
+    flush_join_history();
+
     g_hash_table_iter_init(&iter, crm_peer_cache);
     while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &peer)) {
         crm_update_peer_join(__FUNCTION__, peer, crm_join_none);
     }
 
+    if (join_batch_peers != NULL) {
+        g_hash_table_remove_all(join_batch_peers);
+    }
+
     if (before) {
         if (max_generation_from != NULL) {
             free(max_generation_from);
@@ -176,6 +204,45 @@ join_make_offer(gpointer key, gpointer value, gpointer user_data)
     /* crm_update_peer_expected(__FUNCTION__, member, CRMD_JOINSTATE_PENDING); */
 }
 
+static void
+set_join_batch_peer(const char *uname, gboolean accepts)
+{
+    if (join_batch_peers == NULL) {
+        join_batch_peers = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                 free, NULL);
+    }
+    if (accepts) {
+        g_hash_table_replace(join_batch_peers, strdup(uname),
+                             GINT_TO_POINTER(TRUE));
+    } else {
+        g_hash_table_remove(join_batch_peers, uname);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Check whether a broadcast join acknowledgement is understood by all
+ *
+ * \return TRUE if every active peer other than the local node has said in its
+ *         join request that it accepts a broadcast acknowledgement
+ */
+static gboolean
+all_peers_accept_join_batch(void)
+{
+    GHashTableIter iter;
+    crm_node_t *peer = NULL;
+
+    g_hash_table_iter_init(&iter, crm_peer_cache);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &peer)) {
+        if (crm_is_peer_active(peer) && safe_str_neq(peer->uname, fsa_our_uname)
+            && ((join_batch_peers == NULL) || (peer->uname == NULL)
+                || (g_hash_table_lookup(join_batch_peers, peer->uname) == NULL))) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
 /*	 A_DC_JOIN_OFFER_ALL	*/
 void
 do_dc_join_offer_all(long long action,
@@ -381,6 +448,12 @@ do_dc_join_filter_offer(long long action,
     } else {
         crm_debug("join-%d: Welcoming node %s (ref %s)", join_id, join_from, ref);
         crm_update_peer_join(__FUNCTION__, join_node, crm_join_integrated);
+        te_set_peer_lrm_batch(join_from,
+                              crm_is_true(crm_element_value(join_ack->msg,
+                                                            F_CRM_LRM_BATCH)));
+        set_join_batch_peer(join_from,
+                            crm_is_true(crm_element_value(join_ack->msg,
+                                                          F_CRM_JOIN_BATCH)));
     }
 
     crm_update_peer_expected(__FUNCTION__, join_node, ack_nack);
@@ -477,7 +550,7 @@ finalize_sync_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, voi
         if (check_join_state(fsa_state, __FUNCTION__) == FALSE) {
             crm_debug("Notifying %d clients of join-%d results",
                       crmd_join_phase_count(crm_join_integrated), current_join_id);
-            g_hash_table_foreach(crm_peer_cache, finalize_join_for, NULL);
+            finalize_join();
         }
 
     } else {
@@ -502,6 +575,150 @@ join_update_complete_callback(xmlNode * msg, int call_id, int rc, xmlNode * outp
     }
 }
 
+/*!
+ * \internal
+ * \brief Write all queued join history to the CIB
+ *
+ * Each node's executor history is replaced, by deleting the existing history
+ * of all queued nodes in one request and then adding the new history of all of
+ * them in another. For nodes that sent only the resources whose history
+ * differs from the CIB, only those resources are deleted and added.
+ */
+static void
+flush_join_history(void)
+{
+    int call_id = 0;
+
+    if (join_history_timer != 0) {
+        g_source_remove(join_history_timer);
+        join_history_timer = 0;
+    }
+    if (join_history == NULL) {
+        return;
+    }
+
+    erase_status_tags(join_history_nodes, XML_CIB_TAG_LRM, cib_scope_local);
+    if (join_history_erase != NULL) {
+        crm_debug("join-%d: Deleting changed resource history "
+                  CRM_XS " xpath=%s", current_join_id, join_history_erase->str);
+        controld_erase_status_xpath(g_string_free(join_history_erase, FALSE),
+                                    cib_scope_local);
+        join_history_erase = NULL;
+    }
+
+    fsa_cib_update(XML_CIB_TAG_STATUS, join_history,
+                   cib_scope_local | cib_quorum_override | cib_can_create,
+                   call_id, NULL);
+    fsa_register_cib_callback(call_id, FALSE, NULL, join_update_complete_callback);
+    crm_debug("join-%d: Registered callback for CIB status update %d "
+              "(%u node%s)", current_join_id, call_id, join_history_count,
+              ((join_history_count == 1)? "" : "s"));
+
+    free_xml(join_history);
+    join_history = NULL;
+    join_history_count = 0;
+    g_list_free_full(join_history_nodes, free);
+    join_history_nodes = NULL;
+}
+
+static gboolean
+join_history_timer_popped(gpointer data)
+{
+    join_history_timer = 0;
+    flush_join_history();
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Queue a node's executor history to be written to the CIB
+ *
+ * \param[in] uname  Node that history is for
+ * \param[in] state  Node state with the node's history
+ * \param[in] delta  Whether \p state has only resources that differ from the
+ *                   CIB (see F_CRM_HISTORY_DELTA)
+ */
+static void
+queue_join_history(const char *uname, xmlNode *state, bool delta)
+{
+    xmlNode *copy = NULL;
+    xmlNode *rsc_list = NULL;
+    xmlNode *next = NULL;
+
+    if (join_history == NULL) {
+        join_history = create_xml_node(NULL, XML_CIB_TAG_STATUS);
+    }
+    if (state != NULL) {
+        copy = add_node_copy(join_history, state);
+    }
+    join_history_count++;
+
+    if (!delta) {
+        join_history_nodes = g_list_prepend(join_history_nodes, strdup(uname));
+        return;
+    }
+
+    rsc_list = first_named_child(first_named_child(copy, XML_CIB_TAG_LRM),
+                                 XML_LRM_TAG_RESOURCES);
+    for (xmlNode *xml_rsc = __xml_first_child_element(rsc_list);
+         xml_rsc != NULL; xml_rsc = next) {
+
+        next = __xml_next_element(xml_rsc);
+        if (join_history_erase == NULL) {
+            join_history_erase = g_string_sized_new(1024);
+        } else {
+            g_string_append_c(join_history_erase, '|');
+        }
+        g_string_append_printf(join_history_erase, XPATH_JOIN_RESOURCE,
+                               uname, ID(xml_rsc));
+
+        if (crm_is_true(crm_element_value(xml_rsc, F_CRM_HISTORY_REMOVED))) {
+            free_xml(xml_rsc);
+        }
+    }
+}
+
+/*!
+ * \internal
+ * \brief Add the CIB's history digests for a node to a join acknowledgement
+ *
+ * \param[in,out] parent  Acknowledgement (or its entry for the node)
+ * \param[in]     status  CIB status section
+ * \param[in]     uname   Node being acknowledged
+ */
+static void
+add_history_digests(xmlNode *parent, xmlNode *status, const char *uname)
+{
+    xmlNode *digests = NULL;
+    xmlNode *rsc_list = NULL;
+
+    if (status == NULL) {
+        return;
+    }
+
+    for (xmlNode *node_state = first_named_child(status, XML_CIB_TAG_STATE);
+         node_state != NULL; node_state = crm_next_same_xml(node_state)) {
+        if (safe_str_eq(crm_element_value(node_state, XML_ATTR_UNAME),
+                        uname)) {
+            rsc_list = first_named_child(first_named_child(node_state,
+                                                           XML_CIB_TAG_LRM),
+                                         XML_LRM_TAG_RESOURCES);
+            break;
+        }
+    }
+
+    digests = create_xml_node(parent, F_CRM_HISTORY_DIGESTS);
+    for (xmlNode *xml_rsc = first_named_child(rsc_list, XML_LRM_TAG_RESOURCE);
+         xml_rsc != NULL; xml_rsc = crm_next_same_xml(xml_rsc)) {
+        xmlNode *entry = create_xml_node(digests, XML_LRM_TAG_RESOURCE);
+        char *digest = controld_history_digest(xml_rsc);
+
+        crm_xml_add(entry, XML_ATTR_ID, ID(xml_rsc));
+        crm_xml_add(entry, XML_ATTR_DIGEST, digest);
+        free(digest);
+    }
+}
+
 /*	A_DC_JOIN_PROCESS_ACK	*/
 void
 do_dc_join_ack(long long action,
@@ -510,12 +727,13 @@ do_dc_join_ack(long long action,
                enum crmd_fsa_input current_input, fsa_data_t * msg_data)
 {
     int join_id = -1;
-    int call_id = 0;
     ha_msg_input_t *join_ack = fsa_typed_data(fsa_dt_ha_msg);
 
     const char *op = crm_element_value(join_ack->msg, F_CRM_TASK);
     const char *join_from = crm_element_value(join_ack->msg, F_CRM_HOST_FROM);
     crm_node_t *peer = crm_get_peer(0, join_from);
+    bool delta = crm_is_true(crm_element_value(join_ack->msg,
+                                               F_CRM_HISTORY_DELTA));
 
     if (safe_str_neq(op, CRM_OP_JOIN_CONFIRM) || peer == NULL) {
         crm_debug("Ignoring op=%s message from %s", op, join_from);
@@ -545,84 +763,158 @@ do_dc_join_ack(long long action,
     /* update CIB with the current LRM status from the node
      * We don't need to notify the TE of these updates, a transition will
      *   be started in due time
+     *
+     * Our own history is queried again unless the acknowledgement has only
+     * what differs from the CIB, because a full query would undo that.
      */
-    erase_status_tag(join_from, XML_CIB_TAG_LRM, cib_scope_local);
-
-    if (safe_str_eq(join_from, fsa_our_uname)) {
+    if (safe_str_eq(join_from, fsa_our_uname) && !delta) {
         xmlNode *now_dc_lrmd_state = do_lrm_query(TRUE, fsa_our_uname);
 
         if (now_dc_lrmd_state != NULL) {
             crm_debug("Local executor state updated from query");
-            fsa_cib_update(XML_CIB_TAG_STATUS, now_dc_lrmd_state,
-                cib_scope_local | cib_quorum_override | cib_can_create, call_id, NULL);
+            queue_join_history(join_from, now_dc_lrmd_state, FALSE);
             free_xml(now_dc_lrmd_state);
         } else {
             crm_warn("Local executor state updated from join acknowledgement because query failed");
-            fsa_cib_update(XML_CIB_TAG_STATUS, join_ack->xml,
-                cib_scope_local | cib_quorum_override | cib_can_create, call_id, NULL);
+            queue_join_history(join_from, join_ack->xml, FALSE);
         }
     } else {
-        crm_debug("Executor state for %s updated from join acknowledgement",
-                  join_from);
-        fsa_cib_update(XML_CIB_TAG_STATUS, join_ack->xml,
-           cib_scope_local | cib_quorum_override | cib_can_create, call_id, NULL);
+        crm_debug("Executor state for %s updated from join acknowledgement%s",
+                  join_from, (delta? " (changes only)" : ""));
+        queue_join_history(join_from, join_ack->xml, delta);
     }
 
-    fsa_register_cib_callback(call_id, FALSE, NULL, join_update_complete_callback);
-    crm_debug("join-%d: Registered callback for CIB status update %d", join_id, call_id);
+    if (crmd_join_phase_count(crm_join_finalized) == 0) {
+        flush_join_history();
+
+    } else if (join_history_timer == 0) {
+        join_history_timer = g_timeout_add(JOIN_HISTORY_DELAY_MS,
+                                           join_history_timer_popped, NULL);
+    }
 }
 
-void
-finalize_join_for(gpointer key, gpointer value, gpointer user_data)
+/*!
+ * \internal
+ * \brief Acknowledge the join requests of all integrated nodes
+ *
+ * The node entries for all of them are created in one CIB update. If every
+ * peer understands it, the acknowledgement is broadcast once, listing the nodes
+ * it is for, rather than sent to each node separately.
+ */
+static void
+finalize_join(void)
 {
-    xmlNode *acknak = NULL;
-    xmlNode *tmp1 = NULL;
-    crm_node_t *join_node = value;
-    const char *join_to = join_node->uname;
+    GHashTableIter iter;
+    crm_node_t *join_node = NULL;
+    xmlNode *nodes = create_xml_node(NULL, XML_CIB_TAG_NODES);
+    xmlNode *broadcast = NULL;
+    xmlNode *acked = NULL;
+    xmlNode *status = NULL;
+    GList *ack_list = NULL;
+    int n_remote = 0;
 
-    if(join_node->join != crm_join_integrated) {
-        crm_trace("Skipping %s in state %d", join_to, join_node->join);
-        return;
-    }
+    g_hash_table_iter_init(&iter, crm_peer_cache);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &join_node)) {
+        xmlNode *tmp1 = NULL;
 
-    /* make sure a node entry exists for the new node */
-    crm_trace("Creating node entry for %s", join_to);
+        if (join_node->join != crm_join_integrated) {
+            crm_trace("Skipping %s in state %d",
+                      join_node->uname, join_node->join);
+            continue;
+        }
 
-    tmp1 = create_xml_node(NULL, XML_CIB_TAG_NODE);
-    set_uuid(tmp1, XML_ATTR_UUID, join_node);
-    crm_xml_add(tmp1, XML_ATTR_UNAME, join_to);
+        /* make sure a node entry exists for the new node */
+        crm_trace("Creating node entry for %s", join_node->uname);
+        tmp1 = create_xml_node(nodes, XML_CIB_TAG_NODE);
+        set_uuid(tmp1, XML_ATTR_UUID, join_node);
+        crm_xml_add(tmp1, XML_ATTR_UNAME, join_node->uname);
 
-    fsa_cib_anon_update(XML_CIB_TAG_NODES, tmp1,
-                        cib_scope_local | cib_quorum_override | cib_can_create);
-    free_xml(tmp1);
+        if (crm_is_peer_active(join_node) == FALSE) {
+            /*
+             * NACK'ing nodes that the membership layer doesn't know about yet
+             * simply creates more churn
+             *
+             * Better to leave them waiting and let the join restart when
+             * the new membership event comes in
+             *
+             * All other NACKs (due to versions etc) should still be processed
+             */
+            crm_update_peer_expected(__FUNCTION__, join_node, CRMD_JOINSTATE_PENDING);
+            continue;
+        }
 
-    join_node = crm_get_peer(0, join_to);
-    if (crm_is_peer_active(join_node) == FALSE) {
-        /*
-         * NACK'ing nodes that the membership layer doesn't know about yet
-         * simply creates more churn
-         *
-         * Better to leave them waiting and let the join restart when
-         * the new membership event comes in
-         *
-         * All other NACKs (due to versions etc) should still be processed
-         */
-        crm_update_peer_expected(__FUNCTION__, join_node, CRMD_JOINSTATE_PENDING);
-        return;
+        ack_list = g_list_prepend(ack_list, join_node);
+        if (safe_str_neq(join_node->uname, fsa_our_uname)) {
+            n_remote++;
+        }
+    }
+
+    if (nodes->children != NULL) {
+        fsa_cib_anon_update(XML_CIB_TAG_NODES, nodes,
+                            cib_scope_local | cib_quorum_override | cib_can_create);
+    }
+    free_xml(nodes);
+
+    /* Let each node send only the history that differs from the CIB (which
+     * has been synchronized from the node with the newest copy by now)
+     */
+    if ((ack_list != NULL) && (fsa_cib_conn != NULL)) {
+        int rc = fsa_cib_conn->cmds->query(fsa_cib_conn, XML_CIB_TAG_STATUS,
+                                           &status,
+                                           cib_scope_local|cib_sync_call);
+
+        if (rc != pcmk_ok) {
+            crm_info("join-%d: Asking for full history because the status "
+                     "section could not be queried: %s",
+                     current_join_id, pcmk_strerror(rc));
+            free_xml(status);
+            status = NULL;
+        }
+    }
+
+    if ((n_remote > 1) && all_peers_accept_join_batch()) {
+        broadcast = create_dc_message(CRM_OP_JOIN_ACKNAK, NULL);
+        crm_xml_add(broadcast, CRM_OP_JOIN_ACKNAK, XML_BOOLEAN_TRUE);
+        acked = create_xml_node(broadcast, F_CRM_JOIN_ACKED);
     }
 
-    /* send the ack/nack to the node */
-    acknak = create_dc_message(CRM_OP_JOIN_ACKNAK, join_to);
+    for (GList *iter = ack_list; iter != NULL; iter = iter->next) {
+        const char *join_to = NULL;
+
+        join_node = iter->data;
+        join_to = join_node->uname;
 
-    crm_debug("join-%d: ACK'ing join request from %s",
-              current_join_id, join_to);
-    crm_xml_add(acknak, CRM_OP_JOIN_ACKNAK, XML_BOOLEAN_TRUE);
-    crm_update_peer_join(__FUNCTION__, join_node, crm_join_finalized);
-    crm_update_peer_expected(__FUNCTION__, join_node, CRMD_JOINSTATE_MEMBER);
+        crm_debug("join-%d: ACK'ing join request from %s",
+                  current_join_id, join_to);
+        crm_update_peer_join(__FUNCTION__, join_node, crm_join_finalized);
+        crm_update_peer_expected(__FUNCTION__, join_node, CRMD_JOINSTATE_MEMBER);
 
-    send_cluster_message(crm_get_peer(0, join_to), crm_msg_crmd, acknak, TRUE);
-    free_xml(acknak);
-    return;
+        // Broadcasts are not delivered to their sender, so ACK ourselves alone
+        if ((broadcast != NULL) && safe_str_neq(join_to, fsa_our_uname)) {
+            xmlNode *entry = create_xml_node(acked, XML_CIB_TAG_NODE);
+
+            crm_xml_add(entry, XML_ATTR_UNAME, join_to);
+            add_history_digests(entry, status, join_to);
+
+        } else {
+            /* send the ack/nack to the node */
+            xmlNode *acknak = create_dc_message(CRM_OP_JOIN_ACKNAK, join_to);
+
+            crm_xml_add(acknak, CRM_OP_JOIN_ACKNAK, XML_BOOLEAN_TRUE);
+            add_history_digests(acknak, status, join_to);
+            send_cluster_message(join_node, crm_msg_crmd, acknak, TRUE);
+            free_xml(acknak);
+        }
+    }
+    g_list_free(ack_list);
+    free_xml(status);
+
+    if (broadcast != NULL) {
+        crm_debug("join-%d: Broadcasting ACK to %d nodes",
+                  current_join_id, n_remote);
+        send_cluster_message(NULL, crm_msg_crmd, broadcast, TRUE);
+        free_xml(broadcast);
+    }
 }
 
 gboolean
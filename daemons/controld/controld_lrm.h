@@ -22,6 +22,9 @@ typedef struct resource_history_s {
     lrmd_event_data_t *failed;
     GList *recurring_op_list;
 
+    // Keys of recurring ops dropped above, whose CIB entries should be removed
+    GList *stale_ops;
+
     /* Resources must be stopped using the same
      * parameters they were started with.  This hashtable
      * holds the parameters that should be used for the next stop
@@ -30,6 +33,7 @@ typedef struct resource_history_s {
 } rsc_history_t;
 
 void history_free(gpointer data);
+void history_stats_add_xml(xmlNode *parent);
 
 /* TODO - Replace this with lrmd_event_data_t */
 struct recurring_op_s {
@@ -55,6 +59,7 @@ typedef struct lrm_state_s {
     GHashTable *deletion_ops;
     GHashTable *rsc_info_cache;
     GHashTable *metadata_cache; // key = class[:provider]:agent, value = ra_metadata_s
+    GList *queued_execs;        // probes waiting to be sent in one batch
 
     int num_lrm_register_fails;
 } lrm_state_t;
@@ -134,6 +139,8 @@ int lrm_state_exec(lrm_state_t *lrm_state, const char *rsc_id,
                    int timeout, /* ms */
                    int start_delay,     /* ms */
                    lrmd_key_value_t * params);
+int lrm_state_exec_batch(lrm_state_t *lrm_state, lrmd_exec_op_t *ops,
+                         int n_ops);
 lrmd_rsc_info_t *lrm_state_get_rsc_info(lrm_state_t * lrm_state,
                                         const char *rsc_id, enum lrmd_call_options options);
 int lrm_state_register_rsc(lrm_state_t * lrm_state,
@@ -155,9 +162,23 @@ int remote_ra_exec(lrm_state_t *lrm_state, const char *rsc_id,
                    int start_delay,     /* ms */
                    lrmd_key_value_t * params);
 void remote_ra_cleanup(lrm_state_t * lrm_state);
+void remote_ra_count_traffic(lrm_state_t *lrm_state);
 void remote_ra_fail(const char *node_name);
 void remote_ra_process_pseudo(xmlNode *xml);
 gboolean remote_ra_is_in_maintenance(lrm_state_t * lrm_state);
 void remote_ra_process_maintenance_nodes(xmlNode *xml);
 
 gboolean process_lrm_event(lrm_state_t * lrm_state, lrmd_event_data_t * op, struct recurring_op_s *pending);
+
+/*!
+ * \brief Send any probes queued for a node's executor
+ *
+ * \note This must be done before any other request to the same executor, so
+ *       that requests are processed in the order they were made.
+ */
+void lrm_state_flush_execs(lrm_state_t *lrm_state);
+
+/*!
+ * \brief Drop any probes queued for a node's executor without sending them
+ */
+void lrm_state_discard_execs(lrm_state_t *lrm_state);
@@ -188,6 +188,93 @@ create_node_state_update(crm_node_t *node, int flags, xmlNode *parent,
     return node_state;
 }
 
+/*
+ * Batched node state updates
+ *
+ * A membership event calls the peer status callback for every node whose
+ * state changed, so a network blip that separates a rack can mean dozens of
+ * calls in one dispatch. Rather than a CIB update (and possibly a transition
+ * abort) for each, the DC queues the node state updates and sends them as one
+ * CIB update from a high-priority trigger that runs once the event has been
+ * handled, then aborts the transition once if any change called for it.
+ *
+ * Each queued update holds the node's state as of the change, so the batch is
+ * written before any other node state update that must be ordered after it
+ * (see populate_cib_nodes() and send_stonith_update()).
+ */
+
+static xmlNode *node_state_batch = NULL;        // <status>
+static int node_state_count = 0;
+static const char *node_state_abort = NULL;     // first abort reason queued
+static crm_trigger_t *node_state_trigger = NULL;
+
+static gboolean
+node_state_trigger_cb(gpointer user_data)
+{
+    controld_flush_node_states();
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Queue a node state update for the next batched CIB update
+ *
+ * \param[in,out] node          Node whose state will be used for update
+ * \param[in]     flags         Bitmask of node_update_flags
+ * \param[in]     abort_reason  If not NULL, abort the transition for this
+ *                              reason once the batch is written
+ * \param[in]     source        Who requested the update (for logging)
+ */
+void
+controld_queue_node_state(crm_node_t *node, int flags,
+                          const char *abort_reason, const char *source)
+{
+    if (node_state_batch == NULL) {
+        node_state_batch = create_xml_node(NULL, XML_CIB_TAG_STATUS);
+    }
+    if (create_node_state_update(node, flags, node_state_batch,
+                                 source) != NULL) {
+        node_state_count++;
+    }
+    if (node_state_abort == NULL) {
+        node_state_abort = abort_reason;
+    }
+
+    if (node_state_trigger == NULL) {
+        node_state_trigger = mainloop_add_trigger(G_PRIORITY_HIGH,
+                                                  node_state_trigger_cb, NULL);
+        pcmk__trigger_set_name(node_state_trigger, "node-state-batch");
+    }
+    mainloop_set_trigger(node_state_trigger);
+}
+
+/*!
+ * \internal
+ * \brief Write any queued node state updates, and abort if they called for it
+ */
+void
+controld_flush_node_states(void)
+{
+    const char *abort_reason = node_state_abort;
+
+    node_state_abort = NULL;
+    if (node_state_batch != NULL) {
+        if (node_state_count > 0) {
+            crm_debug("Sending %d batched node state update%s",
+                      node_state_count, ((node_state_count == 1)? "" : "s"));
+            fsa_cib_anon_update(XML_CIB_TAG_STATUS, node_state_batch,
+                                cib_scope_local | cib_quorum_override
+                                | cib_can_create);
+        }
+        free_xml(node_state_batch);
+        node_state_batch = NULL;
+        node_state_count = 0;
+    }
+    if (abort_reason != NULL) {
+        abort_transition(INFINITY, tg_restart, abort_reason, NULL);
+    }
+}
+
 static void
 remove_conflicting_node_callback(xmlNode * msg, int call_id, int rc,
                                  xmlNode * output, void *user_data)
@@ -306,6 +393,8 @@ populate_cib_nodes(enum node_update_flags flags, const char *source)
     int call_options = cib_scope_local | cib_quorum_override;
     xmlNode *node_list = create_xml_node(NULL, XML_CIB_TAG_NODES);
 
+    controld_flush_node_states();
+
 #if SUPPORT_COROSYNC
     if (is_not_set(flags, node_update_quick) && is_corosync_cluster()) {
         from_hashtable = corosync_initialize_nodelist(NULL, FALSE, node_list);
@@ -26,7 +26,7 @@
 #include <controld_transition.h>
 #include <controld_throttle.h>
 
-GListPtr fsa_message_queue = NULL;
+GQueue fsa_message_queue = G_QUEUE_INIT;
 extern void crm_shutdown(int nsig);
 
 extern crm_ipc_t *attrd_ipc;
@@ -64,12 +64,16 @@ register_fsa_input_adv(enum crmd_fsa_cause cause, enum crmd_fsa_input input,
                        void *data, long long with_actions,
                        gboolean prepend, const char *raised_from)
 {
-    unsigned old_len = g_list_length(fsa_message_queue);
+    unsigned old_len = g_queue_get_length(&fsa_message_queue);
     fsa_data_t *fsa_data = NULL;
 
     if (raised_from == NULL) {
         raised_from = "<unknown>";
     }
+    pcmk__trace_event(pcmk__trace_fsa_input, input, cause, raised_from);
+    pcmk__metric_add(pcmk__metric(pcmk__metric_counter, "fsa_inputs",
+                                  "Controller state machine inputs, by input",
+                                  "input", fsa_input2string(input)), 1);
 
     if (input == I_NULL && with_actions == A_NOTHING /* && data == NULL */ ) {
         /* no point doing anything */
@@ -111,6 +115,7 @@ register_fsa_input_adv(enum crmd_fsa_cause cause, enum crmd_fsa_input input,
     fsa_data->data = NULL;
     fsa_data->data_type = fsa_dt_none;
     fsa_data->actions = with_actions;
+    fsa_data->queued = g_get_monotonic_time();
 
     if (with_actions != A_NOTHING) {
         crm_trace("Adding actions %.16llx to input", with_actions);
@@ -152,19 +157,16 @@ register_fsa_input_adv(enum crmd_fsa_cause cause, enum crmd_fsa_input input,
     /* make sure to free it properly later */
     if (prepend) {
         crm_trace("Prepending input");
-        fsa_message_queue = g_list_prepend(fsa_message_queue, fsa_data);
+        g_queue_push_head(&fsa_message_queue, fsa_data);
     } else {
-        fsa_message_queue = g_list_append(fsa_message_queue, fsa_data);
+        g_queue_push_tail(&fsa_message_queue, fsa_data);
     }
 
-    crm_trace("Queue len: %d", g_list_length(fsa_message_queue));
+    crm_trace("Queue len: %u", g_queue_get_length(&fsa_message_queue));
+    fsa_stats_queued(old_len + 1);
 
     /* fsa_dump_queue(LOG_TRACE); */
 
-    if (old_len == g_list_length(fsa_message_queue)) {
-        crm_err("Couldn't add message to the queue");
-    }
-
     if (fsa_source && input != I_WAIT_FOR_EVENT) {
         crm_trace("Triggering FSA: %s", __FUNCTION__);
         mainloop_set_trigger(fsa_source);
@@ -178,7 +180,7 @@ fsa_dump_queue(int log_level)
     int offset = 0;
     GListPtr lpc = NULL;
 
-    for (lpc = fsa_message_queue; lpc != NULL; lpc = lpc->next) {
+    for (lpc = fsa_message_queue.head; lpc != NULL; lpc = lpc->next) {
         fsa_data_t *data = (fsa_data_t *) lpc->data;
 
         do_crm_log_unlikely(log_level,
@@ -254,9 +256,8 @@ delete_fsa_input(fsa_data_t * fsa_data)
 fsa_data_t *
 get_message(void)
 {
-    fsa_data_t *message = g_list_nth_data(fsa_message_queue, 0);
+    fsa_data_t *message = g_queue_pop_head(&fsa_message_queue);
 
-    fsa_message_queue = g_list_remove(fsa_message_queue, message);
     crm_trace("Processing input %d", message->id);
     return message;
 }
@@ -265,7 +266,7 @@ get_message(void)
 gboolean
 is_message(void)
 {
-    return (g_list_length(fsa_message_queue) > 0);
+    return !g_queue_is_empty(&fsa_message_queue);
 }
 
 void *
@@ -724,6 +725,62 @@ handle_ping(xmlNode *msg)
     return I_NULL;
 }
 
+/*!
+ * \brief Handle a CRM_OP_MAINLOOP_STATS request
+ *
+ * \param[in] msg  Message XML
+ *
+ * \return Next FSA input
+ */
+static enum crmd_fsa_input
+handle_mainloop_stats(xmlNode *msg)
+{
+    xmlNode *stats = pcmk__mainloop_stats_xml();
+    xmlNode *reply = NULL;
+
+    fsa_stats_add_xml(stats);
+    history_stats_add_xml(stats);
+
+    crm_xml_add(stats, XML_PING_ATTR_SYSFROM,
+                crm_element_value(msg, F_CRM_SYS_TO));
+
+    reply = create_reply(msg, stats);
+    free_xml(stats);
+    if (reply) {
+        (void) relay_message(reply, TRUE);
+        free_xml(reply);
+    }
+    return I_NULL;
+}
+
+/*!
+ * \brief Handle a CRM_OP_METRICS request
+ *
+ * \param[in] msg  Message XML
+ *
+ * \return Next FSA input
+ */
+static enum crmd_fsa_input
+handle_metrics(xmlNode *msg)
+{
+    xmlNode *metrics = create_xml_node(NULL, "metrics");
+    char *text = pcmk__metrics_text();
+    xmlNode *reply = NULL;
+
+    crm_xml_add(metrics, XML_PING_ATTR_SYSFROM,
+                crm_element_value(msg, F_CRM_SYS_TO));
+    crm_xml_add(metrics, "text", text);
+    free(text);
+
+    reply = create_reply(msg, metrics);
+    free_xml(metrics);
+    if (reply) {
+        (void) relay_message(reply, TRUE);
+        free_xml(reply);
+    }
+    return I_NULL;
+}
+
 /*!
  * \brief Handle a CRM_OP_NODE_INFO request
  *
@@ -920,6 +977,7 @@ handle_request(xmlNode * stored_msg, enum crmd_fsa_cause cause)
 
     } else if (strcmp(op, CRM_OP_LRM_DELETE) == 0
                || strcmp(op, CRM_OP_LRM_FAIL) == 0
+               || strcmp(op, CRM_OP_LRM_CLEANUP) == 0
                || strcmp(op, CRM_OP_LRM_REFRESH) == 0 || strcmp(op, CRM_OP_REPROBE) == 0) {
 
         crm_xml_add(stored_msg, F_CRM_SYS_TO, CRM_SYSTEM_LRMD);
@@ -937,6 +995,12 @@ handle_request(xmlNode * stored_msg, enum crmd_fsa_cause cause)
     } else if (strcmp(op, CRM_OP_PING) == 0) {
         return handle_ping(stored_msg);
 
+    } else if (strcmp(op, CRM_OP_MAINLOOP_STATS) == 0) {
+        return handle_mainloop_stats(stored_msg);
+
+    } else if (strcmp(op, CRM_OP_METRICS) == 0) {
+        return handle_metrics(stored_msg);
+
     } else if (strcmp(op, CRM_OP_NODE_INFO) == 0) {
         return handle_node_info_request(stored_msg);
 
@@ -972,6 +1036,9 @@ handle_request(xmlNode * stored_msg, enum crmd_fsa_cause cause)
         remote_ra_process_maintenance_nodes(xml);
 
         /*========== (NOT_DC)-Only Actions ==========*/
+    } else if (AM_I_DC == FALSE && strcmp(op, CRM_OP_PECALC) == 0) {
+        controld_run_offloaded_pe_calc(stored_msg);
+
     } else if (AM_I_DC == FALSE && strcmp(op, CRM_OP_SHUTDOWN) == 0) {
 
         const char *host_from = crm_element_value(stored_msg, F_CRM_HOST_FROM);
@@ -1016,11 +1083,12 @@ handle_response(xmlNode * stored_msg)
         } else if (safe_str_eq(msg_ref, fsa_pe_ref)) {
             ha_msg_input_t fsa_input;
 
+            controld_accept_pe_reply(stored_msg);
             fsa_input.msg = stored_msg;
             register_fsa_input_later(C_IPC_MESSAGE, I_PE_SUCCESS, &fsa_input);
             crm_trace("Completed: %s...", fsa_pe_ref);
 
-        } else {
+        } else if (controld_speculation_reply(stored_msg) == FALSE) {
             crm_info("%s calculation %s is obsolete", op, msg_ref);
         }
 
@@ -1105,7 +1173,13 @@ send_msg_via_ipc(xmlNode * msg, const char *sys)
 #ifdef FSA_TRACE
         crm_trace("Invoking action A_LRM_INVOKE (%.16llx)", A_LRM_INVOKE);
 #endif
-        do_lrm_invoke(A_LRM_INVOKE, C_IPC_MESSAGE, fsa_state, I_MESSAGE, &fsa_data);
+        if (safe_str_eq(crm_element_value(msg, F_CRM_TASK),
+                        CRM_OP_INVOKE_LRM_BATCH)) {
+            do_lrm_invoke_batch(&fsa_data);
+        } else {
+            do_lrm_invoke(A_LRM_INVOKE, C_IPC_MESSAGE, fsa_state, I_MESSAGE,
+                          &fsa_data);
+        }
 
     } else if (sys != NULL && crmd_is_proxy_session(sys)) {
         crmd_proxy_send(sys, msg);
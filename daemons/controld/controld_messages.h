@@ -14,6 +14,25 @@
 #  include <crm/cluster/internal.h>
 #  include <controld_fsa.h>
 
+/* Set in join requests by controllers that accept CRM_OP_INVOKE_LRM_BATCH */
+#  define F_CRM_LRM_BATCH "lrm_batch"
+
+/* Set in join requests by controllers that accept a broadcast join
+ * acknowledgement listing the nodes it is for (in F_CRM_JOIN_ACKED children)
+ */
+#  define F_CRM_JOIN_BATCH "join_batch"
+#  define F_CRM_JOIN_ACKED "join_acked"
+
+/* Join acknowledgements may carry a digest of each resource's history in the
+ * CIB (in an F_CRM_HISTORY_DIGESTS child, with one XML_LRM_TAG_RESOURCE per
+ * resource). A node that understands them sets F_CRM_HISTORY_DELTA in its
+ * join confirmation, whose history then has only the resources that differ,
+ * plus an entry with F_CRM_HISTORY_REMOVED for each resource to be erased.
+ */
+#  define F_CRM_HISTORY_DIGESTS "history_digests"
+#  define F_CRM_HISTORY_DELTA "history_delta"
+#  define F_CRM_HISTORY_REMOVED "history_removed"
+
 typedef struct ha_msg_input_s {
     xmlNode *msg;
     xmlNode *xml;
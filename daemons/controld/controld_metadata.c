@@ -13,8 +13,13 @@
 
 #include <crm/crm.h>
 #include <crm/lrmd.h>
+#include <crm/services.h>
+#include <crm/msg_xml.h>
+#include <crm/common/internal.h>
 
 #include "controld_lrm.h"
+#include "controld_fsa.h"
+#include "controld_utils.h"
 
 #if ENABLE_VERSIONED_ATTRS
 static regex_t *version_format_regex = NULL;
@@ -267,3 +272,148 @@ metadata_cache_get(GHashTable *mdc, lrmd_rsc_info_t *rsc)
     }
     return metadata;
 }
+
+/*
+ * Meta-data prefetch
+ *
+ * Once the controller has connected to the CIB, it gets the meta-data of every
+ * OCF agent in the configuration that is not already in the on-disk meta-data
+ * cache, a few agents at a time, so that the first operations on those
+ * resources after a start or upgrade do not have to wait for it.
+ */
+
+#define METADATA_PREFETCH_MAX 4
+
+static GQueue *prefetch_queue = NULL;  // svc_action_t *
+static int prefetch_active = 0;
+
+static void prefetch_next(void);
+
+static void
+prefetch_done(svc_action_t *action)
+{
+    prefetch_active--;
+    if ((action->rc == PCMK_OCF_OK) && (action->stdout_data != NULL)) {
+        pcmk__metadata_cache_put(action->standard, action->provider,
+                                 action->agent, action->stdout_data);
+    } else {
+        crm_debug("Could not prefetch meta-data for %s:%s:%s "
+                  CRM_XS " rc=%d", action->standard, action->provider,
+                  action->agent, action->rc);
+    }
+    prefetch_next();
+}
+
+static void
+prefetch_next(void)
+{
+    while ((prefetch_active < METADATA_PREFETCH_MAX)
+           && (prefetch_queue != NULL) && !g_queue_is_empty(prefetch_queue)) {
+        svc_action_t *action = g_queue_pop_head(prefetch_queue);
+
+        crm_trace("Prefetching meta-data for %s:%s:%s",
+                  action->standard, action->provider, action->agent);
+        if (services_action_async(action, prefetch_done)) {
+            prefetch_active++;
+        } else {
+            services_action_free(action);
+        }
+    }
+    if ((prefetch_queue != NULL) && g_queue_is_empty(prefetch_queue)
+        && (prefetch_active == 0)) {
+        g_queue_free(prefetch_queue);
+        prefetch_queue = NULL;
+    }
+}
+
+static void
+prefetch_query_callback(xmlNode *msg, int call_id, int rc, xmlNode *output,
+                        void *user_data)
+{
+    GHashTable *seen = NULL;
+    xmlXPathObjectPtr xpathObj = NULL;
+    int max = 0;
+
+    if ((rc != pcmk_ok) || (output == NULL)) {
+        return;
+    }
+
+    seen = crm_str_table_new();
+    xpathObj = xpath_search(output, "//" XML_CIB_TAG_RESOURCE "[@"
+                            XML_AGENT_ATTR_CLASS "='" PCMK_RESOURCE_CLASS_OCF
+                            "']");
+    max = numXpathResults(xpathObj);
+
+    for (int lpc = 0; lpc < max; lpc++) {
+        xmlNode *rsc = getXpathResult(xpathObj, lpc);
+        const char *provider = crm_element_value(rsc, XML_AGENT_ATTR_PROVIDER);
+        const char *type = crm_element_value(rsc, XML_ATTR_TYPE);
+        char *key = NULL;
+        char *cached = NULL;
+        svc_action_t *action = NULL;
+
+        if ((provider == NULL) || (type == NULL)) {
+            continue;
+        }
+        key = crm_strdup_printf("%s:%s", provider, type);
+        if (g_hash_table_lookup(seen, key) != NULL) {
+            free(key);
+            continue;
+        }
+        g_hash_table_insert(seen, key, strdup(key));
+
+        cached = pcmk__metadata_cache_get(PCMK_RESOURCE_CLASS_OCF, provider,
+                                          type);
+        if (cached != NULL) {
+            free(cached);
+            continue;
+        }
+
+        action = resources_action_create(type, PCMK_RESOURCE_CLASS_OCF,
+                                         provider, type, CRMD_ACTION_METADATA,
+                                         0, CRMD_METADATA_CALL_TIMEOUT, NULL,
+                                         0);
+        if (action != NULL) {
+            if (prefetch_queue == NULL) {
+                prefetch_queue = g_queue_new();
+            }
+            g_queue_push_tail(prefetch_queue, action);
+        }
+    }
+
+    freeXpathObject(xpathObj);
+    g_hash_table_destroy(seen);
+
+    if (prefetch_queue != NULL) {
+        crm_info("Prefetching meta-data for %d resource agent%s",
+                 g_queue_get_length(prefetch_queue),
+                 (g_queue_get_length(prefetch_queue) == 1)? "" : "s");
+        prefetch_next();
+    }
+}
+
+/*!
+ * \internal
+ * \brief Get missing meta-data for all OCF agents in the CIB in the background
+ *
+ * \note This does nothing if the on-disk meta-data cache is disabled, or if a
+ *       prefetch has already been started.
+ */
+void
+controld_prefetch_metadata(void)
+{
+    static bool started = FALSE;
+    const char *value = daemon_option("metadata_cache");
+    int call_id = 0;
+
+    if (started || (fsa_cib_conn == NULL)
+        || ((value != NULL) && !crm_is_true(value))) {
+        return;
+    }
+    started = TRUE;
+
+    call_id = fsa_cib_conn->cmds->query(fsa_cib_conn,
+                                        "//" XML_CIB_TAG_RESOURCES, NULL,
+                                        cib_xpath | cib_scope_local);
+    fsa_register_cib_callback(call_id, FALSE, NULL, prefetch_query_callback);
+}
@@ -33,6 +33,7 @@ GHashTable *metadata_cache_new(void);
 void metadata_cache_free(GHashTable *mdc);
 void metadata_cache_reset(GHashTable *mdc);
 void metadata_cache_fini(void);
+void controld_prefetch_metadata(void);
 
 struct ra_metadata_s *metadata_cache_update(GHashTable *mdc,
                                             lrmd_rsc_info_t *rsc,
@@ -22,6 +22,15 @@
 /* The max start timeout before cmd retry */
 #define MAX_START_TIMEOUT_MS 10000
 
+/* The default number of remote connections that can be coming up at once */
+#define REMOTE_CONNECT_LIMIT_DEFAULT "20"
+
+/* How often to measure a connection's traffic, and how many proxied messages
+ * per measurement add one to its reported load
+ */
+#define REMOTE_LOAD_INTERVAL_MS 60000
+#define REMOTE_LOAD_UNIT        60
+
 typedef struct remote_ra_cmd_s {
     /*! the local node the cmd is issued from */
     char *owner;
@@ -75,12 +84,119 @@ typedef struct remote_ra_data_s {
      * so we have it signalled back with the transition from the scheduler.
      */
     gboolean is_maintenance;
+
+    /* whether this connection holds one of the connection slots (while a start
+     * is connecting), or is waiting for one */
+    gboolean connecting;
+    gboolean waiting;
+
+    mainloop_timer_t *load_timer;   // running while the connection is active
+    unsigned int traffic;           // messages proxied since last measured
+    int reported_load;              // last value of CRM_ATTR_REMOTE_LOAD set
 } remote_ra_data_t;
 
 static int handle_remote_ra_start(lrm_state_t * lrm_state, remote_ra_cmd_t * cmd, int timeout_ms);
 static void handle_remote_ra_stop(lrm_state_t * lrm_state, remote_ra_cmd_t * cmd);
 static GList *fail_all_monitor_cmds(GList * list);
 
+/*
+ * Connection slots
+ *
+ * Connecting to a Pacemaker Remote node (TCP connect, TLS handshake, and
+ * signon) happens in the background, so after a DC election, the starts of
+ * all remote connections can be in progress at once. To bound the load that
+ * puts on the controller (and the network), at most PCMK_remote_connect_limit
+ * starts hold a connection slot at any time. Other starts wait at the head of
+ * their connection's command queue until a slot is released, in the order they
+ * asked for one.
+ */
+
+static int connect_limit = -1;
+static int connects_active = 0;
+static GQueue *connects_waiting = NULL;   // node names waiting for a slot
+
+static int
+remote_connect_limit(void)
+{
+    if (connect_limit < 0) {
+        const char *value = daemon_option("remote_connect_limit");
+
+        connect_limit = crm_parse_int(value, REMOTE_CONNECT_LIMIT_DEFAULT);
+        if (connect_limit < 0) {
+            connect_limit = 0;
+        }
+        crm_debug("Allowing %d remote connection%s to be established at once%s",
+                  connect_limit, ((connect_limit == 1)? "" : "s"),
+                  ((connect_limit == 0)? " (unlimited)" : ""));
+    }
+    return connect_limit;
+}
+
+/*!
+ * \internal
+ * \brief Get a connection slot for a start, or get in line for one
+ *
+ * \param[in] lrm_state  Executor state of connection being started
+ *
+ * \return TRUE if the connection holds a slot, FALSE if it has to wait (in
+ *         which case its work trigger will be set when a slot is released)
+ */
+static gboolean
+connect_slot_acquire(lrm_state_t *lrm_state)
+{
+    remote_ra_data_t *ra_data = lrm_state->remote_ra_data;
+
+    if (ra_data->connecting) {
+        return TRUE;
+    }
+    if ((remote_connect_limit() > 0) && (connects_active >= connect_limit)) {
+        if (!ra_data->waiting) {
+            if (connects_waiting == NULL) {
+                connects_waiting = g_queue_new();
+            }
+            g_queue_push_tail(connects_waiting, strdup(lrm_state->node_name));
+            ra_data->waiting = TRUE;
+            crm_debug("Delaying start of %s until one of the %d remote "
+                      "connections in progress completes",
+                      lrm_state->node_name, connects_active);
+        }
+        return FALSE;
+    }
+    ra_data->connecting = TRUE;
+    connects_active++;
+    return TRUE;
+}
+
+static void
+connect_slot_release(lrm_state_t *lrm_state)
+{
+    remote_ra_data_t *ra_data = lrm_state->remote_ra_data;
+    char *node_name = NULL;
+
+    if ((ra_data == NULL) || !ra_data->connecting) {
+        return;
+    }
+    ra_data->connecting = FALSE;
+    connects_active--;
+
+    // Wake the first waiting connection that still exists
+    while ((connects_waiting != NULL)
+           && ((node_name = g_queue_pop_head(connects_waiting)) != NULL)) {
+        lrm_state_t *waiting = lrm_state_find(node_name);
+
+        free(node_name);
+        if (waiting && waiting->remote_ra_data) {
+            remote_ra_data_t *waiting_data = waiting->remote_ra_data;
+
+            if (waiting_data->waiting) {
+                waiting_data->waiting = FALSE;
+                mainloop_set_trigger(waiting_data->work);
+                break;
+            }
+        }
+    }
+}
+
 static void
 free_cmd(gpointer user_data)
 {
@@ -423,6 +539,7 @@ retry_start_cmd_cb(gpointer data)
         }
         ra_data->cur_cmd = NULL;
         free_cmd(cmd);
+        connect_slot_release(lrm_state);
     } else {
         /* wait for connection event */
     }
@@ -610,11 +727,15 @@ remote_lrm_op_callback(lrmd_event_data_t * op)
             cmd->rc = PCMK_OCF_OK;
             cmd->op_status = PCMK_LRM_OP_DONE;
             ra_data->active = TRUE;
+            ra_data->traffic = 0;
+            ra_data->reported_load = 0;
+            mainloop_timer_start(ra_data->load_timer);
         }
 
         crm_debug("Remote connection event matched %s action", cmd->action);
         report_remote_ra_result(cmd);
         cmd_handled = TRUE;
+        connect_slot_release(lrm_state);
 
     } else if (op->type == lrmd_event_poke && safe_str_eq(cmd->action, "monitor")) {
 
@@ -689,6 +810,7 @@ handle_remote_ra_stop(lrm_state_t * lrm_state, remote_ra_cmd_t * cmd)
     }
 
     ra_data->active = FALSE;
+    mainloop_timer_stop(ra_data->load_timer);
     lrm_state_disconnect(lrm_state);
 
     if (ra_data->cmds) {
@@ -700,6 +822,7 @@ handle_remote_ra_stop(lrm_state_t * lrm_state, remote_ra_cmd_t * cmd)
     ra_data->cmds = NULL;
     ra_data->recurring_cmds = NULL;
     ra_data->cur_cmd = NULL;
+    connect_slot_release(lrm_state);
 
     if (cmd) {
         cmd->rc = PCMK_OCF_OK;
@@ -755,6 +878,11 @@ handle_remote_ra_exec(gpointer user_data)
         g_list_free_1(first);
 
         if (!strcmp(cmd->action, "start") || !strcmp(cmd->action, "migrate_from")) {
+            if (!connect_slot_acquire(lrm_state)) {
+                // Stay first in line; the trigger is set when a slot frees up
+                ra_data->cmds = g_list_prepend(ra_data->cmds, cmd);
+                return TRUE;
+            }
             ra_data->migrate_status = 0;
             rc = handle_remote_ra_start(lrm_state, cmd, cmd->timeout);
             if (rc == 0) {
@@ -764,6 +892,7 @@ handle_remote_ra_exec(gpointer user_data)
                 return TRUE;
             } else {
                 crm_debug("connect failed, not expecting to match any connection event later");
+                connect_slot_release(lrm_state);
                 cmd->rc = PCMK_OCF_UNKNOWN_ERROR;
                 cmd->op_status = PCMK_LRM_OP_ERROR;
             }
@@ -826,6 +955,60 @@ handle_remote_ra_exec(gpointer user_data)
     return TRUE;
 }
 
+/*
+ * Connection load
+ *
+ * Each cluster node proxies IPC for the Pacemaker Remote nodes whose
+ * connections it hosts, so a node hosting many busy connections can become a
+ * bottleneck. While a connection is active, the number of messages proxied
+ * for it is measured once per REMOTE_LOAD_INTERVAL_MS, and its load (1, plus 1
+ * for every REMOTE_LOAD_UNIT messages, rounded down to a power of two so that
+ * small variations do not cause CIB updates) is set as the remote node's
+ * CRM_ATTR_REMOTE_LOAD transient attribute. The scheduler uses it to balance
+ * connections across cluster nodes if balance-remote-connections is enabled.
+ */
+
+/*!
+ * \internal
+ * \brief Count a message proxied for a remote connection
+ *
+ * \param[in] lrm_state  Executor state of the remote connection
+ */
+void
+remote_ra_count_traffic(lrm_state_t *lrm_state)
+{
+    remote_ra_data_t *ra_data = lrm_state->remote_ra_data;
+
+    if (ra_data != NULL) {
+        ra_data->traffic++;
+    }
+}
+
+static gboolean
+remote_load_timer_cb(gpointer data)
+{
+    lrm_state_t *lrm_state = data;
+    remote_ra_data_t *ra_data = lrm_state->remote_ra_data;
+    unsigned int weight = 1 + ra_data->traffic / REMOTE_LOAD_UNIT;
+    int load = 1;
+
+    ra_data->traffic = 0;
+    while (load <= weight / 2) {
+        load *= 2;
+    }
+    if (ra_data->active && (load != ra_data->reported_load)) {
+        char *value = crm_itoa(load);
+
+        crm_debug("Load of remote connection to %s is now %d",
+                  lrm_state->node_name, load);
+        update_attrd(lrm_state->node_name, CRM_ATTR_REMOTE_LOAD, value, NULL,
+                     TRUE);
+        free(value);
+        ra_data->reported_load = load;
+    }
+    return TRUE;
+}
+
 static void
 remote_ra_data_init(lrm_state_t * lrm_state)
 {
@@ -837,6 +1020,9 @@ remote_ra_data_init(lrm_state_t * lrm_state)
 
     ra_data = calloc(1, sizeof(remote_ra_data_t));
     ra_data->work = mainloop_add_trigger(G_PRIORITY_HIGH, handle_remote_ra_exec, lrm_state);
+    ra_data->load_timer = mainloop_timer_add("remote-load",
+                                             REMOTE_LOAD_INTERVAL_MS, TRUE,
+                                             remote_load_timer_cb, lrm_state);
     lrm_state->remote_ra_data = ra_data;
 }
 
@@ -856,7 +1042,9 @@ remote_ra_cleanup(lrm_state_t * lrm_state)
     if (ra_data->recurring_cmds) {
         g_list_free_full(ra_data->recurring_cmds, free_cmd);
     }
+    connect_slot_release(lrm_state);
     mainloop_destroy_trigger(ra_data->work);
+    mainloop_timer_del(ra_data->load_timer);
     free(ra_data);
     lrm_state->remote_ra_data = NULL;
 }
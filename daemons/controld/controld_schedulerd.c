@@ -11,6 +11,7 @@
 
 #include <crm/cib.h>
 #include <crm/cluster.h>
+#include <crm/cluster/internal.h>
 #include <crm/common/xml.h>
 #include <crm/crm.h>
 #include <crm/msg_xml.h>
@@ -18,9 +19,13 @@
 #include <pacemaker-controld.h>
 #include <controld_fsa.h>
 #include <controld_messages.h>  /* register_fsa_error_adv */
+#include <controld_transition.h>  /* te_pending_spans */
+#include <controld_throttle.h>  /* throttle_least_loaded_peer */
 
 static mainloop_io_t *pe_subsystem = NULL;
 
+static void discard_dedup(void);
+
 /*!
  * \internal
  * \brief Close any scheduler connection and free associated memory
@@ -28,6 +33,9 @@ static mainloop_io_t *pe_subsystem = NULL;
 void
 pe_subsystem_free(void)
 {
+    controld_discard_speculation();
+    controld_discard_offload();
+    discard_dedup();
     if (pe_subsystem) {
         mainloop_del_ipc_client(pe_subsystem);
         pe_subsystem = NULL;
@@ -210,6 +218,128 @@ do_pe_control(long long action,
 int fsa_pe_query = 0;
 char *fsa_pe_ref = NULL;
 
+/*
+ * Input deduplication
+ *
+ * During churn, the scheduler is often asked to recalculate although nothing
+ * it uses has changed, for example after an update that changed only
+ * num_updates or the timing of an operation. The controller keeps a digest of
+ * each request's input that ignores such fields. If the next request's digest
+ * is the same, and the transition calculated last time had no actions and
+ * completed successfully, that result is used again instead of invoking the
+ * scheduler. Calculations run by the recheck timer always go to the scheduler,
+ * because time-based rules may give a different result for the same input.
+ */
+static struct dedup_s {
+    bool forced;            // Whether the next calculation must not be skipped
+    char *digest;           // Digest of input of last scheduler request
+    char *ref;              // Reference of last scheduler request
+    xmlNode *reply;         // Its reply, if it may be used again
+} dedup = { FALSE, NULL, NULL, NULL };
+
+// Attributes that do not affect the scheduler's result
+static const char *dedup_ignored[] = {
+    XML_ATTR_NUMUPDATES,
+    XML_CIB_ATTR_WRITTEN,
+    XML_ATTR_UPDATE_ORIG,
+    XML_ATTR_UPDATE_CLIENT,
+    XML_ATTR_UPDATE_USER,
+    XML_ATTR_ORIGIN,
+    XML_RSC_OP_LAST_CHANGE,
+    XML_RSC_OP_LAST_RUN,
+    XML_RSC_OP_T_EXEC,
+    XML_RSC_OP_T_QUEUE,
+};
+
+static void
+discard_dedup(void)
+{
+    free(dedup.digest);
+    dedup.digest = NULL;
+    free(dedup.ref);
+    dedup.ref = NULL;
+    free_xml(dedup.reply);
+    dedup.reply = NULL;
+}
+
+static void
+add_dedup_text(GString *text, xmlNode *xml)
+{
+    g_string_append_printf(text, "<%s", (const char *) xml->name);
+    for (xmlAttrPtr a = crm_first_attr(xml); a != NULL; a = a->next) {
+        const char *name = (const char *) a->name;
+        bool ignored = FALSE;
+
+        for (int lpc = 0; lpc < DIMOF(dedup_ignored); lpc++) {
+            if (!strcmp(name, dedup_ignored[lpc])) {
+                ignored = TRUE;
+                break;
+            }
+        }
+        if (!ignored) {
+            g_string_append_printf(text, " %s=\"%s\"", name, crm_attr_value(a));
+        }
+    }
+    g_string_append_c(text, '>');
+    for (xmlNode *child = __xml_first_child_element(xml); child != NULL;
+         child = __xml_next_element(child)) {
+        add_dedup_text(text, child);
+    }
+    g_string_append(text, "</>");
+}
+
+/*!
+ * \internal
+ * \brief Calculate a digest of the parts of a scheduler input that matter
+ *
+ * \param[in] input  Scheduler input (CIB with DC-specific additions)
+ *
+ * \return Newly allocated digest
+ */
+static char *
+dedup_digest(xmlNode *input)
+{
+    GString *text = g_string_sized_new(64 * 1024);
+    char *digest = NULL;
+
+    add_dedup_text(text, input);
+    digest = crm_md5sum(text->str);
+    g_string_free(text, TRUE);
+    return digest;
+}
+
+/*!
+ * \internal
+ * \brief Use the last scheduler result again if the input is effectively same
+ *
+ * \param[in] digest  Digest of the current input (see dedup_digest())
+ *
+ * \return TRUE if the last result was used, otherwise FALSE
+ */
+static bool
+use_dedup(const char *digest)
+{
+    ha_msg_input_t fsa_input;
+
+    if (dedup.forced || (dedup.reply == NULL) || (te_pending_spans != NULL)
+        || safe_str_neq(digest, dedup.digest)
+        || (transition_graph == NULL) || !transition_graph->complete
+        || (transition_graph->abort_priority != 0)
+        || (transition_graph->completion_action != tg_done)
+        || (transition_graph->num_synapses != 0)) {
+        return FALSE;
+    }
+
+    crm_info("Not invoking the scheduler: input unchanged since calculation %s",
+             dedup.ref);
+    controld_accept_pe_reply(dedup.reply);
+    free(fsa_pe_ref);
+    fsa_pe_ref = strdup(dedup.ref);
+    fsa_input.msg = dedup.reply;
+    register_fsa_input_later(C_IPC_MESSAGE, I_PE_SUCCESS, &fsa_input);
+    return TRUE;
+}
+
 /*	 A_PE_INVOKE	*/
 void
 do_pe_invoke(long long action,
@@ -241,6 +371,9 @@ do_pe_invoke(long long action,
                    fsa_state2string(cur_state));
         return;
     }
+    if (cause == C_TIMER_POPPED) {
+        dedup.forced = TRUE;
+    }
     if (is_set(fsa_input_register, R_HAVE_CIB) == FALSE) {
         crm_err("Attempted to invoke scheduler without consistent Cluster Information Base!");
 
@@ -315,11 +448,480 @@ force_local_option(xmlNode *xml, const char *attr_name, const char *attr_value)
     freeXpathObject(xpathObj);
 }
 
+/*!
+ * \internal
+ * \brief Create a scheduler calculation request for a CIB query result
+ *
+ * \param[in,out] output  CIB query result (will be modified)
+ *
+ * \return Newly created request (caller must free with free_xml())
+ */
+static xmlNode *
+create_pe_request(xmlNode *output)
+{
+    pid_t watchdog = pcmk_locate_sbd();
+    xmlNode *cmd = NULL;
+
+    // Refresh the remote node cache when the scheduler is invoked
+    crm_remote_peer_cache_refresh(output);
+
+    crm_xml_add(output, XML_ATTR_DC_UUID, fsa_our_uuid);
+    crm_xml_add_int(output, XML_ATTR_HAVE_QUORUM, fsa_has_quorum);
+
+    force_local_option(output, XML_ATTR_HAVE_WATCHDOG, watchdog?"true":"false");
+
+    if (ever_had_quorum && crm_have_quorum == FALSE) {
+        crm_xml_add_int(output, XML_ATTR_QUORUM_PANIC, 1);
+    }
+
+    cmd = create_request(CRM_OP_PECALC, output, NULL, CRM_SYSTEM_PENGINE,
+                         CRM_SYSTEM_DC, NULL);
+
+    // unpack_graph() expands shared parameter sets, so ask for them
+    crm_xml_add(cmd, PCMK__COMPACT_GRAPH_ATTR, XML_BOOLEAN_TRUE);
+    return cmd;
+}
+
+/*
+ * Speculative calculations
+ *
+ * When the active transition is aborted, the DC normally waits for its
+ * in-flight actions to complete before asking the scheduler for a new
+ * transition. If speculation is enabled, the scheduler is asked right away,
+ * using the CIB as of the abort. Once the graph drains, the CIB is queried as
+ * usual, and if its version is still the one the speculative result was
+ * calculated from, that result is used instead of invoking the scheduler
+ * again. Otherwise (typically because action results were recorded in the
+ * meantime) it is discarded.
+ */
+static struct speculation_s {
+    bool enabled;
+    int query;              // Call ID of CIB query for speculative request
+    char *ref;              // Reference of speculative scheduler request
+    char *cib_version;      // Version of CIB request was calculated from
+    xmlNode *reply;         // Scheduler reply, once received
+} speculation = { false, 0, NULL, NULL, NULL };
+
+static char *
+cib_version_string(xmlNode *cib)
+{
+    return crm_strdup_printf("%s.%s.%s",
+                             crm_str(crm_element_value(cib, XML_ATTR_GENERATION_ADMIN)),
+                             crm_str(crm_element_value(cib, XML_ATTR_GENERATION)),
+                             crm_str(crm_element_value(cib, XML_ATTR_NUMUPDATES)));
+}
+
+/*!
+ * \internal
+ * \brief Enable or disable speculative scheduler calculations
+ *
+ * \param[in] value  Value of transition-speculation cluster option
+ */
+void
+controld_set_speculation(const char *value)
+{
+    speculation.enabled = crm_is_true(value);
+    if (!speculation.enabled) {
+        controld_discard_speculation();
+    }
+}
+
+/*!
+ * \internal
+ * \brief Forget any outstanding or completed speculative calculation
+ */
+void
+controld_discard_speculation(void)
+{
+    speculation.query = 0;
+    free(speculation.ref);
+    speculation.ref = NULL;
+    free(speculation.cib_version);
+    speculation.cib_version = NULL;
+    free_xml(speculation.reply);
+    speculation.reply = NULL;
+}
+
+static void
+speculate_callback(xmlNode *msg, int call_id, int rc, xmlNode *output,
+                   void *user_data)
+{
+    xmlNode *cmd = NULL;
+
+    if ((rc != pcmk_ok) || (call_id != speculation.query)) {
+        crm_trace("Skipping speculative calculation for CIB query %d", call_id);
+        return;
+
+    } else if (!AM_I_DC || is_not_set(fsa_input_register, R_PE_CONNECTED)
+               || (fsa_state != S_TRANSITION_ENGINE)
+               || transition_graph->complete) {
+        // The graph drained first, so a regular calculation is under way
+        crm_trace("Speculative calculation no longer useful");
+        controld_discard_speculation();
+        return;
+
+    } else if (num_cib_op_callbacks() > 1) {
+        crm_trace("Skipping speculative calculation: CIB updates pending");
+        controld_discard_speculation();
+        return;
+    }
+
+    speculation.cib_version = cib_version_string(output);
+    cmd = create_pe_request(output);
+    speculation.ref = crm_element_value_copy(cmd, XML_ATTR_REFERENCE);
+
+    rc = pe_subsystem_send(cmd);
+    if (rc < 0) {
+        crm_info("Could not request speculative calculation: %s "
+                 CRM_XS " rc=%d", pcmk_strerror(rc), rc);
+        controld_discard_speculation();
+    } else {
+        crm_debug("Requested speculative calculation %s from CIB %s",
+                  speculation.ref, speculation.cib_version);
+    }
+    free_xml(cmd);
+}
+
+/*!
+ * \internal
+ * \brief Ask the scheduler for a transition before the active one drains
+ *
+ * \note This does nothing unless transition-speculation is enabled. Any
+ *       previous speculative calculation is discarded.
+ */
+void
+controld_speculate_pe_calc(void)
+{
+    if (!speculation.enabled || !AM_I_DC
+        || is_not_set(fsa_input_register, R_PE_CONNECTED)
+        || is_not_set(fsa_input_register, R_HAVE_CIB)) {
+        return;
+    }
+    controld_discard_speculation();
+    speculation.query = fsa_cib_conn->cmds->query(fsa_cib_conn, NULL, NULL,
+                                                  cib_scope_local);
+    fsa_register_cib_callback(speculation.query, FALSE, NULL,
+                              speculate_callback);
+}
+
+/*!
+ * \internal
+ * \brief Keep a scheduler reply if it answers a speculative calculation
+ *
+ * \param[in] msg  Scheduler reply
+ *
+ * \return TRUE if \p msg was the reply to a speculative request
+ */
+bool
+controld_speculation_reply(xmlNode *msg)
+{
+    const char *ref = crm_element_value(msg, XML_ATTR_REFERENCE);
+
+    if ((speculation.ref == NULL) || safe_str_neq(ref, speculation.ref)) {
+        return FALSE;
+    }
+    crm_debug("Speculative calculation %s completed", ref);
+    free_xml(speculation.reply);
+    speculation.reply = copy_xml(msg);
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Use a speculative result in place of a new calculation, if valid
+ *
+ * \param[in] output  Current CIB
+ *
+ * \return TRUE if a speculative result was used, otherwise FALSE
+ */
+static bool
+use_speculation(xmlNode *output)
+{
+    bool used = FALSE;
+
+    if (speculation.reply != NULL) {
+        char *version = cib_version_string(output);
+
+        if (safe_str_eq(version, speculation.cib_version)) {
+            ha_msg_input_t fsa_input;
+
+            crm_info("Using speculative calculation %s for CIB %s",
+                     speculation.ref, version);
+            free(fsa_pe_ref);
+            fsa_pe_ref = strdup(speculation.ref);
+            fsa_input.msg = speculation.reply;
+            register_fsa_input_later(C_IPC_MESSAGE, I_PE_SUCCESS, &fsa_input);
+            used = TRUE;
+
+        } else {
+            crm_debug("Discarding speculative calculation %s "
+                      "(CIB changed from %s to %s)",
+                      speculation.ref, speculation.cib_version, version);
+        }
+        free(version);
+    }
+    controld_discard_speculation();
+    return used;
+}
+
+/*
+ * Offloaded calculations
+ *
+ * On large clusters, the DC's CPU can become the bottleneck, because the DC
+ * runs the scheduler in addition to its controller and the CIB manager's
+ * writes. If the scheduler-offload cluster option names a node (or is "true",
+ * meaning the least loaded peer), the DC sends its scheduler requests to that
+ * node's controller, which passes them to its own scheduler and relays the
+ * reply back. If no reply arrives in time, the DC asks its own scheduler.
+ */
+
+#define OFFLOAD_TIMEOUT_MS 30000
+
+static struct offload_s {
+    char *target;           // NULL if disabled, "true" for least loaded peer
+    xmlNode *cmd;           // request sent to a peer (for local fallback)
+    mainloop_timer_t *timer;
+} offload = { NULL, NULL, NULL };
+
+// Connection to local scheduler for requests offloaded by the DC
+static mainloop_io_t *offload_subsystem = NULL;
+
+/*!
+ * \internal
+ * \brief Set which node scheduler calculations should be offloaded to
+ *
+ * \param[in] value  Value of scheduler-offload cluster option
+ */
+void
+controld_set_offload(const char *value)
+{
+    int enabled = 0;
+
+    free(offload.target);
+    offload.target = NULL;
+    if ((value == NULL)
+        || ((crm_str_to_boolean(value, &enabled) > 0) && !enabled)) {
+        return;
+    }
+    offload.target = strdup(crm_is_true(value)? XML_BOOLEAN_TRUE : value);
+}
+
+/*!
+ * \internal
+ * \brief Forget any outstanding offloaded calculation
+ */
+void
+controld_discard_offload(void)
+{
+    if (offload.timer != NULL) {
+        mainloop_timer_stop(offload.timer);
+    }
+    free_xml(offload.cmd);
+    offload.cmd = NULL;
+}
+
+static gboolean
+offload_timeout_cb(gpointer user_data)
+{
+    const char *ref = crm_element_value(offload.cmd, XML_ATTR_REFERENCE);
+    int rc = pcmk_ok;
+
+    if ((offload.cmd == NULL) || safe_str_neq(ref, fsa_pe_ref)
+        || (fsa_state != S_POLICY_ENGINE)) {
+        controld_discard_offload();
+        return FALSE;
+    }
+
+    crm_warn("Offloaded calculation %s timed out, using local scheduler", ref);
+
+    // Use a new reference, so a late reply from the peer is ignored
+    free(fsa_pe_ref);
+    fsa_pe_ref = crm_strdup_printf("%s-local", ref);
+    crm_xml_add(offload.cmd, XML_ATTR_REFERENCE, fsa_pe_ref);
+    rc = pe_subsystem_send(offload.cmd);
+    if (rc < 0) {
+        crm_err("Could not contact the scheduler: %s " CRM_XS " rc=%d",
+                pcmk_strerror(rc), rc);
+        register_fsa_error_adv(C_FSA_INTERNAL, I_ERROR, NULL, NULL,
+                               __FUNCTION__);
+    }
+    controld_discard_offload();
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Send a scheduler request to a peer, if configured to
+ *
+ * \param[in] cmd  Scheduler request
+ *
+ * \return TRUE if the request was sent to a peer, otherwise FALSE
+ */
+static bool
+offload_pe_request(xmlNode *cmd)
+{
+    const char *target = NULL;
+    crm_node_t *peer = NULL;
+    xmlNode *remote_cmd = NULL;
+    bool sent = FALSE;
+
+    controld_discard_offload();
+    if (offload.target == NULL) {
+        return FALSE;
+    }
+
+    if (safe_str_eq(offload.target, XML_BOOLEAN_TRUE)) {
+        target = throttle_least_loaded_peer();
+    } else if (safe_str_neq(offload.target, fsa_our_uname)) {
+        target = offload.target;
+    }
+    peer = target? crm_find_peer(0, target) : NULL;
+    if ((peer == NULL) || !crm_is_peer_active(peer)) {
+        crm_trace("No peer available to offload calculation to");
+        return FALSE;
+    }
+
+    // The peer's controller handles the request and relays it
+    remote_cmd = copy_xml(cmd);
+    crm_xml_add(remote_cmd, F_CRM_SYS_TO, CRM_SYSTEM_CRMD);
+    crm_xml_add(remote_cmd, F_CRM_HOST_TO, peer->uname);
+    sent = send_cluster_message(peer, crm_msg_crmd, remote_cmd, TRUE);
+    free_xml(remote_cmd);
+    if (!sent) {
+        crm_info("Could not offload calculation to %s", peer->uname);
+        return FALSE;
+    }
+
+    crm_info("Offloaded calculation %s to %s",
+             crm_element_value(cmd, XML_ATTR_REFERENCE), peer->uname);
+    offload.cmd = copy_xml(cmd);
+    if (offload.timer == NULL) {
+        offload.timer = mainloop_timer_add("scheduler-offload",
+                                           OFFLOAD_TIMEOUT_MS, FALSE,
+                                           offload_timeout_cb, NULL);
+    }
+    mainloop_timer_start(offload.timer);
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Prepare a scheduler reply to be used as the next transition
+ *
+ * \param[in,out] msg  Scheduler reply matching the current request
+ */
+void
+controld_accept_pe_reply(xmlNode *msg)
+{
+    xmlNode *graph = get_message_xml(msg, F_CRM_DATA);
+    int id = 0;
+
+    if (offload.cmd != NULL) {
+        crm_debug("Offloaded calculation %s completed",
+                  crm_element_value(msg, XML_ATTR_REFERENCE));
+        controld_discard_offload();
+    }
+
+    /* Graphs may come from different schedulers, whose transition numbers are
+     * independent. Never reuse the number of the graph being replaced, so that
+     * late results of its actions cannot be mistaken for the new one's.
+     */
+    if ((graph != NULL) && (transition_graph != NULL)
+        && (crm_element_value_int(graph, "transition_id", &id) == 0)
+        && (id == transition_graph->id)) {
+        crm_xml_add_int(graph, "transition_id", id + 1);
+    }
+
+    // A result without actions may be used again (see use_dedup())
+    if ((msg != dedup.reply) && (graph != NULL)
+        && safe_str_eq(crm_element_value(msg, XML_ATTR_REFERENCE), dedup.ref)
+        && (first_named_child(graph, "synapse") == NULL)) {
+        free_xml(dedup.reply);
+        dedup.reply = copy_xml(msg);
+    }
+}
+
+static int
+offload_ipc_dispatch(const char *buffer, ssize_t length, gpointer userdata)
+{
+    xmlNode *msg = string2xml(buffer);
+    const char *host_to = NULL;
+
+    if (msg == NULL) {
+        return 0;
+    }
+
+    // Relay the scheduler's reply to the DC that asked for it
+    host_to = crm_element_value(msg, F_CRM_HOST_TO);
+    if ((host_to == NULL)
+        || !send_cluster_message(crm_get_peer(0, host_to), crm_msg_crmd, msg,
+                                 TRUE)) {
+        crm_warn("Could not relay offloaded calculation %s to %s",
+                 crm_str(crm_element_value(msg, XML_ATTR_REFERENCE)),
+                 crm_str(host_to));
+    }
+    free_xml(msg);
+    return 0;
+}
+
+static void
+offload_ipc_destroy(gpointer user_data)
+{
+    crm_info("Connection to the scheduler for offloaded calculations closed");
+    offload_subsystem = NULL;
+}
+
+/*!
+ * \internal
+ * \brief Pass a scheduler request offloaded by the DC to the local scheduler
+ *
+ * \param[in,out] msg  Scheduler request from DC
+ */
+void
+controld_run_offloaded_pe_calc(xmlNode *msg)
+{
+    static struct ipc_client_callbacks offload_callbacks = {
+        .dispatch = offload_ipc_dispatch,
+        .destroy = offload_ipc_destroy
+    };
+    const char *from = crm_element_value(msg, F_CRM_HOST_FROM);
+    int rc = 0;
+
+    if (AM_I_DC || safe_str_neq(from, fsa_our_dc)) {
+        crm_warn("Ignoring scheduler request from %s: not the DC",
+                 crm_str(from));
+        return;
+    }
+
+    if (offload_subsystem == NULL) {
+        offload_subsystem = mainloop_add_ipc_client(CRM_SYSTEM_PENGINE,
+                                                    G_PRIORITY_DEFAULT,
+                                                    5 * 1024 * 1024 /* 5MB */,
+                                                    NULL, &offload_callbacks);
+        if (offload_subsystem == NULL) {
+            crm_warn("Could not connect to scheduler for offloaded calculation");
+            return;
+        }
+    }
+
+    crm_xml_add(msg, F_CRM_SYS_TO, CRM_SYSTEM_PENGINE);
+    rc = crm_ipc_send(mainloop_get_ipc_client(offload_subsystem), msg, 0, 0,
+                      NULL);
+    if (rc <= 0) {
+        crm_warn("Could not pass offloaded calculation %s to scheduler "
+                 CRM_XS " rc=%d",
+                 crm_str(crm_element_value(msg, XML_ATTR_REFERENCE)), rc);
+    } else {
+        crm_debug("Running calculation %s for %s",
+                  crm_element_value(msg, XML_ATTR_REFERENCE), from);
+    }
+}
+
 static void
 do_pe_invoke_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void *user_data)
 {
     xmlNode *cmd = NULL;
-    pid_t watchdog = pcmk_locate_sbd();
+    char *digest = NULL;
 
     if (rc != pcmk_ok) {
         crm_err("Could not retrieve the Cluster Information Base: %s "
@@ -355,23 +957,38 @@ do_pe_invoke_callback(xmlNode * msg, int call_id, int rc, xmlNode * output, void
 
     CRM_LOG_ASSERT(output != NULL);
 
-    // Refresh the remote node cache when the scheduler is invoked
-    crm_remote_peer_cache_refresh(output);
+    if (use_speculation(output)) {
+        discard_dedup();
+        return;
+    }
 
-    crm_xml_add(output, XML_ATTR_DC_UUID, fsa_our_uuid);
-    crm_xml_add_int(output, XML_ATTR_HAVE_QUORUM, fsa_has_quorum);
+    cmd = create_pe_request(output);
+    digest = dedup_digest(output);
+    if (use_dedup(digest)) {
+        free(digest);
+        free_xml(cmd);
+        return;
+    }
 
-    force_local_option(output, XML_ATTR_HAVE_WATCHDOG, watchdog?"true":"false");
+    discard_dedup();
+    dedup.forced = FALSE;
+    dedup.digest = digest;
+    dedup.ref = crm_element_value_copy(cmd, XML_ATTR_REFERENCE);
 
-    if (ever_had_quorum && crm_have_quorum == FALSE) {
-        crm_xml_add_int(output, XML_ATTR_QUORUM_PANIC, 1);
+    if (te_pending_spans != NULL) {
+        // Kept until a graph comes back with them, in case this is superseded
+        crm_xml_add(cmd, PCMK__TRACE_SPAN_ATTR, te_pending_spans);
+        pcmk__trace_hops(pcmk__hop_schedule_requested, 0, te_pending_spans);
     }
 
-    cmd = create_request(CRM_OP_PECALC, output, NULL, CRM_SYSTEM_PENGINE, CRM_SYSTEM_DC, NULL);
-
     free(fsa_pe_ref);
     fsa_pe_ref = crm_element_value_copy(cmd, XML_ATTR_REFERENCE);
 
+    if (offload_pe_request(cmd)) {
+        free_xml(cmd);
+        return;
+    }
+
     rc = pe_subsystem_send(cmd);
     if (rc < 0) {
         crm_err("Could not contact the scheduler: %s " CRM_XS " rc=%d",
@@ -32,10 +32,7 @@ te_start_action_timer(crm_graph_t * graph, crm_action_t * action)
     action->timer = calloc(1, sizeof(crm_action_timer_t));
     action->timer->timeout = action->timeout;
     action->timer->action = action;
-    action->timer->source_id = g_timeout_add(action->timer->timeout + graph->network_delay,
-                                             action_timer_callback, (void *)action->timer);
-
-    CRM_ASSERT(action->timer->source_id != 0);
+    start_te_timer(action->timer, action->timer->timeout + graph->network_delay);
 }
 
 static gboolean
@@ -114,6 +111,9 @@ send_stonith_update(crm_action_t * action, const char *target, const char *uuid)
 
     crmd_peer_down(peer, TRUE);
 
+    /* Apply any membership changes that preceded this first */
+    controld_flush_node_states();
+
     /* Generate a node state update for the CIB */
     node_state = create_node_state_update(peer, flags, NULL, __FUNCTION__);
 
@@ -378,6 +378,133 @@ controld_record_action_timeout(crm_action_t *action)
     action->sent_update = TRUE;
 }
 
+/*
+ * Executor requests for a peer that has said (in its join request) that it
+ * accepts CRM_OP_INVOKE_LRM_BATCH are not sent as soon as each action is
+ * initiated. Instead, all the requests for the same router node from one pass
+ * over the transition graph are sent together, in as few messages as possible,
+ * once the pass is over.
+ */
+#define TE_LRM_BATCH_MAX 100
+
+static GHashTable *lrm_batch_peers = NULL;  /* node names */
+static GHashTable *lrm_batches = NULL;      /* router node -> xmlNode* */
+
+/*!
+ * \internal
+ * \brief Record whether a peer accepts batched executor requests
+ *
+ * \param[in] node       Name of peer
+ * \param[in] supported  Whether peer accepts CRM_OP_INVOKE_LRM_BATCH
+ */
+void
+te_set_peer_lrm_batch(const char *node, gboolean supported)
+{
+    CRM_CHECK(node != NULL, return);
+
+    if (lrm_batch_peers == NULL) {
+        lrm_batch_peers = crm_str_table_new();
+    }
+    if (supported) {
+        g_hash_table_replace(lrm_batch_peers, strdup(node), strdup(node));
+    } else {
+        g_hash_table_remove(lrm_batch_peers, node);
+    }
+}
+
+static gboolean
+peer_accepts_lrm_batch(const char *node)
+{
+    return (lrm_batch_peers != NULL)
+           && (g_hash_table_lookup(lrm_batch_peers, node) != NULL);
+}
+
+static gboolean
+send_lrm_batch(const char *router_node, xmlNode *batch)
+{
+    int count = (int) xmlChildElementCount(batch);
+    xmlNode *cmd = create_request(CRM_OP_INVOKE_LRM_BATCH, batch, router_node,
+                                  CRM_SYSTEM_LRMD, CRM_SYSTEM_TENGINE, NULL);
+    gboolean rc = send_cluster_message(crm_get_peer(0, router_node),
+                                       crm_msg_lrmd, cmd, TRUE);
+
+    crm_debug("Sent %d executor request%s to %s in one message",
+              count, ((count == 1)? "" : "s"), router_node);
+    free_xml(cmd);
+    return rc;
+}
+
+static void
+queue_lrm_batch(const char *router_node, xmlNode *rsc_op)
+{
+    xmlNode *batch = NULL;
+
+    if (lrm_batches == NULL) {
+        lrm_batches = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                            (GDestroyNotify) free_xml);
+    }
+
+    batch = g_hash_table_lookup(lrm_batches, router_node);
+    if (batch == NULL) {
+        batch = create_xml_node(NULL, CRM_OP_INVOKE_LRM_BATCH);
+        g_hash_table_insert(lrm_batches, strdup(router_node), batch);
+    }
+    add_node_copy(batch, rsc_op);
+
+    if (xmlChildElementCount(batch) >= TE_LRM_BATCH_MAX) {
+        if (send_lrm_batch(router_node, batch) == FALSE) {
+            crm_err("Could not send executor requests to %s", router_node);
+            abort_transition(INFINITY, tg_restart, "Send failed", NULL);
+        }
+        g_hash_table_remove(lrm_batches, router_node);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Send any batched executor requests
+ *
+ * \note Requests that cannot be sent are left to time out, after the
+ *       transition is aborted.
+ */
+void
+te_flush_lrm_batches(void)
+{
+    GHashTableIter iter;
+    const char *router_node = NULL;
+    xmlNode *batch = NULL;
+
+    if (lrm_batches == NULL) {
+        return;
+    }
+
+    g_hash_table_iter_init(&iter, lrm_batches);
+    while (g_hash_table_iter_next(&iter, (gpointer *) &router_node,
+                                  (gpointer *) &batch)) {
+        xmlNode *rsc_op = __xml_first_child(batch);
+        gboolean rc = FALSE;
+
+        if (__xml_next(rsc_op) == NULL) {
+            // A lone request is sent the usual way
+            xmlNode *cmd = create_request(CRM_OP_INVOKE_LRM, rsc_op,
+                                          router_node, CRM_SYSTEM_LRMD,
+                                          CRM_SYSTEM_TENGINE, NULL);
+
+            rc = send_cluster_message(crm_get_peer(0, router_node),
+                                      crm_msg_lrmd, cmd, TRUE);
+            free_xml(cmd);
+        } else {
+            rc = send_lrm_batch(router_node, batch);
+        }
+
+        if (rc == FALSE) {
+            crm_err("Could not send executor requests to %s", router_node);
+            abort_transition(INFINITY, tg_restart, "Send failed", NULL);
+        }
+        g_hash_table_iter_remove(&iter);
+    }
+}
+
 static gboolean
 te_rsc_command(crm_graph_t * graph, crm_action_t * action)
 {
@@ -437,8 +564,10 @@ te_rsc_command(crm_graph_t * graph, crm_action_t * action)
                task, task_uuid, (is_local? " locally" : ""), on_node,
                (no_wait? " without waiting" : ""), action->id);
 
-    cmd = create_request(CRM_OP_INVOKE_LRM, rsc_op, router_node,
-                         CRM_SYSTEM_LRMD, CRM_SYSTEM_TENGINE, NULL);
+    if (is_local || !peer_accepts_lrm_batch(router_node)) {
+        cmd = create_request(CRM_OP_INVOKE_LRM, rsc_op, router_node,
+                             CRM_SYSTEM_LRMD, CRM_SYSTEM_TENGINE, NULL);
+    }
 
     if (is_local) {
         /* shortcut local resource commands */
@@ -459,6 +588,9 @@ te_rsc_command(crm_graph_t * graph, crm_action_t * action)
 
         do_lrm_invoke(A_LRM_INVOKE, C_FSA_INTERNAL, fsa_state, I_NULL, &msg);
 
+    } else if (cmd == NULL) {
+        queue_lrm_batch(router_node, rsc_op);
+
     } else {
         rc = send_cluster_message(crm_get_peer(0, router_node), crm_msg_lrmd, cmd, TRUE);
     }
@@ -710,12 +842,7 @@ notify_crmd(crm_graph_t * graph)
         case tg_restart:
             type = "restart";
             if (fsa_state == S_TRANSITION_ENGINE) {
-                if (transition_timer->period_ms > 0) {
-                    crm_timer_stop(transition_timer);
-                    crm_timer_start(transition_timer);
-                } else {
-                    event = I_PE_CALC;
-                }
+                controld_request_pe_calc(true);
 
             } else if (fsa_state == S_POLICY_ENGINE) {
                 register_fsa_action(A_PE_INVOKE);
@@ -63,7 +63,7 @@ te_update_diff_v1(const char *event, xmlNode *diff)
 
     xml_log_patchset(LOG_TRACE, __FUNCTION__, diff);
     if (cib_config_changed(NULL, NULL, &diff)) {
-        abort_transition(INFINITY, tg_restart, "Non-status change", diff);
+        abort_transition_delayable(INFINITY, tg_restart, "Non-status change", diff);
         goto bail;              /* configuration changed */
     }
 
@@ -74,7 +74,7 @@ te_update_diff_v1(const char *event, xmlNode *diff)
     if (numXpathResults(xpathObj) > 0) {
         xmlNode *aborted = getXpathResult(xpathObj, 0);
 
-        abort_transition(INFINITY, tg_restart, "Ticket attribute: update", aborted);
+        abort_transition_delayable(INFINITY, tg_restart, "Ticket attribute: update", aborted);
         goto bail;
 
     }
@@ -87,7 +87,7 @@ te_update_diff_v1(const char *event, xmlNode *diff)
     if (numXpathResults(xpathObj) > 0) {
         xmlNode *aborted = getXpathResult(xpathObj, 0);
 
-        abort_transition(INFINITY, tg_restart, "Ticket attribute: removal", aborted);
+        abort_transition_delayable(INFINITY, tg_restart, "Ticket attribute: removal", aborted);
         goto bail;
     }
     freeXpathObject(xpathObj);
@@ -109,7 +109,7 @@ te_update_diff_v1(const char *event, xmlNode *diff)
         }
 
         if (crm_is_true(value) == FALSE) {
-            abort_transition(INFINITY, tg_restart, "Transient attribute: update", attr);
+            abort_transition_delayable(INFINITY, tg_restart, "Transient attribute: update", attr);
             crm_log_xml_trace(attr, "Abort");
             goto bail;
         }
@@ -125,7 +125,7 @@ te_update_diff_v1(const char *event, xmlNode *diff)
     if (numXpathResults(xpathObj) > 0) {
         xmlNode *aborted = getXpathResult(xpathObj, 0);
 
-        abort_transition(INFINITY, tg_restart, "Transient attribute: removal", aborted);
+        abort_transition_delayable(INFINITY, tg_restart, "Transient attribute: removal", aborted);
         goto bail;
 
     }
@@ -274,102 +274,186 @@ process_resource_updates(const char *node, xmlNode *xml, xmlNode *change,
     }
 }
 
-#define NODE_PATT "/lrm[@id="
-static char *get_node_from_xpath(const char *xpath) 
-{
-    char *nodeid = NULL;
-    char *tmp = strstr(xpath, NODE_PATT);
+/*
+ * Patchset paths are routed with a single left-to-right scan, walking a small
+ * trie of the element names the controller cares about. Each entry is a child
+ * of the entry whose kind is its parent. Scanning stops at the first element
+ * not in the trie, so the deepest recognized element determines the handler.
+ */
+enum diff_path_kind {
+    diff_path_other = 0,
+    diff_path_cib,
+    diff_path_config,
+    diff_path_status,
+    diff_path_tickets,
+    diff_path_node_state,
+    diff_path_transient,
+    diff_path_lrm,
+    diff_path_lrm_resources,
+    diff_path_lrm_resource,
+    diff_path_rsc_op,
+};
+
+static const struct diff_path_trie_s {
+    const char *name;
+    enum diff_path_kind parent;
+    enum diff_path_kind kind;
+    bool subtree;   // Whether everything beneath is handled the same way
+} diff_path_trie[] = {
+    { XML_TAG_CIB, diff_path_other, diff_path_cib, false },
+    { XML_CIB_TAG_CONFIGURATION, diff_path_cib, diff_path_config, true },
+    { XML_CIB_TAG_STATUS, diff_path_cib, diff_path_status, false },
+    { XML_CIB_TAG_TICKETS, diff_path_status, diff_path_tickets, true },
+    { XML_CIB_TAG_STATE, diff_path_status, diff_path_node_state, false },
+    { XML_TAG_TRANSIENT_NODEATTRS, diff_path_node_state, diff_path_transient,
+      true },
+    { XML_CIB_TAG_LRM, diff_path_node_state, diff_path_lrm, false },
+    { XML_LRM_TAG_RESOURCES, diff_path_lrm, diff_path_lrm_resources, false },
+    { XML_LRM_TAG_RESOURCE, diff_path_lrm_resources, diff_path_lrm_resource,
+      false },
+    { XML_LRM_TAG_RSC_OP, diff_path_lrm_resource, diff_path_rsc_op, true },
+};
 
-    if(tmp) {
-        tmp += strlen(NODE_PATT);
-        tmp += 1;
+struct diff_path_s {
+    const char *xpath;
+    enum diff_path_kind kind;   // Deepest element recognized in xpath
+    const char *state_id;       // ID of node_state in xpath, if any
+    size_t state_id_len;
+    const char *lrm_id;         // ID of lrm in xpath, if any
+    size_t lrm_id_len;
+    const char *op_id;          // ID of lrm_rsc_op in xpath, if any
+    size_t op_id_len;
+};
 
-        nodeid = strdup(tmp);
-        tmp = strstr(nodeid, "\'");
-        CRM_ASSERT(tmp);
-        tmp[0] = 0;
-    }
-    return nodeid;
-}
+#define DIFF_PATH_ID "[@id='"
 
-static char *extract_node_uuid(const char *xpath) 
+/*!
+ * \internal
+ * \brief Classify a patchset change path
+ *
+ * \param[in]  xpath  Path of change (as generated by xml_get_path())
+ * \param[out] path   Where to store classification (pointing into \p xpath)
+ */
+static void
+parse_diff_path(const char *xpath, struct diff_path_s *path)
 {
-    char *mutable_path = strdup(xpath);
-    char *node_uuid = NULL;
-    char *search = NULL;
-    char *match = NULL;
+    const char *p = xpath;
+
+    memset(path, 0, sizeof(struct diff_path_s));
+    path->xpath = xpath;
+
+    while ((p != NULL) && (*p == '/')) {
+        const char *name = p + 1;
+        size_t name_len = strcspn(name, "/[");
+        const char *id = NULL;
+        size_t id_len = 0;
+        const struct diff_path_trie_s *entry = NULL;
+
+        p = name + name_len;
+        if (*p == '[') {
+            if (strncmp(p, DIFF_PATH_ID, strlen(DIFF_PATH_ID)) == 0) {
+                id = p + strlen(DIFF_PATH_ID);
+                id_len = strcspn(id, "'");
+                p = id + id_len;
+            }
+            p = strchr(p, ']');
+            if (p != NULL) {
+                ++p;
+            }
+        }
 
-    match = strstr(mutable_path, "node_state[@id=\'");
-    if (match == NULL) {
-        free(mutable_path);
-        return NULL;
-    }
-    match += strlen("node_state[@id=\'");
+        for (int lpc = 0; lpc < DIMOF(diff_path_trie); lpc++) {
+            if ((diff_path_trie[lpc].parent == path->kind)
+                && (strncmp(diff_path_trie[lpc].name, name, name_len) == 0)
+                && (diff_path_trie[lpc].name[name_len] == '\0')) {
+                entry = &(diff_path_trie[lpc]);
+                break;
+            }
+        }
+        if (entry == NULL) {
+            return;
+        }
 
-    search = strchr(match, '\'');
-    if (search == NULL) {
-        free(mutable_path);
-        return NULL;
+        path->kind = entry->kind;
+        switch (path->kind) {
+            case diff_path_node_state:
+                path->state_id = id;
+                path->state_id_len = id_len;
+                break;
+            case diff_path_lrm:
+                path->lrm_id = id;
+                path->lrm_id_len = id_len;
+                break;
+            case diff_path_rsc_op:
+                path->op_id = id;
+                path->op_id_len = id_len;
+                break;
+            default:
+                break;
+        }
+        if (entry->subtree) {
+            return;
+        }
     }
-    search[0] = 0;
+}
 
-    node_uuid = strdup(match);
-    free(mutable_path);
-    return node_uuid;
+/* The path scan only records where each ID is in the path, and the functions
+ * that use an ID need it as a string of its own, so this copies it. That is
+ * one small copy per ID actually used, rather than the copies and rescans of
+ * the whole path that extracting IDs used to need.
+ */
+static inline char *
+diff_path_id(const char *id, size_t id_len)
+{
+    return id? strndup(id, id_len) : NULL;
 }
 
 static void
-abort_unless_down(const char *xpath, const char *op, xmlNode *change,
-                  const char *reason)
+abort_unless_down(const struct diff_path_s *path, const char *op,
+                  xmlNode *change, const char *reason, bool delayable)
 {
     char *node_uuid = NULL;
     crm_action_t *down = NULL;
 
     if(safe_str_neq(op, "delete")) {
-        abort_transition(INFINITY, tg_restart, reason, change);
+        abort_transition_graph(INFINITY, tg_restart, reason, change,
+                               delayable, __FUNCTION__, __LINE__);
         return;
     }
 
-    node_uuid = extract_node_uuid(xpath);
+    node_uuid = diff_path_id(path->state_id, path->state_id_len);
     if(node_uuid == NULL) {
-        crm_err("Could not extract node ID from %s", xpath);
-        abort_transition(INFINITY, tg_restart, reason, change);
+        crm_err("Could not extract node ID from %s", path->xpath);
+        abort_transition_graph(INFINITY, tg_restart, reason, change,
+                               delayable, __FUNCTION__, __LINE__);
         return;
     }
 
     down = match_down_event(node_uuid);
     if (down == NULL) {
-        crm_trace("Not expecting %s to be down (%s)", node_uuid, xpath);
-        abort_transition(INFINITY, tg_restart, reason, change);
+        crm_trace("Not expecting %s to be down (%s)", node_uuid, path->xpath);
+        abort_transition_graph(INFINITY, tg_restart, reason, change,
+                               delayable, __FUNCTION__, __LINE__);
     } else {
-        crm_trace("Expecting changes to %s (%s)", node_uuid, xpath);
+        crm_trace("Expecting changes to %s (%s)", node_uuid, path->xpath);
     }
     free(node_uuid);
 }
 
 static void
-process_op_deletion(const char *xpath, xmlNode *change)
+process_op_deletion(const struct diff_path_s *path, xmlNode *change)
 {
-    char *mutable_key = strdup(xpath);
-    char *key;
-    char *node_uuid;
+    char *key = diff_path_id(path->op_id, path->op_id_len);
+    char *node_uuid = NULL;
     crm_action_t *cancel = NULL;
 
-    // Extract the part of xpath between last pair of single quotes
-    key = strrchr(mutable_key, '\'');
-    if (key != NULL) {
-        *key = '\0';
-        key = strrchr(mutable_key, '\'');
-    }
     if (key == NULL) {
         crm_warn("Ignoring malformed CIB update (resource deletion of %s)",
-                 xpath);
-        free(mutable_key);
+                 path->xpath);
         return;
     }
-    ++key;
 
-    node_uuid = extract_node_uuid(xpath);
+    node_uuid = diff_path_id(path->state_id, path->state_id_len);
     cancel = get_cancel_action(key, node_uuid);
     if (cancel) {
         crm_info("Cancellation of %s on %s confirmed (%d)",
@@ -382,24 +466,33 @@ process_op_deletion(const char *xpath, xmlNode *change)
         abort_transition(INFINITY, tg_restart, "Resource operation removal",
                          change);
     }
-    free(mutable_key);
+    free(key);
     free(node_uuid);
 }
 
 static void
-process_delete_diff(const char *xpath, const char *op, xmlNode *change)
+process_delete_diff(const struct diff_path_s *path, const char *op,
+                    xmlNode *change)
 {
-    if (strstr(xpath, "/" XML_LRM_TAG_RSC_OP "[")) {
-        process_op_deletion(xpath, change);
+    switch (path->kind) {
+        case diff_path_rsc_op:
+            process_op_deletion(path, change);
+            break;
 
-    } else if (strstr(xpath, "/" XML_CIB_TAG_LRM "[")) {
-        abort_unless_down(xpath, op, change, "Resource state removal");
+        case diff_path_lrm:
+        case diff_path_lrm_resources:
+        case diff_path_lrm_resource:
+            abort_unless_down(path, op, change, "Resource state removal",
+                              false);
+            break;
 
-    } else if (strstr(xpath, "/" XML_CIB_TAG_STATE "[")) {
-        abort_unless_down(xpath, op, change, "Node state removal");
+        case diff_path_node_state:
+            abort_unless_down(path, op, change, "Node state removal", false);
+            break;
 
-    } else {
-        crm_trace("Ignoring delete of %s", xpath);
+        default:
+            crm_trace("Ignoring delete of %s", path->xpath);
+            break;
     }
 }
 
@@ -433,8 +526,8 @@ process_cib_diff(xmlNode *cib, xmlNode *change, const char *op,
         process_status_diff(status, change, op, xpath);
     }
     if (config) {
-        abort_transition(INFINITY, tg_restart,
-                         "Non-status-only change", change);
+        abort_transition_delayable(INFINITY, tg_restart,
+                                   "Non-status-only change", change);
     }
 }
 
@@ -448,6 +541,7 @@ te_update_diff_v2(xmlNode *diff)
 
         xmlNode *match = NULL;
         const char *name = NULL;
+        struct diff_path_s path;
         const char *xpath = crm_element_value(change, XML_DIFF_PATH);
 
         // Possible ops: create, modify, delete, move
@@ -466,6 +560,12 @@ te_update_diff_v2(xmlNode *diff)
             continue;
         }
 
+        parse_diff_path(xpath, &path);
+        if (path.kind == diff_path_other) {
+            crm_trace("Ignoring %s change outside CIB at %s", op, xpath);
+            continue;
+        }
+
         // Find the result of create/modify ops
         if (strcmp(op, "create") == 0) {
             match = change->children;
@@ -494,23 +594,24 @@ te_update_diff_v2(xmlNode *diff)
                   op, (xpath? xpath : "CIB"),
                   (name? " matched by " : ""), (name? name : ""));
 
-        if (strstr(xpath, "/" XML_TAG_CIB "/" XML_CIB_TAG_CONFIGURATION)) {
-            abort_transition(INFINITY, tg_restart, "Configuration change",
-                             change);
+        if (path.kind == diff_path_config) {
+            abort_transition_delayable(INFINITY, tg_restart,
+                                       "Configuration change", change);
             break; // Won't be packaged with operation results we may be waiting for
 
-        } else if (strstr(xpath, "/" XML_CIB_TAG_TICKETS)
+        } else if ((path.kind == diff_path_tickets)
                    || safe_str_eq(name, XML_CIB_TAG_TICKETS)) {
-            abort_transition(INFINITY, tg_restart, "Ticket attribute change", change);
+            abort_transition_delayable(INFINITY, tg_restart, "Ticket attribute change", change);
             break; // Won't be packaged with operation results we may be waiting for
 
-        } else if (strstr(xpath, "/" XML_TAG_TRANSIENT_NODEATTRS "[")
+        } else if ((path.kind == diff_path_transient)
                    || safe_str_eq(name, XML_TAG_TRANSIENT_NODEATTRS)) {
-            abort_unless_down(xpath, op, change, "Transient attribute change");
+            abort_unless_down(&path, op, change, "Transient attribute change",
+                              true);
             break; // Won't be packaged with operation results we may be waiting for
 
         } else if (strcmp(op, "delete") == 0) {
-            process_delete_diff(xpath, op, change);
+            process_delete_diff(&path, op, change);
 
         } else if (name == NULL) {
             crm_warn("Ignoring malformed CIB update (%s at %s has no result)",
@@ -529,19 +630,22 @@ te_update_diff_v2(xmlNode *diff)
             process_resource_updates(ID(match), match, change, op, xpath);
 
         } else if (strcmp(name, XML_LRM_TAG_RESOURCES) == 0) {
-            char *local_node = get_node_from_xpath(xpath);
+            char *local_node = diff_path_id(path.lrm_id,
+                                             path.lrm_id_len);
 
             process_resource_updates(local_node, match, change, op, xpath);
             free(local_node);
 
         } else if (strcmp(name, XML_LRM_TAG_RESOURCE) == 0) {
-            char *local_node = get_node_from_xpath(xpath);
+            char *local_node = diff_path_id(path.lrm_id,
+                                             path.lrm_id_len);
 
             process_lrm_resource_diff(match, local_node);
             free(local_node);
 
         } else if (strcmp(name, XML_LRM_TAG_RSC_OP) == 0) {
-            char *local_node = get_node_from_xpath(xpath);
+            char *local_node = diff_path_id(path.lrm_id,
+                                             path.lrm_id_len);
 
             process_graph_event(match, local_node);
             free(local_node);
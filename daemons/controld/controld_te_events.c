@@ -18,6 +18,9 @@
 #include <controld_fsa.h>
 
 char *failed_stop_offset = NULL;
+gint64 transition_started = 0;
+char *te_pending_spans = NULL;
+char *transition_spans = NULL;
 char *failed_start_offset = NULL;
 
 gboolean
@@ -306,28 +309,13 @@ match_graph_event(crm_action_t *action, xmlNode *event, int op_status,
 crm_action_t *
 get_action(int id, gboolean confirmed)
 {
-    GListPtr gIter = NULL;
-    GListPtr gIter2 = NULL;
-
-    gIter = transition_graph->synapses;
-    for (; gIter != NULL; gIter = gIter->next) {
-        synapse_t *synapse = (synapse_t *) gIter->data;
+    crm_action_t *action = find_graph_action(transition_graph, id);
 
-        gIter2 = synapse->actions;
-        for (; gIter2 != NULL; gIter2 = gIter2->next) {
-            crm_action_t *action = (crm_action_t *) gIter2->data;
-
-            if (action->id == id) {
-                if (confirmed) {
-                    stop_te_timer(action->timer);
-                    te_action_confirmed(action);
-                }
-                return action;
-            }
-        }
+    if ((action != NULL) && confirmed) {
+        stop_te_timer(action->timer);
+        te_action_confirmed(action);
     }
-
-    return NULL;
+    return action;
 }
 
 crm_action_t *
@@ -424,6 +412,33 @@ match_down_event(const char *target)
     return match;
 }
 
+// Record the trace span of a failed operation, for the next transition
+static void
+note_failure_span(const char *op_key, int call_id)
+{
+    char span[PCMK__TRACE_TAG_LEN];
+    char *rsc_id = NULL;
+    char *task = NULL;
+    guint interval_ms = 0;
+    char *old = te_pending_spans;
+
+    if (!parse_op_key(op_key, &rsc_id, &task, &interval_ms)) {
+        return;
+    }
+    pcmk__trace_span_id(span, rsc_id, call_id);
+    pcmk__trace_event(pcmk__trace_recovery_hop, pcmk__hop_failure_seen,
+                      transition_graph->id, span);
+
+    // Don't let a long series of failures grow the scheduler request much
+    if ((old == NULL) || (strlen(old) < 1024)) {
+        te_pending_spans = old? crm_strdup_printf("%s,%s", old, span)
+                              : strdup(span);
+        free(old);
+    }
+    free(rsc_id);
+    free(task);
+}
+
 void
 process_graph_event(xmlNode *event, const char *event_node)
 {
@@ -504,6 +519,9 @@ process_graph_event(xmlNode *event, const char *event_node)
     if (action && (rc == target_rc)) {
         crm_trace("Processed update to %s: %s", id, magic);
     } else {
+        if (pcmk__trace_active) {
+            note_failure_span(id, callid);
+        }
         if (update_failcount(event, event_node, rc, target_rc,
                              (transition_num == -1), ignore_failures)) {
             desc = "failed";
@@ -380,6 +380,167 @@ te_connect_stonith(gpointer user_data)
     return TRUE;
 }
 
+/*
+ * Action timers
+ *
+ * Rather than a mainloop source per in-flight action, active action timers are
+ * kept in a binary min-heap ordered by deadline, with a single mainloop timeout
+ * armed for the earliest one. Starting or stopping a timer is O(log n), and the
+ * mainloop source is only replaced when the earliest deadline changes.
+ */
+
+static GPtrArray *timer_queue = NULL;   // crm_action_timer_t*, heap-ordered
+static guint timer_queue_source = 0;    // mainloop timeout for earliest timer
+static gint64 timer_queue_armed = 0;    // deadline that source is armed for
+static int last_timer_id = 0;
+
+#define queued_timer(i) \
+    ((crm_action_timer_t *) g_ptr_array_index(timer_queue, (i)))
+
+static void
+set_queued_timer(guint i, crm_action_timer_t *timer)
+{
+    timer_queue->pdata[i] = timer;
+    timer->queue_index = i;
+}
+
+static void
+timer_queue_sift_up(guint i)
+{
+    crm_action_timer_t *timer = queued_timer(i);
+
+    while (i > 0) {
+        guint parent = (i - 1) / 2;
+
+        if (queued_timer(parent)->deadline <= timer->deadline) {
+            break;
+        }
+        set_queued_timer(i, queued_timer(parent));
+        i = parent;
+    }
+    set_queued_timer(i, timer);
+}
+
+static void
+timer_queue_sift_down(guint i)
+{
+    crm_action_timer_t *timer = queued_timer(i);
+
+    for (guint child = 2 * i + 1; child < timer_queue->len;
+         child = 2 * i + 1) {
+
+        if ((child + 1 < timer_queue->len)
+            && (queued_timer(child + 1)->deadline
+                < queued_timer(child)->deadline)) {
+            child++;
+        }
+        if (timer->deadline <= queued_timer(child)->deadline) {
+            break;
+        }
+        set_queued_timer(i, queued_timer(child));
+        i = child;
+    }
+    set_queued_timer(i, timer);
+}
+
+static void
+timer_queue_remove(crm_action_timer_t *timer)
+{
+    guint i = timer->queue_index;
+
+    // This moves the last entry into the vacated position
+    g_ptr_array_remove_index_fast(timer_queue, i);
+    if (i < timer_queue->len) {
+        if ((i > 0)
+            && (queued_timer((i - 1) / 2)->deadline
+                > queued_timer(i)->deadline)) {
+            timer_queue_sift_up(i);
+        } else {
+            timer_queue_sift_down(i);
+        }
+    }
+}
+
+static gboolean timer_queue_popped(gpointer data);
+
+// Ensure the mainloop timeout matches the earliest queued deadline
+static void
+arm_timer_queue(void)
+{
+    gint64 deadline = 0;
+    gint64 now = 0;
+
+    if ((timer_queue == NULL) || (timer_queue->len == 0)) {
+        if (timer_queue_source != 0) {
+            g_source_remove(timer_queue_source);
+            timer_queue_source = 0;
+        }
+        return;
+    }
+
+    deadline = queued_timer(0)->deadline;
+    if ((timer_queue_source != 0) && (deadline == timer_queue_armed)) {
+        return;
+    }
+    if (timer_queue_source != 0) {
+        g_source_remove(timer_queue_source);
+    }
+
+    // Round up, so the timeout never pops before the deadline
+    now = g_get_monotonic_time();
+    timer_queue_armed = deadline;
+    timer_queue_source = g_timeout_add((deadline > now)?
+                                       (guint) ((deadline - now + 999) / 1000)
+                                       : 0,
+                                       timer_queue_popped, NULL);
+}
+
+static gboolean
+timer_queue_popped(gpointer data)
+{
+    gint64 now = g_get_monotonic_time();
+
+    timer_queue_source = 0;
+    while ((timer_queue->len > 0) && (queued_timer(0)->deadline <= now)) {
+        crm_action_timer_t *timer = queued_timer(0);
+
+        timer_queue_remove(timer);
+        timer->source_id = 0;
+        action_timer_callback(timer);
+    }
+    arm_timer_queue();
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Start (or restart) an action timer
+ *
+ * \param[in] timer       Action timer to start
+ * \param[in] timeout_ms  Milliseconds until action_timer_callback() is called
+ */
+void
+start_te_timer(crm_action_timer_t *timer, guint timeout_ms)
+{
+    CRM_CHECK(timer != NULL, return);
+
+    if (timer->source_id != 0) {
+        timer_queue_remove(timer);
+    } else if (timer_queue == NULL) {
+        timer_queue = g_ptr_array_new();
+    }
+
+    if (++last_timer_id <= 0) {
+        last_timer_id = 1;
+    }
+    timer->source_id = last_timer_id;
+    timer->deadline = g_get_monotonic_time() + (gint64) timeout_ms * 1000;
+
+    g_ptr_array_add(timer_queue, timer);
+    timer_queue_sift_up(timer_queue->len - 1);
+    arm_timer_queue();
+}
+
 gboolean
 stop_te_timer(crm_action_timer_t * timer)
 {
@@ -388,8 +549,9 @@ stop_te_timer(crm_action_timer_t * timer)
     }
     if (timer->source_id != 0) {
         crm_trace("Stopping action timer");
-        g_source_remove(timer->source_id);
+        timer_queue_remove(timer);
         timer->source_id = 0;
+        arm_timer_queue();
     } else {
         crm_trace("Action timer was already stopped");
         return FALSE;
@@ -397,9 +559,53 @@ stop_te_timer(crm_action_timer_t * timer)
     return TRUE;
 }
 
+/*!
+ * \internal
+ * \brief Stop all active action timers of a transition graph
+ *
+ * \param[in] graph  Graph whose action timers should be stopped
+ *
+ * \return Number of timers stopped
+ * \note This must be called before the graph is destroyed.
+ */
+int
+te_cancel_graph_timers(crm_graph_t *graph)
+{
+    guint kept = 0;
+    int cancelled = 0;
+
+    if ((graph == NULL) || (timer_queue == NULL)) {
+        return 0;
+    }
+
+    for (guint i = 0; i < timer_queue->len; i++) {
+        crm_action_timer_t *timer = queued_timer(i);
+
+        if ((timer->action != NULL)
+            && (find_graph_action(graph, timer->action->id) == timer->action)) {
+            timer->source_id = 0;
+            cancelled++;
+        } else {
+            set_queued_timer(kept++, timer);
+        }
+    }
+
+    if (cancelled > 0) {
+        g_ptr_array_set_size(timer_queue, kept);
+        for (guint i = kept / 2; i-- > 0; ) {
+            timer_queue_sift_down(i);
+        }
+        arm_timer_queue();
+        crm_debug("Stopped %d action timer%s of transition %d",
+                  cancelled, ((cancelled == 1)? "" : "s"), graph->id);
+    }
+    return cancelled;
+}
+
 gboolean
 te_graph_trigger(gpointer user_data)
 {
+    static int spans_dispatched_id = -1;
     enum transition_status graph_rc = -1;
 
     if (transition_graph == NULL) {
@@ -429,12 +635,20 @@ te_graph_trigger(gpointer user_data)
         transition_graph->batch_limit = throttle_get_total_job_limit(limit);
         graph_rc = run_graph(transition_graph);
         transition_graph->batch_limit = limit; /* Restore the configured value */
+        te_flush_lrm_batches();
 
         /* significant overhead... */
         /* print_graph(LOG_TRACE, transition_graph); */
 
         if (graph_rc == transition_active) {
             crm_trace("Transition not yet complete");
+            if ((transition_spans != NULL)
+                && (spans_dispatched_id != transition_graph->id)) {
+                // Record only the first dispatch of actions in the transition
+                pcmk__trace_hops(pcmk__hop_actions_dispatched,
+                                 transition_graph->id, transition_spans);
+                spans_dispatched_id = transition_graph->id;
+            }
             return TRUE;
 
         } else if (graph_rc == transition_pending) {
@@ -450,6 +664,20 @@ te_graph_trigger(gpointer user_data)
 
     crm_debug("Transition %d is now complete", transition_graph->id);
     transition_graph->complete = TRUE;
+    if (transition_started > 0) {
+        pcmk__metric_observe_us(pcmk__metric(pcmk__metric_histogram,
+                                             "transition_seconds",
+                                             "Time taken to execute "
+                                             "transitions, by result",
+                                             "result",
+                                             transition_status(graph_rc)),
+                                g_get_monotonic_time() - transition_started);
+        transition_started = 0;
+    }
+    pcmk__trace_hops(pcmk__hop_transition_complete, transition_graph->id,
+                     transition_spans);
+    free(transition_spans);
+    transition_spans = NULL;
     notify_crmd(transition_graph);
 
     return TRUE;
@@ -502,9 +730,91 @@ abort_after_delay(int abort_priority, enum transition_action abort_action,
     abort_timer.id = g_timeout_add(delay_ms, abort_timer_popped, NULL);
 }
 
+/* Aborts that may be merged with later ones are coalesced into a single
+ * scheduler run: the transition timer (transition-delay) is restarted by each
+ * such abort, and the deadline below caps how long a burst can defer the run.
+ */
+static guint transition_delay_max_ms = 0;
+static guint transition_deadline_id = 0;
+static bool abort_urgent = false;
+
+void
+update_transition_delay_max(const char *value)
+{
+    long long ms = crm_get_msec(value);
+
+    transition_delay_max_ms = (ms > 0)? (guint) ms : 0;
+}
+
+static void
+stop_transition_deadline(void)
+{
+    if (transition_deadline_id != 0) {
+        g_source_remove(transition_deadline_id);
+        transition_deadline_id = 0;
+    }
+}
+
+static gboolean
+transition_deadline_popped(gpointer data)
+{
+    transition_deadline_id = 0;
+    if (is_timer_started(transition_timer)) {
+        crm_info("Aborts have delayed a new transition for %ums, "
+                 "computing it now", transition_delay_max_ms);
+        crm_timer_stop(transition_timer);
+        register_fsa_input(C_FSA_INTERNAL, I_PE_CALC, NULL);
+    }
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Request a new transition, coalescing it with nearby aborts if allowed
+ *
+ * \param[in] delayable  Whether the abort causing this may wait for others
+ *
+ * \note If transition-delay is set, a delayable request restarts the
+ *       transition timer, so bursts of such aborts result in one scheduler run
+ *       once the CIB has been quiet for that long. If transition-delay-max is
+ *       also set, the run happens no later than that after the first abort of
+ *       the burst. Requests that cannot wait (or any request following an
+ *       urgent abort of the active transition) start the calculation now.
+ */
+void
+controld_request_pe_calc(bool delayable)
+{
+    delayable = delayable && !abort_urgent;
+    abort_urgent = false;
+
+    if (!delayable || (transition_timer->period_ms <= 0)) {
+        if (is_timer_started(transition_timer)) {
+            crm_debug("Cancelling %s for urgent abort",
+                      get_timer_desc(transition_timer));
+            crm_timer_stop(transition_timer);
+        }
+        stop_transition_deadline();
+        register_fsa_input(C_FSA_INTERNAL, I_PE_CALC, NULL);
+        return;
+    }
+
+    if (!is_timer_started(transition_timer)) {
+        // First abort of a new burst
+        stop_transition_deadline();
+        if (transition_delay_max_ms > 0) {
+            transition_deadline_id = g_timeout_add(transition_delay_max_ms,
+                                                   transition_deadline_popped,
+                                                   NULL);
+        }
+    }
+    crm_timer_stop(transition_timer);
+    crm_timer_start(transition_timer);
+}
+
 void
 abort_transition_graph(int abort_priority, enum transition_action abort_action,
-                       const char *abort_text, xmlNode * reason, const char *fn, int line)
+                       const char *abort_text, xmlNode * reason, bool delayable,
+                       const char *fn, int line)
 {
     int add[] = { 0, 0, 0 };
     int del[] = { 0, 0, 0 };
@@ -539,6 +849,12 @@ abort_transition_graph(int abort_priority, enum transition_action abort_action,
         if(update_abort_priority(transition_graph, abort_priority, abort_action, abort_text)) {
             level = LOG_NOTICE;
         }
+        if (!delayable) {
+            abort_urgent = true;
+        }
+        if ((abort_action == tg_restart) && (fsa_state == S_TRANSITION_ENGINE)) {
+            controld_speculate_pe_calc();
+        }
     }
 
     if(reason) {
@@ -650,12 +966,7 @@ abort_transition_graph(int abort_priority, enum transition_action abort_action,
     }
 
     if (transition_graph->complete) {
-        if (transition_timer->period_ms > 0) {
-            crm_timer_stop(transition_timer);
-            crm_timer_start(transition_timer);
-        } else {
-            register_fsa_input(C_FSA_INTERNAL, I_PE_CALC, NULL);
-        }
+        controld_request_pe_calc(delayable);
         return;
     }
 
@@ -17,6 +17,7 @@
 #include <crm/crm.h>
 #include <crm/msg_xml.h>
 #include <crm/cluster.h>
+#include <crm/cluster/internal.h>
 
 #include <controld_fsa.h>
 #include <controld_throttle.h>
@@ -46,6 +47,112 @@ static float throttle_load_target = 0.0;
 static GHashTable *throttle_records = NULL;
 static mainloop_timer_t *throttle_timer = NULL;
 
+/*
+ * Adaptive throttling
+ *
+ * With PCMK_throttle_adaptive=true, a node chooses its own job limit rather
+ * than deriving a throttle mode from the load average, which says little on a
+ * host with many cores or in a container. Every few seconds it checks how long
+ * its executor requests waited in the executor's queue, how long its resource
+ * history updates took to be acknowledged by the CIB manager, and (if the
+ * kernel provides them) the CPU, I/O and memory pressure stall figures. If any
+ * is over its target, the limit is halved; otherwise, it is raised by a tenth
+ * of the maximum, up to the maximum (the usual additive-increase,
+ * multiplicative-decrease scheme).
+ *
+ * The chosen limit is sent as the node's maximum in throttle messages, so a DC
+ * of any version honors it.
+ */
+#define THROTTLE_ADAPTIVE_INTERVAL_MS   5000
+#define THROTTLE_QUEUE_TARGET_MS        500
+#define THROTTLE_CIB_TARGET_MS          1000
+#define THROTTLE_PRESSURE_TARGET        20.0    /* % of time stalled */
+
+struct throttle_sample_s {
+    guint count;
+    guint64 sum;
+    guint max;
+};
+
+static int throttle_adaptive = -1;      /* -1 until initialized */
+static int throttle_adaptive_limit = 0;
+static struct throttle_sample_s throttle_queue_time = { 0, };
+static struct throttle_sample_s throttle_cib_latency = { 0, };
+
+static bool
+throttle_is_adaptive(void)
+{
+    if (throttle_adaptive < 0) {
+        throttle_adaptive = crm_is_true(daemon_option("throttle_adaptive"));
+    }
+    return throttle_adaptive;
+}
+
+static void
+throttle_sample_add(struct throttle_sample_s *sample, guint ms)
+{
+    sample->count++;
+    sample->sum += ms;
+    sample->max = QB_MAX(sample->max, ms);
+}
+
+/*!
+ * \internal
+ * \brief Check (and reset) a latency sample against its target
+ *
+ * \param[in,out] sample     Latency sample
+ * \param[in]     desc       Description of sample (for logging)
+ * \param[in]     target_ms  Highest acceptable average latency
+ *
+ * \return TRUE if the average latency was above \p target_ms, otherwise FALSE
+ */
+static bool
+throttle_sample_over(struct throttle_sample_s *sample, const char *desc,
+                     guint target_ms)
+{
+    bool over = FALSE;
+
+    if (sample->count > 0) {
+        guint avg = (guint) (sample->sum / sample->count);
+
+        over = (avg > target_ms);
+        do_crm_log((over? LOG_INFO : LOG_TRACE),
+                   "%s averaged %ums (max %ums) over %u sample%s",
+                   desc, avg, sample->max, sample->count,
+                   ((sample->count == 1)? "" : "s"));
+    }
+    memset(sample, 0, sizeof(struct throttle_sample_s));
+    return over;
+}
+
+/*!
+ * \internal
+ * \brief Record how long an executor request waited to be run
+ *
+ * \param[in] ms  Time spent in the local executor's queue
+ */
+void
+throttle_record_queue_time(guint ms)
+{
+    if (throttle_is_adaptive()) {
+        throttle_sample_add(&throttle_queue_time, ms);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Record how long the CIB manager took to acknowledge an update
+ *
+ * \param[in] ms  Time from sending the update to its callback
+ */
+void
+throttle_record_cib_latency(guint ms)
+{
+    if (throttle_is_adaptive()) {
+        throttle_sample_add(&throttle_cib_latency, ms);
+    }
+}
+
 #if SUPPORT_PROCFS
 /*!
  * \internal
@@ -278,8 +385,103 @@ throttle_handle_load(float load, const char *desc, int cores)
 
     return throttle_check_thresholds(load, desc, thresholds);
 }
+
+/*!
+ * \internal
+ * \brief Get the highest recent pressure stall figure
+ *
+ * \param[out] pressure  Where to store the highest 10-second "some" average
+ *                       of CPU, I/O and memory pressure (as a percentage)
+ *
+ * \return TRUE if any pressure figure could be read, otherwise FALSE
+ */
+static bool
+throttle_pressure(float *pressure)
+{
+    const char *files[] = {
+        "/proc/pressure/cpu", "/proc/pressure/io", "/proc/pressure/memory"
+    };
+    bool found = FALSE;
+
+    *pressure = 0.0;
+    for (int lpc = 0; lpc < DIMOF(files); lpc++) {
+        char buffer[256];
+        FILE *stream = fopen(files[lpc], "r");
+        float avg10 = 0.0;
+
+        if (stream == NULL) {
+            continue; // Kernels before 4.20 have no pressure stall information
+        }
+        if (fgets(buffer, sizeof(buffer), stream)
+            && (sscanf(buffer, "some avg10=%f", &avg10) == 1)) {
+            crm_trace("%s: %.2f%%", files[lpc], avg10);
+            *pressure = QB_MAX(*pressure, avg10);
+            found = TRUE;
+        }
+        fclose(stream);
+    }
+    return found;
+}
 #endif
 
+/*!
+ * \internal
+ * \brief Adjust the adaptive job limit according to recent measurements
+ *
+ * \return Throttle mode to report
+ */
+static enum throttle_state_e
+throttle_adapt(void)
+{
+    int max = QB_MAX(1, throttle_job_max);
+    int old_limit = 0;
+    bool congested = FALSE;
+    enum throttle_state_e mode = throttle_none;
+
+    if ((throttle_adaptive_limit <= 0) || (throttle_adaptive_limit > max)) {
+        throttle_adaptive_limit = max;
+    }
+    old_limit = throttle_adaptive_limit;
+
+    // Check every signal, so that all of the samples are reset
+    congested |= throttle_sample_over(&throttle_queue_time,
+                                      "Executor queue time",
+                                      THROTTLE_QUEUE_TARGET_MS);
+    congested |= throttle_sample_over(&throttle_cib_latency,
+                                      "CIB update latency",
+                                      THROTTLE_CIB_TARGET_MS);
+#if SUPPORT_PROCFS
+    {
+        float pressure = 0.0;
+
+        if (throttle_pressure(&pressure)
+            && (pressure > THROTTLE_PRESSURE_TARGET)) {
+            crm_info("Pressure stall at %.2f%%", pressure);
+            congested = TRUE;
+        }
+    }
+#endif
+
+    if (congested) {
+        if (throttle_adaptive_limit == 1) {
+            // Nothing more can be done locally, so ask for fewer jobs overall
+            mode = throttle_high;
+        }
+        throttle_adaptive_limit = QB_MAX(1, throttle_adaptive_limit / 2);
+
+    } else {
+        throttle_adaptive_limit = QB_MIN(max, throttle_adaptive_limit
+                                              + QB_MAX(1, max / 10));
+    }
+
+    if (throttle_adaptive_limit != old_limit) {
+        crm_notice("%s job limit to %d (of at most %d)",
+                   (congested? "Reducing" : "Raising"),
+                   throttle_adaptive_limit, max);
+    }
+    return mode;
+}
+
 static enum throttle_state_e
 throttle_mode(void)
 {
@@ -348,14 +550,18 @@ throttle_send_command(enum throttle_state_e mode)
 {
     xmlNode *xml = NULL;
     static enum throttle_state_e last = -1;
+    static int last_max = -1;
+    int max = throttle_is_adaptive()? throttle_adaptive_limit : throttle_job_max;
 
-    if(mode != last) {
-        crm_info("New throttle mode: %.4x (was %.4x)", mode, last);
+    if ((mode != last) || (max != last_max)) {
+        crm_info("New throttle mode: %.4x (was %.4x), job limit %d",
+                 mode, last, max);
         last = mode;
+        last_max = max;
 
         xml = create_request(CRM_OP_THROTTLE, NULL, NULL, CRM_SYSTEM_CRMD, CRM_SYSTEM_CRMD, NULL);
         crm_xml_add_int(xml, F_CRM_THROTTLE_MODE, mode);
-        crm_xml_add_int(xml, F_CRM_THROTTLE_MAX, throttle_job_max);
+        crm_xml_add_int(xml, F_CRM_THROTTLE_MAX, max);
 
         send_cluster_message(NULL, crm_msg_crmd, xml, TRUE);
         free_xml(xml);
@@ -365,7 +571,11 @@ throttle_send_command(enum throttle_state_e mode)
 static gboolean
 throttle_timer_cb(gpointer data)
 {
-    throttle_send_command(throttle_mode());
+    if (throttle_is_adaptive()) {
+        throttle_send_command(throttle_adapt());
+    } else {
+        throttle_send_command(throttle_mode());
+    }
     return TRUE;
 }
 
@@ -414,7 +624,11 @@ throttle_init(void)
     if(throttle_records == NULL) {
         throttle_records = g_hash_table_new_full(
             crm_str_hash, g_str_equal, NULL, throttle_record_free);
-        throttle_timer = mainloop_timer_add("throttle", 30 * 1000, TRUE, throttle_timer_cb, NULL);
+        throttle_timer = mainloop_timer_add("throttle",
+                                            (throttle_is_adaptive()?
+                                             THROTTLE_ADAPTIVE_INTERVAL_MS
+                                             : 30 * 1000),
+                                            TRUE, throttle_timer_cb, NULL);
     }
 
     throttle_update_job_max(NULL);
@@ -513,6 +727,36 @@ throttle_get_job_limit(const char *node)
     return jobs;
 }
 
+/*!
+ * \internal
+ * \brief Find the active cluster peer with the least reported load
+ *
+ * \return Name of least loaded peer other than the local node (or NULL if
+ *         none has reported its load)
+ */
+const char *
+throttle_least_loaded_peer(void)
+{
+    GHashTableIter iter;
+    struct throttle_record_s *r = NULL;
+    struct throttle_record_s *best = NULL;
+
+    g_hash_table_iter_init(&iter, throttle_records);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &r)) {
+        crm_node_t *peer = crm_find_peer(0, r->node);
+
+        if ((peer == NULL) || !crm_is_peer_active(peer)
+            || safe_str_eq(r->node, fsa_our_uname)) {
+            continue;
+        }
+        if ((best == NULL) || (r->mode < best->mode)
+            || ((r->mode == best->mode) && (r->max > best->max))) {
+            best = r;
+        }
+    }
+    return best? best->node : NULL;
+}
+
 void
 throttle_update(xmlNode *xml)
 {
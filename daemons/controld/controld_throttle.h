@@ -25,3 +25,6 @@ void throttle_update(xmlNode *xml);
 void throttle_update_job_max(const char *preference);
 int throttle_get_job_limit(const char *node);
 int throttle_get_total_job_limit(int l);
+const char *throttle_least_loaded_peer(void);
+void throttle_record_queue_time(guint ms);
+void throttle_record_cib_latency(guint ms);
@@ -47,6 +47,7 @@ do_te_control(long long action,
 
     if (action & A_TE_STOP) {
         if (transition_graph) {
+            te_cancel_graph_timers(transition_graph);
             destroy_graph(transition_graph);
             transition_graph = NULL;
         }
@@ -102,6 +103,7 @@ do_te_control(long long action,
         set_graph_functions(&te_graph_fns);
 
         if (transition_graph) {
+            te_cancel_graph_timers(transition_graph);
             destroy_graph(transition_graph);
         }
 
@@ -182,6 +184,7 @@ do_te_invoke(long long action,
                   crm_log_xml_err(input->msg, "Bad command");
                   return);
 
+        te_cancel_graph_timers(transition_graph);
         destroy_graph(transition_graph);
         transition_graph = unpack_graph(graph_data, graph_input);
         if (transition_graph == NULL) {
@@ -191,6 +194,17 @@ do_te_invoke(long long action,
         }
         crm_info("Processing graph %d (ref=%s) derived from %s", transition_graph->id, ref,
                  graph_input);
+        transition_started = g_get_monotonic_time();
+
+        free(transition_spans);
+        transition_spans = crm_element_value_copy(graph_data,
+                                                  PCMK__TRACE_SPAN_ATTR);
+        pcmk__trace_hops(pcmk__hop_transition_started, transition_graph->id,
+                         transition_spans);
+        if (safe_str_eq(transition_spans, te_pending_spans)) {
+            free(te_pending_spans);
+            te_pending_spans = NULL;
+        }
 
         te_reset_job_counts();
         value = crm_element_value(graph_data, "failed-stop-offset");
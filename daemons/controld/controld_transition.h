@@ -32,7 +32,9 @@ void process_graph_event(xmlNode *event, const char *event_node);
 
 /* utils */
 extern crm_action_t *get_action(int id, gboolean confirmed);
+void start_te_timer(crm_action_timer_t *timer, guint timeout_ms);
 extern gboolean stop_te_timer(crm_action_timer_t * timer);
+int te_cancel_graph_timers(crm_graph_t *graph);
 extern const char *get_rsc_state(const char *task, enum op_status status);
 
 /* unpack */
@@ -60,12 +62,20 @@ extern void trigger_graph_processing(const char *fn, int line);
 void abort_after_delay(int abort_priority, enum transition_action abort_action,
                        const char *abort_text, guint delay_ms);
 extern void abort_transition_graph(int abort_priority, enum transition_action abort_action,
-                                   const char *abort_text, xmlNode * reason, const char *fn,
-                                   int line);
+                                   const char *abort_text, xmlNode * reason,
+                                   bool delayable, const char *fn, int line);
+void controld_request_pe_calc(bool delayable);
+void update_transition_delay_max(const char *value);
 
 #  define trigger_graph()	trigger_graph_processing(__FUNCTION__, __LINE__)
 #  define abort_transition(pri, action, text, reason)			\
-	abort_transition_graph(pri, action, text, reason,__FUNCTION__,__LINE__);
+	abort_transition_graph(pri, action, text, reason, false, __FUNCTION__, __LINE__);
+
+/* Abort for a change that may be coalesced with others arriving shortly
+ * after it (see transition-delay and transition-delay-max)
+ */
+#  define abort_transition_delayable(pri, action, text, reason)		\
+	abort_transition_graph(pri, action, text, reason, true, __FUNCTION__, __LINE__);
 
 extern gboolean te_connect_stonith(gpointer user_data);
 
@@ -73,11 +83,16 @@ extern crm_trigger_t *transition_trigger;
 extern crm_trigger_t *stonith_reconnect;
 
 extern char *failed_stop_offset;
+extern gint64 transition_started; // g_get_monotonic_time() at graph unpack
+extern char *te_pending_spans;      // trace span IDs for the next transition
+extern char *transition_spans;      // trace span IDs for this transition
 extern char *failed_start_offset;
 extern int active_timeout;
 extern int stonith_op_active;
 
 void te_action_confirmed(crm_action_t * action);
+void te_set_peer_lrm_batch(const char *node, gboolean supported);
+void te_flush_lrm_batches(void);
 void te_reset_job_counts(void);
 
 #endif
@@ -957,6 +957,7 @@ erase_status_tag(const char *uname, const char *tag, int options)
         int call_id;
         char *xpath = crm_strdup_printf(XPATH_STATUS_TAG, uname, tag);
 
+        controld_flush_resource_updates();
         crm_info("Deleting %s status entries for %s " CRM_XS " xpath=%s",
                  tag, uname, xpath);
         call_id = fsa_cib_conn->cmds->remove(fsa_cib_conn, xpath, NULL,
@@ -966,6 +967,112 @@ erase_status_tag(const char *uname, const char *tag, int options)
     }
 }
 
+/*!
+ * \internal
+ * \brief Erase a status section entry for several nodes in one CIB request
+ *
+ * \param[in] unames   Names of nodes to erase entries for (as char *)
+ * \param[in] tag      Status section entry (for example, XML_CIB_TAG_LRM)
+ * \param[in] options  CIB call options to use in addition to the defaults
+ */
+void
+erase_status_tags(GList *unames, const char *tag, int options)
+{
+    char *xpath = NULL;
+
+    if ((fsa_cib_conn == NULL) || (unames == NULL)) {
+        return;
+    }
+
+    for (GList *iter = unames; iter != NULL; iter = iter->next) {
+        char *one = crm_strdup_printf(XPATH_STATUS_TAG,
+                                      (const char *) iter->data, tag);
+
+        if (xpath == NULL) {
+            xpath = one;
+        } else {
+            char *both = crm_strdup_printf("%s|%s", xpath, one);
+
+            free(xpath);
+            free(one);
+            xpath = both;
+        }
+    }
+
+    crm_info("Deleting %s status entries for %d node%s " CRM_XS " xpath=%s",
+             tag, g_list_length(unames), ((unames->next == NULL)? "" : "s"),
+             xpath);
+    controld_erase_status_xpath(xpath, options);
+}
+
+/*!
+ * \internal
+ * \brief Erase every status section entry matching an XPath expression
+ *
+ * \param[in] xpath    XPath expression (this function takes ownership)
+ * \param[in] options  CIB call options to use in addition to the defaults
+ */
+void
+controld_erase_status_xpath(char *xpath, int options)
+{
+    int call_id = 0;
+
+    if (fsa_cib_conn == NULL) {
+        free(xpath);
+        return;
+    }
+    controld_flush_resource_updates();
+    call_id = fsa_cib_conn->cmds->remove(fsa_cib_conn, xpath, NULL,
+                                         cib_quorum_override | cib_xpath
+                                         | cib_multiple | options);
+    fsa_register_cib_callback(call_id, FALSE, xpath, erase_xpath_callback);
+    // CIB library handles freeing xpath
+}
+
+/*!
+ * \internal
+ * \brief Calculate a digest of a resource's executor history
+ *
+ * The digest does not depend on the order of the operation entries or on
+ * their debug origin, so a node's history and the CIB copy of it have the same
+ * digest whenever the scheduler would see the same thing in both.
+ *
+ * \param[in] xml_rsc  Resource history (XML_LRM_TAG_RESOURCE)
+ *
+ * \return Newly allocated digest
+ */
+char *
+controld_history_digest(xmlNode *xml_rsc)
+{
+    GList *digests = NULL;
+    GString *text = g_string_sized_new(1024);
+    xmlNode *copy = create_xml_node(NULL, XML_LRM_TAG_RESOURCE);
+    char *digest = NULL;
+
+    copy_in_properties(copy, xml_rsc);
+    digests = g_list_prepend(digests, calculate_operation_digest(copy, NULL));
+    free_xml(copy);
+
+    for (xmlNode *op = __xml_first_child_element(xml_rsc); op != NULL;
+         op = __xml_next_element(op)) {
+        copy = copy_xml(op);
+        xml_remove_prop(copy, XML_ATTR_ORIGIN);
+        digests = g_list_prepend(digests,
+                                 calculate_operation_digest(copy, NULL));
+        free_xml(copy);
+    }
+
+    digests = g_list_sort(digests, (GCompareFunc) strcmp);
+    for (GList *iter = digests; iter != NULL; iter = iter->next) {
+        g_string_append(text, (const char *) iter->data);
+    }
+    digest = crm_md5sum(text->str);
+
+    g_string_free(text, TRUE);
+    g_list_free_full(digests, free);
+    return digest;
+}
+
 void crmd_peer_down(crm_node_t *peer, bool full) 
 {
     if(full && peer->state == NULL) {
@@ -39,6 +39,7 @@
 extern gboolean fsa_has_quorum;
 extern int last_peer_update;
 extern int last_resource_update;
+void controld_flush_resource_updates(void);
 
 enum node_update_flags {
     node_update_none = 0x0000,
@@ -58,6 +59,15 @@ gboolean is_timer_started(fsa_timer_t * timer);
 crm_exit_t crmd_exit(crm_exit_t exit_code);
 crm_exit_t crmd_fast_exit(crm_exit_t exit_code);
 void pe_subsystem_free(void);
+bool controld_daemon_ready(uint32_t proc);
+void controld_set_speculation(const char *value);
+void controld_speculate_pe_calc(void);
+bool controld_speculation_reply(xmlNode *msg);
+void controld_discard_speculation(void);
+void controld_set_offload(const char *value);
+void controld_discard_offload(void);
+void controld_accept_pe_reply(xmlNode *msg);
+void controld_run_offloaded_pe_calc(xmlNode *msg);
 
 void fsa_dump_actions(long long action, const char *text);
 void fsa_dump_inputs(int log_level, const char *text, long long input_register);
@@ -66,11 +76,18 @@ gboolean update_dc(xmlNode * msg);
 void crm_update_peer_join(const char *source, crm_node_t * node, enum crm_join_phase phase);
 xmlNode *create_node_state_update(crm_node_t *node, int flags,
                                   xmlNode *parent, const char *source);
+void controld_queue_node_state(crm_node_t *node, int flags,
+                               const char *abort_reason, const char *source);
+void controld_flush_node_states(void);
 void populate_cib_nodes(enum node_update_flags flags, const char *source);
 void crm_update_quorum(gboolean quorum, gboolean force_update);
 void erase_status_tag(const char *uname, const char *tag, int options);
+void erase_status_tags(GList *unames, const char *tag, int options);
+void controld_erase_status_xpath(char *xpath, int options);
+char *controld_history_digest(xmlNode *xml_rsc);
 void update_attrd(const char *host, const char *name, const char *value, const char *user_name, gboolean is_remote_node);
 void update_attrd_remote_node_removed(const char *host, const char *user_name);
+void controld_attrd_subscribe(void);
 void update_attrd_clear_failures(const char *host, const char *rsc,
                                  const char *op, const char *interval_spec,
                                  gboolean is_remote_node);
@@ -85,6 +85,9 @@ main(int argc, char **argv)
     crm_log_init(NULL, LOG_INFO, TRUE, FALSE, argc, argv, FALSE);
     crm_info("CRM Git Version: %s (%s)", PACEMAKER_VERSION, BUILD_VERSION);
 
+    // Parse large messages from the CIB manager without blocking the main loop
+    pcmk__workers_init(-1);
+
     if (optind > argc) {
         ++argerr;
     }
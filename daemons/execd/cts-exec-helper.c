@@ -42,7 +42,16 @@ static struct crm_option long_options[] = {
     {"start-delay",      1, 0, 's'},
     {"param-key",        1, 0, 'k'},
     {"param-val",        1, 0, 'v'},
-    
+
+    {"-spacer-",         1, 0, '-', "\nLoad testing"},
+    {"benchmark",        1, 0, 'B', "\tRegister this many resources (of --class, --provider and --type,"},
+    {"-spacer-",         1, 0, '-', "\t\t\tocf:pacemaker:Dummy by default, with any --param-key/--param-val),"},
+    {"-spacer-",         1, 0, '-', "\t\t\tstart them, run --bench-cycles stop/start cycles, keep recurring"},
+    {"-spacer-",         1, 0, '-', "\t\t\tmonitors (if --interval is given) for --bench-duration seconds,"},
+    {"-spacer-",         1, 0, '-', "\t\t\tthen print latency and CPU statistics for each action"},
+    {"bench-cycles",     1, 0, 'y', "\tNumber of stop/start cycles in benchmark mode (default 1)"},
+    {"bench-duration",   1, 0, 'D', "\tSeconds to run recurring monitors in benchmark mode (default 60)"},
+
     {"-spacer-",         1, 0, '-'},
     {0, 0, 0, 0}
 };
@@ -54,6 +63,7 @@ static int exec_call_opts = 0;
 extern void cleanup_alloc_calculations(pe_working_set_t * data_set);
 static gboolean start_test(gpointer user_data);
 static void try_connect(void);
+static void start_benchmark(void);
 
 static struct {
     int verbose;
@@ -65,6 +75,9 @@ static struct {
     int no_wait;
     int is_running;
     int no_connect;
+    int benchmark;          // number of resources to load test with
+    int bench_cycles;
+    int bench_duration;     // seconds
     const char *api_call;
     const char *rsc_id;
     const char *provider;
@@ -196,6 +209,11 @@ start_test(gpointer user_data)
             return 0;
         }
     }
+    if (options.benchmark > 0) {
+        start_benchmark();
+        return 0;
+    }
+
     lrmd_conn->cmds->set_callback(lrmd_conn, read_events);
 
     if (options.timeout) {
@@ -348,6 +366,336 @@ start_test(gpointer user_data)
     return 0;
 }
 
+/*
+ * Benchmark mode
+ *
+ * Drives the executor with many resources at once and reports, for each
+ * action, how long operations waited in the executor's queue (queue_time) and
+ * ran (exec_time), as the executor itself measured them, plus the rest of the
+ * time from the request to this client receiving the result. That remainder
+ * covers forking and executing the agent and delivering the notification, so
+ * it shows the executor's own overhead. The executor's CPU use (including the
+ * agents it reaped) per operation is read from /proc, where available.
+ */
+
+enum bench_phase_e {
+    bench_register,
+    bench_start,
+    bench_stop,
+    bench_monitor,
+    bench_cleanup,
+};
+
+struct bench_stats_s {
+    int count;
+    int failed;
+    unsigned long long queue_ms;
+    unsigned int queue_max;
+    unsigned long long exec_ms;
+    unsigned int exec_max;
+    unsigned long long overhead_us;   // only for results with a known request time
+    int overhead_count;
+    gint64 overhead_max;
+};
+
+static struct {
+    enum bench_phase_e phase;
+    int cycle;
+    int pending;
+    GHashTable *requested;          // call ID -> request time (monotonic us)
+    GHashTable *stats;              // action -> struct bench_stats_s
+    long long cpu_ticks_start;
+    int ops_total;
+} bench = { bench_register, };
+
+static char *
+bench_rsc_id(int i)
+{
+    return crm_strdup_printf("bench-rsc-%d", i);
+}
+
+static lrmd_key_value_t *
+copy_params(lrmd_key_value_t *params)
+{
+    lrmd_key_value_t *copy = NULL;
+
+    for (; params != NULL; params = params->next) {
+        copy = lrmd_key_value_add(copy, params->key, params->value);
+    }
+    return copy;
+}
+
+/*!
+ * \internal
+ * \brief Get the CPU time used by the executor and its reaped children
+ *
+ * \return Clock ticks used, or -1 if unknown
+ */
+static long long
+executor_cpu_ticks(void)
+{
+#ifdef __linux__
+    static char *stat_path = NULL;
+    long long ticks = -1;
+    char buffer[1024];
+    FILE *stat_file = NULL;
+
+    if (stat_path == NULL) {
+        GDir *proc = g_dir_open("/proc", 0, NULL);
+        const char *entry = NULL;
+
+        while ((proc != NULL) && (stat_path == NULL)
+               && ((entry = g_dir_read_name(proc)) != NULL)) {
+            char *comm_path = crm_strdup_printf("/proc/%s/comm", entry);
+            FILE *comm = fopen(comm_path, "r");
+
+            if ((comm != NULL) && fgets(buffer, sizeof(buffer), comm)
+                && (strcmp(buffer, "pacemaker-execd\n") == 0)) {
+                stat_path = crm_strdup_printf("/proc/%s/stat", entry);
+            }
+            if (comm != NULL) {
+                fclose(comm);
+            }
+            free(comm_path);
+        }
+        if (proc != NULL) {
+            g_dir_close(proc);
+        }
+        if (stat_path == NULL) {
+            return -1;
+        }
+    }
+
+    stat_file = fopen(stat_path, "r");
+    if ((stat_file != NULL) && fgets(buffer, sizeof(buffer), stat_file)) {
+        // Fields 14-17 (utime, stime, cutime, cstime) follow "(comm) state"
+        char *fields = strrchr(buffer, ')');
+        unsigned long long utime, stime;
+        long long cutime, cstime;
+
+        if ((fields != NULL)
+            && (sscanf(fields + 2,
+                       "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %lld %lld",
+                       &utime, &stime, &cutime, &cstime) == 4)) {
+            ticks = (long long) (utime + stime) + cutime + cstime;
+        }
+    }
+    if (stat_file != NULL) {
+        fclose(stat_file);
+    }
+    return ticks;
+#else
+    return -1;
+#endif
+}
+
+static void
+bench_exec(const char *rsc_id, const char *action, guint interval_ms)
+{
+    gint64 *requested = NULL;
+    int call_id = lrmd_conn->cmds->exec(lrmd_conn, rsc_id, action, NULL,
+                                        interval_ms, options.timeout, 0,
+                                        lrmd_opt_none,
+                                        copy_params(options.params));
+
+    if (call_id <= 0) {
+        crm_err("Could not execute %s on %s: %s",
+                action, rsc_id, pcmk_strerror(call_id));
+        return;
+    }
+    requested = malloc(sizeof(gint64));
+    CRM_ASSERT(requested != NULL);
+    *requested = g_get_monotonic_time();
+    g_hash_table_insert(bench.requested, GINT_TO_POINTER(call_id), requested);
+    bench.pending++;
+}
+
+static void
+bench_exec_all(const char *action, guint interval_ms)
+{
+    for (int i = 0; i < options.benchmark; i++) {
+        char *rsc_id = bench_rsc_id(i);
+
+        bench_exec(rsc_id, action, interval_ms);
+        free(rsc_id);
+    }
+    crm_info("Benchmark requested %d %s operations", bench.pending, action);
+}
+
+static void
+print_bench_stats(gpointer key, gpointer value, gpointer user_data)
+{
+    struct bench_stats_s *stats = value;
+
+    printf("%-12s %7d %6d %10.1f %8u %10.1f %8u %12.3f %10.3f\n",
+           (const char *) key, stats->count, stats->failed,
+           (double) stats->queue_ms / stats->count, stats->queue_max,
+           (double) stats->exec_ms / stats->count, stats->exec_max,
+           (stats->overhead_count?
+            (stats->overhead_us / 1000.0 / stats->overhead_count) : 0.0),
+           stats->overhead_max / 1000.0);
+}
+
+static void
+bench_report(void)
+{
+    long long cpu_ticks = executor_cpu_ticks();
+
+    printf("%-12s %7s %6s %10s %8s %10s %8s %12s %10s\n", "action", "ops",
+           "failed", "queue-ms", "max", "exec-ms", "max", "overhead-ms", "max");
+    g_hash_table_foreach(bench.stats, print_bench_stats, NULL);
+
+    if ((cpu_ticks >= 0) && (bench.cpu_ticks_start >= 0)
+        && (bench.ops_total > 0)) {
+        printf("executor CPU per operation (including agents): %.3f ms\n",
+               (cpu_ticks - bench.cpu_ticks_start) * 1000.0
+               / sysconf(_SC_CLK_TCK) / bench.ops_total);
+    }
+    fflush(stdout);
+}
+
+static gboolean
+bench_monitor_done(gpointer user_data)
+{
+    // Cancelling reports nothing back, so go straight on to stopping
+    for (int i = 0; i < options.benchmark; i++) {
+        char *rsc_id = bench_rsc_id(i);
+
+        lrmd_conn->cmds->cancel(lrmd_conn, rsc_id, "monitor",
+                                options.interval_ms);
+        free(rsc_id);
+    }
+    bench.phase = bench_cleanup;
+    bench_exec_all("stop", 0);
+    return FALSE;
+}
+
+// Move to the next phase once every operation of this one has completed
+static void
+bench_next_phase(void)
+{
+    switch (bench.phase) {
+        case bench_start:
+            if (bench.cycle < options.bench_cycles) {
+                bench.phase = bench_stop;
+                bench_exec_all("stop", 0);
+                break;
+            }
+            if (options.interval_ms > 0) {
+                bench.phase = bench_monitor;
+                bench_exec_all("monitor", options.interval_ms);
+                bench.pending = 0; // Recurring results never finish
+                g_timeout_add_seconds(options.bench_duration,
+                                      bench_monitor_done, NULL);
+                break;
+            }
+            bench.phase = bench_cleanup;
+            bench_exec_all("stop", 0);
+            break;
+
+        case bench_stop:
+            bench.cycle++;
+            bench.phase = bench_start;
+            bench_exec_all("start", 0);
+            break;
+
+        case bench_cleanup:
+            bench_report();
+            for (int i = 0; i < options.benchmark; i++) {
+                char *rsc_id = bench_rsc_id(i);
+
+                lrmd_conn->cmds->unregister_rsc(lrmd_conn, rsc_id, 0);
+                free(rsc_id);
+            }
+            test_exit(CRM_EX_OK);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void
+bench_events(lrmd_event_data_t *event)
+{
+    struct bench_stats_s *stats = NULL;
+    gint64 *requested = NULL;
+
+    if ((event->type != lrmd_event_exec_complete)
+        || (event->op_status == PCMK_LRM_OP_CANCELLED)) {
+        return;
+    }
+
+    stats = g_hash_table_lookup(bench.stats, event->op_type);
+    if (stats == NULL) {
+        stats = calloc(1, sizeof(struct bench_stats_s));
+        g_hash_table_insert(bench.stats, strdup(event->op_type), stats);
+    }
+    stats->count++;
+    bench.ops_total++;
+    if ((event->op_status != PCMK_LRM_OP_DONE) || (event->rc != PCMK_OCF_OK)) {
+        stats->failed++;
+    }
+    stats->queue_ms += event->queue_time;
+    stats->queue_max = QB_MAX(stats->queue_max, event->queue_time);
+    stats->exec_ms += event->exec_time;
+    stats->exec_max = QB_MAX(stats->exec_max, event->exec_time);
+
+    /* Only the first result of a recurring operation can be matched to its
+     * request
+     */
+    requested = g_hash_table_lookup(bench.requested,
+                                    GINT_TO_POINTER(event->call_id));
+    if (requested != NULL) {
+        gint64 overhead = g_get_monotonic_time() - *requested
+                          - 1000 * (gint64) (event->queue_time + event->exec_time);
+
+        overhead = QB_MAX(overhead, 0);
+        stats->overhead_us += overhead;
+        stats->overhead_count++;
+        stats->overhead_max = QB_MAX(stats->overhead_max, overhead);
+        g_hash_table_remove(bench.requested, GINT_TO_POINTER(event->call_id));
+
+        if ((event->interval_ms == 0) && (--bench.pending == 0)) {
+            bench_next_phase();
+        }
+    }
+}
+
+static void
+start_benchmark(void)
+{
+    const char *class = options.class? options.class : PCMK_RESOURCE_CLASS_OCF;
+    const char *provider = options.provider? options.provider : "pacemaker";
+    const char *type = options.type? options.type : "Dummy";
+
+    if (options.timeout <= 0) {
+        options.timeout = 20000;
+    }
+    bench.requested = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                            NULL, free);
+    bench.stats = crm_str_table_new();
+    lrmd_conn->cmds->set_callback(lrmd_conn, bench_events);
+
+    for (int i = 0; i < options.benchmark; i++) {
+        char *rsc_id = bench_rsc_id(i);
+        int rc = lrmd_conn->cmds->register_rsc(lrmd_conn, rsc_id, class,
+                                               provider, type, 0);
+
+        if (rc != pcmk_ok) {
+            print_result(printf("Could not register %s: %s\n",
+                                rsc_id, pcmk_strerror(rc)));
+            free(rsc_id);
+            test_exit(CRM_EX_ERROR);
+        }
+        free(rsc_id);
+    }
+
+    bench.cpu_ticks_start = executor_cpu_ticks();
+    bench.phase = bench_start;
+    bench_exec_all("start", 0);
+}
+
 static int
 generate_params(void)
 {
@@ -393,6 +741,8 @@ generate_params(void)
     data_set.input = cib_xml_copy;
     data_set.now = crm_time_new(NULL);
 
+    // Only the resource's configured parameters are needed
+    set_bit(data_set.flags, pe_flag_no_history);
     cluster_status(&data_set);
     if (options.rsc_id) {
         rsc = pe_find_resource_with_flags(data_set.resources, options.rsc_id,
@@ -454,6 +804,8 @@ main(int argc, char **argv)
     crm_trigger_t *trig;
 
     crm_log_cli_init("cts-exec-helper");
+    options.bench_cycles = 1;
+    options.bench_duration = 60;
     crm_set_options(NULL, "mode [options]", long_options,
                     "Inject commands into the executor, and watch for events\n");
 
@@ -543,6 +895,15 @@ main(int argc, char **argv)
             case 'S':
                 use_tls = TRUE;
                 break;
+            case 'B':
+                options.benchmark = crm_parse_int(optarg, "0");
+                break;
+            case 'y':
+                options.bench_cycles = crm_parse_int(optarg, "1");
+                break;
+            case 'D':
+                options.bench_duration = crm_parse_int(optarg, "60");
+                break;
             default:
                 ++argerr;
                 break;
@@ -589,7 +950,7 @@ main(int argc, char **argv)
 
     /* if we can't perform an api_call or listen for events, 
      * there is nothing to do */
-    if (!options.api_call && !options.listen) {
+    if (!options.api_call && !options.listen && (options.benchmark <= 0)) {
         crm_err("Nothing to be done.  Please specify 'api-call' and/or 'listen'");
         return CRM_EX_OK;
     }
@@ -7,6 +7,13 @@
 
 #include <crm_internal.h>
 
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <glib.h>
 
 #include <crm/crm.h>
@@ -18,6 +25,61 @@
 
 #include "pacemaker-execd.h"
 
+/*
+ * Batched alert delivery
+ *
+ * By default, each alert agent is run once per event, so a mass failover can
+ * mean thousands of agent processes per alert. An alert whose delivery meta
+ * attribute is "batch" or "receiver" instead gets a queue here, per recipient.
+ * Events wait in the queue for the alert's batch delay, and are then delivered
+ * together, up to the batch size at a time:
+ *
+ * - "batch" runs the agent once per batch, with CRM_alert_kind set to "batch"
+ *   and CRM_alert_count to the number of events. The events themselves are on
+ *   the agent's standard input, one XML element per line, with an attribute for
+ *   each CRM_alert_* variable the agent would otherwise have been given (minus
+ *   the prefix). Only one instance of the agent runs at a time, and no more than
+ *   one is started per batch delay, so a slow agent can't be overwhelmed.
+ *
+ * - "receiver" treats the alert's path as the name of a Unix stream socket that
+ *   a long-running receiver listens on, and writes the same lines to it over a
+ *   persistent connection. If the receiver is not listening, or is not keeping
+ *   up, delivery is retried after the batch delay. After a reconnect, events are
+ *   delivered at least once (the last event written before a failed connection
+ *   may be repeated).
+ *
+ * If the queue reaches the alert's queue size, the oldest events are dropped
+ * (with a warning) rather than letting memory grow without bound.
+ */
+
+struct alert_queue_s {
+    char *key;                  // alert ID and recipient
+    char *id;
+    char *path;
+    enum crm_alert_delivery delivery;
+    int timeout;
+    int batch_delay;
+    int batch_size;
+    int queue_size;
+
+    GQueue *events;             // parameter tables of events waiting
+    unsigned int dropped;       // events dropped since last warning
+    guint timer;                // delivery timer
+    int call_id;                // in-flight agent (for inflight_alerts), or 0
+    gint64 last_start;          // monotonic time last agent (batch) was run
+
+    int fd;                     // connection to receiver, or -1
+    gboolean connecting;        // connection to receiver is in progress
+    GString *output;            // lines not yet written to receiver
+    gsize written;              // bytes of output already written
+    gboolean unreachable;       // receiver connection failure was logged
+};
+
+static GHashTable *alert_queues = NULL; // key = alert_queue_s key, value = queue
+static int batch_call_id = 0;           // negative, to avoid clients' call IDs
+
+static void schedule_alert_queue(struct alert_queue_s *queue);
+
 /* Track in-flight alerts so we can wait for them at shutdown */
 static GHashTable *inflight_alerts; /* key = call_id, value = timeout */
 static gboolean draining_alerts = FALSE;
@@ -77,6 +139,396 @@ alert_complete(svc_action_t *action)
     action->cb_data = NULL;
 }
 
+static void
+free_alert_queue(gpointer data)
+{
+    struct alert_queue_s *queue = data;
+
+    if (queue->timer) {
+        pcmk__timeout_remove(queue->timer);
+    }
+    if (queue->fd >= 0) {
+        close(queue->fd);
+    }
+    g_queue_free_full(queue->events, (GDestroyNotify) g_hash_table_destroy);
+    g_string_free(queue->output, TRUE);
+    free(queue->key);
+    free(queue->id);
+    free(queue->path);
+    free(queue);
+}
+
+// Find or create the delivery queue for an alert event
+static struct alert_queue_s *
+get_alert_queue(const char *alert_id, const char *alert_path, int timeout,
+                GHashTable *params)
+{
+    const char *recipient = crm_alert_keys[CRM_alert_recipient][0];
+    char *key = crm_strdup_printf("%s %s", alert_id,
+                                  crm_str(g_hash_table_lookup(params,
+                                                              recipient)));
+    struct alert_queue_s *queue = NULL;
+
+    if (alert_queues == NULL) {
+        alert_queues = g_hash_table_new_full(crm_str_hash, g_str_equal, NULL,
+                                             free_alert_queue);
+    }
+    queue = g_hash_table_lookup(alert_queues, key);
+    if (queue == NULL) {
+        queue = calloc(1, sizeof(struct alert_queue_s));
+        CRM_ASSERT(queue != NULL);
+        queue->key = key;
+        queue->id = strdup(alert_id);
+        queue->events = g_queue_new();
+        queue->fd = -1;
+        queue->output = g_string_sized_new(1024);
+        g_hash_table_insert(alert_queues, queue->key, queue);
+    } else {
+        free(key);
+    }
+
+    // Configuration changes take effect with the next event
+    free(queue->path);
+    queue->path = strdup(alert_path);
+    queue->timeout = timeout;
+    queue->delivery = crm_alert_text2delivery(g_hash_table_lookup(params,
+                                                  CRM_ALERT_META_DELIVERY));
+    queue->batch_delay = crm_parse_int(g_hash_table_lookup(params,
+                                           CRM_ALERT_META_BATCH_DELAY),
+                                       "0");
+    queue->batch_size = crm_parse_int(g_hash_table_lookup(params,
+                                          CRM_ALERT_META_BATCH_SIZE),
+                                      "0");
+    queue->queue_size = crm_parse_int(g_hash_table_lookup(params,
+                                          CRM_ALERT_META_QUEUE_SIZE),
+                                      "0");
+    if (queue->batch_delay < 0) {
+        queue->batch_delay = CRM_ALERT_DEFAULT_BATCH_DELAY_MS;
+    }
+    if (queue->batch_size <= 0) {
+        queue->batch_size = CRM_ALERT_DEFAULT_BATCH_SIZE;
+    }
+    if (queue->queue_size <= 0) {
+        queue->queue_size = CRM_ALERT_DEFAULT_QUEUE_SIZE;
+    }
+    return queue;
+}
+
+// Append an event to a string, as one line of XML
+static void
+add_event_line(GString *output, GHashTable *params)
+{
+    static const size_t prefix_len = sizeof("CRM_alert_") - 1;
+    xmlNode *event = create_xml_node(NULL, "event");
+    GHashTableIter iter;
+    const char *name = NULL;
+    const char *value = NULL;
+    char *line = NULL;
+
+    g_hash_table_iter_init(&iter, params);
+    while (g_hash_table_iter_next(&iter, (gpointer *) &name,
+                                  (gpointer *) &value)) {
+        if (crm_starts_with(name, "CRM_alert_") && (name[prefix_len] != '\0')) {
+            crm_xml_add(event, name + prefix_len, value);
+        }
+    }
+    line = dump_xml_unformatted(event);
+    g_string_append(output, g_strchomp(line));
+    g_string_append_c(output, '\n');
+    free(line);
+    free_xml(event);
+}
+
+static void
+batch_complete(svc_action_t *action)
+{
+    struct alert_queue_s *queue = NULL;
+
+    remove_inflight_alert(GPOINTER_TO_INT(action->cb_data));
+    crm_debug("Alert batch pid %d for %s completed with rc=%d",
+              action->pid, action->id, action->rc);
+
+    if (alert_queues != NULL) {
+        GHashTableIter iter;
+
+        g_hash_table_iter_init(&iter, alert_queues);
+        while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &queue)) {
+            if (queue->call_id == GPOINTER_TO_INT(action->cb_data)) {
+                queue->call_id = 0;
+                schedule_alert_queue(queue);
+                break;
+            }
+        }
+    }
+    action->cb_data = NULL;
+}
+
+// Run a batch alert's agent for as many queued events as a batch allows
+static void
+run_alert_batch(struct alert_queue_s *queue)
+{
+    GString *input = g_string_sized_new(1024);
+    GHashTable *params = crm_str_table_new();
+    GHashTable *event = NULL;
+    svc_action_t *action = NULL;
+    int count = 0;
+
+    while ((count < queue->batch_size)
+           && ((event = g_queue_pop_head(queue->events)) != NULL)) {
+        GHashTableIter iter;
+        const char *name = NULL;
+        const char *value = NULL;
+
+        // Agents get their own environment variables, but not events'
+        g_hash_table_iter_init(&iter, event);
+        while (g_hash_table_iter_next(&iter, (gpointer *) &name,
+                                      (gpointer *) &value)) {
+            if ((!crm_starts_with(name, "CRM_alert_")
+                 && !crm_starts_with(name, "CRM_notify_"))
+                || crm_ends_with(name, "_recipient")
+                || crm_ends_with(name, "_version")) {
+                g_hash_table_replace(params, strdup(name), strdup(value));
+            }
+        }
+        add_event_line(input, event);
+        g_hash_table_destroy(event);
+        ++count;
+    }
+    if (count == 0) {
+        g_string_free(input, TRUE);
+        g_hash_table_destroy(params);
+        return;
+    }
+
+    crm_insert_alert_key(params, CRM_alert_kind, "batch");
+    g_hash_table_replace(params, strdup("CRM_alert_count"), crm_itoa(count));
+
+    crm_info("Executing alert %s with a batch of %d events", queue->id, count);
+    queue->call_id = --batch_call_id;
+    queue->last_start = g_get_monotonic_time();
+    action = services_alert_create(queue->id, queue->path, queue->timeout,
+                                   params, 0,
+                                   GINT_TO_POINTER(queue->call_id));
+    if ((services_action_user(action, CRM_DAEMON_USER) < 0)
+        || (services_alert_input(action, input->str, input->len) < 0)) {
+        crm_err("Dropped batch of %d events for alert %s", count, queue->id);
+        queue->call_id = 0;
+        services_action_free(action);
+        g_string_free(input, TRUE);
+        return;
+    }
+    g_string_free(input, TRUE);
+
+    add_inflight_alert(queue->call_id, queue->timeout);
+    if (services_alert_async(action, batch_complete) == FALSE) {
+        remove_inflight_alert(queue->call_id);
+        queue->call_id = 0;
+        services_action_free(action);
+    }
+}
+
+// Connect to a receiver alert's socket, if not already connected
+static gboolean
+connect_alert_receiver(struct alert_queue_s *queue)
+{
+    struct sockaddr_un addr;
+    int rc = 0;
+
+    if ((queue->fd >= 0) && queue->connecting) {
+        struct pollfd pfd = { queue->fd, POLLOUT, 0 };
+        socklen_t len = sizeof(rc);
+
+        if (poll(&pfd, 1, 0) <= 0) {
+            return FALSE; // Still connecting (or interrupted)
+        }
+        queue->connecting = FALSE;
+        if (getsockopt(queue->fd, SOL_SOCKET, SO_ERROR, &rc, &len) < 0) {
+            rc = errno;
+        }
+        if (rc != 0) {
+            close(queue->fd);
+            queue->fd = -1;
+            goto bail;
+        }
+        goto connected;
+    }
+
+    if (queue->fd >= 0) {
+        return TRUE;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(queue->path) >= sizeof(addr.sun_path)) {
+        rc = ENAMETOOLONG;
+        goto bail;
+    }
+    strncpy(addr.sun_path, queue->path, sizeof(addr.sun_path) - 1);
+
+    queue->fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if (queue->fd < 0) {
+        rc = errno;
+        goto bail;
+    }
+
+    // A receiver that is slow to accept must not block the daemon
+    fcntl(queue->fd, F_SETFL, fcntl(queue->fd, F_GETFL) | O_NONBLOCK);
+    if (connect(queue->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        if (errno == EINPROGRESS) {
+            queue->connecting = TRUE; // Check again when retrying
+            return FALSE;
+        }
+        rc = errno;
+        close(queue->fd);
+        queue->fd = -1;
+        goto bail;
+    }
+
+connected:
+    // Resend anything interrupted by a lost connection
+    queue->written = 0;
+    if (queue->unreachable) {
+        crm_notice("Reconnected to receiver for alert %s at %s",
+                   queue->id, queue->path);
+        queue->unreachable = FALSE;
+    }
+    return TRUE;
+
+bail:
+    if (!queue->unreachable) {
+        crm_warn("Could not connect to receiver for alert %s at %s "
+                 "(will retry): %s", queue->id, queue->path,
+                 pcmk_strerror(rc));
+        queue->unreachable = TRUE;
+    }
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Write queued events to a receiver alert's socket
+ *
+ * \return TRUE if everything queued was written, otherwise FALSE
+ */
+static gboolean
+write_alert_receiver(struct alert_queue_s *queue)
+{
+    while (TRUE) {
+        if (queue->written == queue->output->len) {
+            GHashTable *event = NULL;
+
+            g_string_truncate(queue->output, 0);
+            queue->written = 0;
+            for (int count = 0; count < queue->batch_size; count++) {
+                event = g_queue_pop_head(queue->events);
+                if (event == NULL) {
+                    break;
+                }
+                add_event_line(queue->output, event);
+                g_hash_table_destroy(event);
+            }
+            if (queue->output->len == 0) {
+                return TRUE;
+            }
+        }
+
+        if (!connect_alert_receiver(queue)) {
+            return FALSE;
+        }
+
+        while (queue->written < queue->output->len) {
+            ssize_t rc = send(queue->fd, queue->output->str + queue->written,
+                              queue->output->len - queue->written,
+                              MSG_NOSIGNAL);
+
+            if (rc >= 0) {
+                queue->written += rc;
+
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return FALSE;
+
+            } else if (errno != EINTR) {
+                crm_warn("Lost connection to receiver for alert %s "
+                         "(will retry): %s", queue->id, pcmk_strerror(errno));
+                queue->unreachable = TRUE;
+                close(queue->fd);
+                queue->fd = -1;
+                return FALSE;
+            }
+        }
+    }
+}
+
+static gboolean
+alert_queue_timer_cb(gpointer user_data)
+{
+    struct alert_queue_s *queue = user_data;
+
+    queue->timer = 0;
+    if (queue->dropped > 0) {
+        crm_warn("Dropped %u events for alert %s because its queue was full",
+                 queue->dropped, queue->id);
+        queue->dropped = 0;
+    }
+
+    if (queue->delivery == crm_alert_deliver_receiver) {
+        if (!write_alert_receiver(queue)) {
+            queue->timer = pcmk__timeout_add(QB_MAX(queue->batch_delay, 100),
+                                             alert_queue_timer_cb, queue);
+        }
+    } else if (queue->call_id == 0) {
+        run_alert_batch(queue);
+    }
+    return FALSE;
+}
+
+// Arrange for an alert queue's events to be delivered
+static void
+schedule_alert_queue(struct alert_queue_s *queue)
+{
+    guint delay = queue->batch_delay;
+
+    if ((queue->timer != 0) || (queue->call_id != 0)
+        || (g_queue_is_empty(queue->events)
+            && (queue->written == queue->output->len))) {
+        return;
+    }
+
+    // Deliver a full batch now, unless a batch agent was run too recently
+    if (g_queue_get_length(queue->events) >= queue->batch_size) {
+        gint64 since = (g_get_monotonic_time() - queue->last_start) / 1000;
+
+        delay = (since >= queue->batch_delay)? 0 : (queue->batch_delay - since);
+        if (queue->delivery == crm_alert_deliver_receiver) {
+            delay = 0;
+        }
+    }
+    queue->timer = pcmk__timeout_add(delay, alert_queue_timer_cb, queue);
+}
+
+// Add an alert event to its alert's delivery queue
+static void
+queue_alert_event(const char *alert_id, const char *alert_path, int timeout,
+                  GHashTable *params)
+{
+    struct alert_queue_s *queue = get_alert_queue(alert_id, alert_path,
+                                                  timeout, params);
+
+    g_hash_table_remove(params, CRM_ALERT_META_DELIVERY);
+    g_hash_table_remove(params, CRM_ALERT_META_BATCH_DELAY);
+    g_hash_table_remove(params, CRM_ALERT_META_BATCH_SIZE);
+    g_hash_table_remove(params, CRM_ALERT_META_QUEUE_SIZE);
+
+    while (g_queue_get_length(queue->events) >= queue->queue_size) {
+        g_hash_table_destroy(g_queue_pop_head(queue->events));
+        queue->dropped++;
+    }
+    g_queue_push_tail(queue->events, params);
+    crm_trace("Queued event for alert %s (%u waiting)",
+              queue->id, g_queue_get_length(queue->events));
+    schedule_alert_queue(queue);
+}
+
 int
 process_lrmd_alert_exec(crm_client_t *client, uint32_t id, xmlNode *request)
 {
@@ -106,6 +558,11 @@ process_lrmd_alert_exec(crm_client_t *client, uint32_t id, xmlNode *request)
     crm_insert_alert_key_int(params, CRM_alert_node_sequence,
                              ++alert_sequence_no);
 
+    if (g_hash_table_lookup(params, CRM_ALERT_META_DELIVERY) != NULL) {
+        queue_alert_event(alert_id, alert_path, alert_timeout, params);
+        return pcmk_ok;
+    }
+
     cb_data = calloc(1, sizeof(struct alert_cb_s));
     CRM_CHECK(cb_data != NULL,
               rc = -ENOMEM; goto err);
@@ -159,8 +616,28 @@ lrmd_drain_alerts(GMainContext *ctx)
     int timer_ms;
 
     draining_alerts = TRUE;
+
+    // Deliver whatever is queued now, rather than waiting for batch delays
+    if (alert_queues != NULL) {
+        GHashTableIter iter;
+        struct alert_queue_s *queue = NULL;
+
+        g_hash_table_iter_init(&iter, alert_queues);
+        while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &queue)) {
+            if (queue->timer) {
+                pcmk__timeout_remove(queue->timer);
+                queue->timer = 0;
+            }
+            if (queue->delivery == crm_alert_deliver_receiver) {
+                write_alert_receiver(queue);
+            } else if (queue->call_id == 0) {
+                run_alert_batch(queue);
+            }
+        }
+    }
+
     if (inflight_alerts == NULL) {
-        return;
+        goto done;
     }
 
     timer_ms = max_inflight_timeout() + 5000;
@@ -183,4 +660,10 @@ lrmd_drain_alerts(GMainContext *ctx)
 
     g_hash_table_destroy(inflight_alerts);
     inflight_alerts = NULL;
+
+done:
+    if (alert_queues != NULL) {
+        g_hash_table_destroy(alert_queues);
+        alert_queues = NULL;
+    }
 }
@@ -72,6 +72,10 @@ typedef struct lrmd_cmd_s {
     int last_notify_op_status;
     int last_pid;
 
+    gboolean has_slot;      /* Whether this counts against its class's limit */
+    int exec_class;         /* Class whose limit this counts against */
+    GList *probe_sharers;   /* Probes waiting to be given this one's result */
+
     GHashTable *params;
 } lrmd_cmd_t;
 
@@ -79,6 +83,293 @@ static void cmd_finalize(lrmd_cmd_t * cmd, lrmd_rsc_t * rsc);
 static gboolean lrmd_rsc_dispatch(gpointer user_data);
 static void cancel_all_recurring(lrmd_rsc_t * rsc, const char *client_id);
 
+/*
+ * Execution classes
+ *
+ * Each resource's commands run one at a time, from its own queue, but when a
+ * node is busy (recovering many resources, say, while every resource's
+ * monitors start), what matters is which resource's command runs first. So
+ * commands are divided into classes, in order of priority: anything for a
+ * fence device, stops, starts (and anything else that changes a resource's
+ * state), probes, and the first run of recurring monitors.
+ *
+ * Each class may be limited to a number of commands running at once, by
+ * PCMK_<class>_limit: by default, probes and monitors are limited to four per
+ * processor, and other classes are not limited (fence device commands never
+ * are). A command that would go over its class's limit waits in its
+ * resource's queue, and so does any command while a command of a higher
+ * priority class is waiting, so monitors can never hold up recovery.
+ * Whenever a limited command finishes, every waiting resource tries again.
+ * (Repeats of recurring monitors are paced by the services library instead,
+ * using PCMK_recurring_limit.)
+ *
+ * In addition, agents of the service classes (lsb, systemd, upstart and
+ * service) get no parameters and are not told which resource they are run
+ * for, so a probe of one gives the result of a probe of any resource using
+ * the same agent. A probe that would run such an agent while another probe is
+ * running it waits for that one's result instead.
+ */
+
+enum exec_class {
+    exec_class_fencing,
+    exec_class_stop,
+    exec_class_start,
+    exec_class_probe,
+    exec_class_monitor,
+    exec_class_max      // not a class, only the number of classes
+};
+
+struct exec_class_s {
+    const char *name;
+    int limit;              // -1 until known, 0 for none
+    int cores_default;      // default limit per processor (0 for none)
+    unsigned int running;
+    GList *waiters;         // IDs of resources waiting to run a command
+};
+
+static struct exec_class_s exec_classes[exec_class_max] = {
+    { "fencing", 0, 0, 0, NULL },
+    { "stop", -1, 0, 0, NULL },
+    { "start", -1, 0, 0, NULL },
+    { "probe", -1, 4, 0, NULL },
+    { "monitor", -1, 4, 0, NULL },
+};
+
+static GHashTable *shared_probes = NULL;    // agent -> probe running it
+
+static gboolean
+is_probe(lrmd_cmd_t *cmd)
+{
+    return (cmd->interval_ms == 0) && (cmd->real_action == NULL)
+           && safe_str_eq(cmd->action, "monitor");
+}
+
+static enum exec_class
+cmd_exec_class(lrmd_rsc_t *rsc, lrmd_cmd_t *cmd)
+{
+    // For systemd's follow-up monitors, real_action is what is being waited for
+    const char *action = cmd->real_action? cmd->real_action : cmd->action;
+
+    if (safe_str_eq(rsc->class, PCMK_RESOURCE_CLASS_STONITH)) {
+        return exec_class_fencing;
+    } else if (safe_str_eq(action, "stop")) {
+        return exec_class_stop;
+    } else if (is_probe(cmd)) {
+        return exec_class_probe;
+    } else if (safe_str_eq(action, "monitor") && (cmd->interval_ms > 0)) {
+        return exec_class_monitor;
+    }
+    return exec_class_start;
+}
+
+static int
+exec_class_limit(enum exec_class c)
+{
+    struct exec_class_s *class = &exec_classes[c];
+
+    if (class->limit < 0) {
+        char *option = crm_strdup_printf("%s_limit", class->name);
+        const char *value = daemon_option(option);
+
+        if (value == NULL) {
+            class->limit = class->cores_default * crm_procfs_num_cores();
+        } else {
+            class->limit = crm_parse_int(value, "0");
+        }
+        if (class->limit < 0) {
+            class->limit = 0;
+        }
+        crm_debug("Running at most %d %s commands at once (0 means unlimited)",
+                  class->limit, class->name);
+        free(option);
+    }
+    return class->limit;
+}
+
+/* Key identifying the agent of a probe whose result may be shared, or NULL */
+static char *
+probe_share_key(lrmd_rsc_t *rsc)
+{
+    if (safe_str_eq(rsc->class, PCMK_RESOURCE_CLASS_LSB)
+        || safe_str_eq(rsc->class, PCMK_RESOURCE_CLASS_SYSTEMD)
+        || safe_str_eq(rsc->class, PCMK_RESOURCE_CLASS_UPSTART)
+        || safe_str_eq(rsc->class, PCMK_RESOURCE_CLASS_SERVICE)) {
+        return crm_strdup_printf("%s:%s", rsc->class, rsc->type);
+    }
+    return NULL;
+}
+
+static gboolean
+probe_is_shared(lrmd_rsc_t *rsc)
+{
+    char *key = NULL;
+    gboolean shared = FALSE;
+
+    if (shared_probes != NULL) {
+        key = probe_share_key(rsc);
+        shared = (key != NULL)
+                 && (g_hash_table_lookup(shared_probes, key) != NULL);
+        free(key);
+    }
+    return shared;
+}
+
+/*!
+ * \internal
+ * \brief Check whether a resource's next command must wait to run
+ *
+ * \param[in] rsc  Resource to check
+ * \param[in] cmd  Resource's next command
+ *
+ * \return TRUE if \p cmd must wait (\p rsc will be dispatched again when a
+ *         command finishes), otherwise FALSE
+ */
+static gboolean
+exec_must_wait(lrmd_rsc_t *rsc, lrmd_cmd_t *cmd)
+{
+    enum exec_class c = cmd_exec_class(rsc, cmd);
+    struct exec_class_s *class = &exec_classes[c];
+    const char *reason = NULL;
+
+    for (int higher = 0; higher < c; higher++) {
+        if (exec_classes[higher].waiters != NULL) {
+            reason = exec_classes[higher].name;
+            break;
+        }
+    }
+
+    if ((reason == NULL) && (exec_class_limit(c) > 0)
+        && (class->running >= (unsigned int) class->limit)
+        && !((c == exec_class_probe) && probe_is_shared(rsc))) {
+        reason = class->name;
+    }
+
+    if (reason == NULL) {
+        return FALSE;
+    }
+
+    if (g_list_find_custom(class->waiters, rsc->rsc_id,
+                           (GCompareFunc) strcmp) == NULL) {
+        class->waiters = g_list_append(class->waiters, strdup(rsc->rsc_id));
+    }
+    crm_trace("%s %s must wait for %s commands (%u %s running)",
+              cmd->rsc_id, cmd->action, reason, class->running, class->name);
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Start accounting for a command that is about to run
+ *
+ * \param[in] rsc  Resource command is for
+ * \param[in] cmd  Command
+ *
+ * \return TRUE if \p cmd will instead get the result of an identical probe
+ *         already running (and so must not be executed), otherwise FALSE
+ */
+static gboolean
+exec_start(lrmd_rsc_t *rsc, lrmd_cmd_t *cmd)
+{
+    enum exec_class c = cmd_exec_class(rsc, cmd);
+    char *key = (c == exec_class_probe)? probe_share_key(rsc) : NULL;
+
+    if (key != NULL) {
+        lrmd_cmd_t *running = NULL;
+
+        if (shared_probes == NULL) {
+            shared_probes = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                  free, NULL);
+        }
+        running = g_hash_table_lookup(shared_probes, key);
+        if (running != NULL) {
+            crm_debug("Probe of %s will use result of probe of %s (%s)",
+                      rsc->rsc_id, running->rsc_id, key);
+            running->probe_sharers = g_list_append(running->probe_sharers, cmd);
+            free(key);
+            return TRUE;
+        }
+        g_hash_table_insert(shared_probes, key, cmd);
+    }
+
+    cmd->exec_class = c;
+    cmd->has_slot = TRUE;
+    exec_classes[c].running++;
+    return FALSE;
+}
+
+/* Stop remembering that a resource (about to be freed) is waiting */
+static void
+exec_forget_waiter(lrmd_rsc_t *rsc)
+{
+    for (int c = 0; c < exec_class_max; c++) {
+        GList *iter = g_list_find_custom(exec_classes[c].waiters, rsc->rsc_id,
+                                         (GCompareFunc) strcmp);
+
+        if (iter != NULL) {
+            free(iter->data);
+            exec_classes[c].waiters = g_list_delete_link(exec_classes[c].waiters,
+                                                         iter);
+        }
+    }
+}
+
+static gboolean
+shared_probe_matches(gpointer key, gpointer value, gpointer user_data)
+{
+    return value == user_data;
+}
+
+/*!
+ * \internal
+ * \brief Stop accounting for a command, and let waiting resources try again
+ *
+ * \param[in] cmd  Command that finished (or will be rescheduled)
+ */
+static void
+exec_finished(lrmd_cmd_t *cmd)
+{
+    GList *sharers = cmd->probe_sharers;
+
+    if (!cmd->has_slot) {
+        return;
+    }
+    cmd->has_slot = FALSE;
+    cmd->probe_sharers = NULL;
+    exec_classes[cmd->exec_class].running--;
+
+    if ((cmd->exec_class == exec_class_probe) && (shared_probes != NULL)) {
+        g_hash_table_foreach_remove(shared_probes, shared_probe_matches, cmd);
+    }
+
+    for (GList *iter = sharers; iter != NULL; iter = iter->next) {
+        lrmd_cmd_t *sharer = iter->data;
+
+        sharer->exec_rc = cmd->exec_rc;
+        sharer->lrmd_op_status = cmd->lrmd_op_status;
+        sharer->output = cmd->output? strdup(cmd->output) : NULL;
+        sharer->exit_reason = cmd->exit_reason? strdup(cmd->exit_reason) : NULL;
+        cmd_finalize(sharer, g_hash_table_lookup(rsc_list, sharer->rsc_id));
+    }
+    g_list_free(sharers);
+
+    /* Let every waiting resource try again, highest priority first; any that
+     * still cannot run will wait again
+     */
+    for (int c = 0; c < exec_class_max; c++) {
+        GList *waiters = exec_classes[c].waiters;
+
+        exec_classes[c].waiters = NULL;
+        for (GList *iter = waiters; iter != NULL; iter = iter->next) {
+            lrmd_rsc_t *rsc = g_hash_table_lookup(rsc_list, iter->data);
+
+            if (rsc != NULL) {
+                mainloop_set_trigger(rsc->work);
+            }
+        }
+        g_list_free_full(waiters, free);
+    }
+}
+
 static void
 log_finished(lrmd_cmd_t * cmd, int exec_time, int queue_time)
 {
@@ -147,11 +438,23 @@ build_rsc_from_xml(xmlNode * msg)
     return rsc;
 }
 
+static bool
+recurring_output_wanted(void)
+{
+    static int wanted = -1;
+
+    if (wanted < 0) {
+        const char *value = daemon_option("recurring_output");
+
+        wanted = (value == NULL) || crm_is_true(value);
+    }
+    return wanted;
+}
+
 static lrmd_cmd_t *
-create_lrmd_cmd(xmlNode * msg, crm_client_t * client)
+create_lrmd_cmd(xmlNode *msg, xmlNode *rsc_xml, crm_client_t *client)
 {
     int call_options = 0;
-    xmlNode *rsc_xml = get_xpath_object("//" F_LRMD_RSC, msg, LOG_ERR);
     lrmd_cmd_t *cmd = NULL;
 
     cmd = calloc(1, sizeof(lrmd_cmd_t));
@@ -178,6 +481,13 @@ create_lrmd_cmd(xmlNode * msg, crm_client_t * client)
                   cmd->rsc_id, cmd->action, cmd->interval_ms);
         cmd->service_flags |= SVC_ACTION_LEAVE_GROUP;
     }
+
+    /* A recurring monitor's stdout is only ever logged (and its exit reason
+     * comes from stderr), so it can be thrown away as it is read
+     */
+    if ((cmd->interval_ms > 0) && !recurring_output_wanted()) {
+        cmd->service_flags |= SVC_ACTION_DISCARD_OUTPUT;
+    }
     return cmd;
 }
 
@@ -185,13 +495,13 @@ static void
 free_lrmd_cmd(lrmd_cmd_t * cmd)
 {
     if (cmd->stonith_recurring_id) {
-        g_source_remove(cmd->stonith_recurring_id);
+        pcmk__timeout_remove(cmd->stonith_recurring_id);
     }
     if (cmd->delay_id) {
         g_source_remove(cmd->delay_id);
     }
     if (cmd->params) {
-        g_hash_table_destroy(cmd->params);
+        g_hash_table_unref(cmd->params); // may still be used by an action
     }
     free(cmd->origin);
     free(cmd->action);
@@ -302,7 +612,7 @@ merge_dup:
     if (safe_str_eq(rsc->class, PCMK_RESOURCE_CLASS_STONITH)) {
         /* if we are waiting for the next interval, kick it off now */
         if (dup_pending == TRUE) {
-            g_source_remove(cmd->stonith_recurring_id);
+            pcmk__timeout_remove(cmd->stonith_recurring_id);
             cmd->stonith_recurring_id = 0;
             stonith_recurring_op_helper(cmd);
         }
@@ -368,7 +678,7 @@ create_lrmd_reply(const char *origin, int rc, int call_id)
 static void
 send_client_notify(gpointer key, gpointer value, gpointer user_data)
 {
-    xmlNode *update_msg = user_data;
+    pcmk__fanout_t *fanout = user_data;
     crm_client_t *client = value;
     int rc;
 
@@ -380,7 +690,7 @@ send_client_notify(gpointer key, gpointer value, gpointer user_data)
         return;
     }
 
-    rc = lrmd_server_send_notify(client, update_msg);
+    rc = lrmd_server_send_fanout(client, fanout);
     if ((rc <= 0) && (rc != -ENOTCONN)) {
         crm_warn("Could not notify client %s/%s: %s " CRM_XS " rc=%d",
                  client->name, client->id,
@@ -447,6 +757,7 @@ send_cmd_complete_notify(lrmd_cmd_t * cmd)
     int exec_time = 0;
     int queue_time = 0;
     xmlNode *notify = NULL;
+    pcmk__fanout_t *fanout = NULL;
 
 #ifdef HAVE_SYS_TIMEB_H
     exec_time = time_diff_ms(NULL, &cmd->t_run);
@@ -472,6 +783,16 @@ send_cmd_complete_notify(lrmd_cmd_t * cmd)
     cmd->last_notify_rc = cmd->exec_rc;
     cmd->last_notify_op_status = cmd->lrmd_op_status;
 
+    if (pcmk__trace_active && (cmd->lrmd_op_status != PCMK_LRM_OP_CANCELLED)
+        && ((cmd->exec_rc != PCMK_OCF_OK)
+            || (cmd->lrmd_op_status != PCMK_LRM_OP_DONE))) {
+        char span[PCMK__TRACE_TAG_LEN];
+
+        pcmk__trace_span_id(span, cmd->rsc_id, cmd->call_id);
+        pcmk__trace_event(pcmk__trace_recovery_hop, pcmk__hop_op_failed,
+                          cmd->exec_rc, span);
+    }
+
     notify = create_xml_node(NULL, T_LRMD_NOTIFY);
 
     crm_xml_add(notify, F_LRMD_ORIGIN, __FUNCTION__);
@@ -513,16 +834,21 @@ send_cmd_complete_notify(lrmd_cmd_t * cmd)
             hash2smartfield((gpointer) key, (gpointer) value, args);
         }
     }
-    if (cmd->client_id && (cmd->call_opts & lrmd_opt_notify_orig_only)) {
+    fanout = lrmd_notify_fanout_new(notify);
+    if (fanout == NULL) {
+        crm_err("Could not notify clients: notification not serializable");
+
+    } else if (cmd->client_id && (cmd->call_opts & lrmd_opt_notify_orig_only)) {
         crm_client_t *client = crm_client_get_by_id(cmd->client_id);
 
         if (client) {
-            send_client_notify(client->id, client, notify);
+            send_client_notify(client->id, client, fanout);
         }
     } else if (client_connections != NULL) {
-        g_hash_table_foreach(client_connections, send_client_notify, notify);
+        g_hash_table_foreach(client_connections, send_client_notify, fanout);
     }
 
+    pcmk__fanout_free(fanout);
     free_xml(notify);
 }
 
@@ -532,6 +858,7 @@ send_generic_notify(int rc, xmlNode * request)
     if (client_connections != NULL) {
         int call_id = 0;
         xmlNode *notify = NULL;
+        pcmk__fanout_t *fanout = NULL;
         xmlNode *rsc_xml = get_xpath_object("//" F_LRMD_RSC, request, LOG_ERR);
         const char *rsc_id = crm_element_value(rsc_xml, F_LRMD_RSC_ID);
         const char *op = crm_element_value(request, F_LRMD_OPERATION);
@@ -545,8 +872,12 @@ send_generic_notify(int rc, xmlNode * request)
         crm_xml_add(notify, F_LRMD_OPERATION, op);
         crm_xml_add(notify, F_LRMD_RSC_ID, rsc_id);
 
-        g_hash_table_foreach(client_connections, send_client_notify, notify);
-
+        fanout = lrmd_notify_fanout_new(notify);
+        if (fanout != NULL) {
+            g_hash_table_foreach(client_connections, send_client_notify,
+                                 fanout);
+            pcmk__fanout_free(fanout);
+        }
         free_xml(notify);
     }
 }
@@ -573,6 +904,8 @@ cmd_finalize(lrmd_cmd_t * cmd, lrmd_rsc_t * rsc)
     crm_trace("Resource operation rsc:%s action:%s completed (%p %p)", cmd->rsc_id, cmd->action,
               rsc ? rsc->active : NULL, cmd);
 
+    exec_finished(cmd);
+
     if (rsc && (rsc->active == cmd)) {
         rsc->active = NULL;
         mainloop_set_trigger(rsc->work);
@@ -882,6 +1215,7 @@ action_complete(svc_action_t * action)
                            cmd->rsc_id, cmd->action, services_ocf_exitcode_str(cmd->exec_rc), cmd->exec_rc, time_sum, timeout_left, delay);
             }
 
+            exec_finished(cmd);
             cmd_reset(cmd);
             if(rsc) {
                 rsc->active = NULL;
@@ -965,11 +1299,11 @@ stonith_action_complete(lrmd_cmd_t * cmd, int rc)
 
     if (recurring && rsc) {
         if (cmd->stonith_recurring_id) {
-            g_source_remove(cmd->stonith_recurring_id);
+            pcmk__timeout_remove(cmd->stonith_recurring_id);
         }
-        cmd->stonith_recurring_id = g_timeout_add(cmd->interval_ms,
-                                                  stonith_recurring_op_helper,
-                                                  cmd);
+        cmd->stonith_recurring_id = pcmk__timeout_add(cmd->interval_ms,
+                                                      stonith_recurring_op_helper,
+                                                      cmd);
     }
 
     cmd_finalize(cmd, rsc);
@@ -981,6 +1315,116 @@ lrmd_stonith_callback(stonith_t * stonith, stonith_callback_data_t * data)
     stonith_action_complete(data->userdata, data->rc);
 }
 
+/*
+ * Batched fence device monitors
+ *
+ * Recurring monitors of fence devices that become due in the same main loop
+ * iteration (as they usually do for devices that were started together) are
+ * sent to the fencer as a single request, which gets a single reply with each
+ * device's result, rather than as one request and reply per device.
+ */
+
+// Recurring monitors waiting to be sent to the fencer
+static GList *pending_monitors = NULL;
+
+// GList of commands for each batch sent but not yet replied to
+static GList *active_monitor_batches = NULL;
+
+static crm_trigger_t *monitor_trigger = NULL;
+
+static void
+lrmd_stonith_batch_callback(stonith_t *stonith, stonith_callback_data_t *data)
+{
+    GList *cmds = data->userdata;
+
+    active_monitor_batches = g_list_remove(active_monitor_batches, cmds);
+    for (GList *iter = cmds; iter != NULL; iter = iter->next) {
+        lrmd_cmd_t *cmd = iter->data;
+
+        stonith_action_complete(cmd, stonith_monitor_batch_rc(data, cmd->rsc_id));
+    }
+    g_list_free(cmds);
+}
+
+static int
+stonith_monitor_one(stonith_t *stonith_api, lrmd_cmd_t *cmd)
+{
+    int rc = stonith_api->cmds->monitor(stonith_api, 0, cmd->rsc_id,
+                                        cmd->timeout / 1000);
+
+    rc = stonith_api->cmds->register_callback(stonith_api,
+                                              rc,
+                                              0,
+                                              0,
+                                              cmd, "lrmd_stonith_callback", lrmd_stonith_callback);
+    return (rc == 0)? -1 : rc;
+}
+
+static int
+send_pending_monitors(gpointer user_data)
+{
+    GList *cmds = pending_monitors;
+    stonith_t *stonith_api = get_stonith_connection();
+    stonith_key_value_t *devices = NULL;
+    int timeout = 0;
+    int rc = 0;
+
+    pending_monitors = NULL;
+    if (cmds == NULL) {
+        return TRUE;
+    }
+
+    if (stonith_api == NULL) {
+        for (GList *iter = cmds; iter != NULL; iter = iter->next) {
+            stonith_action_complete(iter->data, -ENOTCONN);
+        }
+        g_list_free(cmds);
+        return TRUE;
+    }
+
+    if (cmds->next == NULL) {
+        lrmd_cmd_t *cmd = cmds->data;
+
+        g_list_free(cmds);
+        rc = stonith_monitor_one(stonith_api, cmd);
+        if (rc <= 0) {
+            stonith_action_complete(cmd, rc);
+        }
+        return TRUE;
+    }
+
+    for (GList *iter = cmds; iter != NULL; iter = iter->next) {
+        lrmd_cmd_t *cmd = iter->data;
+
+        devices = stonith_key_value_add(devices, cmd->rsc_id, NULL);
+        timeout = QB_MAX(timeout, cmd->timeout);
+    }
+    crm_trace("Monitoring %d fence devices at once", g_list_length(cmds));
+
+    rc = stonith_api->cmds->monitor_batch(stonith_api, 0, devices,
+                                          timeout / 1000);
+    stonith_key_value_freeall(devices, 1, 1);
+
+    // On failure, register_callback() calls the callback immediately
+    active_monitor_batches = g_list_prepend(active_monitor_batches, cmds);
+    stonith_api->cmds->register_callback(stonith_api, rc, 0, 0, cmds,
+                                         "lrmd_stonith_batch_callback",
+                                         lrmd_stonith_batch_callback);
+    return TRUE;
+}
+
+static void
+queue_stonith_monitor(lrmd_cmd_t *cmd)
+{
+    if (monitor_trigger == NULL) {
+        monitor_trigger = mainloop_add_trigger(G_PRIORITY_LOW,
+                                               send_pending_monitors, NULL);
+        pcmk__trigger_set_name(monitor_trigger, "fence device monitors");
+    }
+    pending_monitors = g_list_append(pending_monitors, cmd);
+    mainloop_set_trigger(monitor_trigger);
+}
+
 void
 stonith_connection_failed(void)
 {
@@ -990,6 +1434,12 @@ stonith_connection_failed(void)
     lrmd_rsc_t *rsc = NULL;
     char *key = NULL;
 
+    // Any such commands are active, so they are finalized below
+    g_list_free(pending_monitors);
+    pending_monitors = NULL;
+    g_list_free_full(active_monitor_batches, (GDestroyNotify) g_list_free);
+    active_monitor_batches = NULL;
+
     g_hash_table_iter_init(&iter, rsc_list);
     while (g_hash_table_iter_next(&iter, (gpointer *) & key, (gpointer *) & rsc)) {
         if (safe_str_eq(rsc->class, PCMK_RESOURCE_CLASS_STONITH)) {
@@ -1078,20 +1528,18 @@ lrmd_rsc_execute_stonith(lrmd_rsc_t * rsc, lrmd_cmd_t * cmd)
         goto cleanup_stonith_exec;
     }
 
-    rc = stonith_api->cmds->monitor(stonith_api, 0, cmd->rsc_id, cmd->timeout / 1000);
+    if (cmd->interval_ms > 0) {
+        // rsc->active is already cmd, which will be completed once sent
+        queue_stonith_monitor(cmd);
+        return pcmk_ok;
+    }
 
-    rc = stonith_api->cmds->register_callback(stonith_api,
-                                              rc,
-                                              0,
-                                              0,
-                                              cmd, "lrmd_stonith_callback", lrmd_stonith_callback);
+    rc = stonith_monitor_one(stonith_api, cmd);
 
     /* don't cleanup yet, we will find out the result of the monitor later */
     if (rc > 0) {
         rsc->active = cmd;
         return rc;
-    } else if (rc == 0) {
-        rc = -1;
     }
 
   cleanup_stonith_exec:
@@ -1103,7 +1551,7 @@ static int
 lrmd_rsc_execute_service_lib(lrmd_rsc_t * rsc, lrmd_cmd_t * cmd)
 {
     svc_action_t *action = NULL;
-    GHashTable *params_copy = NULL;
+    GHashTable *params = NULL;
 
     CRM_ASSERT(rsc);
     CRM_ASSERT(cmd);
@@ -1121,13 +1569,16 @@ lrmd_rsc_execute_service_lib(lrmd_rsc_t * rsc, lrmd_cmd_t * cmd)
     }
 #endif
 
-    params_copy = crm_str_table_dup(cmd->params);
+    /* The parameters are never modified once parsed (secrets are substituted
+     * in the agent's process), so the action can share the table
+     */
+    params = cmd->params? g_hash_table_ref(cmd->params) : NULL;
 
     action = resources_action_create(rsc->rsc_id, rsc->class, rsc->provider,
                                      rsc->type,
                                      normalize_action_name(rsc, cmd->action),
                                      cmd->interval_ms, cmd->timeout,
-                                     params_copy, cmd->service_flags);
+                                     params, cmd->service_flags);
 
     if (!action) {
         crm_err("Failed to create action, action:%s on resource %s", cmd->action, rsc->rsc_id);
@@ -1183,6 +1634,9 @@ lrmd_rsc_execute(lrmd_rsc_t * rsc)
                  cmd->rsc_id, cmd->action, cmd->start_delay);
             return TRUE;
         }
+        if (exec_must_wait(rsc, cmd)) {
+            return TRUE;
+        }
         rsc->pending_ops = g_list_remove_link(rsc->pending_ops, first);
         g_list_free_1(first);
 
@@ -1206,6 +1660,10 @@ lrmd_rsc_execute(lrmd_rsc_t * rsc)
 
     log_execute(cmd);
 
+    if (exec_start(rsc, cmd)) {
+        return TRUE;
+    }
+
     if (safe_str_eq(rsc->class, PCMK_RESOURCE_CLASS_STONITH)) {
         lrmd_rsc_execute_stonith(rsc, cmd);
     } else {
@@ -1221,6 +1679,33 @@ lrmd_rsc_dispatch(gpointer user_data)
     return lrmd_rsc_execute(user_data);
 }
 
+/*!
+ * \internal
+ * \brief Update the executor's queue metrics (for pcmk__metrics_text())
+ */
+void
+execd_collect_metrics(void)
+{
+    GHashTableIter iter;
+    lrmd_rsc_t *rsc = NULL;
+    unsigned int pending = 0;
+    unsigned int active = 0;
+
+    g_hash_table_iter_init(&iter, rsc_list);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &rsc)) {
+        pending += g_list_length(rsc->pending_ops);
+        if (rsc->active != NULL) {
+            active++;
+        }
+    }
+    pcmk__metric_set(pcmk__metric(pcmk__metric_gauge, "executor_queued_ops",
+                                  "Operations waiting to be executed",
+                                  NULL, NULL), pending);
+    pcmk__metric_set(pcmk__metric(pcmk__metric_gauge, "executor_active_ops",
+                                  "Operations being executed", NULL, NULL),
+                     active);
+}
+
 void
 free_rsc(gpointer data)
 {
@@ -1271,6 +1756,7 @@ free_rsc(gpointer data)
     /* frees list, but not list elements. */
     g_list_free(rsc->recurring_ops);
 
+    exec_forget_waiter(rsc);
     free(rsc->rsc_id);
     free(rsc->class);
     free(rsc->provider);
@@ -1302,7 +1788,10 @@ process_lrmd_signon(crm_client_t *client, xmlNode *request, int call_id)
     if (crm_is_true(is_ipc_provider)) {
         // This is a remote connection from a cluster node's controller
 #ifdef SUPPORT_REMOTE
-        ipc_proxy_add_provider(client);
+        ipc_proxy_add_provider(client,
+                               (compare_version(protocol_version,
+                                                LRMD_PROXY_BATCH_PROTOCOL_VERSION)
+                                >= 0));
 #endif
     }
     return reply;
@@ -1410,7 +1899,7 @@ process_lrmd_rsc_exec(crm_client_t * client, uint32_t id, xmlNode * request)
         return -ENODEV;
     }
 
-    cmd = create_lrmd_cmd(request, client);
+    cmd = create_lrmd_cmd(request, rsc_xml, client);
     call_id = cmd->call_id;
 
     /* Don't reference cmd after handing it off to be scheduled.
@@ -1420,6 +1909,66 @@ process_lrmd_rsc_exec(crm_client_t * client, uint32_t id, xmlNode * request)
     return call_id;
 }
 
+/*!
+ * \internal
+ * \brief Schedule each operation in a batch execution request
+ *
+ * \param[in] client   Client that sent request
+ * \param[in] request  Request XML
+ * \param[in] call_id  Call ID assigned to request (used for first operation)
+ *
+ * \return Reply with one result (call ID or error) per operation, in order
+ */
+static xmlNode *
+process_lrmd_rsc_exec_batch(crm_client_t *client, xmlNode *request,
+                            int call_id)
+{
+    xmlNode *batch = get_xpath_object("//" F_LRMD_BATCH, request, LOG_ERR);
+    xmlNode *reply = create_lrmd_reply(__FUNCTION__, pcmk_ok, call_id);
+    int n_ops = 0;
+
+    for (xmlNode *rsc_xml = first_named_child(batch, F_LRMD_RSC);
+         rsc_xml != NULL; rsc_xml = crm_next_same_xml(rsc_xml)) {
+
+        const char *rsc_id = crm_element_value(rsc_xml, F_LRMD_RSC_ID);
+        xmlNode *result = create_xml_node(reply, F_LRMD_RSC);
+        lrmd_rsc_t *rsc = NULL;
+        lrmd_cmd_t *cmd = NULL;
+        int rc = 0;
+
+        crm_xml_add(result, F_LRMD_RSC_ID, rsc_id);
+
+        if (rsc_id == NULL) {
+            rc = -EINVAL;
+
+        } else if ((rsc = g_hash_table_lookup(rsc_list, rsc_id)) == NULL) {
+            crm_info("Resource '%s' not found (%d active resources)",
+                     rsc_id, g_hash_table_size(rsc_list));
+            rc = -ENODEV;
+
+        } else {
+            cmd = create_lrmd_cmd(request, rsc_xml, client);
+
+            // Each operation after the first gets a call ID of its own
+            if (n_ops > 0) {
+                lrmd_call_id++;
+                if (lrmd_call_id < 1) {
+                    lrmd_call_id = 1;
+                }
+                cmd->call_id = lrmd_call_id;
+            }
+            rc = cmd->call_id;
+            n_ops++;
+            schedule_lrmd_cmd(rsc, cmd);
+        }
+        crm_xml_add_int(result, F_LRMD_CALLID, rc);
+    }
+
+    crm_debug("Scheduled %d operation%s from %s in one request",
+              n_ops, ((n_ops == 1)? "" : "s"), client->name);
+    return reply;
+}
+
 static int
 cancel_op(const char *rsc_id, const char *action, guint interval_ms)
 {
@@ -1639,6 +2188,9 @@ process_lrmd_message(crm_client_t * client, uint32_t id, xmlNode * request)
     } else if (crm_str_eq(op, LRMD_OP_RSC_EXEC, TRUE)) {
         rc = process_lrmd_rsc_exec(client, id, request);
         do_reply = 1;
+    } else if (crm_str_eq(op, LRMD_OP_RSC_EXEC_BATCH, TRUE)) {
+        reply = process_lrmd_rsc_exec_batch(client, request, call_id);
+        do_reply = 1;
     } else if (crm_str_eq(op, LRMD_OP_RSC_CANCEL, TRUE)) {
         rc = process_lrmd_rsc_cancel(client, id, request);
         do_reply = 1;
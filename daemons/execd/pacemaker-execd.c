@@ -20,6 +20,7 @@
 #include <crm/common/mainloop.h>
 #include <crm/common/ipc.h>
 #include <crm/common/ipcs.h>
+#include <crm/cluster/internal.h>
 
 #include "pacemaker-execd.h"
 
@@ -251,6 +252,59 @@ lrmd_server_send_notify(crm_client_t * client, xmlNode * msg)
     return -ENOTCONN;
 }
 
+/*!
+ * \internal
+ * \brief Send a notification serialized once to a client
+ *
+ * \param[in]     client  Client to notify
+ * \param[in,out] fanout  Notification, as prepared by lrmd_notify_fanout_new()
+ *
+ * \return Bytes sent or queued on success, -errno otherwise
+ */
+int
+lrmd_server_send_fanout(crm_client_t *client, pcmk__fanout_t *fanout)
+{
+    crm_trace("Sending notification to client (%s)", client->id);
+    switch (client->kind) {
+        case CRM_CLIENT_IPC:
+            if (client->ipcs == NULL) {
+                crm_trace("Could not notify local client: disconnected");
+                return -ENOTCONN;
+            }
+            return pcmk__ipcs_send_fanout(client, fanout, crm_ipc_server_event);
+#ifdef ENABLE_PCMK_REMOTE
+        case CRM_CLIENT_TLS:
+            if (client->remote == NULL) {
+                crm_trace("Could not notify remote client: disconnected");
+                return -ENOTCONN;
+            }
+            return pcmk__remote_send_fanout(client->remote, fanout);
+#endif
+        default:
+            crm_err("Could not notify client: unknown type %d", client->kind);
+    }
+    return -ENOTCONN;
+}
+
+/*!
+ * \internal
+ * \brief Serialize a notification once for all clients
+ *
+ * \param[in,out] msg  Notification to serialize
+ *
+ * \return Newly allocated fan-out (free with pcmk__fanout_free()), or NULL
+ *         if \p msg could not be serialized
+ * \note This adds the fields that remote clients expect to \p msg (which
+ *       local clients ignore), so that the same text can go to either kind.
+ */
+pcmk__fanout_t *
+lrmd_notify_fanout_new(xmlNode *msg)
+{
+    crm_xml_add_int(msg, F_LRMD_REMOTE_MSG_ID, 0);
+    crm_xml_add(msg, F_LRMD_REMOTE_MSG_TYPE, "notify");
+    return pcmk__fanout_new(msg);
+}
+
 /*!
  * \internal
  * \brief Clean up and exit immediately
@@ -560,6 +614,7 @@ main(int argc, char **argv, char **envp)
     }
 
     crm_log_init(NULL, LOG_INFO, TRUE, FALSE, argc, argv, FALSE);
+    pcmk__mainloop_use_scalable();
 
     while (bump_log_num > 0) {
         crm_bump_log_level(argc, argv);
@@ -590,6 +645,7 @@ main(int argc, char **argv, char **envp)
     crm_build_path(CRM_RSCTMP_DIR, 0755);
 
     rsc_list = g_hash_table_new_full(crm_str_hash, g_str_equal, NULL, free_rsc);
+    pcmk__metrics_add_collector(execd_collect_metrics);
     ipcs = mainloop_add_ipc_server(CRM_SYSTEM_LRMD, QB_IPC_SHM, &lrmd_ipc_callbacks);
     if (ipcs == NULL) {
         crm_err("Failed to create IPC server: shutting down and inhibiting respawn");
@@ -602,6 +658,8 @@ main(int argc, char **argv, char **envp)
         crm_exit(CRM_EX_FATAL);
     }
     ipc_proxy_init();
+#else
+    pcmk__notify_ready(crm_proc_execd);
 #endif
 
     mainloop_add_signal(SIGTERM, lrmd_shutdown);
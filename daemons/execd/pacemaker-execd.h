@@ -19,6 +19,7 @@
 #  endif
 
 GHashTable *rsc_list;
+extern int lrmd_call_id;
 
 typedef struct lrmd_rsc_s {
     char *rsc_id;
@@ -59,6 +60,8 @@ extern int lrmd_tls_set_key(gnutls_datum_t * key);
 int lrmd_server_send_reply(crm_client_t * client, uint32_t id, xmlNode * reply);
 
 int lrmd_server_send_notify(crm_client_t * client, xmlNode * msg);
+int lrmd_server_send_fanout(crm_client_t *client, pcmk__fanout_t *fanout);
+pcmk__fanout_t *lrmd_notify_fanout_new(xmlNode *msg);
 
 void notify_of_new_client(crm_client_t *new_client);
 
@@ -66,6 +69,8 @@ void process_lrmd_message(crm_client_t * client, uint32_t id, xmlNode * request)
 
 void free_rsc(gpointer data);
 
+void execd_collect_metrics(void);
+
 void handle_shutdown_ack(void);
 
 void handle_shutdown_nack(void);
@@ -90,7 +95,7 @@ void stonith_connection_failed(void);
 #ifdef SUPPORT_REMOTE
 void ipc_proxy_init(void);
 void ipc_proxy_cleanup(void);
-void ipc_proxy_add_provider(crm_client_t *client);
+void ipc_proxy_add_provider(crm_client_t *client, bool batch);
 void ipc_proxy_remove_provider(crm_client_t *client);
 void ipc_proxy_forward_client(crm_client_t *client, xmlNode *xml);
 crm_client_t *ipc_proxy_get_provider(void);
@@ -32,6 +32,8 @@ static qb_ipcs_service_t *stonith_ipcs = NULL;
 static GList *ipc_providers = NULL;
 /* ipc clients == things like cibadmin, crm_resource, connecting locally */
 static GHashTable *ipc_clients = NULL;
+// Messages not yet sent to IPC providers that accept batches, by provider
+static GHashTable *provider_batches = NULL;
 
 /*!
  * \internal
@@ -49,6 +51,28 @@ ipc_proxy_get_provider()
     return ipc_providers? (crm_client_t*) (ipc_providers->data) : NULL;
 }
 
+static int
+provider_send(xmlNode *msg, gpointer user_data)
+{
+    return lrmd_server_send_notify((crm_client_t *) user_data, msg);
+}
+
+/* Send (or batch) a proxied IPC message to an IPC provider */
+static void
+ipc_proxy_send(crm_client_t *ipc_proxy, xmlNode *msg)
+{
+    remote_proxy_batch_t *batch = NULL;
+
+    if (provider_batches != NULL) {
+        batch = g_hash_table_lookup(provider_batches, ipc_proxy->id);
+    }
+    if (batch != NULL) {
+        remote_proxy_batch_add(batch, msg);
+    } else {
+        lrmd_server_send_notify(ipc_proxy, msg);
+    }
+}
+
 static int32_t
 ipc_proxy_accept(qb_ipcs_connection_t * c, uid_t uid, gid_t gid, const char *ipc_channel)
 {
@@ -81,7 +105,7 @@ ipc_proxy_accept(qb_ipcs_connection_t * c, uid_t uid, gid_t gid, const char *ipc
     crm_xml_add(msg, F_LRMD_IPC_OP, LRMD_IPC_OP_NEW);
     crm_xml_add(msg, F_LRMD_IPC_IPC_SERVER, ipc_channel);
     crm_xml_add(msg, F_LRMD_IPC_SESSION, client->id);
-    lrmd_server_send_notify(ipc_proxy, msg);
+    ipc_proxy_send(ipc_proxy, msg);
     free_xml(msg);
     crm_debug("created new ipc proxy with session id %s", client->id);
     return 0;
@@ -123,6 +147,12 @@ ipc_proxy_created(qb_ipcs_connection_t * c)
     crm_trace("Connection %p", c);
 }
 
+static void
+forward_one(xmlNode *xml, gpointer user_data)
+{
+    ipc_proxy_forward_client((crm_client_t *) user_data, xml);
+}
+
 void
 ipc_proxy_forward_client(crm_client_t *ipc_proxy, xmlNode *xml)
 {
@@ -132,6 +162,10 @@ ipc_proxy_forward_client(crm_client_t *ipc_proxy, xmlNode *xml)
     crm_client_t *ipc_client;
     int rc = 0;
 
+    if (remote_proxy_batch_foreach(xml, forward_one, ipc_proxy)) {
+        return;
+    }
+
     /* If the IPC provider is acknowledging our shutdown request,
      * defuse the short exit timer to give the cluster time to
      * stop any resources we're running.
@@ -151,7 +185,7 @@ ipc_proxy_forward_client(crm_client_t *ipc_proxy, xmlNode *xml)
         xmlNode *msg = create_xml_node(NULL, T_LRMD_IPC_PROXY);
         crm_xml_add(msg, F_LRMD_IPC_OP, LRMD_IPC_OP_DESTROY);
         crm_xml_add(msg, F_LRMD_IPC_SESSION, session);
-        lrmd_server_send_notify(ipc_proxy, msg);
+        ipc_proxy_send(ipc_proxy, msg);
         free_xml(msg);
         return;
     }
@@ -239,6 +273,7 @@ ipc_proxy_dispatch(qb_ipcs_connection_t * c, void *data, size_t size)
      * in the controller, allowing the controller to process the messages async.
      */
     set_bit(flags, crm_ipc_proxied);
+    flags &= ~pcmk__ipc_transport_flags;
     client->request_id = id;
 
     msg = create_xml_node(NULL, T_LRMD_IPC_PROXY);
@@ -249,7 +284,7 @@ ipc_proxy_dispatch(qb_ipcs_connection_t * c, void *data, size_t size)
     crm_xml_add_int(msg, F_LRMD_IPC_MSG_ID, id);
     crm_xml_add_int(msg, F_LRMD_IPC_MSG_FLAGS, flags);
     add_message_xml(msg, F_LRMD_IPC_MSG, request);
-    lrmd_server_send_notify(ipc_proxy, msg);
+    ipc_proxy_send(ipc_proxy, msg);
     free_xml(request);
     free_xml(msg);
 
@@ -275,6 +310,15 @@ ipc_proxy_shutdown_req(crm_client_t *ipc_proxy)
      */
     crm_xml_add(msg, F_LRMD_IPC_SESSION, "0");
 
+    // Send this directly (after anything batched) so its result is known
+    if (provider_batches != NULL) {
+        remote_proxy_batch_t *batch = g_hash_table_lookup(provider_batches,
+                                                          ipc_proxy->id);
+
+        if (batch != NULL) {
+            remote_proxy_batch_flush(batch);
+        }
+    }
     rc = (lrmd_server_send_notify(ipc_proxy, msg) < 0)? -1 : 0;
     free_xml(msg);
     return rc;
@@ -298,7 +342,7 @@ ipc_proxy_closed(qb_ipcs_connection_t * c)
         xmlNode *msg = create_xml_node(NULL, T_LRMD_IPC_PROXY);
         crm_xml_add(msg, F_LRMD_IPC_OP, LRMD_IPC_OP_DESTROY);
         crm_xml_add(msg, F_LRMD_IPC_SESSION, client->id);
-        lrmd_server_send_notify(ipc_proxy, msg);
+        ipc_proxy_send(ipc_proxy, msg);
         free_xml(msg);
     }
 
@@ -357,11 +401,28 @@ static struct qb_ipcs_service_handlers cib_proxy_callbacks_rw = {
     .connection_destroyed = ipc_proxy_destroy
 };
 
+/*!
+ * \internal
+ * \brief Add an IPC provider
+ *
+ * \param[in] ipc_proxy  Client connection of provider
+ * \param[in] batch      Whether provider accepts batched proxy messages
+ */
 void
-ipc_proxy_add_provider(crm_client_t *ipc_proxy)
+ipc_proxy_add_provider(crm_client_t *ipc_proxy, bool batch)
 {
     // Prepending ensures the most recent connection is always first
     ipc_providers = g_list_prepend(ipc_providers, ipc_proxy);
+
+    if (batch) {
+        if (provider_batches == NULL) {
+            provider_batches = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                     free,
+                                                     (GDestroyNotify) remote_proxy_batch_free);
+        }
+        g_hash_table_replace(provider_batches, strdup(ipc_proxy->id),
+                             remote_proxy_batch_new(provider_send, ipc_proxy));
+    }
 }
 
 void
@@ -374,6 +435,9 @@ ipc_proxy_remove_provider(crm_client_t *ipc_proxy)
     GListPtr gIter = NULL;
 
     ipc_providers = g_list_remove(ipc_providers, ipc_proxy);
+    if (provider_batches != NULL) {
+        g_hash_table_remove(provider_batches, ipc_proxy->id);
+    }
 
     g_hash_table_iter_init(&iter, ipc_clients);
     while (g_hash_table_iter_next(&iter, (gpointer *) & key, (gpointer *) & ipc_client)) {
@@ -430,6 +494,10 @@ ipc_proxy_cleanup(void)
         g_hash_table_destroy(ipc_clients);
         ipc_clients = NULL;
     }
+    if (provider_batches) {
+        g_hash_table_destroy(provider_batches);
+        provider_batches = NULL;
+    }
     cib_ipc_servers_destroy(cib_ro, cib_rw, cib_shm);
     qb_ipcs_destroy(attrd_ipcs);
     qb_ipcs_destroy(stonith_ipcs);
@@ -312,11 +312,16 @@ lrmd_init_remote_tls_server()
     crm_gnutls_global_init();
     gnutls_global_set_log_function(debug_log);
 
-    gnutls_dh_params_init(&dh_params);
-    gnutls_dh_params_generate2(dh_params, 1024);
     gnutls_psk_allocate_server_credentials(&psk_cred_s);
     gnutls_psk_set_server_credentials_function(psk_cred_s, lrmd_tls_server_key_cb);
+#ifdef HAVE_GNUTLS_PSK_SET_SERVER_KNOWN_DH_PARAMS
+    // Use a standard (RFC 7919) group rather than generating one at start-up
+    gnutls_psk_set_server_known_dh_params(psk_cred_s, GNUTLS_SEC_PARAM_MEDIUM);
+#else
+    gnutls_dh_params_init(&dh_params);
+    gnutls_dh_params_generate2(dh_params, 1024);
     gnutls_psk_set_server_dh_params(psk_cred_s, dh_params);
+#endif
 
     /* The key callback won't get called until the first client connection
      * attempt. Do it once here, so we can warn the user at start-up if we can't
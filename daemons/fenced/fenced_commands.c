@@ -21,9 +21,11 @@
 #include <ctype.h>
 
 #include <crm/crm.h>
+#include <crm/services.h>
 #include <crm/msg_xml.h>
 #include <crm/common/ipc.h>
 #include <crm/common/ipcs.h>
+#include <crm/common/internal.h>
 #include <crm/cluster/internal.h>
 #include <crm/common/mainloop.h>
 
@@ -71,6 +73,8 @@ static void stonith_send_reply(xmlNode * reply, int call_options, const char *re
 static void search_devices_record_result(struct device_search_s *search, const char *device,
                                          gboolean can_fence);
 
+struct monitor_batch_s;
+
 typedef struct async_command_s {
 
     int id;
@@ -107,8 +111,28 @@ typedef struct async_command_s {
     int last_timeout_signo;
 
     stonith_device_t *active_on;
+    /*! The batched monitor request this command is part of, if any */
+    struct monitor_batch_s *batch;
 } async_command_t;
 
+/*
+ * Batched monitors
+ *
+ * A client monitoring many devices (such as the executor, which monitors every
+ * active fence device resource) can ask for all of them at once, and gets a
+ * single reply with each device's result once all have returned. A device
+ * whose agent succeeded at list, monitor or status within the last
+ * PCMK_fencing_monitor_cache seconds (by default, 0) is reported as running
+ * without executing the agent again.
+ */
+struct monitor_batch_s {
+    xmlNode *request;   // copy of the original request (for the reply)
+    xmlNode *results;   // F_STONITH_DEVICE entries with F_STONITH_RC
+    int remaining;      // number of monitors still executing
+};
+
+static int monitor_cache = -1;
+
 static xmlNode *stonith_construct_async_reply(async_command_t * cmd, const char *output,
                                               xmlNode * data, int rc);
 
@@ -504,6 +528,7 @@ free_device(gpointer data)
 
     g_list_free_full(device->targets, free);
 
+    mainloop_timer_del(device->list_timer);
     mainloop_destroy_trigger(device->work);
 
     free_xml(device->agent_metadata);
@@ -714,13 +739,20 @@ get_agent_metadata(const char *agent)
         return NULL;
 
     } else if(buffer == NULL) {
-        stonith_t *st = stonith_api_new();
-        int rc = st->cmds->metadata(st, st_opt_sync_call, agent, NULL, &buffer, 10);
-
-        stonith_api_delete(st);
-        if (rc || !buffer) {
-            crm_err("Could not retrieve metadata for fencing agent %s", agent);
-            return NULL;
+        // Use the copy cached on disk by an earlier run, if still valid
+        buffer = pcmk__metadata_cache_get(PCMK_RESOURCE_CLASS_STONITH, NULL,
+                                          agent);
+        if (buffer == NULL) {
+            stonith_t *st = stonith_api_new();
+            int rc = st->cmds->metadata(st, st_opt_sync_call, agent, NULL, &buffer, 10);
+
+            stonith_api_delete(st);
+            if (rc || !buffer) {
+                crm_err("Could not retrieve metadata for fencing agent %s", agent);
+                return NULL;
+            }
+            pcmk__metadata_cache_put(PCMK_RESOURCE_CLASS_STONITH, NULL, agent,
+                                     buffer);
         }
         g_hash_table_replace(metadata_cache, strdup(agent), buffer);
     }
@@ -1050,6 +1082,129 @@ status_search_cb(GPid pid, int rc, const char *output, gpointer user_data)
     search_devices_record_result(search, dev->id, can);
 }
 
+// Update a device's targets from the result of a list action
+static void
+update_dynamic_list(stonith_device_t *dev, int rc, const char *output)
+{
+    /* If we successfully got the targets earlier, don't disable. */
+    if (rc != 0 && !dev->targets) {
+        crm_notice("Disabling port list queries for %s (%d): %s", dev->id, rc, output);
+        /* Fall back to status */
+        g_hash_table_replace(dev->params, strdup(STONITH_ATTR_HOSTCHECK), strdup("status"));
+
+        g_list_free_full(dev->targets, free);
+        dev->targets = NULL;
+    } else if (!rc) {
+        crm_info("Refreshing port list for %s", dev->id);
+        g_list_free_full(dev->targets, free);
+        dev->targets = parse_host_list(output);
+        dev->targets_age = time(NULL);
+    }
+}
+
+/*
+ * Background target list refresh
+ *
+ * A search for devices capable of fencing a target would otherwise run the
+ * list action of any dynamic-list device whose list is more than a minute
+ * old, so fencing (and every query before it) could wait for slow agents.
+ * Instead, each such device's list is refreshed by a timer every
+ * pcmk_list_refresh, whenever the device is not busy, and searches use the
+ * list the device already has. A search still waits for the list action of a
+ * device that has never successfully listed its targets.
+ */
+
+#define DEFAULT_LIST_REFRESH_MS 60000
+
+static guint
+list_refresh_ms(stonith_device_t *dev)
+{
+    const char *value = g_hash_table_lookup(dev->params,
+                                            STONITH_ATTR_LIST_REFRESH);
+    long long ms = (value? crm_get_msec(value) : DEFAULT_LIST_REFRESH_MS);
+
+    return (ms > 0)? (guint) ms : 0;
+}
+
+static void
+list_refresh_cb(GPid pid, int rc, const char *output, gpointer user_data)
+{
+    async_command_t *cmd = user_data;
+    stonith_device_t *dev = cmd->device ? g_hash_table_lookup(device_list, cmd->device) : NULL;
+
+    free_async_command(cmd);
+    if (dev == NULL) {
+        return;
+    }
+    dev->list_pending = FALSE;
+    mainloop_set_trigger(dev->work);
+    if (rc != -ENODEV) {
+        update_dynamic_list(dev, rc, output);
+    }
+}
+
+static gboolean
+list_refresh_timer_cb(gpointer data)
+{
+    stonith_device_t *dev = data;
+
+    if (safe_str_neq(target_list_type(dev), "dynamic-list")) {
+        // The device has fallen back to status checks
+        return FALSE;
+    }
+
+    // Don't hold up fencing (the action limit applies to list actions, too)
+    if (!dev->list_pending && (dev->pending_ops == NULL)
+        && (get_active_cmds(dev) == 0)) {
+        crm_trace("Refreshing target list of %s in background", dev->id);
+        dev->list_pending = TRUE;
+        schedule_internal_command(__FUNCTION__, dev, "list", NULL, 0, NULL,
+                                  list_refresh_cb);
+    }
+    return TRUE;
+}
+
+// Start refreshing a registered device's targets, if appropriate
+static void
+start_list_refresh(stonith_device_t *dev)
+{
+    guint interval_ms = 0;
+
+    if (safe_str_neq(target_list_type(dev), "dynamic-list")) {
+        return;
+    }
+    interval_ms = list_refresh_ms(dev);
+
+    if (dev->list_timer != NULL) {
+        if (mainloop_timer_running(dev->list_timer)) {
+            return;
+        }
+
+        /* Rearm a timer that stopped, such as one that found the device had
+         * fallen back to status checks. Make sure it is stopped before setting
+         * its period, because mainloop_timer_set_period() restarts a timer
+         * that is still scheduled.
+         */
+        mainloop_timer_stop(dev->list_timer);
+        if (interval_ms > 0) {
+            mainloop_timer_set_period(dev->list_timer, interval_ms);
+            mainloop_timer_start(dev->list_timer);
+            list_refresh_timer_cb(dev);
+        }
+        return;
+    }
+    if (interval_ms == 0) {
+        return;
+    }
+
+    dev->list_timer = mainloop_timer_add("list-refresh", interval_ms, TRUE,
+                                         list_refresh_timer_cb, dev);
+    mainloop_timer_start(dev->list_timer);
+
+    // Get the first list now, so the first search doesn't need to
+    list_refresh_timer_cb(dev);
+}
+
 static void
 dynamic_list_search_cb(GPid pid, int rc, const char *output, gpointer user_data)
 {
@@ -1071,21 +1226,7 @@ dynamic_list_search_cb(GPid pid, int rc, const char *output, gpointer user_data)
     }
 
     mainloop_set_trigger(dev->work);
-
-    /* If we successfully got the targets earlier, don't disable. */
-    if (rc != 0 && !dev->targets) {
-        crm_notice("Disabling port list queries for %s (%d): %s", dev->id, rc, output);
-        /* Fall back to status */
-        g_hash_table_replace(dev->params, strdup(STONITH_ATTR_HOSTCHECK), strdup("status"));
-
-        g_list_free_full(dev->targets, free);
-        dev->targets = NULL;
-    } else if (!rc) {
-        crm_info("Refreshing port list for %s", dev->id);
-        g_list_free_full(dev->targets, free);
-        dev->targets = parse_host_list(output);
-        dev->targets_age = time(NULL);
-    }
+    update_dynamic_list(dev, rc, output);
 
     if (dev->targets) {
         const char *alias = g_hash_table_lookup(dev->aliases, search->host);
@@ -1170,6 +1311,7 @@ stonith_device_register(xmlNode * msg, const char **desc, gboolean from_cib)
                    g_hash_table_size(device_list));
         free_device(device);
         device = dup;
+        start_list_refresh(device);
 
     } else {
         stonith_device_t *old = g_hash_table_lookup(device_list, device->id);
@@ -1191,6 +1333,7 @@ stonith_device_register(xmlNode * msg, const char **desc, gboolean from_cib)
 
         crm_notice("Added '%s' to the device list (%d active devices)", device->id,
                    g_hash_table_size(device_list));
+        start_list_refresh(device);
     }
     if (desc) {
         *desc = device->id;
@@ -1539,6 +1682,152 @@ stonith_device_action(xmlNode * msg, char **output)
     return rc;
 }
 
+static void
+monitor_batch_record(struct monitor_batch_s *batch, const char *device, int rc)
+{
+    xmlNode *entry = create_xml_node(batch->results, F_STONITH_DEVICE);
+
+    crm_xml_add(entry, XML_ATTR_ID, device);
+    crm_xml_add_int(entry, F_STONITH_RC, rc);
+}
+
+static void
+monitor_batch_reply(struct monitor_batch_s *batch)
+{
+    int call_options = 0;
+    xmlNode *reply = stonith_construct_reply(batch->request, NULL,
+                                             batch->results, pcmk_ok);
+
+    crm_element_value_int(batch->request, F_STONITH_CALLOPTS, &call_options);
+    crm_trace("Sending results of batched monitor for %s",
+              crm_element_value(batch->request, F_STONITH_CLIENTNAME));
+    do_local_reply(reply, crm_element_value(batch->request, F_STONITH_CLIENTID),
+                   is_set(call_options, st_opt_sync_call), FALSE);
+    free_xml(reply);
+}
+
+static void
+free_monitor_batch(struct monitor_batch_s *batch)
+{
+    free_xml(batch->request);
+    free_xml(batch->results);
+    free(batch);
+}
+
+/*!
+ * \internal
+ * \brief Record the result of one monitor in a batch, and reply if it was last
+ *
+ * \param[in] cmd  Monitor command that completed
+ * \param[in] rc   Result of monitor
+ */
+static void
+monitor_batch_done(async_command_t *cmd, int rc)
+{
+    struct monitor_batch_s *batch = cmd->batch;
+
+    cmd->batch = NULL;
+    monitor_batch_record(batch, cmd->device, rc);
+    if (--batch->remaining == 0) {
+        monitor_batch_reply(batch);
+        free_monitor_batch(batch);
+    }
+}
+
+static int
+monitor_cache_s(void)
+{
+    if (monitor_cache < 0) {
+        monitor_cache = crm_get_msec(daemon_option("fencing_monitor_cache"));
+        monitor_cache = (monitor_cache < 0)? 0 : (monitor_cache / 1000);
+    }
+    return monitor_cache;
+}
+
+/*!
+ * \internal
+ * \brief Monitor several devices for a client, replying once for all
+ *
+ * \param[in]  request  Batched monitor request
+ * \param[out] data     Where to store results, if all are known immediately
+ *
+ * \return pcmk_ok if \p data has all results, -EINPROGRESS if the reply will
+ *         be sent once the monitors return
+ */
+static int
+stonith_monitor_batch(xmlNode *request, xmlNode **data)
+{
+    const char *names[] = {
+        F_STONITH_OPERATION,
+        F_STONITH_CALLID,
+        F_STONITH_CLIENTID,
+        F_STONITH_CLIENTNAME,
+        F_STONITH_CALLOPTS,
+        F_STONITH_TIMEOUT
+    };
+    xmlNode *list = get_xpath_object("//" F_STONITH_CALLDATA, request, LOG_ERR);
+    struct monitor_batch_s *batch = calloc(1, sizeof(struct monitor_batch_s));
+    time_t now = time(NULL);
+
+    CRM_ASSERT(batch != NULL);
+    batch->request = copy_xml(request);
+    batch->results = create_xml_node(NULL, STONITH_OP_MONITOR_BATCH);
+
+    // The batch can't be replied to until all devices have been looked at
+    batch->remaining = 1;
+
+    for (xmlNode *entry = __xml_first_child_element(list); entry != NULL;
+         entry = __xml_next_element(entry)) {
+
+        const char *id = crm_element_value(entry, F_STONITH_DEVICE);
+        stonith_device_t *device = NULL;
+        async_command_t *cmd = NULL;
+        xmlNode *msg = NULL;
+        xmlNode *op = NULL;
+
+        if (id == NULL) {
+            continue;
+        }
+        device = g_hash_table_lookup(device_list, id);
+        if ((device == NULL) || (device->api_registered == FALSE)) {
+            monitor_batch_record(batch, id, -ENODEV);
+            continue;
+        }
+        if ((monitor_cache_s() > 0) && device->verified
+            && (device->last_verified + monitor_cache_s() >= now)) {
+            crm_trace("Using cached monitor result for %s", id);
+            monitor_batch_record(batch, id, pcmk_ok);
+            continue;
+        }
+
+        // Execute the monitor as if it had been requested individually
+        msg = create_xml_node(NULL, __FUNCTION__);
+        for (int lpc = 0; lpc < DIMOF(names); lpc++) {
+            crm_xml_add(msg, names[lpc], crm_element_value(request, names[lpc]));
+        }
+        op = create_xml_node(msg, F_STONITH_DEVICE);
+        crm_xml_add(op, F_STONITH_DEVICE, id);
+        crm_xml_add(op, F_STONITH_ACTION, "monitor");
+        cmd = create_async_command(msg);
+        free_xml(msg);
+        if (cmd == NULL) {
+            monitor_batch_record(batch, id, -EPROTO);
+            continue;
+        }
+        cmd->batch = batch;
+        batch->remaining++;
+        schedule_stonith_command(cmd, device);
+    }
+
+    if (--batch->remaining > 0) {
+        return -EINPROGRESS;
+    }
+    *data = batch->results;
+    batch->results = NULL;
+    free_monitor_batch(batch);
+    return pcmk_ok;
+}
+
 static void
 search_devices_record_result(struct device_search_s *search, const char *device, gboolean can_fence)
 {
@@ -1654,7 +1943,11 @@ can_fence_host_with_device(stonith_device_t * dev, struct device_search_s *searc
     } else if (safe_str_eq(check_type, "dynamic-list")) {
         time_t now = time(NULL);
 
-        if (dev->targets == NULL || dev->targets_age + 60 < now) {
+        /* Without background refreshes, a list more than a minute old must
+         * be refreshed now
+         */
+        if ((dev->targets == NULL)
+            || ((dev->list_timer == NULL) && (dev->targets_age + 60 < now))) {
             crm_trace("Running %s command to see if %s can fence %s (%s)",
                       check_type, dev->id, search->host, search->action);
 
@@ -2037,6 +2330,12 @@ stonith_send_async_reply(async_command_t * cmd, const char *output, int rc, GPid
     xmlNode *reply = NULL;
     gboolean bcast = FALSE;
 
+    if (cmd->batch != NULL) {
+        log_operation(cmd, rc, pid, NULL, output);
+        monitor_batch_done(cmd, rc);
+        return;
+    }
+
     reply = stonith_construct_async_reply(cmd, output, NULL, rc);
 
     if (safe_str_eq(cmd->action, "metadata")) {
@@ -2130,6 +2429,7 @@ st_child_done(GPid pid, int rc, const char *output, gpointer user_data)
              safe_str_eq(cmd->action, "monitor") || safe_str_eq(cmd->action, "status"))) {
 
             device->verified = TRUE;
+            device->last_verified = time(NULL);
         }
 
         mainloop_set_trigger(device->work);
@@ -2487,6 +2787,13 @@ handle_request(crm_client_t * client, uint32_t id, uint32_t flags, xmlNode * req
     } else if (crm_str_eq(op, STONITH_OP_EXEC, TRUE)) {
         rc = stonith_device_action(request, &output);
 
+    } else if (crm_str_eq(op, STONITH_OP_MONITOR_BATCH, TRUE)) {
+        if (remote_peer) {
+            rc = -EOPNOTSUPP;
+        } else {
+            rc = stonith_monitor_batch(request, &data);
+        }
+
     } else if (crm_str_eq(op, STONITH_OP_TIMEOUT_UPDATE, TRUE)) {
         const char *call_id = crm_element_value(request, F_STONITH_CALLID);
         const char *client_id = crm_element_value(request, F_STONITH_CLIENTID);
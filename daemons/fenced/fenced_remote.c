@@ -73,6 +73,32 @@ typedef struct st_query_result_s {
 
 static GHashTable *remote_op_list = NULL;
 
+/*
+ * Fencing history
+ *
+ * Every operation is kept in remote_op_list after it completes, so that the
+ * history can be queried. The operations are also kept in op_history, in the
+ * order they were created or completed, and each time that happens, the
+ * operation is given the next value of history_seq. So, clients can ask for
+ * only what changed since they last asked, and the oldest completed operations
+ * are easy to find when there are more than PCMK_fencing_history_max of them
+ * (which are then forgotten). ops_by_target (target name -> GList of
+ * operations) is for queries about one node.
+ *
+ * history_seq starts again from 0 whenever the history does, so each history
+ * also gets a unique incarnation ID, and a sequence number from any other
+ * incarnation is ignored.
+ */
+static GQueue *op_history = NULL;
+static GHashTable *ops_by_target = NULL;
+static int history_seq = 0;
+static int history_max = -1;
+static char *history_incarnation = NULL;
+static crm_trigger_t *trim_trigger = NULL;
+
+static int parallel_devices = -1;
+static int early_start = -1;
+
 void call_remote_stonith(remote_fencing_op_t * op, st_query_result_t * peer);
 static void remote_op_done(remote_fencing_op_t * op, xmlNode * data, int rc, int dup);
 extern xmlNode *stonith_create_op(int call_id, const char *token, const char *op, xmlNode * data,
@@ -108,6 +134,20 @@ free_remote_op_list()
         g_hash_table_destroy(remote_op_list);
         remote_op_list = NULL;
     }
+    if (op_history != NULL) {
+        g_queue_free(op_history);
+        op_history = NULL;
+    }
+    if (ops_by_target != NULL) {
+        g_hash_table_destroy(ops_by_target);
+        ops_by_target = NULL;
+    }
+    if (trim_trigger != NULL) {
+        mainloop_destroy_trigger(trim_trigger);
+        trim_trigger = NULL;
+    }
+    free(history_incarnation);
+    history_incarnation = NULL;
 }
 
 struct peer_count_data {
@@ -225,6 +265,172 @@ clear_remote_op_timers(remote_fencing_op_t * op)
     }
 }
 
+/*!
+ * \internal
+ * \brief Add a newly created operation to the history indexes
+ *
+ * \param[in] op  Operation to add
+ */
+static void
+index_op_history(remote_fencing_op_t *op)
+{
+    if (op_history == NULL) {
+        op_history = g_queue_new();
+        ops_by_target = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                              (GDestroyNotify) g_list_free);
+    }
+
+    op->history_seq = ++history_seq;
+    g_queue_push_tail(op_history, op);
+    op->history_link = g_queue_peek_tail_link(op_history);
+
+    if (op->target != NULL) {
+        char *key = NULL;
+        GList *ops = NULL;
+
+        // Reuse the existing key (if any), because the list head changes
+        if (g_hash_table_lookup_extended(ops_by_target, op->target,
+                                         (gpointer *) &key,
+                                         (gpointer *) &ops)) {
+            g_hash_table_steal(ops_by_target, op->target);
+        } else {
+            key = strdup(op->target);
+        }
+        g_hash_table_insert(ops_by_target, key, g_list_prepend(ops, op));
+    }
+}
+
+/*!
+ * \internal
+ * \brief Remove an operation from the history indexes
+ *
+ * \param[in] op  Operation to remove
+ */
+static void
+unindex_op_history(remote_fencing_op_t *op)
+{
+    if (op->history_link == NULL) {
+        return;
+    }
+    g_queue_delete_link(op_history, op->history_link);
+    op->history_link = NULL;
+
+    if (op->target != NULL) {
+        char *key = NULL;
+        GList *ops = NULL;
+
+        if (g_hash_table_lookup_extended(ops_by_target, op->target,
+                                         (gpointer *) &key,
+                                         (gpointer *) &ops)) {
+            g_hash_table_steal(ops_by_target, op->target);
+            ops = g_list_remove(ops, op);
+            if (ops != NULL) {
+                g_hash_table_insert(ops_by_target, key, ops);
+            } else {
+                free(key);
+            }
+        }
+    }
+}
+
+static int
+history_max_ops(void)
+{
+    if (history_max < 0) {
+        const char *value = daemon_option("fencing_history_max");
+
+        history_max = crm_parse_int(value, "500");
+        if (history_max < 0) {
+            history_max = 0;
+        }
+    }
+    return history_max;
+}
+
+static gboolean
+op_is_complete(const remote_fencing_op_t *op)
+{
+    return (op->state == st_done) || (op->state == st_failed);
+}
+
+/*!
+ * \internal
+ * \brief Forget the oldest completed operations if there are too many
+ *
+ * \note This is called from the main loop rather than when an operation
+ *       completes, because callers may still be using the operation (or
+ *       others) then.
+ */
+static int
+trim_op_history(gpointer user_data)
+{
+    GHashTable *in_use = NULL;
+    GHashTableIter iter;
+    remote_fencing_op_t *op = NULL;
+    GList *link = NULL;
+    guint max = (guint) history_max_ops();
+    guint removed = 0;
+
+    if ((max == 0) || (remote_op_list == NULL)
+        || (g_hash_table_size(remote_op_list) <= max)) {
+        return TRUE;
+    }
+
+    // Operations still pending delivery to an in-flight original must stay
+    in_use = g_hash_table_new(NULL, NULL);
+    g_hash_table_iter_init(&iter, remote_op_list);
+    while (g_hash_table_iter_next(&iter, NULL, (void **) &op)) {
+        if (!op_is_complete(op)) {
+            for (GList *d = op->duplicates; d != NULL; d = d->next) {
+                g_hash_table_insert(in_use, d->data, d->data);
+            }
+        }
+    }
+
+    for (link = g_queue_peek_head_link(op_history);
+         (link != NULL) && (g_hash_table_size(remote_op_list) > max); ) {
+        op = link->data;
+        link = link->next;
+        if (op_is_complete(op) && (g_hash_table_lookup(in_use, op) == NULL)) {
+            g_hash_table_remove(remote_op_list, op->id);
+            removed++;
+        }
+    }
+    g_hash_table_destroy(in_use);
+
+    crm_debug("Forgot %u oldest fencing operation%s (keeping %u)",
+              removed, ((removed == 1)? "" : "s"),
+              g_hash_table_size(remote_op_list));
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Record that an operation has completed in the history indexes
+ *
+ * \param[in] op  Operation that completed
+ */
+static void
+update_op_history(remote_fencing_op_t *op)
+{
+    if (op->history_link == NULL) {
+        return;
+    }
+    op->history_seq = ++history_seq;
+    g_queue_unlink(op_history, op->history_link);
+    g_queue_push_tail_link(op_history, op->history_link);
+
+    if ((history_max_ops() > 0)
+        && (g_hash_table_size(remote_op_list) > (guint) history_max)) {
+        if (trim_trigger == NULL) {
+            trim_trigger = mainloop_add_trigger(G_PRIORITY_LOW,
+                                                trim_op_history, NULL);
+            pcmk__trigger_set_name(trim_trigger, "fencing history");
+        }
+        mainloop_set_trigger(trim_trigger);
+    }
+}
+
 static void
 free_remote_op(gpointer data)
 {
@@ -234,6 +440,7 @@ free_remote_op(gpointer data)
     crm_log_xml_debug(op->request, "Destroying");
 
     clear_remote_op_timers(op);
+    unindex_op_history(op);
 
     free(op->id);
     free(op->action);
@@ -254,6 +461,7 @@ free_remote_op(gpointer data)
         g_list_free_full(op->devices_list, free);
         op->devices_list = NULL;
     }
+    g_list_free_full(op->devices_running, free);
     g_list_free_full(op->automatic_list, free);
     g_list_free(op->duplicates);
     free(op);
@@ -472,6 +680,8 @@ remote_op_done(remote_fencing_op_t * op, xmlNode * data, int rc, int dup)
     op->completed = time(NULL);
     clear_remote_op_timers(op);
     undo_op_remap(op);
+    g_list_free_full(op->devices_running, free);
+    op->devices_running = NULL;
 
     if (op->notify_sent == TRUE) {
         crm_err("Already sent notifications for '%s of %s by %s' (for=%s@%s.%.8s, state=%d): %s",
@@ -519,6 +729,12 @@ remote_op_done(remote_fencing_op_t * op, xmlNode * data, int rc, int dup)
 
     if (dup == FALSE) {
         handle_duplicates(op, data, rc);
+        pcmk__metric_observe_us(pcmk__metric(pcmk__metric_histogram,
+                                             "fencing_seconds",
+                                             "Time taken by fencing "
+                                             "operations, by action",
+                                             "action", op->action),
+                                (op->completed - op->created) * G_USEC_PER_SEC);
     }
 
     /* Free non-essential parts of the record
@@ -533,6 +749,7 @@ remote_op_done(remote_fencing_op_t * op, xmlNode * data, int rc, int dup)
         free_xml(op->request);
         op->request = NULL;
     }
+    update_op_history(op);
 
   remote_op_done_cleanup:
     free_xml(local_data);
@@ -552,6 +769,9 @@ remote_op_watchdog_done(gpointer userdata)
     return FALSE;
 }
 
+static void parallel_level_done(remote_fencing_op_t *op, const char *device,
+                                xmlNode *msg, int rc);
+
 static gboolean
 remote_op_timeout_one(gpointer userdata)
 {
@@ -561,6 +781,13 @@ remote_op_timeout_one(gpointer userdata)
 
     crm_notice("Peer's fencing (%s) of %s for %s timed out" CRM_XS "id=%s",
                op->action, op->target, op->client_name, op->id);
+    if (op->devices_running != NULL) {
+        // Devices requested at the same time share one timeout
+        g_list_free_full(op->devices_running, free);
+        op->devices_running = NULL;
+        parallel_level_done(op, NULL, NULL, -ETIME);
+        return FALSE;
+    }
     call_remote_stonith(op, NULL);
     return FALSE;
 }
@@ -605,7 +832,7 @@ remote_op_query_timeout(gpointer data)
     op->query_timer = 0;
     if (op->state == st_done) {
         crm_debug("Operation %s for %s already completed", op->id, op->target);
-    } else if (op->state == st_exec) {
+    } else if ((op->state == st_exec) && !op->awaiting_peers) {
         crm_debug("Operation %s for %s already in progress", op->id, op->target);
     } else if (op->query_results) {
         crm_debug("Query %s for %s complete: %d", op->id, op->target, op->state);
@@ -1041,6 +1268,7 @@ create_remote_stonith_op(const char *client, xmlNode * request, gboolean peer)
             crm_warn("Could not expand nodeid '%s' into a host name", op->target);
         }
     }
+    index_op_history(op);
 
     /* check to see if this is a duplicate operation of another in-flight operation */
     merge_duplicates(op);
@@ -1434,6 +1662,219 @@ advance_op_topology(remote_fencing_op_t *op, const char *device, xmlNode *msg,
     }
 }
 
+static xmlNode *
+create_fence_request(remote_fencing_op_t *op, int timeout)
+{
+    xmlNode *remote_op = stonith_create_op(op->client_callid, op->id, STONITH_OP_FENCE, NULL, 0);
+
+    crm_xml_add(remote_op, F_STONITH_REMOTE_OP_ID, op->id);
+    crm_xml_add(remote_op, F_STONITH_TARGET, op->target);
+    crm_xml_add(remote_op, F_STONITH_ACTION, op->action);
+    crm_xml_add(remote_op, F_STONITH_ORIGIN, op->originator);
+    crm_xml_add(remote_op, F_STONITH_CLIENTID, op->client_id);
+    crm_xml_add(remote_op, F_STONITH_CLIENTNAME, op->client_name);
+    crm_xml_add_int(remote_op, F_STONITH_TIMEOUT, timeout);
+    crm_xml_add_int(remote_op, F_STONITH_CALLOPTS, op->call_options);
+    return remote_op;
+}
+
+static bool
+fencing_option(const char *option, int *cached)
+{
+    if (*cached < 0) {
+        const char *value = daemon_option(option);
+
+        *cached = (value != NULL) && crm_is_true(value);
+    }
+    return *cached;
+}
+
+/*
+ * Parallel topology levels
+ *
+ * With PCMK_fencing_parallel_devices, all devices of a topology level are
+ * requested at once (possibly from different peers) rather than one after
+ * another, so a level takes as long as its slowest device rather than the sum
+ * of all. The level still succeeds only if every device does, and it is not
+ * considered done (in either case) until all have returned or the longest
+ * device timeout has passed. If a peer is not yet known for every device, or
+ * watchdog self-fencing could be involved, or unfencing might need to run
+ * further devices, the level is executed one device at a time as usual.
+ */
+
+/*!
+ * \internal
+ * \brief Choose a peer to execute a device, without marking it executed
+ *
+ * \param[in] op      Fencing operation
+ * \param[in] device  Device ID
+ *
+ * \return Peer to use (with the same preferences as stonith_choose_peer())
+ */
+static st_query_result_t *
+peer_for_device(remote_fencing_op_t *op, const char *device)
+{
+    for (int pass = 0; pass < 3; pass++) {
+        if ((pass == 2) && (op->phase == st_phase_on)) {
+            break;  // Never self-fence for the "on" phase of a remapped reboot
+        }
+        for (GListPtr iter = op->query_results; iter != NULL; iter = iter->next) {
+            st_query_result_t *peer = iter->data;
+            device_properties_t *props = find_peer_device(op, peer, device);
+            gboolean is_target = safe_str_eq(peer->host, op->target);
+
+            if ((props == NULL) || (is_target != (pass == 2))
+                || ((pass == 0) && !props->verified)) {
+                continue;
+            }
+            return peer;
+        }
+    }
+    return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Request all devices at an operation's current level at once
+ *
+ * \param[in,out] op  Fencing operation at the start of a topology level
+ *
+ * \return TRUE if the devices were requested, FALSE if the level must be
+ *         executed one device at a time
+ */
+static gboolean
+call_level_parallel(remote_fencing_op_t *op)
+{
+    GListPtr peers = NULL;
+    GListPtr d = NULL;
+    GListPtr p = NULL;
+    int timeout_max = 0;
+
+    if (!fencing_option("fencing_parallel_devices", &parallel_devices)
+        || (op->devices != op->devices_list)
+        || (g_list_next(op->devices_list) == NULL)
+        || ((op->phase == st_phase_requested) && safe_str_eq(op->action, "on"))) {
+        return FALSE;
+    }
+
+    // Only start if every device can be requested
+    for (d = op->devices_list; d != NULL; d = d->next) {
+        st_query_result_t *peer = peer_for_device(op, d->data);
+
+        if ((peer == NULL) || safe_str_eq(d->data, "watchdog")
+            || ((stonith_watchdog_timeout_ms > 0)
+                && safe_str_eq(peer->host, op->target))) {
+            g_list_free(peers);
+            return FALSE;
+        }
+        peers = g_list_append(peers, peer);
+    }
+
+    op->parallel_rc = pcmk_ok;
+    for (d = op->devices_list, p = peers; d != NULL; d = d->next, p = p->next) {
+        const char *device = d->data;
+        st_query_result_t *peer = p->data;
+        int timeout = get_device_timeout(op, peer, device);
+        xmlNode *remote_op = create_fence_request(op, timeout);
+
+        grab_peer_device(op, peer, device, FALSE);
+        timeout_max = QB_MAX(timeout_max, TIMEOUT_MULTIPLY_FACTOR * timeout);
+        crm_info("Requesting that '%s' perform op '%s %s' with '%s' for %s "
+                 "(%ds, with %d other devices)", peer->host, op->target,
+                 op->action, device, op->client_name,
+                 (int) (TIMEOUT_MULTIPLY_FACTOR * timeout),
+                 g_list_length(op->devices_list) - 1);
+        crm_xml_add(remote_op, F_STONITH_DEVICE, device);
+        crm_xml_add(remote_op, F_STONITH_MODE, "slave");
+
+        send_cluster_message(crm_get_peer(0, peer->host), crm_msg_stonith_ng, remote_op, FALSE);
+        peer->tried = TRUE;
+        free_xml(remote_op);
+        op->devices_running = g_list_append(op->devices_running, strdup(device));
+    }
+    g_list_free(peers);
+
+    op->state = st_exec;
+    if (op->op_timer_one) {
+        g_source_remove(op->op_timer_one);
+    }
+    op->op_timer_one = g_timeout_add((1000 * timeout_max), remote_op_timeout_one, op);
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Continue an operation after all devices requested at once are done
+ *
+ * \param[in,out] op      Fencing operation
+ * \param[in]     device  Last device to return (if known)
+ * \param[in]     msg     Last device's reply (if any)
+ * \param[in]     rc      pcmk_ok if every device succeeded, else first failure
+ */
+static void
+parallel_level_done(remote_fencing_op_t *op, const char *device, xmlNode *msg,
+                    int rc)
+{
+    if (op->op_timer_one) {
+        g_source_remove(op->op_timer_one);
+        op->op_timer_one = 0;
+    }
+
+    if ((op->phase == st_phase_on) && (rc != pcmk_ok)) {
+        crm_warn("Ignoring 'on' failure (%s) for %s after successful 'off'",
+                 pcmk_strerror(rc), op->target);
+        rc = pcmk_ok;
+    }
+
+    if (rc == pcmk_ok) {
+        // Continue as if the level's devices had been executed one by one
+        op->devices = g_list_last(op->devices_list);
+        advance_op_topology(op, device, msg, rc);
+
+    } else if (stonith_topology_next(op) == pcmk_ok) {
+        call_remote_stonith(op, NULL);
+
+    } else {
+        op->state = st_failed;
+        remote_op_done(op, msg, rc, FALSE);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Record the result of one of the devices requested at once
+ *
+ * \param[in,out] op      Fencing operation
+ * \param[in]     device  Device that returned
+ * \param[in]     msg     Device's reply
+ * \param[in]     rc      Device's result
+ */
+static void
+parallel_device_done(remote_fencing_op_t *op, const char *device, xmlNode *msg,
+                     int rc)
+{
+    GListPtr match = g_list_find_custom(op->devices_running, device,
+                                        sort_strings);
+
+    if (match == NULL) {
+        crm_err("Received outdated reply for device %s to fence (%s) %s",
+                device, op->action, op->target);
+        return;
+    }
+    free(match->data);
+    op->devices_running = g_list_delete_link(op->devices_running, match);
+
+    if ((rc != pcmk_ok) && (op->parallel_rc == pcmk_ok)) {
+        op->parallel_rc = rc;
+    }
+    if (op->devices_running != NULL) {
+        crm_trace("Waiting for %d more devices to fence (%s) %s",
+                  g_list_length(op->devices_running), op->action, op->target);
+        return;
+    }
+    parallel_level_done(op, device, msg, op->parallel_rc);
+}
+
 void
 call_remote_stonith(remote_fencing_op_t * op, st_query_result_t * peer)
 {
@@ -1441,6 +1882,7 @@ call_remote_stonith(remote_fencing_op_t * op, st_query_result_t * peer)
     int timeout = op->base_timeout;
 
     crm_trace("State for %s.%.8s: %s %d", op->target, op->client_name, op->id, op->state);
+    op->awaiting_peers = FALSE;
     if (peer == NULL && !is_set(op->call_options, st_opt_topology)) {
         peer = stonith_choose_peer(op);
     }
@@ -1456,6 +1898,11 @@ call_remote_stonith(remote_fencing_op_t * op, st_query_result_t * peer)
                  total_timeout, op->target, op->client_name, op->id);
     }
 
+    if (is_set(op->call_options, st_opt_topology) && op->devices
+        && call_level_parallel(op)) {
+        return;
+    }
+
     if (is_set(op->call_options, st_opt_topology) && op->devices) {
         /* Ignore any peer preference, they might not have the device we need */
         /* When using topology, stonith_choose_peer() removes the device from
@@ -1468,16 +1915,7 @@ call_remote_stonith(remote_fencing_op_t * op, st_query_result_t * peer)
 
     if (peer) {
         int timeout_one = 0;
-        xmlNode *remote_op = stonith_create_op(op->client_callid, op->id, STONITH_OP_FENCE, NULL, 0);
-
-        crm_xml_add(remote_op, F_STONITH_REMOTE_OP_ID, op->id);
-        crm_xml_add(remote_op, F_STONITH_TARGET, op->target);
-        crm_xml_add(remote_op, F_STONITH_ACTION, op->action);
-        crm_xml_add(remote_op, F_STONITH_ORIGIN, op->originator);
-        crm_xml_add(remote_op, F_STONITH_CLIENTID, op->client_id);
-        crm_xml_add(remote_op, F_STONITH_CLIENTNAME, op->client_name);
-        crm_xml_add_int(remote_op, F_STONITH_TIMEOUT, timeout);
-        crm_xml_add_int(remote_op, F_STONITH_CALLOPTS, op->call_options);
+        xmlNode *remote_op = create_fence_request(op, timeout);
 
         if (device) {
             timeout_one = TIMEOUT_MULTIPLY_FACTOR *
@@ -1579,9 +2017,11 @@ call_remote_stonith(remote_fencing_op_t * op, st_query_result_t * peer)
     } else if (device) {
         crm_info("Waiting for additional peers capable of fencing (%s) %s with %s for %s.%.8s",
                  op->action, op->target, device, op->client_name, op->id);
+        op->awaiting_peers = TRUE;
     } else {
         crm_info("Waiting for additional peers capable of fencing (%s) %s for %s%.8s",
                  op->action, op->target, op->client_name, op->id);
+        op->awaiting_peers = TRUE;
     }
 }
 
@@ -1649,6 +2089,41 @@ all_topology_devices_found(remote_fencing_op_t * op)
     return TRUE;
 }
 
+/*!
+ * \internal
+ * \brief Check whether verified peers are known for the current level
+ *
+ * \param[in] op  Fencing operation
+ *
+ * \return TRUE if every device at the operation's current topology level is
+ *         verified on a peer other than the target, otherwise FALSE
+ */
+static gboolean
+current_level_devices_found(remote_fencing_op_t *op)
+{
+    if (op->devices_list == NULL) {
+        return FALSE;
+    }
+    for (GListPtr device = op->devices_list; device; device = device->next) {
+        gboolean found = FALSE;
+
+        for (GListPtr iter = op->query_results; iter && !found; iter = iter->next) {
+            st_query_result_t *peer = iter->data;
+            device_properties_t *props = NULL;
+
+            if (safe_str_eq(peer->host, op->target)) {
+                continue;
+            }
+            props = find_peer_device(op, peer, device->data);
+            found = (props != NULL) && props->verified;
+        }
+        if (!found) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
 /*!
  * \internal
  * \brief Parse action-specific device properties from XML
@@ -1861,6 +2336,20 @@ process_remote_stonith_query(xmlNode * msg)
             crm_trace("All topology devices found");
             call_remote_stonith(op, result);
 
+        } else if ((op->state == st_query)
+                   && fencing_option("fencing_early_start", &early_start)
+                   && current_level_devices_found(op)) {
+            /* Later levels might be missed if this one fails before their
+             * devices are found, but the operation will wait for more replies
+             * then (see awaiting_peers).
+             */
+            crm_trace("All devices for topology level %d found", op->level);
+            call_remote_stonith(op, result);
+
+        } else if ((op->state == st_exec) && op->awaiting_peers) {
+            crm_trace("Retrying fencing with new query result");
+            call_remote_stonith(op, result);
+
         } else if (have_all_replies) {
             crm_info("All topology query replies have arrived, continuing (%d expected/%d received) ",
                      replies_expected, op->replies);
@@ -1944,7 +2433,8 @@ process_remote_stonith_exec(xmlNode * msg)
         return -EOPNOTSUPP;
     }
 
-    if (op->devices && device && safe_str_neq(op->devices->data, device)) {
+    if ((op->devices_running == NULL)
+        && op->devices && device && safe_str_neq(op->devices->data, device)) {
         crm_err("Received outdated reply for device %s (instead of %s) to "
                 "fence (%s) %s. Operation already timed out at peer level.",
                 device, (const char *) op->devices->data, op->action, op->target);
@@ -1994,6 +2484,11 @@ process_remote_stonith_exec(xmlNode * msg)
             rc = pcmk_ok;
         }
 
+        if (op->devices_running != NULL) {
+            parallel_device_done(op, device, msg, rc);
+            return rc;
+        }
+
         if (rc == pcmk_ok) {
             /* An operation completed successfully. Try another device if
              * necessary, otherwise mark the operation as done. */
@@ -2030,12 +2525,48 @@ process_remote_stonith_exec(xmlNode * msg)
     return rc;
 }
 
+static void
+add_history_entry(xmlNode *list, const remote_fencing_op_t *op)
+{
+    xmlNode *entry = create_xml_node(list, STONITH_OP_EXEC);
+
+    crm_trace("Attaching op %s", op->id);
+    crm_xml_add(entry, F_STONITH_REMOTE_OP_ID, op->id);
+    crm_xml_add(entry, F_STONITH_TARGET, op->target);
+    crm_xml_add(entry, F_STONITH_ACTION, op->action);
+    crm_xml_add(entry, F_STONITH_ORIGIN, op->originator);
+    crm_xml_add(entry, F_STONITH_DELEGATE, op->delegate);
+    crm_xml_add(entry, F_STONITH_CLIENTNAME, op->client_name);
+    crm_xml_add_int(entry, F_STONITH_DATE, (int) op->completed);
+    crm_xml_add_int(entry, F_STONITH_STATE, op->state);
+}
+
+/*!
+ * \internal
+ * \brief Get the fencing history requested by a client
+ *
+ * \param[in]  msg     History request
+ * \param[out] output  Where to store history list
+ *
+ * \return 0
+ *
+ * \note If the request has F_STONITH_HISTORY_SINCE, only operations created or
+ *       completed since the history had that sequence number are listed
+ *       (unless the request's F_STONITH_HISTORY_INCARNATION is not the current
+ *       one, which means this fencer was restarted since then, in which case
+ *       everything is listed). The current sequence number and incarnation ID
+ *       are always returned as F_STONITH_HISTORY_SEQ and
+ *       F_STONITH_HISTORY_INCARNATION.
+ */
 int
 stonith_fence_history(xmlNode * msg, xmlNode ** output)
 {
     int rc = 0;
+    int since = 0;
     const char *target = NULL;
     xmlNode *dev = get_xpath_object("//@" F_STONITH_TARGET, msg, LOG_TRACE);
+    xmlNode *since_xml = get_xpath_object("//@" F_STONITH_HISTORY_SINCE, msg,
+                                          LOG_TRACE);
     char *nodename = NULL;
 
     if (dev) {
@@ -2053,31 +2584,56 @@ stonith_fence_history(xmlNode * msg, xmlNode ** output)
         }
     }
 
-    crm_trace("Looking for operations on %s in %p", target, remote_op_list);
+    if (history_incarnation == NULL) {
+        history_incarnation = crm_generate_uuid();
+    }
+
+    if (since_xml) {
+        const char *incarnation = NULL;
+
+        incarnation = crm_element_value(since_xml,
+                                        F_STONITH_HISTORY_INCARNATION);
+        crm_element_value_int(since_xml, F_STONITH_HISTORY_SINCE, &since);
+        if ((since < 0) || (since > history_seq)
+            || safe_str_neq(incarnation, history_incarnation)) {
+            since = 0;
+        }
+    }
+
+    crm_trace("Looking for operations on %s since %d in %p",
+              target, since, remote_op_list);
 
     *output = create_xml_node(NULL, F_STONITH_HISTORY_LIST);
-    if (remote_op_list) {
-        GHashTableIter iter;
-        remote_fencing_op_t *op = NULL;
+    crm_xml_add_int(*output, F_STONITH_HISTORY_SEQ, history_seq);
+    crm_xml_add(*output, F_STONITH_HISTORY_INCARNATION, history_incarnation);
 
-        g_hash_table_iter_init(&iter, remote_op_list);
-        while (g_hash_table_iter_next(&iter, NULL, (void **)&op)) {
-            xmlNode *entry = NULL;
+    if (op_history == NULL) {
+        // No operations yet
 
-            if (target && strcmp(op->target, target) != 0) {
-                continue;
+    } else if (since > 0) {
+        // Newest first, stopping at the first one the client already has
+        for (GList *iter = g_queue_peek_tail_link(op_history); iter != NULL;
+             iter = iter->prev) {
+            remote_fencing_op_t *op = iter->data;
+
+            if (op->history_seq <= since) {
+                break;
             }
+            if ((target == NULL) || safe_str_eq(op->target, target)) {
+                add_history_entry(*output, op);
+            }
+        }
 
-            rc = 0;
-            crm_trace("Attaching op %s", op->id);
-            entry = create_xml_node(*output, STONITH_OP_EXEC);
-            crm_xml_add(entry, F_STONITH_TARGET, op->target);
-            crm_xml_add(entry, F_STONITH_ACTION, op->action);
-            crm_xml_add(entry, F_STONITH_ORIGIN, op->originator);
-            crm_xml_add(entry, F_STONITH_DELEGATE, op->delegate);
-            crm_xml_add(entry, F_STONITH_CLIENTNAME, op->client_name);
-            crm_xml_add_int(entry, F_STONITH_DATE, (int) op->completed);
-            crm_xml_add_int(entry, F_STONITH_STATE, op->state);
+    } else if (target != NULL) {
+        for (GList *iter = g_hash_table_lookup(ops_by_target, target);
+             iter != NULL; iter = iter->next) {
+            add_history_entry(*output, iter->data);
+        }
+
+    } else {
+        for (GList *iter = g_queue_peek_head_link(op_history); iter != NULL;
+             iter = iter->next) {
+            add_history_entry(*output, iter->data);
         }
     }
 
@@ -2088,21 +2644,19 @@ stonith_fence_history(xmlNode * msg, xmlNode ** output)
 gboolean
 stonith_check_fence_tolerance(int tolerance, const char *target, const char *action)
 {
-    GHashTableIter iter;
     time_t now = time(NULL);
-    remote_fencing_op_t *rop = NULL;
 
     crm_trace("tolerance=%d, remote_op_list=%p", tolerance, remote_op_list);
 
-    if (tolerance <= 0 || !remote_op_list || target == NULL || action == NULL) {
+    if (tolerance <= 0 || !ops_by_target || target == NULL || action == NULL) {
         return FALSE;
     }
 
-    g_hash_table_iter_init(&iter, remote_op_list);
-    while (g_hash_table_iter_next(&iter, NULL, (void **)&rop)) {
-        if (strcmp(rop->target, target) != 0) {
-            continue;
-        } else if (rop->state != st_done) {
+    for (GList *iter = g_hash_table_lookup(ops_by_target, target);
+         iter != NULL; iter = iter->next) {
+        remote_fencing_op_t *rop = iter->data;
+
+        if (rop->state != st_done) {
             continue;
         /* We don't have to worry about remapped reboots here
          * because if state is done, any remapping has been undone
@@ -195,6 +195,17 @@ stonith_peer_ais_callback(cpg_handle_t handle,
         return;
     }
     if (kind == crm_class_cluster) {
+        char *op = NULL;
+
+        // Pokes are ignored anyway, so don't bother parsing them
+        if ((pcmk__xml_peek_attr(data, F_STONITH_OPERATION, &op) == pcmk_ok)
+            && crm_str_eq(op, "poke", TRUE)) {
+            free(op);
+            free(data);
+            return;
+        }
+        free(op);
+
         xml = string2xml(data);
         if (xml == NULL) {
             crm_err("Invalid XML: '%.120s'", data);
@@ -673,17 +684,36 @@ update_done:
 
 extern xmlNode *do_calculations(pe_working_set_t * data_set, xmlNode * xml_input, crm_time_t * now);
 
+// Check whether a resource or any of its children has an ID in a table
+static bool
+rsc_listed(resource_t *rsc, GHashTable *ids)
+{
+    if (g_hash_table_lookup(ids, rsc->id) || g_hash_table_lookup(ids, ID(rsc->xml))) {
+        return TRUE;
+    }
+    for (GListPtr gIter = rsc->children; gIter != NULL; gIter = gIter->next) {
+        if (rsc_listed(gIter->data, ids)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
 /*!
  * \internal
- * \brief Update all STONITH device definitions based on current CIB
+ * \brief Update STONITH device definitions based on current CIB
+ *
+ * \param[in] only  If not NULL, only update devices in resources (or with
+ *                  parents) whose IDs are keys in this table
  */
 static void
-cib_devices_update(void)
+cib_devices_update(GHashTable *only)
 {
     GListPtr gIter = NULL;
     pe_working_set_t data_set;
 
-    crm_info("Updating devices to version %s.%s.%s",
+    crm_info("Updating %s to version %s.%s.%s",
+             (only? "changed devices" : "devices"),
              crm_element_value(local_cib, XML_ATTR_GENERATION_ADMIN),
              crm_element_value(local_cib, XML_ATTR_GENERATION),
              crm_element_value(local_cib, XML_ATTR_NUMUPDATES));
@@ -698,71 +728,287 @@ cib_devices_update(void)
     do_calculations(&data_set, NULL, NULL);
 
     for (gIter = data_set.resources; gIter != NULL; gIter = gIter->next) {
-        cib_device_update(gIter->data, &data_set);
+        if ((only == NULL) || rsc_listed(gIter->data, only)) {
+            cib_device_update(gIter->data, &data_set);
+        }
     }
     data_set.input = NULL; /* Wasn't a copy */
     cleanup_alloc_calculations(&data_set);
 }
 
+/*
+ * Incremental device updates
+ *
+ * Evaluating devices means unpacking the whole configuration, so on a large
+ * cluster it should only be done when a change could affect a device. From a
+ * v2 patchset, only these changes are considered to:
+ *
+ * - a change to a resource that is, contains, or is registered as a device
+ *   re-evaluates that resource;
+ * - a change to a location constraint for such a resource re-evaluates the
+ *   resource, and so does a change to node attributes if the constraint has
+ *   rules (other constraints do not affect where devices may run);
+ * - deleting a resource, or changing it so it is no longer a fencing
+ *   resource, removes the affected devices without evaluating anything.
+ *
+ * Anything whose effect cannot be narrowed down this way (such as deleting a
+ * location constraint, or a constraint using a pattern or resource set)
+ * re-evaluates every device as before.
+ */
+
+// Check whether resource XML is or contains a fencing resource
+static bool
+xml_has_device(xmlNode *xml)
+{
+    if (crm_str_eq(TYPE(xml), XML_CIB_TAG_RESOURCE, TRUE)) {
+        const char *rclass = crm_element_value(xml, XML_AGENT_ATTR_CLASS);
+
+        // A primitive using a template could get its class from there
+        return safe_str_eq(rclass, PCMK_RESOURCE_CLASS_STONITH)
+               || (crm_element_value(xml, XML_CIB_TAG_RSC_TEMPLATE) != NULL);
+    }
+    for (xmlNode *child = __xml_first_child(xml); child != NULL;
+         child = __xml_next(child)) {
+        if (xml_has_device(child)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Find a resource in the locally cached CIB, by ID at any level
+static xmlNode *
+find_cib_resource(const char *id)
+{
+    char *xpath = crm_strdup_printf("//" XML_CIB_TAG_RESOURCES "//*[@id='%s']",
+                                    id);
+    xmlNode *match = get_xpath_object(xpath, local_cib, LOG_TRACE);
+
+    free(xpath);
+    return match;
+}
+
+// Check whether a resource ID is, contains, or is registered as a device
+static bool
+resource_has_device(const char *id)
+{
+    xmlNode *xml = find_cib_resource(id);
+
+    return (g_hash_table_lookup(device_list, id) != NULL)
+           || ((xml != NULL) && xml_has_device(xml));
+}
+
+/*!
+ * \internal
+ * \brief Get the ID of the top-level element of a CIB section that a change is in
+ *
+ * \param[in] change   Change from a v2 patchset
+ * \param[in] xpath    Path of \p change
+ * \param[in] section  Section name, preceded by a slash
+ *
+ * \return Newly allocated ID, or NULL if it cannot be determined
+ */
+static char *
+changed_element_id(xmlNode *change, const char *xpath, const char *section)
+{
+    const char *p = strstr(xpath, section);
+    const char *id = NULL;
+    const char *end = NULL;
+
+    if (p == NULL) {
+        return NULL;
+    }
+    p += strlen(section);
+
+    if (*p == '\0') {
+        // Creation of a top-level element, whose XML is in the change
+        return (change->children && ID(change->children))?
+               strdup(ID(change->children)) : NULL;
+    }
+
+    end = strchr(p + 1, '/');
+    id = strstr(p, "[@id='");
+    if ((*p != '/') || (id == NULL) || ((end != NULL) && (id > end))) {
+        return NULL;
+    }
+    id += strlen("[@id='");
+    end = strchr(id, '\'');
+    return end? strndup(id, end - id) : NULL;
+}
+
+// Add resources of location constraints with rules (FALSE if unknown)
+static bool
+add_rule_devices(GHashTable *changed)
+{
+    xmlNode *constraints = get_xpath_object("//" XML_CIB_TAG_CONSTRAINTS,
+                                            local_cib, LOG_TRACE);
+
+    for (xmlNode *cons = first_named_child(constraints,
+                                           XML_CONS_TAG_RSC_LOCATION);
+         cons != NULL; cons = crm_next_same_xml(cons)) {
+        const char *rsc = crm_element_value(cons, XML_LOC_ATTR_SOURCE);
+
+        if (first_named_child(cons, XML_TAG_RULE) == NULL) {
+            continue;
+        } else if (rsc == NULL) {
+            return FALSE;
+
+        } else if (resource_has_device(rsc)) {
+            char *copy = strdup(rsc);
+
+            g_hash_table_replace(changed, copy, copy);
+        }
+    }
+    return TRUE;
+}
+
+// Check whether a change modifies the resource a constraint applies to
+static bool
+changes_constraint_rsc(xmlNode *change)
+{
+    xmlNode *list = first_named_child(change, XML_DIFF_LIST);
+
+    for (xmlNode *attr = first_named_child(list, XML_DIFF_ATTR);
+         attr != NULL; attr = crm_next_same_xml(attr)) {
+        if (safe_str_eq(crm_element_value(attr, XML_NVPAIR_ATTR_NAME),
+                        XML_LOC_ATTR_SOURCE)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Check whether a resource ID in a table is no longer in the CIB
+static gboolean
+resource_gone(gpointer key, gpointer value, gpointer user_data)
+{
+    return find_cib_resource((const char *) key) == NULL;
+}
+
+// Remove devices whose fencing resources are no longer in the CIB
+static void
+remove_stale_devices(void)
+{
+    GHashTableIter iter;
+    const char *id = NULL;
+    stonith_device_t *device = NULL;
+    GList *stale = NULL;
+
+    g_hash_table_iter_init(&iter, device_list);
+    while (g_hash_table_iter_next(&iter, (gpointer *) &id,
+                                  (gpointer *) &device)) {
+        xmlNode *xml = NULL;
+
+        if (!device->cib_registered) {
+            continue;
+        }
+        xml = find_cib_resource(id);
+        if ((xml == NULL) || !xml_has_device(xml)) {
+            stale = g_list_prepend(stale, strdup(id));
+        }
+    }
+    for (GList *gIter = stale; gIter != NULL; gIter = gIter->next) {
+        crm_info("Device %s is no longer configured", (char *) gIter->data);
+        stonith_device_remove(gIter->data, TRUE);
+    }
+    g_list_free_full(stale, free);
+}
+
 static void
 update_cib_stonith_devices_v2(const char *event, xmlNode * msg)
 {
     xmlNode *change = NULL;
     char *reason = NULL;
     bool needs_update = FALSE;
+    bool resources_changed = FALSE;
+    GHashTable *changed = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                free, NULL);
     xmlNode *patchset = get_message_xml(msg, F_CIB_UPDATE_RESULT);
 
     for (change = __xml_first_child(patchset); change != NULL; change = __xml_next(change)) {
         const char *op = crm_element_value(change, XML_DIFF_OP);
         const char *xpath = crm_element_value(change, XML_DIFF_PATH);
-        const char *shortpath = NULL;
+        char *id = NULL;
 
         if(op == NULL || strcmp(op, "move") == 0) {
             continue;
 
-        } else if(safe_str_eq(op, "delete") && strstr(xpath, XML_CIB_TAG_RESOURCE)) {
-            const char *rsc_id = NULL;
-            char *search = NULL;
-            char *mutable = NULL;
-
-            if (strstr(xpath, XML_TAG_ATTR_SETS)) {
+        } else if(strstr(xpath, "/" XML_CIB_TAG_RESOURCES)) {
+            resources_changed = TRUE;
+            id = changed_element_id(change, xpath, "/" XML_CIB_TAG_RESOURCES);
+            if (id == NULL) {
+                reason = crm_strdup_printf("%s %s", op, xpath);
                 needs_update = TRUE;
                 break;
-            } 
-            mutable = strdup(xpath);
-            rsc_id = strstr(mutable, "primitive[@id=\'");
-            if (rsc_id != NULL) {
-                rsc_id += strlen("primitive[@id=\'");
-                search = strchr(rsc_id, '\'');
             }
-            if (search != NULL) {
-                *search = 0;
-                stonith_device_remove(rsc_id, TRUE);
+            if (resource_has_device(id)) {
+                g_hash_table_replace(changed, id, id);
             } else {
-                crm_warn("Ignoring malformed CIB update (resource deletion)");
+                free(id);
             }
-            free(mutable);
 
-        } else if(strstr(xpath, XML_CIB_TAG_RESOURCES)) {
-            shortpath = strrchr(xpath, '/'); CRM_ASSERT(shortpath);
-            reason = crm_strdup_printf("%s %s", op, shortpath+1);
-            needs_update = TRUE;
-            break;
+        } else if(strstr(xpath, "/" XML_CIB_TAG_CONSTRAINTS)) {
+            xmlNode *cons = NULL;
 
-        } else if(strstr(xpath, XML_CIB_TAG_CONSTRAINTS)) {
-            shortpath = strrchr(xpath, '/'); CRM_ASSERT(shortpath);
-            reason = crm_strdup_printf("%s %s", op, shortpath+1);
-            needs_update = TRUE;
-            break;
+            id = changed_element_id(change, xpath, "/" XML_CIB_TAG_CONSTRAINTS);
+            if (id != NULL) {
+                char *search = crm_strdup_printf("//" XML_CIB_TAG_CONSTRAINTS
+                                                 "/*[@id='%s']", id);
+
+                cons = get_xpath_object(search, local_cib, LOG_TRACE);
+                free(search);
+            }
+            free(id);
+
+            if ((cons != NULL)
+                && safe_str_neq(TYPE(cons), XML_CONS_TAG_RSC_LOCATION)) {
+                continue; // only location constraints affect devices
+
+            } else if ((cons == NULL)
+                       || (crm_element_value(cons, XML_LOC_ATTR_SOURCE) == NULL)
+                       || changes_constraint_rsc(change)) {
+                // It may have applied to a different resource before
+                reason = crm_strdup_printf("%s %s", op, xpath);
+                needs_update = TRUE;
+                break;
+            }
+
+            id = crm_element_value_copy(cons, XML_LOC_ATTR_SOURCE);
+            if (resource_has_device(id)) {
+                g_hash_table_replace(changed, id, id);
+            } else {
+                free(id);
+            }
+
+        } else if (strstr(xpath, "/" XML_CIB_TAG_CONFIGURATION
+                                 "/" XML_CIB_TAG_NODES)) {
+            if (!add_rule_devices(changed)) {
+                reason = crm_strdup_printf("%s %s", op, xpath);
+                needs_update = TRUE;
+                break;
+            }
         }
     }
 
     if(needs_update) {
         crm_info("Updating device list from the cib: %s", reason);
-        cib_devices_update();
+        cib_devices_update(NULL);
+
     } else {
-        crm_trace("No updates for device list found in cib");
+        if (resources_changed) {
+            remove_stale_devices();
+            g_hash_table_foreach_remove(changed, resource_gone, NULL);
+        }
+        if (g_hash_table_size(changed) > 0) {
+            crm_info("Updating %d resource%s in device list from the cib",
+                     g_hash_table_size(changed),
+                     ((g_hash_table_size(changed) == 1)? "" : "s"));
+            cib_devices_update(changed);
+        } else {
+            crm_trace("No updates for device list found in cib");
+        }
     }
+    g_hash_table_destroy(changed);
     free(reason);
 }
 
@@ -824,7 +1070,7 @@ update_cib_stonith_devices_v1(const char *event, xmlNode * msg)
 
     if(needs_update) {
         crm_info("Updating device list from the cib: %s", reason);
-        cib_devices_update();
+        cib_devices_update(NULL);
     }
 }
 
@@ -1082,7 +1328,7 @@ update_cib_cache_cb(const char *event, xmlNode * msg)
         crm_info("Updating stonith device and topology lists now that stonith is enabled");
         stonith_enabled_saved = TRUE;
         fencing_topology_init();
-        cib_devices_update();
+        cib_devices_update(NULL);
 
     } else {
         update_fencing_topology(event, msg);
@@ -1098,7 +1344,7 @@ init_cib_cache_cb(xmlNode * msg, int call_id, int rc, xmlNode * output, void *us
     local_cib = copy_xml(output);
 
     fencing_topology_init();
-    cib_devices_update();
+    cib_devices_update(NULL);
 }
 
 static void
@@ -1380,6 +1626,16 @@ main(int argc, char **argv)
         printf("    <content type=\"integer\" default=\"1\"/>\n");
         printf("  </parameter>\n");
 
+        printf("  <parameter name=\"%s\" unique=\"0\">\n", STONITH_ATTR_LIST_REFRESH);
+        printf
+            ("    <shortdesc lang=\"en\">How often to refresh the list of machines controlled by a device with %s=dynamic-list</shortdesc>\n",
+             STONITH_ATTR_HOSTCHECK);
+        printf
+            ("    <longdesc lang=\"en\">The list is refreshed in the background, so that fencing does not have to wait for the device to be queried.\n"
+             "A value of 0 disables background refreshes, so the device is queried when fencing if its list is more than a minute old.</longdesc>\n");
+        printf("    <content type=\"time\" default=\"60s\"/>\n");
+        printf("  </parameter>\n");
+
 
         for (lpc = 0; lpc < DIMOF(actions); lpc++) {
             printf("  <parameter name=\"pcmk_%s_action\" unique=\"0\">\n", actions[lpc]);
@@ -1481,6 +1737,9 @@ main(int argc, char **argv)
     }
 
     stonith_ipc_server_init(&ipcs, &ipc_callbacks);
+    if (stand_alone == FALSE) {
+        pcmk__notify_ready(crm_proc_fenced);
+    }
 
     /* Create the mainloop and run it... */
     mainloop = g_main_loop_new(NULL, FALSE);
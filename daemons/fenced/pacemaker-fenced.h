@@ -35,6 +35,8 @@ typedef struct stonith_device_s {
     char *on_target_actions;
     GListPtr targets;
     time_t targets_age;
+    mainloop_timer_t *list_timer;   /* refreshes targets in the background */
+    gboolean list_pending;          /* whether a background list is running */
     gboolean has_attr_map;
     /* should nodeid parameter for victim be included in agent arguments */
     gboolean include_nodeid;
@@ -53,6 +55,8 @@ typedef struct stonith_device_s {
     /*! A verified device is one that has contacted the
      * agent successfully to perform a monitor operation */
     gboolean verified;
+    /*! When the agent last succeeded at a list, monitor or status action */
+    time_t last_verified;
 
     gboolean cib_registered;
     gboolean api_registered;
@@ -142,11 +146,24 @@ typedef struct remote_fencing_op_s {
     GListPtr devices_list;
     /*! Current entry in the topology device list */
     GListPtr devices;
+    /*! Devices at the current level that were requested at the same time
+     * (see PCMK_fencing_parallel_devices) and have not yet returned */
+    GListPtr devices_running;
+    /*! First failure of the devices requested at the same time */
+    int parallel_rc;
+    /*! Whether no peer could be chosen until more query replies arrive */
+    gboolean awaiting_peers;
 
     /*! List of duplicate operations attached to this operation. Once this operation
      * completes, the duplicate operations will be closed out as well. */
     GListPtr duplicates;
 
+    /*! Value of the history sequence number when this operation was created
+     * or last completed */
+    int history_seq;
+    /*! This operation's entry in the history list */
+    GList *history_link;
+
 } remote_fencing_op_t;
 
 /*
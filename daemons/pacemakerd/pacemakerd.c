@@ -15,6 +15,7 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/reboot.h>
+#include <sys/syscall.h>
 
 #include <crm/msg_xml.h>
 #include <crm/common/ipcs.h>
@@ -47,6 +48,8 @@ typedef struct pcmk_child_s {
     const char *command;
 
     gboolean active_before_startup;
+    gboolean ready;     // Whether child has said it accepts connections
+    gboolean exit_watched;  // Whether non-child's exit is watched via pidfd
 } pcmk_child_t;
 
 /* Index into the array below */
@@ -83,6 +86,8 @@ static pcmk_child_t pcmk_children[] = {
     },
 };
 
+static gboolean polling_existing = FALSE;
+
 static gboolean start_child(pcmk_child_t * child);
 static gboolean check_active_before_startup_processes(gpointer user_data);
 static gboolean update_node_processes(uint32_t id, const char *uname,
@@ -103,11 +108,64 @@ get_process_list(void)
     return procs;
 }
 
+/*!
+ * \internal
+ * \brief Get the process flags of local daemons ready for connections
+ *
+ * \return Bitmask of crm_proc_* flags
+ */
+static uint32_t
+get_ready_list(void)
+{
+    uint32_t ready = 0;
+
+    for (int lpc = 0; lpc < SIZEOF(pcmk_children); lpc++) {
+        if ((pcmk_children[lpc].pid != 0) && pcmk_children[lpc].ready) {
+            ready |= pcmk_children[lpc].flag;
+        }
+    }
+    return ready;
+}
+
+/*!
+ * \internal
+ * \brief Record that a child daemon is ready, and tell clients
+ *
+ * \param[in] msg  Readiness notification from the daemon
+ *
+ * \note Daemons are identified by their process flag, because the system name
+ *       a daemon sends messages as is not the name it is started as.
+ */
+static void
+pcmk_child_ready(xmlNode *msg)
+{
+    int proc = 0;
+    const char *name = crm_element_value(msg, F_CRM_SYS_FROM);
+
+    crm_element_value_int(msg, F_CRM_PROC, &proc);
+    for (int lpc = 0; lpc < SIZEOF(pcmk_children); lpc++) {
+        pcmk_child_t *child = &(pcmk_children[lpc]);
+
+        if ((child->pid != 0) && (proc != 0) && (child->flag == proc)) {
+            if (child->ready == FALSE) {
+                crm_info("%s is ready " CRM_XS " pid=%d",
+                         child->name, child->pid);
+                child->ready = TRUE;
+                update_process_clients(NULL);
+            }
+            return;
+        }
+    }
+    crm_debug("Ignoring readiness notification from unknown daemon %s",
+              crm_str(name));
+}
+
 static void
 pcmk_process_exit(pcmk_child_t * child)
 {
     child->pid = 0;
     child->active_before_startup = FALSE;
+    child->ready = FALSE;
 
     /* Broadcast the fact that one of our processes died ASAP
      *
@@ -232,6 +290,7 @@ start_child(pcmk_child_t * child)
     const char *env_callgrind = getenv("PCMK_callgrind_enabled");
 
     child->active_before_startup = FALSE;
+    child->ready = FALSE;
 
     if (child->command == NULL) {
         crm_info("Nothing to do for child \"%s\"", child->name);
@@ -298,6 +357,9 @@ start_child(pcmk_child_t * child)
         }
         opts_default[0] = strdup(child->command);
 
+        // Apply any configured CPUs, scheduling policy and control group
+        pcmk__place_daemon(child->name);
+
         if(gid) {
             // Whether we need root group access to talk to cluster layer
             bool need_root_group = TRUE;
@@ -376,7 +438,10 @@ pcmk_shutdown_worker(gpointer user_data)
         phase = max;
 
         /* Add a second, more frequent, check to speed up shutdown */
-        g_timeout_add_seconds(5, check_active_before_startup_processes, NULL);
+        if (polling_existing) {
+            g_timeout_add_seconds(5, check_active_before_startup_processes,
+                                  NULL);
+        }
     }
 
     for (; phase > 0; phase--) {
@@ -495,6 +560,9 @@ pcmk_ipc_dispatch(qb_ipcs_connection_t * qbc, void *data, size_t size)
                    crm_element_value(msg, F_CRM_REFERENCE), crm_element_value(msg, F_CRM_ORIGIN));
         pcmk_shutdown(15);
 
+    } else if (crm_str_eq(task, CRM_OP_DAEMON_READY, TRUE)) {
+        pcmk_child_ready(msg);
+
     } else if (crm_str_eq(task, CRM_OP_RM_NODE_CACHE, TRUE)) {
         /* Send to everyone */
         struct iovec *iov;
@@ -563,6 +631,7 @@ update_process_clients(crm_client_t *client)
     if (is_corosync_cluster()) {
         crm_xml_add_int(update, "quorate", pcmk_quorate);
     }
+    crm_xml_add_int(update, "ready", (int) get_ready_list());
 
     g_hash_table_iter_init(&iter, crm_peer_cache);
     while (g_hash_table_iter_next(&iter, NULL, (gpointer *) & node)) {
@@ -679,6 +748,88 @@ mcp_chown(const char *path, uid_t uid, gid_t gid)
     }
 }
 
+/*
+ * Daemons that were already running when we started are not our children, so
+ * we do not get SIGCHLD when they exit. Where the kernel supports process file
+ * descriptors, each such daemon is watched with one, which becomes readable
+ * when the process exits. Otherwise, they are polled.
+ */
+
+struct exit_watch_s {
+    pcmk_child_t *child;
+    int pidfd;
+};
+
+static int
+open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int) syscall(SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int
+existing_process_exited(gpointer user_data)
+{
+    struct exit_watch_s *watch = user_data;
+
+    crm_notice("Process %s terminated (pid=%d)",
+               watch->child->name, watch->child->pid);
+    watch->child->exit_watched = FALSE;
+    pcmk_process_exit(watch->child);
+    return -1;
+}
+
+static void
+free_exit_watch(gpointer user_data)
+{
+    struct exit_watch_s *watch = user_data;
+
+    close(watch->pidfd);
+    free(watch);
+}
+
+static struct mainloop_fd_callbacks exit_watch_callbacks = {
+    .dispatch = existing_process_exited,
+    .destroy = free_exit_watch,
+};
+
+/*!
+ * \internal
+ * \brief Watch for the exit of a daemon that is not our child
+ *
+ * \param[in] child  Daemon to watch
+ *
+ * \return TRUE if the daemon is being watched, FALSE if it must be polled
+ */
+static gboolean
+watch_existing_process(pcmk_child_t *child)
+{
+    struct exit_watch_s *watch = NULL;
+    int pidfd = open_pidfd(child->pid);
+
+    if (pidfd < 0) {
+        crm_trace("Could not open process descriptor for %s (pid=%d): %s",
+                  child->name, child->pid, pcmk_strerror(errno));
+        return FALSE;
+    }
+
+    watch = calloc(1, sizeof(struct exit_watch_s));
+    CRM_ASSERT(watch != NULL);
+    watch->child = child;
+    watch->pidfd = pidfd;
+    if (mainloop_add_fd(child->name, G_PRIORITY_DEFAULT, pidfd, watch,
+                        &exit_watch_callbacks) == NULL) {
+        free_exit_watch(watch);
+        return FALSE;
+    }
+    child->exit_watched = TRUE;
+    return TRUE;
+}
+
 static gboolean
 check_active_before_startup_processes(gpointer user_data)
 {
@@ -691,6 +842,8 @@ check_active_before_startup_processes(gpointer user_data)
             if (pcmk_children[lpc].active_before_startup == FALSE) {
                 /* we are already tracking it as a child process. */
                 continue;
+            } else if (pcmk_children[lpc].exit_watched) {
+                continue;
             } else if (start_seq != pcmk_children[lpc].start_seq) {
                 continue;
             } else {
@@ -745,13 +898,17 @@ find_and_track_existing_processes(void)
                            pcmk_children[i].name, pid);
                 pcmk_children[i].pid = pid;
                 pcmk_children[i].active_before_startup = TRUE;
-                start_tracker = TRUE;
+                pcmk_children[i].ready = TRUE; // It won't tell us again
+                if (!watch_existing_process(&(pcmk_children[i]))) {
+                    start_tracker = TRUE;
+                }
                 break;
             }
         }
     }
 
     if (start_tracker) {
+        polling_existing = TRUE;
         g_timeout_add_seconds(PCMK_PROCESS_CHECK_INTERVAL, check_active_before_startup_processes,
                               NULL);
     }
@@ -1039,6 +1196,10 @@ main(int argc, char **argv)
     crm_build_path(CRM_BLACKBOX_DIR, 0750);
     mcp_chown(CRM_BLACKBOX_DIR, pcmk_uid, pcmk_gid);
 
+    // Used to cache agent meta-data in
+    crm_build_path(CRM_METADATA_DIR, 0750);
+    mcp_chown(CRM_METADATA_DIR, pcmk_uid, pcmk_gid);
+
     // Used to store scheduler inputs in
     crm_build_path(PE_STATE_DIR, 0750);
     mcp_chown(PE_STATE_DIR, pcmk_uid, pcmk_gid);
@@ -20,6 +20,7 @@
 
 #include <crm/common/ipcs.h>
 #include <crm/common/mainloop.h>
+#include <crm/cluster/internal.h>
 #include <crm/pengine/internal.h>
 #include <crm/msg_xml.h>
 
@@ -47,6 +48,7 @@ pe_ipc_created(qb_ipcs_connection_t * c)
 }
 
 gboolean process_pe_message(xmlNode * msg, xmlNode * xml_data, crm_client_t * sender);
+void sched_archive_flush(void);
 
 static int32_t
 pe_ipc_dispatch(qb_ipcs_connection_t * qbc, void *data, size_t size)
@@ -164,6 +166,7 @@ main(int argc, char **argv)
         crm_err("Failed to create IPC server: shutting down and inhibiting respawn");
         crm_exit(CRM_EX_FATAL);
     }
+    pcmk__notify_ready(crm_proc_schedulerd);
 
     /* Create the mainloop and run it... */
     crm_info("Starting %s", crm_system_name);
@@ -172,6 +175,7 @@ main(int argc, char **argv)
     g_main_loop_run(mainloop);
 
     crm_info("Exiting %s", crm_system_name);
+    sched_archive_flush();
     return crm_exit(CRM_EX_OK);
 }
 
@@ -179,5 +183,6 @@ void
 pengine_shutdown(int nsig)
 {
     mainloop_del_ipc_server(ipcs);
+    sched_archive_flush();
     crm_exit(CRM_EX_OK);
 }
@@ -286,7 +286,8 @@ check_action_definition(resource_t * rsc, node_t * active_node, xmlNode * xml_op
     if(digest_data->rc != RSC_DIGEST_MATCH
        && digest_secure
        && digest_data->digest_secure_calc
-       && strcmp(digest_data->digest_secure_calc, digest_secure) == 0) {
+       && pe__op_digest_eq(xml_op, XML_LRM_ATTR_SECURE_DIGEST,
+                           digest_data->digest_secure_calc)) {
         if (is_set(data_set->flags, pe_flag_stdout)) {
             printf("Only 'private' parameters to " CRM_OP_FMT " on %s changed: %s\n",
                    rsc->id, task, interval_ms, active_node->details->uname,
@@ -404,7 +405,7 @@ check_actions_for(xmlNode * rsc_entry, resource_t * rsc, node_t * node, pe_worki
         }
     }
 
-    sorted_op_list = g_list_sort(op_list, sort_op_by_callid);
+    sorted_op_list = pe__sort_ops_by_callid(op_list);
     calculate_active_ops(sorted_op_list, &start_index, &stop_index);
 
     for (gIter = sorted_op_list; gIter != NULL; gIter = gIter->next) {
@@ -745,6 +746,18 @@ set_alloc_actions(pe_working_set_t * data_set)
     }
 }
 
+/*
+ * Node health
+ *
+ * Each node's combined health is calculated once per transition, and the
+ * nodes whose health is not zero are collected (weighted by their health)
+ * into a single location constraint without a resource. Once the configured
+ * location constraints have been applied, that constraint is applied to each
+ * resource in turn, rather than creating a separate constraint (with its own
+ * node copy) for every combination of resource and unhealthy node.
+ */
+static rsc_to_node_t *health_constraint = NULL;
+
 static void
 calculate_system_health(gpointer gKey, gpointer gValue, gpointer user_data)
 {
@@ -774,6 +787,11 @@ apply_system_health(pe_working_set_t * data_set)
     const char *health_strategy = pe_pref(data_set->config_hash, "node-health-strategy");
     int base_health = 0;
 
+    if (health_constraint != NULL) { // left over from an unfinished calculation
+        pe_free_rsc_to_node(g_list_prepend(NULL, health_constraint));
+        health_constraint = NULL;
+    }
+
     if (health_strategy == NULL || safe_str_eq(health_strategy, "none")) {
         /* Prevent any accidental health -> score translation */
         node_score_red = 0;
@@ -831,28 +849,56 @@ apply_system_health(pe_working_set_t * data_set)
         crm_info(" Node %s has an combined system health of %d",
                  node->details->uname, system_health);
 
-        /* If the health is non-zero, then create a new rsc2node so that the
-         * weight will be added later on.
+        /* If the health is non-zero, remember it so that the weight will be
+         * added to every resource later on.
          */
         if (system_health != 0) {
-
-            GListPtr gIter2 = data_set->resources;
-
-            for (; gIter2 != NULL; gIter2 = gIter2->next) {
-                resource_t *rsc = (resource_t *) gIter2->data;
-
-                rsc2node_new(health_strategy, rsc, system_health, NULL, node, data_set);
+            node_t *copy = node_copy(node);
+
+            if (health_constraint == NULL) {
+                health_constraint = calloc(1, sizeof(rsc_to_node_t));
+                CRM_ASSERT(health_constraint != NULL);
+                health_constraint->id = strdup(health_strategy);
+                health_constraint->role_filter = RSC_ROLE_UNKNOWN;
+                health_constraint->discover_mode = pe_discover_always;
             }
+            copy->weight = system_health;
+            health_constraint->node_list_rh =
+                g_list_prepend(health_constraint->node_list_rh, copy);
         }
     }
 
     return TRUE;
 }
 
+/*!
+ * \internal
+ * \brief Add node health scores to every resource's allowed node weights
+ *
+ * \param[in] data_set  Cluster working set
+ */
+static void
+apply_node_health(pe_working_set_t *data_set)
+{
+    if (health_constraint == NULL) {
+        return;
+    }
+
+    for (GListPtr gIter = data_set->resources; gIter != NULL;
+         gIter = gIter->next) {
+        resource_t *rsc = (resource_t *) gIter->data;
+
+        health_constraint->rsc_lh = rsc;
+        rsc->cmds->rsc_location(rsc, health_constraint);
+    }
+    health_constraint->rsc_lh = NULL;
+}
+
 gboolean
 stage0(pe_working_set_t * data_set)
 {
     xmlNode *cib_constraints = get_object_root(XML_CIB_TAG_CONSTRAINTS, data_set->input);
+    sched_profile_mark_t start;
 
     if (data_set->input == NULL) {
         return FALSE;
@@ -860,12 +906,17 @@ stage0(pe_working_set_t * data_set)
 
     if (is_set(data_set->flags, pe_flag_have_status) == FALSE) {
         crm_trace("Calculating status");
+        start = sched_profile_mark();
         cluster_status(data_set);
+        sched_profile_record("cluster_status", &start, data_set);
     }
 
     set_alloc_actions(data_set);
     apply_system_health(data_set);
+
+    start = sched_profile_mark();
     unpack_constraints(cib_constraints, data_set);
+    sched_profile_record("unpack_constraints", &start, data_set);
 
     return TRUE;
 }
@@ -965,6 +1016,7 @@ stage2(pe_working_set_t * data_set)
     }
 
     apply_placement_constraints(data_set);
+    apply_node_health(data_set);
 
     gIter = data_set->nodes;
     for (; gIter != NULL; gIter = gIter->next) {
@@ -1148,6 +1200,17 @@ sort_rsc_process_order(gconstpointer a, gconstpointer b, gpointer data)
     return rc;
 }
 
+/*!
+ * \internal
+ * \brief Assign every resource to a node, in priority order
+ *
+ * \param[in,out] data_set  Cluster working set
+ *
+ * \note Allocation must stay serial, even for unrelated resources. The
+ *       allocators share the working set, the rule evaluation cache, static
+ *       buffers and the (non-thread-safe) logging, and node choice breaks
+ *       ties on cluster-wide node load.
+ */
 static void
 allocate_resources(pe_working_set_t * data_set)
 {
@@ -1433,11 +1496,11 @@ fence_guest(pe_node_t *node, pe_action_t *done, pe_working_set_t *data_set)
         crm_info("Implying guest node %s is down (action %d) after %s fencing",
                  node->details->uname, stonith_op->id, stop->node->details->uname);
         order_actions(parent_stonith_op, stonith_op,
-                      pe_order_runnable_left|pe_order_implies_then);
+                      pe_order_runnable_left|pe_order_implies_then, data_set);
 
     } else if (stop) {
         order_actions(stop, stonith_op,
-                      pe_order_runnable_left|pe_order_implies_then);
+                      pe_order_runnable_left|pe_order_implies_then, data_set);
         crm_info("Implying guest node %s is down (action %d) "
                  "after container %s is stopped (action %d)",
                  node->details->uname, stonith_op->id,
@@ -1452,7 +1515,7 @@ fence_guest(pe_node_t *node, pe_action_t *done, pe_working_set_t *data_set)
     /* Order/imply other actions relative to pseudo-fence as with real fence */
     stonith_constraints(node, stonith_op, data_set);
     if(done) {
-        order_actions(stonith_op, done, pe_order_implies_then);
+        order_actions(stonith_op, done, pe_order_implies_then, data_set);
     }
 }
 
@@ -1465,13 +1528,13 @@ stage6(pe_working_set_t * data_set)
     action_t *dc_down = NULL;
     action_t *dc_fence = NULL;
     action_t *stonith_op = NULL;
-    action_t *last_stonith = NULL;
     gboolean integrity_lost = FALSE;
     action_t *all_stopped = get_pseudo_op(ALL_STOPPED, data_set);
     action_t *done = get_pseudo_op(STONITH_DONE, data_set);
     gboolean need_stonith = TRUE;
     GListPtr gIter;
     GListPtr stonith_ops = NULL;
+    GListPtr last_stonith = NULL;
 
     /* Remote ordering constraints need to happen prior to calculate
      * fencing because it is one more place we will mark the node as
@@ -1519,13 +1582,11 @@ stage6(pe_working_set_t * data_set)
                 dc_fence = stonith_op;
 
             } else if (is_set(data_set->flags, pe_flag_concurrent_fencing) == FALSE) {
-                if (last_stonith) {
-                    order_actions(last_stonith, stonith_op, pe_order_optional);
-                }
-                last_stonith = stonith_op;
+                // Ordered by sched_order_fencing() once all are known
+                stonith_ops = g_list_append(stonith_ops, stonith_op);
 
             } else {
-                order_actions(stonith_op, done, pe_order_implies_then);
+                order_actions(stonith_op, done, pe_order_implies_then, data_set);
                 stonith_ops = g_list_append(stonith_ops, stonith_op);
             }
 
@@ -1556,6 +1617,10 @@ stage6(pe_working_set_t * data_set)
         }
     }
 
+    if (is_set(data_set->flags, pe_flag_concurrent_fencing) == FALSE) {
+        last_stonith = sched_order_fencing(stonith_ops, data_set);
+    }
+
     if (integrity_lost) {
         if (is_set(data_set->flags, pe_flag_stonith_enabled) == FALSE) {
             pe_warn("YOUR RESOURCES ARE NOW LIKELY COMPROMISED");
@@ -1588,38 +1653,34 @@ stage6(pe_working_set_t * data_set)
                       node_stop->node->details->uname,
                       dc_down->task, dc_down->node->details->uname);
 
-            order_actions(node_stop, dc_down, pe_order_optional);
+            order_actions(node_stop, dc_down, pe_order_optional, data_set);
         }
 
-        if (last_stonith) {
-            if (dc_down != last_stonith) {
-                order_actions(last_stonith, dc_down, pe_order_optional);
-            }
-
-        } else {
-            GListPtr gIter2 = NULL;
-
-            for (gIter2 = stonith_ops; gIter2 != NULL; gIter2 = gIter2->next) {
-                stonith_op = (action_t *) gIter2->data;
+        gIter = (last_stonith != NULL)? last_stonith : stonith_ops;
+        for (; gIter != NULL; gIter = gIter->next) {
+            stonith_op = (action_t *) gIter->data;
 
-                if (dc_down != stonith_op) {
-                    order_actions(stonith_op, dc_down, pe_order_optional);
-                }
+            if (dc_down != stonith_op) {
+                order_actions(stonith_op, dc_down, pe_order_optional, data_set);
             }
         }
     }
 
 
     if (dc_fence) {
-        order_actions(dc_down, done, pe_order_implies_then);
+        order_actions(dc_down, done, pe_order_implies_then, data_set);
 
-    } else if (last_stonith) {
-        order_actions(last_stonith, done, pe_order_implies_then);
+    } else {
+        for (gIter = last_stonith; gIter != NULL; gIter = gIter->next) {
+            order_actions((action_t *) gIter->data, done, pe_order_implies_then,
+                          data_set);
+        }
     }
 
-    order_actions(done, all_stopped, pe_order_implies_then);
+    order_actions(done, all_stopped, pe_order_implies_then, data_set);
 
     g_list_free(stonith_ops);
+    g_list_free(last_stonith);
     return TRUE;
 }
 
@@ -1658,7 +1719,8 @@ find_actions_by_task(GListPtr actions, resource_t * rsc, const char *original_ke
 }
 
 static void
-rsc_order_then(action_t * lh_action, resource_t * rsc, order_constraint_t * order)
+rsc_order_then(action_t * lh_action, resource_t * rsc, order_constraint_t * order,
+               pe_working_set_t * data_set)
 {
     GListPtr gIter = NULL;
     GListPtr rh_actions = NULL;
@@ -1699,7 +1761,7 @@ rsc_order_then(action_t * lh_action, resource_t * rsc, order_constraint_t * orde
         action_t *rh_action_iter = (action_t *) gIter->data;
 
         if (lh_action) {
-            order_actions(lh_action, rh_action_iter, type);
+            order_actions(lh_action, rh_action_iter, type, data_set);
 
         } else if (type & pe_order_implies_then) {
             update_action_flags(rh_action_iter, pe_action_runnable | pe_action_clear, __FUNCTION__, __LINE__);
@@ -1766,18 +1828,19 @@ rsc_order_first(resource_t * lh_rsc, order_constraint_t * order, pe_working_set_
             rh_rsc = order->rh_action->rsc;
         }
         if (rh_rsc) {
-            rsc_order_then(lh_action_iter, rh_rsc, order);
+            rsc_order_then(lh_action_iter, rh_rsc, order, data_set);
 
         } else if (order->rh_action) {
-            order_actions(lh_action_iter, order->rh_action, order->type);
+            order_actions(lh_action_iter, order->rh_action, order->type, data_set);
         }
     }
 
     g_list_free(lh_actions);
 }
 
-extern gboolean update_action(action_t * action);
-extern void update_colo_start_chain(action_t * action);
+extern gboolean update_action(action_t * action, pe_working_set_t * data_set);
+extern void update_colo_start_chain(action_t * action,
+                                    pe_working_set_t * data_set);
 
 static int
 is_recurring_action(action_t *action) 
@@ -1789,8 +1852,86 @@ is_recurring_action(action_t *action)
     return (interval_ms > 0);
 }
 
+/* Ordering-relevant details of a remote connection, gathered once per
+ * connection rather than once for every action on the remote node
+ */
+typedef struct remote_ordering_s {
+    resource_t *remote_rsc;
+    node_t *cluster_node;       // Node currently hosting the connection
+    enum remote_connection_state state;
+    action_t *start;            // Connection start, if there is exactly one
+    action_t *stop;             // Connection stop, if there is exactly one
+    action_t *container_start;  // Container start, if there is exactly one
+} remote_ordering_t;
+
+static action_t *
+find_unique_action(resource_t *rsc, char *key)
+{
+    action_t *action = NULL;
+    GListPtr matches = NULL;
+
+    if (rsc != NULL) {
+        matches = find_actions(rsc->actions, key, NULL);
+        if ((matches != NULL) && (matches->next == NULL)) {
+            action = (action_t *) matches->data;
+        }
+        g_list_free(matches);
+    }
+    free(key);
+    return action;
+}
+
+/*!
+ * \internal
+ * \brief Order a resource's start before an action, reusing a known start
+ *
+ * \param[in] lh_rsc     Resource whose start should come first
+ * \param[in] start      lh_rsc's start action, if already known
+ * \param[in] rh_action  Action to order after the start
+ * \param[in] extra      Ordering flags to add to the defaults
+ * \param[in] data_set   Cluster working set
+ */
 static void
-apply_container_ordering(action_t *action, pe_working_set_t *data_set)
+order_known_start_then_action(resource_t *lh_rsc, action_t *start,
+                              action_t *rh_action, enum pe_ordering extra,
+                              pe_working_set_t *data_set)
+{
+    if (start == NULL) {
+        order_start_then_action(lh_rsc, rh_action, extra, data_set);
+    } else {
+        custom_action_order(lh_rsc, NULL, start, rh_action->rsc, NULL,
+                            rh_action,
+                            pe_order_preserve | pe_order_runnable_left | extra,
+                            data_set);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Order an action before a resource's stop, reusing a known stop
+ *
+ * \param[in] lh_action  Action to order before the stop
+ * \param[in] rh_rsc     Resource whose stop should come second
+ * \param[in] stop       rh_rsc's stop action, if already known
+ * \param[in] extra      Ordering flags to add to the defaults
+ * \param[in] data_set   Cluster working set
+ */
+static void
+order_action_then_known_stop(action_t *lh_action, resource_t *rh_rsc,
+                             action_t *stop, enum pe_ordering extra,
+                             pe_working_set_t *data_set)
+{
+    if (stop == NULL) {
+        order_action_then_stop(lh_action, rh_rsc, extra, data_set);
+    } else {
+        custom_action_order(lh_action->rsc, NULL, lh_action, rh_rsc, NULL,
+                            stop, pe_order_preserve | extra, data_set);
+    }
+}
+
+static void
+apply_container_ordering(action_t *action, const remote_ordering_t *conn,
+                         pe_working_set_t *data_set)
 {
     /* VMs are also classified as containers for these purposes... in
      * that they both involve a 'thing' running on a real or remote
@@ -1807,7 +1948,7 @@ apply_container_ordering(action_t *action, pe_working_set_t *data_set)
     CRM_ASSERT(action->node);
     CRM_ASSERT(is_remote_node(action->node));
 
-    remote_rsc = action->node->details->remote_rsc;
+    remote_rsc = conn->remote_rsc;
     CRM_ASSERT(remote_rsc);
 
     container = remote_rsc->container;
@@ -1836,12 +1977,13 @@ apply_container_ordering(action_t *action, pe_working_set_t *data_set)
         case start_rsc:
         case action_promote:
             /* Force resource recovery if the container is recovered */
-            order_start_then_action(container, action, pe_order_implies_then,
-                                    data_set);
+            order_known_start_then_action(container, conn->container_start,
+                                          action, pe_order_implies_then,
+                                          data_set);
 
             /* Wait for the connection resource to be up too */
-            order_start_then_action(remote_rsc, action, pe_order_none,
-                                    data_set);
+            order_known_start_then_action(remote_rsc, conn->start, action,
+                                          pe_order_none, data_set);
             break;
 
         case stop_rsc:
@@ -1862,8 +2004,8 @@ apply_container_ordering(action_t *action, pe_working_set_t *data_set)
                  * stopped (otherwise we re-introduce an ordering loop when the
                  * connection is restarting).
                  */
-                order_action_then_stop(action, remote_rsc, pe_order_none,
-                                       data_set);
+                order_action_then_known_stop(action, remote_rsc, conn->stop,
+                                             pe_order_none, data_set);
             }
             break;
 
@@ -1875,12 +2017,14 @@ apply_container_ordering(action_t *action, pe_working_set_t *data_set)
                  * the connection was re-established
                  */
                 if(task != no_action) {
-                    order_start_then_action(remote_rsc, action,
-                                            pe_order_implies_then, data_set);
+                    order_known_start_then_action(remote_rsc, conn->start,
+                                                  action,
+                                                  pe_order_implies_then,
+                                                  data_set);
                 }
             } else {
-                order_start_then_action(remote_rsc, action, pe_order_none,
-                                        data_set);
+                order_known_start_then_action(remote_rsc, conn->start, action,
+                                              pe_order_none, data_set);
             }
             break;
     }
@@ -1963,11 +2107,12 @@ get_remote_node_state(pe_node_t *node)
  * \brief Order actions on remote node relative to actions for the connection
  */
 static void
-apply_remote_ordering(action_t *action, pe_working_set_t *data_set)
+apply_remote_ordering(action_t *action, const remote_ordering_t *conn,
+                      pe_working_set_t *data_set)
 {
     resource_t *remote_rsc = NULL;
     enum action_tasks task = text2task(action->task);
-    enum remote_connection_state state = get_remote_node_state(action->node);
+    enum remote_connection_state state = conn->state;
 
     enum pe_ordering order_opts = pe_order_none;
 
@@ -1978,7 +2123,7 @@ apply_remote_ordering(action_t *action, pe_working_set_t *data_set)
     CRM_ASSERT(action->node);
     CRM_ASSERT(is_remote_node(action->node));
 
-    remote_rsc = action->node->details->remote_rsc;
+    remote_rsc = conn->remote_rsc;
     CRM_ASSERT(remote_rsc);
 
     crm_trace("Order %s action %s relative to %s%s (state: %s)",
@@ -2005,13 +2150,14 @@ apply_remote_ordering(action_t *action, pe_working_set_t *data_set)
             }
 
             /* Ensure connection is up before running this action */
-            order_start_then_action(remote_rsc, action, order_opts, data_set);
+            order_known_start_then_action(remote_rsc, conn->start, action,
+                                          order_opts, data_set);
             break;
 
         case stop_rsc:
             if(state == remote_state_alive) {
-                order_action_then_stop(action, remote_rsc,
-                                       pe_order_implies_first, data_set);
+                order_action_then_known_stop(action, remote_rsc, conn->stop,
+                                             pe_order_implies_first, data_set);
 
             } else if(state == remote_state_failed) {
                 /* We would only be here if the resource is
@@ -2020,22 +2166,23 @@ apply_remote_ordering(action_t *action, pe_working_set_t *data_set)
                  * node.
                  */
                 pe_fence_node(data_set, action->node, "resources are active and the connection is unrecoverable");
-                order_action_then_stop(action, remote_rsc,
-                                       pe_order_implies_first, data_set);
+                order_action_then_known_stop(action, remote_rsc, conn->stop,
+                                             pe_order_implies_first, data_set);
 
             } else if(remote_rsc->next_role == RSC_ROLE_STOPPED) {
                 /* State must be remote_state_unknown or remote_state_stopped.
                  * Since the connection is not coming back up in this
                  * transition, stop this resource first.
                  */
-                order_action_then_stop(action, remote_rsc,
-                                       pe_order_implies_first, data_set);
+                order_action_then_known_stop(action, remote_rsc, conn->stop,
+                                             pe_order_implies_first, data_set);
 
             } else {
                 /* The connection is going to be started somewhere else, so
                  * stop this resource after that completes.
                  */
-                order_start_then_action(remote_rsc, action, pe_order_none, data_set);
+                order_known_start_then_action(remote_rsc, conn->start, action,
+                                              pe_order_none, data_set);
             }
             break;
 
@@ -2045,8 +2192,8 @@ apply_remote_ordering(action_t *action, pe_working_set_t *data_set)
              * blocked because the connection start would not be allowed.
              */
             if(state == remote_state_resting || state == remote_state_unknown) {
-                order_start_then_action(remote_rsc, action, pe_order_none,
-                                        data_set);
+                order_known_start_then_action(remote_rsc, conn->start, action,
+                                              pe_order_none, data_set);
             } /* Otherwise we can rely on the stop ordering */
             break;
 
@@ -2057,11 +2204,11 @@ apply_remote_ordering(action_t *action, pe_working_set_t *data_set)
                  * recurring monitors to be restarted, even if just
                  * the connection was re-established
                  */
-                order_start_then_action(remote_rsc, action,
-                                        pe_order_implies_then, data_set);
+                order_known_start_then_action(remote_rsc, conn->start, action,
+                                              pe_order_implies_then, data_set);
 
             } else {
-                node_t *cluster_node = pe__current_node(remote_rsc);
+                node_t *cluster_node = conn->cluster_node;
 
                 if(task == monitor_rsc && state == remote_state_failed) {
                     /* We would only be here if we do not know the
@@ -2080,25 +2227,66 @@ apply_remote_ordering(action_t *action, pe_working_set_t *data_set)
                      * stopped _before_ we let the connection get
                      * closed
                      */
-                    order_action_then_stop(action, remote_rsc,
-                                           pe_order_runnable_left, data_set);
+                    order_action_then_known_stop(action, remote_rsc,
+                                                 conn->stop,
+                                                 pe_order_runnable_left,
+                                                 data_set);
 
                 } else {
-                    order_start_then_action(remote_rsc, action, pe_order_none,
-                                            data_set);
+                    order_known_start_then_action(remote_rsc, conn->start,
+                                                  action, pe_order_none,
+                                                  data_set);
                 }
             }
             break;
     }
 }
 
+/*!
+ * \internal
+ * \brief Get the ordering details for a remote node's connection
+ *
+ * \param[in] connections  Table of details already gathered, by node
+ * \param[in] node         Remote node to get connection details for
+ *
+ * \return Connection details for \p node (owned by \p connections)
+ */
+static const remote_ordering_t *
+get_remote_ordering(GHashTable *connections, node_t *node)
+{
+    remote_ordering_t *conn = g_hash_table_lookup(connections, node->details);
+
+    if (conn == NULL) {
+        resource_t *remote_rsc = node->details->remote_rsc;
+
+        conn = calloc(1, sizeof(remote_ordering_t));
+        CRM_ASSERT(conn != NULL);
+        conn->remote_rsc = remote_rsc;
+        conn->cluster_node = pe__current_node(remote_rsc);
+        conn->state = get_remote_node_state(node);
+        conn->start = find_unique_action(remote_rsc, start_key(remote_rsc));
+        conn->stop = find_unique_action(remote_rsc, stop_key(remote_rsc));
+        if (remote_rsc->container != NULL) {
+            conn->container_start = find_unique_action(remote_rsc->container,
+                                                       start_key(remote_rsc->container));
+        }
+        g_hash_table_insert(connections, node->details, conn);
+    }
+    return conn;
+}
+
 static void
 apply_remote_node_ordering(pe_working_set_t *data_set)
 {
+    GHashTable *connections = NULL;
+
     if (is_set(data_set->flags, pe_flag_have_remote_nodes) == FALSE) {
         return;
     }
 
+    connections = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                        free);
+
     for (GListPtr gIter = data_set->actions; gIter != NULL; gIter = gIter->next) {
         action_t *action = (action_t *) gIter->data;
         resource_t *remote = NULL;
@@ -2163,13 +2351,20 @@ apply_remote_node_ordering(pe_working_set_t *data_set)
          */
         if (remote->container) {
             crm_trace("Container ordering for %s", action->uuid);
-            apply_container_ordering(action, data_set);
+            apply_container_ordering(action,
+                                     get_remote_ordering(connections,
+                                                         action->node),
+                                     data_set);
 
         } else {
             crm_trace("Remote ordering for %s", action->uuid);
-            apply_remote_ordering(action, data_set);
+            apply_remote_ordering(action,
+                                  get_remote_ordering(connections,
+                                                      action->node),
+                                  data_set);
         }
     }
+    g_hash_table_destroy(connections);
 }
 
 static void
@@ -2287,13 +2482,188 @@ order_probes(pe_working_set_t * data_set)
                 action_t *probe = (action_t *) pIter->data;
 
                 crm_err("Ordering %s before %s", first->uuid, probe->uuid);
-                order_actions(first, probe, pe_order_optional);
+                order_actions(first, probe, pe_order_optional, data_set);
             }
         }
     }
 #endif
 }
 
+/*
+ * Migration streams
+ *
+ * If migration-streams is positive, live migrations between each pair of
+ * nodes are divided into that many streams, each of which migrates one
+ * resource at a time, so that evacuating a node shares the links to its
+ * peers evenly instead of starting migrations in an arbitrary order until
+ * migration-limit is reached. Within each pair, resources are migrated in
+ * ascending order of their migration-weight meta-attribute (an estimate of
+ * how long they take to migrate, such as a VM's memory size), so the most
+ * resources are moved soonest.
+ *
+ * Streams are formed by optional orderings between migrations, which the
+ * controller's per-node job limits still apply on top of. Resources that are
+ * ordered relative to other resources are left out, so that the streams
+ * cannot create ordering loops.
+ */
+
+typedef struct migration_s {
+    resource_t *rsc;
+    action_t *migrate_to;
+    action_t *migrate_from;
+    const char *source;
+    const char *target;
+    int weight;
+} migration_t;
+
+static bool
+same_node_pair(const migration_t *migration1, const migration_t *migration2)
+{
+    return !strcmp(migration1->source, migration2->source)
+           && !strcmp(migration1->target, migration2->target);
+}
+
+// Sort migrations by node pair, then by weight
+static gint
+sort_migration(gconstpointer a, gconstpointer b)
+{
+    const migration_t *migration1 = a;
+    const migration_t *migration2 = b;
+    int rc = strcmp(migration1->source, migration2->source);
+
+    if (rc == 0) {
+        rc = strcmp(migration1->target, migration2->target);
+    }
+    if (rc != 0) {
+        return rc;
+    }
+    if (migration1->weight != migration2->weight) {
+        return (migration1->weight < migration2->weight)? -1 : 1;
+    }
+    return strcmp(migration1->rsc->id, migration2->rsc->id);
+}
+
+/*!
+ * \internal
+ * \brief Get top-level resources that are ordered relative to others
+ *
+ * \param[in] data_set  Cluster working set
+ *
+ * \return Newly created table of resources (which the caller should destroy)
+ */
+static GHashTable *
+ordered_resources(pe_working_set_t *data_set)
+{
+    GHashTable *ordered = g_hash_table_new(NULL, NULL);
+
+    for (GListPtr gIter = data_set->ordering_constraints; gIter != NULL;
+         gIter = gIter->next) {
+        order_constraint_t *order = (order_constraint_t *) gIter->data;
+        resource_t *first = order->lh_rsc;
+        resource_t *then = order->rh_rsc;
+
+        if ((first == NULL) && (order->lh_action != NULL)) {
+            first = order->lh_action->rsc;
+        }
+        if ((then == NULL) && (order->rh_action != NULL)) {
+            then = order->rh_action->rsc;
+        }
+        if ((first == NULL) || (then == NULL)) {
+            continue;
+        }
+        first = uber_parent(first);
+        then = uber_parent(then);
+        if (first != then) {
+            g_hash_table_add(ordered, first);
+            g_hash_table_add(ordered, then);
+        }
+    }
+    return ordered;
+}
+
+/*!
+ * \internal
+ * \brief Order live migrations into a limited number of streams per node pair
+ *
+ * \param[in] data_set  Cluster working set
+ */
+static void
+order_migration_streams(pe_working_set_t *data_set)
+{
+    int streams = crm_parse_int(pe_pref(data_set->config_hash,
+                                        "migration-streams"), "0");
+    GHashTable *ordered = NULL;
+    GList *migrations = NULL;
+    GList *previous = NULL;    // earliest migration not yet followed
+    int pair_len = 0;
+
+    if (streams <= 0) {
+        return;
+    }
+
+    ordered = ordered_resources(data_set);
+    for (GListPtr gIter = data_set->actions; gIter != NULL;
+         gIter = gIter->next) {
+        action_t *action = (action_t *) gIter->data;
+        action_t *migrate_from = NULL;
+        migration_t *migration = NULL;
+
+        if ((action->rsc == NULL) || (action->node == NULL)
+            || safe_str_neq(action->task, RSC_MIGRATE)
+            || is_set(action->flags, pe_action_optional)
+            || is_not_set(action->flags, pe_action_runnable)
+            || g_hash_table_contains(ordered, uber_parent(action->rsc))) {
+            continue;
+        }
+        migrate_from = find_first_action(action->rsc->actions, NULL,
+                                         RSC_MIGRATED, NULL);
+        if ((migrate_from == NULL) || (migrate_from->node == NULL)) {
+            continue;
+        }
+
+        migration = calloc(1, sizeof(migration_t));
+        CRM_ASSERT(migration != NULL);
+        migration->rsc = action->rsc;
+        migration->migrate_to = action;
+        migration->migrate_from = migrate_from;
+        migration->source = action->node->details->uname;
+        migration->target = migrate_from->node->details->uname;
+        migration->weight =
+            crm_parse_int(g_hash_table_lookup(action->rsc->meta,
+                                              XML_RSC_ATTR_MIGRATION_WEIGHT),
+                          "0");
+        migrations = g_list_prepend(migrations, migration);
+    }
+    g_hash_table_destroy(ordered);
+
+    /* Within each node pair, start the migration at position N only after the
+     * one at position N - streams completes
+     */
+    migrations = g_list_sort(migrations, sort_migration);
+    for (GList *gIter = migrations; gIter != NULL; gIter = gIter->next) {
+        migration_t *then = gIter->data;
+        migration_t *first = NULL;
+
+        if ((previous == NULL) || !same_node_pair(previous->data, then)) {
+            previous = gIter;
+            pair_len = 0;
+        }
+        if (++pair_len <= streams) {
+            continue;
+        }
+
+        first = previous->data;
+        previous = previous->next;
+        pe_rsc_trace(then->rsc,
+                     "Migrating %s from %s to %s after %s (stream %d of %d)",
+                     then->rsc->id, then->source, then->target, first->rsc->id,
+                     ((pair_len - 1) % streams) + 1, streams);
+        order_actions(first->migrate_from, then->migrate_to,
+                      pe_order_optional, data_set);
+    }
+    g_list_free_full(migrations, free);
+}
+
 gboolean
 stage7(pe_working_set_t * data_set)
 {
@@ -2324,18 +2694,18 @@ stage7(pe_working_set_t * data_set)
         rsc = order->rh_rsc;
         if (rsc != NULL) {
             crm_trace("action-to-rsc_action");
-            rsc_order_then(order->lh_action, rsc, order);
+            rsc_order_then(order->lh_action, rsc, order, data_set);
 
         } else {
             crm_trace("action-to-action");
-            order_actions(order->lh_action, order->rh_action, order->type);
+            order_actions(order->lh_action, order->rh_action, order->type, data_set);
         }
     }
 
     for (gIter = data_set->actions; gIter != NULL; gIter = gIter->next) {
         action_t *action = (action_t *) gIter->data;
 
-        update_colo_start_chain(action);
+        update_colo_start_chain(action, data_set);
     }
 
     crm_trace("Ordering probes");
@@ -2345,9 +2715,12 @@ stage7(pe_working_set_t * data_set)
     for (gIter = data_set->actions; gIter != NULL; gIter = gIter->next) {
         action_t *action = (action_t *) gIter->data;
 
-        update_action(action);
+        update_action(action, data_set);
     }
 
+    // Only now is it known which migrations will actually happen
+    order_migration_streams(data_set);
+
     LogNodeActions(data_set, FALSE);
     for (gIter = data_set->resources; gIter != NULL; gIter = gIter->next) {
         resource_t *rsc = (resource_t *) gIter->data;
@@ -2452,6 +2825,7 @@ stage8(pe_working_set_t * data_set)
     }
 
     crm_log_xml_trace(data_set->graph, "created generic action list");
+    find_graph_loops(data_set);
     crm_trace("Created transition graph %d.", transition_id);
 
     return TRUE;
@@ -2511,6 +2885,8 @@ cleanup_alloc_calculations(pe_working_set_t * data_set)
         return;
     }
 
+    reset_capacity_cache();
+
     crm_trace("deleting %d order cons: %p",
               g_list_length(data_set->ordering_constraints), data_set->ordering_constraints);
     pe_free_ordering(data_set->ordering_constraints);
@@ -2521,9 +2897,14 @@ cleanup_alloc_calculations(pe_working_set_t * data_set)
     pe_free_rsc_to_node(data_set->placement_constraints);
     data_set->placement_constraints = NULL;
 
+    if (health_constraint != NULL) {
+        pe_free_rsc_to_node(g_list_prepend(NULL, health_constraint));
+        health_constraint = NULL;
+    }
+
     crm_trace("deleting %d inter-resource cons: %p",
               g_list_length(data_set->colocation_constraints), data_set->colocation_constraints);
-    g_list_free_full(data_set->colocation_constraints, free);
+    g_list_free(data_set->colocation_constraints);  // Entries are in the arena
     data_set->colocation_constraints = NULL;
 
     crm_trace("deleting %d ticket deps: %p",
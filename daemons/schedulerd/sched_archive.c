@@ -0,0 +1,457 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#if HAVE_BZLIB_H
+#  include <bzlib.h>
+#endif
+
+#include <crm/crm.h>
+#include <crm/common/xml.h>
+
+#include <glib.h>
+
+#include <crm/pengine/internal.h>
+#include <pacemaker-schedulerd.h>
+#include <sched_utils.h>
+
+/*
+ * Scheduler input archive
+ *
+ * Every calculation's input is saved to a pe-input, pe-warn or pe-error file
+ * for later troubleshooting. Compressing and synchronizing those files can take
+ * a long time on a busy disk, so the input is serialized in the main thread,
+ * and then compressed, written and recorded in the series' .last file by a
+ * single background thread (so the files and sequence numbers are written in
+ * the order the calculations happened). At most ARCHIVE_QUEUE_MAX writes may
+ * be outstanding; beyond that, the scheduler waits for the writer to catch up
+ * rather than letting memory grow without bound. Logging is not thread-safe,
+ * so the writer only records the outcome of each write, and the main thread
+ * logs it once the write has completed.
+ *
+ * If pe-input-snapshot-interval is greater than 1, only inputs whose sequence
+ * number is a multiple of it (or that have no previous input to compare with)
+ * are saved in full, and all others are saved as the differences from the
+ * previous input in the series (see pe__read_input()). A chain of differences
+ * therefore never crosses a multiple of the interval, so when a file is
+ * overwritten after the series wraps, the old files up to the next multiple,
+ * which could otherwise be derived from it, are removed as well.
+ */
+
+#define ARCHIVE_QUEUE_MAX 16
+
+struct archive_job_s {
+    char *filename;
+    char *text;
+    char *series;
+    int sequence;
+    int wrap;
+    int stale_end;      // old files before this sequence number are obsolete
+    gboolean compress;
+
+    // Outcome, recorded by write_archive_file() and logged by log_archive_job()
+    int removed;        // number of obsolete files removed
+    size_t saved;       // number of bytes saved
+    gboolean compressed; // whether the saved data was compressed
+    int bz_rc;          // bzip2 error if compression failed, otherwise BZ_OK
+    const char *failed; // first step of the write that failed, if any
+    int failed_errno;   // errno from that step
+};
+
+struct archive_series_s {
+    int next;           // next sequence number, as of the last queued write
+    int last_sequence;  // sequence number of last queued write
+    char *last_file;    // base name of last queued write
+    xmlNode *last_input;
+};
+
+// Series name -> struct archive_series_s
+static GHashTable *archive_series = NULL;
+
+static void
+free_archive_series(gpointer data)
+{
+    struct archive_series_s *state = data;
+
+    free(state->last_file);
+    free_xml(state->last_input);
+    free(state);
+}
+
+static void
+free_archive_job(struct archive_job_s *job)
+{
+    free(job->filename);
+    free(job->text);
+    free(job->series);
+    free(job);
+}
+
+// Record a failed step of a write (in the writer thread, so without logging)
+static void
+archive_failed(struct archive_job_s *job, const char *step)
+{
+    if (job->failed == NULL) {
+        job->failed = step;
+        job->failed_errno = errno;
+    }
+}
+
+/*!
+ * \internal
+ * \brief Save a serialized scheduler input and update its series' .last file
+ *
+ * \param[in,out] job  Write to perform (its outcome will be recorded in it)
+ *
+ * \note This may run in the writer thread, so it must not log. The series'
+ *       .last file is written here rather than with write_last_sequence(),
+ *       which logs.
+ */
+static void
+write_archive_file(struct archive_job_s *job)
+{
+    FILE *stream = NULL;
+    char *compressed = NULL;
+    unsigned int compressed_len = 0;
+    size_t length = strlen(job->text);
+    int sequence = job->sequence + 1;
+
+    unlink(job->filename);
+    for (int lpc = job->sequence + 1; lpc < job->stale_end; lpc++) {
+        char *stale = generate_series_filename(PE_STATE_DIR, job->series, lpc,
+                                               job->compress);
+
+        if (unlink(stale) == 0) {
+            job->removed++;
+        }
+        free(stale);
+    }
+
+#if HAVE_BZLIB_H
+    if (job->compress) {
+        compressed_len = (length * 1.1) + 600; // recommended size
+        compressed = calloc(compressed_len, sizeof(char));
+        CRM_ASSERT(compressed != NULL);
+        job->bz_rc = BZ2_bzBuffToBuffCompress(compressed, &compressed_len,
+                                              job->text, length,
+                                              CRM_BZ2_BLOCKS, 0, CRM_BZ2_WORK);
+        if (job->bz_rc == BZ_OK) {
+            job->compressed = TRUE;
+        } else {
+            free(compressed);
+            compressed = NULL;
+        }
+    }
+#endif
+
+    stream = fopen(job->filename, "w");
+    if (stream == NULL) {
+        archive_failed(job, "save");
+
+    } else {
+        const char *data = compressed? compressed : job->text;
+        size_t data_len = compressed? compressed_len : length;
+
+        if (fwrite(data, 1, data_len, stream) != data_len) {
+            archive_failed(job, "write");
+        }
+        if (fflush(stream) != 0) {
+            archive_failed(job, "flush");
+        }
+
+        /* Don't report error if the file does not support synchronization */
+        if (fsync(fileno(stream)) < 0 && errno != EROFS && errno != EINVAL) {
+            archive_failed(job, "synchronize");
+        }
+        fclose(stream);
+        job->saved = data_len;
+    }
+    free(compressed);
+
+    if (job->wrap != 0) {
+        char *series_file = crm_strdup_printf("%s/%s.last", PE_STATE_DIR,
+                                              job->series);
+
+        if ((job->wrap > 0) && (sequence >= job->wrap)) {
+            sequence = 0;
+        }
+        stream = fopen(series_file, "w");
+        if ((stream == NULL) || (fprintf(stream, "%d", sequence) < 0)) {
+            archive_failed(job, "record sequence number of");
+        }
+        if (stream != NULL) {
+            fclose(stream);
+        }
+        free(series_file);
+    }
+}
+
+// Log the outcome of a completed write (in the main thread)
+static void
+log_archive_job(struct archive_job_s *job)
+{
+    if (job->removed > 0) {
+        crm_trace("Removed %d file%s that may have depended on %s",
+                  job->removed, ((job->removed == 1)? "" : "s"),
+                  job->filename);
+    }
+#if HAVE_BZLIB_H
+    if (job->compress && (job->bz_rc != BZ_OK)) {
+        crm_warn("Not compressing %s: %s " CRM_XS " bzerror=%d",
+                 job->filename, bz2_strerror(job->bz_rc), job->bz_rc);
+    }
+#endif
+    if (job->failed != NULL) {
+        crm_err("Could not %s scheduler input %s: %s",
+                job->failed, job->filename, pcmk_strerror(job->failed_errno));
+    } else {
+        crm_trace("Saved %lu bytes%s to %s", (unsigned long) job->saved,
+                  (job->compressed? " (compressed)" : ""), job->filename);
+    }
+}
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+
+static GThreadPool *archive_writer = NULL;
+static GAsyncQueue *archive_results = NULL; // completed writes to be logged
+static GMutex archive_lock;
+static GCond archive_done;
+static int archive_pending = 0;
+
+// Log and free completed writes (in the main thread)
+static gboolean
+report_archive_results(gpointer user_data)
+{
+    struct archive_job_s *job = NULL;
+
+    while ((job = g_async_queue_try_pop(archive_results)) != NULL) {
+        log_archive_job(job);
+        free_archive_job(job);
+    }
+    return FALSE;
+}
+
+static void
+archive_worker(gpointer data, gpointer user_data)
+{
+    write_archive_file(data);
+    g_async_queue_push(archive_results, data);
+    g_idle_add(report_archive_results, NULL);
+
+    g_mutex_lock(&archive_lock);
+    archive_pending--;
+    g_cond_broadcast(&archive_done);
+    g_mutex_unlock(&archive_lock);
+}
+
+// Wait until no more than \p limit writes are outstanding
+static void
+wait_for_archive(int limit)
+{
+    g_mutex_lock(&archive_lock);
+    while (archive_pending > limit) {
+        g_cond_wait(&archive_done, &archive_lock);
+    }
+    g_mutex_unlock(&archive_lock);
+}
+
+static gboolean
+queue_archive_job(struct archive_job_s *job)
+{
+    if (archive_writer == NULL) {
+        GError *error = NULL;
+
+        archive_writer = g_thread_pool_new(archive_worker, NULL, 1, FALSE,
+                                           &error);
+        if (archive_writer == NULL) {
+            crm_warn("Saving scheduler inputs synchronously: %s",
+                     (error? error->message : "could not create thread"));
+            g_clear_error(&error);
+            return FALSE;
+        }
+        archive_results = g_async_queue_new();
+    }
+
+    wait_for_archive(ARCHIVE_QUEUE_MAX - 1);
+
+    g_mutex_lock(&archive_lock);
+    archive_pending++;
+    g_mutex_unlock(&archive_lock);
+
+    g_thread_pool_push(archive_writer, job, NULL);
+    return TRUE;
+}
+
+#endif
+
+/*!
+ * \internal
+ * \brief Get the sequence number to use for the next file in a series
+ *
+ * \param[in] series  Name of file series
+ *
+ * \return Next sequence number, accounting for writes not yet completed
+ */
+int
+sched_archive_sequence(const char *series)
+{
+    struct archive_series_s *state = NULL;
+
+    if (archive_series != NULL) {
+        state = g_hash_table_lookup(archive_series, series);
+    }
+    if (state != NULL) {
+        return state->next;
+    }
+    return get_last_sequence(PE_STATE_DIR, series);
+}
+
+/*!
+ * \internal
+ * \brief Serialize the differences between two inputs
+ *
+ * \param[in] old_input  Previous input in series
+ * \param[in] input      Input to save
+ * \param[in] base_file  Base name of file \p old_input was saved as
+ *
+ * \return Newly allocated text of delta-encoded input, or NULL on error
+ */
+static char *
+dump_input_delta(xmlNode *old_input, xmlNode *input, const char *base_file)
+{
+    xmlNode *delta = NULL;
+    xmlNode *patchset = NULL;
+    xmlNode *target = NULL;
+    char *text = NULL;
+
+    if (safe_str_neq(crm_element_name(old_input), crm_element_name(input))) {
+        return NULL;
+    }
+
+    target = copy_xml(input);
+    xml_track_changes(target, NULL, NULL, FALSE);
+    xml_calculate_changes(old_input, target);
+    patchset = xml_create_patchset(2, old_input, target, NULL, FALSE);
+    xml_accept_changes(target);
+    free_xml(target);
+
+    delta = create_xml_node(NULL, PE__XML_INPUT_DELTA);
+    crm_xml_add(delta, PE__XML_ATTR_DELTA_BASE, base_file);
+    if (patchset != NULL) {
+        // No patchset means the inputs are identical
+        add_node_copy(delta, patchset);
+        free_xml(patchset);
+    }
+    text = dump_xml_formatted(delta);
+    free_xml(delta);
+    return text;
+}
+
+/*!
+ * \internal
+ * \brief Save a scheduler input to a file series
+ *
+ * \param[in] xml       Scheduler input to save
+ * \param[in] filename  Name of file to save input as
+ * \param[in] series    Name of file series that \p filename belongs to
+ * \param[in] sequence  Sequence number of \p filename within \p series
+ * \param[in] wrap      Maximum number of files to keep in \p series
+ * \param[in] interval  Save inputs in full only every this many files
+ *                      (0 or 1 to always save them in full)
+ * \param[in] compress  Whether to compress the file
+ *
+ * \note The input is serialized before returning, but may be written after
+ *       returning.
+ */
+void
+sched_archive_write(xmlNode *xml, const char *filename, const char *series,
+                    int sequence, int wrap, int interval, gboolean compress)
+{
+    struct archive_job_s *job = calloc(1, sizeof(struct archive_job_s));
+    struct archive_series_s *state = NULL;
+    const char *base_name = strrchr(filename, '/');
+
+    CRM_ASSERT(job != NULL);
+    base_name = base_name? (base_name + 1) : filename;
+
+    if (archive_series == NULL) {
+        archive_series = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                               free, free_archive_series);
+    }
+    state = g_hash_table_lookup(archive_series, series);
+    if (state == NULL) {
+        state = calloc(1, sizeof(struct archive_series_s));
+        CRM_ASSERT(state != NULL);
+        state->last_sequence = -1;
+        g_hash_table_insert(archive_series, strdup(series), state);
+    }
+
+    job->filename = strdup(filename);
+    job->series = strdup(series);
+    job->sequence = sequence;
+    job->wrap = wrap;
+    job->stale_end = sequence + 1;
+    job->compress = compress;
+
+    if (interval > 1) {
+        job->stale_end = ((sequence / interval) + 1) * interval;
+        if ((wrap > 0) && (job->stale_end > wrap)) {
+            job->stale_end = wrap;
+        }
+        if ((sequence % interval) && (state->last_input != NULL)
+            && (state->last_sequence == sequence - 1)) {
+            job->text = dump_input_delta(state->last_input, xml,
+                                         state->last_file);
+        }
+    }
+    if (job->text == NULL) {
+        job->text = dump_xml_formatted(xml);
+    }
+
+    free_xml(state->last_input);
+    free(state->last_file);
+    if (interval > 1) {
+        state->last_input = copy_xml(xml);
+        state->last_file = strdup(base_name);
+    } else {
+        state->last_input = NULL;
+        state->last_file = NULL;
+    }
+    state->last_sequence = sequence;
+    state->next = sequence + 1;
+    if ((wrap > 0) && (state->next >= wrap)) {
+        state->next = 0;
+    }
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    if (queue_archive_job(job)) {
+        return;
+    }
+#endif
+    write_archive_file(job);
+    log_archive_job(job);
+    free_archive_job(job);
+}
+
+/*!
+ * \internal
+ * \brief Wait for all queued scheduler inputs to be saved
+ */
+void
+sched_archive_flush(void)
+{
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    if (archive_writer != NULL) {
+        wait_for_archive(0);
+        report_archive_results(NULL);
+    }
+#endif
+}
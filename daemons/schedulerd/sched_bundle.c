@@ -27,7 +27,7 @@ is_child_container_node(container_variant_data_t *data, pe_node_t *node)
     return FALSE;
 }
 
-gint sort_clone_instance(gconstpointer a, gconstpointer b, gpointer data_set);
+GListPtr sort_clone_instances(GListPtr instances, pe_working_set_t *data_set);
 void distribute_children(resource_t *rsc, GListPtr children, GListPtr nodes,
                          int max, int per_host_max, pe_working_set_t * data_set);
 
@@ -120,7 +120,7 @@ container_color(resource_t * rsc, node_t * prefer, pe_working_set_t * data_set)
 
     nodes = g_hash_table_get_values(rsc->allowed_nodes);
     nodes = g_list_sort_with_data(nodes, sort_node_weight, NULL);
-    containers = g_list_sort_with_data(containers, sort_clone_instance, data_set);
+    containers = sort_clone_instances(containers, data_set);
     distribute_children(rsc, containers, nodes,
                         container_data->replicas, container_data->replicas_per_host, data_set);
     g_list_free(nodes);
@@ -578,7 +578,8 @@ tuple_for_docker(resource_t *rsc, resource_t *docker, node_t *node)
 
 static enum pe_graph_flags
 container_update_interleave_actions(action_t * first, action_t * then, node_t * node, enum pe_action_flags flags,
-                     enum pe_action_flags filter, enum pe_ordering type)
+                     enum pe_action_flags filter, enum pe_ordering type,
+                     pe_working_set_t * data_set)
 {
     GListPtr gIter = NULL;
     GListPtr children = NULL;
@@ -679,7 +680,7 @@ container_update_interleave_actions(action_t * first, action_t * then, node_t *
                 continue;
             }
 
-            if (order_actions(first_action, then_action, type)) {
+            if (order_actions(first_action, then_action, type, data_set)) {
                 crm_debug("Created constraint for %s (%d) -> %s (%d) %.6x",
                           first_action->uuid, is_set(first_action->flags, pe_action_optional),
                           then_action->uuid, is_set(then_action->flags, pe_action_optional), type);
@@ -688,7 +689,7 @@ container_update_interleave_actions(action_t * first, action_t * then, node_t *
             if(first_action && then_action) {
                 changed |= then_child->cmds->update_actions(first_action, then_action, node,
                                                             first_child->cmds->action_flags(first_action, node),
-                                                            filter, type);
+                                                            filter, type, data_set);
             } else {
                 crm_err("Nothing found either for %s (%p) or %s (%p) %s",
                         first_child->id, first_action,
@@ -736,21 +737,24 @@ bool can_interleave_actions(pe_action_t *first, pe_action_t *then)
 
 enum pe_graph_flags
 container_update_actions(action_t * first, action_t * then, node_t * node, enum pe_action_flags flags,
-                     enum pe_action_flags filter, enum pe_ordering type)
+                     enum pe_action_flags filter, enum pe_ordering type,
+                     pe_working_set_t * data_set)
 {
     enum pe_graph_flags changed = pe_graph_none;
 
     crm_trace("%s -> %s", first->uuid, then->uuid);
 
     if(can_interleave_actions(first, then)) {
-        changed = container_update_interleave_actions(first, then, node, flags, filter, type);
+        changed = container_update_interleave_actions(first, then, node, flags,
+                                                      filter, type, data_set);
 
     } else if(then->rsc) {
         GListPtr gIter = NULL;
         GListPtr children = NULL;
 
         // Handle the 'primitive' ordering case
-        changed |= native_update_actions(first, then, node, flags, filter, type);
+        changed |= native_update_actions(first, then, node, flags, filter, type,
+                                         data_set);
 
         // Now any children (or containers in the case of a bundle)
         children = get_containers_or_children(then->rsc);
@@ -764,13 +768,14 @@ container_update_actions(action_t * first, action_t * then, node_t * node, enum
 
                 if (is_set(then_child_flags, pe_action_runnable)) {
                     then_child_changed |=
-                        then_child->cmds->update_actions(first, then_child_action, node, flags, filter, type);
+                        then_child->cmds->update_actions(first, then_child_action, node, flags, filter, type,
+                                                         data_set);
                 }
                 changed |= then_child_changed;
                 if (then_child_changed & pe_graph_updated_then) {
                     for (GListPtr lpc = then_child_action->actions_after; lpc != NULL; lpc = lpc->next) {
                         action_wrapper_t *next = (action_wrapper_t *) lpc->data;
-                        update_action(next->action);
+                        update_action(next->action, data_set);
                     }
                 }
             }
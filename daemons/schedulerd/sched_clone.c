@@ -16,6 +16,7 @@
 #include <lib/pengine/variant.h>
 
 gint sort_clone_instance(gconstpointer a, gconstpointer b, gpointer data_set);
+GListPtr sort_clone_instances(GListPtr instances, pe_working_set_t *data_set);
 static void append_parent_colocation(resource_t * rsc, resource_t * child, gboolean all);
 
 static gint
@@ -62,8 +63,71 @@ did_fail(const resource_t * rsc)
     return FALSE;
 }
 
-gint
-sort_clone_instance(gconstpointer a, gconstpointer b, gpointer data_set)
+/*!
+ * \internal
+ * \brief Score an instance's current node, including parent colocations
+ *
+ * \param[in] rsc      Instance to score
+ * \param[in] current  Node that \p rsc is currently active on
+ * \param[in] scores   If not NULL, table of scores already calculated
+ *
+ * \return Score of \p current after merging in the colocation scores of
+ *         \p rsc's parent
+ * \note The score depends only on other resources' allowed nodes, which do not
+ *       change while instances are sorted, so it is cached in \p scores.
+ */
+static int
+instance_current_score(const resource_t *rsc, node_t *current,
+                       GHashTable *scores)
+{
+    gpointer cached = NULL;
+    GHashTable *hash = NULL;
+    node_t *node = NULL;
+    int score = 0;
+
+    if (scores && g_hash_table_lookup_extended(scores, rsc, NULL, &cached)) {
+        return GPOINTER_TO_INT(cached);
+    }
+
+    hash = g_hash_table_new_full(crm_str_hash, g_str_equal, NULL, free);
+    node = node_copy(current);
+    g_hash_table_insert(hash, (gpointer) node->details->id, node);
+
+    if (rsc->parent) {
+        for (GListPtr gIter = rsc->parent->rsc_cons; gIter; gIter = gIter->next) {
+            rsc_colocation_t *constraint = (rsc_colocation_t *) gIter->data;
+
+            crm_trace("Applying %s to %s", constraint->id, rsc->id);
+
+            hash = native_merge_weights(constraint->rsc_rh, rsc->id, hash,
+                                        constraint->node_attribute,
+                                        (float)constraint->score / INFINITY, 0);
+        }
+
+        for (GListPtr gIter = rsc->parent->rsc_cons_lhs; gIter; gIter = gIter->next) {
+            rsc_colocation_t *constraint = (rsc_colocation_t *) gIter->data;
+
+            crm_trace("Applying %s to %s", constraint->id, rsc->id);
+
+            hash = native_merge_weights(constraint->rsc_lh, rsc->id, hash,
+                                        constraint->node_attribute,
+                                        (float)constraint->score / INFINITY, pe_weights_positive);
+        }
+    }
+
+    node = g_hash_table_lookup(hash, current->details->id);
+    score = node->weight;
+    g_hash_table_destroy(hash);
+
+    if (scores) {
+        g_hash_table_insert(scores, (gpointer) rsc, GINT_TO_POINTER(score));
+    }
+    return score;
+}
+
+static gint
+compare_clone_instances(const resource_t *resource1,
+                        const resource_t *resource2, GHashTable *scores)
 {
     int rc = 0;
     node_t *node1 = NULL;
@@ -76,9 +140,6 @@ sort_clone_instance(gconstpointer a, gconstpointer b, gpointer data_set)
     gboolean can1 = TRUE;
     gboolean can2 = TRUE;
 
-    const resource_t *resource1 = (const resource_t *)a;
-    const resource_t *resource2 = (const resource_t *)b;
-
     CRM_ASSERT(resource1 != NULL);
     CRM_ASSERT(resource2 != NULL);
 
@@ -206,135 +267,23 @@ sort_clone_instance(gconstpointer a, gconstpointer b, gpointer data_set)
     }
 
     if (node1 && node2) {
-        int lpc = 0;
-        int max = 0;
-        node_t *n = NULL;
-        GListPtr gIter = NULL;
-        GListPtr list1 = NULL;
-        GListPtr list2 = NULL;
-        GHashTable *hash1 =
-            g_hash_table_new_full(crm_str_hash, g_str_equal, NULL, free);
-        GHashTable *hash2 =
-            g_hash_table_new_full(crm_str_hash, g_str_equal, NULL, free);
-
-        n = node_copy(current_node1);
-        g_hash_table_insert(hash1, (gpointer) n->details->id, n);
-
-        n = node_copy(current_node2);
-        g_hash_table_insert(hash2, (gpointer) n->details->id, n);
-
-        if(resource1->parent) {
-            for (gIter = resource1->parent->rsc_cons; gIter; gIter = gIter->next) {
-                rsc_colocation_t *constraint = (rsc_colocation_t *) gIter->data;
-
-                crm_trace("Applying %s to %s", constraint->id, resource1->id);
-
-                hash1 = native_merge_weights(constraint->rsc_rh, resource1->id, hash1,
-                                             constraint->node_attribute,
-                                             (float)constraint->score / INFINITY, 0);
-            }
-
-            for (gIter = resource1->parent->rsc_cons_lhs; gIter; gIter = gIter->next) {
-                rsc_colocation_t *constraint = (rsc_colocation_t *) gIter->data;
-
-                crm_trace("Applying %s to %s", constraint->id, resource1->id);
-
-                hash1 = native_merge_weights(constraint->rsc_lh, resource1->id, hash1,
-                                             constraint->node_attribute,
-                                             (float)constraint->score / INFINITY, pe_weights_positive);
-            }
-        }
-
-        if(resource2->parent) {
-            for (gIter = resource2->parent->rsc_cons; gIter; gIter = gIter->next) {
-                rsc_colocation_t *constraint = (rsc_colocation_t *) gIter->data;
-
-                crm_trace("Applying %s to %s", constraint->id, resource2->id);
-
-                hash2 = native_merge_weights(constraint->rsc_rh, resource2->id, hash2,
-                                             constraint->node_attribute,
-                                             (float)constraint->score / INFINITY, 0);
-            }
+        int score1 = instance_current_score(resource1, current_node1, scores);
+        int score2 = instance_current_score(resource2, current_node2, scores);
 
-            for (gIter = resource2->parent->rsc_cons_lhs; gIter; gIter = gIter->next) {
-                rsc_colocation_t *constraint = (rsc_colocation_t *) gIter->data;
-
-                crm_trace("Applying %s to %s", constraint->id, resource2->id);
-
-                hash2 = native_merge_weights(constraint->rsc_lh, resource2->id, hash2,
-                                             constraint->node_attribute,
-                                             (float)constraint->score / INFINITY, pe_weights_positive);
-            }
-        }
-
-        /* Current location score */
-        node1 = g_hash_table_lookup(hash1, current_node1->details->id);
-        node2 = g_hash_table_lookup(hash2, current_node2->details->id);
-
-        if (node1->weight < node2->weight) {
-            if (node1->weight < 0) {
-                crm_trace("%s > %s: current score: %d %d", resource1->id, resource2->id, node1->weight, node2->weight);
-                rc = -1;
-                goto out;
-
-            } else {
-                crm_trace("%s < %s: current score: %d %d", resource1->id, resource2->id, node1->weight, node2->weight);
-                rc = 1;
-                goto out;
-            }
-
-        } else if (node1->weight > node2->weight) {
-            crm_trace("%s > %s: current score: %d %d", resource1->id, resource2->id, node1->weight, node2->weight);
-            rc = -1;
-            goto out;
-        }
-
-        /* All location scores */
-        list1 = g_hash_table_get_values(hash1);
-        list2 = g_hash_table_get_values(hash2);
-
-        list1 = g_list_sort_with_data(list1, sort_node_weight, current_node1);
-        list2 = g_list_sort_with_data(list2, sort_node_weight, current_node2);
-        max = g_list_length(list1);
-        if (max < g_list_length(list2)) {
-            max = g_list_length(list2);
-        }
-
-        for (; lpc < max; lpc++) {
-            node1 = g_list_nth_data(list1, lpc);
-            node2 = g_list_nth_data(list2, lpc);
-            if (node1 == NULL) {
-                crm_trace("%s < %s: colocated score NULL", resource1->id, resource2->id);
-                rc = 1;
-                break;
-
-            } else if (node2 == NULL) {
-                crm_trace("%s > %s: colocated score NULL", resource1->id, resource2->id);
-                rc = -1;
-                break;
-            }
-
-            if (node1->weight < node2->weight) {
-                crm_trace("%s < %s: colocated score", resource1->id, resource2->id);
-                rc = 1;
-                break;
-
-            } else if (node1->weight > node2->weight) {
-                crm_trace("%s > %s: colocated score", resource1->id, resource2->id);
-                rc = -1;
-                break;
+        /* Only the current node is scored, so there are no other colocated
+         * location scores to compare
+         */
+        if (score1 < score2) {
+            if (score1 < 0) {
+                crm_trace("%s > %s: current score: %d %d", resource1->id, resource2->id, score1, score2);
+                return -1;
             }
-        }
-
-        /* Order by reverse uname - same as sort_node_weight() does? */
-  out:
-        g_hash_table_destroy(hash1);    /* Free mem */
-        g_hash_table_destroy(hash2);    /* Free mem */
-        g_list_free(list1);
-        g_list_free(list2);
+            crm_trace("%s < %s: current score: %d %d", resource1->id, resource2->id, score1, score2);
+            return 1;
 
-        if (rc != 0) {
-            return rc;
+        } else if (score1 > score2) {
+            crm_trace("%s > %s: current score: %d %d", resource1->id, resource2->id, score1, score2);
+            return -1;
         }
     }
 
@@ -343,6 +292,43 @@ sort_clone_instance(gconstpointer a, gconstpointer b, gpointer data_set)
     return rc;
 }
 
+gint
+sort_clone_instance(gconstpointer a, gconstpointer b, gpointer data_set)
+{
+    return compare_clone_instances((const resource_t *) a,
+                                   (const resource_t *) b, NULL);
+}
+
+static gint
+sort_clone_instance_cached(gconstpointer a, gconstpointer b, gpointer scores)
+{
+    return compare_clone_instances((const resource_t *) a,
+                                   (const resource_t *) b, scores);
+}
+
+/*!
+ * \internal
+ * \brief Sort instances into the order they should be allocated
+ *
+ * \param[in] instances  List of instances to sort
+ * \param[in] data_set   Cluster working set
+ *
+ * \return Sorted list
+ * \note This is equivalent to sorting with sort_clone_instance(), except that
+ *       each instance's colocated score is calculated only once rather than
+ *       for every comparison, which matters for clones with many instances.
+ */
+GListPtr
+sort_clone_instances(GListPtr instances, pe_working_set_t *data_set)
+{
+    GHashTable *scores = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    instances = g_list_sort_with_data(instances, sort_clone_instance_cached,
+                                      scores);
+    g_hash_table_destroy(scores);
+    return instances;
+}
+
 static node_t *
 can_run_instance(resource_t * rsc, node_t * node, int limit)
 {
@@ -623,7 +609,7 @@ clone_color(resource_t *rsc, node_t *prefer, pe_working_set_t *data_set)
 
     nodes = g_hash_table_get_values(rsc->allowed_nodes);
     nodes = g_list_sort_with_data(nodes, sort_node_weight, NULL);
-    rsc->children = g_list_sort_with_data(rsc->children, sort_clone_instance, data_set);
+    rsc->children = sort_clone_instances(rsc->children, data_set);
     distribute_children(rsc, rsc->children, nodes, clone_data->clone_max, clone_data->clone_node_max, data_set);
     g_list_free(nodes);
 
@@ -781,7 +767,7 @@ child_ordering_constraints(resource_t * rsc, pe_working_set_t * data_set)
         if (stop) {
             if (last_stop) {
                 /* child/child relative stop */
-                order_actions(stop, last_stop, pe_order_optional);
+                order_actions(stop, last_stop, pe_order_optional, data_set);
             }
             last_stop = stop;
         }
@@ -789,7 +775,7 @@ child_ordering_constraints(resource_t * rsc, pe_working_set_t * data_set)
         if (start) {
             if (last_start) {
                 /* child/child relative start */
-                order_actions(last_start, start, pe_order_optional);
+                order_actions(last_start, start, pe_order_optional, data_set);
             }
             last_start = start;
         }
@@ -866,7 +852,8 @@ clone_create_pseudo_actions(
         *stop_notify = create_notification_boundaries(rsc, RSC_STOP, stop, stopped, data_set);
 
         if (start_notify && *start_notify && *stop_notify) {
-            order_actions((*stop_notify)->post_done, (*start_notify)->pre, pe_order_optional);
+            order_actions((*stop_notify)->post_done, (*start_notify)->pre,
+                          pe_order_optional, data_set);
         }
     }
 }
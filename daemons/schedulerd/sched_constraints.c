@@ -47,12 +47,38 @@ static rsc_to_node_t *generate_location_rule(resource_t * rsc, xmlNode * rule_xm
                                              const char *discovery, pe_working_set_t * data_set,
                                              pe_match_data_t * match_data);
 
+/* Location rules are evaluated once per node for every resource they apply
+ * to, and an rsc-pattern constraint may apply to hundreds of resources. Unless
+ * a rule uses regular expression submatches or resource parameters, its
+ * result on a node is the same for all of them, so it is remembered here
+ * (by rule ID) while constraints are being unpacked.
+ */
+struct location_rule_results_s {
+    gboolean uses_match_data;
+    GHashTable *accepted;   // node ID -> GINT_TO_POINTER(accept + 1)
+};
+
+static GHashTable *location_rule_results = NULL;
+
+static void
+free_location_rule_results(gpointer data)
+{
+    struct location_rule_results_s *results = data;
+
+    g_hash_table_destroy(results->accepted);
+    free(results);
+}
+
 gboolean
 unpack_constraints(xmlNode * xml_constraints, pe_working_set_t * data_set)
 {
     xmlNode *xml_obj = NULL;
     xmlNode *lifetime = NULL;
 
+    location_rule_results = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                  free,
+                                                  free_location_rule_results);
+
     for (xml_obj = __xml_first_child(xml_constraints); xml_obj != NULL;
          xml_obj = __xml_next_element(xml_obj)) {
         const char *id = crm_element_value(xml_obj, XML_ATTR_ID);
@@ -92,6 +118,8 @@ unpack_constraints(xmlNode * xml_constraints, pe_working_set_t * data_set)
         }
     }
 
+    g_hash_table_destroy(location_rule_results);
+    location_rule_results = NULL;
     return TRUE;
 }
 
@@ -168,24 +196,18 @@ get_ordering_type(xmlNode * xml_obj)
 static resource_t *
 pe_find_constraint_resource(GListPtr rsc_list, const char *id)
 {
-    GListPtr rIter = NULL;
-
-    for (rIter = rsc_list; id && rIter; rIter = rIter->next) {
-        resource_t *parent = rIter->data;
-        resource_t *match = parent->fns->find_rsc(parent, id, NULL,
-                                                  pe_find_renamed);
-
-        if (match != NULL) {
-            if(safe_str_neq(match->id, id)) {
-                /* We found an instance of a clone instead */
-                match = uber_parent(match);
-                crm_debug("Found %s for %s", match->id, id);
-            }
-            return match;
-        }
+    /* This uses the working set's resource indexes when possible, rather
+     * than searching every resource tree for each constraint reference
+     */
+    resource_t *match = pe_find_resource_with_flags(rsc_list, id,
+                                                    pe_find_renamed);
+
+    if ((match != NULL) && safe_str_neq(match->id, id)) {
+        /* We found an instance of a clone instead */
+        match = uber_parent(match);
+        crm_debug("Found %s for %s", match->id, id);
     }
-    crm_trace("No match for %s", id);
-    return NULL;
+    return match;
 }
 
 static gboolean
@@ -479,6 +501,38 @@ unpack_simple_rsc_order(xmlNode * xml_obj, pe_working_set_t * data_set)
     return TRUE;
 }
 
+/*!
+ * \internal
+ * \brief Check whether a constraint's resource sets might reference tags
+ *
+ * \param[in] xml_obj   Constraint XML
+ * \param[in] data_set  Cluster working set
+ *
+ * \return FALSE if every resource reference in every set of \p xml_obj is a
+ *         resource, otherwise TRUE (a template, tag or invalid reference)
+ */
+static gboolean
+sets_need_expansion(xmlNode *xml_obj, pe_working_set_t *data_set)
+{
+    for (xmlNode *set = __xml_first_child(xml_obj); set != NULL;
+         set = __xml_next_element(set)) {
+
+        if (safe_str_neq((const char *)set->name, XML_CONS_TAG_RSC_SET)) {
+            continue;
+        }
+        for (xmlNode *xml_rsc = __xml_first_child(set); xml_rsc != NULL;
+             xml_rsc = __xml_next_element(xml_rsc)) {
+
+            if (safe_str_eq((const char *)xml_rsc->name, XML_TAG_RESOURCE_REF)
+                && (pe_find_constraint_resource(data_set->resources,
+                                                ID(xml_rsc)) == NULL)) {
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
 static gboolean
 expand_tags_in_sets(xmlNode * xml_obj, xmlNode ** expanded_xml, pe_working_set_t * data_set)
 {
@@ -494,6 +548,11 @@ expand_tags_in_sets(xmlNode * xml_obj, xmlNode ** expanded_xml, pe_working_set_t
         return FALSE;
     }
 
+    /* Most constraints reference only resources, so avoid copying them */
+    if (!sets_need_expansion(xml_obj, data_set)) {
+        return TRUE;
+    }
+
     new_xml = copy_xml(xml_obj);
     cons_id = ID(new_xml);
 
@@ -1016,6 +1075,84 @@ get_node_score(const char *rule, const char *score, gboolean raw, node_t * node,
     return score_f;
 }
 
+/*!
+ * \internal
+ * \brief Check whether a rule's result can depend on the resource it is for
+ *
+ * \param[in] rule  Rule XML (with any id-ref already expanded)
+ *
+ * \return TRUE if any expression in \p rule (or its nested rules) uses
+ *         regular expression submatches or a param/meta value-source
+ */
+static gboolean
+rule_uses_match_data(xmlNode *rule)
+{
+    for (xmlNode *expr = __xml_first_child(rule); expr != NULL;
+         expr = __xml_next_element(expr)) {
+
+        const char *tag = crm_element_name(expr);
+
+        if (safe_str_eq(tag, XML_TAG_RULE)) {
+            if (rule_uses_match_data(expand_idref(expr, NULL))) {
+                return TRUE;
+            }
+
+        } else if (safe_str_eq(tag, XML_TAG_EXPRESSION)) {
+            const char *attr = crm_element_value(expr, XML_EXPR_ATTR_ATTRIBUTE);
+            const char *source = crm_element_value(expr,
+                                                   XML_EXPR_ATTR_VALUE_SOURCE);
+
+            if ((attr && strchr(attr, '%'))
+                || safe_str_eq(source, "param")
+                || safe_str_eq(source, "meta")) {
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+static gboolean
+test_location_rule(xmlNode *rule_xml, node_t *node, pe_working_set_t *data_set,
+                   pe_match_data_t *match_data)
+{
+    const char *rule_id = ID(rule_xml);
+    struct location_rule_results_s *results = NULL;
+    gpointer cached = NULL;
+    gboolean accept = FALSE;
+
+    if ((location_rule_results == NULL) || (rule_id == NULL)
+        || (node->details->id == NULL)) {
+        return pe_test_rule_full(rule_xml, node->details->attrs,
+                                 RSC_ROLE_UNKNOWN, data_set->now, match_data);
+    }
+
+    results = g_hash_table_lookup(location_rule_results, rule_id);
+    if (results == NULL) {
+        results = calloc(1, sizeof(struct location_rule_results_s));
+        CRM_ASSERT(results != NULL);
+        results->uses_match_data = rule_uses_match_data(rule_xml);
+        results->accepted = g_hash_table_new(crm_str_hash, g_str_equal);
+        g_hash_table_insert(location_rule_results, strdup(rule_id), results);
+    }
+
+    if (results->uses_match_data && (match_data != NULL)) {
+        return pe_test_rule_full(rule_xml, node->details->attrs,
+                                 RSC_ROLE_UNKNOWN, data_set->now, match_data);
+    }
+
+    cached = g_hash_table_lookup(results->accepted, node->details->id);
+    if (cached != NULL) {
+        return GPOINTER_TO_INT(cached) - 1;
+    }
+
+    accept = pe_test_rule_full(rule_xml, node->details->attrs, RSC_ROLE_UNKNOWN,
+                               data_set->now, match_data);
+    g_hash_table_insert(results->accepted, (gpointer) node->details->id,
+                        GINT_TO_POINTER(accept + 1));
+    return accept;
+}
+
 static rsc_to_node_t *
 generate_location_rule(resource_t * rsc, xmlNode * rule_xml, const char *discovery, pe_working_set_t * data_set,
                        pe_match_data_t * match_data)
@@ -1100,7 +1237,7 @@ generate_location_rule(resource_t * rsc, xmlNode * rule_xml, const char *discove
         int score_f = 0;
         node_t *node = (node_t *) gIter->data;
 
-        accept = pe_test_rule_full(rule_xml, node->details->attrs, RSC_ROLE_UNKNOWN, data_set->now, match_data);
+        accept = test_location_rule(rule_xml, node, data_set, match_data);
 
         crm_trace("Rule %s %s on %s", ID(rule_xml), accept ? "passed" : "failed",
                   node->details->uname);
@@ -1306,10 +1443,7 @@ rsc_colocation_new(const char *id, const char *node_attr, int score,
         return FALSE;
     }
 
-    new_con = calloc(1, sizeof(rsc_colocation_t));
-    if (new_con == NULL) {
-        return FALSE;
-    }
+    new_con = pe__arena_alloc(data_set, sizeof(rsc_colocation_t));
 
     if (state_lh == NULL || safe_str_eq(state_lh, RSC_ROLE_STARTED_S)) {
         state_lh = RSC_ROLE_UNKNOWN_S;
@@ -1537,7 +1671,7 @@ custom_action_order(resource_t * lh_rsc, char *lh_action_task, action_t * lh_act
         return -1;
     }
 
-    order = calloc(1, sizeof(order_constraint_t));
+    order = pe__arena_alloc(data_set, sizeof(order_constraint_t));
 
     crm_trace("Creating[%d] %s %s %s - %s %s %s", data_set->order_id,
               lh_rsc?lh_rsc->id:"NA", lh_action_task, lh_action?lh_action->uuid:"NA",
@@ -1784,6 +1918,26 @@ unpack_order_set(xmlNode * set, enum pe_order_kind parent_kind, resource_t ** rs
     return TRUE;
 }
 
+/* Unordered sets whose pairwise orderings would exceed this many are ordered
+ * through a pseudo-action instead (see order_rsc_sets())
+ */
+#define ORDER_SET_BARRIER_MIN 64
+#define ORDER_SET_BARRIER "order-set-barrier"
+
+static int
+count_set_members(xmlNode *set)
+{
+    int count = 0;
+
+    for (xmlNode *xml_rsc = __xml_first_child(set); xml_rsc != NULL;
+         xml_rsc = __xml_next_element(xml_rsc)) {
+        if (crm_str_eq((const char *)xml_rsc->name, XML_TAG_RESOURCE_REF, TRUE)) {
+            count++;
+        }
+    }
+    return count;
+}
+
 static gboolean
 order_rsc_sets(const char *id, xmlNode * set1, xmlNode * set2, enum pe_order_kind kind,
                pe_working_set_t * data_set, gboolean invert, gboolean symmetrical)
@@ -1938,6 +2092,43 @@ order_rsc_sets(const char *id, xmlNode * set1, xmlNode * set2, enum pe_order_kin
             }
         }
 
+    } else if ((kind == pe_order_kind_mandatory)
+               && is_not_set(flags, pe_order_implies_first)
+               && ((count_set_members(set1) * count_set_members(set2))
+                   > ORDER_SET_BARRIER_MIN)) {
+        /* Rather than ordering every member of set1 before every member of
+         * set2, order them all relative to a single pseudo-action. The
+         * implies-then and runnable-left flags propagate through it the same
+         * way, while the number of orderings grows with the sum rather than
+         * the product of the set sizes.
+         *
+         * Implies-first does not: an action without a resource is never made
+         * required by the actions after it, so the barrier would stay optional
+         * and be left out of the graph along with the orderings through it.
+         * The inverse orderings of symmetrical constraints therefore keep the
+         * pairwise expansion.
+         */
+        char *task = crm_strdup_printf(ORDER_SET_BARRIER ":%s_%s:%s_%s",
+                                       ID(set1), action_1, ID(set2), action_2);
+        action_t *barrier = get_pseudo_op(task, data_set);
+
+        free(task);
+        for (xml_rsc = __xml_first_child(set1); xml_rsc != NULL; xml_rsc = __xml_next_element(xml_rsc)) {
+            if (crm_str_eq((const char *)xml_rsc->name, XML_TAG_RESOURCE_REF, TRUE)) {
+                EXPAND_CONSTRAINT_IDREF(id, rsc_1, ID(xml_rsc));
+                custom_action_order(rsc_1, generate_op_key(rsc_1->id, action_1, 0), NULL,
+                                    NULL, NULL, barrier, flags, data_set);
+            }
+        }
+        for (xml_rsc = __xml_first_child(set2); xml_rsc != NULL; xml_rsc = __xml_next_element(xml_rsc)) {
+            if (crm_str_eq((const char *)xml_rsc->name, XML_TAG_RESOURCE_REF, TRUE)) {
+                EXPAND_CONSTRAINT_IDREF(id, rsc_2, ID(xml_rsc));
+                custom_action_order(NULL, NULL, barrier,
+                                    rsc_2, generate_op_key(rsc_2->id, action_2, 0), NULL,
+                                    flags, data_set);
+            }
+        }
+
     } else {
         for (xml_rsc = __xml_first_child(set1); xml_rsc != NULL; xml_rsc = __xml_next_element(xml_rsc)) {
             if (crm_str_eq((const char *)xml_rsc->name, XML_TAG_RESOURCE_REF, TRUE)) {
@@ -2133,7 +2324,7 @@ unpack_rsc_order(xmlNode * xml_obj, pe_working_set_t * data_set)
                    if(!last_action) { last_action = RSC_START; }
 
                    if(rsc == NULL && last_rsc == NULL) {
-                   order_actions(last_end, set_begin, flags);
+                   order_actions(last_end, set_begin, flags, data_set);
                    } else {
                    custom_action_order(
                    last_rsc, null_or_opkey(last_rsc, last_action), last_end,
@@ -2147,7 +2338,7 @@ unpack_rsc_order(xmlNode * xml_obj, pe_working_set_t * data_set)
 
                    flags = get_flags(id, kind, last_action, set_action, TRUE);
                    if(rsc == NULL && last_rsc == NULL) {
-                   order_actions(last_inv_begin, set_inv_end, flags);
+                   order_actions(last_inv_begin, set_inv_end, flags, data_set);
 
                    } else {
                    custom_action_order(
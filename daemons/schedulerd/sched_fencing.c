@@ -0,0 +1,281 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <regex.h>
+#include <glib.h>
+
+#include <crm/crm.h>
+#include <crm/msg_xml.h>
+#include <crm/services.h>
+#include <crm/fencing/internal.h>
+
+#include <crm/pengine/status.h>
+#include <pacemaker-schedulerd.h>
+#include <sched_allocate.h>
+#include <sched_utils.h>
+
+/*
+ * Fencing several nodes
+ *
+ * Unless concurrent-fencing is enabled, fencing actions used to be ordered
+ * one after another, so losing a rack of nodes cost as many fencing rounds
+ * as there were nodes, even when each node has its own device (such as an
+ * IPMI interface). The reason not to fence concurrently is that a device may
+ * not cope with being used for several targets at once, so only fencing
+ * actions that might use the same device need to be ordered.
+ *
+ * The devices that might fence each target are worked out together, from
+ * the fencing topology if it has levels for the target, otherwise from the
+ * configured fencing resources. A device whose targets cannot be known in
+ * advance (because it does not use a static host list) is assumed to be able
+ * to fence every node, and a target with no known device is assumed to be
+ * fenceable by any device. Each fencing action is then ordered after the
+ * previous one for each device it might use, and the rest run in parallel.
+ */
+
+// Check whether a host list or map names a node
+static bool
+host_listed(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+
+    for (const char *p = list; (p != NULL) && (*p != '\0'); ) {
+        size_t token = strcspn(p, " ,;:=\t\n");
+
+        if ((token == len) && (strncasecmp(p, name, len) == 0)) {
+            return TRUE;
+        }
+        p += token;
+        p += strspn(p, " ,;:=\t\n");
+    }
+    return FALSE;
+}
+
+static bool
+device_may_fence(resource_t *device, node_t *node)
+{
+    const char *check = g_hash_table_lookup(device->parameters,
+                                            STONITH_ATTR_HOSTCHECK);
+    const char *list = g_hash_table_lookup(device->parameters,
+                                           STONITH_ATTR_HOSTLIST);
+    const char *map = g_hash_table_lookup(device->parameters,
+                                          STONITH_ATTR_HOSTMAP);
+
+    if ((check == NULL) && ((list != NULL) || (map != NULL))) {
+        check = "static-list";
+    }
+    if (safe_str_neq(check, "static-list")) {
+        return TRUE;
+    }
+    return host_listed(list, node->details->uname)
+           || host_listed(map, node->details->uname);
+}
+
+static bool
+level_matches(xmlNode *level, node_t *node)
+{
+    const char *target = crm_element_value(level, XML_ATTR_STONITH_TARGET);
+    const char *pattern = crm_element_value(level,
+                                            XML_ATTR_STONITH_TARGET_PATTERN);
+    const char *attr = crm_element_value(level,
+                                         XML_ATTR_STONITH_TARGET_ATTRIBUTE);
+
+    if (target != NULL) {
+        return safe_str_eq(target, node->details->uname);
+
+    } else if (pattern != NULL) {
+        regex_t regex;
+        bool match = FALSE;
+
+        if (regcomp(&regex, pattern, REG_EXTENDED|REG_NOSUB) == 0) {
+            match = (regexec(&regex, node->details->uname, 0, NULL, 0) == 0);
+            regfree(&regex);
+        }
+        return match;
+
+    } else if (attr != NULL) {
+        const char *value = crm_element_value(level,
+                                              XML_ATTR_STONITH_TARGET_VALUE);
+
+        return safe_str_eq(value, pe_node_attribute_raw(node, attr));
+    }
+    return FALSE;
+}
+
+// Add fencing resources (including clone instances) to a list of device IDs
+static GListPtr
+add_fencing_devices(GListPtr devices, GListPtr resources, node_t *node)
+{
+    for (GListPtr gIter = resources; gIter != NULL; gIter = gIter->next) {
+        resource_t *rsc = (resource_t *) gIter->data;
+        const char *class = NULL;
+
+        if (rsc->children != NULL) {
+            devices = add_fencing_devices(devices, rsc->children, node);
+            continue;
+        }
+
+        class = crm_element_value(rsc->xml, XML_AGENT_ATTR_CLASS);
+        if (safe_str_eq(class, PCMK_RESOURCE_CLASS_STONITH)
+            && device_may_fence(rsc, node)) {
+            // Clone instances share their primitive's XML ID
+            const char *id = ID(rsc->xml);
+
+            if (g_list_find_custom(devices, id, (GCompareFunc) strcmp) == NULL) {
+                devices = g_list_prepend(devices, (gpointer) id);
+            }
+        }
+    }
+    return devices;
+}
+
+/*!
+ * \internal
+ * \brief Get the IDs of the devices that might be used to fence a node
+ *
+ * \param[in] node      Node to be fenced
+ * \param[in] data_set  Cluster working set
+ *
+ * \return List of newly allocated device IDs (empty if no devices are known)
+ */
+static GListPtr
+fencing_devices(node_t *node, pe_working_set_t *data_set)
+{
+    GListPtr devices = NULL;
+    GListPtr ids = NULL;
+    xmlNode *topology = get_xpath_object("//" XML_TAG_FENCING_TOPOLOGY,
+                                         data_set->input, LOG_TRACE);
+
+    for (xmlNode *level = first_named_child(topology, XML_TAG_FENCING_LEVEL);
+         level != NULL; level = crm_next_same_xml(level)) {
+        const char *list = NULL;
+
+        if (!level_matches(level, node)) {
+            continue;
+        }
+        list = crm_element_value(level, XML_ATTR_STONITH_DEVICES);
+        for (const char *p = list; (p != NULL) && (*p != '\0'); ) {
+            size_t len = strcspn(p, ",");
+
+            if (len > 0) {
+                for (GListPtr gIter = devices; gIter != NULL;
+                     gIter = gIter->next) {
+                    if ((strlen(gIter->data) == len)
+                        && (strncmp(gIter->data, p, len) == 0)) {
+                        len = 0;
+                        break;
+                    }
+                }
+            }
+            if (len > 0) {
+                devices = g_list_prepend(devices, strndup(p, len));
+            }
+            p += strcspn(p, ",");
+            p += strspn(p, ",");
+        }
+    }
+    if (devices != NULL) {
+        return devices;
+    }
+
+    ids = add_fencing_devices(NULL, data_set->resources, node);
+    for (GListPtr gIter = ids; gIter != NULL; gIter = gIter->next) {
+        devices = g_list_prepend(devices, strdup(gIter->data));
+    }
+    g_list_free(ids);
+    return devices;
+}
+
+// Order a fencing action after another, unless it already is
+static GListPtr
+order_fencing_after(GListPtr before, action_t *last, action_t *stonith_op,
+                    const char *device, pe_working_set_t *data_set)
+{
+    if ((last != NULL) && (g_list_find(before, last) == NULL)) {
+        crm_debug("Ordering fencing of %s after %s (both may use %s)",
+                  stonith_op->node->details->uname,
+                  last->node->details->uname, device);
+        order_actions(last, stonith_op, pe_order_optional, data_set);
+        before = g_list_prepend(before, last);
+    }
+    return before;
+}
+
+/*!
+ * \internal
+ * \brief Order fencing actions that might use the same device
+ *
+ * \param[in] stonith_ops  Fencing actions, in the order to run them
+ * \param[in] data_set     Cluster working set
+ *
+ * \return List of the given fencing actions that no other fencing action is
+ *         ordered after (the caller should free it with g_list_free())
+ * \note A target whose devices are not known might be fenced by any device,
+ *       so it is ordered after all fencing before it, and all fencing after
+ *       it is ordered after it. If no target's devices are known, fencing is
+ *       therefore serialized exactly as without this check.
+ */
+GListPtr
+sched_order_fencing(GListPtr stonith_ops, pe_working_set_t *data_set)
+{
+    // Device ID ("" for unknown) -> last fencing action that might use it
+    GHashTable *last_use = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                 free, NULL);
+    GListPtr last_ops = NULL;
+
+    for (GListPtr gIter = stonith_ops; gIter != NULL; gIter = gIter->next) {
+        action_t *stonith_op = (action_t *) gIter->data;
+        GListPtr devices = fencing_devices(stonith_op->node, data_set);
+        GListPtr before = NULL;
+
+        if (devices == NULL) {
+            GHashTableIter iter;
+            char *device = NULL;
+            action_t *last = NULL;
+
+            g_hash_table_iter_init(&iter, last_use);
+            while (g_hash_table_iter_next(&iter, (gpointer *) &device,
+                                          (gpointer *) &last)) {
+                before = order_fencing_after(before, last, stonith_op,
+                                             "any device", data_set);
+                g_hash_table_iter_replace(&iter, stonith_op);
+            }
+            g_hash_table_replace(last_use, strdup(""), stonith_op);
+
+        } else {
+            before = order_fencing_after(before,
+                                         g_hash_table_lookup(last_use, ""),
+                                         stonith_op, "any device", data_set);
+            for (GListPtr dIter = devices; dIter != NULL;
+                 dIter = dIter->next) {
+                before = order_fencing_after(before,
+                                             g_hash_table_lookup(last_use,
+                                                                 dIter->data),
+                                             stonith_op, dIter->data,
+                                             data_set);
+                g_hash_table_replace(last_use, dIter->data, stonith_op);
+            }
+        }
+
+        if (before == NULL) {
+            crm_debug("Fencing %s may run in parallel with other fencing",
+                      stonith_op->node->details->uname);
+        }
+        for (GListPtr bIter = before; bIter != NULL; bIter = bIter->next) {
+            last_ops = g_list_remove(last_ops, bIter->data);
+        }
+        last_ops = g_list_append(last_ops, stonith_op);
+
+        // Keys now belong to last_use
+        g_list_free(devices);
+        g_list_free(before);
+    }
+    g_hash_table_destroy(last_use);
+    return last_ops;
+}
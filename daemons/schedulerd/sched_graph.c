@@ -18,7 +18,7 @@
 #include <sched_allocate.h>
 #include <sched_utils.h>
 
-void update_colo_start_chain(action_t * action);
+void update_colo_start_chain(action_t * action, pe_working_set_t * data_set);
 gboolean rsc_update_action(action_t * first, action_t * then, enum pe_ordering type);
 
 static enum pe_action_flags
@@ -173,7 +173,7 @@ rsc_expand_action(action_t * action)
 static enum pe_graph_flags
 graph_update_action(action_t * first, action_t * then, node_t * node,
                     enum pe_action_flags first_flags, enum pe_action_flags then_flags,
-                    action_wrapper_t *order)
+                    action_wrapper_t *order, pe_working_set_t *data_set)
 {
     enum pe_graph_flags changed = pe_graph_none;
     enum pe_ordering type = order->type;
@@ -206,7 +206,7 @@ graph_update_action(action_t * first, action_t * then, node_t * node,
         if (then->rsc) {
             changed |=
                 then->rsc->cmds->update_actions(first, then, node, first_flags & pe_action_optional,
-                                                pe_action_optional, pe_order_implies_then);
+                                                pe_action_optional, pe_order_implies_then, data_set);
 
         } else if (is_set(first_flags, pe_action_optional) == FALSE) {
             if (update_action_flags(then, pe_action_optional | pe_action_clear, __FUNCTION__, __LINE__)) {
@@ -225,7 +225,7 @@ graph_update_action(action_t * first, action_t * then, node_t * node,
 
         processed = TRUE;
         changed |=
-            then->rsc->cmds->update_actions(first, then, node, first_flags, restart, pe_order_restart);
+            then->rsc->cmds->update_actions(first, then, node, first_flags, restart, pe_order_restart, data_set);
         if (changed) {
             pe_rsc_trace(then->rsc, "restart: %s then %s: changed", first->uuid, then->uuid);
         } else {
@@ -238,7 +238,7 @@ graph_update_action(action_t * first, action_t * then, node_t * node,
         if (first->rsc) {
             changed |=
                 first->rsc->cmds->update_actions(first, then, node, first_flags,
-                                                 pe_action_optional, pe_order_implies_first);
+                                                 pe_action_optional, pe_order_implies_first, data_set);
 
         } else if (is_set(first_flags, pe_action_optional) == FALSE) {
             pe_rsc_trace(first->rsc, "first unrunnable: %s (%d) then %s (%d)",
@@ -263,7 +263,7 @@ graph_update_action(action_t * first, action_t * then, node_t * node,
         if (then->rsc) {
             changed |=
                 then->rsc->cmds->update_actions(first, then, node, first_flags & pe_action_optional,
-                                                pe_action_optional, pe_order_implies_first_master);
+                                                pe_action_optional, pe_order_implies_first_master, data_set);
         }
 
         if (changed) {
@@ -281,7 +281,7 @@ graph_update_action(action_t * first, action_t * then, node_t * node,
         if (then->rsc) {
             changed |=
                 then->rsc->cmds->update_actions(first, then, node, first_flags,
-                                                pe_action_runnable, pe_order_one_or_more);
+                                                pe_action_runnable, pe_order_one_or_more, data_set);
 
         } else if (is_set(first_flags, pe_action_runnable)) {
             /* alright. a "first" action is considered runnable, incremente
@@ -316,7 +316,7 @@ graph_update_action(action_t * first, action_t * then, node_t * node,
         } else {
             pe_rsc_trace(then->rsc, "Enforcing %s then %s", first->uuid, then->uuid);
             changed |= then->rsc->cmds->update_actions(first, then, node, first_flags,
-                                                       pe_action_runnable, pe_order_runnable_left);
+                                                       pe_action_runnable, pe_order_runnable_left, data_set);
         }
 
         if (changed) {
@@ -331,7 +331,7 @@ graph_update_action(action_t * first, action_t * then, node_t * node,
         if (then->rsc) {
             changed |=
                 then->rsc->cmds->update_actions(first, then, node, first_flags,
-                                                pe_action_runnable, pe_order_runnable_left);
+                                                pe_action_runnable, pe_order_runnable_left, data_set);
 
         } else if (is_set(first_flags, pe_action_runnable) == FALSE) {
             pe_rsc_trace(then->rsc, "then unrunnable: %s then %s", first->uuid, then->uuid);
@@ -351,7 +351,7 @@ graph_update_action(action_t * first, action_t * then, node_t * node,
         if (then->rsc) {
             changed |=
                 then->rsc->cmds->update_actions(first, then, node, first_flags,
-                                                pe_action_optional, pe_order_implies_first_migratable);
+                                                pe_action_optional, pe_order_implies_first_migratable, data_set);
         }
         if (changed) {
             pe_rsc_trace(then->rsc, "optional: %s then %s: changed", first->uuid, then->uuid);
@@ -365,7 +365,7 @@ graph_update_action(action_t * first, action_t * then, node_t * node,
         if (then->rsc) {
             changed |=
                 then->rsc->cmds->update_actions(first, then, node, first_flags,
-                                                pe_action_optional, pe_order_pseudo_left);
+                                                pe_action_optional, pe_order_pseudo_left, data_set);
         }
         if (changed) {
             pe_rsc_trace(then->rsc, "optional: %s then %s: changed", first->uuid, then->uuid);
@@ -379,7 +379,7 @@ graph_update_action(action_t * first, action_t * then, node_t * node,
         if (then->rsc) {
             changed |=
                 then->rsc->cmds->update_actions(first, then, node, first_flags,
-                                                pe_action_runnable, pe_order_optional);
+                                                pe_action_runnable, pe_order_optional, data_set);
         }
         if (changed) {
             pe_rsc_trace(then->rsc, "optional: %s then %s: changed", first->uuid, then->uuid);
@@ -393,7 +393,7 @@ graph_update_action(action_t * first, action_t * then, node_t * node,
         if (then->rsc) {
             changed |=
                 then->rsc->cmds->update_actions(first, then, node, first_flags,
-                                                pe_action_runnable, pe_order_asymmetrical);
+                                                pe_action_runnable, pe_order_asymmetrical, data_set);
         }
 
         if (changed) {
@@ -445,7 +445,8 @@ graph_update_action(action_t * first, action_t * then, node_t * node,
 }
 
 static void
-mark_start_blocked(resource_t *rsc, resource_t *reason)
+mark_start_blocked(resource_t *rsc, resource_t *reason,
+                   pe_working_set_t *data_set)
 {
     GListPtr gIter = rsc->actions;
     char *reason_text = crm_strdup_printf("colocation with %s", reason->id);
@@ -458,15 +459,15 @@ mark_start_blocked(resource_t *rsc, resource_t *reason)
         }
         if (is_set(action->flags, pe_action_runnable)) {
             pe_action_set_flag_reason(__FUNCTION__, __LINE__, action, NULL, reason_text, pe_action_runnable, FALSE);
-            update_colo_start_chain(action);
-            update_action(action);
+            update_colo_start_chain(action, data_set);
+            update_action(action, data_set);
         }
     }
     free(reason_text);
 }
 
 void
-update_colo_start_chain(action_t *action)
+update_colo_start_chain(action_t *action, pe_working_set_t *data_set)
 {
     GListPtr gIter = NULL;
     resource_t *rsc = NULL;
@@ -500,13 +501,125 @@ update_colo_start_chain(action_t *action)
     for (gIter = rsc->rsc_cons_lhs; gIter != NULL; gIter = gIter->next) {
         rsc_colocation_t *colocate_with = (rsc_colocation_t *)gIter->data;
         if (colocate_with->score == INFINITY) {
-            mark_start_blocked(colocate_with->rsc_lh, action->rsc);
+            mark_start_blocked(colocate_with->rsc_lh, action->rsc, data_set);
         }
     }
 }
 
+/* Actions whose orderings must be re-evaluated, in the order they will be
+ * processed, a table mapping each of them to its link in that queue (so that
+ * each is queued at most once), and the actions queued by the action currently
+ * being processed, most recent first
+ */
+static GQueue *pending_updates = NULL;
+static GHashTable *queued_updates = NULL;
+static GList *deferred_updates = NULL;
+static gboolean processing_updates = FALSE;
+
+// Number of actions re-evaluated by update_action() since the daemon started
+static unsigned long update_steps = 0;
+
+static void process_action_update(action_t * then,
+                                  pe_working_set_t * data_set);
+
+/*!
+ * \internal
+ * \brief Get the number of actions re-evaluated by update_action()
+ *
+ * \return Total number of propagation steps since the process started
+ */
+unsigned long
+update_action_steps(void)
+{
+    return update_steps;
+}
+
+/*!
+ * \internal
+ * \brief Put an action at the front of the update queue
+ *
+ * \param[in] action  Action to queue (moved forward if already queued)
+ */
+static void
+queue_action_update(action_t * action)
+{
+    GList *link = g_hash_table_lookup(queued_updates, action);
+
+    if (link != NULL) {
+        g_queue_delete_link(pending_updates, link);
+    }
+    g_queue_push_head(pending_updates, action);
+    g_hash_table_insert(queued_updates, action,
+                        g_queue_peek_head_link(pending_updates));
+}
+
+/*!
+ * \internal
+ * \brief Propagate an action's flags through its orderings
+ *
+ * Whenever an action's flags change, the actions ordered around it need to be
+ * re-evaluated. Doing so recursively can revisit the same actions an
+ * exponential number of times on deep clone and bundle ordering chains, so
+ * affected actions are kept in a queue instead, each at most once until it is
+ * next processed. Calls made while an action is being processed just record
+ * the action to update.
+ *
+ * Once an action has been processed, the actions it recorded go to the front
+ * of the queue, in the order they were recorded. Actions are therefore
+ * re-evaluated in the same depth-first order as the recursion did, apart from
+ * those that were already queued further back (they move forward rather than
+ * being processed twice). The order does not affect the resulting flags:
+ * propagation only ever clears pe_action_optional and pe_action_runnable
+ * (requires-any actions recount their runnable inputs each time, and a reload
+ * is made optional again only once the stop after it is required), so it ends
+ * at the same fixed point whatever order actions are processed in. It does
+ * affect which reason is recorded first for a change, and so the "due to"
+ * text in transition summaries, which is why the recursive order is kept.
+ *
+ * \param[in] then      Action to re-evaluate
+ * \param[in] data_set  Working set that \p then belongs to
+ *
+ * \return FALSE (for backward compatibility)
+ */
 gboolean
-update_action(action_t * then)
+update_action(action_t * then, pe_working_set_t * data_set)
+{
+    if (processing_updates) {
+        deferred_updates = g_list_prepend(deferred_updates, then);
+        return FALSE;
+    }
+
+    if (pending_updates == NULL) {
+        pending_updates = g_queue_new();
+        queued_updates = g_hash_table_new(NULL, NULL);
+    }
+
+    processing_updates = TRUE;
+    queue_action_update(then);
+    while (!g_queue_is_empty(pending_updates)) {
+        action_t *action = g_queue_pop_head(pending_updates);
+        GList *iter = NULL;
+
+        // Allow the action to be queued again if its own flags change
+        g_hash_table_remove(queued_updates, action);
+        process_action_update(action, data_set);
+        update_steps++;
+
+        /* Most recent first, so the first action recorded ends up at the head
+         * (and is the only copy, if it was recorded more than once)
+         */
+        for (iter = deferred_updates; iter != NULL; iter = iter->next) {
+            queue_action_update((action_t *) iter->data);
+        }
+        g_list_free(deferred_updates);
+        deferred_updates = NULL;
+    }
+    processing_updates = FALSE;
+    return FALSE;
+}
+
+static void
+process_action_update(action_t * then, pe_working_set_t * data_set)
 {
     GListPtr lpc = NULL;
     enum pe_graph_flags changed = pe_graph_none;
@@ -629,12 +742,13 @@ update_action(action_t * then)
              *
              */
             node_t *node = then->node;
-            changed |= graph_update_action(first, then, node, first_flags, then_flags, other);
+            changed |= graph_update_action(first, then, node, first_flags,
+                                           then_flags, other, data_set);
 
             /* 'first' was for a complex resource (clone, group, etc),
              * create a new dependency if necessary
              */
-        } else if (order_actions(first, then, other->type)) {
+        } else if (order_actions(first, then, other->type, data_set)) {
             /* This was the first time 'first' and 'then' were associated,
              * start again to get the new actions_before list
              */
@@ -661,9 +775,9 @@ update_action(action_t * then)
             for (lpc2 = first->actions_after; lpc2 != NULL; lpc2 = lpc2->next) {
                 action_wrapper_t *other = (action_wrapper_t *) lpc2->data;
 
-                update_action(other->action);
+                update_action(other->action, data_set);
             }
-            update_action(first);
+            update_action(first, data_set);
         }
     }
 
@@ -685,17 +799,15 @@ update_action(action_t * then)
                   uname : "");
 
         if (is_set(last_flags, pe_action_runnable) && is_not_set(then->flags, pe_action_runnable)) {
-            update_colo_start_chain(then);
+            update_colo_start_chain(then, data_set);
         }
-        update_action(then);
+        update_action(then, data_set);
         for (lpc = then->actions_after; lpc != NULL; lpc = lpc->next) {
             action_wrapper_t *other = (action_wrapper_t *) lpc->data;
 
-            update_action(other->action);
+            update_action(other->action, data_set);
         }
     }
-
-    return FALSE;
 }
 
 gboolean
@@ -1575,8 +1687,24 @@ check_dump_input(int last_action, action_t * action, action_wrapper_t * wrapper)
     return TRUE;
 }
 
+/*!
+ * \internal
+ * \brief Check whether an input can be reached from the action it precedes
+ *
+ * \param[in] init_action  Action whose input is being checked
+ * \param[in] action       Action being followed back through its inputs
+ * \param[in] wrapper      Input of \p action to follow
+ * \param[in] explored     Actions already followed in this check without
+ *                         reaching \p init_action
+ *
+ * \return TRUE if \p init_action is an input of \p wrapper, directly or not
+ * \note Remembering the actions already explored makes each check linear in
+ *       the size of the graph. Otherwise every path would be followed
+ *       separately, which grows exponentially with fan-in.
+ */
 static gboolean
-graph_has_loop(action_t * init_action, action_t * action, action_wrapper_t * wrapper)
+graph_has_loop(action_t * init_action, action_t * action, action_wrapper_t * wrapper,
+               GHashTable *explored)
 {
     GListPtr lpc = NULL;
     gboolean has_loop = FALSE;
@@ -1620,12 +1748,18 @@ graph_has_loop(action_t * init_action, action_t * action, action_wrapper_t * wra
         return TRUE;
     }
 
+    if (g_hash_table_contains(explored, wrapper->action)) {
+        return FALSE;
+    }
+    g_hash_table_add(explored, wrapper->action);
+
     set_bit(wrapper->action->flags, pe_action_tracking);
 
     for (lpc = wrapper->action->actions_before; lpc != NULL; lpc = lpc->next) {
         action_wrapper_t *wrapper_before = (action_wrapper_t *) lpc->data;
 
-        if (graph_has_loop(init_action, wrapper->action, wrapper_before)) {
+        if (graph_has_loop(init_action, wrapper->action, wrapper_before,
+                           explored)) {
             has_loop = TRUE;
             goto done;
         }
@@ -1649,13 +1783,19 @@ should_dump_input(int last_action, action_t * action, action_wrapper_t * wrapper
     if (wrapper->type == pe_order_load
         && action->rsc
         && safe_str_eq(action->task, RSC_MIGRATE)) {
+        GHashTable *explored = g_hash_table_new(g_direct_hash, g_direct_equal);
+        gboolean has_loop = FALSE;
+
         crm_trace("Checking graph loop - load migrate: %s.%s -> %s.%s",
                   wrapper->action->uuid,
                   wrapper->action->node ? wrapper->action->node->details->uname : "",
                   action->uuid,
                   action->node ? action->node->details->uname : "");
 
-        if (graph_has_loop(action, action, wrapper)) {
+        has_loop = graph_has_loop(action, action, wrapper, explored);
+        g_hash_table_destroy(explored);
+
+        if (has_loop) {
             /* Remove the orders like the following if they are introducing any graph loops:
              *     "load_stopped_node2" -> "rscA_migrate_to node1"
              * which were created also from: sched_native.c: MigrateRsc()
@@ -1740,3 +1880,268 @@ graph_element_from_action(action_t * action, pe_working_set_t * data_set)
         add_node_nocopy(input, crm_element_name(xml_action), xml_action);
     }
 }
+
+/* Per-action state for find_graph_loops() */
+struct loop_vertex_s {
+    action_t *action;
+    GListPtr next_input;    // Next entry of action->actions_before to follow
+    int index;              // Order in which action was reached, or -1
+    int lowlink;            // Lowest index reachable from action
+    gboolean on_stack;
+};
+
+static void
+report_graph_loop(GPtrArray *stack, int first)
+{
+    char *desc = NULL;
+    size_t len = 0;
+
+    for (guint lpc = first; lpc < stack->len; lpc++) {
+        struct loop_vertex_s *vertex = g_ptr_array_index(stack, lpc);
+        action_t *action = vertex->action;
+
+        len += strlen(action->uuid) + 32
+               + (action->node? strlen(action->node->details->uname) : 0);
+        desc = realloc_safe(desc, len);
+        sprintf(desc + ((lpc == first)? 0 : strlen(desc)), "%s%s%s%s",
+                ((lpc == first)? "" : ", "), action->uuid,
+                (action->node? " on " : ""),
+                (action->node? action->node->details->uname : ""));
+    }
+    crm_err("Transition graph contains a loop of %d actions: %s",
+            (int) (stack->len - first), desc);
+    free(desc);
+}
+
+/*!
+ * \internal
+ * \brief Log every loop among the inputs dumped to the transition graph
+ *
+ * The controller could never complete a transition containing a loop, so this
+ * finds the strongly connected components of the graph of dumped inputs, using
+ * Tarjan's algorithm, and logs each component of more than one action. That is
+ * one linear pass over the graph, however many loops there are. The algorithm
+ * is made iterative so long ordering chains cannot exhaust the stack.
+ *
+ * \param[in] data_set  Cluster working set, after the graph has been created
+ */
+void
+find_graph_loops(pe_working_set_t *data_set)
+{
+    int next_index = 0;
+    int num_actions = data_set->action_id;
+    struct loop_vertex_s *vertices = NULL;
+    GPtrArray *stack = NULL;    // Tarjan's stack of vertices
+    GPtrArray *path = NULL;     // Vertices being explored (the call stack)
+
+    if (num_actions <= 0) {
+        return;
+    }
+
+    vertices = calloc(num_actions, sizeof(struct loop_vertex_s));
+    CRM_ASSERT(vertices != NULL);
+    for (GListPtr gIter = data_set->actions; gIter != NULL; gIter = gIter->next) {
+        action_t *action = (action_t *) gIter->data;
+
+        if ((action->id >= 0) && (action->id < num_actions)) {
+            vertices[action->id].action = action;
+            vertices[action->id].next_input = action->actions_before;
+            vertices[action->id].index = -1;
+        }
+    }
+
+    stack = g_ptr_array_new();
+    path = g_ptr_array_new();
+
+    for (int lpc = 0; lpc < num_actions; lpc++) {
+        if ((vertices[lpc].action == NULL) || (vertices[lpc].index >= 0)
+            || is_not_set(vertices[lpc].action->flags, pe_action_dumped)) {
+            continue;
+        }
+
+        vertices[lpc].index = vertices[lpc].lowlink = next_index++;
+        vertices[lpc].on_stack = TRUE;
+        g_ptr_array_add(stack, &vertices[lpc]);
+        g_ptr_array_add(path, &vertices[lpc]);
+
+        while (path->len > 0) {
+            struct loop_vertex_s *vertex = g_ptr_array_index(path, path->len - 1);
+
+            if (vertex->next_input != NULL) {
+                action_wrapper_t *wrapper = vertex->next_input->data;
+                struct loop_vertex_s *input = NULL;
+
+                vertex->next_input = vertex->next_input->next;
+                if ((wrapper->state != pe_link_dumped)
+                    || (wrapper->action->id < 0)
+                    || (wrapper->action->id >= num_actions)) {
+                    continue;
+                }
+
+                input = &vertices[wrapper->action->id];
+                if (input->index < 0) {
+                    input->index = input->lowlink = next_index++;
+                    input->on_stack = TRUE;
+                    g_ptr_array_add(stack, input);
+                    g_ptr_array_add(path, input);
+
+                } else if (input->on_stack) {
+                    vertex->lowlink = QB_MIN(vertex->lowlink, input->index);
+                }
+                continue;
+            }
+
+            // All of this vertex's inputs have been followed
+            g_ptr_array_remove_index(path, path->len - 1);
+            if (path->len > 0) {
+                struct loop_vertex_s *parent = g_ptr_array_index(path, path->len - 1);
+
+                parent->lowlink = QB_MIN(parent->lowlink, vertex->lowlink);
+            }
+
+            if (vertex->lowlink == vertex->index) {
+                guint first = stack->len;
+
+                do {
+                    first--;
+                } while (g_ptr_array_index(stack, first) != vertex);
+
+                if (first + 1 < stack->len) {
+                    report_graph_loop(stack, first);
+                }
+                for (guint member = first; member < stack->len; member++) {
+                    ((struct loop_vertex_s *) g_ptr_array_index(stack, member))->on_stack = FALSE;
+                }
+                g_ptr_array_set_size(stack, first);
+            }
+        }
+    }
+
+    g_ptr_array_free(path, TRUE);
+    g_ptr_array_free(stack, TRUE);
+    free(vertices);
+}
+
+/*!
+ * \internal
+ * \brief Build a key identifying a resource operation's parameters
+ *
+ * \param[in] attrs  Action's attributes XML
+ * \param[in] names  Sorted names of the action's non-meta attributes
+ *
+ * \return Newly allocated key (caller must free)
+ */
+static char *
+parameter_set_key(xmlNode *attrs, GList *names)
+{
+    GString *key = g_string_sized_new(256);
+
+    for (GList *iter = names; iter != NULL; iter = iter->next) {
+        const char *name = (const char *) iter->data;
+        const char *value = crm_element_value(attrs, name);
+
+        // Include lengths so no two distinct sets can produce the same key
+        g_string_append_printf(key, "%lu:%s%lu:%s",
+                               (unsigned long) strlen(name), name,
+                               (unsigned long) strlen(value), value);
+    }
+    return g_string_free(key, FALSE);
+}
+
+/*!
+ * \internal
+ * \brief Move a resource operation's parameters into a shared set
+ *
+ * \param[in,out] action_xml  Resource operation XML
+ * \param[in,out] sets_xml    Graph's list of parameter sets
+ * \param[in,out] sets        Set IDs, indexed by parameter set key
+ */
+static void
+compact_action_parameters(xmlNode *action_xml, xmlNode *sets_xml,
+                          GHashTable *sets)
+{
+    xmlNode *attrs = first_named_child(action_xml, XML_TAG_ATTRS);
+    GList *names = NULL;
+    char *key = NULL;
+    const char *set_id = NULL;
+
+    for (xmlAttrPtr a = crm_first_attr(attrs); a != NULL; a = a->next) {
+        const char *name = (const char *) a->name;
+
+        if (!crm_starts_with(name, CRM_META "_")) {
+            names = g_list_insert_sorted(names, (gpointer) name,
+                                         (GCompareFunc) strcmp);
+        }
+    }
+    if (names == NULL) {
+        return;
+    }
+
+    key = parameter_set_key(attrs, names);
+    set_id = g_hash_table_lookup(sets, key);
+    if (set_id == NULL) {
+        xmlNode *set_xml = create_xml_node(sets_xml, XML_GRAPH_TAG_PARAM_SET);
+        xmlNode *set_attrs = create_xml_node(set_xml, XML_TAG_ATTRS);
+
+        crm_xml_set_id(set_xml, "%u", g_hash_table_size(sets));
+        for (GList *iter = names; iter != NULL; iter = iter->next) {
+            crm_xml_add(set_attrs, (const char *) iter->data,
+                        crm_element_value(attrs, (const char *) iter->data));
+        }
+        set_id = ID(set_xml);
+        g_hash_table_insert(sets, key, strdup(set_id));
+        key = NULL;
+    }
+    crm_xml_add(action_xml, XML_GRAPH_ATTR_PARAM_SET, set_id);
+    free(key);
+
+    for (GList *iter = names; iter != NULL; iter = iter->next) {
+        xml_remove_prop(attrs, (const char *) iter->data);
+    }
+    g_list_free(names);
+}
+
+/*!
+ * \internal
+ * \brief List each distinct set of resource parameters once in a graph
+ *
+ * Operations on the same resource nearly always have identical parameters,
+ * and only their meta-attributes differ. This moves the parameters of each
+ * resource operation into a parameter set listed once per graph, referenced by
+ * ID from the operation, which can shrink a large graph considerably.
+ * unpack_graph() expands the references again, so this must only be done for
+ * requesters that asked for it.
+ *
+ * \param[in,out] graph  Transition graph XML to compact
+ */
+void
+compact_graph_parameters(xmlNode *graph)
+{
+    GHashTable *sets = crm_str_table_new();
+    xmlNode *sets_xml = create_xml_node(graph, XML_GRAPH_TAG_PARAM_SET "s");
+
+    for (xmlNode *synapse = first_named_child(graph, "synapse");
+         synapse != NULL; synapse = crm_next_same_xml(synapse)) {
+
+        for (xmlNode *action_set = first_named_child(synapse, "action_set");
+             action_set != NULL; action_set = crm_next_same_xml(action_set)) {
+
+            for (xmlNode *action = first_named_child(action_set,
+                                                     XML_GRAPH_TAG_RSC_OP);
+                 action != NULL; action = crm_next_same_xml(action)) {
+                compact_action_parameters(action, sets_xml, sets);
+            }
+        }
+    }
+
+    crm_debug("Graph refers to %u distinct resource parameter sets",
+              g_hash_table_size(sets));
+    if (g_hash_table_size(sets) > 0) {
+        // Keep the sets ahead of the synapses that refer to them
+        xmlUnlinkNode(sets_xml);
+        xmlAddPrevSibling(__xml_first_child(graph), sets_xml);
+    } else {
+        free_xml(sets_xml);
+    }
+    g_hash_table_destroy(sets);
+}
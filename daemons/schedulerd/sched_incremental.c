@@ -0,0 +1,589 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <crm/crm.h>
+#include <crm/cib.h>
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+
+#include <glib.h>
+
+#include <crm/pengine/status.h>
+#include <pacemaker-schedulerd.h>
+#include <sched_allocate.h>
+#include <sched_utils.h>
+
+/*
+ * Incremental scheduling
+ *
+ * Between two consecutive scheduler inputs, usually only a handful of
+ * resource histories change (an action completed or a monitor failed).
+ * Everything the scheduler knows about the remaining resources is identical,
+ * so the placement computed for them last time is still the answer.
+ *
+ * We therefore remember a digest of everything in the input except the
+ * per-resource operation histories, plus one digest per lrm_resource entry.
+ * If only histories changed, the resources they belong to are marked as
+ * changed, the change is spread across colocation, ordering, parent/child
+ * and container relationships, and every standalone primitive outside that
+ * closure is assigned straight to its previous node, skipping the expensive
+ * colocation weight merging in native_color().
+ *
+ * Ticket states are treated the same way, so that granting or revoking a
+ * ticket in a geo cluster recalculates only the resources that depend on it
+ * (through rsc_ticket constraints, found via an index of ticket dependencies)
+ * and whatever is related to them, however many other resources there are.
+ *
+ * Anything more than that (configuration changes, node state or attribute
+ * changes, time-based rules, utilization placement) falls back to a full
+ * calculation.
+ */
+
+static char *last_static_digest = NULL;
+static GHashTable *last_history = NULL;     // "node/rsc" -> digest
+static GHashTable *last_tickets = NULL;     // ticket id -> digest
+static GHashTable *last_assignments = NULL; // rsc id -> node id
+
+static GHashTable *changed_histories = NULL; // rsc history id -> NULL
+static GHashTable *changed_tickets = NULL;   // ticket id -> NULL
+static GHashTable *pinned = NULL;            // resource_t* -> node id
+
+static void
+add_static_attrs(xmlNode *xml, char **buffer, int *offset, int *max)
+{
+    xmlNode *shallow = create_xml_node(NULL, crm_element_name(xml));
+
+    copy_in_properties(shallow, xml);
+    xml_remove_prop(shallow, XML_ATTR_NUMUPDATES);
+    xml_remove_prop(shallow, XML_ATTR_ORIGIN);
+    crm_xml_dump(shallow, xml_log_option_filtered, buffer, offset, max, 0);
+    free_xml(shallow);
+}
+
+static void
+add_node_history(GHashTable *history, xmlNode *node_state)
+{
+    const char *node_id = ID(node_state);
+    xmlNode *lrm_rscs = find_xml_node(find_xml_node(node_state,
+                                                    XML_CIB_TAG_LRM, FALSE),
+                                      XML_LRM_TAG_RESOURCES, FALSE);
+
+    for (xmlNode *rsc_entry = __xml_first_child(lrm_rscs); rsc_entry != NULL;
+         rsc_entry = __xml_next_element(rsc_entry)) {
+
+        if (crm_str_eq((const char *)rsc_entry->name, XML_LRM_TAG_RESOURCE, TRUE)) {
+            g_hash_table_insert(history,
+                                crm_strdup_printf("%s/%s", node_id, ID(rsc_entry)),
+                                calculate_xml_versioned_digest(rsc_entry, FALSE,
+                                                               TRUE,
+                                                               CRM_FEATURE_SET));
+        }
+    }
+}
+
+static void
+add_ticket_states(GHashTable *tickets, xmlNode *tickets_xml)
+{
+    for (xmlNode *ticket = __xml_first_child(tickets_xml); ticket != NULL;
+         ticket = __xml_next_element(ticket)) {
+
+        if (ID(ticket) != NULL) {
+            g_hash_table_insert(tickets, strdup(ID(ticket)),
+                                calculate_xml_versioned_digest(ticket, FALSE,
+                                                               TRUE,
+                                                               CRM_FEATURE_SET));
+        }
+    }
+}
+
+/*!
+ * \internal
+ * \brief Digest an input, splitting out operation histories and tickets
+ *
+ * \param[in]  input    Scheduler input
+ * \param[out] history  Table to populate with one digest per lrm_resource
+ *                      (or NULL to skip digesting histories)
+ * \param[out] tickets  Table to populate with one digest per ticket state
+ *                      (or NULL to skip digesting ticket states)
+ *
+ * \return Newly allocated digest of all input except operation histories and
+ *         ticket states
+ */
+static char *
+digest_input(xmlNode *input, GHashTable *history, GHashTable *tickets)
+{
+    char *digest = NULL;
+    char *buffer = NULL;
+    int offset = 0, max = 0;
+    xmlNode *status = get_object_root(XML_CIB_TAG_STATUS, input);
+
+    add_static_attrs(input, &buffer, &offset, &max);
+    crm_xml_dump(get_object_root(XML_CIB_TAG_CONFIGURATION, input),
+                 xml_log_option_filtered, &buffer, &offset, &max, 0);
+
+    for (xmlNode *state = __xml_first_child(status); state != NULL;
+         state = __xml_next_element(state)) {
+
+        if (crm_str_eq((const char *)state->name, XML_CIB_TAG_TICKETS, TRUE)) {
+            if (tickets != NULL) {
+                add_ticket_states(tickets, state);
+            }
+            continue;
+
+        } else if (crm_str_eq((const char *)state->name, XML_CIB_TAG_STATE, TRUE) == FALSE) {
+            // Anything else unexpected counts as static
+            crm_xml_dump(state, xml_log_option_filtered, &buffer, &offset, &max, 0);
+            continue;
+        }
+
+        add_static_attrs(state, &buffer, &offset, &max);
+        for (xmlNode *child = __xml_first_child(state); child != NULL;
+             child = __xml_next_element(child)) {
+
+            if (crm_str_eq((const char *)child->name, XML_CIB_TAG_LRM, TRUE) == FALSE) {
+                crm_xml_dump(child, xml_log_option_filtered, &buffer, &offset, &max, 0);
+            }
+        }
+        if (history != NULL) {
+            add_node_history(history, state);
+        }
+    }
+
+    if (buffer != NULL) {
+        digest = crm_md5sum(buffer);
+        free(buffer);
+    }
+    return digest;
+}
+
+// Add keys that differ between two digest tables to a set
+static void
+note_changed_digests(GHashTable *changed, GHashTable *old, GHashTable *new,
+                     void (*note)(GHashTable *, const char *))
+{
+    GHashTableIter iter;
+    char *key = NULL;
+    char *value = NULL;
+
+    g_hash_table_iter_init(&iter, new);
+    while (g_hash_table_iter_next(&iter, (gpointer *) &key, (gpointer *) &value)) {
+        if (safe_str_neq(value, g_hash_table_lookup(old, key))) {
+            note(changed, key);
+        }
+    }
+
+    g_hash_table_iter_init(&iter, old);
+    while (g_hash_table_iter_next(&iter, (gpointer *) &key, NULL)) {
+        if (g_hash_table_lookup(new, key) == NULL) {
+            note(changed, key);
+        }
+    }
+}
+
+static void
+note_changed_ticket(GHashTable *changed, const char *ticket_id)
+{
+    g_hash_table_add(changed, strdup(ticket_id));
+}
+
+static void
+note_changed_history(GHashTable *changed, const char *key)
+{
+    const char *rsc_id = strrchr(key, '/');
+
+    if (rsc_id != NULL) {
+        g_hash_table_add(changed, strdup(rsc_id + 1));
+    }
+}
+
+/*!
+ * \internal
+ * \brief Check whether an input might enable incremental scheduling
+ *
+ * \param[in] input  Scheduler input
+ *
+ * \return false if no cluster property set in \p input enables
+ *         incremental-scheduling, otherwise true (whether it applies is
+ *         checked against the unpacked options later)
+ */
+static bool
+incremental_configured(xmlNode *input)
+{
+    xmlNode *crm_config = get_object_root(XML_CIB_TAG_CRMCONFIG, input);
+
+    for (xmlNode *set = __xml_first_child_element(crm_config); set != NULL;
+         set = __xml_next_element(set)) {
+
+        if (!crm_str_eq(crm_element_name(set), XML_CIB_TAG_PROPSET, TRUE)) {
+            continue;
+        }
+        for (xmlNode *nvpair = __xml_first_child_element(set); nvpair != NULL;
+             nvpair = __xml_next_element(nvpair)) {
+
+            if (safe_str_eq(crm_element_value(nvpair, XML_NVPAIR_ATTR_NAME),
+                            "incremental-scheduling")
+                && crm_is_true(crm_element_value(nvpair,
+                                                 XML_NVPAIR_ATTR_VALUE))) {
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Compare a new scheduler input against the previous one
+ *
+ * \param[in] input  Scheduler input about to be calculated
+ *
+ * \note Must be called for every input the daemon processes, so the saved
+ *       state always reflects the previous input.
+ */
+void
+sched_incremental_prepare(xmlNode *input)
+{
+    GHashTable *history = NULL;
+    GHashTable *tickets = NULL;
+    char *digest = NULL;
+
+    if (changed_histories != NULL) {
+        g_hash_table_destroy(changed_histories);
+        changed_histories = NULL;
+    }
+    if (changed_tickets != NULL) {
+        g_hash_table_destroy(changed_tickets);
+        changed_tickets = NULL;
+    }
+
+    if (input == NULL) {
+        free(last_static_digest);
+        last_static_digest = NULL;
+        pe__keep_digests(FALSE);
+        return;
+    }
+
+    /* Without incremental scheduling (the default), only the static digest is
+     * needed, for the kept operation digests below, so don't digest every
+     * resource history and ticket state too
+     */
+    if (incremental_configured(input)) {
+        history = crm_str_table_new();
+        tickets = crm_str_table_new();
+    }
+
+    digest = digest_input(input, history, tickets);
+
+    /* Operation digests depend only on the static part of the input, so they
+     * can be reused for as long as that is unchanged (unless rules might
+     * evaluate differently as time passes)
+     */
+    if (safe_str_neq(digest, last_static_digest)) {
+        pe__clear_kept_digests();
+    }
+    pe__keep_digests(get_xpath_object("//date_expression", input,
+                                      LOG_TRACE) == NULL);
+
+    if (history && last_history && last_tickets
+        && safe_str_eq(digest, last_static_digest)) {
+
+        changed_histories = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                  free, NULL);
+        note_changed_digests(changed_histories, last_history, history,
+                             note_changed_history);
+
+        changed_tickets = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                free, NULL);
+        note_changed_digests(changed_tickets, last_tickets, tickets,
+                             note_changed_ticket);
+
+        crm_debug("%d resource histories and %d tickets changed since last input",
+                  g_hash_table_size(changed_histories),
+                  g_hash_table_size(changed_tickets));
+    }
+
+    free(last_static_digest);
+    last_static_digest = digest;
+
+    if (last_history) {
+        g_hash_table_destroy(last_history);
+    }
+    last_history = history;
+
+    if (last_tickets) {
+        g_hash_table_destroy(last_tickets);
+    }
+    last_tickets = tickets;
+}
+
+static bool
+mark_changed(GHashTable *changed, resource_t *rsc)
+{
+    if (rsc == NULL) {
+        return FALSE;
+    }
+    rsc = uber_parent(rsc);
+    if (g_hash_table_lookup(changed, rsc)) {
+        return FALSE;
+    }
+    g_hash_table_add(changed, rsc);
+    return TRUE;
+}
+
+static bool
+linked_changed(GHashTable *changed, resource_t *rsc1, resource_t *rsc2)
+{
+    if (rsc1 == NULL || rsc2 == NULL) {
+        return FALSE;
+
+    } else if (g_hash_table_lookup(changed, uber_parent(rsc1))) {
+        return mark_changed(changed, rsc2);
+
+    } else if (g_hash_table_lookup(changed, uber_parent(rsc2))) {
+        return mark_changed(changed, rsc1);
+    }
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Spread a set of changed resources across their relationships
+ *
+ * \param[in,out] changed   Set of top-level resources to expand
+ * \param[in]     data_set  Cluster working set
+ */
+static void
+expand_change_closure(GHashTable *changed, pe_working_set_t *data_set)
+{
+    bool expanded = TRUE;
+
+    while (expanded) {
+        expanded = FALSE;
+
+        for (GListPtr gIter = data_set->colocation_constraints; gIter != NULL; gIter = gIter->next) {
+            rsc_colocation_t *constraint = (rsc_colocation_t *) gIter->data;
+
+            expanded |= linked_changed(changed, constraint->rsc_lh,
+                                       constraint->rsc_rh);
+        }
+
+        for (GListPtr gIter = data_set->ordering_constraints; gIter != NULL; gIter = gIter->next) {
+            order_constraint_t *order = (order_constraint_t *) gIter->data;
+
+            expanded |= linked_changed(changed, order->lh_rsc, order->rh_rsc);
+        }
+
+        for (GListPtr gIter = data_set->resources; gIter != NULL; gIter = gIter->next) {
+            resource_t *rsc = (resource_t *) gIter->data;
+
+            expanded |= linked_changed(changed, rsc, rsc->container);
+            for (GListPtr fIter = rsc->fillers; fIter != NULL; fIter = fIter->next) {
+                expanded |= linked_changed(changed, rsc, fIter->data);
+            }
+        }
+    }
+}
+
+static void
+free_resource_list(gpointer data)
+{
+    g_list_free((GListPtr) data);
+}
+
+/*!
+ * \internal
+ * \brief Index the resources that depend on each ticket
+ *
+ * \param[in] data_set  Cluster working set, after constraints are unpacked
+ *
+ * \return Newly created table of ticket ID -> list of resource_t* (which the
+ *         caller should destroy)
+ */
+static GHashTable *
+ticket_index(pe_working_set_t *data_set)
+{
+    GHashTable *index = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                              NULL, free_resource_list);
+
+    for (GListPtr gIter = data_set->ticket_constraints; gIter != NULL;
+         gIter = gIter->next) {
+        rsc_ticket_t *rsc_ticket = (rsc_ticket_t *) gIter->data;
+        const char *ticket_id = rsc_ticket->ticket->id;
+        GListPtr rscs = g_hash_table_lookup(index, ticket_id);
+
+        // Prepending changes the list head, so take the old one out first
+        g_hash_table_steal(index, ticket_id);
+        g_hash_table_insert(index, (gpointer) ticket_id,
+                            g_list_prepend(rscs, rsc_ticket->rsc_lh));
+    }
+    return index;
+}
+
+static bool
+incremental_allowed(pe_working_set_t *data_set)
+{
+    if ((changed_histories == NULL) || (changed_tickets == NULL)
+        || (last_assignments == NULL)) {
+        return FALSE;
+
+    } else if (crm_is_true(pe_pref(data_set->config_hash,
+                                   "incremental-scheduling")) == FALSE) {
+        return FALSE;
+
+    } else if (safe_str_neq(data_set->placement_strategy, "default")) {
+        crm_trace("Not scheduling incrementally: placement-strategy=%s",
+                  data_set->placement_strategy);
+        return FALSE;
+
+    } else if (get_xpath_object("//date_expression", data_set->input, LOG_TRACE)) {
+        crm_trace("Not scheduling incrementally: time-based rules in use");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Decide which resources can reuse their previous placement
+ *
+ * \param[in] data_set  Cluster working set, after constraints are unpacked
+ */
+void
+sched_incremental_apply(pe_working_set_t *data_set)
+{
+    GHashTable *changed = NULL;
+    GHashTableIter iter;
+    const char *rsc_id = NULL;
+    int total = 0;
+
+    if (pinned != NULL) {
+        g_hash_table_destroy(pinned);
+        pinned = NULL;
+    }
+
+    if (incremental_allowed(data_set) == FALSE) {
+        return;
+    }
+
+    changed = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_hash_table_iter_init(&iter, changed_histories);
+    while (g_hash_table_iter_next(&iter, (gpointer *) &rsc_id, NULL)) {
+        resource_t *rsc = pe_find_resource_with_flags(data_set->resources, rsc_id,
+                                                      pe_find_renamed|pe_find_anon);
+
+        mark_changed(changed, rsc);
+    }
+
+    if (g_hash_table_size(changed_tickets) > 0) {
+        GHashTable *dependents = ticket_index(data_set);
+        const char *ticket_id = NULL;
+
+        g_hash_table_iter_init(&iter, changed_tickets);
+        while (g_hash_table_iter_next(&iter, (gpointer *) &ticket_id, NULL)) {
+            GListPtr rscs = g_hash_table_lookup(dependents, ticket_id);
+
+            crm_debug("Ticket %s changed: recalculating %u dependent resources",
+                      ticket_id, g_list_length(rscs));
+            for (GListPtr gIter = rscs; gIter != NULL; gIter = gIter->next) {
+                mark_changed(changed, gIter->data);
+            }
+        }
+        g_hash_table_destroy(dependents);
+    }
+
+    for (GListPtr gIter = data_set->resources; gIter != NULL; gIter = gIter->next) {
+        resource_t *rsc = (resource_t *) gIter->data;
+
+        // Failures can expire with time alone
+        if (rsc->failure_timeout > 0) {
+            mark_changed(changed, rsc);
+        }
+    }
+
+    expand_change_closure(changed, data_set);
+
+    pinned = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (GListPtr gIter = data_set->resources; gIter != NULL; gIter = gIter->next) {
+        resource_t *rsc = (resource_t *) gIter->data;
+        const char *node_id = g_hash_table_lookup(last_assignments, rsc->id);
+
+        total++;
+        if ((node_id == NULL) || (rsc->variant != pe_native)
+            || rsc->is_remote_node || is_set(rsc->flags, pe_rsc_is_container)
+            || is_not_set(rsc->flags, pe_rsc_managed)
+            || g_hash_table_lookup(changed, rsc)) {
+            continue;
+        }
+        g_hash_table_insert(pinned, rsc, (gpointer) node_id);
+    }
+
+    crm_info("Scheduling incrementally: reusing placement of %d of %d resources",
+             g_hash_table_size(pinned), total);
+    g_hash_table_destroy(changed);
+}
+
+/*!
+ * \internal
+ * \brief Get the node a resource should be assigned to without scoring
+ *
+ * \param[in] rsc  Resource being allocated
+ *
+ * \return Resource's allowed node entry for its previous placement if that
+ *         can be reused, otherwise NULL
+ */
+node_t *
+sched_incremental_pinned_node(resource_t *rsc)
+{
+    const char *node_id = NULL;
+    node_t *node = NULL;
+
+    if (pinned == NULL || rsc->allowed_nodes == NULL) {
+        return NULL;
+    }
+
+    node_id = g_hash_table_lookup(pinned, rsc);
+    if (node_id != NULL) {
+        node = g_hash_table_lookup(rsc->allowed_nodes, node_id);
+    }
+    if (node && ((node->weight < 0) || (can_run_resources(node) == FALSE))) {
+        pe_rsc_debug(rsc, "Previous placement of %s on %s is no longer possible",
+                     rsc->id, node->details->uname);
+        node = NULL;
+    }
+    return node;
+}
+
+/*!
+ * \internal
+ * \brief Remember resource placement for the next incremental calculation
+ *
+ * \param[in] data_set  Cluster working set, after allocation
+ */
+void
+sched_incremental_record(pe_working_set_t *data_set)
+{
+    if (last_assignments) {
+        g_hash_table_destroy(last_assignments);
+    }
+    last_assignments = crm_str_table_new();
+
+    for (GListPtr gIter = data_set->resources; gIter != NULL; gIter = gIter->next) {
+        resource_t *rsc = (resource_t *) gIter->data;
+
+        if ((rsc->variant == pe_native) && rsc->allocated_to) {
+            g_hash_table_insert(last_assignments, strdup(rsc->id),
+                                strdup(rsc->allocated_to->details->id));
+        }
+    }
+
+    if (pinned != NULL) {
+        g_hash_table_destroy(pinned);
+        pinned = NULL;
+    }
+}
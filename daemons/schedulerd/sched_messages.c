@@ -46,15 +46,269 @@ series_t series[] = {
     {"pe-input", "pe-input-series-max", 400},
 };
 
+/* Results of the most recent calculations, so that an identical request (for
+ * example, after an election or a repeated abort with no net change) can be
+ * answered without calculating it all again. The result of an input that uses
+ * anything evaluated against the current time (date rules, failure timeouts,
+ * remote reconnect intervals or operation interval origins) is only reused
+ * within the same second; any other result depends on the input alone.
+ */
+
+#define RESULT_CACHE_SIZE 4
+
+struct cached_result_s {
+    char *digest;               // digest of scheduler input
+    time_t now;                 // when the result was calculated
+    gboolean time_dependent;    // whether the result depends on now
+    xmlNode *graph;             // transition graph that was calculated
+    GHashTable *config_hash;    // cluster options in effect
+    gboolean processing_error;
+    gboolean processing_warning;
+    gboolean config_error;
+    gboolean config_warning;
+};
+
+static GQueue *cached_results = NULL;   // most recently used first
+static unsigned int result_cache_hits = 0;
+static unsigned int result_cache_misses = 0;
+
+// Anything in an input whose evaluation depends on the current time
+#define TIME_DEPENDENT_XPATH                                            \
+    "//date_expression"                                                 \
+    "|//" XML_CIB_TAG_NVPAIR "[@" XML_NVPAIR_ATTR_NAME "='"             \
+        XML_RSC_ATTR_FAIL_TIMEOUT "']"                                  \
+    "|//" XML_CIB_TAG_NVPAIR "[@" XML_NVPAIR_ATTR_NAME "='"             \
+        XML_REMOTE_ATTR_RECONNECT_INTERVAL "']"                         \
+    "|//" XML_CIB_TAG_NVPAIR "[@" XML_NVPAIR_ATTR_NAME "='"             \
+        XML_OP_ATTR_ORIGIN "']"                                         \
+    "|//" XML_ATTR_OP "[@" XML_OP_ATTR_ORIGIN "]"
+
+static gboolean
+input_time_dependent(xmlNode *input)
+{
+    xmlXPathObjectPtr matches = xpath_search(input, TIME_DEPENDENT_XPATH);
+    gboolean rc = (numXpathResults(matches) > 0);
+
+    freeXpathObject(matches);
+    return rc;
+}
+
+static void
+free_cached_result(gpointer data)
+{
+    struct cached_result_s *result = data;
+
+    free(result->digest);
+    free_xml(result->graph);
+    g_hash_table_destroy(result->config_hash);
+    free(result);
+}
+
+static GHashTable *
+copy_config_hash(GHashTable *config_hash)
+{
+    GHashTable *copy = crm_str_table_new();
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+
+    if (config_hash != NULL) {
+        g_hash_table_iter_init(&iter, config_hash);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            g_hash_table_insert(copy, strdup(key), strdup(value));
+        }
+    }
+    return copy;
+}
+
+/*!
+ * \internal
+ * \brief Reuse a previous result for an identical input, if available
+ *
+ * \param[in]     digest    Digest of scheduler input
+ * \param[in]     now       Current time
+ * \param[in,out] data_set  Working set to populate with previous result
+ *
+ * \return TRUE if a previous result was reused, FALSE otherwise
+ */
+static gboolean
+reuse_cached_result(const char *digest, time_t now,
+                    pe_working_set_t *data_set)
+{
+    struct cached_result_s *result = NULL;
+
+    if (cached_results == NULL) {
+        cached_results = g_queue_new();
+    }
+
+    for (GList *gIter = cached_results->head; gIter; gIter = gIter->next) {
+        struct cached_result_s *candidate = gIter->data;
+
+        if (safe_str_eq(candidate->digest, digest)
+            && (!candidate->time_dependent || (candidate->now == now))
+            // Incremental scheduling depends on more than the input
+            && !crm_is_true(pe_pref(candidate->config_hash,
+                                    "incremental-scheduling"))) {
+            result = candidate;
+            g_queue_unlink(cached_results, gIter);
+            g_queue_push_head_link(cached_results, gIter);
+            break;
+        }
+    }
+
+    if (result == NULL) {
+        result_cache_misses++;
+        crm_trace("No previous result for input %s (%u hits, %u misses)",
+                  digest, result_cache_hits, result_cache_misses);
+        return FALSE;
+    }
+
+    result_cache_hits++;
+    crm_info("Reusing previous result for unchanged input %s "
+             "(%u hits, %u misses)",
+             digest, result_cache_hits, result_cache_misses);
+
+    was_processing_error = result->processing_error;
+    was_processing_warning = result->processing_warning;
+    crm_config_error = result->config_error;
+    crm_config_warning = result->config_warning;
+
+    data_set->config_hash = copy_config_hash(result->config_hash);
+    data_set->graph = copy_xml(result->graph);
+    transition_id++;
+    crm_xml_add_int(data_set->graph, "transition_id", transition_id);
+    return TRUE;
+}
+
+static void
+cache_result(const char *digest, time_t now, xmlNode *input,
+             pe_working_set_t *data_set)
+{
+    struct cached_result_s *result = NULL;
+
+    if (data_set->graph == NULL) {
+        return;
+    }
+
+    result = calloc(1, sizeof(struct cached_result_s));
+    CRM_ASSERT(result != NULL);
+    result->digest = strdup(digest);
+    result->now = now;
+    result->time_dependent = input_time_dependent(input);
+    result->graph = copy_xml(data_set->graph);
+    result->config_hash = copy_config_hash(data_set->config_hash);
+    result->processing_error = was_processing_error;
+    result->processing_warning = was_processing_warning;
+    result->config_error = crm_config_error;
+    result->config_warning = crm_config_warning;
+
+    g_queue_push_head(cached_results, result);
+    while (g_queue_get_length(cached_results) > RESULT_CACHE_SIZE) {
+        free_cached_result(g_queue_pop_tail(cached_results));
+    }
+}
+
+/* Superseded calculations
+ *
+ * Whenever the cluster changes again, the controller sends a new request and
+ * discards the result of any earlier one it has not yet received. Requests are
+ * therefore queued, with a newer request from the same client replacing a
+ * queued one, and calculated only once no more input is waiting. A newer
+ * request that arrives while a calculation is in progress is noticed between
+ * scheduler stages, and the calculation is abandoned in its favor.
+ */
+
+static GHashTable *queued_requests = NULL;  // client ID -> newest request
+static crm_trigger_t *calculate_trigger = NULL;
+static const char *calculating_for = NULL;  // client ID of current request
+static gboolean superseded = FALSE;         // whether it has sent a newer one
+
+/*!
+ * \internal
+ * \brief Check whether the calculation in progress has been superseded
+ *
+ * \return TRUE if the same client has sent a newer request, otherwise FALSE
+ * \note This dispatches pending IPC input (so queue_calculation() may be
+ *       called), but no other main loop sources, so calculations never nest.
+ */
+static gboolean
+calculation_superseded(void)
+{
+    if (calculating_for == NULL) {
+        return FALSE; // not calculating for a client (e.g. in the fencer)
+    }
+    pcmk__mainloop_dispatch_ipc();
+    return superseded;
+}
+
+static void calculate_transition(xmlNode *msg, const char *client_id);
+
+static int
+calculate_queued(gpointer user_data)
+{
+    GHashTableIter iter;
+    char *client_id = NULL;
+    xmlNode *msg = NULL;
+
+    g_hash_table_iter_init(&iter, queued_requests);
+    if (g_hash_table_iter_next(&iter, (gpointer *) &client_id,
+                               (gpointer *) &msg)) {
+        g_hash_table_iter_steal(&iter);
+
+        if (crm_client_get_by_id(client_id) == NULL) {
+            crm_info("Discarding calculation %s: client %s disconnected",
+                     crm_element_value(msg, F_CRM_REFERENCE), client_id);
+        } else {
+            calculate_transition(msg, client_id);
+        }
+        free(client_id);
+        free_xml(msg);
+    }
+
+    if (g_hash_table_size(queued_requests) > 0) {
+        mainloop_set_trigger(calculate_trigger);
+    }
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Queue a calculation request, superseding any queued from its client
+ *
+ * \param[in] msg     Request to queue
+ * \param[in] sender  Client that sent request
+ */
+static void
+queue_calculation(xmlNode *msg, crm_client_t *sender)
+{
+    xmlNode *old = NULL;
+
+    if (queued_requests == NULL) {
+        queued_requests = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                free, (GDestroyNotify) free_xml);
+        calculate_trigger = mainloop_add_trigger(G_PRIORITY_LOW,
+                                                 calculate_queued, NULL);
+    }
+
+    if (safe_str_eq(sender->id, calculating_for)) {
+        superseded = TRUE;
+    }
+
+    old = g_hash_table_lookup(queued_requests, sender->id);
+    if (old != NULL) {
+        crm_info("Calculation %s superseded by %s before it started",
+                 crm_element_value(old, F_CRM_REFERENCE),
+                 crm_element_value(msg, F_CRM_REFERENCE));
+    }
+    g_hash_table_replace(queued_requests, strdup(sender->id), copy_xml(msg));
+    mainloop_set_trigger(calculate_trigger);
+}
+
 gboolean process_pe_message(xmlNode * msg, xmlNode * xml_data, crm_client_t * sender);
 
 gboolean
 process_pe_message(xmlNode * msg, xmlNode * xml_data, crm_client_t * sender)
 {
-    static char *last_digest = NULL;
-    static char *filename = NULL;
-
-    time_t execution_date = time(NULL);
     const char *sys_to = crm_element_value(msg, F_CRM_SYS_TO);
     const char *op = crm_element_value(msg, F_CRM_TASK);
     const char *ref = crm_element_value(msg, F_CRM_REFERENCE);
@@ -75,144 +329,243 @@ process_pe_message(xmlNode * msg, xmlNode * xml_data, crm_client_t * sender)
         return FALSE;
 
     } else if (strcasecmp(op, CRM_OP_PECALC) == 0) {
-        int seq = -1;
-        int series_id = 0;
-        int series_wrap = 0;
-        char *digest = NULL;
-        const char *value = NULL;
-        pe_working_set_t data_set;
-        xmlNode *converted = NULL;
-        xmlNode *reply = NULL;
-        gboolean is_repoke = FALSE;
-        gboolean process = TRUE;
-
-        crm_config_error = FALSE;
-        crm_config_warning = FALSE;
-
-        was_processing_error = FALSE;
-        was_processing_warning = FALSE;
-
-        set_working_set_defaults(&data_set);
-
-        digest = calculate_xml_versioned_digest(xml_data, FALSE, FALSE, CRM_FEATURE_SET);
-        converted = copy_xml(xml_data);
-        if (cli_config_update(&converted, NULL, TRUE) == FALSE) {
-            data_set.graph = create_xml_node(NULL, XML_TAG_GRAPH);
-            crm_xml_add_int(data_set.graph, "transition_id", 0);
-            crm_xml_add_int(data_set.graph, "cluster-delay", 0);
-            process = FALSE;
-            free(digest);
-
-        } else if (safe_str_eq(digest, last_digest)) {
-            crm_info("Input has not changed since last time, not saving to disk");
-            is_repoke = TRUE;
-            free(digest);
+        queue_calculation(msg, sender);
+    }
 
-        } else {
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Calculate a transition and send it to the client that requested it
+ *
+ * \param[in] msg        Calculation request
+ * \param[in] client_id  ID of client that sent request
+ */
+static void
+calculate_transition(xmlNode *msg, const char *client_id)
+{
+    static char *last_digest = NULL;
+    static char *filename = NULL;
+
+    time_t execution_date = time(NULL);
+    xmlNode *xml_data = get_message_xml(msg, F_CRM_DATA);
+    crm_client_t *sender = NULL;
+    int seq = -1;
+    int series_id = 0;
+    int series_wrap = 0;
+    int snapshot_interval = 0;
+    char *digest = NULL;
+    char *input_digest = NULL;
+    const char *value = NULL;
+    pe_working_set_t data_set;
+    xmlNode *converted = NULL;
+    xmlNode *reply = NULL;
+    xmlNode *graph = NULL;
+    gboolean is_repoke = FALSE;
+    gboolean process = TRUE;
+
+    crm_config_error = FALSE;
+    crm_config_warning = FALSE;
+
+    was_processing_error = FALSE;
+    was_processing_warning = FALSE;
+
+    set_working_set_defaults(&data_set);
+
+    digest = calculate_xml_versioned_digest(xml_data, FALSE, FALSE, CRM_FEATURE_SET);
+    input_digest = strdup(digest);
+    converted = copy_xml(xml_data);
+    if (cli_config_update(&converted, NULL, TRUE) == FALSE) {
+        data_set.graph = create_xml_node(NULL, XML_TAG_GRAPH);
+        crm_xml_add_int(data_set.graph, "transition_id", 0);
+        crm_xml_add_int(data_set.graph, "cluster-delay", 0);
+        process = FALSE;
+        free(digest);
+        sched_incremental_prepare(NULL);
+
+    } else if (safe_str_eq(digest, last_digest)) {
+        crm_info("Input has not changed since last time, not saving to disk");
+        is_repoke = TRUE;
+        free(digest);
+
+    } else {
+        free(last_digest);
+        last_digest = digest;
+    }
+
+    if (process
+        && !reuse_cached_result(input_digest, execution_date, &data_set)) {
+        sched_incremental_prepare(converted);
+        calculating_for = client_id;
+        superseded = FALSE;
+        do_calculations(&data_set, converted, NULL);
+        calculating_for = NULL;
+        sender = crm_client_get_by_id(client_id);
+
+        if ((data_set.graph == NULL) || (sender == NULL)) {
+            crm_notice("Abandoned calculation %s: %s",
+                       crm_element_value(msg, F_CRM_REFERENCE),
+                       (sender? "superseded by newer input"
+                        : "client disconnected"));
+
+            // Neither the input nor its result can be compared against
+            sched_incremental_prepare(NULL);
             free(last_digest);
-            last_digest = digest;
+            last_digest = NULL;
+
+            free(input_digest);
+            data_set.input = NULL;
+            cleanup_alloc_calculations(&data_set);
+            free_xml(converted);
+            return;
         }
+        sched_incremental_record(&data_set);
+        cache_result(input_digest, execution_date, converted, &data_set);
+    }
+    free(input_digest);
+    sender = crm_client_get_by_id(client_id);
+
+    series_id = get_series();
+    series_wrap = series[series_id].wrap;
+    value = pe_pref(data_set.config_hash, series[series_id].param);
 
-        if (process) {
-            do_calculations(&data_set, converted, NULL);
+    if (value != NULL) {
+        series_wrap = crm_int_helper(value, NULL);
+        if (errno != 0) {
+            series_wrap = series[series_id].wrap;
         }
 
-        series_id = get_series();
-        series_wrap = series[series_id].wrap;
-        value = pe_pref(data_set.config_hash, series[series_id].param);
+    } else {
+        crm_config_warn("No value specified for cluster"
+                        " preference: %s", series[series_id].param);
+    }
 
-        if (value != NULL) {
-            series_wrap = crm_int_helper(value, NULL);
-            if (errno != 0) {
-                series_wrap = series[series_id].wrap;
-            }
+    seq = sched_archive_sequence(series[series_id].name);
+    crm_trace("Series %s: wrap=%d, seq=%d, pref=%s",
+              series[series_id].name, series_wrap, seq, value);
 
-        } else {
-            crm_config_warn("No value specified for cluster"
-                            " preference: %s", series[series_id].param);
-        }
+    value = pe_pref(data_set.config_hash, "pe-input-snapshot-interval");
+    if (value != NULL) {
+        snapshot_interval = crm_parse_int(value, "0");
+    }
 
-        seq = get_last_sequence(PE_STATE_DIR, series[series_id].name);
-        crm_trace("Series %s: wrap=%d, seq=%d, pref=%s",
-                  series[series_id].name, series_wrap, seq, value);
+    data_set.input = NULL;
+    reply = create_reply(msg, NULL);
+    CRM_ASSERT(reply != NULL);
+
+    /* The graph can be very large, so move it into the reply rather than
+     * letting create_reply() copy it
+     */
+    graph = pcmk__xml_move(create_xml_node(reply, F_CRM_DATA),
+                           data_set.graph);
+    data_set.graph = NULL;
+
+    /* Only the requester knows whether it can expand shared parameter
+     * sets, so leave the graph verbose unless it asked
+     */
+    value = crm_element_value(msg, PCMK__COMPACT_GRAPH_ATTR);
+    if (crm_is_true(value)) {
+        compact_graph_parameters(graph);
+    }
 
-        data_set.input = NULL;
-        reply = create_reply(msg, data_set.graph);
-        CRM_ASSERT(reply != NULL);
+    // Pass back the trace span IDs of the failures that led to this
+    value = crm_element_value(msg, PCMK__TRACE_SPAN_ATTR);
+    if (value != NULL) {
+        int graph_id = 0;
 
-        if (is_repoke == FALSE) {
-            free(filename);
-            filename =
-                generate_series_filename(PE_STATE_DIR, series[series_id].name, seq, HAVE_BZLIB_H);
-        }
+        crm_xml_add(graph, PCMK__TRACE_SPAN_ATTR, value);
+        crm_element_value_int(graph, "transition_id", &graph_id);
+        pcmk__trace_hops(pcmk__hop_scheduled, graph_id, value);
+    }
 
-        crm_xml_add(reply, F_CRM_TGRAPH_INPUT, filename);
-        crm_xml_add_int(reply, "graph-errors", was_processing_error);
-        crm_xml_add_int(reply, "graph-warnings", was_processing_warning);
-        crm_xml_add_int(reply, "config-errors", crm_config_error);
-        crm_xml_add_int(reply, "config-warnings", crm_config_warning);
+    if (is_repoke == FALSE) {
+        free(filename);
+        filename =
+            generate_series_filename(PE_STATE_DIR, series[series_id].name, seq, HAVE_BZLIB_H);
+    }
 
-        if (crm_ipcs_send(sender, 0, reply, crm_ipc_server_event) == FALSE) {
-            int graph_file_fd = 0;
-            char *graph_file = NULL;
-            umask(S_IWGRP | S_IWOTH | S_IROTH);
+    crm_xml_add(reply, F_CRM_TGRAPH_INPUT, filename);
+    crm_xml_add_int(reply, "graph-errors", was_processing_error);
+    crm_xml_add_int(reply, "graph-warnings", was_processing_warning);
+    crm_xml_add_int(reply, "config-errors", crm_config_error);
+    crm_xml_add_int(reply, "config-warnings", crm_config_warning);
 
-            graph_file = crm_strdup_printf("%s/pengine.graph.XXXXXX",
-                                           PE_STATE_DIR);
-            graph_file_fd = mkstemp(graph_file);
+    if (crm_ipcs_send(sender, 0, reply, crm_ipc_server_event) == FALSE) {
+        int graph_file_fd = 0;
+        char *graph_file = NULL;
+        umask(S_IWGRP | S_IWOTH | S_IROTH);
 
-            crm_err("Couldn't send transition graph to peer, writing to %s instead",
-                    graph_file);
+        graph_file = crm_strdup_printf("%s/pengine.graph.XXXXXX",
+                                       PE_STATE_DIR);
+        graph_file_fd = mkstemp(graph_file);
 
-            crm_xml_add(reply, F_CRM_TGRAPH, graph_file);
-            write_xml_fd(data_set.graph, graph_file, graph_file_fd, FALSE);
+        crm_err("Couldn't send transition graph to peer, writing to %s instead",
+                graph_file);
 
-            free(graph_file);
-            free_xml(first_named_child(reply, F_CRM_DATA));
-            CRM_ASSERT(crm_ipcs_send(sender, 0, reply, crm_ipc_server_event));
-        }
+        crm_xml_add(reply, F_CRM_TGRAPH, graph_file);
+        write_xml_fd(graph, graph_file, graph_file_fd, FALSE);
 
-        free_xml(reply);
-        cleanup_alloc_calculations(&data_set);
+        free(graph_file);
+        free_xml(first_named_child(reply, F_CRM_DATA));
+        CRM_ASSERT(crm_ipcs_send(sender, 0, reply, crm_ipc_server_event));
+    }
 
-        if (was_processing_error) {
-            crm_err("Calculated transition %d (with errors), saving inputs in %s",
-                    transition_id, filename);
+    free_xml(reply);
+    cleanup_alloc_calculations(&data_set);
 
-        } else if (was_processing_warning) {
-            crm_warn("Calculated transition %d (with warnings), saving inputs in %s",
-                     transition_id, filename);
+    if (was_processing_error) {
+        crm_err("Calculated transition %d (with errors), saving inputs in %s",
+                transition_id, filename);
 
-        } else {
-            crm_notice("Calculated transition %d, saving inputs in %s",
-                       transition_id, filename);
-        }
+    } else if (was_processing_warning) {
+        crm_warn("Calculated transition %d (with warnings), saving inputs in %s",
+                 transition_id, filename);
 
-        if (crm_config_error) {
-            crm_notice("Configuration errors found during scheduler processing,"
-                       "  please run \"crm_verify -L\" to identify issues");
-        }
+    } else {
+        crm_notice("Calculated transition %d, saving inputs in %s",
+                   transition_id, filename);
+    }
 
-        if (is_repoke == FALSE && series_wrap != 0) {
-            unlink(filename);
-            crm_xml_add_int(xml_data, "execution-date", execution_date);
-            write_xml_file(xml_data, filename, HAVE_BZLIB_H);
-            write_last_sequence(PE_STATE_DIR, series[series_id].name, seq + 1, series_wrap);
-        } else {
-            crm_trace("Not writing out %s: %d & %d", filename, is_repoke, series_wrap);
-        }
+    if (crm_config_error) {
+        crm_notice("Configuration errors found during scheduler processing,"
+                   "  please run \"crm_verify -L\" to identify issues");
+    }
 
-        free_xml(converted);
+    if (is_repoke == FALSE && series_wrap != 0) {
+        crm_xml_add_int(xml_data, "execution-date", execution_date);
+        sched_archive_write(xml_data, filename, series[series_id].name,
+                            seq, series_wrap, snapshot_interval,
+                            HAVE_BZLIB_H);
+    } else {
+        crm_trace("Not writing out %s: %d & %d", filename, is_repoke, series_wrap);
     }
 
-    return TRUE;
+    free_xml(converted);
 }
 
+// Run a scheduler stage, recording how long it took
+#define profile_stage(stage, data_set) do {                         \
+        sched_profile_mark_t stage_start = sched_profile_mark();    \
+                                                                    \
+        stage(data_set);                                            \
+        sched_profile_record(#stage, &stage_start, data_set);       \
+    } while (0)
+
+// Run a scheduler stage, unless a newer request has superseded this one
+#define preemptible_stage(stage, data_set) do {                     \
+        if (calculation_superseded()) {                             \
+            return NULL;                                            \
+        }                                                           \
+        profile_stage(stage, data_set);                             \
+    } while (0)
+
 xmlNode *
 do_calculations(pe_working_set_t * data_set, xmlNode * xml_input, crm_time_t * now)
 {
     GListPtr gIter = NULL;
     int rsc_log_level = LOG_INFO;
+    sched_profile_mark_t start;
 
 /*	pe_debug_on(); */
 
@@ -231,8 +584,12 @@ do_calculations(pe_working_set_t * data_set, xmlNode * xml_input, crm_time_t * n
         data_set->now = crm_time_new(NULL);
     }
 
+    sched_profile_reset();
+    start = sched_profile_mark();
+
     crm_trace("Calculate cluster status");
-    stage0(data_set);
+    profile_stage(stage0, data_set);
+    sched_incremental_apply(data_set);
 
     if(is_not_set(data_set->flags, pe_flag_quick_location)) {
         gIter = data_set->resources;
@@ -247,29 +604,34 @@ do_calculations(pe_working_set_t * data_set, xmlNode * xml_input, crm_time_t * n
     }
 
     crm_trace("Applying placement constraints");
-    stage2(data_set);
+    profile_stage(stage2, data_set);
 
     if(is_set(data_set->flags, pe_flag_quick_location)){
         return NULL;
     }
 
     crm_trace("Create internal constraints");
-    stage3(data_set);
+    preemptible_stage(stage3, data_set);
 
     crm_trace("Check actions");
-    stage4(data_set);
+    preemptible_stage(stage4, data_set);
 
     crm_trace("Allocate resources");
-    stage5(data_set);
+    preemptible_stage(stage5, data_set);
 
     crm_trace("Processing fencing and shutdown cases");
-    stage6(data_set);
+    preemptible_stage(stage6, data_set);
 
     crm_trace("Applying ordering constraints");
-    stage7(data_set);
+    preemptible_stage(stage7, data_set);
 
     crm_trace("Create transition graph");
-    stage8(data_set);
+    preemptible_stage(stage8, data_set);
+
+    sched_profile_record("total", &start, data_set);
+    if (crm_is_true(pe_pref(data_set->config_hash, "scheduler-profiling"))) {
+        sched_profile_xml(data_set->graph);
+    }
 
     crm_trace("=#=#=#=#= Summary =#=#=#=#=");
     crm_trace("\t========= Set %d (Un-runnable) =========", -1);
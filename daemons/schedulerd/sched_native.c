@@ -23,7 +23,7 @@
 #define VARIANT_NATIVE 1
 #include <lib/pengine/variant.h>
 
-gboolean update_action(action_t * then);
+gboolean update_action(action_t * then, pe_working_set_t * data_set);
 void native_rsc_colocation_rh_must(resource_t * rsc_lh, gboolean update_lh,
                                    resource_t * rsc_rh, gboolean update_rh);
 
@@ -87,6 +87,10 @@ native_choose_node(resource_t * rsc, node_t * prefer, pe_working_set_t * data_se
         return rsc->allocated_to ? TRUE : FALSE;
     }
 
+    if (prefer == NULL) {
+        prefer = balance_remote_connection(rsc, data_set);
+    }
+
     // Sort allowed nodes by weight
     if (rsc->allowed_nodes) {
         length = g_hash_table_size(rsc->allowed_nodes);
@@ -188,41 +192,81 @@ native_choose_node(resource_t * rsc, node_t * prefer, pe_working_set_t * data_se
     return result;
 }
 
-static int
-node_list_attr_score(GHashTable * list, const char *attr, const char *value)
+struct attr_score_s {
+    int score;
+    const char *uname;
+};
+
+/*!
+ * \internal
+ * \brief Find the best score for each value of a node attribute
+ *
+ * \param[in]  list   Hash table of nodes to check
+ * \param[in]  attr   Name of node attribute to group nodes by
+ * \param[out] unset  Best score of nodes without the attribute
+ *
+ * \return Newly allocated hash table mapping each attribute value to the best
+ *         score (and name) of any node in \p list with that value
+ * \note Building this once per merge keeps node_hash_update() linear in the
+ *       number of nodes, rather than rescanning \p list for every node.
+ */
+static GHashTable *
+node_list_attr_scores(GHashTable * list, const char *attr,
+                      struct attr_score_s *unset)
 {
     GHashTableIter iter;
     node_t *node = NULL;
-    int best_score = -INFINITY;
-    const char *best_node = NULL;
+    GHashTable *scores = g_hash_table_new_full(crm_strcase_hash,
+                                               crm_strcase_equal, NULL, free);
 
-    if (attr == NULL) {
-        attr = CRM_ATTR_UNAME;
-    }
+    unset->score = -INFINITY;
+    unset->uname = NULL;
 
     g_hash_table_iter_init(&iter, list);
     while (g_hash_table_iter_next(&iter, NULL, (void **)&node)) {
         int weight = node->weight;
+        const char *value = pe_node_attribute_raw(node, attr);
+        struct attr_score_s *best = unset;
 
         if (can_run_resources(node) == FALSE) {
             weight = -INFINITY;
         }
-        if (weight > best_score || best_node == NULL) {
-            const char *tmp = pe_node_attribute_raw(node, attr);
 
-            if (safe_str_eq(value, tmp)) {
-                best_score = weight;
-                best_node = node->details->uname;
+        if (value != NULL) {
+            best = g_hash_table_lookup(scores, value);
+            if (best == NULL) {
+                best = calloc(1, sizeof(struct attr_score_s));
+                CRM_ASSERT(best != NULL);
+                best->score = -INFINITY;
+                g_hash_table_insert(scores, (gpointer) value, best);
             }
         }
+
+        if (weight > best->score || best->uname == NULL) {
+            best->score = weight;
+            best->uname = node->details->uname;
+        }
+    }
+    return scores;
+}
+
+static int
+node_list_attr_score(GHashTable * scores, struct attr_score_s *unset,
+                     const char *attr, const char *value)
+{
+    struct attr_score_s *best = unset;
+
+    if (value != NULL) {
+        best = g_hash_table_lookup(scores, value);
     }
 
     if (safe_str_neq(attr, CRM_ATTR_UNAME)) {
         crm_info("Best score for %s=%s was %s with %d",
-                 attr, value, best_node ? best_node : "<none>", best_score);
+                 attr, value, ((best && best->uname)? best->uname : "<none>"),
+                 (best? best->score : -INFINITY));
     }
 
-    return best_score;
+    return best? best->score : -INFINITY;
 }
 
 static void
@@ -233,11 +277,15 @@ node_hash_update(GHashTable * list1, GHashTable * list2, const char *attr, float
     int new_score = 0;
     GHashTableIter iter;
     node_t *node = NULL;
+    GHashTable *scores = NULL;
+    struct attr_score_s unset;
 
     if (attr == NULL) {
         attr = CRM_ATTR_UNAME;
     }
 
+    scores = node_list_attr_scores(list2, attr, &unset);
+
     g_hash_table_iter_init(&iter, list1);
     while (g_hash_table_iter_next(&iter, NULL, (void **)&node)) {
         float weight_f = 0;
@@ -246,7 +294,8 @@ node_hash_update(GHashTable * list1, GHashTable * list2, const char *attr, float
         CRM_LOG_ASSERT(node != NULL);
         if(node == NULL) { continue; };
 
-        score = node_list_attr_score(list2, attr, pe_node_attribute_raw(node, attr));
+        score = node_list_attr_score(scores, &unset, attr,
+                                     pe_node_attribute_raw(node, attr));
 
         weight_f = factor * score;
         /* Round the number */
@@ -283,19 +332,135 @@ node_hash_update(GHashTable * list1, GHashTable * list2, const char *attr, float
             node->weight = new_score;
         }
     }
+    g_hash_table_destroy(scores);
 }
 
 GHashTable *
 node_hash_dup(GHashTable * hash)
 {
-    /* Hack! */
-    GListPtr list = g_hash_table_get_values(hash);
-    GHashTable *result = node_hash_from_list(list);
+    GHashTableIter iter;
+    node_t *node = NULL;
+    GHashTable *result = g_hash_table_new_full(crm_str_hash, g_str_equal, NULL,
+                                               free);
+
+    g_hash_table_iter_init(&iter, hash);
+    while (g_hash_table_iter_next(&iter, NULL, (void **)&node)) {
+        node_t *n = node_copy(node);
 
-    g_list_free(list);
+        g_hash_table_insert(result, (gpointer) n->details->id, n);
+    }
     return result;
 }
 
+/*!
+ * \internal
+ * \brief Merge colocation scores for a single candidate node
+ *
+ * This calculates what rsc_merge_weights() would, with pe_weights_rollback,
+ * for a node table in which \p node is the only node not banned. Banned nodes
+ * stay banned whatever is merged into them, so only \p node's score needs to
+ * be followed through the chain of colocations, rather than copying the whole
+ * table at each step. This is the usual case for all but the first member of
+ * a colocated group, whose colocation with the previous member leaves just
+ * one node.
+ *
+ * \param[in]     rsc     Resource whose scores should be merged in
+ * \param[in]     rhs     ID of resource being allocated (for logging)
+ * \param[in]     node    The one allowed node
+ * \param[in]     attr    Colocation node attribute (NULL for node name)
+ * \param[in]     factor  Multiplier for \p rsc's scores
+ * \param[in,out] weight  Score of \p node, updated with merged score
+ *
+ * \return FALSE if a resource in the chain is not a primitive or uses a node
+ *         attribute, in which case \p weight is unchanged and the caller must
+ *         do a full merge, otherwise TRUE
+ */
+static gboolean
+merge_one_node_weight(resource_t *rsc, const char *rhs, node_t *node,
+                      const char *attr, float factor, int *weight)
+{
+    int multiplier = (factor < 0)? -1 : 1;
+    int score = -INFINITY;
+    int merged = *weight;
+    float weight_f = 0;
+    node_t *allowed = NULL;
+    gboolean complete = TRUE;
+
+    if ((rsc->variant != pe_native)
+        || ((attr != NULL) && safe_str_neq(attr, CRM_ATTR_UNAME))
+        || (pe_node_attribute_raw(node, CRM_ATTR_UNAME) == NULL)) {
+        return FALSE;
+    }
+
+    if (is_set(rsc->flags, pe_rsc_merging)) {
+        pe_rsc_info(rsc, "%s: Breaking dependency loop at %s", rhs, rsc->id);
+        return TRUE;
+    }
+
+    allowed = g_hash_table_lookup(rsc->allowed_nodes, node->details->id);
+    if (allowed != NULL) {
+        score = can_run_resources(allowed)? allowed->weight : -INFINITY;
+    }
+
+    weight_f = factor * score;
+    if ((factor >= 0) || (score >= 0)) {
+        merged = merge_weights((int)(weight_f < 0 ? weight_f - 0.5 : weight_f + 0.5),
+                               *weight);
+    }
+
+    if ((merged < 0) || (can_run_resources(node) == FALSE)) {
+        pe_rsc_info(rsc, "%s: Rolling back scores from %s", rhs, rsc->id);
+        return TRUE;
+    }
+
+    set_bit(rsc->flags, pe_rsc_merging);
+    for (GListPtr gIter = rsc->rsc_cons_lhs; complete && (gIter != NULL);
+         gIter = gIter->next) {
+        rsc_colocation_t *constraint = (rsc_colocation_t *) gIter->data;
+
+        pe_rsc_trace(rsc, "Applying %s (%s)",
+                     constraint->id, constraint->rsc_lh->id);
+        complete = merge_one_node_weight(constraint->rsc_lh, rhs, node,
+                                         constraint->node_attribute,
+                                         multiplier * (float)constraint->score / INFINITY,
+                                         &merged);
+    }
+    clear_bit(rsc->flags, pe_rsc_merging);
+
+    if (complete) {
+        *weight = merged;
+    }
+    return complete;
+}
+
+/*!
+ * \internal
+ * \brief Get the only node in a table that is not banned, if there is one
+ *
+ * \param[in]  nodes   Node table to check
+ * \param[out] single  Where to store the node (or NULL if all are banned)
+ *
+ * \return TRUE if no more than one node in \p nodes is not banned
+ */
+static gboolean
+single_allowed_node(GHashTable *nodes, node_t **single)
+{
+    GHashTableIter iter;
+    node_t *node = NULL;
+
+    *single = NULL;
+    g_hash_table_iter_init(&iter, nodes);
+    while (g_hash_table_iter_next(&iter, NULL, (void **)&node)) {
+        if (node->weight > -INFINITY) {
+            if (*single != NULL) {
+                return FALSE;
+            }
+            *single = node;
+        }
+    }
+    return TRUE;
+}
+
 GHashTable *
 native_merge_weights(resource_t * rsc, const char *rhs, GHashTable * nodes, const char *attr,
                      float factor, enum pe_weights flags)
@@ -314,6 +479,22 @@ rsc_merge_weights(resource_t * rsc, const char *rhs, GHashTable * nodes, const c
         multiplier = -1;
     }
 
+    if ((flags == pe_weights_rollback) && (nodes != NULL)) {
+        node_t *single = NULL;
+
+        if (single_allowed_node(nodes, &single)) {
+            if (single == NULL) {
+                // Nothing merged into banned nodes can make them usable
+                pe_rsc_info(rsc, "%s: Rolling back scores from %s", rhs, rsc->id);
+                return nodes;
+            }
+            if (merge_one_node_weight(rsc, rhs, single, attr, factor,
+                                      &(single->weight))) {
+                return nodes;
+            }
+        }
+    }
+
     if (is_set(rsc->flags, pe_rsc_merging)) {
         pe_rsc_info(rsc, "%s: Breaking dependency loop at %s", rhs, rsc->id);
         return nodes;
@@ -440,6 +621,7 @@ node_t *
 native_color(resource_t * rsc, node_t * prefer, pe_working_set_t * data_set)
 {
     GListPtr gIter = NULL;
+    node_t *pinned = NULL;
     int alloc_details = scores_log_level + 1;
 
     if (rsc->parent && is_not_set(rsc->parent->flags, pe_rsc_allocating)) {
@@ -490,7 +672,14 @@ native_color(resource_t * rsc, node_t * prefer, pe_working_set_t * data_set)
 
     dump_node_scores(alloc_details, rsc, "Post-coloc", rsc->allowed_nodes);
 
-    for (gIter = rsc->rsc_cons_lhs; gIter != NULL; gIter = gIter->next) {
+    /* If nothing that could influence this resource has changed since the
+     * last calculation, there's no need to merge in the preferences of
+     * everything colocated with it.
+     */
+    pinned = sched_incremental_pinned_node(rsc);
+
+    for (gIter = rsc->rsc_cons_lhs; (pinned == NULL) && (gIter != NULL);
+         gIter = gIter->next) {
         rsc_colocation_t *constraint = (rsc_colocation_t *) gIter->data;
 
         rsc->allowed_nodes =
@@ -544,6 +733,11 @@ native_color(resource_t * rsc, node_t * prefer, pe_working_set_t * data_set)
         pe_rsc_debug(rsc, "Forcing %s to stop", rsc->id);
         native_assign_node(rsc, NULL, NULL, TRUE);
 
+    } else if (pinned && is_set(rsc->flags, pe_rsc_provisional)) {
+        pe_rsc_trace(rsc, "Reusing previous placement of %s on %s", rsc->id,
+                     pinned->details->uname);
+        native_assign_node(rsc, NULL, pinned, FALSE);
+
     } else if (is_set(rsc->flags, pe_rsc_provisional)
                && native_choose_node(rsc, prefer, data_set)) {
         pe_rsc_trace(rsc, "Allocated resource %s to %s", rsc->id,
@@ -958,7 +1152,7 @@ RecurringOp_Stopped(resource_t * rsc, action_t * start, node_t * node,
             for (pIter = probes; pIter != NULL; pIter = pIter->next) {
                 action_t *probe = (action_t *) pIter->data;
 
-                order_actions(probe, stopped_mon, pe_order_runnable_left);
+                order_actions(probe, stopped_mon, pe_order_runnable_left, data_set);
                 crm_trace("%s then %s on %s", probe->uuid, stopped_mon->uuid, stop_node->details->uname);
             }
 
@@ -1866,7 +2060,8 @@ native_action_flags(action_t * action, node_t * node)
 
 enum pe_graph_flags
 native_update_actions(action_t * first, action_t * then, node_t * node, enum pe_action_flags flags,
-                      enum pe_action_flags filter, enum pe_ordering type)
+                      enum pe_action_flags filter, enum pe_ordering type,
+                      pe_working_set_t * data_set)
 {
     /* flags == get_action_flags(first, then_node) called from update_action() */
     enum pe_graph_flags changed = pe_graph_none;
@@ -2035,7 +2230,7 @@ native_update_actions(action_t * first, action_t * then, node_t * node, enum pe_
 
         if(then->rsc && then->rsc->parent) {
             /* "X_stop then X_start" doesn't get handled for cloned groups unless we do this */
-            update_action(then);
+            update_action(then, data_set);
         }
     }
 
@@ -2505,7 +2700,7 @@ StopRsc(resource_t * rsc, node_t * next, gboolean optional, pe_working_set_t * d
         if(is_set(rsc->flags, pe_rsc_needs_unfencing)) {
             action_t *unfence = pe_fence_op(current, "on", TRUE, NULL, data_set);
 
-            order_actions(stop, unfence, pe_order_implies_first);
+            order_actions(stop, unfence, pe_order_implies_first, data_set);
             if (!node_has_been_unfenced(current)) {
                 pe_proc_err("Stopping %s until %s can be unfenced", rsc->id, current->details->uname);
             }
@@ -2535,9 +2730,14 @@ order_after_unfencing(resource_t *rsc, pe_node_t *node, action_t *action,
          */
         action_t *unfence = pe_fence_op(node, "on", TRUE, NULL, data_set);
 
-        order_actions(unfence, action, order);
+        order_actions(unfence, action, order, data_set);
 
-        if (!node_has_been_unfenced(node)) {
+        /* Once unfencing has been required with a reason, requiring it again
+         * changes nothing, so skip that for the node's remaining resources
+         */
+        if (((unfence->reason == NULL)
+             || is_set(unfence->flags, pe_action_optional))
+            && !node_has_been_unfenced(node)) {
             // But unfencing is required if it has never been done
             char *reason = crm_strdup_printf("required by %s %s",
                                              rsc->id, action->task);
@@ -3019,7 +3219,7 @@ native_create_probe(resource_t * rsc, node_t * node, action_t * complete,
          *
          * So instead we explicitly order 'rsc.probe then rsc.start'
          */
-        order_actions(probe, complete, pe_order_implies_then);
+        order_actions(probe, complete, pe_order_implies_then, data_set);
     }
 #endif
     return TRUE;
@@ -3070,7 +3270,7 @@ native_start_constraints(resource_t * rsc, action_t * stonith_op, pe_working_set
             /* Anything other than start or promote requires nothing */
 
         } else if (action->needs == rsc_req_stonith) {
-            order_actions(stonith_done, action, pe_order_optional);
+            order_actions(stonith_done, action, pe_order_optional, data_set);
 
         } else if (safe_str_eq(action->task, RSC_START)
                    && NULL != pe_hash_table_lookup(rsc->allowed_nodes, target->details->id)
@@ -3093,7 +3293,8 @@ native_start_constraints(resource_t * rsc, action_t * stonith_op, pe_working_set
 
             pe_rsc_debug(rsc, "Ordering %s after %s recovery", action->uuid,
                          target->details->uname);
-            order_actions(all_stopped, action, pe_order_optional | pe_order_runnable_left);
+            order_actions(all_stopped, action,
+                          pe_order_optional | pe_order_runnable_left, data_set);
         }
     }
 }
@@ -3160,9 +3361,9 @@ native_stop_constraints(resource_t * rsc, action_t * stonith_op, pe_working_set_
                 flags |= pe_order_preserve;
             }
             if (pe_rsc_is_bundled(rsc) == FALSE) {
-                order_actions(stonith_op, action, flags);
+                order_actions(stonith_op, action, flags, data_set);
             }
-            order_actions(stonith_op, parent_stop, flags);
+            order_actions(stonith_op, parent_stop, flags, data_set);
         } else {
             if (is_set(rsc->flags, pe_rsc_failed)) {
                 crm_notice("Stop of failed resource %s is implicit because %s will be fenced",
@@ -3261,7 +3462,8 @@ native_stop_constraints(resource_t * rsc, action_t * stonith_op, pe_working_set_
                 /* Do nothing, let the recovery be ordered after the parent's implied stop */
 
             } else if (order_implicit) {
-                order_actions(stonith_op, action, pe_order_preserve|pe_order_optional);
+                order_actions(stonith_op, action,
+                              pe_order_preserve|pe_order_optional, data_set);
             }
         }
     }
@@ -71,12 +71,38 @@ static notify_entry_t *dup_notify_entry(notify_entry_t *entry)
     return dup;
 }
 
+/* A space-separated list of names, grown geometrically so that building a
+ * list for a clone with many instances takes linear rather than quadratic time
+ */
+struct notify_list_s {
+    char *text;     // NULL until the first item is added
+    size_t len;
+    size_t max;
+};
+
+static void
+add_notify_list_item(struct notify_list_s *list, const char *item)
+{
+    size_t item_len = strlen(item);
+    size_t needed = list->len + item_len + 2;   /* +1 space, +1 EOS */
+
+    if (needed > list->max) {
+        list->max = (needed > 2 * list->max)? needed : (2 * list->max);
+        list->text = realloc_safe(list->text, list->max);
+    }
+    if (list->len > 0) {
+        list->text[list->len++] = ' ';
+    }
+    memcpy(list->text + list->len, item, item_len + 1);
+    list->len += item_len;
+}
+
 static void
 expand_node_list(GListPtr list, char **uname, char **metal)
 {
     GListPtr gIter = NULL;
-    char *node_list = NULL;
-    char *metal_list = NULL;
+    struct notify_list_s node_list = { NULL, 0, 0 };
+    struct notify_list_s metal_list = { NULL, 0, 0 };
 
     CRM_ASSERT(uname != NULL);
     if (list == NULL) {
@@ -88,28 +114,14 @@ expand_node_list(GListPtr list, char **uname, char **metal)
     }
 
     for (gIter = list; gIter != NULL; gIter = gIter->next) {
-        int len = 0;
-        int existing_len = 0;
         node_t *node = (node_t *) gIter->data;
 
         if (node->details->uname == NULL) {
             continue;
         }
-        len = 2 + strlen(node->details->uname);
-
-        if(node_list) {
-            existing_len = strlen(node_list);
-        }
-//            crm_trace("Adding %s (%dc) at offset %d", node->details->uname, len - 2, existing_len);
-        node_list = realloc_safe(node_list, len + existing_len);
-        sprintf(node_list + existing_len, "%s%s", existing_len == 0 ? "":" ", node->details->uname);
+        add_notify_list_item(&node_list, node->details->uname);
 
         if(metal) {
-            existing_len = 0;
-            if(metal_list) {
-                existing_len = strlen(metal_list);
-            }
-
             if(node->details->remote_rsc
                && node->details->remote_rsc->container
                && node->details->remote_rsc->container->running_on) {
@@ -119,15 +131,13 @@ expand_node_list(GListPtr list, char **uname, char **metal)
             if (node->details->uname == NULL) {
                 continue;
             }
-            len = 2 + strlen(node->details->uname);
-            metal_list = realloc_safe(metal_list, len + existing_len);
-            sprintf(metal_list + existing_len, "%s%s", existing_len == 0 ? "":" ", node->details->uname);
+            add_notify_list_item(&metal_list, node->details->uname);
         }
     }
 
-    *uname = node_list;
+    *uname = node_list.text;
     if(metal) {
-        *metal = metal_list;
+        *metal = metal_list.text;
     }
 }
 
@@ -138,6 +148,8 @@ expand_list(GListPtr list, char **rsc_list, char **node_list)
     const char *uname = NULL;
     const char *rsc_id = NULL;
     const char *last_rsc_id = NULL;
+    struct notify_list_s rscs = { NULL, 0, 0 };
+    struct notify_list_s nodes = { NULL, 0, 0 };
 
     if (rsc_list) {
         *rsc_list = NULL;
@@ -184,16 +196,8 @@ expand_list(GListPtr list, char **rsc_list, char **node_list)
         last_rsc_id = rsc_id;
 
         if (rsc_list != NULL) {
-            int existing_len = 0;
-            int len = 2 + strlen(rsc_id);       /* +1 space, +1 EOS */
-
-            if (*rsc_list) {
-                existing_len = strlen(*rsc_list);
-            }
-
-            crm_trace("Adding %s (%dc) at offset %d", rsc_id, len - 2, existing_len);
-            *rsc_list = realloc_safe(*rsc_list, len + existing_len);
-            sprintf(*rsc_list + existing_len, "%s%s", existing_len == 0 ? "":" ", rsc_id);
+            crm_trace("Adding %s at offset %lu", rsc_id, (unsigned long) rscs.len);
+            add_notify_list_item(&rscs, rsc_id);
         }
 
         if (entry->node != NULL) {
@@ -201,19 +205,17 @@ expand_list(GListPtr list, char **rsc_list, char **node_list)
         }
 
         if (node_list != NULL && uname) {
-            int existing_len = 0;
-            int len = 2 + strlen(uname);
-
-            if (*node_list) {
-                existing_len = strlen(*node_list);
-            }
-
-            crm_trace("Adding %s (%dc) at offset %d", uname, len - 2, existing_len);
-            *node_list = realloc_safe(*node_list, len + existing_len);
-            sprintf(*node_list + existing_len, "%s%s", existing_len == 0 ? "":" ", uname);
+            crm_trace("Adding %s at offset %lu", uname, (unsigned long) nodes.len);
+            add_notify_list_item(&nodes, uname);
         }
     }
 
+    if (rsc_list) {
+        *rsc_list = rscs.text;
+    }
+    if (node_list) {
+        *node_list = nodes.text;
+    }
 }
 
 static void
@@ -262,8 +264,8 @@ pe_notify(resource_t * rsc, node_t * node, action_t * op, action_t * confirm,
     pe_rsc_trace(rsc, "Ordering %s before %s (%d->%d)", op->uuid, trigger->uuid, trigger->id,
                  op->id);
 
-    order_actions(op, trigger, pe_order_optional);
-    order_actions(trigger, confirm, pe_order_optional);
+    order_actions(op, trigger, pe_order_optional, data_set);
+    order_actions(trigger, confirm, pe_order_optional, data_set);
     return trigger;
 }
 
@@ -300,7 +302,7 @@ pe_post_notify(resource_t * rsc, node_t * node, notify_data_t * n_data, pe_worki
                 continue;
             }
 
-            order_actions(n_data->post_done, mon, pe_order_optional);
+            order_actions(n_data->post_done, mon, pe_order_optional, data_set);
         }
     }
 }
@@ -360,8 +362,8 @@ create_notification_boundaries(resource_t * rsc, const char *action, action_t *
         add_hash_param(n_data->pre_done->meta, "notify_key_type", "confirmed-pre");
         add_hash_param(n_data->pre_done->meta, "notify_key_operation", start->task);
 
-        order_actions(n_data->pre_done, start, pe_order_optional);
-        order_actions(n_data->pre, n_data->pre_done, pe_order_optional);
+        order_actions(n_data->pre_done, start, pe_order_optional, data_set);
+        order_actions(n_data->pre, n_data->pre_done, pe_order_optional, data_set);
     }
 
     if (end) {
@@ -405,18 +407,18 @@ create_notification_boundaries(resource_t * rsc, const char *action, action_t *
         add_hash_param(n_data->post_done->meta, "notify_key_type", "confirmed-post");
         add_hash_param(n_data->post_done->meta, "notify_key_operation", end->task);
 
-        order_actions(end, n_data->post, pe_order_implies_then);
-        order_actions(n_data->post, n_data->post_done, pe_order_implies_then);
+        order_actions(end, n_data->post, pe_order_implies_then, data_set);
+        order_actions(n_data->post, n_data->post_done, pe_order_implies_then, data_set);
     }
 
     if (start && end) {
-        order_actions(n_data->pre_done, n_data->post, pe_order_optional);
+        order_actions(n_data->pre_done, n_data->post, pe_order_optional, data_set);
     }
 
     if (safe_str_eq(action, RSC_STOP)) {
         action_t *all_stopped = get_pseudo_op(ALL_STOPPED, data_set);
 
-        order_actions(n_data->post_done, all_stopped, pe_order_optional);
+        order_actions(n_data->post_done, all_stopped, pe_order_optional, data_set);
     }
 
     return n_data;
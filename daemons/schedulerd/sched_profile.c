@@ -0,0 +1,213 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <time.h>
+
+#ifdef HAVE_MALLOC_H
+#  include <malloc.h>
+#endif
+
+#include <crm/crm.h>
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+
+#include <glib.h>
+
+#include <crm/pengine/status.h>
+#include <pacemaker-schedulerd.h>
+#include <sched_utils.h>
+#include <sched_allocate.h>
+
+/*
+ * Scheduler profiling
+ *
+ * do_calculations() records the cost of each stage of the most recent
+ * calculation: wall clock and CPU time, the change in heap usage (where the
+ * C library can report it), the number of times action flags were propagated
+ * through orderings (see update_action()), and the number of resources,
+ * actions, orderings and colocations in the working set once the stage is
+ * done. The results are logged at debug level, optionally added to the
+ * transition graph (see the scheduler-profiling cluster option), and reported
+ * by crm_simulate --profile.
+ */
+
+struct stage_profile_s {
+    char *stage;
+    double wall_ms;
+    double cpu_ms;
+    long heap_bytes;
+    unsigned long update_steps;
+    int resources;
+    int actions;
+    int orderings;
+    int colocations;
+};
+
+// Stages of the current calculation, in the order they completed
+static GList *stage_profiles = NULL;
+
+static void
+free_stage_profile(gpointer data)
+{
+    struct stage_profile_s *profile = data;
+
+    free(profile->stage);
+    free(profile);
+}
+
+static long
+heap_in_use(void)
+{
+#if defined(HAVE_MALLINFO2)
+    struct mallinfo2 info = mallinfo2();
+
+    return (long) info.uordblks;
+#elif defined(HAVE_MALLINFO)
+    struct mallinfo info = mallinfo();
+
+    return (long) info.uordblks;
+#else
+    return 0;
+#endif
+}
+
+static int
+count_resources(GListPtr resources)
+{
+    int count = 0;
+
+    for (GListPtr gIter = resources; gIter != NULL; gIter = gIter->next) {
+        resource_t *rsc = (resource_t *) gIter->data;
+
+        count += 1 + count_resources(rsc->children);
+    }
+    return count;
+}
+
+/*!
+ * \internal
+ * \brief Forget the stage costs of the previous calculation
+ */
+void
+sched_profile_reset(void)
+{
+    g_list_free_full(stage_profiles, free_stage_profile);
+    stage_profiles = NULL;
+}
+
+/*!
+ * \internal
+ * \brief Take a snapshot of the current time and heap usage
+ *
+ * \return Snapshot to pass to sched_profile_record() once the stage is done
+ */
+sched_profile_mark_t
+sched_profile_mark(void)
+{
+    sched_profile_mark_t mark;
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    mark.wall_ms = now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+#else
+    mark.wall_ms = time(NULL) * 1000.0;
+#endif
+    mark.cpu_ms = clock() * 1000.0 / CLOCKS_PER_SEC;
+    mark.heap_bytes = heap_in_use();
+    mark.update_steps = update_action_steps();
+    return mark;
+}
+
+/*!
+ * \internal
+ * \brief Record the cost of a scheduler stage
+ *
+ * \param[in] stage     Name of the stage that just completed
+ * \param[in] start     Snapshot taken when the stage started
+ * \param[in] data_set  Working set the stage operated on
+ */
+void
+sched_profile_record(const char *stage, const sched_profile_mark_t *start,
+                     pe_working_set_t *data_set)
+{
+    sched_profile_mark_t end = sched_profile_mark();
+    struct stage_profile_s *profile = calloc(1, sizeof(struct stage_profile_s));
+
+    CRM_ASSERT(profile != NULL);
+    profile->stage = strdup(stage);
+    profile->wall_ms = end.wall_ms - start->wall_ms;
+    profile->cpu_ms = end.cpu_ms - start->cpu_ms;
+    profile->heap_bytes = end.heap_bytes - start->heap_bytes;
+    profile->update_steps = end.update_steps - start->update_steps;
+    profile->resources = count_resources(data_set->resources);
+    profile->actions = g_list_length(data_set->actions);
+    profile->orderings = g_list_length(data_set->ordering_constraints);
+    profile->colocations = g_list_length(data_set->colocation_constraints);
+
+    crm_debug("Scheduler stage %s took %.3fms (%.3fms CPU, %+ld heap bytes, "
+              "%lu propagation steps): "
+              "%d resources, %d actions, %d orderings, %d colocations",
+              profile->stage, profile->wall_ms, profile->cpu_ms,
+              profile->heap_bytes, profile->update_steps,
+              profile->resources, profile->actions,
+              profile->orderings, profile->colocations);
+
+    stage_profiles = g_list_append(stage_profiles, profile);
+    pcmk__metric_observe_us(pcmk__metric(pcmk__metric_histogram,
+                                         "scheduler_stage_seconds",
+                                         "Time taken by scheduler stages, "
+                                         "by stage", "stage", stage),
+                            (gint64) (profile->wall_ms * 1000));
+}
+
+/*!
+ * \internal
+ * \brief Create XML describing the stage costs of the last calculation
+ *
+ * \param[in] parent  Node to add the \<profiling> element to (or NULL)
+ *
+ * \return Newly created \<profiling> element
+ * \note The caller is responsible for freeing the result if \p parent is NULL.
+ */
+xmlNode *
+sched_profile_xml(xmlNode *parent)
+{
+    xmlNode *xml = create_xml_node(parent, "profiling");
+
+    for (GList *gIter = stage_profiles; gIter != NULL; gIter = gIter->next) {
+        struct stage_profile_s *profile = gIter->data;
+        xmlNode *stage = create_xml_node(xml, "stage");
+        char *value = NULL;
+
+        crm_xml_add(stage, XML_ATTR_ID, profile->stage);
+
+        value = crm_strdup_printf("%.3f", profile->wall_ms);
+        crm_xml_add(stage, "wall-ms", value);
+        free(value);
+
+        value = crm_strdup_printf("%.3f", profile->cpu_ms);
+        crm_xml_add(stage, "cpu-ms", value);
+        free(value);
+
+        value = crm_strdup_printf("%ld", profile->heap_bytes);
+        crm_xml_add(stage, "heap-bytes", value);
+        free(value);
+
+        value = crm_strdup_printf("%lu", profile->update_steps);
+        crm_xml_add(stage, "propagation-steps", value);
+        free(value);
+
+        crm_xml_add_int(stage, "resources", profile->resources);
+        crm_xml_add_int(stage, "actions", profile->actions);
+        crm_xml_add_int(stage, "orderings", profile->orderings);
+        crm_xml_add_int(stage, "colocations", profile->colocations);
+    }
+    return xml;
+}
@@ -378,12 +378,19 @@ promotion_order(resource_t *rsc, pe_working_set_t *data_set)
     clear_bit(rsc->flags, pe_rsc_merging);
 }
 
-static gboolean
-filter_anonymous_instance(resource_t *rsc, const node_t *node)
+/* Which instance of an anonymous clone should receive the promotion score for
+ * a node (see filter_anonymous_instance())
+ */
+struct anon_filter_s {
+    resource_t *active; // First instance found active on the node, if any
+    gboolean known;     // Whether any instance has been probed on the node
+};
+
+static void
+find_anonymous_filter(resource_t *parent, const char *key, const node_t *node,
+                      struct anon_filter_s *filter)
 {
     GListPtr rIter = NULL;
-    char *key = clone_strip(rsc->id);
-    resource_t *parent = uber_parent(rsc);
 
     for (rIter = parent->children; rIter; rIter = rIter->next) {
         /* If there is an active instance on the node, only it receives the
@@ -392,21 +399,18 @@ filter_anonymous_instance(resource_t *rsc, const node_t *node)
         resource_t *child = rIter->data;
         resource_t *active = parent->fns->find_rsc(child, key, node, pe_find_clone|pe_find_current);
 
-        if(rsc == active) {
-            pe_rsc_trace(rsc, "Found %s for %s active on %s: done", active->id, key, node->details->uname);
-            free(key);
-            return TRUE;
-        } else if(active) {
-            pe_rsc_trace(rsc, "Found %s for %s on %s: not %s", active->id, key, node->details->uname, rsc->id);
-            free(key);
-            return FALSE;
+        if(active) {
+            pe_rsc_trace(active, "Found %s for %s active on %s", active->id, key, node->details->uname);
+            filter->active = active;
+            return;
         } else {
-            pe_rsc_trace(rsc, "%s on %s: not active", key, node->details->uname);
+            pe_rsc_trace(parent, "%s on %s: not active", key, node->details->uname);
         }
     }
 
     for (rIter = parent->children; rIter; rIter = rIter->next) {
         resource_t *child = rIter->data;
+        resource_t *rsc = NULL;
 
         /*
          * We know it's not running, but any score will still count if
@@ -421,13 +425,74 @@ filter_anonymous_instance(resource_t *rsc, const node_t *node)
         if(rsc) {
             pe_rsc_trace(rsc, "Checking %s for %s on %s", rsc->id, key, node->details->uname);
             if (g_hash_table_lookup(rsc->known_on, node->details->id)) {
-                free(key);
-                return TRUE;
+                filter->known = TRUE;
+                return;
             }
         }
     }
+}
+
+/*!
+ * \internal
+ * \brief Check whether an anonymous clone instance gets a node's promotion score
+ *
+ * \param[in]     rsc    Anonymous clone instance (or member of one)
+ * \param[in]     node   Node to check
+ * \param[in,out] cache  If not NULL, table of previous answers to reuse and add to
+ *
+ * \return TRUE if \p rsc is the instance that should use \p node's score
+ * \note The answer is the same for every instance of the clone, so callers
+ *       checking all instances should pass a cache. Without one, checking
+ *       every instance on every node is quadratic in the number of instances.
+ */
+static gboolean
+filter_anonymous_instance(resource_t *rsc, const node_t *node,
+                          GHashTable *cache)
+{
+    char *key = clone_strip(rsc->id);
+    GHashTable *by_node = NULL;
+    struct anon_filter_s *filter = NULL;
+    struct anon_filter_s local = { NULL, FALSE };
+    gboolean result = FALSE;
+
+    if (cache != NULL) {
+        by_node = g_hash_table_lookup(cache, key);
+        if (by_node == NULL) {
+            by_node = g_hash_table_new_full(crm_str_hash, g_str_equal, NULL,
+                                            free);
+            g_hash_table_insert(cache, strdup(key), by_node);
+        }
+        filter = g_hash_table_lookup(by_node, node->details->id);
+    }
+
+    if (filter == NULL) {
+        if (by_node != NULL) {
+            filter = calloc(1, sizeof(struct anon_filter_s));
+            CRM_ASSERT(filter != NULL);
+            g_hash_table_insert(by_node, (gpointer) node->details->id, filter);
+        } else {
+            filter = &local;
+        }
+        find_anonymous_filter(uber_parent(rsc), key, node, filter);
+    }
+
+    if (filter->active != NULL) {
+        result = (filter->active == rsc);
+        pe_rsc_trace(rsc, "%s is active on %s: %s %s", key,
+                     node->details->uname, filter->active->id,
+                     (result? "done" : "not this instance"));
+    } else {
+        result = filter->known;
+    }
     free(key);
-    return FALSE;
+    return result;
+}
+
+static GHashTable *
+new_anonymous_filter_cache(void)
+{
+    return g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                 (GDestroyNotify) g_hash_table_destroy);
 }
 
 static const char *
@@ -445,7 +510,8 @@ lookup_promotion_score(resource_t *rsc, const node_t *node, const char *name)
 }
 
 static int
-promotion_score(resource_t *rsc, const node_t *node, int not_set_value)
+promotion_score(resource_t *rsc, const node_t *node, int not_set_value,
+                GHashTable *anon_cache)
 {
     char *name = rsc->id;
     const char *attr_value = NULL;
@@ -459,7 +525,8 @@ promotion_score(resource_t *rsc, const node_t *node, int not_set_value)
 
         for (; gIter != NULL; gIter = gIter->next) {
             resource_t *child = (resource_t *) gIter->data;
-            int c_score = promotion_score(child, node, not_set_value);
+            int c_score = promotion_score(child, node, not_set_value,
+                                          anon_cache);
 
             if (score == not_set_value) {
                 score = c_score;
@@ -470,7 +537,8 @@ promotion_score(resource_t *rsc, const node_t *node, int not_set_value)
         return score;
     }
 
-    if (is_not_set(rsc->flags, pe_rsc_unique) && filter_anonymous_instance(rsc, node)) {
+    if (is_not_set(rsc->flags, pe_rsc_unique)
+        && filter_anonymous_instance(rsc, node, anon_cache)) {
         pe_rsc_trace(rsc, "Anonymous clone %s is allowed on %s", rsc->id, node->details->uname);
 
     } else if (rsc->running_on || g_hash_table_size(rsc->known_on)) {
@@ -537,6 +605,7 @@ apply_master_prefs(resource_t *rsc)
 {
     int score, new_score;
     GListPtr gIter = rsc->children;
+    GHashTable *anon_cache = NULL;
     clone_variant_data_t *clone_data = NULL;
 
     get_clone_variant_data(clone_data, rsc);
@@ -547,6 +616,7 @@ apply_master_prefs(resource_t *rsc)
     }
 
     clone_data->applied_master_prefs = TRUE;
+    anon_cache = new_anonymous_filter_cache();
 
     for (; gIter != NULL; gIter = gIter->next) {
         GHashTableIter iter;
@@ -563,7 +633,7 @@ apply_master_prefs(resource_t *rsc)
                 continue;
             }
 
-            score = promotion_score(child_rsc, node, 0);
+            score = promotion_score(child_rsc, node, 0, anon_cache);
             if (score > 0) {
                 new_score = merge_weights(node->weight, score);
                 if (new_score != node->weight) {
@@ -581,6 +651,7 @@ apply_master_prefs(resource_t *rsc)
             }
         }
     }
+    g_hash_table_destroy(anon_cache);
 }
 
 static void
@@ -642,6 +713,7 @@ color_promotable(resource_t *rsc, pe_working_set_t *data_set)
     enum rsc_role_e next_role = RSC_ROLE_UNKNOWN;
     char score[33];
     size_t len = sizeof(score);
+    GHashTable *anon_cache = new_anonymous_filter_cache();
     clone_variant_data_t *clone_data = NULL;
 
     get_clone_variant_data(clone_data, rsc);
@@ -688,7 +760,8 @@ color_promotable(resource_t *rsc, pe_working_set_t *data_set)
                  * but prevents anyone from being promoted if
                  * neither a constraint nor a promotion score is present
                  */
-                child_rsc->priority = promotion_score(child_rsc, chosen, -1);
+                child_rsc->priority = promotion_score(child_rsc, chosen, -1,
+                                                      anon_cache);
                 break;
 
             case RSC_ROLE_SLAVE:
@@ -721,6 +794,8 @@ color_promotable(resource_t *rsc, pe_working_set_t *data_set)
         }
     }
 
+    g_hash_table_destroy(anon_cache);
+
     dump_node_scores(LOG_TRACE, rsc, "Pre merge", rsc->allowed_nodes);
     promotion_order(rsc, data_set);
 
@@ -844,15 +919,15 @@ create_promotable_actions(resource_t * rsc, pe_working_set_t * data_set)
              * Requires exposing *_notify
              */
             order_actions(clone_data->stop_notify->post_done, clone_data->promote_notify->pre,
-                          pe_order_optional);
+                          pe_order_optional, data_set);
             order_actions(clone_data->start_notify->post_done, clone_data->promote_notify->pre,
-                          pe_order_optional);
+                          pe_order_optional, data_set);
             order_actions(clone_data->demote_notify->post_done, clone_data->promote_notify->pre,
-                          pe_order_optional);
+                          pe_order_optional, data_set);
             order_actions(clone_data->demote_notify->post_done, clone_data->start_notify->pre,
-                          pe_order_optional);
+                          pe_order_optional, data_set);
             order_actions(clone_data->demote_notify->post_done, clone_data->stop_notify->pre,
-                          pe_order_optional);
+                          pe_order_optional, data_set);
         }
     }
 
@@ -19,48 +19,111 @@ static GListPtr group_find_colocated_rscs(GListPtr colocated_rscs, resource_t *
 static void group_add_unallocated_utilization(GHashTable * all_utilization, resource_t * rsc,
                                               GListPtr all_rscs);
 
-struct compare_data {
-    const node_t *node1;
-    const node_t *node2;
-    int result;
+/*
+ * Parsed node capacities
+ *
+ * Nodes are compared by remaining capacity many times while they are sorted
+ * for each resource, so each node's remaining capacity is parsed into a list
+ * of values sorted by utilization attribute name the first time it is needed,
+ * and reparsed only after calculate_utilization() changes it. The cache only
+ * ever holds node utilization tables, which live as long as the working set,
+ * and it is emptied by reset_capacity_cache() when the working set is freed.
+ */
+
+struct capacity_item_s {
+    char *name;
+    int value;
 };
 
+struct capacity_s {
+    int count;
+    struct capacity_item_s *items;  // sorted by name
+};
+
+static GHashTable *capacity_cache = NULL; // utilization table -> capacity
+
 static void
-do_compare_capacity1(gpointer key, gpointer value, gpointer user_data)
+free_capacity(gpointer data)
 {
-    int node1_capacity = 0;
-    int node2_capacity = 0;
-    struct compare_data *data = user_data;
-
-    node1_capacity = crm_parse_int(value, "0");
-    node2_capacity =
-        crm_parse_int(g_hash_table_lookup(data->node2->details->utilization, key), "0");
-
-    if (node1_capacity > node2_capacity) {
-        data->result--;
-    } else if (node1_capacity < node2_capacity) {
-        data->result++;
+    struct capacity_s *capacity = data;
+
+    for (int lpc = 0; lpc < capacity->count; lpc++) {
+        free(capacity->items[lpc].name);
     }
+    free(capacity->items);
+    free(capacity);
 }
 
-static void
-do_compare_capacity2(gpointer key, gpointer value, gpointer user_data)
+static int
+compare_capacity_items(const void *a, const void *b)
 {
-    int node1_capacity = 0;
-    int node2_capacity = 0;
-    struct compare_data *data = user_data;
+    return strcmp(((const struct capacity_item_s *) a)->name,
+                  ((const struct capacity_item_s *) b)->name);
+}
 
-    if (g_hash_table_lookup_extended(data->node1->details->utilization, key, NULL, NULL)) {
-        return;
+static const struct capacity_s *
+node_capacity(const node_t *node)
+{
+    GHashTable *utilization = node->details->utilization;
+    struct capacity_s *capacity = NULL;
+
+    if (capacity_cache == NULL) {
+        capacity_cache = g_hash_table_new_full(NULL, NULL, NULL,
+                                               free_capacity);
     }
+    capacity = g_hash_table_lookup(capacity_cache, utilization);
+    if (capacity == NULL) {
+        GHashTableIter iter;
+        gpointer key = NULL;
+        gpointer value = NULL;
+        int lpc = 0;
+
+        capacity = calloc(1, sizeof(struct capacity_s));
+        CRM_ASSERT(capacity != NULL);
+        capacity->count = g_hash_table_size(utilization);
+        capacity->items = calloc(QB_MAX(capacity->count, 1),
+                                 sizeof(struct capacity_item_s));
+        CRM_ASSERT(capacity->items != NULL);
+
+        g_hash_table_iter_init(&iter, utilization);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            capacity->items[lpc].name = strdup(key);
+            capacity->items[lpc].value = crm_parse_int(value, "0");
+            lpc++;
+        }
+        qsort(capacity->items, capacity->count, sizeof(struct capacity_item_s),
+              compare_capacity_items);
+        g_hash_table_insert(capacity_cache, utilization, capacity);
+    }
+    return capacity;
+}
 
-    node1_capacity = 0;
-    node2_capacity = crm_parse_int(value, "0");
+// Remaining capacity of a node for a utilization attribute (0 if not set)
+static int
+node_capacity_value(const node_t *node, const char *name)
+{
+    const struct capacity_s *capacity = node_capacity(node);
+    struct capacity_item_s key = { (char *) name, 0 };
+    struct capacity_item_s *item = bsearch(&key, capacity->items,
+                                           capacity->count,
+                                           sizeof(struct capacity_item_s),
+                                           compare_capacity_items);
+
+    return item? item->value : 0;
+}
 
-    if (node1_capacity > node2_capacity) {
-        data->result--;
-    } else if (node1_capacity < node2_capacity) {
-        data->result++;
+/*!
+ * \internal
+ * \brief Forget all parsed node capacities
+ *
+ * \note This must be called before the nodes of a working set are freed.
+ */
+void
+reset_capacity_cache(void)
+{
+    if (capacity_cache != NULL) {
+        g_hash_table_destroy(capacity_cache);
+        capacity_cache = NULL;
     }
 }
 
@@ -70,16 +133,43 @@ do_compare_capacity2(gpointer key, gpointer value, gpointer user_data)
 int
 compare_capacity(const node_t * node1, const node_t * node2)
 {
-    struct compare_data data;
-
-    data.node1 = node1;
-    data.node2 = node2;
-    data.result = 0;
+    const struct capacity_s *capacity1 = node_capacity(node1);
+    const struct capacity_s *capacity2 = node_capacity(node2);
+    int lpc1 = 0;
+    int lpc2 = 0;
+    int result = 0;
+
+    /* Walk both sorted lists together, treating an attribute missing from
+     * either node as zero
+     */
+    while ((lpc1 < capacity1->count) || (lpc2 < capacity2->count)) {
+        int node1_capacity = 0;
+        int node2_capacity = 0;
+        int cmp = 0;
+
+        if (lpc1 >= capacity1->count) {
+            cmp = 1;
+        } else if (lpc2 >= capacity2->count) {
+            cmp = -1;
+        } else {
+            cmp = strcmp(capacity1->items[lpc1].name,
+                         capacity2->items[lpc2].name);
+        }
 
-    g_hash_table_foreach(node1->details->utilization, do_compare_capacity1, &data);
-    g_hash_table_foreach(node2->details->utilization, do_compare_capacity2, &data);
+        if (cmp <= 0) {
+            node1_capacity = capacity1->items[lpc1++].value;
+        }
+        if (cmp >= 0) {
+            node2_capacity = capacity2->items[lpc2++].value;
+        }
 
-    return data.result;
+        if (node1_capacity > node2_capacity) {
+            result--;
+        } else if (node1_capacity < node2_capacity) {
+            result++;
+        }
+    }
+    return result;
 }
 
 struct calculate_data {
@@ -117,6 +207,10 @@ calculate_utilization(GHashTable * current_utilization,
     data.current_utilization = current_utilization;
     data.plus = plus;
 
+    if (capacity_cache != NULL) {
+        g_hash_table_remove(capacity_cache, current_utilization);
+    }
+
     g_hash_table_foreach(utilization, do_calculate_utilization, &data);
 }
 
@@ -135,7 +229,7 @@ check_capacity(gpointer key, gpointer value, gpointer user_data)
     struct capacity_data *data = user_data;
 
     required = crm_parse_int(value, "0");
-    remaining = crm_parse_int(g_hash_table_lookup(data->node->details->utilization, key), "0");
+    remaining = node_capacity_value(data->node, key);
 
     if (required > remaining) {
         CRM_ASSERT(data->rsc_id);
@@ -410,6 +504,134 @@ process_utilization(resource_t * rsc, node_t ** prefer, pe_working_set_t * data_
     }
 }
 
+/*
+ * Remote connection balancing
+ *
+ * A cluster node proxies the IPC of every Pacemaker Remote node whose
+ * connection it hosts, so if balance-remote-connections is enabled, each
+ * connection is placed on the least loaded of the nodes with the best score
+ * for it. A node's load is the sum of the loads of the other connections
+ * placed there (or still running there, if not yet placed), where each
+ * connection's load is the traffic measured by the controller hosting it
+ * (see controld_remote_ra.c), or 1 if none has been reported.
+ *
+ * Rebalancing is lazy: an active connection stays where it is unless its
+ * node would be loaded by at least twice the connection's own load more than
+ * the least loaded node, so that small differences do not cause moves.
+ * Guest node connections follow their containers and are not balanced.
+ */
+
+static int
+remote_connection_load(resource_t *rsc, pe_working_set_t *data_set)
+{
+    node_t *remote = pe_find_node(data_set->nodes, rsc->id);
+    int load = crm_parse_int(remote? pe_node_attribute_raw(remote,
+                                                           CRM_ATTR_REMOTE_LOAD)
+                                   : NULL, "1");
+
+    return (load > 0)? load : 1;
+}
+
+static int
+node_remote_load(node_t *node, resource_t *except, pe_working_set_t *data_set)
+{
+    int load = 0;
+
+    for (GListPtr gIter = data_set->resources; gIter; gIter = gIter->next) {
+        resource_t *rsc = (resource_t *) gIter->data;
+        node_t *host = NULL;
+
+        if (!rsc->is_remote_node || (rsc->container != NULL)
+            || (rsc == except)) {
+            continue;
+        }
+        if (is_set(rsc->flags, pe_rsc_provisional)) {
+            host = pe__current_node(rsc);
+        } else {
+            host = rsc->allocated_to;
+        }
+        if ((host != NULL) && (host->details == node->details)) {
+            load += remote_connection_load(rsc, data_set);
+        }
+    }
+    return load;
+}
+
+/*!
+ * \internal
+ * \brief Choose a node for a remote connection that balances connection load
+ *
+ * \param[in] rsc       Resource being allocated
+ * \param[in] data_set  Cluster working set
+ *
+ * \return Node to prefer for \p rsc, or NULL if \p rsc is not a remote
+ *         connection to balance
+ */
+node_t *
+balance_remote_connection(resource_t *rsc, pe_working_set_t *data_set)
+{
+    GHashTableIter iter;
+    node_t *node = NULL;
+    node_t *current = NULL;
+    node_t *lightest = NULL;
+    node_t *running = pe__current_node(rsc);
+    int best_weight = -INFINITY;
+    int current_load = 0;
+    int lightest_load = 0;
+    int load = 0;
+
+    if (!rsc->is_remote_node || (rsc->container != NULL)
+        || !crm_is_true(pe_pref(data_set->config_hash,
+                                "balance-remote-connections"))) {
+        return NULL;
+    }
+
+    g_hash_table_iter_init(&iter, rsc->allowed_nodes);
+    while (g_hash_table_iter_next(&iter, NULL, (void **) &node)) {
+        if (can_run_resources(node) && (node->weight >= 0)
+            && (node->weight > best_weight)) {
+            best_weight = node->weight;
+        }
+    }
+
+    g_hash_table_iter_init(&iter, rsc->allowed_nodes);
+    while (g_hash_table_iter_next(&iter, NULL, (void **) &node)) {
+        if (!can_run_resources(node) || (node->weight < 0)
+            || (node->weight != best_weight)) {
+            continue;
+        }
+        load = node_remote_load(node, rsc, data_set);
+        if ((running != NULL) && (running->details == node->details)) {
+            current = node;
+            current_load = load;
+        }
+        if ((lightest == NULL) || (load < lightest_load)
+            || ((load == lightest_load)
+                && (strcmp(node->details->uname,
+                           lightest->details->uname) < 0))) {
+            lightest = node;
+            lightest_load = load;
+        }
+    }
+
+    if (lightest == NULL) {
+        return NULL;
+    }
+
+    load = remote_connection_load(rsc, data_set);
+    if ((current != NULL)
+        && (current_load < lightest_load + 2 * load)) {
+        pe_rsc_trace(rsc, "Keeping remote connection %s on %s (load %d)",
+                     rsc->id, current->details->uname, current_load);
+        return current;
+    }
+
+    pe_rsc_debug(rsc, "Balancing remote connection %s (load %d) onto %s "
+                 "(load %d)", rsc->id, load, lightest->details->uname,
+                 lightest_load);
+    return lightest;
+}
+
 #define VARIANT_GROUP 1
 #include <lib/pengine/variant.h>
 
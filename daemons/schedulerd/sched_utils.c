@@ -22,7 +22,7 @@ pe_free_ordering(GListPtr constraints)
 
         free(order->lh_action_task);
         free(order->rh_action_task);
-        free(order);
+        // The constraint itself belongs to the working set's arena
     }
     if (constraints != NULL) {
         g_list_free(constraints);
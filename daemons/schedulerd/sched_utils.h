@@ -71,15 +71,43 @@ filter_colocation_constraint(resource_t * rsc_lh, resource_t * rsc_rh,
                              rsc_colocation_t * constraint, gboolean preview);
 
 extern int compare_capacity(const node_t * node1, const node_t * node2);
+extern void reset_capacity_cache(void);
 extern void calculate_utilization(GHashTable * current_utilization,
                                   GHashTable * utilization, gboolean plus);
 
 extern void process_utilization(resource_t * rsc, node_t ** prefer, pe_working_set_t * data_set);
+node_t *balance_remote_connection(resource_t *rsc, pe_working_set_t *data_set);
 pe_action_t *create_pseudo_resource_op(resource_t * rsc, const char *task, bool optional, bool runnable, pe_working_set_t *data_set);
 pe_action_t *pe_cancel_op(pe_resource_t *rsc, const char *name,
                           guint interval_ms, pe_node_t *node,
                           pe_working_set_t *data_set);
 
+void sched_incremental_prepare(xmlNode *input);
+void sched_incremental_apply(pe_working_set_t *data_set);
+void sched_incremental_record(pe_working_set_t *data_set);
+node_t *sched_incremental_pinned_node(resource_t *rsc);
+
+GListPtr sched_order_fencing(GListPtr stonith_ops, pe_working_set_t *data_set);
+
+typedef struct sched_profile_mark_s {
+    double wall_ms;
+    double cpu_ms;
+    long heap_bytes;
+    unsigned long update_steps;
+} sched_profile_mark_t;
+
+void sched_profile_reset(void);
+sched_profile_mark_t sched_profile_mark(void);
+void sched_profile_record(const char *stage, const sched_profile_mark_t *start,
+                          pe_working_set_t *data_set);
+xmlNode *sched_profile_xml(xmlNode *parent);
+
+int sched_archive_sequence(const char *series);
+void sched_archive_write(xmlNode *xml, const char *filename, const char *series,
+                         int sequence, int wrap, int interval,
+                         gboolean compress);
+void sched_archive_flush(void);
+
 #  define STONITH_DONE "stonith_complete"
 #  define ALL_STOPPED "all_stopped"
 #  define LOAD_STOPPED "load_stopped"
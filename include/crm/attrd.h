@@ -22,6 +22,7 @@
 extern "C" {
 #endif
 
+#  include <glib.h>
 #  include <crm/common/ipc.h>
 
 /* attribute options for clients to use with these functions */
@@ -29,14 +30,40 @@ extern "C" {
 #define attrd_opt_remote  0x001
 #define attrd_opt_private 0x002
 
+/* one attribute change for attrd_update_batch() */
+typedef struct attrd_update_s {
+    char *host;     /* node to update (or NULL for the local node) */
+    char *name;
+    char *value;    /* new value (or NULL to delete) */
+    char *dampen;   /* new dampening (or NULL to leave unchanged) */
+    char *set;      /* attribute set to use if creating (or NULL) */
+} attrd_update_t;
+
+/* one attribute value from attrd_query_values() */
+typedef struct attrd_value_s {
+    char *host;
+    char *name;
+    char *value;
+} attrd_value_t;
+
 const char *attrd_get_target(const char *name);
 
 int attrd_update_delegate(crm_ipc_t * ipc, char command, const char *host,
                           const char *name, const char *value, const char *section,
                           const char *set, const char *dampen, const char *user_name, int options);
+int attrd_update_metric(crm_ipc_t *ipc, const char *host, const char *name,
+                        const char *value, const char *interval,
+                        const char *thresholds, const char *user_name,
+                        int options);
+int attrd_update_batch(crm_ipc_t *ipc, GList *updates, const char *section,
+                       const char *user_name, int options);
 int attrd_clear_delegate(crm_ipc_t *ipc, const char *host, const char *resource,
                          const char *operation, const char *interval_spec,
                          const char *user_name, int options);
+int attrd_subscribe(crm_ipc_t *ipc, const char *pattern, gboolean enabled);
+int attrd_query_values(crm_ipc_t *ipc, GList *names, const char *pattern,
+                       const char *host, GList **values);
+void attrd_free_values(GList *values);
 
 #ifdef __cplusplus
 }
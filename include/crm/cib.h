@@ -135,6 +135,15 @@ typedef struct cib_api_operations_s {
                                                         xmlNode *, void *),
                                        void (*free_func)(void *));
 
+    int (*init_transaction) (cib_t * cib);
+    int (*end_transaction) (cib_t * cib, gboolean commit, int call_options);
+
+    /* Only send diff notifications for changes at or below (or above) path,
+     * either an absolute XPath such as /cib/status/node_state or a section
+     * name (may be used several times, and with enabled=0 to undo)
+     */
+    int (*set_notify_filter) (cib_t * cib, const char *path, int enabled);
+
 } cib_api_operations_t;
 
 struct cib_s {
@@ -151,6 +160,8 @@ struct cib_s {
     void (*op_callback) (const xmlNode * msg, int call_id, int rc, xmlNode * output);
 
     cib_api_operations_t *cmds;
+
+    xmlNode *transaction;       /* requests queued by init_transaction() */
 };
 
 /* Core functions */
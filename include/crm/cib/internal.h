@@ -36,6 +36,8 @@
 #  define CIB_OP_APPLY_DIFF "cib_apply_diff"
 #  define CIB_OP_UPGRADE    "cib_upgrade"
 #  define CIB_OP_DELETE_ALT	"cib_delete_alt"
+#  define CIB_OP_COMMIT_TRANSACT	"cib_commit_transact"
+#  define CIB_OP_STAGE_TRANSACT	"cib_stage_transact"
 
 #  define F_CIB_CLIENTID  "cib_clientid"
 #  define F_CIB_CALLOPTS  "cib_callopt"
@@ -56,14 +58,25 @@
 #  define F_CIB_CALLBACK_TOKEN	"cib_async_id"
 #  define F_CIB_GLOBAL_UPDATE	"cib_update"
 #  define F_CIB_UPDATE_RESULT	"cib_update_result"
+#  define F_CIB_UPDATE_CIB	"cib_update_cib"
 #  define F_CIB_CLIENTNAME	"cib_clientname"
 #  define F_CIB_NOTIFY_TYPE	"cib_notify_type"
 #  define F_CIB_NOTIFY_ACTIVATE	"cib_notify_activate"
+#  define F_CIB_NOTIFY_FILTER	"cib_notify_filter"
 #  define F_CIB_UPDATE_DIFF	"cib_update_diff"
+#  define F_CIB_COMPACT	"cib_compact"
+#  define F_CIB_SYNC_DELTA	"cib_sync_delta"
 #  define F_CIB_USER		"cib_user"
 #  define F_CIB_LOCAL_NOTIFY_ID	"cib_local_notify_id"
 #  define F_CIB_PING_ID         "cib_ping_id"
 #  define F_CIB_SCHEMA_MAX      "cib_schema_max"
+#  define F_CIB_STAGED          "cib_staged"
+
+/* Call data for an xpath query requesting only certain attributes of matches
+ * (value is a list of attribute names separated by spaces or commas)
+ */
+#  define XML_CIB_TAG_PROJECTION    "cib_projection"
+#  define XML_CIB_ATTR_PROJECTION   "attributes"
 
 #  define T_CIB			"cib"
 #  define T_CIB_NOTIFY		"cib_notify"
@@ -72,6 +85,7 @@
 #  define T_CIB_POST_NOTIFY	"cib_post_notify"
 #  define T_CIB_UPDATE_CONFIRM	"cib_update_confirmation"
 #  define T_CIB_REPLACE_NOTIFY	"cib_refresh_notify"
+#  define T_CIB_TRANSACTION	"cib_transaction"
 
 #  define cib_channel_ro		"cib_ro"
 #  define cib_channel_rw		"cib_rw"
@@ -174,6 +188,12 @@ int cib_process_upgrade(const char *op, int options, const char *section, xmlNod
                         xmlNode * input, xmlNode * existing_cib, xmlNode ** result_cib,
                         xmlNode ** answer);
 
+int cib_process_commit_transaction(const char *op, int options,
+                                   const char *section, xmlNode *req,
+                                   xmlNode *input, xmlNode *existing_cib,
+                                   xmlNode **result_cib, xmlNode **answer);
+gboolean cib_op_in_transaction(const char *op);
+
 /*!
  * \internal
  * \brief Core function to manipulate with/query CIB/XML per xpath + arguments
@@ -183,7 +203,10 @@ int cib_process_upgrade(const char *op, int options, const char *section, xmlNod
  *                     <tt>cib_{multiple,no_children,xpath_address}</tt>
  * \param[in] section, xpath defining place of interest in
  *                     <tt>{existing,result}_cib</tt>
- * \param[in] req, UNUSED
+ * \param[in] req, the request; for \c CIB_OP_QUERY, its call data may be a
+ *                 \c XML_CIB_TAG_PROJECTION element, in which case the answer
+ *                 is an "xpath-query" element holding, for each match, a
+ *                 childless copy carrying only the listed attributes
  * \param[in] input, the input operand for
  *                   <tt>CIB_OP_{CREATE,MODIFY,REPLACE}</tt>
  * \param[in] existing_cib, the input operand (CIB) for \c CIB_OP_QUERY
@@ -205,6 +228,23 @@ int cib_internal_op(cib_t * cib, const char *op, const char *host,
                     const char *section, xmlNode * data,
                     xmlNode ** output_data, int call_options, const char *user_name);
 
+typedef struct cib_future_s cib_future_t;
+
+cib_future_t *cib_future_submit(cib_t *cib, const char *op,
+                                const char *section, xmlNode *data,
+                                int call_options);
+int cib_future_wait(cib_future_t *future, xmlNode **output_data);
+void cib_future_free(cib_future_t *future);
+
+// Where the CIB manager publishes the shared CIB snapshot, if enabled
+#define CIB_SNAPSHOT_FILE CRM_STATE_DIR "/cib.snapshot"
+
+void cib__acl_views_enable(void);
+void cib__acl_views_invalidate(void);
+
+int cib__file_commit(cib_t *cib);
+int cib__publish_snapshot(xmlNode *cib, const char *path);
+xmlNode *cib__read_snapshot(const char *path, const char *section);
 
 int cib_file_read_and_verify(const char *filename, const char *sigfile,
                              xmlNode **root);
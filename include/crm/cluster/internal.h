@@ -8,7 +8,9 @@
 #ifndef CRM_CLUSTER_INTERNAL__H
 #  define CRM_CLUSTER_INTERNAL__H
 
+#  include <sys/time.h>   // struct timeval
 #  include <crm/cluster.h>
+#  include <crm/cluster/election.h>
 
 typedef struct crm_ais_host_s AIS_Host;
 typedef struct crm_ais_msg_s AIS_Message;
@@ -348,4 +350,12 @@ gboolean node_name_is_valid(const char *key, const char *name);
 crm_node_t * crm_find_peer_full(unsigned int id, const char *uname, int flags);
 crm_node_t * crm_find_peer(unsigned int id, const char *uname);
 
+void pcmk__peer_index_add(crm_node_t *node);
+void pcmk__election_set_ranked(election_t *e, bool ranked, guint defer_ms);
+int pcmk__election_compare(const char *our_version, const struct timeval *our_age,
+                           unsigned int our_rank, const char *your_version,
+                           const struct timeval *your_age,
+                           unsigned int your_rank);
+crm_node_t *pcmk__peer_by_uuid(const char *uuid);
+
 #endif
@@ -28,6 +28,17 @@
 /* Default-Format-String used to pass timestamps to the alerts scripts */
 #  define CRM_ALERT_DEFAULT_TSTAMP_FORMAT "%H:%M:%S.%06N"
 
+/* Defaults for alerts that are not delivered one event per agent run */
+#  define CRM_ALERT_DEFAULT_BATCH_DELAY_MS (1000)
+#  define CRM_ALERT_DEFAULT_BATCH_SIZE (100)
+#  define CRM_ALERT_DEFAULT_QUEUE_SIZE (1000)
+
+/* Parameters telling the executor how to deliver such alerts */
+#  define CRM_ALERT_META_DELIVERY    "CRM_meta_delivery"
+#  define CRM_ALERT_META_BATCH_DELAY "CRM_meta_batch_delay"
+#  define CRM_ALERT_META_BATCH_SIZE  "CRM_meta_batch_size"
+#  define CRM_ALERT_META_QUEUE_SIZE  "CRM_meta_queue_size"
+
 typedef struct {
     char *name;
     char *value;
@@ -42,6 +53,12 @@ enum crm_alert_flags {
     crm_alert_default      = crm_alert_node|crm_alert_fencing|crm_alert_resource
 };
 
+enum crm_alert_delivery {
+    crm_alert_deliver_each = 0,     // run the agent once per event
+    crm_alert_deliver_batch,        // run the agent once per batch of events
+    crm_alert_deliver_receiver,     // write events to a listening socket
+};
+
 typedef struct {
     char *id;
     char *path;
@@ -51,6 +68,10 @@ typedef struct {
     GHashTable *envvars;
     int timeout;
     uint32_t flags;
+    enum crm_alert_delivery delivery;
+    int batch_delay;    // ms to collect events before delivering them
+    int batch_size;     // maximum events per delivery
+    int queue_size;     // maximum events waiting for delivery
 } crm_alert_entry_t;
 
 enum crm_alert_keys_e {
@@ -95,6 +116,30 @@ void crm_set_envvar_list(crm_alert_entry_t *entry);
 void crm_unset_envvar_list(crm_alert_entry_t *entry);
 bool crm_patchset_contains_alert(xmlNode *msg, bool config);
 
+static inline const char *
+crm_alert_delivery2text(enum crm_alert_delivery delivery)
+{
+    switch (delivery) {
+        case crm_alert_deliver_batch:
+            return "batch";
+        case crm_alert_deliver_receiver:
+            return "receiver";
+        default:
+            return "each";
+    }
+}
+
+static inline enum crm_alert_delivery
+crm_alert_text2delivery(const char *text)
+{
+    if (safe_str_eq(text, "batch")) {
+        return crm_alert_deliver_batch;
+    } else if (safe_str_eq(text, "receiver")) {
+        return crm_alert_deliver_receiver;
+    }
+    return crm_alert_deliver_each;
+}
+
 static inline const char *
 crm_alert_flag2text(enum crm_alert_flags flag)
 {
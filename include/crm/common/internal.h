@@ -12,8 +12,11 @@
 #include <dirent.h>     /* for struct dirent */
 #include <unistd.h>     /* for getpid() */
 #include <sys/types.h>  /* for uid_t and gid_t */
+#include <sys/uio.h>    /* for struct iovec */
+#include <signal.h>     /* for sigset_t */
 
 #include <crm/common/logging.h>
+#include <crm/common/mainloop.h>
 
 /* internal I/O utilities (from io.c) */
 
@@ -37,6 +40,7 @@ const char *crm_get_tmpdir(void);
 int crm_procfs_process_info(struct dirent *entry, char *name, int *pid);
 int crm_procfs_pid_of(const char *name);
 unsigned int crm_procfs_num_cores(void);
+unsigned long crm_procfs_rss_kb(void);
 
 
 /* internal XML schema functions (from xml.c) */
@@ -45,6 +49,236 @@ void crm_schema_init(void);
 void crm_schema_cleanup(void);
 
 
+/* internal XML tree functions (from xml.c) */
+
+xmlNode *pcmk__xml_move(xmlNode *parent, xmlNode *child);
+void pcmk__xml_snapshot(xmlNode *xml);
+void pcmk__xml_snapshot_release(xmlNode *xml);
+void pcmk__xml_snapshot_restore(xmlNode *xml);
+void pcmk__xml_cache_digests(xmlNode *xml);
+char *pcmk__xml_cached_digest(xmlNode *xml, int options);
+const char *pcmk__xml_intern(const char *name);
+void *pcmk__xml_parsed(const xmlNode *xml);
+bool pcmk__xml_set_parsed(xmlNode *xml, void *parsed, GDestroyNotify free_fn);
+int pcmk__xml_peek_attr(const char *text, const char *name, char **value);
+GHashTable *pcmk__xml2list_borrowed(xmlNode *parent);
+void pcmk__xml_index_ids(xmlNode *xml);
+xmlNode *pcmk__xml_find_id(xmlNode *top, const char *tag, const char *id);
+void pcmk__xml_free_later(xmlNode *xml);
+void pcmk__xml_free_deferred(void);
+
+/*!
+ * \internal
+ * \brief Check whether an XML element has a given name
+ *
+ * \param[in] xml       Element to check
+ * \param[in] interned  pcmk__xml_intern() result for \p name (or NULL)
+ * \param[in] name      Name to check for
+ *
+ * \return true if \p xml is named \p name, otherwise false
+ */
+static inline bool
+pcmk__xml_name_eq(const xmlNode *xml, const char *interned, const char *name)
+{
+    return ((interned != NULL) && ((const char *) xml->name == interned))
+           || (strcmp((const char *) xml->name, name) == 0);
+}
+
+
+/* internal XPath functions (from xpath.c) */
+
+void pcmk__xpath_cleanup(void);
+
+
+/* internal main loop functions (from mainloop.c) */
+
+void pcmk__mainloop_use_scalable(void);
+int pcmk__mainloop_dispatch_ipc(void);
+guint pcmk__timeout_add(guint interval_ms, GSourceFunc fn, gpointer data);
+void pcmk__timeout_remove(guint id);
+xmlNode *pcmk__mainloop_stats_xml(void);
+void pcmk__trigger_set_name(crm_trigger_t *source, const char *name);
+
+
+/* internal agent process spawning functions (from spawn.c) */
+
+enum pcmk__spawn_flags {
+    pcmk__spawn_none        = 0,
+    pcmk__spawn_new_pgroup  = (1 << 0), // run child in its own process group
+    pcmk__spawn_close_fds   = (1 << 1), // close all descriptors above stderr
+    pcmk__spawn_reset_sched = (1 << 2), // use default scheduling policy
+};
+
+bool pcmk__spawn_enabled(void);
+int pcmk__spawn(const char *file, char *const argv[], char *const envp[],
+                const int fds[3], uint32_t flags, const sigset_t *sigmask,
+                pid_t *pid);
+char **pcmk__spawn_env_new(GHashTable *vars);
+void pcmk__spawn_env_free(char **env);
+
+
+/* internal agent meta-data cache functions (from metadata.c) */
+
+char *pcmk__metadata_cache_get(const char *standard, const char *provider,
+                               const char *type);
+void pcmk__metadata_cache_put(const char *standard, const char *provider,
+                              const char *type, const char *metadata);
+
+
+/* internal worker thread functions (from workers.c) */
+
+void pcmk__workers_init(int threads);
+bool pcmk__workers_enabled(void);
+void pcmk__workers_push(void (*work)(gpointer data),
+                        void (*done)(gpointer data), gpointer data);
+
+
+/* internal trace event functions (from trace_events.c) */
+
+enum pcmk__trace_type {
+    pcmk__trace_ipc_send = 1,       // value1=bytes, value2=request ID, tag=peer
+    pcmk__trace_ipc_recv,           // value1=bytes, value2=request ID, tag=peer
+    pcmk__trace_cib_op_begin,       // value1=call ID, value2=options, tag=op
+    pcmk__trace_cib_op_end,         // value1=call ID, value2=rc, tag=op
+    pcmk__trace_fsa_input,          // value1=input, value2=cause, tag=origin
+    pcmk__trace_action_dispatch,    // value1=action, value2=graph, tag=task
+    pcmk__trace_recovery_hop,       // value1=hop, value2=per hop, tag=span
+};
+
+#define PCMK__TRACE_TYPE_MAX pcmk__trace_recovery_hop
+
+/* Steps in handling a resource operation failure, in the order they normally
+ * happen (recorded by whichever daemon does the step, with the failed
+ * operation's span ID as tag)
+ */
+enum pcmk__trace_hop {
+    pcmk__hop_op_failed = 1,        // executor: value2=rc
+    pcmk__hop_result_received,      // controller on node: value2=rc
+    pcmk__hop_history_sent,         // controller on node: value2=CIB call ID
+    pcmk__hop_history_committed,    // controller on node: value2=CIB rc
+    pcmk__hop_failure_seen,         // DC: value2=transition aborted
+    pcmk__hop_schedule_requested,   // DC
+    pcmk__hop_scheduled,            // scheduler: value2=new transition
+    pcmk__hop_transition_started,   // DC: value2=transition
+    pcmk__hop_actions_dispatched,   // DC: value2=transition
+    pcmk__hop_transition_complete,  // DC: value2=transition
+};
+
+#define PCMK__TRACE_SPAN_ATTR "trace-spans"
+
+// Scheduler request attribute asking for shared parameter sets in the graph
+#define PCMK__COMPACT_GRAPH_ATTR "compact-graph"
+
+#define PCMK__TRACE_MAGIC "PCMKTRC1"
+#define PCMK__TRACE_TAG_LEN 32
+
+// Start of a trace event file (in host byte order)
+typedef struct pcmk__trace_header_s {
+    char magic[8];          // PCMK__TRACE_MAGIC (not nul-terminated)
+    uint32_t record_size;   // sizeof(pcmk__trace_event_t)
+    uint32_t pid;
+    int64_t realtime_us;    // g_get_real_time() when recording started
+    int64_t monotonic_us;   // g_get_monotonic_time() at the same time
+    char system[32];        // crm_system_name
+} pcmk__trace_header_t;
+
+// Trace event record, as kept in memory and written to files
+typedef struct pcmk__trace_event_s {
+    uint32_t seq;           // 1 more than event's position (0 while writing)
+    uint32_t type;          // enum pcmk__trace_type
+    int64_t timestamp_us;   // g_get_monotonic_time()
+    int64_t value1;
+    int64_t value2;
+    char tag[PCMK__TRACE_TAG_LEN];
+} pcmk__trace_event_t;
+
+extern bool pcmk__trace_active;
+
+void pcmk__trace_init(void);
+void pcmk__trace_event_add(enum pcmk__trace_type type, int64_t value1,
+                           int64_t value2, const char *tag);
+void pcmk__trace_dump(void);
+const char *pcmk__trace_type_str(enum pcmk__trace_type type);
+const char *pcmk__trace_hop_str(enum pcmk__trace_hop hop);
+void pcmk__trace_span_id(char *span, const char *rsc_id, int call_id);
+void pcmk__trace_hops(enum pcmk__trace_hop hop, int64_t value,
+                      const char *spans);
+
+// Record a trace event, at the cost of one test when not recording
+#define pcmk__trace_event(type, value1, value2, tag) do {               \
+        if (pcmk__trace_active) {                                       \
+            pcmk__trace_event_add((type), (value1), (value2), (tag));   \
+        }                                                               \
+    } while (0)
+
+
+/* internal asynchronous logging functions (from logging_async.c) */
+
+void pcmk__log_async_init(void);
+void pcmk__log_async_add(int32_t real, const char *filename);
+void pcmk__log_async_remove(int32_t real);
+int32_t pcmk__log_async_real(int32_t target);
+void pcmk__log_async_stop(void);
+
+
+/* internal metrics functions (from metrics.c) */
+
+enum pcmk__metric_type {
+    pcmk__metric_counter,
+    pcmk__metric_gauge,
+    pcmk__metric_histogram,     // of durations
+};
+
+typedef struct pcmk__metric_s pcmk__metric_t;
+
+pcmk__metric_t *pcmk__metric(enum pcmk__metric_type type, const char *name,
+                             const char *help, const char *label,
+                             const char *value);
+void pcmk__metric_add(pcmk__metric_t *metric, double amount);
+void pcmk__metric_set(pcmk__metric_t *metric, double value);
+void pcmk__metric_observe_us(pcmk__metric_t *metric, gint64 duration_us);
+void pcmk__metrics_add_collector(void (*collect)(void));
+char *pcmk__metrics_text(void);
+void pcmk__metrics_init(void);
+
+
+/* internal process placement functions (from placement.c) */
+
+char *pcmk__daemon_setting(const char *option, const char *daemon);
+int pcmk__set_cpus(pid_t pid, const char *cpus);
+int pcmk__set_sched(pid_t pid, const char *policy);
+int pcmk__set_cgroup(pid_t pid, const char *cgroup);
+void pcmk__place_daemon(const char *daemon);
+void pcmk__lock_daemon_memory(const char *daemon);
+void pcmk__place_agent(pid_t pid);
+
+
+/* internal IPC functions (from ipc.c) */
+
+ssize_t pcmk__ipc_prepare_text(uint32_t request, char *text,
+                               struct iovec **result, uint32_t max_send_size,
+                               uint32_t accepts);
+void pcmk__notify_ready(uint32_t proc);
+
+/* crm_ipc_flags that describe how one particular message was sent, rather than
+ * what it asks for, so must never be copied from one message to another
+ */
+#define pcmk__ipc_transport_flags (crm_ipc_compressed|crm_ipc_compressed_lz4 \
+                                   |crm_ipc_accept_lz4|crm_ipc_accept_shm    \
+                                   |crm_ipc_shm)
+
+// A message serialized once, for sending to many clients
+typedef struct pcmk__fanout_s {
+    char *text;                     // unformatted XML of the message
+    struct iovec *ipc[2];           // IPC event prepared without and with LZ4
+    char *remote_lz4;               // LZ4-compressed text for remote clients
+    unsigned int remote_lz4_len;
+} pcmk__fanout_t;
+
+pcmk__fanout_t *pcmk__fanout_new(xmlNode *message);
+void pcmk__fanout_free(pcmk__fanout_t *fanout);
+
+
 /* internal functions related to process IDs (from pid.c) */
 
 int crm_pid_active(long pid, const char *daemon);
@@ -85,6 +319,21 @@ gboolean crm_ends_with_ext(const char *s, const char *match);
 char *add_list_element(char *list, const char *value);
 bool crm_compress_string(const char *data, int length, int max, char **result,
                          unsigned int *result_len);
+bool pcmk__compress_lz4(const char *data, unsigned int length, unsigned int max,
+                        char **result, unsigned int *result_len);
+int pcmk__decompress_lz4(const char *data, unsigned int length, char *result,
+                         unsigned int *result_len);
+const char *pcmk__str_intern(const char *s);
+void pcmk__str_release(const char *s);
+GHashTable *pcmk__str_table_share(GHashTable *table);
+bool pcmk__str_table_is_shared(GHashTable *table);
+const char *pcmk__str_table_digest(GHashTable *table);
+void pcmk__str_table_release(GHashTable *table);
+void pcmk__str_sharing_stats(unsigned long long *strings,
+                             unsigned long long *string_bytes,
+                             unsigned long long *string_refs,
+                             unsigned long long *tables,
+                             unsigned long long *table_refs);
 gint crm_alpha_sort(gconstpointer a, gconstpointer b);
 
 static inline char *
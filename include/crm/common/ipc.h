@@ -39,6 +39,10 @@ enum crm_ipc_flags
     crm_ipc_flags_none      = 0x00000000,
 
     crm_ipc_compressed      = 0x00000001, /* Message has been compressed */
+    crm_ipc_compressed_lz4  = 0x00000002, /* ... with LZ4 rather than bzip2 */
+    crm_ipc_accept_lz4      = 0x00000004, /* Sender can receive LZ4 compression */
+    crm_ipc_accept_shm      = 0x00000008, /* Sender can receive shared memory */
+    crm_ipc_shm             = 0x00000010, /* Message names a shared memory object with the payload */
 
     crm_ipc_proxied         = 0x00000100, /* _ALL_ replies to proxied connections need to be sent as events */
     crm_ipc_client_response = 0x00000200, /* A Response is expected in reply */
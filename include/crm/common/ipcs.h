@@ -50,12 +50,17 @@ struct crm_remote_s {
     gnutls_session_t *tls_session;
     bool tls_handshake_complete;
 #  endif
+
+    /* Shared */
+    bool lz4;   /* peer accepts LZ4 compression */
 };
 
 enum crm_client_flags
 {
     crm_client_flag_ipc_proxied    = 0x00001, /* ipc_proxy code only */
     crm_client_flag_ipc_privileged = 0x00002, /* root or cluster user */
+    crm_client_flag_ipc_lz4        = 0x00004, /* accepts LZ4 compression */
+    crm_client_flag_ipc_shm        = 0x00008, /* accepts shared memory messages */
 };
 
 struct crm_client_s {
@@ -111,6 +116,14 @@ bool crm_set_client_queue_max(crm_client_t *client, const char *qmax);
 void crm_ipcs_send_ack(crm_client_t * c, uint32_t request, uint32_t flags,
                        const char *tag, const char *function, int line);
 
+uint32_t pcmk__ipc_client_accepts(crm_client_t *c);
+ssize_t pcmk__ipcs_send_text(crm_client_t *c, uint32_t request, char *text,
+                             enum crm_ipc_flags flags);
+
+struct pcmk__fanout_s; // defined in crm/common/internal.h
+ssize_t pcmk__ipcs_send_fanout(crm_client_t *c, struct pcmk__fanout_s *fanout,
+                               enum crm_ipc_flags flags);
+
 /* when max_send_size is 0, default ipc buffer size is used */
 ssize_t crm_ipc_prepare(uint32_t request, xmlNode * message, struct iovec ** result, uint32_t max_send_size);
 ssize_t crm_ipcs_send(crm_client_t * c, uint32_t request, xmlNode * message, enum crm_ipc_flags flags);
@@ -95,6 +95,7 @@ extern char *crm_system_name;
 #  define CRM_ATTR_DIGESTS_SECURE   "#digests-secure"
 #  define CRM_ATTR_RA_VERSION       "#ra-version"
 #  define CRM_ATTR_PROTOCOL         "#attrd-protocol"
+#  define CRM_ATTR_REMOTE_LOAD      "#remote-load"
 
 /* Valid operations */
 #  define CRM_OP_NOOP		"noop"
@@ -118,10 +119,12 @@ extern char *crm_system_name;
 #  define CRM_OP_REGISTER		"register"
 #  define CRM_OP_IPC_FWD		"ipc_fwd"
 #  define CRM_OP_INVOKE_LRM	"lrm_invoke"
+#  define CRM_OP_INVOKE_LRM_BATCH	"lrm_invoke_batch"
 #  define CRM_OP_LRM_REFRESH	"lrm_refresh" /* Deprecated */
 #  define CRM_OP_LRM_QUERY	"lrm_query"
 #  define CRM_OP_LRM_DELETE	"lrm_delete"
 #  define CRM_OP_LRM_FAIL		"lrm_fail"
+#  define CRM_OP_LRM_CLEANUP	"lrm_cleanup"
 #  define CRM_OP_PROBED		"probe_complete"
 #  define CRM_OP_REPROBE		"probe_again"
 #  define CRM_OP_CLEAR_FAILCOUNT  "clear_failcount"
@@ -130,6 +133,9 @@ extern char *crm_system_name;
 #  define CRM_OP_RELAXED_CLONE  "clone-one-or-more"
 #  define CRM_OP_RM_NODE_CACHE "rm_node_cache"
 #  define CRM_OP_MAINTENANCE_NODES "maintenance_nodes"
+#  define CRM_OP_MAINLOOP_STATS "mainloop_stats"
+#  define CRM_OP_METRICS "metrics"
+#  define CRM_OP_DAEMON_READY "daemon_ready"
 
 /* Possible cluster membership states */
 #  define CRMD_JOINSTATE_DOWN           "down"
@@ -83,6 +83,9 @@ xmlNode *create_device_registration_xml(const char *id,
  * operation. */
 #  define F_STONITH_ORIGIN        "st_origin"
 #  define F_STONITH_HISTORY_LIST  "st_history"
+#  define F_STONITH_HISTORY_SEQ   "st_history_seq"
+#  define F_STONITH_HISTORY_SINCE "st_history_since"
+#  define F_STONITH_HISTORY_INCARNATION "st_history_incarnation"
 #  define F_STONITH_DATE          "st_date"
 #  define F_STONITH_STATE         "st_state"
 #  define F_STONITH_ACTIVE        "st_active"
@@ -106,6 +109,7 @@ xmlNode *create_device_registration_xml(const char *id,
 #  define STONITH_ATTR_DELAY_MAX "pcmk_delay_max"
 #  define STONITH_ATTR_DELAY_BASE   "pcmk_delay_base"
 #  define STONITH_ATTR_ACTION_LIMIT "pcmk_action_limit"
+#  define STONITH_ATTR_LIST_REFRESH "pcmk_list_refresh"
 
 #  define STONITH_ATTR_ACTION_OP   "action"
 
@@ -117,6 +121,7 @@ xmlNode *create_device_registration_xml(const char *id,
 #  define STONITH_OP_DEVICE_ADD      "st_device_register"
 #  define STONITH_OP_DEVICE_DEL      "st_device_remove"
 #  define STONITH_OP_FENCE_HISTORY   "st_fence_history"
+#  define STONITH_OP_MONITOR_BATCH   "st_monitor_batch"
 #  define STONITH_OP_LEVEL_ADD       "st_level_add"
 #  define STONITH_OP_LEVEL_DEL       "st_level_remove"
 
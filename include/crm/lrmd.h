@@ -31,7 +31,7 @@ typedef struct lrmd_key_value_s {
 /* This should be bumped every time there is an incompatible change that
  * prevents older clients from connecting to this version of the server.
  */
-#define LRMD_PROTOCOL_VERSION "1.1"
+#define LRMD_PROTOCOL_VERSION "1.2"
 
 /* This is the version that the client version will actually be compared
  * against. This should be identical to LRMD_PROTOCOL_VERSION. However, we
@@ -41,6 +41,12 @@ typedef struct lrmd_key_value_s {
  */
 #define LRMD_MIN_PROTOCOL_VERSION "1.0"
 
+/* The first version of the server that supports LRMD_OP_RSC_EXEC_BATCH */
+#define LRMD_BATCH_PROTOCOL_VERSION "1.2"
+
+/* The first version of either side that accepts LRMD_IPC_OP_BATCH */
+#define LRMD_PROXY_BATCH_PROTOCOL_VERSION "1.2"
+
 /* *INDENT-OFF* */
 #define DEFAULT_REMOTE_KEY_LOCATION PACEMAKER_CONFIG_DIR "/authkey"
 #define ALT_REMOTE_KEY_LOCATION "/etc/corosync/authkey"
@@ -82,6 +88,7 @@ typedef struct lrmd_key_value_s {
 #define F_LRMD_RSC_INTERVAL     "lrmd_rsc_interval"
 #define F_LRMD_RSC_DELETED      "lrmd_rsc_deleted"
 #define F_LRMD_RSC              "lrmd_rsc"
+#define F_LRMD_BATCH            "lrmd_batch"
 
 #define F_LRMD_ALERT_ID           "lrmd_alert_id"
 #define F_LRMD_ALERT_PATH         "lrmd_alert_path"
@@ -89,6 +96,7 @@ typedef struct lrmd_key_value_s {
 
 #define LRMD_OP_RSC_REG           "lrmd_rsc_register"
 #define LRMD_OP_RSC_EXEC          "lrmd_rsc_exec"
+#define LRMD_OP_RSC_EXEC_BATCH    "lrmd_rsc_exec_batch"
 #define LRMD_OP_RSC_CANCEL        "lrmd_rsc_cancel"
 #define LRMD_OP_RSC_UNREG         "lrmd_rsc_unregister"
 #define LRMD_OP_RSC_INFO          "lrmd_rsc_info"
@@ -107,6 +115,7 @@ typedef struct lrmd_key_value_s {
 #define LRMD_IPC_OP_SHUTDOWN_REQ  "shutdown_req"
 #define LRMD_IPC_OP_SHUTDOWN_ACK  "shutdown_ack"
 #define LRMD_IPC_OP_SHUTDOWN_NACK "shutdown_nack"
+#define LRMD_IPC_OP_BATCH         "batch"
 
 #define F_LRMD_IPC_OP           "lrmd_ipc_op"
 #define F_LRMD_IPC_IPC_SERVER   "lrmd_ipc_server"
@@ -248,6 +257,23 @@ typedef struct lrmd_event_data_s {
 lrmd_event_data_t *lrmd_copy_event(lrmd_event_data_t * event);
 void lrmd_free_event(lrmd_event_data_t * event);
 
+/*! One operation to execute with the exec_batch() API call */
+typedef struct lrmd_exec_op_s {
+    const char *rsc_id;
+    const char *action;
+    /*! userdata string given back in event notification */
+    const char *userdata;
+    guint interval_ms;
+    /*! timeout in ms */
+    int timeout;
+    /*! start delay in ms */
+    int start_delay;
+    /*! ownership of params is given up to api */
+    lrmd_key_value_t *params;
+    /*! set by the api to the call ID, or a negative error code on failure */
+    int call_id;
+} lrmd_exec_op_t;
+
 typedef struct lrmd_rsc_info_s {
     char *id;
     char *type;
@@ -268,6 +294,12 @@ lrmd_rsc_info_t *lrmd_copy_rsc_info(lrmd_rsc_info_t * rsc_info);
 void lrmd_free_rsc_info(lrmd_rsc_info_t * rsc_info);
 void lrmd_free_op_info(lrmd_op_info_t *op_info);
 
+/*!
+ * \brief Callback for executor events
+ *
+ * \note The event and all strings and tables it references are valid only for
+ *       the duration of the callback. Use lrmd_copy_event() to keep them.
+ */
 typedef void (*lrmd_event_callback) (lrmd_event_data_t * event);
 
 typedef struct lrmd_list_s {
@@ -525,6 +557,27 @@ typedef struct lrmd_api_operations_s {
                                 char **output, enum lrmd_call_options options,
                                 lrmd_key_value_t *params);
 
+    /*!
+     * \brief Issue several commands on resources at once
+     *
+     * \param[in]     lrmd     Executor connection
+     * \param[in,out] ops      Operations to execute (the call_id member of
+     *                         each will be set)
+     * \param[in]     n_ops    Number of entries in \p ops
+     * \param[in]     options  Call options (as for exec())
+     *
+     * \note This is the same as calling exec() for each entry of \p ops in
+     *       order, except that the operations are sent to the executor in a
+     *       single request (if it supports that), with a single reply. Results
+     *       are still reported by an individual event for each operation.
+     * \note The API will handle freeing the params of each entry.
+     *
+     * \retval number of operations successfully queued in the executor
+     * \retval negative error code if the request could not be sent at all
+     */
+    int (*exec_batch) (lrmd_t *lrmd, lrmd_exec_op_t *ops, int n_ops,
+                       enum lrmd_call_options options);
+
 } lrmd_api_operations_t;
 
 struct lrmd_s {
@@ -52,6 +52,7 @@ extern "C" {
 #  define F_CRM_MSG_TYPE		F_SUBTYPE
 #  define F_CRM_SYS_TO			"crm_sys_to"
 #  define F_CRM_SYS_FROM		"crm_sys_from"
+#  define F_CRM_PROC			"crm_proc"
 #  define F_CRM_HOST_FROM		F_ORIG
 #  define F_CRM_REFERENCE		XML_ATTR_REFERENCE
 #  define F_CRM_VERSION			XML_ATTR_VERSION
@@ -63,6 +64,7 @@ extern "C" {
 #  define F_CRM_ELECTION_AGE_S		"election-age-sec"
 #  define F_CRM_ELECTION_AGE_US		"election-age-nano-sec"
 #  define F_CRM_ELECTION_OWNER		"election-owner"
+#  define F_CRM_ELECTION_RANK		"election-rank"
 #  define F_CRM_TGRAPH			"crm-tgraph-file"
 #  define F_CRM_TGRAPH_INPUT		"crm-tgraph-in"
 
@@ -206,6 +208,7 @@ extern "C" {
 #  define XML_RSC_ATTR_REMOTE_NODE  	"remote-node"
 #  define XML_RSC_ATTR_CLEAR_OP         "clear_failure_op"
 #  define XML_RSC_ATTR_CLEAR_INTERVAL   "clear_failure_interval"
+#  define XML_RSC_ATTR_MIGRATION_WEIGHT "migration-weight"
 
 #  define XML_REMOTE_ATTR_RECONNECT_INTERVAL "reconnect_interval"
 
@@ -286,6 +289,8 @@ extern "C" {
 #  define XML_GRAPH_TAG_CRM_EVENT	"crm_event"
 #  define XML_GRAPH_TAG_DOWNED            "downed"
 #  define XML_GRAPH_TAG_MAINTENANCE       "maintenance"
+#  define XML_GRAPH_TAG_PARAM_SET         "parameter_set"
+#  define XML_GRAPH_ATTR_PARAM_SET        "parameter_set_id"
 
 #  define XML_TAG_RULE			"rule"
 #  define XML_RULE_ATTR_SCORE		"score"
@@ -344,6 +349,10 @@ extern "C" {
 #  define XML_ALERT_ATTR_PATH		"path"
 #  define XML_ALERT_ATTR_TIMEOUT	"timeout"
 #  define XML_ALERT_ATTR_TSTAMP_FORMAT	"timestamp-format"
+#  define XML_ALERT_ATTR_DELIVERY	"delivery"
+#  define XML_ALERT_ATTR_BATCH_DELAY	"batch-delay"
+#  define XML_ALERT_ATTR_BATCH_SIZE	"batch-size"
+#  define XML_ALERT_ATTR_QUEUE_SIZE	"queue-size"
 #  define XML_ALERT_ATTR_REC_VALUE	"value"
 
 #  define XML_CIB_TAG_GENERATION_TUPPLE	"generation_tuple"
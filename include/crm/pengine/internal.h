@@ -91,6 +91,7 @@ enum rsc_role_e container_resource_state(const resource_t * rsc, gboolean curren
 gboolean common_unpack(xmlNode * xml_obj, resource_t ** rsc, resource_t * parent,
                        pe_working_set_t * data_set);
 void common_free(resource_t * rsc);
+void pe__free_rsc_xml(xmlNode *xml);
 
 extern pe_working_set_t *pe_dataset;
 
@@ -111,6 +112,33 @@ int pe_get_failcount(node_t *node, resource_t *rsc, time_t *last_failure,
                      pe_working_set_t *data_set);
 
 
+/* Allocation of objects that are freed together with the working set */
+
+void *pe__arena_alloc(pe_working_set_t *data_set, size_t size);
+void pe__free_arena(pe_working_set_t *data_set);
+
+
+/* Saved scheduler inputs (from utils.c)
+ *
+ * A saved input may be stored as the differences from the previous input in
+ * its series, in an element naming the file it is based on (in the same
+ * directory) that contains an XML patchset.
+ */
+
+#define PE__XML_INPUT_DELTA "pe-input-delta"
+#define PE__XML_ATTR_DELTA_BASE "base"
+
+xmlNode *pe__read_input(const char *filename);
+
+
+/* Functions for maintaining the working set's lookup indexes */
+
+void pe__index_resource(pe_working_set_t *data_set, pe_resource_t *rsc);
+void pe__index_resource_name(pe_working_set_t *data_set, pe_resource_t *rsc);
+void pe__index_node(pe_working_set_t *data_set, pe_node_t *node);
+void pe__filter_history(pe_working_set_t *data_set, const char *rsc_id);
+
+
 /* Functions for finding/counting a resource's active nodes */
 
 pe_node_t *pe__find_active_on(const pe_resource_t *rsc,
@@ -141,7 +169,8 @@ pe_hash_table_lookup(GHashTable * hash, gconstpointer key)
 }
 
 extern action_t *get_pseudo_op(const char *name, pe_working_set_t * data_set);
-extern gboolean order_actions(action_t * lh_action, action_t * rh_action, enum pe_ordering order);
+extern gboolean order_actions(action_t * lh_action, action_t * rh_action,
+                              enum pe_ordering order, pe_working_set_t * data_set);
 
 GHashTable *node_hash_dup(GHashTable * hash);
 
@@ -233,6 +262,8 @@ extern void resource_location(resource_t * rsc, node_t * node, int score, const
                               pe_working_set_t * data_set);
 
 extern gint sort_op_by_callid(gconstpointer a, gconstpointer b);
+GList *pe__sort_ops_by_callid(GList *ops);
+bool pe__sort_ops_quietly(GList **ops);
 extern gboolean get_target_role(resource_t * rsc, enum rsc_role_e *role);
 
 extern resource_t *find_clone_instance(resource_t * rsc, const char *sub_id,
@@ -260,6 +291,40 @@ pe_base_name_eq(resource_t *rsc, const char *id)
 
 int get_target_rc(xmlNode * xml_op);
 
+enum pe__op_history_flags {
+    pe__op_magic_valid      = (1 << 0), // transition magic was decoded
+    pe__op_uuid_packed      = (1 << 1), // transition_uuid is set
+    pe__op_digest_packed    = (1 << 2), // op_digest is set
+    pe__op_restart_packed   = (1 << 3), // restart_digest is set
+    pe__op_secure_packed    = (1 << 4), // secure_digest is set
+};
+
+// Bytes in a packed UUID or MD5 digest
+#define PE__OP_PACKED_LEN 16
+
+/* Values parsed from an operation history entry (see pe__op_history()), with
+ * the transition UUID and digests packed into binary (when they are in the
+ * lower-case form they are generated in)
+ */
+typedef struct pe__op_history_s {
+    int call_id;            // -1 if none (such as for a pending operation)
+    int rc;                 // 0 if none
+    int status;             // PCMK_LRM_OP_UNKNOWN if none
+    guint interval_ms;
+    int last_change;        // -1 if none
+    int target_rc;          // from transition key (-1 if none or invalid)
+    int transition_id;      // from transition magic (-1 if none or invalid)
+    uint32_t flags;         // group of enum pe__op_history_flags
+    uint8_t transition_uuid[PE__OP_PACKED_LEN]; // from transition magic
+    uint8_t op_digest[PE__OP_PACKED_LEN];
+    uint8_t restart_digest[PE__OP_PACKED_LEN];
+    uint8_t secure_digest[PE__OP_PACKED_LEN];
+} pe__op_history_t;
+
+void pe__op_history(xmlNode *xml_op, pe__op_history_t *history);
+bool pe__op_digest_eq(xmlNode *xml_op, const char *attr, const char *digest);
+guint pe__op_interval_ms(xmlNode *op);
+
 gint sort_node_uname(gconstpointer a, gconstpointer b);
 bool is_set_recursive(resource_t * rsc, long long flag, bool any);
 
@@ -287,6 +352,9 @@ typedef struct op_digest_cache_s {
 
 op_digest_cache_t *rsc_action_digest_cmp(resource_t * rsc, xmlNode * xml_op, node_t * node,
                                          pe_working_set_t * data_set);
+void pe__free_digests(gpointer ptr);
+void pe__keep_digests(bool keep);
+void pe__clear_kept_digests(void);
 
 action_t *pe_fence_op(node_t * node, const char *op, bool optional, const char *reason, pe_working_set_t * data_set);
 void trigger_unfencing(
@@ -9,8 +9,11 @@
 
 #include <glib.h>
 #include <libxml/tree.h>
+#include <crm/pengine/status.h>
 
 GListPtr pe_unpack_alerts(xmlNode *alerts);
 void pe_free_alert_list(GListPtr alert_list);
 
+void pe__enable_rule_cache(pe_working_set_t *data_set, gboolean enable);
+
 #endif
@@ -75,6 +75,7 @@ enum pe_find {
 #  define pe_flag_quick_location        0x00100000ULL
 #  define pe_flag_sanitized             0x00200000ULL
 #  define pe_flag_stdout                0x00400000ULL
+#  define pe_flag_no_history            0x00800000ULL // skip operation history
 
 struct pe_working_set_s {
     xmlNode *input;
@@ -124,6 +125,16 @@ struct pe_working_set_s {
 
     int blocked_resources;
     int disabled_resources;
+
+    /* lookup indexes, maintained by the library (see cluster_status()) */
+    GHashTable *resource_id_index;      // resource ID -> resource
+    GHashTable *resource_name_index;    // history (renamed) ID -> resource
+    GHashTable *node_id_index;          // node ID -> node
+    GHashTable *node_uname_index;       // node name -> node
+    GHashTable *action_index;           // action key -> actions (newest first)
+    struct pe_arena_s *arena;           // objects freed with the working set
+    GHashTable *ordering_index;         // (first, then) -> wrappers in first
+    GHashTable *history_filter;         // IDs whose history to unpack (or all)
 };
 
 struct pe_node_shared_s {
@@ -156,6 +167,7 @@ struct pe_node_shared_s {
     GHashTable *attrs;          /* char* => char* */
     GHashTable *utilization;
     GHashTable *digest_cache;   /*! cache of calculated resource digests */
+    GHashTable *fail_index;     /*! failure attributes by resource name */
 };
 
 struct pe_node_s {
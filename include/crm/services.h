@@ -151,6 +151,11 @@ enum nagios_exitcode {
 enum svc_action_flags {
     /* On timeout, only kill pid, do not kill entire pid group */
     SVC_ACTION_LEAVE_GROUP = 0x01,
+
+    /* Read and throw away the agent's stdout rather than keep it in
+     * stdout_data (stderr is kept regardless)
+     */
+    SVC_ACTION_DISCARD_OUTPUT = 0x02,
 };
 
 typedef struct svc_action_private_s svc_action_private_t;
@@ -315,6 +320,7 @@ svc_action_t *services_alert_create(const char *id, const char *exec,
                                    int sequence, void *cb_data);
 gboolean services_alert_async(svc_action_t *action,
                               void (*cb)(svc_action_t *op));
+int services_alert_input(svc_action_t *action, const char *data, size_t len);
 
     static inline const char *services_lrm_status_str(enum op_status status) {
         switch (status) {
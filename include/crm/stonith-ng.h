@@ -97,6 +97,7 @@ typedef struct stonith_history_s {
     int state;
     time_t completed;
     struct stonith_history_s *next;
+    char *id;       // NULL if fencer is too old to report it
 } stonith_history_t;
 
 typedef struct stonith_s stonith_t;
@@ -126,6 +127,7 @@ typedef struct stonith_callback_data_s
     int rc;
     int call_id;
     void *userdata;
+    void *opaque;   // Managed by library
 } stonith_callback_data_t;
 
 typedef struct stonith_api_operations_s
@@ -390,6 +392,52 @@ typedef struct stonith_api_operations_s
                     stonith_key_value_t *params, int timeout, char **output,
                     char **error_output);
 
+    /*!
+     * \brief Retrieve fencing operations created or completed since a query
+     *
+     * \param[in]     st       Fencer connection to use
+     * \param[in]     options  Bitmask of stonith_call_options to pass to fencer
+     * \param[in]     node     If not NULL, only list operations for this node
+     * \param[in,out] incarnation  History incarnation ID returned by the
+     *                         previous call (or NULL), which will be replaced
+     *                         by the current one (to be freed by the caller)
+     * \param[in,out] seq      History sequence number returned by the
+     *                         previous call (or 0 for the whole history), which
+     *                         will be replaced by the current one
+     * \param[out]    output   Where to store operations
+     * \param[in]     timeout  Fail if no response within this many seconds
+     *
+     * \return 0 on success, negative error code otherwise
+     *
+     * \note Operations are identified by their id, so the caller can merge
+     *       them with what it already has. If the new value of \p incarnation
+     *       differs from the one passed, the fencer was restarted, and the
+     *       whole history was listed. The fencer forgets the oldest completed
+     *       operations once there are more than PCMK_fencing_history_max.
+     * \note History is not available in standalone mode.
+     */
+    int (*history_since)(stonith_t *st, int options, const char *node,
+                         char **incarnation, int *seq,
+                         stonith_history_t **output, int timeout);
+
+    /*!
+     * \brief Check whether several fencing devices are working, all at once
+     *
+     * \param[in] st       Fencer connection to use
+     * \param[in] options  Bitmask of stonith_call_options to pass to fencer
+     * \param[in] devices  IDs of devices to monitor (as keys)
+     * \param[in] timeout  Fail if no response within this many seconds
+     *
+     * \return Call ID (for register_callback()) on success, negative error
+     *         code otherwise
+     *
+     * \note The callback is called once, when all devices have been
+     *       monitored, and can get each device's result with
+     *       stonith_monitor_batch_rc().
+     */
+    int (*monitor_batch)(stonith_t *st, int options,
+                         stonith_key_value_t *devices, int timeout);
+
 } stonith_api_operations_t;
 
 struct stonith_s
@@ -420,6 +468,7 @@ stonith_key_value_t *stonith_key_value_add(stonith_key_value_t * kvp, const char
 void stonith_key_value_freeall(stonith_key_value_t * kvp, int keys, int values);
 
 void stonith_history_free(stonith_history_t *history);
+int stonith_monitor_batch_rc(stonith_callback_data_t *data, const char *device);
 
 /* Basic helpers that allows nodes to be fenced and the history to be
  * queried without mainloop or the caller understanding the full API
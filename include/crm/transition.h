@@ -46,6 +46,8 @@ typedef struct synapse_s {
 
     GListPtr actions;           /* crm_action_t* */
     GListPtr inputs;            /* crm_action_t* */
+
+    int pending_inputs;         /* inputs not yet confirmed */
 } synapse_t;
 
 typedef struct crm_action_s {
@@ -70,9 +72,11 @@ typedef struct crm_action_s {
 } crm_action_t;
 
 struct te_timer_s {
-    int source_id;
+    int source_id;          // nonzero while the timer is active
     int timeout;
     crm_action_t *action;
+    gint64 deadline;        // monotonic time (in microseconds) timer expires
+    guint queue_index;      // position in the controller's timer queue
 };
 
 /* order matters here */
@@ -109,6 +113,9 @@ struct crm_graph_s {
     GListPtr synapses;          /* synapse_t* */
 
     int migration_limit;
+
+    GHashTable *actions_by_id;  /* action ID -> crm_action_t* in a synapse */
+    GHashTable *consumers;      /* action ID -> GList* of inputs (copies) */
 };
 
 typedef struct crm_graph_functions_s {
@@ -135,6 +142,7 @@ crm_graph_t *unpack_graph(xmlNode * xml_graph, const char *reference);
 int run_graph(crm_graph_t * graph);
 gboolean update_graph(crm_graph_t * graph, crm_action_t * action);
 void destroy_graph(crm_graph_t * graph);
+crm_action_t *find_graph_action(crm_graph_t * graph, int id);
 const char *transition_status(enum transition_status state);
 void print_graph(unsigned int log_level, crm_graph_t * graph);
 void print_action(int log_level, const char *prefix, crm_action_t * action);
@@ -172,6 +172,7 @@ char *generate_hash_key(const char *crm_msg_reference, const char *sys);
 typedef struct crm_remote_s crm_remote_t;
 
 int crm_remote_send(crm_remote_t * remote, xmlNode * msg);
+int pcmk__remote_send_fanout(crm_remote_t *remote, pcmk__fanout_t *fanout);
 int crm_remote_ready(crm_remote_t * remote, int total_timeout /*ms */ );
 gboolean crm_remote_recv(crm_remote_t * remote, int total_timeout /*ms */ , int *disconnected);
 xmlNode *crm_remote_parse_buffer(crm_remote_t * remote);
@@ -215,6 +216,9 @@ void *crm_create_anon_tls_session(int sock, int type, void *credentials);
  * \retval NULL on failure
  */
 void *create_psk_tls_session(int csock, int type, void *credentials);
+
+void pcmk__tls_client_resume(void *session, const char *server, int port);
+void pcmk__tls_client_remember(void *session, const char *server, int port);
 #  endif
 
 const char *daemon_option(const char *option);
@@ -246,18 +250,30 @@ pid_t pcmk_locate_sbd(void);
 #  define F_ATTRD_RESOURCE          "attr_resource"
 #  define F_ATTRD_OPERATION         "attr_clear_operation"
 #  define F_ATTRD_INTERVAL          "attr_clear_interval"
+#  define F_ATTRD_DIGEST            "attr_digest"
+#  define F_ATTRD_SYNC_PARTIAL      "attr_sync_partial"
+#  define F_ATTRD_CLEAR_FAILURE     "attr_clear_failure"
+#  define F_ATTRD_NOTIFY_ENABLED    "attr_notify_enabled"
+#  define F_ATTRD_IS_METRIC         "attr_is_metric"
+#  define F_ATTRD_THRESHOLDS        "attr_thresholds"
+#  define XML_ATTRD_SYNC_BUCKET     "attr_sync_bucket"
 
 /* attrd operations */
 #  define ATTRD_OP_PEER_REMOVE   "peer-remove"
 #  define ATTRD_OP_UPDATE        "update"
 #  define ATTRD_OP_UPDATE_BOTH   "update-both"
 #  define ATTRD_OP_UPDATE_DELAY  "update-delay"
+#  define ATTRD_OP_UPDATE_BATCH  "update-batch"
 #  define ATTRD_OP_QUERY         "query"
 #  define ATTRD_OP_REFRESH       "refresh"
 #  define ATTRD_OP_FLUSH         "flush"
 #  define ATTRD_OP_SYNC          "sync"
 #  define ATTRD_OP_SYNC_RESPONSE "sync-response"
+#  define ATTRD_OP_SYNC_SUMMARY  "sync-summary"
+#  define ATTRD_OP_SYNC_PULL     "sync-pull"
 #  define ATTRD_OP_CLEAR_FAILURE "clear-failure"
+#  define ATTRD_OP_NOTIFY        "notify"
+#  define ATTRD_OP_CHANGED       "changed"
 
 #  define PCMK_ENV_PHYSICAL_HOST "physical_host"
 
@@ -350,4 +366,17 @@ void remote_proxy_free(gpointer data);
 void remote_proxy_relay_event(remote_proxy_t *proxy, xmlNode *msg);
 void remote_proxy_relay_response(remote_proxy_t *proxy, xmlNode *msg, int msg_id);
 
+/* Batching of proxied IPC messages sent over one remote connection */
+typedef struct remote_proxy_batch_s remote_proxy_batch_t;
+
+remote_proxy_batch_t *remote_proxy_batch_new(int (*send)(xmlNode *msg,
+                                                         gpointer user_data),
+                                             gpointer user_data);
+int  remote_proxy_batch_add(remote_proxy_batch_t *batch, xmlNode *msg);
+int  remote_proxy_batch_flush(remote_proxy_batch_t *batch);
+void remote_proxy_batch_free(remote_proxy_batch_t *batch);
+gboolean remote_proxy_batch_foreach(xmlNode *msg,
+                                    void (*fn)(xmlNode *msg, gpointer user_data),
+                                    gpointer user_data);
+
 #endif                          /* CRM_INTERNAL__H */
@@ -189,6 +189,40 @@ cib_client_erase(cib_t * cib, xmlNode ** output_data, int call_options)
     return cib_internal_op(cib, CIB_OP_ERASE, NULL, NULL, NULL, output_data, call_options, NULL);
 }
 
+static int
+cib_client_init_transaction(cib_t * cib)
+{
+    op_common(cib);
+    if (cib->transaction != NULL) {
+        return -EALREADY;
+    }
+    cib->transaction = create_xml_node(NULL, T_CIB_TRANSACTION);
+    return pcmk_ok;
+}
+
+static int
+cib_client_end_transaction(cib_t * cib, gboolean commit, int call_options)
+{
+    int rc = pcmk_ok;
+    xmlNode *transaction = NULL;
+
+    op_common(cib);
+    if (cib->transaction == NULL) {
+        return -EINVAL;
+    }
+
+    /* Clear it first, so the commit itself is not queued */
+    transaction = cib->transaction;
+    cib->transaction = NULL;
+
+    if (commit && (__xml_first_child_element(transaction) != NULL)) {
+        rc = cib_internal_op(cib, CIB_OP_COMMIT_TRANSACT, NULL, NULL,
+                             transaction, NULL, call_options, NULL);
+    }
+    free_xml(transaction);
+    return rc;
+}
+
 static void
 cib_destroy_op_callback(gpointer data)
 {
@@ -401,6 +435,9 @@ cib_new_variant(void)
 
     new_cib->cmds->delete_absolute = cib_client_delete_absolute;
 
+    new_cib->cmds->init_transaction = cib_client_init_transaction;
+    new_cib->cmds->end_transaction = cib_client_end_transaction;
+
     return new_cib;
 }
 
@@ -436,6 +473,8 @@ cib_delete(cib_t *cib)
 {
     cib_free_callbacks(cib);
     if (cib) {
+        free_xml(cib->transaction);
+        cib->transaction = NULL;
         cib->cmds->free(cib);
     }
 }
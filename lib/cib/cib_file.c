@@ -35,8 +35,9 @@
 #include <crm/common/ipc.h>
 #include <crm/common/xml.h>
 
-#define cib_flag_dirty 0x00001
-#define cib_flag_live  0x00002
+#define cib_flag_dirty     0x00001
+#define cib_flag_live      0x00002
+#define cib_flag_compress  0x00004  // write with bzip2 compression
 
 typedef struct cib_file_opaque_s {
     int flags;
@@ -73,6 +74,12 @@ cib_file_register_notification(cib_t * cib, const char *callback, int enabled)
     return -EPROTONOSUPPORT;
 }
 
+static int
+cib_file_set_notify_filter(cib_t * cib, const char *path, int enabled)
+{
+    return -EPROTONOSUPPORT;
+}
+
 /*!
  * \internal
  * \brief Compare the calculated digest of an XML tree against a signature file
@@ -485,6 +492,10 @@ cib_file_new(const char *cib_location)
     if (cib_file_is_live(cib_location)) {
         set_bit(private->flags, cib_flag_live);
         crm_trace("File %s detected as live CIB", cib_location);
+
+    } else if (crm_ends_with_ext(cib_location, ".bz2")
+               || crm_is_true(getenv("CIB_file_compress"))) {
+        set_bit(private->flags, cib_flag_compress);
     }
     private->filename = strdup(cib_location);
 
@@ -496,6 +507,7 @@ cib_file_new(const char *cib_location)
     cib->cmds->inputfd = cib_file_inputfd;
 
     cib->cmds->register_notification = cib_file_register_notification;
+    cib->cmds->set_notify_filter = cib_file_set_notify_filter;
     cib->cmds->set_connection_dnotify = cib_file_set_connection_dnotify;
 
     return cib;
@@ -553,6 +565,23 @@ load_file_cib(const char *filename)
     return pcmk_ok;
 }
 
+// Check whether a file starts with the bzip2 signature
+static bool
+cib_file_is_compressed(const char *filename)
+{
+    char magic[3] = { 0, };
+    FILE *fp = fopen(filename, "r");
+
+    if (fp == NULL) {
+        return FALSE;
+    }
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic)) {
+        magic[0] = '\0';
+    }
+    fclose(fp);
+    return (magic[0] == 'B') && (magic[1] == 'Z') && (magic[2] == 'h');
+}
+
 int
 cib_file_signon(cib_t * cib, const char *name, enum cib_conn_type type)
 {
@@ -565,6 +594,12 @@ cib_file_signon(cib_t * cib, const char *name, enum cib_conn_type type)
         rc = load_file_cib(private->filename);
     }
 
+    // Keep a compressed file compressed, whatever it is called
+    if ((rc == pcmk_ok) && is_not_set(private->flags, cib_flag_live)
+        && cib_file_is_compressed(private->filename)) {
+        set_bit(private->flags, cib_flag_compress);
+    }
+
     if (rc == pcmk_ok) {
         crm_debug("%s: Opened connection to local file '%s'", name, private->filename);
         cib->state = cib_connected_command;
@@ -655,6 +690,73 @@ cib_file_write_live(char *path)
     return rc;
 }
 
+/*!
+ * \internal
+ * \brief Write the in-memory CIB to disk if it has changed
+ *
+ * \param[in] cib  CIB object to write
+ *
+ * \return pcmk_ok on success, pcmk_err_generic on failure
+ */
+static int
+cib_file_write(cib_t *cib)
+{
+    int rc = pcmk_ok;
+    cib_file_opaque_t *private = cib->variant_opaque;
+
+    if (is_not_set(private->flags, cib_flag_dirty)) {
+        return pcmk_ok;
+    }
+
+    /* If this is the live CIB, write it out with a digest */
+    if (is_set(private->flags, cib_flag_live)) {
+        if (cib_file_write_live(private->filename) < 0) {
+            rc = pcmk_err_generic;
+        }
+
+    /* Otherwise, it's a simple write */
+    } else {
+        gboolean do_bzip = is_set(private->flags, cib_flag_compress);
+
+        if (write_xml_file(in_mem_cib, private->filename, do_bzip) <= 0) {
+            rc = pcmk_err_generic;
+        }
+    }
+
+    if (rc == pcmk_ok) {
+        crm_info("Wrote CIB to %s", private->filename);
+        clear_bit(private->flags, cib_flag_dirty);
+    } else {
+        crm_err("Could not write CIB to %s", private->filename);
+    }
+    return rc;
+}
+
+/*!
+ * \internal
+ * \brief Write a file-based CIB's changes to disk without signing off
+ *
+ * Changes made to a file-based CIB are kept in memory, and normally written
+ * to the file only once, when the CIB is signed off. Callers that make many
+ * changes over a long time can use this to save them at points of their
+ * choosing instead.
+ *
+ * \param[in] cib  CIB object to write
+ *
+ * \return pcmk_ok on success, -errno or pcmk_err_generic on failure
+ */
+int
+cib__file_commit(cib_t *cib)
+{
+    if ((cib == NULL) || (cib->variant != cib_file)) {
+        return -EPROTONOSUPPORT;
+
+    } else if (cib->state == cib_disconnected) {
+        return -ENOTCONN;
+    }
+    return cib_file_write(cib);
+}
+
 /*!
  * \internal
  * \brief Sign-off method for CIB file variants
@@ -672,37 +774,13 @@ int
 cib_file_signoff(cib_t * cib)
 {
     int rc = pcmk_ok;
-    cib_file_opaque_t *private = cib->variant_opaque;
 
     crm_debug("Disconnecting from the CIB manager");
     cib->state = cib_disconnected;
     cib->type = cib_no_connection;
 
     /* If the in-memory CIB has been changed, write it to disk */
-    if (is_set(private->flags, cib_flag_dirty)) {
-
-        /* If this is the live CIB, write it out with a digest */
-        if (is_set(private->flags, cib_flag_live)) {
-            if (cib_file_write_live(private->filename) < 0) {
-                rc = pcmk_err_generic;
-            }
-
-        /* Otherwise, it's a simple write */
-        } else {
-            gboolean do_bzip = crm_ends_with_ext(private->filename, ".bz2");
-
-            if (write_xml_file(in_mem_cib, private->filename, do_bzip) <= 0) {
-                rc = pcmk_err_generic;
-            }
-        }
-
-        if (rc == pcmk_ok) {
-            crm_info("Wrote CIB to %s", private->filename);
-            clear_bit(private->flags, cib_flag_dirty);
-        } else {
-            crm_err("Could not write CIB to %s", private->filename);
-        }
-    }
+    rc = cib_file_write(cib);
 
     /* Free the in-memory CIB */
     free_xml(in_mem_cib);
@@ -751,9 +829,43 @@ static struct cib_func_entry cib_file_ops[] = {
     {CIB_OP_DELETE,     FALSE, cib_process_delete},
     {CIB_OP_ERASE,      FALSE, cib_process_erase},
     {CIB_OP_UPGRADE,    FALSE, cib_process_upgrade},
+    {CIB_OP_COMMIT_TRANSACT, FALSE, cib_process_commit_transaction},
 };
 /* *INDENT-ON* */
 
+/*!
+ * \internal
+ * \brief Check whether an operation can modify the in-memory CIB in place
+ *
+ * This mirrors the CIB manager's choice, so that a series of operations on a
+ * large file-based CIB does not copy the whole CIB for each one.
+ */
+static bool
+cib_file_modifies_in_place(const char *op, int call_options,
+                           const char *section)
+{
+    const char *feature_set = crm_element_value(in_mem_cib,
+                                                XML_ATTR_CRM_VERSION);
+
+    if (is_set(call_options, cib_dryrun)) {
+        return FALSE;
+
+    } else if (safe_str_eq(section, XML_CIB_TAG_STATUS)) {
+        return TRUE;
+
+    } else if (compare_version("3.0.8", feature_set) >= 0) {
+        // v1 patchsets are calculated by comparing against a full copy
+        return FALSE;
+    }
+
+    return crm_str_eq(op, CIB_OP_MODIFY, TRUE)
+           || crm_str_eq(op, CIB_OP_CREATE, TRUE)
+           || crm_str_eq(op, CIB_OP_DELETE, TRUE)
+           || crm_str_eq(op, CIB_OP_DELETE_ALT, TRUE)
+           || crm_str_eq(op, CIB_OP_BUMP, TRUE)
+           || crm_str_eq(op, CIB_OP_COMMIT_TRANSACT, TRUE);
+}
+
 int
 cib_file_perform_op(cib_t * cib, const char *op, const char *host, const char *section,
                     xmlNode * data, xmlNode ** output_data, int call_options)
@@ -821,6 +933,10 @@ cib_file_perform_op_delegate(cib_t * cib, const char *op, const char *host, cons
         data = get_object_root(section, data);
     }
 
+    if (!query && cib_file_modifies_in_place(op, call_options, section)) {
+        call_options |= cib_zero_copy;
+    }
+
     rc = cib_perform_op(op, call_options, fn, query,
                         section, request, data, TRUE, &changed, in_mem_cib, &result_cib, &cib_diff,
                         &output);
@@ -831,12 +947,17 @@ cib_file_perform_op_delegate(cib_t * cib, const char *op, const char *host, cons
     }
 
     if (rc != pcmk_ok) {
-        free_xml(result_cib);
+        // An in-place operation leaves the in-memory CIB as it was
+        if (result_cib != in_mem_cib) {
+            free_xml(result_cib);
+        }
 
     } else if (query == FALSE) {
         xml_log_patchset(LOG_DEBUG, "cib:diff", cib_diff);
-        free_xml(in_mem_cib);
-        in_mem_cib = result_cib;
+        if (result_cib != in_mem_cib) {
+            free_xml(in_mem_cib);
+            in_mem_cib = result_cib;
+        }
         set_bit(private->flags, cib_flag_dirty);
     }
 
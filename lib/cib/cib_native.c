@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <poll.h>
 
 #include <glib.h>
 
@@ -33,9 +34,38 @@ typedef struct cib_native_opaque_s {
     crm_ipc_t *ipc;
     void (*dnotify_fn) (gpointer user_data);
     mainloop_io_t *source;
+    GQueue pending;     // received messages not yet dispatched
+    int futures;        // futures submitted but not yet completed
 
 } cib_native_opaque_t;
 
+/* When the process has worker threads, received messages at least this big are
+ * parsed in one, and any messages received meanwhile are held so that all are
+ * dispatched in order.
+ */
+#define CIB_PARSE_ASYNC_THRESHOLD (256 * 1024)
+
+/* Maximum number of futures that may await a reply on one connection; further
+ * submissions wait for the oldest to complete first
+ */
+#define CIB_FUTURE_WINDOW 32
+
+struct cib_future_s {
+    cib_t *cib;
+    int call_id;
+    int rc;
+    xmlNode *output;
+    gboolean done;
+    gboolean abandoned; // freed by caller before completion
+};
+
+struct cib_message_s {
+    cib_t *cib;         // NULL if the connection went away while parsing
+    char *text;         // only until parsed
+    xmlNode *xml;
+    gboolean parsed;
+};
+
 int cib_native_perform_op(cib_t * cib, const char *op, const char *host, const char *section,
                           xmlNode * data, xmlNode ** output_data, int call_options);
 
@@ -51,6 +81,8 @@ int cib_native_signon_raw(cib_t * cib, const char *name, enum cib_conn_type type
 bool cib_native_dispatch(cib_t * cib);
 
 int cib_native_set_connection_dnotify(cib_t * cib, void (*dnotify) (gpointer user_data));
+static int cib_native_set_notify_filter(cib_t * cib, const char *path,
+                                        int enabled);
 
 cib_t *
 cib_native_new(void)
@@ -75,6 +107,7 @@ cib_native_new(void)
     cib->cmds->free = cib_native_free;
 
     cib->cmds->register_notification = cib_native_register_notification;
+    cib->cmds->set_notify_filter = cib_native_set_notify_filter;
     cib->cmds->set_connection_dnotify = cib_native_set_connection_dnotify;
 
     return cib;
@@ -86,26 +119,14 @@ cib_native_signon(cib_t * cib, const char *name, enum cib_conn_type type)
     return cib_native_signon_raw(cib, name, type, NULL);
 }
 
-static int
-cib_native_dispatch_internal(const char *buffer, ssize_t length, gpointer userdata)
+static void
+cib_native_dispatch_xml(cib_t *cib, xmlNode *msg)
 {
     const char *type = NULL;
-    xmlNode *msg = NULL;
-
-    cib_t *cib = userdata;
-
-    crm_trace("dispatching %p", userdata);
-
-    if (cib == NULL) {
-        crm_err("No CIB!");
-        return 0;
-    }
-
-    msg = string2xml(buffer);
 
     if (msg == NULL) {
         crm_warn("Received a NULL message from the CIB manager");
-        return 0;
+        return;
     }
 
     /* do callbacks */
@@ -124,6 +145,122 @@ cib_native_dispatch_internal(const char *buffer, ssize_t length, gpointer userda
     }
 
     free_xml(msg);
+}
+
+static int
+cib_native_dispatch_internal(const char *buffer, ssize_t length, gpointer userdata)
+{
+    cib_t *cib = userdata;
+
+    crm_trace("dispatching %p", userdata);
+
+    if (cib == NULL) {
+        crm_err("No CIB!");
+        return 0;
+    }
+
+    cib_native_dispatch_xml(cib, string2xml(buffer));
+    return 0;
+}
+
+static void
+free_message(struct cib_message_s *message)
+{
+    free(message->text);
+    free_xml(message->xml);
+    free(message);
+}
+
+// Parse a received message (in a worker thread)
+static void
+parse_message(gpointer data)
+{
+    struct cib_message_s *message = data;
+
+    message->xml = string2xml(message->text);
+    free(message->text);
+    message->text = NULL;
+}
+
+// Dispatch held messages, up to the first one still being parsed
+static void
+dispatch_pending(cib_t *cib)
+{
+    cib_native_opaque_t *native = cib->variant_opaque;
+    struct cib_message_s *message = NULL;
+
+    while (((message = g_queue_peek_head(&(native->pending))) != NULL)
+           && message->parsed) {
+        xmlNode *msg = message->xml;
+
+        g_queue_pop_head(&(native->pending));
+        message->xml = NULL;
+        free_message(message);
+        cib_native_dispatch_xml(cib, msg);
+    }
+}
+
+static void
+message_parsed(gpointer data)
+{
+    struct cib_message_s *message = data;
+
+    message->parsed = TRUE;
+    if (message->cib == NULL) {
+        free_message(message);
+    } else {
+        dispatch_pending(message->cib);
+    }
+}
+
+// Discard held messages (those still being parsed are freed once parsed)
+static void
+cancel_pending(cib_native_opaque_t *native)
+{
+    struct cib_message_s *message = NULL;
+
+    while ((message = g_queue_pop_head(&(native->pending))) != NULL) {
+        if (message->parsed) {
+            free_message(message);
+        } else {
+            message->cib = NULL;
+        }
+    }
+}
+
+static int
+cib_native_dispatch_ipc(const char *buffer, ssize_t length, gpointer userdata)
+{
+    cib_t *cib = userdata;
+    cib_native_opaque_t *native = NULL;
+    struct cib_message_s *message = NULL;
+
+    if ((cib == NULL) || !pcmk__workers_enabled()) {
+        return cib_native_dispatch_internal(buffer, length, userdata);
+    }
+
+    native = cib->variant_opaque;
+    if ((length < CIB_PARSE_ASYNC_THRESHOLD)
+        && g_queue_is_empty(&(native->pending))) {
+        return cib_native_dispatch_internal(buffer, length, userdata);
+    }
+
+    message = calloc(1, sizeof(struct cib_message_s));
+    CRM_ASSERT(message != NULL);
+    message->cib = cib;
+    g_queue_push_tail(&(native->pending), message);
+
+    if (length < CIB_PARSE_ASYNC_THRESHOLD) {
+        message->xml = string2xml(buffer);
+        message->parsed = TRUE;
+
+    } else {
+        message->text = strdup(buffer);
+        CRM_ASSERT(message->text != NULL);
+        crm_trace("Parsing %lld-byte message from CIB manager in worker thread",
+                  (long long) length);
+        pcmk__workers_push(parse_message, message_parsed, message);
+    }
     return 0;
 }
 
@@ -167,6 +304,7 @@ cib_native_destroy(void *userdata)
     cib->state = cib_disconnected;
     native->source = NULL;
     native->ipc = NULL;
+    cancel_pending(native);
 
     if (native->dnotify_fn) {
         native->dnotify_fn(userdata);
@@ -181,7 +319,7 @@ cib_native_signon_raw(cib_t * cib, const char *name, enum cib_conn_type type, in
     cib_native_opaque_t *native = cib->variant_opaque;
 
     static struct ipc_client_callbacks cib_callbacks = {
-        .dispatch = cib_native_dispatch_internal,
+        .dispatch = cib_native_dispatch_ipc,
         .destroy = cib_native_destroy
     };
 
@@ -278,6 +416,7 @@ cib_native_signoff(cib_t * cib)
     cib_native_opaque_t *native = cib->variant_opaque;
 
     crm_debug("Disconnecting from the CIB manager");
+    cancel_pending(native);
 
     if (native->source != NULL) {
         /* Attached to mainloop */
@@ -356,6 +495,20 @@ cib_native_perform_op_delegate(cib_t * cib, const char *op, const char *host, co
         return -EINVAL;
     }
 
+    /* Plain local queries can be answered from the shared snapshot, if the
+     * CIB manager publishes one and this process may read it
+     */
+    if (safe_str_eq(op, CIB_OP_QUERY) && (host == NULL) && (data == NULL)
+        && (user_name == NULL) && (output_data != NULL)
+        && is_set(call_options, cib_sync_call)
+        && is_not_set(call_options, cib_xpath|cib_no_children)) {
+
+        *output_data = cib__read_snapshot(CIB_SNAPSHOT_FILE, section);
+        if (*output_data != NULL) {
+            return pcmk_ok;
+        }
+    }
+
     if (call_options & cib_sync_call) {
         ipc_flags |= crm_ipc_client_response;
     }
@@ -486,6 +639,34 @@ cib_native_set_connection_dnotify(cib_t * cib, void (*dnotify) (gpointer user_da
     return pcmk_ok;
 }
 
+static int
+cib_native_set_notify_filter(cib_t * cib, const char *path, int enabled)
+{
+    int rc = -ENOTCONN;
+    xmlNode *notify_msg = NULL;
+    cib_native_opaque_t *native = cib->variant_opaque;
+
+    CRM_CHECK(path != NULL, return -EINVAL);
+    if (cib->state == cib_disconnected) {
+        return rc;
+    }
+
+    notify_msg = create_xml_node(NULL, "cib-callback");
+    crm_xml_add(notify_msg, F_CIB_OPERATION, T_CIB_NOTIFY);
+    crm_xml_add(notify_msg, F_CIB_NOTIFY_FILTER, path);
+    crm_xml_add_int(notify_msg, F_CIB_NOTIFY_ACTIVATE, enabled);
+    rc = crm_ipc_send(native->ipc, notify_msg, crm_ipc_client_response,
+                      1000 * cib->call_timeout, NULL);
+    if (rc <= 0) {
+        crm_trace("Notification filter not registered: %d", rc);
+        rc = -ECOMM;
+    } else {
+        rc = pcmk_ok;
+    }
+    free_xml(notify_msg);
+    return rc;
+}
+
 int
 cib_native_register_notification(cib_t * cib, const char *callback, int enabled)
 {
@@ -508,3 +689,177 @@ cib_native_register_notification(cib_t * cib, const char *callback, int enabled)
     free_xml(notify_msg);
     return rc;
 }
+
+/*!
+ * \internal
+ * \brief Wait for messages from the CIB manager and dispatch them
+ *
+ * \param[in] cib         CIB connection
+ * \param[in] timeout_ms  How long to wait for a message
+ *
+ * \return pcmk_ok if a message was dispatched (or the wait was interrupted),
+ *         -errno otherwise
+ */
+static int
+wait_for_reply(cib_t *cib, int timeout_ms)
+{
+    cib_native_opaque_t *native = cib->variant_opaque;
+    struct pollfd pfd = { .events = POLLIN };
+    int rc = 0;
+
+    if ((cib->state == cib_disconnected) || (native->ipc == NULL)) {
+        return -ENOTCONN;
+    }
+
+    pfd.fd = crm_ipc_get_fd(native->ipc);
+    rc = poll(&pfd, 1, timeout_ms);
+    if (rc < 0) {
+        return (errno == EINTR)? pcmk_ok : -errno;
+    } else if (rc == 0) {
+        return -ETIME;
+    }
+    return cib_native_dispatch(cib)? pcmk_ok : -ENOTCONN;
+}
+
+static void
+future_done(xmlNode *msg, int call_id, int rc, xmlNode *output,
+            void *user_data)
+{
+    cib_future_t *future = user_data;
+    cib_native_opaque_t *native = future->cib->variant_opaque;
+
+    native->futures--;
+    if (future->abandoned) {
+        free(future);
+        return;
+    }
+    future->rc = rc;
+    future->output = (output == NULL)? NULL : copy_xml(output);
+    future->done = TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Submit a CIB request without waiting for its reply
+ *
+ * Requests on the same connection are processed and answered in the order
+ * submitted, so callers can submit several independent queries and updates
+ * and then collect their results with cib_future_wait(), overlapping the
+ * round trips. At most CIB_FUTURE_WINDOW requests are left awaiting a reply;
+ * beyond that, submission first waits for the oldest one.
+ *
+ * \param[in] cib           CIB connection
+ * \param[in] op            CIB operation to perform
+ * \param[in] section       CIB section (or xpath, with cib_xpath) to act on
+ * \param[in] data          Operation input, if any
+ * \param[in] call_options  Group of enum cib_call_options flags
+ *
+ * \return Newly allocated future (to be freed with cib_future_free())
+ * \note With connections other than native ones, the request is performed
+ *       synchronously, and the returned future is already complete.
+ */
+cib_future_t *
+cib_future_submit(cib_t *cib, const char *op, const char *section,
+                  xmlNode *data, int call_options)
+{
+    cib_future_t *future = calloc(1, sizeof(cib_future_t));
+    cib_native_opaque_t *native = NULL;
+    int rc = pcmk_ok;
+
+    CRM_ASSERT(future != NULL);
+    future->cib = cib;
+
+    if (cib->variant != cib_native) {
+        future->rc = cib_internal_op(cib, op, NULL, section, data,
+                                     &(future->output),
+                                     call_options|cib_sync_call, NULL);
+        future->done = TRUE;
+        return future;
+    }
+
+    native = cib->variant_opaque;
+    while (native->futures >= CIB_FUTURE_WINDOW) {
+        rc = wait_for_reply(cib, cib->call_timeout * 1000);
+        if (rc != pcmk_ok) {
+            crm_warn("Could not submit %s request: %s",
+                     op, pcmk_strerror(rc));
+            future->rc = rc;
+            future->done = TRUE;
+            return future;
+        }
+    }
+
+    rc = cib_internal_op(cib, op, NULL, section, data, NULL,
+                         call_options & ~cib_sync_call, NULL);
+    if (rc <= 0) {
+        // Failed, or queued in a transaction (there's no reply to wait for)
+        future->rc = rc;
+        future->done = TRUE;
+        return future;
+    }
+
+    future->call_id = rc;
+    native->futures++;
+    cib_client_register_callback_full(cib, future->call_id, 0, FALSE, future,
+                                      "cib_future", future_done, NULL);
+    return future;
+}
+
+/*!
+ * \internal
+ * \brief Wait for a submitted CIB request to complete
+ *
+ * \param[in]  future       Future returned by cib_future_submit()
+ * \param[out] output_data  If not NULL, where to store operation output
+ *                          (the caller is responsible for freeing it)
+ *
+ * \return Result of the request (pcmk_ok on success, -errno otherwise)
+ */
+int
+cib_future_wait(cib_future_t *future, xmlNode **output_data)
+{
+    CRM_CHECK(future != NULL, return -EINVAL);
+
+    while (!future->done) {
+        int rc = wait_for_reply(future->cib, future->cib->call_timeout * 1000);
+
+        if ((rc != pcmk_ok) && !future->done) {
+            cib_native_opaque_t *native = future->cib->variant_opaque;
+
+            crm_warn("Gave up waiting for reply to CIB call %d: %s",
+                     future->call_id, pcmk_strerror(rc));
+            remove_cib_op_callback(future->call_id, FALSE);
+            native->futures--;
+            future->rc = rc;
+            future->done = TRUE;
+        }
+    }
+
+    if (output_data != NULL) {
+        *output_data = future->output;
+        future->output = NULL;
+    }
+    return future->rc;
+}
+
+/*!
+ * \internal
+ * \brief Free a CIB future
+ *
+ * \param[in] future  Future to free
+ *
+ * \note If the request has not completed yet, its reply is discarded.
+ */
+void
+cib_future_free(cib_future_t *future)
+{
+    if (future == NULL) {
+        return;
+    }
+    if (!future->done) {
+        future->abandoned = TRUE;
+        return;
+    }
+    free_xml(future->output);
+    free(future);
+}
@@ -663,6 +663,61 @@ cib_config_changed(xmlNode * last, xmlNode * next, xmlNode ** diff)
     return config_changes;
 }
 
+/*!
+ * \internal
+ * \brief Get the attributes requested by a projected query, if any
+ *
+ * \param[in] req  CIB request
+ *
+ * \return Newly allocated NULL-terminated list of attribute names (to be
+ *         freed with g_strfreev()) if \p req asks for a projection, else NULL
+ */
+static char **
+query_projection(xmlNode *req)
+{
+    xmlNode *data = NULL;
+    const char *attributes = NULL;
+
+    if (req == NULL) {
+        return NULL;
+    }
+    data = get_message_xml(req, F_CIB_CALLDATA);
+    if (!crm_str_eq(crm_element_name(data), XML_CIB_TAG_PROJECTION, TRUE)) {
+        return NULL;
+    }
+    attributes = crm_element_value(data, XML_CIB_ATTR_PROJECTION);
+    if (attributes == NULL) {
+        return NULL;
+    }
+    return g_strsplit_set(attributes, " ,", 0);
+}
+
+/*!
+ * \internal
+ * \brief Add a childless copy of an element with only certain attributes
+ *
+ * \param[in,out] parent      Element to add copy to
+ * \param[in]     match       Element to copy
+ * \param[in]     attributes  NULL-terminated list of attribute names to keep
+ */
+static void
+add_projected_copy(xmlNode *parent, xmlNode *match, char **attributes)
+{
+    xmlNode *copy = create_xml_node(parent, crm_element_name(match));
+
+    for (char **attr = attributes; *attr != NULL; attr++) {
+        const char *value = NULL;
+
+        if (**attr == '\0') {
+            continue;
+        }
+        value = crm_element_value(match, *attr);
+        if (value != NULL) {
+            crm_xml_add(copy, *attr, value);
+        }
+    }
+}
+
 int
 cib_process_xpath(const char *op, int options, const char *section, xmlNode * req, xmlNode * input,
                   xmlNode * existing_cib, xmlNode ** result_cib, xmlNode ** answer)
@@ -671,12 +726,14 @@ cib_process_xpath(const char *op, int options, const char *section, xmlNode * re
     int max = 0;
     int rc = pcmk_ok;
     gboolean is_query = safe_str_eq(op, CIB_OP_QUERY);
+    char **projection = NULL;
 
     xmlXPathObjectPtr xpathObj = NULL;
 
     crm_trace("Processing \"%s\" event", op);
 
     if (is_query) {
+        projection = query_projection(req);
         xpathObj = xpath_search(existing_cib, section);
     } else {
         xpathObj = xpath_search(*result_cib, section);
@@ -692,7 +749,7 @@ cib_process_xpath(const char *op, int options, const char *section, xmlNode * re
         rc = -ENXIO;
 
     } else if (is_query) {
-        if (max > 1) {
+        if ((max > 1) || (projection != NULL)) {
             *answer = create_xml_node(NULL, "xpath-query");
         }
     }
@@ -739,7 +796,10 @@ cib_process_xpath(const char *op, int options, const char *section, xmlNode * re
 
         } else if (safe_str_eq(op, CIB_OP_QUERY)) {
 
-            if (options & cib_no_children) {
+            if (projection != NULL) {
+                add_projected_copy(*answer, match, projection);
+
+            } else if (options & cib_no_children) {
                 const char *tag = TYPE(match);
                 xmlNode *shallow = create_xml_node(*answer, tag);
 
@@ -800,6 +860,117 @@ cib_process_xpath(const char *op, int options, const char *section, xmlNode * re
     }
 
     freeXpathObject(xpathObj);
+    g_strfreev(projection);
+    return rc;
+}
+
+/*!
+ * \internal
+ * \brief Check whether a request may be part of a CIB transaction
+ *
+ * \param[in] op  CIB operation name
+ *
+ * \return TRUE if \p op only changes the CIB incrementally, otherwise FALSE
+ */
+gboolean
+cib_op_in_transaction(const char *op)
+{
+    return safe_str_eq(op, CIB_OP_CREATE)
+           || safe_str_eq(op, CIB_OP_MODIFY)
+           || safe_str_eq(op, CIB_OP_DELETE)
+           || safe_str_eq(op, CIB_OP_BUMP);
+}
+
+/*!
+ * \internal
+ * \brief Apply all requests of a CIB transaction, in order
+ *
+ * The requests are applied to the same working copy, so cib_perform_op()
+ * validates the result, updates the version and creates the patchset only
+ * once, and discards all of the changes if any request fails.
+ *
+ * \param[in]     op, options, section, req  As for the other cib_process_*()
+ * \param[in]     input       \<cib_transaction> with one request per child
+ * \param[in]     existing_cib  Unused (each request sees \p result_cib)
+ * \param[in,out] result_cib  CIB to apply the requests to
+ * \param[out]    answer      Unused
+ *
+ * \return Legacy return code (pcmk_ok on success, otherwise -errno, which for
+ *         a failed request is that request's return code)
+ */
+int
+cib_process_commit_transaction(const char *op, int options, const char *section,
+                               xmlNode *req, xmlNode *input,
+                               xmlNode *existing_cib, xmlNode **result_cib,
+                               xmlNode **answer)
+{
+    int rc = pcmk_ok;
+
+    crm_trace("Processing \"%s\" event", op);
+    *answer = NULL;
+
+    if (safe_str_neq(crm_element_name(input), T_CIB_TRANSACTION)) {
+        crm_err("Cannot commit transaction with no requests");
+        return -EINVAL;
+
+    } else if (crm_is_true(crm_element_value(input, F_CIB_STAGED))) {
+        // The server replaces this with the staged requests, if there are any
+        crm_err("Cannot commit staged transaction with no requests staged");
+        return -ENODATA;
+    }
+
+    for (xmlNode *request = __xml_first_child_element(input); request != NULL;
+         request = __xml_next_element(request)) {
+
+        int call_options = 0;
+        const char *child_op = crm_element_value(request, F_CIB_OPERATION);
+        const char *child_section = crm_element_value(request, F_CIB_SECTION);
+        xmlNode *data = get_message_xml(request, F_CIB_CALLDATA);
+        xmlNode *output = NULL;
+
+        crm_element_value_int(request, F_CIB_CALLOPTS, &call_options);
+
+        /* Mirror the logic in cib_prepare_common() */
+        if ((child_section != NULL) && (data != NULL)
+            && crm_str_eq(crm_element_name(data), XML_TAG_CIB, TRUE)) {
+            data = get_object_root(child_section, data);
+        }
+
+        if (safe_str_eq(child_op, CIB_OP_CREATE)) {
+            rc = cib_process_create(child_op, call_options, child_section,
+                                    request, data, *result_cib, result_cib,
+                                    &output);
+
+        } else if (safe_str_eq(child_op, CIB_OP_MODIFY)) {
+            rc = cib_process_modify(child_op, call_options, child_section,
+                                    request, data, *result_cib, result_cib,
+                                    &output);
+
+        } else if (safe_str_eq(child_op, CIB_OP_DELETE)) {
+            rc = cib_process_delete(child_op, call_options, child_section,
+                                    request, data, *result_cib, result_cib,
+                                    &output);
+
+        } else if (safe_str_eq(child_op, CIB_OP_BUMP)) {
+            rc = cib_process_bump(child_op, call_options, child_section,
+                                  request, data, *result_cib, result_cib,
+                                  &output);
+
+        } else {
+            crm_err("Operation %s is not allowed in a transaction",
+                    crm_str(child_op));
+            rc = -EOPNOTSUPP;
+        }
+
+        if ((output != NULL) && (output != *result_cib)) {
+            free_xml(output);
+        }
+        if (rc != pcmk_ok) {
+            crm_info("Transaction request %s failed: %s",
+                     crm_str(child_op), pcmk_strerror(rc));
+            break;
+        }
+    }
     return rc;
 }
 
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU Lesser General Public License
+ * version 2.1 or later (LGPLv2.1+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdio.h>
+
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+#include <crm/common/internal.h>
+#include <crm/cib/internal.h>
+
+static int failures = 0;
+
+static const char *original =
+    "<cib epoch=\"3\" num_updates=\"7\" admin_epoch=\"0\">"
+      "<configuration>"
+        "<crm_config/>"
+        "<nodes>"
+          "<node id=\"1\" uname=\"node1\"/>"
+        "</nodes>"
+        "<resources>"
+          "<primitive id=\"rsc1\" class=\"ocf\" provider=\"pacemaker\" type=\"Dummy\"/>"
+          "<group id=\"grp\">"
+            "<primitive id=\"rsc2\" class=\"ocf\" provider=\"pacemaker\" type=\"Dummy\"/>"
+          "</group>"
+        "</resources>"
+        "<constraints>"
+          "<rsc_location id=\"loc1\" rsc=\"rsc1\" node=\"node1\" score=\"10\"/>"
+        "</constraints>"
+      "</configuration>"
+      "<status/>"
+    "</cib>";
+
+static xmlNode *
+find_id(xmlNode *xml, const char *id)
+{
+    char *xpath = crm_strdup_printf("//*[@id='%s']", id);
+    xmlNode *match = get_xpath_object(xpath, xml, LOG_TRACE);
+
+    free(xpath);
+    return match;
+}
+
+// Change, insert, move and remove nodes the way a CIB operation might
+static void
+change_cib(xmlNode *cib)
+{
+    xmlNode *state = create_xml_node(first_named_child(cib, XML_CIB_TAG_STATUS),
+                                     XML_CIB_TAG_STATE);
+
+    crm_xml_add(state, XML_ATTR_ID, "1");
+    crm_xml_add(find_id(cib, "rsc1"), XML_AGENT_ATTR_PROVIDER, "heartbeat");
+    xml_remove_prop(find_id(cib, "loc1"), XML_RULE_ATTR_SCORE);
+    pcmk__xml_move(find_id(cib, "grp"), find_id(cib, "rsc1"));
+    free_xml(find_id(cib, "rsc2"));
+    free_xml(find_id(cib, "loc1"));
+}
+
+static int
+change_then_fail(const char *op, int options, const char *section,
+                 xmlNode *req, xmlNode *input, xmlNode *existing_cib,
+                 xmlNode **result_cib, xmlNode **answer)
+{
+    change_cib(*result_cib);
+    return -EINVAL;
+}
+
+static int
+change_and_go_backwards(const char *op, int options, const char *section,
+                        xmlNode *req, xmlNode *input, xmlNode *existing_cib,
+                        xmlNode **result_cib, xmlNode **answer)
+{
+    change_cib(*result_cib);
+    crm_xml_add(*result_cib, XML_ATTR_GENERATION, "2");
+    return pcmk_ok;
+}
+
+static int
+change_and_succeed(const char *op, int options, const char *section,
+                   xmlNode *req, xmlNode *input, xmlNode *existing_cib,
+                   xmlNode **result_cib, xmlNode **answer)
+{
+    change_cib(*result_cib);
+    return pcmk_ok;
+}
+
+/* Perform an operation on a CIB in place, and check both the result code and
+ * that the CIB ends up exactly as expected
+ */
+static void
+check(const char *desc, cib_op_t fn, int expected_rc, bool expect_changes)
+{
+    xmlNode *cib = string2xml(original);
+    xmlNode *expected = string2xml(original);
+    xmlNode *req = create_xml_node(NULL, "cib_command");
+    xmlNode *result = NULL;
+    xmlNode *diff = NULL;
+    xmlNode *output = NULL;
+    gboolean changed = FALSE;
+    char *want = NULL;
+    char *got = NULL;
+    int rc = pcmk_ok;
+
+    if (expect_changes) {
+        change_cib(expected);
+    }
+    crm_xml_add(req, F_ORIG, "node1");
+
+    rc = cib_perform_op(CIB_OP_MODIFY, cib_zero_copy|cib_no_mtime, fn, FALSE,
+                        XML_CIB_TAG_STATUS, req, NULL, FALSE, &changed, cib,
+                        &result, &diff, &output);
+
+    want = dump_xml_unformatted(expected);
+    got = dump_xml_unformatted(cib);
+    if (rc != expected_rc) {
+        printf("FAIL: %s (got %s, expected %s)\n",
+               desc, pcmk_strerror(rc), pcmk_strerror(expected_rc));
+        failures++;
+    } else if (result != cib) {
+        printf("FAIL: %s (result is not the CIB passed in)\n", desc);
+        failures++;
+    } else if (safe_str_neq(want, got)) {
+        printf("FAIL: %s\n  expected: %s\n  got:      %s\n", desc, want, got);
+        failures++;
+    } else if (xml_document_dirty(cib)) {
+        printf("FAIL: %s (tracked changes remain)\n", desc);
+        failures++;
+    } else {
+        printf("PASS: %s\n", desc);
+    }
+
+    free(want);
+    free(got);
+    free_xml(output);
+    free_xml(diff);
+    free_xml(req);
+    free_xml(expected);
+    free_xml(cib);
+}
+
+int
+main(int argc, char **argv)
+{
+    check("failed operation leaves CIB untouched", change_then_fail,
+          -EINVAL, FALSE);
+    check("rejected result leaves CIB untouched", change_and_go_backwards,
+          -pcmk_err_old_data, FALSE);
+    check("successful operation keeps changes", change_and_succeed,
+          pcmk_ok, TRUE);
+
+    return (failures == 0)? 0 : 1;
+}
@@ -100,6 +100,22 @@ cib_remote_register_notification(cib_t * cib, const char *callback, int enabled)
     return pcmk_ok;
 }
 
+static int
+cib_remote_set_notify_filter(cib_t * cib, const char *path, int enabled)
+{
+    xmlNode *notify_msg = NULL;
+    cib_remote_opaque_t *private = cib->variant_opaque;
+
+    CRM_CHECK(path != NULL, return -EINVAL);
+    notify_msg = create_xml_node(NULL, "cib_command");
+    crm_xml_add(notify_msg, F_CIB_OPERATION, T_CIB_NOTIFY);
+    crm_xml_add(notify_msg, F_CIB_NOTIFY_FILTER, path);
+    crm_xml_add_int(notify_msg, F_CIB_NOTIFY_ACTIVATE, enabled);
+    crm_remote_send(&private->callback, notify_msg);
+    free_xml(notify_msg);
+    return pcmk_ok;
+}
+
 cib_t *
 cib_remote_new(const char *server, const char *user, const char *passwd, int port,
                gboolean encrypted)
@@ -135,6 +151,7 @@ cib_remote_new(const char *server, const char *user, const char *passwd, int por
     cib->cmds->inputfd = cib_remote_inputfd;
 
     cib->cmds->register_notification = cib_remote_register_notification;
+    cib->cmds->set_notify_filter = cib_remote_set_notify_filter;
     cib->cmds->set_connection_dnotify = cib_remote_set_connection_dnotify;
 
     return cib;
@@ -228,6 +245,8 @@ cib_tls_signon(cib_t * cib, crm_remote_t * connection, gboolean event_channel)
 
         /* bind the socket to GnuTls lib */
         connection->tls_session = crm_create_anon_tls_session(sock, GNUTLS_CLIENT, anon_cred_c);
+        pcmk__tls_client_resume(connection->tls_session, private->server,
+                                private->port);
 
         if (crm_initiate_client_tls_handshake(connection, DEFAULT_CLIENT_HANDSHAKE_TIMEOUT) != 0) {
             crm_err("Session creation for %s:%d failed", private->server, private->port);
@@ -238,6 +257,10 @@ cib_tls_signon(cib_t * cib, crm_remote_t * connection, gboolean event_channel)
             cib_tls_close(cib);
             return -1;
         }
+
+        // The callback connection can resume the command connection's session
+        pcmk__tls_client_remember(connection->tls_session, private->server,
+                                  private->port);
 #else
         return -EPROTONOSUPPORT;
 #endif
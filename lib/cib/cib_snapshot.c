@@ -0,0 +1,357 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU Lesser General Public License
+ * version 2.1 or later (LGPLv2.1+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <glib.h>
+
+#include <crm/crm.h>
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+#include <crm/cib/internal.h>
+
+/*
+ * Shared CIB snapshot
+ *
+ * If PCMK_cib_shared_snapshot is enabled, the CIB manager publishes every
+ * committed CIB as a file that local clients map instead of querying it over
+ * IPC. The file consists of a header, an index of sections, and the
+ * serialized CIB text followed by a NUL terminator, so that the whole CIB can
+ * be parsed straight from the mapping and a single section can be parsed
+ * without looking at the rest of the text.
+ *
+ * A published file is never modified: each new version is written to a
+ * temporary file that is then renamed over the old one, so a reader that has
+ * mapped a file always sees one complete version, however long it takes. The
+ * CIB manager publishes each version before replying to the request that
+ * created it.
+ *
+ * The file is readable only by the cluster daemon user (and root), neither of
+ * which is subject to ACLs, so it cannot be used to bypass them. Clients that
+ * cannot open it query the CIB manager as before.
+ */
+
+#define SNAPSHOT_MAGIC          "PCMKCIB"
+#define SNAPSHOT_FORMAT         1
+#define SNAPSHOT_NAME_LEN       32
+
+// Maximum number of sections to index
+#define SNAPSHOT_MAX_SECTIONS   32
+
+struct snapshot_header_s {
+    char magic[8];          // SNAPSHOT_MAGIC
+    uint32_t format;        // SNAPSHOT_FORMAT
+    uint32_t num_sections;  // index entries following the header
+    uint64_t text_offset;   // where the NUL-terminated CIB text starts
+    uint64_t text_length;   // length of the CIB text, excluding terminator
+    int32_t admin_epoch;    // version of the published CIB
+    int32_t epoch;
+    int32_t num_updates;
+    uint32_t reserved;
+};
+
+struct snapshot_section_s {
+    char name[SNAPSHOT_NAME_LEN];   // element name
+    uint64_t offset;                // start of element, relative to text
+    uint64_t length;                // length of element's text
+};
+
+/*!
+ * \internal
+ * \brief Copy the name of the element whose tag starts at \p tag
+ */
+static void
+copy_tag_name(const char *tag, char *name)
+{
+    size_t len = strcspn(tag + 1, " \t\r\n/>");
+
+    if (len >= SNAPSHOT_NAME_LEN) {
+        len = SNAPSHOT_NAME_LEN - 1;
+    }
+    memcpy(name, tag + 1, len);
+    name[len] = '\0';
+}
+
+/*!
+ * \internal
+ * \brief Index the children of the root and configuration elements
+ *
+ * \param[in]  text     Unformatted CIB text, as produced by libxml2
+ * \param[out] index    Where to store section entries
+ *
+ * \return Number of entries stored in \p index
+ *
+ * \note This relies on serialized markup never containing a literal '<' or
+ *       '>' except in tags, comments, processing instructions and CDATA
+ *       sections, which libxml2 guarantees by escaping them everywhere else.
+ */
+static int
+index_sections(const char *text, struct snapshot_section_s *index)
+{
+    const char *starts[4] = { NULL, };
+    char names[4][SNAPSHOT_NAME_LEN] = { { 0, }, };
+    const char *p = text;
+    int depth = 0;
+    int num_sections = 0;
+
+    while ((p = strchr(p, '<')) != NULL) {
+        const char *end = NULL;
+
+        if (p[1] == '!') {
+            if (strncmp(p, "<!--", 4) == 0) {
+                end = strstr(p, "-->");
+                end = end? (end + 3) : NULL;
+            } else if (strncmp(p, "<![CDATA[", 9) == 0) {
+                end = strstr(p, "]]>");
+                end = end? (end + 3) : NULL;
+            } else {
+                end = strchr(p, '>');
+                end = end? (end + 1) : NULL;
+            }
+            if (end == NULL) {
+                break;
+            }
+            p = end;
+            continue;
+
+        } else if (p[1] == '?') {
+            end = strstr(p, "?>");
+            if (end == NULL) {
+                break;
+            }
+            p = end + 2;
+            continue;
+        }
+
+        end = strchr(p, '>');
+        if (end == NULL) {
+            break;
+        }
+        end++;
+
+        if (p[1] != '/') {
+            // Start tag
+            depth++;
+            if (depth < 4) {
+                starts[depth] = p;
+                copy_tag_name(p, names[depth]);
+            }
+            if (end[-2] != '/') {
+                p = end;
+                continue;
+            }
+        }
+
+        // End tag, or the end of an empty element
+        if (((depth == 2)
+             || ((depth == 3) && !strcmp(names[2], XML_CIB_TAG_CONFIGURATION)))
+            && (num_sections < SNAPSHOT_MAX_SECTIONS)) {
+
+            strcpy(index[num_sections].name, names[depth]);
+            index[num_sections].offset = starts[depth] - text;
+            index[num_sections].length = end - starts[depth];
+            num_sections++;
+        }
+        depth--;
+        p = end;
+    }
+    return num_sections;
+}
+
+static int
+write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len > 0) {
+        ssize_t rc = write(fd, p, len);
+
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        p += rc;
+        len -= rc;
+    }
+    return pcmk_ok;
+}
+
+/*!
+ * \internal
+ * \brief Publish a CIB as the shared snapshot
+ *
+ * \param[in] cib   CIB to publish
+ * \param[in] path  Where to publish it
+ *
+ * \return pcmk_ok on success, -errno otherwise
+ */
+int
+cib__publish_snapshot(xmlNode *cib, const char *path)
+{
+    struct snapshot_header_s header;
+    struct snapshot_section_s index[SNAPSHOT_MAX_SECTIONS];
+    char *text = dump_xml_unformatted(cib);
+    char *tmp_path = crm_strdup_printf("%s.XXXXXX", path);
+    size_t text_length = 0;
+    int fd = -1;
+    int rc = pcmk_ok;
+
+    if (text == NULL) {
+        rc = -ENOMSG;
+        goto done;
+    }
+    text_length = strlen(text);
+
+    memset(&header, 0, sizeof(header));
+    memset(index, 0, sizeof(index));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.format = SNAPSHOT_FORMAT;
+    header.num_sections = index_sections(text, index);
+    header.text_offset = sizeof(header)
+                         + header.num_sections * sizeof(index[0]);
+    header.text_length = text_length;
+    crm_element_value_int(cib, XML_ATTR_GENERATION_ADMIN, &header.admin_epoch);
+    crm_element_value_int(cib, XML_ATTR_GENERATION, &header.epoch);
+    crm_element_value_int(cib, XML_ATTR_NUMUPDATES, &header.num_updates);
+
+    fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        rc = -errno;
+        goto done;
+    }
+    if (fchmod(fd, S_IRUSR|S_IWUSR) < 0) {
+        rc = -errno;
+        goto done;
+    }
+    rc = write_all(fd, &header, sizeof(header));
+    if (rc == pcmk_ok) {
+        rc = write_all(fd, index, header.num_sections * sizeof(index[0]));
+    }
+    if (rc == pcmk_ok) {
+        rc = write_all(fd, text, text_length + 1);
+    }
+    if (rc != pcmk_ok) {
+        goto done;
+    }
+    close(fd);
+    fd = -1;
+
+    if (rename(tmp_path, path) < 0) {
+        rc = -errno;
+        goto done;
+    }
+    crm_trace("Published CIB %d.%d.%d (%llu bytes, %u sections) to %s",
+              header.admin_epoch, header.epoch, header.num_updates,
+              (unsigned long long) text_length, header.num_sections, path);
+
+done:
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (rc != pcmk_ok) {
+        unlink(tmp_path);
+    }
+    free(tmp_path);
+    free(text);
+    return rc;
+}
+
+/*!
+ * \internal
+ * \brief Parse the CIB (or one section of it) from the shared snapshot
+ *
+ * \param[in] path     Where the snapshot is published
+ * \param[in] section  Name of a top-level or configuration section, or NULL
+ *                     (or "all") for the whole CIB
+ *
+ * \return Newly parsed XML, or NULL if the snapshot is unavailable or does
+ *         not index \p section (in which case the CIB manager must be queried)
+ */
+xmlNode *
+cib__read_snapshot(const char *path, const char *section)
+{
+    const struct snapshot_header_s *header = NULL;
+    const struct snapshot_section_s *index = NULL;
+    const char *text = NULL;
+    xmlNode *xml = NULL;
+    struct stat sb;
+    void *map = MAP_FAILED;
+    int fd = open(path, O_RDONLY|O_CLOEXEC);
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if ((fstat(fd, &sb) == 0) && ((size_t) sb.st_size >= sizeof(*header))) {
+        map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    header = map;
+    index = (const struct snapshot_section_s *) (header + 1);
+    text = (const char *) map + header->text_offset;
+
+    if ((memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+        || (header->format != SNAPSHOT_FORMAT)
+        || (header->num_sections > SNAPSHOT_MAX_SECTIONS)
+        || (header->text_offset != sizeof(*header)
+                                   + header->num_sections * sizeof(*index))
+        || (header->text_offset >= (uint64_t) sb.st_size)
+        || (header->text_length >= sb.st_size - header->text_offset)
+        || (text[header->text_length] != '\0')) {
+        crm_warn("Ignoring invalid CIB snapshot %s", path);
+        goto done;
+    }
+
+    if ((section == NULL) || safe_str_eq(section, XML_CIB_TAG_SECTION_ALL)) {
+        xml = string2xml(text);
+
+    } else {
+        for (uint32_t lpc = 0; lpc < header->num_sections; lpc++) {
+            if (strncmp(index[lpc].name, section, SNAPSHOT_NAME_LEN) == 0) {
+                char *copy = NULL;
+
+                if ((index[lpc].offset > header->text_length)
+                    || (index[lpc].length
+                        > header->text_length - index[lpc].offset)) {
+                    break;
+                }
+                copy = strndup(text + index[lpc].offset, index[lpc].length);
+                CRM_ASSERT(copy != NULL);
+                xml = string2xml(copy);
+                free(copy);
+                break;
+            }
+        }
+    }
+
+    if (xml != NULL) {
+        crm_trace("Read %s from CIB %d.%d.%d snapshot",
+                  (section? section : "CIB"), header->admin_epoch,
+                  header->epoch, header->num_updates);
+    }
+
+done:
+    munmap(map, sb.st_size);
+    return xml;
+}
@@ -209,6 +209,210 @@ cib_acl_enabled(xmlNode *xml, const char *user)
     return rc;
 }
 
+/*!
+ * \internal
+ * \brief Check whether a change could affect whether the CIB is valid
+ *
+ * The schemas accept anything in the status section, and whatever we set the
+ * version and update-tracking attributes of the cib element to, so a change
+ * limited to those cannot make a valid CIB invalid. Anything else means
+ * the whole CIB must be validated again, because references between sections
+ * do not allow parts of it to be validated in isolation.
+ *
+ * \param[in] patchset  Change to check
+ *
+ * \return TRUE if the changed CIB must be validated, otherwise FALSE
+ */
+static gboolean
+patchset_needs_validation(xmlNode *patchset)
+{
+    static const char *status_path = "/" XML_TAG_CIB "/" XML_CIB_TAG_STATUS;
+    static const char *safe_attrs[] = {
+        XML_ATTR_GENERATION,
+        XML_ATTR_NUMUPDATES,
+        XML_CIB_ATTR_WRITTEN,
+        XML_ATTR_UPDATE_ORIG,
+        XML_ATTR_UPDATE_CLIENT,
+        XML_ATTR_UPDATE_USER,
+        XML_ATTR_DC_UUID,
+    };
+    size_t status_len = strlen(status_path);
+    int format = 1;
+
+    crm_element_value_int(patchset, "format", &format);
+    if (format != 2) {
+        return TRUE;
+    }
+
+    for (xmlNode *change = __xml_first_child(patchset); change != NULL;
+         change = __xml_next(change)) {
+
+        const char *op = crm_element_value(change, XML_DIFF_OP);
+        const char *path = crm_element_value(change, XML_DIFF_PATH);
+
+        if (safe_str_neq(crm_element_name(change), XML_DIFF_CHANGE)) {
+            continue; // e.g. version
+        }
+        if (path == NULL) {
+            return TRUE;
+        }
+        if ((strncmp(path, status_path, status_len) == 0)
+            && ((path[status_len] == '\0') || (path[status_len] == '/')
+                || (path[status_len] == '['))) {
+            if ((path[status_len] == '\0') && safe_str_eq(op, "delete")) {
+                return TRUE; // The status section itself is required
+            }
+            continue;
+        }
+        if (safe_str_neq(op, "modify") || safe_str_neq(path, "/" XML_TAG_CIB)) {
+            return TRUE;
+        }
+
+        for (xmlNode *attr = __xml_first_child(first_named_child(change,
+                                                                XML_DIFF_LIST));
+             attr != NULL; attr = __xml_next(attr)) {
+
+            const char *name = crm_element_value(attr, XML_NVPAIR_ATTR_NAME);
+            gboolean safe = FALSE;
+
+            if (attr->type != XML_ELEMENT_NODE) {
+                continue;
+            }
+            for (int lpc = 0; lpc < DIMOF(safe_attrs); lpc++) {
+                if (safe_str_eq(name, safe_attrs[lpc])) {
+                    safe = TRUE;
+                    break;
+                }
+            }
+            if (!safe) {
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * ACL-filtered views
+ *
+ * Filtering the CIB for a user subject to ACLs means copying the whole CIB
+ * and evaluating every ACL entry against it, which is expensive to do for
+ * every query. A process that enables view caching (the CIB manager) keeps
+ * each user's filtered view until it calls cib__acl_views_invalidate(), which
+ * it must do whenever the CIB it passes to cib_perform_op() changes. As a
+ * safeguard, a view is also only used for the same CIB object and version it
+ * was made from.
+ */
+
+struct acl_view_s {
+    xmlNode *xml;           // filtered CIB, or NULL if nothing is readable
+    const xmlNode *source;  // CIB the view was made from
+    char *version;          // version of that CIB
+};
+
+static gboolean acl_views_enabled = FALSE;
+static GHashTable *acl_views = NULL;    // user name -> struct acl_view_s
+
+static void
+free_acl_view(gpointer data)
+{
+    struct acl_view_s *view = data;
+
+    free_xml(view->xml);
+    free(view->version);
+    free(view);
+}
+
+static char *
+acl_view_version(xmlNode *cib)
+{
+    return crm_strdup_printf("%s.%s.%s",
+                             crm_element_value(cib, XML_ATTR_GENERATION_ADMIN),
+                             crm_element_value(cib, XML_ATTR_GENERATION),
+                             crm_element_value(cib, XML_ATTR_NUMUPDATES));
+}
+
+/*!
+ * \internal
+ * \brief Keep ACL-filtered views of the CIB between queries
+ */
+void
+cib__acl_views_enable(void)
+{
+    acl_views_enabled = TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Discard all ACL-filtered views of the CIB
+ *
+ * \note A process that has enabled view caching must call this whenever the
+ *       CIB that it passes to cib_perform_op() changes or is replaced.
+ */
+void
+cib__acl_views_invalidate(void)
+{
+    if (acl_views != NULL) {
+        g_hash_table_remove_all(acl_views);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Get a user's ACL-filtered view of the CIB
+ *
+ * \param[in]  user    User to filter for
+ * \param[in]  cib     CIB to filter
+ * \param[out] result  Where to store filtered view (NULL if nothing readable)
+ * \param[out] cached  Whether \p result belongs to the view cache (and so
+ *                     must be neither freed nor given away)
+ *
+ * \return TRUE if \p cib needed filtering, otherwise FALSE
+ */
+static bool
+acl_filtered_view(const char *user, xmlNode *cib, xmlNode **result,
+                  bool *cached)
+{
+    struct acl_view_s *view = NULL;
+    char *version = NULL;
+
+    *cached = FALSE;
+    if (!acl_views_enabled || (user == NULL)) {
+        return xml_acl_filtered_copy(user, cib, cib, result);
+    }
+
+    version = acl_view_version(cib);
+    if (acl_views != NULL) {
+        view = g_hash_table_lookup(acl_views, user);
+    }
+    if ((view != NULL) && (view->source == cib)
+        && safe_str_eq(view->version, version)) {
+        crm_trace("Using cached ACL view of CIB %s for %s", version, user);
+        free(version);
+        *result = view->xml;
+        *cached = TRUE;
+        return TRUE;
+    }
+
+    if (!xml_acl_filtered_copy(user, cib, cib, result)) {
+        free(version);
+        return FALSE;
+    }
+
+    if (acl_views == NULL) {
+        acl_views = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                          free_acl_view);
+    }
+    view = calloc(1, sizeof(struct acl_view_s));
+    CRM_ASSERT(view != NULL);
+    view->xml = *result;
+    view->source = cib;
+    view->version = version;
+    g_hash_table_replace(acl_views, strdup(user), view);
+    *cached = TRUE;
+    return TRUE;
+}
+
 int
 cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_query,
                const char *section, xmlNode * req, xmlNode * input,
@@ -218,6 +422,7 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
     int rc = pcmk_ok;
     gboolean check_schema = TRUE;
     xmlNode *top = NULL;
+    xmlNode *live = NULL;
     xmlNode *scratch = NULL;
     xmlNode *local_diff = NULL;
 
@@ -246,9 +451,11 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
     if (is_query) {
         xmlNode *cib_ro = current_cib;
         xmlNode *cib_filtered = NULL;
+        bool filtered_cached = FALSE;
 
         if(cib_acl_enabled(cib_ro, user)) {
-            if(xml_acl_filtered_copy(user, current_cib, current_cib, &cib_filtered)) {
+            if(acl_filtered_view(user, current_cib, &cib_filtered,
+                                 &filtered_cached)) {
                 if (cib_filtered == NULL) {
                     crm_debug("Pre-filtered the entire cib");
                     return -EACCES;
@@ -264,7 +471,11 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
             /* nothing */
 
         } else if(cib_filtered == *output) {
-            cib_filtered = NULL; /* Let them have this copy */
+            if (filtered_cached) {
+                *output = copy_xml(*output); /* The view must be kept */
+            } else {
+                cib_filtered = NULL; /* Let them have this copy */
+            }
 
         } else if(*output == current_cib) {
             /* They already know not to free it */
@@ -278,7 +489,9 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
             *output = copy_xml(*output);
         }
 
-        free_xml(cib_filtered);
+        if (!filtered_cached) {
+            free_xml(cib_filtered);
+        }
         return rc;
     }
 
@@ -293,8 +506,15 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
         copy_in_properties(current_cib, scratch);
         top = current_cib;
 
+        /* Modify the caller's CIB in place, saving only what is needed to put
+         * it back the way it was if the request fails
+         */
+        pcmk__xml_snapshot(scratch);
+        live = scratch;
+
         xml_track_changes(scratch, user, NULL, cib_acl_enabled(scratch, user));
         rc = (*fn) (op, call_options, section, req, input, scratch, &scratch, output);
+        CRM_CHECK(scratch == live, rc = -EINVAL; scratch = live);
 
     } else {
         scratch = copy_xml(current_cib);
@@ -366,6 +586,17 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
     strip_text_nodes(scratch);
     fix_plus_plus_recursive(scratch);
 
+    if (is_not_set(call_options, cib_zero_copy)
+        || safe_str_neq(section, XML_CIB_TAG_STATUS)) {
+        static time_t expires = 0;
+        time_t tm_now = time(NULL);
+
+        if (expires < tm_now) {
+            expires = tm_now + 60;  /* Validate clients are correctly applying v2-style diffs at most once a minute */
+            with_digest = TRUE;
+        }
+    }
+
     if (is_set(call_options, cib_zero_copy)) {
         /* At this point, current_cib is just the 'cib' tag and its properties,
          *
@@ -375,14 +606,6 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
         local_diff = xml_create_patchset(2, current_cib, scratch, (bool*)config_changed, manage_counters);
 
     } else {
-        static time_t expires = 0;
-        time_t tm_now = time(NULL);
-
-        if (expires < tm_now) {
-            expires = tm_now + 60;  /* Validate clients are correctly applying v2-style diffs at most once a minute */
-            with_digest = TRUE;
-        }
-
         local_diff = xml_create_patchset(0, current_cib, scratch, (bool*)config_changed, manage_counters);
     }
 
@@ -427,6 +650,11 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
          * b) we don't validate any of its contents at the moment anyway
          */
         check_schema = FALSE;
+
+    } else if (check_schema && (local_diff != NULL)
+               && !patchset_needs_validation(local_diff)) {
+        crm_trace("Not validating CIB: only the status section changed");
+        check_schema = FALSE;
     }
 
     /* === scratch must not be modified after this point ===
@@ -486,13 +714,28 @@ cib_perform_op(const char *op, int call_options, cib_op_t * fn, gboolean is_quer
   done:
 
     *result_cib = scratch;
+    if (live != NULL) {
+        if (rc == pcmk_ok) {
+            pcmk__xml_snapshot_release(live);
+
+        } else {
+            if (rc == -pcmk_err_schema_validation) {
+                // Give the caller the rejected result to report
+                *result_cib = copy_xml(scratch);
+                scratch = *result_cib;
+            }
+            pcmk__xml_snapshot_restore(live);
+        }
+        current_cib = live;
+    }
+
 #if ENABLE_ACL
-    if(rc != pcmk_ok && cib_acl_enabled(current_cib, user)) {
+    if(rc != pcmk_ok && (scratch != live) && cib_acl_enabled(current_cib, user)) {
         if(xml_acl_filtered_copy(user, current_cib, scratch, result_cib)) {
             if (*result_cib == NULL) {
                 crm_debug("Pre-filtered the entire cib result");
             }
-            free_xml(scratch);
+            pcmk__xml_free_later(scratch);
         }
     }
 #endif
@@ -771,5 +1014,26 @@ cib_internal_op(cib_t * cib, const char *op, const char *host,
     }
 #endif
 
+    if (cib->transaction != NULL) {
+        if (cib_op_in_transaction(op)) {
+            /* Queue the request until end_transaction() sends them all */
+            xmlNode *request = cib_create_op(0, T_CIB_TRANSACTION, op, host,
+                                             section, data, call_options,
+                                             user_name);
+
+            CRM_CHECK(request != NULL, return -EINVAL);
+            add_node_nocopy(cib->transaction, NULL, request);
+            crm_trace("Queued %s request in transaction", op);
+            return pcmk_ok;
+
+        } else if (safe_str_eq(op, CIB_OP_REPLACE)
+                   || safe_str_eq(op, CIB_OP_ERASE)
+                   || safe_str_eq(op, CIB_OP_UPGRADE)
+                   || safe_str_eq(op, CIB_OP_APPLY_DIFF)) {
+            crm_err("Operation %s is not allowed in a transaction", op);
+            return -EOPNOTSUPP;
+        }
+    }
+
     return delegate(cib, op, host, section, data, output_data, call_options, user_name);
 }
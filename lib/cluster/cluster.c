@@ -52,6 +52,7 @@ crm_peer_uuid(crm_node_t *peer)
     }
 
     peer->uuid = uuid;
+    pcmk__peer_index_add(peer);
     return peer->uuid;
 }
 
@@ -175,7 +176,6 @@ get_node_name(uint32_t nodeid)
 const char *
 crm_peer_uname(const char *uuid)
 {
-    GHashTableIter iter;
     crm_node_t *node = NULL;
 
     CRM_CHECK(uuid != NULL, return NULL);
@@ -186,14 +186,9 @@ crm_peer_uname(const char *uuid)
     }
 
     /* avoid blocking calls where possible */
-    g_hash_table_iter_init(&iter, crm_peer_cache);
-    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &node)) {
-        if(node->uuid && strcasecmp(node->uuid, uuid) == 0) {
-            if(node->uname) {
-                return node->uname;
-            }
-            break;
-        }
+    node = pcmk__peer_by_uuid(uuid);
+    if (node && node->uname) {
+        return node->uname;
     }
     node = NULL;
 
@@ -210,6 +205,7 @@ crm_peer_uname(const char *uuid)
         if (node) {
             crm_info("Setting uuid for node %s[%u] to '%s'", node->uname, node->id, uuid);
             node->uuid = strdup(uuid);
+            pcmk__peer_index_add(node);
             if(node->uname) {
                 return node->uname;
             }
@@ -96,6 +96,9 @@ uint32_t get_local_nodeid(cpg_handle_t handle)
 GListPtr cs_message_queue = NULL;
 int cs_message_timer = 0;
 
+static GListPtr cs_message_tail = NULL;    // for appending in constant time
+static int cs_message_queue_len = 0;
+
 static ssize_t crm_cs_flush(gpointer data);
 
 static gboolean
@@ -106,22 +109,122 @@ crm_cs_flush_cb(gpointer data)
     return FALSE;
 }
 
+/*
+ * Batching and flow control
+ *
+ * If PCMK_cpg_batch is true, consecutive queued messages (each a complete
+ * AIS_Message, padded to a multiple of CS_BATCH_ALIGN bytes) are packed into a
+ * single CPG multicast of up to CS_BATCH_MAX messages or CS_BATCH_BYTES bytes,
+ * which saves corosync a message (and the totem protocol a slot) for each of
+ * the many small messages daemons exchange during failover. Receivers split
+ * frames back into messages before calling the daemon's deliver function, so
+ * the daemons themselves see no difference. However, older versions deliver
+ * only the first message of a frame, so batching must not be enabled until
+ * every node has been upgraded.
+ *
+ * When corosync pushes back (a send fails with CS_ERR_TRY_AGAIN, or it turns
+ * on flow control for our connection), the queue is flushed again after a
+ * delay that starts at CS_RETRY_MIN_MS and doubles up to CS_RETRY_MAX_MS while
+ * the pressure lasts. Otherwise, anything left after CS_SEND_MAX messages is
+ * flushed as soon as the main loop has handled whatever else is pending.
+ */
+
 #define CS_SEND_MAX 200
+#define CS_BATCH_MAX 64
+#define CS_BATCH_BYTES (64 * 1024)
+#define CS_BATCH_ALIGN 8
+#define CS_BATCH_PAD(len) ((CS_BATCH_ALIGN - ((len) % CS_BATCH_ALIGN)) % CS_BATCH_ALIGN)
+#define CS_RETRY_MIN_MS 10
+#define CS_RETRY_MAX_MS 1000
+
+static gboolean
+cs_batch_enabled(void)
+{
+    static int enabled = -1;
+
+    if (enabled < 0) {
+        enabled = crm_is_true(daemon_option("cpg_batch"));
+        crm_debug("CPG message batching is %s", (enabled? "enabled" : "disabled"));
+    }
+    return enabled;
+}
+
+/*!
+ * \internal
+ * \brief Gather the iovecs for the next frame to send
+ *
+ * \param[out] frame     Where to store iovecs (at least 2 * CS_BATCH_MAX - 1)
+ * \param[out] frame_len Where to store number of iovecs used
+ *
+ * \return Number of queued messages in the frame
+ */
+static int
+cs_gather_frame(struct iovec *frame, int *frame_len)
+{
+    static char padding[CS_BATCH_ALIGN] = { 0 };
+    int messages = 0;
+    size_t bytes = 0;
+    int max = cs_batch_enabled()? CS_BATCH_MAX : 1;
+
+    *frame_len = 0;
+    for (GListPtr gIter = cs_message_queue; gIter && (messages < max);
+         gIter = gIter->next) {
+        struct iovec *iov = gIter->data;
+        size_t pad = (messages > 0)? CS_BATCH_PAD(bytes) : 0;
+
+        if ((messages > 0) && ((bytes + pad + iov->iov_len) > CS_BATCH_BYTES)) {
+            break;
+        }
+        if (pad > 0) {
+            frame[*frame_len].iov_base = padding;
+            frame[*frame_len].iov_len = pad;
+            (*frame_len)++;
+        }
+        frame[*frame_len] = *iov;
+        (*frame_len)++;
+        bytes += pad + iov->iov_len;
+        messages++;
+    }
+    return messages;
+}
+
+static void
+cs_dequeue(int messages)
+{
+    while (messages-- > 0) {
+        struct iovec *iov = cs_message_queue->data;
+
+        cs_message_queue = g_list_delete_link(cs_message_queue,
+                                              cs_message_queue);
+        free(iov->iov_base);
+        free(iov);
+        cs_message_queue_len--;
+    }
+    if (cs_message_queue == NULL) {
+        cs_message_tail = NULL;
+    }
+}
+
 static ssize_t
 crm_cs_flush(gpointer data)
 {
     int sent = 0;
+    int frames = 0;
     ssize_t rc = 0;
     int queue_len = 0;
+    size_t sent_bytes = 0;
+    gboolean backpressure = FALSE;
     static unsigned int last_sent = 0;
+    static uint32_t retry_ms = 0;
     cpg_handle_t *handle = (cpg_handle_t *)data;
+    struct iovec frame[2 * CS_BATCH_MAX - 1];
 
     if (*handle == 0) {
         crm_trace("Connection is dead");
         return pcmk_ok;
     }
 
-    queue_len = g_list_length(cs_message_queue);
+    queue_len = cs_message_queue_len;
     if ((queue_len % 1000) == 0 && queue_len > 1) {
         crm_err("CPG queue has grown to %d", queue_len);
 
@@ -136,43 +239,62 @@ crm_cs_flush(gpointer data)
     }
 
     while (cs_message_queue && sent < CS_SEND_MAX) {
-        struct iovec *iov = cs_message_queue->data;
+        int frame_len = 0;
+        int messages = cs_gather_frame(frame, &frame_len);
+        cpg_flow_control_state_t flow = CPG_FLOW_CONTROL_DISABLED;
 
         errno = 0;
-        rc = cpg_mcast_joined(*handle, CPG_TYPE_AGREED, iov, 1);
+        rc = cpg_mcast_joined(*handle, CPG_TYPE_AGREED, frame, frame_len);
 
         if (rc != CS_OK) {
+            backpressure = TRUE;
             break;
         }
 
-        sent++;
-        last_sent++;
-        crm_trace("CPG message sent, size=%llu",
-                  (unsigned long long) iov->iov_len);
+        for (int lpc = 0; lpc < frame_len; lpc++) {
+            sent_bytes += frame[lpc].iov_len;
+        }
+        sent += messages;
+        last_sent += messages;
+        frames++;
+        crm_trace("CPG frame sent with %d message%s",
+                  messages, ((messages == 1)? "" : "s"));
+        cs_dequeue(messages);
+
+        if ((cpg_flow_control_state_get(*handle, &flow) == CS_OK)
+            && (flow == CPG_FLOW_CONTROL_ENABLED)) {
+            crm_trace("Corosync has enabled flow control");
+            backpressure = TRUE;
+            break;
+        }
+    }
 
-        cs_message_queue = g_list_remove(cs_message_queue, iov);
-        free(iov->iov_base);
-        free(iov);
+    if (sent_bytes > 0) {
+        pcmk__metric_add(pcmk__metric(pcmk__metric_counter, "cpg_sent_bytes",
+                                      "Bytes sent to the cluster via CPG",
+                                      NULL, NULL), sent_bytes);
     }
 
     queue_len -= sent;
     if (sent > 1 || cs_message_queue) {
-        crm_info("Sent %d CPG messages  (%d remaining, last=%u): %s (%lld)",
-                 sent, queue_len, last_sent, ais_error2text(rc),
-                 (long long) rc);
+        crm_info("Sent %d CPG messages in %d frame%s (%d remaining, last=%u): %s (%lld)",
+                 sent, frames, ((frames == 1)? "" : "s"), queue_len, last_sent,
+                 ais_error2text(rc), (long long) rc);
     } else {
         crm_trace("Sent %d CPG messages  (%d remaining, last=%u): %s (%lld)",
                   sent, queue_len, last_sent, ais_error2text(rc),
                   (long long) rc);
     }
 
+    if (backpressure) {
+        retry_ms = (retry_ms == 0)? CS_RETRY_MIN_MS : QB_MIN(CS_RETRY_MAX_MS, 2 * retry_ms);
+    } else {
+        retry_ms = 0;
+    }
+
     if (cs_message_queue) {
-        uint32_t delay_ms = 100;
-        if(rc != CS_OK) {
-            /* Proportionally more if sending failed but cap at 1s */
-            delay_ms = QB_MIN(1000, CS_SEND_MAX + (10 * queue_len));
-        }
-        cs_message_timer = g_timeout_add(delay_ms, crm_cs_flush_cb, data);
+        crm_trace("Flushing CPG queue again in %ums", retry_ms);
+        cs_message_timer = g_timeout_add(retry_ms, crm_cs_flush_cb, data);
     }
 
     return rc;
@@ -186,7 +308,12 @@ send_cpg_iov(struct iovec * iov)
     queued++;
     crm_trace("Queueing CPG message %u (%llu bytes)",
               queued, (unsigned long long) iov->iov_len);
-    cs_message_queue = g_list_append(cs_message_queue, iov);
+    if (cs_message_tail == NULL) {
+        cs_message_queue = cs_message_tail = g_list_append(cs_message_queue, iov);
+    } else {
+        cs_message_tail = g_list_append(cs_message_tail, iov)->next;
+    }
+    cs_message_queue_len++;
     crm_cs_flush(&pcmk_cpg_handle);
     return TRUE;
 }
@@ -210,6 +337,42 @@ pcmk_cpg_dispatch(gpointer user_data)
     return 0;
 }
 
+static cpg_deliver_fn_t cpg_deliver_message = NULL;
+
+// Split a received CPG frame into messages (see "Batching and flow control")
+static void
+cpg_deliver_frame(cpg_handle_t handle, const struct cpg_name *groupName,
+                  uint32_t nodeid, uint32_t pid, void *frame, size_t frame_len)
+{
+    size_t offset = 0;
+
+    pcmk__metric_add(pcmk__metric(pcmk__metric_counter, "cpg_received_bytes",
+                                  "Bytes received from the cluster via CPG",
+                                  NULL, NULL), frame_len);
+
+    while (offset < frame_len) {
+        AIS_Message *msg = (AIS_Message *) ((char *) frame + offset);
+        size_t len = frame_len - offset;
+
+        if ((len < sizeof(AIS_Message)) || (msg->header.size < sizeof(AIS_Message))
+            || (msg->header.size > len)) {
+            if (offset == 0) {
+                // Leave it to the daemon to complain about
+                cpg_deliver_message(handle, groupName, nodeid, pid, frame,
+                                    frame_len);
+            } else {
+                crm_err("Discarding %llu bytes at end of CPG frame from %u.%u",
+                        (unsigned long long) len, nodeid, pid);
+            }
+            return;
+        }
+
+        cpg_deliver_message(handle, groupName, nodeid, pid, msg,
+                            msg->header.size);
+        offset += msg->header.size + CS_BATCH_PAD(msg->header.size);
+    }
+}
+
 char *
 pcmk_message_common_cs(cpg_handle_t handle, uint32_t nodeid, uint32_t pid, void *content,
                         uint32_t *kind, const char **from)
@@ -411,13 +574,14 @@ cluster_connect_cpg(crm_cluster_t *cluster)
     };
 
     cpg_callbacks_t cpg_callbacks = {
-        .cpg_deliver_fn = cluster->cpg.cpg_deliver_fn,
+        .cpg_deliver_fn = cpg_deliver_frame,
         .cpg_confchg_fn = cluster->cpg.cpg_confchg_fn,
         /* .cpg_deliver_fn = pcmk_cpg_deliver, */
         /* .cpg_confchg_fn = pcmk_cpg_membership, */
     };
 
     cpg_evicted = FALSE;
+    cpg_deliver_message = cluster->cpg.cpg_deliver_fn;
     cluster->group.length = 0;
     cluster->group.value[0] = 0;
 
@@ -7,6 +7,7 @@
 
 #include <crm_internal.h>
 
+#include <limits.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 
@@ -29,12 +30,113 @@ struct election_s
         GSourceFunc cb;
         GHashTable *voted;
         mainloop_timer_t *timeout; /* When to stop if not everyone casts a vote */
+        bool ranked;               /* Rank candidates by node ID, not uptime */
+        bool deferred;             /* Whether our vote is held back for a better candidate */
+        guint defer_ms;            /* How long to hold back our vote (0 for never) */
+        mainloop_timer_t *defer_timeout; /* When to vote anyway if deferred */
 };
 
+/* A candidate's vote, reduced to what is compared, so that comparing two
+ * votes needs no string parsing
+ */
+struct election_vote_s {
+        unsigned int version[3];   /* Feature set */
+        struct timeval age;        /* CPU time used by the candidate */
+        unsigned int rank;         /* Cluster node ID (0 if not ranked) */
+};
+
+static void
+parse_vote_version(const char *version, unsigned int parsed[3])
+{
+    parsed[0] = parsed[1] = parsed[2] = 0;
+    if (version != NULL) {
+        sscanf(version, "%u.%u.%u", &parsed[0], &parsed[1], &parsed[2]);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Compare two votes
+ *
+ * \param[in]  ours    Our vote
+ * \param[in]  yours   Peer's vote
+ * \param[out] reason  Where to store what decided the comparison
+ *
+ * \return Positive if our vote wins, negative if it loses, 0 if tied
+ * \note Older feature sets always win, so that during a rolling upgrade the
+ *       DC stays on a node that every peer can understand. Beyond that, the
+ *       lower rank wins, with unranked votes counting as ranked below every
+ *       ranked one, and then the candidate that has used more CPU time wins.
+ *       This is a single order over all votes, so candidates agree on the
+ *       winner even while only some of them use ranked mode.
+ */
+static int
+compare_votes(const struct election_vote_s *ours,
+              const struct election_vote_s *yours, const char **reason)
+{
+    *reason = "Version";
+    for (int lpc = 0; lpc < 3; lpc++) {
+        if (ours->version[lpc] != yours->version[lpc]) {
+            return (ours->version[lpc] < yours->version[lpc])? 1 : -1;
+        }
+    }
+
+    if (ours->rank != yours->rank) {
+        unsigned int our_rank = (ours->rank == 0)? UINT_MAX : ours->rank;
+        unsigned int your_rank = (yours->rank == 0)? UINT_MAX : yours->rank;
+
+        *reason = "Rank";
+        return (our_rank < your_rank)? 1 : -1;
+    }
+
+    *reason = "Uptime";
+    if (ours->age.tv_sec != yours->age.tv_sec) {
+        return (ours->age.tv_sec > yours->age.tv_sec)? 1 : -1;
+    }
+    if (ours->age.tv_usec != yours->age.tv_usec) {
+        return (ours->age.tv_usec > yours->age.tv_usec)? 1 : -1;
+    }
+    return 0;
+}
+
+/*!
+ * \internal
+ * \brief Compare two election votes
+ *
+ * \param[in] our_version   Our feature set
+ * \param[in] our_age       CPU time we have used
+ * \param[in] our_rank      Our node ID if ranked, otherwise 0
+ * \param[in] your_version  Peer's feature set
+ * \param[in] your_age      CPU time peer has used
+ * \param[in] your_rank     Peer's node ID if ranked, otherwise 0
+ *
+ * \return Positive if our vote wins, negative if it loses, 0 if tied
+ * \note This is the comparison election_count_vote() makes, for unit testing.
+ */
+int
+pcmk__election_compare(const char *our_version, const struct timeval *our_age,
+                       unsigned int our_rank, const char *your_version,
+                       const struct timeval *your_age, unsigned int your_rank)
+{
+    struct election_vote_s ours = { { 0, }, };
+    struct election_vote_s yours = { { 0, }, };
+    const char *reason = NULL;
+
+    parse_vote_version(our_version, ours.version);
+    ours.age = *our_age;
+    ours.rank = our_rank;
+    parse_vote_version(your_version, yours.version);
+    yours.age = *your_age;
+    yours.rank = your_rank;
+    return compare_votes(&ours, &yours, &reason);
+}
+
 static void election_complete(election_t *e)
 {
     crm_info("Election %s complete", e->name);
     e->state = election_won;
+    e->deferred = FALSE;
+    mainloop_timer_stop(e->defer_timeout);
 
     if(e->cb) {
         e->cb(e);
@@ -111,6 +213,7 @@ election_fini(election_t *e)
         election_reset(e);
         crm_trace("Destroying %s", e->name);
         mainloop_timer_del(e->timeout);
+        mainloop_timer_del(e->defer_timeout);
         free(e->uname);
         free(e->name);
         free(e);
@@ -133,6 +236,83 @@ election_timeout_stop(election_t *e)
     }
 }
 
+static gboolean
+election_defer_cb(gpointer user_data)
+{
+    election_t *e = user_data;
+
+    if (e->deferred && (e->state == election_in_progress)) {
+        crm_info("No better-ranked candidate has won %s yet, voting", e->name);
+        election_vote(e);
+    }
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Rank election candidates deterministically
+ *
+ * In ranked mode, votes between candidates with the same feature set are
+ * decided by cluster node ID (lowest wins) rather than by CPU time used, which
+ * changes from one round to the next. Since every node knows the membership,
+ * a node that sees an active peer with a lower ID holds back its own vote,
+ * so normally only the winner votes and everyone else concedes, in a single
+ * round. If that has not happened within \p defer_ms, the node votes anyway.
+ *
+ * \param[in] e         Election object
+ * \param[in] ranked    Whether to use ranked mode
+ * \param[in] defer_ms  How long to hold back our vote for a better candidate
+ *
+ * \note Candidates that do not use ranked mode lose to those that do, so
+ *       nodes with differing settings still agree on the outcome.
+ */
+void
+pcmk__election_set_ranked(election_t *e, bool ranked, guint defer_ms)
+{
+    if (e == NULL) {
+        return;
+    }
+    e->ranked = ranked;
+    e->defer_ms = defer_ms;
+    if (e->defer_timeout == NULL) {
+        e->defer_timeout = mainloop_timer_add(e->name, defer_ms, FALSE,
+                                              election_defer_cb, e);
+    } else {
+        mainloop_timer_set_period(e->defer_timeout, defer_ms);
+    }
+    if (!ranked) {
+        e->deferred = FALSE;
+        mainloop_timer_stop(e->defer_timeout);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Check whether an active peer outranks a node
+ *
+ * \param[in] node  Node to check
+ *
+ * \return TRUE if an active peer has a lower (nonzero) node ID
+ */
+static bool
+better_candidate_active(const crm_node_t *node)
+{
+    GHashTableIter iter;
+    crm_node_t *peer = NULL;
+
+    if (node->id == 0) {
+        return FALSE;
+    }
+    g_hash_table_iter_init(&iter, crm_peer_cache);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &peer)) {
+        if ((peer->id != 0) && (peer->id < node->id)
+            && crm_is_peer_active(peer)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
 void
 election_timeout_set_period(election_t *e, guint period)
 {
@@ -178,32 +358,6 @@ crm_uptime(struct timeval *output)
     return 1;
 }
 
-static int
-crm_compare_age(struct timeval your_age)
-{
-    struct timeval our_age;
-
-    crm_uptime(&our_age); /* If an error occurred, our_age will be compared as {0,0} */
-
-    if (our_age.tv_sec > your_age.tv_sec) {
-        crm_debug("Win: %ld vs %ld (seconds)", (long)our_age.tv_sec, (long)your_age.tv_sec);
-        return 1;
-    } else if (our_age.tv_sec < your_age.tv_sec) {
-        crm_debug("Lose: %ld vs %ld (seconds)", (long)our_age.tv_sec, (long)your_age.tv_sec);
-        return -1;
-    } else if (our_age.tv_usec > your_age.tv_usec) {
-        crm_debug("Win: %ld.%ld vs %ld.%ld (usec)",
-                  (long)our_age.tv_sec, (long)our_age.tv_usec, (long)your_age.tv_sec, (long)your_age.tv_usec);
-        return 1;
-    } else if (our_age.tv_usec < your_age.tv_usec) {
-        crm_debug("Lose: %ld.%ld vs %ld.%ld (usec)",
-                  (long)our_age.tv_sec, (long)our_age.tv_usec, (long)your_age.tv_sec, (long)your_age.tv_usec);
-        return -1;
-    }
-
-    return 0;
-}
-
 void
 election_vote(election_t *e)
 {
@@ -223,11 +377,23 @@ election_vote(election_t *e)
     }
 
     e->state = election_in_progress;
+    if (e->ranked && (e->defer_ms > 0) && !e->deferred
+        && better_candidate_active(our_node)) {
+        crm_debug("Deferring vote in %s to a better-ranked candidate", e->name);
+        e->deferred = TRUE;
+        mainloop_timer_start(e->defer_timeout);
+        return;
+    }
+    mainloop_timer_stop(e->defer_timeout);
+
     vote = create_request(CRM_OP_VOTE, NULL, NULL, CRM_SYSTEM_CRMD, CRM_SYSTEM_CRMD, NULL);
 
     e->count++;
     crm_xml_add(vote, F_CRM_ELECTION_OWNER, our_node->uuid);
     crm_xml_add_int(vote, F_CRM_ELECTION_ID, e->count);
+    if (e->ranked) {
+        crm_xml_add_int(vote, F_CRM_ELECTION_RANK, (int) our_node->id);
+    }
 
     crm_uptime(&age);
     crm_xml_add_int(vote, F_CRM_ELECTION_AGE_S, age.tv_sec);
@@ -303,7 +469,7 @@ election_check(election_t *e)
 enum election_result
 election_count_vote(election_t *e, xmlNode *vote, bool can_win)
 {
-    int age = 0;
+    int cmp = 0;
     int election_id = -1;
     int log_level = LOG_INFO;
     gboolean done = FALSE;
@@ -381,18 +547,37 @@ election_count_vote(election_t *e, xmlNode *vote, bool can_win)
         done = TRUE;
 
     } else {
-        struct timeval your_age;
-        const char *your_version = crm_element_value(vote, F_CRM_VERSION);
+        static unsigned int our_version[3] = { 0, 0, 0 };
+        struct election_vote_s ours = { { 0, }, };
+        struct election_vote_s yours = { { 0, }, };
         int tv_sec = 0;
         int tv_usec = 0;
+        int rank = 0;
 
+        if (our_version[0] == 0) {
+            parse_vote_version(CRM_FEATURE_SET, our_version);
+        }
+        memcpy(ours.version, our_version, sizeof(our_version));
+        crm_uptime(&ours.age); /* If an error occurred, our age will be compared as {0,0} */
+
+        parse_vote_version(crm_element_value(vote, F_CRM_VERSION),
+                           yours.version);
         crm_element_value_int(vote, F_CRM_ELECTION_AGE_S, &tv_sec);
         crm_element_value_int(vote, F_CRM_ELECTION_AGE_US, &tv_usec);
+        yours.age.tv_sec = tv_sec;
+        yours.age.tv_usec = tv_usec;
 
-        your_age.tv_sec = tv_sec;
-        your_age.tv_usec = tv_usec;
+        /* Use each rank that was advertised, whether or not the other
+         * candidate uses ranked mode, so both sides compare the same way
+         */
+        if (e->ranked) {
+            ours.rank = our_node->id;
+        }
+        if (crm_element_value_int(vote, F_CRM_ELECTION_RANK, &rank) == 0) {
+            yours.rank = (unsigned int) rank;
+        }
 
-        age = crm_compare_age(your_age);
+        cmp = compare_votes(&ours, &yours, &reason);
         if (crm_str_eq(from, e->uname, TRUE)) {
             char *op_copy = strdup(op);
             char *uname_copy = strdup(from);
@@ -404,19 +589,12 @@ election_count_vote(election_t *e, xmlNode *vote, bool can_win)
             reason = "Recorded";
             done = TRUE;
 
-        } else if (compare_version(your_version, CRM_FEATURE_SET) < 0) {
-            reason = "Version";
-            we_lose = TRUE;
-
-        } else if (compare_version(your_version, CRM_FEATURE_SET) > 0) {
-            reason = "Version";
-
-        } else if (age < 0) {
-            reason = "Uptime";
+        } else if (cmp < 0) {
+            crm_debug("Lose: %s", reason);
             we_lose = TRUE;
 
-        } else if (age > 0) {
-            reason = "Uptime";
+        } else if (cmp > 0) {
+            crm_debug("Win: %s", reason);
 
         } else if (e->uname == NULL) {
             reason = "Unknown host name";
@@ -496,5 +674,7 @@ election_count_vote(election_t *e, xmlNode *vote, bool can_win)
 
     last_election_loss = tm_now;
     e->state = election_lost;
+    e->deferred = FALSE;
+    mainloop_timer_stop(e->defer_timeout);
     return e->state;
 }
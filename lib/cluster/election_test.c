@@ -0,0 +1,114 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU Lesser General Public License
+ * version 2.1 or later (LGPLv2.1+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <crm/cluster/internal.h>
+
+static int failures = 0;
+
+static int
+sign(int value)
+{
+    return (value > 0) - (value < 0);
+}
+
+/* Check that a comparison comes out as expected from both sides, so that the
+ * two candidates agree on the winner
+ */
+static void
+check(const char *desc, const char *v1, long age1, unsigned int rank1,
+      const char *v2, long age2, unsigned int rank2, int expected)
+{
+    struct timeval t1 = { age1, 0 };
+    struct timeval t2 = { age2, 0 };
+    int forward = sign(pcmk__election_compare(v1, &t1, rank1, v2, &t2, rank2));
+    int reverse = sign(pcmk__election_compare(v2, &t2, rank2, v1, &t1, rank1));
+
+    if ((forward != expected) || (reverse != -expected)) {
+        printf("FAIL: %s (got %d and %d, expected %d and %d)\n",
+               desc, forward, reverse, expected, -expected);
+        failures++;
+    } else {
+        printf("PASS: %s\n", desc);
+    }
+}
+
+struct vote_s {
+    const char *version;
+    long age;
+    unsigned int rank;
+};
+
+/* Check that every vote beats every later one, from both sides, so that the
+ * winner among them does not depend on which pairs get compared
+ */
+static void
+check_order(const char *desc, const struct vote_s *votes, int n_votes)
+{
+    int failed = 0;
+
+    for (int i = 0; i < n_votes; i++) {
+        for (int j = i + 1; j < n_votes; j++) {
+            struct timeval ti = { votes[i].age, 0 };
+            struct timeval tj = { votes[j].age, 0 };
+
+            if ((sign(pcmk__election_compare(votes[i].version, &ti,
+                                             votes[i].rank, votes[j].version,
+                                             &tj, votes[j].rank)) != 1)
+                || (sign(pcmk__election_compare(votes[j].version, &tj,
+                                                votes[j].rank, votes[i].version,
+                                                &ti, votes[i].rank)) != -1)) {
+                printf("FAIL: %s (vote %d does not beat vote %d)\n",
+                       desc, i + 1, j + 1);
+                failed++;
+            }
+        }
+    }
+    if (failed) {
+        failures++;
+    } else {
+        printf("PASS: %s\n", desc);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    // Mixed versions: the older feature set wins regardless of anything else
+    check("older major version wins", "2.1.0", 10, 0, "3.0.14", 50, 0, 1);
+    check("older minor version wins", "3.0.14", 10, 0, "3.1.0", 50, 0, 1);
+    check("versions compare numerically", "3.0.9", 10, 0, "3.0.14", 50, 0, 1);
+    check("older version beats lower rank", "3.0.14", 10, 5, "3.1.0", 50, 1, 1);
+    check("missing version counts as oldest", NULL, 10, 0, "3.0.14", 50, 0, 1);
+
+    // Same version: rank (unranked counts as lowest), then CPU time used
+    check("lower rank wins", "3.0.14", 10, 1, "3.0.14", 50, 2, 1);
+    check("more CPU time wins", "3.0.14", 50, 0, "3.0.14", 10, 0, 1);
+    check("ranked vote beats unranked vote", "3.0.14", 10, 1, "3.0.14", 50, 0, 1);
+    check("identical votes tie", "3.0.14", 10, 0, "3.0.14", 10, 0, 0);
+
+    /* While ranked mode spreads through the cluster, ranked and unranked
+     * candidates must still fall into a single order
+     */
+    {
+        const struct vote_s mixed[] = {
+            { "3.0.14", 10, 1 },
+            { "3.0.14", 50, 2 },
+            { "3.0.14", 30, 0 },
+            { "3.0.14", 20, 0 },
+        };
+
+        check_order("mixed ranked and unranked votes are ordered", mixed,
+                    sizeof(mixed) / sizeof(mixed[0]));
+    }
+
+    return (failures == 0)? 0 : 1;
+}
@@ -33,6 +33,26 @@
  */
 GHashTable *crm_peer_cache = NULL;
 
+/*
+ * Peer cache indexes
+ *
+ * Messages and membership events identify cluster nodes by ID, name, or UUID,
+ * so rather than search the whole peer cache for every lookup, the library
+ * keeps an index of the cache entries for each. An entry is added to the
+ * indexes whenever the library sets one of those fields, and removed when the
+ * entry is freed.
+ *
+ * Since conflicting entries can share a value (which the lookup functions
+ * sort out), an index holds only one of them. If an entry that was indexed is
+ * freed, or an indexed value no longer matches (a node was renamed, say), the
+ * indexes are marked stale, and the next lookup that misses rebuilds them from
+ * the peer cache.
+ */
+static GHashTable *peer_ids = NULL;     // ID -> crm_node_t *
+static GHashTable *peer_unames = NULL;  // uname -> crm_node_t *
+static GHashTable *peer_uuids = NULL;   // UUID -> crm_node_t *
+static gboolean peer_index_stale = FALSE;
+
 /*
  * The remote peer cache tracks pacemaker_remote nodes. While the
  * value has the same type as the peer cache's, it is tracked separately for
@@ -147,34 +167,21 @@ remote_state_from_cib(xmlNode *node_state)
     return status;
 }
 
-/* user data for looping through remote node xpath searches */
-struct refresh_data {
-    const char *field;  /* XML attribute to check for node name */
-    gboolean has_state; /* whether to update node state based on XML */
-};
-
 /*!
  * \internal
- * \brief Process one pacemaker_remote node xpath search result
+ * \brief Update the remote peer cache entry for a node found in the CIB
  *
- * \param[in] result     XML search result
- * \param[in] user_data  what to look for in the XML
+ * \param[in] remote  Name of remote node
+ * \param[in] state   Node's state according to its status entry (or NULL if
+ *                    the node was found in the configuration)
  */
 static void
-remote_cache_refresh_helper(xmlNode *result, void *user_data)
+remote_cache_refresh_node(const char *remote, const char *state)
 {
-    struct refresh_data *data = user_data;
-    const char *remote = crm_element_value(result, data->field);
-    const char *state = NULL;
     crm_node_t *node;
 
     CRM_CHECK(remote != NULL, return);
 
-    /* Determine node's state, if the result has it */
-    if (data->has_state) {
-        state = remote_state_from_cib(result);
-    }
-
     /* Check whether cache already has entry for node */
     node = g_hash_table_lookup(crm_remote_peer_cache, remote);
 
@@ -195,6 +202,49 @@ remote_cache_refresh_helper(xmlNode *result, void *user_data)
     }
 }
 
+/*!
+ * \internal
+ * \brief Find guest and remote nodes in (part of) the resource configuration
+ *
+ * \param[in] parent  Resources section or resource element to search below
+ */
+static void
+remote_cache_refresh_resources(xmlNode *parent)
+{
+    for (xmlNode *xml = __xml_first_child_element(parent); xml != NULL;
+         xml = __xml_next_element(xml)) {
+
+        if (!crm_str_eq(crm_element_name(xml), XML_CIB_TAG_RESOURCE, TRUE)) {
+            // Groups, clones, and bundles may contain primitives
+            remote_cache_refresh_resources(xml);
+            continue;
+        }
+
+        // Guest nodes are primitives with a remote-node meta-attribute
+        for (xmlNode *meta = first_named_child(xml, XML_TAG_META_SETS);
+             meta != NULL; meta = crm_next_same_xml(meta)) {
+
+            for (xmlNode *nvpair = first_named_child(meta, XML_CIB_TAG_NVPAIR);
+                 nvpair != NULL; nvpair = crm_next_same_xml(nvpair)) {
+
+                if (safe_str_eq(crm_element_value(nvpair, XML_NVPAIR_ATTR_NAME),
+                                XML_RSC_ATTR_REMOTE_NODE)) {
+                    remote_cache_refresh_node(crm_element_value(nvpair,
+                                                                XML_NVPAIR_ATTR_VALUE),
+                                              NULL);
+                }
+            }
+        }
+
+        // Remote nodes are ocf:pacemaker:remote primitives
+        if (safe_str_eq(crm_element_value(xml, XML_ATTR_TYPE), "remote")
+            && safe_str_eq(crm_element_value(xml, XML_AGENT_ATTR_PROVIDER),
+                           "pacemaker")) {
+            remote_cache_refresh_node(ID(xml), NULL);
+        }
+    }
+}
+
 static void
 mark_dirty(gpointer key, gpointer value, gpointer user_data)
 {
@@ -207,34 +257,24 @@ is_dirty(gpointer key, gpointer value, gpointer user_data)
     return is_set(((crm_node_t*)value)->flags, crm_node_dirty);
 }
 
-/* search string to find CIB resources entries for guest nodes */
-#define XPATH_GUEST_NODE_CONFIG \
-    "//" XML_TAG_CIB "//" XML_CIB_TAG_CONFIGURATION "//" XML_CIB_TAG_RESOURCE \
-    "//" XML_TAG_META_SETS "//" XML_CIB_TAG_NVPAIR \
-    "[@name='" XML_RSC_ATTR_REMOTE_NODE "']"
-
-/* search string to find CIB resources entries for remote nodes */
-#define XPATH_REMOTE_NODE_CONFIG \
-    "//" XML_TAG_CIB "//" XML_CIB_TAG_CONFIGURATION "//" XML_CIB_TAG_RESOURCE \
-    "[@type='remote'][@provider='pacemaker']"
-
-/* search string to find CIB node status entries for pacemaker_remote nodes */
-#define XPATH_REMOTE_NODE_STATUS \
-    "//" XML_TAG_CIB "//" XML_CIB_TAG_STATUS "//" XML_CIB_TAG_STATE \
-    "[@" XML_NODE_IS_REMOTE "='true']"
-
 /*!
  * \brief Repopulate the remote peer cache based on CIB XML
  *
  * \param[in] xmlNode  CIB XML to parse
+ *
+ * \note Only the node state entries and the resource configuration are
+ *       examined, rather than searching the whole CIB (whose status section
+ *       can be very large).
  */
 void
 crm_remote_peer_cache_refresh(xmlNode *cib)
 {
-    struct refresh_data data;
+    xmlNode *section = NULL;
 
     crm_peer_init();
 
+    CRM_CHECK(crm_str_eq(crm_element_name(cib), XML_TAG_CIB, TRUE), return);
+
     /* First, we mark all existing cache entries as dirty,
      * so that later we can remove any that weren't in the CIB.
      * We don't empty the cache, because we need to detect changes in state.
@@ -242,10 +282,15 @@ crm_remote_peer_cache_refresh(xmlNode *cib)
     g_hash_table_foreach(crm_remote_peer_cache, mark_dirty, NULL);
 
     /* Look for guest nodes and remote nodes in the status section */
-    data.field = "id";
-    data.has_state = TRUE;
-    crm_foreach_xpath_result(cib, XPATH_REMOTE_NODE_STATUS,
-                             remote_cache_refresh_helper, &data);
+    section = first_named_child(cib, XML_CIB_TAG_STATUS);
+    for (xmlNode *state = first_named_child(section, XML_CIB_TAG_STATE);
+         state != NULL; state = crm_next_same_xml(state)) {
+
+        if (safe_str_eq(crm_element_value(state, XML_NODE_IS_REMOTE),
+                        XML_BOOLEAN_TRUE)) {
+            remote_cache_refresh_node(ID(state), remote_state_from_cib(state));
+        }
+    }
 
     /* Look for guest nodes and remote nodes in the configuration section,
      * because they may have just been added and not have a status entry yet.
@@ -253,14 +298,9 @@ crm_remote_peer_cache_refresh(xmlNode *cib)
      * peer status callback isn't called until we're sure the node started
      * successfully.
      */
-    data.field = "value";
-    data.has_state = FALSE;
-    crm_foreach_xpath_result(cib, XPATH_GUEST_NODE_CONFIG,
-                             remote_cache_refresh_helper, &data);
-    data.field = "id";
-    data.has_state = FALSE;
-    crm_foreach_xpath_result(cib, XPATH_REMOTE_NODE_CONFIG,
-                             remote_cache_refresh_helper, &data);
+    section = first_named_child(cib, XML_CIB_TAG_CONFIGURATION);
+    remote_cache_refresh_resources(first_named_child(section,
+                                                     XML_CIB_TAG_RESOURCES));
 
     /* Remove all old cache entries that weren't seen in the CIB */
     g_hash_table_foreach_remove(crm_remote_peer_cache, is_dirty, NULL);
@@ -370,12 +410,168 @@ crm_active_peers(void)
     return count;
 }
 
+static void
+peer_index_init(void)
+{
+    if (peer_ids == NULL) {
+        peer_ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+        peer_unames = g_hash_table_new_full(crm_strcase_hash,
+                                            crm_strcase_equal, free, NULL);
+        peer_uuids = g_hash_table_new_full(crm_strcase_hash,
+                                           crm_strcase_equal, free, NULL);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Add a peer cache entry to the indexes by ID, name, and UUID
+ *
+ * \param[in] node  Peer cache entry whose ID, name, or UUID has been set
+ *
+ * \note Remote peer cache entries are not indexed (that cache is already
+ *       keyed by name, which is also the UUID).
+ */
+void
+pcmk__peer_index_add(crm_node_t *node)
+{
+    if ((node == NULL) || is_set(node->flags, crm_remote_node)) {
+        return;
+    }
+    peer_index_init();
+    if (node->id > 0) {
+        g_hash_table_replace(peer_ids, GUINT_TO_POINTER(node->id), node);
+    }
+    if ((node->uname != NULL)
+        && (g_hash_table_lookup(peer_unames, node->uname) != node)) {
+        g_hash_table_replace(peer_unames, strdup(node->uname), node);
+    }
+    if ((node->uuid != NULL)
+        && (g_hash_table_lookup(peer_uuids, node->uuid) != node)) {
+        g_hash_table_replace(peer_uuids, strdup(node->uuid), node);
+    }
+}
+
+static gboolean
+index_points_to(gpointer key, gpointer value, gpointer user_data)
+{
+    return value == user_data;
+}
+
+static void
+peer_index_remove(crm_node_t *node)
+{
+    guint removed = 0;
+
+    if (peer_ids == NULL) {
+        return;
+    }
+    /* Look the node up by its current fields first, to avoid searching the
+     * indexes when it is indexed as expected
+     */
+    if ((node->id > 0)
+        && (g_hash_table_lookup(peer_ids, GUINT_TO_POINTER(node->id)) == node)) {
+        g_hash_table_remove(peer_ids, GUINT_TO_POINTER(node->id));
+        removed++;
+    }
+    if (node->uname && (g_hash_table_lookup(peer_unames, node->uname) == node)) {
+        g_hash_table_remove(peer_unames, node->uname);
+        removed++;
+    }
+    if (node->uuid && (g_hash_table_lookup(peer_uuids, node->uuid) == node)) {
+        g_hash_table_remove(peer_uuids, node->uuid);
+        removed++;
+    }
+    if (peer_index_stale) {
+        // The indexes may still refer to the node by a former value
+        g_hash_table_foreach_remove(peer_ids, index_points_to, node);
+        g_hash_table_foreach_remove(peer_unames, index_points_to, node);
+        g_hash_table_foreach_remove(peer_uuids, index_points_to, node);
+
+    } else if (removed > 0) {
+        // Another entry with the same value may exist but be unindexed
+        peer_index_stale = TRUE;
+    }
+}
+
+static void
+peer_index_rebuild(void)
+{
+    GHashTableIter iter;
+    crm_node_t *node = NULL;
+
+    crm_trace("Rebuilding peer cache indexes");
+    peer_index_init();
+    g_hash_table_remove_all(peer_ids);
+    g_hash_table_remove_all(peer_unames);
+    g_hash_table_remove_all(peer_uuids);
+    peer_index_stale = FALSE;
+
+    g_hash_table_iter_init(&iter, crm_peer_cache);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &node)) {
+        pcmk__peer_index_add(node);
+    }
+}
+
+static crm_node_t *
+peer_by_id(unsigned int id)
+{
+    crm_node_t *node = NULL;
+
+    peer_index_init();
+    node = g_hash_table_lookup(peer_ids, GUINT_TO_POINTER(id));
+    if ((node == NULL)? peer_index_stale : (node->id != id)) {
+        peer_index_rebuild();
+        node = g_hash_table_lookup(peer_ids, GUINT_TO_POINTER(id));
+    }
+    return node;
+}
+
+static crm_node_t *
+peer_by_uname(const char *uname)
+{
+    crm_node_t *node = NULL;
+
+    peer_index_init();
+    node = g_hash_table_lookup(peer_unames, uname);
+    if ((node == NULL)? peer_index_stale
+        : ((node->uname == NULL) || strcasecmp(node->uname, uname))) {
+        peer_index_rebuild();
+        node = g_hash_table_lookup(peer_unames, uname);
+    }
+    return node;
+}
+
+/*!
+ * \internal
+ * \brief Find a cluster node in the peer cache by UUID
+ *
+ * \param[in] uuid  UUID to search for
+ *
+ * \return Peer cache entry with \p uuid if any, otherwise NULL
+ */
+crm_node_t *
+pcmk__peer_by_uuid(const char *uuid)
+{
+    crm_node_t *node = NULL;
+
+    crm_peer_init();
+    peer_index_init();
+    node = g_hash_table_lookup(peer_uuids, uuid);
+    if ((node == NULL)? peer_index_stale
+        : ((node->uuid == NULL) || strcasecmp(node->uuid, uuid))) {
+        peer_index_rebuild();
+        node = g_hash_table_lookup(peer_uuids, uuid);
+    }
+    return node;
+}
+
 static void
 destroy_crm_node(gpointer data)
 {
     crm_node_t *node = data;
 
     crm_trace("Destroying entry for node %u: %s", node->id, node->uname);
+    peer_index_remove(node);
 
     free(node->uname);
     free(node->state);
@@ -405,6 +601,14 @@ crm_peer_destroy(void)
         crm_peer_cache = NULL;
     }
 
+    if (peer_ids != NULL) {
+        g_hash_table_destroy(peer_ids);
+        g_hash_table_destroy(peer_unames);
+        g_hash_table_destroy(peer_uuids);
+        peer_ids = peer_unames = peer_uuids = NULL;
+        peer_index_stale = FALSE;
+    }
+
     if (crm_remote_peer_cache != NULL) {
         crm_trace("Destroying remote peer cache with %d members", g_hash_table_size(crm_remote_peer_cache));
         g_hash_table_destroy(crm_remote_peer_cache);
@@ -508,7 +712,6 @@ crm_get_peer_full(unsigned int id, const char *uname, int flags)
 crm_node_t *
 crm_find_peer(unsigned int id, const char *uname)
 {
-    GHashTableIter iter;
     crm_node_t *node = NULL;
     crm_node_t *by_id = NULL;
     crm_node_t *by_name = NULL;
@@ -518,24 +721,16 @@ crm_find_peer(unsigned int id, const char *uname)
     crm_peer_init();
 
     if (uname != NULL) {
-        g_hash_table_iter_init(&iter, crm_peer_cache);
-        while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &node)) {
-            if(node->uname && strcasecmp(node->uname, uname) == 0) {
-                crm_trace("Name match: %s = %p", node->uname, node);
-                by_name = node;
-                break;
-            }
+        by_name = peer_by_uname(uname);
+        if (by_name) {
+            crm_trace("Name match: %s = %p", by_name->uname, by_name);
         }
     }
 
     if (id > 0) {
-        g_hash_table_iter_init(&iter, crm_peer_cache);
-        while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &node)) {
-            if(node->id == id) {
-                crm_trace("ID match: %u = %p", node->id, node);
-                by_id = node;
-                break;
-            }
+        by_id = peer_by_id(id);
+        if (by_id) {
+            crm_trace("ID match: %u = %p", by_id->id, by_id);
         }
     }
 
@@ -702,6 +897,7 @@ crm_get_peer(unsigned int id, const char *uname)
         }
     }
 
+    pcmk__peer_index_add(node);
     free(uname_lookup);
 
     return node;
@@ -740,9 +936,13 @@ crm_update_peer_uname(crm_node_t *node, const char *uname)
         }
     }
 
+    if (node->uname != NULL) {
+        peer_index_stale = TRUE; // Old name may still be indexed
+    }
     free(node->uname);
     node->uname = strdup(uname);
     CRM_ASSERT(node->uname != NULL);
+    pcmk__peer_index_add(node);
 
     if (crm_status_callback) {
         crm_status_callback(crm_status_uname, node, NULL);
@@ -67,6 +67,10 @@ crm_alert_entry_new(const char *id, const char *path)
     entry->path = strdup(path);
     entry->timeout = CRM_ALERT_DEFAULT_TIMEOUT_MS;
     entry->flags = crm_alert_default;
+    entry->delivery = crm_alert_deliver_each;
+    entry->batch_delay = CRM_ALERT_DEFAULT_BATCH_DELAY_MS;
+    entry->batch_size = CRM_ALERT_DEFAULT_BATCH_SIZE;
+    entry->queue_size = CRM_ALERT_DEFAULT_QUEUE_SIZE;
     return entry;
 }
 
@@ -113,6 +117,10 @@ crm_dup_alert_entry(crm_alert_entry_t *entry)
 
     new_entry->timeout = entry->timeout;
     new_entry->flags = entry->flags;
+    new_entry->delivery = entry->delivery;
+    new_entry->batch_delay = entry->batch_delay;
+    new_entry->batch_size = entry->batch_size;
+    new_entry->queue_size = entry->queue_size;
     new_entry->envvars = crm_str_table_dup(entry->envvars);
     if (entry->tstamp_format) {
         new_entry->tstamp_format = strdup(entry->tstamp_format);
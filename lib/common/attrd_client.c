@@ -221,6 +221,130 @@ done:
     return rc;
 }
 
+/*!
+ * \brief Send a request to pacemaker-attrd to update a metric attribute
+ *
+ * A metric attribute is meant for values that change often, such as health
+ * measurements. It is kept out of the CIB except that a node's value is
+ * written there when it crosses one of the attribute's thresholds, and updates
+ * made on one node are sent to the other nodes at most once per interval
+ * unless they cross a threshold.
+ *
+ * \param[in] ipc        Connection to pacemaker-attrd (or NULL to use a local connection)
+ * \param[in] host       Affect only this host (or NULL for all hosts)
+ * \param[in] name       Name of attribute to update
+ * \param[in] value      Attribute value to set (or NULL to delete)
+ * \param[in] interval   Minimum interval between updates sent to other nodes
+ *                       (or NULL to leave unchanged)
+ * \param[in] thresholds Ascending, comma-separated list of numbers at which
+ *                       to write the value to the CIB (or NULL to leave
+ *                       unchanged, or never write it if creating)
+ * \param[in] user_name  ACL user to pass to pacemaker-attrd
+ * \param[in] options    Bitmask of attrd_opt_* as for attrd_update_delegate()
+ *
+ * \return pcmk_ok if request was successfully submitted to pacemaker-attrd, else -errno
+ * \note The attribute is made a metric only by the update that creates it.
+ */
+int
+attrd_update_metric(crm_ipc_t *ipc, const char *host, const char *name,
+                    const char *value, const char *interval,
+                    const char *thresholds, const char *user_name, int options)
+{
+    int rc = pcmk_ok;
+    xmlNode *update = NULL;
+
+    if (name == NULL) {
+        return -EINVAL;
+    }
+
+    update = create_attrd_op(user_name);
+    crm_xml_add(update, F_ATTRD_TASK,
+                (interval? ATTRD_OP_UPDATE_BOTH : ATTRD_OP_UPDATE));
+    crm_xml_add(update, F_ATTRD_ATTRIBUTE, name);
+    crm_xml_add(update, F_ATTRD_VALUE, value);
+    crm_xml_add(update, F_ATTRD_DAMPEN, interval);
+    crm_xml_add(update, F_ATTRD_SECTION, XML_CIB_TAG_STATUS);
+    crm_xml_add(update, F_ATTRD_HOST, host);
+    crm_xml_add(update, F_ATTRD_THRESHOLDS, thresholds);
+    crm_xml_add_int(update, F_ATTRD_IS_METRIC, 1);
+    crm_xml_add_int(update, F_ATTRD_IS_REMOTE, is_set(options, attrd_opt_remote));
+    crm_xml_add_int(update, F_ATTRD_IS_PRIVATE, is_set(options, attrd_opt_private));
+
+    rc = send_attrd_op(ipc, update);
+    free_xml(update);
+
+    crm_debug("Asked pacemaker-attrd to update metric %s=%s for %s: %s (%d)",
+              name, value, (host? host : "localhost"), pcmk_strerror(rc), rc);
+    return rc;
+}
+
+/*!
+ * \brief Send many attribute updates to pacemaker-attrd in one request
+ *
+ * \param[in] ipc       Connection to pacemaker-attrd (or NULL to use a local connection)
+ * \param[in] updates   List of attrd_update_t to make
+ * \param[in] section   Status or nodes
+ * \param[in] user_name ACL user to pass to pacemaker-attrd
+ * \param[in] options   Bitmask of attrd_opt_* as for attrd_update_delegate()
+ *
+ * \return pcmk_ok if request was successfully submitted to pacemaker-attrd, else -errno
+ * \note This requires a pacemaker-attrd from Pacemaker 2.0.1 or later. Each
+ *       update is made as if by attrd_update_delegate() with command 'B' if it
+ *       has dampening, otherwise 'U' (or 'D' if it has no value). Nodes will
+ *       get all the updates in one cluster message, if all support that.
+ */
+int
+attrd_update_batch(crm_ipc_t *ipc, GList *updates, const char *section,
+                   const char *user_name, int options)
+{
+    int rc = pcmk_ok;
+    int n_updates = 0;
+    xmlNode *batch = create_attrd_op(user_name);
+
+    /* remap common aliases */
+    if (safe_str_eq(section, "reboot")) {
+        section = XML_CIB_TAG_STATUS;
+
+    } else if (safe_str_eq(section, "forever")) {
+        section = XML_CIB_TAG_NODES;
+    }
+
+    crm_xml_add(batch, F_ATTRD_TASK, ATTRD_OP_UPDATE_BATCH);
+
+    for (GList *iter = updates; iter != NULL; iter = iter->next) {
+        attrd_update_t *change = iter->data;
+        xmlNode *update = NULL;
+
+        if ((change == NULL) || (change->name == NULL)) {
+            rc = -EINVAL;
+            goto done;
+        }
+
+        update = create_xml_node(batch, XML_ATTR_OP);
+        crm_xml_add(update, F_ATTRD_TASK,
+                    (change->dampen? ATTRD_OP_UPDATE_BOTH : ATTRD_OP_UPDATE));
+        crm_xml_add(update, F_ATTRD_ATTRIBUTE, change->name);
+        crm_xml_add(update, F_ATTRD_VALUE, change->value);
+        crm_xml_add(update, F_ATTRD_DAMPEN, change->dampen);
+        crm_xml_add(update, F_ATTRD_SECTION, section);
+        crm_xml_add(update, F_ATTRD_HOST, change->host);
+        crm_xml_add(update, F_ATTRD_SET, change->set);
+        crm_xml_add_int(update, F_ATTRD_IS_REMOTE, is_set(options, attrd_opt_remote));
+        crm_xml_add_int(update, F_ATTRD_IS_PRIVATE, is_set(options, attrd_opt_private));
+        n_updates++;
+    }
+
+    if (n_updates > 0) {
+        rc = send_attrd_op(ipc, batch);
+    }
+
+done:
+    free_xml(batch);
+    crm_debug("Asked pacemaker-attrd to make %d attribute updates: %s (%d)",
+              n_updates, pcmk_strerror(rc), rc);
+    return rc;
+}
+
 /*!
  * \brief Send a request to pacemaker-attrd to clear resource failure
  *
@@ -267,6 +391,180 @@ attrd_clear_delegate(crm_ipc_t *ipc, const char *host, const char *resource,
     return rc;
 }
 
+/*!
+ * \brief Subscribe to (or unsubscribe from) attribute change notifications
+ *
+ * \param[in] ipc      Connection to pacemaker-attrd, which must be kept open
+ *                     and dispatched for notifications to be received
+ * \param[in] pattern  Extended regular expression matching the names of
+ *                     attributes of interest (or NULL for all attributes)
+ * \param[in] enabled  TRUE to subscribe, FALSE to unsubscribe
+ *
+ * \return pcmk_ok if request was successfully submitted to pacemaker-attrd, else -errno
+ * \note Each notification is a message with F_ATTRD_TASK set to
+ *       ATTRD_OP_CHANGED, giving the attribute's name, node, new value (unset
+ *       if deleted), set, dampening and whether it is private. It is sent as
+ *       soon as pacemaker-attrd learns of the change, before the change is
+ *       written to the CIB.
+ */
+int
+attrd_subscribe(crm_ipc_t *ipc, const char *pattern, gboolean enabled)
+{
+    int rc = pcmk_ok;
+    xmlNode *notify_op = NULL;
+
+    if (ipc == NULL) {
+        return -EINVAL;
+    }
+
+    notify_op = create_attrd_op(NULL);
+    crm_xml_add(notify_op, F_ATTRD_TASK, ATTRD_OP_NOTIFY);
+    crm_xml_add(notify_op, F_ATTRD_REGEX, pattern);
+    crm_xml_add_int(notify_op, F_ATTRD_NOTIFY_ENABLED, enabled);
+
+    rc = send_attrd_op(ipc, notify_op);
+    free_xml(notify_op);
+
+    crm_debug("Asked pacemaker-attrd to %s changes of %s: %s (%d)",
+              (enabled? "notify of" : "stop notifying of"),
+              (pattern? pattern : "all attributes"), pcmk_strerror(rc), rc);
+    return rc;
+}
+
+// First pacemaker-attrd protocol version supporting multiple-attribute queries
+#define ATTRD_QUERY_VALUES_VERSION 6
+
+static void
+free_attrd_value(gpointer data)
+{
+    attrd_value_t *v = data;
+
+    free(v->host);
+    free(v->name);
+    free(v->value);
+    free(v);
+}
+
+/*!
+ * \brief Free a list of attribute values from attrd_query_values()
+ *
+ * \param[in] values  List to free
+ */
+void
+attrd_free_values(GList *values)
+{
+    g_list_free_full(values, free_attrd_value);
+}
+
+/*!
+ * \brief Query pacemaker-attrd for current attribute values
+ *
+ * Transient attributes are held in memory by pacemaker-attrd, so this is much
+ * cheaper than reading them from the CIB status section, and can get values of
+ * several attributes on several nodes with one request.
+ *
+ * \param[in]  ipc      Connection to pacemaker-attrd (or NULL to use a
+ *                      temporary local connection)
+ * \param[in]  names    List of names (char *) of attributes to query (ignored
+ *                      if \p pattern is given)
+ * \param[in]  pattern  If not NULL, query all attributes whose names match
+ *                      this extended regular expression
+ * \param[in]  host     Node to query (or NULL for all nodes)
+ * \param[out] values   Where to store the resulting list of attrd_value_t *
+ *                      (to be freed with attrd_free_values()), which has no
+ *                      entry for an attribute without a value on a node
+ *
+ * \return pcmk_ok on success, -EPROTONOSUPPORT if pacemaker-attrd is too old
+ *         to support the query, otherwise another -errno
+ */
+int
+attrd_query_values(crm_ipc_t *ipc, GList *names, const char *pattern,
+                   const char *host, GList **values)
+{
+    int rc = pcmk_ok;
+    int version = 0;
+    crm_ipc_t *local_ipc = NULL;
+    xmlNode *query = NULL;
+    xmlNode *reply = NULL;
+
+    if ((values == NULL) || ((names == NULL) && (pattern == NULL))) {
+        return -EINVAL;
+    }
+    *values = NULL;
+
+    /* An older pacemaker-attrd does not reply to a query without a name, so
+     * always give one; its reply is then recognizable by its version.
+     */
+    query = create_attrd_op(NULL);
+    crm_xml_add(query, F_ATTRD_TASK, ATTRD_OP_QUERY);
+    crm_xml_add(query, F_ATTRD_HOST, host);
+    if (pattern) {
+        crm_xml_add(query, F_ATTRD_ATTRIBUTE, pattern);
+        crm_xml_add(query, F_ATTRD_REGEX, pattern);
+    } else {
+        crm_xml_add(query, F_ATTRD_ATTRIBUTE, names->data);
+        for (GList *iter = names->next; iter != NULL; iter = iter->next) {
+            xmlNode *name = create_xml_node(query, XML_ATTR_OP);
+
+            crm_xml_add(name, F_ATTRD_ATTRIBUTE, iter->data);
+        }
+    }
+
+    if (ipc == NULL) {
+        local_ipc = crm_ipc_new(T_ATTRD, 0);
+        if ((local_ipc == NULL) || !crm_ipc_connect(local_ipc)) {
+            rc = -ENOTCONN;
+            goto done;
+        }
+        ipc = local_ipc;
+    }
+
+    rc = crm_ipc_send(ipc, query, crm_ipc_client_response, 0, &reply);
+    if (rc < 0) {
+        goto done;
+    }
+    rc = pcmk_ok;
+
+    if ((reply == NULL)
+        || (crm_element_value_int(reply, F_ATTRD_VERSION, &version) < 0)
+        || (version < ATTRD_QUERY_VALUES_VERSION)) {
+        rc = -EPROTONOSUPPORT;
+        goto done;
+    }
+
+    for (xmlNode *child = __xml_first_child_element(reply); child != NULL;
+         child = __xml_next_element(child)) {
+
+        const char *name = crm_element_value(child, F_ATTRD_ATTRIBUTE);
+        const char *node = crm_element_value(child, F_ATTRD_HOST);
+        const char *value = crm_element_value(child, F_ATTRD_VALUE);
+        attrd_value_t *v = NULL;
+
+        if ((name == NULL) || (node == NULL) || (value == NULL)) {
+            continue;
+        }
+        v = calloc(1, sizeof(attrd_value_t));
+        CRM_ASSERT(v != NULL);
+        v->host = strdup(node);
+        v->name = strdup(name);
+        v->value = strdup(value);
+        *values = g_list_prepend(*values, v);
+    }
+    *values = g_list_reverse(*values);
+
+done:
+    if (local_ipc) {
+        crm_ipc_close(local_ipc);
+        crm_ipc_destroy(local_ipc);
+    }
+    free_xml(query);
+    free_xml(reply);
+    crm_debug("Queried pacemaker-attrd for %s on %s: %s (%d)",
+              (pattern? pattern : "attributes"), (host? host : "all nodes"),
+              pcmk_strerror(rc), rc);
+    return rc;
+}
+
 #define LRM_TARGET_ENV "OCF_RESKEY_" CRM_META "_" XML_LRM_ATTR_TARGET
 
 const char *
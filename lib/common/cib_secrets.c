@@ -16,6 +16,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <time.h>
 
 #include <glib.h>
@@ -31,6 +32,19 @@ static char *read_local_file(char *local_file);
 #define MAX_VALUE_LEN 255
 #define MAGIC "lrm://"
 
+/* Resources with secrets are typically monitored every few seconds, and
+ * reading and hashing every secret for every operation is wasteful. Once a
+ * secret has been verified, remember it until either file changes.
+ */
+struct cached_secret_s {
+    struct stat secret_st;
+    struct stat sign_st;
+    char *value;            // Page-aligned, and locked in memory if possible
+    size_t size;
+};
+
+static GHashTable *secret_cache = NULL;  // Secret file path -> cached secret
+
 static int
 is_magic_value(char *p)
 {
@@ -81,6 +95,108 @@ read_local_file(char *local_file)
     return strdup(buf);
 }
 
+static gboolean
+same_file_version(const struct stat *a, const struct stat *b)
+{
+    return (a->st_dev == b->st_dev) && (a->st_ino == b->st_ino)
+           && (a->st_size == b->st_size) && (a->st_mtime == b->st_mtime)
+           && (a->st_ctime == b->st_ctime);
+}
+
+static void
+free_cached_secret(gpointer data)
+{
+    struct cached_secret_s *cached = data;
+    volatile char *p = cached->value;
+
+    // Wipe via volatile pointer so the compiler can't drop it before free()
+    for (size_t lpc = 0; lpc < cached->size; lpc++) {
+        p[lpc] = '\0';
+    }
+    munlock(cached->value, cached->size);
+    free(cached->value);
+    free(cached);
+}
+
+/*!
+ * \internal
+ * \brief Get a copy of a verified secret, if its files have not changed since
+ *
+ * \param[in] local_file  Path of secret file
+ * \param[in] secret_st   Current status of secret file
+ * \param[in] sign_st     Current status of secret's sign file
+ *
+ * \return Newly allocated copy of secret, or NULL if not cached or stale
+ */
+static char *
+get_cached_secret(const char *local_file, const struct stat *secret_st,
+                  const struct stat *sign_st)
+{
+    struct cached_secret_s *cached = NULL;
+
+    if (secret_cache == NULL) {
+        return NULL;
+    }
+    cached = g_hash_table_lookup(secret_cache, local_file);
+    if (cached == NULL) {
+        return NULL;
+    }
+    if (!same_file_version(&(cached->secret_st), secret_st)
+        || !same_file_version(&(cached->sign_st), sign_st)) {
+        crm_trace("Secret in %s changed since it was cached", local_file);
+        g_hash_table_remove(secret_cache, local_file);
+        return NULL;
+    }
+    return strdup(cached->value);
+}
+
+/*!
+ * \internal
+ * \brief Remember a verified secret
+ *
+ * \param[in] local_file  Path of secret file
+ * \param[in] secret_st   Status of secret file before it was read
+ * \param[in] sign_st     Status of secret's sign file before it was read
+ * \param[in] value       Secret value (already checked against sign file)
+ */
+static void
+cache_secret(const char *local_file, const struct stat *secret_st,
+             const struct stat *sign_st, const char *value)
+{
+    struct cached_secret_s *cached = calloc(1, sizeof(struct cached_secret_s));
+    long page_size = sysconf(_SC_PAGESIZE);
+    void *buf = NULL;
+
+    if (cached == NULL) {
+        return;
+    }
+
+    /* Give each secret whole pages of its own, so unlocking one when it is
+     * replaced can't unlock another
+     */
+    cached->size = (page_size > MAX_VALUE_LEN)? page_size : (MAX_VALUE_LEN + 1);
+    if ((page_size <= 0)
+        || (posix_memalign(&buf, (size_t) page_size, cached->size) != 0)) {
+        free(cached);
+        return;
+    }
+    cached->value = buf;
+    if (mlock(cached->value, cached->size) < 0) {
+        crm_perror(LOG_DEBUG, "Could not lock cached secret from %s in memory",
+                   local_file);
+    }
+    strncpy(cached->value, value, cached->size - 1);
+    cached->value[cached->size - 1] = '\0';
+    cached->secret_st = *secret_st;
+    cached->sign_st = *sign_st;
+
+    if (secret_cache == NULL) {
+        secret_cache = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                             free_cached_secret);
+    }
+    g_hash_table_replace(secret_cache, strdup(local_file), cached);
+}
+
 /*
  * returns 0 on success or no replacements necessary
  * returns -1 if replacement failed for whatever reasone
@@ -93,6 +209,8 @@ replace_secret_params(const char *rsc_id, GHashTable *params)
     char hash_file[FILENAME_MAX+1], *hash;
     GList *secret_params = NULL, *l;
     char *key, *pvalue, *secret_value;
+    struct stat secret_st, sign_st;
+    gboolean cacheable = FALSE;
     int rc = 0;
 
     if (params == NULL) {
@@ -132,6 +250,29 @@ replace_secret_params(const char *rsc_id, GHashTable *params)
         }
 
         strcpy(start_pname, key);
+
+        strcpy(hash_file, local_file);
+        if (strlen(hash_file) + 5 > FILENAME_MAX) {
+            crm_err("cannot build such a long name "
+                    "for the sign file: %s.sign", hash_file);
+            rc = -1;
+            continue;
+        }
+        strncat(hash_file, ".sign", 5);
+
+        /* Check the files before reading them, so a change made while they
+         * are being read is noticed next time
+         */
+        cacheable = (stat(local_file, &secret_st) == 0)
+                    && (stat(hash_file, &sign_st) == 0);
+        if (cacheable) {
+            secret_value = get_cached_secret(local_file, &secret_st, &sign_st);
+            if (secret_value != NULL) {
+                g_hash_table_replace(params, strdup(key), secret_value);
+                continue;
+            }
+        }
+
         secret_value = read_local_file(local_file);
         if (!secret_value) {
             crm_err("secret for rsc %s parameter %s not found in %s",
@@ -140,33 +281,26 @@ replace_secret_params(const char *rsc_id, GHashTable *params)
             continue;
         }
 
-        strcpy(hash_file, local_file);
-        if (strlen(hash_file) + 5 > FILENAME_MAX) {
-            crm_err("cannot build such a long name "
-                    "for the sign file: %s.sign", hash_file);
+        hash = read_local_file(hash_file);
+        if (hash == NULL) {
+            crm_err("md5 sum for rsc %s parameter %s "
+                    "cannot be read from %s", rsc_id, key, hash_file);
             free(secret_value);
             rc = -1;
             continue;
 
-        } else {
-            strncat(hash_file, ".sign", 5);
-            hash = read_local_file(hash_file);
-            if (hash == NULL) {
-                crm_err("md5 sum for rsc %s parameter %s "
-                        "cannot be read from %s", rsc_id, key, hash_file);
-                free(secret_value);
-                rc = -1;
-                continue;
-
-            } else if (!check_md5_hash(hash, secret_value)) {
-                crm_err("md5 sum for rsc %s parameter %s "
-                        "does not match", rsc_id, key);
-                free(secret_value);
-                free(hash);
-                rc = -1;
-                continue;
-            }
+        } else if (!check_md5_hash(hash, secret_value)) {
+            crm_err("md5 sum for rsc %s parameter %s "
+                    "does not match", rsc_id, key);
+            free(secret_value);
             free(hash);
+            rc = -1;
+            continue;
+        }
+        free(hash);
+
+        if (cacheable) {
+            cache_secret(local_file, &secret_st, &sign_st, secret_value);
         }
         g_hash_table_replace(params, strdup(key), secret_value);
     }
@@ -119,11 +119,19 @@ calculate_xml_digest_v2(xmlNode * source, gboolean do_filter)
          */
 
     } else {
-        crm_xml_dump(source, do_filter ? xml_log_option_filtered : 0, &buffer, &offset, &max, 0);
+        int options = do_filter? xml_log_option_filtered : 0;
+
+        // Reuse unchanged parts of the text, if the document caches them
+        digest = pcmk__xml_cached_digest(source, options);
+        if (digest == NULL) {
+            crm_xml_dump(source, options, &buffer, &offset, &max, 0);
+        }
     }
 
-    CRM_ASSERT(buffer != NULL);
-    digest = crm_md5sum(buffer);
+    if (digest == NULL) {
+        CRM_ASSERT(buffer != NULL);
+        digest = crm_md5sum(buffer);
+    }
 
     if (digest_cs == NULL) {
         digest_cs = qb_log_callsite_get(__func__, __FILE__, "cib-digest", LOG_TRACE, __LINE__,
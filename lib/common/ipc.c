@@ -9,6 +9,7 @@
 
 #include <sys/param.h>
 
+#include <ctype.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -18,6 +19,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <bzlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 
 #include <crm/crm.h>
 #include <crm/msg_xml.h>
@@ -52,6 +55,229 @@ crm_ipc_init(void)
     }
 }
 
+/* Received messages that were compressed are decompressed into a reusable
+ * buffer rather than a new allocation. The buffer is sized for the largest
+ * message seen recently, and given back if, for IPC_POOL_WINDOW messages in a
+ * row, none needed more than a quarter of it.
+ */
+#define IPC_POOL_WINDOW 64
+#define IPC_POOL_ALIGN  4096
+
+struct ipc_pool_s {
+    char *buf;
+    size_t size;
+    size_t recent_max;  // largest size needed in current window
+    unsigned int uses;  // messages in current window
+};
+
+// Server-side buffer for decompressing client requests
+static struct ipc_pool_s server_pool = { NULL, 0, 0, 0 };
+
+/*!
+ * \internal
+ * \brief Get a pooled buffer of at least a given size
+ *
+ * \param[in,out] pool  Buffer pool to use
+ * \param[in]     size  Number of bytes needed
+ *
+ * \return Buffer of at least \p size bytes (owned by \p pool, and with
+ *         unspecified contents)
+ */
+static char *
+ipc_pool_reserve(struct ipc_pool_s *pool, size_t size)
+{
+    pool->recent_max = QB_MAX(pool->recent_max, size);
+    if (++(pool->uses) >= IPC_POOL_WINDOW) {
+        if (pool->size > (4 * pool->recent_max)) {
+            crm_trace("Shrinking IPC buffer pool from %lu bytes",
+                      (unsigned long) pool->size);
+            free(pool->buf);
+            pool->buf = NULL;
+            pool->size = 0;
+        }
+        pool->uses = 0;
+        pool->recent_max = size;
+    }
+
+    if (size > pool->size) {
+        // Old contents are not needed, so don't copy them
+        free(pool->buf);
+        pool->size = ((pool->recent_max + IPC_POOL_ALIGN - 1) / IPC_POOL_ALIGN)
+                     * IPC_POOL_ALIGN;
+        pool->buf = malloc(pool->size);
+        CRM_ASSERT(pool->buf != NULL);
+    }
+    return pool->buf;
+}
+
+/*!
+ * \internal
+ * \brief Decompress the payload of a received IPC message
+ *
+ * \param[in]     header  Header of received message
+ * \param[in]     data    Compressed payload
+ * \param[out]    result  Where to store uncompressed payload
+ * \param[in,out] size    Size of \p result on input, bytes stored on output
+ *
+ * \return pcmk_ok on success, -errno otherwise
+ */
+static int
+ipc_decompress(const struct crm_ipc_response_header *header, const char *data,
+               char *result, unsigned int *size)
+{
+    int rc = 0;
+
+    if (is_set(header->flags, crm_ipc_compressed_lz4)) {
+        return pcmk__decompress_lz4(data, header->size_compressed, result,
+                                    size);
+    }
+
+    rc = BZ2_bzBuffToBuffDecompress(result, size, (char *) data,
+                                    header->size_compressed, 1, 0);
+    if (rc != BZ_OK) {
+        crm_err("Decompression failed: %s " CRM_XS " bzerror=%d",
+                bz2_strerror(rc), rc);
+        return -EILSEQ;
+    }
+    return pcmk_ok;
+}
+
+/* Messages too large for the IPC buffer may instead be written to a POSIX
+ * shared memory object, with only the object's name sent over IPC. The
+ * recipient maps the object, unlinks it, and parses the message directly from
+ * the mapping, so there is no size limit and no need to compress.
+ *
+ * This is used only between local processes that can verify each other's
+ * identity: the object is created with mode 0600 by the sender, and the
+ * recipient refuses it unless it is owned by the user at the other end of the
+ * connection (which must therefore be the same user, or root).
+ */
+#if defined(HAVE_SHM_OPEN) && defined(SO_PEERCRED)
+#  define SUPPORT_IPC_SHM 1
+#endif
+
+#define IPC_SHM_PREFIX "/pacemaker-ipc-"
+
+/*!
+ * \internal
+ * \brief Write an IPC payload to a new shared memory object
+ *
+ * \param[in] text  Payload to write
+ * \param[in] len   Number of bytes of \p text (including terminator)
+ *
+ * \return Newly allocated name of object, or NULL on error
+ */
+static char *
+ipc_shm_create(const char *text, size_t len)
+{
+#if SUPPORT_IPC_SHM
+    static gint counter = 0;    // may be called from several threads
+    char *name = crm_strdup_printf(IPC_SHM_PREFIX "%lld-%u-%ld",
+                                   (long long) getpid(),
+                                   (unsigned int) g_atomic_int_add(&counter, 1),
+                                   random());
+    int fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR);
+    void *map = MAP_FAILED;
+
+    if (fd < 0) {
+        crm_perror(LOG_INFO, "Could not create shared memory object %s", name);
+        free(name);
+        return NULL;
+    }
+    if (ftruncate(fd, len) == 0) {
+        map = mmap(NULL, len, PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        crm_perror(LOG_INFO, "Could not map shared memory object %s", name);
+        close(fd);
+        shm_unlink(name);
+        free(name);
+        return NULL;
+    }
+    memcpy(map, text, len);
+    munmap(map, len);
+    close(fd);
+    return name;
+#else
+    return NULL;
+#endif
+}
+
+/*!
+ * \internal
+ * \brief Map (and unlink) a shared memory object holding a received payload
+ *
+ * \param[in]  name  Name of object, as received
+ * \param[in]  uid   User that must own object
+ * \param[out] len   Where to store size of mapping
+ *
+ * \return Read-only mapping of object (to be unmapped with munmap()) on
+ *         success, or NULL on error
+ */
+static char *
+ipc_shm_map(const char *name, uid_t uid, size_t *len)
+{
+#if SUPPORT_IPC_SHM
+    struct stat sb;
+    char *map = MAP_FAILED;
+    int fd = -1;
+
+    // Never open anything other than an object created by ipc_shm_create()
+    if (!crm_starts_with(name, IPC_SHM_PREFIX)
+        || (strchr(name + 1, '/') != NULL)) {
+        crm_err("Ignoring IPC message with invalid shared memory name");
+        return NULL;
+    }
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        crm_perror(LOG_ERR, "Could not open shared memory object %s", name);
+        return NULL;
+    }
+    shm_unlink(name);
+
+    if ((fstat(fd, &sb) < 0) || (sb.st_uid != uid) || (sb.st_size <= 0)) {
+        crm_err("Ignoring IPC message in shared memory object %s not owned "
+                "by sender", name);
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        crm_perror(LOG_ERR, "Could not map shared memory object %s", name);
+        return NULL;
+    }
+    if (map[sb.st_size - 1] != '\0') {
+        crm_err("Ignoring unterminated IPC message in shared memory object %s",
+                name);
+        munmap(map, sb.st_size);
+        return NULL;
+    }
+    *len = sb.st_size;
+    return map;
+#else
+    crm_err("Ignoring IPC message in shared memory: not supported by this build");
+    return NULL;
+#endif
+}
+
+// Remove the shared memory object of a message that will never be received
+static void
+ipc_shm_discard(struct iovec *iov)
+{
+    struct crm_ipc_response_header *header = iov[0].iov_base;
+
+    if (is_set(header->flags, crm_ipc_shm)) {
+        crm_trace("Discarding shared memory object %s",
+                  (const char *) iov[1].iov_base);
+#if SUPPORT_IPC_SHM
+        shm_unlink((const char *) iov[1].iov_base);
+#endif
+    }
+}
+
 unsigned int
 crm_ipc_default_buffer_size(void)
 {
@@ -371,9 +597,11 @@ pcmk_free_ipc_event(struct iovec *event)
     }
 }
 
+// Free an event that was never sent
 static void
 free_event(gpointer data)
 {
+    ipc_shm_discard((struct iovec *) data);
     pcmk_free_ipc_event((struct iovec *) data);
 }
 
@@ -460,6 +688,43 @@ crm_ipcs_client_pid(qb_ipcs_connection_t * c)
     return stats.client_pid;
 }
 
+/*!
+ * \internal
+ * \brief Count IPC bytes for a client in a metric
+ *
+ * \param[in] c       Client that bytes were sent to or received from
+ * \param[in] metric  Name of metric to add to
+ * \param[in] help    Description of metric
+ * \param[in] bytes   Number of bytes
+ *
+ * \note Clients are told apart by name, without any process ID that daemons
+ *       add to it, so the number of metrics does not grow without limit.
+ */
+static void
+count_ipc_bytes(crm_client_t *c, const char *metric, const char *help,
+                size_t bytes)
+{
+    char label[64];
+    const char *name = c->name;
+    size_t len = 0;
+
+    if ((name == NULL) || (*name == '\0') || isdigit((int) *name)) {
+        name = "unnamed";
+    }
+    for (; (name[len] != '\0') && (len < sizeof(label) - 1); len++) {
+        if (((name[len] == '.') || (name[len] == '-'))
+            && isdigit((int) name[len + 1])) {
+            break;
+        }
+        label[len] = name[len];
+    }
+    label[len] = '\0';
+
+    pcmk__metric_add(pcmk__metric(pcmk__metric_counter, metric, help,
+                                  "client", label),
+                     bytes);
+}
+
 xmlNode *
 crm_ipcs_recv(crm_client_t * c, void *data, size_t size, uint32_t * id, uint32_t * flags)
 {
@@ -474,6 +739,18 @@ crm_ipcs_recv(crm_client_t * c, void *data, size_t size, uint32_t * id, uint32_t
     if (flags) {
         *flags = header->flags;
     }
+    pcmk__trace_event(pcmk__trace_ipc_recv, header->qb.size, header->qb.id,
+                      c->name);
+    count_ipc_bytes(c, "ipc_received_bytes",
+                    "Bytes of IPC requests received, by client",
+                    header->qb.size);
+
+    if (is_set(header->flags, crm_ipc_accept_lz4)) {
+        c->flags |= crm_client_flag_ipc_lz4;
+    }
+    if (is_set(header->flags, crm_ipc_accept_shm)) {
+        c->flags |= crm_client_flag_ipc_shm;
+    }
 
     if (is_set(header->flags, crm_ipc_proxied)) {
         /* Mark this client as being the endpoint of a proxy connection.
@@ -489,31 +766,40 @@ crm_ipcs_recv(crm_client_t * c, void *data, size_t size, uint32_t * id, uint32_t
         return NULL;
     }
 
+    if (is_set(header->flags, crm_ipc_shm)) {
+        size_t len = 0;
+        char *map = ipc_shm_map(text, c->uid, &len);
+
+        if (map == NULL) {
+            return NULL;
+        }
+        crm_trace("Received %llu bytes in shared memory: %.200s",
+                  (unsigned long long) len, map);
+        xml = string2xml(map);
+        munmap(map, len);
+        return xml;
+    }
+
     if (header->size_compressed) {
         int rc = 0;
         unsigned int size_u = 1 + header->size_uncompressed;
-        uncompressed = calloc(1, size_u);
 
+        uncompressed = ipc_pool_reserve(&server_pool, size_u);
         crm_trace("Decompressing message data %u bytes into %u bytes",
                   header->size_compressed, size_u);
 
-        rc = BZ2_bzBuffToBuffDecompress(uncompressed, &size_u, text, header->size_compressed, 1, 0);
+        rc = ipc_decompress(header, text, uncompressed, &size_u);
         text = uncompressed;
-
-        if (rc != BZ_OK) {
-            crm_err("Decompression failed: %s " CRM_XS " bzerror=%d",
-                    bz2_strerror(rc), rc);
-            free(uncompressed);
+        if (rc != pcmk_ok) {
             return NULL;
         }
     }
 
     CRM_ASSERT(text[header->size_uncompressed - 1] == 0);
 
+    // Parse directly from the libqb (or pooled) buffer, with no copy
     crm_trace("Received %.200s", text);
     xml = string2xml(text);
-
-    free(uncompressed);
     return xml;
 }
 
@@ -633,14 +919,47 @@ crm_ipcs_flush_events(crm_client_t * c)
     return rc;
 }
 
+// Atomically raise a largest-size-seen value to a new size if it is larger
+static void
+note_biggest(volatile gint *biggest, unsigned int size)
+{
+    gint old = g_atomic_int_get(biggest);
+
+    while (((unsigned int) old < size)
+           && !g_atomic_int_compare_and_exchange(biggest, old,
+                                                 (gint) size)) {
+        old = g_atomic_int_get(biggest);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Create an I/O vector for sending an already serialized message
+ *
+ * \param[in]  request        Identifier for libqb response header
+ * \param[in]  text           Serialized message (this function takes
+ *                            ownership of it and will free it)
+ * \param[out] result         Where to store prepared I/O vector
+ * \param[in]  max_send_size  Maximum message size (or 0 for default)
+ * \param[in]  accepts        Group of crm_ipc_accept_* flags for the ways of
+ *                            sending large messages that the recipient can
+ *                            handle (otherwise bzip2 compression is used)
+ *
+ * \return Size of message on success, -errno otherwise
+ * \note Once crm_ipc_init() has been called, this may be called from a
+ *       thread other than the main one (it keeps no other state than the
+ *       largest size seen, which is updated atomically), but it may log.
+ */
 ssize_t
-crm_ipc_prepare(uint32_t request, xmlNode * message, struct iovec ** result, uint32_t max_send_size)
+pcmk__ipc_prepare_text(uint32_t request, char *text, struct iovec **result,
+                       uint32_t max_send_size, uint32_t accepts)
 {
-    static unsigned int biggest = 0;
+    static volatile gint biggest = 0;
     struct iovec *iov;
     unsigned int total = 0;
     char *compressed = NULL;
-    char *buffer = dump_xml_unformatted(message);
+    char *shm_name = NULL;
+    char *buffer = text;
     struct crm_ipc_response_header *header = calloc(1, sizeof(struct crm_ipc_response_header));
 
     CRM_ASSERT(result != NULL);
@@ -659,6 +978,12 @@ crm_ipc_prepare(uint32_t request, xmlNode * message, struct iovec ** result, uin
     iov[0].iov_base = header;
 
     header->version = PCMK_IPC_VERSION;
+#if SUPPORT_LZ4
+    header->flags |= crm_ipc_accept_lz4;
+#endif
+#if SUPPORT_IPC_SHM
+    header->flags |= crm_ipc_accept_shm;
+#endif
     header->size_uncompressed = 1 + strlen(buffer);
     total = iov[0].iov_len + header->size_uncompressed;
 
@@ -666,11 +991,29 @@ crm_ipc_prepare(uint32_t request, xmlNode * message, struct iovec ** result, uin
         iov[1].iov_base = buffer;
         iov[1].iov_len = header->size_uncompressed;
 
+    } else if (is_set(accepts, crm_ipc_accept_shm)
+               && ((shm_name = ipc_shm_create(buffer,
+                                              header->size_uncompressed)))) {
+        crm_trace("Sending %u bytes in shared memory object %s",
+                  header->size_uncompressed, shm_name);
+        header->flags |= crm_ipc_shm;
+        header->size_uncompressed = 1 + strlen(shm_name);
+        iov[1].iov_base = shm_name;
+        iov[1].iov_len = header->size_uncompressed;
+        free(buffer);
+
     } else {
         unsigned int new_size = 0;
 
-        if (crm_compress_string
-            (buffer, header->size_uncompressed, max_send_size, &compressed, &new_size)) {
+        if (is_set(accepts, crm_ipc_accept_lz4)
+            && pcmk__compress_lz4(buffer, header->size_uncompressed,
+                                      max_send_size, &compressed, &new_size)) {
+            header->flags |= crm_ipc_compressed_lz4;
+        }
+
+        if ((compressed != NULL)
+            || crm_compress_string(buffer, header->size_uncompressed,
+                                   max_send_size, &compressed, &new_size)) {
 
             header->flags |= crm_ipc_compressed;
             header->size_compressed = new_size;
@@ -680,20 +1023,21 @@ crm_ipc_prepare(uint32_t request, xmlNode * message, struct iovec ** result, uin
 
             free(buffer);
 
-            biggest = QB_MAX(header->size_compressed, biggest);
+            note_biggest(&biggest, header->size_compressed);
 
         } else {
             ssize_t rc = -EMSGSIZE;
 
-            crm_log_xml_trace(message, "EMSGSIZE");
-            biggest = QB_MAX(header->size_uncompressed, biggest);
+            note_biggest(&biggest, header->size_uncompressed);
 
             crm_err
                 ("Could not compress the message (%u bytes) into less than the configured ipc limit (%u bytes). "
                  "Set PCMK_ipc_buffer to a higher value (%u bytes suggested)",
-                 header->size_uncompressed, max_send_size, 4 * biggest);
+                 header->size_uncompressed, max_send_size,
+                 4 * (unsigned int) g_atomic_int_get(&biggest));
 
             free(compressed);
+            free(buffer);
             pcmk_free_ipc_event(iov);
             return rc;
         }
@@ -707,6 +1051,18 @@ crm_ipc_prepare(uint32_t request, xmlNode * message, struct iovec ** result, uin
     return header->qb.size;
 }
 
+ssize_t
+crm_ipc_prepare(uint32_t request, xmlNode * message, struct iovec ** result, uint32_t max_send_size)
+{
+    ssize_t rc = pcmk__ipc_prepare_text(request, dump_xml_unformatted(message),
+                                        result, max_send_size, 0);
+
+    if (rc == -EMSGSIZE) {
+        crm_log_xml_trace(message, "EMSGSIZE");
+    }
+    return rc;
+}
+
 ssize_t
 crm_ipcs_sendv(crm_client_t * c, struct iovec * iov, enum crm_ipc_flags flags)
 {
@@ -724,7 +1080,12 @@ crm_ipcs_sendv(crm_client_t * c, struct iovec * iov, enum crm_ipc_flags flags)
         }
     }
 
-    header->flags |= flags;
+    header->flags |= (flags & ~pcmk__ipc_transport_flags);
+    pcmk__trace_event(pcmk__trace_ipc_send, header->qb.size,
+                      ((flags & crm_ipc_server_event)? 0 : header->qb.id),
+                      c->name);
+    count_ipc_bytes(c, "ipc_sent_bytes", "Bytes of IPC messages sent, by client",
+                    header->qb.size);
     if (flags & crm_ipc_server_event) {
         header->qb.id = id++;   /* We don't really use it, but doesn't hurt to set one */
 
@@ -752,6 +1113,7 @@ crm_ipcs_sendv(crm_client_t * c, struct iovec * iov, enum crm_ipc_flags flags)
 
         rc = qb_ipcs_response_sendv(c->ipcs, iov, 2);
         if (rc < header->qb.size) {
+            ipc_shm_discard(iov);
             crm_notice("Response %d to pid %d failed: %s "
                        CRM_XS " bytes=%u rc=%lld ipcs=%p",
                        header->qb.id, c->pid, pcmk_strerror(rc),
@@ -780,19 +1142,67 @@ crm_ipcs_sendv(crm_client_t * c, struct iovec * iov, enum crm_ipc_flags flags)
     return rc;
 }
 
+/*!
+ * \internal
+ * \brief Get the ways of sending large messages that a client can handle
+ *
+ * \param[in] c  Client to check
+ *
+ * \return Group of crm_ipc_accept_* flags suitable for pcmk__ipc_prepare_text()
+ */
+uint32_t
+pcmk__ipc_client_accepts(crm_client_t *c)
+{
+    uint32_t accepts = 0;
+
+    if (is_set(c->flags, crm_client_flag_ipc_lz4)) {
+        accepts |= crm_ipc_accept_lz4;
+    }
+    if (is_set(c->flags, crm_client_flag_ipc_shm)
+        && ((c->uid == 0) || (c->uid == geteuid()))) {
+        accepts |= crm_ipc_accept_shm;
+    }
+    return accepts;
+}
+
 ssize_t
 crm_ipcs_send(crm_client_t * c, uint32_t request, xmlNode * message,
               enum crm_ipc_flags flags)
+{
+    if(c == NULL) {
+        return -EDESTADDRREQ;
+    }
+    return pcmk__ipcs_send_text(c, request, dump_xml_unformatted(message),
+                                flags);
+}
+
+/*!
+ * \internal
+ * \brief Send an already serialized message to an IPC client
+ *
+ * \param[in] c        Client to send message to
+ * \param[in] request  Identifier for libqb response header
+ * \param[in] text     Serialized message (this function takes ownership of it
+ *                     and will free it)
+ * \param[in] flags    Group of crm_ipc_flags to send with message
+ *
+ * \return Bytes sent or queued on success, -errno otherwise
+ */
+ssize_t
+pcmk__ipcs_send_text(crm_client_t *c, uint32_t request, char *text,
+                     enum crm_ipc_flags flags)
 {
     struct iovec *iov = NULL;
     ssize_t rc = 0;
 
-    if(c == NULL) {
+    if (c == NULL) {
+        free(text);
         return -EDESTADDRREQ;
     }
     crm_ipc_init();
 
-    rc = crm_ipc_prepare(request, message, &iov, ipc_buffer_max);
+    rc = pcmk__ipc_prepare_text(request, text, &iov, ipc_buffer_max,
+                                pcmk__ipc_client_accepts(c));
     if (rc > 0) {
         rc = crm_ipcs_sendv(c, iov, flags | crm_ipc_server_free);
     } else {
@@ -803,6 +1213,103 @@ crm_ipcs_send(crm_client_t * c, uint32_t request, xmlNode * message,
     return rc;
 }
 
+/*!
+ * \internal
+ * \brief Serialize a message once for sending to many clients
+ *
+ * \param[in] message  Message to serialize
+ *
+ * \return Newly allocated fan-out (free with pcmk__fanout_free()), or NULL if
+ *         \p message could not be serialized
+ */
+pcmk__fanout_t *
+pcmk__fanout_new(xmlNode *message)
+{
+    pcmk__fanout_t *fanout = NULL;
+    char *text = dump_xml_unformatted(message);
+
+    if (text == NULL) {
+        return NULL;
+    }
+    fanout = calloc(1, sizeof(pcmk__fanout_t));
+    CRM_ASSERT(fanout != NULL);
+    fanout->text = text;
+    return fanout;
+}
+
+/*!
+ * \internal
+ * \brief Free a message serialized for sending to many clients
+ *
+ * \param[in] fanout  Fan-out to free
+ */
+void
+pcmk__fanout_free(pcmk__fanout_t *fanout)
+{
+    if (fanout != NULL) {
+        pcmk_free_ipc_event(fanout->ipc[0]);
+        pcmk_free_ipc_event(fanout->ipc[1]);
+        free(fanout->remote_lz4);
+        free(fanout->text);
+        free(fanout);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Send a message serialized once to an IPC client as an event
+ *
+ * The message is prepared (and compressed if needed) only for the first client
+ * that accepts the same ways of sending large messages, and copied to later
+ * ones. A message that needs shared memory is prepared for each client,
+ * because each client releases the shared memory object it is sent.
+ *
+ * \param[in]     c       Client to send message to
+ * \param[in,out] fanout  Serialized message
+ * \param[in]     flags   Group of crm_ipc_flags to send with message
+ *
+ * \return Bytes sent or queued on success, -errno otherwise
+ */
+ssize_t
+pcmk__ipcs_send_fanout(crm_client_t *c, pcmk__fanout_t *fanout,
+                       enum crm_ipc_flags flags)
+{
+    struct iovec **iov = NULL;
+    uint32_t accepts = 0;
+    ssize_t rc = 0;
+
+    if (c == NULL) {
+        return -EDESTADDRREQ;
+    }
+    crm_ipc_init();
+
+    accepts = pcmk__ipc_client_accepts(c);
+    iov = &(fanout->ipc[is_set(accepts, crm_ipc_accept_lz4)? 1 : 0]);
+
+    if (*iov == NULL) {
+        rc = pcmk__ipc_prepare_text(0, strdup(fanout->text), iov,
+                                    ipc_buffer_max,
+                                    accepts & ~crm_ipc_accept_shm);
+        if ((rc == -EMSGSIZE) && is_set(accepts, crm_ipc_accept_shm)) {
+            // Too big to share, but this client can take shared memory
+            struct iovec *own = NULL;
+
+            rc = pcmk__ipc_prepare_text(0, strdup(fanout->text), &own,
+                                        ipc_buffer_max, accepts);
+            if (rc > 0) {
+                return crm_ipcs_sendv(c, own, flags | crm_ipc_server_free);
+            }
+            pcmk_free_ipc_event(own);
+        }
+        if (rc < 0) {
+            crm_notice("Message to pid %d failed: %s " CRM_XS " rc=%lld ipcs=%p",
+                       c->pid, pcmk_strerror(rc), (long long) rc, c->ipcs);
+            return rc;
+        }
+    }
+    return crm_ipcs_sendv(c, *iov, flags & ~crm_ipc_server_free);
+}
+
 void
 crm_ipcs_send_ack(crm_client_t * c, uint32_t request, uint32_t flags, const char *tag, const char *function,
                   int line)
@@ -836,10 +1343,37 @@ struct crm_ipc_s {
     char *buffer;
     char *name;
 
+    /* buffer that compressed messages are decompressed into, and which is then
+     * swapped with 'buffer'
+     */
+    struct ipc_pool_s spare;
+
+    /* crm_ipc_accept_* flags for what we may send to the server */
+    uint32_t server_accepts;
+
+    /* server process's user, if known (for shared memory messages) */
+    bool server_uid_known;
+    uid_t server_uid;
+
+    /* mapping of last message received in shared memory, if any */
+    char *shm_map;
+    size_t shm_len;
+
     qb_ipcc_connection_t *ipc;
 
 };
 
+// Unmap the last message received in shared memory, if any
+static void
+ipc_shm_release(crm_ipc_t *client)
+{
+    if (client->shm_map != NULL) {
+        munmap(client->shm_map, client->shm_len);
+        client->shm_map = NULL;
+        client->shm_len = 0;
+    }
+}
+
 static unsigned int
 pick_ipc_buffer(unsigned int max)
 {
@@ -908,6 +1442,18 @@ crm_ipc_connect(crm_ipc_t * client)
 
     qb_ipcc_context_set(client->ipc, client);
 
+#if SUPPORT_IPC_SHM
+    {
+        struct ucred cred;
+        socklen_t cred_len = sizeof(cred);
+
+        client->server_uid_known =
+            (getsockopt(client->pfd.fd, SOL_SOCKET, SO_PEERCRED, &cred,
+                        &cred_len) == 0);
+        client->server_uid = cred.uid;
+    }
+#endif
+
 #ifdef HAVE_IPCS_GET_BUFFER_SIZE
     client->max_buf_size = qb_ipcc_get_buffer_size(client->ipc);
     if (client->max_buf_size > client->buf_size) {
@@ -952,7 +1498,9 @@ crm_ipc_destroy(crm_ipc_t * client)
             /* crm_ipc_close(client); */
         }
         crm_trace("Destroying IPC connection to %s: %p", client->name, client);
+        ipc_shm_release(client);
         free(client->buffer);
+        free(client->spare.buf);
         free(client->name);
         free(client);
     }
@@ -1025,24 +1573,40 @@ crm_ipc_decompress(crm_ipc_t * client)
 {
     struct crm_ipc_response_header *header = (struct crm_ipc_response_header *)(void*)client->buffer;
 
+    ipc_shm_release(client);
+
+    if (is_set(header->flags, crm_ipc_accept_lz4)) {
+        client->server_accepts |= crm_ipc_accept_lz4;
+    }
+    if (is_set(header->flags, crm_ipc_accept_shm) && client->server_uid_known
+        && ((client->server_uid == 0) || (client->server_uid == geteuid()))) {
+        client->server_accepts |= crm_ipc_accept_shm;
+    }
+
+    if (is_set(header->flags, crm_ipc_shm)) {
+        if (!client->server_uid_known) {
+            crm_err("Ignoring IPC message in shared memory from unknown user");
+            return -EBADMSG;
+        }
+        client->shm_map = ipc_shm_map(client->buffer + hdr_offset,
+                                      client->server_uid, &(client->shm_len));
+        return (client->shm_map == NULL)? -EBADMSG : pcmk_ok;
+    }
+
     if (header->size_compressed) {
         int rc = 0;
         unsigned int size_u = 1 + header->size_uncompressed;
         /* never let buf size fall below our max size required for ipc reads. */
         unsigned int new_buf_size = QB_MAX((hdr_offset + size_u), client->max_buf_size);
-        char *uncompressed = calloc(1, new_buf_size);
+        char *uncompressed = ipc_pool_reserve(&(client->spare), new_buf_size);
 
         crm_trace("Decompressing message data %u bytes into %u bytes",
                  header->size_compressed, size_u);
 
-        rc = BZ2_bzBuffToBuffDecompress(uncompressed + hdr_offset, &size_u,
-                                        client->buffer + hdr_offset, header->size_compressed, 1, 0);
-
-        if (rc != BZ_OK) {
-            crm_err("Decompression failed: %s " CRM_XS " bzerror=%d",
-                    bz2_strerror(rc), rc);
-            free(uncompressed);
-            return -EILSEQ;
+        rc = ipc_decompress(header, client->buffer + hdr_offset,
+                            uncompressed + hdr_offset, &size_u);
+        if (rc != pcmk_ok) {
+            return rc;
         }
 
         /*
@@ -1058,7 +1622,10 @@ crm_ipc_decompress(crm_ipc_t * client)
         memcpy(uncompressed, client->buffer, hdr_offset);       /* Preserve the header */
         header = (struct crm_ipc_response_header *)(void*)uncompressed;
 
-        free(client->buffer);
+        // Keep the old buffer for decompressing the next compressed message
+        new_buf_size = client->spare.size;
+        client->spare.buf = client->buffer;
+        client->spare.size = client->buf_size;
         client->buf_size = new_buf_size;
         client->buffer = uncompressed;
     }
@@ -1107,7 +1674,9 @@ crm_ipc_read(crm_ipc_t * client)
         crm_err("Connection to %s failed", client->name);
     }
 
-    if (header) {
+    if (client->shm_map != NULL) {
+        return client->shm_len;
+    } else if (header) {
         /* Data excluding the header */
         return header->size_uncompressed;
     }
@@ -1118,6 +1687,9 @@ const char *
 crm_ipc_buffer(crm_ipc_t * client)
 {
     CRM_ASSERT(client != NULL);
+    if (client->shm_map != NULL) {
+        return client->shm_map;
+    }
     return client->buffer + sizeof(struct crm_ipc_response_header);
 }
 
@@ -1154,50 +1726,81 @@ internal_ipc_send_recv(crm_ipc_t * client, const void *iov)
     return rc;
 }
 
+// Milliseconds left until a monotonic deadline (in microseconds)
 static int
-internal_ipc_send_request(crm_ipc_t * client, const void *iov, int ms_timeout)
+ipc_ms_remaining(gint64 deadline)
 {
-    int rc = 0;
-    time_t timeout = time(NULL) + 1 + (ms_timeout / 1000);
+    gint64 remaining = deadline - g_get_monotonic_time();
 
-    do {
-        rc = qb_ipcc_sendv(client->ipc, iov, 2);
-    } while (rc == -EAGAIN && time(NULL) < timeout && crm_ipc_connected(client));
+    return (remaining > 0)? (int) ((remaining + 999) / 1000) : 0;
+}
 
+static int
+internal_ipc_send_request(crm_ipc_t * client, const void *iov, int ms_timeout)
+{
+    int rc = 0;
+    gulong delay_us = 1000;
+    gint64 deadline = g_get_monotonic_time()
+                      + (gint64) QB_MAX(ms_timeout, 1000) * 1000;
+
+    /* The server's queue is full. There is nothing to wait on for it to have
+     * room, so back off rather than retrying as fast as possible.
+     */
+    while (((rc = qb_ipcc_sendv(client->ipc, iov, 2)) == -EAGAIN)
+           && (ipc_ms_remaining(deadline) > 0) && crm_ipc_connected(client)) {
+        g_usleep(delay_us);
+        delay_us = QB_MIN(2 * delay_us, 100000);
+    }
     return rc;
 }
 
+/*!
+ * \internal
+ * \brief Wait for the reply to a request
+ *
+ * Replies arrive in the order their requests were sent, so a reply with an
+ * earlier ID is a late reply to a request that timed out, and is discarded.
+ * Each receive waits (without polling) for as long as is left of the timeout.
+ *
+ * \param[in] client      Connection the request was sent on
+ * \param[in] request_id  ID of request to wait for reply to
+ * \param[in] ms_timeout  How long to wait in total
+ *
+ * \return Size of reply received, -ETIMEDOUT if none in time, or other -errno
+ */
 static int
 internal_ipc_get_reply(crm_ipc_t * client, int request_id, int ms_timeout)
 {
-    time_t timeout = time(NULL) + 1 + (ms_timeout / 1000);
-    int rc = 0;
+    gint64 deadline = g_get_monotonic_time() + (gint64) ms_timeout * 1000;
+    int rc = -ETIMEDOUT;
 
     crm_ipc_init();
 
     /* get the reply */
     crm_trace("client %s waiting on reply to msg id %d", client->name, request_id);
-    do {
+    while (ipc_ms_remaining(deadline) > 0) {
 
-        rc = qb_ipcc_recv(client->ipc, client->buffer, client->buf_size, 1000);
+        rc = qb_ipcc_recv(client->ipc, client->buffer, client->buf_size,
+                          ipc_ms_remaining(deadline));
         if (rc > 0) {
             struct crm_ipc_response_header *hdr = NULL;
 
-            int rc = crm_ipc_decompress(client);
+            int decompress_rc = crm_ipc_decompress(client);
 
-            if (rc != pcmk_ok) {
-                return rc;
+            if (decompress_rc != pcmk_ok) {
+                return decompress_rc;
             }
 
             hdr = (struct crm_ipc_response_header *)(void*)client->buffer;
             if (hdr->qb.id == request_id) {
-                /* Got it */
-                break;
-            } else if (hdr->qb.id < request_id) {
-                xmlNode *bad = string2xml(crm_ipc_buffer(client));
+                /* Got it, and any reply still pending must have come first */
+                client->need_reply = FALSE;
+                return rc;
 
-                crm_err("Discarding old reply %d (need %d)", hdr->qb.id, request_id);
-                crm_log_xml_notice(bad, "OldIpcReply");
+            } else if (hdr->qb.id < request_id) {
+                crm_info("Discarding late reply %d from %s (need %d)",
+                         hdr->qb.id, client->name, request_id);
+                crm_trace("Late reply: %.200s", crm_ipc_buffer(client));
 
             } else {
                 xmlNode *bad = string2xml(crm_ipc_buffer(client));
@@ -1206,13 +1809,17 @@ internal_ipc_get_reply(crm_ipc_t * client, int request_id, int ms_timeout)
                 crm_log_xml_notice(bad, "ImpossibleReply");
                 CRM_ASSERT(hdr->qb.id <= request_id);
             }
+            rc = -ETIMEDOUT;
+
         } else if (crm_ipc_connected(client) == FALSE) {
             crm_err("Server disconnected client %s while waiting for msg id %d", client->name,
                     request_id);
             break;
-        }
 
-    } while (time(NULL) < timeout);
+        } else if ((rc != -EAGAIN) && (rc != -ETIMEDOUT)) {
+            break;
+        }
+    }
 
     return rc;
 }
@@ -1243,7 +1850,15 @@ crm_ipc_send(crm_ipc_t * client, xmlNode * message, enum crm_ipc_flags flags, in
         ms_timeout = 5000;
     }
 
-    if (client->need_reply) {
+    /* If an earlier request timed out, its reply may still arrive. A reply
+     * waited for by ID can be told apart from it, but a blocking send and
+     * receive cannot, so that must wait for the late reply first.
+     */
+    if (client->need_reply && (ms_timeout > 0)) {
+        crm_trace("Reply from %s still pending, will discard it if it arrives",
+                  client->name);
+
+    } else if (client->need_reply) {
         crm_trace("Trying again to obtain pending reply from %s", client->name);
         rc = qb_ipcc_recv(client->ipc, client->buffer, client->buf_size, ms_timeout);
         if (rc < 0) {
@@ -1260,13 +1875,18 @@ crm_ipc_send(crm_ipc_t * client, xmlNode * message, enum crm_ipc_flags flags, in
 
     id++;
     CRM_LOG_ASSERT(id != 0); /* Crude wrap-around detection */
-    rc = crm_ipc_prepare(id, message, &iov, client->max_buf_size);
+    rc = pcmk__ipc_prepare_text(id, dump_xml_unformatted(message), &iov,
+                                client->max_buf_size, client->server_accepts);
     if(rc < 0) {
         return rc;
     }
 
     header = iov[0].iov_base;
-    header->flags |= flags;
+    header->flags |= (flags & ~pcmk__ipc_transport_flags);
+    if (!client->server_uid_known) {
+        // We couldn't check the owner of shared memory from the server
+        clear_bit(header->flags, crm_ipc_accept_shm);
+    }
 
     if(is_set(flags, crm_ipc_proxied)) {
         /* Don't look for a synchronous response */
@@ -1292,6 +1912,7 @@ crm_ipc_send(crm_ipc_t * client, xmlNode * message, enum crm_ipc_flags flags, in
         if (rc <= 0) {
             crm_trace("Failed to send from client %s request %d with %u bytes...",
                       client->name, header->qb.id, header->qb.size);
+            ipc_shm_discard(iov);
             goto send_cleanup;
 
         } else if (is_not_set(flags, crm_ipc_client_response)) {
@@ -1315,6 +1936,16 @@ crm_ipc_send(crm_ipc_t * client, xmlNode * message, enum crm_ipc_flags flags, in
 
     } else {
         rc = internal_ipc_send_recv(client, iov);
+        if (rc <= 0) {
+            ipc_shm_discard(iov);
+
+        } else {
+            int decompress_rc = crm_ipc_decompress(client);
+
+            if (decompress_rc != pcmk_ok) {
+                rc = decompress_rc;
+            }
+        }
     }
 
     if (rc > 0) {
@@ -1351,6 +1982,44 @@ crm_ipc_send(crm_ipc_t * client, xmlNode * message, enum crm_ipc_flags flags, in
 
 /* Utils */
 
+/*!
+ * \internal
+ * \brief Tell pacemakerd that this daemon is ready to accept connections
+ *
+ * pacemakerd passes this on to its clients, so daemons that depend on this one
+ * can connect as soon as it is ready rather than retrying on a timer.
+ *
+ * \param[in] proc  This daemon's process flag (crm_proc_*), by which
+ *                  pacemakerd identifies it
+ *
+ * \note This is best effort. Nothing is sent if pacemakerd is not running
+ *       (for example, if the daemon was started by hand).
+ */
+void
+pcmk__notify_ready(uint32_t proc)
+{
+    crm_ipc_t *mcp = crm_ipc_new(CRM_SYSTEM_MCP, 0);
+
+    if (mcp == NULL) {
+        return;
+    }
+    if (crm_ipc_connect(mcp)) {
+        xmlNode *msg = create_request(CRM_OP_DAEMON_READY, NULL, NULL,
+                                      CRM_SYSTEM_MCP, crm_system_name, NULL);
+
+        crm_xml_add_int(msg, F_CRM_PROC, (int) proc);
+        crm_ipc_send(mcp, msg, 0, 0, NULL);
+        free_xml(msg);
+        crm_ipc_close(mcp);
+        crm_trace("Notified pacemakerd that %s is ready", crm_system_name);
+
+    } else {
+        crm_debug("Could not notify pacemakerd that %s is ready",
+                  crm_system_name);
+    }
+    crm_ipc_destroy(mcp);
+}
+
 xmlNode *
 create_hello_message(const char *uuid,
                      const char *client_name, const char *major_version, const char *minor_version)
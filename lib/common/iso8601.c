@@ -255,38 +255,43 @@ crm_time_get_timezone(crm_time_t * dt, uint * h, uint * m)
     return crm_time_get_sec(dt->seconds, h, m, &s);
 }
 
-long long
-crm_time_get_seconds(crm_time_t * dt)
+// Number of days in the years before a given one (since the year 1)
+static long long
+days_before_year(int year)
 {
-    int lpc;
-    crm_time_t *utc = NULL;
-    long long in_seconds = 0;
-
-    utc = crm_get_utc_time(dt);
-
-    for (lpc = 1; lpc < utc->years; lpc++) {
-        int dmax = year_days(lpc);
+    long long y = year - 1;
 
-        in_seconds += 60 * 60 * 24 * dmax;
+    if (y <= 0) {
+        return 0;
     }
+    return (365 * y) + (y / 4) - (y / 100) + (y / 400);
+}
+
+/* Date-based rules compare and convert times for every expression they
+ * evaluate, so this is done arithmetically on the time as it is, rather than
+ * by normalizing a UTC copy and counting through the years. Subtracting the
+ * offset from the total gives the same result as normalizing first would.
+ */
+long long
+crm_time_get_seconds(crm_time_t * dt)
+{
+    long long in_seconds = 60LL * 60 * 24 * days_before_year(dt->years);
 
-    /* utc->months is an offset that can only be set for a duration
+    /* dt->months is an offset that can only be set for a duration
      * By definiton, the value is variable depending on the date to
      * which it is applied
      *
      * Force 30-day months so that something vaguely sane happens
      * for anyone that tries to use a month in this way
      */
-    if (utc->months > 0) {
-        in_seconds += 60 * 60 * 24 * 30 * utc->months;
+    if ((dt->offset == 0) && (dt->months > 0)) {
+        in_seconds += 60LL * 60 * 24 * 30 * dt->months;
     }
 
-    if (utc->days > 0) {
-        in_seconds += 60 * 60 * 24 * (utc->days - 1);
+    if (dt->days > 0) {
+        in_seconds += 60LL * 60 * 24 * (dt->days - 1);
     }
-    in_seconds += utc->seconds;
-
-    crm_time_free(utc);
+    in_seconds += dt->seconds - dt->offset;
     return in_seconds;
 }
 
@@ -1150,6 +1155,13 @@ crm_time_compare(crm_time_t * a, crm_time_t * b)
         return 1;
     }
 
+    if (!a->duration && !b->duration) {
+        long long a_seconds = crm_time_get_seconds(a);
+        long long b_seconds = crm_time_get_seconds(b);
+
+        return (a_seconds > b_seconds) - (a_seconds < b_seconds);
+    }
+
     t1 = crm_get_utc_time(a);
     t2 = crm_get_utc_time(b);
 
@@ -1170,19 +1182,19 @@ crm_time_add_seconds(crm_time_t * a_time, int extra)
 
     crm_trace("Adding %d seconds to %d (max=%d)", extra, a_time->seconds, seconds);
 
-    a_time->seconds += extra;
-    while (a_time->seconds >= seconds) {
-        a_time->seconds -= seconds;
-        days++;
-    }
-
-    while (a_time->seconds < 0) {
+    days = extra / seconds;
+    a_time->seconds += extra % seconds;
+    days += a_time->seconds / seconds;
+    a_time->seconds %= seconds;
+    if (a_time->seconds < 0) {
         a_time->seconds += seconds;
         days--;
     }
     crm_time_add_days(a_time, days);
 }
 
+#define DAYS_PER_400_YEARS 146097
+
 void
 crm_time_add_days(crm_time_t * a_time, int extra)
 {
@@ -1191,6 +1203,10 @@ crm_time_add_days(crm_time_t * a_time, int extra)
 
     crm_trace("Adding %d days to %.4d-%.3d", extra, a_time->years, a_time->days);
 
+    // Every 400 years have the same number of days, so skip those at once
+    a_time->years += 400 * (extra / DAYS_PER_400_YEARS);
+    extra %= DAYS_PER_400_YEARS;
+
     a_time->days += extra;
     while (a_time->days > ydays) {
         a_time->years++;
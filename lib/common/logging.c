@@ -98,6 +98,9 @@ crm_trigger_blackbox(int nsig)
         crm_enable_blackbox(nsig);
     }
     crm_write_blackbox(nsig, NULL);
+    if (nsig == SIGTRAP) {
+        pcmk__trace_dump();
+    }
 }
 
 const char *
@@ -327,10 +330,12 @@ crm_add_logfile(const char *filename)
     } else if(default_fd >= 0) {
         crm_notice("Switching to %s", filename);
         qb_log_ctl(default_fd, QB_LOG_CONF_ENABLED, QB_FALSE);
+        pcmk__log_async_remove(default_fd);
     }
 
     crm_notice("Additional logging available in %s", filename);
     qb_log_ctl(fd, QB_LOG_CONF_ENABLED, QB_TRUE);
+    pcmk__log_async_add(fd, filename);
     /* qb_log_ctl(fd, QB_LOG_CONF_FILE_SYNC, 1);  Turn on synchronous writes */
 
 #ifdef HAVE_qb_log_conf_QB_LOG_CONF_MAX_LINE_LEN
@@ -500,6 +505,9 @@ crm_log_filter_source(int source, const char *trace_files, const char *trace_fns
                       const char *trace_fmts, const char *trace_tags, const char *trace_blackbox,
                       struct qb_log_callsite *cs)
 {
+    // A log writer target is filtered like the target it replaced
+    int32_t replaced = pcmk__log_async_real(source);
+
     if (qb_log_ctl(source, QB_LOG_CONF_STATE_GET, 0) != QB_LOG_STATE_ENABLED) {
         return;
     } else if (cs->tags != crm_trace_nonlog && source == QB_LOG_BLACKBOX) {
@@ -520,7 +528,8 @@ crm_log_filter_source(int source, const char *trace_files, const char *trace_fns
             free(key);
         }
 
-    } else if (source == QB_LOG_SYSLOG) {       /* No tracing to syslog */
+    } else if ((source == QB_LOG_SYSLOG) || (replaced == QB_LOG_SYSLOG)) {
+        /* No tracing to syslog */
         if (cs->priority <= crm_log_priority && cs->priority <= crm_log_level) {
             qb_bit_set(cs->targets, source);
         }
@@ -820,6 +829,10 @@ crm_log_init(const char *entity, uint8_t level, gboolean daemon, gboolean to_std
     }
     crm_enable_stderr(to_stderr);
 
+    if (crm_is_daemon) {
+        pcmk__log_async_init();
+    }
+
     /* Should we log to a file */
     if (safe_str_eq("none", logfile)) {
         /* No soup^Hlogs for you! */
@@ -833,6 +846,11 @@ crm_log_init(const char *entity, uint8_t level, gboolean daemon, gboolean to_std
     if (crm_is_daemon && daemon_option_enabled(crm_system_name, "blackbox")) {
         crm_enable_blackbox(0);
     }
+    if (crm_is_daemon) {
+        pcmk__trace_init();
+        pcmk__metrics_init();
+        pcmk__lock_daemon_memory(crm_system_name);
+    }
 
     /* Summary */
     crm_trace("Quiet: %d, facility %s", quiet, f_copy);
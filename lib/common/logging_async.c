@@ -0,0 +1,389 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU Lesser General Public License
+ * version 2.1 or later (LGPLv2.1+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <qb/qblog.h>
+
+#include <crm/crm.h>
+#include <crm/common/internal.h>
+
+/*
+ * Asynchronous logging
+ *
+ * libqb writes each message to syslog and the log files from the thread that
+ * logged it, so a slow disk or a stalled syslog daemon stalls whatever the
+ * daemon was doing, down to IPC with its clients. libqb's own threaded mode
+ * cannot be used, since its writer thread does not survive the forks done to
+ * run agents.
+ *
+ * If PCMK_log_async is true, daemons instead replace syslog and each log file
+ * with a libqb custom target of their own. That target formats the message
+ * exactly as the target it replaces would, and queues it for a writer thread.
+ * The logging thread never waits for I/O: if PCMK_log_async_queue messages are
+ * already waiting, the message is counted and dropped, and the writer logs how
+ * many were lost once it catches up.
+ *
+ * A forked child has no writer thread, so it writes its messages itself until
+ * it execs. Messages still queued when the daemon exits are written first, for
+ * up to a couple of seconds.
+ */
+
+#define LOG_ASYNC_QUEUE_DEFAULT 8192
+#define LOG_ASYNC_LINE_MAX 4096
+#define LOG_ASYNC_DRAIN_MS 2000
+
+#if GLIB_CHECK_VERSION(2, 32, 0) && defined(HAVE_QB_LOG_TARGET_FORMAT)
+
+struct async_target_s {
+    int32_t real;           // target being replaced (-1 if slot is unused)
+    int fd;                 // for log files, our own descriptor for the file
+};
+
+struct async_line_s {
+    int32_t shadow;         // our target that the line was logged to
+    int priority;
+    char text[];
+};
+
+static struct async_target_s async_targets[QB_LOG_TARGET_MAX];
+static GAsyncQueue *async_queue = NULL;
+static GThread *async_writer = NULL;
+static volatile gint async_queued = 0;
+static volatile gint async_dropped = 0;
+static gint async_queue_max = LOG_ASYNC_QUEUE_DEFAULT;
+static bool async_direct = FALSE;       // in a forked child
+static bool async_stopping = FALSE;
+
+// Sentinel, telling the writer to stop
+static struct async_line_s async_stop_line = { -1, 0 };
+
+static void
+write_line(int32_t shadow, int priority, const char *text)
+{
+    const struct async_target_s *target = &async_targets[shadow];
+
+    if (target->real == QB_LOG_SYSLOG) {
+        syslog(priority, "%s", text);
+
+    } else if (target->fd >= 0) {
+        struct iovec iov[2];
+
+        iov[0].iov_base = (void *) text;
+        iov[0].iov_len = strlen(text);
+        iov[1].iov_base = (void *) "\n";
+        iov[1].iov_len = 1;
+        while ((writev(target->fd, iov, 2) < 0) && (errno == EINTR));
+    }
+}
+
+static void
+report_dropped(int32_t shadow)
+{
+    gint dropped = g_atomic_int_get(&async_dropped);
+
+    while ((dropped > 0)
+           && !g_atomic_int_compare_and_exchange(&async_dropped, dropped, 0)) {
+        dropped = g_atomic_int_get(&async_dropped);
+    }
+    if (dropped > 0) {
+        char *text = crm_strdup_printf("%s[%lu]: Dropped %d log messages "
+                                       "because the log writer fell behind",
+                                       crm_system_name,
+                                       (unsigned long) getpid(), dropped);
+
+        write_line(shadow, LOG_WARNING, text);
+        free(text);
+    }
+}
+
+static gpointer
+async_writer_thread(gpointer user_data)
+{
+    while (TRUE) {
+        struct async_line_s *line = g_async_queue_pop(async_queue);
+
+        if (line == &async_stop_line) {
+            break;
+        }
+        g_atomic_int_add(&async_queued, -1);
+        report_dropped(line->shadow);
+        write_line(line->shadow, line->priority, line->text);
+        free(line);
+    }
+    return NULL;
+}
+
+static void
+async_logger(int32_t shadow, struct qb_log_callsite *cs, time_t timestamp,
+             const char *msg)
+{
+    char text[LOG_ASYNC_LINE_MAX];
+    struct async_line_s *line = NULL;
+    size_t len = 0;
+
+    if ((shadow < 0) || (shadow >= QB_LOG_TARGET_MAX)
+        || (async_targets[shadow].real < 0)) {
+        return;
+    }
+
+    text[0] = '\0';
+    qb_log_target_format(async_targets[shadow].real, cs, timestamp, msg, text);
+    text[LOG_ASYNC_LINE_MAX - 1] = '\0';
+
+    if (async_direct || async_stopping) {
+        write_line(shadow, cs->priority, text);
+        return;
+    }
+
+    if (g_atomic_int_add(&async_queued, 1) >= async_queue_max) {
+        g_atomic_int_add(&async_queued, -1);
+        g_atomic_int_inc(&async_dropped);
+        return;
+    }
+
+    len = strlen(text);
+    line = malloc(sizeof(struct async_line_s) + len + 1);
+    if (line == NULL) {
+        g_atomic_int_add(&async_queued, -1);
+        g_atomic_int_inc(&async_dropped);
+        return;
+    }
+    line->shadow = shadow;
+    line->priority = cs->priority;
+    memcpy(line->text, text, len + 1);
+    g_async_queue_push(async_queue, line);
+}
+
+static void
+async_child_after_fork(void)
+{
+    /* The writer thread (and any lock it held) did not come along, so write
+     * messages directly, and leave whatever is queued for the parent
+     */
+    async_direct = TRUE;
+}
+
+static int32_t
+async_shadow_of(int32_t real)
+{
+    for (int32_t lpc = 0; lpc < QB_LOG_TARGET_MAX; lpc++) {
+        if (async_targets[lpc].real == real) {
+            return lpc;
+        }
+    }
+    return -1;
+}
+
+/*!
+ * \internal
+ * \brief Start the log writer thread if PCMK_log_async is true
+ *
+ * \note This replaces syslog if it is enabled. Log files are replaced as they
+ *       are added, by pcmk__log_async_add().
+ */
+void
+pcmk__log_async_init(void)
+{
+    const char *value = daemon_option("log_async");
+    int limit = 0;
+
+    if ((async_queue != NULL) || (value == NULL) || !crm_is_true(value)) {
+        return;
+    }
+
+    for (int lpc = 0; lpc < QB_LOG_TARGET_MAX; lpc++) {
+        async_targets[lpc].real = -1;
+        async_targets[lpc].fd = -1;
+    }
+
+    limit = crm_parse_int(daemon_option("log_async_queue"), "0");
+    if (limit > 0) {
+        async_queue_max = limit;
+    }
+
+    async_queue = g_async_queue_new();
+    async_writer = g_thread_try_new("log-writer", async_writer_thread, NULL,
+                                    NULL);
+    if (async_writer == NULL) {
+        g_async_queue_unref(async_queue);
+        async_queue = NULL;
+        crm_warn("Logging synchronously: could not start log writer thread");
+        return;
+    }
+    pthread_atfork(NULL, NULL, async_child_after_fork);
+
+    if (qb_log_ctl(QB_LOG_SYSLOG, QB_LOG_CONF_STATE_GET, 0)
+        == QB_LOG_STATE_ENABLED) {
+        pcmk__log_async_add(QB_LOG_SYSLOG, NULL);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Replace a libqb log target with one written by the log writer
+ *
+ * \param[in] real      Target to replace (which must be enabled)
+ * \param[in] filename  File that \p real writes to (or NULL for syslog)
+ *
+ * \note This does nothing unless pcmk__log_async_init() started a writer.
+ */
+void
+pcmk__log_async_add(int32_t real, const char *filename)
+{
+    int32_t shadow = -1;
+    int fd = -1;
+
+    if ((async_queue == NULL) || (async_shadow_of(real) >= 0)) {
+        return;
+    }
+
+    if (filename != NULL) {
+        fd = open(filename, O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0660);
+        if (fd < 0) {
+            crm_warn("Logging to %s synchronously: %s",
+                     filename, pcmk_strerror(errno));
+            return;
+        }
+    }
+
+    shadow = qb_log_custom_open(async_logger, NULL, NULL, NULL);
+    if ((shadow < 0) || (shadow >= QB_LOG_TARGET_MAX)) {
+        crm_warn("Logging to %s synchronously: %s",
+                 (filename? filename : "syslog"), pcmk_strerror(-shadow));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    async_targets[shadow].real = real;
+    async_targets[shadow].fd = fd;
+
+    qb_log_ctl(shadow, QB_LOG_CONF_ENABLED, QB_TRUE);
+    qb_log_ctl(real, QB_LOG_CONF_ENABLED, QB_FALSE);
+    if (real == QB_LOG_SYSLOG) {
+        // Disabling libqb's syslog target closed its connection
+        openlog(crm_system_name, LOG_PID|LOG_NDELAY,
+                qb_log_facility2int(daemon_option("logfacility")));
+    }
+    crm_update_callsites();
+    crm_debug("Logging to %s asynchronously", (filename? filename : "syslog"));
+}
+
+/*!
+ * \internal
+ * \brief Stop writing a log target's messages (if the log writer writes them)
+ *
+ * \param[in] real  Target that was replaced by pcmk__log_async_add()
+ */
+void
+pcmk__log_async_remove(int32_t real)
+{
+    int32_t shadow = (async_queue == NULL)? -1 : async_shadow_of(real);
+
+    if (shadow >= 0) {
+        // Leave the descriptor open, since queued lines may still refer to it
+        qb_log_ctl(shadow, QB_LOG_CONF_ENABLED, QB_FALSE);
+        crm_update_callsites();
+    }
+}
+
+/*!
+ * \internal
+ * \brief Get the libqb log target that a log writer target replaced
+ *
+ * \param[in] target  libqb log target
+ *
+ * \return Target that \p target replaced, or -1 if it is not a writer target
+ */
+int32_t
+pcmk__log_async_real(int32_t target)
+{
+    if ((async_queue == NULL) || (target < 0) || (target >= QB_LOG_TARGET_MAX)) {
+        return -1;
+    }
+    return async_targets[target].real;
+}
+
+/*!
+ * \internal
+ * \brief Write any queued log messages and stop the log writer
+ *
+ * \note Messages logged afterward are written synchronously.
+ */
+void
+pcmk__log_async_stop(void)
+{
+    gint64 deadline = 0;
+
+    if ((async_queue == NULL) || async_direct || async_stopping) {
+        return;
+    }
+    async_stopping = TRUE;
+    g_async_queue_push(async_queue, &async_stop_line);
+
+    // Don't hang exit on a log destination that has stopped accepting writes
+    deadline = g_get_monotonic_time() + LOG_ASYNC_DRAIN_MS * 1000;
+    while ((g_atomic_int_get(&async_queued) > 0)
+           && (g_get_monotonic_time() < deadline)) {
+        g_usleep(10000);
+    }
+    if (g_atomic_int_get(&async_queued) == 0) {
+        g_thread_join(async_writer);
+        async_writer = NULL;
+    }
+}
+
+#else
+
+void
+pcmk__log_async_init(void)
+{
+    const char *value = daemon_option("log_async");
+
+    if ((value != NULL) && crm_is_true(value)) {
+        crm_warn("Logging synchronously: asynchronous logging is not supported "
+                 "by this build");
+    }
+}
+
+void
+pcmk__log_async_add(int32_t real, const char *filename)
+{
+}
+
+void
+pcmk__log_async_remove(int32_t real)
+{
+}
+
+int32_t
+pcmk__log_async_real(int32_t target)
+{
+    return -1;
+}
+
+void
+pcmk__log_async_stop(void)
+{
+}
+
+#endif
@@ -16,8 +16,17 @@
 #include <errno.h>
 
 #include <sys/wait.h>
+#include <poll.h>
+
+#ifdef HAVE_MALLOC_H
+#  include <malloc.h>
+#endif
+#ifdef HAVE_SYS_EPOLL_H
+#  include <sys/epoll.h>
+#endif
 
 #include <crm/crm.h>
+#include <crm/msg_xml.h>
 #include <crm/common/xml.h>
 #include <crm/common/mainloop.h>
 #include <crm/common/ipcs.h>
@@ -37,12 +46,167 @@ struct mainloop_child_s {
     void (*callback) (mainloop_child_t * p, pid_t pid, int core, int signo, int exitcode);
 };
 
+/*
+ * Dispatch statistics
+ *
+ * The callbacks of triggers, signals, file descriptors, IPC connections and
+ * timers are timed, and the results are kept per source name (sources with the
+ * same name, such as all connections to IPC servers, share an entry): the
+ * number of dispatches, the total and longest time taken by the callback, and
+ * for triggers and timers, the total and longest time between the source
+ * becoming ready and its callback being called. Any callback that takes longer
+ * than PCMK_mainloop_slow_ms is logged as it happens.
+ */
+
+#define MAINLOOP_SLOW_DEFAULT "1000"
+
+struct mainloop_stats_s {
+    char *name;
+    guint64 count;          // dispatches
+    guint64 total_us;       // time spent in callback
+    guint64 max_us;
+    guint64 wait_us;        // time between source becoming ready and dispatch
+    guint64 max_wait_us;
+};
+
+// Entries are never freed, so sources may keep pointers to them
+static GHashTable *mainloop_stats = NULL;
+static gint64 slow_us = -1;
+
+static struct mainloop_stats_s *
+stats_get(const char *name)
+{
+    struct mainloop_stats_s *stats = NULL;
+
+    if (mainloop_stats == NULL) {
+        mainloop_stats = g_hash_table_new(crm_str_hash, g_str_equal);
+    }
+    stats = g_hash_table_lookup(mainloop_stats, name);
+    if (stats == NULL) {
+        stats = calloc(1, sizeof(struct mainloop_stats_s));
+        CRM_ASSERT(stats != NULL);
+        stats->name = strdup(name);
+        CRM_ASSERT(stats->name != NULL);
+        g_hash_table_insert(mainloop_stats, stats->name, stats);
+    }
+    return stats;
+}
+
+/*!
+ * \internal
+ * \brief Record a dispatch
+ *
+ * \param[in] stats  Statistics for source that was dispatched
+ * \param[in] start  Monotonic time (in microseconds) when callback was called
+ * \param[in] ready  Monotonic time when source became ready (or 0 if unknown)
+ */
+static void
+stats_record(struct mainloop_stats_s *stats, gint64 start, gint64 ready)
+{
+    gint64 now = g_get_monotonic_time();
+    guint64 elapsed = (now > start)? (now - start) : 0;
+
+    if (slow_us < 0) {
+        slow_us = crm_parse_int(daemon_option("mainloop_slow_ms"),
+                                MAINLOOP_SLOW_DEFAULT) * 1000LL;
+    }
+
+    stats->count++;
+    stats->total_us += elapsed;
+    stats->max_us = QB_MAX(stats->max_us, elapsed);
+
+    if ((ready > 0) && (start > ready)) {
+        guint64 wait = start - ready;
+
+        stats->wait_us += wait;
+        stats->max_wait_us = QB_MAX(stats->max_wait_us, wait);
+    }
+
+    if ((slow_us > 0) && (elapsed >= slow_us)) {
+        crm_warn("Main loop callback for %s took %.3fs", stats->name,
+                 elapsed / 1000000.0);
+    }
+}
+
+static void
+stats_add_xml(gpointer key, gpointer value, gpointer user_data)
+{
+    struct mainloop_stats_s *stats = value;
+    xmlNode *xml = create_xml_node(user_data, "source");
+    char *s = NULL;
+
+    crm_xml_add(xml, XML_ATTR_ID, stats->name);
+
+#define add_stat(field) do {                                            \
+        s = crm_strdup_printf("%llu", (unsigned long long) stats->field); \
+        crm_xml_add(xml, #field, s);                                    \
+        free(s);                                                        \
+    } while (0)
+
+    add_stat(count);
+    add_stat(total_us);
+    add_stat(max_us);
+    add_stat(wait_us);
+    add_stat(max_wait_us);
+#undef add_stat
+}
+
+// Add the process's memory usage to XML
+static void
+memory_add_xml(xmlNode *parent)
+{
+    xmlNode *xml = create_xml_node(parent, "memory");
+    unsigned long long heap_bytes = 0;
+    char *s = NULL;
+
+#if defined(HAVE_MALLINFO2)
+    struct mallinfo2 info = mallinfo2();
+
+    heap_bytes = info.uordblks;
+#elif defined(HAVE_MALLINFO)
+    struct mallinfo info = mallinfo();
+
+    heap_bytes = info.uordblks;
+#endif
+
+#if SUPPORT_PROCFS
+    s = crm_strdup_printf("%lu", crm_procfs_rss_kb());
+    crm_xml_add(xml, "rss_kb", s);
+    free(s);
+#endif
+    s = crm_strdup_printf("%llu", heap_bytes);
+    crm_xml_add(xml, "heap_bytes", s);
+    free(s);
+}
+
+/*!
+ * \internal
+ * \brief Get the main loop dispatch statistics
+ *
+ * \return Newly allocated XML with a "source" child for each source name and
+ *         a "memory" child with the process's memory usage (the caller is
+ *         responsible for freeing it with free_xml())
+ */
+xmlNode *
+pcmk__mainloop_stats_xml(void)
+{
+    xmlNode *xml = create_xml_node(NULL, "mainloop-stats");
+
+    if (mainloop_stats != NULL) {
+        g_hash_table_foreach(mainloop_stats, stats_add_xml, xml);
+    }
+    memory_add_xml(xml);
+    return xml;
+}
+
 struct trigger_s {
     GSource source;
     gboolean running;
     gboolean trigger;
     void *user_data;
     guint id;
+    gint64 ready;                   // when trigger was last set
+    struct mainloop_stats_s *stats; // set at first dispatch
 
 };
 
@@ -94,7 +258,15 @@ crm_trigger_dispatch(GSource * source, GSourceFunc callback, gpointer userdata)
     trig->trigger = FALSE;
 
     if (callback) {
+        gint64 start = g_get_monotonic_time();
+
+        if (trig->stats == NULL) {
+            const char *name = g_source_get_name(source);
+
+            trig->stats = stats_get(name? name : "trigger");
+        }
         rc = callback(trig->user_data);
+        stats_record(trig->stats, start, trig->ready);
         if (rc < 0) {
             crm_trace("Trigger handler %p not yet complete", trig);
             trig->running = TRUE;
@@ -209,10 +381,28 @@ mainloop_add_trigger(int priority, int (*dispatch) (gpointer user_data), gpointe
     return mainloop_setup_trigger(source, priority, dispatch, userdata);
 }
 
+/*!
+ * \internal
+ * \brief Name a trigger (for its dispatch statistics)
+ *
+ * \param[in] source  Trigger to name
+ * \param[in] name    Name to use
+ */
+void
+pcmk__trigger_set_name(crm_trigger_t *source, const char *name)
+{
+    if (source != NULL) {
+        g_source_set_name((GSource *) source, name);
+    }
+}
+
 void
 mainloop_set_trigger(crm_trigger_t * source)
 {
     if(source) {
+        if (source->trigger == FALSE) {
+            source->ready = g_get_monotonic_time();
+        }
         source->trigger = TRUE;
     }
 }
@@ -266,7 +456,16 @@ crm_signal_dispatch(GSource * source, GSourceFunc callback, gpointer userdata)
 
     sig->trigger.trigger = FALSE;
     if (sig->handler) {
+        gint64 start = g_get_monotonic_time();
+
+        if (sig->trigger.stats == NULL) {
+            char *name = crm_strdup_printf("signal-%d", sig->signal);
+
+            sig->trigger.stats = stats_get(name);
+            free(name);
+        }
         sig->handler(sig->signal);
+        stats_record(sig->trigger.stats, start, sig->trigger.ready);
     }
     return TRUE;
 }
@@ -394,7 +593,531 @@ mainloop_destroy_signal(int sig)
     return TRUE;
 }
 
+/*
+ * Scalable main loop backend
+ *
+ * GLib's main loop polls every source on every iteration: each watched file
+ * descriptor is in the poll() set and each timeout is prepared and checked.
+ * Daemons with hundreds of connections or recurring timers (the executor and
+ * the CIB manager, mainly) can call pcmk__mainloop_use_scalable() at start-up
+ * to instead have:
+ *
+ * - file descriptors watched by mainloop_add_fd() (at the default priority)
+ *   and by libqb IPC servers multiplexed by a single epoll instance, which is
+ *   the only descriptor GLib polls for them; and
+ *
+ * - timers added with pcmk__timeout_add() (including all mainloop_timer_t
+ *   timers and child process timeouts) kept in a hierarchical timer wheel, so
+ *   that adding, removing and expiring a timer take constant time, and GLib
+ *   has only one timeout source to prepare.
+ *
+ * Callbacks keep the same semantics as with GLib sources. Setting
+ * PCMK_mainloop_scalable=false keeps the plain GLib behavior.
+ */
+
+static bool use_scalable = FALSE;
+
+#ifdef HAVE_SYS_EPOLL_H
+
+struct epoll_watch_s {
+    int fd;
+    gboolean (*fn) (int fd, GIOCondition condition, gpointer data);
+    gpointer data;
+    GDestroyNotify destroy;
+    bool removed;
+};
+
+struct epoll_source_s {
+    GSource source;
+    GPollFD pfd;
+    bool dispatching;
+    GList *removed;     // watches to free once dispatch is done
+};
+
+static struct epoll_source_s *epoll_source = NULL;
+
+static gboolean
+epoll_prepare(GSource *source, gint *timeout)
+{
+    *timeout = -1;
+    return FALSE;
+}
+
+static gboolean
+epoll_check(GSource *source)
+{
+    return is_set(((struct epoll_source_s *) source)->pfd.revents, G_IO_IN);
+}
+
+static void epoll_watch_remove(struct epoll_watch_s *watch);
+
+static gboolean
+epoll_dispatch(GSource *source, GSourceFunc callback, gpointer userdata)
+{
+    struct epoll_source_s *es = (struct epoll_source_s *) source;
+    struct epoll_event events[64];
+    int n = epoll_wait(es->pfd.fd, events, DIMOF(events), 0);
+
+    es->dispatching = TRUE;
+    for (int lpc = 0; lpc < n; lpc++) {
+        struct epoll_watch_s *watch = events[lpc].data.ptr;
+
+        // A callback earlier in this batch may have removed this watch
+        if (!watch->removed
+            && !watch->fn(watch->fd, (GIOCondition) events[lpc].events,
+                          watch->data)) {
+            epoll_watch_remove(watch);
+        }
+    }
+    es->dispatching = FALSE;
+    g_list_free_full(es->removed, free);
+    es->removed = NULL;
+    return TRUE;
+}
+
+static GSourceFuncs epoll_source_funcs = {
+    .prepare = epoll_prepare,
+    .check = epoll_check,
+    .dispatch = epoll_dispatch,
+};
+
+/*!
+ * \internal
+ * \brief Watch a file descriptor with the scalable backend
+ *
+ * \param[in] fd       File descriptor to watch
+ * \param[in] events   I/O conditions to watch for
+ * \param[in] fn       Callback for when a condition occurs (as for a GIO
+ *                     watch, returning FALSE removes the watch)
+ * \param[in] data     User data for \p fn and \p destroy
+ * \param[in] destroy  Function to call when watch is removed (or NULL)
+ *
+ * \return Newly allocated watch, or NULL if the backend is not in use or
+ *         cannot watch \p fd (in which case a GLib source should be used)
+ */
+static struct epoll_watch_s *
+epoll_watch_add(int fd, GIOCondition events,
+                gboolean (*fn) (int fd, GIOCondition condition, gpointer data),
+                gpointer data, GDestroyNotify destroy)
+{
+    struct epoll_watch_s *watch = NULL;
+    struct epoll_event event;
+
+    if (!use_scalable) {
+        return NULL;
+    }
+    if (epoll_source == NULL) {
+        int epfd = epoll_create1(EPOLL_CLOEXEC);
+
+        if (epfd < 0) {
+            crm_perror(LOG_WARNING, "Using poll() instead of epoll");
+            use_scalable = FALSE;
+            return NULL;
+        }
+        epoll_source = (struct epoll_source_s *)
+                       g_source_new(&epoll_source_funcs,
+                                    sizeof(struct epoll_source_s));
+        epoll_source->pfd.fd = epfd;
+        epoll_source->pfd.events = G_IO_IN;
+        g_source_add_poll((GSource *) epoll_source, &(epoll_source->pfd));
+        g_source_attach((GSource *) epoll_source, NULL);
+    }
+
+    watch = calloc(1, sizeof(struct epoll_watch_s));
+    CRM_ASSERT(watch != NULL);
+    watch->fd = fd;
+    watch->fn = fn;
+    watch->data = data;
+    watch->destroy = destroy;
+
+    // GLib and epoll use the same values as poll() for I/O conditions
+    memset(&event, 0, sizeof(event));
+    event.events = events & (EPOLLIN|EPOLLPRI|EPOLLOUT);
+    event.data.ptr = watch;
+    if (epoll_ctl(epoll_source->pfd.fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        // For example, fd is a regular file, which epoll cannot watch
+        crm_trace("Could not add fd %d to epoll: %s", fd, pcmk_strerror(errno));
+        free(watch);
+        return NULL;
+    }
+    return watch;
+}
+
+/*!
+ * \internal
+ * \brief Stop watching a file descriptor with the scalable backend
+ *
+ * \param[in] watch  Watch to remove
+ *
+ * \note As with GLib sources, the descriptor must still be open.
+ */
+static void
+epoll_watch_remove(struct epoll_watch_s *watch)
+{
+    if (watch->removed) {
+        return;
+    }
+    watch->removed = TRUE;
+    epoll_ctl(epoll_source->pfd.fd, EPOLL_CTL_DEL, watch->fd, NULL);
+    if (watch->destroy) {
+        watch->destroy(watch->data);
+    }
+    if (epoll_source->dispatching) {
+        epoll_source->removed = g_list_prepend(epoll_source->removed, watch);
+    } else {
+        free(watch);
+    }
+}
+
+#else
+
+struct epoll_watch_s;
+
+#define epoll_watch_add(fd, events, fn, data, destroy) (NULL)
+#define epoll_watch_remove(watch) do { } while (0)
+
+#endif // HAVE_SYS_EPOLL_H
+
+/* The timer wheel has WHEEL_LEVELS levels of WHEEL_SLOTS slots each. A slot
+ * at level 0 holds timers expiring in a particular millisecond, and a slot at
+ * each higher level covers WHEEL_SLOTS times as long as one at the level
+ * below. As time reaches the start of a higher-level slot, its timers are
+ * "cascaded" down into the levels below, so each timer is only touched a
+ * handful of times, however many there are. Five levels of 64 slots cover
+ * about twelve days; a timer further away than that is kept in the top level
+ * and re-added when that slot comes around.
+ */
+#define WHEEL_BITS      6
+#define WHEEL_SLOTS     (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS    5
+
+// Timer IDs from the wheel have this bit set, which GLib source IDs never do
+#define WHEEL_ID_FLAG   0x80000000U
+
+struct wheel_timer_s {
+    guint id;
+    guint interval_ms;
+    guint64 expires;    // in ms of monotonic time
+    GSourceFunc fn;
+    gpointer data;
+
+    struct wheel_timer_s **list;    // list timer is in
+    struct wheel_timer_s *prev;
+    struct wheel_timer_s *next;
+    int level;          // -1 when not in a slot
+    bool removed;       // whether removed while its callback is running
+};
+
+struct timer_wheel_s {
+    GSource source;
+    guint64 current;    // last millisecond processed
+    struct wheel_timer_s *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    int count[WHEEL_LEVELS];
+    struct wheel_timer_s *expiring;     // timers being processed
+    struct wheel_timer_s *running;      // timer whose callback is running
+    GHashTable *timers;                 // ID -> timer
+    guint last_id;
+};
+
+static struct timer_wheel_s *wheel = NULL;
+
+static inline guint64
+wheel_now(void)
+{
+    return (guint64) (g_get_monotonic_time() / 1000);
+}
+
+static void
+wheel_link(struct wheel_timer_s **list, struct wheel_timer_s *timer)
+{
+    timer->list = list;
+    timer->prev = NULL;
+    timer->next = *list;
+    if (*list != NULL) {
+        (*list)->prev = timer;
+    }
+    *list = timer;
+}
+
+static void
+wheel_unlink(struct wheel_timer_s *timer)
+{
+    if (timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        *(timer->list) = timer->next;
+    }
+    if (timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+    if (timer->level >= 0) {
+        wheel->count[timer->level]--;
+    }
+    timer->list = NULL;
+    timer->level = -1;
+}
+
+/*!
+ * \internal
+ * \brief Add a timer to the appropriate slot of the timer wheel
+ *
+ * \param[in] timer     Timer to add
+ * \param[in] earliest  Earliest millisecond that can still be processed
+ */
+static void
+wheel_insert(struct wheel_timer_s *timer, guint64 earliest)
+{
+    guint64 expires = QB_MAX(timer->expires, earliest);
+    guint64 delta = expires - wheel->current;
+    int level = 0;
+
+    while ((level < (WHEEL_LEVELS - 1))
+           && (delta >= (1ULL << (WHEEL_BITS * (level + 1))))) {
+        level++;
+    }
+    if (delta >= (1ULL << (WHEEL_BITS * WHEEL_LEVELS))) {
+        // Too far away: park it in the last slot to come around
+        expires = wheel->current + (1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    }
+
+    wheel_link(&(wheel->slots[level][(expires >> (WHEEL_BITS * level))
+                                     & WHEEL_MASK]), timer);
+    timer->level = level;
+    wheel->count[level]++;
+}
+
+// Move timers from the higher-level slots that start at wheel->current
+static void
+wheel_cascade(void)
+{
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        int slot = (wheel->current >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+        while (wheel->slots[level][slot] != NULL) {
+            struct wheel_timer_s *timer = wheel->slots[level][slot];
+
+            wheel_unlink(timer);
+            wheel_insert(timer, wheel->current); // Before expiring current
+        }
+        if (slot != 0) {
+            break;
+        }
+    }
+}
+
+// Get the next millisecond at which the wheel has something to do
+static guint64
+wheel_next(void)
+{
+    int level = 0;
+
+    while ((level < WHEEL_LEVELS) && (wheel->count[level] == 0)) {
+        level++;
+    }
+    if (level == WHEEL_LEVELS) {
+        return G_MAXUINT64;
+    }
+    if (level == 0) {
+        guint64 limit = wheel->current + WHEEL_SLOTS;
+
+        // Stop at the next cascade, if there is anything to cascade
+        for (int higher = 1; higher < WHEEL_LEVELS; higher++) {
+            if (wheel->count[higher] > 0) {
+                limit = ((wheel->current >> WHEEL_BITS) + 1) << WHEEL_BITS;
+                break;
+            }
+        }
+        for (guint64 ms = wheel->current + 1; ms < limit; ms++) {
+            if (wheel->slots[0][ms & WHEEL_MASK] != NULL) {
+                return ms;
+            }
+        }
+        return limit;
+    }
+
+    // Nothing can happen before the next cascade of the lowest non-empty level
+    return ((wheel->current >> (WHEEL_BITS * level)) + 1)
+           << (WHEEL_BITS * level);
+}
+
+static void
+wheel_expire(struct wheel_timer_s **slot)
+{
+    // Move the slot's timers aside, since callbacks may change the wheel
+    while (*slot != NULL) {
+        struct wheel_timer_s *timer = *slot;
+
+        wheel_unlink(timer);
+        wheel_link(&(wheel->expiring), timer);
+    }
+
+    while (wheel->expiring != NULL) {
+        struct wheel_timer_s *timer = wheel->expiring;
+        gboolean repeat = FALSE;
+
+        wheel_unlink(timer);
+        if (timer->expires > wheel->current) {
+            wheel_insert(timer, wheel->current + 1); // Parked or cascaded early
+            continue;
+        }
+
+        wheel->running = timer;
+        repeat = timer->fn(timer->data);
+        wheel->running = NULL;
+
+        if (repeat && !timer->removed) {
+            timer->expires = wheel_now() + timer->interval_ms;
+            wheel_insert(timer, wheel->current + 1);
+        } else {
+            g_hash_table_remove(wheel->timers, GUINT_TO_POINTER(timer->id));
+        }
+    }
+}
+
+static gboolean
+wheel_prepare(GSource *source, gint *timeout)
+{
+    guint64 next = wheel_next();
+    guint64 now = wheel_now();
+
+    if (next <= now) {
+        *timeout = 0;
+        return TRUE;
+    }
+    *timeout = (next == G_MAXUINT64)? -1 : (gint) QB_MIN(next - now, G_MAXINT);
+    return FALSE;
+}
+
+static gboolean
+wheel_check(GSource *source)
+{
+    return wheel_next() <= wheel_now();
+}
+
+static gboolean
+wheel_dispatch(GSource *source, GSourceFunc callback, gpointer userdata)
+{
+    guint64 now = wheel_now();
+
+    while (wheel->current < now) {
+        guint64 next = wheel_next();
+
+        if (next > now) {
+            wheel->current = now;
+            break;
+        }
+        wheel->current = QB_MAX(next, wheel->current + 1);
+        if ((wheel->current & WHEEL_MASK) == 0) {
+            wheel_cascade();
+        }
+        wheel_expire(&(wheel->slots[0][wheel->current & WHEEL_MASK]));
+    }
+    return TRUE;
+}
+
+static GSourceFuncs wheel_source_funcs = {
+    .prepare = wheel_prepare,
+    .check = wheel_check,
+    .dispatch = wheel_dispatch,
+};
+
+/*!
+ * \internal
+ * \brief Use the scalable main loop backend if configured
+ *
+ * \note This should be called before anything is added to the main loop.
+ */
+void
+pcmk__mainloop_use_scalable(void)
+{
+    const char *value = daemon_option("mainloop_scalable");
+
+    use_scalable = (value == NULL) || crm_is_true(value);
+    crm_debug("Using %s main loop backend",
+              (use_scalable? "scalable" : "default"));
+}
+
+/*!
+ * \internal
+ * \brief Call a function after an interval, like g_timeout_add()
+ *
+ * \param[in] interval_ms  Milliseconds until (each) call
+ * \param[in] fn           Function to call (returning TRUE to call it again
+ *                         after another \p interval_ms)
+ * \param[in] data         User data for \p fn
+ *
+ * \return Timer ID (to be removed with pcmk__timeout_remove() only)
+ */
+guint
+pcmk__timeout_add(guint interval_ms, GSourceFunc fn, gpointer data)
+{
+    struct wheel_timer_s *timer = NULL;
+
+    if (!use_scalable) {
+        return g_timeout_add(interval_ms, fn, data);
+    }
+
+    if (wheel == NULL) {
+        wheel = (struct timer_wheel_s *)
+                g_source_new(&wheel_source_funcs, sizeof(struct timer_wheel_s));
+        wheel->current = wheel_now();
+        wheel->timers = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                              NULL, free);
+        g_source_attach((GSource *) wheel, NULL);
+    }
+
+    timer = calloc(1, sizeof(struct wheel_timer_s));
+    CRM_ASSERT(timer != NULL);
+    do {
+        wheel->last_id = (wheel->last_id + 1) & ~WHEEL_ID_FLAG;
+    } while ((wheel->last_id == 0)
+             || g_hash_table_lookup(wheel->timers,
+                                    GUINT_TO_POINTER(wheel->last_id
+                                                     | WHEEL_ID_FLAG)));
+    timer->id = wheel->last_id | WHEEL_ID_FLAG;
+    timer->interval_ms = interval_ms;
+    timer->expires = wheel_now() + interval_ms;
+    timer->fn = fn;
+    timer->data = data;
+    timer->level = -1;
+    wheel_insert(timer, wheel->current + 1);
+    g_hash_table_insert(wheel->timers, GUINT_TO_POINTER(timer->id), timer);
+    return timer->id;
+}
+
+/*!
+ * \internal
+ * \brief Remove a timer added with pcmk__timeout_add()
+ *
+ * \param[in] id  Timer ID
+ */
+void
+pcmk__timeout_remove(guint id)
+{
+    struct wheel_timer_s *timer = NULL;
+
+    if (is_not_set(id, WHEEL_ID_FLAG)) {
+        g_source_remove(id);
+        return;
+    }
+
+    timer = (wheel == NULL)? NULL
+            : g_hash_table_lookup(wheel->timers, GUINT_TO_POINTER(id));
+    if (timer == NULL) {
+        crm_trace("Timer %u is already gone", id);
+
+    } else if (timer == wheel->running) {
+        timer->removed = TRUE; // Freed once its callback returns
+
+    } else {
+        wheel_unlink(timer);
+        g_hash_table_remove(wheel->timers, GUINT_TO_POINTER(id));
+    }
+}
+
 static qb_array_t *gio_map = NULL;
+static int32_t gio_map_max_fd = -1;    // highest descriptor ever in gio_map
 
 void
 mainloop_cleanup(void) 
@@ -414,12 +1137,28 @@ mainloop_cleanup(void)
 struct gio_to_qb_poll {
     int32_t is_used;
     guint source;
+    struct epoll_watch_s *watch;
     int32_t events;
     void *data;
     qb_ipcs_dispatch_fn_t fn;
     enum qb_loop_priority p;
 };
 
+static gboolean
+gio_dispatch(struct gio_to_qb_poll *adaptor, int fd, GIOCondition condition)
+{
+    static struct mainloop_stats_s *stats = NULL;
+    gint64 start = g_get_monotonic_time();
+    int32_t rc = 0;
+
+    if (stats == NULL) {
+        stats = stats_get("ipc-server");
+    }
+    rc = adaptor->fn(fd, condition, adaptor->data);
+    stats_record(stats, start, 0);
+    return (rc == 0);
+}
+
 static gboolean
 gio_read_socket(GIOChannel * gio, GIOCondition condition, gpointer data)
 {
@@ -432,7 +1171,17 @@ gio_read_socket(GIOChannel * gio, GIOCondition condition, gpointer data)
      * when we destroy a fd and when mainloop actually gives it up */
     CRM_ASSERT(adaptor->is_used > 0);
 
-    return (adaptor->fn(fd, condition, adaptor->data) == 0);
+    return gio_dispatch(adaptor, fd, condition);
+}
+
+static gboolean
+gio_epoll_read(int fd, GIOCondition condition, gpointer data)
+{
+    struct gio_to_qb_poll *adaptor = (struct gio_to_qb_poll *)data;
+
+    crm_trace("%p.%d %d", data, fd, condition);
+    CRM_ASSERT(adaptor->is_used > 0);
+    return gio_dispatch(adaptor, fd, condition);
 }
 
 static void
@@ -446,6 +1195,7 @@ gio_poll_destroy(gpointer data)
     if (adaptor->is_used == 0) {
         crm_trace("Marking adaptor %p unused", adaptor);
         adaptor->source = 0;
+        adaptor->watch = NULL;
     }
 }
 
@@ -464,8 +1214,9 @@ gio_poll_dispatch_update(enum qb_loop_priority p, int32_t fd, int32_t evts,
     }
 
     crm_trace("Adding fd=%d to mainloop as adaptor %p", fd, adaptor);
+    gio_map_max_fd = QB_MAX(gio_map_max_fd, fd);
 
-    if (add && adaptor->source) {
+    if (add && (adaptor->source || adaptor->watch)) {
         crm_err("Adaptor for descriptor %d is still in-use", fd);
         return -EEXIST;
     }
@@ -474,6 +1225,30 @@ gio_poll_dispatch_update(enum qb_loop_priority p, int32_t fd, int32_t evts,
         return -ENOENT;
     }
 
+    if (adaptor->watch) {
+        epoll_watch_remove(adaptor->watch);
+        adaptor->watch = NULL;
+    }
+    if (use_scalable) {
+        if (adaptor->source) {
+            g_source_remove(adaptor->source);
+            adaptor->source = 0;
+        }
+
+        adaptor->fn = fn;
+        adaptor->events = evts | G_IO_HUP | G_IO_NVAL | G_IO_ERR;
+        adaptor->data = data;
+        adaptor->p = p;
+        adaptor->is_used++;
+        adaptor->watch = epoll_watch_add(fd, adaptor->events, gio_epoll_read,
+                                         adaptor, gio_poll_destroy);
+        if (adaptor->watch) {
+            crm_trace("Added fd=%d to epoll", fd);
+            return 0;
+        }
+        adaptor->is_used--; // Fall back to a GLib source
+    }
+
     /* channel is created with ref_count = 1 */
     channel = g_io_channel_unix_new(fd);
     if (!channel) {
@@ -538,6 +1313,10 @@ gio_poll_dispatch_del(int32_t fd)
 
     crm_trace("Looking for fd=%d", fd);
     if (qb_array_index(gio_map, fd, (void **)&adaptor) == 0) {
+        if (adaptor->watch) {
+            epoll_watch_remove(adaptor->watch);
+            adaptor->watch = NULL;
+        }
         if (adaptor->source) {
             g_source_remove(adaptor->source);
             adaptor->source = 0;
@@ -553,6 +1332,48 @@ struct qb_ipcs_poll_handlers gio_poll_funcs = {
     .dispatch_del = gio_poll_dispatch_del,
 };
 
+/*!
+ * \internal
+ * \brief Dispatch input waiting on IPC server descriptors, and nothing else
+ *
+ * This lets a long computation in a main loop callback receive new
+ * connections, requests and disconnections without returning to the main loop.
+ * Unlike a main loop iteration, it does not dispatch any other source (timers,
+ * triggers, idle callbacks and so on), so only the IPC server callbacks need
+ * to be safe to run at that point.
+ *
+ * \return Number of IPC server descriptors dispatched
+ */
+int
+pcmk__mainloop_dispatch_ipc(void)
+{
+    int dispatched = 0;
+
+    for (int32_t fd = 0; (gio_map != NULL) && (fd <= gio_map_max_fd); fd++) {
+        struct gio_to_qb_poll *adaptor = NULL;
+        struct pollfd pfd;
+
+        if ((qb_array_index(gio_map, fd, (void **) &adaptor) != 0)
+            || (adaptor->is_used <= 0) || (adaptor->fn == NULL)) {
+            continue;
+        }
+
+        pfd.fd = fd;
+        pfd.events = adaptor->events;
+        pfd.revents = 0;
+        if ((poll(&pfd, 1, 0) <= 0) || (pfd.revents == 0)) {
+            continue;
+        }
+
+        dispatched++;
+        if (gio_dispatch(adaptor, fd, pfd.revents) == FALSE) {
+            // As the main loop would, stop watching the descriptor
+            gio_poll_dispatch_del(fd);
+        }
+    }
+    return dispatched;
+}
+
 static enum qb_ipc_type
 pick_ipc_type(enum qb_ipc_type requested)
 {
@@ -622,8 +1443,10 @@ struct mainloop_io_s {
 
     int fd;
     guint source;
+    struct epoll_watch_s *watch;    // used instead of source if not NULL
     crm_ipc_t *ipc;
     GIOChannel *channel;
+    struct mainloop_stats_s *stats;
 
     int (*dispatch_fn_ipc) (const char *buffer, ssize_t length, gpointer userdata);
     int (*dispatch_fn_io) (gpointer userdata);
@@ -632,12 +1455,14 @@ struct mainloop_io_s {
 };
 
 static gboolean
-mainloop_gio_callback(GIOChannel * gio, GIOCondition condition, gpointer data)
+mainloop_io_dispatch(int fd, GIOCondition condition, gpointer data)
 {
     gboolean keep = TRUE;
     mainloop_io_t *client = data;
+    struct mainloop_stats_s *stats = client->stats; // client may be freed
+    gint64 start = g_get_monotonic_time();
 
-    CRM_ASSERT(client->fd == g_io_channel_unix_get_fd(gio));
+    CRM_ASSERT(client->fd == fd);
 
     if (condition & G_IO_IN) {
         if (client->ipc) {
@@ -714,12 +1539,21 @@ mainloop_gio_callback(GIOChannel * gio, GIOCondition condition, gpointer data)
         crm_err("Strange condition: %d", condition);
     }
 
+    stats_record(stats, start, 0);
+
     /* keep == FALSE results in mainloop_gio_destroy() being called
      * just before the source is removed from mainloop
      */
     return keep;
 }
 
+static gboolean
+mainloop_gio_callback(GIOChannel * gio, GIOCondition condition, gpointer data)
+{
+    return mainloop_io_dispatch(g_io_channel_unix_get_fd(gio), condition,
+                                data);
+}
+
 static void
 mainloop_gio_destroy(gpointer c)
 {
@@ -813,6 +1647,7 @@ mainloop_add_fd(const char *name, int priority, int fd, void *userdata,
         }
         client->name = strdup(name);
         client->userdata = userdata;
+        client->stats = stats_get(name);
 
         if (callbacks) {
             client->destroy_fn = callbacks->destroy;
@@ -820,6 +1655,16 @@ mainloop_add_fd(const char *name, int priority, int fd, void *userdata,
         }
 
         client->fd = fd;
+        if (priority == G_PRIORITY_DEFAULT) {
+            client->watch = epoll_watch_add(fd, G_IO_IN, mainloop_io_dispatch,
+                                            client, mainloop_gio_destroy);
+            if (client->watch) {
+                crm_trace("Added connection for %s[%p].%d to epoll",
+                          client->name, client, fd);
+                return client;
+            }
+        }
+
         client->channel = g_io_channel_unix_new(fd);
         client->source =
             g_io_add_watch_full(client->channel, priority,
@@ -849,7 +1694,10 @@ mainloop_del_fd(mainloop_io_t * client)
 {
     if (client != NULL) {
         crm_trace("Removing client %s[%p]", client->name, client);
-        if (client->source) {
+        if (client->watch) {
+            epoll_watch_remove(client->watch); // Calls mainloop_gio_destroy()
+
+        } else if (client->source) {
             /* Results in mainloop_gio_destroy() being called just
              * before the source is removed from mainloop
              */
@@ -896,7 +1744,7 @@ child_free(mainloop_child_t *child)
 {
     if (child->timerid != 0) {
         crm_trace("Removing timer %d", child->timerid);
-        g_source_remove(child->timerid);
+        pcmk__timeout_remove(child->timerid);
         child->timerid = 0;
     }
     free(child->desc);
@@ -946,7 +1794,7 @@ child_timeout_callback(gpointer p)
     child->timeout = TRUE;
     crm_warn("%s process (PID %d) timed out", child->desc, (int)child->pid);
 
-    child->timerid = g_timeout_add(5000, child_timeout_callback, child);
+    child->timerid = pcmk__timeout_add(5000, child_timeout_callback, child);
     return FALSE;
 }
 
@@ -1106,7 +1954,7 @@ mainloop_child_add_with_flags(pid_t pid, int timeout, const char *desc, void *pr
     }
 
     if (timeout) {
-        child->timerid = g_timeout_add(timeout, child_timeout_callback, child);
+        child->timerid = pcmk__timeout_add(timeout, child_timeout_callback, child);
     }
 
     child_list = g_list_append(child_list, child);
@@ -1135,6 +1983,8 @@ struct mainloop_timer_s {
         char *name;
         GSourceFunc cb;
         void *userdata;
+        gint64 due;                     // when the timer should next fire
+        struct mainloop_stats_s *stats;
 };
 
 struct mainloop_timer_s mainloop;
@@ -1153,17 +2003,21 @@ static gboolean mainloop_timer_cb(gpointer user_data)
                 */
 
     if(t->cb) {
+        gint64 start = g_get_monotonic_time();
+
         crm_trace("Invoking callbacks for timer %s", t->name);
         repeat = t->repeat;
         if(t->cb(t->userdata) == FALSE) {
             crm_trace("Timer %s complete", t->name);
             repeat = FALSE;
         }
+        stats_record(t->stats, start, t->due);
     }
 
     if(repeat) {
         /* Restore if repeating */
         t->id = id;
+        t->due = g_get_monotonic_time() + t->period_ms * 1000LL;
     }
 
     return repeat;
@@ -1182,7 +2036,8 @@ void mainloop_timer_start(mainloop_timer_t *t)
     mainloop_timer_stop(t);
     if(t && t->period_ms > 0) {
         crm_trace("Starting timer %s", t->name);
-        t->id = g_timeout_add(t->period_ms, mainloop_timer_cb, t);
+        t->due = g_get_monotonic_time() + t->period_ms * 1000LL;
+        t->id = pcmk__timeout_add(t->period_ms, mainloop_timer_cb, t);
     }
 }
 
@@ -1190,7 +2045,7 @@ void mainloop_timer_stop(mainloop_timer_t *t)
 {
     if(t && t->id != 0) {
         crm_trace("Stopping timer %s", t->name);
-        g_source_remove(t->id);
+        pcmk__timeout_remove(t->id);
         t->id = 0;
     }
 }
@@ -1222,6 +2077,7 @@ mainloop_timer_add(const char *name, guint period_ms, bool repeat, GSourceFunc c
         } else {
             t->name = crm_strdup_printf("%p-%u-%d", t, period_ms, repeat);
         }
+        t->stats = stats_get(name? name : "timer");
         t->id = 0;
         t->period_ms = period_ms;
         t->repeat = repeat;
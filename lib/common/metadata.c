@@ -0,0 +1,207 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU Lesser General Public License
+ * version 2.1 or later (LGPLv2.1+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <crm/crm.h>
+#include <crm/services.h>
+#include <crm/common/internal.h>
+
+/*
+ * Agent meta-data cache
+ *
+ * Getting an agent's meta-data means running the agent, which can take a
+ * while, and is done synchronously in several places. So that this is done
+ * only once per agent version rather than once per daemon start, the output is
+ * kept in CRM_METADATA_DIR, one file per agent, for any daemon or tool to use.
+ *
+ * Each file starts with a line identifying the agent executable by path,
+ * modification time and size (and the Pacemaker version, since some meta-data
+ * is generated by Pacemaker itself). A cached copy is used only if that line
+ * still matches, so an upgraded agent is simply run again.
+ *
+ * Only OCF and Red Hat fence agents are cached, since the meta-data for other
+ * classes is cheap to get or has no single executable to check.
+ */
+
+static int metadata_cache_enabled = -1;
+
+static bool
+cache_enabled(void)
+{
+    if (metadata_cache_enabled < 0) {
+        const char *value = daemon_option("metadata_cache");
+
+        metadata_cache_enabled = (value == NULL) || crm_is_true(value);
+    }
+    return metadata_cache_enabled;
+}
+
+static char *
+agent_path(const char *standard, const char *provider, const char *type)
+{
+    if ((type == NULL) || (strchr(type, '/') != NULL)) {
+        return NULL;
+
+    } else if (safe_str_eq(standard, PCMK_RESOURCE_CLASS_OCF)) {
+        if ((provider == NULL) || (strchr(provider, '/') != NULL)) {
+            return NULL;
+        }
+        return crm_strdup_printf(OCF_RA_DIR "/%s/%s", provider, type);
+
+    } else if (safe_str_eq(standard, PCMK_RESOURCE_CLASS_STONITH)
+               && (strncmp(type, "fence_", 6) == 0)) {
+        return crm_strdup_printf(RH_STONITH_DIR "/%s", type);
+    }
+    return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Get the cache file name and identifying line for an agent
+ *
+ * \param[in]  standard  Agent's resource class
+ * \param[in]  provider  Agent's provider (for OCF agents)
+ * \param[in]  type      Agent's name
+ * \param[out] filename  Where to store (newly allocated) cache file name
+ * \param[out] header    Where to store (newly allocated) first line of file
+ *
+ * \return TRUE if the agent's meta-data can be cached, otherwise FALSE
+ */
+static bool
+cache_entry(const char *standard, const char *provider, const char *type,
+            char **filename, char **header)
+{
+    struct stat sb;
+    char *path = NULL;
+
+    if (!cache_enabled()) {
+        return FALSE;
+    }
+
+    path = agent_path(standard, provider, type);
+    if ((path == NULL) || (stat(path, &sb) < 0)) {
+        free(path);
+        return FALSE;
+    }
+
+    *filename = crm_strdup_printf(CRM_METADATA_DIR "/%s-%s-%s.xml", standard,
+                                  (provider? provider : ""), type);
+    *header = crm_strdup_printf("<!-- %s %lld %lld " PACEMAKER_VERSION " -->\n",
+                                path, (long long) sb.st_mtime,
+                                (long long) sb.st_size);
+    free(path);
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Get an agent's meta-data from the on-disk cache
+ *
+ * \param[in] standard  Agent's resource class
+ * \param[in] provider  Agent's provider (for OCF agents)
+ * \param[in] type      Agent's name
+ *
+ * \return Newly allocated copy of cached meta-data, or NULL if none is cached
+ *         for the agent as it is now
+ */
+char *
+pcmk__metadata_cache_get(const char *standard, const char *provider,
+                         const char *type)
+{
+    char *filename = NULL;
+    char *header = NULL;
+    char *contents = NULL;
+    char *metadata = NULL;
+    size_t header_len = 0;
+
+    if (!cache_entry(standard, provider, type, &filename, &header)) {
+        return NULL;
+    }
+
+    if (access(filename, R_OK) == 0) {
+        contents = crm_read_contents(filename);
+    }
+    header_len = strlen(header);
+    if ((contents != NULL) && (strncmp(contents, header, header_len) == 0)
+        && (contents[header_len] != '\0')) {
+        metadata = strdup(contents + header_len);
+        crm_trace("Using cached meta-data for %s:%s:%s",
+                  standard, crm_str(provider), type);
+    }
+
+    free(contents);
+    free(filename);
+    free(header);
+    return metadata;
+}
+
+/*!
+ * \internal
+ * \brief Save an agent's meta-data in the on-disk cache
+ *
+ * \param[in] standard  Agent's resource class
+ * \param[in] provider  Agent's provider (for OCF agents)
+ * \param[in] type      Agent's name
+ * \param[in] metadata  Agent's meta-data
+ *
+ * \note Failure is logged but otherwise ignored, since the cache is only an
+ *       optimization.
+ */
+void
+pcmk__metadata_cache_put(const char *standard, const char *provider,
+                         const char *type, const char *metadata)
+{
+    char *filename = NULL;
+    char *header = NULL;
+    char *tmpname = NULL;
+    char *contents = NULL;
+    int fd = -1;
+    int rc = 0;
+
+    if ((metadata == NULL) || (metadata[0] == '\0')
+        || !cache_entry(standard, provider, type, &filename, &header)) {
+        return;
+    }
+
+    // Write a temporary file then rename it, so readers never see part of one
+    tmpname = crm_strdup_printf("%s.XXXXXX", filename);
+    fd = mkstemp(tmpname);
+    if (fd < 0) {
+        crm_debug("Could not cache meta-data for %s:%s:%s: %s",
+                  standard, crm_str(provider), type, pcmk_strerror(errno));
+        goto done;
+    }
+
+    // Meta-data is not secret, and any daemon may read what another wrote
+    fchmod(fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+
+    contents = crm_strdup_printf("%s%s", header, metadata);
+    rc = crm_write_sync(fd, contents); // This closes fd
+    if ((rc < 0) || (rename(tmpname, filename) < 0)) {
+        crm_debug("Could not cache meta-data for %s:%s:%s: %s",
+                  standard, crm_str(provider), type, pcmk_strerror(errno));
+        unlink(tmpname);
+    } else {
+        crm_debug("Cached meta-data for %s:%s:%s in %s",
+                  standard, crm_str(provider), type, filename);
+    }
+
+  done:
+    free(contents);
+    free(tmpname);
+    free(filename);
+    free(header);
+}
@@ -0,0 +1,481 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU Lesser General Public License
+ * version 2.1 or later (LGPLv2.1+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <crm/crm.h>
+#include <crm/common/mainloop.h>
+#include <crm/common/internal.h>
+
+/*
+ * Metrics
+ *
+ * Daemons count what they do in named counters, gauges and latency histograms,
+ * optionally split by one label (such as the CIB operation or IPC client).
+ * A metric is created the first time it is used, and lives as long as the
+ * process, so callers may keep the pointer returned for a metric with a fixed
+ * label, or look it up each time when the label varies.
+ *
+ * pcmk__metrics_text() formats all of them in the OpenMetrics text format.
+ * The controller returns that for "crmadmin --metrics", and if
+ * PCMK_metrics_dir is set, every daemon serves it to whatever connects to
+ * <dir>/<daemon name>.sock (answering as an HTTP server would, so that
+ * "curl --unix-socket" and Prometheus-style collectors can read it directly).
+ *
+ * Metrics may be updated from any thread.
+ */
+
+#define METRICS_PREFIX "pacemaker_"
+
+// Histogram bucket upper bounds, in seconds (with +Inf implied)
+static const double bucket_bounds[] = {
+    0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30
+};
+#define METRICS_BUCKETS (sizeof(bucket_bounds) / sizeof(bucket_bounds[0]))
+
+struct pcmk__metric_s {
+    char *family;           // name without prefix or suffix
+    char *label;            // label name, or NULL if none
+    char *value;            // label value, or NULL if none
+    enum pcmk__metric_type type;
+    double count;           // counters and gauges: value; histograms: count
+    double sum;             // histograms: sum of observations, in seconds
+    unsigned long long buckets[METRICS_BUCKETS];
+};
+
+struct metric_family_s {
+    char *name;
+    char *help;
+    enum pcmk__metric_type type;
+    GList *series;          // pcmk__metric_t *, in order of creation
+};
+
+static GMutex metrics_lock;
+static GList *metric_collectors = NULL;     // functions to call when exporting
+static GHashTable *metric_families = NULL;  // name -> struct metric_family_s
+static GHashTable *metric_series = NULL;    // name{label=value} -> metric
+static GList *family_order = NULL;
+
+static void
+free_family(gpointer data)
+{
+    struct metric_family_s *family = data;
+
+    g_list_free(family->series);
+    free(family->name);
+    free(family->help);
+    free(family);
+}
+
+static void
+free_metric(gpointer data)
+{
+    pcmk__metric_t *metric = data;
+
+    free(metric->family);
+    free(metric->label);
+    free(metric->value);
+    free(metric);
+}
+
+/*!
+ * \internal
+ * \brief Get (creating if needed) a metric
+ *
+ * \param[in] type   Type of metric
+ * \param[in] name   Metric family name (without the "pacemaker_" prefix or any
+ *                   "_total" suffix)
+ * \param[in] help   Description of metric family
+ * \param[in] label  Name of label to distinguish metrics of this family by
+ *                   (or NULL if the family has only one metric)
+ * \param[in] value  Value of \p label for this metric (or NULL)
+ *
+ * \return Metric (which will exist as long as the process)
+ * \note The first use of a family fixes its type and description.
+ */
+pcmk__metric_t *
+pcmk__metric(enum pcmk__metric_type type, const char *name, const char *help,
+             const char *label, const char *value)
+{
+    pcmk__metric_t *metric = NULL;
+    struct metric_family_s *family = NULL;
+    char *key = NULL;
+
+    if ((label == NULL) || (value == NULL)) {
+        label = NULL;
+        value = NULL;
+    }
+    key = crm_strdup_printf("%s{%s=%s}", name, (label? label : ""),
+                            (value? value : ""));
+
+    g_mutex_lock(&metrics_lock);
+    if (metric_families == NULL) {
+        metric_families = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                NULL, free_family);
+        metric_series = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                              free, free_metric);
+    }
+
+    metric = g_hash_table_lookup(metric_series, key);
+    if (metric != NULL) {
+        g_mutex_unlock(&metrics_lock);
+        free(key);
+        return metric;
+    }
+
+    family = g_hash_table_lookup(metric_families, name);
+    if (family == NULL) {
+        family = calloc(1, sizeof(struct metric_family_s));
+        CRM_ASSERT(family != NULL);
+        family->name = strdup(name);
+        family->help = strdup(help? help : name);
+        family->type = type;
+        g_hash_table_insert(metric_families, family->name, family);
+        family_order = g_list_append(family_order, family);
+    }
+
+    metric = calloc(1, sizeof(pcmk__metric_t));
+    CRM_ASSERT(metric != NULL);
+    metric->family = strdup(name);
+    metric->label = label? strdup(label) : NULL;
+    metric->value = value? strdup(value) : NULL;
+    metric->type = family->type;
+    family->series = g_list_append(family->series, metric);
+    g_hash_table_insert(metric_series, key, metric);
+    g_mutex_unlock(&metrics_lock);
+    return metric;
+}
+
+/*!
+ * \internal
+ * \brief Add to a counter or gauge
+ *
+ * \param[in] metric  Metric to update
+ * \param[in] amount  Amount to add (which must be positive for counters)
+ */
+void
+pcmk__metric_add(pcmk__metric_t *metric, double amount)
+{
+    g_mutex_lock(&metrics_lock);
+    metric->count += amount;
+    g_mutex_unlock(&metrics_lock);
+}
+
+/*!
+ * \internal
+ * \brief Set a gauge
+ *
+ * \param[in] metric  Metric to update
+ * \param[in] value   New value
+ */
+void
+pcmk__metric_set(pcmk__metric_t *metric, double value)
+{
+    g_mutex_lock(&metrics_lock);
+    metric->count = value;
+    g_mutex_unlock(&metrics_lock);
+}
+
+/*!
+ * \internal
+ * \brief Record a duration in a histogram
+ *
+ * \param[in] metric       Metric to update
+ * \param[in] duration_us  Duration to record, in microseconds
+ */
+void
+pcmk__metric_observe_us(pcmk__metric_t *metric, gint64 duration_us)
+{
+    double seconds = (duration_us > 0)? (duration_us / 1000000.0) : 0.0;
+    size_t lpc = 0;
+
+    // Buckets are stored non-cumulatively, and summed when formatted
+    while ((lpc < METRICS_BUCKETS) && (seconds > bucket_bounds[lpc])) {
+        lpc++;
+    }
+
+    g_mutex_lock(&metrics_lock);
+    metric->count++;
+    metric->sum += seconds;
+    if (lpc < METRICS_BUCKETS) {
+        metric->buckets[lpc]++;
+    }
+    g_mutex_unlock(&metrics_lock);
+}
+
+/*!
+ * \internal
+ * \brief Register a function to update gauges just before they are exported
+ *
+ * \param[in] collect  Function to call (in the main thread)
+ *
+ * \note This is for values that are cheaper to compute when asked for than to
+ *       keep up to date, such as the length of a queue.
+ */
+void
+pcmk__metrics_add_collector(void (*collect)(void))
+{
+    metric_collectors = g_list_append(metric_collectors, collect);
+}
+
+static void
+add_escaped(GString *text, const char *value)
+{
+    for (const char *c = value; *c != '\0'; c++) {
+        switch (*c) {
+            case '\\':  g_string_append(text, "\\\\");  break;
+            case '"':   g_string_append(text, "\\\"");  break;
+            case '\n':  g_string_append(text, "\\n");   break;
+            default:    g_string_append_c(text, *c);    break;
+        }
+    }
+}
+
+static void
+add_sample(GString *text, const pcmk__metric_t *metric, const char *suffix,
+           const char *le, double value)
+{
+    g_string_append_printf(text, METRICS_PREFIX "%s%s", metric->family, suffix);
+    if ((metric->label != NULL) || (le != NULL)) {
+        g_string_append_c(text, '{');
+        if (metric->label != NULL) {
+            g_string_append_printf(text, "%s=\"", metric->label);
+            add_escaped(text, metric->value);
+            g_string_append_c(text, '"');
+        }
+        if (le != NULL) {
+            g_string_append_printf(text, "%sle=\"%s\"",
+                                   ((metric->label != NULL)? "," : ""), le);
+        }
+        g_string_append_c(text, '}');
+    }
+    g_string_append_printf(text, " %.17g\n", value);
+}
+
+static const char *
+type_str(enum pcmk__metric_type type)
+{
+    switch (type) {
+        case pcmk__metric_counter:      return "counter";
+        case pcmk__metric_gauge:        return "gauge";
+        case pcmk__metric_histogram:    return "histogram";
+    }
+    return "unknown";
+}
+
+/*!
+ * \internal
+ * \brief Format all metrics in the OpenMetrics text format
+ *
+ * \return Newly allocated text (the caller is responsible for freeing it)
+ */
+char *
+pcmk__metrics_text(void)
+{
+    GString *text = g_string_sized_new(4096);
+
+    for (GList *iter = metric_collectors; iter != NULL; iter = iter->next) {
+        void (*collect)(void) = iter->data;
+
+        collect();
+    }
+
+    g_mutex_lock(&metrics_lock);
+    for (GList *iter = family_order; iter != NULL; iter = iter->next) {
+        const struct metric_family_s *family = iter->data;
+
+        g_string_append_printf(text, "# TYPE " METRICS_PREFIX "%s %s\n",
+                               family->name, type_str(family->type));
+        g_string_append_printf(text, "# HELP " METRICS_PREFIX "%s ",
+                               family->name);
+        add_escaped(text, family->help);
+        g_string_append_c(text, '\n');
+
+        for (GList *s = family->series; s != NULL; s = s->next) {
+            const pcmk__metric_t *metric = s->data;
+            unsigned long long cumulative = 0;
+            char le[32];
+
+            switch (family->type) {
+                case pcmk__metric_counter:
+                    add_sample(text, metric, "_total", NULL, metric->count);
+                    break;
+                case pcmk__metric_gauge:
+                    add_sample(text, metric, "", NULL, metric->count);
+                    break;
+                case pcmk__metric_histogram:
+                    for (size_t b = 0; b < METRICS_BUCKETS; b++) {
+                        cumulative += metric->buckets[b];
+                        snprintf(le, sizeof(le), "%g", bucket_bounds[b]);
+                        add_sample(text, metric, "_bucket", le, cumulative);
+                    }
+                    add_sample(text, metric, "_bucket", "+Inf",
+                               metric->count);
+                    add_sample(text, metric, "_count", NULL, metric->count);
+                    add_sample(text, metric, "_sum", NULL, metric->sum);
+                    break;
+            }
+        }
+    }
+    g_mutex_unlock(&metrics_lock);
+
+    g_string_append(text, "# EOF\n");
+    return g_string_free(text, FALSE);
+}
+
+/*
+ * Metrics endpoint
+ */
+
+static char *metrics_socket = NULL;
+
+static bool
+write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t rc = write(fd, data, len);
+
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FALSE;
+        }
+        data += rc;
+        len -= rc;
+    }
+    return TRUE;
+}
+
+static int
+drain_request(gpointer user_data)
+{
+    char buffer[1024];
+    int fd = GPOINTER_TO_INT(user_data);
+    ssize_t rc = read(fd, buffer, sizeof(buffer));
+
+    if ((rc < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+        return 0;
+    }
+    return (rc > 0)? 0 : -1; // Remove the source at EOF or error
+}
+
+static void
+close_request(gpointer user_data)
+{
+    close(GPOINTER_TO_INT(user_data));
+}
+
+static struct mainloop_fd_callbacks request_callbacks = {
+    .dispatch = drain_request,
+    .destroy = close_request,
+};
+
+static int
+accept_request(gpointer user_data)
+{
+    int fd = accept(GPOINTER_TO_INT(user_data), NULL, NULL);
+    char *body = NULL;
+    char *header = NULL;
+
+    if (fd < 0) {
+        return 0;
+    }
+
+    /* Answer at once, whatever the request was, so a client that sends nothing
+     * (like socat) gets the metrics too. The request is read and discarded
+     * afterward, so closing the connection does not reset it.
+     */
+    body = pcmk__metrics_text();
+    header = crm_strdup_printf("HTTP/1.0 200 OK\r\n"
+                               "Content-Type: application/openmetrics-text; "
+                               "version=1.0.0; charset=utf-8\r\n"
+                               "Content-Length: %llu\r\n"
+                               "Connection: close\r\n\r\n",
+                               (unsigned long long) strlen(body));
+    if (!write_all(fd, header, strlen(header))
+        || !write_all(fd, body, strlen(body))) {
+        crm_debug("Could not send metrics: %s", pcmk_strerror(errno));
+    }
+    free(header);
+    free(body);
+
+    shutdown(fd, SHUT_WR);
+    crm_set_nonblocking(fd);
+    if (mainloop_add_fd("metrics-request", G_PRIORITY_LOW, fd,
+                        GINT_TO_POINTER(fd), &request_callbacks) == NULL) {
+        close(fd);
+    }
+    return 0;
+}
+
+static struct mainloop_fd_callbacks endpoint_callbacks = {
+    .dispatch = accept_request,
+    .destroy = NULL,
+};
+
+/*!
+ * \internal
+ * \brief Serve metrics on a Unix socket if PCMK_metrics_dir is set
+ *
+ * \note This requires a main loop to do anything.
+ */
+void
+pcmk__metrics_init(void)
+{
+    const char *dir = daemon_option("metrics_dir");
+    struct sockaddr_un addr;
+    int fd = -1;
+
+    if ((dir == NULL) || (metrics_socket != NULL) || (crm_system_name == NULL)) {
+        return;
+    }
+
+    metrics_socket = crm_strdup_printf("%s/%s.sock", dir, crm_system_name);
+    if (strlen(metrics_socket) >= sizeof(addr.sun_path)) {
+        crm_warn("Not serving metrics: %s is too long", metrics_socket);
+        return;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, metrics_socket, sizeof(addr.sun_path) - 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    unlink(metrics_socket); // Left behind by an earlier instance
+    if ((fd < 0) || (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+        || (listen(fd, 8) < 0)) {
+        crm_warn("Not serving metrics at %s: %s",
+                 metrics_socket, pcmk_strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    chmod(metrics_socket, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP);
+    crm_set_nonblocking(fd);
+
+    if (mainloop_add_fd("metrics-endpoint", G_PRIORITY_LOW, fd,
+                        GINT_TO_POINTER(fd), &endpoint_callbacks) == NULL) {
+        close(fd);
+        return;
+    }
+    crm_info("Serving metrics at %s", metrics_socket);
+}
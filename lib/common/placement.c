@@ -0,0 +1,331 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU Lesser General Public License
+ * version 2.1 or later (LGPLv2.1+) WITHOUT ANY WARRANTY.
+ */
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#include <crm_internal.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <crm/crm.h>
+#include <crm/common/internal.h>
+
+/*
+ * Process placement
+ *
+ * On busy nodes, cluster daemons can be starved of CPU by the workload (or by
+ * resource agents), delaying their responses long enough to cause timeouts.
+ * These settings (from the environment, see pacemaker.sysconfig) let an
+ * administrator keep them apart:
+ *
+ * - PCMK_daemon_cpus, PCMK_daemon_sched, PCMK_daemon_cgroup and
+ *   PCMK_daemon_lock_memory are applied by pacemakerd to each daemon it
+ *   starts. Each is a value for all daemons, or a space-separated list of
+ *   "<daemon>=<value>" entries, optionally with a value for the rest.
+ *
+ * - PCMK_agent_cpus and PCMK_agent_cgroup are applied by the executor to each
+ *   resource agent process it runs.
+ */
+
+/*!
+ * \internal
+ * \brief Get the value of a placement setting for a particular daemon
+ *
+ * \param[in] option  Name of option (without "PCMK_")
+ * \param[in] daemon  Daemon name
+ *
+ * \return Newly allocated value for \p daemon (or NULL if none)
+ */
+char *
+pcmk__daemon_setting(const char *option, const char *daemon)
+{
+    const char *value = daemon_option(option);
+    size_t name_len = strlen(daemon);
+    char *fallback = NULL;
+
+    for (const char *p = value; (p != NULL) && (*p != '\0'); ) {
+        size_t len = strcspn(p, " \t");
+        const char *eq = memchr(p, '=', len);
+
+        if (eq == NULL) {
+            if (fallback == NULL) {
+                fallback = strndup(p, len);
+            }
+        } else if (((size_t) (eq - p) == name_len)
+                   && (strncmp(p, daemon, name_len) == 0)) {
+            free(fallback);
+            return strndup(eq + 1, len - name_len - 1);
+        }
+        p += len;
+        p += strspn(p, " \t");
+    }
+    return fallback;
+}
+
+/*!
+ * \internal
+ * \brief Restrict a process to a list of CPUs
+ *
+ * \param[in] pid   Process to restrict (0 for this one)
+ * \param[in] cpus  CPU list such as "0-3,8", or "all" for every CPU
+ *
+ * \return pcmk_ok on success, -errno otherwise
+ */
+int
+pcmk__set_cpus(pid_t pid, const char *cpus)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    if (safe_str_eq(cpus, "all")) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &set);
+        }
+
+    } else {
+        for (const char *p = cpus; (p != NULL) && (*p != '\0'); ) {
+            char *end = NULL;
+            long first = strtol(p, &end, 10);
+            long last = first;
+
+            if ((end == p) || (first < 0)) {
+                return -EINVAL;
+            }
+            if (*end == '-') {
+                p = end + 1;
+                last = strtol(p, &end, 10);
+                if ((end == p) || (last < first)) {
+                    return -EINVAL;
+                }
+            }
+            for (long cpu = first; (cpu <= last) && (cpu < CPU_SETSIZE); cpu++) {
+                CPU_SET(cpu, &set);
+            }
+            p = end + strspn(end, ",");
+        }
+    }
+
+    if (sched_setaffinity(pid, sizeof(set), &set) < 0) {
+        return -errno;
+    }
+    return pcmk_ok;
+#else
+    return -EOPNOTSUPP;
+#endif
+}
+
+/*!
+ * \internal
+ * \brief Set the scheduling policy of a process
+ *
+ * \param[in] pid     Process to change (0 for this one)
+ * \param[in] policy  "other", "batch" or "idle", optionally followed by
+ *                    ":<nice value>", or "fifo" or "rr" followed by
+ *                    ":<real-time priority>"
+ *
+ * \return pcmk_ok on success, -errno otherwise
+ */
+int
+pcmk__set_sched(pid_t pid, const char *policy)
+{
+    const char *colon = strchr(policy, ':');
+    size_t len = colon? (size_t) (colon - policy) : strlen(policy);
+    int value = colon? crm_parse_int(colon + 1, "0") : 0;
+    bool realtime = FALSE;
+
+#if defined(HAVE_SCHED_SETSCHEDULER)
+    struct sched_param sp;
+    int class = SCHED_OTHER;
+
+    if ((len == 4) && !strncmp(policy, "fifo", len)) {
+        class = SCHED_FIFO;
+        realtime = TRUE;
+    } else if ((len == 2) && !strncmp(policy, "rr", len)) {
+        class = SCHED_RR;
+        realtime = TRUE;
+#  ifdef SCHED_BATCH
+    } else if ((len == 5) && !strncmp(policy, "batch", len)) {
+        class = SCHED_BATCH;
+#  endif
+#  ifdef SCHED_IDLE
+    } else if ((len == 4) && !strncmp(policy, "idle", len)) {
+        class = SCHED_IDLE;
+#  endif
+    } else if ((len != 5) || strncmp(policy, "other", len)) {
+        return -EINVAL;
+    }
+
+    memset(&sp, 0, sizeof(sp));
+    if (realtime) {
+        sp.sched_priority = value;
+    }
+    if (sched_setscheduler(pid, class, &sp) < 0) {
+        return -errno;
+    }
+#else
+    if ((len != 5) || strncmp(policy, "other", len)) {
+        return -EOPNOTSUPP;
+    }
+#endif
+
+    if (!realtime && (colon != NULL)
+        && (setpriority(PRIO_PROCESS, pid, value) < 0)) {
+        return -errno;
+    }
+    return pcmk_ok;
+}
+
+/*!
+ * \internal
+ * \brief Move a process into a control group
+ *
+ * \param[in] pid     Process to move (0 for this one)
+ * \param[in] cgroup  Control group directory (for example,
+ *                    /sys/fs/cgroup/pacemaker.slice/agents)
+ *
+ * \return pcmk_ok on success, -errno otherwise
+ */
+int
+pcmk__set_cgroup(pid_t pid, const char *cgroup)
+{
+    char *path = crm_strdup_printf("%s/cgroup.procs", cgroup);
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%lld\n",
+                       (long long) (pid? pid : getpid()));
+    int fd = open(path, O_WRONLY|O_CLOEXEC);
+    int rc = pcmk_ok;
+
+    free(path);
+    if (fd < 0) {
+        return -errno;
+    }
+    if (write(fd, buf, len) != len) {
+        rc = -errno;
+    }
+    close(fd);
+    return rc;
+}
+
+/*!
+ * \internal
+ * \brief Apply the configured placement to a daemon about to be executed
+ *
+ * \param[in] daemon  Name of daemon
+ *
+ * \note This is meant to be called by pacemakerd in the child process before
+ *       it gives up root privileges and executes the daemon.
+ */
+void
+pcmk__place_daemon(const char *daemon)
+{
+    char *value = NULL;
+    int rc = pcmk_ok;
+
+    value = pcmk__daemon_setting("daemon_cgroup", daemon);
+    if ((value != NULL) && ((rc = pcmk__set_cgroup(0, value)) != pcmk_ok)) {
+        crm_warn("Could not place %s in control group %s: %s",
+                 daemon, value, pcmk_strerror(rc));
+    }
+    free(value);
+
+    value = pcmk__daemon_setting("daemon_cpus", daemon);
+    if ((value != NULL) && ((rc = pcmk__set_cpus(0, value)) != pcmk_ok)) {
+        crm_warn("Could not restrict %s to CPUs %s: %s",
+                 daemon, value, pcmk_strerror(rc));
+    }
+    free(value);
+
+    value = pcmk__daemon_setting("daemon_sched", daemon);
+    if ((value != NULL) && ((rc = pcmk__set_sched(0, value)) != pcmk_ok)) {
+        crm_warn("Could not set scheduling policy of %s to %s: %s",
+                 daemon, value, pcmk_strerror(rc));
+    }
+    free(value);
+
+    // The lock itself does not survive exec, so the daemon takes it
+    value = pcmk__daemon_setting("daemon_lock_memory", daemon);
+    if (crm_is_true(value)) {
+        struct rlimit unlimited = { RLIM_INFINITY, RLIM_INFINITY };
+
+        if (setrlimit(RLIMIT_MEMLOCK, &unlimited) < 0) {
+            crm_perror(LOG_WARNING, "Could not allow %s to lock memory",
+                       daemon);
+        }
+    }
+    free(value);
+}
+
+/*!
+ * \internal
+ * \brief Lock this daemon's memory if configured to
+ *
+ * \param[in] daemon  Name of this daemon
+ */
+void
+pcmk__lock_daemon_memory(const char *daemon)
+{
+    char *value = pcmk__daemon_setting("daemon_lock_memory", daemon);
+
+    if (crm_is_true(value)) {
+        if (mlockall(MCL_CURRENT|MCL_FUTURE) < 0) {
+            crm_perror(LOG_WARNING, "Could not lock memory of %s", daemon);
+        } else {
+            crm_info("Locked memory of %s", daemon);
+        }
+    }
+    free(value);
+}
+
+/*!
+ * \internal
+ * \brief Apply the configured placement to a resource agent process
+ *
+ * \param[in] pid  Agent process
+ *
+ * \note If the executor is restricted to certain CPUs and no agent CPUs are
+ *       configured, agents are allowed to use every CPU, so that they do not
+ *       compete with the daemons on the CPUs kept for them.
+ */
+void
+pcmk__place_agent(pid_t pid)
+{
+    static const char *cpus = NULL;
+    static const char *cgroup = NULL;
+    static bool loaded = FALSE;
+    int rc = pcmk_ok;
+
+    if (!loaded) {
+        cgroup = daemon_option("agent_cgroup");
+        cpus = daemon_option("agent_cpus");
+        if ((cpus == NULL) && (daemon_option("daemon_cpus") != NULL)) {
+            cpus = "all";
+        }
+        loaded = TRUE;
+    }
+
+    if ((cgroup != NULL) && ((rc = pcmk__set_cgroup(pid, cgroup)) != pcmk_ok)) {
+        crm_warn("Could not place agent process %lld in control group %s: %s",
+                 (long long) pid, cgroup, pcmk_strerror(rc));
+    }
+    if ((cpus != NULL) && ((rc = pcmk__set_cpus(pid, cpus)) != pcmk_ok)) {
+        crm_warn("Could not set CPUs of agent process %lld to %s: %s",
+                 (long long) pid, cpus, pcmk_strerror(rc));
+    }
+}
@@ -18,6 +18,7 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <ctype.h>
+#include <unistd.h>
 
 /*!
  * \internal
@@ -162,3 +163,27 @@ crm_procfs_num_cores(void)
     }
     return cores? cores : 1;
 }
+
+/*!
+ * \internal
+ * \brief Get the resident set size of the current process
+ *
+ * \return Resident set size in kilobytes (or 0 if unable to determine)
+ */
+unsigned long
+crm_procfs_rss_kb(void)
+{
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    FILE *stream = fopen("/proc/self/statm", "r");
+
+    if (stream == NULL) {
+        crm_perror(LOG_INFO, "Could not open /proc/self/statm");
+        return 0;
+    }
+    if (fscanf(stream, "%lu %lu", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(stream);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
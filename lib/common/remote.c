@@ -29,6 +29,7 @@
 #include <crm/common/ipcs.h>
 #include <crm/common/xml.h>
 #include <crm/common/mainloop.h>
+#include <crm/common/internal.h>
 
 #ifdef HAVE_GNUTLS_GNUTLS_H
 #  undef KEYFILE
@@ -79,6 +80,13 @@ const int anon_tls_kx_order[] = {
 
 #define REMOTE_MSG_VERSION 1
 #define ENDIAN_LOCAL 0xBADADBBD
+#define REMOTE_RECV_MIN (16 * 1024) /* maximum TLS record size */
+
+/* Header flags (older peers neither set nor look at these, so a payload is
+ * compressed only if the peer has said it can decompress it)
+ */
+#define REMOTE_FLAG_ACCEPT_LZ4  0x0001  /* sender can decompress LZ4 */
+#define REMOTE_FLAG_LZ4         0x0002  /* payload is LZ4 compressed */
 
 struct crm_remote_header_v0 
 {
@@ -152,10 +160,128 @@ crm_initiate_client_tls_handshake(crm_remote_t * remote, int timeout_ms)
 
     if (rc < 0) {
         crm_trace("gnutls_handshake() failed with %d", rc);
+    } else if (gnutls_session_is_resumed(*remote->tls_session)) {
+        crm_trace("Resumed previous TLS session");
     }
     return rc;
 }
 
+/*
+ * TLS session resumption
+ *
+ * Servers issue session tickets (encrypted with a key that lives as long as
+ * the server process), and clients remember the session data for each server
+ * they have connected to. A client that reconnects to a server offers the data,
+ * and if the server can still decrypt the ticket, both skip the full
+ * handshake, including the key exchange. Otherwise, the handshake silently
+ * falls back to a full one.
+ */
+
+#ifdef HAVE_GNUTLS_SESSION_TICKET_ENABLE_SERVER
+static gnutls_datum_t ticket_key = { NULL, 0 };
+#endif
+
+// Last session data for each server ("host:port" -> gnutls_datum_t *)
+static GHashTable *tls_sessions = NULL;
+
+static void
+enable_session_tickets(gnutls_session_t *session)
+{
+#ifdef HAVE_GNUTLS_SESSION_TICKET_ENABLE_SERVER
+    if (ticket_key.data == NULL) {
+        int rc = gnutls_session_ticket_key_generate(&ticket_key);
+
+        if (rc != GNUTLS_E_SUCCESS) {
+            crm_warn("TLS session resumption will be unavailable: %s "
+                     CRM_XS " rc=%d", gnutls_strerror(rc), rc);
+            ticket_key.data = NULL;
+            return;
+        }
+    }
+    gnutls_session_ticket_enable_server(*session, &ticket_key);
+#endif
+}
+
+static void
+free_session_data(gpointer data)
+{
+    gnutls_datum_t *datum = data;
+
+    gnutls_free(datum->data);
+    free(datum);
+}
+
+/*!
+ * \internal
+ * \brief Offer to resume the last TLS session with a server
+ *
+ * \param[in] session  Client session (before handshake)
+ * \param[in] server   Server host name
+ * \param[in] port     Server port
+ */
+void
+pcmk__tls_client_resume(void *session, const char *server, int port)
+{
+    gnutls_datum_t *data = NULL;
+    char *key = NULL;
+
+    if ((tls_sessions == NULL) || (session == NULL) || (server == NULL)) {
+        return;
+    }
+    key = crm_strdup_printf("%s:%d", server, port);
+    data = g_hash_table_lookup(tls_sessions, key);
+    if (data != NULL) {
+        int rc = gnutls_session_set_data(*(gnutls_session_t *) session,
+                                         data->data, data->size);
+
+        if (rc != GNUTLS_E_SUCCESS) {
+            crm_trace("Not resuming TLS session with %s: %s",
+                      key, gnutls_strerror(rc));
+        }
+    }
+    free(key);
+}
+
+/*!
+ * \internal
+ * \brief Remember a TLS session with a server, so it can be resumed
+ *
+ * \param[in] session  Established client session
+ * \param[in] server   Server host name
+ * \param[in] port     Server port
+ *
+ * \note This should be called after the handshake, and again before the
+ *       session is closed (because with TLS 1.3, the data is resumable only
+ *       once the server has sent a ticket after the handshake).
+ */
+void
+pcmk__tls_client_remember(void *session, const char *server, int port)
+{
+    gnutls_datum_t *data = NULL;
+    int rc = 0;
+
+    if ((session == NULL) || (server == NULL)) {
+        return;
+    }
+
+    data = calloc(1, sizeof(gnutls_datum_t));
+    CRM_ASSERT(data != NULL);
+    rc = gnutls_session_get_data2(*(gnutls_session_t *) session, data);
+    if (rc != GNUTLS_E_SUCCESS) {
+        crm_trace("Could not get TLS session data for %s:%d: %s",
+                  server, port, gnutls_strerror(rc));
+        free(data);
+        return;
+    }
+
+    if (tls_sessions == NULL) {
+        tls_sessions = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                             free_session_data);
+    }
+    g_hash_table_replace(tls_sessions, crm_strdup_printf("%s:%d", server, port),
+                         data);
+}
+
 void *
 crm_create_anon_tls_session(int csock, int type /* GNUTLS_SERVER, GNUTLS_CLIENT */ ,
                             void *credentials)
@@ -173,6 +299,7 @@ crm_create_anon_tls_session(int csock, int type /* GNUTLS_SERVER, GNUTLS_CLIENT
         case GNUTLS_SERVER:
             gnutls_credentials_set(*session, GNUTLS_CRD_ANON,
                                    (gnutls_anon_server_credentials_t) credentials);
+            enable_session_tickets(session);
             break;
         case GNUTLS_CLIENT:
             gnutls_credentials_set(*session, GNUTLS_CRD_ANON,
@@ -196,6 +323,7 @@ create_psk_tls_session(int csock, int type /* GNUTLS_SERVER, GNUTLS_CLIENT */ ,
         case GNUTLS_SERVER:
             gnutls_credentials_set(*session, GNUTLS_CRD_PSK,
                                    (gnutls_psk_server_credentials_t) credentials);
+            enable_session_tickets(session);
             break;
         case GNUTLS_CLIENT:
             gnutls_credentials_set(*session, GNUTLS_CRD_PSK,
@@ -246,95 +374,161 @@ crm_send_tls(gnutls_session_t * session, const char *buf, size_t len)
 
     return rc < 0 ? rc : total_send;
 }
-#endif
 
+/*!
+ * \internal
+ * \brief Send a message's parts over TLS
+ *
+ * \param[in] session  TLS session to send over
+ * \param[in] iov      Message parts to send
+ * \param[in] iovs     Number of parts in \p iov
+ *
+ * \return Number of bytes sent on success, -errno otherwise
+ *
+ * \note The parts are coalesced so that small parts (such as the header) do
+ *       not each cost a TLS record. However, records are never shared between
+ *       messages, since the receiving end relies on that.
+ */
 static int
-crm_send_plaintext(int sock, const char *buf, size_t len)
+crm_send_tls_iov(gnutls_session_t *session, struct iovec *iov, int iovs)
 {
-
     int rc = 0;
-    const char *unsent = buf;
-    int total_send;
+    size_t total = 0;
 
-    if (buf == NULL) {
-        return -EINVAL;
+#ifdef HAVE_GNUTLS_RECORD_CORK
+    gnutls_record_cork(*session);
+    for (int lpc = 0; (lpc < iovs) && (rc >= 0); lpc++) {
+        rc = crm_send_tls(session, iov[lpc].iov_base, iov[lpc].iov_len);
+        total += iov[lpc].iov_len;
     }
-    total_send = len;
 
-    crm_trace("Message on socket %d: size=%llu",
-              sock, (unsigned long long) len);
-  retry:
-    rc = write(sock, unsent, len);
-    if (rc < 0) {
-        rc = -errno;
-        switch (errno) {
-            case EINTR:
-            case EAGAIN:
-                crm_trace("Retry");
-                goto retry;
-            default:
-                crm_perror(LOG_INFO,
-                           "Could only write %d of the remaining %llu bytes",
-                           rc, (unsigned long long) len);
-                break;
+    // Flush what was buffered, even if there was an error
+    do {
+        int flush_rc = gnutls_record_uncork(*session, GNUTLS_RECORD_WAIT);
+
+        if ((flush_rc == GNUTLS_E_INTERRUPTED) || (flush_rc == GNUTLS_E_AGAIN)) {
+            continue;
+        }
+        if ((flush_rc < 0) && (rc >= 0)) {
+            crm_info("TLS connection terminated: %s " CRM_XS " rc=%d",
+                     gnutls_strerror(flush_rc), flush_rc);
+            rc = -ECONNABORTED;
         }
+        break;
+    } while (TRUE);
 
-    } else if (rc < len) {
-        crm_trace("Only sent %d of %llu remaining bytes",
-                  rc, (unsigned long long) len);
-        len -= rc;
-        unsent += rc;
-        goto retry;
+#else
+    char *buffer = NULL;
+    size_t offset = 0;
 
-    } else {
-        crm_trace("Sent %d bytes: %.100s", rc, buf);
+    // Without corking, copying the parts together is cheaper than more records
+    for (int lpc = 0; lpc < iovs; lpc++) {
+        total += iov[lpc].iov_len;
     }
+    buffer = malloc(total);
+    if (buffer == NULL) {
+        return -ENOMEM;
+    }
+    for (int lpc = 0; lpc < iovs; lpc++) {
+        memcpy(buffer + offset, iov[lpc].iov_base, iov[lpc].iov_len);
+        offset += iov[lpc].iov_len;
+    }
+    rc = crm_send_tls(session, buffer, total);
+    free(buffer);
+#endif
 
-    return rc < 0 ? rc : total_send;
+    return (rc < 0)? rc : (int) total;
+}
+#endif
+
+/*!
+ * \internal
+ * \brief Send a message's parts over a plaintext socket with one system call
+ *        (unless the socket does not take everything at once)
+ *
+ * \param[in] sock  Socket to send over
+ * \param[in] iov   Message parts to send (will be modified)
+ * \param[in] iovs  Number of parts in \p iov
+ *
+ * \return Number of bytes sent on success, -errno otherwise
+ */
+static int
+crm_send_plaintext_iov(int sock, struct iovec *iov, int iovs)
+{
+    ssize_t rc = 0;
+    size_t total = 0;
 
+    for (int lpc = 0; lpc < iovs; lpc++) {
+        total += iov[lpc].iov_len;
+    }
+
+    while (iovs > 0) {
+        rc = writev(sock, iov, iovs);
+        if (rc < 0) {
+            if ((errno == EINTR) || (errno == EAGAIN)) {
+                crm_trace("Retry");
+                continue;
+            }
+            rc = -errno;
+            crm_perror(LOG_INFO, "Could not write message to socket %d", sock);
+            return rc;
+        }
+
+        // Skip whatever was written
+        while ((iovs > 0) && ((size_t) rc >= iov[0].iov_len)) {
+            rc -= iov[0].iov_len;
+            iov++;
+            iovs--;
+        }
+        if (iovs > 0) {
+            iov[0].iov_base = (char *) iov[0].iov_base + rc;
+            iov[0].iov_len -= rc;
+        }
+    }
+    crm_trace("Sent %llu bytes on socket %d", (unsigned long long) total, sock);
+    return (int) total;
 }
 
 static int
 crm_remote_sendv(crm_remote_t * remote, struct iovec * iov, int iovs)
 {
-    int rc = 0;
-
-    for (int lpc = 0; (lpc < iovs) && (rc >= 0); lpc++) {
 #ifdef HAVE_GNUTLS_GNUTLS_H
-        if (remote->tls_session) {
-            rc = crm_send_tls(remote->tls_session, iov[lpc].iov_base, iov[lpc].iov_len);
-            continue;
-        }
+    if (remote->tls_session) {
+        return crm_send_tls_iov(remote->tls_session, iov, iovs);
+    }
 #endif
-        if (remote->tcp_socket) {
-            rc = crm_send_plaintext(remote->tcp_socket, iov[lpc].iov_base, iov[lpc].iov_len);
-        } else {
-            rc = -ESOCKTNOSUPPORT;
-        }
+    if (remote->tcp_socket) {
+        return crm_send_plaintext_iov(remote->tcp_socket, iov, iovs);
     }
-    return rc;
+    return -ESOCKTNOSUPPORT;
 }
 
-int
-crm_remote_send(crm_remote_t * remote, xmlNode * msg)
+/*!
+ * \internal
+ * \brief Send serialized XML over a remote connection
+ *
+ * \param[in]     remote          Connection to send on
+ * \param[in]     xml_text        Unformatted XML to send
+ * \param[in,out] compressed      LZ4 compression of \p xml_text (computed and
+ *                                stored here if needed and not yet known)
+ * \param[in,out] compressed_len  Length of \p compressed
+ *
+ * \return Bytes sent on success, -errno otherwise
+ */
+static int
+remote_send_text(crm_remote_t *remote, const char *xml_text, char **compressed,
+                 unsigned int *compressed_len)
 {
-    int rc = pcmk_ok;
     static uint64_t id = 0;
-    char *xml_text = dump_xml_unformatted(msg);
-
+    int rc = pcmk_ok;
     struct iovec iov[2];
     struct crm_remote_header_v0 *header;
 
-    if (xml_text == NULL) {
-        crm_err("Could not send remote message: no message provided");
-        return -EINVAL;
-    }
-
     header = calloc(1, sizeof(struct crm_remote_header_v0));
     iov[0].iov_base = header;
     iov[0].iov_len = sizeof(struct crm_remote_header_v0);
 
-    iov[1].iov_base = xml_text;
+    iov[1].iov_base = (char *) xml_text;
     iov[1].iov_len = 1 + strlen(xml_text);
 
     id++;
@@ -343,6 +537,22 @@ crm_remote_send(crm_remote_t * remote, xmlNode * msg)
     header->version = REMOTE_MSG_VERSION;
     header->payload_offset = iov[0].iov_len;
     header->payload_uncompressed = iov[1].iov_len;
+#if SUPPORT_LZ4
+    header->flags |= REMOTE_FLAG_ACCEPT_LZ4;
+#endif
+
+    if (remote->lz4 && (iov[1].iov_len > CRM_BZ2_THRESHOLD)) {
+        if (*compressed == NULL) {
+            pcmk__compress_lz4(xml_text, iov[1].iov_len, iov[1].iov_len,
+                               compressed, compressed_len);
+        }
+        if (*compressed != NULL) {
+            header->flags |= REMOTE_FLAG_LZ4;
+            header->payload_compressed = *compressed_len;
+            iov[1].iov_base = *compressed;
+            iov[1].iov_len = *compressed_len;
+        }
+    }
     header->size_total = iov[0].iov_len + iov[1].iov_len;
 
     crm_trace("Sending len[0]=%d, start=%x",
@@ -353,11 +563,46 @@ crm_remote_send(crm_remote_t * remote, xmlNode * msg)
                 pcmk_strerror(rc), rc);
     }
 
-    free(iov[0].iov_base);
-    free(iov[1].iov_base);
+    free(header);
     return rc;
 }
 
+int
+crm_remote_send(crm_remote_t * remote, xmlNode * msg)
+{
+    int rc = pcmk_ok;
+    char *xml_text = dump_xml_unformatted(msg);
+    char *compressed = NULL;
+    unsigned int compressed_len = 0;
+
+    if (xml_text == NULL) {
+        crm_err("Could not send remote message: no message provided");
+        return -EINVAL;
+    }
+
+    rc = remote_send_text(remote, xml_text, &compressed, &compressed_len);
+    free(compressed);
+    free(xml_text);
+    return rc;
+}
+
+/*!
+ * \internal
+ * \brief Send a message serialized once over a remote connection
+ *
+ * \param[in]     remote  Connection to send on
+ * \param[in,out] fanout  Serialized message (any compression needed is done
+ *                        only for the first connection that needs it)
+ *
+ * \return Bytes sent on success, -errno otherwise
+ */
+int
+pcmk__remote_send_fanout(crm_remote_t *remote, pcmk__fanout_t *fanout)
+{
+    return remote_send_text(remote, fanout->text, &(fanout->remote_lz4),
+                            &(fanout->remote_lz4_len));
+}
+
 
 /*!
  * \internal
@@ -374,8 +619,37 @@ crm_remote_parse_buffer(crm_remote_t * remote)
         return NULL;
     }
 
-    /* Support compression on the receiving end now, in case we ever want to add it later */
-    if (header->payload_compressed) {
+    if (is_set(header->flags, REMOTE_FLAG_ACCEPT_LZ4)) {
+        remote->lz4 = TRUE;
+    }
+
+    if (header->payload_compressed
+        && is_set(header->flags, REMOTE_FLAG_LZ4)) {
+        int rc = 0;
+        unsigned int size_u = header->payload_uncompressed;
+        char *uncompressed = calloc(1, header->payload_offset + size_u);
+
+        crm_trace("Decompressing LZ4 message data %d bytes into %d bytes",
+                  header->payload_compressed, size_u);
+
+        rc = pcmk__decompress_lz4(remote->buffer + header->payload_offset,
+                                  header->payload_compressed,
+                                  uncompressed + header->payload_offset,
+                                  &size_u);
+        if ((rc != pcmk_ok) || (size_u != header->payload_uncompressed)) {
+            free(uncompressed);
+            return NULL;
+        }
+
+        memcpy(uncompressed, remote->buffer, header->payload_offset);       /* Preserve the header */
+        remote->buffer_size = header->payload_offset + size_u;
+
+        free(remote->buffer);
+        remote->buffer = uncompressed;
+        header = crm_remote_header(remote);
+
+    } else if (header->payload_compressed) {
+        /* Support bzip2 on the receiving end, in case any peer sends it */
         int rc = 0;
         unsigned int size_u = 1 + header->payload_uncompressed;
         char *uncompressed = calloc(1, header->payload_offset + size_u);
@@ -509,9 +783,16 @@ crm_remote_recv_once(crm_remote_t * remote)
         read_len = header->size_total;
     }
 
-    /* automatically grow the buffer when needed */
+    /* Automatically grow the buffer when needed, by doubling (and always to at
+     * least the size of a full TLS record, so records are read in one go)
+     */
     if(remote->buffer_size < read_len) {
-           remote->buffer_size = 2 * read_len;
+        size_t new_size = QB_MAX(remote->buffer_size, REMOTE_RECV_MIN);
+
+        while (new_size < read_len) {
+            new_size *= 2;
+        }
+        remote->buffer_size = new_size;
         crm_trace("Expanding buffer to %llu bytes",
                   (unsigned long long) remote->buffer_size);
 
@@ -467,6 +467,7 @@ crm_exit(crm_exit_t rc)
     mainloop_cleanup();
     crm_xml_cleanup();
 
+    pcmk__log_async_stop();
     qb_log_fini();
     crm_args_fini();
 
@@ -32,6 +32,9 @@ typedef struct {
 
 #define SCHEMA_ZERO { .v = { 0, 0 } }
 
+// Schema directory listing generated at build time (see xml/Makefile.am)
+#define PCMK__SCHEMA_INDEX "schemas.index"
+
 #define schema_scanf(s, prefix, version, suffix) \
     sscanf((s), prefix "%hhu.%hhu" suffix, &((version).v[0]), &((version).v[1]))
 
@@ -54,6 +57,7 @@ struct schema_s {
     char *location;
     char *transform;
     void *cache;
+    char *valid_digest;     // digest of the last document found valid
     enum schema_validator_e validator;
     int after_transform;
     schema_version_t version;
@@ -63,8 +67,17 @@ struct schema_s {
 
 static struct schema_s *known_schemas = NULL;
 static int xml_schema_max = 0;
+static bool schemas_loaded = FALSE;
 static bool silent_logging = FALSE;
 
+// File name -> file name, for schema directory contents listed in the index
+static GHashTable *schema_index = NULL;
+
+#if HAVE_LIBXSLT
+// Path of stylesheet file -> compiled stylesheet
+static GHashTable *xslt_cache = NULL;
+#endif
+
 static void
 xml_log(int priority, const char *fmt, ...)
 G_GNUC_PRINTF(2, 3);
@@ -85,6 +98,7 @@ xml_log(int priority, const char *fmt, ...)
 static int
 xml_latest_schema_index(void)
 {
+    crm_schema_init();
     return xml_schema_max - 3; // index from 0, ignore "pacemaker-next"/"none"
 }
 
@@ -193,6 +207,151 @@ schema_sort(const struct dirent **a, const struct dirent **b)
     return 0;
 }
 
+/*!
+ * \internal
+ * \brief Check whether a file exists in the schema directory
+ *
+ * \param[in] file  Name of file (relative to schema directory)
+ *
+ * \return TRUE if \p file is listed in the schema index (if one was loaded)
+ *         or is present in the schema directory (otherwise), else FALSE
+ */
+static bool
+schema_file_exists(const char *file)
+{
+    bool exists = FALSE;
+
+    if (schema_index != NULL) {
+        exists = (g_hash_table_lookup(schema_index, file) != NULL);
+
+    } else {
+        char *path = get_schema_path(NULL, file);
+        struct stat s;
+
+        exists = (stat(path, &s) == 0);
+        free(path);
+    }
+    return exists;
+}
+
+static int
+compare_schema_versions(const void *a, const void *b)
+{
+    const schema_version_t *a_version = a;
+    const schema_version_t *b_version = b;
+
+    for (int i = 0; i < 2; ++i) {
+        if (a_version->v[i] < b_version->v[i]) {
+            return -1;
+        } else if (a_version->v[i] > b_version->v[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*!
+ * \internal
+ * \brief Read the schema index generated at build time
+ *
+ * The index (PCMK__SCHEMA_INDEX in the schema directory) lists the names of
+ * the installed numbered schemas and upgrade stylesheets, one per line, so
+ * that the schema directory does not have to be scanned and probed.
+ *
+ * \param[in]  base      Schema directory
+ * \param[out] versions  Where to store sorted versions of numbered schemas
+ *
+ * \return Number of entries in \p versions, or -1 if no usable index exists
+ * \note On success, the caller is responsible for freeing \p *versions.
+ */
+static int
+read_schema_index(const char *base, schema_version_t **versions)
+{
+    char *path = crm_strdup_printf("%s/" PCMK__SCHEMA_INDEX, base);
+    FILE *fp = fopen(path, "r");
+    char line[256];
+    int max = 0;
+
+    if (fp == NULL) {
+        crm_trace("Could not open schema index %s: %s",
+                  path, strerror(errno));
+        free(path);
+        return -1;
+    }
+
+    schema_index = crm_str_table_new();
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        schema_version_t version = SCHEMA_ZERO;
+
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') {
+            continue;
+        }
+        g_hash_table_insert(schema_index, strdup(line), strdup(line));
+
+        if (crm_starts_with(line, "pacemaker-")
+            && crm_ends_with_ext(line, ".rng")
+            && version_from_filename(line, &version)) {
+
+            *versions = realloc_safe(*versions,
+                                     (max + 1) * sizeof(schema_version_t));
+            (*versions)[max++] = version;
+        }
+    }
+    fclose(fp);
+
+    if (max == 0) {
+        crm_notice("Ignoring schema index %s: no schemas listed", path);
+        g_hash_table_destroy(schema_index);
+        schema_index = NULL;
+        free(path);
+        return -1;
+    }
+    qsort(*versions, max, sizeof(schema_version_t), compare_schema_versions);
+    crm_debug("Loaded %d schemas from index %s", max, path);
+    free(path);
+    return max;
+}
+
+/*!
+ * \internal
+ * \brief Scan the schema directory for numbered schemas
+ *
+ * \param[in]  base      Schema directory
+ * \param[out] versions  Where to store sorted versions of numbered schemas
+ *
+ * \return Number of entries in \p versions, or -1 on error
+ * \note On success, the caller is responsible for freeing \p *versions.
+ */
+static int
+scan_schema_directory(const char *base, schema_version_t **versions)
+{
+    struct dirent **namelist = NULL;
+    int lpc, max, count = 0;
+
+    max = scandir(base, &namelist, schema_filter, schema_sort);
+    if (max < 0) {
+        crm_notice("scandir(%s) failed: %s (%d)", base, strerror(errno), errno);
+        return -1;
+    }
+
+    *versions = calloc(QB_MAX(max, 1), sizeof(schema_version_t));
+    CRM_ASSERT(*versions != NULL);
+    for (lpc = 0; lpc < max; lpc++) {
+        if (!version_from_filename(namelist[lpc]->d_name,
+                                   &((*versions)[count]))) {
+            // Shouldn't be possible, but makes static analysis happy
+            crm_err("Skipping schema '%s': could not parse version",
+                    namelist[lpc]->d_name);
+        } else {
+            count++;
+        }
+        free(namelist[lpc]);
+    }
+    free(namelist);
+    return count;
+}
+
 /*!
  * \internal
  * \brief Add given schema + auxiliary data to internal bookkeeping.
@@ -295,51 +454,47 @@ add_schema_by_version(const schema_version_t *version, int next,
 {
     bool transform_onleave = FALSE;
     int rc = pcmk_ok;
-    struct stat s;
-    char *xslt = NULL,
-         *transform_upgrade = NULL,
+    char *transform_upgrade = NULL,
          *transform_enter = NULL;
 
     /* prologue for further transform_expected handling */
     if (transform_expected) {
         /* check if there's suitable "upgrade" stylesheet */
         transform_upgrade = schema_strdup_printf("upgrade-", *version, ".xsl");
-        xslt = get_schema_path(NULL, transform_upgrade);
     }
 
     if (!transform_expected) {
         /* jump directly to the end */
 
-    } else if (stat(xslt, &s) == 0) {
+    } else if (schema_file_exists(transform_upgrade)) {
         /* perhaps there's also a targeted "upgrade-enter" stylesheet */
         transform_enter = schema_strdup_printf("upgrade-", *version, "-enter.xsl");
-        free(xslt);
-        xslt = get_schema_path(NULL, transform_enter);
-        if (stat(xslt, &s) != 0) {
+        if (!schema_file_exists(transform_enter)) {
             /* or initially, at least a generic one */
-            crm_debug("Upgrade-enter transform %s not found", xslt);
-            free(xslt);
-            xslt = get_schema_path(NULL, "upgrade-enter.xsl");
-            if (stat(xslt, &s) != 0) {
-                crm_debug("Upgrade-enter transform %s not found, either", xslt);
-                free(xslt);
-                xslt = NULL;
+            crm_debug("Upgrade-enter transform %s not found", transform_enter);
+            free(transform_enter);
+            transform_enter = strdup("upgrade-enter.xsl");
+            if (!schema_file_exists(transform_enter)) {
+                crm_debug("Upgrade-enter transform %s not found, either",
+                          transform_enter);
+                free(transform_enter);
+                transform_enter = NULL;
             }
         }
-        /* xslt contains full path to "upgrade-enter" stylesheet */
-        if (xslt != NULL) {
+        /* transform_enter names the "upgrade-enter" stylesheet */
+        if (transform_enter != NULL) {
             /* then there should be "upgrade-leave" counterpart (enter->leave) */
-            memcpy(strrchr(xslt, '-') + 1, "leave", sizeof("leave") - 1);
-            transform_onleave = (stat(xslt, &s) == 0);
-            free(xslt);
-        } else {
-            free(transform_enter);
-            transform_enter = NULL;
+            char *transform_leave = strdup(transform_enter);
+
+            CRM_ASSERT(transform_leave != NULL);
+            memcpy(strrchr(transform_leave, '-') + 1, "leave",
+                   sizeof("leave") - 1);
+            transform_onleave = schema_file_exists(transform_leave);
+            free(transform_leave);
         }
 
     } else {
-        crm_err("Upgrade transform %s not found", xslt);
-        free(xslt);
+        crm_err("Upgrade transform %s not found", transform_upgrade);
         free(transform_upgrade);
         transform_upgrade = NULL;
         next = -1;
@@ -357,54 +512,49 @@ add_schema_by_version(const schema_version_t *version, int next,
 
 /*!
  * \internal
- * \brief Load pacemaker schemas into cache
+ * \brief Load pacemaker schemas into cache, if not already done
+ *
+ * The schema catalogue is loaded on first use rather than when the XML
+ * library is initialized, so that callers that never validate or upgrade
+ * XML don't pay for it. The build-time schema index is preferred when
+ * present, falling back to scanning the schema directory.
  */
 void
 crm_schema_init(void)
 {
     int lpc, max;
     const char *base = get_schema_root();
-    struct dirent **namelist = NULL;
+    schema_version_t *versions = NULL;
     const schema_version_t zero = SCHEMA_ZERO;
 
-    max = scandir(base, &namelist, schema_filter, schema_sort);
-    if (max < 0) {
-        crm_notice("scandir(%s) failed: %s (%d)", base, strerror(errno), errno);
+    if (schemas_loaded) {
+        return;
+    }
+    schemas_loaded = TRUE;
 
-    } else {
-        for (lpc = 0; lpc < max; lpc++) {
-            bool transform_expected = FALSE;
-            int next = 0;
-            schema_version_t version = SCHEMA_ZERO;
-
-            if (!version_from_filename(namelist[lpc]->d_name, &version)) {
-                // Shouldn't be possible, but makes static analysis happy
-                crm_err("Skipping schema '%s': could not parse version",
-                        namelist[lpc]->d_name);
-                continue;
-            }
-            if ((lpc + 1) < max) {
-                schema_version_t next_version = SCHEMA_ZERO;
+    max = read_schema_index(base, &versions);
+    if (max < 0) {
+        max = scan_schema_directory(base, &versions);
+    }
 
-                if (version_from_filename(namelist[lpc+1]->d_name, &next_version)
-                        && (version.v[0] < next_version.v[0])) {
-                    transform_expected = TRUE;
-                }
+    for (lpc = 0; lpc < max; lpc++) {
+        bool transform_expected = FALSE;
+        int next = 0;
 
-            } else {
-                next = -1;
-            }
-            if (add_schema_by_version(&version, next, transform_expected)
-                    == -ENOENT) {
-                break;
+        if ((lpc + 1) < max) {
+            if (versions[lpc].v[0] < versions[lpc+1].v[0]) {
+                transform_expected = TRUE;
             }
-        }
 
-        for (lpc = 0; lpc < max; lpc++) {
-            free(namelist[lpc]);
+        } else {
+            next = -1;
+        }
+        if (add_schema_by_version(&versions[lpc], next, transform_expected)
+                == -ENOENT) {
+            break;
         }
-        free(namelist);
     }
+    free(versions);
 
     add_schema(schema_validator_rng, &zero, "pacemaker-next",
                "pacemaker-next.rng", NULL, NULL, FALSE, -1);
@@ -413,32 +563,6 @@ crm_schema_init(void)
                "N/A", NULL, NULL, FALSE, -1);
 }
 
-#if 0
-static void
-relaxng_invalid_stderr(void *userData, xmlErrorPtr error)
-{
-    /*
-       Structure xmlError
-       struct _xmlError {
-       int      domain  : What part of the library raised this er
-       int      code    : The error code, e.g. an xmlParserError
-       char *   message : human-readable informative error messag
-       xmlErrorLevel    level   : how consequent is the error
-       char *   file    : the filename
-       int      line    : the line number if available
-       char *   str1    : extra string information
-       char *   str2    : extra string information
-       char *   str3    : extra string information
-       int      int1    : extra number information
-       int      int2    : column number of the error or 0 if N/A
-       void *   ctxt    : the parser context if available
-       void *   node    : the node in the tree
-       }
-     */
-    crm_err("Structured error: line=%d, level=%d %s", error->line, error->level, error->message);
-}
-#endif
-
 static gboolean
 validate_with_relaxng(xmlDocPtr doc, gboolean to_logs, const char *relaxng_file,
                       relaxng_ctx_cache_t **cached_ctx)
@@ -560,6 +684,7 @@ crm_schema_cleanup(void)
                 known_schemas[lpc].cache = NULL;
                 break;
         }
+        free(known_schemas[lpc].valid_digest);
         free(known_schemas[lpc].name);
         free(known_schemas[lpc].location);
         free(known_schemas[lpc].transform);
@@ -567,6 +692,20 @@ crm_schema_cleanup(void)
     }
     free(known_schemas);
     known_schemas = NULL;
+    xml_schema_max = 0;
+    schemas_loaded = FALSE;
+
+    if (schema_index != NULL) {
+        g_hash_table_destroy(schema_index);
+        schema_index = NULL;
+    }
+
+#if HAVE_LIBXSLT
+    if (xslt_cache != NULL) {
+        g_hash_table_destroy(xslt_cache);
+        xslt_cache = NULL;
+    }
+#endif
 
     xsltCleanupGlobals();  /* XXX proper, explicit reshaking regarding
                                   init/fini routines is pending (pair
@@ -580,6 +719,7 @@ validate_with(xmlNode *xml, int method, gboolean to_logs)
     xmlDocPtr doc = NULL;
     gboolean valid = FALSE;
     char *file = NULL;
+    char *digest = NULL;
 
     if (method < 0) {
         return FALSE;
@@ -591,6 +731,19 @@ validate_with(xmlNode *xml, int method, gboolean to_logs)
 
     CRM_CHECK(xml != NULL, return FALSE);
     doc = getDocPtr(xml);
+
+    /* Tools and upgrades often validate the same document against the same
+     * schema more than once, and serializing it is much cheaper than
+     * validating it again
+     */
+    digest = calculate_xml_versioned_digest(xmlDocGetRootElement(doc), FALSE,
+                                            FALSE, CRM_FEATURE_SET);
+    if (safe_str_eq(digest, known_schemas[method].valid_digest)) {
+        crm_trace("Already validated with %s", known_schemas[method].name);
+        free(digest);
+        return TRUE;
+    }
+
     file = get_schema_path(known_schemas[method].name,
                            known_schemas[method].location);
 
@@ -608,6 +761,12 @@ validate_with(xmlNode *xml, int method, gboolean to_logs)
             break;
     }
 
+    if (valid) {
+        free(known_schemas[method].valid_digest);
+        known_schemas[method].valid_digest = digest;
+    } else {
+        free(digest);
+    }
     free(file);
     return valid;
 }
@@ -686,6 +845,7 @@ validate_xml(xmlNode *xml_blob, const char *validation, gboolean to_logs)
 {
     int version = 0;
 
+    crm_schema_init();
     if (validation == NULL) {
         validation = crm_element_value(xml_blob, XML_ATTR_VALIDATION);
     }
@@ -883,23 +1043,59 @@ cib_upgrade_err(void *ctx, const char *fmt, ...)
 #define PCMK_SCHEMAS_EMERGENCY_XSLT 1
 #endif
 
-static xmlNode *
-apply_transformation(xmlNode *xml, const char *transform, gboolean to_logs)
+/*!
+ * \internal
+ * \brief Get a compiled stylesheet, parsing it only the first time it is used
+ *
+ * \param[in] transform  Name of stylesheet file in schema directory
+ *
+ * \return Compiled stylesheet (owned by cache), or NULL if it could not be
+ *         parsed
+ */
+static xsltStylesheet *
+get_transformation(const char *transform)
 {
-    char *xform = NULL;
-    xmlNode *out = NULL;
-    xmlDocPtr res = NULL;
-    xmlDocPtr doc = NULL;
+    char *xform = get_schema_path(NULL, transform);
     xsltStylesheet *xslt = NULL;
-#if PCMK_SCHEMAS_EMERGENCY_XSLT != 0
-    xmlChar *emergency_result;
-    int emergency_txt_len;
-    int emergency_res;
-#endif
 
-    CRM_CHECK(xml != NULL, return FALSE);
-    doc = getDocPtr(xml);
-    xform = get_schema_path(NULL, transform);
+    if (xslt_cache == NULL) {
+        xslt_cache = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                           (GDestroyNotify) xsltFreeStylesheet);
+    }
+
+    xslt = g_hash_table_lookup(xslt_cache, xform);
+    if (xslt != NULL) {
+        free(xform);
+        return xslt;
+    }
+
+    xslt = xsltParseStylesheetFile((const xmlChar *)xform);
+    if (xslt == NULL) {
+        free(xform);
+        return NULL;
+    }
+    crm_trace("Compiled stylesheet %s", xform);
+    g_hash_table_insert(xslt_cache, xform, xslt);
+    return xslt;
+}
+
+/*!
+ * \internal
+ * \brief Apply a stylesheet to a document
+ *
+ * \param[in]  doc        Document to transform
+ * \param[in]  transform  Name of stylesheet file in schema directory
+ * \param[in]  to_logs    Whether to log messages rather than print them
+ * \param[out] used       Where to store the compiled stylesheet applied
+ *
+ * \return Newly allocated result document, or NULL on error
+ */
+static xmlDocPtr
+transform_doc(xmlDocPtr doc, const char *transform, gboolean to_logs,
+              xsltStylesheet **used)
+{
+    xmlDocPtr res = NULL;
+    xsltStylesheet *xslt = NULL;
 
     xmlLoadExtDtdDefaultValue = 1;
     xmlSubstituteEntitiesDefault(1);
@@ -911,40 +1107,66 @@ apply_transformation(xmlNode *xml, const char *transform, gboolean to_logs)
         xsltSetGenericErrorFunc(&crm_log_level, cib_upgrade_err);
     }
 
-    xslt = xsltParseStylesheetFile((const xmlChar *)xform);
+    xslt = get_transformation(transform);
     CRM_CHECK(xslt != NULL, goto cleanup);
 
     res = xsltApplyStylesheet(xslt, doc, NULL);
     CRM_CHECK(res != NULL, goto cleanup);
+    *used = xslt;
 
+  cleanup:
     xsltSetGenericErrorFunc(NULL, NULL);  /* restore default one */
+    return res;
+}
 
-
+/*!
+ * \internal
+ * \brief Get the XML of a transformation result
+ *
+ * \param[in] res   Result document (will be freed or owned by result)
+ * \param[in] xslt  Stylesheet that produced \p res
+ *
+ * \return Root of transformed XML, or NULL on error
+ */
+static xmlNode *
+transform_result(xmlDocPtr res, xsltStylesheet *xslt)
+{
+    xmlNode *out = NULL;
 #if PCMK_SCHEMAS_EMERGENCY_XSLT != 0
+    xmlChar *emergency_result;
+    int emergency_txt_len;
+    int emergency_res;
+
     emergency_res = xsltSaveResultToString(&emergency_result,
                                            &emergency_txt_len, res, xslt);
     xmlFreeDoc(res);
-    CRM_CHECK(emergency_res == 0, goto cleanup);
+    CRM_CHECK(emergency_res == 0, return NULL);
     out = string2xml((const char *) emergency_result);
     free(emergency_result);
 #else
     out = xmlDocGetRootElement(res);
 #endif
+    return out;
+}
 
-  cleanup:
-    if (xslt) {
-        xsltFreeStylesheet(xslt);
-    }
-
-    free(xform);
+static xmlNode *
+apply_transformation(xmlNode *xml, const char *transform, gboolean to_logs)
+{
+    xsltStylesheet *xslt = NULL;
+    xmlDocPtr res = NULL;
 
-    return out;
+    CRM_CHECK(xml != NULL, return FALSE);
+    res = transform_doc(getDocPtr(xml), transform, to_logs, &xslt);
+    return (res == NULL)? NULL : transform_result(res, xslt);
 }
 
 /*!
  * \internal
  * \brief Possibly full enter->upgrade->leave trip per internal bookkeeping.
  *
+ * Each phase is applied directly to the result document of the previous one,
+ * and only the final result is turned back into XML.
+ *
  * \note Only emits warnings about enter/leave phases in case of issues.
  */
 static xmlNode *
@@ -952,49 +1174,55 @@ apply_upgrade(xmlNode *xml, const struct schema_s *schema, gboolean to_logs)
 {
     bool transform_onleave = schema->transform_onleave;
     char *transform_leave;
-    xmlNode *upgrade = NULL,
-            *final = NULL;
+    xmlDocPtr doc = NULL;
+    xmlDocPtr upgrade = NULL,
+              final = NULL;
+    xsltStylesheet *xslt = NULL;
+
+    CRM_CHECK(xml != NULL, return NULL);
+    doc = getDocPtr(xml);
 
     if (schema->transform_enter) {
         crm_debug("Upgrading %s-style configuration, pre-upgrade phase with %s",
                   schema->name, schema->transform_enter);
-        upgrade = apply_transformation(xml, schema->transform_enter, to_logs);
+        upgrade = transform_doc(doc, schema->transform_enter, to_logs, &xslt);
         if (upgrade == NULL) {
             crm_warn("Upgrade-enter transformation %s failed",
                      schema->transform_enter);
             transform_onleave = FALSE;
         }
     }
-    if (upgrade == NULL) {
-        upgrade = xml;
-    }
 
     crm_debug("Upgrading %s-style configuration, main phase with %s",
               schema->name, schema->transform);
-    final = apply_transformation(upgrade, schema->transform, to_logs);
-    if (upgrade != xml) {
-        free_xml(upgrade);
+    final = transform_doc((upgrade? upgrade : doc), schema->transform, to_logs,
+                          &xslt);
+    if (upgrade != NULL) {
+        xmlFreeDoc(upgrade);
         upgrade = NULL;
     }
 
     if (final != NULL && transform_onleave) {
+        xsltStylesheet *leave_xslt = NULL;
+
         upgrade = final;
         transform_leave = strdup(schema->transform_enter);
         /* enter -> leave */
         memcpy(strrchr(transform_leave, '-') + 1, "leave", sizeof("leave") - 1);
         crm_debug("Upgrading %s-style configuration, post-upgrade phase with %s",
                   schema->name, transform_leave);
-        final = apply_transformation(upgrade, transform_leave, to_logs);
+        final = transform_doc(upgrade, transform_leave, to_logs, &leave_xslt);
         if (final == NULL) {
             crm_warn("Upgrade-leave transformation %s failed", transform_leave);
             final = upgrade;
         } else {
-            free_xml(upgrade);
+            xmlFreeDoc(upgrade);
+            xslt = leave_xslt;
         }
         free(transform_leave);
     }
 
-    return final;
+    return (final == NULL)? NULL : transform_result(final, xslt);
 }
 
 #endif  /* HAVE_LIBXSLT */
@@ -1002,6 +1230,7 @@ apply_upgrade(xmlNode *xml, const struct schema_s *schema, gboolean to_logs)
 const char *
 get_schema_name(int version)
 {
+    crm_schema_init();
     if (version < 0 || version >= xml_schema_max) {
         return "unknown";
     }
@@ -1013,6 +1242,7 @@ get_schema_version(const char *name)
 {
     int lpc = 0;
 
+    crm_schema_init();
     if (name == NULL) {
         name = "none";
     }
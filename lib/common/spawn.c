@@ -0,0 +1,226 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU Lesser General Public License
+ * version 2.1 or later (LGPLv2.1+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sched.h>
+
+#ifdef HAVE_SPAWN_H
+#  include <spawn.h>
+#endif
+
+#include <crm/crm.h>
+#include <crm/common/internal.h>
+
+/*
+ * Agent process spawning
+ *
+ * Forking a daemon copies its page tables, and then each page that either
+ * process writes to, which for a daemon with a large heap can cost more than
+ * running a short agent. posix_spawn() does not, since the C library implements
+ * it with vfork() or clone(CLONE_VM), so agents are run with it whenever what
+ * the child must do before exec can be expressed as spawn attributes and file
+ * actions. Callers fall back to fork() when it cannot (or when
+ * PCMK_agent_spawn is "false").
+ */
+
+extern char **environ;
+
+static int spawn_enabled = -1;
+
+/*!
+ * \internal
+ * \brief Check whether pcmk__spawn() can be used at all
+ *
+ * \return true if this build supports spawning and it is not disabled
+ */
+bool
+pcmk__spawn_enabled(void)
+{
+#if defined(HAVE_POSIX_SPAWNP)
+    if (spawn_enabled < 0) {
+        const char *value = daemon_option("agent_spawn");
+
+        spawn_enabled = (value == NULL) || crm_is_true(value);
+    }
+    return spawn_enabled;
+#else
+    return false;
+#endif
+}
+
+/*!
+ * \internal
+ * \brief Run a program in a new process without forking this one
+ *
+ * \param[in]  file       Program to run (searched for in PATH if no slash)
+ * \param[in]  argv       Program arguments (NULL-terminated)
+ * \param[in]  envp       Program environment (or NULL to use ours)
+ * \param[in]  fds        Descriptors to use as the child's stdin, stdout and
+ *                        stderr (-1 to inherit ours)
+ * \param[in]  flags      Group of enum pcmk__spawn_flags
+ * \param[in]  sigmask    Child's signal mask (or NULL to inherit ours)
+ * \param[out] pid        Where to store the child's process ID
+ *
+ * \return pcmk_ok on success, -ENOTSUP if the request cannot be done by
+ *         spawning (so the caller should fork instead), or another -errno if
+ *         the program could not be run
+ *
+ * \note SIGPIPE is always reset to its default action in the child.
+ */
+int
+pcmk__spawn(const char *file, char *const argv[], char *const envp[],
+            const int fds[3], uint32_t flags, const sigset_t *sigmask,
+            pid_t *pid)
+{
+#if defined(HAVE_POSIX_SPAWNP)
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigdefault;
+    short attr_flags = POSIX_SPAWN_SETSIGDEF;
+    int rc = 0;
+
+#  if !defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP)
+    if (is_set(flags, pcmk__spawn_close_fds)) {
+        return -ENOTSUP;
+    }
+#  endif
+#  if !defined(HAVE_SCHED_SETSCHEDULER)
+    clear_bit(flags, pcmk__spawn_reset_sched);
+#  endif
+
+    if (!pcmk__spawn_enabled()) {
+        return -ENOTSUP;
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    for (int lpc = 0; lpc < 3; lpc++) {
+        if ((fds[lpc] >= 0) && (fds[lpc] != lpc)) {
+            posix_spawn_file_actions_adddup2(&actions, fds[lpc], lpc);
+        }
+    }
+#  if defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP)
+    if (is_set(flags, pcmk__spawn_close_fds)) {
+        posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+    }
+#  endif
+
+    sigemptyset(&sigdefault);
+    sigaddset(&sigdefault, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &sigdefault);
+
+    if (sigmask != NULL) {
+        attr_flags |= POSIX_SPAWN_SETSIGMASK;
+        posix_spawnattr_setsigmask(&attr, sigmask);
+    }
+    if (is_set(flags, pcmk__spawn_new_pgroup)) {
+        attr_flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, 0);
+    }
+#  if defined(HAVE_SCHED_SETSCHEDULER)
+    if (is_set(flags, pcmk__spawn_reset_sched)
+        && (sched_getscheduler(0) != SCHED_OTHER)) {
+        struct sched_param sp;
+
+        memset(&sp, 0, sizeof(sp));
+        attr_flags |= POSIX_SPAWN_SETSCHEDULER;
+        posix_spawnattr_setschedpolicy(&attr, SCHED_OTHER);
+        posix_spawnattr_setschedparam(&attr, &sp);
+    }
+#  endif
+    posix_spawnattr_setflags(&attr, attr_flags);
+
+    rc = posix_spawnp(pid, file, &actions, &attr, argv,
+                      (envp? envp : environ));
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return -rc;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+/*!
+ * \internal
+ * \brief Create an environment for a spawned process
+ *
+ * \param[in] vars  Variables to set (in addition to, or replacing, those in
+ *                  our own environment)
+ *
+ * \return Newly allocated NULL-terminated environment array (the caller is
+ *         responsible for freeing it with pcmk__spawn_env_free())
+ */
+char **
+pcmk__spawn_env_new(GHashTable *vars)
+{
+    size_t len = 0;
+    size_t n = 0;
+    char **env = NULL;
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+
+    for (char **e = environ; *e != NULL; e++) {
+        len++;
+    }
+    if (vars != NULL) {
+        len += g_hash_table_size(vars);
+    }
+
+    env = calloc(len + 1, sizeof(char *));
+    CRM_ASSERT(env != NULL);
+
+    if (vars != NULL) {
+        g_hash_table_iter_init(&iter, vars);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            env[n++] = crm_strdup_printf("%s=%s", (const char *) key,
+                                         (const char *) value);
+        }
+    }
+
+    for (char **e = environ; *e != NULL; e++) {
+        const char *eq = strchr(*e, '=');
+
+        if (vars != NULL && (eq != NULL)) {
+            char *name = strndup(*e, eq - *e);
+            bool replaced = (g_hash_table_lookup(vars, name) != NULL);
+
+            free(name);
+            if (replaced) {
+                continue;
+            }
+        }
+        env[n++] = strdup(*e);
+    }
+    return env;
+}
+
+/*!
+ * \internal
+ * \brief Free an environment created by pcmk__spawn_env_new()
+ *
+ * \param[in] env  Environment to free
+ */
+void
+pcmk__spawn_env_free(char **env)
+{
+    if (env != NULL) {
+        for (char **e = env; *e != NULL; e++) {
+            free(*e);
+        }
+        free(env);
+    }
+}
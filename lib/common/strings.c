@@ -15,6 +15,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <bzlib.h>
+#if SUPPORT_LZ4
+#  include <lz4.h>
+#endif
 #include <sys/types.h>
 
 char *
@@ -440,6 +443,82 @@ crm_compress_string(const char *data, int length, int max, char **result, unsign
     return TRUE;
 }
 
+/*!
+ * \internal
+ * \brief Compress data with LZ4, which is much faster than bzip2
+ *
+ * \param[in]  data        Data to compress
+ * \param[in]  length      Number of bytes of \p data
+ * \param[in]  max         Maximum size of result (or 0 for no limit)
+ * \param[out] result      Where to store newly allocated compressed data
+ * \param[out] result_len  Where to store number of bytes of \p result
+ *
+ * \return TRUE on success, FALSE if the result would be larger than \p max
+ *         or LZ4 is not supported by this build
+ */
+bool
+pcmk__compress_lz4(const char *data, unsigned int length, unsigned int max,
+                   char **result, unsigned int *result_len)
+{
+#if SUPPORT_LZ4
+    int rc = 0;
+    char *compressed = NULL;
+
+    if ((max == 0) || (max > (unsigned int) LZ4_compressBound(length))) {
+        max = LZ4_compressBound(length);
+    }
+    compressed = malloc(max);
+    CRM_ASSERT(compressed != NULL);
+
+    rc = LZ4_compress_default(data, compressed, length, max);
+    if (rc <= 0) {
+        crm_trace("Could not compress %u bytes into %u with LZ4", length, max);
+        free(compressed);
+        return FALSE;
+    }
+
+    crm_trace("Compressed %u bytes into %d with LZ4 (ratio %u:1)",
+              length, rc, length / rc);
+    *result = compressed;
+    *result_len = rc;
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+/*!
+ * \internal
+ * \brief Decompress data compressed by pcmk__compress_lz4()
+ *
+ * \param[in]     data        Compressed data
+ * \param[in]     length      Number of bytes of \p data
+ * \param[out]    result      Where to store uncompressed data
+ * \param[in,out] result_len  Size of \p result on input, number of bytes
+ *                            stored on output
+ *
+ * \return pcmk_ok on success, -errno otherwise
+ */
+int
+pcmk__decompress_lz4(const char *data, unsigned int length, char *result,
+                     unsigned int *result_len)
+{
+#if SUPPORT_LZ4
+    int rc = LZ4_decompress_safe(data, result, length, *result_len);
+
+    if (rc < 0) {
+        crm_err("LZ4 decompression of %u bytes failed " CRM_XS " rc=%d",
+                length, rc);
+        return -EILSEQ;
+    }
+    *result_len = rc;
+    return pcmk_ok;
+#else
+    crm_err("Cannot decompress LZ4 data: not supported by this build");
+    return -EPROTONOSUPPORT;
+#endif
+}
+
 /*!
  * \brief Compare two strings alphabetically (case-insensitive)
  *
@@ -477,3 +556,298 @@ crm_strdup_printf(char const *format, ...)
     va_end(ap);
     return string;
 }
+
+/*
+ * Shared strings and string tables
+ *
+ * Daemons that keep many copies of the same strings and parameter tables (such
+ * as the controller's resource history) can keep each distinct string once,
+ * with a reference count, and each distinct table once, found by a digest of
+ * its contents. A shared table is immutable: whoever needs it again, in
+ * whatever layer, takes another reference instead of copying it, and its
+ * digest is calculated only once.
+ *
+ * These functions are not thread-safe, and are meant for use in a daemon's
+ * main thread only.
+ */
+
+struct shared_table_s {
+    char *digest;
+    GHashTable *table;
+    unsigned int refs;
+};
+
+static GHashTable *shared_strings = NULL;           // string -> references
+static GHashTable *shared_tables = NULL;            // digest -> shared_table_s
+static GHashTable *shared_tables_by_table = NULL;   // table -> shared_table_s
+
+/*!
+ * \internal
+ * \brief Get a shared copy of a string
+ *
+ * \param[in] s  String to share (if NULL, NULL is returned)
+ *
+ * \return String with same contents as \p s, to be treated as read-only and
+ *         released with pcmk__str_release()
+ */
+const char *
+pcmk__str_intern(const char *s)
+{
+    gpointer key = NULL;
+    gpointer refs = NULL;
+
+    if (s == NULL) {
+        return NULL;
+    }
+    if (shared_strings == NULL) {
+        shared_strings = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                               free, NULL);
+    }
+    if (g_hash_table_lookup_extended(shared_strings, s, &key, &refs)) {
+        g_hash_table_insert(shared_strings, key,
+                            GUINT_TO_POINTER(GPOINTER_TO_UINT(refs) + 1));
+        return key;
+    }
+    key = strdup(s);
+    CRM_ASSERT(key != NULL);
+    g_hash_table_insert(shared_strings, key, GUINT_TO_POINTER(1));
+    return key;
+}
+
+/*!
+ * \internal
+ * \brief Release a reference to a shared string
+ *
+ * \param[in] s  String returned by pcmk__str_intern() (or NULL)
+ */
+void
+pcmk__str_release(const char *s)
+{
+    gpointer key = NULL;
+    gpointer refs = NULL;
+
+    if ((s == NULL) || (shared_strings == NULL)
+        || !g_hash_table_lookup_extended(shared_strings, s, &key, &refs)) {
+        return;
+    }
+    if (GPOINTER_TO_UINT(refs) <= 1) {
+        g_hash_table_remove(shared_strings, key);
+    } else {
+        g_hash_table_insert(shared_strings, key,
+                            GUINT_TO_POINTER(GPOINTER_TO_UINT(refs) - 1));
+    }
+}
+
+static void
+release_shared_string(gpointer data)
+{
+    pcmk__str_release(data);
+}
+
+/* Digest of a string table's contents (independent of hash table order).
+ * Each name and value is prefixed by its length so the encoding is unambiguous.
+ */
+static char *
+str_table_digest(GHashTable *table)
+{
+    GList *keys = g_list_sort(g_hash_table_get_keys(table),
+                              (GCompareFunc) strcmp);
+    size_t len = 1;
+    char *buffer = NULL;
+    char *end = NULL;
+    char *digest = NULL;
+
+    for (GList *iter = keys; iter != NULL; iter = iter->next) {
+        const char *value = g_hash_table_lookup(table, iter->data);
+
+        len += strlen(iter->data) + (value? strlen(value) : 0) + 44;
+    }
+    buffer = malloc(len);
+    CRM_ASSERT(buffer != NULL);
+    end = buffer;
+    for (GList *iter = keys; iter != NULL; iter = iter->next) {
+        const char *value = g_hash_table_lookup(table, iter->data);
+
+        if (value == NULL) {
+            value = "";
+        }
+        end += sprintf(end, "%lu:%s%lu:%s",
+                       (unsigned long) strlen(iter->data),
+                       (const char *) iter->data,
+                       (unsigned long) strlen(value), value);
+    }
+    *end = '\0';
+    g_list_free(keys);
+
+    digest = crm_md5sum(buffer);
+    free(buffer);
+    return digest;
+}
+
+static void
+free_shared_table(gpointer data)
+{
+    struct shared_table_s *shared = data;
+
+    g_hash_table_destroy(shared->table);
+    free(shared->digest);
+    free(shared);
+}
+
+/*!
+ * \internal
+ * \brief Get a shared, immutable copy of a string table
+ *
+ * \param[in] table  Table to share (if NULL, NULL is returned)
+ *
+ * \return Table with same contents as \p table (which is \p table itself if it
+ *         is already shared), to be released with pcmk__str_table_release()
+ */
+GHashTable *
+pcmk__str_table_share(GHashTable *table)
+{
+    struct shared_table_s *shared = NULL;
+    char *digest = NULL;
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+
+    if (table == NULL) {
+        return NULL;
+    }
+    if (shared_tables == NULL) {
+        shared_tables = g_hash_table_new_full(crm_str_hash, g_str_equal, NULL,
+                                              free_shared_table);
+        shared_tables_by_table = g_hash_table_new(g_direct_hash,
+                                                  g_direct_equal);
+    }
+
+    // Passing a shared table on costs only a reference
+    shared = g_hash_table_lookup(shared_tables_by_table, table);
+    if (shared != NULL) {
+        shared->refs++;
+        return shared->table;
+    }
+
+    digest = str_table_digest(table);
+    shared = g_hash_table_lookup(shared_tables, digest);
+    if (shared != NULL) {
+        free(digest);
+        shared->refs++;
+        return shared->table;
+    }
+
+    shared = calloc(1, sizeof(struct shared_table_s));
+    CRM_ASSERT(shared != NULL);
+    shared->digest = digest;
+    shared->refs = 1;
+    shared->table = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                          release_shared_string,
+                                          release_shared_string);
+    g_hash_table_iter_init(&iter, table);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        g_hash_table_insert(shared->table, (gpointer) pcmk__str_intern(key),
+                            (gpointer) pcmk__str_intern(value));
+    }
+    g_hash_table_insert(shared_tables, shared->digest, shared);
+    g_hash_table_insert(shared_tables_by_table, shared->table, shared);
+    return shared->table;
+}
+
+/*!
+ * \internal
+ * \brief Check whether a string table is shared
+ *
+ * \param[in] table  Table to check
+ *
+ * \return TRUE if \p table was returned by pcmk__str_table_share() and is still
+ *         referenced, otherwise FALSE
+ */
+bool
+pcmk__str_table_is_shared(GHashTable *table)
+{
+    return (table != NULL) && (shared_tables_by_table != NULL)
+           && (g_hash_table_lookup(shared_tables_by_table, table) != NULL);
+}
+
+/*!
+ * \internal
+ * \brief Get the digest of a shared string table's contents
+ *
+ * \param[in] table  Shared table
+ *
+ * \return Digest calculated when \p table was first shared (or NULL if
+ *         \p table is not shared)
+ */
+const char *
+pcmk__str_table_digest(GHashTable *table)
+{
+    struct shared_table_s *shared = NULL;
+
+    if ((table != NULL) && (shared_tables_by_table != NULL)) {
+        shared = g_hash_table_lookup(shared_tables_by_table, table);
+    }
+    return shared? shared->digest : NULL;
+}
+
+/*!
+ * \internal
+ * \brief Release a reference to a shared string table
+ *
+ * \param[in] table  Table returned by pcmk__str_table_share() (or NULL)
+ */
+void
+pcmk__str_table_release(GHashTable *table)
+{
+    struct shared_table_s *shared = NULL;
+
+    if ((table == NULL) || (shared_tables_by_table == NULL)) {
+        return;
+    }
+    shared = g_hash_table_lookup(shared_tables_by_table, table);
+    CRM_CHECK(shared != NULL, return);
+    if (--shared->refs == 0) {
+        g_hash_table_remove(shared_tables_by_table, table);
+        g_hash_table_remove(shared_tables, shared->digest);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Get statistics about shared strings and string tables
+ *
+ * \param[out] strings      Where to store number of distinct shared strings
+ * \param[out] string_bytes Where to store memory used by their text
+ * \param[out] string_refs  Where to store number of references to them
+ * \param[out] tables       Where to store number of distinct shared tables
+ * \param[out] table_refs   Where to store number of references to them
+ */
+void
+pcmk__str_sharing_stats(unsigned long long *strings,
+                        unsigned long long *string_bytes,
+                        unsigned long long *string_refs,
+                        unsigned long long *tables,
+                        unsigned long long *table_refs)
+{
+    GHashTableIter iter;
+    gpointer key = NULL;
+    gpointer value = NULL;
+
+    *strings = *string_bytes = *string_refs = *tables = *table_refs = 0;
+
+    if (shared_strings != NULL) {
+        g_hash_table_iter_init(&iter, shared_strings);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            (*strings)++;
+            *string_bytes += strlen(key) + 1;
+            *string_refs += GPOINTER_TO_UINT(value);
+        }
+    }
+    if (shared_tables != NULL) {
+        g_hash_table_iter_init(&iter, shared_tables);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            (*tables)++;
+            *table_refs += ((struct shared_table_s *) value)->refs;
+        }
+    }
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU Lesser General Public License
+ * version 2.1 or later (LGPLv2.1+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdio.h>
+
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+#include <crm/common/internal.h>
+
+static int failures = 0;
+
+static const char *original =
+    "<cib epoch=\"3\" num_updates=\"7\" admin_epoch=\"0\">"
+      "<configuration>"
+        "<crm_config>"
+          "<cluster_property_set id=\"opts\">"
+            "<nvpair id=\"opts-a\" name=\"a\" value=\"1\"/>"
+            "<nvpair id=\"opts-b\" name=\"b\" value=\"2\"/>"
+          "</cluster_property_set>"
+        "</crm_config>"
+        "<nodes>"
+          "<node id=\"1\" uname=\"node1\"/>"
+          "<node id=\"2\" uname=\"node2\"/>"
+        "</nodes>"
+        "<resources>"
+          "<primitive id=\"rsc1\" class=\"ocf\" provider=\"pacemaker\" type=\"Dummy\"/>"
+          "<group id=\"grp\">"
+            "<primitive id=\"rsc2\" class=\"ocf\" provider=\"pacemaker\" type=\"Dummy\"/>"
+            "<primitive id=\"rsc3\" class=\"ocf\" provider=\"pacemaker\" type=\"Dummy\"/>"
+          "</group>"
+        "</resources>"
+        "<constraints>"
+          "<rsc_location id=\"loc1\" rsc=\"rsc1\" node=\"node1\" score=\"10\"/>"
+          "<rsc_order id=\"ord1\" first=\"rsc1\" then=\"grp\"/>"
+        "</constraints>"
+      "</configuration>"
+      "<status/>"
+    "</cib>";
+
+static xmlNode *
+find_id(xmlNode *xml, const char *id)
+{
+    char *xpath = crm_strdup_printf("//*[@id='%s']", id);
+    xmlNode *match = get_xpath_object(xpath, xml, LOG_TRACE);
+
+    free(xpath);
+    return match;
+}
+
+// Change attributes, including ones on nodes that are later moved or removed
+static void
+change_attributes(xmlNode *cib)
+{
+    crm_xml_add(cib, XML_ATTR_GENERATION, "4");
+    crm_xml_add(find_id(cib, "opts-a"), XML_NVPAIR_ATTR_VALUE, "changed");
+    xml_remove_prop(find_id(cib, "opts-b"), XML_NVPAIR_ATTR_VALUE);
+    crm_xml_add(find_id(cib, "opts-b"), "added", "yes");
+    crm_xml_add(find_id(cib, "rsc2"), XML_AGENT_ATTR_PROVIDER, "heartbeat");
+    crm_xml_add(find_id(cib, "loc1"), XML_RULE_ATTR_SCORE, "INFINITY");
+}
+
+// Add new nodes and copies of existing ones
+static void
+insert_nodes(xmlNode *cib)
+{
+    xmlNode *status = first_named_child(cib, XML_CIB_TAG_STATUS);
+    xmlNode *state = create_xml_node(status, XML_CIB_TAG_STATE);
+
+    crm_xml_add(state, XML_ATTR_ID, "1");
+    create_xml_node(state, XML_CIB_TAG_LRM);
+    add_node_copy(find_id(cib, "grp"), find_id(cib, "rsc1"));
+}
+
+// Remove nodes, including one with children and one just inserted
+static void
+remove_nodes(xmlNode *cib)
+{
+    free_xml(find_id(cib, "ord1"));
+    free_xml(find_id(cib, "opts"));
+    free_xml(first_named_child(cib, XML_CIB_TAG_STATUS)->children);
+}
+
+// Move nodes within the document, including back to where they started
+static void
+move_nodes(xmlNode *cib)
+{
+    xmlNode *resources = find_id(cib, "rsc1")->parent;
+
+    pcmk__xml_move(resources, find_id(cib, "rsc2"));
+    pcmk__xml_move(find_id(cib, "grp"), find_id(cib, "rsc1"));
+    pcmk__xml_move(find_id(cib, "loc1")->parent, find_id(cib, "node2"));
+    pcmk__xml_move(find_id(cib, "grp"), find_id(cib, "rsc3"));
+}
+
+/* Apply a set of changes inside a snapshot, then check that restoring the
+ * snapshot gives back exactly the original document
+ */
+static void
+check_restore(const char *desc, void (*changes[])(xmlNode *), bool track)
+{
+    xmlNode *cib = string2xml(original);
+    char *before = dump_xml_unformatted(cib);
+    char *changed = NULL;
+    char *after = NULL;
+
+    if (track) {
+        xml_track_changes(cib, NULL, NULL, FALSE);
+    }
+    pcmk__xml_snapshot(cib);
+    for (int lpc = 0; changes[lpc] != NULL; lpc++) {
+        changes[lpc](cib);
+    }
+    changed = dump_xml_unformatted(cib);
+    pcmk__xml_snapshot_restore(cib);
+    after = dump_xml_unformatted(cib);
+
+    if (safe_str_eq(before, changed)) {
+        printf("FAIL: %s (changes had no effect)\n", desc);
+        failures++;
+    } else if (safe_str_neq(before, after)) {
+        printf("FAIL: %s\n  expected: %s\n  got:      %s\n",
+               desc, before, after);
+        failures++;
+    } else if (track && xml_document_dirty(cib)) {
+        printf("FAIL: %s (tracked changes remain)\n", desc);
+        failures++;
+    } else {
+        printf("PASS: %s\n", desc);
+    }
+
+    free(before);
+    free(changed);
+    free(after);
+    free_xml(cib);
+}
+
+// Check that releasing a snapshot keeps the changes made since it was taken
+static void
+check_release(const char *desc, void (*changes[])(xmlNode *))
+{
+    xmlNode *cib = string2xml(original);
+    xmlNode *expected = string2xml(original);
+    char *want = NULL;
+    char *got = NULL;
+
+    for (int lpc = 0; changes[lpc] != NULL; lpc++) {
+        changes[lpc](expected);
+    }
+    pcmk__xml_snapshot(cib);
+    for (int lpc = 0; changes[lpc] != NULL; lpc++) {
+        changes[lpc](cib);
+    }
+    pcmk__xml_snapshot_release(cib);
+
+    want = dump_xml_unformatted(expected);
+    got = dump_xml_unformatted(cib);
+    if (safe_str_neq(want, got)) {
+        printf("FAIL: %s\n  expected: %s\n  got:      %s\n", desc, want, got);
+        failures++;
+    } else {
+        printf("PASS: %s\n", desc);
+    }
+
+    free(want);
+    free(got);
+    free_xml(expected);
+    free_xml(cib);
+}
+
+int
+main(int argc, char **argv)
+{
+    void (*attrs[])(xmlNode *) = { change_attributes, NULL };
+    void (*inserts[])(xmlNode *) = { insert_nodes, NULL };
+    void (*removals[])(xmlNode *) = { insert_nodes, remove_nodes, NULL };
+    void (*moves[])(xmlNode *) = { move_nodes, NULL };
+    void (*mixed[])(xmlNode *) = {
+        change_attributes, insert_nodes, move_nodes, remove_nodes, NULL
+    };
+    void (*reordered[])(xmlNode *) = {
+        move_nodes, change_attributes, insert_nodes, remove_nodes, NULL
+    };
+
+    check_restore("restore after attribute changes", attrs, FALSE);
+    check_restore("restore after inserts", inserts, FALSE);
+    check_restore("restore after removals", removals, FALSE);
+    check_restore("restore after moves", moves, FALSE);
+    check_restore("restore after mixed changes", mixed, FALSE);
+    check_restore("restore after mixed changes in another order",
+                  reordered, FALSE);
+    check_restore("restore after mixed tracked changes", mixed, TRUE);
+    check_release("release keeps mixed changes", mixed);
+
+    return (failures == 0)? 0 : 1;
+}
@@ -0,0 +1,409 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU Lesser General Public License
+ * version 2.1 or later (LGPLv2.1+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <crm/crm.h>
+#include <crm/common/internal.h>
+
+/*
+ * Trace events
+ *
+ * Trace logging a hot path (IPC, CIB operations, the controller's state
+ * machine) formats a message for every call, which can slow a busy daemon
+ * down badly enough to hide the problem being looked for. Trace events are a
+ * cheaper alternative: a typed, fixed-size binary record (a timestamp, two
+ * numbers and a short tag) copied into a ring buffer, with the formatting left
+ * to crm_trace_decode afterwards.
+ *
+ * If PCMK_trace_events is set (to "true" or a number of records), daemons keep
+ * the most recent events in memory and write them to CRM_BLACKBOX_DIR along
+ * with the blackbox when sent SIGTRAP. If PCMK_trace_events_file is also set,
+ * new events are appended to that file once a second instead, so nothing is
+ * lost as long as the buffer does not fill up within a second. Each batch
+ * starts with a header, so all daemons may append to the same file.
+ *
+ * Adding an event takes no lock, so events may be added from any thread: each
+ * writer claims a slot with an atomic increment, and marks it complete by
+ * setting its sequence number last. Readers skip slots that are incomplete.
+ *
+ * Recovery from a resource failure passes through several daemons, so each
+ * records a "recovery hop" event as it does its part, tagged with a span ID
+ * that names the failed operation (its resource and call ID, which every
+ * daemon that sees the result knows). The controller passes the span IDs of
+ * failures to the scheduler with the request to recalculate, which returns
+ * them in the transition graph, so the hops that follow can be tagged too.
+ * "crm_trace_decode --recovery" puts the hops recorded by all daemons
+ * together, to show where the time between failure and recovery went.
+ */
+
+#define TRACE_EVENTS_DEFAULT 65536
+#define TRACE_FLUSH_MS 1000
+
+bool pcmk__trace_active = FALSE;
+
+static pcmk__trace_event_t *trace_ring = NULL;
+static guint trace_mask = 0;
+static volatile gint trace_next = 0;        // sequence number of next event
+static guint trace_flushed = 0;             // sequence number of next to write
+static pcmk__trace_header_t trace_header;
+static int trace_stream_fd = -1;
+
+static guint
+ring_size_from(const char *value)
+{
+    long long requested = TRACE_EVENTS_DEFAULT;
+    guint size = 1024;
+
+    if ((value != NULL) && !crm_is_true(value)) {
+        requested = crm_parse_int(value, "0");
+    }
+    if (requested <= 0) {
+        return 0;
+    }
+
+    // Round up to a power of two, so a slot can be found by masking
+    while ((size < requested) && (size < (1U << 24))) {
+        size <<= 1;
+    }
+    return size;
+}
+
+static void
+init_header(void)
+{
+    memset(&trace_header, 0, sizeof(trace_header));
+    memcpy(trace_header.magic, PCMK__TRACE_MAGIC, sizeof(trace_header.magic));
+    trace_header.record_size = sizeof(pcmk__trace_event_t);
+    trace_header.pid = getpid();
+    trace_header.realtime_us = g_get_real_time();
+    trace_header.monotonic_us = g_get_monotonic_time();
+    if (crm_system_name != NULL) {
+        strncpy(trace_header.system, crm_system_name,
+                sizeof(trace_header.system) - 1);
+    }
+}
+
+static bool
+write_all(int fd, const void *data, size_t len)
+{
+    const char *next = data;
+
+    while (len > 0) {
+        ssize_t rc = write(fd, next, len);
+
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FALSE;
+        }
+        next += rc;
+        len -= rc;
+    }
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Write completed events to a file, preceded by the header
+ *
+ * \param[in] fd     File to write to
+ * \param[in] first  Sequence number of first event to write
+ *
+ * \return Sequence number of first event not written
+ * \note Everything is written with a single write, so that several daemons
+ *       can append to the same file without their records being mixed up.
+ */
+static guint
+write_events(int fd, guint first)
+{
+    guint last = (guint) g_atomic_int_get(&trace_next);
+    pcmk__trace_event_t *buffer = NULL;
+    size_t n = 1;
+
+    // Events older than the size of the ring have been overwritten
+    if ((last - first) > (trace_mask + 1)) {
+        first = last - (trace_mask + 1);
+    }
+    if (first == last) {
+        return first;
+    }
+
+    buffer = malloc((last - first + 1) * sizeof(pcmk__trace_event_t));
+    if (buffer == NULL) {
+        return first;
+    }
+    memcpy(&buffer[0], &trace_header, sizeof(trace_header));
+
+    for (; first != last; first++) {
+        pcmk__trace_event_t *event = &trace_ring[first & trace_mask];
+        guint seq = (guint) g_atomic_int_get((volatile gint *) &event->seq);
+        pcmk__trace_event_t copy;
+
+        if (seq == 0) {
+            break; // Still being written, so try again next time
+        }
+        copy = *event;
+
+        // Skip the event if it was overwritten before or while being copied
+        if ((seq != first + 1)
+            || (g_atomic_int_get((volatile gint *) &event->seq) != seq)) {
+            continue;
+        }
+        buffer[n++] = copy;
+    }
+    if ((n > 1) && !write_all(fd, buffer, n * sizeof(pcmk__trace_event_t))) {
+        crm_debug("Could not write trace events: %s", pcmk_strerror(errno));
+    }
+    free(buffer);
+    return first;
+}
+
+static gboolean
+flush_trace_stream(gpointer user_data)
+{
+    if (trace_stream_fd >= 0) {
+        trace_flushed = write_events(trace_stream_fd, trace_flushed);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/*!
+ * \internal
+ * \brief Start recording trace events if PCMK_trace_events is set
+ */
+void
+pcmk__trace_init(void)
+{
+    const char *stream = NULL;
+    guint size = 0;
+
+    if (trace_ring != NULL) {
+        return;
+    }
+
+    size = ring_size_from(daemon_option("trace_events"));
+    if ((daemon_option("trace_events") == NULL) || (size == 0)) {
+        return;
+    }
+
+    // Readers rely on this to handle files with several recordings appended
+    G_STATIC_ASSERT(sizeof(pcmk__trace_header_t)
+                    == sizeof(pcmk__trace_event_t));
+
+    trace_ring = calloc(size, sizeof(pcmk__trace_event_t));
+    if (trace_ring == NULL) {
+        crm_warn("Not recording trace events: %s", pcmk_strerror(ENOMEM));
+        return;
+    }
+    trace_mask = size - 1;
+    init_header();
+
+    stream = daemon_option("trace_events_file");
+    if (stream != NULL) {
+        trace_stream_fd = open(stream, O_WRONLY|O_CREAT|O_APPEND, 0660);
+        if (trace_stream_fd < 0) {
+            crm_warn("Not streaming trace events to %s: %s",
+                     stream, pcmk_strerror(errno));
+        } else {
+            g_timeout_add(TRACE_FLUSH_MS, flush_trace_stream, NULL);
+        }
+    }
+
+    pcmk__trace_active = TRUE;
+    crm_notice("Recording up to %u trace events%s%s", size,
+               ((trace_stream_fd >= 0)? " to " : ""),
+               ((trace_stream_fd >= 0)? stream : ""));
+}
+
+/*!
+ * \internal
+ * \brief Record a trace event (use the pcmk__trace_event() macro instead)
+ *
+ * \param[in] type    Event type
+ * \param[in] value1  First event-specific value
+ * \param[in] value2  Second event-specific value
+ * \param[in] tag     Event-specific text (truncated if too long, may be NULL)
+ */
+void
+pcmk__trace_event_add(enum pcmk__trace_type type, int64_t value1,
+                      int64_t value2, const char *tag)
+{
+    guint seq = 0;
+    pcmk__trace_event_t *event = NULL;
+
+    if (trace_ring == NULL) {
+        return;
+    }
+
+    seq = (guint) g_atomic_int_add(&trace_next, 1);
+    event = &trace_ring[seq & trace_mask];
+
+    g_atomic_int_set((volatile gint *) &event->seq, 0);
+    event->type = type;
+    event->timestamp_us = g_get_monotonic_time();
+    event->value1 = value1;
+    event->value2 = value2;
+    if (tag == NULL) {
+        event->tag[0] = '\0';
+    } else {
+        strncpy(event->tag, tag, PCMK__TRACE_TAG_LEN - 1);
+        event->tag[PCMK__TRACE_TAG_LEN - 1] = '\0';
+    }
+    g_atomic_int_set((volatile gint *) &event->seq, (gint) (seq + 1));
+}
+
+/*!
+ * \internal
+ * \brief Write the recorded trace events to a file in CRM_BLACKBOX_DIR
+ *
+ * \note When events are being streamed, this just writes any that are pending.
+ */
+void
+pcmk__trace_dump(void)
+{
+    char *filename = NULL;
+    int fd = -1;
+
+    if (trace_ring == NULL) {
+        return;
+    }
+    if (trace_stream_fd >= 0) {
+        flush_trace_stream(NULL);
+        return;
+    }
+
+    filename = crm_strdup_printf(CRM_BLACKBOX_DIR "/%s-%lu.trace",
+                                 crm_system_name, (unsigned long) getpid());
+    fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0640);
+    if (fd < 0) {
+        crm_warn("Could not write trace events to %s: %s",
+                 filename, pcmk_strerror(errno));
+    } else {
+        write_events(fd, 0);
+        crm_notice("Trace events written to %s", filename);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(filename);
+}
+
+/*!
+ * \internal
+ * \brief Get a readable name for a trace event type
+ *
+ * \param[in] type  Event type
+ *
+ * \return Name of \p type
+ */
+const char *
+pcmk__trace_type_str(enum pcmk__trace_type type)
+{
+    switch (type) {
+        case pcmk__trace_ipc_send:          return "ipc-send";
+        case pcmk__trace_ipc_recv:          return "ipc-recv";
+        case pcmk__trace_cib_op_begin:      return "cib-op-begin";
+        case pcmk__trace_cib_op_end:        return "cib-op-end";
+        case pcmk__trace_fsa_input:         return "fsa-input";
+        case pcmk__trace_action_dispatch:   return "action-dispatch";
+        case pcmk__trace_recovery_hop:      return "recovery-hop";
+    }
+    return "unknown";
+}
+
+/*!
+ * \internal
+ * \brief Get a readable name for a recovery hop
+ *
+ * \param[in] hop  Recovery hop
+ *
+ * \return Name of \p hop
+ */
+const char *
+pcmk__trace_hop_str(enum pcmk__trace_hop hop)
+{
+    switch (hop) {
+        case pcmk__hop_op_failed:           return "op-failed";
+        case pcmk__hop_result_received:     return "result-received";
+        case pcmk__hop_history_sent:        return "history-sent";
+        case pcmk__hop_history_committed:   return "history-committed";
+        case pcmk__hop_failure_seen:        return "failure-seen";
+        case pcmk__hop_schedule_requested:  return "schedule-requested";
+        case pcmk__hop_scheduled:           return "scheduled";
+        case pcmk__hop_transition_started:  return "transition-started";
+        case pcmk__hop_actions_dispatched:  return "actions-dispatched";
+        case pcmk__hop_transition_complete: return "transition-complete";
+    }
+    return "unknown";
+}
+
+/*!
+ * \internal
+ * \brief Get the span ID of a resource operation
+ *
+ * \param[out] span     Where to store span ID (PCMK__TRACE_TAG_LEN bytes)
+ * \param[in]  rsc_id   ID of operation's resource
+ * \param[in]  call_id  Operation's call ID
+ *
+ * \note The resource ID is truncated if needed, so the call ID always fits.
+ */
+void
+pcmk__trace_span_id(char *span, const char *rsc_id, int call_id)
+{
+    char suffix[16];
+    int rsc_len = 0;
+
+    snprintf(suffix, sizeof(suffix), "#%d", call_id);
+    rsc_len = PCMK__TRACE_TAG_LEN - 1 - strlen(suffix);
+    snprintf(span, PCMK__TRACE_TAG_LEN, "%.*s%s", rsc_len,
+             (rsc_id? rsc_id : ""), suffix);
+}
+
+/*!
+ * \internal
+ * \brief Record a recovery hop for each of a list of spans
+ *
+ * \param[in] hop    Recovery hop
+ * \param[in] value  Hop-specific value
+ * \param[in] spans  Comma-separated span IDs (may be NULL)
+ */
+void
+pcmk__trace_hops(enum pcmk__trace_hop hop, int64_t value, const char *spans)
+{
+    char span[PCMK__TRACE_TAG_LEN];
+
+    if (!pcmk__trace_active || (spans == NULL)) {
+        return;
+    }
+    while (*spans != '\0') {
+        size_t len = strcspn(spans, ",");
+
+        if ((len > 0) && (len < PCMK__TRACE_TAG_LEN)) {
+            memcpy(span, spans, len);
+            span[len] = '\0';
+            pcmk__trace_event_add(pcmk__trace_recovery_hop, hop, value, span);
+        }
+        spans += len;
+        if (*spans == ',') {
+            spans++;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU Lesser General Public License
+ * version 2.1 or later (LGPLv2.1+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include <crm/crm.h>
+#include <crm/common/mainloop.h>
+
+/*
+ * Worker threads
+ *
+ * CPU-heavy work that needs nothing but its own data (parsing or serializing
+ * a private copy of some XML, for example) can be done by a pool of
+ * PCMK_worker_threads threads (by default, one per processor), so that it does
+ * not hold up the main loop. Each job has a work function, called in a worker
+ * thread, and a done function, called afterwards from the main loop (via a
+ * trigger) to use the result.
+ *
+ * If there are no worker threads, the work function is called immediately, but
+ * the done function is still called from the main loop, so callers see the
+ * same order of events either way.
+ */
+
+struct worker_job_s {
+    void (*work)(gpointer data);
+    void (*done)(gpointer data);
+    gpointer data;
+};
+
+static int worker_threads = -1;         // -1 until initialized
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+static GThreadPool *workers = NULL;
+#endif
+
+static GAsyncQueue *finished_jobs = NULL;
+static crm_trigger_t *finished_trigger = NULL;
+
+// Call the done functions of finished jobs (in the main thread)
+static int
+finish_jobs(gpointer user_data)
+{
+    struct worker_job_s *job = NULL;
+
+    while ((job = g_async_queue_try_pop(finished_jobs)) != NULL) {
+        if (job->done != NULL) {
+            job->done(job->data);
+        }
+        free(job);
+    }
+    return TRUE;
+}
+
+static void
+job_finished(struct worker_job_s *job)
+{
+    g_async_queue_push(finished_jobs, job);
+    mainloop_set_trigger(finished_trigger);
+}
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+static void
+run_job(gpointer data, gpointer user_data)
+{
+    struct worker_job_s *job = data;
+
+    job->work(job->data);
+    job_finished(job);
+
+    // Don't leave the main loop waiting in poll() for the trigger
+    g_main_context_wakeup(NULL);
+}
+#endif
+
+/*!
+ * \internal
+ * \brief Create the worker thread pool
+ *
+ * \param[in] threads  Number of threads to use (or -1 to use
+ *                     PCMK_worker_threads or the number of processors)
+ *
+ * \note This does nothing if the pool has already been created, whether
+ *       explicitly or by pcmk__workers_push().
+ */
+void
+pcmk__workers_init(int threads)
+{
+    if (worker_threads >= 0) {
+        return;
+    }
+
+    if (threads < 0) {
+        const char *value = daemon_option("worker_threads");
+
+        if (value == NULL) {
+            threads = crm_procfs_num_cores();
+        } else {
+            threads = crm_parse_int(value, "0");
+        }
+        if (threads < 0) {
+            threads = 0;
+        }
+    }
+
+    finished_jobs = g_async_queue_new();
+    finished_trigger = mainloop_add_trigger(G_PRIORITY_DEFAULT, finish_jobs,
+                                            NULL);
+    pcmk__trigger_set_name(finished_trigger, "workers");
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    if (threads > 0) {
+        GError *error = NULL;
+
+        workers = g_thread_pool_new(run_job, NULL, threads, FALSE, &error);
+        if (workers == NULL) {
+            crm_warn("Doing CPU-heavy work in main thread: %s",
+                     (error? error->message : "could not create threads"));
+            g_clear_error(&error);
+            threads = 0;
+        }
+    }
+#else
+    threads = 0;
+#endif
+
+    worker_threads = threads;
+    crm_debug("Using %d worker thread%s", threads, ((threads == 1)? "" : "s"));
+}
+
+/*!
+ * \internal
+ * \brief Check whether work pushed to the worker threads is done in parallel
+ *
+ * \return true if the worker thread pool has been created with threads
+ */
+bool
+pcmk__workers_enabled(void)
+{
+    return worker_threads > 0;
+}
+
+/*!
+ * \internal
+ * \brief Do work in a worker thread
+ *
+ * \param[in] work  Function to call in a worker thread
+ * \param[in] done  Function to call from the main loop once \p work returns
+ *                  (or NULL if none)
+ * \param[in] data  User data for \p work and \p done
+ *
+ * \note \p work must be safe to call in any thread. It must not use the
+ *       main loop or anything else shared with the main thread, including
+ *       \p data once it has been pushed, until \p done is called.
+ */
+void
+pcmk__workers_push(void (*work)(gpointer data), void (*done)(gpointer data),
+                   gpointer data)
+{
+    struct worker_job_s *job = calloc(1, sizeof(struct worker_job_s));
+
+    CRM_ASSERT((job != NULL) && (work != NULL));
+    job->work = work;
+    job->done = done;
+    job->data = data;
+
+    pcmk__workers_init(-1);
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    if (workers != NULL) {
+        g_thread_pool_push(workers, job, NULL);
+        return;
+    }
+#endif
+
+    work(data);
+    job_finished(job);
+}
@@ -16,14 +16,19 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <limits.h>
 
 #include <libxml/parser.h>
 #include <libxml/tree.h>
 
+#include <md5.h>
+
 #include <crm/crm.h>
 #include <crm/msg_xml.h>
 #include <crm/common/xml.h>
 #include <crm/common/xml_internal.h>  /* CRM_XML_LOG_BASE */
+#include <crm/common/mainloop.h>
 
 #if HAVE_BZLIB_H
 #  include <bzlib.h>
@@ -60,15 +65,41 @@ enum xml_private_flags {
      xpf_acl_create  = 0x1000,
      xpf_acl_denied  = 0x2000,
      xpf_lazy        = 0x4000,
+     xpf_snapshot    = 0x8000,
+     xpf_digest_cache = 0x10000,
 };
 
+/* Every element, attribute and comment (and each document) gets one of these
+ * when created, so it is kept as small as possible: anything needed only for
+ * documents is in xml_doc_private_t, and anything needed only by some callers
+ * is in an xml_cache_t allocated on first use.
+ */
+typedef struct xml_cache_s {
+        char *digest_text;      // cached digest input for element's subtree
+        int digest_len;
+        int digest_options;
+        bool digest_large;      // subtree too big to cache as a whole
+        void *parsed;           // values parsed from element's attributes
+        GDestroyNotify parsed_free;
+} xml_cache_t;
+
 typedef struct xml_private_s {
-        long check;
+        uint32_t check;
+        uint32_t flags;
+        xml_cache_t *cache;
+} xml_private_t;
+
+// Documents' private data, which begins with the same members as a node's
+typedef struct xml_doc_private_s {
+        uint32_t check;
         uint32_t flags;
+        xml_cache_t *cache;
         char *user;
         GListPtr acls;
         GListPtr deleted_objs;
-} xml_private_t;
+        bool index_ids;         // whether to keep id_index (see ID index)
+        GHashTable *id_index;   // "<tag> <id>" -> element, built on demand
+} xml_doc_private_t;
 
 typedef struct xml_acl_s {
         enum xml_private_flags mode;
@@ -80,6 +111,22 @@ typedef struct xml_deleted_obj_s {
         int position;
 } xml_deleted_obj_t;
 
+enum xml_saved_type {
+     xml_saved_attr,    // attribute was set or removed
+     xml_saved_insert,  // node was added
+     xml_saved_remove,  // node was removed (and is not yet freed)
+     xml_saved_move,    // node was moved within the document
+};
+
+typedef struct xml_saved_s {
+        enum xml_saved_type type;
+        xmlNode *node;
+        xmlNode *parent;    // previous parent (remove and move only)
+        int position;       // previous offset among siblings or attributes
+        char *name;         // attribute name (attr only)
+        char *value;        // previous attribute value, or NULL if unset
+} xml_saved_t;
+
 /* *INDENT-OFF* */
 
 static filter_t filter[] = {
@@ -141,18 +188,66 @@ static inline bool TRACKING_CHANGES_LAZY(xmlNode *xml)
         }                                                               \
     } while(1);
 
+/*!
+ * \internal
+ * \brief Make sure an output buffer has room for more text
+ *
+ * \param[in,out] buffer  Output buffer (allocated if NULL)
+ * \param[in,out] offset  Current length of text in \p buffer
+ * \param[in,out] max     Allocated size of \p buffer
+ * \param[in]     length  Number of bytes about to be added
+ *
+ * \note The buffer grows geometrically, so that serializing a document takes
+ *       a logarithmic rather than linear number of reallocations, and always
+ *       has room for a terminating null byte after the new text.
+ */
+static inline void
+buffer_reserve(char **buffer, int *offset, int *max, size_t length)
+{
+    size_t needed;
+
+    if (*buffer == NULL) {
+        *offset = 0;
+        *max = 0;
+    }
+    needed = (size_t) *offset + length + 1;
+
+    if ((*buffer == NULL) || (needed > (size_t) *max)) {
+        size_t new_max = QB_MAX(CHUNK_SIZE, (size_t) *max);
+
+        while (new_max < needed) {
+            new_max *= 2;
+        }
+        CRM_ASSERT(new_max <= INT_MAX);
+        *buffer = realloc_safe(*buffer, new_max);
+        *max = (int) new_max;
+    }
+}
+
+// Append text of known length to an output buffer
+static inline void
+buffer_add_text(char **buffer, int *offset, int *max, const char *text,
+                size_t length)
+{
+    buffer_reserve(buffer, offset, max, length);
+    memcpy(*buffer + *offset, text, length);
+    *offset += length;
+    (*buffer)[*offset] = '\0';
+}
+
+#define buffer_add_literal(buffer, offset, max, text) \
+    buffer_add_text((buffer), (offset), (max), (text), sizeof(text) - 1)
+
 static void
 insert_prefix(int options, char **buffer, int *offset, int *max, int depth)
 {
     if (options & xml_log_option_formatted) {
         size_t spaces = 2 * depth;
 
-        if ((*buffer) == NULL || spaces >= ((*max) - (*offset))) {
-            (*max) = QB_MAX(CHUNK_SIZE, (*max) * 2);
-            (*buffer) = realloc_safe((*buffer), (*max));
-        }
+        buffer_reserve(buffer, offset, max, spaces);
         memset((*buffer) + (*offset), ' ', spaces);
         (*offset) += spaces;
+        (*buffer)[*offset] = '\0';
     }
 }
 
@@ -185,9 +280,54 @@ set_doc_flag(xmlNode *xml, long flag)
     }
 }
 
+/*!
+ * \internal
+ * \brief Discard cached digest input for a node and all of its ancestors
+ *
+ * \param[in] xml  Node, attribute or comment whose contents changed
+ *
+ * \note This must be called for every change to a document that has digest
+ *       caching enabled (see pcmk__xml_cache_digests()). It is called by the
+ *       save_*() and dirty-tracking helpers, and explicitly where neither
+ *       applies.
+ */
+// Discard any values parsed from an element's attributes
+static void
+parsed_changed(xmlNode *xml)
+{
+    xml_private_t *p = (xml == NULL)? NULL : xml->_private;
+
+    if ((xml != NULL) && (xml->type == XML_ELEMENT_NODE) && (p != NULL)
+        && (p->cache != NULL) && (p->cache->parsed != NULL)) {
+        p->cache->parsed_free(p->cache->parsed);
+        p->cache->parsed = NULL;
+    }
+}
+
+static void
+xml_digest_changed(xmlNode *xml)
+{
+    parsed_changed(xml);
+    if ((xml == NULL) || (xml->doc == NULL) || (xml->doc->_private == NULL)
+        || is_not_set(((xml_private_t *) xml->doc->_private)->flags,
+                      xpf_digest_cache)) {
+        return;
+    }
+    for (; xml != NULL; xml = xml->parent) {
+        xml_private_t *p = xml->_private;
+
+        if ((xml->type == XML_ELEMENT_NODE) && (p != NULL)
+            && (p->cache != NULL) && (p->cache->digest_text != NULL)) {
+            free(p->cache->digest_text);
+            p->cache->digest_text = NULL;
+        }
+    }
+}
+
 static void
 __xml_node_dirty(xmlNode *xml) 
 {
+    xml_digest_changed(xml);
     set_doc_flag(xml, xpf_dirty);
     set_parent_flag(xml, xpf_dirty);
 }
@@ -265,7 +405,8 @@ crm_first_attr(const xmlNode *xml)
     return xml->properties;
 }
 
-#define XML_PRIVATE_MAGIC (long) 0x81726354
+#define XML_NODE_PRIVATE_MAGIC  0x81726354
+#define XML_DOC_PRIVATE_MAGIC   0x81726355
 
 static void
 __xml_acl_free(void *data)
@@ -290,10 +431,10 @@ __xml_deleted_obj_free(void *data)
 }
 
 static void
-__xml_private_clean(xml_private_t *p)
+__xml_private_clean(xml_doc_private_t *p)
 {
     if(p) {
-        CRM_ASSERT(p->check == XML_PRIVATE_MAGIC);
+        CRM_ASSERT(p->check == XML_DOC_PRIVATE_MAGIC);
 
         free(p->user);
         p->user = NULL;
@@ -311,13 +452,113 @@ __xml_private_clean(xml_private_t *p)
 }
 
 
+static void
+__xml_cache_free(xml_cache_t *cache)
+{
+    if (cache != NULL) {
+        free(cache->digest_text);
+        if (cache->parsed != NULL) {
+            cache->parsed_free(cache->parsed);
+        }
+        free(cache);
+    }
+}
+
+/*
+ * Private data recycling
+ *
+ * Every element, attribute and comment gets an xml_private_t, so parsing or
+ * copying a CIB allocates (and freeing it releases) one per node. Up to
+ * PRIVATE_FREELIST_MAX of those released in the main thread are kept for
+ * reuse, linked through their cache member. Worker threads always use the
+ * allocator directly.
+ */
+
+#define PRIVATE_FREELIST_MAX 4096
+
+static GThread *xml_main_thread = NULL;
+static xml_private_t *private_freelist = NULL;
+static guint private_freelist_len = 0;
+
+static xml_private_t *
+private_alloc(void)
+{
+    xml_private_t *p = NULL;
+
+    if ((private_freelist != NULL) && (g_thread_self() == xml_main_thread)) {
+        p = private_freelist;
+        private_freelist = (xml_private_t *) p->cache;
+        private_freelist_len--;
+        memset(p, 0, sizeof(xml_private_t));
+    } else {
+        p = calloc(1, sizeof(xml_private_t));
+        CRM_ASSERT(p != NULL);
+    }
+    return p;
+}
+
+static void
+private_release(xml_private_t *p)
+{
+    if ((private_freelist_len < PRIVATE_FREELIST_MAX)
+        && (xml_main_thread != NULL) && (g_thread_self() == xml_main_thread)) {
+        p->check = 0;
+        p->cache = (xml_cache_t *) private_freelist;
+        private_freelist = p;
+        private_freelist_len++;
+    } else {
+        free(p);
+    }
+}
+
+static void
+private_freelist_clear(void)
+{
+    while (private_freelist != NULL) {
+        xml_private_t *p = private_freelist;
+
+        private_freelist = (xml_private_t *) p->cache;
+        free(p);
+    }
+    private_freelist_len = 0;
+}
+
 static void
 __xml_private_free(xml_private_t *p)
 {
-    __xml_private_clean(p);
-    free(p);
+    if (p) {
+        CRM_ASSERT((p->check == XML_NODE_PRIVATE_MAGIC)
+                   || (p->check == XML_DOC_PRIVATE_MAGIC));
+        if (p->check == XML_DOC_PRIVATE_MAGIC) {
+            __xml_private_clean((xml_doc_private_t *) p);
+            if (((xml_doc_private_t *) p)->id_index != NULL) {
+                g_hash_table_destroy(((xml_doc_private_t *) p)->id_index);
+            }
+            __xml_cache_free(p->cache);
+            free(p);
+            return;
+        }
+        __xml_cache_free(p->cache);
+        private_release(p);
+    }
+}
+
+// Get an element's cache, allocating it if needed
+static xml_cache_t *
+__xml_cache(xmlNode *xml)
+{
+    xml_private_t *p = xml->_private;
+
+    if (p->cache == NULL) {
+        p->cache = calloc(1, sizeof(xml_cache_t));
+        CRM_ASSERT(p->cache != NULL);
+    }
+    return p->cache;
 }
 
+static void xml_snapshot_free(xmlDoc *doc);
+static void forget_ids(xmlNode *node);
+
 static void
 pcmkDeregisterNode(xmlNodePtr node)
 {
@@ -327,9 +568,16 @@ pcmkDeregisterNode(xmlNodePtr node)
        onto result tree fragments, represented as standalone documents
        with otherwise infeasible space-prefixed name (xsltInternals.h:
        XSLT_MARK_RES_TREE_FRAG) and carrying it's own load at _private
-       field -- later assert on the XML_PRIVATE_MAGIC would explode */
+       field -- later assert on the XML_*_PRIVATE_MAGIC would explode */
     if (node->type != XML_DOCUMENT_NODE || node->name == NULL
             || node->name[0] != ' ') {
+        if ((node->type == XML_DOCUMENT_NODE) && (node->_private != NULL)
+            && is_set(((xml_private_t *) node->_private)->flags, xpf_snapshot)) {
+            xml_snapshot_free((xmlDoc *) node);
+        }
+        if (node->type != XML_DOCUMENT_NODE) {
+            forget_ids(node);
+        }
         __xml_private_free(node->_private);
     }
 }
@@ -340,12 +588,19 @@ pcmkRegisterNode(xmlNodePtr node)
     xml_private_t *p = NULL;
 
     switch(node->type) {
-        case XML_ELEMENT_NODE:
         case XML_DOCUMENT_NODE:
+            p = calloc(1, sizeof(xml_doc_private_t));
+            CRM_ASSERT(p != NULL);
+            p->check = XML_DOC_PRIVATE_MAGIC;
+            /* Flags will be reset if necessary when tracking is enabled */
+            p->flags |= (xpf_dirty|xpf_created);
+            node->_private = p;
+            break;
+        case XML_ELEMENT_NODE:
         case XML_ATTRIBUTE_NODE:
         case XML_COMMENT_NODE:
-            p = calloc(1, sizeof(xml_private_t));
-            p->check = XML_PRIVATE_MAGIC;
+            p = private_alloc();
+            p->check = XML_NODE_PRIVATE_MAGIC;
             /* Flags will be reset if necessary when tracking is enabled */
             p->flags |= (xpf_dirty|xpf_created);
             node->_private = p;
@@ -370,12 +625,366 @@ pcmkRegisterNode(xmlNodePtr node)
     }
 }
 
+/*
+ * Document snapshots
+ *
+ * Callers that modify a document in place but may need to abandon the
+ * changes (such as the CIB manager applying a request that might fail) can
+ * take a snapshot first, rather than copying the whole document. While a
+ * snapshot is active, each change saves only what it overwrites: the previous
+ * value of a modified attribute, or the position of an added, moved or removed
+ * node. Removed nodes are kept (unlinked) rather than freed until the
+ * snapshot is released. Restoring the snapshot undoes the saved changes in
+ * reverse order, so the cost of both operations is proportional to the size
+ * of the changes rather than the size of the document.
+ *
+ * This is independent of change tracking, so the usual patchset and ACL
+ * handling continues to work on the modified document.
+ */
+
+// Document -> list of xml_saved_t, most recent first
+static GHashTable *xml_snapshots = NULL;
+
+static GListPtr *
+snapshot_of(xmlNode *xml)
+{
+    if ((xml == NULL) || (xml->doc == NULL) || (xml->doc->_private == NULL)
+        || is_not_set(((xml_private_t *) xml->doc->_private)->flags,
+                      xpf_snapshot)) {
+        return NULL;
+    }
+    return g_hash_table_lookup(xml_snapshots, xml->doc);
+}
+
+static int
+xml_child_offset(xmlNode *xml)
+{
+    int position = 0;
+
+    for (xmlNode *cIter = xml->prev; cIter != NULL; cIter = cIter->prev) {
+        position++;
+    }
+    return position;
+}
+
+static void
+save_change(GListPtr *saved, enum xml_saved_type type, xmlNode *node)
+{
+    xml_saved_t *change = calloc(1, sizeof(xml_saved_t));
+
+    CRM_ASSERT(change != NULL);
+    change->type = type;
+    change->node = node;
+    change->position = -1;
+    if ((type == xml_saved_remove) || (type == xml_saved_move)) {
+        change->parent = node->parent;
+        change->position = xml_child_offset(node);
+    }
+    *saved = g_list_prepend(*saved, change);
+}
+
+// Save an attribute's value before it is changed
+static void
+save_attr(xmlNode *xml, const char *name)
+{
+    GListPtr *saved = snapshot_of(xml);
+    xmlAttr *attr = NULL;
+    xml_saved_t *change = NULL;
+
+    xml_digest_changed(xml);
+    if (saved == NULL) {
+        return;
+    }
+    save_change(saved, xml_saved_attr, xml);
+    change = (*saved)->data;
+    change->name = strdup(name);
+
+    attr = xmlHasProp(xml, (const xmlChar *) name);
+    if (attr != NULL) {
+        const char *value = crm_attr_value(attr);
+
+        change->value = strdup(value? value : "");
+        change->position = 0;
+        for (xmlAttr *aIter = attr->prev; aIter != NULL; aIter = aIter->prev) {
+            change->position++;
+        }
+    }
+}
+
+// Save the fact that a node was added to a document
+static void
+save_insert(xmlNode *xml)
+{
+    GListPtr *saved = snapshot_of(xml);
+
+    xml_digest_changed(xml);
+    if (saved != NULL) {
+        save_change(saved, xml_saved_insert, xml);
+    }
+}
+
+// Save a node's position before it is moved elsewhere in the same document
+static void
+save_move(xmlNode *xml)
+{
+    GListPtr *saved = snapshot_of(xml);
+
+    // Only the old location; callers handle the new one
+    xml_digest_changed(xml->parent);
+    if ((saved != NULL) && (xml->parent != NULL)) {
+        save_change(saved, xml_saved_move, xml);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Unlink a node and free it, unless a snapshot needs it
+ *
+ * \param[in,out] xml  Node to remove from its document
+ */
+static void
+xml_remove_node(xmlNode *xml)
+{
+    GListPtr *saved = snapshot_of(xml);
+
+    xml_digest_changed(xml->parent);
+    if ((saved != NULL) && (xml->parent != NULL)
+        && (xml->type != XML_ATTRIBUTE_NODE)) {
+        save_change(saved, xml_saved_remove, xml);
+        xmlUnlinkNode(xml);
+    } else {
+        if ((saved != NULL) && (xml->type == XML_ATTRIBUTE_NODE)) {
+            save_attr(xml->parent, (const char *) xml->name);
+        }
+        xmlUnlinkNode(xml);
+        xmlFreeNode(xml);
+    }
+}
+
+// Free a node that was removed while a snapshot was active
+static void
+free_removed_node(xmlNode *xml)
+{
+    if ((xml->doc != NULL) && (xmlDocGetRootElement(xml->doc) == xml)) {
+        // Replaced nodes end up as the root of a temporary document
+        xmlFreeDoc(xml->doc);
+    } else {
+        xmlFreeNode(xml);
+    }
+}
+
+static void
+free_saved_change(gpointer data)
+{
+    xml_saved_t *change = data;
+
+    if (change->type == xml_saved_remove) {
+        free_removed_node(change->node);
+    }
+    free(change->name);
+    free(change->value);
+    free(change);
+}
+
+static void
+xml_snapshot_free(xmlDoc *doc)
+{
+    GListPtr *saved = g_hash_table_lookup(xml_snapshots, doc);
+
+    if (saved != NULL) {
+        g_list_free_full(*saved, free_saved_change);
+        g_hash_table_remove(xml_snapshots, doc);
+    }
+    clear_bit(((xml_private_t *) doc->_private)->flags, xpf_snapshot);
+}
+
+// Put a node back at its previous offset among its parent's children
+static void
+insert_child(xmlNode *parent, xmlNode *child, int position)
+{
+    xmlDoc *old_doc = child->doc;
+    xmlNode *next = parent->children;
+
+    for (int lpc = 0; (lpc < position) && (next != NULL); lpc++) {
+        next = next->next;
+    }
+
+    xml_digest_changed(child->parent);
+    xmlUnlinkNode(child);
+    if (next != NULL) {
+        xmlAddPrevSibling(next, child);
+    } else {
+        xmlAddChild(parent, child);
+    }
+    xml_digest_changed(parent);
+
+    if ((old_doc != NULL) && (old_doc != parent->doc)) {
+        xmlSetTreeDoc(child, parent->doc);
+        if (xmlDocGetRootElement(old_doc) == NULL) {
+            xmlFreeDoc(old_doc);
+        }
+    }
+}
+
+// Put an attribute back at its previous offset among its element's attributes
+static void
+insert_attr(xmlNode *xml, xmlAttr *attr, int position)
+{
+    xmlAttr *prev = NULL;
+    xmlAttr *next = NULL;
+
+    if (attr->prev != NULL) {
+        attr->prev->next = attr->next;
+    } else {
+        xml->properties = attr->next;
+    }
+    if (attr->next != NULL) {
+        attr->next->prev = attr->prev;
+    }
+
+    next = xml->properties;
+    for (int lpc = 0; (lpc < position) && (next != NULL); lpc++) {
+        prev = next;
+        next = next->next;
+    }
+    attr->prev = prev;
+    attr->next = next;
+    if (prev != NULL) {
+        prev->next = attr;
+    } else {
+        xml->properties = attr;
+    }
+    if (next != NULL) {
+        next->prev = attr;
+    }
+}
+
+static void
+restore_change(xml_saved_t *change)
+{
+    xmlNode *xml = change->node;
+    xmlAttr *attr = NULL;
+
+    switch (change->type) {
+        case xml_saved_attr:
+            xml_digest_changed(xml);
+            if (change->value == NULL) {
+                xmlUnsetProp(xml, (const xmlChar *) change->name);
+                break;
+            }
+            attr = xmlHasProp(xml, (const xmlChar *) change->name);
+            if (attr == NULL) {
+                attr = xmlSetProp(xml, (const xmlChar *) change->name,
+                                  (const xmlChar *) change->value);
+                insert_attr(xml, attr, change->position);
+            } else {
+                xmlSetProp(xml, (const xmlChar *) change->name,
+                           (const xmlChar *) change->value);
+            }
+            ((xml_private_t *) attr->_private)->flags = xpf_none;
+            break;
+
+        case xml_saved_insert:
+            xml_digest_changed(xml->parent);
+            xmlUnlinkNode(xml);
+            xmlFreeNode(xml);
+            break;
+
+        case xml_saved_remove:
+        case xml_saved_move:
+            insert_child(change->parent, xml, change->position);
+            break;
+    }
+}
+
+/*!
+ * \internal
+ * \brief Start saving enough of a document to undo changes made to it
+ *
+ * \param[in,out] xml  Any node in the document to take a snapshot of
+ *
+ * \note Only changes made via this library's functions can be undone. The
+ *       caller must end the snapshot using pcmk__xml_snapshot_release() or
+ *       pcmk__xml_snapshot_restore(), and must not take overlapping
+ *       snapshots of the same document.
+ */
+void
+pcmk__xml_snapshot(xmlNode *xml)
+{
+    GListPtr *saved = NULL;
+
+    CRM_CHECK((xml != NULL) && (xml->doc != NULL)
+              && (xml->doc->_private != NULL), return);
+    CRM_CHECK(snapshot_of(xml) == NULL, return);
+
+    if (xml_snapshots == NULL) {
+        xml_snapshots = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                              NULL, free);
+    }
+    saved = calloc(1, sizeof(GListPtr));
+    CRM_ASSERT(saved != NULL);
+    g_hash_table_insert(xml_snapshots, xml->doc, saved);
+    set_doc_flag(xml, xpf_snapshot);
+}
+
+/*!
+ * \internal
+ * \brief Keep the changes made since a document's snapshot was taken
+ *
+ * \param[in,out] xml  Any node in the document whose snapshot to release
+ */
+void
+pcmk__xml_snapshot_release(xmlNode *xml)
+{
+    if (snapshot_of(xml) != NULL) {
+        xml_snapshot_free(xml->doc);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Undo the changes made since a document's snapshot was taken
+ *
+ * \param[in,out] xml  Any node in the document whose snapshot to restore
+ *
+ * \note This also discards any changes being tracked for the document.
+ */
+void
+pcmk__xml_snapshot_restore(xmlNode *xml)
+{
+    GListPtr *saved = snapshot_of(xml);
+    xml_doc_private_t *doc = NULL;
+
+    if (saved == NULL) {
+        return;
+    }
+
+    crm_trace("Restoring snapshot of %p (%u changes)",
+              xml->doc, g_list_length(*saved));
+    for (GListPtr gIter = *saved; gIter != NULL; gIter = gIter->next) {
+        xml_saved_t *change = gIter->data;
+
+        restore_change(change);
+        if (change->type == xml_saved_remove) {
+            // The node is back in the document, so don't free it
+            change->type = xml_saved_move;
+        }
+    }
+
+    xml = xmlDocGetRootElement(xml->doc);
+    doc = xml->doc->_private;
+    xml_snapshot_free(xml->doc);
+    __xml_private_clean(doc);
+    doc->flags &= xpf_digest_cache;
+    __xml_node_clean(xml);
+}
+
 static xml_acl_t *
 __xml_acl_create(xmlNode * xml, xmlNode *target, enum xml_private_flags mode)
 {
     xml_acl_t *acl = NULL;
 
-    xml_private_t *p = NULL;
+    xml_doc_private_t *p = NULL;
     const char *tag = crm_element_value(xml, XML_ACL_ATTR_TAG);
     const char *ref = crm_element_value(xml, XML_ACL_ATTR_REF);
     const char *xpath = crm_element_value(xml, XML_ACL_ATTR_XPATH);
@@ -547,16 +1156,15 @@ __xml_acl_apply(xmlNode *xml)
 {
     GListPtr aIter = NULL;
     xml_private_t *p = NULL;
+    xml_doc_private_t *doc = xml->doc->_private;
     xmlXPathObjectPtr xpathObj = NULL;
 
     if(xml_acl_enabled(xml) == FALSE) {
-        p = xml->doc->_private;
-        crm_trace("Not applying ACLs for %s", p->user);
+        crm_trace("Not applying ACLs for %s", doc->user);
         return;
     }
 
-    p = xml->doc->_private;
-    for(aIter = p->acls; aIter != NULL; aIter = aIter->next) {
+    for(aIter = doc->acls; aIter != NULL; aIter = aIter->next) {
         int max = 0, lpc = 0;
         xml_acl_t *acl = aIter->data;
 
@@ -593,8 +1201,7 @@ __xml_acl_apply(xmlNode *xml)
     p = xml->_private;
     if(is_not_set(p->flags, xpf_acl_read) && is_not_set(p->flags, xpf_acl_write)) {
         p->flags |= xpf_acl_deny;
-        p = xml->doc->_private;
-        crm_info("Enforcing default ACL for %s to %s", p->user, crm_element_name(xml));
+        crm_info("Enforcing default ACL for %s to %s", doc->user, crm_element_name(xml));
     }
 
 }
@@ -603,7 +1210,7 @@ static void
 __xml_acl_unpack(xmlNode *source, xmlNode *target, const char *user)
 {
 #if ENABLE_ACL
-    xml_private_t *p = NULL;
+    xml_doc_private_t *p = NULL;
 
     if(target == NULL || target->doc == NULL || target->doc->_private == NULL) {
         return;
@@ -686,6 +1293,7 @@ __xml_purge_attributes(xmlNode *xml)
             continue;
         }
 
+        xml_digest_changed(xml);
         xmlUnsetProp(xml, tmp->name);
     }
 
@@ -709,7 +1317,7 @@ xml_acl_filtered_copy(const char *user, xmlNode* acl_source, xmlNode *xml, xmlNo
     GListPtr aIter = NULL;
     xmlNode *target = NULL;
     xml_private_t *p = NULL;
-    xml_private_t *doc = NULL;
+    xml_doc_private_t *doc = NULL;
 
     *result = NULL;
     if(xml == NULL || pcmk_acl_required(user) == FALSE) {
@@ -807,8 +1415,7 @@ __xml_acl_post_process(xmlNode * xml)
                 crm_trace("Cannot add new node %s at %s", crm_element_name(xml), path);
 
                 if(xml != xmlDocGetRootElement(xml->doc)) {
-                    xmlUnlinkNode(xml);
-                    xmlFreeNode(xml);
+                    xml_remove_node(xml);
                 }
                 free(path);
                 return;
@@ -1118,8 +1725,9 @@ is_config_change(xmlNode *xml)
     }
 
     if(xml->doc && xml->doc->_private) {
-        p = xml->doc->_private;
-        for(gIter = p->deleted_objs; gIter; gIter = gIter->next) {
+        xml_doc_private_t *doc = xml->doc->_private;
+
+        for(gIter = doc->deleted_objs; gIter; gIter = gIter->next) {
             xml_deleted_obj_t *deleted_obj = gIter->data;
 
             if(strstr(deleted_obj->path, "/"XML_TAG_CIB"/"XML_CIB_TAG_CONFIGURATION) != NULL) {
@@ -1222,7 +1830,7 @@ xml_create_patchset_v2(xmlNode *source, xmlNode *target)
 {
     int lpc = 0;
     GListPtr gIter = NULL;
-    xml_private_t *doc = NULL;
+    xml_doc_private_t *doc = NULL;
 
     xmlNode *v = NULL;
     xmlNode *version = NULL;
@@ -1530,7 +2138,7 @@ void
 xml_log_changes(uint8_t log_level, const char *function, xmlNode * xml)
 {
     GListPtr gIter = NULL;
-    xml_private_t *doc = NULL;
+    xml_doc_private_t *doc = NULL;
 
     CRM_ASSERT(xml);
     CRM_ASSERT(xml->doc);
@@ -1561,7 +2169,7 @@ void
 xml_accept_changes(xmlNode * xml)
 {
     xmlNode *top = NULL;
-    xml_private_t *doc = NULL;
+    xml_doc_private_t *doc = NULL;
 
     if(xml == NULL) {
         return;
@@ -1571,14 +2179,14 @@ xml_accept_changes(xmlNode * xml)
     doc = xml->doc->_private;
     top = xmlDocGetRootElement(xml->doc);
 
-    __xml_private_clean(xml->doc->_private);
+    __xml_private_clean(doc);
 
     if(is_not_set(doc->flags, xpf_dirty)) {
-        doc->flags = xpf_none;
+        doc->flags &= (xpf_snapshot|xpf_digest_cache);
         return;
     }
 
-    doc->flags = xpf_none;
+    doc->flags &= (xpf_snapshot|xpf_digest_cache);
     __xml_accept_changes(top);
 }
 
@@ -1933,6 +2541,173 @@ __first_xml_child_match(xmlNode *parent, const char *name, const char *id, int p
     return NULL;
 }
 
+/*
+ * Patch target index
+ *
+ * Each change in a v2 patchset locates its target with a path of the form
+ * /TAG[@id='ID']/TAG[@id='ID']..., and finding each component by scanning its
+ * parent's children makes a patchset with many changes (such as a peer's batch
+ * of resource operation results) cost O(changes * siblings). For patchsets
+ * with at least PATCH_INDEX_MIN changes, the elements that have an id are
+ * indexed by parent and id before applying them, and the index is kept
+ * current as the changes create, delete and modify elements.
+ *
+ * A miss falls back to scanning the children, so an element that the index
+ * does not know about (for example, because ACLs prevented its deletion) can
+ * still be found, but the index must never hold an element that was freed.
+ */
+
+#define PATCH_INDEX_MIN 32
+
+typedef struct patch_index_key_s {
+    xmlNode *parent;
+    const char *id;
+} patch_index_key_t;
+
+static guint
+patch_index_hash(gconstpointer key)
+{
+    const patch_index_key_t *k = key;
+
+    return g_str_hash(k->id) ^ g_direct_hash(k->parent);
+}
+
+static gboolean
+patch_index_equal(gconstpointer a, gconstpointer b)
+{
+    const patch_index_key_t *ka = a;
+    const patch_index_key_t *kb = b;
+
+    return (ka->parent == kb->parent) && (strcmp(ka->id, kb->id) == 0);
+}
+
+static void
+patch_index_key_free(gpointer data)
+{
+    patch_index_key_t *key = data;
+
+    free((char *) key->id);
+    free(key);
+}
+
+static void
+patch_index_value_free(gpointer data)
+{
+    g_slist_free(data);
+}
+
+static GHashTable *
+patch_index_new(void)
+{
+    return g_hash_table_new_full(patch_index_hash, patch_index_equal,
+                                 patch_index_key_free, patch_index_value_free);
+}
+
+/*!
+ * \internal
+ * \brief Add an element (and optionally its descendants) to a patch index
+ *
+ * \param[in,out] index      Patch index
+ * \param[in]     xml        Element to add
+ * \param[in]     recursive  Whether to add \p xml's descendants as well
+ */
+static void
+patch_index_add(GHashTable *index, xmlNode *xml, bool recursive)
+{
+    const char *id = NULL;
+
+    if (xml->type != XML_ELEMENT_NODE) {
+        return;
+    }
+
+    id = ID(xml);
+    if ((id != NULL) && (xml->parent != NULL)) {
+        patch_index_key_t lookup = { xml->parent, id };
+        GSList *matches = g_hash_table_lookup(index, &lookup);
+
+        if (matches != NULL) {
+            // Keep document order, so the first match is found first
+            matches = g_slist_append(matches, xml);
+        } else {
+            patch_index_key_t *key = calloc(1, sizeof(patch_index_key_t));
+
+            CRM_ASSERT(key != NULL);
+            key->parent = xml->parent;
+            key->id = strdup(id);
+            g_hash_table_insert(index, key, g_slist_append(NULL, xml));
+        }
+    }
+
+    if (recursive) {
+        for (xmlNode *cIter = __xml_first_child(xml); cIter != NULL;
+             cIter = __xml_next(cIter)) {
+            patch_index_add(index, cIter, TRUE);
+        }
+    }
+}
+
+/*!
+ * \internal
+ * \brief Remove an element (and optionally its descendants) from a patch index
+ *
+ * \param[in,out] index      Patch index
+ * \param[in]     xml        Element to remove
+ * \param[in]     recursive  Whether to remove \p xml's descendants as well
+ */
+static void
+patch_index_remove(GHashTable *index, xmlNode *xml, bool recursive)
+{
+    const char *id = NULL;
+
+    if (xml->type != XML_ELEMENT_NODE) {
+        return;
+    }
+
+    id = ID(xml);
+    if ((id != NULL) && (xml->parent != NULL)) {
+        patch_index_key_t lookup = { xml->parent, id };
+        gpointer key = NULL;
+        gpointer matches = NULL;
+
+        if (g_hash_table_lookup_extended(index, &lookup, &key, &matches)) {
+            // The list head may change, so take the entry out to update it
+            g_hash_table_steal(index, &lookup);
+            matches = g_slist_remove(matches, xml);
+            if (matches == NULL) {
+                patch_index_key_free(key);
+            } else {
+                g_hash_table_insert(index, key, matches);
+            }
+        }
+    }
+
+    if (recursive) {
+        for (xmlNode *cIter = __xml_first_child(xml); cIter != NULL;
+             cIter = __xml_next(cIter)) {
+            patch_index_remove(index, cIter, TRUE);
+        }
+    }
+}
+
+static xmlNode *
+patch_index_find(GHashTable *index, xmlNode *parent, const char *name,
+                 const char *id)
+{
+    patch_index_key_t lookup = { parent, id };
+
+    for (GSList *gIter = g_hash_table_lookup(index, &lookup); gIter != NULL;
+         gIter = gIter->next) {
+        xmlNode *xml = gIter->data;
+
+        if (strcmp((const char *) xml->name, name) == 0) {
+            return xml;
+        }
+    }
+
+    // Fall back to a scan, in case the index is missing something
+    return __first_xml_child_match(parent, name, id, -1);
+}
+
 /*!
  * \internal
  * \brief Simplified, more efficient alternative to get_xpath_object()
@@ -1940,6 +2715,7 @@ __first_xml_child_match(xmlNode *parent, const char *name, const char *id, int p
  * \param[in] top              Root of XML to search
  * \param[in] key              Search xpath
  * \param[in] target_position  If deleting, where to delete
+ * \param[in] index            Patch index of \p top's document (or NULL)
  *
  * \return XML child matching xpath if found, NULL otherwise
  *
@@ -1947,7 +2723,8 @@ __first_xml_child_match(xmlNode *parent, const char *name, const char *id, int p
  *       i.e. the only allowed search predicate is [@id='XXX'].
  */
 static xmlNode *
-__xml_find_path(xmlNode *top, const char *key, int target_position)
+__xml_find_path(xmlNode *top, const char *key, int target_position,
+                GHashTable *index)
 {
     xmlNode *target = (xmlNode*) top->doc;
     const char *current = key;
@@ -1998,7 +2775,11 @@ __xml_find_path(xmlNode *top, const char *key, int target_position)
                     target = __first_xml_child_match(target, tag, NULL, current_position);
                     break;
                 case 2:
-                    target = __first_xml_child_match(target, tag, id, current_position);
+                    if (index != NULL) {
+                        target = patch_index_find(index, target, tag, id);
+                    } else {
+                        target = __first_xml_child_match(target, tag, id, current_position);
+                    }
                     break;
                 default:
                     // This should not be possible
@@ -2030,7 +2811,18 @@ static int
 xml_apply_patchset_v2(xmlNode *xml, xmlNode *patchset)
 {
     int rc = pcmk_ok;
+    int changes = 0;
     xmlNode *change = NULL;
+    GHashTable *index = NULL;
+
+    for (change = __xml_first_child(patchset); change != NULL; change = __xml_next(change)) {
+        changes++;
+    }
+    if (changes >= PATCH_INDEX_MIN) {
+        index = patch_index_new();
+        patch_index_add(index, xmlDocGetRootElement(xml->doc), TRUE);
+    }
+
     for (change = __xml_first_child(patchset); change != NULL; change = __xml_next(change)) {
         xmlNode *match = NULL;
         const char *op = crm_element_value(change, XML_DIFF_OP);
@@ -2045,7 +2837,7 @@ xml_apply_patchset_v2(xmlNode *xml, xmlNode *patchset)
         if(strcmp(op, "delete") == 0) {
             crm_element_value_int(change, XML_DIFF_POSITION, &position);
         }
-        match = __xml_find_path(xml, xpath, position);
+        match = __xml_find_path(xml, xpath, position, index);
         crm_trace("Performing %s on %s with %p", op, xpath, match);
 
         if(match == NULL && strcmp(op, "delete") == 0) {
@@ -2083,7 +2875,11 @@ xml_apply_patchset_v2(xmlNode *xml, xmlNode *patchset)
                 CRM_LOG_ASSERT(position == 0);
                 xmlAddChild(match, child);
             }
+            save_insert(child);
             crm_node_created(child);
+            if (index != NULL) {
+                patch_index_add(index, child, TRUE);
+            }
 
         } else if(strcmp(op, "move") == 0) {
             int position = 0;
@@ -2108,6 +2904,7 @@ xml_apply_patchset_v2(xmlNode *xml, xmlNode *patchset)
                          match->name, position, __xml_offset(match), match->prev,
                          match_child?"next":"last", match_child?match_child:match->parent->last);
 
+                save_move(match);
                 if(match_child) {
                     xmlAddPrevSibling(match_child, match);
 
@@ -2115,6 +2912,7 @@ xml_apply_patchset_v2(xmlNode *xml, xmlNode *patchset)
                     CRM_ASSERT(match->parent->last != NULL);
                     xmlAddNextSibling(match->parent->last, match);
                 }
+                xml_digest_changed(match);
 
             } else {
                 crm_trace("%s is already in position %d", match->name, position);
@@ -2127,6 +2925,9 @@ xml_apply_patchset_v2(xmlNode *xml, xmlNode *patchset)
             }
 
         } else if(strcmp(op, "delete") == 0) {
+            if (index != NULL) {
+                patch_index_remove(index, match, TRUE);
+            }
             free_xml(match);
 
         } else if(strcmp(op, "modify") == 0) {
@@ -2137,6 +2938,10 @@ xml_apply_patchset_v2(xmlNode *xml, xmlNode *patchset)
                 rc = -ENOMSG;
                 continue;
             }
+            if (index != NULL) {
+                // The id may change
+                patch_index_remove(index, match, FALSE);
+            }
             while(pIter != NULL) {
                 const char *name = (const char *)pIter->name;
 
@@ -2150,11 +2955,18 @@ xml_apply_patchset_v2(xmlNode *xml, xmlNode *patchset)
 
                 crm_xml_add(match, name, value);
             }
+            if (index != NULL) {
+                patch_index_add(index, match, FALSE);
+            }
 
         } else {
             crm_err("Unknown operation: %s", op);
         }
     }
+
+    if (index != NULL) {
+        g_hash_table_destroy(index);
+    }
     return rc;
 }
 
@@ -2409,6 +3221,84 @@ expand_plus_plus(xmlNode * target, const char *name, const char *value)
     return;
 }
 
+/*
+ * Name interning
+ *
+ * libxml2 keeps the element and attribute names (and very short text) of a
+ * document that has a dictionary in that dictionary, rather than allocating
+ * them separately for each node. The documents this library creates or parses
+ * in the thread that initialized it all share one dictionary, which lasts as
+ * long as the process, so a name such as "id" or "operation" is stored once
+ * however many CIB copies, requests and results use it, and can be compared
+ * by address with the copy returned by pcmk__xml_intern().
+ *
+ * A dictionary is not thread-safe, so documents from other threads are as
+ * before (parsed ones have their own dictionary), and nodes are copied rather
+ * than moved out of a document whose names another document does not share.
+ * PCMK_xml_intern=false disables this.
+ */
+
+static xmlDict *xml_dict = NULL;
+static GThread *xml_dict_thread = NULL;
+
+// Get the shared dictionary, if it may be used in this thread
+static xmlDict *
+shared_dict(void)
+{
+    if ((xml_dict != NULL) && (g_thread_self() == xml_dict_thread)) {
+        return xml_dict;
+    }
+    return NULL;
+}
+
+static xmlDoc *
+new_xml_doc(xmlDict *dict)
+{
+    xmlDoc *doc = xmlNewDoc((const xmlChar *)"1.0");
+
+    if ((doc != NULL) && (dict != NULL)) {
+        doc->dict = dict;
+        xmlDictReference(dict);
+    }
+    return doc;
+}
+
+// Make a parser use the shared dictionary, if it may be used in this thread
+static void
+use_shared_dict(xmlParserCtxt *ctxt)
+{
+    xmlDict *dict = shared_dict();
+
+    if (dict != NULL) {
+        xmlDictFree(ctxt->dict);
+        ctxt->dict = dict;
+        xmlDictReference(dict);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Get the interned copy of an element or attribute name
+ *
+ * \param[in] name  Name to intern
+ *
+ * \return Copy of \p name shared by nodes using it in documents created in
+ *         this thread (or NULL if names are not interned in this thread)
+ * \note The result is valid for the life of the process, so callers may keep
+ *       it (typically in a static variable, looked up once) and compare node
+ *       names to it with pcmk__xml_name_eq().
+ */
+const char *
+pcmk__xml_intern(const char *name)
+{
+    xmlDict *dict = shared_dict();
+
+    if ((dict == NULL) || (name == NULL)) {
+        return NULL;
+    }
+    return (const char *) xmlDictLookup(dict, (const xmlChar *) name, -1);
+}
+
 xmlDoc *
 getDocPtr(xmlNode * node)
 {
@@ -2418,7 +3308,7 @@ getDocPtr(xmlNode * node)
 
     doc = node->doc;
     if (doc == NULL) {
-        doc = xmlNewDoc((const xmlChar *)"1.0");
+        doc = new_xml_doc(shared_dict());
         xmlDocSetRootElement(doc, node);
         xmlSetTreeDoc(node, doc);
     }
@@ -2435,7 +3325,64 @@ add_node_copy(xmlNode * parent, xmlNode * src_node)
 
     child = xmlDocCopyNode(src_node, doc, 1);
     xmlAddChild(parent, child);
+    save_insert(child);
+    crm_node_created(child);
+    return child;
+}
+
+/*!
+ * \internal
+ * \brief Move an XML tree under a new parent without copying it
+ *
+ * \param[in,out] parent  Node to add \p child to
+ * \param[in,out] child   Node to move (if it is the root of its own document,
+ *                        the emptied document will be freed)
+ *
+ * \return \p child
+ * \note This avoids duplicating large trees (such as transition graphs) that
+ *       are built separately and only then attached to a message. The caller
+ *       must no longer free \p child separately from \p parent.
+ */
+xmlNode *
+pcmk__xml_move(xmlNode *parent, xmlNode *child)
+{
+    xmlDoc *old_doc = NULL;
+    xmlDoc *doc = NULL;
+    bool moved = FALSE;
+
+    CRM_CHECK((parent != NULL) && (child != NULL), return NULL);
+
+    doc = getDocPtr(parent);
+    old_doc = child->doc;
+
+    if ((old_doc != NULL) && (old_doc->dict != NULL)
+        && (old_doc->dict != doc->dict)) {
+        // The names belong to the old document's dictionary
+        xmlNode *copy = add_node_copy(parent, child);
+
+        free_xml(child);
+        return copy;
+    }
+
+    moved = (old_doc == doc) && (child->parent != NULL);
+    if (moved) {
+        save_move(child);
+    }
+    xmlUnlinkNode(child);
+    xmlAddChild(parent, child);
+    if (child->doc != doc) {
+        xmlSetTreeDoc(child, doc);
+    }
+    xml_digest_changed(child);
+    if (moved == FALSE) {
+        save_insert(child);
+    }
     crm_node_created(child);
+
+    if ((old_doc != NULL) && (old_doc != doc)
+        && (xmlDocGetRootElement(old_doc) == NULL)) {
+        xmlFreeDoc(old_doc);
+    }
     return child;
 }
 
@@ -2460,7 +3407,7 @@ __xml_acl_check(xmlNode *xml, const char *name, enum xml_private_flags mode)
             int offset = 0;
             xmlNode *parent = xml;
             char buffer[XML_BUFFER_SIZE];
-            xml_private_t *docp = xml->doc->_private;
+            xml_doc_private_t *docp = xml->doc->_private;
 
             if(docp->acls == NULL) {
                 crm_trace("Ordinary user %s cannot access the CIB without any defined ACLs", docp->user);
@@ -2547,6 +3494,17 @@ crm_xml_add(xmlNode * node, const char *name, const char *value)
         return NULL;
     }
 
+    if (snapshot_of(node) != NULL) {
+        const char *old = crm_element_value(node, name);
+
+        if ((old == NULL) || strcmp(old, value)) {
+            save_attr(node, name);
+        }
+    } else {
+        xml_digest_changed(node);
+    }
+
+    parsed_changed(node);
     attr = xmlSetProp(node, (const xmlChar *)name, (const xmlChar *)value);
     if(dirty) {
         crm_attr_dirty(attr);
@@ -2590,6 +3548,11 @@ crm_xml_replace(xmlNode * node, const char *name, const char *value)
         }
     }
 
+    if ((old_value == NULL) || strcmp(old_value, value)) {
+        save_attr(node, name);
+    }
+
+    parsed_changed(node);
     attr = xmlSetProp(node, (const xmlChar *)name, (const xmlChar *)value);
     if(dirty) {
         crm_attr_dirty(attr);
@@ -2630,7 +3593,7 @@ create_xml_node(xmlNode * parent, const char *name)
     }
 
     if (parent == NULL) {
-        doc = xmlNewDoc((const xmlChar *)"1.0");
+        doc = new_xml_doc(shared_dict());
         node = xmlNewDocRawNode(doc, NULL, (const xmlChar *)name, NULL);
         xmlDocSetRootElement(doc, node);
 
@@ -2638,6 +3601,7 @@ create_xml_node(xmlNode * parent, const char *name)
         doc = getDocPtr(parent);
         node = xmlNewDocRawNode(doc, NULL, (const xmlChar *)name, NULL);
         xmlAddChild(parent, node);
+        save_insert(node);
     }
     crm_node_created(node);
     return node;
@@ -2680,6 +3644,7 @@ free_xml_with_position(xmlNode * child, int position)
         xmlNode *top = NULL;
         xmlDoc *doc = child->doc;
         xml_private_t *p = child->_private;
+        xml_doc_private_t *docp = NULL;
 
         if (doc != NULL) {
             top = xmlDocGetRootElement(doc);
@@ -2720,8 +3685,9 @@ free_xml_with_position(xmlNode * child, int position)
                         }
                     }
 
-                    p = doc->_private;
-                    p->deleted_objs = g_list_append(p->deleted_objs, deleted_obj);
+                    docp = doc->_private;
+                    docp->deleted_objs = g_list_append(docp->deleted_objs,
+                                                       deleted_obj);
                     set_doc_flag(child, xpf_dirty);
                 }
             }
@@ -2729,8 +3695,7 @@ free_xml_with_position(xmlNode * child, int position)
             /* Free this particular subtree
              * Make sure to unlink it from the parent first
              */
-            xmlUnlinkNode(child);
-            xmlFreeNode(child);
+            xml_remove_node(child);
         }
     }
 }
@@ -2742,10 +3707,115 @@ free_xml(xmlNode * child)
     free_xml_with_position(child, -1);
 }
 
-xmlNode *
-copy_xml(xmlNode * src)
+/*
+ * Deferred freeing
+ *
+ * Freeing a whole CIB walks (and deregisters) every node, which can take long
+ * enough on a large cluster to delay the reply or event that the daemon is
+ * handling. pcmk__xml_free_later() instead queues large documents to be freed
+ * by a low-priority trigger once the main loop is otherwise idle, a few at a
+ * time. Nothing is deferred outside a main loop dispatch or from other
+ * threads, because the trigger would never run (or would run in the wrong
+ * thread).
+ */
+
+// Documents with at least this many elements are worth deferring
+#define FREE_LATER_MIN_NODES 1000
+
+// Stop freeing deferred documents once a dispatch has taken this long
+#define FREE_LATER_BUDGET_US 2000
+
+static GQueue *free_later_queue = NULL;
+static crm_trigger_t *free_later_trigger = NULL;
+
+// Count elements in a tree, stopping once there are at least max
+static int
+count_elements(xmlNode *xml, int max)
 {
-    xmlDoc *doc = xmlNewDoc((const xmlChar *)"1.0");
+    int count = 1;
+
+    for (xmlNode *child = __xml_first_child_element(xml);
+         (child != NULL) && (count < max);
+         child = __xml_next_element(child)) {
+        count += count_elements(child, max - count);
+    }
+    return count;
+}
+
+static gboolean
+free_deferred_xml(gpointer user_data)
+{
+    gint64 start = g_get_monotonic_time();
+    guint freed = 0;
+
+    while (!g_queue_is_empty(free_later_queue)) {
+        xmlFreeDoc(g_queue_pop_head(free_later_queue));
+        freed++;
+        if ((g_get_monotonic_time() - start) >= FREE_LATER_BUDGET_US) {
+            break;
+        }
+    }
+    crm_trace("Freed %u deferred XML document%s (%u remaining)",
+              freed, ((freed == 1)? "" : "s"),
+              g_queue_get_length(free_later_queue));
+    if (!g_queue_is_empty(free_later_queue)) {
+        mainloop_set_trigger(free_later_trigger);
+    }
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Free an XML document, possibly once the main loop is idle
+ *
+ * \param[in] xml  Root element of document to free
+ *
+ * \note This behaves like free_xml() for anything other than the root of a
+ *       large document, or when not called from the main loop.
+ */
+void
+pcmk__xml_free_later(xmlNode *xml)
+{
+    if ((xml == NULL) || (xml->doc == NULL)
+        || (xmlDocGetRootElement(xml->doc) != xml)
+        || (g_main_depth() == 0) || (g_thread_self() != xml_main_thread)
+        || (count_elements(xml, FREE_LATER_MIN_NODES)
+            < FREE_LATER_MIN_NODES)) {
+        free_xml(xml);
+        return;
+    }
+
+    if (free_later_queue == NULL) {
+        free_later_queue = g_queue_new();
+        free_later_trigger = mainloop_add_trigger(G_PRIORITY_LOW,
+                                                  free_deferred_xml, NULL);
+        pcmk__trigger_set_name(free_later_trigger, "deferred XML free");
+    }
+    g_queue_push_tail(free_later_queue, xml->doc);
+    mainloop_set_trigger(free_later_trigger);
+}
+
+/*!
+ * \internal
+ * \brief Free any XML documents whose freeing was deferred
+ */
+void
+pcmk__xml_free_deferred(void)
+{
+    if (free_later_queue != NULL) {
+        g_queue_free_full(free_later_queue, (GDestroyNotify) xmlFreeDoc);
+        free_later_queue = NULL;
+    }
+    if (free_later_trigger != NULL) {
+        mainloop_destroy_trigger(free_later_trigger);
+        free_later_trigger = NULL;
+    }
+}
+
+static xmlNode *
+copy_xml_with_dict(xmlNode *src, xmlDict *dict)
+{
+    xmlDoc *doc = new_xml_doc(dict);
     xmlNode *copy = xmlDocCopyNode(src, doc, 1);
 
     xmlDocSetRootElement(doc, copy);
@@ -2753,6 +3823,12 @@ copy_xml(xmlNode * src)
     return copy;
 }
 
+xmlNode *
+copy_xml(xmlNode * src)
+{
+    return copy_xml_with_dict(src, shared_dict());
+}
+
 static void
 crm_xml_err(void *ctx, const char *fmt, ...)
 G_GNUC_PRINTF(2, 3);
@@ -2798,6 +3874,7 @@ string2xml(const char *input)
     CRM_CHECK(ctxt != NULL, return NULL);
 
     /* xmlCtxtUseOptions(ctxt, XML_PARSE_NOBLANKS|XML_PARSE_RECOVER); */
+    use_shared_dict(ctxt);
 
     xmlCtxtResetLastError(ctxt);
     xmlSetGenericErrorFunc(ctxt, crm_xml_err);
@@ -2845,6 +3922,161 @@ string2xml(const char *input)
     return xml;
 }
 
+/*!
+ * \internal
+ * \brief Copy an XML attribute value, replacing entity and character references
+ *
+ * \param[in] start  Start of value
+ * \param[in] len    Length of value
+ *
+ * \return Newly allocated unescaped value, or NULL if it has a reference that
+ *         cannot be handled here
+ */
+static char *
+unescape_attr_value(const char *start, size_t len)
+{
+    static const struct {
+        const char *ref;
+        char c;
+    } entities[] = {
+        { "&lt;", '<' }, { "&gt;", '>' }, { "&amp;", '&' },
+        { "&quot;", '"' }, { "&apos;", '\'' },
+    };
+    char *value = calloc(1, len + 1);
+    char *out = value;
+    const char *end = start + len;
+
+    CRM_ASSERT(value != NULL);
+    for (const char *p = start; p < end; ) {
+        const char *semi = NULL;
+        bool found = FALSE;
+
+        if (*p != '&') {
+            *out++ = *p++;
+            continue;
+        }
+
+        semi = memchr(p, ';', end - p);
+        if (semi == NULL) {
+            free(value);
+            return NULL;
+        }
+        if (p[1] == '#') {
+            char *num_end = NULL;
+            long c = (p[2] == 'x')? strtol(p + 3, &num_end, 16)
+                                  : strtol(p + 2, &num_end, 10);
+
+            // Anything but plain ASCII needs a real parser
+            if ((num_end == semi) && (c > 0) && (c < 0x80)) {
+                *out++ = (char) c;
+                found = TRUE;
+            }
+        } else {
+            for (int lpc = 0; lpc < DIMOF(entities); lpc++) {
+                size_t ref_len = strlen(entities[lpc].ref);
+
+                if (((size_t) (semi - p + 1) == ref_len)
+                    && (strncmp(p, entities[lpc].ref, ref_len) == 0)) {
+                    *out++ = entities[lpc].c;
+                    found = TRUE;
+                    break;
+                }
+            }
+        }
+        if (!found) {
+            free(value);
+            return NULL;
+        }
+        p = semi + 1;
+    }
+    return value;
+}
+
+/*!
+ * \internal
+ * \brief Get an attribute of the root element of XML text without parsing it
+ *
+ * Daemons often need only a few attributes of a message's top-level element
+ * to know whether the message concerns them at all. This scans the start tag
+ * of the root element for one of them, without building a document.
+ *
+ * \param[in]  text   XML text
+ * \param[in]  name   Name of attribute to get
+ * \param[out] value  Where to store newly allocated value (NULL if absent)
+ *
+ * \return pcmk_ok on success, or -EINVAL if the text could not be scanned
+ *         (the caller should fully parse it instead)
+ */
+int
+pcmk__xml_peek_attr(const char *text, const char *name, char **value)
+{
+    size_t name_len = strlen(name);
+    const char *p = text;
+
+    CRM_ASSERT(value != NULL);
+    *value = NULL;
+    if (p == NULL) {
+        return -EINVAL;
+    }
+
+    // Skip any XML declaration, comments and whitespace before the root
+    while (TRUE) {
+        p += strspn(p, " \t\r\n");
+        if (strncmp(p, "<?", 2) == 0) {
+            p = strstr(p, "?>");
+        } else if (strncmp(p, "<!--", 4) == 0) {
+            p = strstr(p, "-->");
+        } else {
+            break;
+        }
+        if (p == NULL) {
+            return -EINVAL;
+        }
+        p = strchr(p, '>') + 1;
+    }
+    if ((*p != '<') || !isalpha((unsigned char) p[1])) {
+        return -EINVAL;
+    }
+
+    // Skip the element name, then check each attribute
+    p += strcspn(p, " \t\r\n/>");
+    while (TRUE) {
+        const char *attr = NULL;
+        size_t attr_len = 0;
+        const char *end = NULL;
+        char quote = 0;
+
+        p += strspn(p, " \t\r\n");
+        if ((*p == '>') || (*p == '/')) {
+            return pcmk_ok; // end of start tag, not found
+        }
+
+        attr = p;
+        attr_len = strcspn(p, " \t\r\n=");
+        p += attr_len;
+        p += strspn(p, " \t\r\n");
+        if (*p != '=') {
+            return -EINVAL;
+        }
+        p++;
+        p += strspn(p, " \t\r\n");
+        quote = *p;
+        if ((quote != '"') && (quote != '\'')) {
+            return -EINVAL;
+        }
+        end = strchr(++p, quote);
+        if (end == NULL) {
+            return -EINVAL;
+        }
+
+        if ((attr_len == name_len) && (strncmp(attr, name, name_len) == 0)) {
+            *value = unescape_attr_value(p, end - p);
+            return (*value == NULL)? -EINVAL : pcmk_ok;
+        }
+        p = end + 1;
+    }
+}
+
 xmlNode *
 stdin2xml(void)
 {
@@ -2941,6 +4173,7 @@ strip_text_nodes(xmlNode * xml)
         switch (iter->type) {
             case XML_TEXT_NODE:
                 /* Remove it */
+                xml_digest_changed(iter->parent);
                 xmlUnlinkNode(iter);
                 xmlFreeNode(iter);
                 break;
@@ -2959,6 +4192,23 @@ strip_text_nodes(xmlNode * xml)
     }
 }
 
+// Check whether a file starts with the bzip2 signature, whatever its name
+static bool
+has_bzip2_magic(const char *filename)
+{
+    char magic[3] = { 0, };
+    FILE *fp = fopen(filename, "r");
+
+    if (fp == NULL) {
+        return FALSE;
+    }
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic)) {
+        magic[0] = '\0';
+    }
+    fclose(fp);
+    return (magic[0] == 'B') && (magic[1] == 'Z') && (magic[2] == 'h');
+}
+
 xmlNode *
 filename2xml(const char *filename)
 {
@@ -2974,13 +4224,15 @@ filename2xml(const char *filename)
     CRM_CHECK(ctxt != NULL, return NULL);
 
     /* xmlCtxtUseOptions(ctxt, XML_PARSE_NOBLANKS|XML_PARSE_RECOVER); */
+    use_shared_dict(ctxt);
 
     xmlCtxtResetLastError(ctxt);
     xmlSetGenericErrorFunc(ctxt, crm_xml_err);
     /* initGenericErrorDefaultFunc(crm_xml_err); */
 
     if (filename) {
-        uncompressed = !crm_ends_with_ext(filename, ".bz2");
+        uncompressed = !crm_ends_with_ext(filename, ".bz2")
+                       && !has_bzip2_magic(filename);
     }
 
     if (filename == NULL) {
@@ -3243,112 +4495,202 @@ add_message_xml(xmlNode * msg, const char *field, xmlNode * xml)
     return TRUE;
 }
 
-static char *
-crm_xml_escape_shuffle(char *text, int start, int *length, const char *replace)
+/*
+ * When xmlCtxtReadDoc() parses &lt; and friends in a value, it converts them
+ * to their human readable form.
+ *
+ * If one uses xmlNodeDump() to convert it back to a string, all is well,
+ * because special characters are converted back to their escape sequences.
+ *
+ * However xmlNodeDump() is randomly dog slow, even with the same input. So we
+ * need to replicate the escaping in our custom version so that the result can
+ * be re-parsed by xmlCtxtReadDoc() when necessary.
+ *
+ * Almost all values need no escaping at all, so they are first scanned a word
+ * at a time for any character that does, and copied unchanged if none does.
+ * The escaped text is part of what CIB digests are calculated over, so it
+ * must stay exactly the same as older versions produce.
+ */
+
+#define ESCAPE_ONES  0x0101010101010101ULL
+#define ESCAPE_HIGHS 0x8080808080808080ULL
+
+// Whether any byte of a word is less than n (which must be at most 128)
+#define word_has_less(word, n) \
+    (((word) - ESCAPE_ONES * (n)) & ~(word) & ESCAPE_HIGHS)
+
+// Whether any byte of a word is c
+#define word_has_byte(word, c) word_has_less((word) ^ (ESCAPE_ONES * (c)), 1)
+
+static inline bool
+xml_char_escaped(char c)
+{
+    switch (c) {
+        case '<':
+        case '>':
+        case '"':
+        case '\'':
+        case '&':
+            return TRUE;
+        default:
+            return (c < ' ') || (c > '~');
+    }
+}
+
+/*!
+ * \internal
+ * \brief Find the first character of a string that must be escaped
+ *
+ * \param[in] text    String to scan
+ * \param[in] length  Length of \p text
+ *
+ * \return Index of first character to escape, or \p length if none
+ */
+static size_t
+xml_escape_scan(const char *text, size_t length)
+{
+    size_t index = 0;
+
+    for (; (index + sizeof(uint64_t)) <= length; index += sizeof(uint64_t)) {
+        uint64_t word;
+
+        memcpy(&word, text + index, sizeof(word));
+        if ((word & ESCAPE_HIGHS) || word_has_less(word, ' ')
+            || word_has_byte(word, 0x7f)
+            || word_has_byte(word, '<') || word_has_byte(word, '>')
+            || word_has_byte(word, '"') || word_has_byte(word, '\'')
+            || word_has_byte(word, '&')) {
+            break;
+        }
+    }
+    for (; index < length; index++) {
+        if (xml_char_escaped(text[index])) {
+            break;
+        }
+    }
+    return index;
+}
+
+/*!
+ * \internal
+ * \brief Get the escaped form of a character
+ *
+ * \param[in]  c       Character to escape
+ * \param[out] octal   Buffer for octal escape (at least 16 bytes)
+ *
+ * \return Replacement text for \p c, or NULL if it is not escaped
+ */
+static const char *
+xml_escape_char(char c, char *octal)
+{
+    switch (c) {
+        case '<':
+            return "&lt;";
+        case '>':
+            return "&gt;";
+        case '"':
+            return "&quot;";
+        case '\'':
+            return "&apos;";
+        case '&':
+            return "&amp;";
+        case '\t':
+            /* Might as well just expand to a few spaces... */
+            return "    ";
+        case '\n':
+            return "\\n";
+        case '\r':
+            return "\\r";
+        default:
+            /* Replace non-printing characters with their octal equivalent */
+            if ((c < ' ') || (c > '~')) {
+                snprintf(octal, 16, "\\%.3o", c);
+                return octal;
+            }
+            return NULL;
+    }
+}
+
+// Get the escaped length of a string whose first escaped character is at start
+static size_t
+xml_escaped_length(const char *text, size_t length, size_t start)
+{
+    size_t escaped = start;
+    char octal[16];
+
+    for (size_t index = start; index < length; index++) {
+        const char *replace = xml_escape_char(text[index], octal);
+
+        escaped += replace? strlen(replace) : 1;
+    }
+    return escaped;
+}
+
+// Copy the escaped form of a string (dest must have room for it and a null)
+static void
+xml_copy_escaped(char *dest, const char *text, size_t length, size_t start)
+{
+    char octal[16];
+
+    memcpy(dest, text, start);
+    dest += start;
+    for (size_t index = start; index < length; index++) {
+        const char *replace = xml_escape_char(text[index], octal);
+
+        if (replace == NULL) {
+            *dest++ = text[index];
+        } else {
+            size_t replace_len = strlen(replace);
+
+            memcpy(dest, replace, replace_len);
+            dest += replace_len;
+        }
+    }
+    *dest = '\0';
+}
+
+// Append the escaped form of a string to an output buffer
+static void
+buffer_add_escaped(char **buffer, int *offset, int *max, const char *text)
 {
-    int lpc;
-    int offset = strlen(replace) - 1;   /* We have space for 1 char already */
-
-    *length += offset;
-    text = realloc_safe(text, *length);
+    size_t length = strlen(text);
+    size_t start = xml_escape_scan(text, length);
+    size_t escaped = 0;
 
-    for (lpc = (*length) - 1; lpc > (start + offset); lpc--) {
-        text[lpc] = text[lpc - offset];
+    if (start == length) {
+        buffer_add_text(buffer, offset, max, text, length);
+        return;
     }
-
-    memcpy(text + start, replace, offset + 1);
-    return text;
+    escaped = xml_escaped_length(text, length, start);
+    buffer_reserve(buffer, offset, max, escaped);
+    xml_copy_escaped(*buffer + *offset, text, length, start);
+    *offset += escaped;
 }
 
 char *
 crm_xml_escape(const char *text)
 {
-    int index;
-    int changes = 0;
-    int length = 1 + strlen(text);
-    char *copy = strdup(text);
-
-    /*
-     * When xmlCtxtReadDoc() parses &lt; and friends in a
-     * value, it converts them to their human readable
-     * form.
-     *
-     * If one uses xmlNodeDump() to convert it back to a
-     * string, all is well, because special characters are
-     * converted back to their escape sequences.
-     *
-     * However xmlNodeDump() is randomly dog slow, even with the same
-     * input. So we need to replicate the escaping in our custom
-     * version so that the result can be re-parsed by xmlCtxtReadDoc()
-     * when necessary.
-     */
+    size_t length = strlen(text);
+    size_t start = xml_escape_scan(text, length);
+    char *copy = NULL;
 
-    for (index = 0; index < length; index++) {
-        switch (copy[index]) {
-            case 0:
-                break;
-            case '<':
-                copy = crm_xml_escape_shuffle(copy, index, &length, "&lt;");
-                changes++;
-                break;
-            case '>':
-                copy = crm_xml_escape_shuffle(copy, index, &length, "&gt;");
-                changes++;
-                break;
-            case '"':
-                copy = crm_xml_escape_shuffle(copy, index, &length, "&quot;");
-                changes++;
-                break;
-            case '\'':
-                copy = crm_xml_escape_shuffle(copy, index, &length, "&apos;");
-                changes++;
-                break;
-            case '&':
-                copy = crm_xml_escape_shuffle(copy, index, &length, "&amp;");
-                changes++;
-                break;
-            case '\t':
-                /* Might as well just expand to a few spaces... */
-                copy = crm_xml_escape_shuffle(copy, index, &length, "    ");
-                changes++;
-                break;
-            case '\n':
-                /* crm_trace("Convert: \\%.3o", copy[index]); */
-                copy = crm_xml_escape_shuffle(copy, index, &length, "\\n");
-                changes++;
-                break;
-            case '\r':
-                copy = crm_xml_escape_shuffle(copy, index, &length, "\\r");
-                changes++;
-                break;
-                /* For debugging...
-            case '\\':
-                crm_trace("Passthrough: \\%c", copy[index+1]);
-                break;
-                */
-            default:
-                /* Check for and replace non-printing characters with their octal equivalent */
-                if(copy[index] < ' ' || copy[index] > '~') {
-                    char *replace = crm_strdup_printf("\\%.3o", copy[index]);
-
-                    /* crm_trace("Convert to octal: \\%.3o", copy[index]); */
-                    copy = crm_xml_escape_shuffle(copy, index, &length, replace);
-                    free(replace);
-                    changes++;
-                }
-        }
+    if (start == length) {
+        copy = strdup(text);
+        CRM_ASSERT(copy != NULL);
+        return copy;
     }
 
-    if (changes) {
-        crm_trace("Dumped '%s'", copy);
-    }
+    copy = malloc(xml_escaped_length(text, length, start) + 1);
+    CRM_ASSERT(copy != NULL);
+    xml_copy_escaped(copy, text, length, start);
+    crm_trace("Dumped '%s'", copy);
     return copy;
 }
 
 static inline void
 dump_xml_attr(xmlAttrPtr attr, int options, char **buffer, int *offset, int *max)
 {
-    char *p_value = NULL;
+    const char *p_value = NULL;
     const char *p_name = NULL;
     xml_private_t *p = NULL;
 
@@ -3363,9 +4705,15 @@ dump_xml_attr(xmlAttrPtr attr, int options, char **buffer, int *offset, int *max
     }
 
     p_name = (const char *)attr->name;
-    p_value = crm_xml_escape((const char *)attr->children->content);
-    buffer_print(*buffer, *max, *offset, " %s=\"%s\"", p_name, p_value);
-    free(p_value);
+    p_value = (const char *)attr->children->content;
+
+    // Room for the name, delimiters and value if it needs no escaping
+    buffer_reserve(buffer, offset, max, strlen(p_name) + strlen(p_value) + 4);
+    buffer_add_literal(buffer, offset, max, " ");
+    buffer_add_text(buffer, offset, max, p_name, strlen(p_name));
+    buffer_add_literal(buffer, offset, max, "=\"");
+    buffer_add_escaped(buffer, offset, max, p_value);
+    buffer_add_literal(buffer, offset, max, "\"");
 }
 
 static void
@@ -3642,30 +4990,18 @@ dump_filtered_xml(xmlNode * data, int options, char **buffer, int *offset, int *
     }
 }
 
+// Dump an element's start tag (or its only tag, if it has no children)
 static void
-dump_xml_element(xmlNode * data, int options, char **buffer, int *offset, int *max, int depth)
+dump_xml_element_start(xmlNode *data, int options, char **buffer, int *offset,
+                       int *max, int depth)
 {
-    const char *name = NULL;
-
-    CRM_ASSERT(max != NULL);
-    CRM_ASSERT(offset != NULL);
-    CRM_ASSERT(buffer != NULL);
-
-    if (data == NULL) {
-        crm_trace("Nothing to dump");
-        return;
-    }
-
-    if (*buffer == NULL) {
-        *offset = 0;
-        *max = 0;
-    }
+    const char *name = crm_element_name(data);
 
-    name = crm_element_name(data);
     CRM_ASSERT(name != NULL);
 
     insert_prefix(options, buffer, offset, max, depth);
-    buffer_print(*buffer, *max, *offset, "<%s", name);
+    buffer_add_literal(buffer, offset, max, "<");
+    buffer_add_text(buffer, offset, max, name, strlen(name));
 
     if (options & xml_log_option_filtered) {
         dump_filtered_xml(data, options, buffer, offset, max);
@@ -3679,29 +5015,63 @@ dump_xml_element(xmlNode * data, int options, char **buffer, int *offset, int *m
     }
 
     if (data->children == NULL) {
-        buffer_print(*buffer, *max, *offset, "/>");
+        buffer_add_literal(buffer, offset, max, "/>");
 
     } else {
-        buffer_print(*buffer, *max, *offset, ">");
+        buffer_add_literal(buffer, offset, max, ">");
     }
 
     if (options & xml_log_option_formatted) {
-        buffer_print(*buffer, *max, *offset, "\n");
+        buffer_add_literal(buffer, offset, max, "\n");
     }
+}
 
+// Dump an element's end tag (if it has children)
+static void
+dump_xml_element_end(xmlNode *data, int options, char **buffer, int *offset,
+                     int *max, int depth)
+{
     if (data->children) {
-        xmlNode *xChild = NULL;
-        for(xChild = data->children; xChild != NULL; xChild = xChild->next) {
-            crm_xml_dump(xChild, options, buffer, offset, max, depth + 1);
-        }
+        const char *name = crm_element_name(data);
 
         insert_prefix(options, buffer, offset, max, depth);
-        buffer_print(*buffer, *max, *offset, "</%s>", name);
+        buffer_add_literal(buffer, offset, max, "</");
+        buffer_add_text(buffer, offset, max, name, strlen(name));
+        buffer_add_literal(buffer, offset, max, ">");
 
         if (options & xml_log_option_formatted) {
-            buffer_print(*buffer, *max, *offset, "\n");
+            buffer_add_literal(buffer, offset, max, "\n");
+        }
+    }
+}
+
+static void
+dump_xml_element(xmlNode * data, int options, char **buffer, int *offset, int *max, int depth)
+{
+    CRM_ASSERT(max != NULL);
+    CRM_ASSERT(offset != NULL);
+    CRM_ASSERT(buffer != NULL);
+
+    if (data == NULL) {
+        crm_trace("Nothing to dump");
+        return;
+    }
+
+    if (*buffer == NULL) {
+        *offset = 0;
+        *max = 0;
+    }
+
+    dump_xml_element_start(data, options, buffer, offset, max, depth);
+
+    if (data->children) {
+        xmlNode *xChild = NULL;
+        for(xChild = data->children; xChild != NULL; xChild = xChild->next) {
+            crm_xml_dump(xChild, options, buffer, offset, max, depth + 1);
         }
     }
+
+    dump_xml_element_end(data, options, buffer, offset, max, depth);
 }
 
 static void
@@ -3723,10 +5093,13 @@ dump_xml_text(xmlNode * data, int options, char **buffer, int *offset, int *max,
 
     insert_prefix(options, buffer, offset, max, depth);
 
-    buffer_print(*buffer, *max, *offset, "%s", data->content);
+    if (data->content != NULL) {
+        buffer_add_text(buffer, offset, max, (const char *) data->content,
+                        strlen((const char *) data->content));
+    }
 
     if (options & xml_log_option_formatted) {
-        buffer_print(*buffer, *max, *offset, "\n");
+        buffer_add_literal(buffer, offset, max, "\n");
     }
 }
 
@@ -3750,12 +5123,15 @@ dump_xml_comment(xmlNode * data, int options, char **buffer, int *offset, int *m
 
     insert_prefix(options, buffer, offset, max, depth);
 
-    buffer_print(*buffer, *max, *offset, "<!--");
-    buffer_print(*buffer, *max, *offset, "%s", data->content);
-    buffer_print(*buffer, *max, *offset, "-->");
+    buffer_add_literal(buffer, offset, max, "<!--");
+    if (data->content != NULL) {
+        buffer_add_text(buffer, offset, max, (const char *) data->content,
+                        strlen((const char *) data->content));
+    }
+    buffer_add_literal(buffer, offset, max, "-->");
 
     if (options & xml_log_option_formatted) {
-        buffer_print(*buffer, *max, *offset, "\n");
+        buffer_add_literal(buffer, offset, max, "\n");
     }
 }
 
@@ -3862,10 +5238,197 @@ crm_xml_dump(xmlNode * data, int options, char **buffer, int *offset, int *max,
 
 }
 
+/*
+ * Digest caching
+ *
+ * Digests of the CIB (see calculate_xml_versioned_digest()) are an MD5 sum of
+ * the whole serialized document, so they must be recalculated in full after
+ * every change, even though most of the text is unchanged. For documents that
+ * have digest caching enabled, each element below the top levels keeps the
+ * serialized text of its subtree (up to XML_DIGEST_SEGMENT_MAX bytes; larger
+ * subtrees instead rely on their children's caches), and any change discards
+ * the cached text of the changed node and its ancestors only. The digest is
+ * then calculated by streaming the cached text of unchanged subtrees and
+ * serializing only the changed ones, giving exactly the same result as
+ * serializing the whole document.
+ */
+
+#define XML_DIGEST_SKELETON_DEPTH 2
+#define XML_DIGEST_SEGMENT_MAX 8192
+
+static void
+digest_add_text(struct md5_ctx *ctx, const char *text, int length)
+{
+    if ((text != NULL) && (length > 0)) {
+        md5_process_bytes(text, length, ctx);
+    }
+}
+
+static void
+digest_add_xml(struct md5_ctx *ctx, xmlNode *xml, int options, int depth)
+{
+    xml_cache_t *cache = NULL;
+    char *buffer = NULL;
+    int offset = 0;
+    int max = 0;
+
+    if ((xml->type != XML_ELEMENT_NODE) || (xml->_private == NULL)) {
+        crm_xml_dump(xml, options, &buffer, &offset, &max, depth);
+        digest_add_text(ctx, buffer, offset);
+        free(buffer);
+        return;
+    }
+
+    cache = ((xml_private_t *) xml->_private)->cache;
+    if ((cache != NULL) && (cache->digest_text != NULL)
+        && (cache->digest_options == options)) {
+        digest_add_text(ctx, cache->digest_text, cache->digest_len);
+        return;
+    }
+
+    if ((depth >= XML_DIGEST_SKELETON_DEPTH)
+        && ((cache == NULL) || !cache->digest_large)) {
+        crm_xml_dump(xml, options, &buffer, &offset, &max, depth);
+        digest_add_text(ctx, buffer, offset);
+        cache = __xml_cache(xml);
+        free(cache->digest_text);
+        cache->digest_text = NULL;
+        if (offset <= XML_DIGEST_SEGMENT_MAX) {
+            cache->digest_text = buffer;
+            cache->digest_len = offset;
+            cache->digest_options = options;
+        } else {
+            cache->digest_large = TRUE;
+            free(buffer);
+        }
+        return;
+    }
+
+    dump_xml_element_start(xml, options, &buffer, &offset, &max, depth);
+    digest_add_text(ctx, buffer, offset);
+
+    for (xmlNode *child = xml->children; child != NULL; child = child->next) {
+        digest_add_xml(ctx, child, options, depth + 1);
+    }
+
+    offset = 0;
+    dump_xml_element_end(xml, options, &buffer, &offset, &max, depth);
+    digest_add_text(ctx, buffer, offset);
+    free(buffer);
+}
+
+/*!
+ * \internal
+ * \brief Enable digest caching for a document
+ *
+ * \param[in,out] xml  Any node in the document
+ *
+ * \note All changes to the document must then be made using this library's
+ *       functions, so that cached text is discarded when it becomes stale.
+ */
+void
+pcmk__xml_cache_digests(xmlNode *xml)
+{
+    if ((xml != NULL) && (xml->doc != NULL) && (xml->doc->_private != NULL)) {
+        set_doc_flag(xml, xpf_digest_cache);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Calculate the MD5 sum of an XML subtree's text using cached text
+ *
+ * \param[in] xml      Root of subtree to digest
+ * \param[in] options  Group of enum xml_log_options flags to dump with
+ *
+ * \return Newly allocated digest, identical to crm_md5sum() of the dumped
+ *         subtree, or NULL if the document does not have digest caching enabled
+ */
+char *
+pcmk__xml_cached_digest(xmlNode *xml, int options)
+{
+    struct md5_ctx ctx;
+    unsigned char raw_digest[MD5_DIGEST_SIZE];
+    char *digest = NULL;
+
+    if ((xml == NULL) || (xml->type != XML_ELEMENT_NODE)
+        || (xml->doc == NULL) || (xml->doc->_private == NULL)
+        || is_not_set(((xml_private_t *) xml->doc->_private)->flags,
+                      xpf_digest_cache)
+        || is_set(options, xml_log_option_formatted)) {
+        return NULL;
+    }
+
+    md5_init_ctx(&ctx);
+    digest_add_xml(&ctx, xml, options, 0);
+    md5_finish_ctx(&ctx, raw_digest);
+
+    digest = malloc(2 * MD5_DIGEST_SIZE + 1);
+    CRM_ASSERT(digest != NULL);
+    for (int lpc = 0; lpc < MD5_DIGEST_SIZE; lpc++) {
+        sprintf(digest + (2 * lpc), "%02x", raw_digest[lpc]);
+    }
+    digest[2 * MD5_DIGEST_SIZE] = '\0';
+    return digest;
+}
+
+/*!
+ * \internal
+ * \brief Get the values a caller has parsed from an element's attributes
+ *
+ * \param[in] xml  Element to check
+ *
+ * \return Values kept with pcmk__xml_set_parsed(), or NULL if none have been
+ *         (or an attribute of \p xml has changed since)
+ */
+void *
+pcmk__xml_parsed(const xmlNode *xml)
+{
+    xml_private_t *p = NULL;
+
+    if ((xml == NULL) || (xml->type != XML_ELEMENT_NODE)) {
+        return NULL;
+    }
+    p = xml->_private;
+    return ((p != NULL) && (p->cache != NULL))? p->cache->parsed : NULL;
+}
+
+/*!
+ * \internal
+ * \brief Keep values parsed from an element's attributes with the element
+ *
+ * \param[in,out] xml      Element that values were parsed from
+ * \param[in]     parsed   Parsed values
+ * \param[in]     free_fn  Function to free \p parsed with
+ *
+ * \return true if \p parsed is now owned by \p xml, otherwise false
+ * \note \p parsed is freed along with \p xml, or as soon as one of its
+ *       attributes is changed using this library's functions. Since an element
+ *       can have only one set of parsed values, only the code that interprets a
+ *       particular kind of element should use this for it.
+ */
+bool
+pcmk__xml_set_parsed(xmlNode *xml, void *parsed, GDestroyNotify free_fn)
+{
+    xml_cache_t *cache = NULL;
+
+    CRM_CHECK((parsed != NULL) && (free_fn != NULL), return FALSE);
+    if ((xml == NULL) || (xml->type != XML_ELEMENT_NODE)
+        || (xml->_private == NULL)) {
+        return FALSE;
+    }
+
+    parsed_changed(xml);
+    cache = __xml_cache(xml);
+    cache->parsed = parsed;
+    cache->parsed_free = free_fn;
+    return TRUE;
+}
+
 void
 crm_buffer_add_char(char **buffer, int *offset, int *max, char c)
 {
-    buffer_print(*buffer, *max, *offset, "%c", c);
+    buffer_add_text(buffer, offset, max, &c, 1);
 }
 
 char *
@@ -3947,18 +5510,25 @@ xml_remove_prop(xmlNode * obj, const char *name)
 {
     if(__xml_acl_check(obj, NULL, xpf_acl_write) == FALSE) {
         crm_trace("Cannot remove %s from %s", name, obj->name);
+        return;
+    }
 
-    } else if(TRACKING_CHANGES(obj)) {
+    parsed_changed(obj);
+    if(TRACKING_CHANGES(obj)) {
         /* Leave in place (marked for removal) until after the diff is calculated */
         xml_private_t *p = NULL;
         xmlAttr *attr = xmlHasProp(obj, (const xmlChar *)name);
 
+        save_attr(obj, name);
         p = attr->_private;
         set_parent_flag(obj, xpf_dirty);
         p->flags |= xpf_deleted;
         /* crm_trace("Setting flag %x due to %s[@id=%s].%s", xpf_dirty, obj->name, ID(obj), name); */
 
     } else {
+        if (xmlHasProp(obj, (const xmlChar *)name) != NULL) {
+            save_attr(obj, name);
+        }
         xmlUnsetProp(obj, (const xmlChar *)name);
     }
 }
@@ -4675,6 +6245,7 @@ add_xml_object(xmlNode * parent, xmlNode * target, xmlNode * update, gboolean as
             const char *p_value = crm_attr_value(pIter);
 
             /* Remove it first so the ordering of the update is preserved */
+            xml_digest_changed(target);
             xmlUnsetProp(target, (const xmlChar *)p_name);
             xmlSetProp(target, (const xmlChar *)p_name, (const xmlChar *)p_value);
         }
@@ -4809,12 +6380,22 @@ replace_xml_child(xmlNode * parent, xmlNode * child, xmlNode * update, gboolean
             free_xml(child);
 
         } else {
-            xmlNode *tmp = copy_xml(update);
+            // It will replace child, so it must share child's names
+            xmlNode *tmp = copy_xml_with_dict(update, child->doc->dict);
             xmlDoc *doc = tmp->doc;
             xmlNode *old = NULL;
 
+            bool saved = (snapshot_of(child) != NULL);
+
             xml_accept_changes(tmp);
+            if (saved) {
+                save_change(snapshot_of(child), xml_saved_remove, child);
+            }
             old = xmlReplaceNode(child, tmp);
+            xml_digest_changed(tmp);
+            if (saved) {
+                save_insert(tmp);
+            }
 
             if(xml_tracking_changes(tmp)) {
                 /* Replaced sections may have included relevant ACLs */
@@ -4823,7 +6404,10 @@ replace_xml_child(xmlNode * parent, xmlNode * child, xmlNode * update, gboolean
 
             xml_calculate_changes(old, tmp);
             xmlDocSetRootElement(doc, old);
-            free_xml(old);
+            if (saved == FALSE) {
+                /* Otherwise, the snapshot frees it (as the root of doc) */
+                free_xml(old);
+            }
         }
         child = NULL;
         return TRUE;
@@ -4960,13 +6544,19 @@ hash2metafield(gpointer key, gpointer value, gpointer user_data)
     free(crm_name);
 }
 
-GHashTable *
-xml2list(xmlNode * parent)
+static GHashTable *
+xml2list_full(xmlNode *parent, bool borrow)
 {
     xmlNode *child = NULL;
     xmlAttrPtr pIter = NULL;
     xmlNode *nvpair_list = NULL;
-    GHashTable *nvpair_hash = crm_str_table_new();
+    GHashTable *nvpair_hash = NULL;
+
+    if (borrow) {
+        nvpair_hash = g_hash_table_new(crm_str_hash, g_str_equal);
+    } else {
+        nvpair_hash = crm_str_table_new();
+    }
 
     CRM_CHECK(parent != NULL, return nvpair_hash);
 
@@ -4984,7 +6574,12 @@ xml2list(xmlNode * parent)
 
         crm_trace("Added %s=%s", p_name, p_value);
 
-        g_hash_table_insert(nvpair_hash, strdup(p_name), strdup(p_value));
+        if (borrow) {
+            g_hash_table_insert(nvpair_hash, (gpointer) p_name,
+                                (gpointer) p_value);
+        } else {
+            g_hash_table_insert(nvpair_hash, strdup(p_name), strdup(p_value));
+        }
     }
 
     for (child = __xml_first_child(nvpair_list); child != NULL; child = __xml_next(child)) {
@@ -4993,7 +6588,13 @@ xml2list(xmlNode * parent)
             const char *value = crm_element_value(child, XML_NVPAIR_ATTR_VALUE);
 
             crm_trace("Added %s=%s", key, value);
-            if (key != NULL && value != NULL) {
+            if (key == NULL || value == NULL) {
+                continue;
+            }
+            if (borrow) {
+                g_hash_table_insert(nvpair_hash, (gpointer) key,
+                                    (gpointer) value);
+            } else {
                 g_hash_table_insert(nvpair_hash, strdup(key), strdup(value));
             }
         }
@@ -5002,6 +6603,33 @@ xml2list(xmlNode * parent)
     return nvpair_hash;
 }
 
+GHashTable *
+xml2list(xmlNode * parent)
+{
+    return xml2list_full(parent, FALSE);
+}
+
+/*!
+ * \internal
+ * \brief Get a table of parameters that borrows its strings from XML
+ *
+ * This is like xml2list(), but rather than copying each name and value, the
+ * table points into \p parent, saving an allocation per string when the table
+ * is needed only briefly.
+ *
+ * \param[in] parent  XML containing parameters
+ *
+ * \return Newly allocated table, valid only as long as \p parent is unchanged
+ * \note The caller is responsible for freeing the result with
+ *       g_hash_table_destroy() (which does not free the strings), and anything
+ *       keeping the table's contents must copy them.
+ */
+GHashTable *
+pcmk__xml2list_borrowed(xmlNode *parent)
+{
+    return xml2list_full(parent, TRUE);
+}
+
 typedef struct name_value_s {
     const char *name;
     const void *value;
@@ -5126,6 +6754,7 @@ void
 crm_xml_init(void)
 {
     static bool init = TRUE;
+    const char *value = NULL;
 
     if(init) {
         init = FALSE;
@@ -5140,7 +6769,20 @@ crm_xml_init(void)
         xmlDeregisterNodeDefault(pcmkDeregisterNode);
         xmlRegisterNodeDefault(pcmkRegisterNode);
 
-        crm_schema_init();
+        // These are per-thread settings, so do the same for worker threads
+        xmlThrDefBufferAllocScheme(XML_BUFFER_ALLOC_DOUBLEIT);
+        xmlThrDefDeregisterNodeDefault(pcmkDeregisterNode);
+        xmlThrDefRegisterNodeDefault(pcmkRegisterNode);
+
+        xml_main_thread = g_thread_self();
+
+        // Schemas are loaded on first use (see crm_schema_init())
+
+        value = daemon_option("xml_intern");
+        if ((value == NULL) || crm_is_true(value)) {
+            xml_dict = xmlDictCreate();
+            xml_dict_thread = g_thread_self();
+        }
     }
 }
 
@@ -5148,12 +6790,136 @@ void
 crm_xml_cleanup(void)
 {
     crm_info("Cleaning up memory from libxml2");
+    pcmk__xml_free_deferred();
     crm_schema_cleanup();
+    pcmk__xpath_cleanup();
     xmlCleanupParser();
+    private_freelist_clear();
 }
 
 #define XPATH_MAX 512
 
+/*
+ * ID index
+ *
+ * expand_idref() resolves a reference by searching the whole document with
+ * XPath, which is costly when a large configuration has many references.
+ * Callers that resolve many references against the same document can have its
+ * IDs indexed instead (see pcmk__xml_index_ids()). The index is built on first
+ * use and dropped whenever a node is freed from the document; elements added
+ * since it was built are still found by falling back to XPath.
+ */
+
+// Drop the ID index of the document that a node is being freed from
+static void
+forget_ids(xmlNode *node)
+{
+    xml_doc_private_t *docp = NULL;
+
+    if ((node->doc == NULL) || (node->doc->_private == NULL)) {
+        return;
+    }
+    docp = node->doc->_private;
+    if ((docp->check == XML_DOC_PRIVATE_MAGIC) && (docp->id_index != NULL)) {
+        g_hash_table_destroy(docp->id_index);
+        docp->id_index = NULL;
+    }
+}
+
+static void
+index_ids(GHashTable *index, xmlNode *xml)
+{
+    for (xmlNode *child = __xml_first_child_element(xml); child != NULL;
+         child = __xml_next_element(child)) {
+
+        const char *id = ID(child);
+
+        // The status section has no referenceable IDs
+        if (!strcmp((const char *) child->name, XML_CIB_TAG_STATUS)) {
+            continue;
+        }
+        if (id != NULL) {
+            char *key = crm_strdup_printf("%s %s", child->name, id);
+
+            // Keep the first match in document order, as XPath would
+            if (g_hash_table_lookup(index, key) == NULL) {
+                g_hash_table_insert(index, key, child);
+            } else {
+                free(key);
+            }
+        }
+        index_ids(index, child);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Index the IDs of a document, for faster reference resolution
+ *
+ * \param[in] xml  Any node in the document to index
+ *
+ * \note This is worthwhile only for a document that will not change much while
+ *       many references are resolved against its root element with
+ *       expand_idref() or pcmk__xml_find_id().
+ */
+void
+pcmk__xml_index_ids(xmlNode *xml)
+{
+    if ((xml != NULL) && (xml->doc != NULL) && (xml->doc->_private != NULL)) {
+        ((xml_doc_private_t *) xml->doc->_private)->index_ids = TRUE;
+    }
+}
+
+/*!
+ * \internal
+ * \brief Find an element by name and ID
+ *
+ * \param[in] top  Element to search (the search is indexed if this is the root
+ *                 element of a document with pcmk__xml_index_ids() enabled)
+ * \param[in] tag  Element name to find
+ * \param[in] id   Element ID to find
+ *
+ * \return First element in \p top named \p tag with ID \p id (or NULL if none)
+ */
+xmlNode *
+pcmk__xml_find_id(xmlNode *top, const char *tag, const char *id)
+{
+    xml_doc_private_t *docp = NULL;
+    xmlNode *match = NULL;
+    char *xpath = NULL;
+
+    CRM_CHECK((top != NULL) && (tag != NULL) && (id != NULL), return NULL);
+
+    if ((top->doc != NULL) && (top->doc->_private != NULL)
+        && (xmlDocGetRootElement(top->doc) == top)) {
+        docp = top->doc->_private;
+    }
+
+    if ((docp != NULL) && docp->index_ids) {
+        char *key = crm_strdup_printf("%s %s", tag, id);
+
+        if (docp->id_index == NULL) {
+            docp->id_index = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                   free, NULL);
+            index_ids(docp->id_index, top);
+            crm_trace("Indexed %u IDs", g_hash_table_size(docp->id_index));
+        }
+        match = g_hash_table_lookup(docp->id_index, key);
+        free(key);
+
+        // Guard against an element renamed or re-identified in place
+        if ((match != NULL) && !strcmp((const char *) match->name, tag)
+            && safe_str_eq(ID(match), id)) {
+            return match;
+        }
+    }
+
+    xpath = crm_strdup_printf("//%s[@id='%s']", tag, id);
+    match = get_xpath_object(xpath, top, LOG_TRACE);
+    free(xpath);
+    return match;
+}
+
 xmlNode *
 expand_idref(xmlNode * input, xmlNode * top)
 {
@@ -5174,7 +6940,7 @@ expand_idref(xmlNode * input, xmlNode * top)
     if (ref != NULL) {
         char *xpath_string = crm_strdup_printf("//%s[@id='%s']", tag, ref);
 
-        result = get_xpath_object(xpath_string, top, LOG_ERR);
+        result = pcmk__xml_find_id(top, tag, ref);
         if (result == NULL) {
             char *nodePath = (char *)xmlGetNodePath(top);
 
@@ -19,6 +19,10 @@
 #include <crm_internal.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
+
+#include <libxml/xpathInternals.h>
+#include <crm/msg_xml.h>
 
 /*
  * From xpath2.c
@@ -140,6 +144,254 @@ dedupXpathResults(xmlXPathObjectPtr xpathObj)
     }
 }
 
+/*
+ * XPath evaluation
+ *
+ * Daemons and tools search the CIB with the same few shapes of expression
+ * many times a minute (node_state by uname, lrm_resource or any element by
+ * id, nvpair by name), and libxml2 compiles each search and collects every
+ * candidate element before testing its predicate. Location paths made only of
+ * element names (or "*") with at most one [@attr='value'] predicate each,
+ * where only the first step may be "//", are therefore evaluated by walking
+ * the tree directly. Other expressions are compiled once and kept, up to
+ * XPATH_CACHE_MAX of them, for reuse.
+ */
+
+#define XPATH_STEPS_MAX 16
+#define XPATH_CACHE_MAX 256
+
+struct xpath_step_s {
+    bool descendant;    // step starts with "//" rather than "/"
+    const char *tag;    // element name, or NULL for any
+    size_t tag_len;
+    const char *attr;   // attribute to match, or NULL for none
+    size_t attr_len;
+    const char *value;  // value attribute must have
+    size_t value_len;
+};
+
+/* Length of the XML name at the start of text, or 0 if there is none. Names
+ * cannot start with '.', so this also rejects the "." and ".." abbreviated
+ * steps, which need libxml2.
+ */
+static size_t
+xpath_name_len(const char *text)
+{
+    size_t len = 0;
+
+    if (!isalpha((unsigned char) text[0]) && (text[0] != '_')) {
+        return 0;
+    }
+    while (isalnum((unsigned char) text[len])
+           || (strchr("_-.", text[len]) != NULL && text[len] != '\0')) {
+        len++;
+    }
+    return len;
+}
+
+/*!
+ * \internal
+ * \brief Parse an xpath that can be evaluated without libxml2
+ *
+ * \param[in]  path   XPath to parse
+ * \param[out] steps  Where to store the location steps of \p path
+ *
+ * \return Number of steps in \p path, or 0 if it is not a simple location path
+ * \note The steps point into \p path, which must outlive them.
+ */
+static int
+parse_simple_xpath(const char *path, struct xpath_step_s *steps)
+{
+    int n_steps = 0;
+
+    while (*path != '\0') {
+        struct xpath_step_s *step = &steps[n_steps];
+
+        if ((path[0] != '/') || (n_steps == XPATH_STEPS_MAX)) {
+            return 0;
+        }
+        memset(step, 0, sizeof(struct xpath_step_s));
+        step->descendant = (path[1] == '/');
+        path += (step->descendant? 2 : 1);
+        if (step->descendant && (n_steps > 0)) {
+            return 0;
+        }
+
+        if (path[0] == '*') {
+            path++;
+        } else {
+            step->tag = path;
+            step->tag_len = xpath_name_len(path);
+            if (step->tag_len == 0) {
+                return 0;
+            }
+            path += step->tag_len;
+        }
+
+        if (path[0] == '[') {
+            char quote = 0;
+
+            if (path[1] != '@') {
+                return 0;
+            }
+            step->attr = path + 2;
+            step->attr_len = xpath_name_len(step->attr);
+            path = step->attr + step->attr_len;
+            if ((step->attr_len == 0) || (path[0] != '=')) {
+                return 0;
+            }
+            quote = path[1];
+            if ((quote != '\'') && (quote != '"')) {
+                return 0;
+            }
+            step->value = path + 2;
+            step->value_len = strcspn(step->value,
+                                      (quote == '"')? "\"" : "'");
+            path = step->value + step->value_len;
+            if ((path[0] != quote) || (path[1] != ']')) {
+                return 0;
+            }
+            path += 2;
+        }
+        n_steps++;
+    }
+    return n_steps;
+}
+
+static bool
+xpath_step_matches(xmlNode *xml, const struct xpath_step_s *step)
+{
+    if (xml->type != XML_ELEMENT_NODE) {
+        return FALSE;
+    }
+    if ((step->tag != NULL)
+        && ((strncmp((const char *) xml->name, step->tag, step->tag_len) != 0)
+            || (xml->name[step->tag_len] != '\0'))) {
+        return FALSE;
+    }
+    if (step->attr == NULL) {
+        return TRUE;
+    }
+
+    for (xmlAttr *attr = xml->properties; attr != NULL; attr = attr->next) {
+        const char *value = NULL;
+
+        if ((strncmp((const char *) attr->name, step->attr,
+                     step->attr_len) != 0)
+            || (attr->name[step->attr_len] != '\0') || (attr->ns != NULL)) {
+            continue;
+        }
+        value = (attr->children? (const char *) attr->children->content : "");
+        return (strncmp(value, step->value, step->value_len) == 0)
+               && (value[step->value_len] == '\0');
+    }
+    return FALSE;
+}
+
+static void add_step_matches(xmlNode *xml, const struct xpath_step_s *steps,
+                             int n_steps, xmlNodeSetPtr matches);
+
+// Add matches for the remaining steps, given a node that matched the first
+static void
+add_matched(xmlNode *xml, const struct xpath_step_s *steps, int n_steps,
+            xmlNodeSetPtr matches)
+{
+    if (n_steps == 1) {
+        xmlXPathNodeSetAddUnique(matches, xml);
+    } else {
+        add_step_matches(xml, steps + 1, n_steps - 1, matches);
+    }
+}
+
+static void
+add_descendant_matches(xmlNode *xml, const struct xpath_step_s *steps,
+                       int n_steps, xmlNodeSetPtr matches)
+{
+    for (xmlNode *child = xml->children; child != NULL; child = child->next) {
+        if (xpath_step_matches(child, steps)) {
+            add_matched(child, steps, n_steps, matches);
+        }
+        if (child->type == XML_ELEMENT_NODE) {
+            add_descendant_matches(child, steps, n_steps, matches);
+        }
+    }
+}
+
+static void
+add_step_matches(xmlNode *xml, const struct xpath_step_s *steps, int n_steps,
+                 xmlNodeSetPtr matches)
+{
+    if (steps->descendant) {
+        add_descendant_matches(xml, steps, n_steps, matches);
+        return;
+    }
+    for (xmlNode *child = xml->children; child != NULL; child = child->next) {
+        if (xpath_step_matches(child, steps)) {
+            add_matched(child, steps, n_steps, matches);
+        }
+    }
+}
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+
+// XPath -> xmlXPathCompExprPtr, for expressions not evaluated natively
+static GHashTable *xpath_cache = NULL;
+static GMutex xpath_cache_lock;
+
+static xmlXPathObjectPtr
+eval_compiled_xpath(const char *path, xmlXPathContextPtr xpathCtx)
+{
+    xmlXPathCompExprPtr comp = NULL;
+    xmlXPathObjectPtr xpathObj = NULL;
+    bool cached = FALSE;
+
+    g_mutex_lock(&xpath_cache_lock);
+    if (xpath_cache == NULL) {
+        xpath_cache = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                            (GDestroyNotify) xmlXPathFreeCompExpr);
+    }
+    comp = g_hash_table_lookup(xpath_cache, path);
+    if (comp == NULL) {
+        comp = xmlXPathCompile((const xmlChar *) path);
+        if ((comp != NULL)
+            && (g_hash_table_size(xpath_cache) < XPATH_CACHE_MAX)) {
+            g_hash_table_insert(xpath_cache, strdup(path), comp);
+            cached = TRUE;
+        }
+    } else {
+        cached = TRUE;
+    }
+    g_mutex_unlock(&xpath_cache_lock);
+
+    // Cached expressions are never freed or modified until cleanup
+    if (comp != NULL) {
+        xpathObj = xmlXPathCompiledEval(comp, xpathCtx);
+        if (!cached) {
+            xmlXPathFreeCompExpr(comp);
+        }
+    }
+    return xpathObj;
+}
+
+#endif
+
+/*!
+ * \internal
+ * \brief Free the compiled expressions kept by xpath_search()
+ */
+void
+pcmk__xpath_cleanup(void)
+{
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    g_mutex_lock(&xpath_cache_lock);
+    if (xpath_cache != NULL) {
+        g_hash_table_destroy(xpath_cache);
+        xpath_cache = NULL;
+    }
+    g_mutex_unlock(&xpath_cache_lock);
+#endif
+}
+
 /* the caller needs to check if the result contains a xmlDocPtr or xmlNodePtr */
 xmlXPathObjectPtr
 xpath_search(xmlNode * xml_top, const char *path)
@@ -147,7 +399,8 @@ xpath_search(xmlNode * xml_top, const char *path)
     xmlDocPtr doc = NULL;
     xmlXPathObjectPtr xpathObj = NULL;
     xmlXPathContextPtr xpathCtx = NULL;
-    const xmlChar *xpathExpr = (const xmlChar *)path;
+    struct xpath_step_s steps[XPATH_STEPS_MAX];
+    int n_steps = 0;
 
     CRM_CHECK(path != NULL, return NULL);
     CRM_CHECK(xml_top != NULL, return NULL);
@@ -155,10 +408,27 @@ xpath_search(xmlNode * xml_top, const char *path)
 
     doc = getDocPtr(xml_top);
 
+    n_steps = parse_simple_xpath(path, steps);
+    if (n_steps > 0) {
+        xpathObj = xmlXPathNewNodeSet(NULL);
+        CRM_ASSERT(xpathObj != NULL);
+        add_step_matches((xmlNode *) doc, steps, n_steps,
+                         xpathObj->nodesetval);
+        if (steps[0].descendant && (n_steps > 1)) {
+            // Matches below nested first-step matches may be out of order
+            xmlXPathNodeSetSort(xpathObj->nodesetval);
+        }
+        return xpathObj;
+    }
+
     xpathCtx = xmlXPathNewContext(doc);
     CRM_ASSERT(xpathCtx != NULL);
 
-    xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    xpathObj = eval_compiled_xpath(path, xpathCtx);
+#else
+    xpathObj = xmlXPathEvalExpression((const xmlChar *) path, xpathCtx);
+#endif
     xmlXPathFreeContext(xpathCtx);
     return xpathObj;
 }
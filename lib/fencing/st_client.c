@@ -15,6 +15,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <fcntl.h>
 
 #include <glib.h>
 
@@ -25,6 +26,7 @@
 #include <crm/common/xml.h>
 
 #include <crm/common/mainloop.h>
+#include <crm/common/internal.h>
 
 #if SUPPORT_CIBSECRETS
 #  include <crm/common/cib_secrets.h>
@@ -869,6 +871,34 @@ internal_stonith_action_execute(stonith_action_t * action)
     p_stderr_fd = fd3[0];
     c_stderr_fd = fd3[1];
 
+    /* Retries must sleep in the child, so they are always forked. Otherwise,
+     * spawn the agent if possible, which saves copying the whole daemon.
+     */
+    if (!is_retry) {
+        int fds[3] = { c_read_fd, c_write_fd, c_stderr_fd };
+        char *argv[] = { action->agent, NULL };
+        pid_t child = 0;
+
+        // The agent must not keep our ends of its pipes open
+        fcntl(p_read_fd, F_SETFD, FD_CLOEXEC);
+        fcntl(p_write_fd, F_SETFD, FD_CLOEXEC);
+        fcntl(p_stderr_fd, F_SETFD, FD_CLOEXEC);
+
+        ret = pcmk__spawn(action->agent, argv, NULL, fds,
+                          pcmk__spawn_new_pgroup, NULL, &child);
+        if (ret == pcmk_ok) {
+            crm_debug("spawned %s as process %d", action->agent, (int) child);
+            pid = child;
+            goto parent;
+
+        } else if (ret != -ENOTSUP) {
+            crm_err("Could not execute %s: %s " CRM_XS " rc=%d",
+                    action->agent, pcmk_strerror(ret), ret);
+            rc = ret;
+            goto fail;
+        }
+    }
+
     crm_debug("forking");
     pid = fork();
     if (pid < 0) {
@@ -909,6 +939,7 @@ internal_stonith_action_execute(stonith_action_t * action)
     }
 
     /* parent */
+  parent:
     action->pid = pid;
     ret = crm_set_nonblocking(p_read_fd);
     if (ret < 0) {
@@ -1255,6 +1286,56 @@ stonith_api_monitor(stonith_t * stonith, int call_options, const char *id, int t
     return stonith_api_call(stonith, call_options, id, "monitor", NULL, timeout, NULL);
 }
 
+static int
+stonith_api_monitor_batch(stonith_t *stonith, int call_options,
+                          stonith_key_value_t *devices, int timeout)
+{
+    int rc = 0;
+    xmlNode *data = create_xml_node(NULL, __FUNCTION__);
+
+    for (; devices != NULL; devices = devices->next) {
+        xmlNode *entry = create_xml_node(data, F_STONITH_DEVICE);
+
+        crm_xml_add(entry, F_STONITH_DEVICE, devices->key);
+    }
+
+    rc = stonith_send_command(stonith, STONITH_OP_MONITOR_BATCH, data, NULL,
+                              call_options, timeout);
+    free_xml(data);
+    return rc;
+}
+
+/*!
+ * \brief Get one device's result from a batched monitor
+ *
+ * \param[in] data    Callback data for monitor_batch() call
+ * \param[in] device  ID of device to check
+ *
+ * \return Result of monitoring \p device (or of the call as a whole, if there
+ *         is none for the device, for example because the call timed out)
+ */
+int
+stonith_monitor_batch_rc(stonith_callback_data_t *data, const char *device)
+{
+    xmlNode *results = NULL;
+
+    CRM_CHECK((data != NULL) && (device != NULL), return -EINVAL);
+
+    results = get_xpath_object("//" STONITH_OP_MONITOR_BATCH, data->opaque,
+                               LOG_TRACE);
+    for (xmlNode *entry = __xml_first_child_element(results); entry != NULL;
+         entry = __xml_next_element(entry)) {
+
+        if (safe_str_eq(ID(entry), device)) {
+            int rc = data->rc;
+
+            crm_element_value_int(entry, F_STONITH_RC, &rc);
+            return rc;
+        }
+    }
+    return (data->rc == pcmk_ok)? -ENODEV : data->rc;
+}
+
 static int
 stonith_api_status(stonith_t * stonith, int call_options, const char *id, const char *port,
                    int timeout)
@@ -1288,8 +1369,9 @@ stonith_api_confirm(stonith_t * stonith, int call_options, const char *target)
 }
 
 static int
-stonith_api_history(stonith_t * stonith, int call_options, const char *node,
-                    stonith_history_t ** history, int timeout)
+stonith_api_history_since(stonith_t *stonith, int call_options,
+                          const char *node, char **incarnation, int *seq,
+                          stonith_history_t **history, int timeout)
 {
     int rc = 0;
     xmlNode *data = NULL;
@@ -1298,9 +1380,15 @@ stonith_api_history(stonith_t * stonith, int call_options, const char *node,
 
     *history = NULL;
 
-    if (node) {
+    if (node || (seq && (*seq > 0))) {
         data = create_xml_node(NULL, __FUNCTION__);
         crm_xml_add(data, F_STONITH_TARGET, node);
+        if (seq && (*seq > 0)) {
+            crm_xml_add_int(data, F_STONITH_HISTORY_SINCE, *seq);
+            if (incarnation) {
+                crm_xml_add(data, F_STONITH_HISTORY_INCARNATION, *incarnation);
+            }
+        }
     }
 
     rc = stonith_send_command(stonith, STONITH_OP_FENCE_HISTORY, data, &output,
@@ -1311,11 +1399,23 @@ stonith_api_history(stonith_t * stonith, int call_options, const char *node,
         xmlNode *op = NULL;
         xmlNode *reply = get_xpath_object("//" F_STONITH_HISTORY_LIST, output, LOG_ERR);
 
+        if (seq) {
+            // An older fencer has no sequence, so everything is always listed
+            *seq = 0;
+            crm_element_value_int(reply, F_STONITH_HISTORY_SEQ, seq);
+        }
+        if (incarnation) {
+            free(*incarnation);
+            *incarnation = crm_element_value_copy(reply,
+                                        F_STONITH_HISTORY_INCARNATION);
+        }
+
         for (op = __xml_first_child(reply); op != NULL; op = __xml_next(op)) {
             stonith_history_t *kvp;
             int completed;
 
             kvp = calloc(1, sizeof(stonith_history_t));
+            kvp->id = crm_element_value_copy(op, F_STONITH_REMOTE_OP_ID);
             kvp->target = crm_element_value_copy(op, F_STONITH_TARGET);
             kvp->action = crm_element_value_copy(op, F_STONITH_ACTION);
             kvp->origin = crm_element_value_copy(op, F_STONITH_ORIGIN);
@@ -1333,9 +1433,18 @@ stonith_api_history(stonith_t * stonith, int call_options, const char *node,
             last = kvp;
         }
     }
+    free_xml(output);
     return rc;
 }
 
+static int
+stonith_api_history(stonith_t * stonith, int call_options, const char *node,
+                    stonith_history_t ** history, int timeout)
+{
+    return stonith_api_history_since(stonith, call_options, node, NULL, NULL,
+                                     history, timeout);
+}
+
 void stonith_history_free(stonith_history_t *history)
 {
     stonith_history_t *hp, *hp_old;
@@ -1346,6 +1455,7 @@ void stonith_history_free(stonith_history_t *history)
         free(hp->origin);
         free(hp->delegate);
         free(hp->client);
+        free(hp->id);
     }
 }
 
@@ -1472,6 +1582,7 @@ stonith_api_del_callback(stonith_t * stonith, int call_id, bool all_callbacks)
 
 static void
 invoke_callback(stonith_t * st, int call_id, int rc, void *userdata,
+                xmlNode *msg,
                 void (*callback) (stonith_t * st, stonith_callback_data_t * data))
 {
     stonith_callback_data_t data = { 0, };
@@ -1479,6 +1590,7 @@ invoke_callback(stonith_t * st, int call_id, int rc, void *userdata,
     data.call_id = call_id;
     data.rc = rc;
     data.userdata = userdata;
+    data.opaque = msg;
 
     callback(st, &data);
 }
@@ -1522,7 +1634,8 @@ stonith_perform_callback(stonith_t * stonith, xmlNode * msg, int call_id, int rc
 
     if (local_blob.callback != NULL && (rc == pcmk_ok || local_blob.only_success == FALSE)) {
         crm_trace("Invoking callback %s for call %d", crm_str(local_blob.id), call_id);
-        invoke_callback(stonith, call_id, rc, local_blob.user_data, local_blob.callback);
+        invoke_callback(stonith, call_id, rc, local_blob.user_data, msg,
+                        local_blob.callback);
 
     } else if (private->op_callback == NULL && rc != pcmk_ok) {
         crm_warn("Fencing command failed: %s", pcmk_strerror(rc));
@@ -1531,7 +1644,7 @@ stonith_perform_callback(stonith_t * stonith, xmlNode * msg, int call_id, int rc
 
     if (private->op_callback != NULL) {
         crm_trace("Invoking global callback for call %d", call_id);
-        invoke_callback(stonith, call_id, rc, NULL, private->op_callback);
+        invoke_callback(stonith, call_id, rc, NULL, msg, private->op_callback);
     }
     crm_trace("OP callback activated.");
 }
@@ -1841,7 +1954,7 @@ stonith_api_add_callback(stonith_t * stonith, int call_id, int timeout, int opti
     } else if (call_id < 0) {
         if (!(options & st_opt_report_only_success)) {
             crm_trace("Call failed, calling %s: %s", callback_name, pcmk_strerror(call_id));
-            invoke_callback(stonith, call_id, call_id, user_data, callback);
+            invoke_callback(stonith, call_id, call_id, user_data, NULL, callback);
         } else {
             crm_warn("Fencer call failed: %s", pcmk_strerror(call_id));
         }
@@ -2292,6 +2405,8 @@ stonith_api_new(void)
     new_stonith->cmds->register_notification = stonith_api_add_notification;
 
     new_stonith->cmds->validate              = stonith_api_validate;
+    new_stonith->cmds->history_since         = stonith_api_history_since;
+    new_stonith->cmds->monitor_batch         = stonith_api_monitor_batch;
 /* *INDENT-ON* */
 
     return new_stonith;
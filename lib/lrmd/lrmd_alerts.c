@@ -190,6 +190,26 @@ exec_alert_list(lrmd_t *lrmd, GList *alert_list, enum crm_alert_flags kind,
 
         copy_params = alert_envvar2params(copy_params, entry);
 
+        if (entry->delivery != crm_alert_deliver_each) {
+            char *value = NULL;
+
+            copy_params = lrmd_key_value_add(copy_params,
+                                             CRM_ALERT_META_DELIVERY,
+                                             crm_alert_delivery2text(entry->delivery));
+            value = crm_itoa(entry->batch_delay);
+            copy_params = lrmd_key_value_add(copy_params,
+                                             CRM_ALERT_META_BATCH_DELAY, value);
+            free(value);
+            value = crm_itoa(entry->batch_size);
+            copy_params = lrmd_key_value_add(copy_params,
+                                             CRM_ALERT_META_BATCH_SIZE, value);
+            free(value);
+            value = crm_itoa(entry->queue_size);
+            copy_params = lrmd_key_value_add(copy_params,
+                                             CRM_ALERT_META_QUEUE_SIZE, value);
+            free(value);
+        }
+
         rc = lrmd->cmds->exec_alert(lrmd, entry->id, entry->path,
                                     entry->timeout, copy_params);
         if (rc < 0) {
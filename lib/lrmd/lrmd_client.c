@@ -25,6 +25,7 @@
 #include <crm/services.h>
 #include <crm/common/mainloop.h>
 #include <crm/common/ipcs.h>
+#include <crm/common/internal.h>
 #include <crm/msg_xml.h>
 
 #include <crm/stonith-ng.h>
@@ -83,6 +84,11 @@ typedef struct lrmd_private_s {
      * of the connection timeout timer. */
     int async_timer;
     int sock;
+
+    /* while the TLS handshake of an async connection is occurring, this
+     * watches the socket so the handshake can continue as data arrives */
+    mainloop_io_t *handshake_source;
+    int handshake_rc;
     /* since tls requires a round trip across the network for a
      * request/reply, there are times where we just want to be able
      * to send a request from the client and not wait around (or even care
@@ -90,6 +96,10 @@ typedef struct lrmd_private_s {
     int expected_late_replies;
     GList *pending_notify;
     crm_trigger_t *process_notify;
+
+    /* whether to send requests whose reply carries only a result without
+     * waiting for the reply (their failures are logged when the reply comes) */
+    gboolean pipeline;
 #endif
 
     lrmd_event_callback callback;
@@ -97,6 +107,7 @@ typedef struct lrmd_private_s {
     /* Internal IPC proxy msg passing for remote guests */
     void (*proxy_callback)(lrmd_t *lrmd, void *userdata, xmlNode *msg);
     void *proxy_callback_userdata;
+    remote_proxy_batch_t *proxy_batch;  /* if peer accepts batched messages */
     char *peer_version;
 } lrmd_private_t;
 
@@ -192,7 +203,13 @@ lrmd_copy_event(lrmd_event_data_t * event)
     copy->output = event->output ? strdup(event->output) : NULL;
     copy->exit_reason = event->exit_reason ? strdup(event->exit_reason) : NULL;
     copy->remote_nodename = event->remote_nodename ? strdup(event->remote_nodename) : NULL;
-    copy->params = crm_str_table_dup(event->params);
+
+    // Shared tables are immutable, so another reference is as good as a copy
+    if (pcmk__str_table_is_shared(event->params)) {
+        copy->params = pcmk__str_table_share(event->params);
+    } else {
+        copy->params = crm_str_table_dup(event->params);
+    }
 
     return copy;
 }
@@ -211,7 +228,9 @@ lrmd_free_event(lrmd_event_data_t * event)
     free((char *)event->output);
     free((char *)event->exit_reason);
     free((char *)event->remote_nodename);
-    if (event->params) {
+    if (pcmk__str_table_is_shared(event->params)) {
+        pcmk__str_table_release(event->params);
+    } else if (event->params) {
         g_hash_table_destroy(event->params);
     }
     free(event);
@@ -225,7 +244,9 @@ lrmd_dispatch_internal(lrmd_t * lrmd, xmlNode * msg)
     lrmd_private_t *native = lrmd->lrmd_private;
     lrmd_event_data_t event = { 0, };
 
-    if (proxy_session != NULL) {
+    if ((proxy_session != NULL)
+        || safe_str_eq(crm_element_value(msg, F_LRMD_IPC_OP),
+                       LRMD_IPC_OP_BATCH)) {
         /* this is proxy business */
         lrmd_internal_proxy_dispatch(lrmd, msg);
         return 1;
@@ -263,7 +284,10 @@ lrmd_dispatch_internal(lrmd_t * lrmd, xmlNode * msg)
         event.exit_reason = crm_element_value(msg, F_LRMD_RSC_EXIT_REASON);
         event.type = lrmd_event_exec_complete;
 
-        event.params = xml2list(msg);
+        /* Strings (including parameters) are borrowed from the message, so
+         * callbacks must use lrmd_copy_event() to keep anything
+         */
+        event.params = pcmk__xml2list_borrowed(msg);
     } else if (crm_str_eq(type, LRMD_OP_NEW_CLIENT, TRUE)) {
         event.type = lrmd_event_new_client;
     } else if (crm_str_eq(type, LRMD_OP_POKE, TRUE)) {
@@ -319,6 +343,24 @@ lrmd_tls_connected(lrmd_t * lrmd)
     return FALSE;
 }
 
+// Account for the reply to a request that was sent without waiting for it
+static void
+lrmd_tls_late_reply(lrmd_private_t *native, xmlNode *reply)
+{
+    int rc = pcmk_ok;
+
+    native->expected_late_replies--;
+    crm_element_value_int(reply, F_LRMD_RC, &rc);
+    if (rc < 0) {
+        int reply_id = 0;
+
+        crm_element_value_int(reply, F_LRMD_REMOTE_MSG_ID, &reply_id);
+        crm_warn("Request %d to Pacemaker Remote node %s failed: %s "
+                 CRM_XS " rc=%d", reply_id, native->remote_nodename,
+                 pcmk_strerror(rc), rc);
+    }
+}
+
 static int
 lrmd_tls_dispatch(gpointer userdata)
 {
@@ -365,7 +407,7 @@ lrmd_tls_dispatch(gpointer userdata)
             lrmd_dispatch_internal(lrmd, xml);
         } else if (safe_str_eq(msg_type, "reply")) {
             if (native->expected_late_replies > 0) {
-                native->expected_late_replies--;
+                lrmd_tls_late_reply(native, xml);
             } else {
                 int reply_id = 0;
                 crm_element_value_int(xml, F_LRMD_CALLID, &reply_id);
@@ -503,6 +545,8 @@ lrmd_tls_connection_destroy(gpointer userdata)
     crm_info("TLS connection destroyed");
 
     if (native->remote->tls_session) {
+        pcmk__tls_client_remember(native->remote->tls_session, native->server,
+                                  native->port);
         gnutls_bye(*native->remote->tls_session, GNUTLS_SHUT_RDWR);
         gnutls_deinit(*native->remote->tls_session);
         gnutls_free(native->remote->tls_session);
@@ -615,7 +659,7 @@ lrmd_tls_recv_reply(lrmd_t * lrmd, int total_timeout, int expected_reply_id, int
             xml = NULL;
         } else if (reply_id != expected_reply_id) {
             if (native->expected_late_replies > 0) {
-                native->expected_late_replies--;
+                lrmd_tls_late_reply(native, xml);
             } else {
                 crm_err("Got outdated reply, expected id %d got id %d", expected_reply_id, reply_id);
             }
@@ -806,6 +850,18 @@ lrmd_send_command(lrmd_t *lrmd, const char *op, xmlNode *data,
         return -EINVAL;
     }
 
+#ifdef HAVE_GNUTLS_GNUTLS_H
+    /* When pipelining, don't wait for the reply to a request that can only
+     * fail if a later request would fail anyway
+     */
+    if (expect_reply && native->pipeline && (output_data == NULL)
+        && (native->type == CRM_CLIENT_TLS)
+        && (safe_str_eq(op, LRMD_OP_RSC_REG)
+            || safe_str_eq(op, LRMD_OP_RSC_UNREG))) {
+        expect_reply = FALSE;
+    }
+#endif
+
     if (expect_reply) {
         rc = lrmd_send_xml(lrmd, op_msg, timeout, &op_reply);
     } else {
@@ -1111,15 +1167,115 @@ report_async_connection_result(lrmd_t * lrmd, int rc)
 
 #ifdef HAVE_GNUTLS_GNUTLS_H
 static void
-lrmd_tcp_connect_cb(void *userdata, int sock)
+lrmd_tls_handshake_failed(lrmd_t *lrmd, int rc)
 {
-    lrmd_t *lrmd = userdata;
     lrmd_private_t *native = lrmd->lrmd_private;
-    char *name;
+
+    crm_warn("Disconnecting after TLS handshake with Pacemaker Remote server %s:%d failed: %s "
+             CRM_XS " rc=%d", native->server, native->port, gnutls_strerror(rc), rc);
+    gnutls_deinit(*native->remote->tls_session);
+    gnutls_free(native->remote->tls_session);
+    native->remote->tls_session = NULL;
+    lrmd_tls_connection_destroy(lrmd);
+    report_async_connection_result(lrmd, -EKEYREJECTED);
+}
+
+static void
+lrmd_tls_handshake_succeeded(lrmd_t *lrmd)
+{
     static struct mainloop_fd_callbacks lrmd_tls_callbacks = {
         .dispatch = lrmd_tls_dispatch,
         .destroy = lrmd_tls_connection_destroy,
     };
+    lrmd_private_t *native = lrmd->lrmd_private;
+    char *name = NULL;
+    int rc = pcmk_ok;
+
+    crm_info("TLS connection to Pacemaker Remote server %s:%d succeeded",
+             native->server, native->port);
+    pcmk__tls_client_remember(native->remote->tls_session, native->server,
+                              native->port);
+
+    name = crm_strdup_printf("pacemaker-remote-%s:%d",
+                             native->server, native->port);
+
+    native->process_notify = mainloop_add_trigger(G_PRIORITY_HIGH, lrmd_tls_dispatch, lrmd);
+    native->source =
+        mainloop_add_fd(name, G_PRIORITY_HIGH, native->sock, lrmd, &lrmd_tls_callbacks);
+
+    rc = lrmd_handshake(lrmd, name);
+    free(name);
+
+    report_async_connection_result(lrmd, rc);
+}
+
+/* Continue an async TLS handshake whenever the server has sent more of it.
+ * Once the handshake is over (one way or the other), the source is removed,
+ * and lrmd_tls_handshake_destroy() reports the result.
+ */
+static int
+lrmd_tls_handshake_dispatch(gpointer userdata)
+{
+    lrmd_t *lrmd = userdata;
+    lrmd_private_t *native = lrmd->lrmd_private;
+
+    native->handshake_rc = gnutls_handshake(*native->remote->tls_session);
+    if ((native->handshake_rc == GNUTLS_E_INTERRUPTED)
+        || (native->handshake_rc == GNUTLS_E_AGAIN)) {
+        return 0;
+    }
+    return -1;
+}
+
+static void
+lrmd_tls_handshake_destroy(gpointer userdata)
+{
+    lrmd_t *lrmd = userdata;
+    lrmd_private_t *native = lrmd->lrmd_private;
+
+    if (native->handshake_source == NULL) {
+        // The connection was dropped before the handshake finished
+        return;
+    }
+    native->handshake_source = NULL;
+
+    if (native->async_timer) {
+        g_source_remove(native->async_timer);
+        native->async_timer = 0;
+    }
+
+    /* If the socket was closed before the handshake completed, the last
+     * result will still be GNUTLS_E_AGAIN, which is treated as a failure.
+     */
+    if (native->handshake_rc == GNUTLS_E_SUCCESS) {
+        lrmd_tls_handshake_succeeded(lrmd);
+    } else {
+        lrmd_tls_handshake_failed(lrmd, native->handshake_rc);
+    }
+}
+
+static gboolean
+lrmd_tls_handshake_timeout(gpointer userdata)
+{
+    lrmd_t *lrmd = userdata;
+    lrmd_private_t *native = lrmd->lrmd_private;
+
+    native->async_timer = 0;
+    native->handshake_rc = GNUTLS_E_TIMEDOUT;
+    mainloop_del_fd(native->handshake_source); // calls lrmd_tls_handshake_destroy()
+    return FALSE;
+}
+
+static void
+lrmd_tcp_connect_cb(void *userdata, int sock)
+{
+    static struct mainloop_fd_callbacks handshake_callbacks = {
+        .dispatch = lrmd_tls_handshake_dispatch,
+        .destroy = lrmd_tls_handshake_destroy,
+    };
+    lrmd_t *lrmd = userdata;
+    lrmd_private_t *native = lrmd->lrmd_private;
+    char *name;
     int rc = sock;
     gnutls_datum_t psk_key = { NULL, 0 };
 
@@ -1134,7 +1290,9 @@ lrmd_tcp_connect_cb(void *userdata, int sock)
     }
 
     /* The TCP connection was successful, so establish the TLS connection.
-     * @TODO make this async to avoid blocking code in client
+     * The socket is non-blocking, so the handshake is driven by the main loop
+     * rather than waited for, which lets the controller bring up many
+     * connections at once.
      */
 
     native->sock = sock;
@@ -1153,33 +1311,32 @@ lrmd_tcp_connect_cb(void *userdata, int sock)
     gnutls_free(psk_key.data);
 
     native->remote->tls_session = create_psk_tls_session(sock, GNUTLS_CLIENT, native->psk_cred_c);
+    pcmk__tls_client_resume(native->remote->tls_session, native->server,
+                            native->port);
 
-    if (crm_initiate_client_tls_handshake(native->remote, LRMD_CLIENT_HANDSHAKE_TIMEOUT) != 0) {
-        crm_warn("Disconnecting after TLS handshake with Pacemaker Remote server %s:%d failed",
-                 native->server, native->port);
-        gnutls_deinit(*native->remote->tls_session);
-        gnutls_free(native->remote->tls_session);
-        native->remote->tls_session = NULL;
-        lrmd_tls_connection_destroy(lrmd);
-        report_async_connection_result(lrmd, -EKEYREJECTED);
+    // This sends the client hello, which the socket buffer will always hold
+    native->handshake_rc = gnutls_handshake(*native->remote->tls_session);
+    if (native->handshake_rc == GNUTLS_E_SUCCESS) {
+        lrmd_tls_handshake_succeeded(lrmd);
         return;
-    }
 
-    crm_info("TLS connection to Pacemaker Remote server %s:%d succeeded",
-             native->server, native->port);
+    } else if ((native->handshake_rc != GNUTLS_E_INTERRUPTED)
+               && (native->handshake_rc != GNUTLS_E_AGAIN)) {
+        lrmd_tls_handshake_failed(lrmd, native->handshake_rc);
+        return;
+    }
 
-    name = crm_strdup_printf("pacemaker-remote-%s:%d",
+    name = crm_strdup_printf("pacemaker-remote-handshake-%s:%d",
                              native->server, native->port);
-
-    native->process_notify = mainloop_add_trigger(G_PRIORITY_HIGH, lrmd_tls_dispatch, lrmd);
-    native->source =
-        mainloop_add_fd(name, G_PRIORITY_HIGH, native->sock, lrmd, &lrmd_tls_callbacks);
-
-    rc = lrmd_handshake(lrmd, name);
+    native->handshake_source = mainloop_add_fd(name, G_PRIORITY_HIGH, sock,
+                                               lrmd, &handshake_callbacks);
     free(name);
-
-    report_async_connection_result(lrmd, rc);
-    return;
+    if (native->handshake_source == NULL) {
+        lrmd_tls_handshake_failed(lrmd, GNUTLS_E_INTERNAL_ERROR);
+        return;
+    }
+    native->async_timer = g_timeout_add(LRMD_CLIENT_HANDSHAKE_TIMEOUT,
+                                        lrmd_tls_handshake_timeout, lrmd);
 }
 
 static int
@@ -1235,6 +1392,8 @@ lrmd_tls_connect(lrmd_t * lrmd, int *fd)
     gnutls_free(psk_key.data);
 
     native->remote->tls_session = create_psk_tls_session(sock, GNUTLS_CLIENT, native->psk_cred_c);
+    pcmk__tls_client_resume(native->remote->tls_session, native->server,
+                            native->port);
 
     if (crm_initiate_client_tls_handshake(native->remote, LRMD_CLIENT_HANDSHAKE_TIMEOUT) != 0) {
         crm_err("Session creation for %s:%d failed", native->server, native->port);
@@ -1247,6 +1406,8 @@ lrmd_tls_connect(lrmd_t * lrmd, int *fd)
 
     crm_info("Client TLS connection established with Pacemaker Remote server %s:%d", native->server,
              native->port);
+    pcmk__tls_client_remember(native->remote->tls_session, native->server,
+                              native->port);
 
     if (fd) {
         *fd = sock;
@@ -1349,7 +1510,17 @@ lrmd_tls_disconnect(lrmd_t * lrmd)
 {
     lrmd_private_t *native = lrmd->lrmd_private;
 
+    if (native->handshake_source != NULL) {
+        mainloop_io_t *source = native->handshake_source;
+
+        // Clear this first so the handshake is abandoned rather than finished
+        native->handshake_source = NULL;
+        mainloop_del_fd(source);
+    }
+
     if (native->remote->tls_session) {
+        pcmk__tls_client_remember(native->remote->tls_session, native->server,
+                                  native->port);
         gnutls_bye(*native->remote->tls_session, GNUTLS_SHUT_RDWR);
         gnutls_deinit(*native->remote->tls_session);
         gnutls_free(native->remote->tls_session);
@@ -1402,6 +1573,9 @@ lrmd_api_disconnect(lrmd_t * lrmd)
     free(native->token);
     native->token = NULL;
 
+    remote_proxy_batch_free(native->proxy_batch);
+    native->proxy_batch = NULL;
+
     free(native->peer_version);
     native->peer_version = NULL;
     return 0;
@@ -1618,6 +1792,15 @@ lrmd_internal_set_proxy_callback(lrmd_t * lrmd, void *userdata, void (*callback)
     native->proxy_callback_userdata = userdata;
 }
 
+static void
+proxy_dispatch_one(xmlNode *msg, gpointer user_data)
+{
+    lrmd_t *lrmd = user_data;
+    lrmd_private_t *native = lrmd->lrmd_private;
+
+    native->proxy_callback(lrmd, native->proxy_callback_userdata, msg);
+}
+
 void
 lrmd_internal_proxy_dispatch(lrmd_t *lrmd, xmlNode *msg)
 {
@@ -1625,20 +1808,41 @@ lrmd_internal_proxy_dispatch(lrmd_t *lrmd, xmlNode *msg)
 
     if (native->proxy_callback) {
         crm_log_xml_trace(msg, "PROXY_INBOUND");
-        native->proxy_callback(lrmd, native->proxy_callback_userdata, msg);
+        if (!remote_proxy_batch_foreach(msg, proxy_dispatch_one, lrmd)) {
+            proxy_dispatch_one(msg, lrmd);
+        }
     }
 }
 
+static int
+proxy_send_now(xmlNode *msg, gpointer user_data)
+{
+    lrmd_t *lrmd = user_data;
+
+    crm_xml_add(msg, F_LRMD_OPERATION, CRM_OP_IPC_FWD);
+    crm_log_xml_trace(msg, "PROXY_OUTBOUND");
+    return lrmd_send_xml_no_reply(lrmd, msg);
+}
+
 int
 lrmd_internal_proxy_send(lrmd_t * lrmd, xmlNode *msg)
 {
+    lrmd_private_t *native = NULL;
+
     if (lrmd == NULL) {
         return -ENOTCONN;
     }
-    crm_xml_add(msg, F_LRMD_OPERATION, CRM_OP_IPC_FWD);
+    native = lrmd->lrmd_private;
 
-    crm_log_xml_trace(msg, "PROXY_OUTBOUND");
-    return lrmd_send_xml_no_reply(lrmd, msg);
+    if ((native->proxy_batch == NULL) && (native->peer_version != NULL)
+        && (compare_version(native->peer_version,
+                            LRMD_PROXY_BATCH_PROTOCOL_VERSION) >= 0)) {
+        native->proxy_batch = remote_proxy_batch_new(proxy_send_now, lrmd);
+    }
+    if (native->proxy_batch != NULL) {
+        return remote_proxy_batch_add(native->proxy_batch, msg);
+    }
+    return proxy_send_now(msg, lrmd);
 }
 
 static int
@@ -1674,15 +1878,28 @@ lrmd_api_get_metadata_params(lrmd_t *lrmd, const char *standard,
 {
     svc_action_t *action = NULL;
     GHashTable *params_table = NULL;
+    char *cached = NULL;
 
     if (!standard || !type) {
         lrmd_key_value_freeall(params);
         return -EINVAL;
     }
 
+    cached = pcmk__metadata_cache_get(standard, provider, type);
+    if (cached != NULL) {
+        lrmd_key_value_freeall(params);
+        *output = cached;
+        return pcmk_ok;
+    }
+
     if (safe_str_eq(standard, PCMK_RESOURCE_CLASS_STONITH)) {
+        int rc = stonith_get_metadata(provider, type, output);
+
         lrmd_key_value_freeall(params);
-        return stonith_get_metadata(provider, type, output);
+        if (rc == pcmk_ok) {
+            pcmk__metadata_cache_put(standard, provider, type, *output);
+        }
+        return rc;
     }
 
     params_table = crm_str_table_new();
@@ -1717,23 +1934,21 @@ lrmd_api_get_metadata_params(lrmd_t *lrmd, const char *standard,
 
     *output = strdup(action->stdout_data);
     services_action_free(action);
+    pcmk__metadata_cache_put(standard, provider, type, *output);
 
     return pcmk_ok;
 }
 
-static int
-lrmd_api_exec(lrmd_t *lrmd, const char *rsc_id, const char *action,
-              const char *userdata, guint interval_ms,
-              int timeout,      /* ms */
-              int start_delay,  /* ms */
-              enum lrmd_call_options options, lrmd_key_value_t * params)
+static xmlNode *
+create_exec_xml(xmlNode *parent, const char *origin, const char *rsc_id,
+                const char *action, const char *userdata, guint interval_ms,
+                int timeout, int start_delay, lrmd_key_value_t *params)
 {
-    int rc = pcmk_ok;
-    xmlNode *data = create_xml_node(NULL, F_LRMD_RSC);
+    xmlNode *data = create_xml_node(parent, F_LRMD_RSC);
     xmlNode *args = create_xml_node(data, XML_TAG_ATTRS);
     lrmd_key_value_t *tmp = NULL;
 
-    crm_xml_add(data, F_LRMD_ORIGIN, __FUNCTION__);
+    crm_xml_add(data, F_LRMD_ORIGIN, origin);
     crm_xml_add(data, F_LRMD_RSC_ID, rsc_id);
     crm_xml_add(data, F_LRMD_RSC_ACTION, action);
     crm_xml_add(data, F_LRMD_RSC_USERDATA_STR, userdata);
@@ -1744,6 +1959,20 @@ lrmd_api_exec(lrmd_t *lrmd, const char *rsc_id, const char *action,
     for (tmp = params; tmp; tmp = tmp->next) {
         hash2smartfield((gpointer) tmp->key, (gpointer) tmp->value, args);
     }
+    return data;
+}
+
+static int
+lrmd_api_exec(lrmd_t *lrmd, const char *rsc_id, const char *action,
+              const char *userdata, guint interval_ms,
+              int timeout,      /* ms */
+              int start_delay,  /* ms */
+              enum lrmd_call_options options, lrmd_key_value_t * params)
+{
+    int rc = pcmk_ok;
+    xmlNode *data = create_exec_xml(NULL, __FUNCTION__, rsc_id, action,
+                                    userdata, interval_ms, timeout,
+                                    start_delay, params);
 
     rc = lrmd_send_command(lrmd, LRMD_OP_RSC_EXEC, data, NULL, timeout, options, TRUE);
     free_xml(data);
@@ -1752,6 +1981,91 @@ lrmd_api_exec(lrmd_t *lrmd, const char *rsc_id, const char *action,
     return rc;
 }
 
+static int
+lrmd_exec_each(lrmd_t *lrmd, lrmd_exec_op_t *ops, int n_ops,
+               enum lrmd_call_options options)
+{
+    int queued = 0;
+
+    for (int lpc = 0; lpc < n_ops; lpc++) {
+        ops[lpc].call_id = lrmd_api_exec(lrmd, ops[lpc].rsc_id,
+                                         ops[lpc].action, ops[lpc].userdata,
+                                         ops[lpc].interval_ms,
+                                         ops[lpc].timeout,
+                                         ops[lpc].start_delay, options,
+                                         ops[lpc].params);
+        ops[lpc].params = NULL; // Freed by lrmd_api_exec()
+        if (ops[lpc].call_id > 0) {
+            queued++;
+        }
+    }
+    return queued;
+}
+
+static int
+lrmd_api_exec_batch(lrmd_t *lrmd, lrmd_exec_op_t *ops, int n_ops,
+                    enum lrmd_call_options options)
+{
+    lrmd_private_t *native = lrmd->lrmd_private;
+    xmlNode *data = NULL;
+    xmlNode *reply = NULL;
+    xmlNode *result = NULL;
+    int timeout = 0;
+    int queued = 0;
+    int rc = pcmk_ok;
+
+    if (n_ops <= 0) {
+        return 0;
+
+    } else if ((n_ops == 1) || (native->peer_version == NULL)
+               || (compare_version(native->peer_version,
+                                   LRMD_BATCH_PROTOCOL_VERSION) < 0)) {
+        return lrmd_exec_each(lrmd, ops, n_ops, options);
+    }
+
+    data = create_xml_node(NULL, F_LRMD_BATCH);
+    for (int lpc = 0; lpc < n_ops; lpc++) {
+        create_exec_xml(data, __FUNCTION__, ops[lpc].rsc_id, ops[lpc].action,
+                        ops[lpc].userdata, ops[lpc].interval_ms,
+                        ops[lpc].timeout, ops[lpc].start_delay,
+                        ops[lpc].params);
+        lrmd_key_value_freeall(ops[lpc].params);
+        ops[lpc].params = NULL;
+        ops[lpc].call_id = -ENOMSG;
+        if (ops[lpc].timeout > timeout) {
+            timeout = ops[lpc].timeout;
+        }
+    }
+
+    crm_debug("Sending %d operations to executor in one request", n_ops);
+    rc = lrmd_send_command(lrmd, LRMD_OP_RSC_EXEC_BATCH, data, &reply,
+                           timeout, options, TRUE);
+    free_xml(data);
+
+    if (rc < 0) {
+        for (int lpc = 0; lpc < n_ops; lpc++) {
+            ops[lpc].call_id = rc;
+        }
+        free_xml(reply);
+        return rc;
+    }
+
+    // The reply has one result per operation, in order
+    result = first_named_child(reply, F_LRMD_RSC);
+    for (int lpc = 0; (lpc < n_ops) && (result != NULL); lpc++) {
+        if (crm_element_value_int(result, F_LRMD_CALLID,
+                                  &(ops[lpc].call_id)) < 0) {
+            ops[lpc].call_id = -ENOMSG;
+        }
+        if (ops[lpc].call_id > 0) {
+            queued++;
+        }
+        result = crm_next_same_xml(result);
+    }
+    free_xml(reply);
+    return queued;
+}
+
 /* timeout is in ms */
 static int
 lrmd_api_exec_alert(lrmd_t *lrmd, const char *alert_id, const char *alert_path,
@@ -1946,6 +2260,7 @@ lrmd_api_new(void)
     new_lrmd->cmds->list_standards = lrmd_api_list_standards;
     new_lrmd->cmds->exec_alert = lrmd_api_exec_alert;
     new_lrmd->cmds->get_metadata_params = lrmd_api_get_metadata_params;
+    new_lrmd->cmds->exec_batch = lrmd_api_exec_batch;
 
     return new_lrmd;
 }
@@ -1969,6 +2284,7 @@ lrmd_remote_api_new(const char *nodename, const char *server, int port)
     if (native->port == 0) {
         native->port = crm_default_remote_port();
     }
+    native->pipeline = crm_is_true(daemon_option("remote_pipeline"));
 
     return new_lrmd;
 #else
@@ -14,6 +14,7 @@
 #include <crm/msg_xml.h>
 #include <crm/services.h>
 #include <crm/common/mainloop.h>
+#include <crm/common/internal.h>
 
 #include <crm/pengine/status.h>
 #include <crm/cib.h>
@@ -141,6 +142,173 @@ remote_proxy_dispatch(const char *buffer, ssize_t length, gpointer userdata)
 }
 
 
+/*
+ * Proxied IPC message batching
+ *
+ * Each message relayed between a remote node's local IPC clients and the
+ * cluster daemons is otherwise wrapped and sent on its own, so a remote node
+ * whose tools (attrd_updater in a loop, say, or several crm_mon instances)
+ * are busy makes both sides send a flood of small messages, each with its own
+ * header, TLS record and (on the receiving side) main loop dispatch. When both
+ * sides support it, messages for all sessions are instead collected as
+ * children of one LRMD_IPC_OP_BATCH message, which is sent on the main loop
+ * iteration after the first message was added (so nothing waits on a timer),
+ * or as soon as it holds PROXY_BATCH_MAX messages, so that no single busy
+ * session can make the others wait for long. The flush runs at default
+ * priority, like the connections that fill the batch, so that a steady stream
+ * of other default-priority events cannot hold it back indefinitely. Each session's messages stay in
+ * order, and each local client's own IPC event queue limits how far it can
+ * fall behind.
+ */
+
+#define PROXY_BATCH_MAX 64
+
+struct remote_proxy_batch_s {
+    xmlNode *msgs;                  // batch being collected, or NULL
+    int n_msgs;
+    crm_trigger_t *flush_trigger;
+    int (*send)(xmlNode *msg, gpointer user_data);
+    gpointer user_data;
+};
+
+static int
+batch_flush_cb(gpointer user_data)
+{
+    remote_proxy_batch_flush(user_data);
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Create a batch of proxied IPC messages
+ *
+ * \param[in] send       Function to call to send a message on the connection
+ * \param[in] user_data  User data for \p send
+ *
+ * \return Newly allocated batch (free with remote_proxy_batch_free())
+ */
+remote_proxy_batch_t *
+remote_proxy_batch_new(int (*send)(xmlNode *msg, gpointer user_data),
+                       gpointer user_data)
+{
+    remote_proxy_batch_t *batch = calloc(1, sizeof(remote_proxy_batch_t));
+
+    CRM_ASSERT(batch != NULL);
+    batch->send = send;
+    batch->user_data = user_data;
+    batch->flush_trigger = mainloop_add_trigger(G_PRIORITY_DEFAULT,
+                                                batch_flush_cb, batch);
+    pcmk__trigger_set_name(batch->flush_trigger, "proxy-batch");
+    return batch;
+}
+
+/*!
+ * \internal
+ * \brief Add (a copy of) a proxied IPC message to a batch
+ *
+ * \param[in] batch  Batch to add to
+ * \param[in] msg    Message to add
+ *
+ * \return pcmk_ok on success, or the result of sending the batch if it filled
+ */
+int
+remote_proxy_batch_add(remote_proxy_batch_t *batch, xmlNode *msg)
+{
+    if (batch->msgs == NULL) {
+        batch->msgs = create_xml_node(NULL, T_LRMD_IPC_PROXY);
+        crm_xml_add(batch->msgs, F_LRMD_IPC_OP, LRMD_IPC_OP_BATCH);
+    }
+    add_node_copy(batch->msgs, msg);
+
+    if (++batch->n_msgs >= PROXY_BATCH_MAX) {
+        return remote_proxy_batch_flush(batch);
+    }
+    mainloop_set_trigger(batch->flush_trigger);
+    return pcmk_ok;
+}
+
+/*!
+ * \internal
+ * \brief Send any messages collected in a batch
+ *
+ * \param[in] batch  Batch to send
+ *
+ * \return pcmk_ok if there was nothing to send, otherwise result of sending
+ */
+int
+remote_proxy_batch_flush(remote_proxy_batch_t *batch)
+{
+    xmlNode *msgs = batch->msgs;
+    int n_msgs = batch->n_msgs;
+    int rc = pcmk_ok;
+
+    if (msgs == NULL) {
+        return pcmk_ok;
+    }
+    batch->msgs = NULL;
+    batch->n_msgs = 0;
+
+    if (n_msgs == 1) {
+        // Don't wrap a lone message
+        rc = batch->send(__xml_first_child_element(msgs), batch->user_data);
+    } else {
+        crm_trace("Sending batch of %d proxied IPC messages", n_msgs);
+        rc = batch->send(msgs, batch->user_data);
+    }
+    if (rc < 0) {
+        crm_warn("Could not send %d proxied IPC message%s: %s " CRM_XS " rc=%d",
+                 n_msgs, ((n_msgs == 1)? "" : "s"), pcmk_strerror(rc), rc);
+    }
+    free_xml(msgs);
+    return rc;
+}
+
+/*!
+ * \internal
+ * \brief Free a batch of proxied IPC messages, discarding any not yet sent
+ *
+ * \param[in] batch  Batch to free
+ */
+void
+remote_proxy_batch_free(remote_proxy_batch_t *batch)
+{
+    if (batch != NULL) {
+        mainloop_destroy_trigger(batch->flush_trigger);
+        free_xml(batch->msgs);
+        free(batch);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Call a function for each message in a received batch
+ *
+ * \param[in] msg        Received proxied IPC message
+ * \param[in] fn         Function to call for each message in batch
+ * \param[in] user_data  User data for \p fn
+ *
+ * \return TRUE if \p msg was a batch, otherwise FALSE (and \p fn was not
+ *         called)
+ */
+gboolean
+remote_proxy_batch_foreach(xmlNode *msg,
+                           void (*fn)(xmlNode *msg, gpointer user_data),
+                           gpointer user_data)
+{
+    if (safe_str_neq(crm_element_value(msg, F_LRMD_IPC_OP),
+                     LRMD_IPC_OP_BATCH)) {
+        return FALSE;
+    }
+    for (xmlNode *child = __xml_first_child_element(msg); child != NULL;
+         child = __xml_next_element(child)) {
+
+        if (crm_str_eq((const char *) child->name, T_LRMD_IPC_PROXY, TRUE)) {
+            fn(child, user_data);
+        }
+    }
+    return TRUE;
+}
+
 void
 remote_proxy_disconnected(gpointer userdata)
 {
@@ -243,6 +411,8 @@ remote_proxy_cb(lrmd_t *lrmd, const char *node_name, xmlNode *msg)
         }
         proxy->last_request_id = 0;
         crm_element_value_int(msg, F_LRMD_IPC_MSG_FLAGS, &flags);
+        // Only what the request asks for applies to the relayed copy
+        flags &= ~pcmk__ipc_transport_flags;
         crm_xml_add(request, XML_ACL_TAG_ROLE, "pacemaker-remote");
 
 #if ENABLE_ACL
@@ -105,6 +105,7 @@ create_child_clone(resource_t * rsc, int sub_id, pe_working_set_t * data_set)
     clone_data->total_clones += 1;
     pe_rsc_trace(child_rsc, "Setting clone attributes for: %s", child_rsc->id);
     rsc->children = g_list_append(rsc->children, child_rsc);
+    pe__index_resource(data_set, child_rsc);
     if (as_orphan) {
         mark_as_orphan(child_rsc);
     }
@@ -591,7 +592,7 @@ clone_free(resource_t * rsc)
 
         CRM_ASSERT(child_rsc);
         pe_rsc_trace(child_rsc, "Freeing child %s", child_rsc->id);
-        free_xml(child_rsc->xml);
+        pe__free_rsc_xml(child_rsc->xml);
         child_rsc->xml = NULL;
         /* There could be a saved unexpanded xml */
         free_xml(child_rsc->orig_xml);
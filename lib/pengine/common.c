@@ -85,6 +85,15 @@ static pe_cluster_option pe_opts[] = {
 	  "When set to TRUE, the cluster will immediately ban a resource from a node if it fails to start there. When FALSE, the cluster will instead check the resource's fail count against its migration-threshold." },
 	{ "enable-startup-probes", NULL, "boolean", NULL, "true", &check_boolean,
 	  "Should the cluster check for active resources during startup", NULL },
+	{ "incremental-scheduling", NULL, "boolean", NULL, "false", &check_boolean,
+	  "Reuse the previous placement of resources unaffected by the latest changes",
+	  "When only resource histories have changed since the last calculation, resources with no colocation, ordering, parent or container relationship to the changed ones keep their previous placement without being re-scored. Configuration, node state and node attribute changes always cause a full calculation." },
+	{ "unpack-threads", NULL, "integer", NULL, "0", &check_number,
+	  "The number of threads used to sort resource histories",
+	  "Values greater than 1 sort each node's resource operation history on a pool of that many worker threads before the status section is processed. Zero or 1 does all work in the main thread." },
+	{ "scheduler-profiling", NULL, "boolean", NULL, "false", &check_boolean,
+	  "Add per-stage timing to transition graphs",
+	  "When TRUE, the scheduler adds a profiling section to each transition graph, with the time, heap usage and object counts of every stage of the calculation." },
 
 	/* Stonith Options */
 	{ "stonith-enabled", NULL, "boolean", NULL, "true", &check_boolean,
@@ -109,6 +118,9 @@ static pe_cluster_option pe_opts[] = {
 	  "The \"correct\" value will depend on the speed and load of your network and cluster nodes." },
 	{ "migration-limit", NULL, "integer", NULL, "-1", &check_number,
 	  "The number of migration jobs that the TE is allowed to execute in parallel on a node"},
+	{ "migration-streams", NULL, "integer", NULL, "0", &check_number,
+	  "The number of live migrations between any two nodes that may run in parallel (0 for no limit)",
+	  "Migrations between each pair of nodes are made in ascending order of their resources' migration-weight meta-attributes." },
 
 	/* Orphans and stopping */
 	{ "stop-all-resources", NULL, "boolean", NULL, "false", &check_boolean,
@@ -138,6 +150,13 @@ static pe_cluster_option pe_opts[] = {
 	    "The number of other scheduler inputs to save",
         "Zero to disable, -1 to store unlimited"
     },
+	{
+        "pe-input-snapshot-interval", NULL, "integer", NULL, "0", &check_number,
+	    "How often to save a scheduler input in full",
+        "Only every Nth saved input (by sequence number) is stored in full, "
+        "and the rest as the differences from the previous input in the same "
+        "series. Zero or one to always store inputs in full."
+    },
 
 	/* Node health */
 	{ "node-health-strategy", NULL, "enum", "none, migrate-on-red, only-green, progressive, custom", "none", &check_health,
@@ -159,6 +178,9 @@ static pe_cluster_option pe_opts[] = {
 	/*Placement Strategy*/
 	{ "placement-strategy", NULL, "enum", "default, utilization, minimal, balanced", "default", &check_placement_strategy,
 	  "The strategy to determine resource placement", NULL},
+	{ "balance-remote-connections", NULL, "boolean", NULL, "false", &check_boolean,
+	  "Spread Pacemaker Remote connections across cluster nodes by their traffic",
+	  "Each connection is placed on the least loaded of the nodes with the best score for it, using the traffic measured by the controllers. Active connections are moved only when that would remove a large imbalance." },
 };
 /* *INDENT-ON* */
 
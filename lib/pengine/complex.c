@@ -187,10 +187,156 @@ template_op_key(xmlNode * op)
     return key;
 }
 
+/*
+ * Expanded templates
+ *
+ * A template-derived resource is unpacked from a copy of its template with the
+ * resource's own definition merged in. The result depends only on those two
+ * definitions, so rather than expanding it again in every scheduler run, it is
+ * kept (keyed by the digests of both) and used directly as the resource's
+ * rsc->xml, which must therefore be treated as read-only. An expansion is
+ * reference-counted by the resources using it, and must be released with
+ * pe__free_rsc_xml() rather than freed.
+ */
+
+struct expanded_template_s {
+    int refcount;
+    char *key;
+    xmlNode *xml;
+};
+
+// Digests of template and resource definition -> struct expanded_template_s
+static GHashTable *expanded_templates = NULL;
+
+// Expanded XML -> struct expanded_template_s (for releasing)
+static GHashTable *expanded_xml_index = NULL;
+
+static void
+expanded_template_unref(gpointer data)
+{
+    struct expanded_template_s *expanded = data;
+
+    if ((expanded != NULL) && (--expanded->refcount == 0)) {
+        g_hash_table_remove(expanded_xml_index, expanded->xml);
+        free_xml(expanded->xml);
+        free(expanded->key);
+        free(expanded);
+    }
+}
+
+static gboolean
+expanded_template_unused(gpointer key, gpointer value, gpointer user_data)
+{
+    return ((struct expanded_template_s *) value)->refcount == 1;
+}
+
+/*!
+ * \internal
+ * \brief Free a resource's XML, or release it if it is a kept expansion
+ *
+ * \param[in] xml  XML to free
+ */
+void
+pe__free_rsc_xml(xmlNode *xml)
+{
+    struct expanded_template_s *expanded = NULL;
+
+    if ((xml != NULL) && (expanded_xml_index != NULL)) {
+        expanded = g_hash_table_lookup(expanded_xml_index, xml);
+    }
+    if (expanded != NULL) {
+        expanded_template_unref(expanded);
+    } else {
+        free_xml(xml);
+    }
+}
+
+// Get the key for an expansion of a template with a resource definition
+static char *
+expanded_template_key(xmlNode *template, xmlNode *xml_obj)
+{
+    char *template_digest = pcmk__xml_parsed(template);
+    char *rsc_digest = calculate_xml_versioned_digest(xml_obj, FALSE, FALSE,
+                                                      CRM_FEATURE_SET);
+    char *key = NULL;
+
+    // A template is shared by many resources, so digest it once per input
+    if (template_digest == NULL) {
+        template_digest = calculate_xml_versioned_digest(template, FALSE,
+                                                         FALSE,
+                                                         CRM_FEATURE_SET);
+        if (!pcmk__xml_set_parsed(template, template_digest, free)) {
+            key = crm_strdup_printf("%s %s", template_digest, rsc_digest);
+            free(template_digest);
+            free(rsc_digest);
+            return key;
+        }
+    }
+    key = crm_strdup_printf("%s %s", template_digest, rsc_digest);
+    free(rsc_digest);
+    return key;
+}
+
+/*!
+ * \internal
+ * \brief Get a kept expansion of a template with a resource definition
+ *
+ * \param[in] key  Key from expanded_template_key()
+ *
+ * \return Kept expansion (with a new reference held by the caller), or NULL
+ */
+static xmlNode *
+expanded_template_get(const char *key)
+{
+    struct expanded_template_s *expanded = NULL;
+
+    if (expanded_templates != NULL) {
+        expanded = g_hash_table_lookup(expanded_templates, key);
+    }
+    if (expanded == NULL) {
+        return NULL;
+    }
+    expanded->refcount++;
+    return expanded->xml;
+}
+
+/*!
+ * \internal
+ * \brief Keep an expansion of a template with a resource definition
+ *
+ * \param[in] key  Key from expanded_template_key() (which will be taken)
+ * \param[in] xml  Expanded XML (a reference to which is held by the caller)
+ */
+static void
+expanded_template_add(char *key, xmlNode *xml)
+{
+    struct expanded_template_s *expanded = NULL;
+
+    if (expanded_templates == NULL) {
+        expanded_templates = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                   NULL,
+                                                   expanded_template_unref);
+        expanded_xml_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+
+    /* Forget expansions that no current resource uses, so that deleted or
+     * frequently changed resources do not accumulate
+     */
+    g_hash_table_foreach_remove(expanded_templates, expanded_template_unused,
+                                NULL);
+
+    expanded = calloc(1, sizeof(struct expanded_template_s));
+    CRM_ASSERT(expanded != NULL);
+    expanded->refcount = 2; // one for the cache and one for the caller
+    expanded->key = key;
+    expanded->xml = xml;
+    g_hash_table_replace(expanded_templates, expanded->key, expanded);
+    g_hash_table_insert(expanded_xml_index, xml, expanded);
+}
+
 static gboolean
 unpack_template(xmlNode * xml_obj, xmlNode ** expanded_xml, pe_working_set_t * data_set)
 {
-    xmlNode *cib_resources = NULL;
     xmlNode *template = NULL;
     xmlNode *new_xml = NULL;
     xmlNode *child_xml = NULL;
@@ -199,6 +345,7 @@ unpack_template(xmlNode * xml_obj, xmlNode ** expanded_xml, pe_working_set_t * d
     const char *template_ref = NULL;
     const char *clone = NULL;
     const char *id = NULL;
+    char *key = NULL;
 
     if (xml_obj == NULL) {
         pe_err("No resource object for template unpacking");
@@ -221,18 +368,22 @@ unpack_template(xmlNode * xml_obj, xmlNode ** expanded_xml, pe_working_set_t * d
         return FALSE;
     }
 
-    cib_resources = get_xpath_object("//"XML_CIB_TAG_RESOURCES, data_set->input, LOG_TRACE);
-    if (cib_resources == NULL) {
-        pe_err("No resources configured");
-        return FALSE;
-    }
-
-    template = find_entity(cib_resources, XML_CIB_TAG_RSC_TEMPLATE, template_ref);
+    template = pcmk__xml_find_id(data_set->input, XML_CIB_TAG_RSC_TEMPLATE,
+                                 template_ref);
     if (template == NULL) {
         pe_err("No template named '%s'", template_ref);
         return FALSE;
     }
 
+    key = expanded_template_key(template, xml_obj);
+    *expanded_xml = expanded_template_get(key);
+    if (*expanded_xml != NULL) {
+        crm_trace("Using kept expansion of template %s for %s",
+                  template_ref, id);
+        free(key);
+        return TRUE;
+    }
+
     new_xml = copy_xml(template);
     xmlNodeSetName(new_xml, xml_obj->name);
     crm_xml_replace(new_xml, XML_ATTR_ID, id);
@@ -286,6 +437,7 @@ unpack_template(xmlNode * xml_obj, xmlNode ** expanded_xml, pe_working_set_t * d
 
     /*free_xml(*expanded_xml); */
     *expanded_xml = new_xml;
+    expanded_template_add(key, new_xml);
 
     /* Disable multi-level templates for now */
     /*if(unpack_template(new_xml, expanded_xml, data_set) == FALSE) {
@@ -784,14 +936,14 @@ common_free(resource_t * rsc)
     }
 
     if (rsc->parent == NULL && is_set(rsc->flags, pe_rsc_orphan)) {
-        free_xml(rsc->xml);
+        pe__free_rsc_xml(rsc->xml);
         rsc->xml = NULL;
         free_xml(rsc->orig_xml);
         rsc->orig_xml = NULL;
 
         /* if rsc->orig_xml, then rsc->xml is an expanded xml from a template */
     } else if (rsc->orig_xml) {
-        free_xml(rsc->xml);
+        pe__free_rsc_xml(rsc->xml);
         rsc->xml = NULL;
     }
     if (rsc->running_on) {
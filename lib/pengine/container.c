@@ -1429,7 +1429,7 @@ container_free(resource_t * rsc)
     g_list_free(rsc->children);
 
     if(container_data->child) {
-        free_xml(container_data->child->xml);
+        pe__free_rsc_xml(container_data->child->xml);
         container_data->child->xml = NULL;
         container_data->child->fns->free(container_data->child);
     }
@@ -8,7 +8,7 @@
 #include <crm_internal.h>
 
 #include <sys/types.h>
-#include <regex.h>
+#include <ctype.h>
 #include <glib.h>
 
 #include <crm/crm.h>
@@ -24,11 +24,11 @@ is_matched_failure(const char *rsc_id, xmlNode *conf_op_xml,
     gboolean matched = FALSE;
     const char *conf_op_name = NULL;
     const char *lrm_op_task = NULL;
-    const char *conf_op_interval_spec = NULL;
     guint conf_op_interval_ms = 0;
     guint lrm_op_interval_ms = 0;
     const char *lrm_op_id = NULL;
     char *last_failure_key = NULL;
+    pe__op_history_t history;
 
     if (rsc_id == NULL || conf_op_xml == NULL || lrm_op_xml == NULL) {
         return FALSE;
@@ -36,14 +36,12 @@ is_matched_failure(const char *rsc_id, xmlNode *conf_op_xml,
 
     // Get name and interval from configured op
     conf_op_name = crm_element_value(conf_op_xml, "name");
-    conf_op_interval_spec = crm_element_value(conf_op_xml,
-                                              XML_LRM_ATTR_INTERVAL);
-    conf_op_interval_ms = crm_parse_interval_spec(conf_op_interval_spec);
+    conf_op_interval_ms = pe__op_interval_ms(conf_op_xml);
 
     // Get name and interval from op history entry
     lrm_op_task = crm_element_value(lrm_op_xml, XML_LRM_ATTR_TASK);
-    crm_element_value_ms(lrm_op_xml, XML_LRM_ATTR_INTERVAL_MS,
-                         &lrm_op_interval_ms);
+    pe__op_history(lrm_op_xml, &history);
+    lrm_op_interval_ms = history.interval_ms;
 
     if ((conf_op_interval_ms != lrm_op_interval_ms)
         || safe_str_neq(conf_op_name, lrm_op_task)) {
@@ -61,11 +59,7 @@ is_matched_failure(const char *rsc_id, xmlNode *conf_op_xml,
                                                 conf_op_interval_ms);
 
         if (safe_str_eq(expected_op_key, lrm_op_id)) {
-            int rc = 0;
-            int target_rc = get_target_rc(lrm_op_xml);
-
-            crm_element_value_int(lrm_op_xml, XML_LRM_ATTR_RC, &rc);
-            if (rc != target_rc) {
+            if (history.rc != history.target_rc) {
                 matched = TRUE;
             }
         }
@@ -115,15 +109,13 @@ block_failure(node_t *node, resource_t *rsc, xmlNode *xml_op,
 
             } else {
                 const char *conf_op_name = NULL;
-                const char *conf_op_interval_spec = NULL;
                 guint conf_op_interval_ms = 0;
                 char *lrm_op_xpath = NULL;
                 xmlXPathObject *lrm_op_xpathObj = NULL;
 
                 // Get name and interval from configured op
                 conf_op_name = crm_element_value(pref, "name");
-                conf_op_interval_spec = crm_element_value(pref, XML_LRM_ATTR_INTERVAL);
-                conf_op_interval_ms = crm_parse_interval_spec(conf_op_interval_spec);
+                conf_op_interval_ms = pe__op_interval_ms(pref);
 
                 lrm_op_xpath = crm_strdup_printf("//node_state[@uname='%s']"
                                                "//lrm_resource[@id='%s']"
@@ -181,97 +173,248 @@ rsc_fail_name(resource_t *rsc)
     return is_set(rsc->flags, pe_rsc_unique)? strdup(name) : clone_strip(name);
 }
 
+/* Failure-related node attributes for one resource name as it appears in
+ * attribute names (possibly with a clone instance number)
+ */
+struct fail_entry_s {
+    char *name;             // resource name part of attribute names
+    int failcount;          // sum of per-operation fail counts
+    time_t last_failure;    // latest per-operation last failure
+    int legacy_failcount;   // @COMPAT DC < 1.1.17: per-resource fail count
+    time_t legacy_last_failure;
+};
+
+static void
+free_fail_entry(gpointer data)
+{
+    struct fail_entry_s *entry = data;
+
+    free(entry->name);
+    free(entry);
+}
+
+static void
+free_fail_entries(gpointer data)
+{
+    g_list_free_full((GList *) data, free_fail_entry);
+}
+
 /*!
  * \internal
- * \brief Compile regular expression to match a failure-related node attribute
+ * \brief Get length of a resource name without any clone instance number
  *
- * \param[in]  prefix    Attribute prefix to match
- * \param[in]  rsc_name  Resource name to match as used in failure attributes
- * \param[in]  is_legacy Whether DC uses per-resource fail counts
- * \param[in]  is_unique Whether the resource is a globally unique clone
- * \param[out] re        Where to store resulting regular expression
+ * \param[in] name  Resource name as used in failure attributes
  *
- * \note Fail attributes are named like PREFIX-RESOURCE#OP_INTERVAL.
- *       The caller is responsible for freeing re with regfree().
+ * \return Length of \p name without a trailing ":<digits>", if any
  */
-static void
-generate_fail_regex(const char *prefix, const char *rsc_name,
-                    gboolean is_legacy, gboolean is_unique, regex_t *re)
+static size_t
+fail_name_base_len(const char *name)
 {
-    char *pattern;
+    const char *colon = strrchr(name, ':');
+    const char *p = NULL;
 
-    /* @COMPAT DC < 1.1.17: Fail counts used to be per-resource rather than
-     * per-operation.
-     */
-    const char *op_pattern = (is_legacy? "" : "#.+_[0-9]+");
+    if ((colon == NULL) || (colon[1] == '\0')) {
+        return strlen(name);
+    }
+    for (p = colon + 1; *p != '\0'; ++p) {
+        if (!isdigit((int) *p)) {
+            return strlen(name);
+        }
+    }
+    return colon - name;
+}
 
-    /* Ignore instance numbers for anything other than globally unique clones.
-     * Anonymous clone fail counts could contain an instance number if the
-     * clone was initially unique, failed, then was converted to anonymous.
-     * @COMPAT Also, before 1.1.8, anonymous clone fail counts always contained
-     * clone instance numbers.
-     */
-    const char *instance_pattern = (is_unique? "" : "(:[0-9]+)?");
+/*!
+ * \internal
+ * \brief Check whether a string is a valid operation suffix of fail attributes
+ *
+ * \param[in] op  Text after the '#' in a failure attribute name
+ *
+ * \return TRUE if \p op looks like OPERATION_INTERVAL, otherwise FALSE
+ */
+static gboolean
+valid_fail_op(const char *op)
+{
+    const char *underscore = strrchr(op, '_');
 
-    pattern = crm_strdup_printf("^%s-%s%s%s$", prefix, rsc_name,
-                                instance_pattern, op_pattern);
-    CRM_LOG_ASSERT(regcomp(re, pattern, REG_EXTENDED|REG_NOSUB) == 0);
-    free(pattern);
+    if ((underscore == NULL) || (underscore == op)
+        || (underscore[1] == '\0')) {
+        return FALSE;
+    }
+    for (const char *p = underscore + 1; *p != '\0'; ++p) {
+        if (!isdigit((int) *p)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
 }
 
 /*!
  * \internal
- * \brief Compile regular expressions to match failure-related node attributes
+ * \brief Add a node attribute to a node's failure index, if relevant
  *
- * \param[in]  rsc             Resource being checked for failures
- * \param[in]  data_set        Data set (for CRM feature set version)
- * \param[out] failcount_re    Storage for regular expression for fail count
- * \param[out] lastfailure_re  Storage for regular expression for last failure
+ * \param[in,out] index  Failure index to update
+ * \param[in]     attr   Node attribute name
+ * \param[in]     value  Node attribute value
  *
- * \note The caller is responsible for freeing the expressions with regfree().
+ * \note Fail attributes are named like PREFIX-RESOURCE[:INSTANCE]#OP_INTERVAL
+ *       (or PREFIX-RESOURCE[:INSTANCE] for DCs older than 1.1.17).
  */
 static void
-generate_fail_regexes(resource_t *rsc, pe_working_set_t *data_set,
-                      regex_t *failcount_re, regex_t *lastfailure_re)
+index_fail_attr(GHashTable *index, const char *attr, const char *value)
 {
-    char *rsc_name = rsc_fail_name(rsc);
-    const char *version = crm_element_value(data_set->input, XML_ATTR_CRM_VERSION);
-    gboolean is_legacy = (compare_version(version, "3.0.13") < 0);
+    gboolean is_failcount = FALSE;
+    const char *name = NULL;
+    const char *op = NULL;
+    char *rsc_name = NULL;
+    char *base = NULL;
+    GList *entries = NULL;
+    GList *iter = NULL;
+    struct fail_entry_s *entry = NULL;
+
+    if (crm_starts_with(attr, CRM_FAIL_COUNT_PREFIX "-")) {
+        is_failcount = TRUE;
+        name = attr + strlen(CRM_FAIL_COUNT_PREFIX "-");
+
+    } else if (crm_starts_with(attr, CRM_LAST_FAILURE_PREFIX "-")) {
+        name = attr + strlen(CRM_LAST_FAILURE_PREFIX "-");
+
+    } else {
+        return;
+    }
+
+    op = strchr(name, '#');
+    if (op == NULL) {
+        rsc_name = strdup(name);
+    } else if (valid_fail_op(op + 1) && (op != name)) {
+        rsc_name = strndup(name, op - name);
+    } else {
+        return;
+    }
+    CRM_ASSERT(rsc_name != NULL);
+    if (*rsc_name == '\0') {
+        free(rsc_name);
+        return;
+    }
+
+    base = strndup(rsc_name, fail_name_base_len(rsc_name));
+    CRM_ASSERT(base != NULL);
+    entries = g_hash_table_lookup(index, base);
+    for (iter = entries; iter != NULL; iter = iter->next) {
+        if (!strcmp(((struct fail_entry_s *) iter->data)->name, rsc_name)) {
+            entry = iter->data;
+            break;
+        }
+    }
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(struct fail_entry_s));
+        CRM_ASSERT(entry != NULL);
+        entry->name = rsc_name;
+        rsc_name = NULL;
+        if (entries == NULL) {
+            g_hash_table_insert(index, base, g_list_append(NULL, entry));
+            base = NULL;
+        } else {
+            entries = g_list_append(entries, entry); // head is unchanged
+        }
+    }
 
-    generate_fail_regex(CRM_FAIL_COUNT_PREFIX, rsc_name, is_legacy,
-                        is_set(rsc->flags, pe_rsc_unique), failcount_re);
+    if (op == NULL) {
+        if (is_failcount) {
+            entry->legacy_failcount = merge_weights(entry->legacy_failcount,
+                                                    char2score(value));
+        } else {
+            entry->legacy_last_failure = QB_MAX(entry->legacy_last_failure,
+                                                crm_int_helper(value, NULL));
+        }
 
-    generate_fail_regex(CRM_LAST_FAILURE_PREFIX, rsc_name, is_legacy,
-                        is_set(rsc->flags, pe_rsc_unique), lastfailure_re);
+    } else if (is_failcount) {
+        entry->failcount = merge_weights(entry->failcount, char2score(value));
 
+    } else {
+        entry->last_failure = QB_MAX(entry->last_failure,
+                                     crm_int_helper(value, NULL));
+    }
     free(rsc_name);
+    free(base);
+}
+
+/*!
+ * \internal
+ * \brief Get a node's index of failure-related attributes, creating if needed
+ *
+ * The index maps resource names (without clone instance numbers) to lists of
+ * fail counts and last failure times, so that looking up a resource's
+ * failures doesn't require matching every node attribute.
+ *
+ * \param[in] node  Node to check
+ *
+ * \return Failure index for \p node
+ */
+static GHashTable *
+node_fail_index(node_t *node)
+{
+    if (node->details->fail_index == NULL) {
+        GHashTableIter iter;
+        const char *attr = NULL;
+        const char *value = NULL;
+
+        node->details->fail_index = g_hash_table_new_full(crm_str_hash,
+                                                          g_str_equal, free,
+                                                          free_fail_entries);
+        if (node->details->attrs != NULL) {
+            g_hash_table_iter_init(&iter, node->details->attrs);
+            while (g_hash_table_iter_next(&iter, (gpointer *) &attr,
+                                          (gpointer *) &value)) {
+                index_fail_attr(node->details->fail_index, attr, value);
+            }
+        }
+    }
+    return node->details->fail_index;
 }
 
 int
 pe_get_failcount(node_t *node, resource_t *rsc, time_t *last_failure,
                  uint32_t flags, xmlNode *xml_op, pe_working_set_t *data_set)
 {
-    char *key = NULL;
-    const char *value = NULL;
-    regex_t failcount_re, lastfailure_re;
+    char *rsc_name = rsc_fail_name(rsc);
+    const char *version = crm_element_value(data_set->input, XML_ATTR_CRM_VERSION);
+    gboolean is_legacy = (compare_version(version, "3.0.13") < 0);
+    gboolean is_unique = is_set(rsc->flags, pe_rsc_unique);
+    char *base = strndup(rsc_name, fail_name_base_len(rsc_name));
+    GList *entries = NULL;
     int failcount = 0;
     time_t last = 0;
-    GHashTableIter iter;
 
-    generate_fail_regexes(rsc, data_set, &failcount_re, &lastfailure_re);
+    CRM_ASSERT(base != NULL);
 
-    /* Resource fail count is sum of all matching operation fail counts */
-    g_hash_table_iter_init(&iter, node->details->attrs);
-    while (g_hash_table_iter_next(&iter, (gpointer *) &key, (gpointer *) &value)) {
-        if (regexec(&failcount_re, key, 0, NULL, 0) == 0) {
-            failcount = merge_weights(failcount, char2score(value));
-        } else if (regexec(&lastfailure_re, key, 0, NULL, 0) == 0) {
-            last = QB_MAX(last, crm_int_helper(value, NULL));
+    /* Resource fail count is sum of all matching operation fail counts.
+     *
+     * Ignore instance numbers for anything other than globally unique clones.
+     * Anonymous clone fail counts could contain an instance number if the
+     * clone was initially unique, failed, then was converted to anonymous.
+     * @COMPAT Also, before 1.1.8, anonymous clone fail counts always contained
+     * clone instance numbers.
+     */
+    entries = g_hash_table_lookup(node_fail_index(node), base);
+    for (GList *iter = entries; iter != NULL; iter = iter->next) {
+        struct fail_entry_s *entry = iter->data;
+
+        if (is_unique || strcmp(base, rsc_name)) {
+            if (strcmp(entry->name, rsc_name)) {
+                continue;
+            }
+        }
+        if (is_legacy) {
+            failcount = merge_weights(failcount, entry->legacy_failcount);
+            last = QB_MAX(last, entry->legacy_last_failure);
+        } else {
+            failcount = merge_weights(failcount, entry->failcount);
+            last = QB_MAX(last, entry->last_failure);
         }
     }
-
-    regfree(&failcount_re);
-    regfree(&lastfailure_re);
+    free(base);
+    free(rsc_name);
 
     if ((failcount > 0) && (last > 0) && (last_failure != NULL)) {
         *last_failure = last;
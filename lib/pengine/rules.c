@@ -24,6 +24,7 @@
 #include <glib.h>
 
 #include <crm/pengine/rules.h>
+#include <crm/pengine/rules_internal.h>
 #include <crm/pengine/internal.h>
 
 #include <sys/types.h>
@@ -576,8 +577,109 @@ parse_xml_duration(crm_time_t * start, xmlNode * duration_spec)
     return end;
 }
 
+/* Date expressions depend only on the expression itself and the effective
+ * time, yet a scheduler run evaluates the same ones (re-parsing all their
+ * dates) for every node, resource and attribute set that refers to them.
+ * While a working set is in use, their results are therefore cached by
+ * expression for as long as the effective time stays the same.
+ */
+struct date_result_s {
+    char *id;
+    unsigned int generation;
+    gboolean passed;
+};
+
+static GHashTable *date_results = NULL;
+static crm_time_t *date_results_now = NULL;
+static pe_working_set_t *date_results_owner = NULL;
+
+/* Bumped whenever the cache is (re)started, so a result cached for an earlier
+ * working set is never used even if its XML node address gets reused
+ */
+static unsigned int date_results_generation = 0;
+
+static void
+free_date_result(gpointer data)
+{
+    struct date_result_s *result = data;
+
+    free(result->id);
+    free(result);
+}
+
+/*!
+ * \internal
+ * \brief Enable or disable caching of date expression results
+ *
+ * \param[in] data_set  Working set the cache is being used for
+ * \param[in] enable    If TRUE, start caching; otherwise, drop all results
+ *
+ * \note The cache is keyed by XML node, so it must be disabled before the
+ *       XML the rules came from is freed. Disabling it for a working set other
+ *       than the one it was enabled for has no effect.
+ */
+void
+pe__enable_rule_cache(pe_working_set_t *data_set, gboolean enable)
+{
+    if (!enable && (date_results_owner != NULL)
+        && (date_results_owner != data_set)) {
+        return;
+    }
+
+    if (date_results != NULL) {
+        g_hash_table_destroy(date_results);
+        date_results = NULL;
+    }
+    crm_time_free(date_results_now);
+    date_results_now = NULL;
+    date_results_owner = NULL;
+    date_results_generation++;
+
+    if (enable) {
+        date_results = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                             NULL, free_date_result);
+        date_results_owner = data_set;
+    }
+}
+
+static gboolean evaluate_date_expression(xmlNode * time_expr, crm_time_t * now);
+
 gboolean
 test_date_expression(xmlNode * time_expr, crm_time_t * now)
+{
+    struct date_result_s *result = NULL;
+
+    if ((date_results == NULL) || (now == NULL)) {
+        return evaluate_date_expression(time_expr, now);
+    }
+
+    if ((date_results_now == NULL)
+        || (crm_time_compare(date_results_now, now) != 0)) {
+        g_hash_table_remove_all(date_results);
+        if (date_results_now == NULL) {
+            date_results_now = crm_time_new(NULL);
+        }
+        crm_time_set(date_results_now, now);
+    }
+
+    result = g_hash_table_lookup(date_results, time_expr);
+    if ((result != NULL) && (result->generation == date_results_generation)
+        && safe_str_eq(result->id, ID(time_expr))) {
+        crm_trace("Using cached result for expression %s", ID(time_expr));
+        return result->passed;
+    }
+
+    result = calloc(1, sizeof(struct date_result_s));
+    CRM_ASSERT(result != NULL);
+    result->id = crm_element_value_copy(time_expr, XML_ATTR_ID);
+    result->generation = date_results_generation;
+    result->passed = evaluate_date_expression(time_expr, now);
+    g_hash_table_replace(date_results, time_expr, result);
+    return result->passed;
+}
+
+static gboolean
+evaluate_date_expression(xmlNode * time_expr, crm_time_t * now)
 {
     crm_time_t *start = NULL;
     crm_time_t *end = NULL;
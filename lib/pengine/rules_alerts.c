@@ -54,6 +54,55 @@ get_meta_attrs_from_cib(xmlNode *basenode, crm_alert_entry_t *entry,
                   entry->id, entry->tstamp_format);
     }
 
+    value = g_hash_table_lookup(config_hash, XML_ALERT_ATTR_DELIVERY);
+    if (value) {
+        entry->delivery = crm_alert_text2delivery(value);
+        if (safe_str_neq(value, crm_alert_delivery2text(entry->delivery))) {
+            crm_warn("Alert %s has invalid delivery value '%s', using '%s'",
+                     entry->id, value,
+                     crm_alert_delivery2text(entry->delivery));
+        }
+    }
+    value = g_hash_table_lookup(config_hash, XML_ALERT_ATTR_BATCH_DELAY);
+    if (value) {
+        int delay = crm_get_msec(value);
+
+        if (delay < 0) {
+            crm_warn("Alert %s has invalid batch delay '%s', using default "
+                     "%dmsec", entry->id, value, entry->batch_delay);
+        } else {
+            entry->batch_delay = delay;
+        }
+    }
+    value = g_hash_table_lookup(config_hash, XML_ALERT_ATTR_BATCH_SIZE);
+    if (value) {
+        int size = crm_parse_int(value, "0");
+
+        if (size <= 0) {
+            crm_warn("Alert %s has invalid batch size '%s', using default %d",
+                     entry->id, value, entry->batch_size);
+        } else {
+            entry->batch_size = size;
+        }
+    }
+    value = g_hash_table_lookup(config_hash, XML_ALERT_ATTR_QUEUE_SIZE);
+    if (value) {
+        int size = crm_parse_int(value, "0");
+
+        if (size <= 0) {
+            crm_warn("Alert %s has invalid queue size '%s', using default %d",
+                     entry->id, value, entry->queue_size);
+        } else {
+            entry->queue_size = size;
+        }
+    }
+    if (entry->delivery != crm_alert_deliver_each) {
+        crm_trace("Alert %s is delivered by %s (batches of up to %d events "
+                  "every %dmsec, up to %d waiting)", entry->id,
+                  crm_alert_delivery2text(entry->delivery), entry->batch_size,
+                  entry->batch_delay, entry->queue_size);
+    }
+
     g_hash_table_destroy(config_hash);
 }
 
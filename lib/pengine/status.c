@@ -16,6 +16,7 @@
 #include <glib.h>
 
 #include <crm/pengine/internal.h>
+#include <crm/pengine/rules_internal.h>
 #include <unpack.h>
 
 /*
@@ -41,6 +42,7 @@ cluster_status(pe_working_set_t * data_set)
 
     crm_trace("Beginning unpack");
     pe_dataset = data_set;
+    pe__enable_rule_cache(data_set, TRUE);
 
     /* reset remaining global variables */
     data_set->failed = create_xml_node(NULL, "failed-ops");
@@ -49,6 +51,9 @@ cluster_status(pe_working_set_t * data_set)
         return FALSE;
     }
 
+    // Resources and rules resolve many id-refs, so index the input's IDs
+    pcmk__xml_index_ids(data_set->input);
+
     if (data_set->now == NULL) {
         data_set->now = crm_time_new(NULL);
     }
@@ -74,6 +79,14 @@ cluster_status(pe_working_set_t * data_set)
         crm_warn("Fencing and resource management disabled due to lack of quorum");
     }
 
+    /* Nodes are indexed as they are created, and resources once the whole
+     * configuration section has been unpacked (see pe__index_resource())
+     */
+    data_set->node_id_index = g_hash_table_new(crm_strcase_hash,
+                                               crm_strcase_equal);
+    data_set->node_uname_index = g_hash_table_new(crm_strcase_hash,
+                                                  crm_strcase_equal);
+
     unpack_nodes(cib_nodes, data_set);
 
     if(is_not_set(data_set->flags, pe_flag_quick_location)) {
@@ -81,6 +94,17 @@ cluster_status(pe_working_set_t * data_set)
     }
 
     unpack_resources(cib_resources, data_set);
+
+    data_set->resource_id_index = g_hash_table_new_full(crm_str_hash,
+                                                        g_str_equal, free,
+                                                        NULL);
+    data_set->resource_name_index = g_hash_table_new_full(crm_str_hash,
+                                                          g_str_equal, free,
+                                                          NULL);
+    for (GListPtr gIter = data_set->resources; gIter; gIter = gIter->next) {
+        pe__index_resource(data_set, (pe_resource_t *) gIter->data);
+    }
+
     unpack_tags(cib_tags, data_set);
 
     if(is_not_set(data_set->flags, pe_flag_quick_location)) {
@@ -146,6 +170,9 @@ pe_free_nodes(GListPtr nodes)
             if (details->digest_cache != NULL) {
                 g_hash_table_destroy(details->digest_cache);
             }
+            if (details->fail_index != NULL) {
+                g_hash_table_destroy(details->fail_index);
+            }
             g_list_free(details->running_rsc);
             g_list_free(details->allocated_rsc);
             free(details);
@@ -161,6 +188,7 @@ void
 cleanup_calculations(pe_working_set_t * data_set)
 {
     pe_dataset = NULL;
+    pe__enable_rule_cache(data_set, FALSE);
     if (data_set == NULL) {
         return;
     }
@@ -186,12 +214,51 @@ cleanup_calculations(pe_working_set_t * data_set)
         g_hash_table_destroy(data_set->tags);
     }
 
+    if (data_set->resource_id_index) {
+        g_hash_table_destroy(data_set->resource_id_index);
+    }
+
+    if (data_set->resource_name_index) {
+        g_hash_table_destroy(data_set->resource_name_index);
+    }
+
+    if (data_set->node_id_index) {
+        g_hash_table_destroy(data_set->node_id_index);
+    }
+
+    if (data_set->node_uname_index) {
+        g_hash_table_destroy(data_set->node_uname_index);
+    }
+
+    if (data_set->action_index) {
+        g_hash_table_destroy(data_set->action_index);
+    }
+
+    if (data_set->ordering_index) {
+        g_hash_table_destroy(data_set->ordering_index);
+    }
+
+    if (data_set->history_filter) {
+        g_hash_table_destroy(data_set->history_filter);
+    }
+
     free(data_set->dc_uuid);
 
     crm_trace("deleting resources");
     pe_free_resources(data_set->resources);
 
     crm_trace("deleting actions");
+    if (data_set->arena != NULL) {
+        // The actions' ordering wrappers belong to the arena
+        for (GListPtr gIter = data_set->actions; gIter; gIter = gIter->next) {
+            action_t *action = gIter->data;
+
+            g_list_free(action->actions_before);
+            action->actions_before = NULL;
+            g_list_free(action->actions_after);
+            action->actions_after = NULL;
+        }
+    }
     pe_free_actions(data_set->actions);
 
     crm_trace("deleting nodes");
@@ -199,9 +266,11 @@ cleanup_calculations(pe_working_set_t * data_set)
 
     free_xml(data_set->graph);
     crm_time_free(data_set->now);
-    free_xml(data_set->input);
+    pcmk__xml_free_later(data_set->input);
     free_xml(data_set->failed);
 
+    pe__free_arena(data_set);
+
     set_working_set_defaults(data_set);
 
     CRM_CHECK(data_set->ordering_constraints == NULL,;
@@ -226,6 +295,171 @@ set_working_set_defaults(pe_working_set_t * data_set)
     set_bit(data_set->flags, pe_flag_stop_action_orphans);
 }
 
+/* Index value for a key claimed by more than one object. Lookups of such
+ * keys fall back to scanning the list, so that list order decides the result
+ * exactly as it did before the indexes existed.
+ */
+static char index_ambiguous;
+
+static void
+index_insert(GHashTable *index, const char *key, gpointer object,
+             gboolean copy_key)
+{
+    gpointer existing = NULL;
+
+    if ((index == NULL) || (key == NULL)) {
+        return;
+    }
+
+    existing = g_hash_table_lookup(index, key);
+    if (existing == NULL) {
+        g_hash_table_insert(index, (copy_key? strdup(key) : (char *) key),
+                            object);
+
+    } else if (existing != object) {
+        g_hash_table_replace(index, (copy_key? strdup(key) : (char *) key),
+                             &index_ambiguous);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Add a resource and all of its descendants to the resource index
+ *
+ * \param[in] data_set  Working set whose index should be updated
+ * \param[in] rsc       Resource that was added to the working set
+ *
+ * \note This is a no-op until cluster_status() has created the indexes, so
+ *       callers may use it unconditionally whenever a resource is created.
+ */
+void
+pe__index_resource(pe_working_set_t *data_set, pe_resource_t *rsc)
+{
+    if ((data_set->resource_id_index == NULL) || (rsc == NULL)) {
+        return;
+    }
+
+    index_insert(data_set->resource_id_index, rsc->id, rsc, TRUE);
+    pe__index_resource_name(data_set, rsc);
+
+    for (GListPtr gIter = rsc->children; gIter != NULL; gIter = gIter->next) {
+        pe__index_resource(data_set, (pe_resource_t *) gIter->data);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Add a resource's history ID (clone_name) to the resource index
+ *
+ * \param[in] data_set  Working set whose index should be updated
+ * \param[in] rsc       Resource that was (re)named in the status section
+ */
+void
+pe__index_resource_name(pe_working_set_t *data_set, pe_resource_t *rsc)
+{
+    if (rsc->clone_name != NULL) {
+        index_insert(data_set->resource_name_index, rsc->clone_name, rsc,
+                     TRUE);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Add a newly created node to the node indexes
+ *
+ * \param[in] data_set  Working set whose indexes should be updated
+ * \param[in] node      Node that was added to the working set
+ */
+void
+pe__index_node(pe_working_set_t *data_set, pe_node_t *node)
+{
+    /* Node details live as long as the working set, so keys need no copy */
+    index_insert(data_set->node_uname_index, node->details->uname, node,
+                 FALSE);
+    index_insert(data_set->node_id_index, node->details->id, node, FALSE);
+}
+
+/*!
+ * \internal
+ * \brief Limit the resource history that cluster_status() will unpack
+ *
+ * Once this has been called, cluster_status() unpacks the operation history
+ * only of resources that were named here (and of their descendants), plus
+ * the connections and containers that Pacemaker Remote nodes depend on. Any
+ * other resource will appear to be stopped, so this is only suitable for
+ * callers interested in particular resources.
+ *
+ * \param[in,out] data_set  Working set that has not been unpacked yet
+ * \param[in]     rsc_id    ID of a resource whose history is needed
+ */
+void
+pe__filter_history(pe_working_set_t *data_set, const char *rsc_id)
+{
+    char *key = NULL;
+
+    if (rsc_id == NULL) {
+        return;
+    }
+    if (data_set->history_filter == NULL) {
+        data_set->history_filter = g_hash_table_new_full(crm_str_hash,
+                                                         g_str_equal, free,
+                                                         NULL);
+    }
+    key = strdup(rsc_id);
+    g_hash_table_replace(data_set->history_filter, key, key);
+}
+
+/*!
+ * \internal
+ * \brief Look up a resource via the working set's indexes
+ *
+ * \param[in]  rsc_list  List being searched
+ * \param[in]  id        Resource ID to search for
+ * \param[in]  flags     Group of enum pe_find flags
+ * \param[out] rsc       Where to store the match (or NULL if none)
+ *
+ * \return TRUE if the index gave a definitive answer, FALSE if the list must
+ *         be scanned
+ */
+static gboolean
+index_find_resource(GListPtr rsc_list, const char *id, enum pe_find flags,
+                    resource_t **rsc)
+{
+    resource_t *by_id = NULL;
+    resource_t *by_name = NULL;
+
+    /* The indexes only describe the working set's own top-level list, and
+     * only exact and renamed matches (pe_find_resource()'s default)
+     */
+    if ((pe_dataset == NULL) || (pe_dataset->resource_id_index == NULL)
+        || (rsc_list == NULL) || (rsc_list != pe_dataset->resources)
+        || ((flags & ~pe_find_renamed) != 0)) {
+        return FALSE;
+    }
+
+    by_id = g_hash_table_lookup(pe_dataset->resource_id_index, id);
+    if (is_set(flags, pe_find_renamed)) {
+        by_name = g_hash_table_lookup(pe_dataset->resource_name_index, id);
+    }
+
+    if (((void *) by_id == &index_ambiguous)
+        || ((void *) by_name == &index_ambiguous)) {
+        return FALSE;
+    }
+
+    if (by_name != NULL) {
+        /* A resource may have been renamed again since it was indexed */
+        if (safe_str_neq(by_name->clone_name, id)
+            || ((by_id != NULL) && (by_id != by_name))) {
+            return FALSE;
+        }
+        by_id = by_name;
+    }
+
+    *rsc = by_id;
+    return TRUE;
+}
+
 resource_t *
 pe_find_resource(GListPtr rsc_list, const char *id)
 {
@@ -236,12 +470,19 @@ resource_t *
 pe_find_resource_with_flags(GListPtr rsc_list, const char *id, enum pe_find flags)
 {
     GListPtr rIter = NULL;
+    resource_t *match = NULL;
+
+    if (id && index_find_resource(rsc_list, id, flags, &match)) {
+        if (match == NULL) {
+            crm_trace("No match for %s", id);
+        }
+        return match;
+    }
 
     for (rIter = rsc_list; id && rIter; rIter = rIter->next) {
         resource_t *parent = rIter->data;
 
-        resource_t *match =
-            parent->fns->find_rsc(parent, id, NULL, flags);
+        match = parent->fns->find_rsc(parent, id, NULL, flags);
         if (match != NULL) {
             return match;
         }
@@ -267,6 +508,15 @@ pe_find_node_id(GListPtr nodes, const char *id)
 {
     GListPtr gIter = nodes;
 
+    if ((id != NULL) && (pe_dataset != NULL) && (nodes != NULL)
+        && (nodes == pe_dataset->nodes) && pe_dataset->node_id_index) {
+        node_t *match = g_hash_table_lookup(pe_dataset->node_id_index, id);
+
+        if ((void *) match != &index_ambiguous) {
+            return match;
+        }
+    }
+
     for (; gIter != NULL; gIter = gIter->next) {
         node_t *node = (node_t *) gIter->data;
 
@@ -283,6 +533,16 @@ pe_find_node(GListPtr nodes, const char *uname)
 {
     GListPtr gIter = nodes;
 
+    if ((uname != NULL) && (pe_dataset != NULL) && (nodes != NULL)
+        && (nodes == pe_dataset->nodes) && pe_dataset->node_uname_index) {
+        node_t *match = g_hash_table_lookup(pe_dataset->node_uname_index,
+                                            uname);
+
+        if ((void *) match != &index_ambiguous) {
+            return match;
+        }
+    }
+
     for (; gIter != NULL; gIter = gIter->next) {
         node_t *node = (node_t *) gIter->data;
 
@@ -15,6 +15,7 @@
 #include <crm/common/xml.h>
 
 #include <crm/common/util.h>
+#include <crm/common/internal.h>
 #include <crm/pengine/rules.h>
 #include <crm/pengine/internal.h>
 #include <unpack.h>
@@ -36,6 +37,13 @@ gboolean unpack_rsc_op(resource_t * rsc, node_t * node, xmlNode * xml_op, xmlNod
                        enum action_fail_response *failed, pe_working_set_t * data_set);
 static gboolean determine_remote_online_status(pe_working_set_t * data_set, node_t * this_node);
 
+/* Interned names of the status section elements matched most often, so that
+ * they can be compared by address (set by unpack_status())
+ */
+static const char *node_state_name = NULL;
+static const char *lrm_resource_name = NULL;
+static const char *rsc_op_name = NULL;
+
 // Bitmask for warnings we only want to print once
 uint32_t pe_wo = 0;
 
@@ -310,22 +318,6 @@ unpack_config(xmlNode * config, pe_working_set_t * data_set)
     return TRUE;
 }
 
-static void
-destroy_digest_cache(gpointer ptr)
-{
-    op_digest_cache_t *data = ptr;
-
-    free_xml(data->params_all);
-    free_xml(data->params_secure);
-    free_xml(data->params_restart);
-
-    free(data->digest_all_calc);
-    free(data->digest_restart_calc);
-    free(data->digest_secure_calc);
-
-    free(data);
-}
-
 node_t *
 pe_create_node(const char *id, const char *uname, const char *type,
                const char *score, pe_working_set_t * data_set)
@@ -381,9 +373,10 @@ pe_create_node(const char *id, const char *uname, const char *type,
 
     new_node->details->digest_cache = g_hash_table_new_full(crm_str_hash,
                                                             g_str_equal, free,
-                                                            destroy_digest_cache);
+                                                            pe__free_digests);
 
     data_set->nodes = g_list_insert_sorted(data_set->nodes, new_node, sort_node_uname);
+    pe__index_node(data_set, new_node);
     return new_node;
 }
 
@@ -900,7 +893,7 @@ unpack_handle_remote_attrs(node_t *this_node, xmlNode *state, pe_working_set_t *
     resource_t *rsc = NULL;
     const char *shutdown = NULL;
 
-    if (crm_str_eq((const char *)state->name, XML_CIB_TAG_STATE, TRUE) == FALSE) {
+    if (!pcmk__xml_name_eq(state, node_state_name, XML_CIB_TAG_STATE)) {
         return;
     }
 
@@ -956,6 +949,200 @@ unpack_handle_remote_attrs(node_t *this_node, xmlNode *state, pe_working_set_t *
     }
 }
 
+/* lrm_resource entry -> its operation history, already sorted by call ID
+ * (only set while unpack_status() runs with unpack-threads enabled)
+ */
+static GHashTable *sorted_histories = NULL;
+
+static GListPtr
+extract_rsc_ops(xmlNode *rsc_entry)
+{
+    GListPtr op_list = NULL;
+
+    for (xmlNode *rsc_op = __xml_first_child(rsc_entry); rsc_op != NULL;
+         rsc_op = __xml_next_element(rsc_op)) {
+        if (pcmk__xml_name_eq(rsc_op, rsc_op_name, XML_LRM_TAG_RSC_OP)) {
+            op_list = g_list_prepend(op_list, rsc_op);
+        }
+    }
+    return op_list;
+}
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+struct history_job_s {
+    xmlNode *lrm_rsc_list;  // One node's lrm_resources section
+    GListPtr entries;       // Entries whose history could be sorted
+    GListPtr histories;     // Sorted history of each of those entries
+    int skipped;            // Number of entries left to the main thread
+};
+
+/* Worker thread body: this must only read the status section, since the
+ * main thread merges the results into the working set afterwards, and must
+ * not log, since logging is not thread-safe. Histories that could not be
+ * sorted without logging are left for unpack_lrm_rsc_state() to sort (and
+ * log about) as usual.
+ */
+static void
+sort_node_histories(gpointer data, gpointer user_data)
+{
+    struct history_job_s *job = data;
+
+    for (xmlNode *rsc_entry = __xml_first_child(job->lrm_rsc_list);
+         rsc_entry != NULL; rsc_entry = __xml_next_element(rsc_entry)) {
+
+        if (pcmk__xml_name_eq(rsc_entry, lrm_resource_name, XML_LRM_TAG_RESOURCE)) {
+            GListPtr op_list = extract_rsc_ops(rsc_entry);
+
+            if (pe__sort_ops_quietly(&op_list)) {
+                job->entries = g_list_prepend(job->entries, rsc_entry);
+                job->histories = g_list_prepend(job->histories, op_list);
+            } else {
+                g_list_free(op_list);
+                job->skipped++;
+            }
+        }
+    }
+}
+
+/*!
+ * \internal
+ * \brief Sort every node's resource histories on a pool of worker threads
+ *
+ * \param[in] status    CIB status section
+ * \param[in] threads   Maximum number of worker threads to use
+ *
+ * \note Only the parsing and ordering of each history is done in parallel.
+ *       unpack_lrm_rsc_state() still processes the results one node at a
+ *       time in the usual order, so the outcome is the same as unpacking
+ *       serially.
+ */
+static void
+presort_histories(xmlNode *status, int threads)
+{
+    GError *error = NULL;
+    GThreadPool *pool = NULL;
+    GListPtr jobs = NULL;
+    int num_jobs = 0;
+    int skipped = 0;
+
+    pool = g_thread_pool_new(sort_node_histories, NULL, threads, TRUE, &error);
+    if (pool == NULL) {
+        crm_warn("Unpacking resource histories serially: %s",
+                 (error? error->message : "could not create threads"));
+        g_clear_error(&error);
+        return;
+    }
+
+    for (xmlNode *state = __xml_first_child(status); state != NULL;
+         state = __xml_next_element(state)) {
+        struct history_job_s *job = NULL;
+        xmlNode *lrm_rsc = NULL;
+
+        if (!pcmk__xml_name_eq(state, node_state_name, XML_CIB_TAG_STATE)) {
+            continue;
+        }
+
+        lrm_rsc = find_xml_node(state, XML_CIB_TAG_LRM, FALSE);
+        lrm_rsc = find_xml_node(lrm_rsc, XML_LRM_TAG_RESOURCES, FALSE);
+        if (lrm_rsc == NULL) {
+            continue;
+        }
+
+        job = calloc(1, sizeof(struct history_job_s));
+        CRM_ASSERT(job != NULL);
+        job->lrm_rsc_list = lrm_rsc;
+        jobs = g_list_prepend(jobs, job);
+        num_jobs++;
+        g_thread_pool_push(pool, job, NULL);
+    }
+
+    // Wait for all jobs to complete
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    sorted_histories = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                             NULL,
+                                             (GDestroyNotify) g_list_free);
+
+    for (GListPtr gIter = jobs; gIter != NULL; gIter = gIter->next) {
+        struct history_job_s *job = gIter->data;
+        GListPtr hIter = job->histories;
+
+        for (GListPtr eIter = job->entries; eIter != NULL;
+             eIter = eIter->next, hIter = hIter->next) {
+            g_hash_table_insert(sorted_histories, eIter->data, hIter->data);
+        }
+        skipped += job->skipped;
+        g_list_free(job->entries);
+        g_list_free(job->histories);
+        free(job);
+    }
+    g_list_free(jobs);
+
+    crm_trace("Sorted resource histories of %d nodes using up to %d threads "
+              "(%d left to sort serially)", num_jobs, threads, skipped);
+}
+#endif
+
+/* lrm_resource entry IDs whose history should be unpacked (only set while
+ * unpack_status() runs for a working set with a history filter)
+ */
+static GHashTable *history_ids = NULL;
+
+static void
+add_history_ids(pe_resource_t *rsc)
+{
+    char *id = strdup(rsc->id);
+
+    // Anonymous clone instances are recorded under their base name
+    g_hash_table_replace(history_ids, id, id);
+    id = clone_strip(rsc->id);
+    g_hash_table_replace(history_ids, id, id);
+
+    for (GListPtr gIter = rsc->children; gIter != NULL; gIter = gIter->next) {
+        add_history_ids((pe_resource_t *) gIter->data);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Expand a working set's history filter into history entry IDs
+ *
+ * \param[in] data_set  Working set with resources unpacked
+ */
+static void
+build_history_ids(pe_working_set_t *data_set)
+{
+    GHashTableIter iter;
+    gpointer key = NULL;
+
+    history_ids = g_hash_table_new_full(crm_str_hash, g_str_equal, free, NULL);
+
+    g_hash_table_iter_init(&iter, data_set->history_filter);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        pe_resource_t *rsc = pe_find_resource_with_flags(data_set->resources,
+                                                         (const char *) key,
+                                                         pe_find_renamed|pe_find_any);
+
+        if (rsc != NULL) {
+            add_history_ids(rsc);
+        }
+    }
+
+    /* Whether Pacemaker Remote nodes are online (and so whether their
+     * histories are trusted) depends on their connections and containers
+     */
+    for (GListPtr gIter = data_set->resources; gIter; gIter = gIter->next) {
+        pe_resource_t *rsc = gIter->data;
+
+        if (rsc->is_remote_node) {
+            add_history_ids(rsc);
+            if (rsc->container != NULL) {
+                add_history_ids(rsc->container);
+            }
+        }
+    }
+}
+
 static bool
 unpack_node_loop(xmlNode * status, bool fence, pe_working_set_t * data_set) 
 {
@@ -968,7 +1155,7 @@ unpack_node_loop(xmlNode * status, bool fence, pe_working_set_t * data_set)
         node_t *this_node = NULL;
         bool process = FALSE;
 
-        if (crm_str_eq((const char *)state->name, XML_CIB_TAG_STATE, TRUE) == FALSE) {
+        if (!pcmk__xml_name_eq(state, node_state_name, XML_CIB_TAG_STATE)) {
             continue;
         }
 
@@ -1056,6 +1243,12 @@ unpack_status(xmlNode * status, pe_working_set_t * data_set)
 
     crm_trace("Beginning unpack");
 
+    if (rsc_op_name == NULL) {
+        node_state_name = pcmk__xml_intern(XML_CIB_TAG_STATE);
+        lrm_resource_name = pcmk__xml_intern(XML_LRM_TAG_RESOURCE);
+        rsc_op_name = pcmk__xml_intern(XML_LRM_TAG_RSC_OP);
+    }
+
     if (data_set->tickets == NULL) {
         data_set->tickets = g_hash_table_new_full(crm_str_hash, g_str_equal,
                                                   free, destroy_ticket);
@@ -1065,7 +1258,7 @@ unpack_status(xmlNode * status, pe_working_set_t * data_set)
         if (crm_str_eq((const char *)state->name, XML_CIB_TAG_TICKETS, TRUE)) {
             unpack_tickets_state((xmlNode *) state, data_set);
 
-        } else if (crm_str_eq((const char *)state->name, XML_CIB_TAG_STATE, TRUE)) {
+        } else if (pcmk__xml_name_eq(state, node_state_name, XML_CIB_TAG_STATE)) {
             xmlNode *attrs = NULL;
             const char *resource_discovery_enabled = NULL;
 
@@ -1132,6 +1325,26 @@ unpack_status(xmlNode * status, pe_working_set_t * data_set)
     }
 
 
+    if (is_set(data_set->flags, pe_flag_no_history)) {
+        crm_trace("Skipping resource operation history");
+        goto done;
+    }
+
+    if (data_set->history_filter != NULL) {
+        build_history_ids(data_set);
+    }
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    {
+        int threads = crm_parse_int(pe_pref(data_set->config_hash,
+                                            "unpack-threads"), "0");
+
+        if (threads > 1) {
+            presort_histories(status, threads);
+        }
+    }
+#endif
+
     while(unpack_node_loop(status, FALSE, data_set)) {
         crm_trace("Start another loop");
     }
@@ -1139,6 +1352,16 @@ unpack_status(xmlNode * status, pe_working_set_t * data_set)
     // Now catch any nodes we didn't see
     unpack_node_loop(status, is_set(data_set->flags, pe_flag_stonith_enabled), data_set);
 
+    if (sorted_histories != NULL) {
+        g_hash_table_destroy(sorted_histories);
+        sorted_histories = NULL;
+    }
+    if (history_ids != NULL) {
+        g_hash_table_destroy(history_ids);
+        history_ids = NULL;
+    }
+
+done:
     for (GListPtr gIter = data_set->nodes; gIter != NULL; gIter = gIter->next) {
         node_t *this_node = gIter->data;
 
@@ -1553,6 +1776,7 @@ create_fake_resource(const char *rsc_id, xmlNode * rsc_entry, pe_working_set_t *
     }
     set_bit(rsc->flags, pe_rsc_orphan);
     data_set->resources = g_list_append(data_set->resources, rsc);
+    pe__index_resource(data_set, rsc);
     return rsc;
 }
 
@@ -1762,6 +1986,7 @@ unpack_find_resource(pe_working_set_t * data_set, node_t * node, const char *rsc
 
         free(rsc->clone_name);
         rsc->clone_name = strdup(rsc_id);
+        pe__index_resource_name(data_set, rsc);
         pe_rsc_debug(rsc, "Internally renamed %s on %s to %s%s",
                      rsc_id, node->details->uname, rsc->id,
                      (is_set(rsc->flags, pe_rsc_orphan)? " (ORPHAN)" : ""));
@@ -2134,7 +2359,6 @@ unpack_lrm_rsc_state(node_t * node, xmlNode * rsc_entry, pe_working_set_t * data
     GListPtr sorted_op_list = NULL;
 
     xmlNode *migrate_op = NULL;
-    xmlNode *rsc_op = NULL;
     xmlNode *last_failure = NULL;
 
     enum action_fail_response on_fail = FALSE;
@@ -2147,10 +2371,14 @@ unpack_lrm_rsc_state(node_t * node, xmlNode * rsc_entry, pe_working_set_t * data
     op_list = NULL;
     sorted_op_list = NULL;
 
-    for (rsc_op = __xml_first_child(rsc_entry); rsc_op != NULL; rsc_op = __xml_next_element(rsc_op)) {
-        if (crm_str_eq((const char *)rsc_op->name, XML_LRM_TAG_RSC_OP, TRUE)) {
-            op_list = g_list_prepend(op_list, rsc_op);
-        }
+    if ((sorted_histories != NULL)
+        && g_hash_table_lookup_extended(sorted_histories, rsc_entry, NULL,
+                                        (gpointer *) &sorted_op_list)) {
+        g_hash_table_steal(sorted_histories, rsc_entry);
+        op_list = sorted_op_list;
+
+    } else {
+        op_list = extract_rsc_ops(rsc_entry);
     }
 
     if (op_list == NULL) {
@@ -2169,7 +2397,9 @@ unpack_lrm_rsc_state(node_t * node, xmlNode * rsc_entry, pe_working_set_t * data
     saved_role = rsc->role;
     on_fail = action_fail_ignore;
     rsc->role = RSC_ROLE_UNKNOWN;
-    sorted_op_list = g_list_sort(op_list, sort_op_by_callid);
+    if (sorted_op_list == NULL) {
+        sorted_op_list = pe__sort_ops_by_callid(op_list);
+    }
 
     for (gIter = sorted_op_list; gIter != NULL; gIter = gIter->next) {
         xmlNode *rsc_op = (xmlNode *) gIter->data;
@@ -2224,7 +2454,7 @@ handle_orphaned_container_fillers(xmlNode * lrm_rsc_list, pe_working_set_t * dat
         const char *rsc_id;
         const char *container_id;
 
-        if (safe_str_neq((const char *)rsc_entry->name, XML_LRM_TAG_RESOURCE)) {
+        if (!pcmk__xml_name_eq(rsc_entry, lrm_resource_name, XML_LRM_TAG_RESOURCE)) {
             continue;
         }
 
@@ -2265,8 +2495,18 @@ unpack_lrm_resources(node_t * node, xmlNode * lrm_rsc_list, pe_working_set_t * d
     for (rsc_entry = __xml_first_child(lrm_rsc_list); rsc_entry != NULL;
          rsc_entry = __xml_next_element(rsc_entry)) {
 
-        if (crm_str_eq((const char *)rsc_entry->name, XML_LRM_TAG_RESOURCE, TRUE)) {
-            resource_t *rsc = unpack_lrm_rsc_state(node, rsc_entry, data_set);
+        if (pcmk__xml_name_eq(rsc_entry, lrm_resource_name, XML_LRM_TAG_RESOURCE)) {
+            resource_t *rsc = NULL;
+
+            if ((history_ids != NULL)
+                && ((ID(rsc_entry) == NULL)
+                    || !g_hash_table_lookup_extended(history_ids,
+                                                     ID(rsc_entry), NULL,
+                                                     NULL))) {
+                continue;
+            }
+
+            rsc = unpack_lrm_rsc_state(node, rsc_entry, data_set);
             if (!rsc) {
                 continue;
             }
@@ -2568,6 +2808,7 @@ unpack_rsc_op_failure(resource_t * rsc, node_t * node, int rc, xmlNode * xml_op,
     guint interval_ms = 0;
     bool is_probe = FALSE;
     action_t *action = NULL;
+    pe__op_history_t history;
 
     const char *key = get_op_key(xml_op);
     const char *task = crm_element_value(xml_op, XML_LRM_ATTR_TASK);
@@ -2576,7 +2817,8 @@ unpack_rsc_op_failure(resource_t * rsc, node_t * node, int rc, xmlNode * xml_op,
 
     *last_failure = xml_op;
 
-    crm_element_value_ms(xml_op, XML_LRM_ATTR_INTERVAL_MS, &interval_ms);
+    pe__op_history(xml_op, &history);
+    interval_ms = history.interval_ms;
     if ((interval_ms == 0) && safe_str_eq(task, CRMD_ACTION_STATUS)) {
         is_probe = TRUE;
         pe_rsc_trace(rsc, "is a probe: %s", key);
@@ -2698,6 +2940,7 @@ determine_op_status(
 {
     guint interval_ms = 0;
     int result = PCMK_LRM_OP_DONE;
+    pe__op_history_t history;
 
     const char *key = get_op_key(xml_op);
     const char *task = crm_element_value(xml_op, XML_LRM_ATTR_TASK);
@@ -2705,7 +2948,8 @@ determine_op_status(
     bool is_probe = FALSE;
 
     CRM_ASSERT(rsc);
-    crm_element_value_ms(xml_op, XML_LRM_ATTR_INTERVAL_MS, &interval_ms);
+    pe__op_history(xml_op, &history);
+    interval_ms = history.interval_ms;
     if ((interval_ms == 0) && safe_str_eq(task, CRMD_ACTION_STATUS)) {
         is_probe = TRUE;
     }
@@ -2805,11 +3049,13 @@ static bool check_operation_expiry(resource_t *rsc, node_t *node, int rc, xmlNod
     time_t last_failure = 0;
     guint interval_ms = 0;
     int failure_timeout = rsc->failure_timeout;
+    pe__op_history_t history;
     const char *key = get_op_key(xml_op);
     const char *task = crm_element_value(xml_op, XML_LRM_ATTR_TASK);
     const char *clear_reason = NULL;
 
-    crm_element_value_ms(xml_op, XML_LRM_ATTR_INTERVAL_MS, &interval_ms);
+    pe__op_history(xml_op, &history);
+    interval_ms = history.interval_ms;
 
     /* clearing recurring monitor operation failures automatically
      * needs to be carefully considered */
@@ -2840,9 +3086,9 @@ static bool check_operation_expiry(resource_t *rsc, node_t *node, int rc, xmlNod
     }
 
     if (failure_timeout > 0) {
-        int last_run = 0;
+        int last_run = history.last_change;
 
-        if (crm_element_value_int(xml_op, XML_RSC_OP_LAST_CHANGE, &last_run) == 0) {
+        if (last_run >= 0) {
             time_t now = get_effective_time(data_set);
 
             if (now > (last_run + failure_timeout)) {
@@ -2908,7 +3154,7 @@ static bool check_operation_expiry(resource_t *rsc, node_t *node, int rc, xmlNod
             action_t *fence = pe_fence_op(remote_node, NULL, TRUE, NULL, data_set);
             crm_notice("Waiting for %s to complete before clearing %s failure for remote node %s", fence?fence->uuid:"nil", task, rsc->id);
 
-            order_actions(fence, clear_op, pe_order_implies_then);
+            order_actions(fence, clear_op, pe_order_implies_then, data_set);
         }
     }
 
@@ -2930,18 +3176,10 @@ static bool check_operation_expiry(resource_t *rsc, node_t *node, int rc, xmlNod
 
 int get_target_rc(xmlNode *xml_op)
 {
-    int dummy = 0;
-    int target_rc = 0;
-    char *dummy_string = NULL;
-    const char *key = crm_element_value(xml_op, XML_ATTR_TRANSITION_KEY);
-    if (key == NULL) {
-        return -1;
-    }
-
-    decode_transition_key(key, &dummy_string, &dummy, &dummy, &target_rc);
-    free(dummy_string);
+    pe__op_history_t history;
 
-    return target_rc;
+    pe__op_history(xml_op, &history);
+    return history.target_rc;
 }
 
 static enum action_fail_response
@@ -3060,8 +3298,9 @@ unpack_rsc_op(resource_t * rsc, node_t * node, xmlNode * xml_op, xmlNode ** last
 
     int rc = 0;
     int status = PCMK_LRM_OP_UNKNOWN;
-    int target_rc = get_target_rc(xml_op);
+    int target_rc = 0;
     guint interval_ms = 0;
+    pe__op_history_t history;
 
     gboolean expired = FALSE;
     resource_t *parent = rsc;
@@ -3076,10 +3315,12 @@ unpack_rsc_op(resource_t * rsc, node_t * node, xmlNode * xml_op, xmlNode ** last
     task = crm_element_value(xml_op, XML_LRM_ATTR_TASK);
     key = crm_element_value(xml_op, XML_ATTR_TRANSITION_KEY);
 
-    crm_element_value_int(xml_op, XML_LRM_ATTR_RC, &rc);
-    crm_element_value_int(xml_op, XML_LRM_ATTR_CALLID, &task_id);
-    crm_element_value_int(xml_op, XML_LRM_ATTR_OPSTATUS, &status);
-    crm_element_value_ms(xml_op, XML_LRM_ATTR_INTERVAL_MS, &interval_ms);
+    pe__op_history(xml_op, &history);
+    rc = history.rc;
+    task_id = history.call_id;
+    status = history.status;
+    interval_ms = history.interval_ms;
+    target_rc = history.target_rc;
 
     CRM_CHECK(task != NULL, return FALSE);
     CRM_CHECK(status <= PCMK_LRM_OP_NOT_INSTALLED, return FALSE);
@@ -3332,7 +3573,7 @@ extract_operations(const char *node, const char *rsc, xmlNode * rsc_entry, gbool
     sorted_op_list = NULL;
 
     for (rsc_op = __xml_first_child(rsc_entry); rsc_op != NULL; rsc_op = __xml_next_element(rsc_op)) {
-        if (crm_str_eq((const char *)rsc_op->name, XML_LRM_TAG_RSC_OP, TRUE)) {
+        if (pcmk__xml_name_eq(rsc_op, rsc_op_name, XML_LRM_TAG_RSC_OP)) {
             crm_xml_add(rsc_op, "resource", rsc);
             crm_xml_add(rsc_op, XML_ATTR_UNAME, node);
             op_list = g_list_prepend(op_list, rsc_op);
@@ -3344,7 +3585,7 @@ extract_operations(const char *node, const char *rsc, xmlNode * rsc_entry, gbool
         return NULL;
     }
 
-    sorted_op_list = g_list_sort(op_list, sort_op_by_callid);
+    sorted_op_list = pe__sort_ops_by_callid(op_list);
 
     /* create active recurring operations as optional */
     if (active_filter == FALSE) {
@@ -3392,7 +3633,7 @@ find_operations(const char *rsc, const char *node, gboolean active_filter,
     for (node_state = __xml_first_child(status); node_state != NULL;
          node_state = __xml_next_element(node_state)) {
 
-        if (crm_str_eq((const char *)node_state->name, XML_CIB_TAG_STATE, TRUE)) {
+        if (pcmk__xml_name_eq(node_state, node_state_name, XML_CIB_TAG_STATE)) {
             const char *uname = crm_element_value(node_state, XML_ATTR_UNAME);
 
             if (node != NULL && safe_str_neq(uname, node)) {
@@ -3423,7 +3664,7 @@ find_operations(const char *rsc, const char *node, gboolean active_filter,
 
                 for (lrm_rsc = __xml_first_child(tmp); lrm_rsc != NULL;
                      lrm_rsc = __xml_next_element(lrm_rsc)) {
-                    if (crm_str_eq((const char *)lrm_rsc->name, XML_LRM_TAG_RESOURCE, TRUE)) {
+                    if (pcmk__xml_name_eq(lrm_rsc, lrm_resource_name, XML_LRM_TAG_RESOURCE)) {
 
                         const char *rsc_id = crm_element_value(lrm_rsc, XML_ATTR_ID);
 
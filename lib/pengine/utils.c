@@ -10,7 +10,9 @@
 #include <crm/msg_xml.h>
 #include <crm/common/xml.h>
 #include <crm/common/util.h>
+#include <crm/common/internal.h>
 
+#include <ctype.h>
 #include <glib.h>
 
 #include <crm/pengine/rules.h>
@@ -419,6 +421,13 @@ custom_action(resource_t * rsc, char *key, const char *task,
         data_set->singletons = g_hash_table_new_full(crm_str_hash, g_str_equal, NULL, NULL);
     }
 
+    if (data_set->action_index == NULL) {
+        /* Case-insensitive, since keys are compared with safe_str_eq() */
+        data_set->action_index = g_hash_table_new_full(crm_strcase_hash,
+                                                       crm_strcase_equal, NULL,
+                                                       (GDestroyNotify) g_list_free);
+    }
+
     if (possible_matches != NULL) {
         if (g_list_length(possible_matches) > 1) {
             pe_warn("Action %s for %s on %s exists %d times",
@@ -468,6 +477,14 @@ custom_action(resource_t * rsc, char *key, const char *task,
         action->meta = crm_str_table_new();
 
         if (save_action) {
+            GListPtr same_key = g_hash_table_lookup(data_set->action_index,
+                                                    action->uuid);
+
+            /* Keep the index in the same (newest first) order as the lists */
+            g_hash_table_steal(data_set->action_index, action->uuid);
+            g_hash_table_insert(data_set->action_index, action->uuid,
+                                g_list_prepend(same_key, action));
+
             data_set->actions = g_list_prepend(data_set->actions, action);
             if(rsc == NULL) {
                 g_hash_table_insert(data_set->singletons, action->uuid, action);
@@ -1141,7 +1158,6 @@ find_rsc_op_entry_helper(resource_t * rsc, const char *key, gboolean include_dis
     char *local_key = NULL;
     const char *name = NULL;
     const char *value = NULL;
-    const char *interval_spec = NULL;
     char *match_key = NULL;
     xmlNode *op = NULL;
     xmlNode *operation = NULL;
@@ -1151,13 +1167,12 @@ find_rsc_op_entry_helper(resource_t * rsc, const char *key, gboolean include_dis
          operation = __xml_next_element(operation)) {
         if (crm_str_eq((const char *)operation->name, "op", TRUE)) {
             name = crm_element_value(operation, "name");
-            interval_spec = crm_element_value(operation, XML_LRM_ATTR_INTERVAL);
             value = crm_element_value(operation, "enabled");
             if (!include_disabled && value && crm_is_true(value) == FALSE) {
                 continue;
             }
 
-            interval_ms = crm_parse_interval_spec(interval_spec);
+            interval_ms = pe__op_interval_ms(operation);
             match_key = generate_op_key(rsc->id, name, interval_ms);
             if (safe_str_eq(key, match_key)) {
                 op = operation;
@@ -1350,17 +1365,73 @@ get_complex_task(resource_t * rsc, const char *name, gboolean allow_non_atomic)
     return task;
 }
 
+/*!
+ * \internal
+ * \brief Get the actions that a search of a list could possibly match
+ *
+ * Every action saved in the working set is indexed by its key, in the same
+ * (newest first) order as the working set's action list and each resource's
+ * action list. Searches of either kind of list only need to look at the
+ * indexed actions with the right key.
+ *
+ * \param[in]  input   List of actions being searched
+ * \param[in]  key     Action key being searched for
+ * \param[out] filter  Where to store resource that matches must belong to
+ *
+ * \return Indexed actions with \p key if \p input is an indexed list,
+ *         otherwise \p input itself
+ */
+static GListPtr
+action_candidates(GListPtr input, const char *key, resource_t **filter)
+{
+    action_t *first = NULL;
+    GListPtr same_key = NULL;
+
+    *filter = NULL;
+    if ((key == NULL) || (input == NULL) || (pe_dataset == NULL)
+        || (pe_dataset->action_index == NULL)) {
+        return input;
+    }
+
+    if (input == pe_dataset->actions) {
+        return g_hash_table_lookup(pe_dataset->action_index, key);
+    }
+
+    /* Only custom_action() adds to resource action lists, so a list is a
+     * resource's own if it is the list of its first action's resource (and
+     * that action belongs to this working set)
+     */
+    first = (action_t *) input->data;
+    if ((first == NULL) || (first->rsc == NULL)
+        || (input != first->rsc->actions)) {
+        return input;
+    }
+
+    same_key = g_hash_table_lookup(pe_dataset->action_index, first->uuid);
+    if (g_list_find(same_key, first) == NULL) {
+        return input;
+    }
+
+    *filter = first->rsc;
+    return g_hash_table_lookup(pe_dataset->action_index, key);
+}
+
 action_t *
 find_first_action(GListPtr input, const char *uuid, const char *task, node_t * on_node)
 {
     GListPtr gIter = NULL;
+    resource_t *filter = NULL;
 
     CRM_CHECK(uuid || task, return NULL);
 
-    for (gIter = input; gIter != NULL; gIter = gIter->next) {
+    for (gIter = action_candidates(input, uuid, &filter); gIter != NULL;
+         gIter = gIter->next) {
         action_t *action = (action_t *) gIter->data;
 
-        if (uuid != NULL && safe_str_neq(uuid, action->uuid)) {
+        if ((filter != NULL) && (action->rsc != filter)) {
+            continue;
+
+        } else if (uuid != NULL && safe_str_neq(uuid, action->uuid)) {
             continue;
 
         } else if (task != NULL && safe_str_neq(task, action->task)) {
@@ -1383,15 +1454,20 @@ find_first_action(GListPtr input, const char *uuid, const char *task, node_t * o
 GListPtr
 find_actions(GListPtr input, const char *key, const node_t *on_node)
 {
-    GListPtr gIter = input;
+    GListPtr gIter = NULL;
     GListPtr result = NULL;
+    resource_t *filter = NULL;
 
     CRM_CHECK(key != NULL, return NULL);
 
-    for (; gIter != NULL; gIter = gIter->next) {
+    for (gIter = action_candidates(input, key, &filter); gIter != NULL;
+         gIter = gIter->next) {
         action_t *action = (action_t *) gIter->data;
 
-        if (safe_str_neq(key, action->uuid)) {
+        if ((filter != NULL) && (action->rsc != filter)) {
+            continue;
+
+        } else if (safe_str_neq(key, action->uuid)) {
             crm_trace("%s does not match action %s", key, action->uuid);
             continue;
 
@@ -1423,14 +1499,20 @@ find_actions(GListPtr input, const char *key, const node_t *on_node)
 GListPtr
 find_actions_exact(GListPtr input, const char *key, node_t * on_node)
 {
-    GListPtr gIter = input;
+    GListPtr gIter = NULL;
     GListPtr result = NULL;
+    resource_t *filter = NULL;
 
     CRM_CHECK(key != NULL, return NULL);
 
-    for (; gIter != NULL; gIter = gIter->next) {
+    for (gIter = action_candidates(input, key, &filter); gIter != NULL;
+         gIter = gIter->next) {
         action_t *action = (action_t *) gIter->data;
 
+        if ((filter != NULL) && (action->rsc != filter)) {
+            continue;
+        }
+
         crm_trace("Matching %s against %s", key, action->uuid);
         if (safe_str_neq(key, action->uuid)) {
             crm_trace("Key mismatch: %s vs. %s", key, action->uuid);
@@ -1516,93 +1598,401 @@ resource_location(resource_t * rsc, node_t * node, int score, const char *tag,
     }
 }
 
-#define sort_return(an_int, why) do {					\
-	free(a_uuid);						\
-	free(b_uuid);						\
-	crm_trace("%s (%d) %c %s (%d) : %s",				\
-		  a_xml_id, a_call_id, an_int>0?'>':an_int<0?'<':'=',	\
-		  b_xml_id, b_call_id, why);				\
-	return an_int;							\
-    } while(0)
+// Get the value of a lower-case hexadecimal digit (or -1 if it isn't one)
+static int
+hex_value(char c)
+{
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    } else if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
 
-gint
-sort_op_by_callid(gconstpointer a, gconstpointer b)
+/*!
+ * \internal
+ * \brief Pack a hexadecimal digest (such as an MD5 sum) into binary
+ *
+ * \param[in]  text  Text to pack
+ * \param[out] out   Where to store packed value
+ *
+ * \return true if \p text is exactly 2 * PE__OP_PACKED_LEN lower-case
+ *         hexadecimal digits, otherwise false
+ * \note Only text in the form digests are generated in is packed, so two packed
+ *       values are equal exactly when their text is. Anything else must be
+ *       compared as text.
+ */
+static bool
+pack_hex(const char *text, uint8_t *out)
 {
-    int a_call_id = -1;
-    int b_call_id = -1;
+    if (text == NULL) {
+        return FALSE;
+    }
+    for (int lpc = 0; lpc < 2 * PE__OP_PACKED_LEN; lpc++) {
+        int value = hex_value(text[lpc]);
 
-    char *a_uuid = NULL;
-    char *b_uuid = NULL;
+        if (value < 0) {
+            return FALSE;
+        }
+        if ((lpc % 2) == 0) {
+            out[lpc / 2] = value << 4;
+        } else {
+            out[lpc / 2] |= value;
+        }
+    }
+    return (text[2 * PE__OP_PACKED_LEN] == '\0');
+}
 
-    const xmlNode *xml_a = a;
-    const xmlNode *xml_b = b;
+/*!
+ * \internal
+ * \brief Pack a UUID into binary
+ *
+ * \param[in]  text  Text to pack
+ * \param[out] out   Where to store packed value
+ *
+ * \return true if \p text is a lower-case UUID in the usual 8-4-4-4-12 form
+ *         with nothing after it, otherwise false
+ * \note As with pack_hex(), anything not packed must be compared as text.
+ */
+static bool
+pack_uuid(const char *text, uint8_t *out)
+{
+    char digits[2 * PE__OP_PACKED_LEN + 1];
+    int len = 0;
 
-    const char *a_xml_id = crm_element_value(xml_a, XML_ATTR_ID);
-    const char *b_xml_id = crm_element_value(xml_b, XML_ATTR_ID);
+    if ((text == NULL) || (strlen(text) != 36)) {
+        return FALSE;
+    }
+    for (int lpc = 0; lpc < 36; lpc++) {
+        if ((lpc == 8) || (lpc == 13) || (lpc == 18) || (lpc == 23)) {
+            if (text[lpc] != '-') {
+                return FALSE;
+            }
+        } else {
+            digits[len++] = text[lpc];
+        }
+    }
+    digits[len] = '\0';
+    return pack_hex(digits, out);
+}
 
-    if (safe_str_eq(a_xml_id, b_xml_id)) {
-        /* We have duplicate lrm_rsc_op entries in the status
-         *    section which is unliklely to be a good thing
-         *    - we can handle it easily enough, but we need to get
-         *    to the bottom of why it's happening.
-         */
-        pe_err("Duplicate lrm_rsc_op entries named %s", a_xml_id);
-        sort_return(0, "duplicate");
+/* Parse a transition key ("action:transition:target-rc:uuid") without copying
+ * it, returning the UUID part (or NULL if the key is invalid). Like
+ * decode_transition_key(), this allows whitespace before the UUID.
+ */
+static const char *
+parse_transition_key(const char *key, int *transition_id, int *target_rc)
+{
+    int action_id = 0;
+    int offset = 0;
+
+    if ((key == NULL)
+        || (sscanf(key, "%d:%d:%d:%n", &action_id, transition_id, target_rc,
+                   &offset) != 3)
+        || (offset == 0)) {
+        return NULL;
+    }
+    while (isspace(key[offset])) {
+        offset++;
+    }
+    return (key[offset] == '\0')? NULL : (key + offset);
+}
+
+// Get the UUID part of a transition magic string (or NULL if it is invalid)
+static const char *
+parse_transition_magic(const char *magic, int *transition_id)
+{
+    int op_status = 0;
+    int op_rc = 0;
+    int target_rc = 0;
+    int offset = 0;
+
+    if ((magic == NULL)
+        || (sscanf(magic, "%d:%d;%n", &op_status, &op_rc, &offset) != 2)
+        || (offset == 0)) {
+        return NULL;
+    }
+    return parse_transition_key(magic + offset, transition_id, &target_rc);
+}
+
+// Parse an operation history entry's attributes
+static void
+parse_op_history(xmlNode *xml_op, pe__op_history_t *history)
+{
+    const char *uuid = NULL;
+    int dummy = 0;
+
+    memset(history, 0, sizeof(pe__op_history_t));
+    history->call_id = -1;
+    history->status = PCMK_LRM_OP_UNKNOWN;
+    history->last_change = -1;
+    history->target_rc = -1;
+    history->transition_id = -1;
+
+    crm_element_value_int(xml_op, XML_LRM_ATTR_CALLID, &history->call_id);
+    crm_element_value_int(xml_op, XML_LRM_ATTR_RC, &history->rc);
+    crm_element_value_int(xml_op, XML_LRM_ATTR_OPSTATUS, &history->status);
+    crm_element_value_ms(xml_op, XML_LRM_ATTR_INTERVAL_MS,
+                         &history->interval_ms);
+    crm_element_value_int(xml_op, XML_RSC_OP_LAST_CHANGE,
+                          &history->last_change);
+
+    if (parse_transition_key(crm_element_value(xml_op, XML_ATTR_TRANSITION_KEY),
+                             &dummy, &history->target_rc) == NULL) {
+        history->target_rc = -1;
+    }
+
+    uuid = parse_transition_magic(crm_element_value(xml_op,
+                                                    XML_ATTR_TRANSITION_MAGIC),
+                                  &history->transition_id);
+    if (uuid == NULL) {
+        history->transition_id = -1;
+    } else {
+        set_bit(history->flags, pe__op_magic_valid);
+        if (pack_uuid(uuid, history->transition_uuid)) {
+            set_bit(history->flags, pe__op_uuid_packed);
+        }
+    }
+
+    if (pack_hex(crm_element_value(xml_op, XML_LRM_ATTR_OP_DIGEST),
+                 history->op_digest)) {
+        set_bit(history->flags, pe__op_digest_packed);
+    }
+    if (pack_hex(crm_element_value(xml_op, XML_LRM_ATTR_RESTART_DIGEST),
+                 history->restart_digest)) {
+        set_bit(history->flags, pe__op_restart_packed);
+    }
+    if (pack_hex(crm_element_value(xml_op, XML_LRM_ATTR_SECURE_DIGEST),
+                 history->secure_digest)) {
+        set_bit(history->flags, pe__op_secure_packed);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Get the values of an operation history entry's attributes
+ *
+ * \param[in]  xml_op   Operation history entry (lrm_rsc_op)
+ * \param[out] history  Where to store values parsed from \p xml_op
+ *
+ * \note The entry is parsed only the first time this is called for it, or the
+ *       first time after one of its attributes has changed, and the result is
+ *       kept with \p xml_op (if possible) and copied into \p history. This may
+ *       be called from any thread, as long as no other thread is using the
+ *       same entry.
+ */
+void
+pe__op_history(xmlNode *xml_op, pe__op_history_t *history)
+{
+    const pe__op_history_t *cached = pcmk__xml_parsed(xml_op);
+    pe__op_history_t *copy = NULL;
+
+    if (cached != NULL) {
+        *history = *cached;
+        return;
+    }
+
+    parse_op_history(xml_op, history);
+
+    // Keep a copy with the entry, unless it can't hold one
+    copy = malloc(sizeof(pe__op_history_t));
+    if (copy != NULL) {
+        *copy = *history;
+        if (!pcmk__xml_set_parsed(xml_op, copy, free)) {
+            free(copy);
+        }
+    }
+}
+
+/*!
+ * \internal
+ * \brief Check whether an operation history entry has a given digest
+ *
+ * \param[in] xml_op  Operation history entry (lrm_rsc_op)
+ * \param[in] attr    Name of digest attribute to check
+ * \param[in] digest  Digest (as text) to compare with
+ *
+ * \return true if \p xml_op's \p attr is \p digest, otherwise false
+ */
+bool
+pe__op_digest_eq(xmlNode *xml_op, const char *attr, const char *digest)
+{
+    pe__op_history_t history;
+    const uint8_t *packed = NULL;
+    uint8_t other[PE__OP_PACKED_LEN];
+
+    pe__op_history(xml_op, &history);
+
+    if (safe_str_eq(attr, XML_LRM_ATTR_OP_DIGEST)) {
+        if (is_set(history.flags, pe__op_digest_packed)) {
+            packed = history.op_digest;
+        }
+    } else if (safe_str_eq(attr, XML_LRM_ATTR_RESTART_DIGEST)) {
+        if (is_set(history.flags, pe__op_restart_packed)) {
+            packed = history.restart_digest;
+        }
+    } else if (safe_str_eq(attr, XML_LRM_ATTR_SECURE_DIGEST)) {
+        if (is_set(history.flags, pe__op_secure_packed)) {
+            packed = history.secure_digest;
+        }
+    }
+
+    if ((packed != NULL) && pack_hex(digest, other)) {
+        return memcmp(packed, other, PE__OP_PACKED_LEN) == 0;
     }
+    return safe_str_eq(crm_element_value(xml_op, attr), digest);
+}
 
-    crm_element_value_int(xml_a, XML_LRM_ATTR_CALLID, &a_call_id);
-    crm_element_value_int(xml_b, XML_LRM_ATTR_CALLID, &b_call_id);
+// Check whether two history entries' transition magic has the same UUID
+static bool
+same_transition_uuid(xmlNode *xml_a, const pe__op_history_t *history_a,
+                     xmlNode *xml_b, const pe__op_history_t *history_b)
+{
+    const char *uuid_a = NULL;
+    const char *uuid_b = NULL;
+    size_t len_a = 0;
+    size_t len_b = 0;
+    int dummy = 0;
+
+    if (is_set(history_a->flags, pe__op_uuid_packed)
+        && is_set(history_b->flags, pe__op_uuid_packed)) {
+        return memcmp(history_a->transition_uuid, history_b->transition_uuid,
+                      PE__OP_PACKED_LEN) == 0;
+    }
+
+    /* At least one is not a well-formed UUID (which should never happen), so
+     * compare the text the way decode_transition_key() would have read it
+     */
+    uuid_a = parse_transition_magic(crm_element_value(xml_a,
+                                                      XML_ATTR_TRANSITION_MAGIC),
+                                    &dummy);
+    uuid_b = parse_transition_magic(crm_element_value(xml_b,
+                                                      XML_ATTR_TRANSITION_MAGIC),
+                                    &dummy);
+    if ((uuid_a == NULL) || (uuid_b == NULL)) {
+        return (uuid_a == uuid_b);
+    }
+    while ((uuid_a[len_a] != '\0') && !isspace(uuid_a[len_a]) && (len_a < 36)) {
+        len_a++;
+    }
+    while ((uuid_b[len_b] != '\0') && !isspace(uuid_b[len_b]) && (len_b < 36)) {
+        len_b++;
+    }
+    return (len_a == len_b) && (strncmp(uuid_a, uuid_b, len_a) == 0);
+}
+
+/*!
+ * \internal
+ * \brief Get the interval of a configured operation
+ *
+ * \param[in] op  Operation definition (op)
+ *
+ * \return Interval of \p op in milliseconds (parsed only once per definition)
+ */
+guint
+pe__op_interval_ms(xmlNode *op)
+{
+    guint *interval_ms = pcmk__xml_parsed(op);
+
+    if (interval_ms == NULL) {
+        guint parsed = crm_parse_interval_spec(crm_element_value(op,
+                                                                 XML_LRM_ATTR_INTERVAL));
+
+        interval_ms = malloc(sizeof(guint));
+        if ((interval_ms == NULL)
+            || !pcmk__xml_set_parsed(op, interval_ms, free)) {
+            free(interval_ms);
+            return parsed;
+        }
+        *interval_ms = parsed;
+    }
+    return *interval_ms;
+}
+
+/*!
+ * \internal
+ * \brief Order two operation history entries by call ID, without logging
+ *
+ * \param[in]  xml_a  First operation history entry (lrm_rsc_op)
+ * \param[in]  xml_b  Second operation history entry (lrm_rsc_op)
+ * \param[out] why    Where to store the basis of the result
+ * \param[out] odd    Where to store whether the entries could not be ordered
+ *                    as they should (which should never happen)
+ *
+ * \return As for sort_op_by_callid()
+ * \note The entries must have different IDs.
+ */
+static int
+order_ops_by_callid(xmlNode *xml_a, xmlNode *xml_b, const char **why,
+                    bool *odd)
+{
+    int a_call_id = -1;
+    int b_call_id = -1;
+    pe__op_history_t history_a;
+    pe__op_history_t history_b;
+
+    *odd = FALSE;
+
+    // Sorting compares each entry many times, so parse each only once
+    pe__op_history(xml_a, &history_a);
+    pe__op_history(xml_b, &history_b);
+    a_call_id = history_a.call_id;
+    b_call_id = history_b.call_id;
 
     if (a_call_id == -1 && b_call_id == -1) {
         /* both are pending ops so it doesn't matter since
          *   stops are never pending
          */
-        sort_return(0, "pending");
+        *why = "pending";
+        return 0;
 
     } else if (a_call_id >= 0 && a_call_id < b_call_id) {
-        sort_return(-1, "call id");
+        *why = "call id";
+        return -1;
 
     } else if (b_call_id >= 0 && a_call_id > b_call_id) {
-        sort_return(1, "call id");
+        *why = "call id";
+        return 1;
 
     } else if (b_call_id >= 0 && a_call_id == b_call_id) {
         /*
          * The op and last_failed_op are the same
          * Order on last-rc-change
          */
-        int last_a = -1;
-        int last_b = -1;
-
-        crm_element_value_int(xml_a, XML_RSC_OP_LAST_CHANGE, &last_a);
-        crm_element_value_int(xml_b, XML_RSC_OP_LAST_CHANGE, &last_b);
+        int last_a = history_a.last_change;
+        int last_b = history_b.last_change;
 
-        crm_trace("rc-change: %d vs %d", last_a, last_b);
+        *why = "rc-change";
         if (last_a >= 0 && last_a < last_b) {
-            sort_return(-1, "rc-change");
+            return -1;
 
         } else if (last_b >= 0 && last_a > last_b) {
-            sort_return(1, "rc-change");
+            return 1;
         }
-        sort_return(0, "rc-change");
+        return 0;
 
     } else {
         /* One of the inputs is a pending operation
          * Attempt to use XML_ATTR_TRANSITION_MAGIC to determine its age relative to the other
          */
 
-        int a_id = -1;
-        int b_id = -1;
-        int dummy = -1;
+        int a_id = history_a.transition_id;
+        int b_id = history_b.transition_id;
 
-        const char *a_magic = crm_element_value(xml_a, XML_ATTR_TRANSITION_MAGIC);
-        const char *b_magic = crm_element_value(xml_b, XML_ATTR_TRANSITION_MAGIC);
-
-        CRM_CHECK(a_magic != NULL && b_magic != NULL, sort_return(0, "No magic"));
-        if(!decode_transition_magic(a_magic, &a_uuid, &a_id, &dummy, &dummy, &dummy, &dummy)) {
-            sort_return(0, "bad magic a");
+        if ((crm_element_value(xml_a, XML_ATTR_TRANSITION_MAGIC) == NULL)
+            || (crm_element_value(xml_b, XML_ATTR_TRANSITION_MAGIC) == NULL)) {
+            *why = "No magic";
+            *odd = TRUE;
+            return 0;
+        }
+        if (is_not_set(history_a.flags, pe__op_magic_valid)) {
+            *why = "bad magic a";
+            return 0;
         }
-        if(!decode_transition_magic(b_magic, &b_uuid, &b_id, &dummy, &dummy, &dummy, &dummy)) {
-            sort_return(0, "bad magic b");
+        if (is_not_set(history_b.flags, pe__op_magic_valid)) {
+            *why = "bad magic b";
+            return 0;
         }
         /* try to determine the relative age of the operation...
          * some pending operations (e.g. a start) may have been superseded
@@ -1610,7 +2000,8 @@ sort_op_by_callid(gconstpointer a, gconstpointer b)
          *
          * [a|b]_id == -1 means it's a shutdown operation and _always_ comes last
          */
-        if (safe_str_neq(a_uuid, b_uuid) || a_id == b_id) {
+        if (!same_transition_uuid(xml_a, &history_a, xml_b, &history_b)
+            || a_id == b_id) {
             /*
              * some of the logic in here may be redundant...
              *
@@ -1620,24 +2011,160 @@ sort_op_by_callid(gconstpointer a, gconstpointer b)
              *   because we query the LRM directly
              */
 
+            *why = "transition + call";
             if (b_call_id == -1) {
-                sort_return(-1, "transition + call");
+                return -1;
 
             } else if (a_call_id == -1) {
-                sort_return(1, "transition + call");
+                return 1;
             }
 
         } else if ((a_id >= 0 && a_id < b_id) || b_id == -1) {
-            sort_return(-1, "transition");
+            *why = "transition";
+            return -1;
 
         } else if ((b_id >= 0 && a_id > b_id) || a_id == -1) {
-            sort_return(1, "transition");
+            *why = "transition";
+            return 1;
         }
     }
 
     /* we should never end up here */
-    CRM_CHECK(FALSE, sort_return(0, "default"));
+    *why = "default";
+    *odd = TRUE;
+    return 0;
+}
 
+gint
+sort_op_by_callid(gconstpointer a, gconstpointer b)
+{
+    xmlNode *xml_a = (xmlNode *) a;
+    xmlNode *xml_b = (xmlNode *) b;
+    const char *a_xml_id = crm_element_value(xml_a, XML_ATTR_ID);
+    const char *b_xml_id = crm_element_value(xml_b, XML_ATTR_ID);
+    const char *why = NULL;
+    bool odd = FALSE;
+    int rc = 0;
+
+    if (safe_str_eq(a_xml_id, b_xml_id)) {
+        /* We have duplicate lrm_rsc_op entries in the status
+         *    section which is unliklely to be a good thing
+         *    - we can handle it easily enough, but we need to get
+         *    to the bottom of why it's happening.
+         */
+        pe_err("Duplicate lrm_rsc_op entries named %s", a_xml_id);
+        why = "duplicate";
+
+    } else {
+        rc = order_ops_by_callid(xml_a, xml_b, &why, &odd);
+        CRM_LOG_ASSERT(!odd);
+    }
+
+    crm_trace("%s %c %s : %s",
+              a_xml_id, rc>0?'>':rc<0?'<':'=', b_xml_id, why);
+    return rc;
+}
+
+/*!
+ * \internal
+ * \brief Sort a list of operation history entries by call ID
+ *
+ * \param[in] ops  List of operation history entries (lrm_rsc_op)
+ *
+ * \return \p ops sorted with sort_op_by_callid()
+ * \note The controller writes history in order, and later results usually
+ *       come later in the CIB too, so the list is checked in one pass first
+ *       and sorted only if that finds an entry out of order.
+ */
+GList *
+pe__sort_ops_by_callid(GList *ops)
+{
+    for (GList *iter = ops; (iter != NULL) && (iter->next != NULL);
+         iter = iter->next) {
+
+        if (sort_op_by_callid(iter->data, iter->next->data) > 0) {
+            return g_list_sort(ops, sort_op_by_callid);
+        }
+    }
+    return ops;
+}
+
+// Whether an attribute is absent or an integer that parses without logging
+static bool
+quiet_int_attr(const xmlNode *xml, const char *name)
+{
+    const char *value = crm_element_value(xml, name);
+    size_t digits = 0;
+
+    if (value == NULL) {
+        return TRUE;
+    }
+    if (*value == '-') {
+        value++;
+    }
+    digits = strspn(value, "0123456789");
+    return (digits > 0) && (digits <= 9) && (value[digits] == '\0');
+}
+
+static gint
+sort_op_quietly(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    const char *why = NULL;
+    bool odd = FALSE;
+    int rc = order_ops_by_callid((xmlNode *) a, (xmlNode *) b, &why, &odd);
+
+    if (odd) {
+        *((bool *) user_data) = TRUE;
+    }
+    return rc;
+}
+
+/*!
+ * \internal
+ * \brief Sort operation history entries by call ID, if that needs no logging
+ *
+ * \param[in,out] ops  List of operation history entries (lrm_rsc_op)
+ *
+ * \return true if \p ops is now sorted as pe__sort_ops_by_callid() would
+ *         sort it, or false if pe__sort_ops_by_callid() would log a problem
+ *         with the entries (in which case \p ops may be in any order)
+ * \note This never logs, so it may be called from a worker thread, as long as
+ *       no other thread is using the same entries.
+ */
+bool
+pe__sort_ops_quietly(GList **ops)
+{
+    GHashTable *ids = g_hash_table_new(g_str_hash, g_str_equal);
+    bool odd = FALSE;
+
+    for (GList *iter = *ops; iter != NULL; iter = iter->next) {
+        xmlNode *xml_op = iter->data;
+        const char *id = crm_element_value(xml_op, XML_ATTR_ID);
+
+        // Leave anything unusual to be sorted (and logged) as usual
+        if ((id == NULL) || (g_hash_table_lookup(ids, id) != NULL)
+            || !quiet_int_attr(xml_op, XML_LRM_ATTR_CALLID)
+            || !quiet_int_attr(xml_op, XML_LRM_ATTR_RC)
+            || !quiet_int_attr(xml_op, XML_LRM_ATTR_OPSTATUS)
+            || !quiet_int_attr(xml_op, XML_LRM_ATTR_INTERVAL_MS)
+            || !quiet_int_attr(xml_op, XML_RSC_OP_LAST_CHANGE)) {
+            g_hash_table_destroy(ids);
+            return FALSE;
+        }
+        g_hash_table_insert(ids, (gpointer) id, (gpointer) id);
+    }
+    g_hash_table_destroy(ids);
+
+    // As with pe__sort_ops_by_callid(), sort only if something is out of order
+    for (GList *iter = *ops; (iter != NULL) && (iter->next != NULL);
+         iter = iter->next) {
+
+        if (sort_op_quietly(iter->data, iter->next->data, &odd) > 0) {
+            *ops = g_list_sort_with_data(*ops, sort_op_quietly, &odd);
+            break;
+        }
+    }
+    return !odd;
 }
 
 time_t
@@ -1691,12 +2218,170 @@ get_target_role(resource_t * rsc, enum rsc_role_e * role)
     return TRUE;
 }
 
+/* Working set objects that are never freed individually (such as ordering
+ * wrappers and constraints) are carved out of large blocks, so that a
+ * transition's worth of them costs a handful of allocations and is released
+ * all at once by cleanup_calculations().
+ */
+#define PE_ARENA_BLOCK_SIZE (64 * 1024)
+#define PE_ARENA_ALIGN      (2 * sizeof(void *))
+
+struct pe_arena_block_s {
+    struct pe_arena_block_s *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+struct pe_arena_s {
+    struct pe_arena_block_s *blocks;    // Most recently added first
+};
+
+/*!
+ * \internal
+ * \brief Allocate zeroed memory that lives as long as a working set
+ *
+ * \param[in] data_set  Working set that will own the memory
+ * \param[in] size      Number of bytes needed
+ *
+ * \return Pointer to newly allocated memory (never NULL)
+ * \note The result must not be passed to free(); it is released when
+ *       cleanup_calculations() calls pe__free_arena().
+ */
+void *
+pe__arena_alloc(pe_working_set_t *data_set, size_t size)
+{
+    struct pe_arena_block_s *block = NULL;
+    void *result = NULL;
+
+    size = (size + PE_ARENA_ALIGN - 1) & ~(PE_ARENA_ALIGN - 1);
+
+    if (data_set->arena == NULL) {
+        data_set->arena = calloc(1, sizeof(struct pe_arena_s));
+        CRM_ASSERT(data_set->arena != NULL);
+    }
+
+    block = data_set->arena->blocks;
+    if ((block == NULL) || (block->size - block->used < size)) {
+        size_t block_size = QB_MAX(size, PE_ARENA_BLOCK_SIZE);
+
+        block = calloc(1, sizeof(struct pe_arena_block_s) + block_size);
+        CRM_ASSERT(block != NULL);
+        block->size = block_size;
+        block->next = data_set->arena->blocks;
+        data_set->arena->blocks = block;
+    }
+
+    result = block->data + block->used;
+    block->used += size;
+    return result;
+}
+
+/*!
+ * \internal
+ * \brief Release all memory allocated with pe__arena_alloc()
+ *
+ * \param[in] data_set  Working set whose arena should be freed
+ */
+void
+pe__free_arena(pe_working_set_t *data_set)
+{
+    if (data_set->arena == NULL) {
+        return;
+    }
+    while (data_set->arena->blocks != NULL) {
+        struct pe_arena_block_s *block = data_set->arena->blocks;
+
+        data_set->arena->blocks = block->next;
+        free(block);
+    }
+    free(data_set->arena);
+    data_set->arena = NULL;
+}
+
+// Wrappers are freed along with the working set that owns the actions
+static action_wrapper_t *
+new_action_wrapper(pe_working_set_t *data_set)
+{
+    return pe__arena_alloc(data_set, sizeof(action_wrapper_t));
+}
+
+struct ordering_pair_s {
+    action_t *first;
+    action_t *then;
+};
+
+static guint
+ordering_pair_hash(gconstpointer key)
+{
+    const struct ordering_pair_s *pair = key;
+
+    return g_direct_hash(pair->first) ^ (g_direct_hash(pair->then) * 31);
+}
+
+static gboolean
+ordering_pair_equal(gconstpointer a, gconstpointer b)
+{
+    const struct ordering_pair_s *pair_a = a;
+    const struct ordering_pair_s *pair_b = b;
+
+    return (pair_a->first == pair_b->first) && (pair_a->then == pair_b->then);
+}
+
+static void
+free_ordering_wrappers(gpointer data)
+{
+    g_list_free((GList *) data);
+}
+
+/*!
+ * \internal
+ * \brief Find the wrappers already ordering one action before another
+ *
+ * \param[in]     first     'First' action of ordering
+ * \param[in]     then      'Then' action of ordering
+ * \param[out]    pair      Where to store the index key for the pair
+ *                          (allocated if the pair is not yet indexed)
+ * \param[in,out] data_set  Working set that \p first and \p then belong to
+ *
+ * \return Wrappers in \p first's actions_after that point to \p then
+ */
+static GList *
+ordering_wrappers(action_t *first, action_t *then,
+                  struct ordering_pair_s **pair, pe_working_set_t *data_set)
+{
+    struct ordering_pair_s lookup = { first, then };
+    gpointer key = NULL;
+    gpointer value = NULL;
+
+    if (data_set->ordering_index == NULL) {
+        data_set->ordering_index = g_hash_table_new_full(ordering_pair_hash,
+                                                         ordering_pair_equal,
+                                                         NULL,
+                                                         free_ordering_wrappers);
+    }
+
+    if (g_hash_table_lookup_extended(data_set->ordering_index, &lookup,
+                                     &key, &value)) {
+        *pair = key;
+        return value;
+    }
+
+    // Keys live as long as the wrappers, so allocate them the same way
+    *pair = pe__arena_alloc(data_set, sizeof(struct ordering_pair_s));
+    (*pair)->first = first;
+    (*pair)->then = then;
+    return NULL;
+}
+
 gboolean
-order_actions(action_t * lh_action, action_t * rh_action, enum pe_ordering order)
+order_actions(action_t * lh_action, action_t * rh_action, enum pe_ordering order,
+              pe_working_set_t * data_set)
 {
     GListPtr gIter = NULL;
     action_wrapper_t *wrapper = NULL;
     GListPtr list = NULL;
+    struct ordering_pair_s *pair = NULL;
 
     if (order == pe_order_none) {
         return FALSE;
@@ -1705,15 +2390,22 @@ order_actions(action_t * lh_action, action_t * rh_action, enum pe_ordering order
     if (lh_action == NULL || rh_action == NULL) {
         return FALSE;
     }
+    CRM_CHECK(data_set != NULL, return FALSE);
 
     crm_trace("Ordering Action %s before %s", lh_action->uuid, rh_action->uuid);
 
     /* Ensure we never create a dependency on ourselves... it's happened */
     CRM_ASSERT(lh_action != rh_action);
 
-    /* Filter dups, otherwise update_action_states() has too much work to do */
-    gIter = lh_action->actions_after;
-    for (; gIter != NULL; gIter = gIter->next) {
+    /* Filter dups, otherwise update_action_states() has too much work to do.
+     *
+     * When scheduling, only the existing orderings between this same pair of
+     * actions need to be checked. Their current types are checked rather than
+     * remembering the types seen so far, because graph processing may clear a
+     * wrapper's type after it has been created.
+     */
+    list = ordering_wrappers(lh_action, rh_action, &pair, data_set);
+    for (gIter = list; gIter != NULL; gIter = gIter->next) {
         action_wrapper_t *after = (action_wrapper_t *) gIter->data;
 
         if (after->action == rh_action && (after->type & order)) {
@@ -1721,10 +2413,14 @@ order_actions(action_t * lh_action, action_t * rh_action, enum pe_ordering order
         }
     }
 
-    wrapper = calloc(1, sizeof(action_wrapper_t));
+    wrapper = new_action_wrapper(data_set);
     wrapper->action = rh_action;
     wrapper->type = order;
 
+    list = g_list_prepend(list, wrapper);
+    g_hash_table_steal(data_set->ordering_index, pair);
+    g_hash_table_insert(data_set->ordering_index, pair, list);
+
     list = lh_action->actions_after;
     list = g_list_prepend(list, wrapper);
     lh_action->actions_after = list;
@@ -1734,7 +2430,7 @@ order_actions(action_t * lh_action, action_t * rh_action, enum pe_ordering order
 /* 	order |= pe_order_implies_then; */
 /* 	order ^= pe_order_implies_then; */
 
-    wrapper = calloc(1, sizeof(action_wrapper_t));
+    wrapper = new_action_wrapper(data_set);
     wrapper->action = lh_action;
     wrapper->type = order;
     list = rh_action->actions_before;
@@ -1855,13 +2551,145 @@ append_versioned_params(xmlNode *versioned_params, const char *ra_version, xmlNo
 }
 #endif
 
+void
+pe__free_digests(gpointer ptr)
+{
+    op_digest_cache_t *data = ptr;
+
+    free_xml(data->params_all);
+    free_xml(data->params_secure);
+    free_xml(data->params_restart);
+
+    free(data->digest_all_calc);
+    free(data->digest_restart_calc);
+    free(data->digest_secure_calc);
+
+    free(data);
+}
+
+/* Calculated digests kept across working sets, when enabled by the caller
+ * (see pe__keep_digests())
+ */
+static GHashTable *kept_digests = NULL;
+static bool keeping_digests = FALSE;
+
+/*!
+ * \internal
+ * \brief Enable or disable keeping operation digests across working sets
+ *
+ * Calculating an operation's digests requires unpacking the resource's
+ * parameters and evaluating any rules, for every operation history entry, on
+ * every run. A long-lived caller that knows the configuration and node
+ * attributes haven't changed since the previous working set (and that no
+ * time-based rules are in use) can enable this to reuse earlier results.
+ *
+ * \param[in] keep  Whether to keep digests (if false, kept ones are dropped)
+ */
+void
+pe__keep_digests(bool keep)
+{
+    keeping_digests = keep;
+    if (!keep) {
+        pe__clear_kept_digests();
+    }
+}
+
+/*!
+ * \internal
+ * \brief Drop all operation digests kept across working sets
+ *
+ * \note This must be called whenever anything other than operation history
+ *       might have changed since the digests were calculated.
+ */
+void
+pe__clear_kept_digests(void)
+{
+    if (kept_digests != NULL) {
+        crm_trace("Dropping %d kept operation digests",
+                  g_hash_table_size(kept_digests));
+        g_hash_table_destroy(kept_digests);
+        kept_digests = NULL;
+    }
+}
+
+static op_digest_cache_t *
+copy_digests(const op_digest_cache_t *data)
+{
+    op_digest_cache_t *copy = calloc(1, sizeof(op_digest_cache_t));
+
+    CRM_ASSERT(copy != NULL);
+    copy->params_all = copy_xml(data->params_all);
+    copy->params_secure = copy_xml(data->params_secure);
+    copy->params_restart = copy_xml(data->params_restart);
+    copy->digest_all_calc = data->digest_all_calc?
+                            strdup(data->digest_all_calc) : NULL;
+    copy->digest_secure_calc = data->digest_secure_calc?
+                               strdup(data->digest_secure_calc) : NULL;
+    copy->digest_restart_calc = data->digest_restart_calc?
+                                strdup(data->digest_restart_calc) : NULL;
+    return copy;
+}
+
+/*!
+ * \internal
+ * \brief Get key for an operation's digests kept across working sets
+ *
+ * \param[in] rsc       Resource that operation is for
+ * \param[in] key       Operation key
+ * \param[in] node      Node that operation is for
+ * \param[in] xml_op    Operation history entry (or NULL)
+ * \param[in] data_set  Cluster working set
+ *
+ * \return Newly allocated key, or NULL if digests may not be kept
+ * \note Besides the resource and node, digests depend on the operation
+ *       history entry's feature set, agent version and filter lists.
+ */
+static char *
+kept_digests_key(resource_t *rsc, const char *key, node_t *node,
+                 xmlNode *xml_op, pe_working_set_t *data_set)
+{
+    if (!keeping_digests || container_fix_remote_addr(rsc)) {
+        /* A container's remote connection address depends on where the
+         * container is placed, not just the configuration
+         */
+        return NULL;
+    }
+    if (xml_op == NULL) {
+        return crm_strdup_printf("%s %s %d", node->details->id, key,
+                                 is_set(data_set->flags, pe_flag_sanitized));
+    }
+    return crm_strdup_printf("%s %s %d %d %s|%s|%s|%s",
+                             node->details->id, key,
+                             is_set(data_set->flags, pe_flag_sanitized),
+                             (crm_element_value(xml_op, XML_LRM_ATTR_RESTART_DIGEST) != NULL),
+                             crm_str(crm_element_value(xml_op, XML_ATTR_CRM_VERSION)),
+                             crm_str(crm_element_value(xml_op, XML_LRM_ATTR_OP_SECURE)),
+                             crm_str(crm_element_value(xml_op, XML_LRM_ATTR_OP_RESTART)),
+                             crm_str(crm_element_value(xml_op, XML_ATTR_RA_VERSION)));
+}
+
 static op_digest_cache_t *
 rsc_action_digest(resource_t * rsc, const char *task, const char *key,
                   node_t * node, xmlNode * xml_op, pe_working_set_t * data_set) 
 {
     op_digest_cache_t *data = NULL;
+    char *kept_key = NULL;
 
     data = g_hash_table_lookup(node->details->digest_cache, key);
+    if (data == NULL) {
+        kept_key = kept_digests_key(rsc, key, node, xml_op, data_set);
+        if ((kept_key != NULL) && (kept_digests != NULL)) {
+            data = g_hash_table_lookup(kept_digests, kept_key);
+        }
+        if (data != NULL) {
+            crm_trace("Reusing kept digests for %s on %s",
+                      key, node->details->uname);
+            data = copy_digests(data);
+            g_hash_table_insert(node->details->digest_cache, strdup(key), data);
+            free(kept_key);
+            return data;
+        }
+    }
     if (data == NULL) {
         GHashTable *local_rsc_params = crm_str_table_new();
         action_t *action = custom_action(rsc, strdup(key), task, node, TRUE, FALSE, data_set);
@@ -1941,6 +2769,15 @@ rsc_action_digest(resource_t * rsc, const char *task, const char *key,
         }
 
         g_hash_table_insert(node->details->digest_cache, strdup(key), data);
+
+        if (kept_key != NULL) {
+            if (kept_digests == NULL) {
+                kept_digests = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                     free, pe__free_digests);
+            }
+            g_hash_table_insert(kept_digests, kept_key, copy_digests(data));
+            kept_key = NULL;
+        }
     }
 
     return data;
@@ -1973,7 +2810,9 @@ rsc_action_digest_cmp(resource_t * rsc, xmlNode * xml_op, node_t * node,
     data = rsc_action_digest(rsc, task, key, node, xml_op, data_set);
 
     data->rc = RSC_DIGEST_MATCH;
-    if (digest_restart && data->digest_restart_calc && strcmp(data->digest_restart_calc, digest_restart) != 0) {
+    if (digest_restart && data->digest_restart_calc
+        && !pe__op_digest_eq(xml_op, XML_LRM_ATTR_RESTART_DIGEST,
+                             data->digest_restart_calc)) {
         pe_rsc_info(rsc, "Parameters to %s on %s changed: was %s vs. now %s (restart:%s) %s",
                  key, node->details->uname,
                  crm_str(digest_restart), data->digest_restart_calc,
@@ -1984,7 +2823,8 @@ rsc_action_digest_cmp(resource_t * rsc, xmlNode * xml_op, node_t * node,
         /* it is unknown what the previous op digest was */
         data->rc = RSC_DIGEST_UNKNOWN;
 
-    } else if (strcmp(digest_all, data->digest_all_calc) != 0) {
+    } else if (!pe__op_digest_eq(xml_op, XML_LRM_ATTR_OP_DIGEST,
+                                 data->digest_all_calc)) {
         pe_rsc_info(rsc, "Parameters to %s on %s changed: was %s vs. now %s (%s:%s) %s",
                  key, node->details->uname,
                  crm_str(digest_all), data->digest_all_calc,
@@ -2206,7 +3046,7 @@ trigger_unfencing(
         action_t *unfence = pe_fence_op(node, "on", FALSE, reason, data_set);
 
         if(dependency) {
-            order_actions(unfence, dependency, pe_order_optional);
+            order_actions(unfence, dependency, pe_order_optional, data_set);
         }
 
     } else if(rsc) {
@@ -2332,3 +3172,78 @@ void pe_action_set_reason(pe_action_t *action, const char *reason, bool overwrit
         }
     }
 }
+
+// Longest chain of delta-encoded inputs that will be followed
+#define MAX_INPUT_DELTAS 1000
+
+static xmlNode *
+read_input(const char *filename, int depth)
+{
+    xmlNode *xml = filename2xml(filename);
+    xmlNode *base = NULL;
+    char *base_file = NULL;
+    const char *base_name = NULL;
+    const char *slash = NULL;
+    int rc = pcmk_ok;
+
+    if ((xml == NULL)
+        || safe_str_neq(crm_element_name(xml), PE__XML_INPUT_DELTA)) {
+        return xml;
+    }
+
+    base_name = crm_element_value(xml, PE__XML_ATTR_DELTA_BASE);
+    if ((base_name == NULL) || (depth >= MAX_INPUT_DELTAS)) {
+        crm_err("Cannot reconstruct scheduler input %s: %s",
+                crm_str(filename),
+                (base_name? "too many differences" : "no base input"));
+        free_xml(xml);
+        return NULL;
+    }
+
+    // The base is in the same directory as the input derived from it
+    slash = filename? strrchr(filename, '/') : NULL;
+    if (slash != NULL) {
+        base_file = crm_strdup_printf("%.*s/%s", (int) (slash - filename),
+                                      filename, base_name);
+    } else {
+        base_file = strdup(base_name);
+    }
+
+    base = read_input(base_file, depth + 1);
+    if (base != NULL) {
+        rc = xml_apply_patchset(base, first_named_child(xml, XML_TAG_DIFF),
+                                FALSE);
+        if (rc != pcmk_ok) {
+            crm_err("Cannot reconstruct scheduler input %s from %s: %s "
+                    CRM_XS " rc=%d",
+                    crm_str(filename), base_file, pcmk_strerror(rc), rc);
+            free_xml(base);
+            base = NULL;
+        }
+    } else {
+        crm_err("Cannot reconstruct scheduler input %s: could not read %s",
+                crm_str(filename), base_file);
+    }
+
+    free(base_file);
+    free_xml(xml);
+    return base;
+}
+
+/*!
+ * \internal
+ * \brief Read a saved scheduler input, reconstructing it if necessary
+ *
+ * \param[in] filename  Name of file to read (or NULL for standard input)
+ *
+ * \return Scheduler input XML on success, NULL otherwise
+ * \note Inputs saved as differences from an earlier input are reconstructed
+ *       from the earlier inputs, which must be in the same directory (or the
+ *       current directory, for standard input). The caller is responsible
+ *       for freeing the result with free_xml().
+ */
+xmlNode *
+pe__read_input(const char *filename)
+{
+    return read_input(filename, 0);
+}
@@ -20,6 +20,7 @@
 
 #include <crm/crm.h>
 #include <crm/common/mainloop.h>
+#include <crm/common/internal.h>
 #include <crm/services.h>
 #include <crm/msg_xml.h>
 #include "services_private.h"
@@ -45,8 +46,93 @@ static GList *blocked_ops = NULL;
 /* ops currently active (in-flight) */
 static GList *inflight_ops = NULL;
 
+/* number of in-flight ops for each resource */
+static GHashTable *inflight_by_rsc = NULL;
+
+/*
+ * Recurring operation pacing
+ *
+ * Without pacing, recurring operations that were started together (for
+ * example, all of a node's monitors after it rejoins the cluster) would repeat
+ * together forever, forking a burst of agents at each interval. So the first
+ * repeat of each recurring operation is delayed by a random part of
+ * PCMK_recurring_spread percent of its interval, spreading the repeats out
+ * over the interval. In addition, no more than PCMK_recurring_limit repeats
+ * (by default, four per processor) run at once, and the rest wait as blocked
+ * operations until one finishes. Operations requested by the caller rather
+ * than repeated by the library are never held back.
+ */
+
+#define RECURRING_SPREAD_DEFAULT "50"
+
+static int recurring_limit = -1;
+static int recurring_spread = -1;
+static unsigned int inflight_repeats = 0;
+
 static void handle_blocked_ops(void);
 
+static int
+repeat_limit(void)
+{
+    if (recurring_limit < 0) {
+        const char *value = daemon_option("recurring_limit");
+
+        if (value == NULL) {
+            recurring_limit = 4 * crm_procfs_num_cores();
+        } else {
+            recurring_limit = crm_parse_int(value, "0");
+        }
+        if (recurring_limit < 0) {
+            recurring_limit = 0;
+        }
+        crm_debug("Running at most %d recurring operation repeats at once "
+                  "(0 means unlimited)", recurring_limit);
+    }
+    return recurring_limit;
+}
+
+// Whether an operation must wait for a recurring repeat slot
+static gboolean
+repeat_must_wait(svc_action_t *op)
+{
+    return op->opaque->repeat && (repeat_limit() > 0)
+           && (inflight_repeats >= (unsigned int) recurring_limit);
+}
+
+/*!
+ * \internal
+ * \brief Get the delay before a recurring operation's next repeat
+ *
+ * \param[in,out] op  Recurring operation that completed
+ *
+ * \return Operation's interval, plus a one-time random phase offset
+ */
+guint
+services_repeat_delay(svc_action_t *op)
+{
+    guint delay = op->interval_ms;
+
+    if (recurring_spread < 0) {
+        recurring_spread = crm_parse_int(daemon_option("recurring_spread"),
+                                         RECURRING_SPREAD_DEFAULT);
+        if (recurring_spread < 0) {
+            recurring_spread = 0;
+        } else if (recurring_spread > 100) {
+            recurring_spread = 100;
+        }
+    }
+
+    if (!op->opaque->phase_spread) {
+        guint64 spread_ms = ((guint64) op->interval_ms * recurring_spread) / 100;
+
+        op->opaque->phase_spread = TRUE;
+        if ((spread_ms > 0) && (spread_ms < G_MAXINT)) {
+            delay += (guint) g_random_int_range(0, (gint32) spread_ms + 1);
+        }
+    }
+    return delay;
+}
+
 /*!
  * \brief Find first service class that can provide a specified agent
  *
@@ -101,7 +187,7 @@ inflight_systemd_or_upstart(svc_action_t *op)
 {
     return (safe_str_eq(op->standard, PCMK_RESOURCE_CLASS_SYSTEMD)
             || safe_str_eq(op->standard, PCMK_RESOURCE_CLASS_UPSTART))
-            && (g_list_find(inflight_ops, op) != NULL);
+            && op->opaque->inflight;
 }
 
 /*!
@@ -198,6 +284,7 @@ resources_action_create(const char *name, const char *standard,
 
     op = calloc(1, sizeof(svc_action_t));
     op->opaque = calloc(1, sizeof(svc_action_private_t));
+    op->opaque->stdin_fd = -1;
     op->rsc = strdup(name);
     op->interval_ms = interval_ms;
     op->timeout = timeout;
@@ -276,13 +363,13 @@ resources_action_create(const char *name, const char *standard,
     }
 
     if(params) {
-        g_hash_table_destroy(params);
+        g_hash_table_unref(params);
     }
     return op;
 
   return_error:
     if(params) {
-        g_hash_table_destroy(params);
+        g_hash_table_unref(params);
     }
     services_action_free(op);
 
@@ -297,6 +384,7 @@ services_action_create_generic(const char *exec, const char *args[])
 
     op = calloc(1, sizeof(*op));
     op->opaque = calloc(1, sizeof(svc_action_private_t));
+    op->opaque->stdin_fd = -1;
 
     op->opaque->exec = strdup(exec);
     op->opaque->args[0] = strdup(exec);
@@ -421,6 +509,60 @@ services_alert_async(svc_action_t *action, void (*cb)(svc_action_t *op))
     return responsible;
 }
 
+/*!
+ * \brief Give an alert agent data to read on its standard input
+ *
+ * \param[in,out] action  Alert action to modify (which must not be running)
+ * \param[in]     data    Data for the agent to read
+ * \param[in]     len     Length of \p data
+ *
+ * \return pcmk_ok on success, -errno otherwise
+ *
+ * \note The data is kept in an unlinked file rather than a pipe, so an agent
+ *       that is slow to read it cannot hold up the daemon, however large it is.
+ */
+int
+services_alert_input(svc_action_t *action, const char *data, size_t len)
+{
+    char *path = crm_strdup_printf(CRM_STATE_DIR "/alert-input.XXXXXX");
+    int fd = mkstemp(path);
+    int rc = pcmk_ok;
+
+    if (fd < 0) {
+        rc = -errno;
+        crm_err("Could not create input file for alert %s: %s",
+                action->id, pcmk_strerror(rc));
+        free(path);
+        return rc;
+    }
+    unlink(path);
+    free(path);
+
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            rc = -errno;
+            crm_err("Could not write input for alert %s: %s",
+                    action->id, pcmk_strerror(rc));
+            close(fd);
+            return rc;
+        }
+        data += written;
+        len -= written;
+    }
+    lseek(fd, 0, SEEK_SET);
+
+    if (action->opaque->stdin_fd >= 0) {
+        close(action->opaque->stdin_fd);
+    }
+    action->opaque->stdin_fd = fd;
+    return pcmk_ok;
+}
+
 #if SUPPORT_DBUS
 /*!
  * \internal
@@ -507,7 +649,7 @@ services_action_free(svc_action_t * op)
     services_action_cleanup(op);
 
     if (op->opaque->repeat_timer) {
-        g_source_remove(op->opaque->repeat_timer);
+        pcmk__timeout_remove(op->opaque->repeat_timer);
         op->opaque->repeat_timer = 0;
     }
 
@@ -518,6 +660,9 @@ services_action_free(svc_action_t * op)
         free(op->opaque->args[i]);
     }
 
+    if (op->opaque->stdin_fd >= 0) {
+        close(op->opaque->stdin_fd);
+    }
     free(op->opaque);
     free(op->rsc);
     free(op->action);
@@ -530,7 +675,7 @@ services_action_free(svc_action_t * op)
     free(op->stderr_data);
 
     if (op->params) {
-        g_hash_table_destroy(op->params);
+        g_hash_table_unref(op->params); // caller may hold another reference
         op->params = NULL;
     }
 
@@ -547,7 +692,7 @@ cancel_recurring_action(svc_action_t * op)
     }
 
     if (op->opaque->repeat_timer) {
-        g_source_remove(op->opaque->repeat_timer);
+        pcmk__timeout_remove(op->opaque->repeat_timer);
         op->opaque->repeat_timer = 0;
     }
 
@@ -645,7 +790,7 @@ services_action_kick(const char *name, const char *action, guint interval_ms)
         return TRUE;
     } else {
         if (op->opaque->repeat_timer) {
-            g_source_remove(op->opaque->repeat_timer);
+            pcmk__timeout_remove(op->opaque->repeat_timer);
             op->opaque->repeat_timer = 0;
         }
         recurring_action_timer(op);
@@ -680,7 +825,7 @@ handle_duplicate_recurring(svc_action_t * op)
         /* immediately execute the next interval */
         if (dup->pid != 0) {
             if (op->opaque->repeat_timer) {
-                g_source_remove(op->opaque->repeat_timer);
+                pcmk__timeout_remove(op->opaque->repeat_timer);
                 op->opaque->repeat_timer = 0;
             }
             recurring_action_timer(dup);
@@ -726,8 +871,25 @@ services_add_inflight_op(svc_action_t * op)
 
     CRM_ASSERT(op->synchronous == FALSE);
 
+    if (op->opaque->repeat) {
+        op->opaque->repeat = FALSE;
+        op->opaque->repeat_slot = TRUE;
+        inflight_repeats++;
+    }
+
     /* keep track of ops that are in-flight to avoid collisions in the same namespace */
     if (op->rsc) {
+        gpointer count = NULL;
+
+        if (inflight_by_rsc == NULL) {
+            inflight_by_rsc = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                    free, NULL);
+        }
+        count = g_hash_table_lookup(inflight_by_rsc, op->rsc);
+        g_hash_table_replace(inflight_by_rsc, strdup(op->rsc),
+                             GUINT_TO_POINTER(GPOINTER_TO_UINT(count) + 1));
+
+        op->opaque->inflight = TRUE;
         inflight_ops = g_list_append(inflight_ops, op);
     }
 }
@@ -742,7 +904,24 @@ void
 services_untrack_op(svc_action_t *op)
 {
     /* Op is no longer in-flight or blocked */
-    inflight_ops = g_list_remove(inflight_ops, op);
+    if (op->opaque->inflight) {
+        guint count = GPOINTER_TO_UINT(g_hash_table_lookup(inflight_by_rsc,
+                                                           op->rsc));
+
+        if (count <= 1) {
+            g_hash_table_remove(inflight_by_rsc, op->rsc);
+        } else {
+            g_hash_table_replace(inflight_by_rsc, strdup(op->rsc),
+                                 GUINT_TO_POINTER(count - 1));
+        }
+        op->opaque->inflight = FALSE;
+        inflight_ops = g_list_remove(inflight_ops, op);
+    }
+    if (op->opaque->repeat_slot) {
+        op->opaque->repeat_slot = FALSE;
+        inflight_repeats--;
+    }
+    op->opaque->repeat = FALSE;
     blocked_ops = g_list_remove(blocked_ops, op);
 
     /* Op is no longer blocking other ops, so check if any need to run */
@@ -767,7 +946,7 @@ services_action_async(svc_action_t * op, void (*action_callback) (svc_action_t *
         g_hash_table_replace(recurring_actions, op->id, op);
     }
 
-    if (op->rsc && is_op_blocked(op->rsc)) {
+    if ((op->rsc && is_op_blocked(op->rsc)) || repeat_must_wait(op)) {
         blocked_ops = g_list_append(blocked_ops, op);
         return TRUE;
     }
@@ -781,17 +960,8 @@ static gboolean processing_blocked_ops = FALSE;
 gboolean
 is_op_blocked(const char *rsc)
 {
-    GList *gIter = NULL;
-    svc_action_t *op = NULL;
-
-    for (gIter = inflight_ops; gIter != NULL; gIter = gIter->next) {
-        op = gIter->data;
-        if (safe_str_eq(op->rsc, rsc)) {
-            return TRUE;
-        }
-    }
-
-    return FALSE;
+    return (rsc != NULL) && (inflight_by_rsc != NULL)
+           && (g_hash_table_lookup(inflight_by_rsc, rsc) != NULL);
 }
 
 static void
@@ -809,11 +979,12 @@ handle_blocked_ops(void)
 
     processing_blocked_ops = TRUE;
 
-    /* n^2 operation here, but blocked ops are incredibly rare. this list
-     * will be empty 99% of the time. */
+    /* Ops blocked by another op on the same resource are rare, but recurring
+     * repeats waiting for a slot may not be, so is_op_blocked() is a lookup.
+     */
     for (gIter = blocked_ops; gIter != NULL; gIter = gIter->next) {
         op = gIter->data;
-        if (is_op_blocked(op->rsc)) {
+        if (is_op_blocked(op->rsc) || repeat_must_wait(op)) {
             continue;
         }
         executed_ops = g_list_append(executed_ops, op);
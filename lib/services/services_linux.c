@@ -29,6 +29,7 @@
 #include "crm/crm.h"
 #include "crm/common/mainloop.h"
 #include "crm/services.h"
+#include "crm/common/internal.h"
 
 #include "services_private.h"
 
@@ -36,41 +37,111 @@
 #  include "crm/common/cib_secrets.h"
 #endif
 
+#define OUTPUT_TRUNCATED_MARKER "\n[output truncated by Pacemaker]\n"
+
+/*!
+ * \internal
+ * \brief Get the most agent output of one kind that will be kept
+ *
+ * \return PCMK_agent_output_max (in bytes, by default 1MiB), or 0 if unlimited
+ */
+static size_t
+output_max(void)
+{
+    static int max = -1;
+
+    if (max < 0) {
+        max = crm_parse_int(daemon_option("agent_output_max"), "1048576");
+        if (max < 0) {
+            max = 0;
+        }
+    }
+    return (size_t) max;
+}
+
+/*!
+ * \internal
+ * \brief Add agent output to a buffer, growing it geometrically
+ *
+ * \param[in,out] out    Buffer to add to
+ * \param[in]     text   Output to add
+ * \param[in]     len    Number of bytes in \p text
+ * \param[in]     op_id  Action ID (for logging)
+ */
+static void
+output_append(struct svc_output_s *out, const char *text, size_t len,
+              const char *op_id)
+{
+    size_t max = output_max();
+    size_t needed = 0;
+
+    if ((max > 0) && (out->len + len > max)) {
+        len = (out->len < max)? (max - out->len) : 0;
+        out->truncated = TRUE;
+        crm_warn("Discarding output of %s beyond %llu bytes "
+                 CRM_XS " PCMK_agent_output_max", op_id,
+                 (unsigned long long) max);
+    }
+
+    needed = out->len + len + 1;
+    if (out->truncated) {
+        needed += strlen(OUTPUT_TRUNCATED_MARKER);
+    }
+    if (needed > out->size) {
+        size_t size = (out->size < 1024)? 1024 : out->size;
+
+        while (size < needed) {
+            size *= 2;
+        }
+        out->data = realloc_safe(out->data, size);
+        out->size = size;
+    }
+
+    memcpy(out->data + out->len, text, len);
+    out->len += len;
+    if (out->truncated) {
+        memcpy(out->data + out->len, OUTPUT_TRUNCATED_MARKER,
+               strlen(OUTPUT_TRUNCATED_MARKER));
+        out->len += strlen(OUTPUT_TRUNCATED_MARKER);
+    }
+    out->data[out->len] = '\0';
+}
+
 static gboolean
 svc_read_output(int fd, svc_action_t * op, bool is_stderr)
 {
-    char *data = NULL;
-    int rc = 0, len = 0;
-    char buf[500];
-    static const size_t buf_read_len = sizeof(buf) - 1;
-
+    char **data = is_stderr? &(op->stderr_data) : &(op->stdout_data);
+    struct svc_output_s *out = is_stderr? &(op->opaque->stderr_buf)
+                                         : &(op->opaque->stdout_buf);
+    bool discard = !is_stderr && is_set(op->flags, SVC_ACTION_DISCARD_OUTPUT);
+    int rc = 0;
+    char buf[4096];
+    static const size_t buf_read_len = sizeof(buf);
 
     if (fd < 0) {
         crm_trace("No fd for %s", op->id);
         return FALSE;
     }
 
-    if (is_stderr && op->stderr_data) {
-        len = strlen(op->stderr_data);
-        data = op->stderr_data;
-        crm_trace("Reading %s stderr into offset %d", op->id, len);
-
-    } else if (is_stderr == FALSE && op->stdout_data) {
-        len = strlen(op->stdout_data);
-        data = op->stdout_data;
-        crm_trace("Reading %s stdout into offset %d", op->id, len);
-
-    } else {
-        crm_trace("Reading %s %s into offset %d", op->id, is_stderr?"stderr":"stdout", len);
+    // Output may have been freed (for a recurring action) or set elsewhere
+    if (*data != out->data) {
+        out->data = *data;
+        out->len = (*data? strlen(*data) : 0);
+        out->size = (*data? (out->len + 1) : 0);
+        out->truncated = FALSE;
     }
 
+    crm_trace("Reading %s %s into offset %llu%s", op->id,
+              (is_stderr? "stderr" : "stdout"), (unsigned long long) out->len,
+              (discard? " (discarding)" : ""));
+
     do {
         rc = read(fd, buf, buf_read_len);
         if (rc > 0) {
-            crm_trace("Got %d chars: %.80s", rc, buf);
-            buf[rc] = 0;
-            data = realloc_safe(data, len + rc + 1);
-            len += sprintf(data + len, "%s", buf);
+            crm_trace("Got %d chars: %.*s", rc, ((rc < 80)? rc : 80), buf);
+            if (!discard && !out->truncated) {
+                output_append(out, buf, rc, op->id);
+            }
 
         } else if (errno != EINTR) {
             /* error or EOF
@@ -82,12 +153,7 @@ svc_read_output(int fd, svc_action_t * op, bool is_stderr)
 
     } while (rc == buf_read_len || rc < 0);
 
-    if (is_stderr) {
-        op->stderr_data = data;
-    } else {
-        op->stdout_data = data;
-    }
-
+    *data = out->data;
     return rc;
 }
 
@@ -143,10 +209,23 @@ static struct mainloop_fd_callbacks stderr_callbacks = {
     .destroy = pipe_err_done,
 };
 
+/*!
+ * \internal
+ * \brief Set an environment variable for an action's agent
+ *
+ * \param[in] key        Variable name
+ * \param[in] value      Variable value
+ * \param[in] user_data  Table to add variable to (or NULL to set it in our
+ *                       own environment, for use in a forked child)
+ */
 static void
 set_ocf_env(const char *key, const char *value, gpointer user_data)
 {
-    if (setenv(key, value, 1) != 0) {
+    if (user_data != NULL) {
+        g_hash_table_replace((GHashTable *) user_data, strdup(key),
+                             strdup(value));
+
+    } else if (setenv(key, value, 1) != 0) {
         crm_perror(LOG_ERR, "setenv failed for key:%s and value:%s", key, value);
     }
 }
@@ -164,35 +243,39 @@ set_ocf_env_with_prefix(gpointer key, gpointer value, gpointer user_data)
  * \internal
  * \brief Add environment variables suitable for an action
  *
- * \param[in] op  Action to use
+ * \param[in] op      Action to use
+ * \param[in] params  Action parameters to use (normally op->params)
+ * \param[in] vars    Table to add variables to (or NULL to set them in our
+ *                    own environment)
  */
 static void
-add_action_env_vars(const svc_action_t *op)
+add_action_env_vars(const svc_action_t *op, GHashTable *params,
+                    GHashTable *vars)
 {
     if (safe_str_eq(op->standard, PCMK_RESOURCE_CLASS_OCF) == FALSE) {
         return;
     }
 
-    if (op->params) {
-        g_hash_table_foreach(op->params, set_ocf_env_with_prefix, NULL);
+    if (params) {
+        g_hash_table_foreach(params, set_ocf_env_with_prefix, vars);
     }
 
-    set_ocf_env("OCF_RA_VERSION_MAJOR", "1", NULL);
-    set_ocf_env("OCF_RA_VERSION_MINOR", "0", NULL);
-    set_ocf_env("OCF_ROOT", OCF_ROOT_DIR, NULL);
-    set_ocf_env("OCF_EXIT_REASON_PREFIX", PCMK_OCF_REASON_PREFIX, NULL);
+    set_ocf_env("OCF_RA_VERSION_MAJOR", "1", vars);
+    set_ocf_env("OCF_RA_VERSION_MINOR", "0", vars);
+    set_ocf_env("OCF_ROOT", OCF_ROOT_DIR, vars);
+    set_ocf_env("OCF_EXIT_REASON_PREFIX", PCMK_OCF_REASON_PREFIX, vars);
 
     if (op->rsc) {
-        set_ocf_env("OCF_RESOURCE_INSTANCE", op->rsc, NULL);
+        set_ocf_env("OCF_RESOURCE_INSTANCE", op->rsc, vars);
     }
 
     if (op->agent != NULL) {
-        set_ocf_env("OCF_RESOURCE_TYPE", op->agent, NULL);
+        set_ocf_env("OCF_RESOURCE_TYPE", op->agent, vars);
     }
 
     /* Notes: this is not added to specification yet. Sept 10,2004 */
     if (op->provider != NULL) {
-        set_ocf_env("OCF_RESOURCE_PROVIDER", op->provider, NULL);
+        set_ocf_env("OCF_RESOURCE_PROVIDER", op->provider, vars);
     }
 }
 
@@ -210,6 +293,8 @@ recurring_action_timer(gpointer data)
     op->stderr_data = NULL;
     op->opaque->repeat_timer = 0;
 
+    /* This counts against PCMK_recurring_limit */
+    op->opaque->repeat = TRUE;
     services_action_async(op, NULL);
     return FALSE;
 }
@@ -226,8 +311,9 @@ operation_finalize(svc_action_t * op)
             cancel_recurring_action(op);
         } else {
             recurring = 1;
-            op->opaque->repeat_timer = g_timeout_add(op->interval_ms,
-                                                     recurring_action_timer, (void *)op);
+            op->opaque->repeat_timer = pcmk__timeout_add(services_repeat_delay(op),
+                                                         recurring_action_timer,
+                                                         (void *)op);
         }
     }
 
@@ -431,7 +517,7 @@ action_launch_child(svc_action_t *op)
     }
 #endif
 
-    add_action_env_vars(op);
+    add_action_env_vars(op, op->params, NULL);
 
     /* Become the desired user */
     if (op->opaque->uid && (geteuid() == 0)) {
@@ -465,6 +551,88 @@ action_launch_child(svc_action_t *op)
     _exit(op->rc);
 }
 
+// Record how long this process was held up starting an agent
+static void
+observe_start_time(const char *method, gint64 started)
+{
+    pcmk__metric_observe_us(pcmk__metric(pcmk__metric_histogram,
+                                         "agent_start_seconds",
+                                         "Time taken to fork or spawn agent "
+                                         "processes, by method",
+                                         "method", method),
+                            g_get_monotonic_time() - started);
+}
+
+/*!
+ * \internal
+ * \brief Run an action's agent without forking, if possible
+ *
+ * The child gets the same setup as action_launch_child() would give it, but
+ * without a copy of this process, which is much cheaper when the daemon is
+ * large. Whatever cannot be done by posix_spawn() (switching user, resetting a
+ * non-default nice value, or failing the action when CIB secrets cannot be
+ * read) is left to the fork() path.
+ *
+ * \param[in,out] op       Action to run
+ * \param[in]     out_fd   Write end of the agent's stdout pipe
+ * \param[in]     err_fd   Write end of the agent's stderr pipe
+ * \param[in]     sigmask  Agent's signal mask (or NULL to inherit ours)
+ *
+ * \return pcmk_ok if the agent was started (with op->pid set), -ENOTSUP if
+ *         the caller should fork instead, otherwise -errno
+ */
+static int
+action_spawn_child(svc_action_t *op, int out_fd, int err_fd,
+                   const sigset_t *sigmask)
+{
+    int fds[3] = { op->opaque->stdin_fd, out_fd, err_fd };
+    GHashTable *params = op->params;
+    GHashTable *vars = NULL;
+    char **envp = NULL;
+    int rc = pcmk_ok;
+    gint64 started = 0;
+
+    if (!pcmk__spawn_enabled()
+        || (op->opaque->uid && (geteuid() == 0))) {
+        return -ENOTSUP;
+    }
+
+    errno = 0;
+    if ((getpriority(PRIO_PROCESS, 0) != 0) || (errno != 0)) {
+        return -ENOTSUP;
+    }
+
+#if SUPPORT_CIBSECRETS
+    if (params != NULL) {
+        params = crm_str_table_dup(op->params);
+        if (replace_secret_params(op->rsc, params) < 0) {
+            g_hash_table_destroy(params);
+            return -ENOTSUP;
+        }
+    }
+#endif
+
+    vars = crm_str_table_new();
+    add_action_env_vars(op, params, vars);
+    envp = pcmk__spawn_env_new(vars);
+
+    started = g_get_monotonic_time();
+    rc = pcmk__spawn(op->opaque->exec, op->opaque->args, envp, fds,
+                     pcmk__spawn_new_pgroup|pcmk__spawn_close_fds
+                     |pcmk__spawn_reset_sched, sigmask, &(op->pid));
+    if (rc == pcmk_ok) {
+        crm_trace("Spawned %s as process %d", op->id, op->pid);
+        observe_start_time("spawn", started);
+    }
+
+    pcmk__spawn_env_free(envp);
+    g_hash_table_destroy(vars);
+    if (params != op->params) {
+        g_hash_table_destroy(params);
+    }
+    return rc;
+}
+
 #ifndef HAVE_SYS_SIGNALFD_H
 static int sigchld_pipe[2] = { -1, -1 };
 
@@ -630,8 +798,10 @@ services_os_action_execute(svc_action_t * op)
     int stdout_fd[2];
     int stderr_fd[2];
     int rc;
+    gint64 started = 0;
     struct stat st;
     sigset_t *pmask;
+    const sigset_t *child_mask = NULL;
 
 #ifdef HAVE_SYS_SIGNALFD_H
     sigset_t mask;
@@ -705,6 +875,9 @@ services_os_action_execute(svc_action_t * op)
         }
 
         pmask = &mask;
+
+        // The child gets the mask we had before blocking SIGCHLD
+        child_mask = &old_mask;
 #else
         if(pipe(sigchld_pipe) == -1) {
             crm_perror(LOG_ERR, "pipe() failed");
@@ -732,7 +905,33 @@ services_os_action_execute(svc_action_t * op)
 #endif
     }
 
+    rc = action_spawn_child(op, stdout_fd[1], stderr_fd[1], child_mask);
+    if (rc == pcmk_ok) {
+        goto parent;
+
+    } else if (rc != -ENOTSUP) {
+        rc = -rc;
+
+        close(stdout_fd[0]);
+        close(stdout_fd[1]);
+        close(stderr_fd[0]);
+        close(stderr_fd[1]);
+
+        crm_err("Could not execute '%s': %s (%d)", op->opaque->exec, pcmk_strerror(rc), rc);
+        services_handle_exec_error(op, rc);
+        if (!op->synchronous) {
+            return operation_finalize(op);
+        }
+
+        sigchld_cleanup();
+        return FALSE;
+    }
+
+    started = g_get_monotonic_time();
     op->pid = fork();
+    if (op->pid > 0) {
+        observe_start_time("fork", started);
+    }
     switch (op->pid) {
         case -1:
             rc = errno;
@@ -754,6 +953,13 @@ services_os_action_execute(svc_action_t * op)
         case 0:                /* Child */
             close(stdout_fd[0]);
             close(stderr_fd[0]);
+            if ((op->opaque->stdin_fd >= 0)
+                && (op->opaque->stdin_fd != STDIN_FILENO)) {
+                if (dup2(op->opaque->stdin_fd, STDIN_FILENO) != STDIN_FILENO) {
+                    crm_err("dup2() failed (stdin)");
+                }
+                close(op->opaque->stdin_fd);
+            }
             if (STDOUT_FILENO != stdout_fd[1]) {
                 if (dup2(stdout_fd[1], STDOUT_FILENO) != STDOUT_FILENO) {
                     crm_err("dup2() failed (stdout)");
@@ -776,8 +982,14 @@ services_os_action_execute(svc_action_t * op)
     }
 
     /* Only the parent reaches here */
+  parent:
+    pcmk__place_agent(op->pid);
     close(stdout_fd[1]);
     close(stderr_fd[1]);
+    if (op->opaque->stdin_fd >= 0) {
+        close(op->opaque->stdin_fd);
+        op->opaque->stdin_fd = -1;
+    }
 
     op->opaque->stdout_fd = stdout_fd[0];
     rc = crm_set_nonblocking(op->opaque->stdout_fd);
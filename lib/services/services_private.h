@@ -16,6 +16,14 @@
 #endif
 
 #define MAX_ARGC        255
+// Agent output read so far (into op->stdout_data or op->stderr_data)
+struct svc_output_s {
+    char *data;             // buffer last read into (to detect replacement)
+    size_t len;             // bytes of output in data
+    size_t size;            // bytes allocated for data
+    gboolean truncated;     // output has reached PCMK_agent_output_max
+};
+
 struct svc_action_private_s {
     char *exec;
     char *args[MAX_ARGC];
@@ -26,11 +34,20 @@ struct svc_action_private_s {
     guint repeat_timer;
     void (*callback) (svc_action_t * op);
 
+    gboolean repeat;        // next execution is a recurring repeat
+    gboolean repeat_slot;   // in flight as a recurring repeat
+    gboolean phase_spread;  // first repeat has been spread out
+    gboolean inflight;      // in inflight_ops
+
     int stderr_fd;
     mainloop_io_t *stderr_gsource;
+    struct svc_output_s stderr_buf;
 
     int stdout_fd;
     mainloop_io_t *stdout_gsource;
+    struct svc_output_s stdout_buf;
+
+    int stdin_fd;           // agent's input, if set by services_alert_input()
 #if SUPPORT_DBUS
     DBusPendingCall* pending;
     unsigned timerid;
@@ -70,6 +87,9 @@ void services_untrack_op(svc_action_t *op);
 G_GNUC_INTERNAL
 gboolean is_op_blocked(const char *rsc);
 
+G_GNUC_INTERNAL
+guint services_repeat_delay(svc_action_t *op);
+
 #if SUPPORT_DBUS
 G_GNUC_INTERNAL
 void services_set_op_pending(svc_action_t *op, DBusPendingCall *pending);
@@ -96,6 +96,9 @@ systemd_call_simple_method(const char *method)
     return reply;
 }
 
+static void systemd_unsubscribe(void);
+static const char *systemd_unit_extension(const char *name);
+
 static gboolean
 systemd_init(void)
 {
@@ -105,6 +108,7 @@ systemd_init(void)
     if (systemd_proxy
         && dbus_connection_get_is_connected(systemd_proxy) == FALSE) {
         crm_warn("Connection to System DBus is closed. Reconnecting...");
+        systemd_unsubscribe();
         pcmk_dbus_disconnect(systemd_proxy);
         systemd_proxy = NULL;
         need_init = 1;
@@ -135,6 +139,7 @@ void
 systemd_cleanup(void)
 {
     if (systemd_proxy) {
+        systemd_unsubscribe();
         pcmk_dbus_disconnect(systemd_proxy);
         systemd_proxy = NULL;
     }
@@ -144,6 +149,327 @@ systemd_cleanup(void)
  * end of systemd_proxy functions
  */
 
+/*
+ * Unit state cache
+ *
+ * Each monitor would otherwise ask systemd for the unit's ActiveState (after
+ * looking up the unit). Instead, once subscribed to systemd's signals, we keep
+ * the ActiveState of each unit that has been monitored, updating it from the
+ * PropertiesChanged signals systemd sends, and asynchronous monitors answer
+ * from that. A unit's state is forgotten (so the next monitor asks systemd)
+ * whenever we act on the unit ourselves, systemd unloads the unit or reloads
+ * its configuration, or the connection is lost. Replies and signals arrive in
+ * the order systemd sent them, so a cached state is never older than the last
+ * reply we got.
+ *
+ * Synchronous monitors (from tools, which may not run a main loop to receive
+ * signals) always ask systemd. Set PCMK_systemd_subscribe to "false" to do so
+ * for all monitors.
+ *
+ * Probes come in bursts (for every resource, when a node joins), and most are
+ * for units that have not been monitored yet. So when a probe finds nothing
+ * cached after we subscribe or systemd reloads, the states of all loaded units
+ * are fetched with a single ListUnits call, and the rest of the burst is
+ * answered from that rather than with a LoadUnit and Get call per unit.
+ */
+
+#define SIGNAL_MATCH_PROPERTIES                                             \
+    "type='signal',sender='" BUS_NAME "',interface='"                       \
+    DBUS_INTERFACE_PROPERTIES "',member='PropertiesChanged',arg0='"         \
+    BUS_NAME_UNIT "'"
+
+#define SIGNAL_MATCH_MANAGER                                                \
+    "type='signal',sender='" BUS_NAME "',interface='" BUS_NAME_MANAGER "'"
+
+static bool subscribed = FALSE;
+static bool prime_needed = FALSE;       // whether to fetch all unit states
+static GHashTable *unit_paths = NULL;   // agent name -> unit object path
+static GHashTable *unit_states = NULL;  // unit object path -> ActiveState
+
+static bool
+unit_tracked(const char *path)
+{
+    return (unit_states != NULL) && (path != NULL)
+           && g_hash_table_lookup_extended(unit_states, path, NULL, NULL);
+}
+
+/* Update (or with state NULL, forget) the cached state of a tracked unit */
+static void
+unit_state_set(const char *path, const char *state)
+{
+    if (unit_tracked(path)) {
+
+        crm_trace("Unit %s ActiveState is %s", path,
+                  (state? state : "unknown"));
+        g_hash_table_replace(unit_states, strdup(path),
+                             (state? strdup(state) : NULL));
+    }
+}
+
+static void
+unit_properties_changed(DBusMessage *msg, const char *path)
+{
+    DBusMessageIter args;
+    DBusMessageIter dict;
+    DBusBasicValue value;
+
+    if (!dbus_message_iter_init(msg, &args)
+        || !pcmk_dbus_type_check(msg, &args, DBUS_TYPE_STRING,
+                                 __FUNCTION__, __LINE__)) {
+        return;
+    }
+    dbus_message_iter_get_basic(&args, &value);
+    if (strcmp(value.str, BUS_NAME_UNIT) != 0) {
+        return;
+    }
+
+    // Changed properties (a{sv})
+    dbus_message_iter_next(&args);
+    if (!pcmk_dbus_type_check(msg, &args, DBUS_TYPE_ARRAY,
+                              __FUNCTION__, __LINE__)) {
+        return;
+    }
+    dbus_message_iter_recurse(&args, &dict);
+    while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+        DBusMessageIter sv;
+        DBusMessageIter v;
+
+        dbus_message_iter_recurse(&dict, &sv);
+        if (dbus_message_iter_get_arg_type(&sv) == DBUS_TYPE_STRING) {
+            dbus_message_iter_get_basic(&sv, &value);
+            if (strcmp(value.str, "ActiveState") == 0) {
+                dbus_message_iter_next(&sv);
+                dbus_message_iter_recurse(&sv, &v);
+                if (dbus_message_iter_get_arg_type(&v) == DBUS_TYPE_STRING) {
+                    dbus_message_iter_get_basic(&v, &value);
+                    unit_state_set(path, value.str);
+                } else {
+                    unit_state_set(path, NULL);
+                }
+            }
+        }
+        dbus_message_iter_next(&dict);
+    }
+
+    // Invalidated properties (as), whose new values were not sent
+    dbus_message_iter_next(&args);
+    if (dbus_message_iter_get_arg_type(&args) == DBUS_TYPE_ARRAY) {
+        DBusMessageIter names;
+
+        dbus_message_iter_recurse(&args, &names);
+        while (dbus_message_iter_get_arg_type(&names) == DBUS_TYPE_STRING) {
+            dbus_message_iter_get_basic(&names, &value);
+            if (strcmp(value.str, "ActiveState") == 0) {
+                unit_state_set(path, NULL);
+            }
+            dbus_message_iter_next(&names);
+        }
+    }
+}
+
+static DBusHandlerResult
+systemd_signal_filter(DBusConnection *connection, DBusMessage *msg,
+                      void *user_data)
+{
+    if (dbus_message_is_signal(msg, DBUS_INTERFACE_PROPERTIES,
+                               "PropertiesChanged")) {
+        const char *path = dbus_message_get_path(msg);
+
+        if (unit_tracked(path)) {
+            unit_properties_changed(msg, path);
+        }
+
+    } else if (dbus_message_is_signal(msg, BUS_NAME_MANAGER, "UnitRemoved")) {
+        const char *id = NULL;
+        const char *path = NULL;
+
+        if (dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &id,
+                                  DBUS_TYPE_OBJECT_PATH, &path,
+                                  DBUS_TYPE_INVALID)) {
+            unit_state_set(path, NULL);
+        }
+
+    } else if (dbus_message_is_signal(msg, BUS_NAME_MANAGER, "Reloading")
+               && (unit_states != NULL)) {
+        // Units will be tracked again when next monitored
+        crm_trace("Forgetting cached unit states because systemd is reloading");
+        g_hash_table_remove_all(unit_paths);
+        g_hash_table_remove_all(unit_states);
+        prime_needed = TRUE;
+    }
+
+    // The connection is shared, so let any other filters see the signal too
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+/*!
+ * \internal
+ * \brief Subscribe to systemd unit signals, if enabled and not already done
+ *
+ * \return TRUE if subscribed, otherwise FALSE
+ */
+static bool
+systemd_subscribe(void)
+{
+    static int enabled = -1;
+    DBusMessage *reply = NULL;
+
+    if (enabled < 0) {
+        const char *value = daemon_option("systemd_subscribe");
+
+        enabled = (value == NULL) || crm_is_true(value);
+    }
+    if (subscribed || !enabled || (systemd_proxy == NULL)) {
+        return subscribed;
+    }
+
+    if (!dbus_connection_add_filter(systemd_proxy, systemd_signal_filter,
+                                    NULL, NULL)) {
+        crm_warn("Not caching systemd unit states: could not add filter");
+        enabled = 0;
+        return FALSE;
+    }
+    dbus_bus_add_match(systemd_proxy, SIGNAL_MATCH_PROPERTIES, NULL);
+    dbus_bus_add_match(systemd_proxy, SIGNAL_MATCH_MANAGER, NULL);
+
+    reply = systemd_call_simple_method("Subscribe");
+    if (reply == NULL) {
+        crm_warn("Not caching systemd unit states: could not subscribe");
+        dbus_bus_remove_match(systemd_proxy, SIGNAL_MATCH_PROPERTIES, NULL);
+        dbus_bus_remove_match(systemd_proxy, SIGNAL_MATCH_MANAGER, NULL);
+        dbus_connection_remove_filter(systemd_proxy, systemd_signal_filter,
+                                      NULL);
+        enabled = 0;
+        return FALSE;
+    }
+    dbus_message_unref(reply);
+
+    unit_paths = crm_str_table_new();
+    unit_states = crm_str_table_new();
+    subscribed = TRUE;
+    prime_needed = TRUE;
+    crm_debug("Caching systemd unit states from signals");
+    return TRUE;
+}
+
+static void
+systemd_unsubscribe(void)
+{
+    if (subscribed) {
+        if (dbus_connection_get_is_connected(systemd_proxy)) {
+            dbus_bus_remove_match(systemd_proxy, SIGNAL_MATCH_PROPERTIES, NULL);
+            dbus_bus_remove_match(systemd_proxy, SIGNAL_MATCH_MANAGER, NULL);
+        }
+        dbus_connection_remove_filter(systemd_proxy, systemd_signal_filter,
+                                      NULL);
+        g_hash_table_destroy(unit_paths);
+        g_hash_table_destroy(unit_states);
+        unit_paths = unit_states = NULL;
+        subscribed = FALSE;
+    }
+}
+
+/* Start tracking a unit's state (which is unknown until systemd tells us) */
+static void
+unit_state_track(const char *agent, const char *path)
+{
+    if (subscribed && (agent != NULL) && (path != NULL)
+        && !unit_tracked(path)) {
+
+        g_hash_table_replace(unit_paths, strdup(agent), strdup(path));
+        g_hash_table_replace(unit_states, strdup(path), NULL);
+    }
+}
+
+static const char *
+unit_state_path(const char *agent)
+{
+    return (subscribed && (agent != NULL))?
+           g_hash_table_lookup(unit_paths, agent) : NULL;
+}
+
+/* Get a unit's cached ActiveState, or NULL if not known */
+static const char *
+unit_state_get(const char *agent)
+{
+    const char *path = unit_state_path(agent);
+
+    return path? g_hash_table_lookup(unit_states, path) : NULL;
+}
+
+/* Cache the state of one ListUnits entry (ssssssouso) */
+static void
+unit_state_list_entry(DBusMessage *reply, DBusMessageIter *entry)
+{
+    DBusMessageIter elem;
+    DBusBasicValue value;
+    const char *fields[7] = { NULL, };
+    const char *ext = NULL;
+
+    dbus_message_iter_recurse(entry, &elem);
+
+    // name, description, load state, active state, sub state, following, path
+    for (int lpc = 0; lpc < 7; lpc++) {
+        int type = (lpc == 6)? DBUS_TYPE_OBJECT_PATH : DBUS_TYPE_STRING;
+
+        if (!pcmk_dbus_type_check(reply, &elem, type, __FUNCTION__, __LINE__)) {
+            return;
+        }
+        dbus_message_iter_get_basic(&elem, &value);
+        fields[lpc] = value.str;
+        dbus_message_iter_next(&elem);
+    }
+
+    ext = systemd_unit_extension(fields[0]);
+    if ((ext == NULL) || safe_str_neq(fields[2], "loaded")) {
+        return;
+    }
+
+    g_hash_table_replace(unit_paths, strdup(fields[0]), strdup(fields[6]));
+    if (!strcmp(ext, ".service")) {
+        // Agents may name services without the extension
+        g_hash_table_replace(unit_paths, strndup(fields[0], ext - fields[0]),
+                             strdup(fields[6]));
+    }
+    g_hash_table_replace(unit_states, strdup(fields[6]), strdup(fields[3]));
+}
+
+/* Cache the states of all loaded units, if not done since the last reload */
+static void
+unit_states_prime(void)
+{
+    DBusMessage *reply = NULL;
+    DBusMessageIter args;
+    DBusMessageIter entry;
+
+    if (!subscribed || !prime_needed) {
+        return;
+    }
+    prime_needed = FALSE;
+
+    reply = systemd_call_simple_method("ListUnits");
+    if (reply == NULL) {
+        return;
+    }
+    if (dbus_message_iter_init(reply, &args)
+        && pcmk_dbus_type_check(reply, &args, DBUS_TYPE_ARRAY,
+                                __FUNCTION__, __LINE__)) {
+
+        dbus_message_iter_recurse(&args, &entry);
+        while (dbus_message_iter_get_arg_type(&entry) == DBUS_TYPE_STRUCT) {
+            unit_state_list_entry(reply, &entry);
+            dbus_message_iter_next(&entry);
+        }
+        crm_trace("Cached states of %u loaded systemd units",
+                  g_hash_table_size(unit_states));
+    }
+    dbus_message_unref(reply);
+}
+
+/*
+ * end of unit state cache functions
+ */
+
 /*!
  * \internal
  * \brief Check whether a file name represents a manageable systemd unit
@@ -565,27 +891,33 @@ systemd_async_dispatch(DBusPendingCall *pending, void *user_data)
 
 #define SYSTEMD_OVERRIDE_ROOT "/run/systemd/system/"
 
-static void
-systemd_unit_check(const char *name, const char *state, void *userdata)
+static int
+systemd_state_rc(const char *state)
 {
-    svc_action_t * op = userdata;
-
-    crm_trace("Resource %s has %s='%s'", op->rsc, name, state);
-
     if(state == NULL) {
-        op->rc = PCMK_OCF_NOT_RUNNING;
+        return PCMK_OCF_NOT_RUNNING;
 
     } else if (g_strcmp0(state, "active") == 0) {
-        op->rc = PCMK_OCF_OK;
+        return PCMK_OCF_OK;
     } else if (g_strcmp0(state, "reloading") == 0) {
-        op->rc = PCMK_OCF_OK;
+        return PCMK_OCF_OK;
     } else if (g_strcmp0(state, "activating") == 0) {
-        op->rc = PCMK_OCF_PENDING;
+        return PCMK_OCF_PENDING;
     } else if (g_strcmp0(state, "deactivating") == 0) {
-        op->rc = PCMK_OCF_PENDING;
-    } else {
-        op->rc = PCMK_OCF_NOT_RUNNING;
+        return PCMK_OCF_PENDING;
     }
+    return PCMK_OCF_NOT_RUNNING;
+}
+
+static void
+systemd_unit_check(const char *name, const char *state, void *userdata)
+{
+    svc_action_t * op = userdata;
+
+    crm_trace("Resource %s has %s='%s'", op->rsc, name, state);
+
+    op->rc = systemd_state_rc(state);
+    unit_state_set(unit_state_path(op->agent), state);
 
     if (op->synchronous == FALSE) {
         services_set_op_pending(op, NULL);
@@ -606,6 +938,8 @@ systemd_unit_exec_with_unit(svc_action_t * op, const char *unit)
         DBusPendingCall *pending = NULL;
         char *state;
 
+        unit_state_track(op->agent, unit);
+
         state = systemd_get_property(unit, "ActiveState",
                                      (op->synchronous? NULL : systemd_unit_check),
                                      op, (op->synchronous? NULL : &pending),
@@ -768,6 +1102,30 @@ systemd_unit_exec(svc_action_t * op)
         return TRUE;
     }
 
+    if (safe_str_eq(op->action, "monitor")
+        || safe_str_eq(op->action, "status")) {
+
+        if (!op->synchronous && systemd_subscribe()
+            && (op->interval_ms == 0) && (unit_state_get(op->agent) == NULL)) {
+            unit_states_prime();
+        }
+
+        if (!op->synchronous && systemd_subscribe()
+            && (unit_state_get(op->agent) != NULL)) {
+
+            const char *state = unit_state_get(op->agent);
+
+            crm_trace("Resource %s has cached ActiveState='%s'",
+                      op->rsc, state);
+            op->rc = systemd_state_rc(state);
+            return operation_finalize(op);
+        }
+
+    } else {
+        // Whatever we do to the unit, ask systemd for its state next time
+        unit_state_set(unit_state_path(op->agent), NULL);
+    }
+
     unit = systemd_unit_by_name(op->agent, op);
     free(unit);
 
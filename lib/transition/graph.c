@@ -27,36 +27,38 @@
 
 crm_graph_functions_t *graph_fns = NULL;
 
-static gboolean
-update_synapse_ready(synapse_t * synapse, int action_id)
+/*!
+ * \brief Find an action in a transition graph by its ID
+ *
+ * \param[in] graph  Transition graph to search
+ * \param[in] id     ID of action to find
+ *
+ * \return Action (not an input copy of it) with \p id, or NULL if none
+ */
+crm_action_t *
+find_graph_action(crm_graph_t * graph, int id)
 {
-    GListPtr lpc = NULL;
-    gboolean updates = FALSE;
+    if ((graph == NULL) || (graph->actions_by_id == NULL)) {
+        return NULL;
+    }
+    return g_hash_table_lookup(graph->actions_by_id, GINT_TO_POINTER(id));
+}
 
+static gboolean
+update_synapse_ready(synapse_t * synapse, crm_action_t * prereq)
+{
     CRM_CHECK(synapse->executed == FALSE, return FALSE);
     CRM_CHECK(synapse->confirmed == FALSE, return FALSE);
 
-    synapse->ready = TRUE;
-    for (lpc = synapse->inputs; lpc != NULL; lpc = lpc->next) {
-        crm_action_t *prereq = (crm_action_t *) lpc->data;
-
-        crm_trace("Processing input %d", prereq->id);
-
-        if (prereq->id == action_id) {
-            crm_trace("Marking input %d of synapse %d confirmed", action_id, synapse->id);
-            prereq->confirmed = TRUE;
-            updates = TRUE;
-
-        } else if (prereq->confirmed == FALSE) {
-            synapse->ready = FALSE;
-        }
-
+    if (prereq->confirmed == FALSE) {
+        crm_trace("Marking input %d of synapse %d confirmed", prereq->id, synapse->id);
+        prereq->confirmed = TRUE;
+        synapse->pending_inputs--;
     }
+    synapse->ready = (synapse->pending_inputs == 0);
 
-    if (updates) {
-        crm_trace("Updated synapse %d", synapse->id);
-    }
-    return updates;
+    crm_trace("Updated synapse %d", synapse->id);
+    return TRUE;
 }
 
 static gboolean
@@ -98,27 +100,47 @@ update_synapse_confirmed(synapse_t * synapse, int action_id)
     return updates;
 }
 
+/*
+ * Only the synapse that contains the action, and the synapses that have it as
+ * an input, can be affected by its completion, so they are found via the
+ * graph's indexes rather than by checking every synapse.
+ */
 gboolean
 update_graph(crm_graph_t * graph, crm_action_t * action)
 {
-    gboolean rc = FALSE;
     gboolean updates = FALSE;
+    crm_action_t *match = find_graph_action(graph, action->id);
     GListPtr lpc = NULL;
 
-    for (lpc = graph->synapses; lpc != NULL; lpc = lpc->next) {
-        synapse_t *synapse = (synapse_t *) lpc->data;
+    if ((match != NULL) && (match->synapse != NULL)) {
+        synapse_t *synapse = match->synapse;
+
+        if (synapse->confirmed || synapse->failed) {
+            crm_trace("Synapse complete");
+
+        } else if (synapse->executed) {
+            crm_trace("Synapse executed");
+            updates = update_synapse_confirmed(synapse, action->id);
+        }
+    }
+
+    if (graph->consumers != NULL) {
+        lpc = g_hash_table_lookup(graph->consumers,
+                                  GINT_TO_POINTER(action->id));
+    }
+    for (; lpc != NULL; lpc = lpc->next) {
+        crm_action_t *prereq = (crm_action_t *) lpc->data;
+        synapse_t *synapse = prereq->synapse;
 
         if (synapse->confirmed || synapse->failed) {
             crm_trace("Synapse complete");
 
         } else if (synapse->executed) {
             crm_trace("Synapse executed");
-            rc = update_synapse_confirmed(synapse, action->id);
 
         } else if (action->failed == FALSE || synapse->priority == INFINITY) {
-            rc = update_synapse_ready(synapse, action->id);
+            updates = update_synapse_ready(synapse, prereq) || updates;
         }
-        updates = updates || rc;
     }
 
     if (updates) {
@@ -135,6 +157,14 @@ should_fire_synapse(crm_graph_t * graph, synapse_t * synapse)
     CRM_CHECK(synapse->executed == FALSE, return FALSE);
     CRM_CHECK(synapse->confirmed == FALSE, return FALSE);
 
+    if (synapse->pending_inputs > 0) {
+        crm_trace("Synapse %d still has %d unconfirmed input%s",
+                  synapse->id, synapse->pending_inputs,
+                  ((synapse->pending_inputs == 1)? "" : "s"));
+        synapse->ready = FALSE;
+        return FALSE;
+    }
+
     crm_trace("Checking pre-reqs for synapse %d", synapse->id);
     /* lookup prereqs */
     synapse->ready = TRUE;
@@ -184,6 +214,16 @@ initiate_action(crm_graph_t * graph, crm_action_t * action)
     CRM_CHECK(id != NULL, return FALSE);
 
     action->executed = TRUE;
+    if (pcmk__trace_active) {
+        const char *key = crm_element_value(action->xml, XML_LRM_ATTR_TASK_KEY);
+
+        if (key == NULL) {
+            key = crm_element_value(action->xml, XML_LRM_ATTR_TASK);
+        }
+        pcmk__trace_event_add(pcmk__trace_action_dispatch, action->id,
+                              graph->id, key);
+    }
+
     if (action->type == action_type_pseudo) {
         crm_trace("Executing pseudo-event: %s (%d)", id, action->id);
         return graph_fns->pseudo(graph, action);
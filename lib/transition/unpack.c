@@ -28,8 +28,40 @@
 
 CRM_TRACE_INIT_DATA(transitioner);
 
+/*!
+ * \internal
+ * \brief Restore the parameters an action shares with others in the graph
+ *
+ * \param[in,out] action_xml  Action XML (copied from graph)
+ * \param[in]     param_sets  Graph's parameter sets, indexed by ID
+ */
+static void
+expand_parameter_set(xmlNode *action_xml, GHashTable *param_sets)
+{
+    const char *set_id = crm_element_value(action_xml, XML_GRAPH_ATTR_PARAM_SET);
+    xmlNode *set_attrs = NULL;
+    xmlNode *attrs = NULL;
+
+    if (set_id == NULL) {
+        return;
+    }
+
+    set_attrs = g_hash_table_lookup(param_sets, set_id);
+    attrs = first_named_child(action_xml, XML_TAG_ATTRS);
+    if ((set_attrs == NULL) || (attrs == NULL)) {
+        crm_err("Action %s refers to unknown parameter set %s",
+                ID(action_xml), set_id);
+
+    } else {
+        for (xmlAttrPtr a = crm_first_attr(set_attrs); a != NULL; a = a->next) {
+            crm_xml_add(attrs, (const char *) a->name, crm_attr_value(a));
+        }
+    }
+    xml_remove_prop(action_xml, XML_GRAPH_ATTR_PARAM_SET);
+}
+
 static crm_action_t *
-unpack_action(synapse_t * parent, xmlNode * xml_action)
+unpack_action(synapse_t * parent, xmlNode * xml_action, GHashTable *param_sets)
 {
     crm_action_t *action = NULL;
     const char *value = crm_element_value(xml_action, XML_ATTR_ID);
@@ -51,6 +83,7 @@ unpack_action(synapse_t * parent, xmlNode * xml_action)
     action->type = action_type_rsc;
     action->xml = copy_xml(xml_action);
     action->synapse = parent;
+    expand_parameter_set(action->xml, param_sets);
 
     if (safe_str_eq(crm_element_name(action->xml), XML_GRAPH_TAG_RSC_OP)) {
         action->type = action_type_rsc;
@@ -91,7 +124,8 @@ unpack_action(synapse_t * parent, xmlNode * xml_action)
 }
 
 static synapse_t *
-unpack_synapse(crm_graph_t * new_graph, xmlNode * xml_synapse)
+unpack_synapse(crm_graph_t * new_graph, xmlNode * xml_synapse,
+               GHashTable *param_sets)
 {
     const char *value = NULL;
     xmlNode *inputs = NULL;
@@ -123,7 +157,8 @@ unpack_synapse(crm_graph_t * new_graph, xmlNode * xml_synapse)
 
             for (action = __xml_first_child(action_set); action != NULL;
                  action = __xml_next(action)) {
-                crm_action_t *new_action = unpack_action(new_synapse, action);
+                crm_action_t *new_action = unpack_action(new_synapse, action,
+                                                             param_sets);
 
                 if (new_action == NULL) {
                     continue;
@@ -134,6 +169,8 @@ unpack_synapse(crm_graph_t * new_graph, xmlNode * xml_synapse)
                 crm_trace("Adding action %d to synapse %d", new_action->id, new_synapse->id);
 
                 new_synapse->actions = g_list_append(new_synapse->actions, new_action);
+                g_hash_table_replace(new_graph->actions_by_id,
+                                     GINT_TO_POINTER(new_action->id), new_action);
             }
         }
     }
@@ -149,7 +186,9 @@ unpack_synapse(crm_graph_t * new_graph, xmlNode * xml_synapse)
                 xmlNode *input = NULL;
 
                 for (input = __xml_first_child(trigger); input != NULL; input = __xml_next(input)) {
-                    crm_action_t *new_input = unpack_action(new_synapse, input);
+                    crm_action_t *new_input = unpack_action(new_synapse, input,
+                                                            param_sets);
+                    GList *consumers = NULL;
 
                     if (new_input == NULL) {
                         continue;
@@ -158,6 +197,18 @@ unpack_synapse(crm_graph_t * new_graph, xmlNode * xml_synapse)
                     crm_trace("Adding input %d to synapse %d", new_input->id, new_synapse->id);
 
                     new_synapse->inputs = g_list_append(new_synapse->inputs, new_input);
+                    new_synapse->pending_inputs++;
+
+                    /* Inserting after the head leaves the table's value valid */
+                    consumers = g_hash_table_lookup(new_graph->consumers,
+                                                    GINT_TO_POINTER(new_input->id));
+                    if (consumers == NULL) {
+                        g_hash_table_insert(new_graph->consumers,
+                                            GINT_TO_POINTER(new_input->id),
+                                            g_list_prepend(NULL, new_input));
+                    } else {
+                        g_list_insert(consumers, new_input, 1);
+                    }
                 }
             }
         }
@@ -185,6 +236,8 @@ unpack_graph(xmlNode * xml_graph, const char *reference)
     const char *t_id = NULL;
     const char *time = NULL;
     xmlNode *synapse = NULL;
+    xmlNode *set = NULL;
+    GHashTable *param_sets = NULL;
 
     new_graph = calloc(1, sizeof(crm_graph_t));
 
@@ -194,6 +247,10 @@ unpack_graph(xmlNode * xml_graph, const char *reference)
     new_graph->transition_timeout = -1;
     new_graph->stonith_timeout = -1;
     new_graph->completion_action = tg_done;
+    new_graph->actions_by_id = g_hash_table_new(g_direct_hash, g_direct_equal);
+    new_graph->consumers = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                                 NULL,
+                                                 (GDestroyNotify) g_list_free);
 
     if (reference) {
         new_graph->source = strdup(reference);
@@ -203,12 +260,12 @@ unpack_graph(xmlNode * xml_graph, const char *reference)
 
     if (xml_graph != NULL) {
         t_id = crm_element_value(xml_graph, "transition_id");
-        CRM_CHECK(t_id != NULL, free(new_graph);
+        CRM_CHECK(t_id != NULL, destroy_graph(new_graph);
                   return NULL);
         new_graph->id = crm_parse_int(t_id, "-1");
 
         time = crm_element_value(xml_graph, "cluster-delay");
-        CRM_CHECK(time != NULL, free(new_graph);
+        CRM_CHECK(time != NULL, destroy_graph(new_graph);
                   return NULL);
         new_graph->network_delay = crm_get_msec(time);
 
@@ -226,9 +283,25 @@ unpack_graph(xmlNode * xml_graph, const char *reference)
         new_graph->migration_limit = crm_parse_int(t_id, "-1");
     }
 
+    /* The scheduler lists parameters shared by several actions once, if the
+     * requester asked for it, so index them for unpack_action() to expand
+     */
+    param_sets = g_hash_table_new(crm_str_hash, g_str_equal);
+    for (set = first_named_child(first_named_child(xml_graph,
+                                                   XML_GRAPH_TAG_PARAM_SET "s"),
+                                 XML_GRAPH_TAG_PARAM_SET);
+         set != NULL; set = crm_next_same_xml(set)) {
+
+        if (ID(set) != NULL) {
+            g_hash_table_insert(param_sets, (gpointer) ID(set),
+                                first_named_child(set, XML_TAG_ATTRS));
+        }
+    }
+
     for (synapse = __xml_first_child(xml_graph); synapse != NULL; synapse = __xml_next(synapse)) {
         if (crm_str_eq((const char *)synapse->name, "synapse", TRUE)) {
-            synapse_t *new_synapse = unpack_synapse(new_graph, synapse);
+            synapse_t *new_synapse = unpack_synapse(new_graph, synapse,
+                                                    param_sets);
 
             if (new_synapse != NULL) {
                 new_graph->synapses = g_list_append(new_graph->synapses, new_synapse);
@@ -236,6 +309,8 @@ unpack_graph(xmlNode * xml_graph, const char *reference)
         }
     }
 
+    g_hash_table_destroy(param_sets);
+
     crm_debug("Unpacked transition %d: %d actions in %d synapses",
               new_graph->id, new_graph->num_actions, new_graph->num_synapses);
 
@@ -245,9 +320,12 @@ unpack_graph(xmlNode * xml_graph, const char *reference)
 static void
 destroy_action(crm_action_t * action)
 {
+    /* Action timers are not mainloop sources, so the caller must stop them
+     * before destroying the graph
+     */
     if (action->timer && action->timer->source_id != 0) {
-        crm_warn("Cancelling timer for action %d (src=%d)", action->id, action->timer->source_id);
-        g_source_remove(action->timer->source_id);
+        crm_warn("Timer for action %d (id=%d) still active when graph destroyed",
+                 action->id, action->timer->source_id);
     }
     if (action->params) {
         g_hash_table_destroy(action->params);
@@ -282,6 +360,12 @@ destroy_graph(crm_graph_t * graph)
     if (graph == NULL) {
         return;
     }
+    if (graph->actions_by_id != NULL) {
+        g_hash_table_destroy(graph->actions_by_id);
+    }
+    if (graph->consumers != NULL) {
+        g_hash_table_destroy(graph->consumers);
+    }
     while (g_list_length(graph->synapses) > 0) {
         synapse_t *synapse = g_list_nth_data(graph->synapses, 0);
 
@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <libgen.h>
 
 #include <sys/param.h>
@@ -36,7 +37,8 @@ static struct crm_option long_options[] = {
     {"update-delay", 0, 0, 'Y', "Update the attribute's dampening in pacemaker-attrd (requires -d/--delay). If this causes the dampening to change, the attribute will also be written to the cluster configuration, so be aware that repeatedly changing the dampening reduces its effectiveness."},
     {"query",   0, 0, 'Q', "\tQuery the attribute's value from pacemaker-attrd"},
     {"delete",  0, 0, 'D', "\tDelete the attribute in pacemaker-attrd.  If a value was previously set, it will also be removed from the cluster configuration"},
-    {"refresh", 0, 0, 'R', "\t(Advanced) Force the pacemaker-attrd daemon to resend all current values to the CIB\n"},
+    {"refresh", 0, 0, 'R', "\t(Advanced) Force the pacemaker-attrd daemon to resend all current values to the CIB"},
+    {"batch",   0, 0, 'b', "\tUpdate many attributes in one request, reading one update per line from standard input, as name=NAME [value=VALUE] [node=NODE] [delay=DELAY] [set=SET] (defaulting to -N/-d/-s values). Values containing spaces may be double-quoted. Without value, the attribute is deleted.\n"},
 
     {"-spacer-",1, 0, '-', "\nAdditional options:"},
     {"delay",   1, 0, 'd', "The time to wait (dampening) in seconds for further changes before writing"},
@@ -46,6 +48,8 @@ static struct crm_option long_options[] = {
     /* lifetime could be implemented if there is sufficient user demand */
     {"lifetime",1, 0, 'l', "(Deprecated) Lifetime of the node attribute (silently ignored by cluster)"},
     {"private", 0, 0, 'p', "\tIf this creates a new attribute, never write the attribute to the CIB"},
+    {"metric",  0, 0, 'M', "\tIf this creates a new attribute, make it a metric: write it to the CIB only when its value crosses one of the thresholds, and use the delay as the minimum interval between sending updates to other nodes (update only)"},
+    {"thresholds", 1, 0, 'T', "Comma-separated ascending list of numbers at which to write a metric attribute to the CIB (with -M/--metric)"},
 
     /* Legacy options */
     {"quiet",   0, 0, 'q', NULL, pcmk_option_hidden},
@@ -59,6 +63,12 @@ static int do_query(const char *attr_name, const char *attr_node, gboolean query
 static int do_update(char command, const char *attr_node, const char *attr_name,
                      const char *attr_value, const char *attr_section,
                      const char *attr_set, const char *attr_dampen, int attr_options);
+static int do_update_metric(const char *attr_node, const char *attr_name,
+                            const char *attr_value, const char *attr_dampen,
+                            const char *attr_thresholds, int attr_options);
+static int do_batch(const char *attr_node, const char *attr_section,
+                    const char *attr_set, const char *attr_dampen,
+                    int attr_options);
 
 int
 main(int argc, char **argv)
@@ -74,9 +84,11 @@ main(int argc, char **argv)
     const char *attr_set = NULL;
     const char *attr_section = NULL;
     const char *attr_dampen = NULL;
+    const char *attr_thresholds = NULL;
     char command = 'Q';
 
     gboolean query_all = FALSE;
+    gboolean metric = FALSE;
 
     crm_log_cli_init("attrd_updater");
     crm_set_options(NULL, "command -n attribute [options]", long_options,
@@ -121,9 +133,16 @@ main(int argc, char **argv)
             case 'p':
                 set_bit(attr_options, attrd_opt_private);
                 break;
+            case 'M':
+                metric = TRUE;
+                break;
+            case 'T':
+                attr_thresholds = strdup(optarg);
+                break;
             case 'q':
                 break;
             case 'Y':
+            case 'b':
                 command = flag;
                 crm_log_args(argc, argv); /* Too much? */
                 break;
@@ -147,7 +166,12 @@ main(int argc, char **argv)
         ++argerr;
     }
 
-    if (command != 'R' && attr_name == NULL) {
+    if ((command != 'R') && (command != 'b') && (attr_name == NULL)) {
+        ++argerr;
+    }
+
+    if (metric && (command != 'U') && (command != 'v') && (command != 'B')
+        && (command != 'D')) {
         ++argerr;
     }
 
@@ -165,9 +189,20 @@ main(int argc, char **argv)
          */
 
         attr_node = attrd_get_target(attr_node);
-        exit_code = crm_errno2exit(do_update(command, attr_node, attr_name,
-                                   attr_value, attr_section, attr_set,
-                                   attr_dampen, attr_options));
+        if (command == 'b') {
+            exit_code = crm_errno2exit(do_batch(attr_node, attr_section,
+                                                attr_set, attr_dampen,
+                                                attr_options));
+        } else if (metric) {
+            exit_code = crm_errno2exit(do_update_metric(attr_node, attr_name,
+                                       ((command == 'D')? NULL : attr_value),
+                                       attr_dampen, attr_thresholds,
+                                       attr_options));
+        } else {
+            exit_code = crm_errno2exit(do_update(command, attr_node, attr_name,
+                                       attr_value, attr_section, attr_set,
+                                       attr_dampen, attr_options));
+        }
     }
     return crm_exit(exit_code);
 }
@@ -357,3 +392,208 @@ do_update(char command, const char *attr_node, const char *attr_name,
     }
     return rc;
 }
+
+static int
+do_update_metric(const char *attr_node, const char *attr_name,
+                 const char *attr_value, const char *attr_dampen,
+                 const char *attr_thresholds, int attr_options)
+{
+    int rc = attrd_update_metric(NULL, attr_node, attr_name, attr_value,
+                                 attr_dampen, attr_thresholds, NULL,
+                                 attr_options);
+    if (rc != pcmk_ok) {
+        fprintf(stderr, "Could not update metric %s=%s: %s (%d)\n",
+                attr_name, attr_value, pcmk_strerror(rc), rc);
+    }
+    return rc;
+}
+
+static void
+free_batch_update(gpointer data)
+{
+    attrd_update_t *update = data;
+
+    free(update->host);
+    free(update->name);
+    free(update->value);
+    free(update->dampen);
+    free(update->set);
+    free(update);
+}
+
+/*!
+ * \internal
+ * \brief Get the next field from a line of batch input
+ *
+ * Fields are separated by whitespace, except within double quotes, so that
+ * values may contain spaces (as in value="a b"). The quotes are removed, and
+ * within them, a backslash escapes the next character.
+ *
+ * \param[in,out] line  Rest of line (will be modified, and advanced past the
+ *                      field)
+ * \param[out]    word  Where to store field (pointing into \p line), or NULL
+ *                      at the end of the line or at a comment
+ *
+ * \return pcmk_ok on success, or -EINVAL if a quote is not closed
+ */
+static int
+next_batch_field(char **line, char **word)
+{
+    char *in = *line + strspn(*line, " \t\r\n");
+    char *out = in;
+    gboolean quoted = FALSE;
+
+    *word = NULL;
+    if ((*in == '\0') || (*in == '#')) {
+        *line = in;
+        return pcmk_ok;
+    }
+
+    *word = in;
+    for (; *in != '\0'; in++) {
+        if (*in == '"') {
+            quoted = !quoted;
+        } else if (quoted && (*in == '\\') && (in[1] != '\0')) {
+            *out++ = *++in;
+        } else if (!quoted && (strchr(" \t\r\n", *in) != NULL)) {
+            in++;
+            break;
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+    *line = in;
+    return quoted? -EINVAL : pcmk_ok;
+}
+
+/*!
+ * \internal
+ * \brief Parse one line of batch input
+ *
+ * \param[in] line       Input line (will be modified)
+ * \param[in] line_num   Line number (for error messages)
+ * \param[in] attr_node  Default node
+ * \param[in] attr_set   Default attribute set
+ * \param[in] attr_dampen  Default dampening
+ * \param[out] rc         Set to -EINVAL if the line is invalid
+ *
+ * \return Newly allocated update, or NULL if the line is blank, a comment,
+ *         or invalid (in which case *rc is set to -EINVAL)
+ */
+static attrd_update_t *
+parse_batch_line(char *line, int line_num, const char *attr_node,
+                 const char *attr_set, const char *attr_dampen, int *rc)
+{
+    attrd_update_t *update = calloc(1, sizeof(attrd_update_t));
+    char *word = NULL;
+
+    CRM_ASSERT(update != NULL);
+
+    while (TRUE) {
+        char *value = NULL;
+        char **field = NULL;
+
+        if (next_batch_field(&line, &word) != pcmk_ok) {
+            fprintf(stderr, "Line %d: unterminated quote\n", line_num);
+            *rc = -EINVAL;
+            free_batch_update(update);
+            return NULL;
+        }
+        if (word == NULL) {
+            break;
+        }
+
+        value = strchr(word, '=');
+        if (value == NULL) {
+            fprintf(stderr, "Line %d: expected name=value, not '%s'\n",
+                    line_num, word);
+            *rc = -EINVAL;
+            free_batch_update(update);
+            return NULL;
+        }
+        *value++ = '\0';
+
+        if (safe_str_eq(word, "name")) {
+            field = &update->name;
+        } else if (safe_str_eq(word, "value")) {
+            field = &update->value;
+        } else if (safe_str_eq(word, "node") || safe_str_eq(word, "host")) {
+            field = &update->host;
+        } else if (safe_str_eq(word, "delay")) {
+            field = &update->dampen;
+        } else if (safe_str_eq(word, "set")) {
+            field = &update->set;
+        } else {
+            fprintf(stderr, "Line %d: unknown field '%s'\n", line_num, word);
+            *rc = -EINVAL;
+            free_batch_update(update);
+            return NULL;
+        }
+        free(*field);
+        *field = strdup(value);
+    }
+
+    if ((update->name == NULL) && (update->value == NULL)
+        && (update->host == NULL) && (update->dampen == NULL)
+        && (update->set == NULL)) {
+        free_batch_update(update);
+        return NULL; // Blank line or comment
+    }
+    if (update->name == NULL) {
+        fprintf(stderr, "Line %d: no attribute name given\n", line_num);
+        *rc = -EINVAL;
+        free_batch_update(update);
+        return NULL;
+    }
+
+    if ((update->host == NULL) && (attr_node != NULL)) {
+        update->host = strdup(attr_node);
+    }
+    if ((update->dampen == NULL) && (attr_dampen != NULL)) {
+        update->dampen = strdup(attr_dampen);
+    }
+    if ((update->set == NULL) && (attr_set != NULL)) {
+        update->set = strdup(attr_set);
+    }
+    return update;
+}
+
+/*!
+ * \internal
+ * \brief Read updates from standard input and submit them in one request
+ *
+ * \return pcmk_ok on success, -errno on error
+ */
+static int
+do_batch(const char *attr_node, const char *attr_section, const char *attr_set,
+         const char *attr_dampen, int attr_options)
+{
+    char line[4096];
+    int line_num = 0;
+    int rc = pcmk_ok;
+    GList *updates = NULL;
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        attrd_update_t *update = NULL;
+
+        line_num++;
+        update = parse_batch_line(line, line_num, attr_node, attr_set,
+                                  attr_dampen, &rc);
+        if (update != NULL) {
+            updates = g_list_prepend(updates, update);
+        }
+    }
+
+    if (rc == pcmk_ok) {
+        updates = g_list_reverse(updates);
+        rc = attrd_update_batch(NULL, updates, attr_section, NULL,
+                                attr_options);
+        if (rc != pcmk_ok) {
+            fprintf(stderr, "Could not update attributes: %s (%d)\n",
+                    pcmk_strerror(rc), rc);
+        }
+    }
+    g_list_free_full(updates, free_batch_update);
+    return rc;
+}
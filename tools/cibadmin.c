@@ -22,6 +22,7 @@ const char *host = NULL;
 const char *cib_user = NULL;
 const char *cib_action = NULL;
 const char *obj_type = NULL;
+const char *query_attrs = NULL;
 
 cib_t *the_cib = NULL;
 GMainLoop *mainloop = NULL;
@@ -52,6 +53,10 @@ static struct crm_option long_options[] = {
     {"-spacer-",    0, 0, '-', "\n\tThe tagname and all attributes must match in order for the element to be deleted\n"},
     {"delete-all",  0, 0, 'd', "When used with --xpath, remove all matching objects in the configuration instead of just the first one"},
     {"empty",       0, 0, 'a', "\tOutput an empty CIB"},
+    {"batch",       0, 0, 'T', "\tApply several requests atomically, as a single CIB update"},
+    {"-spacer-",    0, 0, '-', "\n\tThe input must be a <cib_transaction> with one <create>, <modify>, <delete> or <bump> element per request (with an optional scope attribute), each containing the object to use\n"},
+    {"bulk-load",   0, 0, 'L', "Create many objects as a single CIB update, sending them in parts so that no one request is too large"},
+    {"-spacer-",    0, 0, '-', "\n\tThe input may be a CIB section (such as <resources>) or <configuration>, each of whose objects is created (or, with --allow-create, created or updated), or a <cib_transaction> as for --batch\n"},
     {"md5-sum",	    0, 0, '5', "\tCalculate the on-disk CIB digest"},
     {"md5-sum-versioned",  0, 0, '6', "Calculate an on-the-wire versioned CIB digest"},
     {"blank",       0, 0, '-', NULL, 1},
@@ -76,6 +81,7 @@ static struct crm_option long_options[] = {
 
     {"xpath",       1, 0, 'A', "A valid XPath to use instead of --scope,-o"},
     {"node-path",   0, 0, 'e',  "When performing XPath queries, return the address of any matches found."},
+    {"attributes",  1, 0, 'k',  "When performing XPath queries, return only the named attributes (separated by spaces or commas) of any matches found, without their children."},
     {"-spacer-",    0, 0, '-', " Eg: /cib/configuration/resources/clone[@id='ms_RH1_SCS']/primitive[@id='prm_RH1_SCS']", pcmk_option_paragraph},
     {"node",	    1, 0, 'N', "(Advanced) Send command to the specified host\n"},
     {"-space-",	    0, 0, '!', NULL, 1},
@@ -90,6 +96,9 @@ static struct crm_option long_options[] = {
     {"-spacer-",    0, 0, '-', "Query all 'target-role' settings:", pcmk_option_paragraph},
     {"-spacer-",    0, 0, '-', " cibadmin --query --xpath \"//nvpair[@name='target-role']\"", pcmk_option_example},
 
+    {"-spacer-",    0, 0, '-', "Query the last call ID recorded for each node's history of resource 'rsc1':", pcmk_option_paragraph},
+    {"-spacer-",    0, 0, '-', " cibadmin --query --xpath \"//lrm_resource[@id='rsc1']/lrm_rsc_op\" --attributes \"id call-id\"", pcmk_option_example},
+
     {"-spacer-",    0, 0, '-', "Remove all 'is-managed' settings:", pcmk_option_paragraph},
     {"-spacer-",    0, 0, '-', " cibadmin --delete-all --xpath \"//nvpair[@name='is-managed']\"", pcmk_option_example},
 
@@ -105,6 +114,12 @@ static struct crm_option long_options[] = {
     {"-spacer-",    0, 0, '-', "Replace the constraints section of the configuration with the contents of $HOME/constraints.xml:", pcmk_option_paragraph},
     {"-spacer-",    0, 0, '-', " cibadmin --replace --scope constraints --xml-file $HOME/constraints.xml", pcmk_option_example},
 
+    {"-spacer-",    0, 0, '-', "Create a resource and a constraint for it together, or not at all:", pcmk_option_paragraph},
+    {"-spacer-",    0, 0, '-', " cibadmin --batch --xml-text '<cib_transaction><create scope=\"resources\"><primitive id=\"new\" class=\"ocf\" provider=\"heartbeat\" type=\"Dummy\"/></create><create scope=\"constraints\"><rsc_location id=\"new-on-node1\" rsc=\"new\" node=\"node1\" score=\"100\"/></create></cib_transaction>'", pcmk_option_example},
+
+    {"-spacer-",    0, 0, '-', "Add all the resources in $HOME/resources.xml (a <resources> section) to the configuration at once:", pcmk_option_paragraph},
+    {"-spacer-",    0, 0, '-', " cibadmin --bulk-load --xml-file $HOME/resources.xml", pcmk_option_example},
+
     {"-spacer-",    0, 0, '-', "Increase the configuration version to prevent old configurations from being loaded accidentally:", pcmk_option_paragraph},
     {"-spacer-",    0, 0, '-', " cibadmin --modify --xml-text '<cib admin_epoch=\"admin_epoch++\"/>'", pcmk_option_example},
 
@@ -202,6 +217,9 @@ main(int argc, char **argv)
             case 'e':
                 command_options |= cib_xpath_address;
                 break;
+            case 'k':
+                query_attrs = optarg;
+                break;
             case 'u':
                 cib_action = CIB_OP_UPGRADE;
                 dangerous_cmd = TRUE;
@@ -243,6 +261,12 @@ main(int argc, char **argv)
             case 'n':
                 command_options |= cib_no_children;
                 break;
+            case 'T':
+                cib_action = CIB_OP_COMMIT_TRANSACT;
+                break;
+            case 'L':
+                cib_action = "bulk-load";
+                break;
             case 'B':
                 cib_action = CIB_OP_BUMP;
                 crm_log_args(argc, argv);
@@ -336,6 +360,13 @@ main(int argc, char **argv)
         crm_help('?', CRM_EX_USAGE);
     }
 
+    if ((query_attrs != NULL)
+        && (safe_str_neq(cib_action, CIB_OP_QUERY)
+            || is_not_set(command_options, cib_xpath))) {
+        fprintf(stderr, "--attributes can only be used with --query and --xpath\n");
+        crm_exit(CRM_EX_USAGE);
+    }
+
     if (dangerous_cmd && force_flag == FALSE) {
         fprintf(stderr, "The supplied command is considered dangerous."
                 "  To prevent accidental destruction of the cluster,"
@@ -365,6 +396,15 @@ main(int argc, char **argv)
         crm_exit(CRM_EX_CONFIG);
     }
 
+    if (query_attrs != NULL) {
+        /* Queries take no other input. A CIB manager that does not know this
+         * request returns complete matches, which are still correct output.
+         */
+        free_xml(input);
+        input = create_xml_node(NULL, XML_CIB_TAG_PROJECTION);
+        crm_xml_add(input, XML_CIB_ATTR_PROJECTION, query_attrs);
+    }
+
     if (safe_str_eq(cib_action, "md5-sum")) {
         char *digest = NULL;
 
@@ -468,6 +508,221 @@ main(int argc, char **argv)
     return crm_exit(exit_code);
 }
 
+static int
+do_batch(xmlNode *input, int call_options)
+{
+    int rc = pcmk_ok;
+
+    if (safe_str_neq(crm_element_name(input), T_CIB_TRANSACTION)) {
+        fprintf(stderr, "Batch input must be a <" T_CIB_TRANSACTION "> element\n");
+        return -EINVAL;
+    }
+
+    rc = the_cib->cmds->init_transaction(the_cib);
+    if (rc != pcmk_ok) {
+        return rc;
+    }
+
+    for (xmlNode *request = __xml_first_child_element(input); request != NULL;
+         request = __xml_next_element(request)) {
+
+        const char *name = crm_element_name(request);
+        const char *op = NULL;
+
+        if (safe_str_eq(name, "create")) {
+            op = CIB_OP_CREATE;
+        } else if (safe_str_eq(name, "modify")) {
+            op = CIB_OP_MODIFY;
+        } else if (safe_str_eq(name, "delete")) {
+            op = CIB_OP_DELETE;
+        } else if (safe_str_eq(name, "bump")) {
+            op = CIB_OP_BUMP;
+        } else {
+            fprintf(stderr, "Unknown batch request <%s>\n", crm_str(name));
+            rc = -EINVAL;
+            break;
+        }
+
+        rc = cib_internal_op(the_cib, op, NULL,
+                             crm_element_value(request, "scope"),
+                             __xml_first_child_element(request), NULL,
+                             call_options, cib_user);
+        if (rc != pcmk_ok) {
+            break;
+        }
+    }
+
+    if (rc != pcmk_ok) {
+        the_cib->cmds->end_transaction(the_cib, FALSE, call_options);
+        return rc;
+    }
+    return the_cib->cmds->end_transaction(the_cib, TRUE, call_options);
+}
+
+/*!
+ * \internal
+ * \brief Add a request for every object in a CIB section to a transaction
+ *
+ * \param[in,out] requests      <cib_transaction> to add requests to
+ * \param[in]     objects       Section containing objects
+ * \param[in]     scope         Section to create objects in
+ * \param[in]     call_options  Group of enum cib_call_options flags
+ */
+static void
+add_bulk_objects(xmlNode *requests, xmlNode *objects, const char *scope,
+                 int call_options)
+{
+    // With --allow-create, objects that already exist are updated instead
+    const char *op = is_set(call_options, cib_can_create)? CIB_OP_MODIFY
+                                                          : CIB_OP_CREATE;
+
+    for (xmlNode *object = __xml_first_child_element(objects); object != NULL;
+         object = __xml_next_element(object)) {
+
+        add_node_nocopy(requests, NULL,
+                        cib_create_op(0, T_CIB_TRANSACTION, op, NULL, scope,
+                                      object, call_options, cib_user));
+    }
+}
+
+/*!
+ * \internal
+ * \brief Create a transaction of all the requests bulk input describes
+ *
+ * \param[in] input         Bulk input
+ * \param[in] call_options  Group of enum cib_call_options flags
+ *
+ * \return Newly allocated <cib_transaction>, or NULL if input is invalid
+ */
+static xmlNode *
+bulk_requests(xmlNode *input, int call_options)
+{
+    xmlNode *requests = create_xml_node(NULL, T_CIB_TRANSACTION);
+    const char *name = crm_element_name(input);
+
+    if (safe_str_eq(name, T_CIB_TRANSACTION)) {
+        for (xmlNode *request = __xml_first_child_element(input);
+             request != NULL; request = __xml_next_element(request)) {
+
+            const char *op = NULL;
+
+            name = crm_element_name(request);
+            if (safe_str_eq(name, "create")) {
+                op = CIB_OP_CREATE;
+            } else if (safe_str_eq(name, "modify")) {
+                op = CIB_OP_MODIFY;
+            } else if (safe_str_eq(name, "delete")) {
+                op = CIB_OP_DELETE;
+            } else if (safe_str_eq(name, "bump")) {
+                op = CIB_OP_BUMP;
+            } else {
+                fprintf(stderr, "Unknown batch request <%s>\n", crm_str(name));
+                free_xml(requests);
+                return NULL;
+            }
+            add_node_nocopy(requests, NULL,
+                            cib_create_op(0, T_CIB_TRANSACTION, op, NULL,
+                                          crm_element_value(request, "scope"),
+                                          __xml_first_child_element(request),
+                                          call_options, cib_user));
+        }
+
+    } else if (safe_str_eq(name, XML_CIB_TAG_CONFIGURATION)) {
+        for (xmlNode *section = __xml_first_child_element(input);
+             section != NULL; section = __xml_next_element(section)) {
+            add_bulk_objects(requests, section, crm_element_name(section),
+                             call_options);
+        }
+
+    } else {
+        add_bulk_objects(requests, input, (obj_type? obj_type : name),
+                         call_options);
+    }
+    return requests;
+}
+
+/*!
+ * \internal
+ * \brief Apply many requests as one transaction, sending them in parts
+ *
+ * The requests are staged by the CIB manager in parts small enough for IPC,
+ * without changing the CIB, and then committed together, so the result is
+ * validated, versioned and diffed once, and causes one transition.
+ *
+ * \param[in] input         Bulk input (see bulk_requests())
+ * \param[in] call_options  Group of enum cib_call_options flags
+ *
+ * \return As for cib_internal_op() with the commit request
+ */
+static int
+do_bulk_load(xmlNode *input, int call_options)
+{
+    int rc = pcmk_ok;
+    int staged = 0;
+    size_t chunk_max = crm_ipc_default_buffer_size() / 2;
+    size_t chunk_size = 0;
+    xmlNode *requests = bulk_requests(input, call_options);
+    xmlNode *chunk = NULL;
+    xmlNode *commit = NULL;
+    xmlNode *next = NULL;
+
+    if (requests == NULL) {
+        return -EINVAL;
+    }
+
+    // Files have no size limit, so are simply committed in one transaction
+    if (the_cib->variant == cib_file) {
+        rc = cib_internal_op(the_cib, CIB_OP_COMMIT_TRANSACT, NULL, NULL,
+                             requests, NULL, call_options, cib_user);
+        free_xml(requests);
+        return rc;
+    }
+
+    for (xmlNode *request = __xml_first_child_element(requests);
+         request != NULL; request = next) {
+
+        char *text = dump_xml_unformatted(request);
+
+        next = __xml_next_element(request);
+        if (chunk == NULL) {
+            chunk = create_xml_node(NULL, T_CIB_TRANSACTION);
+        }
+        chunk_size += strlen(text);
+        free(text);
+        add_node_copy(chunk, request);
+        staged++;
+
+        if ((chunk_size >= chunk_max) || (next == NULL)) {
+            rc = cib_internal_op(the_cib, CIB_OP_STAGE_TRANSACT, NULL, NULL,
+                                 chunk, NULL, call_options|cib_sync_call,
+                                 cib_user);
+            free_xml(chunk);
+            chunk = NULL;
+            chunk_size = 0;
+            if (rc != pcmk_ok) {
+                fprintf(stderr, "Could not stage requests: %s\n",
+                        pcmk_strerror(rc));
+                free_xml(requests);
+                return rc;
+            }
+            crm_info("Staged %d request%s", staged, ((staged == 1)? "" : "s"));
+        }
+    }
+    free_xml(requests);
+
+    if (staged == 0) {
+        fprintf(stderr, "No objects to load\n");
+        return -ENODATA;
+    }
+
+    commit = create_xml_node(NULL, T_CIB_TRANSACTION);
+    crm_xml_add(commit, F_CIB_STAGED, XML_BOOLEAN_TRUE);
+    rc = cib_internal_op(the_cib, CIB_OP_COMMIT_TRANSACT, host, NULL, commit,
+                         NULL, call_options, cib_user);
+    free_xml(commit);
+    return rc;
+}
+
 int
 do_work(xmlNode * input, int call_options, xmlNode ** output)
 {
@@ -482,7 +737,17 @@ do_work(xmlNode * input, int call_options, xmlNode ** output)
         }
     }
 
-    if (cib_action != NULL) {
+    if (safe_str_eq(cib_action, CIB_OP_COMMIT_TRANSACT)) {
+        return do_batch(input, call_options);
+
+    } else if (safe_str_eq(cib_action, "bulk-load")) {
+        if (input == NULL) {
+            fprintf(stderr, "Please supply XML to load with -X, -x or -p\n");
+            return -EINVAL;
+        }
+        return do_bulk_load(input, call_options);
+
+    } else if (cib_action != NULL) {
         crm_trace("Passing \"%s\" to variant_op...", cib_action);
         return cib_internal_op(the_cib, cib_action, host, obj_type, input, output, call_options, cib_user);
 
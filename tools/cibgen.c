@@ -0,0 +1,626 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <crm/crm.h>
+#include <crm/cib.h>
+#include <crm/msg_xml.h>
+#include <crm/lrmd.h>
+#include <crm/common/xml.h>
+#include <crm/common/util.h>
+
+/*
+ * Synthetic CIB generator
+ *
+ * Writes a CIB describing a cluster of the requested size and shape, with
+ * every resource already active on a "home" node so that the scheduler has a
+ * realistic status section to unpack. The output depends only on the options
+ * (including the seed), so the same command always produces the same input,
+ * and can be fed straight to crm_simulate (-x, --benchmark or --profile).
+ */
+
+#define CIBGEN_DATE 1530000000  // fixed execution-date and operation times
+
+static struct cibgen_options_s {
+    int nodes;
+    int joining;        // extra cluster nodes with no resource history
+    int remote_nodes;
+    int guest_nodes;
+    int primitives;
+    int groups;
+    int group_size;
+    int clones;
+    int promotable;
+    int bundles;
+    int replicas;
+    int density;        // percentage of resources with constraints
+    int history;        // number of nodes with history for each resource
+    unsigned long seed;
+    const char *output;
+    int serialize;      // number of times to time serialization, or 0
+} options = { 16, 0, 0, 0, 100, 0, 3, 0, 0, 0, 3, 20, 1, 1, NULL, 0 };
+
+/* A private generator (rather than random()) keeps the output identical
+ * across platforms for a given seed
+ */
+static unsigned long
+next_random(int limit)
+{
+    options.seed = options.seed * 6364136223846793005UL + 1442695040888963407UL;
+    return ((options.seed >> 33) % (unsigned long) limit);
+}
+
+static char *
+node_name(int n)
+{
+    return crm_strdup_printf("node%d", (n % options.nodes) + 1);
+}
+
+static void
+add_meta(xmlNode *parent, const char *id, const char *name, const char *value)
+{
+    xmlNode *meta = first_named_child(parent, XML_TAG_META_SETS);
+
+    if (meta == NULL) {
+        meta = create_xml_node(parent, XML_TAG_META_SETS);
+        crm_xml_set_id(meta, "%s-meta", id);
+    }
+    crm_create_nvpair_xml(meta, NULL, name, value);
+}
+
+static xmlNode *
+add_primitive(xmlNode *parent, const char *id, const char *provider,
+              const char *type)
+{
+    xmlNode *rsc = create_xml_node(parent, XML_CIB_TAG_RESOURCE);
+    xmlNode *ops = NULL;
+
+    crm_xml_add(rsc, XML_ATTR_ID, id);
+    crm_xml_add(rsc, XML_AGENT_ATTR_CLASS, PCMK_RESOURCE_CLASS_OCF);
+    crm_xml_add(rsc, XML_AGENT_ATTR_PROVIDER, provider);
+    crm_xml_add(rsc, XML_ATTR_TYPE, type);
+
+    ops = create_xml_node(rsc, "operations");
+    crm_create_op_xml(ops, id, "monitor", "10s", NULL);
+    return rsc;
+}
+
+/* Status section helpers */
+
+static xmlNode *
+add_node_state(xmlNode *status, const char *id, const char *uname,
+               gboolean remote)
+{
+    xmlNode *state = create_xml_node(status, XML_CIB_TAG_STATE);
+
+    crm_xml_add(state, XML_ATTR_ID, id);
+    crm_xml_add(state, XML_ATTR_UNAME, uname);
+    crm_xml_add(state, XML_NODE_IN_CLUSTER, XML_BOOLEAN_TRUE);
+    if (remote) {
+        crm_xml_add(state, XML_NODE_IS_REMOTE, XML_BOOLEAN_TRUE);
+    } else {
+        crm_xml_add(state, XML_NODE_IS_PEER, ONLINESTATUS);
+        crm_xml_add(state, XML_NODE_JOIN_STATE, CRMD_JOINSTATE_MEMBER);
+        crm_xml_add(state, XML_NODE_EXPECTED, CRMD_JOINSTATE_MEMBER);
+    }
+    crm_xml_add(state, XML_ATTR_ORIGIN, crm_system_name);
+    return state;
+}
+
+static xmlNode *
+find_node_state(xmlNode *status, const char *uname)
+{
+    for (xmlNode *state = __xml_first_child(status); state != NULL;
+         state = __xml_next_element(state)) {
+
+        if (safe_str_eq(crm_element_value(state, XML_ATTR_UNAME), uname)) {
+            return state;
+        }
+    }
+    return NULL;
+}
+
+static void
+add_history_op(xmlNode *lrm_rsc, const char *node, const char *task,
+               guint interval_ms, int rc, int *call_id)
+{
+    lrmd_event_data_t op;
+
+    memset(&op, 0, sizeof(op));
+    op.rsc_id = ID(lrm_rsc);
+    op.op_type = task;
+    op.interval_ms = interval_ms;
+    op.rc = rc;
+    op.op_status = PCMK_LRM_OP_DONE;
+    op.call_id = ++(*call_id);
+    op.t_run = CIBGEN_DATE;
+    op.t_rcchange = CIBGEN_DATE;
+    create_operation_update(lrm_rsc, &op, CRM_FEATURE_SET, rc, node,
+                            crm_system_name, LOG_TRACE);
+}
+
+/*!
+ * \internal
+ * \brief Add a resource's operation history to the status section
+ *
+ * \param[in] status    Status section
+ * \param[in] id        Resource history ID
+ * \param[in] provider  Resource agent provider
+ * \param[in] type      Resource agent type
+ * \param[in] home      Index of node resource is active on
+ * \param[in] active    Number of consecutive nodes (from \p home) it is active on
+ *
+ * \note The resource is probed (and found inactive) on as many further nodes
+ *       as needed to give it history on options.history nodes. If that is 0,
+ *       no history is added, so the resource is inactive everywhere.
+ */
+static void
+add_history(xmlNode *status, const char *id, const char *provider,
+            const char *type, int home, int active)
+{
+    int depth = QB_MAX(options.history, active);
+
+    if (options.history == 0) {
+        return;
+    } else if (depth > options.nodes) {
+        depth = options.nodes;
+    }
+
+    for (int lpc = 0; lpc < depth; lpc++) {
+        char *uname = node_name(home + lpc);
+        xmlNode *state = find_node_state(status, uname);
+        xmlNode *lrm = first_named_child(state, XML_CIB_TAG_LRM);
+        xmlNode *lrm_rscs = NULL;
+        xmlNode *lrm_rsc = NULL;
+        int call_id = 0;
+
+        if (lrm == NULL) {
+            lrm = create_xml_node(state, XML_CIB_TAG_LRM);
+            crm_xml_add(lrm, XML_ATTR_ID, ID(state));
+            create_xml_node(lrm, XML_LRM_TAG_RESOURCES);
+        }
+        lrm_rscs = first_named_child(lrm, XML_LRM_TAG_RESOURCES);
+
+        lrm_rsc = create_xml_node(lrm_rscs, XML_LRM_TAG_RESOURCE);
+        crm_xml_add(lrm_rsc, XML_ATTR_ID, id);
+        crm_xml_add(lrm_rsc, XML_AGENT_ATTR_CLASS, PCMK_RESOURCE_CLASS_OCF);
+        crm_xml_add(lrm_rsc, XML_AGENT_ATTR_PROVIDER, provider);
+        crm_xml_add(lrm_rsc, XML_ATTR_TYPE, type);
+
+        if (lpc < active) {
+            add_history_op(lrm_rsc, uname, CRMD_ACTION_START, 0,
+                           PCMK_OCF_OK, &call_id);
+            add_history_op(lrm_rsc, uname, CRMD_ACTION_STATUS, 10000,
+                           PCMK_OCF_OK, &call_id);
+        } else {
+            add_history_op(lrm_rsc, uname, CRMD_ACTION_STATUS, 0,
+                           PCMK_OCF_NOT_RUNNING, &call_id);
+        }
+        free(uname);
+    }
+}
+
+/* Constraints section helpers */
+
+static void
+add_constraints(xmlNode *constraints, const char *id, GPtrArray *earlier)
+{
+    xmlNode *xml = NULL;
+
+    if ((int) next_random(100) >= options.density) {
+        return;
+    }
+
+    xml = create_xml_node(constraints, XML_CONS_TAG_RSC_LOCATION);
+    crm_xml_set_id(xml, "loc-%s", id);
+    crm_xml_add(xml, XML_LOC_ATTR_SOURCE, id);
+    {
+        char *uname = node_name(next_random(options.nodes));
+
+        crm_xml_add(xml, XML_CIB_TAG_NODE, uname);
+        free(uname);
+    }
+    crm_xml_add_int(xml, XML_RULE_ATTR_SCORE, (int) next_random(200) - 100);
+
+    if (earlier->len > 0) {
+        const char *other = g_ptr_array_index(earlier,
+                                              next_random(earlier->len));
+
+        // Half of the constrained resources also depend on an earlier one
+        if (next_random(2) == 0) {
+            xml = create_xml_node(constraints, XML_CONS_TAG_RSC_DEPEND);
+            crm_xml_set_id(xml, "col-%s", id);
+            crm_xml_add(xml, XML_COLOC_ATTR_SOURCE, id);
+            crm_xml_add(xml, XML_COLOC_ATTR_TARGET, other);
+            crm_xml_add(xml, XML_RULE_ATTR_SCORE,
+                        (next_random(2) == 0)? CRM_INFINITY_S : "100");
+
+            xml = create_xml_node(constraints, XML_CONS_TAG_RSC_ORDER);
+            crm_xml_set_id(xml, "ord-%s", id);
+            crm_xml_add(xml, XML_ORDER_ATTR_FIRST, other);
+            crm_xml_add(xml, XML_ORDER_ATTR_THEN, id);
+            crm_xml_add(xml, XML_ORDER_ATTR_KIND, "Mandatory");
+        }
+    }
+    g_ptr_array_add(earlier, strdup(id));
+}
+
+static xmlNode *
+generate_cib(void)
+{
+    int home = 0;
+    xmlNode *cib = createEmptyCib(1);
+    xmlNode *crm_config = get_object_root(XML_CIB_TAG_CRMCONFIG, cib);
+    xmlNode *nodes = get_object_root(XML_CIB_TAG_NODES, cib);
+    xmlNode *resources = get_object_root(XML_CIB_TAG_RESOURCES, cib);
+    xmlNode *constraints = get_object_root(XML_CIB_TAG_CONSTRAINTS, cib);
+    xmlNode *status = get_object_root(XML_CIB_TAG_STATUS, cib);
+    xmlNode *xml = NULL;
+    GPtrArray *earlier = g_ptr_array_new_with_free_func(free);
+
+    crm_xml_add(cib, XML_ATTR_HAVE_QUORUM, XML_BOOLEAN_TRUE);
+    crm_xml_add(cib, XML_ATTR_DC_UUID, "1");
+    crm_xml_add_int(cib, "execution-date", CIBGEN_DATE);
+
+    xml = create_xml_node(crm_config, XML_CIB_TAG_PROPSET);
+    crm_xml_add(xml, XML_ATTR_ID, CIB_OPTIONS_FIRST);
+    crm_create_nvpair_xml(xml, NULL, "stonith-enabled", XML_BOOLEAN_FALSE);
+
+    for (int lpc = 1; lpc <= options.nodes; lpc++) {
+        char *id = crm_itoa(lpc);
+        char *uname = node_name(lpc - 1);
+
+        xml = create_xml_node(nodes, XML_CIB_TAG_NODE);
+        crm_xml_add(xml, XML_ATTR_ID, id);
+        crm_xml_add(xml, XML_ATTR_UNAME, uname);
+        add_node_state(status, id, uname, FALSE);
+        free(uname);
+        free(id);
+    }
+
+    /* Joining nodes come after the others, so resources never have a home
+     * (or any history) on them
+     */
+    for (int lpc = options.nodes + 1; lpc <= options.nodes + options.joining;
+         lpc++) {
+        char *id = crm_itoa(lpc);
+        char *uname = crm_strdup_printf("node%d", lpc);
+
+        xml = create_xml_node(nodes, XML_CIB_TAG_NODE);
+        crm_xml_add(xml, XML_ATTR_ID, id);
+        crm_xml_add(xml, XML_ATTR_UNAME, uname);
+        add_node_state(status, id, uname, FALSE);
+        free(uname);
+        free(id);
+    }
+
+    // Remote nodes, each with its connection resource active on a cluster node
+    for (int lpc = 1; lpc <= options.remote_nodes; lpc++) {
+        char *id = crm_strdup_printf("remote%d", lpc);
+
+        xml = add_primitive(resources, id, "pacemaker", "remote");
+        xml = create_xml_node(xml, XML_TAG_ATTR_SETS);
+        crm_xml_set_id(xml, "%s-attributes", id);
+        crm_create_nvpair_xml(xml, NULL, "server", id);
+
+        xml = create_xml_node(nodes, XML_CIB_TAG_NODE);
+        crm_xml_add(xml, XML_ATTR_ID, id);
+        crm_xml_add(xml, XML_ATTR_UNAME, id);
+        crm_xml_add(xml, XML_ATTR_TYPE, "remote");
+        add_node_state(status, id, id, TRUE);
+
+        add_history(status, id, "pacemaker", "remote", home++, 1);
+        free(id);
+    }
+
+    // Guest nodes, each in a virtual machine active on a cluster node
+    for (int lpc = 1; lpc <= options.guest_nodes; lpc++) {
+        char *id = crm_strdup_printf("vm%d", lpc);
+        char *guest = crm_strdup_printf("guest%d", lpc);
+
+        xml = add_primitive(resources, id, "pacemaker", "Dummy");
+        add_meta(xml, id, XML_RSC_ATTR_REMOTE_NODE, guest);
+        add_node_state(status, guest, guest, TRUE);
+
+        add_history(status, id, "pacemaker", "Dummy", home++, 1);
+        free(guest);
+        free(id);
+    }
+
+    for (int lpc = 1; lpc <= options.primitives; lpc++) {
+        char *id = crm_strdup_printf("rsc%d", lpc);
+
+        add_primitive(resources, id, "pacemaker", "Dummy");
+        add_history(status, id, "pacemaker", "Dummy", home++, 1);
+        add_constraints(constraints, id, earlier);
+        free(id);
+    }
+
+    for (int lpc = 1; lpc <= options.groups; lpc++) {
+        char *id = crm_strdup_printf("group%d", lpc);
+        xmlNode *group = create_xml_node(resources, XML_CIB_TAG_GROUP);
+
+        crm_xml_add(group, XML_ATTR_ID, id);
+        for (int member = 1; member <= options.group_size; member++) {
+            char *member_id = crm_strdup_printf("%s-rsc%d", id, member);
+
+            add_primitive(group, member_id, "pacemaker", "Dummy");
+            add_history(status, member_id, "pacemaker", "Dummy", home, 1);
+            free(member_id);
+        }
+        home++;
+        add_constraints(constraints, id, earlier);
+        free(id);
+    }
+
+    // Anonymous clones, active on every cluster node
+    for (int lpc = 1; lpc <= options.clones; lpc++) {
+        char *id = crm_strdup_printf("clone%d", lpc);
+        char *child_id = crm_strdup_printf("cloned%d", lpc);
+
+        xml = create_xml_node(resources, XML_CIB_TAG_INCARNATION);
+        crm_xml_add(xml, XML_ATTR_ID, id);
+        add_primitive(xml, child_id, "pacemaker", "Dummy");
+        add_history(status, child_id, "pacemaker", "Dummy", 0, options.nodes);
+        add_constraints(constraints, id, earlier);
+        free(child_id);
+        free(id);
+    }
+
+    // Promotable clones, active (but not yet promoted) on every cluster node
+    for (int lpc = 1; lpc <= options.promotable; lpc++) {
+        char *id = crm_strdup_printf("promotable%d", lpc);
+        char *child_id = crm_strdup_printf("stateful%d", lpc);
+
+        xml = create_xml_node(resources, XML_CIB_TAG_INCARNATION);
+        crm_xml_add(xml, XML_ATTR_ID, id);
+        add_meta(xml, id, XML_RSC_ATTR_PROMOTABLE, XML_BOOLEAN_TRUE);
+        add_primitive(xml, child_id, "pacemaker", "Stateful");
+        add_history(status, child_id, "pacemaker", "Stateful", 0,
+                    options.nodes);
+        add_constraints(constraints, id, earlier);
+        free(child_id);
+        free(id);
+    }
+
+    // Bundles of a Dummy resource, which the scheduler starts from scratch
+    for (int lpc = 1; lpc <= options.bundles; lpc++) {
+        char *id = crm_strdup_printf("bundle%d", lpc);
+        char *child_id = crm_strdup_printf("bundled%d", lpc);
+        xmlNode *bundle = create_xml_node(resources, XML_CIB_TAG_CONTAINER);
+
+        crm_xml_add(bundle, XML_ATTR_ID, id);
+
+        xml = create_xml_node(bundle, "docker");
+        crm_xml_add(xml, "image", "pcmk:synthetic");
+        crm_xml_add_int(xml, "replicas", options.replicas);
+
+        xml = create_xml_node(bundle, "network");
+        crm_xml_add(xml, "control-port", "3121");
+
+        add_primitive(bundle, child_id, "pacemaker", "Dummy");
+        add_constraints(constraints, id, earlier);
+        free(child_id);
+        free(id);
+    }
+
+    g_ptr_array_free(earlier, TRUE);
+    return cib;
+}
+
+/* *INDENT-OFF* */
+static struct crm_option long_options[] = {
+    /* Top-level Options */
+    {"help",    0, 0, '?', "\tThis text"},
+    {"version", 0, 0, '$', "\tVersion information"  },
+    {"verbose", 0, 0, 'V', "\tIncrease debug output"},
+
+    {"-spacer-",     0, 0, '-', "\nCluster size and shape:"},
+    {"nodes",        1, 0, 'n', "\tNumber of cluster nodes (default 16)"},
+    {"joining",      1, 0, 'j', "\tNumber of additional cluster nodes that have just joined, so every"},
+    {"-spacer-",     0, 0, '-', "\t\t\tresource must be probed on them (default 0)"},
+    {"remote-nodes", 1, 0, 'r', "Number of Pacemaker Remote nodes (default 0)"},
+    {"guest-nodes",  1, 0, 'g', "Number of guest nodes (default 0)"},
+    {"primitives",   1, 0, 'p', "Number of ungrouped primitives (default 100)"},
+    {"groups",       1, 0, 'G', "\tNumber of groups (default 0)"},
+    {"group-size",   1, 0, 'z', "Number of members in each group (default 3)"},
+    {"clones",       1, 0, 'c', "\tNumber of anonymous clones (default 0)"},
+    {"promotable",   1, 0, 'm', "Number of promotable clones (default 0)"},
+    {"bundles",      1, 0, 'b', "\tNumber of bundles (default 0)"},
+    {"replicas",     1, 0, 'R', "Number of replicas in each bundle (default 3)"},
+    {"density",      1, 0, 'd', "\tPercentage of resources with a location constraint, half of which"},
+    {"-spacer-",     0, 0, '-', "\t\t\talso depend on (are colocated with and ordered after) another resource (default 20)"},
+    {"history",      1, 0, 'H', "\tNumber of nodes with operation history for each resource, or 0"},
+    {"-spacer-",     0, 0, '-', "\t\t\tfor none so that every resource must be started (default 1)"},
+    {"seed",         1, 0, 's', "\tSeed for the choice of constraints (default 1)"},
+
+    {"-spacer-",     0, 0, '-', "\nOutput:"},
+    {"output",       1, 0, 'o', "\tWrite the CIB to the named file instead of standard output"},
+    {"serialize",    1, 0, 'S', "Instead of writing the CIB, time serializing it this many times, and print"},
+    {"-spacer-",     0, 0, '-', "\t\t\tthe minimum, mean and maximum milliseconds and the size in bytes"},
+
+    {"-spacer-",    0, 0, '-', "\nExamples:\n"},
+    {"-spacer-",    0, 0, '-', "Time the scheduler for 5000 resources on 64 nodes with 4 remote nodes", pcmk_option_paragraph},
+    {"-spacer-",    0, 0, '-', " cibgen --nodes 64 --remote-nodes 4 --primitives 5000 -o /tmp/big.xml", pcmk_option_example},
+    {"-spacer-",    0, 0, '-', " crm_simulate -x /tmp/big.xml --benchmark 5", pcmk_option_example},
+    {"-spacer-",    0, 0, '-', "Time probing 3000 resources on a node joining a 32-node cluster", pcmk_option_paragraph},
+    {"-spacer-",    0, 0, '-', " cibgen --nodes 32 --joining 1 --primitives 3000 --history 32 -o /tmp/join.xml", pcmk_option_example},
+    {"-spacer-",    0, 0, '-', "Time serializing the CIB of 20000 resources on 256 nodes", pcmk_option_paragraph},
+    {"-spacer-",    0, 0, '-', " cibgen --nodes 256 --primitives 20000 --serialize 20", pcmk_option_example},
+
+    {0, 0, 0, 0}
+};
+/* *INDENT-ON* */
+
+static double
+now_ms(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+#else
+    return time(NULL) * 1000.0;
+#endif
+}
+
+/* Time serializing the CIB the way IPC messages and digests do (unformatted)
+ * and the way disk writes do (formatted), and print one tab-separated line for
+ * each. Comparing the output of two builds shows whether a change made
+ * serialization faster or slower.
+ */
+static void
+benchmark_serialize(xmlNode *cib, int runs)
+{
+    for (int formatted = 0; formatted <= 1; formatted++) {
+        double min = 0.0, max = 0.0, total = 0.0;
+        size_t bytes = 0;
+
+        for (int run = 0; run < runs; run++) {
+            double start = now_ms();
+            char *text = formatted? dump_xml_formatted(cib)
+                                  : dump_xml_unformatted(cib);
+            double elapsed = now_ms() - start;
+
+            bytes = strlen(text);
+            free(text);
+            total += elapsed;
+            if ((run == 0) || (elapsed < min)) {
+                min = elapsed;
+            }
+            if (elapsed > max) {
+                max = elapsed;
+            }
+        }
+        printf("%s\t%.3f\t%.3f\t%.3f\t%lu\n",
+               (formatted? "formatted" : "unformatted"),
+               min, total / runs, max, (unsigned long) bytes);
+    }
+}
+
+static int
+parse_count(const char *value, int minimum)
+{
+    int count = crm_parse_int(value, NULL);
+
+    if (count < minimum) {
+        fprintf(stderr, "Invalid count: %s\n", value);
+        crm_exit(CRM_EX_USAGE);
+    }
+    return count;
+}
+
+int
+main(int argc, char **argv)
+{
+    int flag = 0;
+    int index = 0;
+    int argerr = 0;
+    xmlNode *cib = NULL;
+
+    crm_log_cli_init("cibgen");
+    crm_set_options(NULL, "[options]", long_options,
+                    "Generate a synthetic CIB for scheduler scalability testing");
+
+    while (1) {
+        flag = crm_get_option(argc, argv, &index);
+        if (flag == -1)
+            break;
+
+        switch (flag) {
+            case 'V':
+                crm_bump_log_level(argc, argv);
+                break;
+            case '?':
+            case '$':
+                crm_help(flag, CRM_EX_OK);
+                break;
+            case 'n':
+                options.nodes = parse_count(optarg, 1);
+                break;
+            case 'j':
+                options.joining = parse_count(optarg, 0);
+                break;
+            case 'r':
+                options.remote_nodes = parse_count(optarg, 0);
+                break;
+            case 'g':
+                options.guest_nodes = parse_count(optarg, 0);
+                break;
+            case 'p':
+                options.primitives = parse_count(optarg, 0);
+                break;
+            case 'G':
+                options.groups = parse_count(optarg, 0);
+                break;
+            case 'z':
+                options.group_size = parse_count(optarg, 1);
+                break;
+            case 'c':
+                options.clones = parse_count(optarg, 0);
+                break;
+            case 'm':
+                options.promotable = parse_count(optarg, 0);
+                break;
+            case 'b':
+                options.bundles = parse_count(optarg, 0);
+                break;
+            case 'R':
+                options.replicas = parse_count(optarg, 1);
+                break;
+            case 'd':
+                options.density = parse_count(optarg, 0);
+                break;
+            case 'H':
+                options.history = parse_count(optarg, 0);
+                break;
+            case 's':
+                options.seed = (unsigned long) crm_int_helper(optarg, NULL);
+                break;
+            case 'o':
+                options.output = optarg;
+                break;
+            case 'S':
+                options.serialize = parse_count(optarg, 1);
+                break;
+            default:
+                ++argerr;
+                break;
+        }
+    }
+
+    if (optind < argc) {
+        ++argerr;
+    }
+    if (argerr) {
+        crm_help('?', CRM_EX_USAGE);
+    }
+
+    cib = generate_cib();
+    if (options.serialize > 0) {
+        benchmark_serialize(cib, options.serialize);
+
+    } else if (options.output == NULL) {
+        char *text = dump_xml_formatted(cib);
+
+        printf("%s", text);
+        free(text);
+
+    } else if (write_xml_file(cib, options.output, FALSE) < 0) {
+        fprintf(stderr, "Could not write %s\n", options.output);
+        free_xml(cib);
+        crm_exit(CRM_EX_CANTCREAT);
+    }
+    free_xml(cib);
+    crm_exit(CRM_EX_OK);
+}
@@ -33,6 +33,7 @@ gboolean BE_QUIET = FALSE;
 char command = 'G';
 
 const char *dest_uname = NULL;
+char *dest_uname_arg = NULL;
 char *dest_node = NULL;
 char *set_name = NULL;
 char *attr_id = NULL;
@@ -53,7 +54,7 @@ static struct crm_option long_options[] = {
     {"quiet",   0, 0, 'q', "\tPrint only the value on stdout\n"},
 
     {"name",    1, 0, 'n', "Name of the attribute/option to operate on"},
-    {"pattern", 1, 0, 'P', "Pattern matching names of attributes (only with -v/-D and -l reboot)"},
+    {"pattern", 1, 0, 'P', "Pattern matching names of attributes (only with -l reboot)"},
 
     {"-spacer-",    0, 0, '-', "\nCommands:"},
     {"query",       0, 0, 'G', "\tQuery the current value of the attribute/option"},
@@ -71,6 +72,9 @@ static struct crm_option long_options[] = {
     {"id",	    1, 0, 'i', "\t(Advanced) The ID used to identify the attribute"},
     {"default",     1, 0, 'd', "(Advanced) The default value to display if none is found in the configuration"},
 
+    {"batch",       0, 0, 'B', "\t(Advanced) Read further commands from standard input, one per line\n"
+                               "\t\t\tusing the options above, and run them over a single CIB connection"},
+
     {"inhibit-policy-engine", 0, 0, '!', NULL, 1},
 
     /* legacy */
@@ -95,33 +99,63 @@ static struct crm_option long_options[] = {
     {"-spacer-",	1, 0, '-', " crm_attribute --type crm_config --name cluster-delay --query", pcmk_option_example},
     {"-spacer-",	1, 0, '-', "Query the value of the cluster-delay cluster option. Only print the value:", pcmk_option_paragraph},
     {"-spacer-",	1, 0, '-', " crm_attribute --type crm_config --name cluster-delay --query --quiet", pcmk_option_example},
+    {"-spacer-",	1, 0, '-', "Query several attributes without reconnecting to the cluster for each one:", pcmk_option_paragraph},
+    {"-spacer-",	1, 0, '-', " printf '%s\\n' '-N myhost -n location -G' '-n cluster-delay -G' | crm_attribute --batch", pcmk_option_example},
 
     {0, 0, 0, 0}
 };
 /* *INDENT-ON* */
 
-int
-main(int argc, char **argv)
+/*!
+ * \internal
+ * \brief Reset command-specific options to their defaults
+ */
+static void
+reset_command(void)
 {
-    cib_t *the_cib = NULL;
-    int rc = pcmk_ok;
+    BE_QUIET = FALSE;
+    command = 'G';
+    dest_uname = NULL;
+    free(dest_uname_arg);
+    dest_uname_arg = NULL;
+    free(dest_node);
+    dest_node = NULL;
+    free(set_name);
+    set_name = NULL;
+    free(attr_id);
+    attr_id = NULL;
+    if (attr_name != attr_pattern) {
+        free(attr_name);
+    }
+    attr_name = NULL;
+    free(attr_pattern);
+    attr_pattern = NULL;
+    type = NULL;
+    rsc_id = NULL;
+    attr_value = NULL;
+    attr_default = NULL;
+    set_type = NULL;
+}
 
-    int cib_opts = cib_sync_call;
+/*!
+ * \internal
+ * \brief Parse command-line options into the command globals
+ *
+ * \param[in]     argc      Number of arguments in \p argv
+ * \param[in]     argv      Arguments
+ * \param[in,out] cib_opts  CIB call options to update
+ * \param[out]    batch     If not NULL, set to TRUE if --batch was given
+ *
+ * \return Number of invalid arguments
+ */
+static int
+parse_command(int argc, char **argv, int *cib_opts, gboolean *batch)
+{
     int argerr = 0;
     int flag;
-
     int option_index = 0;
-    int is_remote_node = 0;
-
-    crm_log_cli_init("crm_attribute");
-    crm_set_options(NULL, "<command> -n <attribute> [options]", long_options,
-                    "Manage node's attributes and cluster options."
-                    "\n\nAllows node attributes and cluster options to be queried, modified and deleted.\n");
-
-    if (argc < 2) {
-        crm_help('?', CRM_EX_USAGE);
-    }
 
+    optind = 0; // (Re-)initialize getopt, so this may be called per batch line
     while (1) {
         flag = crm_get_option(argc, argv, &option_index);
         if (flag == -1)
@@ -151,7 +185,9 @@ main(int argc, char **argv)
                 break;
             case 'U':
             case 'N':
-                dest_uname = strdup(optarg);
+                free(dest_uname_arg);
+                dest_uname_arg = strdup(optarg);
+                dest_uname = dest_uname_arg;
                 break;
             case 's':
                 set_name = strdup(optarg);
@@ -179,9 +215,17 @@ main(int argc, char **argv)
             case 'd':
                 attr_default = optarg;
                 break;
+            case 'B':
+                if (batch != NULL) {
+                    *batch = TRUE;
+                } else {
+                    fprintf(stderr, "Error: --batch is not allowed in a batch\n");
+                    ++argerr;
+                }
+                break;
             case '!':
                 crm_warn("Inhibiting notifications for this update");
-                cib_opts |= cib_inhibit_notify;
+                *cib_opts |= cib_inhibit_notify;
                 break;
             default:
                 printf("Argument code 0%o (%c) is not (?yet?) supported\n", flag, flag);
@@ -200,20 +244,98 @@ main(int argc, char **argv)
     if (optind > argc) {
         ++argerr;
     }
+    return argerr;
+}
 
-    if (argerr) {
-        crm_help('?', CRM_EX_USAGE);
+/*!
+ * \internal
+ * \brief Sign on to the CIB manager, if not already connected
+ *
+ * \param[in] the_cib  CIB object
+ *
+ * \return Standard Pacemaker return code
+ */
+static int
+connect_cib(cib_t *the_cib)
+{
+    int rc = pcmk_ok;
+
+    if (the_cib->state == cib_disconnected) {
+        rc = the_cib->cmds->signon(the_cib, crm_system_name, cib_command);
+        if (rc != pcmk_ok) {
+            fprintf(stderr, "Error connecting to the CIB manager: %s\n",
+                    pcmk_strerror(rc));
+        }
     }
+    return rc;
+}
 
-    the_cib = cib_new();
-    rc = the_cib->cmds->signon(the_cib, crm_system_name, cib_command);
+/*!
+ * \internal
+ * \brief Query pacemaker-attrd for transient attribute values
+ *
+ * \param[out] read_value  Where to store value of attr_name (if no pattern)
+ *
+ * \return Standard Pacemaker return code (-ENXIO if there is no value, and
+ *         -ENOTCONN or -EPROTONOSUPPORT if pacemaker-attrd can't be used)
+ */
+static int
+query_attrd(char **read_value)
+{
+    GList *names = NULL;
+    GList *values = NULL;
+    int rc = pcmk_ok;
 
+    if (attr_pattern == NULL) {
+        names = g_list_prepend(names, attr_name);
+    }
+    rc = attrd_query_values(NULL, names, attr_pattern, dest_uname, &values);
+    g_list_free(names);
     if (rc != pcmk_ok) {
-        fprintf(stderr, "Error connecting to the CIB manager: %s\n",
-                pcmk_strerror(rc));
-        return crm_exit(crm_errno2exit(rc));
+        return rc;
     }
 
+    if (attr_pattern == NULL) {
+        if (values == NULL) {
+            rc = -ENXIO;
+        } else {
+            *read_value = strdup(((attrd_value_t *) values->data)->value);
+        }
+
+    } else {
+        for (GList *iter = values; iter != NULL; iter = iter->next) {
+            attrd_value_t *v = iter->data;
+
+            crm_info("Read %s=%s from pacemaker-attrd", v->name, v->value);
+            if (BE_QUIET) {
+                fprintf(stdout, "%s\n", v->value);
+            } else {
+                fprintf(stdout, "scope=%s  name=%s value=%s\n",
+                        XML_CIB_TAG_STATUS, v->name, v->value);
+            }
+        }
+    }
+    attrd_free_values(values);
+    return rc;
+}
+
+/*!
+ * \internal
+ * \brief Perform the command described by the command globals
+ *
+ * \param[in] the_cib   Connected CIB object
+ * \param[in] cib_opts  CIB call options
+ *
+ * \return Standard Pacemaker return code
+ */
+static int
+run_command(cib_t *the_cib, int cib_opts)
+{
+    int rc = pcmk_ok;
+    int is_remote_node = 0;
+    bool from_attrd = FALSE;
+    char *read_value = NULL;
+
     if (type == NULL && dest_uname != NULL) {
 	    type = "forever";
     }
@@ -240,26 +362,56 @@ main(int argc, char **argv)
             dest_uname = get_local_node_name();
         }
 
-        rc = query_node_uuid(the_cib, dest_uname, &dest_node, &is_remote_node);
-        if (pcmk_ok != rc) {
-            fprintf(stderr, "Could not map name=%s to a UUID\n", dest_uname);
-            the_cib->cmds->signoff(the_cib);
-            cib_delete(the_cib);
-            return crm_exit(crm_errno2exit(rc));
+        /* Transient attributes are held in memory by pacemaker-attrd, so query
+         * it rather than the CIB, unless it is unavailable
+         */
+        if ((command == 'G') && safe_str_eq(type, XML_CIB_TAG_STATUS)
+            && (set_name == NULL) && (attr_id == NULL)) {
+
+            rc = query_attrd(&read_value);
+            from_attrd = (rc == pcmk_ok) || (rc == -ENXIO);
+            if (!from_attrd && (attr_pattern != NULL)) {
+                fprintf(stderr, "Error: querying by pattern requires pacemaker-attrd: %s\n",
+                        pcmk_strerror(rc));
+                return rc;
+            }
+        }
+
+        if (!from_attrd) {
+            rc = connect_cib(the_cib);
+            if (rc != pcmk_ok) {
+                return rc;
+            }
+            rc = query_node_uuid(the_cib, dest_uname, &dest_node, &is_remote_node);
+            if (pcmk_ok != rc) {
+                fprintf(stderr, "Could not map name=%s to a UUID\n", dest_uname);
+                return rc;
+            }
+        }
+    }
+
+    if (!from_attrd) {
+        rc = connect_cib(the_cib);
+        if (rc != pcmk_ok) {
+            return rc;
         }
     }
 
     if ((command == 'D') && (attr_name == NULL) && (attr_pattern == NULL)) {
         fprintf(stderr, "Error: must specify attribute name or pattern to delete\n");
-        return crm_exit(CRM_EX_USAGE);
+        return -EINVAL;
     }
 
-    if (attr_pattern) {
+    if (attr_pattern && (command == 'G') && from_attrd) {
+        // Matching values were displayed by query_attrd()
+        return pcmk_ok;
+
+    } else if (attr_pattern) {
         if (((command != 'v') && (command != 'D'))
             || safe_str_neq(type, XML_CIB_TAG_STATUS)) {
 
-            fprintf(stderr, "Error: pattern can only be used with till-reboot update or delete\n");
-            return crm_exit(CRM_EX_USAGE);
+            fprintf(stderr, "Error: pattern can only be used with till-reboot query, update or delete\n");
+            return -EINVAL;
         }
         command = 'u';
         free(attr_name);
@@ -296,10 +448,10 @@ main(int argc, char **argv)
 
     } else {                    /* query */
 
-        char *read_value = NULL;
-
-        rc = read_attr_delegate(the_cib, type, dest_node, set_type, set_name,
-                                attr_id, attr_name, &read_value, TRUE, NULL);
+        if (!from_attrd) {
+            rc = read_attr_delegate(the_cib, type, dest_node, set_type, set_name,
+                                    attr_id, attr_name, &read_value, TRUE, NULL);
+        }
 
         if (rc == -ENXIO && attr_default) {
             read_value = strdup(attr_default);
@@ -332,8 +484,109 @@ main(int argc, char **argv)
     } else if (rc != pcmk_ok) {
         fprintf(stderr, "Error performing operation: %s\n", pcmk_strerror(rc));
     }
+    return rc;
+}
 
-    the_cib->cmds->signoff(the_cib);
+/*!
+ * \internal
+ * \brief Run commands read from standard input over one CIB connection
+ *
+ * Each non-empty line is parsed like a crm_attribute command line (without
+ * the program name), so that callers issuing many queries or updates pay the
+ * start-up and CIB sign-on cost only once.
+ *
+ * \param[in] the_cib   Connected CIB object
+ * \param[in] cib_opts  CIB call options
+ *
+ * \return Result of the last failed command, or pcmk_ok if all succeeded
+ */
+static int
+run_batch(cib_t *the_cib, int cib_opts)
+{
+    char line[1024];
+    int line_num = 0;
+    int last_rc = pcmk_ok;
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        char *line_argv_str = crm_strdup_printf("%s %s", crm_system_name,
+                                                g_strstrip(line));
+        char **line_argv = NULL;
+        int line_argc = 0;
+        int line_opts = cib_opts;
+        GError *error = NULL;
+        int rc = pcmk_ok;
+
+        line_num++;
+        if ((line[0] == '\0') || (line[0] == '#')) {
+            free(line_argv_str);
+            continue;
+        }
+
+        reset_command();
+        if (!g_shell_parse_argv(line_argv_str, &line_argc, &line_argv,
+                                &error)) {
+            fprintf(stderr, "Invalid command on line %d: %s\n",
+                    line_num, error->message);
+            g_clear_error(&error);
+            rc = -EINVAL;
+
+        } else if (parse_command(line_argc, line_argv, &line_opts,
+                                 NULL) > 0) {
+            fprintf(stderr, "Invalid command on line %d\n", line_num);
+            rc = -EINVAL;
+
+        } else {
+            rc = run_command(the_cib, line_opts);
+        }
+
+        if (rc != pcmk_ok) {
+            last_rc = rc;
+        }
+        g_strfreev(line_argv);
+        free(line_argv_str);
+        fflush(stdout);
+    }
+    reset_command();
+    return last_rc;
+}
+
+int
+main(int argc, char **argv)
+{
+    cib_t *the_cib = NULL;
+    int rc = pcmk_ok;
+
+    int cib_opts = cib_sync_call;
+    gboolean batch = FALSE;
+
+    crm_log_cli_init("crm_attribute");
+    crm_set_options(NULL, "<command> -n <attribute> [options]", long_options,
+                    "Manage node's attributes and cluster options."
+                    "\n\nAllows node attributes and cluster options to be queried, modified and deleted.\n");
+
+    if (argc < 2) {
+        crm_help('?', CRM_EX_USAGE);
+    }
+
+    if (parse_command(argc, argv, &cib_opts, &batch) > 0) {
+        crm_help('?', CRM_EX_USAGE);
+    }
+
+    // Connect to the CIB manager only when a command needs it
+    the_cib = cib_new();
+
+    if (batch) {
+        rc = run_batch(the_cib, cib_opts);
+    } else {
+        rc = run_command(the_cib, cib_opts);
+    }
+
+    if (the_cib->state != cib_disconnected) {
+        the_cib->cmds->signoff(the_cib);
+    }
     cib_delete(the_cib);
+    if (rc == -EINVAL) { // invalid option combination
+        return crm_exit(CRM_EX_USAGE);
+    }
     return crm_exit(crm_errno2exit(rc));
 }
@@ -22,16 +22,21 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/param.h>
 #include <sys/types.h>
+#include <bzlib.h>
+
+#include <libxml/xmlreader.h>
 
 #include <crm/crm.h>
 #include <crm/msg_xml.h>
 #include <crm/common/xml.h>
 #include <crm/common/ipc.h>
 #include <crm/cib.h>
+#include <crm/common/internal.h>
 
 /* *INDENT-OFF* */
 static struct crm_option long_options[] = {
@@ -53,12 +58,16 @@ static struct crm_option long_options[] = {
     {"cib",	 0, 0, 'c', "\t\tCompare/patch the inputs as a CIB (includes versions details)"},
     {"stdin",	 0, 0, 's', NULL, 1},
     {"no-version", 0, 0, 'u', "\tGenerate the difference without versions details"},
+    {"stream",	 0, 0, 'S', "\t\tCompare the inputs while reading them, keeping little of either in memory."},
+    {"-spacer-", 1, 0, '-', "\t\t\tElements are matched by name and id, text and comments are ignored, and the patch has no digest.\n"},
     {"-spacer-", 1, 0, '-', "\nExamples:", pcmk_option_paragraph},
     {"-spacer-", 1, 0, '-', "Obtain the two different configuration files by running cibadmin on the two cluster setups to compare:", pcmk_option_paragraph},
     {"-spacer-", 1, 0, '-', " cibadmin --query > cib-old.xml", pcmk_option_example},
     {"-spacer-", 1, 0, '-', " cibadmin --query > cib-new.xml", pcmk_option_example},
     {"-spacer-", 1, 0, '-', "Calculate and save the difference between the two files:", pcmk_option_paragraph},
     {"-spacer-", 1, 0, '-', " crm_diff --original cib-old.xml --new cib-new.xml > patch.xml", pcmk_option_example },
+    {"-spacer-", 1, 0, '-', "Do the same for two very large (optionally bzip2-compressed) files:", pcmk_option_paragraph},
+    {"-spacer-", 1, 0, '-', " crm_diff --stream --original cib-old.xml.bz2 --new cib-new.xml.bz2 > patch.xml", pcmk_option_example },
     {"-spacer-", 1, 0, '-', "Apply the patch to the original file:", pcmk_option_paragraph },
     {"-spacer-", 1, 0, '-', " crm_diff --original cib-old.xml --patch patch.xml > updated.xml", pcmk_option_example },
     {"-spacer-", 1, 0, '-', "Apply the patch to the running cluster:", pcmk_option_paragraph },
@@ -221,6 +230,687 @@ generate_patch(xmlNode *object_1, xmlNode *object_2, const char *xml_file_2,
     return -pcmk_err_generic;
 }
 
+/*
+ * Streaming comparison
+ *
+ * Parsing two very large inputs (such as CIBs with big status sections) into
+ * complete DOM trees and tracking changes between them needs a lot of memory
+ * and time. With --stream, both inputs are instead read with libxml2's
+ * streaming reader, and elements are matched by name and id as they are read,
+ * siblings being compared in the same order in both inputs. Only siblings
+ * that are out of step are kept in memory (until their match turns up, or
+ * the end of their parent shows that they were added or removed).
+ *
+ * The result is a version 2 patchset, which can be applied with --patch or
+ * cibadmin --patch. It has no digest (which would need the whole result in
+ * memory), so applying it does not check one. Text content and comments are
+ * not compared, and positions of created and moved elements count only
+ * elements.
+ */
+
+struct stream_input_s {
+    xmlTextReaderPtr reader;
+    gboolean unread;        // reader is on a node that has not been used yet
+    gboolean failed;        // input could not be parsed
+    FILE *fp;               // compressed file (if any)
+    BZFILE *bz;
+};
+
+struct stream_cursor_s {
+    struct stream_input_s *input;   // input being read (NULL if in memory)
+    int depth;                      // depth of children (if streaming)
+    xmlNode *xml;                   // current child (if in memory)
+    gboolean have;                  // whether cursor is on a child
+};
+
+struct stream_pending_s {
+    xmlNode *xml;           // copy of child read out of order
+    int index;              // its position among its siblings
+};
+
+struct stream_placement_s {
+    char *path;             // path of matched child (NULL if created)
+    xmlNode *created;       // created child (NULL if matched)
+    int a_index;            // position of matched child in original
+};
+
+static int
+stream_bz2_read(void *context, char *buffer, int len)
+{
+    struct stream_input_s *input = context;
+    int rc = BZ_OK;
+    int nread = BZ2_bzRead(&rc, input->bz, buffer, len);
+
+    return ((rc == BZ_OK) || (rc == BZ_STREAM_END))? nread : -1;
+}
+
+static int
+stream_bz2_close(void *context)
+{
+    struct stream_input_s *input = context;
+    int rc = BZ_OK;
+
+    BZ2_bzReadClose(&rc, input->bz);
+    fclose(input->fp);
+    input->bz = NULL;
+    input->fp = NULL;
+    return 0;
+}
+
+static gboolean
+stream_open(struct stream_input_s *input, const char *source, gboolean raw)
+{
+    int options = XML_PARSE_NOBLANKS | XML_PARSE_NONET | XML_PARSE_HUGE;
+
+    memset(input, 0, sizeof(struct stream_input_s));
+    if (raw) {
+        input->reader = xmlReaderForMemory(source, strlen(source), NULL, NULL,
+                                           options);
+
+    } else if (crm_ends_with_ext(source, ".bz2")) {
+        int rc = BZ_OK;
+
+        input->fp = fopen(source, "r");
+        if (input->fp == NULL) {
+            return FALSE;
+        }
+        input->bz = BZ2_bzReadOpen(&rc, input->fp, 0, 0, NULL, 0);
+        if (rc != BZ_OK) {
+            BZ2_bzReadClose(&rc, input->bz);
+            fclose(input->fp);
+            return FALSE;
+        }
+        input->reader = xmlReaderForIO(stream_bz2_read, stream_bz2_close,
+                                       input, source, NULL, options);
+
+    } else {
+        input->reader = xmlReaderForFile(source, NULL, options);
+    }
+    return (input->reader != NULL);
+}
+
+/*!
+ * \internal
+ * \brief Move a streaming input to the next element at a given depth
+ *
+ * \param[in] input  Input to read
+ * \param[in] depth  Depth of the children being read
+ *
+ * \return TRUE if the input is on the next child, FALSE if the parent (or
+ *         the input) has ended
+ */
+static gboolean
+stream_next(struct stream_input_s *input, int depth)
+{
+    while (TRUE) {
+        int type = 0;
+        int node_depth = 0;
+
+        if (input->unread) {
+            input->unread = FALSE;
+        } else {
+            int rc = xmlTextReaderRead(input->reader);
+
+            if (rc != 1) {
+                input->failed |= (rc < 0);
+                return FALSE;
+            }
+        }
+
+        type = xmlTextReaderNodeType(input->reader);
+        node_depth = xmlTextReaderDepth(input->reader);
+        if (node_depth < depth) {
+            if (type != XML_READER_TYPE_END_ELEMENT) {
+                input->unread = TRUE;
+            }
+            return FALSE;
+        }
+        if ((type == XML_READER_TYPE_ELEMENT) && (node_depth == depth)) {
+            return TRUE;
+        }
+    }
+}
+
+// Create an element with the name and attributes of a streaming input's current one
+static xmlNode *
+stream_shell(struct stream_input_s *input, gboolean *empty)
+{
+    xmlTextReaderPtr reader = input->reader;
+    xmlNode *shell = create_xml_node(NULL,
+                                     (const char *) xmlTextReaderConstName(reader));
+
+    *empty = (xmlTextReaderIsEmptyElement(reader) == 1);
+    if (xmlTextReaderMoveToFirstAttribute(reader) == 1) {
+        do {
+            crm_xml_add(shell, (const char *) xmlTextReaderConstName(reader),
+                        (const char *) xmlTextReaderConstValue(reader));
+        } while (xmlTextReaderMoveToNextAttribute(reader) == 1);
+        xmlTextReaderMoveToElement(reader);
+    }
+    return shell;
+}
+
+static void
+cursor_next(struct stream_cursor_s *cursor)
+{
+    if (cursor->input != NULL) {
+        cursor->have = stream_next(cursor->input, cursor->depth);
+    } else {
+        cursor->xml = __xml_next_element(cursor->xml);
+        cursor->have = (cursor->xml != NULL);
+    }
+}
+
+// Get the key (name and id) that children are matched by
+static char *
+cursor_key(struct stream_cursor_s *cursor)
+{
+    char *key = NULL;
+
+    if (cursor->input != NULL) {
+        xmlTextReaderPtr reader = cursor->input->reader;
+        xmlChar *id = xmlTextReaderGetAttribute(reader, (const xmlChar *) XML_ATTR_ID);
+
+        key = crm_strdup_printf("%s\n%s", xmlTextReaderConstName(reader),
+                                (id? (const char *) id : ""));
+        xmlFree(id);
+    } else {
+        key = crm_strdup_printf("%s\n%s", crm_element_name(cursor->xml),
+                                (ID(cursor->xml)? ID(cursor->xml) : ""));
+    }
+    return key;
+}
+
+// Get the current child in memory (copying it if streaming), and move past it
+static xmlNode *
+cursor_take(struct stream_cursor_s *cursor, xmlNode *holder)
+{
+    xmlNode *xml = cursor->xml;
+
+    if (cursor->input != NULL) {
+        xmlTextReaderPtr reader = cursor->input->reader;
+        xmlNode *node = xmlTextReaderExpand(reader);
+        int rc = 0;
+
+        xml = NULL;
+        if (node != NULL) {
+            xml = xmlDocCopyNode(node, holder->doc, 1);
+            xmlAddChild(holder, xml);
+        }
+        rc = xmlTextReaderNext(reader);
+        cursor->input->unread = (rc == 1);
+        cursor->input->failed |= (node == NULL) || (rc < 0);
+    }
+    cursor_next(cursor);
+    return xml;
+}
+
+static char *
+stream_path(const char *parent_path, xmlNode *xml)
+{
+    const char *id = ID(xml);
+
+    if (id == NULL) {
+        return crm_strdup_printf("%s/%s", parent_path, crm_element_name(xml));
+    }
+    return crm_strdup_printf("%s/%s[@id='%s']", parent_path,
+                             crm_element_name(xml), id);
+}
+
+static xmlNode *
+stream_change(xmlNode *patchset, const char *op, const char *path,
+              int position)
+{
+    xmlNode *change = create_xml_node(patchset, XML_DIFF_CHANGE);
+
+    crm_xml_add(change, XML_DIFF_OP, op);
+    crm_xml_add(change, XML_DIFF_PATH, path);
+    if (position >= 0) {
+        crm_xml_add_int(change, XML_DIFF_POSITION, position);
+    }
+    return change;
+}
+
+static void
+stream_change_attr(xmlNode *list, const char *op, const char *name,
+                   const char *value)
+{
+    xmlNode *attr = create_xml_node(list, XML_DIFF_ATTR);
+
+    crm_xml_add(attr, XML_NVPAIR_ATTR_NAME, name);
+    crm_xml_add(attr, XML_DIFF_OP, op);
+    if (value != NULL) {
+        crm_xml_add(attr, XML_NVPAIR_ATTR_VALUE, value);
+    }
+}
+
+// Add a modify change if two elements' attributes differ
+static void
+stream_diff_attrs(xmlNode *patchset, const char *path, xmlNode *old_xml,
+                  xmlNode *new_xml)
+{
+    xmlNode *list = NULL;
+
+    for (xmlAttr *a = new_xml->properties; a != NULL; a = a->next) {
+        const char *name = (const char *) a->name;
+        const char *value = crm_element_value(new_xml, name);
+
+        if (safe_str_neq(value, crm_element_value(old_xml, name))) {
+            if (list == NULL) {
+                list = create_xml_node(NULL, XML_DIFF_LIST);
+            }
+            stream_change_attr(list, "set", name, value);
+        }
+    }
+    for (xmlAttr *a = old_xml->properties; a != NULL; a = a->next) {
+        const char *name = (const char *) a->name;
+
+        if (crm_element_value(new_xml, name) == NULL) {
+            if (list == NULL) {
+                list = create_xml_node(NULL, XML_DIFF_LIST);
+            }
+            stream_change_attr(list, "unset", name, NULL);
+        }
+    }
+
+    if (list != NULL) {
+        xmlNode *change = stream_change(patchset, "modify", path, -1);
+        xmlNode *result = NULL;
+
+        add_node_nocopy(change, NULL, list);
+        result = create_xml_node(change, XML_DIFF_RESULT);
+
+        // Like a v2 patchset from a full comparison, give all attributes
+        result = create_xml_node(result, crm_element_name(new_xml));
+        for (xmlAttr *a = new_xml->properties; a != NULL; a = a->next) {
+            const char *name = (const char *) a->name;
+
+            crm_xml_add(result, name, crm_element_value(new_xml, name));
+        }
+    }
+}
+
+static void stream_diff_children(xmlNode *patchset, const char *path,
+                                 struct stream_cursor_s *old_children,
+                                 struct stream_cursor_s *new_children);
+
+/*!
+ * \internal
+ * \brief Compare two matching elements
+ *
+ * \param[in] patchset     Patchset to add changes to
+ * \param[in] parent_path  Path of the elements' parent
+ * \param[in] old_cursor   Cursor on original element
+ * \param[in] old_xml      Original element if not taken from \p old_cursor
+ * \param[in] new_cursor   Cursor on new element
+ * \param[in] new_xml      New element if not taken from \p new_cursor
+ *
+ * \return Newly allocated path of element
+ * \note A streaming cursor is left at the end of its element.
+ */
+static char *
+stream_diff_element(xmlNode *patchset, const char *parent_path,
+                    struct stream_cursor_s *old_cursor, xmlNode *old_xml,
+                    struct stream_cursor_s *new_cursor, xmlNode *new_xml)
+{
+    struct stream_cursor_s old_children = { NULL, 0, NULL, FALSE };
+    struct stream_cursor_s new_children = { NULL, 0, NULL, FALSE };
+    xmlNode *old_shell = NULL;
+    xmlNode *new_shell = NULL;
+    gboolean empty = FALSE;
+    char *path = NULL;
+
+    if (old_xml == NULL) {
+        old_xml = old_cursor->xml;
+        if (old_cursor->input != NULL) {
+            old_shell = stream_shell(old_cursor->input, &empty);
+            old_children.input = old_cursor->input;
+            old_children.depth = old_cursor->depth + 1;
+            old_children.have = !empty && stream_next(old_children.input,
+                                                      old_children.depth);
+            old_xml = old_shell;
+        }
+    }
+    if (old_shell == NULL) {
+        old_children.xml = __xml_first_child_element(old_xml);
+        old_children.have = (old_children.xml != NULL);
+    }
+
+    if (new_xml == NULL) {
+        new_xml = new_cursor->xml;
+        if (new_cursor->input != NULL) {
+            new_shell = stream_shell(new_cursor->input, &empty);
+            new_children.input = new_cursor->input;
+            new_children.depth = new_cursor->depth + 1;
+            new_children.have = !empty && stream_next(new_children.input,
+                                                      new_children.depth);
+            new_xml = new_shell;
+        }
+    }
+    if (new_shell == NULL) {
+        new_children.xml = __xml_first_child_element(new_xml);
+        new_children.have = (new_children.xml != NULL);
+    }
+
+    path = stream_path(parent_path, new_xml);
+    stream_diff_attrs(patchset, path, old_xml, new_xml);
+    stream_diff_children(patchset, path, &old_children, &new_children);
+
+    free_xml(old_shell);
+    free_xml(new_shell);
+    return path;
+}
+
+static void
+free_pending_queue(gpointer data)
+{
+    g_queue_free_full((GQueue *) data, free);
+}
+
+static void
+free_placement(gpointer data)
+{
+    struct stream_placement_s *placement = data;
+
+    if (placement != NULL) {
+        free(placement->path);
+        free(placement);
+    }
+}
+
+static void
+pending_add(GHashTable *pending, char *key, xmlNode *xml, int index)
+{
+    GQueue *queue = g_hash_table_lookup(pending, key);
+    struct stream_pending_s *entry = NULL;
+
+    if (xml == NULL) {      // Parse error, reported when the input ends
+        free(key);
+        return;
+    }
+    if (queue == NULL) {
+        queue = g_queue_new();
+        g_hash_table_insert(pending, key, queue);
+    } else {
+        free(key);
+    }
+    entry = calloc(1, sizeof(struct stream_pending_s));
+    CRM_ASSERT(entry != NULL);
+    entry->xml = xml;
+    entry->index = index;
+    g_queue_push_tail(queue, entry);
+}
+
+static struct stream_pending_s *
+pending_take(GHashTable *pending, const char *key)
+{
+    GQueue *queue = g_hash_table_lookup(pending, key);
+
+    return queue? g_queue_pop_head(queue) : NULL;
+}
+
+static void
+place(GPtrArray *placements, int index, char *path, xmlNode *created,
+      int a_index)
+{
+    struct stream_placement_s *placement = NULL;
+
+    placement = calloc(1, sizeof(struct stream_placement_s));
+    CRM_ASSERT(placement != NULL);
+    placement->path = path;
+    placement->created = created;
+    placement->a_index = a_index;
+
+    if (index >= placements->len) {
+        g_ptr_array_set_size(placements, index + 1);
+    }
+    g_ptr_array_index(placements, index) = placement;
+}
+
+/*!
+ * \internal
+ * \brief Compare the children of two matching elements
+ *
+ * \param[in] patchset      Patchset to add changes to
+ * \param[in] path          Path of the elements
+ * \param[in] old_children  Cursor on first child of original element
+ * \param[in] new_children  Cursor on first child of new element
+ */
+static void
+stream_diff_children(xmlNode *patchset, const char *path,
+                     struct stream_cursor_s *old_children,
+                     struct stream_cursor_s *new_children)
+{
+    GHashTable *old_pending = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                    free, free_pending_queue);
+    GHashTable *new_pending = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                                    free, free_pending_queue);
+    GPtrArray *placements = g_ptr_array_new_with_free_func(free_placement);
+    xmlNode *holder = create_xml_node(NULL, "holder");
+    int old_index = 0;
+    int new_index = 0;
+    int last_index = -1;
+    gboolean reordered = FALSE;
+    GHashTableIter iter;
+    gpointer value = NULL;
+
+    while (old_children->have || new_children->have) {
+        char *old_key = old_children->have? cursor_key(old_children) : NULL;
+        char *new_key = new_children->have? cursor_key(new_children) : NULL;
+        struct stream_pending_s *entry = NULL;
+
+        if ((old_key != NULL) && safe_str_eq(old_key, new_key)) {
+            place(placements, new_index++,
+                  stream_diff_element(patchset, path, old_children, NULL,
+                                      new_children, NULL),
+                  NULL, old_index++);
+            cursor_next(old_children);
+            cursor_next(new_children);
+
+        } else if ((new_key != NULL)
+                   && (entry = pending_take(old_pending, new_key)) != NULL) {
+            place(placements, new_index++,
+                  stream_diff_element(patchset, path, NULL, entry->xml,
+                                      new_children, NULL),
+                  NULL, entry->index);
+            cursor_next(new_children);
+            free(entry);
+
+        } else if ((old_key != NULL)
+                   && (entry = pending_take(new_pending, old_key)) != NULL) {
+            place(placements, entry->index,
+                  stream_diff_element(patchset, path, old_children, NULL,
+                                      NULL, entry->xml),
+                  NULL, old_index++);
+            cursor_next(old_children);
+            free(entry);
+
+        } else {
+            // Keep both in memory until their matches (if any) turn up
+            if (new_key != NULL) {
+                pending_add(new_pending, new_key, cursor_take(new_children, holder),
+                            new_index++);
+                new_key = NULL;
+            }
+            if (old_key != NULL) {
+                pending_add(old_pending, old_key, cursor_take(old_children, holder),
+                            old_index++);
+                old_key = NULL;
+            }
+        }
+        free(old_key);
+        free(new_key);
+    }
+
+    // Original children that were not matched have been deleted
+    g_hash_table_iter_init(&iter, old_pending);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        for (GList *gIter = ((GQueue *) value)->head; gIter; gIter = gIter->next) {
+            struct stream_pending_s *entry = gIter->data;
+            char *child_path = stream_path(path, entry->xml);
+
+            stream_change(patchset, "delete", child_path, -1);
+            free(child_path);
+        }
+    }
+
+    // New children that were not matched have been created
+    g_hash_table_iter_init(&iter, new_pending);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        for (GList *gIter = ((GQueue *) value)->head; gIter; gIter = gIter->next) {
+            struct stream_pending_s *entry = gIter->data;
+
+            place(placements, entry->index, NULL, entry->xml, -1);
+        }
+    }
+
+    for (int lpc = 0; lpc < placements->len; lpc++) {
+        struct stream_placement_s *placement = g_ptr_array_index(placements, lpc);
+
+        if ((placement != NULL) && (placement->path != NULL)) {
+            if (placement->a_index < last_index) {
+                reordered = TRUE;
+                break;
+            }
+            last_index = placement->a_index;
+        }
+    }
+
+    /* Create and move in order of position, so that each child is put where
+     * everything before it is already in place
+     */
+    for (int lpc = 0; lpc < placements->len; lpc++) {
+        struct stream_placement_s *placement = g_ptr_array_index(placements, lpc);
+
+        if (placement == NULL) {
+            continue;
+
+        } else if (placement->created != NULL) {
+            xmlNode *change = stream_change(patchset, "create", path, lpc);
+
+            add_node_copy(change, placement->created);
+
+        } else if (reordered) {
+            stream_change(patchset, "move", placement->path, lpc);
+        }
+    }
+
+    g_ptr_array_free(placements, TRUE);
+    g_hash_table_destroy(old_pending);
+    g_hash_table_destroy(new_pending);
+    free_xml(holder);
+}
+
+static void
+stream_add_version(xmlNode *version, const char *tag, xmlNode *root,
+                   const char **vfields, size_t nvfields)
+{
+    xmlNode *xml = create_xml_node(version, tag);
+
+    for (int lpc = 0; lpc < nvfields; lpc++) {
+        const char *value = crm_element_value(root, vfields[lpc]);
+
+        crm_xml_add(xml, vfields[lpc], (value? value : "1"));
+    }
+}
+
+static int
+stream_patch(const char *source_1, gboolean raw_1, const char *source_2,
+             gboolean raw_2, gboolean as_cib, gboolean no_version)
+{
+    struct stream_input_s input_1;
+    struct stream_input_s input_2;
+    struct stream_cursor_s children_1 = { &input_1, 1, NULL, FALSE };
+    struct stream_cursor_s children_2 = { &input_2, 1, NULL, FALSE };
+    xmlNode *output = NULL;
+    xmlNode *root_1 = NULL;
+    xmlNode *root_2 = NULL;
+    gboolean empty_1 = FALSE;
+    gboolean empty_2 = FALSE;
+    char *path = NULL;
+    int rc = pcmk_ok;
+
+    const char *vfields[] = {
+        XML_ATTR_GENERATION_ADMIN,
+        XML_ATTR_GENERATION,
+        XML_ATTR_NUMUPDATES,
+    };
+
+    if (!stream_open(&input_1, source_1, raw_1)) {
+        fprintf(stderr, "Could not open the first XML fragment\n");
+        return -ENOENT;
+    }
+    if (!stream_open(&input_2, source_2, raw_2)) {
+        fprintf(stderr, "Could not open the second XML fragment\n");
+        xmlFreeTextReader(input_1.reader);
+        return -ENOENT;
+    }
+
+    if (!stream_next(&input_1, 0) || !stream_next(&input_2, 0)) {
+        goto done; // Reported below
+    }
+
+    root_1 = stream_shell(&input_1, &empty_1);
+    root_2 = stream_shell(&input_2, &empty_2);
+    if (safe_str_neq(crm_element_name(root_1), crm_element_name(root_2))) {
+        fprintf(stderr, "Cannot compare <%s> to <%s>\n",
+                crm_element_name(root_1), crm_element_name(root_2));
+        rc = -pcmk_err_generic;
+        goto done;
+    }
+
+    output = create_xml_node(NULL, XML_TAG_DIFF);
+    crm_xml_add_int(output, "format", 2);
+
+    /* If we're ignoring the version, make the version information
+     * identical, so it isn't detected as a change. */
+    if (no_version) {
+        for (int lpc = 0; lpc < DIMOF(vfields); lpc++) {
+            crm_copy_xml_element(root_1, root_2, vfields[lpc]);
+        }
+    } else {
+        xmlNode *version = create_xml_node(output, XML_DIFF_VERSION);
+
+        stream_add_version(version, XML_DIFF_VSOURCE, root_1, vfields,
+                           DIMOF(vfields));
+        stream_add_version(version, XML_DIFF_VTARGET, root_2, vfields,
+                           DIMOF(vfields));
+    }
+
+    path = stream_path("", root_2);
+    stream_diff_attrs(output, path, root_1, root_2);
+    children_1.have = !empty_1 && stream_next(&input_1, 1);
+    children_2.have = !empty_2 && stream_next(&input_2, 1);
+    stream_diff_children(output, path, &children_1, &children_2);
+
+  done:
+    if (input_1.failed || (root_1 == NULL)) {
+        fprintf(stderr, "Could not parse the first XML fragment\n");
+        rc = -pcmk_err_schema_validation;
+
+    } else if (input_2.failed || (root_2 == NULL)) {
+        fprintf(stderr, "Could not parse the second XML fragment\n");
+        rc = -pcmk_err_schema_validation;
+
+    } else if ((rc == pcmk_ok)
+               && (find_xml_node(output, XML_DIFF_CHANGE, FALSE) != NULL)) {
+        if (as_cib) {
+            log_patch_cib_versions(output);
+        }
+        xml_log_patchset(LOG_NOTICE, __FUNCTION__, output);
+        print_patch(output);
+        rc = -pcmk_err_generic;
+    }
+
+    free(path);
+    free_xml(output);
+    free_xml(root_1);
+    free_xml(root_2);
+    xmlFreeTextReader(input_1.reader);
+    xmlFreeTextReader(input_2.reader);
+    return rc;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -230,6 +920,7 @@ main(int argc, char **argv)
     gboolean use_stdin = FALSE;
     gboolean as_cib = FALSE;
     gboolean no_version = FALSE;
+    gboolean stream = FALSE;
     int argerr = 0;
     int flag;
     int rc = pcmk_ok;
@@ -282,6 +973,9 @@ main(int argc, char **argv)
             case 'u':
                 no_version = TRUE;
                 break;
+            case 'S':
+                stream = TRUE;
+                break;
             case 'V':
                 crm_bump_log_level(argc, argv);
                 break;
@@ -318,6 +1012,16 @@ main(int argc, char **argv)
         return CRM_EX_USAGE;
     }
 
+    if (stream) {
+        if (apply || use_stdin || (xml_file_1 == NULL) || (xml_file_2 == NULL)) {
+            fprintf(stderr, "error: -S/--stream needs two inputs to compare (not standard input)\n");
+            return CRM_EX_USAGE;
+        }
+        rc = stream_patch(xml_file_1, raw_1, xml_file_2, raw_2, as_cib,
+                          no_version);
+        return crm_errno2exit(rc);
+    }
+
     if (raw_1) {
         object_1 = string2xml(xml_file_1);
 
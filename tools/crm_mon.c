@@ -124,6 +124,7 @@ int fence_history_level = 0;
 gboolean print_brief = FALSE;
 gboolean print_pending = TRUE;
 gboolean print_clone_detail = FALSE;
+gboolean xml_stream = FALSE;
 
 /* FIXME allow, detect, and correctly interpret glob pattern or regex? */
 const char *print_neg_location_prefix = "";
@@ -136,6 +137,29 @@ const char *print_neg_location_prefix = "";
 long last_refresh = 0;
 crm_trigger_t *refresh_trigger = NULL;
 
+/*
+ * Cached status
+ *
+ * Most refreshes happen without anything having changed (to update the time
+ * shown, or to poll for pending fencing actions), so the unpacked working set
+ * is kept as long as the CIB version it was unpacked from is current, and the
+ * processed fencing history is kept as long as the fencer reports no change
+ * since it was fetched. Only the output is regenerated each time. The working
+ * set is also unpacked again once it is MON_STATUS_MAX_AGE seconds old, since
+ * some status (such as expired failures) depends on the time.
+ */
+#define MON_STATUS_MAX_AGE 60
+
+static pe_working_set_t mon_data_set;
+static gboolean mon_data_set_valid = FALSE;
+static gboolean mon_constraints_unpacked = FALSE;
+static char *mon_data_set_version = NULL;
+static time_t mon_data_set_time = 0;
+
+static stonith_history_t *mon_stonith_history = NULL;
+static int mon_stonith_history_seq = 0;
+static char *mon_stonith_history_incarnation = NULL;
+
 /* Define exit codes for monitoring-compatible output */
 #define MON_STATUS_WARN CRM_EX_ERROR
 
@@ -220,6 +244,9 @@ mon_cib_connection_destroy(gpointer user_data)
         g_source_remove(timer_id);
         timer_id = 0;
     }
+    // The fencer's history sequence may be different after reconnecting
+    mon_stonith_history_seq = 0;
+
     if (st) {
         /* the client API won't properly reconnect notifications
          * if they are still in the table - so remove them
@@ -370,6 +397,8 @@ static struct crm_option long_options[] = {
     {"as-xml",         0, 0, 'X', "\t\tWrite cluster status as xml to stdout. This will enable one-shot mode."},
     {"web-cgi",        0, 0, 'w', "\t\tWeb mode with output suitable for CGI (preselected when run as *.cgi)"},
     {"simple-status",  0, 0, 's', "\tDisplay the cluster status once as a simple one line output (suitable for nagios)"},
+    {"as-xml-stream",  0, 0, 'S', "\tWrite cluster status as xml to stdout, then one line of xml for each change.\n"
+                                  "\t\t\t\tA new status line is written whenever changes could not be followed."},
     {"-spacer-",	1, 0, '-', "\nDisplay Options:"},
     {"group-by-node",  0, 0, 'n', "\tGroup resources by node"     },
     {"inactive",       0, 0, 'r', "\t\tDisplay inactive resources"  },
@@ -411,6 +440,8 @@ static struct crm_option long_options[] = {
     {"-spacer-",	1, 0, '-', " crm_mon --daemonize --as-html /path/to/docroot/filename.html", pcmk_option_example},
     {"-spacer-",	1, 0, '-', "Start crm_mon and export the current cluster status as xml to stdout, then exit.:", pcmk_option_paragraph},
     {"-spacer-",	1, 0, '-', " crm_mon --as-xml", pcmk_option_example},
+    {"-spacer-",	1, 0, '-', "Follow the cluster status as a stream of xml lines (one status line, then one line per event):", pcmk_option_paragraph},
+    {"-spacer-",	1, 0, '-', " crm_mon --as-xml-stream", pcmk_option_example},
 
     {NULL, 0, 0, 0}
 };
@@ -689,6 +720,13 @@ main(int argc, char **argv)
                 output_format = mon_output_cgi;
                 one_shot = TRUE;
                 break;
+            case 'S':
+                argerr += (output_format != mon_output_console);
+                output_format = mon_output_xml;
+                xml_stream = TRUE;
+                watch_fencing = TRUE;
+                fence_connect = TRUE;
+                break;
             case 's':
                 argerr += (output_format != mon_output_console);
                 output_format = mon_output_monitor;
@@ -1565,7 +1603,7 @@ print_rsc_history(FILE *stream, pe_working_set_t *data_set, node_t *node,
             op_list = g_list_append(op_list, rsc_op);
         }
     }
-    op_list = g_list_sort(op_list, sort_op_by_callid);
+    op_list = pe__sort_ops_by_callid(op_list);
 
     /* Print each operation */
     for (gIter = op_list; gIter != NULL; gIter = gIter->next) {
@@ -3495,13 +3533,13 @@ print_status(pe_working_set_t * data_set,
  * \internal
  * \brief Print cluster status in XML format
  *
+ * \param[in] stream     File stream to display output to
  * \param[in] data_set   Working set of CIB state
  */
 static void
-print_xml_status(pe_working_set_t * data_set,
+print_xml_status(FILE *stream, pe_working_set_t * data_set,
                  stonith_history_t *stonith_history)
 {
-    FILE *stream = stdout;
     GListPtr gIter = NULL;
     int print_opts = get_resource_display_options();
 
@@ -3599,7 +3637,49 @@ print_xml_status(pe_working_set_t * data_set,
 
     fprintf(stream, "</crm_mon>\n");
     fflush(stream);
-    fclose(stream);
+}
+
+/*!
+ * \internal
+ * \brief Print cluster status in XML format, on one line (for --as-xml-stream)
+ *
+ * \param[in] data_set   Working set of CIB state
+ */
+static void
+print_xml_stream_status(pe_working_set_t *data_set,
+                        stonith_history_t *stonith_history)
+{
+    FILE *tmp = tmpfile();
+    char *buffer = NULL;
+    size_t len = 0;
+    xmlNode *status = NULL;
+
+    if (tmp == NULL) {
+        fprintf(stderr, "Could not create temporary file: %s\n",
+                pcmk_strerror(errno));
+        return;
+    }
+
+    // Reuse the --as-xml output, then reformat it without newlines
+    print_xml_status(tmp, data_set, stonith_history);
+    rewind(tmp);
+    while (!feof(tmp) && !ferror(tmp)) {
+        buffer = realloc_safe(buffer, len + 4097);
+        len += fread(buffer + len, 1, 4096, tmp);
+        buffer[len] = '\0';
+    }
+    fclose(tmp);
+
+    status = string2xml(buffer);
+    free(buffer);
+    if (status != NULL) {
+        char *text = dump_xml_unformatted(status);
+
+        printf("%s\n", text);
+        fflush(stdout);
+        free(text);
+        free_xml(status);
+    }
 }
 
 /*!
@@ -3790,6 +3870,225 @@ send_custom_trap(const char *node, const char *rsc, const char *task, int target
     return 0;
 }
 
+/*
+ * XML stream output
+ *
+ * With --as-xml-stream, the full status (as with --as-xml) is written once, on
+ * a single line, and after that only one line per change, each an <event>
+ * element with a type of "resource" (a resource operation result), "node" (a
+ * change in a node's membership or standby setting), "configuration" (a
+ * change below the configuration section, which requires the v2 patchset
+ * format) or "fencing". A new status line is written
+ * whenever a change could not be applied (and after reconnecting), so a
+ * reader can always start over from the last status line.
+ */
+
+static void
+stream_event(xmlNode *event)
+{
+    char *text = NULL;
+    char *now_s = crm_itoa((int) time(NULL));
+
+    crm_xml_add(event, "timestamp", now_s);
+    text = dump_xml_unformatted(event);
+    printf("%s\n", text);
+    fflush(stdout);
+    free(text);
+    free(now_s);
+    free_xml(event);
+}
+
+static void
+stream_rsc_event(const char *node, const char *rsc, const char *task,
+                 int target_rc, int rc, int status, const char *desc)
+{
+    xmlNode *event = create_xml_node(NULL, "event");
+
+    crm_xml_add(event, "type", "resource");
+    crm_xml_add(event, "node", node);
+    crm_xml_add(event, "resource", rsc);
+    crm_xml_add(event, "task", task);
+    crm_xml_add_int(event, "rc", rc);
+    crm_xml_add_int(event, "target_rc", target_rc);
+    crm_xml_add_int(event, "status", status);
+    crm_xml_add(event, "failed",
+                ((status == PCMK_LRM_OP_DONE) && (rc == target_rc))? "false" : "true");
+    crm_xml_add(event, "description", desc);
+    stream_event(event);
+}
+
+/*!
+ * \internal
+ * \brief Write a node event for a node state change, if it is about membership
+ *
+ * \param[in] change  Change from a v2 patchset
+ * \param[in] state   Node state entry resulting from \p change
+ */
+static void
+stream_node_event(xmlNode *change, xmlNode *state)
+{
+    const char *fields[] = {
+        XML_NODE_IN_CLUSTER, XML_NODE_IS_PEER, XML_NODE_JOIN_STATE,
+        XML_NODE_EXPECTED
+    };
+    xmlNode *event = NULL;
+    xmlNode *list = first_named_child(change, XML_DIFF_LIST);
+    gboolean relevant = (list == NULL); // created, so everything is new
+
+    // Node state entries are modified all the time for other reasons
+    for (xmlNode *attr = first_named_child(list, XML_DIFF_ATTR);
+         (attr != NULL) && !relevant; attr = crm_next_same_xml(attr)) {
+
+        const char *name = crm_element_value(attr, XML_NVPAIR_ATTR_NAME);
+
+        for (int lpc = 0; lpc < DIMOF(fields); lpc++) {
+            if (safe_str_eq(name, fields[lpc])) {
+                relevant = TRUE;
+                break;
+            }
+        }
+    }
+    if (!relevant) {
+        return;
+    }
+
+    event = create_xml_node(NULL, "event");
+    crm_xml_add(event, "type", "node");
+    crm_xml_add(event, "id", ID(state));
+    crm_xml_add(event, "node", crm_element_value(state, XML_ATTR_UNAME));
+    for (int lpc = 0; lpc < DIMOF(fields); lpc++) {
+        crm_xml_add(event, fields[lpc], crm_element_value(state, fields[lpc]));
+    }
+    stream_event(event);
+}
+
+/*!
+ * \internal
+ * \brief Write a configuration event for a change from a v2 patchset
+ *
+ * \param[in] change  Change from a v2 patchset
+ */
+static void
+stream_config_event(xmlNode *change)
+{
+    const char *op = crm_element_value(change, XML_DIFF_OP);
+    const char *xpath = crm_element_value(change, XML_DIFF_PATH);
+    xmlNode *created = NULL;
+    xmlNode *event = NULL;
+
+    if (!crm_starts_with(xpath, "/" XML_TAG_CIB "/" XML_CIB_TAG_CONFIGURATION)) {
+        return;
+    }
+
+    event = create_xml_node(NULL, "event");
+    crm_xml_add(event, "type", "configuration");
+    crm_xml_add(event, "operation", op);
+    crm_xml_add(event, "path", xpath);
+    if (safe_str_eq(op, "create")) {
+        created = __xml_first_child(change);
+    }
+    if (created != NULL) {
+        crm_xml_add(event, "element", crm_element_name(created));
+        crm_xml_add(event, "id", ID(created));
+    }
+    stream_event(event);
+}
+
+// Whether a node is in standby (a transient setting overrides a permanent one)
+static gboolean
+node_in_standby(xmlNode *cib, const char *id)
+{
+    const char *fmt[] = {
+        "/" XML_TAG_CIB "/" XML_CIB_TAG_STATUS "/" XML_CIB_TAG_STATE
+            "[@" XML_ATTR_ID "='%s']/" XML_TAG_TRANSIENT_NODEATTRS "/"
+            XML_TAG_ATTR_SETS "/" XML_CIB_TAG_NVPAIR
+            "[@" XML_NVPAIR_ATTR_NAME "='standby']",
+        "/" XML_TAG_CIB "/" XML_CIB_TAG_CONFIGURATION "/" XML_CIB_TAG_NODES
+            "/" XML_CIB_TAG_NODE "[@" XML_ATTR_ID "='%s']/" XML_TAG_ATTR_SETS
+            "/" XML_CIB_TAG_NVPAIR "[@" XML_NVPAIR_ATTR_NAME "='standby']",
+    };
+
+    for (int lpc = 0; lpc < DIMOF(fmt); lpc++) {
+        char *xpath = crm_strdup_printf(fmt[lpc], id);
+        xmlNode *nvpair = get_xpath_object(xpath, cib, LOG_TRACE);
+
+        free(xpath);
+        if (nvpair != NULL) {
+            return crm_is_true(crm_element_value(nvpair,
+                                                 XML_NVPAIR_ATTR_VALUE));
+        }
+    }
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Write a node event for each node whose standby setting has changed
+ *
+ * \param[in] cib     Current CIB
+ * \param[in] report  If FALSE, only remember the current settings (because a
+ *                    full status line was just written)
+ */
+static void
+stream_standby_events(xmlNode *cib, gboolean report)
+{
+    static GHashTable *standby = NULL; // node ID -> GINT_TO_POINTER(standby)
+    xmlNode *nodes = get_xpath_object("/" XML_TAG_CIB "/"
+                                      XML_CIB_TAG_CONFIGURATION "/"
+                                      XML_CIB_TAG_NODES, cib, LOG_TRACE);
+
+    if (standby == NULL) {
+        standby = crm_str_table_new();
+    }
+
+    for (xmlNode *node = first_named_child(nodes, XML_CIB_TAG_NODE);
+         node != NULL; node = crm_next_same_xml(node)) {
+
+        const char *id = ID(node);
+        gboolean now = (id != NULL) && node_in_standby(cib, id);
+        gpointer before = NULL;
+        gboolean known = FALSE;
+
+        if (id == NULL) {
+            continue;
+        }
+        known = g_hash_table_lookup_extended(standby, id, NULL, &before);
+        if (known && (GPOINTER_TO_INT(before) == now)) {
+            continue;
+        }
+        g_hash_table_replace(standby, strdup(id), GINT_TO_POINTER(now));
+
+        // A new node is only worth reporting if it starts out in standby
+        if (report && (known || now)) {
+            xmlNode *event = create_xml_node(NULL, "event");
+
+            crm_xml_add(event, "type", "node");
+            crm_xml_add(event, "id", id);
+            crm_xml_add(event, "node", crm_element_value(node, XML_ATTR_UNAME));
+            crm_xml_add(event, "standby", (now? "true" : "false"));
+            stream_event(event);
+        }
+    }
+}
+
+static void
+stream_fence_event(stonith_event_t *e)
+{
+    xmlNode *event = create_xml_node(NULL, "event");
+
+    crm_xml_add(event, "type", "fencing");
+    crm_xml_add(event, "id", e->id);
+    crm_xml_add(event, "target", e->target);
+    crm_xml_add(event, "action", e->action);
+    crm_xml_add(event, "operation", e->operation);
+    crm_xml_add(event, "origin", e->origin);
+    crm_xml_add(event, "delegate", e->executioner);
+    crm_xml_add(event, "client", e->client_origin);
+    crm_xml_add_int(event, "rc", e->result);
+    crm_xml_add(event, "description", pcmk_strerror(e->result));
+    stream_event(event);
+}
+
 static void
 handle_rsc_op(xmlNode * xml, const char *node_id)
 {
@@ -3887,6 +4186,9 @@ handle_rsc_op(xmlNode * xml, const char *node_id)
     if (notify && external_agent) {
         send_custom_trap(node, rsc, task, target_rc, rc, status, desc);
     }
+    if (notify && xml_stream) {
+        stream_rsc_event(node, rsc, task, target_rc, rc, status, desc);
+    }
   bail:
     free(update_te_uuid);
     free(rsc);
@@ -3954,6 +4256,9 @@ static void crm_diff_update_v2(const char *event, xmlNode * msg)
         }
 
         crm_trace("Handling %s operation for %s %p, %s", op, xpath, match, name);
+        if (xml_stream) {
+            stream_config_event(change);
+        }
         if(xpath == NULL) {
             /* Version field, ignore */
 
@@ -3989,6 +4294,9 @@ static void crm_diff_update_v2(const char *event, xmlNode * msg)
             if (node == NULL) {
                 node = ID(match);
             }
+            if (xml_stream) {
+                stream_node_event(change, match);
+            }
             handle_rsc_op(match, node);
 
         } else if(strcmp(name, XML_CIB_TAG_LRM) == 0) {
@@ -4041,9 +4349,14 @@ crm_diff_update(const char *event, xmlNode * msg)
     int rc = -1;
     static bool stale = FALSE;
     gboolean cib_updated = FALSE;
+    gboolean cib_reloaded = FALSE;
     xmlNode *diff = get_message_xml(msg, F_CIB_UPDATE_RESULT);
+    xmlNode *full_cib = get_message_xml(msg, F_CIB_UPDATE_CIB);
 
-    print_dot();
+    if (!xml_stream) {
+        // Stream output is machine-readable, one element per line
+        print_dot();
+    }
 
     if (current_cib != NULL) {
         rc = xml_apply_patchset(current_cib, diff, TRUE);
@@ -4053,6 +4366,12 @@ crm_diff_update(const char *event, xmlNode * msg)
             case -pcmk_err_diff_failed:
                 crm_notice("[%s] Patch aborted: %s (%d)", event, pcmk_strerror(rc), rc);
                 free_xml(current_cib); current_cib = NULL;
+
+                // The CIB manager sends the whole CIB if we fell too far behind
+                if (full_cib != NULL) {
+                    current_cib = copy_xml(full_cib);
+                    cib_reloaded = TRUE;
+                }
                 break;
             case pcmk_ok:
                 cib_updated = TRUE;
@@ -4066,9 +4385,10 @@ crm_diff_update(const char *event, xmlNode * msg)
     if (current_cib == NULL) {
         crm_trace("Re-requesting the full cib");
         cib->cmds->query(cib, NULL, &current_cib, cib_scope_local | cib_sync_call);
+        cib_reloaded = TRUE;
     }
 
-    if (external_agent) {
+    if (external_agent || xml_stream) {
         int format = 0;
         crm_element_value_int(diff, "format", &format);
         switch(format) {
@@ -4084,7 +4404,7 @@ crm_diff_update(const char *event, xmlNode * msg)
     }
 
     if (current_cib == NULL) {
-        if(!stale) {
+        if(!stale && !xml_stream) {
             print_as("--- Stale data ---");
         }
         stale = TRUE;
@@ -4092,19 +4412,151 @@ crm_diff_update(const char *event, xmlNode * msg)
     }
 
     stale = FALSE;
+    if (xml_stream) {
+        // Changes are streamed as events, unless they could not be followed
+        if (cib_reloaded) {
+            mainloop_set_trigger(refresh_trigger);
+        } else {
+            stream_standby_events(current_cib, TRUE);
+        }
+        return;
+    }
     kick_refresh(cib_updated);
 }
 
+static void
+free_cached_status(void)
+{
+    if (mon_data_set_valid) {
+        cleanup_alloc_calculations(&mon_data_set);
+        mon_data_set_valid = FALSE;
+    }
+    free(mon_data_set_version);
+    mon_data_set_version = NULL;
+
+    stonith_history_free(mon_stonith_history);
+    mon_stonith_history = NULL;
+    mon_stonith_history_seq = 0;
+    free(mon_stonith_history_incarnation);
+    mon_stonith_history_incarnation = NULL;
+}
+
+static char *
+cib_version_string(xmlNode *xml)
+{
+    return crm_strdup_printf("%s.%s.%s",
+                             crm_element_value(xml, XML_ATTR_GENERATION_ADMIN),
+                             crm_element_value(xml, XML_ATTR_GENERATION),
+                             crm_element_value(xml, XML_ATTR_NUMUPDATES));
+}
+
+/*!
+ * \internal
+ * \brief Unpack the current CIB, unless the cached working set is up to date
+ *
+ * \return TRUE if mon_data_set is usable, FALSE if the CIB could not be used
+ */
+static gboolean
+refresh_data_set(void)
+{
+    char *version = cib_version_string(current_cib);
+    xmlNode *cib_copy = NULL;
+
+    if (mon_data_set_valid && safe_str_eq(version, mon_data_set_version)
+        && ((time(NULL) - mon_data_set_time) < MON_STATUS_MAX_AGE)) {
+        crm_trace("Reusing status unpacked from CIB %s", version);
+        free(version);
+        return TRUE;
+    }
+
+    if (mon_data_set_valid) {
+        cleanup_alloc_calculations(&mon_data_set);
+        mon_data_set_valid = FALSE;
+    }
+    free(mon_data_set_version);
+    mon_data_set_version = version;
+
+    cib_copy = copy_xml(current_cib);
+    if (cli_config_update(&cib_copy, NULL, FALSE) == FALSE) {
+        free_xml(cib_copy);
+        return FALSE;
+    }
+
+    set_working_set_defaults(&mon_data_set);
+    mon_data_set.input = cib_copy;
+    cluster_status(&mon_data_set);
+    mon_data_set_valid = TRUE;
+    mon_constraints_unpacked = FALSE;
+    mon_data_set_time = time(NULL);
+    return TRUE;
+}
+
+/*!
+ * \internal
+ * \brief Get the fencing history, unless the cached copy is up to date
+ *
+ * \return TRUE if mon_stonith_history is usable, otherwise FALSE
+ */
+static gboolean
+refresh_stonith_history(void)
+{
+    stonith_history_t *history = NULL;
+    int seq = mon_stonith_history_seq;
+
+    if (st == NULL) {
+        fprintf(stderr, "Critical: No stonith-API\n");
+        return FALSE;
+    }
+
+    if (st->cmds->history_since(st, st_opt_sync_call, NULL,
+                                &mon_stonith_history_incarnation, &seq,
+                                &history, 120)) {
+        goto failed;
+    }
+
+    if (mon_stonith_history_seq > 0) {
+        if ((history == NULL) && (seq == mon_stonith_history_seq)) {
+            crm_trace("Fencing history unchanged since %d", seq);
+            return TRUE;
+        }
+
+        // Something changed, so get it all again to reduce and sort
+        stonith_history_free(history);
+        history = NULL;
+        seq = 0;
+        if (st->cmds->history_since(st, st_opt_sync_call, NULL,
+                                    &mon_stonith_history_incarnation, &seq,
+                                    &history, 120)) {
+            goto failed;
+        }
+    }
+
+    if ((!fence_full_history) && (output_format != mon_output_xml)) {
+        history = reduce_stonith_history(history);
+    }
+    stonith_history_free(mon_stonith_history);
+    mon_stonith_history = sort_stonith_history(history);
+    mon_stonith_history_seq = seq;
+    return TRUE;
+
+  failed:
+    fprintf(stderr, "Critical: Unable to get stonith-history\n");
+    stonith_history_free(mon_stonith_history);
+    mon_stonith_history = NULL;
+    mon_stonith_history_seq = 0;
+    mon_cib_connection_destroy(NULL);
+    return FALSE;
+}
+
 gboolean
 mon_refresh_display(gpointer user_data)
 {
-    xmlNode *cib_copy = copy_xml(current_cib);
-    pe_working_set_t data_set;
+    pe_working_set_t *data_set = &mon_data_set;
     stonith_history_t *stonith_history = NULL;
 
     last_refresh = time(NULL);
 
-    if (cli_config_update(&cib_copy, NULL, FALSE) == FALSE) {
+    if (refresh_data_set() == FALSE) {
         if (cib) {
             cib->cmds->signoff(cib);
         }
@@ -4118,56 +4570,48 @@ mon_refresh_display(gpointer user_data)
 
     /* get the stonith-history if there is evidence we need it
      */
-    while (fence_history) {
-        if (st != NULL) {
-            if (st->cmds->history(st, st_opt_sync_call, NULL, &stonith_history, 120)) {
-                fprintf(stderr, "Critical: Unable to get stonith-history\n");
-                mon_cib_connection_destroy(NULL);
-            } else {
-                if ((!fence_full_history) && (output_format != mon_output_xml)) {
-                    stonith_history = reduce_stonith_history(stonith_history);
-                }
-                stonith_history = sort_stonith_history(stonith_history);
-                break; /* all other cases are errors */
+    if (fence_history) {
+        if (refresh_stonith_history() == FALSE) {
+            print_as("Reading stonith-history failed");
+            if (output_format == mon_output_console) {
+                sleep(2);
             }
-        } else {
-            fprintf(stderr, "Critical: No stonith-API\n");
+            return FALSE;
         }
-        free_xml(cib_copy);
-        print_as("Reading stonith-history failed");
-        if (output_format == mon_output_console) {
-            sleep(2);
-        }
-        return FALSE;
+        stonith_history = mon_stonith_history;
     }
 
-    set_working_set_defaults(&data_set);
-    data_set.input = cib_copy;
-    cluster_status(&data_set);
-
     /* Unpack constraints if any section will need them
      * (tickets may be referenced in constraints but not granted yet,
      * and bans need negative location constraints) */
-    if (show & (mon_show_bans | mon_show_tickets)) {
-        xmlNode *cib_constraints = get_object_root(XML_CIB_TAG_CONSTRAINTS, data_set.input);
-        unpack_constraints(cib_constraints, &data_set);
+    if ((show & (mon_show_bans | mon_show_tickets))
+        && !mon_constraints_unpacked) {
+        xmlNode *cib_constraints = get_object_root(XML_CIB_TAG_CONSTRAINTS, data_set->input);
+        unpack_constraints(cib_constraints, data_set);
+        mon_constraints_unpacked = TRUE;
     }
 
     switch (output_format) {
         case mon_output_html:
         case mon_output_cgi:
-            if (print_html_status(&data_set, output_filename, stonith_history) != 0) {
+            if (print_html_status(data_set, output_filename, stonith_history) != 0) {
                 fprintf(stderr, "Critical: Unable to output html file\n");
                 clean_up(CRM_EX_CANTCREAT);
             }
             break;
 
         case mon_output_xml:
-            print_xml_status(&data_set, stonith_history);
+            if (xml_stream) {
+                print_xml_stream_status(data_set, stonith_history);
+                stream_standby_events(data_set->input, FALSE);
+            } else {
+                print_xml_status(stdout, data_set, stonith_history);
+                fclose(stdout);
+            }
             break;
 
         case mon_output_monitor:
-            print_simple_status(&data_set, stonith_history);
+            print_simple_status(data_set, stonith_history);
             if (has_warnings) {
                 clean_up(MON_STATUS_WARN);
             }
@@ -4175,19 +4619,15 @@ mon_refresh_display(gpointer user_data)
 
         case mon_output_plain:
         case mon_output_console:
-            print_status(&data_set, stonith_history);
+            print_status(data_set, stonith_history);
             break;
 
         case mon_output_none:
             break;
     }
 
-    stonith_history_free(stonith_history);
-    stonith_history = NULL;
-    cleanup_alloc_calculations(&data_set);
-
     /* poll for pending fence-actions as we don't get notifications so far */
-    if ((!one_shot) && (show & mon_show_fence_history)) {
+    if ((!one_shot) && !xml_stream && (show & mon_show_fence_history)) {
         kick_refresh(FALSE);
     }
     return TRUE;
@@ -4199,12 +4639,18 @@ mon_st_callback_event(stonith_t * st, stonith_event_t * e)
     if (st->state == stonith_disconnected) {
         /* disconnect cib as well and have everything reconnect */
         mon_cib_connection_destroy(NULL);
-    } else if (external_agent) {
-        char *desc = crm_strdup_printf("Operation %s requested by %s for peer %s: %s (ref=%s)",
-                                    e->operation, e->origin, e->target, pcmk_strerror(e->result),
-                                    e->id);
-        send_custom_trap(e->target, NULL, e->operation, pcmk_ok, e->result, 0, desc);
-        free(desc);
+    } else {
+        if (xml_stream) {
+            stream_fence_event(e);
+        }
+        if (external_agent) {
+            char *desc = crm_strdup_printf("Operation %s requested by %s for peer %s: %s (ref=%s)",
+                                           e->operation, e->origin, e->target,
+                                           pcmk_strerror(e->result), e->id);
+
+            send_custom_trap(e->target, NULL, e->operation, pcmk_ok, e->result, 0, desc);
+            free(desc);
+        }
     }
 }
 
@@ -4288,6 +4734,7 @@ clean_up(crm_exit_t exit_code)
         st = NULL;
     }
 
+    free_cached_status();
     free(output_filename);
     free(xml_file);
     free(pid_file);
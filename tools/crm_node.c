@@ -16,6 +16,7 @@
 #include <crm/common/mainloop.h>
 #include <crm/msg_xml.h>
 #include <crm/cib.h>
+#include <crm/cib/internal.h>
 #include <crm/attrd.h>
 
 static int command = 0;
@@ -273,6 +274,8 @@ cib_remove_node(long id, const char *name)
 {
     int rc;
     cib_t *cib = NULL;
+    cib_future_t *node_removal = NULL;
+    cib_future_t *state_removal = NULL;
     xmlNode *node = NULL;
     xmlNode *node_state = NULL;
 
@@ -295,16 +298,24 @@ cib_remove_node(long id, const char *name)
     cib = cib_new();
     cib->cmds->signon(cib, crm_system_name, cib_command);
 
-    rc = cib->cmds->remove(cib, XML_CIB_TAG_NODES, node, cib_sync_call);
+    // The two removals are independent, so send both before waiting
+    node_removal = cib_future_submit(cib, CIB_OP_DELETE, XML_CIB_TAG_NODES,
+                                     node, cib_none);
+    state_removal = cib_future_submit(cib, CIB_OP_DELETE, XML_CIB_TAG_STATUS,
+                                      node_state, cib_none);
+
+    rc = cib_future_wait(node_removal, NULL);
     if (rc != pcmk_ok) {
         printf("Could not remove %s[%ld] from " XML_CIB_TAG_NODES ": %s",
                 name, id, pcmk_strerror(rc));
     }
-    rc = cib->cmds->remove(cib, XML_CIB_TAG_STATUS, node_state, cib_sync_call);
+    rc = cib_future_wait(state_removal, NULL);
     if (rc != pcmk_ok) {
         printf("Could not remove %s[%ld] from " XML_CIB_TAG_STATUS ": %s",
                 name, id, pcmk_strerror(rc));
     }
+    cib_future_free(node_removal);
+    cib_future_free(state_removal);
 
     cib->cmds->signoff(cib);
     cib_delete(cib);
@@ -803,6 +803,24 @@ main(int argc, char **argv)
         if (rc != pcmk_ok) {
             goto bail;
         }
+
+        /* Unpack only as much resource history as the command needs, since
+         * that is most of the work for a large status section
+         */
+        switch (rsc_cmd) {
+            case 'l':
+            case 'q':
+            case 'w':
+            case 'G':
+                set_bit(data_set.flags, pe_flag_no_history);
+                break;
+            case 'W':
+            case 'g':
+                pe__filter_history(&data_set, rsc_id);
+                break;
+            default:
+                break;
+        }
         cluster_status(&data_set);
     }
 
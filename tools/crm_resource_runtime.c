@@ -403,15 +403,78 @@ cli_resource_delete_attribute(resource_t *rsc, const char *requested_name,
     return rc;
 }
 
+/*!
+ * \internal
+ * \brief Get the node whose controller handles executor requests for a node
+ *
+ * \param[in]  host_uname   Node that requests are for
+ * \param[out] router_node  Where to store the node to send requests to
+ * \param[in]  data_set     Cluster working set
+ *
+ * \return pcmk_ok on success, -ENXIO if \p host_uname is a Pacemaker Remote
+ *         node with no active connection
+ */
+static int
+get_router_node(const char *host_uname, const char **router_node,
+                pe_working_set_t *data_set)
+{
+    node_t *node = pe_find_node(data_set->nodes, host_uname);
+
+    *router_node = host_uname;
+    if (node && is_remote_node(node)) {
+        node = pe__current_node(node->details->remote_rsc);
+        if (node == NULL) {
+            CMD_ERR("No cluster connection to Pacemaker Remote node %s detected",
+                    host_uname);
+            return -ENXIO;
+        }
+        *router_node = node->details->uname;
+    }
+    return pcmk_ok;
+}
+
+static xmlNode *
+create_lrm_op_data(const char *host_uname, const char *router_node)
+{
+    char *key = generate_transition_key(0, getpid(), 0, "xxxxxxxx-xrsc-opxx-xcrm-resourcexxxx");
+    xmlNode *msg_data = create_xml_node(NULL, XML_GRAPH_TAG_RSC_OP);
+
+    crm_xml_add(msg_data, XML_ATTR_TRANSITION_KEY, key);
+    free(key);
+
+    crm_xml_add(msg_data, XML_LRM_ATTR_TARGET, host_uname);
+    if (safe_str_neq(router_node, host_uname)) {
+        crm_xml_add(msg_data, XML_LRM_ATTR_ROUTER_NODE, router_node);
+    }
+    return msg_data;
+}
+
+static int
+send_lrm_request(crm_ipc_t *crmd_channel, const char *op, xmlNode *msg_data,
+                 const char *router_node)
+{
+    int rc = pcmk_ok;
+    char *our_pid = crm_getpid_s();
+    xmlNode *cmd = create_request(op, msg_data, router_node, CRM_SYSTEM_CRMD,
+                                  crm_system_name, our_pid);
+
+    if (crm_ipc_send(crmd_channel, cmd, 0, 0, NULL) <= 0) {
+        crm_debug("Could not send %s op to the controller", op);
+        rc = -ENOTCONN;
+    }
+
+    free_xml(cmd);
+    free(our_pid);
+    return rc;
+}
+
 static int
 send_lrm_rsc_op(crm_ipc_t * crmd_channel, const char *op,
                 const char *host_uname, const char *rsc_id,
                 bool only_failed, pe_working_set_t * data_set)
 {
-    char *our_pid = NULL;
     char *key = NULL;
     int rc = -ECOMM;
-    xmlNode *cmd = NULL;
     xmlNode *xml_rsc = NULL;
     const char *value = NULL;
     const char *router_node = host_uname;
@@ -430,31 +493,15 @@ send_lrm_rsc_op(crm_ipc_t * crmd_channel, const char *op,
     } else if (host_uname == NULL) {
         CMD_ERR("Please supply a node name with --node");
         return -EINVAL;
-    } else {
-        node_t *node = pe_find_node(data_set->nodes, host_uname);
-
-        if (node && is_remote_node(node)) {
-            node = pe__current_node(node->details->remote_rsc);
-            if (node == NULL) {
-                CMD_ERR("No cluster connection to Pacemaker Remote node %s detected",
-                        host_uname);
-                return -ENXIO;
-            }
-            router_node = node->details->uname;
-        }
     }
 
-    key = generate_transition_key(0, getpid(), 0, "xxxxxxxx-xrsc-opxx-xcrm-resourcexxxx");
-
-    msg_data = create_xml_node(NULL, XML_GRAPH_TAG_RSC_OP);
-    crm_xml_add(msg_data, XML_ATTR_TRANSITION_KEY, key);
-    free(key);
-
-    crm_xml_add(msg_data, XML_LRM_ATTR_TARGET, host_uname);
-    if (safe_str_neq(router_node, host_uname)) {
-        crm_xml_add(msg_data, XML_LRM_ATTR_ROUTER_NODE, router_node);
+    rc = get_router_node(host_uname, &router_node, data_set);
+    if (rc != pcmk_ok) {
+        return rc;
     }
 
+    msg_data = create_lrm_op_data(host_uname, router_node);
+
     xml_rsc = create_xml_node(msg_data, XML_CIB_TAG_RESOURCE);
     if (rsc->clone_name) {
         crm_xml_add(xml_rsc, XML_ATTR_ID, rsc->clone_name);
@@ -467,12 +514,14 @@ send_lrm_rsc_op(crm_ipc_t * crmd_channel, const char *op,
     value = crm_copy_xml_element(rsc->xml, xml_rsc, XML_ATTR_TYPE);
     if (value == NULL) {
         CMD_ERR("%s has no type!  Aborting...", rsc_id);
+        free_xml(msg_data);
         return -ENXIO;
     }
 
     value = crm_copy_xml_element(rsc->xml, xml_rsc, XML_AGENT_ATTR_CLASS);
     if (value == NULL) {
         CMD_ERR("%s has no class!  Aborting...", rsc_id);
+        free_xml(msg_data);
         return -ENXIO;
     }
 
@@ -485,21 +534,8 @@ send_lrm_rsc_op(crm_ipc_t * crmd_channel, const char *op,
     crm_xml_add(params, key, "60000");  /* 1 minute */
     free(key);
 
-    our_pid = crm_getpid_s();
-    cmd = create_request(op, msg_data, router_node, CRM_SYSTEM_CRMD, crm_system_name, our_pid);
-
-/* 	crm_log_xml_warn(cmd, "send_lrm_rsc_op"); */
+    rc = send_lrm_request(crmd_channel, op, msg_data, router_node);
     free_xml(msg_data);
-
-    if (crm_ipc_send(crmd_channel, cmd, 0, 0, NULL) > 0) {
-        rc = 0;
-
-    } else {
-        crm_debug("Could not send %s op to the controller", op);
-        rc = -ENOTCONN;
-    }
-
-    free_xml(cmd);
     return rc;
 }
 
@@ -520,6 +556,21 @@ rsc_fail_name(resource_t *rsc)
     return is_set(rsc->flags, pe_rsc_unique)? strdup(name) : clone_strip(name);
 }
 
+// Handle any controller replies that have already arrived
+static void
+process_controller_replies(void)
+{
+    crm_trace("Processing %d mainloop inputs", crmd_replies_needed);
+    while (g_main_context_iteration(NULL, FALSE)) {
+        crm_trace("Processed mainloop input, %d still remaining",
+                  crmd_replies_needed);
+    }
+
+    if (crmd_replies_needed < 0) {
+        crmd_replies_needed = 0;
+    }
+}
+
 static int
 clear_rsc_history(crm_ipc_t *crmd_channel, const char *host_uname,
                   const char *rsc_id, pe_working_set_t *data_set)
@@ -537,36 +588,34 @@ clear_rsc_history(crm_ipc_t *crmd_channel, const char *host_uname,
         return rc;
     }
     crmd_replies_needed++;
-
-    crm_trace("Processing %d mainloop inputs", crmd_replies_needed);
-    while (g_main_context_iteration(NULL, FALSE)) {
-        crm_trace("Processed mainloop input, %d still remaining",
-                  crmd_replies_needed);
-    }
-
-    if (crmd_replies_needed < 0) {
-        crmd_replies_needed = 0;
-    }
+    process_controller_replies();
     return rc;
 }
 
-static int
-clear_rsc_failures(crm_ipc_t *crmd_channel, const char *node_name,
-                   const char *rsc_id, const char *operation,
-                   const char *interval_spec, pe_working_set_t *data_set)
+/*!
+ * \internal
+ * \brief Get the resources with failures to clean on a node
+ *
+ * \param[in] node_name      Node to check
+ * \param[in] rsc_id         Resource to check (or NULL for all)
+ * \param[in] operation      Operation to check (or NULL for all)
+ * \param[in] interval_spec  Interval of \p operation (if specified)
+ * \param[in] data_set       Cluster working set
+ *
+ * \return Newly created table used as a set of resource history IDs
+ * \note This lets each resource be cleaned only once (per node), regardless
+ *       of how many failed operations it has.
+ */
+static GHashTable *
+failed_resources(const char *node_name, const char *rsc_id,
+                 const char *operation, const char *interval_spec,
+                 pe_working_set_t *data_set)
 {
-    int rc = pcmk_ok;
     const char *failed_value = NULL;
     const char *failed_id = NULL;
-    const char *interval_ms_s = NULL;
-    GHashTable *rscs = NULL;
-    GHashTableIter iter;
-
-    /* Create a hash table to use as a set of resources to clean. This lets us
-     * clean each resource only once (per node) regardless of how many failed
-     * operations it has.
-     */
-    rscs = g_hash_table_new_full(crm_str_hash, g_str_equal, NULL, NULL);
+    char *interval_ms_s = NULL;
+    GHashTable *rscs = g_hash_table_new_full(crm_str_hash, g_str_equal,
+                                             NULL, NULL);
 
     // Normalize interval to milliseconds for comparison to history entry
     if (operation) {
@@ -616,19 +665,90 @@ clear_rsc_failures(crm_ipc_t *crmd_channel, const char *node_name,
 
         g_hash_table_add(rscs, (gpointer) failed_id);
     }
+    free(interval_ms_s);
+    return rscs;
+}
+
+static int
+clear_rsc_failures(crm_ipc_t *crmd_channel, const char *node_name,
+                   const char *rsc_id, const char *operation,
+                   const char *interval_spec, pe_working_set_t *data_set)
+{
+    int rc = pcmk_ok;
+    const char *failed_id = NULL;
+    GHashTable *rscs = failed_resources(node_name, rsc_id, operation,
+                                        interval_spec, data_set);
+    GHashTableIter iter;
 
     g_hash_table_iter_init(&iter, rscs);
     while (g_hash_table_iter_next(&iter, (gpointer *) &failed_id, NULL)) {
         crm_debug("Erasing failures of %s on %s", failed_id, node_name);
         rc = clear_rsc_history(crmd_channel, node_name, failed_id, data_set);
         if (rc != pcmk_ok) {
-            return rc;
+            break;
         }
     }
     g_hash_table_destroy(rscs);
     return rc;
 }
 
+/*!
+ * \internal
+ * \brief Erase the history of all failed resources on a node in one request
+ *
+ * \param[in] crmd_channel   Controller connection
+ * \param[in] node_name      Node to clean up
+ * \param[in] operation      Operation to clean (or NULL for all)
+ * \param[in] interval_spec  Interval of \p operation (if specified)
+ * \param[in] data_set       Cluster working set
+ *
+ * \return pcmk_ok on success, -errno otherwise
+ */
+static int
+clear_node_failures(crm_ipc_t *crmd_channel, const char *node_name,
+                    const char *operation, const char *interval_spec,
+                    pe_working_set_t *data_set)
+{
+    int rc = pcmk_ok;
+    const char *failed_id = NULL;
+    const char *router_node = NULL;
+    xmlNode *msg_data = NULL;
+    GHashTable *rscs = failed_resources(node_name, NULL, operation,
+                                        interval_spec, data_set);
+    GHashTableIter iter;
+
+    if (g_hash_table_size(rscs) == 0) {
+        goto done;
+    }
+    rc = get_router_node(node_name, &router_node, data_set);
+    if (rc != pcmk_ok) {
+        goto done;
+    }
+
+    msg_data = create_lrm_op_data(node_name, router_node);
+    g_hash_table_iter_init(&iter, rscs);
+    while (g_hash_table_iter_next(&iter, (gpointer *) &failed_id, NULL)) {
+        xmlNode *xml_rsc = create_xml_node(msg_data, XML_CIB_TAG_RESOURCE);
+
+        crm_xml_add(xml_rsc, XML_ATTR_ID, failed_id);
+    }
+
+    crm_debug("Erasing failures of %u resource%s on %s",
+              g_hash_table_size(rscs),
+              ((g_hash_table_size(rscs) == 1)? "" : "s"), node_name);
+    rc = send_lrm_request(crmd_channel, CRM_OP_LRM_CLEANUP, msg_data,
+                          router_node);
+    free_xml(msg_data);
+    if (rc == pcmk_ok) {
+        crmd_replies_needed++;
+        process_controller_replies();
+    }
+
+done:
+    g_hash_table_destroy(rscs);
+    return rc;
+}
+
 static int
 clear_rsc_fail_attrs(resource_t *rsc, const char *operation,
                      const char *interval_spec, node_t *node)
@@ -791,8 +911,8 @@ cli_cleanup_all(crm_ipc_t *crmd_channel, const char *node_name,
     }
 
     if (node_name) {
-        rc = clear_rsc_failures(crmd_channel, node_name, NULL,
-                                operation, interval_spec, data_set);
+        rc = clear_node_failures(crmd_channel, node_name, operation,
+                                 interval_spec, data_set);
         if (rc != pcmk_ok) {
             printf("Cleaned all resource failures on %s, but unable to clean history: %s\n",
                    node_name, pcmk_strerror(rc));
@@ -802,8 +922,8 @@ cli_cleanup_all(crm_ipc_t *crmd_channel, const char *node_name,
         for (GList *iter = data_set->nodes; iter; iter = iter->next) {
             pe_node_t *node = (pe_node_t *) iter->data;
 
-            rc = clear_rsc_failures(crmd_channel, node->details->uname, NULL,
-                                    operation, interval_spec, data_set);
+            rc = clear_node_failures(crmd_channel, node->details->uname,
+                                     operation, interval_spec, data_set);
             if (rc != pcmk_ok) {
                 printf("Cleaned all resource failures on all nodes, but unable to clean history: %s\n",
                        pcmk_strerror(rc));
@@ -1550,12 +1670,61 @@ print_pending_actions(GListPtr actions)
 /* For --wait, how long to sleep between cluster state checks */
 #define WAIT_SLEEP_S (2)
 
+/* For --wait with CIB notifications, longest time between cluster state checks
+ * (the scheduler's conclusions can depend on the time as well as the CIB)
+ */
+#define WAIT_RECHECK_S (10)
+
+static gboolean wait_cib_changed = FALSE;
+static gboolean wait_timer_popped = FALSE;
+
+static void
+wait_cib_diff(const char *event, xmlNode *msg)
+{
+    wait_cib_changed = TRUE;
+}
+
+static gboolean
+wait_timer_cb(gpointer user_data)
+{
+    wait_timer_popped = TRUE;
+    return FALSE;
+}
+
+/*!
+ * \internal
+ * \brief Wait until the CIB changes or some time passes
+ *
+ * \param[in] seconds  Longest time to wait
+ *
+ * \note A burst of changes (as a transition usually makes) is waited for as
+ *       one, so the cluster state is checked once for all of them.
+ */
+static void
+wait_for_cib_change(int seconds)
+{
+    guint timer = g_timeout_add_seconds(seconds, wait_timer_cb, NULL);
+
+    wait_timer_popped = FALSE;
+    while (!wait_cib_changed && !wait_timer_popped) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    while (g_main_context_pending(NULL)) {
+        g_main_context_iteration(NULL, FALSE);
+    }
+    if (!wait_timer_popped) {
+        g_source_remove(timer);
+    }
+    wait_cib_changed = FALSE;
+}
+
 /*!
  * \internal
  * \brief Wait until all pending cluster actions are complete
  *
  * This waits until either the CIB's transition graph is idle or a timeout is
- * reached.
+ * reached. The cluster state is checked again whenever the CIB changes (or
+ * every so often, if CIB notifications are not available).
  *
  * \param[in] timeout_ms Consider failed if actions do not complete in this time
  *                       (specified in milliseconds, but one-second granularity
@@ -1573,6 +1742,17 @@ wait_till_stable(int timeout_ms, cib_t * cib)
     time_t expire_time = time(NULL) + timeout_s;
     time_t time_diff;
     bool printed_version_warning = BE_QUIET; // i.e. don't print if quiet
+    bool notify = FALSE;
+
+    // Subscribe before the first check, so no change can be missed
+    wait_cib_changed = FALSE;
+    if (cib->cmds->add_notify_callback(cib, T_CIB_DIFF_NOTIFY,
+                                       wait_cib_diff) == pcmk_ok) {
+        notify = TRUE;
+    } else {
+        crm_info("CIB notifications not available, checking every %ds",
+                 WAIT_SLEEP_S);
+    }
 
     set_working_set_defaults(&data_set);
     do {
@@ -1584,10 +1764,15 @@ wait_till_stable(int timeout_ms, cib_t * cib)
         } else {
             print_pending_actions(data_set.actions);
             cleanup_alloc_calculations(&data_set);
-            return -ETIME;
+            rc = -ETIME;
+            goto done;
         }
         if (rc == pcmk_ok) { /* this avoids sleep on first loop iteration */
-            sleep(WAIT_SLEEP_S);
+            if (notify) {
+                wait_for_cib_change(QB_MIN(time_diff, WAIT_RECHECK_S));
+            } else {
+                sleep(WAIT_SLEEP_S);
+            }
         }
 
         /* Get latest transition graph */
@@ -1595,7 +1780,7 @@ wait_till_stable(int timeout_ms, cib_t * cib)
         rc = update_working_set_from_cib(&data_set, cib);
         if (rc != pcmk_ok) {
             cleanup_alloc_calculations(&data_set);
-            return rc;
+            goto done;
         }
         do_calculations(&data_set, data_set.input, NULL);
 
@@ -1618,8 +1803,13 @@ wait_till_stable(int timeout_ms, cib_t * cib)
         }
 
     } while (actions_are_pending(data_set.actions));
+    rc = pcmk_ok;
 
-    return pcmk_ok;
+  done:
+    if (notify) {
+        cib->cmds->del_notify_callback(cib, T_CIB_DIFF_NOTIFY, wait_cib_diff);
+    }
+    return rc;
 }
 
 int
@@ -10,19 +10,28 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 
 #include <sys/stat.h>
 #include <sys/param.h>
 #include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
 
 #include <crm/crm.h>
 #include <crm/cib.h>
 #include <crm/common/util.h>
 #include <crm/transition.h>
 #include <crm/common/iso8601.h>
+#include <crm/common/internal.h>
 #include <crm/pengine/status.h>
+#include <crm/pengine/internal.h>
 #include <sched_allocate.h>
+#include <sched_utils.h>
 #include "fake_transition.h"
 
 cib_t *global_cib = NULL;
@@ -46,7 +55,7 @@ extern xmlNode *do_calculations(pe_working_set_t * data_set, xmlNode * xml_input
 char *use_date = NULL;
 
 static void
-get_date(pe_working_set_t * data_set)
+get_date(pe_working_set_t * data_set, bool print_original)
 {
     int value = 0;
     time_t original_date = 0;
@@ -64,7 +73,9 @@ get_date(pe_working_set_t * data_set)
         crm_time_set_timet(data_set->now, &original_date);
 
         when = crm_time_as_string(data_set->now, crm_time_log_date|crm_time_log_timeofday);
-        printf("Using the original execution date of: %s\n", when);
+        if (print_original) {
+            printf("Using the original execution date of: %s\n", when);
+        }
 
         free(when);
     }
@@ -401,10 +412,10 @@ setup_input(const char *input, const char *output)
         }
 
     } else if (safe_str_eq(input, "-")) {
-        cib_object = filename2xml(NULL);
+        cib_object = pe__read_input(NULL);
 
     } else {
-        cib_object = filename2xml(input);
+        cib_object = pe__read_input(input);
     }
 
     if (get_object_root(XML_CIB_TAG_STATUS, cib_object) == NULL) {
@@ -458,8 +469,17 @@ static struct crm_option long_options[] = {
     {"in-place",      0, 0, 'X', "Simulate the transition's execution and store the result back to the input file"},
     {"show-scores",   0, 0, 's', "Show allocation scores"},
     {"show-utilization",   0, 0, 'U', "Show utilization information"},
-    {"profile",       1, 0, 'P', "Run all tests in the named directory to create profiling data"},
+    {"profile",       1, 0, 'P', "Run all tests in the named directory to create profiling data, reporting the cost of each scheduler stage"},
+    {"repeat",        1, 0, 'n', "\tWith --profile, calculate each input this many times and report the median and 95th percentile cost of each stage"},
+    {"warmup",        1, 0, 'W', "\tWith --profile, calculate each input this many times before the measured runs, without reporting them"},
+    {"profile-json",  1, 0, 'o', "With --profile, also write the results to the named file as JSON, one object per line for each input and stage"},
+    {"profile-baseline", 1, 0, 'c', "With --profile, compare the median wall clock time of each input and stage with the named file, saved earlier with --profile-json"},
+    {"benchmark",     1, 0, 'N', "Run the calculation for the input the given number of times, then report the latency and peak memory use as a tab-separated line"},
     {"pending",       0, 0, 'j', "\tDisplay pending state if 'record-pending' is enabled", pcmk_option_hidden},
+    {"batch",         1, 0, 'B', "\tRun each scenario in the named file against the input, and display a summary of each one's transition"},
+    {"-spacer-",      0, 0, '-', "\t\tEach line of the file is a set of synthetic cluster events, eg. --node-down node1 --op-inject ..."},
+    {"replay-series", 1, 0, 'Y', "Calculate each scheduler input in the named directory in the order it was saved, and report the time spent in each part of the calculation as a tab-separated line per input"},
+    {"jobs",          1, 0, 'J', "\tNumber of --batch scenarios to run at once (default: number of processors)"},
 
     {"-spacer-",     0, 0, '-', "\nSynthetic Cluster Events:"},
     {"node-up",      1, 0, 'u', "\tBring a node online"},
@@ -505,34 +525,402 @@ static struct crm_option long_options[] = {
 /* *INDENT-ON* */
 
 static void
-profile_one(const char *xml_file)
+print_stage_profile(void)
 {
-    xmlNode *cib_object = NULL;
-    pe_working_set_t data_set;
+    xmlNode *profile = sched_profile_xml(NULL);
+
+    for (xmlNode *stage = __xml_first_child(profile); stage != NULL;
+         stage = __xml_next_element(stage)) {
+        printf("  %-20s %10sms (%10sms CPU) %12s heap bytes %8s steps:"
+               " %s resources, %s actions, %s orderings, %s colocations\n",
+               crm_element_value(stage, XML_ATTR_ID),
+               crm_element_value(stage, "wall-ms"),
+               crm_element_value(stage, "cpu-ms"),
+               crm_element_value(stage, "heap-bytes"),
+               crm_element_value(stage, "propagation-steps"),
+               crm_element_value(stage, "resources"),
+               crm_element_value(stage, "actions"),
+               crm_element_value(stage, "orderings"),
+               crm_element_value(stage, "colocations"));
+    }
+    free_xml(profile);
+}
 
-    printf("* Testing %s\n", xml_file);
-    cib_object = filename2xml(xml_file);
+static xmlNode *
+read_profile_input(const char *xml_file)
+{
+    xmlNode *cib_object = pe__read_input(xml_file);
+
+    if (cib_object == NULL) {
+        return NULL;
+    }
     if (get_object_root(XML_CIB_TAG_STATUS, cib_object) == NULL) {
         create_xml_node(cib_object, XML_CIB_TAG_STATUS);
     }
 
     if (cli_config_update(&cib_object, NULL, FALSE) == FALSE) {
         free_xml(cib_object);
-        return;
+        return NULL;
     }
 
     if (validate_xml(cib_object, NULL, FALSE) != TRUE) {
         free_xml(cib_object);
+        return NULL;
+    }
+    return cib_object;
+}
+
+/*
+ * Profiling
+ *
+ * With --repeat or --warmup, each input is calculated (warm-up + repeat)
+ * times, and the median and 95th percentile of each stage's wall clock time,
+ * CPU time, heap growth and propagation steps over the measured runs are
+ * reported, so that a single noisy run does not decide whether a scheduler
+ * change helps. With --profile-json, the results are also written as JSON
+ * lines, which --profile-baseline can read back to report each stage's
+ * change from an earlier run.
+ */
+
+#define PROFILE_METRICS 4
+
+static const char *profile_metrics[PROFILE_METRICS] = {
+    "wall-ms", "cpu-ms", "heap-bytes", "propagation-steps"
+};
+
+static int profile_warmup = 0;
+static int profile_repeat = 0;
+static FILE *profile_json = NULL;
+static GHashTable *profile_baseline = NULL; // "<file> <stage>" -> median ms
+
+// Measurements of one stage over the measured runs of one input
+struct stage_samples_s {
+    char *stage;
+    GArray *values[PROFILE_METRICS];    // doubles, one per measured run
+};
+
+static void
+free_stage_samples(gpointer data)
+{
+    struct stage_samples_s *samples = data;
+
+    for (int lpc = 0; lpc < PROFILE_METRICS; lpc++) {
+        g_array_free(samples->values[lpc], TRUE);
+    }
+    free(samples->stage);
+    free(samples);
+}
+
+static gint
+compare_doubles(gconstpointer a, gconstpointer b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x < y)? -1 : ((x > y)? 1 : 0);
+}
+
+// Nearest-rank percentile of sorted values
+static double
+percentile(GArray *sorted, int percent)
+{
+    int rank = (sorted->len * percent + 99) / 100;
+
+    if (sorted->len == 0) {
+        return 0.0;
+    }
+    return g_array_index(sorted, double, (rank > 0)? (rank - 1) : 0);
+}
+
+static void
+json_write_string(FILE *out, const char *value)
+{
+    fputc('"', out);
+    for (const char *c = value; *c != '\0'; c++) {
+        if ((*c == '"') || (*c == '\\')) {
+            fprintf(out, "\\%c", *c);
+        } else if ((unsigned char) *c < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char) *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/*!
+ * \internal
+ * \brief Get the value of a key in a line written by --profile-json
+ *
+ * \param[in] line  JSON object on a single line
+ * \param[in] key   Key to find
+ *
+ * \return Newly allocated value (unescaped, if a string), or NULL if not found
+ * \note This reads only what profile_one() writes, not JSON in general.
+ */
+static char *
+json_line_value(const char *line, const char *key)
+{
+    char *pattern = crm_strdup_printf("\"%s\": ", key);
+    const char *start = strstr(line, pattern);
+    char *value = NULL;
+    size_t len = 0;
+
+    if (start == NULL) {
+        free(pattern);
+        return NULL;
+    }
+    start += strlen(pattern);
+    free(pattern);
+
+    value = calloc(strlen(start) + 1, 1);
+    CRM_ASSERT(value != NULL);
+    if (*start != '"') {
+        len = strcspn(start, ",}");
+        memcpy(value, start, len);
+        return value;
+    }
+
+    for (const char *c = start + 1; (*c != '\0') && (*c != '"'); c++) {
+        if ((*c == '\\') && (c[1] != '\0')) {
+            c++;
+        }
+        value[len++] = *c;
+    }
+    return value;
+}
+
+static int
+read_profile_baseline(const char *filename)
+{
+    char line[4096];
+    FILE *in = fopen(filename, "r");
+
+    if (in == NULL) {
+        fprintf(stderr, "Could not open profile baseline %s: %s\n",
+                filename, strerror(errno));
+        return CRM_EX_NOINPUT;
+    }
+
+    profile_baseline = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                             free);
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char *file = json_line_value(line, "file");
+        char *stage = json_line_value(line, "stage");
+        char *median = json_line_value(line, "wall-ms-median");
+
+        if ((file != NULL) && (stage != NULL) && (median != NULL)) {
+            double *value = malloc(sizeof(double));
+
+            CRM_ASSERT(value != NULL);
+            *value = strtod(median, NULL);
+            g_hash_table_replace(profile_baseline,
+                                 crm_strdup_printf("%s %s", file, stage),
+                                 value);
+        }
+        free(file);
+        free(stage);
+        free(median);
+    }
+    fclose(in);
+    return CRM_EX_OK;
+}
+
+// Add the stage costs of the last calculation to the samples for an input
+static GList *
+add_stage_samples(GList *samples)
+{
+    xmlNode *profile = sched_profile_xml(NULL);
+
+    for (xmlNode *stage = __xml_first_child(profile); stage != NULL;
+         stage = __xml_next_element(stage)) {
+        const char *id = crm_element_value(stage, XML_ATTR_ID);
+        struct stage_samples_s *stage_samples = NULL;
+
+        for (GList *iter = samples; iter != NULL; iter = iter->next) {
+            if (safe_str_eq(((struct stage_samples_s *) iter->data)->stage,
+                            id)) {
+                stage_samples = iter->data;
+                break;
+            }
+        }
+        if (stage_samples == NULL) {
+            stage_samples = calloc(1, sizeof(struct stage_samples_s));
+            CRM_ASSERT(stage_samples != NULL);
+            stage_samples->stage = strdup(id);
+            for (int lpc = 0; lpc < PROFILE_METRICS; lpc++) {
+                stage_samples->values[lpc] = g_array_new(FALSE, FALSE,
+                                                         sizeof(double));
+            }
+            samples = g_list_append(samples, stage_samples);
+        }
+
+        for (int lpc = 0; lpc < PROFILE_METRICS; lpc++) {
+            const char *value = crm_element_value(stage, profile_metrics[lpc]);
+            double number = value? strtod(value, NULL) : 0.0;
+
+            g_array_append_val(stage_samples->values[lpc], number);
+        }
+    }
+    free_xml(profile);
+    return samples;
+}
+
+static void
+report_stage_samples(const char *xml_file, struct stage_samples_s *samples)
+{
+    double median[PROFILE_METRICS];
+    double p95[PROFILE_METRICS];
+    double *baseline = NULL;
+
+    for (int lpc = 0; lpc < PROFILE_METRICS; lpc++) {
+        g_array_sort(samples->values[lpc], compare_doubles);
+        median[lpc] = percentile(samples->values[lpc], 50);
+        p95[lpc] = percentile(samples->values[lpc], 95);
+    }
+
+    printf("  %-20s %10.3fms (p95 %10.3fms) %10.3fms CPU %12.0f heap bytes"
+           " %8.0f steps", samples->stage, median[0], p95[0], median[1],
+           median[2], median[3]);
+
+    if (profile_baseline != NULL) {
+        char *key = crm_strdup_printf("%s %s", xml_file, samples->stage);
+
+        baseline = g_hash_table_lookup(profile_baseline, key);
+        free(key);
+        if ((baseline != NULL) && (*baseline > 0.0)) {
+            printf(" %+7.1f%% vs %.3fms", (median[0] - *baseline) * 100.0
+                                          / *baseline, *baseline);
+        } else {
+            printf(" (no baseline)");
+        }
+    }
+    printf("\n");
+
+    if (profile_json != NULL) {
+        fprintf(profile_json, "{\"file\": ");
+        json_write_string(profile_json, xml_file);
+        fprintf(profile_json, ", \"stage\": ");
+        json_write_string(profile_json, samples->stage);
+        fprintf(profile_json, ", \"runs\": %u", samples->values[0]->len);
+        for (int lpc = 0; lpc < PROFILE_METRICS; lpc++) {
+            fprintf(profile_json, ", \"%s-median\": %.3f, \"%s-p95\": %.3f",
+                    profile_metrics[lpc], median[lpc],
+                    profile_metrics[lpc], p95[lpc]);
+        }
+        fprintf(profile_json, "}\n");
+    }
+}
+
+static void
+profile_one(const char *xml_file)
+{
+    xmlNode *cib_object = NULL;
+    pe_working_set_t data_set;
+    GList *samples = NULL;
+    int runs = profile_warmup + ((profile_repeat > 0)? profile_repeat : 1);
+
+    printf("* Testing %s\n", xml_file);
+    cib_object = read_profile_input(xml_file);
+    if (cib_object == NULL) {
         return;
     }
 
-    set_working_set_defaults(&data_set);
+    if ((runs == 1) && (profile_json == NULL) && (profile_baseline == NULL)) {
+        set_working_set_defaults(&data_set);
 
-    data_set.input = cib_object;
-    get_date(&data_set);
-    do_calculations(&data_set, cib_object, NULL);
+        data_set.input = cib_object;
+        get_date(&data_set, TRUE);
+        do_calculations(&data_set, cib_object, NULL);
+        print_stage_profile();
 
-    cleanup_alloc_calculations(&data_set);
+        cleanup_alloc_calculations(&data_set);
+        return;
+    }
+
+    for (int lpc = 0; lpc < runs; lpc++) {
+        set_working_set_defaults(&data_set);
+        data_set.input = copy_xml(cib_object);
+        get_date(&data_set, TRUE);
+        do_calculations(&data_set, data_set.input, NULL);
+        if (lpc >= profile_warmup) {
+            samples = add_stage_samples(samples);
+        }
+        cleanup_alloc_calculations(&data_set);
+    }
+    free_xml(cib_object);
+
+    for (GList *iter = samples; iter != NULL; iter = iter->next) {
+        report_stage_samples(xml_file, iter->data);
+    }
+    g_list_free_full(samples, free_stage_samples);
+    if (profile_json != NULL) {
+        fflush(profile_json);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Time repeated calculations of the same input
+ *
+ * \param[in] xml_file  Input to calculate
+ * \param[in] runs      Number of times to run the calculation
+ *
+ * \return Exit status
+ * \note The result is printed as "benchmark", the number of runs, the minimum,
+ *       mean and maximum wall clock time in milliseconds, and the peak
+ *       resident set size of the process in kilobytes, separated by tabs.
+ */
+static int
+benchmark_one(const char *xml_file, int runs)
+{
+    double min_ms = 0.0;
+    double max_ms = 0.0;
+    double total_ms = 0.0;
+    struct rusage usage;
+    xmlNode *cib_object = read_profile_input(xml_file);
+
+    if (cib_object == NULL) {
+        fprintf(stderr, "Could not read a valid configuration from %s\n",
+                xml_file);
+        return CRM_EX_DATAERR;
+    }
+
+    for (int lpc = 0; lpc < runs; lpc++) {
+        pe_working_set_t data_set;
+        sched_profile_mark_t start;
+        sched_profile_mark_t end;
+        double elapsed_ms = 0.0;
+
+        set_working_set_defaults(&data_set);
+        data_set.input = copy_xml(cib_object);
+        get_date(&data_set, TRUE);
+
+        start = sched_profile_mark();
+        do_calculations(&data_set, data_set.input, NULL);
+        end = sched_profile_mark();
+        cleanup_alloc_calculations(&data_set);
+
+        elapsed_ms = end.wall_ms - start.wall_ms;
+        total_ms += elapsed_ms;
+        if ((lpc == 0) || (elapsed_ms < min_ms)) {
+            min_ms = elapsed_ms;
+        }
+        if (elapsed_ms > max_ms) {
+            max_ms = elapsed_ms;
+        }
+    }
+    free_xml(cib_object);
+
+    if (getrusage(RUSAGE_SELF, &usage) < 0) {
+        usage.ru_maxrss = 0;
+    }
+
+    // ru_maxrss is already in kilobytes on Linux and the BSDs
+    printf("benchmark\t%d\t%.3f\t%.3f\t%.3f\t%ld\n", runs, min_ms,
+           (runs > 0)? (total_ms / runs) : 0.0, max_ms,
+           (long) usage.ru_maxrss);
+    return CRM_EX_OK;
 }
 
 #ifndef FILENAME_MAX
@@ -556,7 +944,9 @@ profile_all(const char *dir)
                 free(namelist[file_num]);
                 continue;
 
-            } else if (!crm_ends_with_ext(namelist[file_num]->d_name, ".xml")) {
+            } else if (!crm_ends_with_ext(namelist[file_num]->d_name, ".xml")
+                       && !crm_ends_with_ext(namelist[file_num]->d_name,
+                                             ".bz2")) {
                 free(namelist[file_num]);
                 continue;
             }
@@ -574,6 +964,622 @@ profile_all(const char *dir)
     return lpc;
 }
 
+/*
+ * Batch mode
+ *
+ * The input is read, upgraded, validated and unpacked once, and each scenario
+ * is then run in a child process. The child inherits the unpacked input and the
+ * shadow CIB's in-memory copy of it, so these are shared (copy-on-write) with
+ * the parent rather than recreated, and applying the scenario's events to the
+ * shadow CIB changes only the child's copy. Since the scheduler and the file
+ * CIB keep their state in globals, separate processes are also the only way to
+ * run scenarios in parallel.
+ */
+
+struct scenario_s {
+    int id;
+    char *events;       // scenario as given in the batch file
+    gchar **argv;       // events parsed into options and values
+
+    GListPtr node_up;
+    GListPtr node_down;
+    GListPtr node_fail;
+    GListPtr op_inject;
+    GListPtr op_fail;
+    GListPtr ticket_grant;
+    GListPtr ticket_revoke;
+    GListPtr ticket_standby;
+    GListPtr ticket_activate;
+    const char *quorum;
+    const char *watchdog;
+
+    pid_t pid;
+    int fd;             // read end of pipe from child
+    char *result;       // summary columns sent by child
+};
+
+static void
+free_scenario(gpointer data)
+{
+    struct scenario_s *scenario = data;
+
+    g_list_free(scenario->node_up);
+    g_list_free(scenario->node_down);
+    g_list_free(scenario->node_fail);
+    g_list_free(scenario->op_inject);
+    g_list_free(scenario->op_fail);
+    g_list_free(scenario->ticket_grant);
+    g_list_free(scenario->ticket_revoke);
+    g_list_free(scenario->ticket_standby);
+    g_list_free(scenario->ticket_activate);
+    g_strfreev(scenario->argv);
+    free(scenario->events);
+    free(scenario->result);
+    free(scenario);
+}
+
+#define event_is(option, long_name, short_name) \
+    (safe_str_eq((option), "--" long_name) || safe_str_eq((option), "-" short_name))
+
+/*!
+ * \internal
+ * \brief Parse a line of a batch file into a scenario
+ *
+ * \param[in] line  Line of batch file
+ * \param[in] id    Scenario number
+ *
+ * \return Newly allocated scenario, or NULL if \p line is not valid
+ */
+static struct scenario_s *
+parse_scenario(const char *line, int id)
+{
+    struct scenario_s *scenario = calloc(1, sizeof(struct scenario_s));
+    GError *error = NULL;
+    int argc = 0;
+
+    CRM_ASSERT(scenario != NULL);
+    scenario->id = id;
+    scenario->events = strdup(line);
+    scenario->fd = -1;
+
+    if (!g_shell_parse_argv(line, &argc, &scenario->argv, &error)) {
+        fprintf(stderr, "Invalid scenario %d: %s\n", id, error->message);
+        g_clear_error(&error);
+        free_scenario(scenario);
+        return NULL;
+    }
+
+    for (int lpc = 0; lpc < argc; lpc += 2) {
+        const char *option = scenario->argv[lpc];
+        char *value = scenario->argv[lpc + 1];
+
+        if (value == NULL) {
+            fprintf(stderr, "Invalid scenario %d: %s requires a value\n",
+                    id, option);
+            free_scenario(scenario);
+            return NULL;
+
+        } else if (event_is(option, "node-up", "u")) {
+            scenario->node_up = g_list_append(scenario->node_up, value);
+        } else if (event_is(option, "node-down", "d")) {
+            scenario->node_down = g_list_append(scenario->node_down, value);
+        } else if (event_is(option, "node-fail", "f")) {
+            scenario->node_fail = g_list_append(scenario->node_fail, value);
+        } else if (event_is(option, "op-inject", "i")) {
+            scenario->op_inject = g_list_append(scenario->op_inject, value);
+        } else if (event_is(option, "op-fail", "F")) {
+            scenario->op_fail = g_list_append(scenario->op_fail, value);
+        } else if (event_is(option, "quorum", "q")) {
+            scenario->quorum = value;
+        } else if (event_is(option, "watchdog", "w")) {
+            scenario->watchdog = value;
+        } else if (event_is(option, "ticket-grant", "g")) {
+            scenario->ticket_grant = g_list_append(scenario->ticket_grant,
+                                                   value);
+        } else if (event_is(option, "ticket-revoke", "r")) {
+            scenario->ticket_revoke = g_list_append(scenario->ticket_revoke,
+                                                    value);
+        } else if (event_is(option, "ticket-standby", "b")) {
+            scenario->ticket_standby = g_list_append(scenario->ticket_standby,
+                                                     value);
+        } else if (event_is(option, "ticket-activate", "e")) {
+            scenario->ticket_activate = g_list_append(scenario->ticket_activate,
+                                                      value);
+        } else {
+            fprintf(stderr, "Invalid scenario %d: %s is not a synthetic"
+                    " cluster event\n", id, option);
+            free_scenario(scenario);
+            return NULL;
+        }
+    }
+    return scenario;
+}
+
+/*!
+ * \internal
+ * \brief Read the scenarios in a batch file
+ *
+ * \param[in]  filename   Batch file (blank lines and lines starting with '#'
+ *                        are ignored)
+ * \param[out] scenarios  Where to store list of parsed scenarios
+ *
+ * \return pcmk_ok on success, otherwise a negative error code
+ */
+static int
+read_scenarios(const char *filename, GListPtr *scenarios)
+{
+    FILE *fp = fopen(filename, "r");
+    char line[LINE_MAX];
+    int id = 0;
+    int rc = pcmk_ok;
+
+    if (fp == NULL) {
+        rc = -errno;
+        fprintf(stderr, "Could not open %s: %s\n", filename, pcmk_strerror(rc));
+        return rc;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        struct scenario_s *scenario = NULL;
+
+        g_strstrip(line);
+        if ((line[0] == '\0') || (line[0] == '#')) {
+            continue;
+        }
+
+        scenario = parse_scenario(line, ++id);
+        if (scenario == NULL) {
+            rc = -EINVAL;
+            break;
+        }
+        *scenarios = g_list_append(*scenarios, scenario);
+    }
+    fclose(fp);
+    return rc;
+}
+
+/*!
+ * \internal
+ * \brief Apply a scenario to the base input, run the scheduler, and report
+ *
+ * \param[in] base      Unpacked base input
+ * \param[in] scenario  Scenario to run
+ * \param[in] fd        Where to write the scenario's summary columns
+ *
+ * \note This is called in a child process, and does not return.
+ */
+static void
+run_scenario(pe_working_set_t *base, struct scenario_s *scenario, int fd)
+{
+    pe_working_set_t data_set;
+    xmlNode *input = NULL;
+    sched_profile_mark_t start;
+    sched_profile_mark_t end;
+    int actions = 0;
+    int fencing = 0;
+    int starts = 0;
+    int stops = 0;
+    int migrations = 0;
+    int promotes = 0;
+    int demotes = 0;
+    int blocked = 0;
+    const char *status = "ok";
+    char *result = NULL;
+    int null_fd = open("/dev/null", O_WRONLY);
+
+    // Only the summary is wanted from each scenario
+    if (null_fd >= 0) {
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+    quiet = TRUE;
+
+    bringing_nodes_online = (scenario->node_up != NULL);
+    modify_configuration(base, global_cib, scenario->quorum,
+                         scenario->watchdog, scenario->node_up,
+                         scenario->node_down, scenario->node_fail,
+                         scenario->op_inject, scenario->ticket_grant,
+                         scenario->ticket_revoke, scenario->ticket_standby,
+                         scenario->ticket_activate);
+
+    if (global_cib->cmds->query(global_cib, NULL, &input,
+                                cib_sync_call) != pcmk_ok) {
+        _exit(CRM_EX_ERROR);
+    }
+
+    set_working_set_defaults(&data_set);
+    data_set.input = input;
+    if (is_set(base->flags, pe_flag_sanitized)) {
+        set_bit(data_set.flags, pe_flag_sanitized);
+    }
+    get_date(&data_set, TRUE);
+
+    start = sched_profile_mark();
+    do_calculations(&data_set, input, NULL);
+    end = sched_profile_mark();
+
+    for (GListPtr iter = data_set.actions; iter != NULL; iter = iter->next) {
+        action_t *action = (action_t *) iter->data;
+
+        if (is_set(action->flags, pe_action_pseudo)
+            || is_set(action->flags, pe_action_optional)) {
+            continue;
+
+        } else if (is_not_set(action->flags, pe_action_runnable)) {
+            blocked++;
+            continue;
+        }
+
+        actions++;
+        if (safe_str_eq(action->task, CRM_OP_FENCE)) {
+            fencing++;
+        } else if (safe_str_eq(action->task, RSC_START)) {
+            starts++;
+        } else if (safe_str_eq(action->task, RSC_STOP)) {
+            stops++;
+        } else if (safe_str_eq(action->task, RSC_MIGRATE)) {
+            migrations++;
+        } else if (safe_str_eq(action->task, RSC_PROMOTE)) {
+            promotes++;
+        } else if (safe_str_eq(action->task, RSC_DEMOTE)) {
+            demotes++;
+        }
+    }
+
+    if ((scenario->op_fail != NULL)
+        && (run_simulation(&data_set, global_cib, scenario->op_fail,
+                           TRUE) != pcmk_ok)) {
+        status = "failed";
+    }
+
+    result = crm_strdup_printf("%7d %5d %5d %5d %7d %7d %6d %7d %9.3f  %-6s",
+                               actions, fencing, starts, stops, migrations,
+                               promotes, demotes, blocked,
+                               end.wall_ms - start.wall_ms, status);
+    if (write(fd, result, strlen(result)) < 0) {
+        _exit(CRM_EX_ERROR);
+    }
+
+    // Exit without freeing anything or writing the shadow CIB back to disk
+    _exit(CRM_EX_OK);
+}
+
+static void
+start_scenario(pe_working_set_t *base, struct scenario_s *scenario)
+{
+    int fds[2] = { -1, -1 };
+
+    if (pipe(fds) < 0) {
+        crm_perror(LOG_ERR, "Could not run scenario %d", scenario->id);
+        return;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    scenario->pid = fork();
+    if (scenario->pid == 0) {
+        close(fds[0]);
+        run_scenario(base, scenario, fds[1]);
+
+    } else if (scenario->pid < 0) {
+        crm_perror(LOG_ERR, "Could not run scenario %d", scenario->id);
+        close(fds[0]);
+        scenario->pid = 0;
+
+    } else {
+        scenario->fd = fds[0];
+    }
+    close(fds[1]);
+}
+
+static void
+finish_scenario(struct scenario_s *scenario, int status)
+{
+    char buffer[256];
+    ssize_t len = read(scenario->fd, buffer, sizeof(buffer) - 1);
+
+    close(scenario->fd);
+    scenario->fd = -1;
+    if (WIFEXITED(status) && (WEXITSTATUS(status) == CRM_EX_OK) && (len > 0)) {
+        buffer[len] = '\0';
+        scenario->result = strdup(buffer);
+    }
+}
+
+/*!
+ * \internal
+ * \brief Run all the scenarios in a batch file against an unpacked input
+ *
+ * \param[in] base      Unpacked input
+ * \param[in] filename  Batch file
+ * \param[in] jobs      Maximum number of scenarios to run at once
+ *
+ * \return pcmk_ok if every scenario ran, -pcmk_err_generic if any scenario
+ *         failed, or the (negative) error from reading the batch file
+ */
+static int
+run_batch(pe_working_set_t *base, const char *filename, int jobs)
+{
+    GListPtr scenarios = NULL;
+    GListPtr next = NULL;
+    int running = 0;
+    int rc = read_scenarios(filename, &scenarios);
+
+    if (rc != pcmk_ok) {
+        g_list_free_full(scenarios, free_scenario);
+        return rc;
+    }
+
+    next = scenarios;
+    while ((next != NULL) || (running > 0)) {
+        int status = 0;
+        pid_t pid = 0;
+
+        if ((next != NULL) && (running < jobs)) {
+            start_scenario(base, next->data);
+            if (((struct scenario_s *) next->data)->pid > 0) {
+                running++;
+            }
+            next = next->next;
+            continue;
+        }
+
+        pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (GListPtr iter = scenarios; iter != NULL; iter = iter->next) {
+            struct scenario_s *scenario = iter->data;
+
+            if (scenario->pid == pid) {
+                finish_scenario(scenario, status);
+                running--;
+                break;
+            }
+        }
+    }
+
+    printf("%-8s %7s %5s %5s %5s %7s %7s %6s %7s %9s  %-6s  %s\n",
+           "Scenario", "Actions", "Fence", "Start", "Stop", "Migrate",
+           "Promote", "Demote", "Blocked", "ms", "Result", "Events");
+    for (GListPtr iter = scenarios; iter != NULL; iter = iter->next) {
+        struct scenario_s *scenario = iter->data;
+
+        if (scenario->result == NULL) {
+            rc = -pcmk_err_generic;
+        }
+        printf("%-8d %s  %s\n", scenario->id,
+               (scenario->result? scenario->result
+                : "      -     -     -     -       -       -      -       -"
+                  "         -  error "),
+               scenario->events);
+    }
+
+    g_list_free_full(scenarios, free_scenario);
+    return rc;
+}
+
+/*
+ * Series replay
+ *
+ * The pe-input files saved by the scheduler are a record of the real inputs a
+ * cluster has calculated, so calculating them again in turn is a benchmark of
+ * the scheduler that is derived from production use, and comparing replays
+ * shows how an upgrade affects it.
+ */
+
+#define REPLAY_SERIES "pe-input"
+
+struct replay_input_s {
+    int sequence;
+    char *filename;
+};
+
+// Sequence number that the series' next input will use (for sorting)
+static int replay_next_sequence = 0;
+
+static void
+free_replay_input(gpointer data)
+{
+    struct replay_input_s *input = data;
+
+    free(input->filename);
+    free(input);
+}
+
+/*!
+ * \internal
+ * \brief Sort series inputs in the order they were saved
+ *
+ * Inputs are numbered in increasing order, but once a series wraps, the oldest
+ * input is the one after the most recent one, which comes after any input with
+ * a lower number.
+ */
+static gint
+sort_replay_input(gconstpointer a, gconstpointer b)
+{
+    const struct replay_input_s *input_a = a;
+    const struct replay_input_s *input_b = b;
+    gboolean wrapped_a = (input_a->sequence < replay_next_sequence);
+    gboolean wrapped_b = (input_b->sequence < replay_next_sequence);
+
+    if (wrapped_a != wrapped_b) {
+        return wrapped_a? 1 : -1;
+    }
+    return input_a->sequence - input_b->sequence;
+}
+
+/*!
+ * \internal
+ * \brief Get the sequence number of a series input from its file name
+ *
+ * \param[in] name  File name (without directory)
+ *
+ * \return Sequence number, or -1 if \p name is not an input in the series
+ */
+static int
+replay_sequence(const char *name)
+{
+    const char *prefix = REPLAY_SERIES "-";
+    char *end = NULL;
+    long sequence = 0;
+
+    if (strncmp(name, prefix, strlen(prefix)) != 0) {
+        return -1;
+    }
+    name += strlen(prefix);
+    if ((name[0] < '0') || (name[0] > '9')) {
+        return -1;
+    }
+    sequence = strtol(name, &end, 10);
+    if ((end[0] != '\0') && safe_str_neq(end, ".bz2")) {
+        return -1;
+    }
+    return (int) sequence;
+}
+
+// Sum of the wall clock time of the named scheduler stages
+static double
+stage_ms(xmlNode *profile, const char **stages)
+{
+    double total = 0.0;
+
+    for (xmlNode *stage = __xml_first_child(profile); stage != NULL;
+         stage = __xml_next_element(stage)) {
+        const char *id = crm_element_value(stage, XML_ATTR_ID);
+
+        for (int lpc = 0; stages[lpc] != NULL; lpc++) {
+            if (safe_str_eq(id, stages[lpc])) {
+                total += strtod(crm_element_value(stage, "wall-ms"), NULL);
+                break;
+            }
+        }
+    }
+    return total;
+}
+
+static void
+replay_one(const char *filename)
+{
+    static const char *unpack_stages[] = { "stage0", NULL };
+    static const char *allocate_stages[] = {
+        "stage2", "stage3", "stage4", "stage5", "stage6", "stage7", NULL
+    };
+    static const char *graph_stages[] = { "stage8", NULL };
+    static const char *total_stages[] = { "total", NULL };
+
+    pe_working_set_t data_set;
+    xmlNode *cib_object = read_profile_input(filename);
+    xmlNode *profile = NULL;
+    xmlNode *total = NULL;
+    struct rusage usage;
+    int synapses = 0;
+
+    if (cib_object == NULL) {
+        printf("replay\t%s\terror\n", filename);
+        return;
+    }
+
+    set_working_set_defaults(&data_set);
+    data_set.input = cib_object;
+    get_date(&data_set, FALSE);
+    do_calculations(&data_set, cib_object, NULL);
+
+    for (xmlNode *synapse = __xml_first_child_element(data_set.graph);
+         synapse != NULL; synapse = __xml_next_element(synapse)) {
+        synapses++;
+    }
+
+    profile = sched_profile_xml(NULL);
+    for (total = __xml_first_child(profile); total != NULL;
+         total = __xml_next_element(total)) {
+        if (safe_str_eq(crm_element_value(total, XML_ATTR_ID), "total")) {
+            break;
+        }
+    }
+
+    if (getrusage(RUSAGE_SELF, &usage) < 0) {
+        usage.ru_maxrss = 0;
+    }
+
+    printf("replay\t%s\t%.3f\t%.3f\t%.3f\t%.3f\t%d\t%d\t%s\t%ld\n",
+           filename, stage_ms(profile, unpack_stages),
+           stage_ms(profile, allocate_stages),
+           stage_ms(profile, graph_stages), stage_ms(profile, total_stages),
+           g_list_length(data_set.actions), synapses,
+           (total? crm_str(crm_element_value(total, "heap-bytes")) : "0"),
+           (long) usage.ru_maxrss);
+    fflush(stdout);
+
+    free_xml(profile);
+    cleanup_alloc_calculations(&data_set);
+}
+
+/*!
+ * \internal
+ * \brief Calculate every input of a saved series, in order
+ *
+ * \param[in] dir  Directory containing series
+ *
+ * \return Exit status
+ * \note Each input is reported as "replay", its file name, the wall clock time
+ *       in milliseconds taken to unpack it, allocate resources, create the
+ *       transition graph and do the whole calculation, the number of actions,
+ *       the number of synapses in the graph, the change in heap size over the
+ *       calculation in bytes, and the peak resident set size of the process
+ *       so far in kilobytes, separated by tabs.
+ */
+static int
+replay_series(const char *dir)
+{
+    struct dirent **namelist = NULL;
+    GListPtr inputs = NULL;
+    int file_num = scandir(dir, &namelist, 0, alphasort);
+
+    if (file_num < 0) {
+        fprintf(stderr, "Could not read %s: %s\n", dir, pcmk_strerror(errno));
+        return CRM_EX_NOINPUT;
+    }
+
+    for (int lpc = 0; lpc < file_num; lpc++) {
+        int sequence = replay_sequence(namelist[lpc]->d_name);
+
+        if (sequence >= 0) {
+            struct replay_input_s *input = calloc(1, sizeof(struct replay_input_s));
+
+            CRM_ASSERT(input != NULL);
+            input->sequence = sequence;
+            input->filename = crm_strdup_printf("%s/%s", dir,
+                                                namelist[lpc]->d_name);
+            inputs = g_list_prepend(inputs, input);
+        }
+        free(namelist[lpc]);
+    }
+    free(namelist);
+
+    if (inputs == NULL) {
+        fprintf(stderr, "No " REPLAY_SERIES " files found in %s\n", dir);
+        return CRM_EX_NOINPUT;
+    }
+
+    replay_next_sequence = get_last_sequence(dir, REPLAY_SERIES);
+    inputs = g_list_sort(inputs, sort_replay_input);
+
+    // Suppress everything but the report
+    quiet = TRUE;
+    printf("#replay\tinput\tunpack-ms\tallocate-ms\tgraph-ms\ttotal-ms"
+           "\tactions\tsynapses\theap-bytes\tmax-rss-kb\n");
+    for (GListPtr iter = inputs; iter != NULL; iter = iter->next) {
+        replay_one(((struct replay_input_s *) iter->data)->filename);
+    }
+
+    g_list_free_full(inputs, free_replay_input);
+    return CRM_EX_OK;
+}
+
 static int
 count_resources(pe_working_set_t * data_set, resource_t * rsc)
 {
@@ -612,6 +1618,12 @@ main(int argc, char **argv)
     const char *quorum = NULL;
     const char *watchdog = NULL;
     const char *test_dir = NULL;
+    const char *profile_json_file = NULL;
+    const char *profile_baseline_file = NULL;
+    int benchmark_runs = 0;
+    const char *batch_file = NULL;
+    const char *replay_dir = NULL;
+    int batch_jobs = 0;
     const char *dot_file = NULL;
     const char *graph_file = NULL;
     const char *input_file = NULL;
@@ -762,9 +1774,47 @@ main(int argc, char **argv)
             case 'O':
                 output_file = optarg;
                 break;
+            case 'n':
+                profile_repeat = crm_parse_int(optarg, "0");
+                if (profile_repeat < 1) {
+                    fprintf(stderr, "--repeat must be a positive number\n");
+                    ++argerr;
+                }
+                break;
+            case 'W':
+                profile_warmup = crm_parse_int(optarg, "0");
+                if (profile_warmup < 0) {
+                    fprintf(stderr, "--warmup must not be negative\n");
+                    ++argerr;
+                }
+                break;
+            case 'o':
+                profile_json_file = optarg;
+                break;
+            case 'c':
+                profile_baseline_file = optarg;
+                break;
             case 'P':
                 test_dir = optarg;
                 break;
+            case 'N':
+                benchmark_runs = crm_parse_int(optarg, "0");
+                if (benchmark_runs < 1) {
+                    ++argerr;
+                }
+                break;
+            case 'B':
+                batch_file = optarg;
+                break;
+            case 'Y':
+                replay_dir = optarg;
+                break;
+            case 'J':
+                batch_jobs = crm_parse_int(optarg, "0");
+                if (batch_jobs < 1) {
+                    ++argerr;
+                }
+                break;
             default:
                 ++argerr;
                 break;
@@ -780,7 +1830,40 @@ main(int argc, char **argv)
     }
 
     if (test_dir != NULL) {
-        return profile_all(test_dir);
+        if (profile_baseline_file != NULL) {
+            rc = read_profile_baseline(profile_baseline_file);
+            if (rc != CRM_EX_OK) {
+                return rc;
+            }
+        }
+        if (profile_json_file != NULL) {
+            profile_json = fopen(profile_json_file, "w");
+            if (profile_json == NULL) {
+                fprintf(stderr, "Could not create %s: %s\n",
+                        profile_json_file, strerror(errno));
+                return CRM_EX_CANTCREAT;
+            }
+        }
+        rc = profile_all(test_dir);
+        if (profile_json != NULL) {
+            fclose(profile_json);
+        }
+        if (profile_baseline != NULL) {
+            g_hash_table_destroy(profile_baseline);
+        }
+        return rc;
+    }
+
+    if (replay_dir != NULL) {
+        return replay_series(replay_dir);
+    }
+
+    if (benchmark_runs > 0) {
+        if ((xml_file == NULL) || safe_str_eq(xml_file, "-")) {
+            fprintf(stderr, "--benchmark requires --xml-file\n");
+            return CRM_EX_USAGE;
+        }
+        return benchmark_one(xml_file, benchmark_runs);
     }
 
     setup_input(xml_file, store ? xml_file : output_file);
@@ -808,13 +1891,21 @@ main(int argc, char **argv)
     }
 
     data_set.input = input;
-    get_date(&data_set);
+    get_date(&data_set, TRUE);
     if(xml_file) {
         set_bit(data_set.flags, pe_flag_sanitized);
     }
     set_bit(data_set.flags, pe_flag_stdout);
     cluster_status(&data_set);
 
+    if (batch_file != NULL) {
+        if (batch_jobs < 1) {
+            batch_jobs = QB_MAX(crm_procfs_num_cores(), 1);
+        }
+        rc = run_batch(&data_set, batch_file, batch_jobs);
+        goto done;
+    }
+
     if (quiet == FALSE) {
         int options = print_pending ? pe_print_pending : 0;
 
@@ -846,7 +1937,7 @@ main(int argc, char **argv)
 
         cleanup_calculations(&data_set);
         data_set.input = input;
-        get_date(&data_set);
+        get_date(&data_set, TRUE);
 
         if(xml_file) {
             set_bit(data_set.flags, pe_flag_sanitized);
@@ -909,7 +2000,7 @@ main(int argc, char **argv)
             rc = pcmk_err_generic;
         }
         if(quiet == FALSE) {
-            get_date(&data_set);
+            get_date(&data_set, TRUE);
 
             quiet_log("\nRevised cluster status:\n");
             set_bit(data_set.flags, pe_flag_stdout);
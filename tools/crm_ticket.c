@@ -717,6 +717,8 @@ main(int argc, char **argv)
     data_set.input = cib_xml_copy;
     data_set.now = crm_time_new(NULL);
 
+    // Tickets don't depend on where resources are active
+    set_bit(data_set.flags, pe_flag_no_history);
     cluster_status(&data_set);
 
     /* For recording the tickets that are referenced in rsc_ticket constraints
@@ -0,0 +1,429 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <crm/crm.h>
+#include <crm/common/internal.h>
+
+/* *INDENT-OFF* */
+static struct crm_option long_options[] = {
+    /* Top-level Options */
+    {"help",       0, 0, '?', "\tThis text"},
+    {"version",    0, 0, '$', "\tVersion information"  },
+    {"verbose",    0, 0, 'V', "\tIncrease debug output"},
+
+    {"summary",    0, 0, 's', "\tShow counts of each type of event, and how long"
+     "\n\t\t\tCIB operations took, rather than each event"},
+    {"recovery",   0, 0, 'r', "\tShow the steps taken to recover from each failed"
+     "\n\t\t\tresource operation, and the time between them"},
+
+    {"-spacer-",   1, 0, '-', "\nExamples:", pcmk_option_paragraph},
+    {"-spacer-",   1, 0, '-', "Show the trace events a daemon wrote when sent SIGTRAP:", pcmk_option_paragraph},
+    {"-spacer-",   1, 0, '-', " crm_trace_decode " CRM_BLACKBOX_DIR "/pacemaker-controld-1234.trace", pcmk_option_example},
+    {"-spacer-",   1, 0, '-', "Show where the time went in recoveries, using the trace events of all daemons on the DC and the node with the failure:", pcmk_option_paragraph},
+    {"-spacer-",   1, 0, '-', " crm_trace_decode --recovery node1/*.trace node2/*.trace", pcmk_option_example},
+
+    {0, 0, 0, 0}
+};
+/* *INDENT-ON* */
+
+struct type_summary_s {
+    unsigned long long count;
+    unsigned long long total_us;    // for begin/end pairs
+    long long max_us;
+};
+
+// A recovery hop, with what is needed to compare it with other daemons' hops
+struct recovery_hop_s {
+    int64_t realtime_us;
+    uint32_t pid;
+    char system[32];
+    int hop;
+    int64_t value;
+};
+
+enum decode_mode {
+    decode_events,
+    decode_summary,
+    decode_recovery,
+};
+
+struct decode_state_s {
+    pcmk__trace_header_t header;
+    bool have_header;
+    uint32_t last_seq;
+    unsigned long long lost;
+    struct type_summary_s types[PCMK__TRACE_TYPE_MAX + 1];
+    GHashTable *cib_begins;         // call ID -> timestamp
+    GHashTable *spans;              // span ID -> GList of recovery_hop_s
+};
+
+static int64_t
+realtime_of(const struct decode_state_s *state, int64_t timestamp_us)
+{
+    return state->header.realtime_us
+           + (timestamp_us - state->header.monotonic_us);
+}
+
+static void
+print_realtime(int64_t realtime_us)
+{
+    time_t seconds = (time_t) (realtime_us / G_USEC_PER_SEC);
+    struct tm tm;
+    char buffer[64];
+
+    localtime_r(&seconds, &tm);
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("%s.%06lld", buffer,
+           (long long) (realtime_us % G_USEC_PER_SEC));
+}
+
+static void
+print_time(const struct decode_state_s *state, int64_t timestamp_us)
+{
+    print_realtime(realtime_of(state, timestamp_us));
+}
+
+static void
+print_event(const struct decode_state_s *state,
+            const pcmk__trace_event_t *event)
+{
+    print_time(state, event->timestamp_us);
+    printf(" %s[%lu] %s", state->header.system,
+           (unsigned long) state->header.pid,
+           pcmk__trace_type_str(event->type));
+
+    switch (event->type) {
+        case pcmk__trace_ipc_send:
+        case pcmk__trace_ipc_recv:
+            printf(" bytes=%lld request=%lld peer=%s",
+                   (long long) event->value1, (long long) event->value2,
+                   event->tag);
+            break;
+        case pcmk__trace_cib_op_begin:
+            printf(" call=%lld options=%#llx op=%s",
+                   (long long) event->value1,
+                   (unsigned long long) event->value2, event->tag);
+            break;
+        case pcmk__trace_cib_op_end:
+            printf(" call=%lld rc=%lld op=%s",
+                   (long long) event->value1, (long long) event->value2,
+                   event->tag);
+            break;
+        case pcmk__trace_fsa_input:
+            printf(" input=%lld cause=%lld origin=%s",
+                   (long long) event->value1, (long long) event->value2,
+                   event->tag);
+            break;
+        case pcmk__trace_action_dispatch:
+            printf(" action=%lld transition=%lld key=%s",
+                   (long long) event->value1, (long long) event->value2,
+                   event->tag);
+            break;
+        case pcmk__trace_recovery_hop:
+            printf(" hop=%s value=%lld span=%s",
+                   pcmk__trace_hop_str(event->value1),
+                   (long long) event->value2, event->tag);
+            break;
+        default:
+            printf(" value1=%lld value2=%lld tag=%s",
+                   (long long) event->value1, (long long) event->value2,
+                   event->tag);
+            break;
+    }
+    printf("\n");
+}
+
+static void
+summarize_event(struct decode_state_s *state, const pcmk__trace_event_t *event)
+{
+    struct type_summary_s *summary = NULL;
+    gpointer key = GINT_TO_POINTER((gint) event->value1);
+    gpointer begin = NULL;
+
+    if ((event->type < pcmk__trace_ipc_send)
+        || (event->type > PCMK__TRACE_TYPE_MAX)) {
+        return;
+    }
+    summary = &(state->types[event->type]);
+    summary->count++;
+
+    if (event->type == pcmk__trace_cib_op_begin) {
+        int64_t *timestamp = malloc(sizeof(int64_t));
+
+        CRM_ASSERT(timestamp != NULL);
+        *timestamp = event->timestamp_us;
+        g_hash_table_replace(state->cib_begins, key, timestamp);
+
+    } else if ((event->type == pcmk__trace_cib_op_end)
+               && g_hash_table_lookup_extended(state->cib_begins, key, NULL,
+                                               &begin)) {
+        long long duration = event->timestamp_us - *(int64_t *) begin;
+
+        summary->total_us += duration;
+        if (duration > summary->max_us) {
+            summary->max_us = duration;
+        }
+        g_hash_table_remove(state->cib_begins, key);
+    }
+}
+
+static void
+print_summary(const struct decode_state_s *state)
+{
+    for (int type = pcmk__trace_ipc_send; type <= PCMK__TRACE_TYPE_MAX;
+         type++) {
+        const struct type_summary_s *summary = &(state->types[type]);
+
+        printf("%-16s %12llu", pcmk__trace_type_str(type), summary->count);
+        if ((type == pcmk__trace_cib_op_end) && (summary->count > 0)) {
+            printf("  average=%lluus max=%lldus",
+                   summary->total_us / summary->count, summary->max_us);
+        }
+        printf("\n");
+    }
+    if (state->lost > 0) {
+        printf("%-16s %12llu\n", "lost", state->lost);
+    }
+}
+
+static void
+collect_hop(struct decode_state_s *state, const pcmk__trace_event_t *event)
+{
+    struct recovery_hop_s *hop = NULL;
+    gpointer key = NULL;
+    gpointer hops = NULL;
+
+    if (event->type != pcmk__trace_recovery_hop) {
+        return;
+    }
+    hop = calloc(1, sizeof(struct recovery_hop_s));
+    CRM_ASSERT(hop != NULL);
+    hop->realtime_us = realtime_of(state, event->timestamp_us);
+    hop->pid = state->header.pid;
+    memcpy(hop->system, state->header.system, sizeof(hop->system));
+    hop->hop = (int) event->value1;
+    hop->value = event->value2;
+
+    if (g_hash_table_lookup_extended(state->spans, event->tag, &key, &hops)) {
+        g_hash_table_steal(state->spans, key);
+    } else {
+        key = strdup(event->tag);
+    }
+    g_hash_table_insert(state->spans, key, g_list_prepend(hops, hop));
+}
+
+static gint
+sort_hops(gconstpointer a, gconstpointer b)
+{
+    const struct recovery_hop_s *hop_a = a;
+    const struct recovery_hop_s *hop_b = b;
+
+    if (hop_a->realtime_us != hop_b->realtime_us) {
+        return (hop_a->realtime_us < hop_b->realtime_us)? -1 : 1;
+    }
+    return hop_a->hop - hop_b->hop;
+}
+
+static void
+print_recovery(const char *span, GList *hops)
+{
+    const struct recovery_hop_s *first = hops->data;
+    const struct recovery_hop_s *previous = first;
+
+    printf("\nRecovery after failure of %s:\n", span);
+    for (GList *iter = hops; iter != NULL; iter = iter->next) {
+        const struct recovery_hop_s *hop = iter->data;
+
+        printf("  ");
+        print_realtime(hop->realtime_us);
+        printf(" %+9.3fs (%+8.3fs)  %-20s %-24s %lld\n",
+               (hop->realtime_us - first->realtime_us) / 1000000.0,
+               (hop->realtime_us - previous->realtime_us) / 1000000.0,
+               pcmk__trace_hop_str(hop->hop), hop->system,
+               (long long) hop->value);
+        previous = hop;
+    }
+}
+
+/*!
+ * \internal
+ * \brief Show each recovery recorded for a span ID
+ *
+ * A recurring operation keeps its call ID, so the same span ID is used by each
+ * of its failures. A new recovery is taken to begin with any failure hop
+ * recorded after the previous recovery's transition completed.
+ */
+static void
+print_span(gpointer key, gpointer value, gpointer user_data)
+{
+    GList *hops = g_list_sort(g_list_copy(value), sort_hops);
+    GList *start = hops;
+    bool complete = FALSE;
+
+    for (GList *iter = hops; iter != NULL; iter = iter->next) {
+        const struct recovery_hop_s *hop = iter->data;
+
+        if (complete && (hop->hop <= pcmk__hop_result_received)) {
+            // Split the list before this hop, and show what came before
+            iter->prev->next = NULL;
+            iter->prev = NULL;
+            if (g_list_length(start) > 1) {
+                print_recovery(key, start);
+            }
+            g_list_free(start);
+            start = iter;
+            complete = FALSE;
+        }
+        if (hop->hop == pcmk__hop_transition_complete) {
+            complete = TRUE;
+        }
+    }
+
+    // A lone hop is usually just a result that was not a failure after all
+    if ((start != NULL) && (g_list_length(start) > 1)) {
+        print_recovery(key, start);
+    }
+    g_list_free(start);
+}
+
+static void
+free_hops(gpointer data)
+{
+    g_list_free_full(data, free);
+}
+
+static int
+decode_file(const char *filename, struct decode_state_s *state,
+            enum decode_mode mode)
+{
+    FILE *fp = fopen(filename, "r");
+    pcmk__trace_event_t event;
+
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", filename, strerror(errno));
+        return CRM_EX_NOINPUT;
+    }
+
+    /* Headers and events are the same size, so a file can be read one record
+     * at a time even if several recordings were appended to it
+     */
+    while (fread(&event, sizeof(event), 1, fp) == 1) {
+        if (memcmp(&event, PCMK__TRACE_MAGIC, strlen(PCMK__TRACE_MAGIC)) == 0) {
+            memcpy(&(state->header), &event, sizeof(state->header));
+            if (state->header.record_size != sizeof(pcmk__trace_event_t)) {
+                fprintf(stderr, "%s: Unsupported trace record size %lu\n",
+                        filename, (unsigned long) state->header.record_size);
+                fclose(fp);
+                return CRM_EX_DATAERR;
+            }
+            state->header.system[sizeof(state->header.system) - 1] = '\0';
+            state->have_header = TRUE;
+            state->last_seq = 0;
+            continue;
+        }
+        if (!state->have_header) {
+            fprintf(stderr, "%s: Not a trace event file\n", filename);
+            fclose(fp);
+            return CRM_EX_DATAERR;
+        }
+
+        event.tag[PCMK__TRACE_TAG_LEN - 1] = '\0';
+        if ((state->last_seq != 0) && (event.seq > state->last_seq + 1)) {
+            state->lost += event.seq - state->last_seq - 1;
+            if (mode == decode_events) {
+                printf("... %lu events lost ...\n",
+                       (unsigned long) (event.seq - state->last_seq - 1));
+            }
+        }
+        state->last_seq = event.seq;
+
+        switch (mode) {
+            case decode_events:
+                print_event(state, &event);
+                break;
+            case decode_summary:
+                summarize_event(state, &event);
+                break;
+            case decode_recovery:
+                collect_hop(state, &event);
+                break;
+        }
+    }
+    fclose(fp);
+    return CRM_EX_OK;
+}
+
+int
+main(int argc, char **argv)
+{
+    int flag = 0;
+    int option_index = 0;
+    int rc = CRM_EX_OK;
+    enum decode_mode mode = decode_events;
+    struct decode_state_s state;
+
+    crm_log_cli_init("crm_trace_decode");
+    crm_set_options(NULL, "[options] <trace file> [...]", long_options,
+                    "Tool for displaying the trace events recorded by Pacemaker daemons"
+                    " (see PCMK_trace_events)");
+
+    while (flag >= 0) {
+        flag = crm_get_option(argc, argv, &option_index);
+        switch (flag) {
+            case -1:
+                break;
+            case 'V':
+                crm_bump_log_level(argc, argv);
+                break;
+            case '$':
+            case '?':
+                crm_help(flag, CRM_EX_OK);
+                break;
+            case 's':
+                mode = decode_summary;
+                break;
+            case 'r':
+                mode = decode_recovery;
+                break;
+            default:
+                crm_help(flag, CRM_EX_USAGE);
+                break;
+        }
+    }
+
+    if (optind >= argc) {
+        crm_help('?', CRM_EX_USAGE);
+    }
+
+    memset(&state, 0, sizeof(state));
+    state.cib_begins = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                             NULL, free);
+    state.spans = g_hash_table_new_full(crm_str_hash, g_str_equal, free,
+                                        free_hops);
+
+    for (int lpc = optind; (lpc < argc) && (rc == CRM_EX_OK); lpc++) {
+        state.have_header = FALSE;
+        rc = decode_file(argv[lpc], &state, mode);
+    }
+    if (mode == decode_summary) {
+        print_summary(&state);
+    } else if (mode == decode_recovery) {
+        g_hash_table_foreach(state.spans, print_span, NULL);
+    }
+
+    g_hash_table_destroy(state.cib_begins);
+    g_hash_table_destroy(state.spans);
+    return rc;
+}
@@ -28,6 +28,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
+#include <time.h>
 #include <glib.h>
 
 #include <crm/common/xml.h>
@@ -35,6 +36,7 @@
 #include <crm/msg_xml.h>
 #include <crm/cib.h>
 #include <crm/pengine/status.h>
+#include <crm/pengine/internal.h>
 
 gboolean USE_LIVE_CIB = FALSE;
 char *cib_save = NULL;
@@ -57,17 +59,117 @@ static struct crm_option long_options[] = {
 
     {"-spacer-",    1, 0, '-', "\nAdditional Options:"},
     {"save-xml",    1, 0, 'S', "Save the verified XML to the named file.  Most useful with -L"},
+    {"fast",        0, 0, 'F', "\tCheck only the configuration (not the status), with schema validation and the other checks done in parallel, and report how long each took"},
 
     {"-spacer-",    1, 0, '-', "\nExamples:", pcmk_option_paragraph},
     {"-spacer-",    1, 0, '-', "Check the consistency of the configuration in the running cluster:", pcmk_option_paragraph},
     {"-spacer-",    1, 0, '-', " crm_verify --live-check", pcmk_option_example},
     {"-spacer-",    1, 0, '-', "Check the consistency of the configuration in a given file and produce verbose output:", pcmk_option_paragraph},
     {"-spacer-",    1, 0, '-', " crm_verify --xml-file file.xml --verbose", pcmk_option_example},
+    {"-spacer-",    1, 0, '-', "Quickly check only the configuration in the running cluster:", pcmk_option_paragraph},
+    {"-spacer-",    1, 0, '-', " crm_verify --live-check --fast", pcmk_option_example},
   
     {0, 0, 0, 0}
 };
 /* *INDENT-ON* */
 
+struct validation_job_s {
+    xmlNode *xml;
+    gboolean valid;
+    double ms;
+};
+
+static double
+elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0
+           + (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static gpointer
+validate_job(gpointer user_data)
+{
+    struct validation_job_s *job = user_data;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    job->valid = validate_xml(job->xml, NULL, FALSE);
+    job->ms = elapsed_ms(&start);
+    return NULL;
+}
+
+/*!
+ * \internal
+ * \brief Check a configuration without simulating the cluster's response
+ *
+ * Schema validation is done in a separate thread, while this one unpacks the
+ * configuration, which checks the resources, constraints and so on, and the
+ * objects they refer to. The status section is ignored, so nothing is
+ * unpacked for it, and no actions are created.
+ *
+ * \param[in] cib_object  CIB to check (this will be freed)
+ */
+static void
+verify_fast(xmlNode *cib_object)
+{
+    pe_working_set_t data_set;
+    struct validation_job_s job = { NULL, FALSE, 0.0 };
+    struct timespec start;
+    struct timespec check_start;
+    double check_ms = 0.0;
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    GThread *thread = NULL;
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* Upgrading an old configuration validates it against each schema along
+     * the way, so do that (which is rarely needed) before validating the
+     * result in parallel
+     */
+    if (cli_config_update(&cib_object, NULL, FALSE) == FALSE) {
+        crm_config_error = TRUE;
+        free_xml(cib_object);
+        fprintf(stderr, "The cluster will NOT be able to use this configuration.\n");
+        fprintf(stderr, "Please manually update the configuration to conform to the %s syntax.\n",
+                xml_latest_schema());
+        return;
+    }
+
+    job.xml = copy_xml(cib_object);
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    thread = g_thread_new("validate", validate_job, &job);
+#else
+    validate_job(&job);
+#endif
+
+    free_xml(get_object_root(XML_CIB_TAG_STATUS, cib_object));
+    create_xml_node(cib_object, XML_CIB_TAG_STATUS);
+
+    clock_gettime(CLOCK_MONOTONIC, &check_start);
+    set_working_set_defaults(&data_set);
+    data_set.now = crm_time_new(NULL);
+    data_set.input = cib_object;
+    stage0(&data_set);
+    cleanup_alloc_calculations(&data_set);
+    check_ms = elapsed_ms(&check_start);
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    g_thread_join(thread);
+#endif
+    free_xml(job.xml);
+    if (job.valid == FALSE) {
+        crm_config_err("CIB did not pass schema validation");
+    }
+
+    printf("Schema validation:    %10.3fms\n", job.ms);
+    printf("Configuration checks: %10.3fms\n", check_ms);
+    printf("Total:                %10.3fms\n", elapsed_ms(&start));
+}
+
 int
 main(int argc, char **argv)
 {
@@ -82,6 +184,7 @@ main(int argc, char **argv)
     int rc = pcmk_ok;
 
     bool verbose = FALSE;
+    gboolean fast = FALSE;
     gboolean xml_stdin = FALSE;
     const char *xml_tag = NULL;
     const char *xml_file = NULL;
@@ -116,6 +219,9 @@ main(int argc, char **argv)
             case 'S':
                 cib_save = optarg;
                 break;
+            case 'F':
+                fast = TRUE;
+                break;
             case 'V':
                 verbose = TRUE;
                 crm_bump_log_level(argc, argv);
@@ -177,7 +283,7 @@ main(int argc, char **argv)
         }
 
     } else if (xml_file != NULL) {
-        cib_object = filename2xml(xml_file);
+        cib_object = pe__read_input(xml_file);
         if (cib_object == NULL) {
             fprintf(stderr, "Couldn't parse input file: %s\n", xml_file);
             rc = -ENODATA;
@@ -223,7 +329,11 @@ main(int argc, char **argv)
         create_xml_node(cib_object, XML_CIB_TAG_STATUS);
     }
 
-    if (validate_xml(cib_object, NULL, FALSE) == FALSE) {
+    if (fast) {
+        verify_fast(cib_object);
+        cib_object = NULL;
+
+    } else if (validate_xml(cib_object, NULL, FALSE) == FALSE) {
         crm_config_err("CIB did not pass schema validation");
         free_xml(cib_object);
         cib_object = NULL;
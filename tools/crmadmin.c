@@ -51,6 +51,8 @@ gboolean DO_WHOIS_DC = FALSE;
 gboolean DO_NODE_LIST = FALSE;
 gboolean BE_SILENT = FALSE;
 gboolean DO_RESOURCE_LIST = FALSE;
+gboolean DO_STATS = FALSE;
+gboolean DO_METRICS = FALSE;
 const char *crmd_operation = NULL;
 char *dest_node = NULL;
 crm_exit_t exit_code = CRM_EX_OK;
@@ -71,6 +73,10 @@ static struct crm_option long_options[] = {
     {"dc_lookup", 0, 0, 'D', "Display the uname of the node co-ordinating the cluster."},
     {"-spacer-",  1, 0, '-', "\n\tThis is an internal detail and is rarely useful to administrators except when deciding on which node to examine the logs.\n"},
     {"nodes",     0, 0, 'N', "\tDisplay the uname of all member nodes"},
+    {"stats",     1, 0, 'T', "Display main loop dispatch, FSA input and memory statistics of the controller on the specified node"},
+    {"-spacer-",  1, 0, '-', "\n\tFor each callback: the number of dispatches, the total and longest time taken (in ms), and the total and longest time spent waiting to be dispatched (in ms)\n"},
+    {"metrics",   1, 0, 'M', "Display the metrics of the controller on the specified node, in OpenMetrics text format"},
+    {"-spacer-",  1, 0, '-', "\n\tOther daemons serve their metrics on Unix sockets if PCMK_metrics_dir is set\n"},
     {"election",  0, 0, 'E', "(Advanced) Start an election for the cluster co-ordinator"},
     {
         "kill",      1, 0, 'K',
@@ -145,6 +151,16 @@ main(int argc, char **argv)
                 crm_trace("Option %c => %s", flag, optarg);
                 dest_node = strdup(optarg);
                 break;
+            case 'T':
+                DO_STATS = TRUE;
+                crm_trace("Option %c => %s", flag, optarg);
+                dest_node = strdup(optarg);
+                break;
+            case 'M':
+                DO_METRICS = TRUE;
+                crm_trace("Option %c => %s", flag, optarg);
+                dest_node = strdup(optarg);
+                break;
             case 'E':
                 DO_ELECT_DC = TRUE;
                 break;
@@ -231,6 +247,14 @@ do_work(void)
             all_is_good = FALSE;
         }
 
+    } else if (DO_STATS) {
+        sys_to = CRM_SYSTEM_CRMD;
+        crmd_operation = CRM_OP_MAINLOOP_STATS;
+
+    } else if (DO_METRICS) {
+        sys_to = CRM_SYSTEM_CRMD;
+        crmd_operation = CRM_OP_METRICS;
+
     } else if (DO_ELECT_DC) {
         /* tell the local node to initiate an election */
 
@@ -376,6 +400,108 @@ validate_crm_message(xmlNode * msg, const char *sys, const char *uuid, const cha
     return TRUE;
 }
 
+static long long
+stats_value(xmlNode *source, const char *field)
+{
+    const char *value = crm_element_value(source, field);
+
+    return value? crm_int_helper(value, NULL) : 0;
+}
+
+static gint
+sort_stats(gconstpointer a, gconstpointer b)
+{
+    long long a_total = stats_value((xmlNode *) a, "total_us");
+    long long b_total = stats_value((xmlNode *) b, "total_us");
+
+    return (a_total < b_total)? 1 : ((a_total > b_total)? -1 : 0);
+}
+
+static void
+print_fsa_stats(xmlNode *fsa)
+{
+    printf("\nFSA inputs (queue length %lld, at most %lld):\n",
+           stats_value(fsa, "queue_len"), stats_value(fsa, "max_queue_len"));
+    printf("%-22s %8s %12s %10s %12s %10s  %s\n", "Input", "Count",
+           "Total wait", "Max wait", "Processing", "Max proc",
+           "Waits <1ms/<10ms/<100ms/<1s/<10s/more");
+
+    for (xmlNode *input = first_named_child(fsa, "input"); input != NULL;
+         input = crm_next_same_xml(input)) {
+
+        printf("%-22s %8lld %12.3f %10.3f %12.3f %10.3f  "
+               "%lld/%lld/%lld/%lld/%lld/%lld\n",
+               crm_element_value(input, XML_ATTR_ID),
+               stats_value(input, "count"),
+               stats_value(input, "wait_us") / 1000.0,
+               stats_value(input, "max_wait_us") / 1000.0,
+               stats_value(input, "process_us") / 1000.0,
+               stats_value(input, "max_process_us") / 1000.0,
+               stats_value(input, "wait_lt_1ms"),
+               stats_value(input, "wait_lt_10ms"),
+               stats_value(input, "wait_lt_100ms"),
+               stats_value(input, "wait_lt_1s"),
+               stats_value(input, "wait_lt_10s"),
+               stats_value(input, "wait_ge_10s"));
+    }
+}
+
+static void
+print_stats(xmlNode *reply)
+{
+    xmlNode *data = get_message_xml(reply, F_CRM_DATA);
+    xmlNode *fsa = first_named_child(data, "fsa-stats");
+    xmlNode *memory = first_named_child(data, "memory");
+    xmlNode *history = first_named_child(data, "history-stats");
+    GList *sources = NULL;
+
+    for (xmlNode *source = first_named_child(data, "source"); source != NULL;
+         source = crm_next_same_xml(source)) {
+        sources = g_list_prepend(sources, source);
+    }
+    sources = g_list_sort(sources, sort_stats);
+
+    printf("Main loop statistics of %s@%s:\n",
+           crm_element_value(data, XML_PING_ATTR_SYSFROM),
+           crm_element_value(reply, F_CRM_HOST_FROM));
+    printf("%-32s %10s %12s %10s %12s %10s\n", "Source", "Dispatches",
+           "Total", "Max", "Total wait", "Max wait");
+
+    for (GList *iter = sources; iter != NULL; iter = iter->next) {
+        xmlNode *source = iter->data;
+
+        printf("%-32s %10lld %12.3f %10.3f %12.3f %10.3f\n",
+               crm_element_value(source, XML_ATTR_ID),
+               stats_value(source, "count"),
+               stats_value(source, "total_us") / 1000.0,
+               stats_value(source, "max_us") / 1000.0,
+               stats_value(source, "wait_us") / 1000.0,
+               stats_value(source, "max_wait_us") / 1000.0);
+    }
+    g_list_free(sources);
+
+    if (fsa != NULL) {
+        print_fsa_stats(fsa);
+    }
+    if (memory != NULL) {
+        printf("\nMemory: %lld KB resident, %lld bytes of heap in use\n",
+               stats_value(memory, "rss_kb"),
+               stats_value(memory, "heap_bytes"));
+    }
+    if (history != NULL) {
+        printf("Resource history: %lld resources on %lld nodes, "
+               "%lld strings (%lld bytes, %lld uses), "
+               "%lld parameter tables (%lld uses)\n",
+               stats_value(history, "resources"),
+               stats_value(history, "nodes"),
+               stats_value(history, "strings"),
+               stats_value(history, "string_bytes"),
+               stats_value(history, "string_refs"),
+               stats_value(history, "param_tables"),
+               stats_value(history, "param_table_refs"));
+    }
+}
+
 int
 admin_msg_callback(const char *buffer, ssize_t length, gpointer userdata)
 {
@@ -406,6 +532,15 @@ admin_msg_callback(const char *buffer, ssize_t length, gpointer userdata)
             fprintf(stderr, "%s\n", state);
         }
 
+    } else if (DO_STATS) {
+        print_stats(xml);
+
+    } else if (DO_METRICS) {
+        xmlNode *data = get_message_xml(xml, F_CRM_DATA);
+        const char *text = crm_element_value(data, "text");
+
+        printf("%s", (text? text : ""));
+
     } else if (DO_WHOIS_DC) {
         const char *dc = crm_element_value(xml, F_CRM_HOST_FROM);
 
@@ -0,0 +1,621 @@
+/*
+ * Copyright 2018 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This source code is licensed under the GNU General Public License version 2
+ * or later (GPLv2+) WITHOUT ANY WARRANTY.
+ */
+
+#include <crm_internal.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <crm/crm.h>
+#include <crm/cib.h>
+#include <crm/cib/internal.h>
+#include <crm/msg_xml.h>
+#include <crm/common/ipc.h>
+#include <crm/common/ipcs.h>
+#include <crm/common/mainloop.h>
+#include <crm/common/xml.h>
+
+/*
+ * Library microbenchmarks
+ *
+ * Times the library calls that dominate the daemons' CPU use: IPC round trips,
+ * XML parsing and serialization, patchsets, digests, schema validation and
+ * CIB operations. Each prints one tab-separated line per variant with the
+ * minimum, mean and maximum milliseconds and a size in bytes, as cibgen
+ * --serialize does, so the output of two builds can be compared directly.
+ *
+ * The XML benchmarks run against a real CIB (for example, one saved by
+ * "cibadmin -Q" or generated by cibgen).
+ */
+
+enum microbench_e {
+    bench_ipc       = 0x01,
+    bench_xml       = 0x02,
+    bench_patchset  = 0x04,
+    bench_digest    = 0x08,
+    bench_validate  = 0x10,
+    bench_cib_ops   = 0x20,
+};
+
+static struct microbench_options_s {
+    int runs;
+    unsigned int benchmarks;
+    const char *xml_file;
+    const char *ipc_buffers;    // comma-separated IPC buffer sizes
+} options = { 20, 0, NULL, "0" };
+
+/* *INDENT-OFF* */
+static struct crm_option long_options[] = {
+    /* Top-level Options */
+    {"help",    0, 0, '?', "\tThis text"},
+    {"version", 0, 0, '$', "\tVersion information"  },
+    {"verbose", 0, 0, 'V', "\tIncrease debug output"},
+
+    {"-spacer-",     0, 0, '-', "\nInput:"},
+    {"xml-file",     1, 0, 'x', "CIB to use for the XML and CIB benchmarks"},
+    {"runs",         1, 0, 'r', "\tNumber of times to time each call (default 20)"},
+
+    {"-spacer-",     0, 0, '-', "\nBenchmarks (all by default, or those given):"},
+    {"ipc",          0, 0, 'i', "\tIPC request round trips for a range of message sizes"},
+    {"ipc-buffers",  1, 0, 'b', "Comma-separated IPC buffer sizes to use, above which messages are"},
+    {"-spacer-",     0, 0, '-', "\t\t\tcompressed, or 0 for the default (default 0)"},
+    {"xml",          0, 0, 'X', "\tParsing and serializing the CIB"},
+    {"patchset",     0, 0, 'p', "Creating and applying a patchset for a status update"},
+    {"digest",       0, 0, 'd', "\tCalculating the CIB digest"},
+    {"validate",     0, 0, 'v', "Validating the CIB against its schema"},
+    {"cib-ops",      0, 0, 'c', "\tPerforming each type of CIB operation"},
+
+    {"-spacer-",    0, 0, '-', "\nExamples:\n"},
+    {"-spacer-",    0, 0, '-', "Time everything against a synthetic CIB of 5000 resources on 64 nodes", pcmk_option_paragraph},
+    {"-spacer-",    0, 0, '-', " cibgen --nodes 64 --primitives 5000 -o /tmp/big.xml", pcmk_option_example},
+    {"-spacer-",    0, 0, '-', " microbench -x /tmp/big.xml", pcmk_option_example},
+    {"-spacer-",    0, 0, '-', "Time IPC round trips with the default and a 1MiB compression threshold", pcmk_option_paragraph},
+    {"-spacer-",    0, 0, '-', " microbench --ipc --ipc-buffers 0,1048576", pcmk_option_example},
+
+    {0, 0, 0, 0}
+};
+/* *INDENT-ON* */
+
+struct timing_s {
+    double min;
+    double max;
+    double total;
+    int runs;
+};
+
+static double
+now_ms(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+#else
+    return time(NULL) * 1000.0;
+#endif
+}
+
+static void
+add_timing(struct timing_s *timing, double start)
+{
+    double elapsed = now_ms() - start;
+
+    if ((timing->runs == 0) || (elapsed < timing->min)) {
+        timing->min = elapsed;
+    }
+    if (elapsed > timing->max) {
+        timing->max = elapsed;
+    }
+    timing->total += elapsed;
+    timing->runs++;
+}
+
+static void
+print_timing(const char *benchmark, const char *variant,
+             const struct timing_s *timing, size_t bytes)
+{
+    printf("%s\t%s\t%.3f\t%.3f\t%.3f\t%lu\n", benchmark, variant, timing->min,
+           (timing->runs? (timing->total / timing->runs) : 0.0), timing->max,
+           (unsigned long) bytes);
+    fflush(stdout);
+}
+
+/*
+ * IPC
+ */
+
+static int32_t
+echo_accept(qb_ipcs_connection_t *c, uid_t uid, gid_t gid)
+{
+    return (crm_client_new(c, uid, gid) == NULL)? -EIO : 0;
+}
+
+static int32_t
+echo_dispatch(qb_ipcs_connection_t *qbc, void *data, size_t size)
+{
+    uint32_t id = 0;
+    uint32_t flags = 0;
+    crm_client_t *c = crm_client_get(qbc);
+    xmlNode *msg = crm_ipcs_recv(c, data, size, &id, &flags);
+
+    // Parse the request as a daemon would, but answer with only an ack
+    crm_ipcs_send_ack(c, id, flags, "ack", __FUNCTION__, __LINE__);
+    free_xml(msg);
+    return 0;
+}
+
+static int32_t
+echo_closed(qb_ipcs_connection_t *c)
+{
+    crm_client_t *client = crm_client_get(c);
+
+    if (client != NULL) {
+        crm_client_destroy(client);
+    }
+    return 0;
+}
+
+static void
+echo_destroy(qb_ipcs_connection_t *c)
+{
+    echo_closed(c);
+}
+
+static struct qb_ipcs_service_handlers echo_callbacks = {
+    .connection_accept = echo_accept,
+    .connection_created = NULL,
+    .msg_process = echo_dispatch,
+    .connection_closed = echo_closed,
+    .connection_destroyed = echo_destroy
+};
+
+static pid_t
+start_echo_server(const char *name)
+{
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+
+        crm_client_init();
+        if (mainloop_add_ipc_server(name, QB_IPC_NATIVE,
+                                    &echo_callbacks) == NULL) {
+            _exit(CRM_EX_OSERR);
+        }
+        g_main_loop_run(loop);
+        _exit(CRM_EX_OK);
+    }
+    return pid;
+}
+
+/* Build a message of about the given size out of name/value pairs, which
+ * compresses about as well as real CIB content
+ */
+static xmlNode *
+ipc_payload(size_t size)
+{
+    xmlNode *msg = create_xml_node(NULL, "microbench");
+    size_t bytes = 0;
+
+    for (int i = 0; bytes < size; i++) {
+        xmlNode *nvpair = create_xml_node(msg, XML_CIB_TAG_NVPAIR);
+        char *value = crm_strdup_printf("value-%d-%d", i, i * 7919);
+
+        crm_xml_set_id(nvpair, "microbench-nvpair-%d", i);
+        crm_xml_add(nvpair, XML_NVPAIR_ATTR_NAME, value + 6);
+        crm_xml_add(nvpair, XML_NVPAIR_ATTR_VALUE, value);
+        bytes += 64 + strlen(value);
+        free(value);
+    }
+    return msg;
+}
+
+static void
+benchmark_ipc(void)
+{
+    static const size_t sizes[] = {
+        1024, 16 * 1024, 128 * 1024, 1024 * 1024, 8 * 1024 * 1024
+    };
+    char *name = crm_strdup_printf("microbench-%lld", (long long) getpid());
+    pid_t server = start_echo_server(name);
+    char **buffers = g_strsplit(options.ipc_buffers, ",", 0);
+
+    if (server < 0) {
+        crm_perror(LOG_ERR, "Could not start IPC server");
+        free(name);
+        g_strfreev(buffers);
+        return;
+    }
+
+    for (char **buffer = buffers; *buffer != NULL; buffer++) {
+        size_t buf_size = (size_t) crm_int_helper(*buffer, NULL);
+        crm_ipc_t *ipc = crm_ipc_new(name, buf_size);
+        bool connected = FALSE;
+
+        // Give the server a few seconds to start listening
+        for (int attempt = 0; (attempt < 50) && !connected; attempt++) {
+            connected = crm_ipc_connect(ipc);
+            if (!connected) {
+                usleep(100000);
+            }
+        }
+        if (!connected) {
+            fprintf(stderr, "Could not connect to IPC server %s\n", name);
+            crm_ipc_destroy(ipc);
+            break;
+        }
+
+        for (size_t s = 0; s < DIMOF(sizes); s++) {
+            struct timing_s timing = { 0, };
+            xmlNode *msg = ipc_payload(sizes[s]);
+            char *text = dump_xml_unformatted(msg);
+            char *variant = crm_strdup_printf("%lu bytes, buffer %s",
+                                              (unsigned long) strlen(text),
+                                              ((buf_size > 0)? *buffer
+                                                             : "default"));
+
+            for (int run = 0; run < options.runs; run++) {
+                xmlNode *reply = NULL;
+                double start = now_ms();
+
+                if (crm_ipc_send(ipc, msg, crm_ipc_client_response, 5000,
+                                 &reply) < 0) {
+                    fprintf(stderr, "IPC round trip failed\n");
+                }
+                add_timing(&timing, start);
+                free_xml(reply);
+            }
+            print_timing("ipc-round-trip", variant, &timing, strlen(text));
+            free(variant);
+            free(text);
+            free_xml(msg);
+        }
+        crm_ipc_close(ipc);
+        crm_ipc_destroy(ipc);
+    }
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    g_strfreev(buffers);
+    free(name);
+}
+
+/*
+ * XML
+ */
+
+static void
+benchmark_xml(xmlNode *cib)
+{
+    struct timing_s parse = { 0, };
+    struct timing_s dump = { 0, };
+    char *text = dump_xml_unformatted(cib);
+
+    for (int run = 0; run < options.runs; run++) {
+        double start = now_ms();
+        xmlNode *xml = string2xml(text);
+
+        add_timing(&parse, start);
+
+        start = now_ms();
+        free(dump_xml_unformatted(xml));
+        add_timing(&dump, start);
+        free_xml(xml);
+    }
+    print_timing("string2xml", "cib", &parse, strlen(text));
+    print_timing("dump_xml_unformatted", "cib", &dump, strlen(text));
+    free(text);
+}
+
+// Change a CIB copy the way a typical status update would
+static void
+apply_status_update(xmlNode *cib, int run)
+{
+    xmlNode *status = first_named_child(cib, XML_CIB_TAG_STATUS);
+    xmlNode *node_state = first_named_child(status, XML_CIB_TAG_STATE);
+    char *origin = crm_strdup_printf("microbench-%d", run);
+
+    if (node_state == NULL) {
+        node_state = create_xml_node(status, XML_CIB_TAG_STATE);
+        crm_xml_add(node_state, XML_ATTR_ID, "microbench");
+    }
+    crm_xml_add(node_state, XML_ATTR_ORIGIN, origin);
+    free(origin);
+}
+
+static void
+benchmark_patchset(xmlNode *cib)
+{
+    struct timing_s create = { 0, };
+    struct timing_s apply = { 0, };
+    size_t bytes = 0;
+
+    for (int run = 0; run < options.runs; run++) {
+        xmlNode *target = copy_xml(cib);
+        xmlNode *patched = copy_xml(cib);
+        xmlNode *patchset = NULL;
+        double start = 0.0;
+
+        xml_track_changes(target, NULL, NULL, FALSE);
+        apply_status_update(target, run);
+
+        start = now_ms();
+        patchset = xml_create_patchset(2, cib, target, NULL, TRUE);
+        add_timing(&create, start);
+
+        if (patchset != NULL) {
+            char *text = dump_xml_unformatted(patchset);
+
+            bytes = strlen(text);
+            free(text);
+
+            start = now_ms();
+            if (xml_apply_patchset(patched, patchset, TRUE) != pcmk_ok) {
+                fprintf(stderr, "Could not apply patchset\n");
+            }
+            add_timing(&apply, start);
+        }
+        free_xml(patchset);
+        free_xml(patched);
+        free_xml(target);
+    }
+    print_timing("xml_create_patchset", "status update", &create, bytes);
+    print_timing("xml_apply_patchset", "status update", &apply, bytes);
+}
+
+static void
+benchmark_digest(xmlNode *cib)
+{
+    struct timing_s timing = { 0, };
+    char *text = dump_xml_unformatted(cib);
+
+    for (int run = 0; run < options.runs; run++) {
+        double start = now_ms();
+
+        free(calculate_xml_versioned_digest(cib, FALSE, FALSE,
+                                            CRM_FEATURE_SET));
+        add_timing(&timing, start);
+    }
+    print_timing("calculate_xml_digest_v2", "cib", &timing, strlen(text));
+    free(text);
+}
+
+static void
+benchmark_validate(xmlNode *cib)
+{
+    struct timing_s timing = { 0, };
+    const char *schema = crm_element_value(cib, XML_ATTR_VALIDATION);
+
+    for (int run = 0; run < options.runs; run++) {
+        double start = now_ms();
+
+        if (!validate_xml(cib, NULL, FALSE) && (run == 0)) {
+            fprintf(stderr, "CIB does not validate against %s\n",
+                    crm_str(schema));
+        }
+        add_timing(&timing, start);
+    }
+    print_timing("validate_xml", crm_str(schema), &timing, 0);
+}
+
+/*
+ * CIB operations
+ */
+
+struct cib_op_bench_s {
+    const char *op;
+    cib_op_t fn;
+    gboolean query;
+    const char *section;
+};
+
+static xmlNode *
+cib_op_input(const char *op, xmlNode *cib)
+{
+    xmlNode *input = NULL;
+
+    if (safe_str_eq(op, CIB_OP_MODIFY)) {
+        xmlNode *node_state = first_named_child(first_named_child(cib, XML_CIB_TAG_STATUS),
+                                                XML_CIB_TAG_STATE);
+
+        input = create_xml_node(NULL, XML_CIB_TAG_STATE);
+        crm_xml_add(input, XML_ATTR_ID,
+                    ((node_state != NULL)? ID(node_state) : "microbench"));
+        crm_xml_add(input, XML_ATTR_ORIGIN, "microbench");
+
+    } else if (safe_str_eq(op, CIB_OP_CREATE)) {
+        input = create_xml_node(NULL, XML_CIB_TAG_RESOURCE);
+        crm_xml_add(input, XML_ATTR_ID, "microbench-rsc");
+        crm_xml_add(input, XML_AGENT_ATTR_CLASS, PCMK_RESOURCE_CLASS_OCF);
+        crm_xml_add(input, XML_AGENT_ATTR_PROVIDER, "pacemaker");
+        crm_xml_add(input, XML_ATTR_TYPE, "Dummy");
+
+    } else if (safe_str_eq(op, CIB_OP_DELETE)) {
+        xmlNode *constraints = get_object_root(XML_CIB_TAG_CONSTRAINTS, cib);
+        xmlNode *constraint = __xml_first_child_element(constraints);
+
+        if (constraint != NULL) {
+            input = create_xml_node(NULL, crm_element_name(constraint));
+            crm_xml_add(input, XML_ATTR_ID, ID(constraint));
+        }
+
+    } else if (safe_str_eq(op, CIB_OP_REPLACE)) {
+        input = copy_xml(get_object_root(XML_CIB_TAG_CRMCONFIG, cib));
+    }
+    return input;
+}
+
+static void
+benchmark_cib_ops(xmlNode *cib)
+{
+    struct cib_op_bench_s ops[] = {
+        { CIB_OP_QUERY, cib_process_query, TRUE, NULL },
+        { CIB_OP_MODIFY, cib_process_modify, FALSE, XML_CIB_TAG_STATUS },
+        { CIB_OP_CREATE, cib_process_create, FALSE, XML_CIB_TAG_RESOURCES },
+        { CIB_OP_DELETE, cib_process_delete, FALSE, XML_CIB_TAG_CONSTRAINTS },
+        { CIB_OP_REPLACE, cib_process_replace, FALSE, XML_CIB_TAG_CRMCONFIG },
+        { CIB_OP_BUMP, cib_process_bump, FALSE, NULL },
+    };
+
+    for (size_t lpc = 0; lpc < DIMOF(ops); lpc++) {
+        struct timing_s timing = { 0, };
+        xmlNode *input = cib_op_input(ops[lpc].op, cib);
+        int rc = pcmk_ok;
+
+        if (!ops[lpc].query && (ops[lpc].fn != cib_process_bump)
+            && (input == NULL)) {
+            continue; // Nothing suitable in this CIB
+        }
+
+        for (int run = 0; run < options.runs; run++) {
+            xmlNode *request = cib_create_op(run, "microbench", ops[lpc].op,
+                                             NULL, ops[lpc].section, input,
+                                             cib_none, NULL);
+            xmlNode *result_cib = NULL;
+            xmlNode *diff = NULL;
+            xmlNode *output = NULL;
+            gboolean changed = FALSE;
+            double start = now_ms();
+
+            rc = cib_perform_op(ops[lpc].op, cib_none, &(ops[lpc].fn),
+                                ops[lpc].query, ops[lpc].section, request,
+                                input, TRUE, &changed, cib, &result_cib, &diff,
+                                &output);
+            add_timing(&timing, start);
+
+            if ((output != NULL) && (output != cib) && (output != result_cib)) {
+                free_xml(output);
+            }
+            if (result_cib != cib) {
+                free_xml(result_cib);
+            }
+            free_xml(diff);
+            free_xml(request);
+        }
+        if (rc != pcmk_ok) {
+            fprintf(stderr, "CIB %s failed: %s\n", ops[lpc].op,
+                    pcmk_strerror(rc));
+        }
+        print_timing("cib_perform_op", ops[lpc].op, &timing, 0);
+        free_xml(input);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int flag = 0;
+    int index = 0;
+    int argerr = 0;
+    xmlNode *cib = NULL;
+
+    crm_log_cli_init("microbench");
+    crm_set_options(NULL, "[options]", long_options,
+                    "Time the library calls the cluster daemons depend on most");
+
+    while (1) {
+        flag = crm_get_option(argc, argv, &index);
+        if (flag == -1)
+            break;
+
+        switch (flag) {
+            case 'V':
+                crm_bump_log_level(argc, argv);
+                break;
+            case '?':
+            case '$':
+                crm_help(flag, CRM_EX_OK);
+                break;
+            case 'x':
+                options.xml_file = optarg;
+                break;
+            case 'r':
+                options.runs = crm_parse_int(optarg, NULL);
+                if (options.runs < 1) {
+                    ++argerr;
+                }
+                break;
+            case 'i':
+                options.benchmarks |= bench_ipc;
+                break;
+            case 'b':
+                options.ipc_buffers = optarg;
+                break;
+            case 'X':
+                options.benchmarks |= bench_xml;
+                break;
+            case 'p':
+                options.benchmarks |= bench_patchset;
+                break;
+            case 'd':
+                options.benchmarks |= bench_digest;
+                break;
+            case 'v':
+                options.benchmarks |= bench_validate;
+                break;
+            case 'c':
+                options.benchmarks |= bench_cib_ops;
+                break;
+            default:
+                ++argerr;
+                break;
+        }
+    }
+
+    if (optind < argc) {
+        ++argerr;
+    }
+    if (argerr) {
+        crm_help('?', CRM_EX_USAGE);
+    }
+
+    if (options.benchmarks == 0) {
+        options.benchmarks = bench_ipc | bench_xml | bench_patchset
+                             | bench_digest | bench_validate | bench_cib_ops;
+    }
+
+    if (is_set(options.benchmarks, bench_ipc)) {
+        benchmark_ipc();
+    }
+
+    if (options.benchmarks & ~bench_ipc) {
+        if (options.xml_file == NULL) {
+            fprintf(stderr, "The XML and CIB benchmarks need --xml-file\n");
+            crm_exit(CRM_EX_USAGE);
+        }
+        cib = filename2xml(options.xml_file);
+        if (cib == NULL) {
+            fprintf(stderr, "Could not parse %s\n", options.xml_file);
+            crm_exit(CRM_EX_DATAERR);
+        }
+    }
+
+    if (is_set(options.benchmarks, bench_xml)) {
+        benchmark_xml(cib);
+    }
+    if (is_set(options.benchmarks, bench_patchset)) {
+        benchmark_patchset(cib);
+    }
+    if (is_set(options.benchmarks, bench_digest)) {
+        benchmark_digest(cib);
+    }
+    if (is_set(options.benchmarks, bench_validate)) {
+        benchmark_validate(cib);
+    }
+    if (is_set(options.benchmarks, bench_cib_ops)) {
+        benchmark_cib_ops(cib);
+    }
+
+    free_xml(cib);
+    crm_exit(CRM_EX_OK);
+}